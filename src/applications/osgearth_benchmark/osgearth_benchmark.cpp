@@ -0,0 +1,369 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2016 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgViewer/Viewer>
+#include <osgGA/AnimationPathManipulator>
+#include <osgDB/DatabasePager>
+#include <osgDB/FileNameUtils>
+#include <osgEarth/Notify>
+#include <osgEarth/Config>
+#include <osgEarth/Memory>
+#include <osgEarth/Metrics>
+#include <osgEarth/StringUtils>
+#include <osgEarthUtil/EarthManipulator>
+#include <osgEarthUtil/ExampleResources>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+
+#define LC "[benchmark] "
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+// Measurements compared against a baseline. Lower is better for all of them.
+static const char* s_comparedKeys[] = {
+    "frame_ms_p50", "frame_ms_p90", "frame_ms_p99",
+    "cull_ms_p50",  "cull_ms_p99",
+    "draw_ms_p50",  "draw_ms_p99",
+    "gpu_ms_p50",   "gpu_ms_p99",
+    "initial_load_ms", "settle_ms", "http_latency_ms",
+    "memory_peak_mb",
+    0L
+};
+
+int
+usage(const char* name)
+{
+    OE_NOTICE
+        << "\nUsage: " << name << " file.earth --path camera.path [options]\n"
+        << "\nPlays back a recorded camera path and reports frame timings, tile loading\n"
+        << "and memory use. Record a path in osgearth_viewer with the 'z' key.\n"
+        << "\n    --frames [n]             : number of frames to measure (default: one pass of the path)"
+        << "\n    --settle-timeout [s]     : max seconds to wait for tiles to finish loading (default: 60)"
+        << "\n    --out [file.json]        : write the results to a file instead of the console"
+        << "\n    --baseline [file.json]   : compare against earlier results and fail on regressions"
+        << "\n    --tolerance [t]          : allowed slowdown vs. the baseline, as a fraction (default: 0.1)"
+        << "\n" << std::endl
+        << MapNodeHelper().usage() << std::endl;
+
+    return 0;
+}
+
+namespace
+{
+    double percentile(std::vector<double>& values, double p)
+    {
+        if (values.empty())
+            return 0.0;
+        std::sort(values.begin(), values.end());
+        unsigned i = (unsigned)(p * (double)(values.size()-1) + 0.5);
+        return values[osg::minimum(i, (unsigned)values.size()-1)];
+    }
+
+    void addPercentiles(Config& conf, const std::string& name, std::vector<double>& values)
+    {
+        conf.set(name + "_p50", percentile(values, 0.50));
+        conf.set(name + "_p90", percentile(values, 0.90));
+        conf.set(name + "_p99", percentile(values, 0.99));
+        conf.set(name + "_max", percentile(values, 1.0));
+    }
+
+    // Whether the pager and the terrain engine have nothing left to load.
+    bool isIdle(osgViewer::Viewer& viewer)
+    {
+        static MetricValue* s_requests = Metrics::getValue("loader.requests");
+        static MetricValue* s_mergeQueue = Metrics::getValue("loader.merge_queue");
+
+        return
+            !viewer.getDatabasePager()->getRequestsInProgress() &&
+            s_requests->get() == 0u &&
+            s_mergeQueue->get() == 0u;
+    }
+
+    // Runs frames until everything is loaded and returns the time it took (ms),
+    // or a negative number on timeout.
+    double settle(osgViewer::Viewer& viewer, double timeout_s)
+    {
+        osg::Timer_t start = osg::Timer::instance()->tick();
+
+        // give the pager a few frames to pick up new requests.
+        for (unsigned i = 0; i < 10 && !viewer.done(); ++i)
+            viewer.frame();
+
+        while (!viewer.done() && !isIdle(viewer))
+        {
+            if (osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick()) > timeout_s)
+                return -1.0;
+            viewer.frame();
+        }
+        return osg::Timer::instance()->delta_m(start, osg::Timer::instance()->tick());
+    }
+
+    bool readStat(osg::Stats* stats, unsigned frame, const std::string& name, std::vector<double>& output)
+    {
+        double value = 0.0;
+        if (stats && stats->getAttribute(frame, name, value))
+        {
+            output.push_back(value * 1000.0);
+            return true;
+        }
+        return false;
+    }
+
+    // Compares results to a baseline, prints a table, and returns the number of regressions.
+    unsigned compare(const Config& results, const Config& baseline, double tolerance)
+    {
+        unsigned regressions = 0u;
+
+        std::cout
+            << std::left << std::setw(18) << "metric"
+            << std::right << std::setw(12) << "baseline"
+            << std::setw(12) << "current"
+            << std::setw(10) << "change" << std::endl;
+
+        for (unsigned i = 0; s_comparedKeys[i] != 0L; ++i)
+        {
+            std::string key(s_comparedKeys[i]);
+            if (!results.hasValue(key) || !baseline.hasValue(key))
+                continue;
+
+            double before = baseline.value<double>(key, 0.0);
+            double after = results.value<double>(key, 0.0);
+
+            // negative values mean a timeout; treat as a regression.
+            bool failed =
+                (after < 0.0 && before >= 0.0) ||
+                (before > 0.0 && after > before * (1.0 + tolerance));
+
+            double change = before > 0.0 ? (after - before) / before : 0.0;
+
+            std::cout
+                << std::left << std::setw(18) << key
+                << std::right << std::fixed << std::setprecision(2)
+                << std::setw(12) << before
+                << std::setw(12) << after
+                << std::setw(9) << (change * 100.0) << "%"
+                << (failed ? "  REGRESSION" : "") << std::endl;
+
+            if (failed)
+                ++regressions;
+        }
+
+        return regressions;
+    }
+}
+
+
+int
+main(int argc, char** argv)
+{
+    osg::ArgumentParser arguments(&argc,argv);
+
+    if ( arguments.read("--help") )
+        return usage(argv[0]);
+
+    // remember the earth file for the report; the loader consumes it.
+    std::string earthFile;
+    for (int i = 1; i < arguments.argc() && earthFile.empty(); ++i)
+    {
+        if (osgDB::getLowerCaseFileExtension(arguments[i]) == "earth")
+            earthFile = arguments[i];
+    }
+
+    unsigned frames = 0u;
+    arguments.read("--frames", frames);
+
+    double settleTimeout = 60.0;
+    arguments.read("--settle-timeout", settleTimeout);
+
+    std::string outFile;
+    arguments.read("--out", outFile);
+
+    std::string baselineFile;
+    arguments.read("--baseline", baselineFile);
+
+    double tolerance = 0.1;
+    arguments.read("--tolerance", tolerance);
+
+    std::string pathFile;
+    arguments.read("--path", pathFile);
+
+    osgViewer::Viewer viewer(arguments);
+    viewer.getDatabasePager()->setUnrefImageDataAfterApplyPolicy( true, false );
+    viewer.setRunFrameScheme(osgViewer::ViewerBase::CONTINUOUS);
+
+    osgDB::Registry::instance()->getObjectWrapperManager()->findWrapper("osg::Image");
+
+    viewer.getCamera()->setSmallFeatureCullingPixelSize(-1.0f);
+    viewer.getCamera()->setNearFarRatio(0.0001);
+
+    // the camera path drives the run; without one we just sit at the home viewpoint.
+    osg::ref_ptr<osgGA::AnimationPathManipulator> pathManip;
+    if (!pathFile.empty())
+    {
+        pathManip = new osgGA::AnimationPathManipulator(pathFile);
+        if (!pathManip->valid())
+        {
+            OE_WARN << LC << "Failed to load camera path " << pathFile << std::endl;
+            return 1;
+        }
+        viewer.setCameraManipulator(pathManip.get());
+    }
+    else
+    {
+        viewer.setCameraManipulator(new EarthManipulator(arguments));
+        if (frames == 0u)
+            frames = 1000u;
+    }
+
+    osg::Node* node = MapNodeHelper().load(arguments, &viewer);
+    if ( !node )
+        return usage(argv[0]);
+
+    viewer.setSceneData( node );
+    viewer.realize();
+
+    viewer.getViewerStats()->collectStats("frame_rate", true);
+    viewer.getCamera()->getStats()->collectStats("rendering", true);
+    viewer.getCamera()->getStats()->collectStats("gpu", true);
+
+    // Load the starting view completely, so the measured frames all start from
+    // the same state.
+    double initialLoad = settle(viewer, settleTimeout);
+    if (initialLoad < 0.0)
+    {
+        OE_WARN << LC << "Timed out loading the starting view" << std::endl;
+    }
+
+    double period = 0.0;
+    if (pathManip.valid())
+    {
+        pathManip->home(viewer.getFrameStamp()->getReferenceTime());
+        period = pathManip->getAnimationPath()->getPeriod();
+    }
+
+    static MetricValue* s_httpLatency = Metrics::getValue("http.latency_ms");
+    static MetricValue* s_httpRequests = Metrics::getValue("http.requests");
+    unsigned httpRequestsStart = s_httpRequests->get();
+    double httpLatencySum = 0.0;
+    unsigned httpLatencySamples = 0u;
+    unsigned lastHttpRequests = httpRequestsStart;
+
+    std::vector<double> frameTimes, cullTimes, drawTimes, gpuTimes;
+
+    osg::Timer_t runStart = osg::Timer::instance()->tick();
+    osg::Timer_t last = runStart;
+
+    for (unsigned f = 0u; !viewer.done(); ++f)
+    {
+        if (frames > 0u && f >= frames)
+            break;
+        if (frames == 0u && osg::Timer::instance()->delta_s(runStart, last) >= period)
+            break;
+
+        viewer.frame();
+
+        osg::Timer_t now = osg::Timer::instance()->tick();
+        frameTimes.push_back(osg::Timer::instance()->delta_m(last, now));
+        last = now;
+
+        osg::Stats* stats = viewer.getCamera()->getStats();
+        unsigned fn = stats->getLatestFrameNumber();
+        readStat(stats, fn, "Cull traversal time taken", cullTimes);
+        readStat(stats, fn, "Draw traversal time taken", drawTimes);
+        if (fn > 0)
+            readStat(stats, fn-1, "GPU draw time taken", gpuTimes);
+
+        // sample the latency of the most recent request whenever new ones finished.
+        unsigned httpRequests = s_httpRequests->get();
+        if (httpRequests != lastHttpRequests)
+        {
+            httpLatencySum += (double)s_httpLatency->get();
+            ++httpLatencySamples;
+            lastHttpRequests = httpRequests;
+        }
+    }
+
+    unsigned measuredFrames = frameTimes.size();
+    double runTime = osg::Timer::instance()->delta_s(runStart, last);
+
+    // How long the terrain takes to catch up with where the camera ended.
+    double settleTime = settle(viewer, settleTimeout);
+
+    Config results("benchmark");
+    results.set("earth_file", earthFile);
+    results.set("path", pathFile);
+    results.set("frames", measuredFrames);
+    results.set("fps", runTime > 0.0 ? (double)measuredFrames / runTime : 0.0);
+    addPercentiles(results, "frame_ms", frameTimes);
+    addPercentiles(results, "cull_ms", cullTimes);
+    addPercentiles(results, "draw_ms", drawTimes);
+    addPercentiles(results, "gpu_ms", gpuTimes);
+    results.set("initial_load_ms", initialLoad);
+    results.set("settle_ms", settleTime);
+    results.set("http_requests", s_httpRequests->get() - httpRequestsStart);
+    results.set("http_latency_ms", httpLatencySamples > 0u ? httpLatencySum / (double)httpLatencySamples : 0.0);
+    results.set("memory_mb", (double)Memory::getProcessPhysicalUsage() / 1048576.0);
+    results.set("memory_peak_mb", (double)Memory::getProcessPeakPrivateUsage() / 1048576.0);
+
+    if (!outFile.empty())
+    {
+        std::ofstream out(outFile.c_str());
+        out << results.toJSON(true) << std::endl;
+        OE_NOTICE << LC << "Wrote results to " << outFile << std::endl;
+    }
+    else
+    {
+        std::cout << results.toJSON(true) << std::endl;
+    }
+
+    if (!baselineFile.empty())
+    {
+        std::ifstream in(baselineFile.c_str());
+        if (!in.is_open())
+        {
+            OE_WARN << LC << "Failed to open baseline " << baselineFile << std::endl;
+            return 1;
+        }
+        std::stringstream buf;
+        buf << in.rdbuf();
+
+        Config baseline;
+        if (!baseline.fromJSON(buf.str()))
+        {
+            OE_WARN << LC << "Failed to parse baseline " << baselineFile << std::endl;
+            return 1;
+        }
+
+        unsigned regressions = compare(results, baseline, tolerance);
+        if (regressions > 0u)
+        {
+            OE_WARN << LC << regressions << " measurements regressed by more than "
+                << (tolerance*100.0) << "%" << std::endl;
+            return 2;
+        }
+    }
+
+    return 0;
+}
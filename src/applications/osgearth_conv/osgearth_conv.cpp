@@ -30,9 +30,13 @@
 #include <osgEarth/ElevationLayer>
 #include <osg/ArgumentParser>
 #include <osg/Timer>
+#include <OpenThreads/Thread>
+#include <OpenThreads/Condition>
 #include <iomanip>
 #include <algorithm>
 #include <iterator>
+#include <deque>
+#include <map>
 
 using namespace osgEarth;
 
@@ -50,6 +54,9 @@ int usage(char** argv)
         << "\n    --max-level [int]                   : maximum level of detail"
         << "\n    --osg-options [OSG options string]  : options to pass to OSG readers/writers"
         << "\n    --extents [minLat] [minLong] [maxLat] [maxLong] : Lat/Long extends to copy"
+        << "\n    --threads [int]                     : number of reader threads; uses the pipelined converter"
+        << "\n    --writers [int]                     : number of writer threads (default = 1, which writes in order)"
+        << "\n    --queue-size [int]                  : max tiles waiting between pipeline stages (default = 8 per reader)"
         << std::endl;
 
     return 0;
@@ -117,10 +124,271 @@ struct ElevationLayerToTileSource : public TileHandler
 };
 
 
+// TileHandler that runs the copy as a pipeline: the visitor queues up keys,
+// a pool of reader threads creates the tiles (read, mosaic, reproject), and
+// writer threads store them. With one writer (the default) the tiles are
+// written in the order the visitor produced them, which keeps outputs like
+// MBTiles appending to their index in order. The output driver encodes the
+// tile in storeImage/storeHeightField, so extra writers only pay off for
+// drivers that can encode and store concurrently.
+//
+// The queues between the stages are bounded, so memory use stays flat no
+// matter how far the visitor gets ahead of the writers.
+class TilePipeline : public TileHandler
+{
+public:
+    TilePipeline(ImageLayer* imageSource, ElevationLayer* hfSource, TileSource* dest,
+                 unsigned numReaders, unsigned numWriters, unsigned queueSize) :
+        _imageSource(imageSource), _hfSource(hfSource), _dest(dest),
+        _numReaders(osg::maximum(numReaders, 1u)),
+        _numWriters(osg::maximum(numWriters, 1u)),
+        _ordered(numWriters <= 1u),
+        _queueSize(osg::maximum(queueSize, 1u)),
+        _nextSeq(0u), _nextToWrite(0u),
+        _noMoreKeys(false), _readersDone(false),
+        _numRead(0u), _numEmpty(0u), _numWritten(0u), _numFailed(0u),
+        _readTime(0.0), _writeTime(0.0)
+    {
+        for (unsigned i = 0; i < _numReaders; ++i)
+            _readers.push_back(new Worker(this, true));
+        for (unsigned i = 0; i < _numWriters; ++i)
+            _writers.push_back(new Worker(this, false));
+    }
+
+    ~TilePipeline()
+    {
+        finish();
+    }
+
+    void start()
+    {
+        _start = osg::Timer::instance()->tick();
+        for (unsigned i = 0; i < _readers.size(); ++i)
+            _readers[i]->start();
+        for (unsigned i = 0; i < _writers.size(); ++i)
+            _writers[i]->start();
+    }
+
+    // Drains the pipeline and stops the threads.
+    void finish()
+    {
+        {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+            _noMoreKeys = true;
+            _keysChanged.broadcast();
+        }
+        for (unsigned i = 0; i < _readers.size(); ++i)
+        {
+            _readers[i]->join();
+            delete _readers[i];
+        }
+        _readers.clear();
+
+        {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+            _readersDone = true;
+            _readyChanged.broadcast();
+        }
+        for (unsigned i = 0; i < _writers.size(); ++i)
+        {
+            _writers[i]->join();
+            delete _writers[i];
+        }
+        _writers.clear();
+    }
+
+public: // TileHandler
+
+    bool handleTile(const TileKey& key, const TileVisitor& tv)
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+        while (_keys.size() >= _queueSize)
+            _keysChanged.wait(&_mutex);
+
+        _keys.push_back(std::make_pair(_nextSeq++, key));
+        _keysChanged.broadcast();
+
+        // We don't know yet whether the tile has data, so keep going.
+        return true;
+    }
+
+    bool hasData(const TileKey& key) const
+    {
+        return _imageSource.valid() ?
+            _imageSource->mayHaveDataInExtent(key.getExtent()) :
+            _hfSource->mayHaveDataInExtent(key.getExtent());
+    }
+
+public: // stats
+
+    unsigned getNumWritten() const { return _numWritten; }
+
+    double getTilesPerSecond() const
+    {
+        double t = osg::Timer::instance()->delta_s(_start, osg::Timer::instance()->tick());
+        return t > 0.0 ? (double)_numWritten/t : 0.0;
+    }
+
+    void printStats(std::ostream& out) const
+    {
+        double wall = osg::Timer::instance()->delta_s(_start, osg::Timer::instance()->tick());
+        unsigned numWrites = _numWritten + _numFailed;
+
+        // How busy each stage was; the busiest one limits the throughput.
+        double readBusy  = wall > 0.0 ? 100.0*_readTime/(wall*(double)_numReaders) : 0.0;
+        double writeBusy = wall > 0.0 ? 100.0*_writeTime/(wall*(double)_numWriters) : 0.0;
+
+        out << std::fixed << std::setprecision(1)
+            << "Read " << _numRead << " tiles (" << _numEmpty << " empty), wrote "
+            << _numWritten << " (" << _numFailed << " failed) at "
+            << (wall > 0.0 ? (double)_numWritten/wall : 0.0) << " tiles/s\n"
+            << "Average read = " << (_numRead > 0 ? 1000.0*_readTime/(double)_numRead : 0.0) << " ms ("
+            << _numReaders << " readers, " << readBusy << "% busy), "
+            << "average write = " << (numWrites > 0 ? 1000.0*_writeTime/(double)numWrites : 0.0) << " ms ("
+            << _numWriters << " writers, " << writeBusy << "% busy)"
+            << std::endl;
+    }
+
+protected:
+
+    struct Tile
+    {
+        TileKey        _key;
+        GeoImage       _image;
+        GeoHeightField _hf;
+    };
+
+    struct Worker : public OpenThreads::Thread
+    {
+        Worker(TilePipeline* pipeline, bool reader) : _pipeline(pipeline), _reader(reader) { }
+        void run()
+        {
+            if (_reader) _pipeline->readLoop();
+            else         _pipeline->writeLoop();
+        }
+        TilePipeline* _pipeline;
+        bool          _reader;
+    };
+
+    void readLoop()
+    {
+        while (true)
+        {
+            unsigned seq;
+            Tile tile;
+            {
+                OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+                while (_keys.empty() && !_noMoreKeys)
+                    _keysChanged.wait(&_mutex);
+                if (_keys.empty())
+                    return;
+
+                seq = _keys.front().first;
+                tile._key = _keys.front().second;
+                _keys.pop_front();
+                _keysChanged.broadcast();
+            }
+
+            osg::Timer_t t0 = osg::Timer::instance()->tick();
+            if (_imageSource.valid())
+                tile._image = _imageSource->createImage(tile._key);
+            else
+                tile._hf = _hfSource->createHeightField(tile._key, 0L);
+            double t = osg::Timer::instance()->delta_s(t0, osg::Timer::instance()->tick());
+
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+
+            // In order, the oldest tile never waits, so the writer can always progress.
+            if (_ordered)
+            {
+                while (seq >= _nextToWrite + _queueSize)
+                    _readyChanged.wait(&_mutex);
+            }
+            else
+            {
+                while (_ready.size() >= _queueSize)
+                    _readyChanged.wait(&_mutex);
+            }
+
+            ++_numRead;
+            if (!tile._image.valid() && !tile._hf.valid())
+                ++_numEmpty;
+            _readTime += t;
+
+            // empty tiles go through too, so the ones behind them can be written.
+            _ready[seq] = tile;
+            _readyChanged.broadcast();
+        }
+    }
+
+    void writeLoop()
+    {
+        while (true)
+        {
+            Tile tile;
+            {
+                OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+                while (true)
+                {
+                    if (!_ready.empty() && (!_ordered || _ready.begin()->first == _nextToWrite))
+                        break;
+                    if (_readersDone && _ready.empty())
+                        return;
+                    _readyChanged.wait(&_mutex);
+                }
+
+                tile = _ready.begin()->second;
+                _ready.erase(_ready.begin());
+                ++_nextToWrite;
+                _readyChanged.broadcast();
+            }
+
+            if (!tile._image.valid() && !tile._hf.valid())
+                continue;
+
+            osg::Timer_t t0 = osg::Timer::instance()->tick();
+            bool ok = tile._image.valid() ?
+                _dest->storeImage(tile._key, tile._image.getImage(), 0L) :
+                _dest->storeHeightField(tile._key, tile._hf.getHeightField(), 0L);
+            double t = osg::Timer::instance()->delta_s(t0, osg::Timer::instance()->tick());
+
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+            if (ok) ++_numWritten; else ++_numFailed;
+            _writeTime += t;
+        }
+    }
+
+    osg::ref_ptr<ImageLayer>      _imageSource;
+    osg::ref_ptr<ElevationLayer>  _hfSource;
+    TileSource*                   _dest;
+    unsigned                      _numReaders;
+    unsigned                      _numWriters;
+    bool                          _ordered;
+    unsigned                      _queueSize;
+
+    OpenThreads::Mutex            _mutex;
+    OpenThreads::Condition        _keysChanged;
+    OpenThreads::Condition        _readyChanged;
+    std::deque<std::pair<unsigned, TileKey> > _keys;
+    std::map<unsigned, Tile>      _ready;
+    unsigned                      _nextSeq;
+    unsigned                      _nextToWrite;
+    bool                          _noMoreKeys;
+    bool                          _readersDone;
+
+    std::vector<Worker*>          _readers;
+    std::vector<Worker*>          _writers;
+
+    osg::Timer_t                  _start;
+    unsigned                      _numRead, _numEmpty, _numWritten, _numFailed;
+    double                        _readTime, _writeTime;
+};
+
+
 // Custom progress reporter
 struct ProgressReporter : public osgEarth::ProgressCallback
 {
-    ProgressReporter() : _first(true) { }
+    ProgressReporter(TilePipeline* pipeline =0L) : _first(true), _pipeline(pipeline) { }
 
     bool reportProgress(double             current,
                         double             total,
@@ -155,8 +423,17 @@ struct ProgressReporter : public osgEarth::ProgressCallback
             << (int)current << "/" << (int)total
             << " (" << (100.0f*percentage) << "%, " 
             << (int)minsTotal << "m" << (int)secsTotal << "s projected, "
-            << (int)minsToGo << "m" << (int)secsToGo << "s remaining)        "
-            << std::flush;
+            << (int)minsToGo << "m" << (int)secsToGo << "s remaining";
+
+        // the visitor only queues tiles when pipelined, so show the writes too
+        if ( _pipeline )
+        {
+            std::cout
+                << ", " << _pipeline->getNumWritten() << " written, "
+                << _pipeline->getTilesPerSecond() << " tiles/s";
+        }
+
+        std::cout << ")        " << std::flush;
 
         if ( percentage >= 100.0f )
             std::cout << std::endl;
@@ -169,6 +446,7 @@ struct ProgressReporter : public osgEarth::ProgressCallback
     Threading::Mutex _mutex;
     bool _first;
     osg::Timer_t _start;
+    TilePipeline* _pipeline;
 };
 
 
@@ -196,7 +474,9 @@ struct ProgressReporter : public osgEarth::ProgressCallback
  *      --profile [profile]   : reproject to the target profile, e.g. "wgs84"
  *      --min-level [int]     : min level of detail to copy
  *      --max-level [int]     : max level of detail to copy
- *      --threads [n]         : threads to use (may crash. Careful.)
+ *      --threads [n]         : reader threads to use; runs the pipelined converter
+ *      --writers [n]         : writer threads (default 1, which writes tiles in order)
+ *      --queue-size [n]      : max tiles queued between pipeline stages
  *
  *      --extents [minLat] [minLong] [maxLat] [maxLong] : Lat/Long extends to copy (*)
  *
@@ -320,19 +600,19 @@ main(int argc, char** argv)
         << std::endl;
 
     // create the visitor.
-    osg::ref_ptr<TileVisitor> visitor;
+    osg::ref_ptr<TileVisitor> visitor = new TileVisitor();
 
+    // multithreading uses the pipelined converter:
     unsigned numThreads = 1;
-    if (args.read("--threads", numThreads))
-    {
-        MultithreadedTileVisitor* mtv = new MultithreadedTileVisitor();
-        mtv->setNumThreads( numThreads < 1 ? 1 : numThreads );
-        visitor = mtv;
-    }
-    else
-    {
-        visitor = new TileVisitor();
-    }
+    bool pipelined = args.read("--threads", numThreads);
+
+    unsigned numWriters = 1;
+    args.read("--writers", numWriters);
+
+    unsigned queueSize = 8 * osg::maximum(numThreads, 1u);
+    args.read("--queue-size", queueSize);
+
+    osg::ref_ptr<TilePipeline> pipeline;
 
     if (heightFields)
     {
@@ -348,7 +628,10 @@ main(int argc, char** argv)
             OE_WARN << LC << "Input profile is not valid" << std::endl;
             return -1;
         }
-        visitor->setTileHandler( new ElevationLayerToTileSource(layer, output.get()) );
+        if ( pipelined )
+            pipeline = new TilePipeline(0L, layer, output.get(), numThreads, numWriters, queueSize);
+        else
+            visitor->setTileHandler( new ElevationLayerToTileSource(layer, output.get()) );
     }
 
     else // image layers
@@ -365,7 +648,10 @@ main(int argc, char** argv)
             OE_WARN << LC << "Input profile is not valid" << std::endl;
             return -1;
         }
-        visitor->setTileHandler( new ImageLayerToTileSource(layer, output.get()) );
+        if ( pipelined )
+            pipeline = new TilePipeline(layer, 0L, output.get(), numThreads, numWriters, queueSize);
+        else
+            visitor->setTileHandler( new ImageLayerToTileSource(layer, output.get()) );
     }
 
     // set the manula extents, if specified:
@@ -419,12 +705,26 @@ main(int argc, char** argv)
     // Ready!!!
     std::cout << "Working..." << std::endl;
 
-    visitor->setProgressCallback( new ProgressReporter() );
+    visitor->setProgressCallback( new ProgressReporter(pipeline.get()) );
+
+    if ( pipeline.valid() )
+    {
+        OE_NOTICE << LC << "Pipelined with " << numThreads << " readers, " << numWriters << " writers" << std::endl;
+        visitor->setTileHandler( pipeline.get() );
+        pipeline->start();
+    }
 
     osg::Timer_t t0 = osg::Timer::instance()->tick();
 
     visitor->run( outputProfile.get() );
 
+    if ( pipeline.valid() )
+    {
+        pipeline->finish();
+        std::cout << std::endl;
+        pipeline->printStats( std::cout );
+    }
+
     osg::Timer_t t1 = osg::Timer::instance()->tick();
 
     std::cout
@@ -0,0 +1,354 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2016 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgViewer/CompositeViewer>
+#include <osgDB/DatabasePager>
+#include <osgDB/FileNameUtils>
+#include <osgEarth/Notify>
+#include <osgEarth/Config>
+#include <osgEarth/MapNode>
+#include <osgEarth/Memory>
+#include <osgEarth/Metrics>
+#include <osgEarth/Random>
+#include <osgEarth/StringUtils>
+#include <osgEarth/VisibleLayer>
+#include <osgEarthUtil/EarthManipulator>
+#include <osgEarthUtil/ExampleResources>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+
+#define LC "[loadtest] "
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+int
+usage(const char* name)
+{
+    OE_NOTICE
+        << "\nUsage: " << name << " file.earth [options]\n"
+        << "\nRenders several off-screen views that fly to random places and toggle layers,\n"
+        << "and reports tile throughput, loader backlog, memory and frame times over time.\n"
+        << "\n    --views [n]              : number of simulated views (default: 2)"
+        << "\n    --size [pixels]          : width and height of each view (default: 512)"
+        << "\n    --duration [s]           : length of the run (default: 300)"
+        << "\n    --interval [s]           : length of each report interval (default: 5)"
+        << "\n    --fly-period [s]         : seconds between new destinations per view (default: 10)"
+        << "\n    --toggle-period [s]      : seconds between layer toggles, 0 for none (default: 15)"
+        << "\n    --seed [n]               : random seed, for repeatable runs (default: 0)"
+        << "\n    --out [file.json]        : write the results to a file instead of the console"
+        << "\n" << std::endl
+        << MapNodeHelper().usage() << std::endl;
+
+    return 0;
+}
+
+namespace
+{
+    double percentile(std::vector<double>& values, double p)
+    {
+        if (values.empty())
+            return 0.0;
+        std::sort(values.begin(), values.end());
+        unsigned i = (unsigned)(p * (double)(values.size()-1) + 0.5);
+        return values[osg::minimum(i, (unsigned)values.size()-1)];
+    }
+
+    void addPercentiles(Config& conf, const std::string& name, std::vector<double>& values)
+    {
+        conf.set(name + "_p50", percentile(values, 0.50));
+        conf.set(name + "_p90", percentile(values, 0.90));
+        conf.set(name + "_p99", percentile(values, 0.99));
+        conf.set(name + "_max", percentile(values, 1.0));
+    }
+
+    // A random place to look at, from orbit down to street level.
+    Viewpoint randomViewpoint(Random& prng)
+    {
+        Viewpoint vp;
+        vp.focalPoint() = GeoPoint(
+            SpatialReference::get("wgs84"),
+            -180.0 + 360.0*prng.next(),
+            -80.0 + 160.0*prng.next(),
+            0.0,
+            ALTMODE_ABSOLUTE);
+        vp.heading()->set(360.0*prng.next(), Units::DEGREES);
+        vp.pitch()->set(-89.0 + 75.0*prng.next(), Units::DEGREES);
+
+        // log-uniform, so close-ups are as common as overviews.
+        vp.range()->set(pow(10.0, 2.5 + 4.5*prng.next()), Units::METERS);
+        return vp;
+    }
+
+    // Loader work waiting to finish, across the pager and the terrain engine.
+    unsigned getBacklog(osgViewer::CompositeViewer& viewer)
+    {
+        static MetricValue* s_requests = Metrics::getValue("loader.requests");
+        static MetricValue* s_mergeQueue = Metrics::getValue("loader.merge_queue");
+
+        unsigned pager = 0u;
+        for (unsigned i = 0; i < viewer.getNumViews(); ++i)
+            pager += viewer.getView(i)->getDatabasePager()->getFileRequestListSize();
+
+        return s_requests->get() + s_mergeQueue->get() + pager;
+    }
+}
+
+
+int
+main(int argc, char** argv)
+{
+    osg::ArgumentParser arguments(&argc,argv);
+
+    if ( arguments.read("--help") )
+        return usage(argv[0]);
+
+    std::string earthFile;
+    for (int i = 1; i < arguments.argc() && earthFile.empty(); ++i)
+    {
+        if (osgDB::getLowerCaseFileExtension(arguments[i]) == "earth")
+            earthFile = arguments[i];
+    }
+
+    int numViews = 2;
+    arguments.read("--views", numViews);
+    numViews = osg::maximum(numViews, 1);
+
+    int size = 512;
+    arguments.read("--size", size);
+
+    double duration = 300.0;
+    arguments.read("--duration", duration);
+
+    double interval = 5.0;
+    arguments.read("--interval", interval);
+    interval = osg::maximum(interval, 0.1);
+
+    double flyPeriod = 10.0;
+    arguments.read("--fly-period", flyPeriod);
+
+    double togglePeriod = 15.0;
+    arguments.read("--toggle-period", togglePeriod);
+
+    unsigned seed = 0u;
+    arguments.read("--seed", seed);
+
+    std::string outFile;
+    arguments.read("--out", outFile);
+
+    osgViewer::CompositeViewer viewer(arguments);
+    viewer.setRunFrameScheme(osgViewer::ViewerBase::CONTINUOUS);
+
+    osgDB::Registry::instance()->getObjectWrapperManager()->findWrapper("osg::Image");
+
+    // Off-screen views; every one but the first shares the first one's GL
+    // objects, like windows in one application would.
+    for (int i = 0; i < numViews; ++i)
+    {
+        osg::ref_ptr<osg::GraphicsContext::Traits> traits = new osg::GraphicsContext::Traits();
+        traits->width = size;
+        traits->height = size;
+        traits->pbuffer = true;
+        traits->windowDecoration = false;
+        traits->doubleBuffer = false;
+        if (i > 0)
+            traits->sharedContext = viewer.getView(0)->getCamera()->getGraphicsContext();
+
+        osg::GraphicsContext* gc = osg::GraphicsContext::createGraphicsContext(traits.get());
+        if (!gc)
+        {
+            OE_WARN << LC << "Failed to create an off-screen graphics context" << std::endl;
+            return 1;
+        }
+
+        osgViewer::View* view = new osgViewer::View();
+        view->getCamera()->setGraphicsContext(gc);
+        view->getCamera()->setViewport(0, 0, size, size);
+        view->getCamera()->setProjectionMatrixAsPerspective(45, 1, 1, 10);
+        view->getCamera()->setDrawBuffer(GL_FRONT);
+        view->getCamera()->setReadBuffer(GL_FRONT);
+        view->getCamera()->setSmallFeatureCullingPixelSize(-1.0f);
+        view->getCamera()->setNearFarRatio(0.0001);
+        view->getCamera()->setName(Stringify() << "View " << i);
+        view->setCameraManipulator(new EarthManipulator(arguments));
+        view->getDatabasePager()->setUnrefImageDataAfterApplyPolicy( true, false );
+        MapNodeHelper().configureView(view);
+        viewer.addView(view);
+    }
+
+    osg::Node* node = MapNodeHelper().load(arguments, &viewer);
+    if ( !node )
+        return usage(argv[0]);
+
+    for (unsigned i = 0; i < viewer.getNumViews(); ++i)
+        viewer.getView(i)->setSceneData(node);
+
+    MapNode* mapNode = MapNode::get(node);
+    VisibleLayerVector layers;
+    if (mapNode)
+        mapNode->getMap()->getLayers(layers);
+
+    // remember how the layers started so the run can restore them.
+    std::vector<bool> visible;
+    for (unsigned i = 0; i < layers.size(); ++i)
+        visible.push_back(layers[i]->getVisible());
+
+    viewer.realize();
+
+    Random prng(seed);
+
+    std::vector<double> nextFlight(viewer.getNumViews(), 0.0);
+    double nextToggle = togglePeriod;
+    unsigned toggles = 0u;
+
+    static MetricValue* s_merges = Metrics::getValue("loader.merges_per_frame");
+    static MetricValue* s_httpRequests = Metrics::getValue("http.requests");
+    static MetricValue* s_httpInFlight = Metrics::getValue("http.in_flight");
+
+    Config results("loadtest");
+    results.set("earth_file", earthFile);
+    results.set("views", numViews);
+    results.set("size", size);
+    results.set("seed", seed);
+
+    std::vector<double> frameTimes, intervalFrameTimes;
+    unsigned tiles = 0u, intervalTiles = 0u;
+    unsigned httpStart = s_httpRequests->get(), intervalHttpStart = httpStart;
+    unsigned backlogStart = getBacklog(viewer);
+    unsigned backlogPeak = backlogStart;
+    double memoryPeak = 0.0;
+
+    osg::Timer_t runStart = osg::Timer::instance()->tick();
+    osg::Timer_t last = runStart;
+    double intervalStart = 0.0;
+
+    while (!viewer.done())
+    {
+        double t = osg::Timer::instance()->delta_s(runStart, last);
+        if (t >= duration)
+            break;
+
+        // each view flies somewhere new on its own schedule.
+        for (unsigned i = 0; i < viewer.getNumViews(); ++i)
+        {
+            if (t >= nextFlight[i])
+            {
+                EarthManipulator* manip = dynamic_cast<EarthManipulator*>(viewer.getView(i)->getCameraManipulator());
+                if (manip)
+                    manip->setViewpoint(randomViewpoint(prng), 0.5*flyPeriod*(0.5 + prng.next()));
+                nextFlight[i] = t + flyPeriod*(0.5 + prng.next());
+            }
+        }
+
+        if (togglePeriod > 0.0 && t >= nextToggle && !layers.empty())
+        {
+            VisibleLayer* layer = layers[prng.next(layers.size())].get();
+            layer->setVisible(!layer->getVisible());
+            ++toggles;
+            nextToggle = t + togglePeriod;
+        }
+
+        viewer.frame();
+
+        osg::Timer_t now = osg::Timer::instance()->tick();
+        double frameMs = osg::Timer::instance()->delta_m(last, now);
+        frameTimes.push_back(frameMs);
+        intervalFrameTimes.push_back(frameMs);
+        last = now;
+
+        unsigned merged = s_merges->get();
+        tiles += merged;
+        intervalTiles += merged;
+
+        unsigned backlog = getBacklog(viewer);
+        backlogPeak = osg::maximum(backlogPeak, backlog);
+
+        t = osg::Timer::instance()->delta_s(runStart, now);
+        if (t - intervalStart >= interval)
+        {
+            double span = t - intervalStart;
+            double memory = (double)Memory::getProcessPhysicalUsage() / 1048576.0;
+            memoryPeak = osg::maximum(memoryPeak, memory);
+            unsigned http = s_httpRequests->get();
+
+            Config sample("sample");
+            sample.set("t", t);
+            sample.set("frames", intervalFrameTimes.size());
+            sample.set("tiles_per_s", (double)intervalTiles / span);
+            sample.set("backlog", backlog);
+            sample.set("http_per_s", (double)(http - intervalHttpStart) / span);
+            sample.set("http_in_flight", s_httpInFlight->get());
+            sample.set("memory_mb", memory);
+            addPercentiles(sample, "frame_ms", intervalFrameTimes);
+            results.add(sample);
+
+            OE_NOTICE << LC << std::fixed << std::setprecision(1)
+                << "t=" << t << "s"
+                << " tiles/s=" << sample.value("tiles_per_s")
+                << " backlog=" << backlog
+                << " http/s=" << sample.value("http_per_s")
+                << " mem=" << memory << "MB"
+                << " frame p99=" << sample.value("frame_ms_p99") << "ms"
+                << std::endl;
+
+            intervalStart = t;
+            intervalTiles = 0u;
+            intervalHttpStart = http;
+            intervalFrameTimes.clear();
+        }
+    }
+
+    double runTime = osg::Timer::instance()->delta_s(runStart, last);
+    unsigned backlogEnd = getBacklog(viewer);
+
+    for (unsigned i = 0; i < layers.size(); ++i)
+        layers[i]->setVisible(visible[i]);
+
+    results.set("duration_s", runTime);
+    results.set("frames", frameTimes.size());
+    results.set("layer_toggles", toggles);
+    results.set("tiles", tiles);
+    results.set("tiles_per_s", runTime > 0.0 ? (double)tiles / runTime : 0.0);
+    results.set("backlog_start", backlogStart);
+    results.set("backlog_end", backlogEnd);
+    results.set("backlog_peak", backlogPeak);
+    results.set("http_requests", s_httpRequests->get() - httpStart);
+    results.set("memory_high_water_mb", memoryPeak);
+    results.set("memory_peak_mb", (double)Memory::getProcessPeakPrivateUsage() / 1048576.0);
+    addPercentiles(results, "frame_ms", frameTimes);
+
+    if (!outFile.empty())
+    {
+        std::ofstream out(outFile.c_str());
+        out << results.toJSON(true) << std::endl;
+        OE_NOTICE << LC << "Wrote results to " << outFile << std::endl;
+    }
+    else
+    {
+        std::cout << results.toJSON(true) << std::endl;
+    }
+
+    return 0;
+}
@@ -72,6 +72,7 @@ usage( const std::string& msg = "" )
         << "            [--ext <extension>]             : overrides the image file extension (e.g. jpg)\n"
         << "            [--overwrite]                   : overwrite existing tiles\n"
         << "            [--keep-empties]                : writes out fully transparent image tiles (normally discarded)\n"
+        << "            [--dedup]                       : identical tiles share one file (hard links)\n"
         << "            [--continue-single-color]       : continues to subdivide single color tiles, subdivision typicall stops on single color images\n"
         << "            [--elevation-pixel-depth]       : pixeldepth for elevations\n"
         << "            [--db-options]                : db options string to pass to the image writer in quotes (e.g., \"JPEG_QUALITY 60\")\n"
@@ -221,6 +222,9 @@ makeTMS( osg::ArgumentParser& args )
     // whether to keep 'empty' tiles
     bool keepEmpties = args.read( "--keep-empties" );
 
+    // whether identical tiles share one file
+    bool deduplicate = args.read( "--dedup" );
+
     //TODO:  Single color
     bool continueSingleColor = args.read( "--continue-single-color" );
 
@@ -337,6 +341,7 @@ makeTMS( osg::ArgumentParser& args )
     packager.setOverwrite(overwrite);
     packager.setKeepEmpties(keepEmpties);
     packager.setApplyAlphaMask(applyAlphaMask);
+    packager.setDeduplicate(deduplicate);
 
 
     // new map for an output earth file if necessary.
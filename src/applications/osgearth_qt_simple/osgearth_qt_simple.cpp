@@ -46,6 +46,7 @@ usage( const std::string& msg )
 {
     OE_NOTICE << msg << std::endl << std::endl;
     OE_NOTICE << "USAGE: osgearth_qt_simple file.earth" << std::endl;
+    OE_NOTICE << "    --render-thread    : render in a thread of its own instead of Qt paint events" << std::endl;
         
     return -1;
 }
@@ -59,6 +60,7 @@ main(int argc, char** argv)
     if ( arguments.read("--stencil") )
         osg::DisplaySettings::instance()->setMinimumNumStencilBits(8);
 
+    bool renderThread = arguments.read("--render-thread");
 
     osgViewer::Viewer viewer(arguments);
     viewer.setThreadingModel( viewer.SingleThreaded );
@@ -81,7 +83,7 @@ main(int argc, char** argv)
 
     QApplication app(argc, argv);
 
-    QWidget* viewerWidget = new ViewerWidget( &viewer );
+    ViewerWidget* viewerWidget = new ViewerWidget( &viewer );
 
     QMainWindow win;
     win.setCentralWidget( viewerWidget );
@@ -90,5 +92,9 @@ main(int argc, char** argv)
     win.statusBar()->showMessage(QString("Quite possibly the world's simplest osgEarthQt app."));
 
     win.show();
+
+    if ( renderThread )
+        viewerWidget->setRenderThreaded( true );
+
     app.exec();
 }
@@ -42,11 +42,13 @@
 #include <osgEarthDrivers/feature_ogr/OGRFeatureOptions>
 
 #include <iostream>
+#include <fstream>
 #include <sstream>
 #include <iterator>
 
 using namespace osgEarth;
 using namespace osgEarth::Drivers;
+using namespace osgEarth::Symbology;
 
 #define LC "[osgearth_cache] "
 
@@ -92,9 +94,15 @@ int
         << "        [--max-level level]             ; Highest LOD level to seed (default=highest available)" << std::endl
         << "        [--bounds xmin ymin xmax ymax]* ; Geospatial bounding box to seed (in map coordinates; default=entire map)" << std::endl
         << "        [--index shapefile]             ; Use the feature extents in a shapefile to set the bounding boxes for seeding" << std::endl
+        << "        [--path file]                   ; Seed only the tiles the terrain would load flying along a path (text file of lon lat alt, or line features)" << std::endl
         << "        [--mp]                          ; Use multiprocessing to process the tiles.  Useful for GDAL sources as this avoids the global GDAL lock" << std::endl
         << "        [--mt]                          ; Use multithreading to process the tiles." << std::endl
         << "        [--concurrency]                 ; The number of threads or processes to use if --mp or --mt are provided." << std::endl
+        << "        [--distributed path]            ; Shares the work with other hosts through batch files in a shared folder" << std::endl
+        << "        [--coordinator]                 ; With --distributed, traverses the tiles and writes the batches (default=work on batches)" << std::endl
+        << "        [--lease-timeout seconds]       ; With --distributed, time after which an abandoned batch is given to another worker (default=600)" << std::endl
+        << "        [--checkpoint file]             ; Records finished work in a file and resumes from it if the seed is interrupted (not with --mp)" << std::endl
+        << "        [--checkpoint-level level]      ; LOD of the subtrees to record in the checkpoint file (default=8)" << std::endl
         << "        [--verbose]                     ; Displays progress of the seed operation" << std::endl
         << std::endl
         << "    --purge file.earth                  ; Purges a layer cache in a .earth file (interactive)" << std::endl
@@ -112,6 +120,79 @@ int message( const std::string& msg )
     return 0;
 }
 
+/**
+ * Reads camera positions into a path filter. A text file has one
+ * "lon lat alt" point per line (WGS84, altitude in meters above the
+ * ellipsoid, separated by spaces or commas; # starts a comment). Any
+ * other file is opened as a feature source and the points of its
+ * geometries are used in order.
+ */
+bool
+readPath( const std::string& filename, FlightPathFilter* filter )
+{
+    std::string ext = osgDB::getLowerCaseFileExtension(filename);
+    if (ext == "txt" || ext == "csv" || ext == "xyz")
+    {
+        std::ifstream in( filename.c_str() );
+        if (!in.is_open())
+            return false;
+
+        const SpatialReference* wgs84 = SpatialReference::get("wgs84");
+        std::string line;
+        while (std::getline(in, line))
+        {
+            std::string::size_type comment = line.find('#');
+            if (comment != std::string::npos)
+                line = line.substr(0, comment);
+
+            StringVector parts;
+            StringTokenizer(line, parts, " ,\t", "", false, true);
+            if (parts.size() >= 3)
+            {
+                filter->addPoint(GeoPoint(
+                    wgs84,
+                    as<double>(parts[0], 0.0),
+                    as<double>(parts[1], 0.0),
+                    as<double>(parts[2], 0.0),
+                    ALTMODE_ABSOLUTE));
+            }
+        }
+    }
+    else
+    {
+        OGRFeatureOptions featureOpt;
+        featureOpt.url() = filename;
+
+        osg::ref_ptr< FeatureSource > features = FeatureSourceFactory::create( featureOpt );
+        Status status = features->open();
+        if (status.isError())
+        {
+            OE_WARN << LC << status.message() << std::endl;
+            return false;
+        }
+
+        osg::ref_ptr< FeatureCursor > cursor = features->createFeatureCursor(0L);
+        while (cursor.valid() && cursor->hasMore())
+        {
+            osg::ref_ptr< Feature > feature = cursor->nextFeature();
+            if (!feature.valid() || !feature->getGeometry())
+                continue;
+
+            GeometryIterator parts( feature->getGeometry(), false );
+            while (parts.hasMore())
+            {
+                Geometry* part = parts.next();
+                for (Geometry::const_iterator p = part->begin(); p != part->end(); ++p)
+                {
+                    filter->addPoint(GeoPoint(feature->getSRS(), *p, ALTMODE_ABSOLUTE));
+                }
+            }
+        }
+    }
+
+    return filter->getNumPoints() > 0;
+}
+
 int
 seed( osg::ArgumentParser& args )
 {    
@@ -159,6 +240,24 @@ seed( osg::ArgumentParser& args )
     int elevationLayerIndex = -1;
     args.read("--elevation", elevationLayerIndex);
 
+    std::string checkpointFile;
+    args.read("--checkpoint", checkpointFile);
+
+    unsigned int checkpointLevel = 8;
+    args.read("--checkpoint-level", checkpointLevel);
+
+    std::string pathFile;
+    args.read("--path", pathFile);
+
+    std::string workPath;
+    args.read("--distributed", workPath);
+
+    bool coordinator = args.read("--coordinator");
+    args.read("--worker");
+
+    unsigned int leaseTimeout = 0;
+    args.read("--lease-timeout", leaseTimeout);
+
 
     //Read in the earth file.
     osg::ref_ptr<osg::Node> node = osgDB::readNodeFiles( args );
@@ -198,6 +297,27 @@ seed( osg::ArgumentParser& args )
         }
     }
 
+    // Read in a flight path
+    osg::ref_ptr<FlightPathFilter> pathFilter;
+    if (!pathFile.empty())
+    {
+        const TerrainOptions& terrainOptions = mapNode->getMapNodeOptions().getTerrainOptions();
+        if (terrainOptions.rangeMode() == osg::LOD::PIXEL_SIZE_ON_SCREEN)
+        {
+            OE_WARN << LC << "The terrain uses pixel-size ranges; the path uses distance ranges instead" << std::endl;
+        }
+
+        pathFilter = new FlightPathFilter(mapNode->getMap()->getProfile(), terrainOptions.minTileRangeFactor().get());
+        if (!readPath(pathFile, pathFilter.get()))
+            return usage( "Failed to read a path from " + pathFile );
+
+        OE_NOTICE << LC << "Read a path of " << pathFilter->getNumPoints() << " points from " << pathFile << std::endl;
+
+        // Restrict the traversal (and the estimate) to the corridor's extent.
+        GeoExtent pathExtent = pathFilter->getExtent(minLevel >= 0 ? (unsigned)minLevel : 0u);
+        bounds.push_back( pathExtent.transform(mapNode->getMapSRS()).bounds() );
+    }
+
     // If they requested to do an estimate then don't do the seed, just print out the estimated values.
     if (estimate)
     {        
@@ -228,6 +348,7 @@ seed( osg::ArgumentParser& args )
     }
     
     osg::ref_ptr< TileVisitor > visitor;
+    bool multiprocess = false;
 
 
     // If we are given a task file, load it up and create a new TileKeyListVisitor
@@ -246,7 +367,29 @@ seed( osg::ArgumentParser& args )
     // If we dont' have a visitor create one.
     if (!visitor.valid())
     {
-        if (args.read("--mt"))
+        if (!workPath.empty())
+        {
+            // Share the work with other hosts through the work folder
+            DistributedTileVisitor* v = new DistributedTileVisitor();
+            v->setWorkPath(workPath);
+            v->setRole(coordinator ? DistributedTileVisitor::ROLE_COORDINATOR : DistributedTileVisitor::ROLE_WORKER);
+            if (concurrency > 0)
+            {
+                v->setNumThreads(concurrency);
+            }
+
+            if (batchSize > 0)
+            {
+                v->setBatchSize(batchSize);
+            }
+
+            if (leaseTimeout > 0)
+            {
+                v->setLeaseTimeout(leaseTimeout);
+            }
+            visitor = v;
+        }
+        else if (args.read("--mt"))
         {
             // Create a multithreaded visitor
             MultithreadedTileVisitor* v = new MultithreadedTileVisitor();
@@ -282,6 +425,7 @@ seed( osg::ArgumentParser& args )
             }
             v->setEarthFile( earthFile );            
             visitor = v;            
+            multiprocess = true;
         }
         else
         {
@@ -290,6 +434,11 @@ seed( osg::ArgumentParser& args )
         }        
     }
 
+    if (pathFilter.valid())
+    {
+        visitor->setKeyFilter(pathFilter.get());
+    }
+
     osg::ref_ptr< ProgressCallback > progress = new ConsoleProgressCallback();
     
     if (verbose)
@@ -315,6 +464,14 @@ seed( osg::ArgumentParser& args )
     CacheSeed seeder;
     seeder.setVisitor(visitor.get());
 
+    if (!checkpointFile.empty())
+    {
+        if (multiprocess)
+            OE_WARN << LC << "Checkpoints are not supported with --mp; ignoring --checkpoint" << std::endl;
+        else
+            seeder.setCheckpointFile(checkpointFile, checkpointLevel);
+    }
+
     osgEarth::Map* map = mapNode->getMap();
 
     // They want to seed an image layer
@@ -366,18 +523,34 @@ seed( osg::ArgumentParser& args )
         TerrainLayerVector terrainLayers;
         map->getLayers(terrainLayers);
 
-        // Seed all the map layers
-        for (unsigned int i = 0; i < terrainLayers.size(); ++i)
-        {            
-            osg::ref_ptr< TerrainLayer > layer = terrainLayers[i].get();
-            OE_NOTICE << "Seeding layer" << layer->getName() << std::endl;            
+        // Seed all the layers in one traversal so the work is spread across
+        // them. That's not possible with --mp, which runs one layer per process.
+        if (!multiprocess)
+        {
+            OE_NOTICE << "Seeding " << terrainLayers.size() << " layers" << std::endl;
             osg::Timer_t start = osg::Timer::instance()->tick();
-            seeder.run(layer.get(), map);            
+            seeder.run(terrainLayers, map);
             osg::Timer_t end = osg::Timer::instance()->tick();
             if (verbose)
             {
-                OE_NOTICE << "Completed seeding layer " << layer->getName() << " in " << prettyPrintTime( osg::Timer::instance()->delta_s( start, end ) ) << std::endl;
-            }                
+                OE_NOTICE << "Completed seeding in " << prettyPrintTime( osg::Timer::instance()->delta_s( start, end ) ) << std::endl;
+            }
+        }
+        else
+        {
+            // Seed all the map layers
+            for (unsigned int i = 0; i < terrainLayers.size(); ++i)
+            {            
+                osg::ref_ptr< TerrainLayer > layer = terrainLayers[i].get();
+                OE_NOTICE << "Seeding layer" << layer->getName() << std::endl;            
+                osg::Timer_t start = osg::Timer::instance()->tick();
+                seeder.run(layer.get(), map);            
+                osg::Timer_t end = osg::Timer::instance()->tick();
+                if (verbose)
+                {
+                    OE_NOTICE << "Completed seeding layer " << layer->getName() << " in " << prettyPrintTime( osg::Timer::instance()->delta_s( start, end ) ) << std::endl;
+                }                
+            }
         }
 
         //for (unsigned int i = 0; i < map->getNumElevationLayers(); ++i)
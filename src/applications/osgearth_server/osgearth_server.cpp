@@ -25,6 +25,9 @@
 #include <osgEarth/Notify>
 #include <osgEarth/Registry>
 #include <osgEarth/TerrainEngineNode>
+#include <osgEarth/Containers>
+#include <osgEarth/ThreadingUtils>
+#include <osgEarth/StringUtils>
 #include <osgEarthUtil/ExampleResources>
 #include <osgDB/ReaderWriter>
 #include <osgDB/ReadFile>
@@ -48,7 +51,9 @@
 #include <Poco/Util/Option.h>
 #include <Poco/Util/OptionSet.h>
 #include <Poco/Util/HelpFormatter.h>
+#include <osg/Timer>
 #include <iostream>
+#include <sstream>
 
 using Poco::Net::ServerSocket;
 using Poco::Net::HTTPRequestHandler;
@@ -296,6 +301,9 @@ usage(const char* name)
 {
     OE_NOTICE 
         << "\nUsage: " << name << " file.earth" << std::endl
+        << "  --port <n>          : port to listen on (default 8000)" << std::endl
+        << "  --cache-size <mb>   : size of the encoded tile cache (default 256)" << std::endl
+        << "  --max-age <seconds> : Cache-Control max-age for tiles (default 3600)" << std::endl
         << MapNodeHelper().usage() << std::endl;
 
     return 0;
@@ -463,6 +471,146 @@ public:
 
 static TileImageServer* _server;
 
+/**
+ * An encoded tile image, shared by every request for the same tile.
+ * Requests that arrive while the tile is rendering wait on _ready
+ * instead of rendering it again.
+ */
+struct EncodedTile : public osg::Referenced
+{
+    EncodedTile() : _valid(false) { }
+
+    Threading::Event _ready;
+    bool             _valid;
+    std::string      _data;
+    std::string      _mime;
+    std::string      _etag;
+};
+
+/**
+ * Cache of encoded tile responses, keyed by "z/x/y.ext", with counters
+ * for the /metrics endpoint.
+ */
+class TileResponseCache
+{
+public:
+    TileResponseCache() :
+      _cache(1000000u),
+      _requests(0u), _hits(0u), _coalesced(0u), _renders(0u), _failures(0u), _renderTime(0.0)
+      {
+          // bounded by bytes; the entry limit is only a backstop
+          _cache.setMaxCost(256u * 1024u * 1024u);
+      }
+
+      void setMaxBytes(size_t bytes) { _cache.setMaxCost(bytes); }
+
+      //! Gets the encoded tile, rendering and encoding it if necessary.
+      osg::ref_ptr<EncodedTile> get(unsigned z, unsigned x, unsigned y, const std::string& ext)
+      {
+          std::string key = Stringify() << z << "/" << x << "/" << y << "." << ext;
+
+          osg::ref_ptr<EncodedTile> tile;
+          bool render = false;
+          {
+              Threading::ScopedMutexLock lock(_mutex);
+              ++_requests;
+
+              Cache::Record rec;
+              if (_cache.get(key, rec))
+              {
+                  ++_hits;
+                  return rec.value();
+              }
+
+              InFlight::iterator i = _inFlight.find(key);
+              if (i != _inFlight.end())
+              {
+                  ++_coalesced;
+                  tile = i->second.get();
+              }
+              else
+              {
+                  tile = new EncodedTile();
+                  _inFlight[key] = tile.get();
+                  render = true;
+              }
+          }
+
+          if (!render)
+          {
+              tile->_ready.wait();
+              return tile;
+          }
+
+          osg::Timer_t start = osg::Timer::instance()->tick();
+          encode(z, x, y, ext, tile.get());
+          double ms = osg::Timer::instance()->delta_m(start, osg::Timer::instance()->tick());
+
+          {
+              Threading::ScopedMutexLock lock(_mutex);
+              _inFlight.erase(key);
+              ++_renders;
+              _renderTime += ms;
+              if (tile->_valid)
+                  _cache.insert(key, tile, tile->_data.size());
+              else
+                  ++_failures;
+          }
+
+          tile->_ready.set();
+          return tile;
+      }
+
+      //! Writes the counters as plain text.
+      void writeMetrics(std::ostream& out)
+      {
+          Threading::ScopedMutexLock lock(_mutex);
+          out << "requests " << _requests << "\n"
+              << "cache_hits " << _hits << "\n"
+              << "coalesced " << _coalesced << "\n"
+              << "renders " << _renders << "\n"
+              << "failures " << _failures << "\n"
+              << "mean_render_ms " << (_renders > 0u ? _renderTime/(double)_renders : 0.0) << "\n"
+              << "cached_tiles " << _cache.getStats()._entries << "\n"
+              << "cached_bytes " << _cache.getCost() << "\n";
+      }
+
+private:
+    void encode(unsigned z, unsigned x, unsigned y, const std::string& ext, EncodedTile* tile)
+    {
+        osgDB::ReaderWriter* rw = osgDB::Registry::instance()->getReaderWriterForExtension(ext);
+        if (!rw)
+            return;
+
+        osg::ref_ptr< osg::Image > image = _server->getTile(z, x, y);
+        if (!image.valid())
+            return;
+
+        std::stringstream buf;
+        if (!rw->writeImage(*image.get(), buf).success())
+            return;
+
+        tile->_data = buf.str();
+        tile->_mime = (ext == "jpeg" || ext == "jpg") ? "image/jpeg" : "image/png";
+        tile->_etag = Stringify() << "\"" << hashToString(tile->_data) << "\"";
+        tile->_valid = true;
+    }
+
+    typedef LRUCache< std::string, osg::ref_ptr<EncodedTile> > Cache;
+    typedef std::map< std::string, osg::ref_ptr<EncodedTile> > InFlight;
+
+    Threading::Mutex _mutex;
+    Cache            _cache;
+    InFlight         _inFlight;
+    unsigned         _requests, _hits, _coalesced, _renders, _failures;
+    double           _renderTime;
+};
+
+static TileResponseCache _responses;
+
+// max-age for the Cache-Control header, in seconds
+static int _maxAge = 3600;
+
 class TileRequestHandler: public HTTPRequestHandler
 {
 public:
@@ -488,35 +636,48 @@ public:
             OE_DEBUG << "y=" << y << std::endl;              
             OE_DEBUG << "ext=" << ext << std::endl;
 
-            response.setChunkedTransferEncoding(true);
-
-            osg::ref_ptr< osg::Image > image = _server->getTile(z, x, y);
-            
-            if (image)
+            osg::ref_ptr<EncodedTile> tile = _responses.get(z, x, y, ext);
+            if (tile->_valid)
             {
-                osgDB::ReaderWriter* rw = osgDB::Registry::instance()->getReaderWriterForExtension(ext);
-                if (rw)
+                response.set("ETag", tile->_etag);
+                response.set("Cache-Control", Stringify() << "public, max-age=" << _maxAge);
+
+                if (request.get("If-None-Match", "") == tile->_etag)
                 {
-                    std::string mime = "image/png";
-                    if (ext == "jpeg" || ext == "jpg")
-                    {
-                        mime = "image/jpeg";
-                    }                    
-                    response.setContentType(mime);
-                    std::ostream& ostr = response.send();                 
-                    rw->writeImage(*image.get(), ostr);                    
-                }             
+                    response.setStatus(Poco::Net::HTTPResponse::HTTP_NOT_MODIFIED);
+                    response.send();
+                    return;
+                }
 
+                response.setContentType(tile->_mime);
+                response.sendBuffer(tile->_data.data(), tile->_data.size());
+                return;
             }
         }
  
-        response.setStatus(Poco::Net::HTTPResponse::HTTP_NOT_FOUND);                
+        response.setStatus(Poco::Net::HTTPResponse::HTTP_NOT_FOUND);
+        response.send();
     }
 
 private:
     std::string _format;
 };
 
+class MetricsRequestHandler: public HTTPRequestHandler
+{
+public:
+    void handleRequest(HTTPServerRequest& request,
+                       HTTPServerResponse& response)
+    {
+        std::stringstream buf;
+        _responses.writeMetrics(buf);
+        std::string text = buf.str();
+        response.setContentType("text/plain");
+        response.set("Cache-Control", "no-cache");
+        response.sendBuffer(text.data(), text.size());
+    }
+};
+
 class TileRequestHandlerFactory : public HTTPRequestHandlerFactory
 {
     public:
@@ -527,21 +688,16 @@ class TileRequestHandlerFactory : public HTTPRequestHandlerFactory
     HTTPRequestHandler* createRequestHandler(
         const HTTPServerRequest& request)
     {        
+        if ( request.getURI() == "/metrics" )
+        {
+            return new MetricsRequestHandler();
+        }
+
         StringTokenizer tok("/");
         StringVector tized;
         tok.tokenize(request.getURI(), tized);            
         if ( tized.size() == 4 )
         {
-            int z = as<int>(tized[1], 0);
-            int x = as<int>(tized[2], 0);
-            unsigned int y = as<int>(osgDB::getNameLessExtension(tized[3]),0);
-            std::string ext = osgDB::getFileExtension(tized[3]);
-
-            OE_DEBUG << "z=" << z << std::endl;
-            OE_DEBUG << "x=" << x << std::endl;
-            OE_DEBUG << "y=" << y << std::endl;              
-            OE_DEBUG << "ext=" << ext << std::endl;
-
             return new TileRequestHandler();
         }
 
@@ -602,6 +758,13 @@ main(int argc, char** argv)
     arguments.read("--port", port);
     OE_NOTICE << "Listening on port " << port << std::endl;
 
+    // size of the encoded tile cache, in megabytes
+    int cacheMB = 256;
+    if (arguments.read("--cache-size", cacheMB))
+        _responses.setMaxBytes((size_t)cacheMB * 1024u * 1024u);
+
+    arguments.read("--max-age", _maxAge);
+
     // thread-safe initialization of the OSG wrapper manager. Calling this here
     // prevents the "unsupported wrapper" messages from OSG
     osgDB::Registry::instance()->getObjectWrapperManager()->findWrapper("osg::Image");
@@ -39,6 +39,9 @@ usage(const char* name)
 {
     OE_NOTICE 
         << "\nUsage: " << name << " file.earth" << std::endl
+        << "    --views <n>         : number of views" << std::endl
+        << "    --shared            : all views in one window (one graphics context)" << std::endl
+        << "    --shared-contexts   : one window per view, sharing GL objects with the first" << std::endl
         << MapNodeHelper().usage() << std::endl;
 
     return 0;
@@ -60,6 +63,12 @@ main(int argc, char** argv)
     bool sharedGC;
     sharedGC = arguments.read("--shared");
 
+    // Separate windows whose contexts share textures, buffers and programs,
+    // so each tile uploads once instead of once per window. OSG gives shared
+    // contexts the same context ID, so every per-context GL object (and the
+    // ResourceReleaser's queue) is shared as well.
+    bool sharedContexts = arguments.read("--shared-contexts");
+
     // create a viewer:
     osgViewer::CompositeViewer viewer(arguments);
     viewer.setThreadingModel(viewer.SingleThreaded);
@@ -74,7 +83,35 @@ main(int argc, char** argv)
     {
         osgViewer::View* view = new osgViewer::View();
         int width = sharedGC? size*numViews : size;
-        view->setUpViewInWindow(10+(i*size+30), 10, width, size);
+        if (sharedContexts)
+        {
+            osg::GraphicsContext::Traits* traits = new osg::GraphicsContext::Traits();
+            traits->x = 10+(i*size+30);
+            traits->y = 10;
+            traits->width = size;
+            traits->height = size;
+            traits->windowDecoration = true;
+            traits->doubleBuffer = true;
+            traits->windowName = Stringify() << "View " << i;
+            if (i > 0)
+                traits->sharedContext = viewer.getView(0)->getCamera()->getGraphicsContext();
+
+            osg::GraphicsContext* gc = osg::GraphicsContext::createGraphicsContext(traits);
+            if (!gc)
+            {
+                OE_WARN << LC << "Failed to create a graphics context" << std::endl;
+                return -1;
+            }
+            view->getCamera()->setGraphicsContext(gc);
+            view->getCamera()->setViewport(0, 0, size, size);
+            view->getCamera()->setProjectionMatrixAsPerspective(45, 1, 1, 10);
+            view->getCamera()->setDrawBuffer(GL_BACK);
+            view->getCamera()->setReadBuffer(GL_BACK);
+        }
+        else
+        {
+            view->setUpViewInWindow(10+(i*size+30), 10, width, size);
+        }
         view->setCameraManipulator(new EarthManipulator(arguments));
         view->setSceneData(node);
         view->getDatabasePager()->setUnrefImageDataAfterApplyPolicy( true, false );
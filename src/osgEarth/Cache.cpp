@@ -18,6 +18,7 @@
  */
 #include <osgEarth/Cache>
 #include <osgEarth/Registry>
+#include <osgEarth/InstrumentedCacheBin>
 #include "sha1.hpp"
 
 #include <osgDB/ReadFile>
@@ -57,6 +58,19 @@ CacheSettings::isCacheEnabled() const
     return _cache.valid() && _policy->isCacheEnabled();
 }
 
+void
+CacheSettings::setCacheBin(CacheBin* bin)
+{
+    if ( bin && InstrumentedCacheBin::isEnabled() && !dynamic_cast<InstrumentedCacheBin*>(bin) )
+    {
+        _activeBin = new InstrumentedCacheBin(bin, _policy.get());
+    }
+    else
+    {
+        _activeBin = bin;
+    }
+}
+
 void
 CacheSettings::integrateCachePolicy(const optional<CachePolicy>& policy)
 {
@@ -18,6 +18,7 @@
  */
 #include <osgEarth/CacheBin>
 #include <osgEarth/Registry>
+#include <osgEarth/OptionsOverlay>
 #include <osgEarth/Cache>
 
 #include <osgDB/FileNameUtils>
@@ -260,8 +261,9 @@ namespace
                     if (rs != CacheBin::STATUS_OK)
                     {
                         // The OSGB serializer won't actually write the image data without this:
-                        osg::ref_ptr<osgDB::Options> dbo = Registry::cloneOrCreateOptions(_writeOptions);
-                        dbo->setPluginStringData("WriteImageHint", "IncludeData");
+                        osg::ref_ptr<const osgDB::Options> dbo = OptionsOverlay()
+                            .setPluginStringData("WriteImageHint", "IncludeData")
+                            .apply(_writeOptions);
 
                         OE_INFO << LC << "Writing image \"" << image.getFileName() << "\" to the cache\n";
 
@@ -284,6 +286,76 @@ namespace
 }
 
 
+#undef  LC
+#define LC "[CacheBin] "
+
+// Metadata property that marks a record as an encoded image
+#define ENCODED_FORMAT_KEY "osgearth.encoded_format"
+
+void
+CacheBin::setEncodedFormat(Config& metadata, const std::string& format)
+{
+    metadata.set(ENCODED_FORMAT_KEY, format);
+}
+
+std::string
+CacheBin::getEncodedFormat(const Config& metadata)
+{
+    return metadata.value(ENCODED_FORMAT_KEY);
+}
+
+ReadResult
+CacheBin::decodeImage(std::istream& in, const std::string& format, const osgDB::Options* dbo)
+{
+    // same lookup order as the HTTPClient: extension, then MIME type
+    osgDB::ReaderWriter* rw =
+        format.find('/') == std::string::npos ?
+        osgDB::Registry::instance()->getReaderWriterForExtension(format) :
+        osgDB::Registry::instance()->getReaderWriterForMimeType(format);
+
+    if (!rw)
+    {
+        OE_WARN << LC << "No reader for encoded image format \"" << format << "\"" << std::endl;
+        return ReadResult(ReadResult::RESULT_NO_READER);
+    }
+
+    osgDB::ReaderWriter::ReadResult r = rw->readImage(in, dbo);
+    if (!r.validImage())
+    {
+        ReadResult result(ReadResult::RESULT_READER_ERROR);
+        result.setErrorDetail(r.message());
+        return result;
+    }
+
+    return ReadResult(r.takeImage());
+}
+
+void
+CacheBin::readImages(const std::vector<std::string>& keys,
+                     const osgDB::Options*           dbo,
+                     std::vector<ReadResult>&        output)
+{
+    output.clear();
+    output.reserve(keys.size());
+    for (std::vector<std::string>::const_iterator i = keys.begin(); i != keys.end(); ++i)
+    {
+        output.push_back(readImage(*i, dbo));
+    }
+}
+
+bool
+CacheBin::writeBatch(const WriteRecords&   records,
+                     const osgDB::Options* dbo)
+{
+    bool ok = true;
+    for (WriteRecords::const_iterator i = records.begin(); i != records.end(); ++i)
+    {
+        if (!write(i->_key, i->_object.get(), i->_meta, dbo))
+            ok = false;
+    }
+    return ok;
+}
+
 bool
 CacheBin::writeNode(const std::string&    key,
                     osg::Node*            node,
@@ -29,15 +29,44 @@ using namespace osgEarth;
 using namespace OpenThreads;
 
 CacheTileHandler::CacheTileHandler( TerrainLayer* layer, const Map* map ):
-_layer( layer ),
+_layers( 1, layer ),
+_map( map )
+{
+}
+
+CacheTileHandler::CacheTileHandler( const TerrainLayerVector& layers, const Map* map ):
+_layers( layers ),
 _map( map )
 {
 }
 
 bool CacheTileHandler::handleTile(const TileKey& key, const TileVisitor& tv)
+{
+    // keep going as long as any layer has more to offer below this key.
+    bool traverseChildren = false;
+    for (TerrainLayerVector::const_iterator i = _layers.begin(); i != _layers.end(); ++i)
+    {
+        if ((*i)->mayHaveData(key) && handleTile(i->get(), key))
+        {
+            traverseChildren = true;
+        }
+    }
+    return traverseChildren;
+}
+
+bool CacheTileHandler::handleTile(TerrainLayer* layer, const TileKey& key)
 {        
-    ImageLayer* imageLayer = dynamic_cast< ImageLayer* >( _layer.get() );
-    ElevationLayer* elevationLayer = dynamic_cast< ElevationLayer* >( _layer.get() );    
+    // A record that's already cached and can't expire needs no work. The status
+    // check only touches the record's metadata, where create*() would read and
+    // decode the whole tile.
+    if (layer->getCacheSettings()->cachePolicy()->getMinAcceptTime() == 0 &&
+        layer->isCached(key))
+    {
+        return true;
+    }
+
+    ImageLayer* imageLayer = dynamic_cast< ImageLayer* >( layer );
+    ElevationLayer* elevationLayer = dynamic_cast< ElevationLayer* >( layer );    
 
     // Just call createImage or createHeightField on the layer and the it will be cached!
     if (imageLayer)
@@ -59,7 +88,7 @@ bool CacheTileHandler::handleTile(const TileKey& key, const TileVisitor& tv)
 
     // If we didn't produce a result but the key isn't within range then we should continue to 
     // traverse the children b/c a min level was set.
-    if (!_layer->isKeyInLegalRange(key))
+    if (!layer->isKeyInLegalRange(key))
     {
         return true;
     }
@@ -69,16 +98,25 @@ bool CacheTileHandler::handleTile(const TileKey& key, const TileVisitor& tv)
 
 bool CacheTileHandler::hasData( const TileKey& key ) const
 {
-    return _layer->mayHaveData(key);
+    for (TerrainLayerVector::const_iterator i = _layers.begin(); i != _layers.end(); ++i)
+    {
+        if ((*i)->mayHaveData(key))
+            return true;
+    }
+    return false;
 }
 
 std::string CacheTileHandler::getProcessString() const
 {
+    // An external process seeds one layer at a time.
     std::stringstream buf;
-    ImageLayer* imageLayer = dynamic_cast< ImageLayer* >( _layer.get() );
-    ElevationLayer* elevationLayer = dynamic_cast< ElevationLayer* >( _layer.get() );    
+    if (_layers.size() != 1)
+        return buf.str();
+
+    ImageLayer* imageLayer = dynamic_cast< ImageLayer* >( _layers[0].get() );
+    ElevationLayer* elevationLayer = dynamic_cast< ElevationLayer* >( _layers[0].get() );    
 
-    unsigned index = _map->getIndexOfLayer(_layer.get());
+    unsigned index = _map->getIndexOfLayer(_layers[0].get());
     if (index < _map->getNumLayers())
     {
         buf << "osgearth_cache --seed ";
@@ -99,7 +137,8 @@ std::string CacheTileHandler::getProcessString() const
 /***************************************************************************************/
 
 CacheSeed::CacheSeed():
-_visitor(new TileVisitor())
+_visitor(new TileVisitor()),
+_checkpointLevel(8u)
 {
 }
 
@@ -113,8 +152,41 @@ void CacheSeed::setVisitor(TileVisitor* visitor)
     _visitor = visitor;
 }
 
+void CacheSeed::setCheckpointFile(const std::string& filename, unsigned level)
+{
+    _checkpointFile = filename;
+    _checkpointLevel = level;
+}
+
 void CacheSeed::run( TerrainLayer* layer, const Map* map )
 {
-    _visitor->setTileHandler( new CacheTileHandler( layer, map ) );
+    run( TerrainLayerVector(1, layer), map );
+}
+
+void CacheSeed::run( const TerrainLayerVector& layers, const Map* map )
+{
+    _visitor->setTileHandler( new CacheTileHandler( layers, map ) );
+
+    if (!_checkpointFile.empty())
+    {
+        // The scope ties the checkpoints to this set of layers and levels;
+        // changing either starts a fresh seed.
+        std::stringstream scope;
+        scope << "levels=" << _visitor->getMinLevel() << "-" << _visitor->getMaxLevel() << " layers=";
+        for (unsigned i = 0; i < layers.size(); ++i)
+            scope << (i > 0 ? "+" : "") << layers[i]->getCacheID();
+
+        osg::ref_ptr<TileCheckpoint> checkpoint = new TileCheckpoint(
+            _checkpointFile,
+            osg::minimum(_checkpointLevel, _visitor->getMaxLevel()));
+
+        checkpoint->setScope(scope.str());
+        unsigned count = checkpoint->load();
+        OE_INFO << LC << "Read " << count << " checkpoints from " << _checkpointFile << std::endl;
+
+        _visitor->setCheckpoint( checkpoint.get() );
+    }
+
     _visitor->run( map->getProfile() );
-}
\ No newline at end of file
+    _visitor->setCheckpoint( 0L );
+}
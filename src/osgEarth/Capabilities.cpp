@@ -136,7 +136,8 @@ _supportsETC            ( false ),
 _supportsRGTC           ( false ),
 _supportsTextureBuffer  ( false ),
 _maxTextureBufferSize   ( 0 ),
-_isCoreProfile          ( true )
+_isCoreProfile          ( true ),
+_supportsProgramBinary  ( false )
 {
     // little hack to force the osgViewer library to link so we can create a graphics context
     osgViewerGetVersion();
@@ -326,6 +327,11 @@ _isCoreProfile          ( true )
             osg::isGLExtensionSupported( id, "GL_ARB_transform_feedback2" );
         OE_INFO << LC << "  Transform feedback = " << SAYBOOL(supportsTransformFeedback) << "\n";
 
+        _supportsProgramBinary =
+            _supportsGLSL &&
+            osg::isGLExtensionOrVersionSupported( id, "GL_ARB_get_program_binary", 4.1f );
+        OE_INFO << LC << "  Program binaries = " << SAYBOOL(_supportsProgramBinary) << std::endl;
+
 
         // Writing to gl_FragDepth is not supported under GLES, is supported under gles3
 #if (defined(OSG_GLES1_AVAILABLE) || defined(OSG_GLES2_AVAILABLE))
@@ -22,6 +22,7 @@
 #include <osgEarth/ClampingTechnique>
 #include <osgEarth/Capabilities>
 #include <osgEarth/CullingUtils>
+#include <osgEarth/GPUTimer>
 #include <osgEarth/Registry>
 #include <osgEarth/Shaders>
 
@@ -70,6 +71,7 @@ namespace
     {
         osg::ref_ptr<osg::Texture2D> _rttTexture;
         osg::ref_ptr<osg::StateSet>  _groupStateSet;
+        osg::ref_ptr<osg::Depth>     _groupDepth;
         osg::ref_ptr<osg::Uniform>   _camViewToDepthClipUniform;
         osg::ref_ptr<osg::Uniform>   _depthClipToCamViewUniform;
 
@@ -177,6 +179,8 @@ ClampingTechnique::setUpCamera(OverlayDecorator::TechRTTParams& params)
     params._rttCamera->setFinalDrawCallback( new RttOut() );
 #endif
 
+    GPUTimer::install( params._rttCamera.get(), "clamping" );
+
     // set up a StateSet for the RTT camera.
     osg::StateSet* rttStateSet = params._rttCamera->getOrCreateStateSet();
 
@@ -202,6 +206,12 @@ ClampingTechnique::setUpCamera(OverlayDecorator::TechRTTParams& params)
     // from interfering with the depth camera
     VirtualProgram* rttVP = VirtualProgram::getOrCreate(rttStateSet);
     rttVP->setInheritShaders(false);
+
+    // likewise, the depth map always uses the standard depth convention, even
+    // if the main camera reverses its depth comparisons (reverse-Z).
+    rttStateSet->setAttributeAndModes(
+        new osg::Depth( osg::Depth::LEQUAL, 0.0, 1.0, true ),
+        osg::StateAttribute::ON | osg::StateAttribute::OVERRIDE );
     
     // attach the terrain to the camera.
     // todo: should probably protect this with a mutex.....
@@ -220,8 +230,9 @@ ClampingTechnique::setUpCamera(OverlayDecorator::TechRTTParams& params)
         osg::StateAttribute::ON | osg::StateAttribute::OVERRIDE );
 
     // set up depth test/write parameters for the overlay geometry:
+    local->_groupDepth = new osg::Depth( osg::Depth::LEQUAL, 0.0, 1.0, true );
     local->_groupStateSet->setAttributeAndModes(
-        new osg::Depth( osg::Depth::LEQUAL, 0.0, 1.0, true ),
+        local->_groupDepth.get(),
         osg::StateAttribute::ON );
 
     local->_groupStateSet->setRenderingHint( osg::StateSet::TRANSPARENT_BIN );
@@ -326,6 +337,16 @@ ClampingTechnique::cullOverlayGroup(OverlayDecorator::TechRTTParams& params,
 
         LocalPerViewData& local = *static_cast<LocalPerViewData*>(params._techniqueData.get());
 
+        // the overlay geometry draws into the main camera, so it follows that
+        // camera's depth convention (OE_REVERSE_Z is set by the ReverseZDepthBuffer)
+        const osg::StateSet* cameraStateSet = cv->getCurrentCamera() ? cv->getCurrentCamera()->getStateSet() : 0L;
+        bool reverseZ =
+            cameraStateSet &&
+            cameraStateSet->getDefineList().find("OE_REVERSE_Z") != cameraStateSet->getDefineList().end();
+        osg::Depth::Function func = reverseZ ? osg::Depth::GEQUAL : osg::Depth::LEQUAL;
+        if ( local._groupDepth->getFunction() != func )
+            local._groupDepth->setFunction( func );
+
         // construct a matrix that transforms from camera view coords to depth texture
         // clip coords directly. This will avoid precision loss in the 32-bit shader.
         static osg::Matrix s_scaleBiasMat = 
@@ -19,6 +19,15 @@
 #include <osgEarth/CompositeTileSource>
 #include <osgEarth/Registry>
 #include <osgEarth/Progress>
+#include <osgEarth/TileRasterizer>
+#include <osgEarth/VirtualProgram>
+#include <osgEarth/StringUtils>
+#include <osgEarth/ImageUtils>
+#include <osgEarth/JobScheduler>
+#include <osg/BlendFunc>
+#include <osg/Geode>
+#include <osg/Geometry>
+#include <osg/Texture2D>
 
 #define LC "[CompositeTileSource] "
 
@@ -27,7 +36,8 @@ using namespace osgEarth;
 //------------------------------------------------------------------------
 
 CompositeTileSourceOptions::CompositeTileSourceOptions( const TileSourceOptions& options ) :
-TileSourceOptions( options )
+TileSourceOptions( options ),
+_gpuCompositing  ( true )
 {
     setDriver( "composite" );
     fromConfig( _conf );
@@ -54,6 +64,8 @@ CompositeTileSourceOptions::getConfig() const
 {    
     Config conf = TileSourceOptions::getConfig();
 
+    conf.set( "gpu_compositing", _gpuCompositing );
+
     for( ComponentVector::const_iterator i = _components.begin(); i != _components.end(); ++i )
     {
         if ( i->_imageLayerOptions.isSet() )
@@ -75,6 +87,8 @@ CompositeTileSourceOptions::mergeConfig( const Config& conf )
 void 
 CompositeTileSourceOptions::fromConfig( const Config& conf )
 {    
+    conf.getIfSet( "gpu_compositing", _gpuCompositing );
+
     const ConfigSet& images = conf.hasChild("images") ? conf.child("images").children() : conf.children("image");
     for( ConfigSet::const_iterator i = images.begin(); i != images.end(); ++i )
     {
@@ -126,124 +140,276 @@ namespace
 
     // some helper types.    
     typedef std::vector<ImageInfo> ImageMixVector;   
-}
 
-//-----------------------------------------------------------------------
+    // Per-fetch progress. Cancels along with the caller, or on its own when
+    // a layer above it turns out to hide it.
+    struct FetchProgress : public ProgressCallback
+    {
+        osg::ref_ptr<ProgressCallback> _caller;
+        bool _skipped;
 
-CompositeTileSource::CompositeTileSource( const TileSourceOptions& options ) :
-TileSource  ( options ),
-_options    ( options ),
-_initialized( false ),
-_dynamic    ( false )
-{
-    //nop
-}
+        FetchProgress(ProgressCallback* caller) : _caller(caller), _skipped(false) { }
 
-osg::Image*
-CompositeTileSource::createImage(const TileKey&    key,
-                                 ProgressCallback* progress )
-{    
-    ImageMixVector images;
-    images.reserve(_imageLayers.size());
+        bool isCanceled() { return _canceled || (_caller.valid() && _caller->isCanceled()); }
+    };
 
-    // Try to get an image from each of the layers for the given key.
-    for (ImageLayerVector::const_iterator itr = _imageLayers.begin(); itr != _imageLayers.end(); ++itr)
+    //! Fetches one component layer's image for a tile.
+    struct FetchImage : public TaskRequest
     {
-        ImageLayer* layer = itr->get();
-        ImageInfo imageInfo;
-        imageInfo.dataInExtents = layer->mayHaveDataInExtent(key.getExtent());
-        imageInfo.opacity = layer->getOpacity();
+        osg::ref_ptr<ImageLayer>    _layer;
+        TileKey                     _key;
+        osg::ref_ptr<FetchProgress> _progress;
+        GeoImage                    _image;
+        bool                        _opaque;
 
-        if (imageInfo.dataInExtents)
+        FetchImage(ImageLayer* layer, const TileKey& key, ProgressCallback* caller) :
+            _layer(layer), _key(key), _progress(new FetchProgress(caller)), _opaque(false) { }
+
+        void operator()(ProgressCallback*)
         {
-            GeoImage image = layer->createImage(key, progress);
-            if (image.valid())
+            if (_progress->isCanceled())
+                return;
+
+            _image = _layer->createImage(_key, _progress.get());
+
+            // An opaque layer covering the whole tile hides everything below it.
+            _opaque =
+                _image.valid() &&
+                _layer->getOpacity() >= 1.0f &&
+                !ImageUtils::hasTransparency(_image.getImage());
+        }
+    };
+    typedef std::vector<osg::ref_ptr<FetchImage> > FetchVector;
+
+    //! Runs the fetches on the job scheduler (inline if there's only one)
+    //! and waits for them. Layers under the topmost opaque result are
+    //! abandoned as soon as that result comes in.
+    void runFetches(FetchVector& fetches)
+    {
+        if (fetches.size() == 1u)
+        {
+            (*fetches[0])(0L);
+            return;
+        }
+
+        JobScheduler* scheduler = Registry::instance()->getJobScheduler();
+        bool onWorker = scheduler->isWorkerThread();
+
+        osg::ref_ptr<JobGroup> group = new JobGroup();
+
+        // top of the stack first, since it decides whether the rest matter
+        for (int i = (int)fetches.size()-1; i >= 0; --i)
+            scheduler->submit(fetches[i].get(), JobScheduler::LANE_HIGH, group.get());
+
+        unsigned skipBelow = 0u;
+        while (group->getNumPending() > 0u)
+        {
+            for (unsigned i = fetches.size()-1; i > skipBelow; --i)
             {
-                imageInfo.image = image.getImage();
+                if (fetches[i]->isCompleted() && fetches[i]->_opaque)
+                {
+                    for (unsigned j = skipBelow; j < i; ++j)
+                    {
+                        fetches[j]->_progress->_skipped = true;
+                        fetches[j]->_progress->cancel();
+                    }
+                    skipBelow = i;
+                    break;
+                }
             }
 
-            // If the progress got cancelled or it needs a retry then return NULL to prevent this tile from being built and cached with incomplete or partial data.
-            if (progress && progress->isCanceled())
+            if (onWorker)
             {
-                OE_DEBUG << LC << " createImage was cancelled or needs retry for " << key.str() << std::endl;
-                return 0L;
+                // help out rather than block a worker
+                if (!scheduler->runOne())
+                    OpenThreads::Thread::YieldCurrentThread();
+            }
+            else
+            {
+                group->wait(group->getNumPending() - 1u);
             }
         }
-
-        images.push_back(imageInfo);
     }
 
-    // Determine the output texture size to use based on the image that were creatd.
-    unsigned numValidImages = 0;
-    osg::Vec2s textureSize;
-    for (unsigned int i = 0; i < images.size(); i++)
+    /**
+     * Fetches an image from each layer for the given key, falling back on
+     * cropped ancestors for the layers that came up empty when others
+     * didn't. Returns false if the progress was canceled.
+     */
+    bool gatherImages(const ImageLayerVector& layers,
+                      const TileKey&          key,
+                      ProgressCallback*       progress,
+                      ImageMixVector&         images)
     {
-        ImageInfo& info = images[i];
-        if (info.image.valid())
+        images.reserve(layers.size());
+
+        // Fetch from all the layers with data in the tile at once.
+        FetchVector fetches;
+        std::vector<int> fetchIndex(layers.size(), -1);
+
+        for (unsigned i = 0; i < layers.size(); ++i)
         {
-            if (numValidImages == 0)
+            ImageLayer* layer = layers[i].get();
+            ImageInfo imageInfo;
+            imageInfo.dataInExtents = layer->mayHaveDataInExtent(key.getExtent());
+            imageInfo.opacity = layer->getOpacity();
+            images.push_back(imageInfo);
+
+            if (imageInfo.dataInExtents)
             {
-                textureSize.set( info.image->s(), info.image->t());
+                fetchIndex[i] = fetches.size();
+                fetches.push_back(new FetchImage(layer, key, progress));
             }
-            numValidImages++;        
         }
-    } 
 
-    // Create fallback images if we have some valid data but not for all the layers
-    if (numValidImages > 0 && numValidImages < images.size())
-    {
+        if (!fetches.empty())
+        {
+            runFetches(fetches);
+        }
+
+        for (unsigned i = 0; i < layers.size(); ++i)
+        {
+            if (fetchIndex[i] < 0)
+                continue;
+
+            FetchImage* fetch = fetches[fetchIndex[i]].get();
+
+            // hidden under an opaque layer; there's nothing to fall back on either.
+            if (fetch->_progress->_skipped)
+            {
+                images[i].dataInExtents = false;
+                continue;
+            }
+
+            // If the progress got cancelled or it needs a retry then return NULL to prevent this tile from being built and cached with incomplete or partial data.
+            if (fetch->_progress->isCanceled())
+            {
+                if (progress)
+                    progress->cancel();
+                OE_DEBUG << LC << " createImage was cancelled or needs retry for " << key.str() << std::endl;
+                return false;
+            }
+
+            if (fetch->_image.valid())
+            {
+                images[i].image = fetch->_image.getImage();
+            }
+        }
+
+        // Determine the output texture size to use based on the image that were creatd.
+        unsigned numValidImages = 0;
+        osg::Vec2s textureSize;
         for (unsigned int i = 0; i < images.size(); i++)
         {
             ImageInfo& info = images[i];
-            ImageLayer* layer = _imageLayers[i].get();
-            if (!info.image.valid() && info.dataInExtents)
-            {                      
-                TileKey parentKey = key.createParentKey();
-
-                GeoImage image;
-                while (!image.valid() && parentKey.valid())
+            if (info.image.valid())
+            {
+                if (numValidImages == 0)
                 {
-                    image = layer->createImage(parentKey, progress);
-                    if (image.valid())
-                    {
-                        break;
-                    }
+                    textureSize.set( info.image->s(), info.image->t());
+                }
+                numValidImages++;        
+            }
+        } 
 
-                    // If the progress got cancelled or it needs a retry then return NULL to prevent this tile from being built and cached with incomplete or partial data.
-                    if (progress && progress->isCanceled())
+        // Create fallback images if we have some valid data but not for all the layers
+        if (numValidImages > 0 && numValidImages < images.size())
+        {
+            for (unsigned int i = 0; i < images.size(); i++)
+            {
+                ImageInfo& info = images[i];
+                ImageLayer* layer = layers[i].get();
+                if (!info.image.valid() && info.dataInExtents)
+                {                      
+                    TileKey parentKey = key.createParentKey();
+
+                    GeoImage image;
+                    while (!image.valid() && parentKey.valid())
                     {
-                        OE_DEBUG << LC << " createImage was cancelled or needs retry for " << key.str() << std::endl;
-                        return 0L;
+                        image = layer->createImage(parentKey, progress);
+                        if (image.valid())
+                        {
+                            break;
+                        }
+
+                        // If the progress got cancelled or it needs a retry then return NULL to prevent this tile from being built and cached with incomplete or partial data.
+                        if (progress && progress->isCanceled())
+                        {
+                            OE_DEBUG << LC << " createImage was cancelled or needs retry for " << key.str() << std::endl;
+                            return false;
+                        }
+
+                        parentKey = parentKey.createParentKey();
                     }
 
-                    parentKey = parentKey.createParentKey();
+                    if (image.valid())
+                    {                                        
+                        // TODO:  Bilinear options?
+                        bool bilinear = layer->isCoverage() ? false : true;
+                        GeoImage cropped = image.crop( key.getExtent(), true, textureSize.x(), textureSize.y(), bilinear);
+                        info.image = cropped.getImage();
+                    }                    
                 }
-
-                if (image.valid())
-                {                                        
-                    // TODO:  Bilinear options?
-                    bool bilinear = layer->isCoverage() ? false : true;
-                    GeoImage cropped = image.crop( key.getExtent(), true, textureSize.x(), textureSize.y(), bilinear);
-                    info.image = cropped.getImage();
-                }                    
             }
         }
+
+        return !(progress && progress->isCanceled());
     }
 
+    // Renders one component of a GPU composite. The color filters of the
+    // component's layer get spliced in ahead of the opacity.
+    const char* compositeVertex =
+        "#version " GLSL_VERSION_STR "\n"
+        "out vec2 oe_composite_uv; \n"
+        "void oe_composite_vertex(inout vec4 vertex) \n"
+        "{ \n"
+        "    oe_composite_uv = gl_MultiTexCoord0.xy; \n"
+        "} \n";
+
+    const char* compositeFragment =
+        "#version " GLSL_VERSION_STR "\n"
+        "uniform sampler2D oe_composite_tex; \n"
+        "uniform float oe_composite_opacity; \n"
+        "in vec2 oe_composite_uv; \n"
+        "$COLOR_FILTER_HEAD"
+        "void oe_composite_fragment(inout vec4 color) \n"
+        "{ \n"
+        "    color = texture(oe_composite_tex, oe_composite_uv); \n"
+        "$COLOR_FILTER_BODY"
+        "    color.a *= oe_composite_opacity; \n"
+        "} \n";
+}
+
+//-----------------------------------------------------------------------
+
+CompositeTileSource::CompositeTileSource( const TileSourceOptions& options ) :
+TileSource     ( options ),
+_options       ( options ),
+_initialized   ( false ),
+_dynamic       ( false ),
+_gpuCompositing( false )
+{
+    //nop
+}
+
+osg::Image*
+CompositeTileSource::createImage(const TileKey&    key,
+                                 ProgressCallback* progress )
+{    
+    ImageMixVector images;
+    if (!gatherImages(_imageLayers, key, progress, images))
+        return 0L;
+
     // Now finally create the output image.
     //Recompute the number of valid images
-    numValidImages = 0;
+    unsigned numValidImages = 0;
     for (unsigned int i = 0; i < images.size(); i++)
     {
         ImageInfo& info = images[i];
         if (info.image.valid()) numValidImages++;        
     }    
 
-    if ( progress && progress->isCanceled() )
-    {
-        return 0L;
-    }
-    else if ( numValidImages == 0 )
+    if ( numValidImages == 0 )
     {
         return 0L;
     }
@@ -281,9 +447,117 @@ CompositeTileSource::createImage(const TileKey&    key,
         }        
         return result;
     }
+}
 
+osg::Texture*
+CompositeTileSource::createTexture(const TileKey&    key,
+                                   ProgressCallback* progress,
+                                   osg::Matrixf&     textureMatrix)
+{
+    ImageMixVector images;
+    if (!gatherImages(_imageLayers, key, progress, images))
+        return 0L;
+
+    textureMatrix.makeIdentity();
+
+    const GeoExtent& extent = key.getExtent();
+    osg::ref_ptr<osg::Group> root = new osg::Group();
+    osg::Vec2s textureSize;
+
+    // One textured quad per component, covering the tile's extent (the
+    // rasterizer projects the extent onto the target). They draw in
+    // layer order and blend like ImageUtils::mix.
+    for (unsigned i = 0; i < images.size(); ++i)
+    {
+        ImageInfo& info = images[i];
+        if (!info.image.valid())
+            continue;
+
+        if (root->getNumChildren() == 0)
+            textureSize.set(info.image->s(), info.image->t());
+
+        osg::Texture2D* tex = new osg::Texture2D(info.image.get());
+        tex->setWrap(osg::Texture::WRAP_S, osg::Texture::CLAMP_TO_EDGE);
+        tex->setWrap(osg::Texture::WRAP_T, osg::Texture::CLAMP_TO_EDGE);
+        tex->setFilter(osg::Texture::MIN_FILTER, osg::Texture::LINEAR);
+        tex->setFilter(osg::Texture::MAG_FILTER, osg::Texture::LINEAR);
+        tex->setResizeNonPowerOfTwoHint(false);
+        tex->setUnRefImageDataAfterApply(true);
+
+        osg::Geometry* quad = osg::createTexturedQuadGeometry(
+            osg::Vec3(extent.xMin(), extent.yMin(), 0.0),
+            osg::Vec3(extent.width(), 0.0, 0.0),
+            osg::Vec3(0.0, extent.height(), 0.0));
+        quad->setUseDisplayList(false);
+        quad->setUseVertexBufferObjects(true);
+
+        osg::StateSet* quadState = quad->getOrCreateStateSet();
+        quadState->setTextureAttribute(0, tex, osg::StateAttribute::ON);
+        quadState->addUniform(new osg::Uniform("oe_composite_opacity", info.opacity));
+
+        osg::Geode* geode = new osg::Geode();
+        geode->addDrawable(quad);
+        geode->setStateSet(_componentStateSets[i].get());
+        root->addChild(geode);
+    }
+
+    if (root->getNumChildren() == 0)
+        return 0L;
+
+    osg::Texture2D* output = new osg::Texture2D();
+    output->setTextureSize(textureSize.x(), textureSize.y());
+    output->setInternalFormat(GL_RGBA8);
+    output->setSourceFormat(GL_RGBA);
+    output->setSourceType(GL_UNSIGNED_BYTE);
+    output->setWrap(osg::Texture::WRAP_S, osg::Texture::CLAMP_TO_EDGE);
+    output->setWrap(osg::Texture::WRAP_T, osg::Texture::CLAMP_TO_EDGE);
+    output->setFilter(osg::Texture::MIN_FILTER, osg::Texture::LINEAR);
+    output->setFilter(osg::Texture::MAG_FILTER, osg::Texture::LINEAR);
+    output->setResizeNonPowerOfTwoHint(false);
+
+    // tells the terrain engine to render the components into the texture.
+    output->setUserData(new GeoNode(root.get(), extent));
+
+    return output;
+}
+
+void
+CompositeTileSource::createComponentStateSets()
+{
+    osg::ref_ptr<osg::BlendFunc> blend = new osg::BlendFunc(
+        GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA,
+        GL_ONE,       GL_ONE_MINUS_SRC_ALPHA);
+
+    for (ImageLayerVector::const_iterator i = _imageLayers.begin(); i != _imageLayers.end(); ++i)
+    {
+        ImageLayer* layer = i->get();
+
+        osg::StateSet* stateSet = new osg::StateSet();
+        stateSet->setAttributeAndModes(blend.get(), osg::StateAttribute::ON);
+        stateSet->addUniform(new osg::Uniform("oe_composite_tex", 0));
+
+        VirtualProgram* vp = VirtualProgram::getOrCreate(stateSet);
+        vp->setName("CompositeTileSource");
+
+        std::stringstream head, body;
+        const ColorFilterChain& chain = layer->getColorFilters();
+        for (ColorFilterChain::const_iterator j = chain.begin(); j != chain.end(); ++j)
+        {
+            const ColorFilter* filter = j->get();
+            head << "void " << filter->getEntryPointFunctionName() << "(inout vec4 color);\n";
+            body << "    " << filter->getEntryPointFunctionName() << "(color);\n";
+            filter->install(stateSet);
+        }
 
+        std::string fragment = compositeFragment;
+        replaceIn(fragment, "$COLOR_FILTER_HEAD", head.str());
+        replaceIn(fragment, "$COLOR_FILTER_BODY", body.str());
 
+        vp->setFunction("oe_composite_vertex", compositeVertex, ShaderComp::LOCATION_VERTEX_MODEL);
+        vp->setFunction("oe_composite_fragment", fragment, ShaderComp::LOCATION_FRAGMENT_COLORING);
+
+        _componentStateSets.push_back(stateSet);
+    }
 }
 
 osg::HeightField* CompositeTileSource::createHeightField(
@@ -467,6 +741,19 @@ CompositeTileSource::initialize(const osgDB::Options* dbOptions)
 
     setProfile( profile.get() );
 
+    // Coverage values can't blend, so only plain imagery goes on the GPU.
+    _gpuCompositing = _options.gpuCompositing() == true && !_imageLayers.empty();
+    for (ImageLayerVector::const_iterator i = _imageLayers.begin(); i != _imageLayers.end() && _gpuCompositing; ++i)
+    {
+        if (i->get()->isCoverage())
+            _gpuCompositing = false;
+    }
+
+    if (_gpuCompositing)
+    {
+        createComponentStateSets();
+    }
+
     _initialized = true;
     return STATUS_OK;
 }
@@ -29,7 +29,8 @@ using namespace osgEarth;
 
 DrapeableNode::DrapeableNode() :
 _drapingEnabled( true ),
-_updateRequested( true )
+_updateRequested( true ),
+_drapingRevision( 0u )
 {
     // Unfortunetly, there's no way to return a correct bounding sphere for
     // the node since the draping will move it to the ground. The bounds
@@ -46,6 +47,7 @@ DrapeableNode::DrapeableNode(const DrapeableNode& rhs, const osg::CopyOp& copy)
 osg::Group(rhs, copy)
 {
     _drapingEnabled = rhs._drapingEnabled;
+    _drapingRevision = 0u;
 }
 
 void
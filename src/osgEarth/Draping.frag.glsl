@@ -6,13 +6,44 @@ $GLSL_DEFAULT_PRECISION_FLOAT
 #pragma vp_order      0.6
 
 #pragma import_defines(OE_IS_PICK_CAMERA)
+#pragma import_defines(OE_DRAPING_CASCADES)
+
+#ifdef OE_DRAPING_CASCADES
+
+uniform sampler2DArray oe_overlay_tex;
+uniform mat4 oe_overlay_cascadeMatrix[OE_DRAPING_CASCADES];
+uniform float oe_overlay_cascadeFar[OE_DRAPING_CASCADES];
+in vec4 oe_overlay_vertexView;
+
+vec4 oe_overlay_sample()
+{
+    // pick the nearest cascade whose far split lies beyond this fragment
+    float dist = -oe_overlay_vertexView.z;
+    int c = OE_DRAPING_CASCADES-1;
+    for(int i=OE_DRAPING_CASCADES-2; i>=0; --i)
+    {
+        if (dist <= oe_overlay_cascadeFar[i])
+            c = i;
+    }
+    vec4 tc = oe_overlay_cascadeMatrix[c] * oe_overlay_vertexView;
+    return texture(oe_overlay_tex, vec3(tc.xy/tc.w, float(c)));
+}
+
+#else
 
 uniform sampler2D oe_overlay_tex;
 in vec4 oe_overlay_texcoord;
 
+vec4 oe_overlay_sample()
+{
+    return textureProj(oe_overlay_tex, oe_overlay_texcoord);
+}
+
+#endif
+
 void oe_overlay_fragment(inout vec4 color)
 {
-    vec4 texel = textureProj(oe_overlay_tex, oe_overlay_texcoord);
+    vec4 texel = oe_overlay_sample();
 
 #ifdef OE_IS_PICK_CAMERA
     color = texel;
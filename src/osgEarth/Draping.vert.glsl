@@ -4,12 +4,24 @@ $GLSL_DEFAULT_PRECISION_FLOAT
 #pragma vp_entryPoint oe_overlay_vertex
 #pragma vp_location   vertex_view
 
+#pragma import_defines(OE_DRAPING_CASCADES)
+
 uniform mat4 oe_overlay_texmatrix;
 uniform float oe_overlay_rttLimitZ;
 
+#ifdef OE_DRAPING_CASCADES
+// cascade projections are affine, so the fragment stage can
+// project the interpolated view-space position itself.
+out vec4 oe_overlay_vertexView;
+#else
 out vec4 oe_overlay_texcoord;
+#endif
 
 void oe_overlay_vertex(inout vec4 vertexVIEW)
 {
+#ifdef OE_DRAPING_CASCADES
+    oe_overlay_vertexView = vertexVIEW;
+#else
     oe_overlay_texcoord = oe_overlay_texmatrix * vertexVIEW;
+#endif
 }
@@ -63,9 +63,11 @@ DrapingCullSet::push(DrapeableNode* node, const osg::NodePath& path, const osg::
     entry._path.setNodePath( path );
     entry._matrix = new osg::RefMatrix( osg::computeLocalToWorld(path) );
     entry._frame = fs ? fs->getFrameNumber() : 0;
-    _bs.expandBy( osg::BoundingSphere(
+    entry._bound.set(
         node->getBound().center() * (*entry._matrix.get()),
-        node->getBound().radius() ));
+        node->getBound().radius() );
+    entry._revision = node->getDrapingRevision();
+    _bs.expandBy( entry._bound );
 }
 
 void
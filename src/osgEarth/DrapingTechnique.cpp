@@ -24,15 +24,23 @@
 #include <osgEarth/Registry>
 #include <osgEarth/Shaders>
 #include <osgEarth/Lighting>
+#include <osgEarth/GPUTimer>
+
+#include <osgEarth/StringUtils>
 
 #include <osg/BlendFunc>
 #include <osg/Texture2D>
+#include <osg/Texture2DArray>
+#include <cstring>
 
 #define LC "[DrapingTechnique] "
 
 //#define OE_TEST if (_dumpRequested) OE_INFO << std::setprecision(9)
 #define OE_TEST OE_NULL
 
+// Blend between logarithmic (1.0) and uniform (0.0) cascade splits.
+#define CASCADE_SPLIT_LAMBDA 0.75
+
 using namespace osgEarth;
 
 //---------------------------------------------------------------------------
@@ -78,7 +86,37 @@ namespace
     // Additional per-view data stored by the draping technique.
     struct LocalPerViewData : public osg::Referenced
     {
+        LocalPerViewData() : _rendered(false), _size(0.0), _signature(0u) { }
+
         osg::ref_ptr<osg::Uniform> _texGenUniform;
+
+        // State of the last single-texture rendering, so it can be reused.
+        bool                       _rendered;
+        osg::Matrixd               _rttViewMatrix;
+        osg::Matrixd               _rttProjMatrix;
+        osg::Vec3d                 _eye;
+        osg::Vec3d                 _look;
+        double                     _size;
+        unsigned                   _signature;
+
+        // One distance slice of a cascaded overlay, along with the
+        // projection it was last rendered with so it can be reused.
+        struct Cascade
+        {
+            Cascade() : _rendered(false), _empty(true), _tightSize(0.0), _signature(0u) { }
+            osg::ref_ptr<osg::Camera> _camera;
+            bool                      _rendered;   // layer holds a valid rendering
+            bool                      _empty;      // nothing to drape in this slice
+            osg::Matrixd              _rttViewMatrix;
+            osg::Matrixd              _rttProjMatrix;
+            osg::BoundingBoxd         _coverage;   // rendered extent, in _rttViewMatrix space
+            double                    _tightSize;  // size of the fitted extent when rendered
+            unsigned                  _signature;  // contents when rendered
+        };
+
+        std::vector<Cascade>       _cascades;
+        osg::ref_ptr<osg::Uniform> _cascadeMatrixUniform;
+        osg::ref_ptr<osg::Uniform> _cascadeFarUniform;
     };
 }
 
@@ -314,6 +352,125 @@ namespace
 
 //---------------------------------------------------------------------------
 
+namespace
+{
+    inline void hashCombine(unsigned& hash, unsigned value)
+    {
+        hash ^= value + 0x9e3779b9u + (hash << 6) + (hash >> 2);
+    }
+
+    inline void hashCombine(unsigned& hash, double value)
+    {
+        unsigned words[2];
+        ::memcpy(words, &value, sizeof(words));
+        hashCombine(hash, words[0]);
+        hashCombine(hash, words[1]);
+    }
+
+    inline void hashEntry(unsigned& hash, const DrapingCullSet::Entry& entry)
+    {
+        hashCombine(hash, (unsigned)(size_t)entry._node.get());
+        hashCombine(hash, entry._revision);
+        hashCombine(hash, entry._bound.center().x());
+        hashCombine(hash, entry._bound.center().y());
+        hashCombine(hash, entry._bound.center().z());
+        hashCombine(hash, (double)entry._bound.radius());
+    }
+
+    // Whether a cull set entry will actually be drawn by the draping camera.
+    inline bool isLive(const DrapingCullSet::Entry& entry, int frame)
+    {
+        return frame - entry._frame <= 1 && entry._bound.valid();
+    }
+
+    // Fits an extent, in the XY plane of an RTT view matrix, around the draped
+    // geometry that falls within one slice of the main camera's frustum.
+    // Returns false if there is nothing to drape in the slice.
+    bool fitCascade(const osg::Matrixd&                       rttViewMatrix,
+                    const std::vector<osg::Vec3d>&            slice,
+                    const std::vector<DrapingCullSet::Entry>& entries,
+                    int                                       frame,
+                    osg::BoundingBoxd&                        output)
+    {
+        output.init();
+
+        osg::BoundingBoxd sliceBox;
+        for(unsigned i=0; i<slice.size(); ++i)
+            sliceBox.expandBy( slice[i] * rttViewMatrix );
+
+        if ( !sliceBox.valid() )
+            return false;
+
+        for(unsigned i=0; i<entries.size(); ++i)
+        {
+            const DrapingCullSet::Entry& entry = entries[i];
+            if ( !isLive(entry, frame) )
+                continue;
+
+            osg::Vec3d c = entry._bound.center() * rttViewMatrix;
+            double     r = entry._bound.radius();
+
+            double xmin = osg::maximum(c.x()-r, sliceBox.xMin());
+            double xmax = osg::minimum(c.x()+r, sliceBox.xMax());
+            double ymin = osg::maximum(c.y()-r, sliceBox.yMin());
+            double ymax = osg::minimum(c.y()+r, sliceBox.yMax());
+
+            if ( xmin <= xmax && ymin <= ymax )
+            {
+                output.expandBy( osg::Vec3d(xmin, ymin, 0.0) );
+                output.expandBy( osg::Vec3d(xmax, ymax, 0.0) );
+            }
+        }
+
+        return output.valid();
+    }
+
+    // Identifies the draped contents overlapping an extent in the XY plane
+    // of an RTT view matrix, so we can tell when they change.
+    unsigned getSignature(const osg::Matrixd&                       rttViewMatrix,
+                          const osg::BoundingBoxd&                  extent,
+                          const std::vector<DrapingCullSet::Entry>& entries,
+                          int                                       frame)
+    {
+        unsigned hash = 0u;
+
+        for(unsigned i=0; i<entries.size(); ++i)
+        {
+            const DrapingCullSet::Entry& entry = entries[i];
+            if ( !isLive(entry, frame) )
+                continue;
+
+            osg::Vec3d c = entry._bound.center() * rttViewMatrix;
+            double     r = entry._bound.radius();
+
+            if ( c.x()+r >= extent.xMin() && c.x()-r <= extent.xMax() &&
+                 c.y()+r >= extent.yMin() && c.y()-r <= extent.yMax() )
+            {
+                hashEntry(hash, entry);
+            }
+        }
+
+        return hash;
+    }
+
+    // Identifies all the draped contents.
+    unsigned getSignature(const std::vector<DrapingCullSet::Entry>& entries,
+                          int                                       frame)
+    {
+        unsigned hash = 0u;
+
+        for(unsigned i=0; i<entries.size(); ++i)
+        {
+            if ( isLive(entries[i], frame) )
+                hashEntry(hash, entries[i]);
+        }
+
+        return hash;
+    }
+}
+
+//---------------------------------------------------------------------------
+
 #undef  LC
 #define LC "[DrapingTechnique] "
 
@@ -323,7 +480,9 @@ _textureSize     ( 1024 ),
 _mipmapping      ( false ),
 _rttBlending     ( true ),
 _attachStencil   ( false ),
-_maxFarNearRatio ( 5.0 )
+_maxFarNearRatio ( 5.0 ),
+_numCascades     ( 1u ),
+_updateThreshold( 0.0 )
 {
     _supported = Registry::capabilities().supportsGLSL();
 
@@ -343,7 +502,8 @@ DrapingTechnique::hasData(OverlayDecorator::TechRTTParams& params) const
 namespace
 {
     // Customized texture class will disable texture filtering when rendering under a pick camera.
-    class DrapingTexture : public osg::Texture2D
+    template<typename TEXTURE>
+    class DrapingTexture : public TEXTURE
     {
     public:
         virtual void apply(osg::State& state) const
@@ -351,20 +511,20 @@ namespace
             const osg::StateSet::DefineList& defines = state.getDefineMap().currentDefines;
             if (defines.find("OE_IS_PICK_CAMERA") != defines.end())
             {
-                FilterMode minFilter = _min_filter;
-                FilterMode magFilter = _mag_filter;
+                osg::Texture::FilterMode minFilter = this->_min_filter;
+                osg::Texture::FilterMode magFilter = this->_mag_filter;
                 DrapingTexture* ncThis = const_cast<DrapingTexture*>(this);
-                ncThis->_min_filter = NEAREST;
-                ncThis->_mag_filter = NEAREST;
+                ncThis->_min_filter = osg::Texture::NEAREST;
+                ncThis->_mag_filter = osg::Texture::NEAREST;
                 ncThis->dirtyTextureParameters();
-                osg::Texture2D::apply(state);
+                TEXTURE::apply(state);
                 ncThis->_min_filter = minFilter;
                 ncThis->_mag_filter = magFilter;
                 ncThis->dirtyTextureParameters();
             }
             else
             {
-                osg::Texture2D::apply(state);
+                TEXTURE::apply(state);
             }
         }
     };
@@ -375,19 +535,37 @@ DrapingTechnique::setUpCamera(OverlayDecorator::TechRTTParams& params)
 {
     OE_INFO << LC << "Using texture size = " << _textureSize.get() << std::endl;
 
+    bool cascaded = _numCascades > 1u;
+    if ( cascaded )
+    {
+        OE_INFO << LC << "Using " << _numCascades << " cascades" << std::endl;
+    }
+
     // create the projected texture:
-    osg::Texture2D* projTexture = new DrapingTexture(); 
+    osg::Texture* projTexture;
 
 #ifdef __IOS__
     int mainViewportWidth = params._mainCamera->getViewport()->width();
     int mainViewportHeight = params._mainCamera->getViewport()->height();
-#endif
-    
-#ifdef __IOS__
-    projTexture->setTextureSize( mainViewportWidth, mainViewportHeight );
 #else
-    projTexture->setTextureSize( *_textureSize, *_textureSize );
+    int mainViewportWidth = *_textureSize;
+    int mainViewportHeight = *_textureSize;
 #endif
+
+    if ( cascaded )
+    {
+        // one layer per cascade:
+        osg::Texture2DArray* tex = new DrapingTexture<osg::Texture2DArray>();
+        tex->setTextureSize( mainViewportWidth, mainViewportHeight, _numCascades );
+        projTexture = tex;
+    }
+    else
+    {
+        osg::Texture2D* tex = new DrapingTexture<osg::Texture2D>();
+        tex->setTextureSize( mainViewportWidth, mainViewportHeight );
+        projTexture = tex;
+    }
+
     projTexture->setInternalFormat( GL_RGBA8 );  //use GL_RGBA8 for compatibility with osg's glTexStorage extension
     projTexture->setSourceFormat( GL_RGBA );
     projTexture->setSourceType( GL_UNSIGNED_BYTE );
@@ -398,60 +576,87 @@ DrapingTechnique::setUpCamera(OverlayDecorator::TechRTTParams& params)
     //projTexture->setWrap( osg::Texture::WRAP_R, osg::Texture::CLAMP_TO_EDGE );
     projTexture->setBorderColor( osg::Vec4(0,0,0,0) );
 
-    // set up the RTT camera:
-    params._rttCamera = new DrapingCamera(_drapingManager);
-    params._rttCamera->setUserData(params._mainCamera);
-    params._rttCamera->setClearColor( osg::Vec4f(0,0,0,0) );
-    // this ref frame causes the RTT to inherit its viewpoint from above (in order to properly
-    // process PagedLOD's etc. -- it doesn't affect the perspective of the RTT camera though)
-    params._rttCamera->setReferenceFrame( osg::Camera::ABSOLUTE_RF_INHERIT_VIEWPOINT );
-#ifdef __IOS__
-    params._rttCamera->setViewport( 0, 0, mainViewportWidth, mainViewportHeight );
-#else
-    params._rttCamera->setViewport( 0, 0, *_textureSize, *_textureSize );
-#endif
-    params._rttCamera->setComputeNearFarMode( osg::CullSettings::DO_NOT_COMPUTE_NEAR_FAR );
-    params._rttCamera->setRenderOrder( osg::Camera::PRE_RENDER );
-    params._rttCamera->setRenderTargetImplementation( osg::Camera::FRAME_BUFFER_OBJECT );
-    params._rttCamera->setImplicitBufferAttachmentMask(0, 0);
-    
+    // fire up the local per-view data:
+    LocalPerViewData* local = new LocalPerViewData();
+    params._techniqueData = local;
+
+    // set up a StateSet for the RTT camera(s).
+    osg::StateSet* rttStateSet = new osg::StateSet();
+
+    // set up the RTT camera(s). Cascades all draw into the same texture,
+    // each to its own layer.
+    unsigned numCameras = cascaded ? _numCascades : 1u;
+    for(unsigned layer = 0; layer < numCameras; ++layer)
+    {
+        osg::Camera* camera = new DrapingCamera(_drapingManager);
+        camera->setUserData(params._mainCamera);
+        camera->setClearColor( osg::Vec4f(0,0,0,0) );
+        // this ref frame causes the RTT to inherit its viewpoint from above (in order to properly
+        // process PagedLOD's etc. -- it doesn't affect the perspective of the RTT camera though)
+        camera->setReferenceFrame( osg::Camera::ABSOLUTE_RF_INHERIT_VIEWPOINT );
+        camera->setViewport( 0, 0, mainViewportWidth, mainViewportHeight );
+        camera->setComputeNearFarMode( osg::CullSettings::DO_NOT_COMPUTE_NEAR_FAR );
+        camera->setRenderOrder( osg::Camera::PRE_RENDER );
+        camera->setRenderTargetImplementation( osg::Camera::FRAME_BUFFER_OBJECT );
+        camera->setImplicitBufferAttachmentMask(0, 0);
+
 #ifdef __IOS__
-    params._rttCamera->attach( osg::Camera::COLOR_BUFFER1, projTexture, 0, 0, _mipmapping );
+        camera->attach( osg::Camera::COLOR_BUFFER1, projTexture, 0, layer, _mipmapping );
 #else
-    params._rttCamera->attach( osg::Camera::COLOR_BUFFER0, projTexture, 0, 0, _mipmapping );
+        camera->attach( osg::Camera::COLOR_BUFFER0, projTexture, 0, layer, _mipmapping );
 #endif
 
-    if ( _attachStencil )
-    {
-        OE_INFO << LC << "Attaching a stencil buffer to the RTT camera" << std::endl;
-
-        // try a depth-packed buffer. failing that, try a normal one.. if the FBO doesn't support
-        // that (which is doesn't on some GPUs like Intel), it will automatically fall back on 
-        // a PBUFFER_RTT impl
-        if ( Registry::capabilities().supportsDepthPackedStencilBuffer() )
+        if ( _attachStencil )
         {
+            if ( layer == 0u )
+            {
+                OE_INFO << LC << "Attaching a stencil buffer to the RTT camera" << std::endl;
+            }
+
+            // try a depth-packed buffer. failing that, try a normal one.. if the FBO doesn't support
+            // that (which is doesn't on some GPUs like Intel), it will automatically fall back on 
+            // a PBUFFER_RTT impl
+            if ( Registry::capabilities().supportsDepthPackedStencilBuffer() )
+            {
 #if defined(OSG_GLES2_AVAILABLE) || defined(OSG_GLES3_AVAILABLE)
-            params._rttCamera->attach( osg::Camera::PACKED_DEPTH_STENCIL_BUFFER, GL_DEPTH24_STENCIL8_EXT );
+                camera->attach( osg::Camera::PACKED_DEPTH_STENCIL_BUFFER, GL_DEPTH24_STENCIL8_EXT );
 #else
-            params._rttCamera->attach( osg::Camera::PACKED_DEPTH_STENCIL_BUFFER, GL_DEPTH_STENCIL_EXT );
+                camera->attach( osg::Camera::PACKED_DEPTH_STENCIL_BUFFER, GL_DEPTH_STENCIL_EXT );
 #endif
+            }
+            else
+            {
+                camera->attach( osg::Camera::STENCIL_BUFFER, GL_STENCIL_INDEX );
+            }
+
+            camera->setClearStencil( 0 );
+            camera->setClearMask( GL_COLOR_BUFFER_BIT | GL_STENCIL_BUFFER_BIT );
         }
         else
         {
-            params._rttCamera->attach( osg::Camera::STENCIL_BUFFER, GL_STENCIL_INDEX );
+            camera->setClearMask( GL_COLOR_BUFFER_BIT );
         }
 
-        params._rttCamera->setClearStencil( 0 );
-        params._rttCamera->setClearMask( GL_COLOR_BUFFER_BIT | GL_STENCIL_BUFFER_BIT );
-    }
-    else
-    {
-        params._rttCamera->setClearMask( GL_COLOR_BUFFER_BIT );
-    }
+        camera->setStateSet( rttStateSet );
 
+        GPUTimer::install( camera, "draping" );
+
+        // attach the overlay group to the camera. 
+        // TODO: we should probably lock this since other cull traversals might be accessing the group
+        //       while we are changing its children.
+        camera->addChild( params._group );
+
+        if ( cascaded )
+        {
+            local->_cascades.push_back( LocalPerViewData::Cascade() );
+            local->_cascades.back()._camera = camera;
+        }
 
-    // set up a StateSet for the RTT camera.
-    osg::StateSet* rttStateSet = params._rttCamera->getOrCreateStateSet();
+        if ( layer == 0u )
+        {
+            params._rttCamera = camera;
+        }
+    }
 
     osg::StateAttribute::OverrideValue forceOff =
         osg::StateAttribute::OFF | osg::StateAttribute::PROTECTED | osg::StateAttribute::OVERRIDE;
@@ -483,13 +688,10 @@ DrapingTechnique::setUpCamera(OverlayDecorator::TechRTTParams& params)
         rttStateSet->setMode(GL_BLEND, osg::StateAttribute::OFF | osg::StateAttribute::OVERRIDE);
     }
 
-    // attach the overlay group to the camera. 
-    // TODO: we should probably lock this since other cull traversals might be accessing the group
-    //       while we are changing its children.
-    params._rttCamera->addChild( params._group );
-
     // overlay geometry is rendered with no depth testing, and in the order it's found in the
-    // scene graph... until further notice.
+    // scene graph... until further notice. That also means it has no use for a reverse-Z
+    // depth buffer on the main camera, whose clip-space remapping would undo the warp clip.
+    rttStateSet->setDefine("OE_REVERSE_Z", osg::StateAttribute::OFF);
     rttStateSet->setMode(GL_DEPTH_TEST, 0);
     rttStateSet->setRenderBinDetails(1, "TraversalOrderBin", osg::StateSet::OVERRIDE_PROTECTED_RENDERBIN_DETAILS );
 
@@ -497,12 +699,8 @@ DrapingTechnique::setUpCamera(OverlayDecorator::TechRTTParams& params)
     // apply to the terrain before cull-traversing it. This will activate the projective
     // texturing on the terrain.
     params._terrainStateSet->setTextureAttributeAndModes( *_textureUnit, projTexture, osg::StateAttribute::ON );
-
-    // fire up the local per-view data:
-    LocalPerViewData* local = new LocalPerViewData();
-    params._techniqueData = local;
     
-    if ( _maxFarNearRatio > 1.0 )
+    if ( _maxFarNearRatio > 1.0 && !cascaded )
     {
         // Custom clipper that accounts for the projection matrix warping.
         // Without this, you will get geometry beyond the original ortho far plane.
@@ -528,11 +726,25 @@ DrapingTechnique::setUpCamera(OverlayDecorator::TechRTTParams& params)
 
     // sampler for projected texture:
     params._terrainStateSet->getOrCreateUniform(
-        "oe_overlay_tex", osg::Uniform::SAMPLER_2D )->set( *_textureUnit );
+        "oe_overlay_tex", cascaded ? osg::Uniform::SAMPLER_2D_ARRAY : osg::Uniform::SAMPLER_2D )->set( *_textureUnit );
 
-    // the texture projection matrix uniform.
-    local->_texGenUniform = params._terrainStateSet->getOrCreateUniform(
-        "oe_overlay_texmatrix", osg::Uniform::FLOAT_MAT4 );
+    if ( cascaded )
+    {
+        // per-cascade texture projection matrices and far split distances.
+        params._terrainStateSet->setDefine("OE_DRAPING_CASCADES", Stringify() << _numCascades);
+
+        local->_cascadeMatrixUniform = params._terrainStateSet->getOrCreateUniform(
+            "oe_overlay_cascadeMatrix", osg::Uniform::FLOAT_MAT4, _numCascades );
+
+        local->_cascadeFarUniform = params._terrainStateSet->getOrCreateUniform(
+            "oe_overlay_cascadeFar", osg::Uniform::FLOAT, _numCascades );
+    }
+    else
+    {
+        // the texture projection matrix uniform.
+        local->_texGenUniform = params._terrainStateSet->getOrCreateUniform(
+            "oe_overlay_texmatrix", osg::Uniform::FLOAT_MAT4 );
+    }
 
     // shaders
     Shaders pkg;
@@ -540,7 +752,6 @@ DrapingTechnique::setUpCamera(OverlayDecorator::TechRTTParams& params)
     pkg.load( terrain_vp, pkg.DrapingFragment );
 }
 
-
 void
 DrapingTechnique::preCullTerrain(OverlayDecorator::TechRTTParams& params,
                                  osgUtil::CullVisitor*             cv )
@@ -586,6 +797,12 @@ DrapingTechnique::preCullTerrain(OverlayDecorator::TechRTTParams& params,
         // We do this so we can detect the RTT's camera's parent for 
         // things like auto-scaling, picking, and so on.
         params._rttCamera->setView(cv->getCurrentCamera()->getView());
+
+        LocalPerViewData& local = *static_cast<LocalPerViewData*>(params._techniqueData.get());
+        for(unsigned i=0; i<local._cascades.size(); ++i)
+        {
+            local._cascades[i]._camera->setView(cv->getCurrentCamera()->getView());
+        }
     }
 }
        
@@ -603,21 +820,64 @@ DrapingTechnique::cullOverlayGroup(OverlayDecorator::TechRTTParams& params,
     {
         LocalPerViewData& local = *static_cast<LocalPerViewData*>(params._techniqueData.get());
 
+        if ( !local._cascades.empty() )
+        {
+            cullCascades( params, cv );
+            return;
+        }
+
         // this xforms from clip [-1..1] to texture [0..1] space
         static osg::Matrix s_scaleBiasMat = 
             osg::Matrix::translate(1.0,1.0,1.0) * 
             osg::Matrix::scale(0.5,0.5,0.5);
 
-        // resolution weighting based on camera distance.
-        if ( _maxFarNearRatio > 1.0 )
+        // Reuse the last rendering while the view stays within the update
+        // threshold and the draped contents do not change.
+        bool render = true;
+
+        osg::Vec3d look = osg::Matrixd::transform3x3( *cv->getModelViewMatrix(), osg::Vec3d(0,0,-1) );
+        look.normalize();
+
+        double left, right, bottom, top, orthoNear, orthoFar;
+        params._rttProjMatrix.getOrtho( left, right, bottom, top, orthoNear, orthoFar );
+        double size = osg::maximum(right-left, top-bottom);
+
+        const std::vector<DrapingCullSet::Entry>& entries = _drapingManager.get(params._mainCamera).getEntries();
+        int frame = cv->getFrameStamp() ? cv->getFrameStamp()->getFrameNumber() : 0;
+
+        if ( _updateThreshold > 0.0 && local._rendered )
         {
-            optimizeProjectionMatrix( params, _maxFarNearRatio );
+            if ((params._eyeWorld - local._eye).length() <= _updateThreshold*local._size &&
+                (look - local._look).length() <= _updateThreshold &&
+                fabs(size - local._size) <= _updateThreshold*local._size &&
+                getSignature(entries, frame) == local._signature)
+            {
+                render = false;
+            }
         }
 
-        params._rttCamera->setViewMatrix      ( params._rttViewMatrix );
-        params._rttCamera->setProjectionMatrix( params._rttProjMatrix );
+        if ( render )
+        {
+            // resolution weighting based on camera distance.
+            if ( _maxFarNearRatio > 1.0 )
+            {
+                optimizeProjectionMatrix( params, _maxFarNearRatio );
+            }
 
-        osg::Matrix VPT = params._rttViewMatrix * params._rttProjMatrix * s_scaleBiasMat;
+            params._rttCamera->setViewMatrix      ( params._rttViewMatrix );
+            params._rttCamera->setProjectionMatrix( params._rttProjMatrix );
+
+            local._rttViewMatrix = params._rttViewMatrix;
+            local._rttProjMatrix = params._rttProjMatrix;
+            local._eye           = params._eyeWorld;
+            local._look          = look;
+            local._size          = size;
+            local._signature     = _updateThreshold > 0.0 ? getSignature(entries, frame) : 0u;
+            local._rendered      = true;
+        }
+
+        // Always project with the matrices the texture was rendered with.
+        osg::Matrix VPT = local._rttViewMatrix * local._rttProjMatrix * s_scaleBiasMat;
 
         if ( local._texGenUniform.valid() )
         {
@@ -639,7 +899,152 @@ DrapingTechnique::cullOverlayGroup(OverlayDecorator::TechRTTParams& params,
         }
 
         // traverse the overlay group (via the RTT camera).
-        static_cast<DrapingCamera*>(params._rttCamera.get())->accept( *cv, cv->getCurrentCamera() );
+        if ( render )
+        {
+            static_cast<DrapingCamera*>(params._rttCamera.get())->accept( *cv, cv->getCurrentCamera() );
+        }
+    }
+}
+
+void
+DrapingTechnique::cullCascades(OverlayDecorator::TechRTTParams& params,
+                               osgUtil::CullVisitor*            cv )
+{
+    LocalPerViewData& local = *static_cast<LocalPerViewData*>(params._techniqueData.get());
+
+    // this xforms from clip [-1..1] to texture [0..1] space
+    static osg::Matrix s_scaleBiasMat = 
+        osg::Matrix::translate(1.0,1.0,1.0) * 
+        osg::Matrix::scale(0.5,0.5,0.5);
+
+    // sends every fragment to the (transparent) texture border
+    static osg::Matrix s_emptyMat =
+        osg::Matrix::scale(0.0,0.0,0.0) *
+        osg::Matrix::translate(-1.0,-1.0,0.0);
+
+    const osg::Matrixd& MV = *cv->getModelViewMatrix();
+    osg::Matrixd inverseMV;
+    inverseMV.invert( MV );
+
+    // line of sight in world space; cascades split along it, matching
+    // the view-space depth the terrain shader uses to pick a cascade.
+    osg::Vec3d look = osg::Matrixd::transform3x3( MV, osg::Vec3d(0,0,-1) );
+    look.normalize();
+    const osg::Vec3d& eye = params._eyeWorld;
+
+    // depth range of the visible frustum:
+    std::vector<osg::Vec3d> verts;
+    params._visibleFrustumPH.getPoints( verts );
+
+    double zNear = DBL_MAX, zFar = 0.0;
+    for(unsigned i=0; i<verts.size(); ++i)
+    {
+        double d = (verts[i]-eye) * look;
+        zNear = osg::minimum(zNear, d);
+        zFar  = osg::maximum(zFar, d);
+    }
+    zNear = osg::maximum(zNear, 1.0);
+    zFar  = osg::maximum(zFar, zNear+1.0);
+
+    // keep the ortho depth range the decorator established:
+    double left, right, bottom, top, orthoNear, orthoFar;
+    params._rttProjMatrix.getOrtho( left, right, bottom, top, orthoNear, orthoFar );
+
+    const std::vector<DrapingCullSet::Entry>& entries = _drapingManager.get(params._mainCamera).getEntries();
+    int frame = cv->getFrameStamp() ? cv->getFrameStamp()->getFrameNumber() : 0;
+
+    unsigned numCascades = local._cascades.size();
+    double nearSplit = zNear;
+
+    for(unsigned i=0; i<numCascades; ++i)
+    {
+        LocalPerViewData::Cascade& cascade = local._cascades[i];
+
+        // "practical" split scheme, as used for cascaded shadow maps
+        double t = (double)(i+1) / (double)numCascades;
+        double farSplit = i+1 == numCascades ? zFar :
+            CASCADE_SPLIT_LAMBDA*zNear*pow(zFar/zNear, t) +
+            (1.0-CASCADE_SPLIT_LAMBDA)*(zNear + (zFar-zNear)*t);
+
+        local._cascadeFarUniform->setElement( i, (float)farSplit );
+
+        // slice this cascade out of the visible frustum:
+        osgShadow::ConvexPolyhedron slicePH( params._visibleFrustumPH );
+        if ( i > 0 )
+            slicePH.cut( osg::Plane(look, eye + look*nearSplit) );
+        if ( i+1 < numCascades )
+            slicePH.cut( osg::Plane(-look, eye + look*farSplit) );
+
+        std::vector<osg::Vec3d> slice;
+        slicePH.getPoints( slice );
+
+        nearSplit = farSplit;
+
+        // Reuse the last rendering if it still covers the slice at about the
+        // same resolution and the contents within it did not change.
+        bool render = true;
+        osg::BoundingBoxd fit;
+
+        if ( _updateThreshold > 0.0 && cascade._rendered &&
+             fitCascade(cascade._rttViewMatrix, slice, entries, frame, fit) )
+        {
+            double size = osg::maximum(fit.xMax()-fit.xMin(), fit.yMax()-fit.yMin());
+
+            if (cascade._coverage.contains(fit._min) &&
+                cascade._coverage.contains(fit._max) &&
+                size >= cascade._tightSize * (1.0-_updateThreshold) &&
+                getSignature(cascade._rttViewMatrix, cascade._coverage, entries, frame) == cascade._signature)
+            {
+                render = false;
+                cascade._empty = false;
+            }
+        }
+
+        if ( render )
+        {
+            if ( fitCascade(params._rttViewMatrix, slice, entries, frame, fit) )
+            {
+                // pad the extent so small camera motions stay inside it
+                double size = osg::maximum(fit.xMax()-fit.xMin(), fit.yMax()-fit.yMin());
+                double pad  = osg::maximum(_updateThreshold*size, 0.5);
+
+                cascade._coverage.set(
+                    fit.xMin()-pad, fit.yMin()-pad, -1.0,
+                    fit.xMax()+pad, fit.yMax()+pad,  1.0 );
+
+                cascade._rttViewMatrix = params._rttViewMatrix;
+                cascade._rttProjMatrix.makeOrtho(
+                    cascade._coverage.xMin(), cascade._coverage.xMax(),
+                    cascade._coverage.yMin(), cascade._coverage.yMax(),
+                    orthoNear, orthoFar );
+
+                cascade._tightSize = size;
+                cascade._signature = getSignature(cascade._rttViewMatrix, cascade._coverage, entries, frame);
+                cascade._rendered  = true;
+                cascade._empty     = false;
+
+                cascade._camera->setViewMatrix( cascade._rttViewMatrix );
+                cascade._camera->setProjectionMatrix( cascade._rttProjMatrix );
+                static_cast<DrapingCamera*>(cascade._camera.get())->accept( *cv, cv->getCurrentCamera() );
+            }
+            else
+            {
+                cascade._empty = true;
+            }
+        }
+
+        // Always project with the matrices the layer was rendered with.
+        // (Same caveat as the single-texture path regarding setting
+        // uniforms during CULL.)
+        if ( cascade._empty )
+        {
+            local._cascadeMatrixUniform->setElement( i, s_emptyMat );
+        }
+        else
+        {
+            local._cascadeMatrixUniform->setElement( i,
+                inverseMV * cascade._rttViewMatrix * cascade._rttProjMatrix * s_scaleBiasMat );
+        }
     }
 }
 
@@ -711,6 +1116,18 @@ DrapingTechnique::getResolutionRatio() const
     return (float)_maxFarNearRatio;
 }
 
+void
+DrapingTechnique::setNumCascades(unsigned value)
+{
+    _numCascades = osg::clampBetween(value, 1u, 8u);
+}
+
+void
+DrapingTechnique::setUpdateThreshold(float value)
+{
+    _updateThreshold = (double)osg::clampBetween(value, 0.0f, 1.0f);
+}
+
 void
 DrapingTechnique::onInstall( TerrainEngineNode* engine )
 {
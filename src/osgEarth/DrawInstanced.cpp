@@ -171,6 +171,29 @@ ConvertToDrawInstanced::apply(osg::Drawable& drawable)
 void
 ConvertToDrawInstanced::apply(osg::LOD& lod)
 {
+    // With distance ranges, keep every level and let the shader choose one
+    // for each instance: wrap each child in a group whose uniform holds its
+    // range, and open up the LOD so the CPU draws them all.
+    if (lod.getRangeMode() == osg::LOD::DISTANCE_FROM_EYE_POINT &&
+        lod.getNumRanges() == lod.getNumChildren() &&
+        lod.getNumChildren() > 1)
+    {
+        for(unsigned i=0; i<lod.getNumChildren(); ++i)
+        {
+            const osg::LOD::MinMaxPair& range = lod.getRangeList()[i];
+
+            osg::Group* wrapper = new osg::Group();
+            wrapper->addChild( lod.getChild(i) );
+            wrapper->getOrCreateStateSet()->addUniform(new osg::Uniform("oe_di_range", osg::Vec2f(range.first, range.second)));
+
+            lod.setChild( i, wrapper );
+            lod.setRange( i, 0.0f, FLT_MAX );
+        }
+
+        apply(static_cast<osg::Group&>(lod));
+        return;
+    }
+
     // find the highest LOD:
     int   minIndex = 0;
     float minRange = FLT_MAX;
@@ -396,6 +419,11 @@ DrawInstanced::convertGraphToUseDrawInstanced( osg::Group* parent )
         stateset->setTextureAttribute(cdi.getTextureImageUnit(), posTBO);
         stateset->getOrCreateUniform("oe_di_postex_TBO", osg::Uniform::SAMPLER_BUFFER)->set(cdi.getTextureImageUnit());
 
+        // Model bounds and default range for the per-instance culling in the shader:
+        osg::BoundingSphere nodeBound(nodeBox);
+        stateset->addUniform(new osg::Uniform("oe_di_bound", osg::Vec4f(nodeBound.center(), nodeBound.radius())));
+        stateset->addUniform(new osg::Uniform("oe_di_range", osg::Vec2f(0.0f, FLT_MAX)));
+
         // Tell the SG to skip the positioning TBO.
         ShaderGenerator::setIgnoreHint(posTBO, true);
 
@@ -20,7 +20,12 @@
 #include <osgEarth/HeightFieldUtils>
 #include <osgEarth/Progress>
 #include <osgEarth/Metrics>
+#include <osgEarth/TileLoadTrace>
 #include <osgEarth/URI>
+#include <osgEarth/JobScheduler>
+#include <osgEarth/Registry>
+#include <OpenThreads/Thread>
+#include <algorithm>
 
 using namespace osgEarth;
 using namespace OpenThreads;
@@ -300,6 +305,8 @@ ElevationLayer::createHeightFieldFromTileSource(const TileKey&    key,
             {
                 source->getBlacklist()->add( key );
             }
+
+            setKnownEmpty( key, progress );
         }
     }
 
@@ -465,6 +472,15 @@ ElevationLayer::assembleHeightField(const TileKey& key,
     }
 }
 
+std::string
+ElevationLayer::getCacheKey(const TileKey& key) const
+{
+    // the cache key combines the Key and the horizontal profile.
+    return Cache::makeCacheKey(
+        Stringify() << key.str() << "-" << key.getProfile()->getHorizSignature(),
+        "elevation");
+}
+
 GeoHeightField
 ElevationLayer::createHeightField(const TileKey& key)
 {
@@ -479,6 +495,8 @@ ElevationLayer::createHeightField(const TileKey&    key,
                      "key", key.str().c_str(),
                      "name", getName().c_str());
 
+    PendingRequest pending(this);
+
     if (getStatus().isError())
     {
         return GeoHeightField::INVALID;
@@ -490,6 +508,12 @@ ElevationLayer::createHeightField(const TileKey&    key,
         return GeoHeightField::INVALID;
     }
 
+    // Nothing there; skip both the cache and the source.
+    if ( isKnownEmpty(key) )
+    {
+        return GeoHeightField::INVALID;
+    }
+
     GeoHeightField result;
     osg::ref_ptr<osg::HeightField> hf;
     osg::ref_ptr<NormalMap> normalMap;
@@ -497,11 +521,7 @@ ElevationLayer::createHeightField(const TileKey&    key,
     // Check the memory cache first
     bool fromMemCache = false;
 
-    // cache key combines the key with the full signature (incl vdatum)
-    // the cache key combines the Key and the horizontal profile.
-    std::string cacheKey = Cache::makeCacheKey(
-        Stringify() << key.str() << "-" << key.getProfile()->getHorizSignature(),
-        "elevation");
+    std::string cacheKey = getCacheKey(key);
     const CachePolicy& policy = getCacheSettings()->cachePolicy().get();
 
     if ( _memCache.valid() )
@@ -553,7 +573,11 @@ ElevationLayer::createHeightField(const TileKey&    key,
 
         if ( cacheBin && policy.isCacheReadable() )
         {
-            ReadResult r = cacheBin->readObject(cacheKey, 0L);
+            ReadResult r;
+            {
+                TileLoadTrace::ScopedStage traceStage("cache.read");
+                r = cacheBin->readObject(cacheKey, 0L);
+            }
             if ( r.succeeded() )
             {            
                 bool expired = policy.isExpired(r.lastModifiedTime());
@@ -618,6 +642,7 @@ ElevationLayer::createHeightField(const TileKey&    key,
                  !fromCache    &&
                  policy.isCacheWriteable() )
             {
+                TileLoadTrace::ScopedStage traceStage("cache.write");
                 cacheBin->write(cacheKey, hf.get(), 0L);
             }
 
@@ -656,15 +681,9 @@ ElevationLayer::createHeightField(const TileKey&    key,
         return GeoHeightField::INVALID;
     }
 
-    // write to mem cache if needed:
-    if ( result.valid() && !fromMemCache && _memCache.valid() )
-    {
-        CacheBin* bin = _memCache->getOrCreateDefaultBin();
-        bin->write(cacheKey, result.getHeightField(), 0L);
-    }
-
-    // post-processing:
-    if ( result.valid() )
+    // post-processing (a heightfield from the mem cache already had it; the
+    // cache shares it, so it must not change):
+    if ( result.valid() && !fromMemCache )
     {
         if ( options().noDataPolicy() == NODATA_MSL )
         {
@@ -690,6 +709,14 @@ ElevationLayer::createHeightField(const TileKey&    key,
         }
     }
 
+    // write to mem cache if needed. The terrain and the ElevationPool both
+    // sample this layer's rasters through here, so they share one copy.
+    if ( result.valid() && !fromMemCache && _memCache.valid() )
+    {
+        CacheBin* bin = _memCache->getOrCreateDefaultBin();
+        bin->write(cacheKey, result.getHeightField(), 0L);
+    }
+
     return result;
 }
 
@@ -724,6 +751,156 @@ namespace
     //typedef std::pair<RefElevationLayer, TileKey> LayerAndKey;
     typedef std::vector<LayerData>              LayerDataVector;
 
+    // Per-fetch progress, so concurrent fetches don't share a message
+    // buffer. Cancels along with the fetch group.
+    struct FetchProgress : public ProgressCallback
+    {
+        osg::ref_ptr<ProgressCallback> _group;
+
+        FetchProgress(ProgressCallback* group) : _group(group) { }
+
+        bool isCanceled() { return _canceled || (_group.valid() && _group->isCanceled()); }
+    };
+
+    //! Fetches one layer's heightfield for a tile. Contenders fall back on
+    //! parent keys until a heightfield comes back; offsets don't.
+    struct FetchHeightField : public TaskRequest
+    {
+        osg::ref_ptr<ElevationLayer> _layer;
+        TileKey        _key;
+        TileKey        _actualKey;
+        GeoExtent      _tileExtent;
+        bool           _allowFallback;
+        GeoHeightField _hf;
+        bool           _coversTile;
+        std::string    _message;
+
+        FetchHeightField(const LayerData& ld, const GeoExtent& tileExtent, bool allowFallback) :
+            _layer(ld.layer.get()),
+            _key(ld.key),
+            _actualKey(ld.key),
+            _tileExtent(tileExtent),
+            _allowFallback(allowFallback),
+            _coversTile(false) { }
+
+        bool isFallback() const { return _actualKey != _key; }
+
+        void operator()(ProgressCallback* group)
+        {
+            osg::ref_ptr<ProgressCallback> progress = new FetchProgress(group);
+
+            if (!_allowFallback)
+            {
+                _hf = _layer->createHeightField(_key, progress.get());
+            }
+            else
+            {
+                while (!_hf.valid() && _actualKey.valid() && _layer->isKeyInLegalRange(_actualKey))
+                {
+                    if (progress->isCanceled())
+                        return;
+
+                    _hf = _layer->createHeightField(_actualKey, progress.get());
+                    if (!_hf.valid())
+                        _actualKey = _actualKey.createParentKey();
+                }
+            }
+
+            if (!_hf.valid())
+            {
+                _message = progress->message();
+                return;
+            }
+
+            // A heightfield that spans the whole tile without any NODATA
+            // resolves every sample, so lower-priority layers won't be needed.
+            if (_hf.getExtent().contains(_tileExtent))
+            {
+                const osg::FloatArray* heights = _hf.getHeightField()->getFloatArray();
+                _coversTile = std::find(heights->begin(), heights->end(), NO_DATA_VALUE) == heights->end();
+            }
+        }
+    };
+    typedef std::vector<osg::ref_ptr<FetchHeightField> > FetchVector;
+
+    //! Per-layer sampling parameters for compositing. A heightfield in the
+    //! tile's own SRS that spans the whole tile is sampled directly, skipping
+    //! the per-sample transform and bounds checks in GeoHeightField::getElevation.
+    struct CompositeSource
+    {
+        const FetchHeightField* fetch;
+        bool   direct;
+        double xmin, ymin, xInterval, yInterval;
+        short  deltaLOD;
+    };
+
+    //! Runs a set of fetches on the job scheduler (or inline if there's only
+    //! one) and waits for them. Lower-priority contenders are abandoned as
+    //! soon as a higher-priority contender covers the whole tile.
+    bool runFetches(FetchVector& contenders, FetchVector& offsets, ProgressCallback* progress)
+    {
+        if (contenders.size() + offsets.size() == 1)
+        {
+            FetchHeightField* fetch = contenders.empty() ? offsets[0].get() : contenders[0].get();
+            (*fetch)(progress);
+            return !(progress && progress->isCanceled());
+        }
+
+        JobScheduler* scheduler = Registry::instance()->getJobScheduler();
+        bool onWorker = scheduler->isWorkerThread();
+
+        // separate groups so that short-circuiting the contenders
+        // doesn't cancel the offsets
+        osg::ref_ptr<JobGroup> contenderGroup = new JobGroup();
+        osg::ref_ptr<JobGroup> offsetGroup = new JobGroup();
+
+        for (unsigned i = 0; i < contenders.size(); ++i)
+            scheduler->submit(contenders[i].get(), JobScheduler::LANE_HIGH, contenderGroup.get());
+        for (unsigned i = 0; i < offsets.size(); ++i)
+            scheduler->submit(offsets[i].get(), JobScheduler::LANE_HIGH, offsetGroup.get());
+
+        bool canceled = false;
+        unsigned pending;
+        while ((pending = contenderGroup->getNumPending() + offsetGroup->getNumPending()) > 0u)
+        {
+            if (!canceled && progress && progress->isCanceled())
+            {
+                contenderGroup->cancel();
+                offsetGroup->cancel();
+                canceled = true;
+            }
+
+            if (!contenderGroup->isCanceled())
+            {
+                for (unsigned i = 0; i < contenders.size() && contenders[i]->isCompleted(); ++i)
+                {
+                    if (contenders[i]->_coversTile)
+                    {
+                        contenderGroup->cancel();
+                        break;
+                    }
+                }
+            }
+
+            if (onWorker)
+            {
+                // help out rather than block a worker
+                if (!scheduler->runOne())
+                    OpenThreads::Thread::YieldCurrentThread();
+            }
+            else if (contenderGroup->getNumPending() > 0u)
+            {
+                contenderGroup->wait(contenderGroup->getNumPending() - 1u);
+            }
+            else
+            {
+                offsetGroup->wait();
+            }
+        }
+
+        return !canceled;
+    }
+
     //! Gets the normal vector for elevation data at column s, row t.
     osg::Vec3 getNormal(const GeoExtent& extent, const osg::HeightField* hf, int s, int t)
     {
@@ -774,6 +951,8 @@ namespace
     //! normals) in order to maintain terrain correlation. Maybe someday.
     void createNormalMap(const GeoExtent& extent, const osg::HeightField* hf, const osg::ShortArray* deltaLOD, NormalMap* normalMap)
     {
+        TileLoadTrace::ScopedStage traceStage("normalmap");
+
         int w = hf->getNumColumns();
         int h = hf->getNumRows();
 
@@ -966,17 +1145,6 @@ ElevationLayerVector::populateHeightFieldAndNormalMap(osg::HeightField*      hf,
     double   ymin       = key.getExtent().yMin();
     double   dx         = key.getExtent().width() / (double)(numColumns-1);
     double   dy         = key.getExtent().height() / (double)(numRows-1);
-   
-    // We will load the actual heightfields on demand. We might not need them all.
-    GeoHeightFieldVector heightFields(contenders.size());
-    GeoHeightFieldVector offsetFields(offsets.size());
-    std::vector<bool>    heightFallback(contenders.size(), false);
-    std::vector<bool>    heightFailed(contenders.size(), false);
-    std::vector<bool>    offsetFailed(offsets.size(), false);
-
-    // The maximum number of heightfields to keep in this local cache
-    const unsigned maxHeightFields = 50;
-    unsigned numHeightFieldsInCache = 0;
 
     const SpatialReference* keySRS = keyToUse.getProfile()->getSRS();
 
@@ -986,43 +1154,86 @@ ElevationLayerVector::populateHeightFieldAndNormalMap(osg::HeightField*      hf,
 
     // query resolution interval (x, y) of each sample.
     osg::ref_ptr<osg::ShortArray> deltaLOD = new osg::ShortArray(total);
-    
-    int nodataCount = 0;
 
-    TileKey scratchKey; // Storage if a new key needs to be constructed
+    // Fetch all the heightfields at once.
+    FetchVector contenderFetches, offsetFetches;
+    for (unsigned i = 0; i < contenders.size(); ++i)
+        contenderFetches.push_back(new FetchHeightField(contenders[i], keyToUse.getExtent(), true));
+    for (unsigned i = 0; i < offsets.size(); ++i)
+        offsetFetches.push_back(new FetchHeightField(offsets[i], keyToUse.getExtent(), false));
 
-    bool requiresResample = true;
+    if (!runFetches(contenderFetches, offsetFetches, progress))
+    {
+        return false;
+    }
+
+#ifdef ANALYZE
+    for (unsigned i = 0; i < contenderFetches.size(); ++i)
+    {
+        LayerAnalysis& la = layerAnalysis[contenders[i].layer.get()];
+        la.failed = !contenderFetches[i]->_hf.valid();
+        la.fallback = contenderFetches[i]->isFallback();
+        la.actualKeyValid = contenderFetches[i]->_actualKey.valid();
+        la.message = contenderFetches[i]->_message;
+    }
+#endif
 
     // If we only have a single contender layer, and the tile is the same size as the requested 
     // heightfield then we just use it directly and avoid having to resample it
-    if (contenders.size() == 1)
+    bool requiresResample = true;
+    if (contenders.size() == 1 && offsets.empty())
     {
-        ElevationLayer* layer = contenders[0].layer.get();
-        TileKey& contenderKey = contenders[0].key;
-
-        GeoHeightField layerHF = layer->createHeightField(contenderKey, 0);
-        if (layerHF.valid())
+        const FetchHeightField* fetch = contenderFetches[0].get();
+        const osg::HeightField* layerHF = fetch->_hf.getHeightField();
+        if (fetch->_hf.valid() &&
+            !fetch->isFallback() &&
+            layerHF->getNumColumns() == hf->getNumColumns() &&
+            layerHF->getNumRows() == hf->getNumRows())
         {
-            if (layerHF.getHeightField()->getNumColumns() == hf->getNumColumns() &&
-                layerHF.getHeightField()->getNumRows() == hf->getNumRows())
-            {
-                requiresResample = false;
-                memcpy(hf->getFloatArray()->asVector().data(),
-                    layerHF.getHeightField()->getFloatArray()->asVector().data(),
-                    sizeof(float) * hf->getFloatArray()->size()
-                );
-                deltaLOD->resize(hf->getFloatArray()->size(), 0);
-                realData = true;
-            }
+            requiresResample = false;
+            memcpy(hf->getFloatArray()->asVector().data(),
+                layerHF->getFloatArray()->asVector().data(),
+                sizeof(float) * hf->getFloatArray()->size()
+            );
+            realData = true;
         }
     }
 
-    // If we need to mosaic multiple layers or resample it to a new output tilesize go through a resampling loop.
+    // If we need to mosaic multiple layers or resample it to a new output tilesize,
+    // composite them one row at a time: each layer in priority order fills in whatever
+    // samples in the row the layers above it left unresolved.
     if (requiresResample)
     {
-        for (unsigned c = 0; c < numColumns; ++c)
+        std::vector<CompositeSource> sources(contenders.size());
+        for (unsigned i = 0; i < contenders.size(); ++i)
+        {
+            CompositeSource& src = sources[i];
+            src.fetch = contenderFetches[i].get();
+            src.direct = false;
+            if (!src.fetch->_hf.valid())
+                continue;
+
+            const GeoExtent& ex = src.fetch->_hf.getExtent();
+            const osg::HeightField* layerHF = src.fetch->_hf.getHeightField();
+            src.direct =
+                (ex.getSRS() == keySRS ||
+                 (ex.getSRS()->isHorizEquivalentTo(keySRS) && ex.getSRS()->isVertEquivalentTo(keySRS))) &&
+                ex.contains(keyToUse.getExtent());
+            src.xmin = ex.xMin();
+            src.ymin = ex.yMin();
+            src.xInterval = ex.width() / (double)(layerHF->getNumColumns()-1);
+            src.yInterval = ex.height() / (double)(layerHF->getNumRows()-1);
+            src.deltaLOD = key.getLOD() - src.fetch->_actualKey.getLOD();
+        }
+
+        std::vector<int>      resolvedIndex(numColumns);
+        std::vector<unsigned> unresolved, stillUnresolved;
+        unresolved.reserve(numColumns);
+        stillUnresolved.reserve(numColumns);
+
+        for (unsigned r = 0; r < numRows; ++r)
         {
-            double x = xmin + (dx * (double)c);
+            double y = ymin + (dy * (double)r);
 
             // periodically check for cancelation
             if (progress && progress->isCanceled())
@@ -1030,145 +1241,88 @@ ElevationLayerVector::populateHeightFieldAndNormalMap(osg::HeightField*      hf,
                 return false;
             }
 
-            for (unsigned r = 0; r < numRows; ++r)
+            unresolved.clear();
+            for (unsigned c = 0; c < numColumns; ++c)
             {
-                double y = ymin + (dy * (double)r);
-
-                // Collect elevations from each layer as necessary.
-                int resolvedIndex = -1;
+                unresolved.push_back(c);
+                resolvedIndex[c] = -1;
+            }
 
-                osg::Vec3 normal_sum(0, 0, 0);
+            for (unsigned i = 0; i < sources.size() && !unresolved.empty(); ++i)
+            {
+                const CompositeSource& src = sources[i];
+                const GeoHeightField& layerHF = src.fetch->_hf;
+                if (!layerHF.valid())
+                    continue;
 
-                for (int i = 0; i < contenders.size() && resolvedIndex < 0; ++i)
+                // We only have real data if this is not a fallback heightfield.
+                if (!src.fetch->isFallback())
                 {
-                    ElevationLayer* layer = contenders[i].layer.get();
-                    TileKey& contenderKey = contenders[i].key;
-                    int index = contenders[i].index;
-
-                    if (heightFailed[i])
-                        continue;
-
-                    TileKey* actualKey = &contenderKey;
+                    realData = true;
+                }
 
-                    GeoHeightField& layerHF = heightFields[i];
+                stillUnresolved.clear();
+                for (unsigned u = 0; u < unresolved.size(); ++u)
+                {
+                    unsigned c = unresolved[u];
+                    double x = xmin + (dx * (double)c);
 
-                    if (!layerHF.valid())
+                    float elevation = NO_DATA_VALUE;
+                    if (src.direct)
                     {
-                        // We couldn't get the heightfield from the cache, so try to create it.
-                        // We also fallback on parent layers to make sure that we have data at the location even if it's fallback.
-                        while (!layerHF.valid() && actualKey->valid() && layer->isKeyInLegalRange(*actualKey))
-                        {
-                            layerHF = layer->createHeightField(*actualKey, progress);
-                            if (!layerHF.valid())
-                            {
-                                if (actualKey != &scratchKey)
-                                {
-                                    scratchKey = *actualKey;
-                                    actualKey = &scratchKey;
-                                }
-                                *actualKey = actualKey->createParentKey();
-                            }
-                        }
-
-                        // Mark this layer as fallback if necessary.
-                        if (layerHF.valid())
-                        {
-                            heightFallback[i] = (*actualKey != contenderKey); // actualKey != contenders[i].second;
-                            numHeightFieldsInCache++;
-                        }
-                        else
-                        {
-                            heightFailed[i] = true;
-#ifdef ANALYZE
-                            layerAnalysis[layer].failed = true;
-                            layerAnalysis[layer].actualKeyValid = actualKey->valid();
-                            if (progress) layerAnalysis[layer].message = progress->message();
-#endif
-                            continue;
-                        }
+                        elevation = HeightFieldUtils::getHeightAtLocation(
+                            layerHF.getHeightField(),
+                            x, y,
+                            src.xmin, src.ymin,
+                            src.xInterval, src.yInterval,
+                            interpolation);
                     }
-
-                    if (layerHF.valid())
+                    else if (!layerHF.getElevation(keySRS, x, y, interpolation, keySRS, elevation))
                     {
-                        bool isFallback = heightFallback[i];
-#ifdef ANALYZE
-                        layerAnalysis[layer].fallback = isFallback;
-#endif
-
-                        // We only have real data if this is not a fallback heightfield.
-                        if (!isFallback)
-                        {
-                            realData = true;
-                        }
+                        elevation = NO_DATA_VALUE;
+                    }
 
-                        float elevation;
-                        if (layerHF.getElevation(keySRS, x, y, interpolation, keySRS, elevation))
-                        {
-                            if (elevation != NO_DATA_VALUE)
-                            {
-                                // remember the index so we can only apply offset layers that
-                                // sit on TOP of this layer.
-                                resolvedIndex = index;
+                    if (elevation != NO_DATA_VALUE)
+                    {
+                        // remember the index so we can only apply offset layers that
+                        // sit on TOP of this layer.
+                        resolvedIndex[c] = contenders[i].index;
 
-                                hf->setHeight(c, r, elevation);
+                        hf->setHeight(c, r, elevation);
+                        (*deltaLOD)[r*numColumns + c] = src.deltaLOD;
 
 #ifdef ANALYZE
-                                layerAnalysis[layer].samples++;
+                        layerAnalysis[contenders[i].layer.get()].samples++;
 #endif
-
-                                if (deltaLOD)
-                                {
-                                    (*deltaLOD)[r*numColumns + c] = key.getLOD() - actualKey->getLOD();
-                                }
-                            }
-                            else
-                            {
-                                ++nodataCount;
-                            }
-                        }
                     }
-
-
-                    // Clear the heightfield cache if we have too many heightfields in the cache.
-                    if (numHeightFieldsInCache >= maxHeightFields)
+                    else
                     {
-                        //OE_NOTICE << "Clearing cache" << std::endl;
-                        for (unsigned int k = 0; k < heightFields.size(); k++)
-                        {
-                            heightFields[k] = GeoHeightField::INVALID;
-                            heightFallback[k] = false;
-                        }
-                        numHeightFieldsInCache = 0;
+                        stillUnresolved.push_back(c);
                     }
                 }
 
-                for (int i = offsets.size() - 1; i >= 0; --i)
-                {
-                    // Only apply an offset layer if it sits on top of the resolved layer
-                    // (or if there was no resolved layer).
-                    if (resolvedIndex >= 0 && offsets[i].index < resolvedIndex)
-                        continue;
+                unresolved.swap(stillUnresolved);
+            }
 
-                    TileKey &contenderKey = offsets[i].key;
+            for (int i = offsets.size() - 1; i >= 0; --i)
+            {
+                const GeoHeightField& layerHF = offsetFetches[i]->_hf;
+                if (!layerHF.valid())
+                    continue;
 
-                    if (offsetFailed[i] == true)
-                        continue;
+                // If we actually got a layer then we have real data
+                realData = true;
 
-                    GeoHeightField& layerHF = offsetFields[i];
-                    if (!layerHF.valid())
-                    {
-                        ElevationLayer* offset = offsets[i].layer.get();
+                short offsetDeltaLOD = key.getLOD() - offsets[i].key.getLOD();
 
-                        layerHF = offset->createHeightField(contenderKey, progress);
-                        if (!layerHF.valid())
-                        {
-                            offsetFailed[i] = true;
-                            continue;
-                        }
-                    }
+                for (unsigned c = 0; c < numColumns; ++c)
+                {
+                    // Only apply an offset layer if it sits on top of the resolved layer
+                    // (or if there was no resolved layer).
+                    if (resolvedIndex[c] >= 0 && offsets[i].index < resolvedIndex[c])
+                        continue;
 
-                    // If we actually got a layer then we have real data
-                    realData = true;
+                    double x = xmin + (dx * (double)c);
 
                     float elevation = 0.0f;
                     if (layerHF.getElevation(keySRS, x, y, interpolation, keySRS, elevation) &&
@@ -1179,10 +1333,7 @@ ElevationLayerVector::populateHeightFieldAndNormalMap(osg::HeightField*      hf,
                         // Update the resolution tracker to account for the offset. Sadly this
                         // will wipe out the resolution of the actual data, and might result in 
                         // normal faceting. See the comments on "createNormalMap" for more info
-                        if (deltaLOD)
-                        {
-                            (*deltaLOD)[r*numColumns + c] = key.getLOD() - contenderKey.getLOD();
-                        }
+                        (*deltaLOD)[r*numColumns + c] = offsetDeltaLOD;
                     }
                 }
             }
@@ -19,6 +19,9 @@
 #include <osgEarth/ElevationPool>
 #include <osgEarth/Map>
 #include <osgEarth/Metrics>
+#include <osgEarth/HeightFieldUtils>
+#include <osgEarth/Registry>
+#include <algorithm>
 
 using namespace osgEarth;
 
@@ -32,19 +35,7 @@ _entries(0u),
 _maxEntries( 128u ),
 _tileSize( 257u )
 {
-    //nop
-    //_opQueue = Registry::instance()->getAsyncOperationQueue();
-    if (!_opQueue.valid())
-    {
-        _opQueue = new osg::OperationQueue();
-        for (unsigned i=0; i<2; ++i)
-        {
-            osg::OperationThread* thread = new osg::OperationThread();
-            thread->setOperationQueue(_opQueue.get());
-            thread->start();
-            _opThreads.push_back(thread);
-        }
-    }
+    _jobs = new JobGroup();
 }
 
 ElevationPool::~ElevationPool()
@@ -70,10 +61,7 @@ ElevationPool::clear()
 void
 ElevationPool::stopThreading()
 {
-    _opQueue->releaseAllOperations();
-    
-    for (unsigned i = 0; i<_opThreads.size(); ++i)
-    _opThreads[i]->setDone(true);
+    _jobs->cancel();
 }
 
 void
@@ -97,7 +85,7 @@ ElevationPool::getElevation(const GeoPoint& point, unsigned lod)
 {
     GetElevationOp* op = new GetElevationOp(this, point, lod);
     Future<ElevationSample> result = op->_promise.getFuture();
-    _opQueue->add(op);
+    Registry::instance()->getJobScheduler()->submit(op, JobScheduler::LANE_LOW, _jobs.get());
     return result;
 }
 
@@ -108,7 +96,7 @@ _pool(pool), _point(point), _lod(lod)
 }
 
 void
-ElevationPool::GetElevationOp::operator()(osg::Object*)
+ElevationPool::GetElevationOp::operator()(ProgressCallback*)
 {
     osg::ref_ptr<ElevationPool> pool;
     if (!_promise.isAbandoned() && _pool.lock(pool))
@@ -149,6 +137,7 @@ ElevationPool::fetchTileFromMap(const TileKey& key, const ElevationLayerVector&
         {
             tile->_hf = GeoHeightField( hf.get(), keyToUse.getExtent() );
             tile->_bounds = keyToUse.getExtent().bounds();
+            tile->_pyramid.build(hf.get());
         }
         else
         {
@@ -159,11 +148,233 @@ ElevationPool::fetchTileFromMap(const TileKey& key, const ElevationLayerVector&
     return tile->_hf.valid();
 }
 
+namespace
+{
+    // Clips the parameter range [t0, t1] of the (2D) segment p0 + t*dp to a
+    // box. Returns false if the clipped range is empty.
+    inline bool clipToBox(const osg::Vec3d& p0, const osg::Vec3d& dp,
+                          double xmin, double ymin, double xmax, double ymax,
+                          double& t0, double& t1)
+    {
+        const double lo[2] = { xmin, ymin };
+        const double hi[2] = { xmax, ymax };
+
+        for (int i = 0; i < 2; ++i)
+        {
+            if (dp[i] == 0.0)
+            {
+                if (p0[i] < lo[i] || p0[i] > hi[i])
+                    return false;
+            }
+            else
+            {
+                double a = (lo[i] - p0[i]) / dp[i];
+                double b = (hi[i] - p0[i]) / dp[i];
+                if (a > b) std::swap(a, b);
+                t0 = osg::maximum(t0, a);
+                t1 = osg::minimum(t1, b);
+                if (t0 > t1)
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    // Extents of a pyramid node that spans "cells" heightfield cells a side.
+    inline void nodeBounds(const GeoExtent& ex, unsigned numCols, unsigned numRows,
+                           unsigned cells, unsigned col, unsigned row,
+                           double& xmin, double& ymin, double& xmax, double& ymax)
+    {
+        double xInterval = ex.width() / (double)numCols;
+        double yInterval = ex.height() / (double)numRows;
+        xmin = ex.xMin() + (double)(col*cells) * xInterval;
+        ymin = ex.yMin() + (double)(row*cells) * yInterval;
+        xmax = ex.xMin() + (double)osg::minimum((col+1u)*cells, numCols) * xInterval;
+        ymax = ex.yMin() + (double)osg::minimum((row+1u)*cells, numRows) * yInterval;
+    }
+}
+
+void
+ElevationPool::MinMaxPyramid::build(const osg::HeightField* hf)
+{
+    _levels.clear();
+
+    if (!hf || hf->getNumColumns() < 2 || hf->getNumRows() < 2)
+        return;
+
+    // finest level: one entry per cell.
+    unsigned cols = hf->getNumColumns() - 1;
+    unsigned rows = hf->getNumRows() - 1;
+
+    _levels.push_back(Level());
+    Level& base = _levels.back();
+    base._cols = cols, base._rows = rows;
+    base._min.resize(cols*rows);
+    base._max.resize(cols*rows);
+
+    for (unsigned r = 0; r < rows; ++r)
+    {
+        for (unsigned c = 0; c < cols; ++c)
+        {
+            const float h[4] = {
+                hf->getHeight(c, r),   hf->getHeight(c+1, r),
+                hf->getHeight(c, r+1), hf->getHeight(c+1, r+1) };
+
+            float lo = FLT_MAX, hi = -FLT_MAX;
+            for (int i = 0; i < 4; ++i)
+            {
+                if (h[i] != NO_DATA_VALUE)
+                {
+                    lo = osg::minimum(lo, h[i]);
+                    hi = osg::maximum(hi, h[i]);
+                }
+            }
+            base._min[r*cols + c] = lo;
+            base._max[r*cols + c] = hi;
+        }
+    }
+
+    // coarser levels, down to a single root node:
+    while (cols > 1u || rows > 1u)
+    {
+        unsigned ncols = (cols + 1u) / 2u;
+        unsigned nrows = (rows + 1u) / 2u;
+
+        _levels.push_back(Level());
+        Level& level = _levels.back();
+        const Level& prev = _levels[_levels.size() - 2];
+        level._cols = ncols, level._rows = nrows;
+        level._min.assign(ncols*nrows, FLT_MAX);
+        level._max.assign(ncols*nrows, -FLT_MAX);
+
+        for (unsigned r = 0; r < rows; ++r)
+        {
+            for (unsigned c = 0; c < cols; ++c)
+            {
+                unsigned i = (r/2u)*ncols + (c/2u);
+                level._min[i] = osg::minimum(level._min[i], prev._min[r*cols + c]);
+                level._max[i] = osg::maximum(level._max[i], prev._max[r*cols + c]);
+            }
+        }
+
+        cols = ncols, rows = nrows;
+    }
+}
+
+bool
+ElevationPool::MinMaxPyramid::intersect(const GeoHeightField& hf,
+                                        const osg::Vec3d& p0, const osg::Vec3d& dp,
+                                        double t0, double t1,
+                                        double& out_t) const
+{
+    if (_levels.empty())
+        return false;
+
+    return intersectNode(hf, _levels.size()-1, 0u, 0u, p0, dp, t0, t1, out_t);
+}
+
+bool
+ElevationPool::MinMaxPyramid::intersectNode(const GeoHeightField& hf,
+                                            unsigned level, unsigned col, unsigned row,
+                                            const osg::Vec3d& p0, const osg::Vec3d& dp,
+                                            double t0, double t1,
+                                            double& out_t) const
+{
+    const Level& L = _levels[level];
+    unsigned i = row*L._cols + col;
+
+    // all NO_DATA?
+    if (L._min[i] > L._max[i])
+        return false;
+
+    const osg::HeightField* field = hf.getHeightField();
+    const GeoExtent& ex = hf.getExtent();
+    const unsigned numCols = _levels[0]._cols;
+    const unsigned numRows = _levels[0]._rows;
+
+    double xmin, ymin, xmax, ymax;
+    nodeBounds(ex, numCols, numRows, 1u << level, col, row, xmin, ymin, xmax, ymax);
+    if (!clipToBox(p0, dp, xmin, ymin, xmax, ymax, t0, t1))
+        return false;
+
+    // If the segment passes above everything in this node, skip it.
+    double za = p0.z() + dp.z()*t0;
+    double zb = p0.z() + dp.z()*t1;
+    if (osg::minimum(za, zb) > (double)L._max[i])
+        return false;
+
+    if (level == 0u)
+    {
+        // Entirely below the cell: it hits where it enters.
+        if (osg::maximum(za, zb) < (double)L._min[i])
+        {
+            out_t = t0;
+            return true;
+        }
+
+        // Otherwise march across the cell.
+        const unsigned steps = 8u;
+        const double xInterval = ex.width() / (double)numCols;
+        const double yInterval = ex.height() / (double)numRows;
+        for (unsigned s = 0; s <= steps; ++s)
+        {
+            double t = t0 + (t1 - t0) * (double)s / (double)steps;
+            float h = HeightFieldUtils::getHeightAtLocation(
+                field, p0.x() + dp.x()*t, p0.y() + dp.y()*t,
+                ex.xMin(), ex.yMin(), xInterval, yInterval, INTERP_BILINEAR);
+
+            if (h != NO_DATA_VALUE && p0.z() + dp.z()*t <= (double)h)
+            {
+                out_t = t;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Visit the children in the order the segment enters them, so the first
+    // hit we find is the nearest one.
+    const Level& C = _levels[level-1u];
+    const unsigned cells = 1u << (level-1u);
+    unsigned kids[4][2];
+    double   entry[4];
+    unsigned n = 0;
+
+    for (unsigned r = row*2u; r < osg::minimum(row*2u+2u, C._rows); ++r)
+    {
+        for (unsigned c = col*2u; c < osg::minimum(col*2u+2u, C._cols); ++c)
+        {
+            double ct0 = t0, ct1 = t1;
+            nodeBounds(ex, numCols, numRows, cells, c, r, xmin, ymin, xmax, ymax);
+            if (clipToBox(p0, dp, xmin, ymin, xmax, ymax, ct0, ct1))
+            {
+                unsigned k = n++;
+                while (k > 0 && entry[k-1] > ct0)
+                {
+                    entry[k] = entry[k-1];
+                    kids[k][0] = kids[k-1][0], kids[k][1] = kids[k-1][1];
+                    --k;
+                }
+                entry[k] = ct0;
+                kids[k][0] = c, kids[k][1] = r;
+            }
+        }
+    }
+
+    for (unsigned k = 0; k < n; ++k)
+    {
+        if (intersectNode(hf, level-1u, kids[k][0], kids[k][1], p0, dp, t0, t1, out_t))
+            return true;
+    }
+
+    return false;
+}
+
 void
 ElevationPool::popMRU()
 {
     // first rememeber the key of the item we're about the pop:
-    TileKey key = _mru.back()->_key;
+    TileKey::ID key = _mru.back()->_key.getID();
 
     // establish a temporary observer on the item:
     osg::observer_ptr<Tile> temp = _mru.back().get();
@@ -179,14 +390,50 @@ ElevationPool::popMRU()
     }
 }
 
-bool
-ElevationPool::tryTile(const TileKey& key, const ElevationLayerVector& layers, osg::ref_ptr<Tile>& out)
+struct ElevationPool::FetchTileTask : public TaskRequest
+{
+    FetchTileTask(ElevationPool* pool, Tile* tile, const ElevationLayerVector& layers) :
+        _pool(pool), _tile(tile), _layers(layers) { }
+
+    void operator()(ProgressCallback*)
+    {
+        osg::ref_ptr<ElevationPool> pool;
+        bool ok = _pool.lock(pool) && pool->fetchTileFromMap(_tile->_key, _layers, _tile.get());
+        finish(ok, false);
+    }
+
+    // If the scheduler discarded us before we ran, release anyone waiting
+    // and let the next request for this tile try again.
+    ~FetchTileTask()
+    {
+        if (!_promise.isResolved())
+            finish(false, true);
+    }
+
+    void finish(bool ok, bool discarded)
+    {
+        osg::ref_ptr<ElevationPool> pool;
+        if (_pool.lock(pool))
+            pool->finishFetch(_tile.get(), ok, discarded);
+        else
+            _tile->_status.exchange(ok ? STATUS_AVAILABLE : STATUS_FAIL);
+
+        _promise.resolve(ok ? _tile.get() : 0L);
+    }
+
+    osg::observer_ptr<ElevationPool> _pool;
+    osg::ref_ptr<Tile> _tile;
+    ElevationLayerVector _layers;
+    Promise<Tile> _promise;
+};
+
+Future<ElevationPool::Tile>
+ElevationPool::getTileAsync(const TileKey& key, const ElevationLayerVector& layers)
 {
-    // first see whether the tile is available
-    _tilesMutex.lock();
+    Threading::ScopedMutexLock lock(_tilesMutex);
 
     // locate the tile in the local tile cache:
-    osg::observer_ptr<Tile>& tile_obs = _tiles[key];
+    osg::observer_ptr<Tile>& tile_obs = _tiles[key.getID()];
 
     osg::ref_ptr<Tile> tile;
 
@@ -211,26 +458,34 @@ ElevationPool::tryTile(const TileKey& key, const ElevationLayerVector& layers, o
         // add to the main cache (after putting it on the LRU).
         tile_obs = tile;
     }
-       
-    // This means the tile object exists but has yet to be populated:
+
+    // This means the tile object exists but has yet to be populated;
+    // schedule a fetch from the map.
     if ( tile->_status == STATUS_EMPTY )
     {
         OE_TEST << "  getTile(" << key.str() << ") -> fetch from map\n";
         tile->_status.exchange(STATUS_IN_PROGRESS);
-        _tilesMutex.unlock();
 
-        bool ok = fetchTileFromMap(key, layers, tile.get());
-        tile->_status.exchange( ok ? STATUS_AVAILABLE : STATUS_FAIL );
-        
-        out = ok ? tile.get() : 0L;
-        return ok;
+        FetchTileTask* task = new FetchTileTask(this, tile.get(), layers);
+        Future<Tile> result = task->_promise.getFuture();
+        _pendingFetches[key] = std::make_pair(tile.get(), result);
+        Registry::instance()->getJobScheduler()->submit(task, JobScheduler::LANE_NORMAL);
+        return result;
+    }
+
+    // This means the tile data fetch is already queued or running; share it.
+    else if ( tile->_status == STATUS_IN_PROGRESS )
+    {
+        OE_DEBUG << "  getTile(" << key.str() << ") -> in progress\n";
+        PendingFetches::iterator i = _pendingFetches.find(key);
+        if (i != _pendingFetches.end() && i->second.first == tile.get())
+            return i->second.second;
     }
 
     // This means the tile object is populated and available for use:
     else if ( tile->_status == STATUS_AVAILABLE )
     {
         OE_TEST << "  getTile(" << key.str() << ") -> available\n";
-        out = tile.get();
 
         // Mark this tile as recently used:
         _mru.push_front(tile.get());
@@ -242,28 +497,32 @@ ElevationPool::tryTile(const TileKey& key, const ElevationLayerVector& layers, o
             --_entries;
         }
 
-        _tilesMutex.unlock();
-        return true;
+        Promise<Tile> promise;
+        promise.resolve(tile.get());
+        return promise.getFuture();
     }
 
     // This means the attempt to populate the tile with data failed.
-    else if ( tile->_status == STATUS_FAIL )
-    {
-        OE_TEST << "  getTile(" << key.str() << ") -> fail\n";
-        _tilesMutex.unlock();
-        out = 0L;
-        return false;
-    }
+    OE_TEST << "  getTile(" << key.str() << ") -> fail\n";
+    Promise<Tile> promise;
+    promise.resolve(0L);
+    return promise.getFuture();
+}
 
-    // This means tile data fetch is still in progress (in another thread)
-    // and the caller should check back later.
-    else //if ( tile->_status == STATUS_IN_PROGRESS )
-    {
-        OE_DEBUG << "  getTile(" << key.str() << ") -> in progress...waiting\n";
-        _tilesMutex.unlock();
-        out = 0L;
-        return true;            // out:NULL => check back later please.
-    }
+void
+ElevationPool::finishFetch(Tile* tile, bool ok, bool discarded)
+{
+    Threading::ScopedMutexLock lock(_tilesMutex);
+
+    tile->_status.exchange(
+        ok ? STATUS_AVAILABLE :
+        discarded ? STATUS_EMPTY :
+        STATUS_FAIL);
+
+    // the pool may have been cleared and the key re-requested since.
+    PendingFetches::iterator i = _pendingFetches.find(tile->_key);
+    if (i != _pendingFetches.end() && i->second.first == tile)
+        _pendingFetches.erase(i);
 }
 
 void
@@ -272,28 +531,25 @@ ElevationPool::clearImpl()
     // assumes the tiles lock is taken.
     _tiles.clear();
     _mru.clear();
+    _pendingFetches.clear();
     _entries = 0u;
 }
 
 bool
 ElevationPool::getTile(const TileKey& key, const ElevationLayerVector& layers, osg::ref_ptr<ElevationPool::Tile>& output)
-{   
-    OE_START_TIMER(get);
+{
+    Future<Tile> result = getTileAsync(key, layers);
 
-    const double timeout = 30.0;
-    osg::ref_ptr<Tile> tile;
-    while( tryTile(key, layers, tile) && !tile.valid() && OE_GET_TIMER(get) < timeout)
+    // A worker thread must not just sit and wait: the fetch may be queued
+    // behind it (or behind other jobs waiting on fetches), so help drain
+    // the queue until our tile shows up.
+    JobScheduler* scheduler = Registry::instance()->getJobScheduler();
+    if (scheduler->isWorkerThread())
     {
-        // condition: another thread is working on fetching the tile from the map,
-        // so wait and try again later. Do this until we succeed or time out.
-        OpenThreads::Thread::YieldCurrentThread();
+        while (!result.isAvailable() && scheduler->runOne());
     }
 
-    if ( !tile.valid() && OE_GET_TIMER(get) >= timeout )
-    {
-        // this means we timed out trying to fetch the map tile.
-        OE_TEST << LC << "Timeout fetching tile " << key.str() << std::endl;
-    }
+    osg::ref_ptr<Tile> tile = result.get();
 
     if ( tile.valid() )
     {
@@ -351,64 +607,93 @@ ElevationEnvelope::~ElevationEnvelope()
     //nop
 }
 
+namespace
+{
+    // Bilinear heightfield sample at a point known to be inside the extent;
+    // equivalent to GeoHeightField::getElevation() without the SRS checks.
+    inline float sampleHeightField(const GeoHeightField& geohf, double x, double y)
+    {
+        const osg::HeightField* hf = geohf.getHeightField();
+        const GeoExtent& ex = geohf.getExtent();
+        double xInterval = ex.width()  / (double)(hf->getNumColumns()-1);
+        double yInterval = ex.height() / (double)(hf->getNumRows()-1);
+        return HeightFieldUtils::getHeightAtLocation(
+            hf, x, y, ex.xMin(), ex.yMin(), xInterval, yInterval, INTERP_BILINEAR);
+    }
+}
+
 bool
 ElevationEnvelope::sample(double x, double y, float& out_elevation, float& out_resolution)
+{
+    GeoPoint p(_inputSRS.get(), x, y, 0.0f, ALTMODE_ABSOLUTE);
+
+    if (p.transformInPlace(_mapProfile->getSRS()))
+    {
+        return sampleMapCoords(p.x(), p.y(), out_elevation, out_resolution);
+    }
+    else
+    {
+        OE_WARN << LC << "sample: xform failed" << std::endl;
+        out_elevation = NO_DATA_VALUE;
+        out_resolution = 0.0f;
+        return false;
+    }
+}
+
+bool
+ElevationEnvelope::sampleMapCoords(double x, double y, float& out_elevation, float& out_resolution)
 {
     out_elevation = NO_DATA_VALUE;
     out_resolution = 0.0f;
     bool foundTile = false;
 
-    GeoPoint p(_inputSRS.get(), x, y, 0.0f, ALTMODE_ABSOLUTE);
-
-    if (p.transformInPlace(_mapProfile->getSRS()))
+    // find the tile containing the point:
+    for(ElevationPool::QuerySet::const_iterator tile_ref = _tiles.begin();
+        tile_ref != _tiles.end();
+        ++tile_ref)
     {
-        // find the tile containing the point:
-        for(ElevationPool::QuerySet::const_iterator tile_ref = _tiles.begin();
-            tile_ref != _tiles.end();
-            ++tile_ref)
+        ElevationPool::Tile* tile = tile_ref->get();
+
+        if (tile->_bounds.contains(x, y) && tile->_hf.getExtent().contains(x, y))
         {
-            ElevationPool::Tile* tile = tile_ref->get();
+            foundTile = true;
 
-            if (tile->_bounds.contains(p.x(), p.y()))
+            // Found an intersecting tile; sample the elevation:
+            out_elevation = sampleHeightField(tile->_hf, x, y);
+            if (out_elevation != NO_DATA_VALUE)
             {
-                foundTile = true;
-
-                // Found an intersecting tile; sample the elevation:
-                if (tile->_hf.getElevation(0L, p.x(), p.y(), INTERP_BILINEAR, 0L, out_elevation))
-                {
-                    out_resolution = tile->_hf.getXInterval();
-                    // got it; finished
-                    break;
-                }
+                out_resolution = tile->_hf.getXInterval();
+                // got it; finished
+                break;
             }
         }
+    }
 
-        // If we didn't find a tile containing the point, we need to ask the clamper
-        // for the tile so we can add it to the query set.
-        if (!foundTile)
-        {
-            TileKey key = _mapProfile->createTileKey(p.x(), p.y(), _lod);
-            osg::ref_ptr<ElevationPool::Tile> tile;
+    // If we didn't find a tile containing the point, we need to ask the clamper
+    // for the tile so we can add it to the query set.
+    if (!foundTile)
+    {
+        TileKey key = _mapProfile->createTileKey(x, y, _lod);
+        osg::ref_ptr<ElevationPool::Tile> tile;
 
-            osg::ref_ptr<ElevationPool> pool;
+        osg::ref_ptr<ElevationPool> pool;
 
-            if (_pool.lock(pool) && pool->getTile(key, _layers, tile))
-            {
-                // Got the new tile; put it in the query set:
-                _tiles.insert(tile.get());
+        if (_pool.lock(pool) && pool->getTile(key, _layers, tile))
+        {
+            // Got the new tile; put it in the query set:
+            _tiles.insert(tile.get());
 
-                // Then sample the elevation:
-                if (tile->_hf.getElevation(0L, p.x(), p.y(), INTERP_BILINEAR, 0L, out_elevation))
+            // Then sample the elevation:
+            if (tile->_hf.getExtent().contains(x, y))
+            {
+                out_elevation = sampleHeightField(tile->_hf, x, y);
+                if (out_elevation != NO_DATA_VALUE)
                 {
                     out_resolution = 0.5*(tile->_hf.getXInterval() + tile->_hf.getYInterval());
                 }
             }
         }
     }
-    else
-    {
-        OE_WARN << LC << "sample: xform failed" << std::endl;
-    }
 
     // push the result, even if it was not found and it's NO_DATA_VALUE
     return out_elevation != NO_DATA_VALUE;
@@ -432,26 +717,54 @@ ElevationEnvelope::getElevationAndResolution(double x, double y)
     return std::make_pair(elevation, resolution);
 }
 
+Future<ElevationSample>
+ElevationEnvelope::getElevationAsync(double x, double y)
+{
+    // If we already hold data for this point, answer right away:
+    GeoPoint p(_inputSRS.get(), x, y, 0.0f, ALTMODE_ABSOLUTE);
+    if (p.transformInPlace(_mapProfile->getSRS()))
+    {
+        for(ElevationPool::QuerySet::const_iterator tile_ref = _tiles.begin();
+            tile_ref != _tiles.end();
+            ++tile_ref)
+        {
+            ElevationPool::Tile* tile = tile_ref->get();
+            if (tile->_bounds.contains(p.x(), p.y()) && tile->_hf.getExtent().contains(p.x(), p.y()))
+            {
+                float elevation = sampleHeightField(tile->_hf, p.x(), p.y());
+                if (elevation != NO_DATA_VALUE)
+                {
+                    Promise<ElevationSample> promise;
+                    promise.resolve(new ElevationSample(elevation, tile->_hf.getXInterval()));
+                    return promise.getFuture();
+                }
+            }
+        }
+    }
+
+    // Otherwise hand the query off to the pool.
+    osg::ref_ptr<ElevationPool> pool;
+    if (_pool.lock(pool))
+    {
+        return pool->getElevation(GeoPoint(_inputSRS.get(), x, y, 0.0f, ALTMODE_ABSOLUTE), _lod);
+    }
+
+    // no pool: an abandoned future.
+    return Future<ElevationSample>();
+}
+
 unsigned
 ElevationEnvelope::getElevations(const std::vector<osg::Vec3d>& input,
                                  std::vector<float>& output)
 {
     METRIC_SCOPED_EX("ElevationEnvelope::getElevations", 1, "num", toString(input.size()).c_str());
 
-    unsigned count = 0u;
+    output.resize(input.size());
+    if (input.empty())
+        return 0u;
 
-    output.reserve(input.size());
-    output.clear();
-
-    // for each input point:
-    for (std::vector<osg::Vec3d>::const_iterator v = input.begin(); v != input.end(); ++v)
-    {
-        float elevation, resolution;
-        sample(v->x(), v->y(), elevation, resolution);
-        output.push_back(elevation);
-        if (elevation != NO_DATA_VALUE)
-            ++count;
-    }
+    unsigned count = getElevations(
+        &input[0].x(), &input[0].y(), input.size(), 3u, &output[0]);
 
     if (count < input.size())
     {
@@ -467,6 +780,56 @@ ElevationEnvelope::getElevations(const std::vector<osg::Vec3d>& input,
     return count;
 }
 
+unsigned
+ElevationEnvelope::getElevations(const double* x,
+                                 const double* y,
+                                 unsigned      num,
+                                 unsigned      stride,
+                                 float*        out_elevations,
+                                 float*        out_resolutions)
+{
+    if (num == 0u || x == 0L || y == 0L || out_elevations == 0L)
+        return 0u;
+
+    if (stride == 0u)
+        stride = 1u;
+
+    // Gather the points into the scratch buffer (reused across calls)
+    // and transform them into the map SRS all at once.
+    _scratch.resize(num);
+    for (unsigned i = 0; i < num; ++i)
+    {
+        _scratch[i].set(x[i*stride], y[i*stride], 0.0);
+    }
+
+    const SpatialReference* mapSRS = _mapProfile->getSRS();
+    bool xformed =
+        _inputSRS->isHorizEquivalentTo(mapSRS) ||
+        _inputSRS->transform(_scratch, mapSRS);
+
+    unsigned count = 0u;
+    float resolution;
+
+    for (unsigned i = 0; i < num; ++i)
+    {
+        float& elevation = out_elevations[i];
+
+        // If the batch transform failed we don't know which points were bad,
+        // so fall back on the per-point path.
+        bool ok = xformed ?
+            sampleMapCoords(_scratch[i].x(), _scratch[i].y(), elevation, resolution) :
+            sample(x[i*stride], y[i*stride], elevation, resolution);
+
+        if (out_resolutions)
+            out_resolutions[i] = resolution;
+
+        if (ok)
+            ++count;
+    }
+
+    return count;
+}
+
 bool
 ElevationEnvelope::getElevationExtrema(const std::vector<osg::Vec3d>& input,
                                        float& min, float& max)
@@ -508,6 +871,97 @@ ElevationEnvelope::getElevationExtrema(const std::vector<osg::Vec3d>& input,
     return (min <= max);
 }
 
+bool
+ElevationEnvelope::intersect(const osg::Vec3d& start,
+                             const osg::Vec3d& end,
+                             osg::Vec3d& out_hit)
+{
+    const SpatialReference* mapSRS = _mapProfile->getSRS();
+    bool xform = !_inputSRS->isHorizEquivalentTo(mapSRS);
+
+    osg::Vec3d p0(start), p1(end);
+    if (xform)
+    {
+        if (!_inputSRS->transform2D(start.x(), start.y(), mapSRS, p0.x(), p0.y()) ||
+            !_inputSRS->transform2D(end.x(), end.y(), mapSRS, p1.x(), p1.y()))
+        {
+            OE_WARN << LC << "intersect: xform failed" << std::endl;
+            return false;
+        }
+    }
+    osg::Vec3d dp = p1 - p0;
+
+    // Walk the segment one tile at a time, starting at the start point.
+    // The step past each tile edge is a fraction of the segment length.
+    const double nudge = 1e-6;
+
+    for (double t = 0.0; t <= 1.0; )
+    {
+        double x = p0.x() + dp.x()*t;
+        double y = p0.y() + dp.y()*t;
+
+        // find the (highest resolution) tile containing the point:
+        ElevationPool::Tile* tile = 0L;
+        for(ElevationPool::QuerySet::const_iterator tile_ref = _tiles.begin();
+            tile_ref != _tiles.end() && !tile;
+            ++tile_ref)
+        {
+            if (tile_ref->get()->_hf.getExtent().contains(x, y))
+                tile = tile_ref->get();
+        }
+
+        GeoExtent extent;
+
+        if (!tile)
+        {
+            TileKey key = _mapProfile->createTileKey(x, y, _lod);
+            if (!key.valid())
+                break;
+
+            osg::ref_ptr<ElevationPool::Tile> newTile;
+            osg::ref_ptr<ElevationPool> pool;
+            if (_pool.lock(pool) && pool->getTile(key, _layers, newTile))
+            {
+                _tiles.insert(newTile.get());
+                tile = newTile.get();
+            }
+
+            // No data here; skip over this key's extent.
+            extent = tile ? tile->_hf.getExtent() : key.getExtent();
+        }
+        else
+        {
+            extent = tile->_hf.getExtent();
+        }
+
+        double t0 = t, t1 = 1.0;
+        if (!clipToBox(p0, dp, extent.xMin(), extent.yMin(), extent.xMax(), extent.yMax(), t0, t1))
+            break;
+
+        double hit;
+        if (tile && tile->_pyramid.intersect(tile->_hf, p0, dp, t0, t1, hit))
+        {
+            out_hit.set(p0.x() + dp.x()*hit, p0.y() + dp.y()*hit, p0.z() + dp.z()*hit);
+            if (xform)
+            {
+                mapSRS->transform2D(out_hit.x(), out_hit.y(), _inputSRS.get(), out_hit.x(), out_hit.y());
+            }
+            return true;
+        }
+
+        t = osg::maximum(t, t1) + nudge;
+    }
+
+    return false;
+}
+
+bool
+ElevationEnvelope::isVisible(const osg::Vec3d& from, const osg::Vec3d& to)
+{
+    osg::Vec3d hit;
+    return !intersect(from, to, hit);
+}
+
 const SpatialReference*
 ElevationEnvelope::getSRS() const
 {
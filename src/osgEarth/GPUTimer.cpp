@@ -0,0 +1,260 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2016 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/GPUTimer>
+#include <osgEarth/Metrics>
+#include <osg/GLExtensions>
+#include <osg/buffered_value>
+#include <deque>
+#include <map>
+#include <stdlib.h>
+
+#define LC "[GPUTimer] "
+
+using namespace osgEarth;
+
+#ifndef GL_TIME_ELAPSED
+#define GL_TIME_ELAPSED 0x88BF
+#endif
+
+#ifndef GL_QUERY_RESULT
+#define GL_QUERY_RESULT 0x8866
+#endif
+
+#ifndef GL_QUERY_RESULT_AVAILABLE
+#define GL_QUERY_RESULT_AVAILABLE 0x8867
+#endif
+
+// Queries a timer may have in flight before it skips a measurement rather
+// than wait on the GPU.
+#define MAX_PENDING 16u
+
+namespace
+{
+    bool s_enabled = ::getenv(OSGEARTH_ENV_GPU_TIMERS) != 0L;
+
+    struct Query
+    {
+        GLuint   _id;
+        unsigned _frame;
+    };
+
+    struct Timer
+    {
+        Timer() : _frame(~0u), _sum(0u), _metric(0L) { }
+        std::deque<Query>   _pending;   // oldest first
+        std::vector<GLuint> _free;
+        unsigned            _frame;     // frame whose results are being summed
+        unsigned            _sum;       // us
+        MetricValue*        _metric;
+    };
+
+    struct PerContext
+    {
+        PerContext() : _active(0L) { }
+        std::map<std::string, Timer> _timers;
+        Timer*                       _active;
+    };
+
+    osg::buffered_object<PerContext>& getContexts()
+    {
+        static osg::buffered_object<PerContext> s_contexts;
+        return s_contexts;
+    }
+
+    // Reads back whatever results are ready, without blocking, and publishes
+    // each frame's total once the next frame's results start coming in.
+    void collect(Timer& timer, const osg::GLExtensions* ext)
+    {
+        while (!timer._pending.empty())
+        {
+            const Query& q = timer._pending.front();
+
+            GLint available = 0;
+            ext->glGetQueryObjectiv(q._id, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                break;
+
+            GLuint64 ns = 0;
+            ext->glGetQueryObjectui64v(q._id, GL_QUERY_RESULT, &ns);
+
+            if (q._frame != timer._frame)
+            {
+                if (timer._frame != ~0u)
+                    timer._metric->set(timer._sum);
+                timer._frame = q._frame;
+                timer._sum = 0u;
+            }
+            timer._sum += (unsigned)(ns / 1000u);
+
+            timer._free.push_back(q._id);
+            timer._pending.pop_front();
+        }
+    }
+
+    struct BeginCameraTimer : public osg::Camera::DrawCallback
+    {
+        BeginCameraTimer(const std::string& name, const osg::Camera::DrawCallback* next) :
+            _name(name), _next(next) { }
+
+        void operator()(osg::RenderInfo& ri) const
+        {
+            if (_next.valid())
+                (*_next)(ri);
+            if (GPUTimer::enabled())
+                GPUTimer::begin(ri, _name);
+        }
+
+        std::string _name;
+        osg::ref_ptr<const osg::Camera::DrawCallback> _next;
+    };
+
+    struct EndCameraTimer : public osg::Camera::DrawCallback
+    {
+        EndCameraTimer(const std::string& name, const osg::Camera::DrawCallback* next) :
+            _name(name), _next(next) { }
+
+        void operator()(osg::RenderInfo& ri) const
+        {
+            if (GPUTimer::enabled())
+                GPUTimer::end(ri, _name);
+            if (_next.valid())
+                (*_next)(ri);
+        }
+
+        std::string _name;
+        osg::ref_ptr<const osg::Camera::DrawCallback> _next;
+    };
+
+    struct DrawableTimer : public osg::Drawable::DrawCallback
+    {
+        DrawableTimer(const std::string& name, osg::Drawable::DrawCallback* next) :
+            _name(name), _next(next) { }
+
+        void drawImplementation(osg::RenderInfo& ri, const osg::Drawable* drawable) const
+        {
+            GPUTimer::Scope timer(ri, _name);
+            if (_next.valid())
+                _next->drawImplementation(ri, drawable);
+            else
+                drawable->drawImplementation(ri);
+        }
+
+        std::string _name;
+        osg::ref_ptr<osg::Drawable::DrawCallback> _next;
+    };
+}
+
+bool
+GPUTimer::enabled()
+{
+    return s_enabled;
+}
+
+void
+GPUTimer::setEnabled(bool value)
+{
+    s_enabled = value;
+}
+
+bool
+GPUTimer::begin(osg::RenderInfo& ri, const std::string& name)
+{
+    if (name.empty())
+        return false;
+
+    osg::State* state = ri.getState();
+    if (!state)
+        return false;
+
+    PerContext& pc = getContexts()[state->getContextID()];
+    if (pc._active)
+        return false;
+
+    const osg::GLExtensions* ext = state->get<osg::GLExtensions>();
+    if (!ext || !(ext->isTimerQuerySupported || ext->isARBTimerQuerySupported))
+        return false;
+
+    Timer& timer = pc._timers[name];
+    if (!timer._metric)
+        timer._metric = Metrics::getValue("gpu." + name);
+
+    collect(timer, ext);
+
+    if (timer._pending.size() >= MAX_PENDING)
+        return false;
+
+    GLuint id;
+    if (timer._free.empty())
+    {
+        ext->glGenQueries(1, &id);
+    }
+    else
+    {
+        id = timer._free.back();
+        timer._free.pop_back();
+    }
+
+    ext->glBeginQuery(GL_TIME_ELAPSED, id);
+
+    Query q;
+    q._id = id;
+    q._frame = state->getFrameStamp() ? state->getFrameStamp()->getFrameNumber() : 0u;
+    timer._pending.push_back(q);
+
+    pc._active = &timer;
+    return true;
+}
+
+void
+GPUTimer::end(osg::RenderInfo& ri, const std::string& name)
+{
+    osg::State* state = ri.getState();
+    if (!state)
+        return;
+
+    PerContext& pc = getContexts()[state->getContextID()];
+    if (!pc._active)
+        return;
+
+    std::map<std::string, Timer>::iterator i = pc._timers.find(name);
+    if (i == pc._timers.end() || &i->second != pc._active)
+        return;
+
+    state->get<osg::GLExtensions>()->glEndQuery(GL_TIME_ELAPSED);
+    pc._active = 0L;
+}
+
+void
+GPUTimer::install(osg::Camera* camera, const std::string& name)
+{
+    if (!camera)
+        return;
+
+    camera->setInitialDrawCallback(new BeginCameraTimer(name, camera->getInitialDrawCallback()));
+    camera->setFinalDrawCallback(new EndCameraTimer(name, camera->getFinalDrawCallback()));
+}
+
+void
+GPUTimer::install(osg::Drawable* drawable, const std::string& name)
+{
+    if (!drawable)
+        return;
+
+    drawable->setDrawCallback(new DrawableTimer(name, drawable->getDrawCallback()));
+}
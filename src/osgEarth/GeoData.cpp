@@ -20,6 +20,7 @@
 #include <osgEarth/GeoData>
 #include <osgEarth/GeoMath>
 #include <osgEarth/HeightFieldUtils>
+#include <osgEarth/ImageResampler>
 #include <osgEarth/Registry>
 #include <osgEarth/Terrain>
 
@@ -990,6 +991,43 @@ GeoExtent::contains(const GeoExtent& rhs) const
 #undef  OVERLAPS
 #define OVERLAPS(A, B, C, D) (!(B <= C || A >= D))
 
+namespace
+{
+    // Overlap of two rectangles in the same SRS, "a" and "b", each given by
+    // its west, east (normalized), south, north and width; accounts for
+    // the antimeridian in a geographic SRS.
+    bool rectsIntersect(bool geographic,
+                        double aw, double ae, double as, double an, double awidth,
+                        double bw, double be, double bs, double bn, double bwidth)
+    {
+        // Trivial reject: y-dimension does not overlap:
+        bool y_excl = as >= bn || an <= bs;
+        if (y_excl)
+            return false;
+
+        // Trivial reject: x-dimension does not overlap in projected SRS:
+        if (!geographic)
+        {
+            bool x_excl = aw >= be || ae <= bw;
+            return x_excl == false;
+        }
+
+        // By now we know that Y overlaps and we are in a geographic SRS
+        // and therefore must consider the antimeridian wrap-around in X.
+        // a0/a1 and b0/b1 are "a"; c0/c1 and d0/d1 are "b":
+        double a0 = ae - awidth, a1 = ae;
+        double b0 = aw, b1 = aw + awidth;
+        double c0 = be - bwidth, c1 = be;
+        double d0 = bw, d1 = bw + bwidth;
+        return
+            OVERLAPS(a0, a1, c0, c1) ||
+            OVERLAPS(a0, a1, d0, d1) ||
+            OVERLAPS(b0, b1, c0, c1) ||
+            OVERLAPS(b0, b1, d0, d1);
+    }
+}
+}
+
 bool
 GeoExtent::intersects(const GeoExtent& rhs, bool checkSRS) const
 {
@@ -1013,30 +1051,23 @@ GeoExtent::intersects(const GeoExtent& rhs, bool checkSRS) const
         }
     }
 
-    // Trivial reject: y-dimension does not overlap:
-    bool y_excl = south() >= rhs.north() || north() <= rhs.south();
-    if (y_excl)
-        return false;
+    return rectsIntersect(
+        _srs->isGeographic(),
+        west(), east(), south(), north(), width(),
+        rhs.west(), rhs.east(), rhs.south(), rhs.north(), rhs.width());
+}
 
-    // Trivial reject: x-dimension does not overlap in projected SRS:
-    if (!_srs->isGeographic())
-    {
-        bool x_excl = west() >= rhs.east() || east() <= rhs.west();
-        return x_excl == false;
-    }
+bool
+GeoExtent::intersects(const Bounds& rhs) const
+{
+    if ( !isValid() || !rhs.isValid() )
+        return false;
 
-    // By now we know that Y overlaps and we are in a geographic SRS
-    // and therefore must consider the antimeridian wrap-around in X.
-    // a and b are "this"; c and d are "rhs":
-    double a0 = east() - width(), a1 = east();
-    double b0 = west(), b1 = west() + width();
-    double c0 = rhs.east() - rhs.width(), c1 = rhs.east();
-    double d0 = rhs.west(), d1 = rhs.west() + rhs.width();
-    return
-        OVERLAPS(a0, a1, c0, c1) ||
-        OVERLAPS(a0, a1, d0, d1) ||
-        OVERLAPS(b0, b1, c0, c1) ||
-        OVERLAPS(b0, b1, d0, d1);
+    // same as an extent made from the bounds, without making one:
+    return rectsIntersect(
+        _srs->isGeographic(),
+        west(), east(), south(), north(), width(),
+        normalizeX(rhs.xMin()), normalizeX(rhs.xMax()), rhs.yMin(), rhs.yMax(), rhs.width());
 }
 
 GeoCircle
@@ -1062,11 +1093,12 @@ GeoExtent::computeBoundingGeoCircle() const
         {
             osg::Vec3d center, sw, se, ne, nw;
 
-            GeoPoint(getSRS(), x, y, 0, ALTMODE_ABSOLUTE).toWorld(center);
-            GeoPoint(getSRS(), west(), south(), 0, ALTMODE_ABSOLUTE).toWorld(sw);
-            GeoPoint(getSRS(), east(), south(), 0, ALTMODE_ABSOLUTE).toWorld(se);
-            GeoPoint(getSRS(), east(), north(), 0, ALTMODE_ABSOLUTE).toWorld(ne);
-            GeoPoint(getSRS(), west(), north(), 0, ALTMODE_ABSOLUTE).toWorld(nw);
+            const SpatialReference* srs = getSRS();
+            srs->transformToWorld(osg::Vec3d(x, y, 0), center);
+            srs->transformToWorld(osg::Vec3d(west(), south(), 0), sw);
+            srs->transformToWorld(osg::Vec3d(east(), south(), 0), se);
+            srs->transformToWorld(osg::Vec3d(east(), north(), 0), ne);
+            srs->transformToWorld(osg::Vec3d(west(), north(), 0), nw);
             
             double radius2 = (center-sw).length2();
             radius2 = std::max(radius2, (center-se).length2());
@@ -1470,24 +1502,28 @@ GeoExtent::createWorldBoundingSphere(double minElev, double maxElev) const
 {
     osg::BoundingSphered bs;
 
-    if (getSRS()->isProjected())
+    // transform the corners straight through the SRS; a GeoPoint per
+    // corner would take and release a reference to it each time.
+    const SpatialReference* srs = getSRS();
+
+    if (srs->isProjected())
     {
         osg::Vec3d w;
-        GeoPoint(getSRS(), xMin(), yMin(), minElev, ALTMODE_ABSOLUTE).toWorld(w); bs.expandBy(w);
-        GeoPoint(getSRS(), xMax(), yMax(), maxElev, ALTMODE_ABSOLUTE).toWorld(w); bs.expandBy(w);
+        srs->transformToWorld(osg::Vec3d(xMin(), yMin(), minElev), w); bs.expandBy(w);
+        srs->transformToWorld(osg::Vec3d(xMax(), yMax(), maxElev), w); bs.expandBy(w);
     }
 
     else // geocentric
     {
         osg::Vec3d w;
-        GeoPoint(getSRS(), xMin(), yMin(), minElev, ALTMODE_ABSOLUTE).toWorld(w); bs.expandBy(w);
-        GeoPoint(getSRS(), xMax(), yMin(), minElev, ALTMODE_ABSOLUTE).toWorld(w); bs.expandBy(w);
-        GeoPoint(getSRS(), xMax(), yMax(), minElev, ALTMODE_ABSOLUTE).toWorld(w); bs.expandBy(w);
-        GeoPoint(getSRS(), xMin(), yMax(), minElev, ALTMODE_ABSOLUTE).toWorld(w); bs.expandBy(w);
-        GeoPoint(getSRS(), xMin(), yMin(), maxElev, ALTMODE_ABSOLUTE).toWorld(w); bs.expandBy(w);
-        GeoPoint(getSRS(), xMax(), yMin(), maxElev, ALTMODE_ABSOLUTE).toWorld(w); bs.expandBy(w);
-        GeoPoint(getSRS(), xMax(), yMax(), maxElev, ALTMODE_ABSOLUTE).toWorld(w); bs.expandBy(w);
-        GeoPoint(getSRS(), xMin(), yMax(), maxElev, ALTMODE_ABSOLUTE).toWorld(w); bs.expandBy(w);
+        srs->transformToWorld(osg::Vec3d(xMin(), yMin(), minElev), w); bs.expandBy(w);
+        srs->transformToWorld(osg::Vec3d(xMax(), yMin(), minElev), w); bs.expandBy(w);
+        srs->transformToWorld(osg::Vec3d(xMax(), yMax(), minElev), w); bs.expandBy(w);
+        srs->transformToWorld(osg::Vec3d(xMin(), yMax(), minElev), w); bs.expandBy(w);
+        srs->transformToWorld(osg::Vec3d(xMin(), yMin(), maxElev), w); bs.expandBy(w);
+        srs->transformToWorld(osg::Vec3d(xMax(), yMin(), maxElev), w); bs.expandBy(w);
+        srs->transformToWorld(osg::Vec3d(xMax(), yMax(), maxElev), w); bs.expandBy(w);
+        srs->transformToWorld(osg::Vec3d(xMin(), yMax(), maxElev), w); bs.expandBy(w);
     }
 
     return bs;
@@ -1916,7 +1952,7 @@ namespace
     osg::Image*
     reprojectImage(osg::Image* srcImage, const std::string srcWKT, double srcMinX, double srcMinY, double srcMaxX, double srcMaxY,
                    const std::string destWKT, double destMinX, double destMinY, double destMaxX, double destMaxY,
-                   int width = 0, int height = 0, bool useBilinearInterpolation = true)
+                   int width = 0, int height = 0, ImageResampler::Filter filter = ImageResampler::FILTER_BILINEAR)
     {
         GDAL_SCOPED_LOCK;
         osg::Timer_t start = osg::Timer::instance()->tick();
@@ -1948,20 +1984,15 @@ namespace
                
         GDALDataset* destDS = createMemDS(width, height, numBands, dataType, destMinX, destMinY, destMaxX, destMaxY, destWKT);
 
-        if (useBilinearInterpolation == true)
-        {
-            GDALReprojectImage(srcDS, NULL,
-                               destDS, NULL,
-                               GRA_Bilinear,
-                               0,0,0,0,0);
-        }
-        else
-        {
-            GDALReprojectImage(srcDS, NULL,
-                               destDS, NULL,
-                               GRA_NearestNeighbour,
-                               0,0,0,0,0);
-        }
+        GDALResampleAlg alg =
+            filter == ImageResampler::FILTER_BICUBIC  ? GRA_Cubic :
+            filter == ImageResampler::FILTER_BILINEAR ? GRA_Bilinear :
+            GRA_NearestNeighbour;
+
+        GDALReprojectImage(srcDS, NULL,
+                           destDS, NULL,
+                           alg,
+                           0,0,0,0,0);
 
         osg::Image* result = createImageFromDataset(destDS);
         
@@ -1977,12 +2008,12 @@ namespace
 
 
     osg::Image* manualReproject(
-        const osg::Image* image, 
-        const GeoExtent&  src_extent, 
-        const GeoExtent&  dest_extent,
-        bool              interpolate,
-        unsigned int      width = 0, 
-        unsigned int      height = 0)
+        const osg::Image*       image, 
+        const GeoExtent&        src_extent, 
+        const GeoExtent&        dest_extent,
+        ImageResampler::Filter  filter,
+        unsigned int            width = 0, 
+        unsigned int            height = 0)
     {
         //TODO:  Compute the optimal destination size
         if (width == 0 || height == 0)
@@ -2001,8 +2032,6 @@ namespace
         //Initialize the image to be completely transparent/black
         memset(result->data(), 0, result->getImageSizeInBytes());
 
-        //ImageUtils::PixelReader ra(result);
-        ImageUtils::PixelWriter writer(result);
         const double dx = dest_extent.width() / (double)width;
         const double dy = dest_extent.height() / (double)height;
 
@@ -2024,139 +2053,58 @@ namespace
             dest_extent.xMax() - .5 * dx, dest_extent.yMax() - .5 * dy,
             srcPointsX, srcPointsY, width, height);
 
-        // Next, go through the source-SRS sample grid, read the color at each point from the source image,
-        // and write it to the corresponding pixel in the destination image.
+        // Convert the sample grid (which comes back column by column) into
+        // row-major source pixel coordinates for the resampler. Points that
+        // fall outside the source extent get a negative coordinate so the
+        // resampler leaves them transparent.
+        double *pixelsX = new double[numPixels * 2];
+        double *pixelsY = pixelsX + numPixels;
+
+        const double xfac = (image->s() - 1) / src_extent.width();
+        const double yfac = (image->t() - 1) / src_extent.height();
+
         int pixel = 0;
-        ImageUtils::PixelReader ia(image);
-        double xfac = (image->s() - 1) / src_extent.width();
-        double yfac = (image->t() - 1) / src_extent.height();
         for (unsigned int c = 0; c < width; ++c)
         {
-            for (unsigned int r = 0; r < height; ++r)
-            {   
+            for (unsigned int r = 0; r < height; ++r, ++pixel)
+            {
                 double src_x = srcPointsX[pixel];
                 double src_y = srcPointsY[pixel];
+                unsigned int i = r*width + c;
 
                 if ( src_x < src_extent.xMin() || src_x > src_extent.xMax() || src_y < src_extent.yMin() || src_y > src_extent.yMax() )
                 {
-                    //If the sample point is outside of the bound of the source extent, increment the pixel and keep looping through.
-                    //OE_WARN << LC << "ERROR: sample point out of bounds: " << src_x << ", " << src_y << std::endl;
-                    pixel++;
-                    continue;
-                }
-
-                float px = (src_x - src_extent.xMin()) * xfac;
-                float py = (src_y - src_extent.yMin()) * yfac;
-
-                int px_i = osg::clampBetween( (int)osg::round(px), 0, image->s()-1 );
-                int py_i = osg::clampBetween( (int)osg::round(py), 0, image->t()-1 );
-
-                osg::Vec4 color(0,0,0,0);
-
-                // TODO: consider this again later. Causes blockiness.
-                if ( !interpolate ) //! isSrcContiguous ) // non-contiguous space- use nearest neighbot
-                {
-                    color = ia(px_i, py_i);
+                    pixelsX[i] = -1.0;
+                    pixelsY[i] = -1.0;
                 }
-
-                else // contiguous space - use bilinear sampling
+                else
                 {
-                    int rowMin = osg::maximum((int)floor(py), 0);
-                    int rowMax = osg::maximum(osg::minimum((int)ceil(py), (int)(image->t()-1)), 0);
-                    int colMin = osg::maximum((int)floor(px), 0);
-                    int colMax = osg::maximum(osg::minimum((int)ceil(px), (int)(image->s()-1)), 0);
-
-                    if (rowMin > rowMax) rowMin = rowMax;
-                    if (colMin > colMax) colMin = colMax;
-
-                    osg::Vec4 urColor = ia(colMax, rowMax);
-                    osg::Vec4 llColor = ia(colMin, rowMin);
-                    osg::Vec4 ulColor = ia(colMin, rowMax);
-                    osg::Vec4 lrColor = ia(colMax, rowMin);
-
-                    /*Average Interpolation*/
-                    /*double x_rem = px - (int)px;
-                    double y_rem = py - (int)py;
-
-                    double w00 = (1.0 - y_rem) * (1.0 - x_rem);
-                    double w01 = (1.0 - y_rem) * x_rem;
-                    double w10 = y_rem * (1.0 - x_rem);
-                    double w11 = y_rem * x_rem;
-                    double wsum = w00 + w01 + w10 + w11;
-                    wsum = 1.0/wsum;
-
-                    color.r() = (w00 * llColor.r() + w01 * lrColor.r() + w10 * ulColor.r() + w11 * urColor.r()) * wsum;
-                    color.g() = (w00 * llColor.g() + w01 * lrColor.g() + w10 * ulColor.g() + w11 * urColor.g()) * wsum;
-                    color.b() = (w00 * llColor.b() + w01 * lrColor.b() + w10 * ulColor.b() + w11 * urColor.b()) * wsum;
-                    color.a() = (w00 * llColor.a() + w01 * lrColor.a() + w10 * ulColor.a() + w11 * urColor.a()) * wsum;*/
-
-                    /*Nearest Neighbor Interpolation*/
-                    /*if (px_i >= 0 && px_i < image->s() &&
-                    py_i >= 0 && py_i < image->t())
-                    {
-                    //OE_NOTICE << "[osgEarth::GeoData] Sampling pixel " << px << "," << py << std::endl;
-                    color = ImageUtils::getColor(image, px_i, py_i);
-                    }
-                    else
-                    {
-                    OE_NOTICE << "[osgEarth::GeoData] Pixel out of range " << px_i << "," << py_i << "  image is " << image->s() << "x" << image->t() << std::endl;
-                    }*/
-
-                    /*Bilinear interpolation*/
-                    //Check for exact value
-                    if ((colMax == colMin) && (rowMax == rowMin))
-                    {
-                        //OE_NOTICE << "[osgEarth::GeoData] Exact value" << std::endl;
-                        color = ia(px_i, py_i);
-                    }
-                    else if (colMax == colMin)
-                    {
-                        //OE_NOTICE << "[osgEarth::GeoData] Vertically" << std::endl;
-                        //Linear interpolate vertically
-                        for (unsigned int i = 0; i < 4; ++i)
-                        {
-                            color[i] = ((float)rowMax - py) * llColor[i] + (py - (float)rowMin) * ulColor[i];
-                        }
-                    }
-                    else if (rowMax == rowMin)
-                    {
-                        //OE_NOTICE << "[osgEarth::GeoData] Horizontally" << std::endl;
-                        //Linear interpolate horizontally
-                        for (unsigned int i = 0; i < 4; ++i)
-                        {
-                            color[i] = ((float)colMax - px) * llColor[i] + (px - (float)colMin) * lrColor[i];
-                        }
-                    }
-                    else
-                    {
-                        //OE_NOTICE << "[osgEarth::GeoData] Bilinear" << std::endl;
-                        //Bilinear interpolate
-                        float col1 = colMax - px, col2 = px - colMin;
-                        float row1 = rowMax - py, row2 = py - rowMin;
-                        for (unsigned int i = 0; i < 4; ++i)
-                        {
-                            float r1 = col1 * llColor[i] + col2 * lrColor[i];
-                            float r2 = col1 * ulColor[i] + col2 * urColor[i];
-
-                            //OE_INFO << "r1, r2 = " << r1 << " , " << r2 << std::endl;
-                            color[i] = row1 * r1 + row2 * r2;
-                        }
-                    }
+                    pixelsX[i] = (src_x - src_extent.xMin()) * xfac;
+                    pixelsY[i] = (src_y - src_extent.yMin()) * yfac;
                 }
-
-                writer(color, c, r);
-                pixel++;
             }
         }
 
         delete[] srcPointsX;
 
+        ImageResampler(image, filter).resample(pixelsX, pixelsY, result);
+
+        delete[] pixelsX;
+
         return result;
     }
 }
 
 GeoImage
 GeoImage::reproject(const SpatialReference* to_srs, const GeoExtent* to_extent, unsigned int width, unsigned int height, bool useBilinearInterpolation) const
+{
+    return reproject(
+        to_srs, to_extent, width, height,
+        useBilinearInterpolation ? ImageResampler::FILTER_BILINEAR : ImageResampler::FILTER_NEAREST);
+}
+
+GeoImage
+GeoImage::reproject(const SpatialReference* to_srs, const GeoExtent* to_extent, unsigned int width, unsigned int height, ImageResampler::Filter filter) const
 {  
     GeoExtent destExtent;
     if (to_extent)
@@ -2172,15 +2120,22 @@ GeoImage::reproject(const SpatialReference* to_srs, const GeoExtent* to_extent,
 
     bool isNormalized = ImageUtils::isNormalized(getImage());
     
+    // Formats the resampler reads natively also go the manual route, since
+    // it runs without holding the global GDAL lock.
     if ( getSRS()->isUserDefined()      || 
         to_srs->isUserDefined()         ||
         getSRS()->isSphericalMercator() ||
         to_srs->isSphericalMercator()   ||
-        !isNormalized )
+        !isNormalized                   ||
+        (width > 0 && height > 0 && ImageResampler::isNativeFormat(getImage())) )
     {
         // if either of the SRS is a custom projection, we have to do a manual reprojection since
-        // GDAL will not recognize the SRS.
-        resultImage = manualReproject(getImage(), getExtent(), destExtent, useBilinearInterpolation && isNormalized, width, height);
+        // GDAL will not recognize the SRS. Non-normalized data (like elevation) is never
+        // interpolated.
+        resultImage = manualReproject(
+            getImage(), getExtent(), destExtent,
+            isNormalized ? filter : ImageResampler::FILTER_NEAREST,
+            width, height);
     }
     else
     {
@@ -2191,7 +2146,7 @@ GeoImage::reproject(const SpatialReference* to_srs, const GeoExtent* to_extent,
             getExtent().xMin(), getExtent().yMin(), getExtent().xMax(), getExtent().yMax(),
             to_srs->getWKT(),
             destExtent.xMin(), destExtent.yMin(), destExtent.xMax(), destExtent.yMax(),
-            width, height, useBilinearInterpolation);
+            width, height, filter);
     }   
     return GeoImage(resultImage, destExtent);
 }
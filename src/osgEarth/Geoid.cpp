@@ -91,6 +91,65 @@ Geoid::getHeight(double lat_deg, double lon_deg, const ElevationInterpolation& i
     return result;
 }
 
+void
+Geoid::getHeights(double              west_deg,
+                  double              south_deg,
+                  double              xstep_deg,
+                  double              ystep_deg,
+                  unsigned            cols,
+                  unsigned            rows,
+                  std::vector<float>& output) const
+{
+    output.assign(cols*rows, 0.0f);
+
+    if ( !_valid )
+        return;
+
+    const unsigned hfCols = _hf->getNumColumns();
+    const unsigned hfRows = _hf->getNumRows();
+    const std::vector<float>& heights = _hf->getFloatArray()->asVector();
+
+    // Columns share their interpolation weights across every row, so work
+    // them out once.
+    std::vector<unsigned> c0(cols), c1(cols);
+    std::vector<float>    cw(cols);
+    std::vector<bool>     inside(cols);
+    for(unsigned c=0; c<cols; ++c)
+    {
+        double lon = west_deg + xstep_deg*double(c);
+        inside[c] = lon >= _bounds.xMin() && lon <= _bounds.xMax();
+        double px = osg::clampBetween((lon-_bounds.xMin())/_bounds.width(), 0.0, 1.0) * double(hfCols-1);
+        c0[c] = osg::minimum((unsigned)px, hfCols-1);
+        c1[c] = osg::minimum(c0[c]+1, hfCols-1);
+        cw[c] = float(px - double(c0[c]));
+    }
+
+    for(unsigned r=0; r<rows; ++r)
+    {
+        double lat = south_deg + ystep_deg*double(r);
+        if ( lat < _bounds.yMin() || lat > _bounds.yMax() )
+            continue;
+
+        double py = osg::clampBetween((lat-_bounds.yMin())/_bounds.height(), 0.0, 1.0) * double(hfRows-1);
+        unsigned r0 = osg::minimum((unsigned)py, hfRows-1);
+        unsigned r1 = osg::minimum(r0+1, hfRows-1);
+        float rw = float(py - double(r0));
+
+        const float* row0 = &heights[r0*hfCols];
+        const float* row1 = &heights[r1*hfCols];
+        float* out = &output[r*cols];
+
+        for(unsigned c=0; c<cols; ++c)
+        {
+            if ( !inside[c] )
+                continue;
+            float s = row0[c0[c]] + (row0[c1[c]] - row0[c0[c]]) * cw[c];
+            float n = row1[c0[c]] + (row1[c1[c]] - row1[c0[c]]) * cw[c];
+            out[c] = s + (n - s) * rw;
+        }
+    }
+}
+
 bool
 Geoid::isEquivalentTo( const Geoid& rhs ) const
 {
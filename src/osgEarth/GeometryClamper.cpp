@@ -33,7 +33,8 @@ _localData(localData),
 _useVertexZ(true),
 _revert(false),
 _scale( 1.0f ),
-_offset( 0.0f )
+_offset( 0.0f ),
+_elevationLOD( 15u )
 {
     this->setNodeMaskOverride( ~0 );
     _lsi = new osgUtil::LineSegmentIntersector(osg::Vec3d(0,0,0), osg::Vec3d(0,0,0));
@@ -77,57 +78,185 @@ GeometryClamper::apply(osg::Drawable& drawable)
     osg::Matrix world2local;
     world2local.invert( local2world );
 
-    const osg::EllipsoidModel* em = _terrainSRS->getEllipsoid();
-    osg::Vec3d n_vector(0,0,1), start, end, msl;
+    GeometryData& data = _localData[verts];
 
-    bool isGeocentric = _terrainSRS->isGeographic();
+    if (!data._verts.valid() || data._verts->size() != verts->size())
+    {
+        data._verts = osg::clone(verts, osg::CopyOp::DEEP_COPY_ALL);
+        data._altitudes = new osg::FloatArray();
+        data._altitudes->reserve(verts->size());
 
-    osgUtil::IntersectionVisitor iv( _lsi.get() );
+        bool isGeocentric = _terrainSRS->isGeographic();
 
-    double r = std::min( em->getRadiusEquator(), em->getRadiusPolar() );
+        for( unsigned k=0; k<verts->size(); ++k )
+        {
+            if ( isGeocentric )
+            {
+                // should really be the alt along the n_vector but leave for now
+                // since most scene-clamped geometry will be in relative to a
+                // local tangent plane anyway -gw
+                data._altitudes->push_back( (*verts)[k].z() );
+            }
+            else
+            {
+                osg::Vec3d vw = (*verts)[k];
+                vw = vw * local2world;
+                data._altitudes->push_back( float(vw.z()) - _offset);
+            }
+        }
+    }
 
+    _indices.clear();
     unsigned count = 0;
 
-    bool geomDirty = false;
+    if ( _elevationPool.valid() )
+    {
+        // leaves any verts it could not resolve in _indices:
+        count += clampToElevationPool( verts, data, local2world, world2local );
+    }
+    else
+    {
+        _indices.reserve( verts->size() );
+        for( unsigned k=0; k<verts->size(); ++k )
+            _indices.push_back( k );
+    }
 
-    GeometryData& data = _localData[verts];
-    
-    bool storeAltitudes = false;
+    if ( _terrainPatch.valid() && !_indices.empty() )
+    {
+        count += clampToTerrainPatch( verts, data, local2world, world2local );
+    }
 
-    if (!data._verts.valid() || data._verts->size() != verts->size())
+    bool geomDirty = count > 0;
+
+    if ( geomDirty )
     {
-        data._verts = osg::clone(verts, osg::CopyOp::DEEP_COPY_ALL);
-        data._altitudes = new osg::FloatArray();
-        data._altitudes->reserve(verts->size());
-        storeAltitudes = true;
+        geom->dirtyBound();
+        if ( geom->getUseVertexBufferObjects() )
+        {
+            verts->getVertexBufferObject()->setUsage( GL_DYNAMIC_DRAW_ARB );
+            verts->dirty();
+        }
+        else
+        {
+            geom->dirtyDisplayList();
+        }
+
+        OE_DEBUG << LC << "clamped " << count << " verts." << std::endl;
+    }
+}
+
+unsigned
+GeometryClamper::clampToElevationPool(osg::Vec3Array*     verts,
+                                      GeometryData&       data,
+                                      const osg::Matrixd& local2world,
+                                      const osg::Matrixd& world2local)
+{
+    // Sample in lat/long for a geocentric terrain, or in the terrain's
+    // own SRS for a projected one.
+    const SpatialReference* srs =
+        _terrainSRS->isGeographic() ? _terrainSRS->getGeographicSRS() : _terrainSRS.get();
+
+    if ( !_envelope.valid() )
+    {
+        _envelope = _elevationPool->createEnvelope( srs, _elevationLOD );
+        if ( !_envelope.valid() )
+            return 0u;
     }
 
+    // Collect the verts to clamp, in sampling coordinates:
+    _points.clear();
+    _points.reserve( verts->size() );
+    _candidates.clear();
+    _candidates.reserve( verts->size() );
+
     for( unsigned k=0; k<verts->size(); ++k )
     {
         osg::Vec3d vw = (*verts)[k];
         vw = vw * local2world;
 
-        if ( isGeocentric )
+        osg::Vec3d p;
+        if ( !srs->transformFromWorld(vw, p) )
         {
-            // normal to the ellipsoid:
-            n_vector = em->computeLocalUpVector(vw.x(),vw.y(),vw.z());
+            _indices.push_back( k );
+            continue;
+        }
 
-            // if we need to store the original altitudes:
-            if (storeAltitudes)
-            {
-                // should really be the alt along the n_vector but leave for now
-                // since most scene-clamped geometry will be in relative to a
-                // local tangent plane anyway -gw
-                data._altitudes->push_back( (*verts)[k].z() );
-            }
+        if ( _extent.isValid() && !_extent.contains(p.x(), p.y(), srs) )
+            continue;
+
+        _points.push_back( p );
+        _candidates.push_back( k );
+    }
+
+    if ( _points.empty() )
+        return 0u;
+
+    // One query for the whole drawable:
+    _elevations.resize( _points.size() );
+    _envelope->getElevations(
+        &_points[0].x(), &_points[0].y(),
+        _points.size(), 3u,
+        &_elevations[0] );
+
+    unsigned count = 0u;
+
+    for( unsigned i=0; i<_points.size(); ++i )
+    {
+        unsigned k = _candidates[i];
+
+        if ( _elevations[i] == NO_DATA_VALUE )
+        {
+            _indices.push_back( k );
+            continue;
         }
 
-        else
+        osg::Vec3d p = _points[i];
+        p.z() = _elevations[i] + _offset;
+
+        if ( _useVertexZ )
         {
-            if (storeAltitudes)
-            {
-                data._altitudes->push_back( float(vw.z()) - _offset);
-            }
+            p.z() += (*data._altitudes)[k];
+        }
+
+        osg::Vec3d fw;
+        if ( srs->transformToWorld(p, fw) )
+        {
+            (*verts)[k] = (fw * world2local);
+            ++count;
+        }
+    }
+
+    return count;
+}
+
+unsigned
+GeometryClamper::clampToTerrainPatch(osg::Vec3Array*     verts,
+                                     GeometryData&       data,
+                                     const osg::Matrixd& local2world,
+                                     const osg::Matrixd& world2local)
+{
+    const osg::EllipsoidModel* em = _terrainSRS->getEllipsoid();
+    osg::Vec3d n_vector(0,0,1);
+
+    bool isGeocentric = _terrainSRS->isGeographic();
+
+    osgUtil::IntersectionVisitor iv( _lsi.get() );
+
+    double r = std::min( em->getRadiusEquator(), em->getRadiusPolar() );
+
+    unsigned count = 0;
+
+    for( unsigned i=0; i<_indices.size(); ++i )
+    {
+        unsigned k = _indices[i];
+
+        osg::Vec3d vw = (*verts)[k];
+        vw = vw * local2world;
+
+        if ( isGeocentric )
+        {
+            // normal to the ellipsoid:
+            n_vector = em->computeLocalUpVector(vw.x(),vw.y(),vw.z());
         }
 
         _lsi->reset();
@@ -140,11 +269,6 @@ GeometryClamper::apply(osg::Drawable& drawable)
         if ( _lsi->containsIntersections() )
         {
             osg::Vec3d fw = _lsi->getFirstIntersection().getWorldIntersectPoint();
-            //if ( _scale != 1.0 )
-            //{
-            //    osg::Vec3d delta = fw - msl;
-            //    fw += delta*_scale;
-            //}
 
             if ( _offset != 0.0 )
             {
@@ -157,26 +281,11 @@ GeometryClamper::apply(osg::Drawable& drawable)
             }
 
             (*verts)[k] = (fw * world2local);
-            geomDirty = true;
             ++count;
         }
     }
 
-    if ( geomDirty )
-    {
-        geom->dirtyBound();
-        if ( geom->getUseVertexBufferObjects() )
-        {
-            verts->getVertexBufferObject()->setUsage( GL_DYNAMIC_DRAW_ARB );
-            verts->dirty();
-        }
-        else
-        {
-            geom->dirtyDisplayList();
-        }
-
-        OE_DEBUG << LC << "clamped " << count << " verts." << std::endl;
-    }
+    return count;
 }
 
 
@@ -19,9 +19,14 @@
 #include <osgEarth/HTTPClient>
 #include <osgEarth/Progress>
 #include <osgEarth/Metrics>
+#include <osgEarth/TileLoadTrace>
+#include <osgEarth/Registry>
+#include <osgEarth/JobScheduler>
 #include <osgDB/ReadFile>
 #include <osgDB/FileNameUtils>
 #include <curl/curl.h>
+#include <OpenThreads/Condition>
+#include <map>
 
 // Whether to use WinInet instead of cURL - CMAKE option
 #ifdef OSGEARTH_USE_WININET_FOR_HTTP
@@ -113,12 +118,12 @@ namespace osgEarth
 
         void writeHeader(const char* ptr, size_t realsize)
         {
-            std::string header(ptr);
-            StringTokenizer tok(":");
-            StringVector tized;
-            tok.tokenize(header, tized);
-            if ( tized.size() >= 2 )
-                _headers[tized[0]] = tized[1];
+            // The header data is not null-terminated, and values like dates
+            // and ETags may contain colons, so split at the first one only.
+            std::string header(ptr, realsize);
+            std::string::size_type colon = header.find(':');
+            if ( colon != std::string::npos && colon > 0 )
+                _headers[trim(header.substr(0, colon))] = trim(header.substr(colon+1));
         }
 
         std::ostream* _stream;
@@ -171,7 +176,8 @@ static int CurlProgressCallback(void *clientp,double dltotal,double dlnow,double
 /****************************************************************************/
 
 HTTPRequest::HTTPRequest( const std::string& url )
-: _url( url )
+: _url( url ),
+_keepEncodedData( false )
 {
     //NOP
 }
@@ -179,7 +185,8 @@ HTTPRequest::HTTPRequest( const std::string& url )
 HTTPRequest::HTTPRequest( const HTTPRequest& rhs ) :
 _parameters( rhs._parameters ),
 _headers(rhs._headers),
-_url( rhs._url )
+_url( rhs._url ),
+_keepEncodedData( rhs._keepEncodedData )
 {
     //nop
 }
@@ -239,6 +246,11 @@ void HTTPRequest::setLastModified( const DateTime &lastModified)
     addHeader("If-Modified-Since", lastModified.asRFC1123());
 }
 
+void HTTPRequest::setETag( const std::string& etag )
+{
+    addHeader("If-None-Match", etag);
+}
+
 
 std::string
 HTTPRequest::getURL() const
@@ -387,6 +399,71 @@ namespace
     static osg::ref_ptr< URLRewriter > s_rewriter;
 
     static osg::ref_ptr< CurlConfigHandler > s_curlConfigHandler;
+
+    // Maximum number of simultaneous requests to one host (0 = no limit)
+    static unsigned                    s_maxConnectionsPerHost = 0u;
+
+    // Share handle so that all the per-thread curl handles draw from one
+    // pool of live connections, DNS results and TLS sessions.
+    static CURLSH*                     s_curlShare = 0L;
+    static Threading::Mutex            s_curlShareMutex[CURL_LOCK_DATA_LAST];
+
+    void curlShareLock(CURL*, curl_lock_data data, curl_lock_access, void*)
+    {
+        s_curlShareMutex[data].lock();
+    }
+
+    void curlShareUnlock(CURL*, curl_lock_data data, void*)
+    {
+        s_curlShareMutex[data].unlock();
+    }
+
+    // Caps the number of transfers in flight to any one host, so a large
+    // pager thread pool doesn't get us throttled (or banned) by a server.
+    class HostLimiter
+    {
+    public:
+        void acquire(const std::string& host)
+        {
+            Threading::ScopedMutexLock lock(_mutex);
+            while (s_maxConnectionsPerHost > 0u && _active[host] >= s_maxConnectionsPerHost)
+                _cond.wait(&_mutex, 100);
+            ++_active[host];
+        }
+
+        void release(const std::string& host)
+        {
+            Threading::ScopedMutexLock lock(_mutex);
+            std::map<std::string, unsigned>::iterator i = _active.find(host);
+            if (i != _active.end() && --i->second == 0u)
+                _active.erase(i);
+            _cond.broadcast();
+        }
+
+    private:
+        std::map<std::string, unsigned> _active;
+        Threading::Mutex                _mutex;
+        OpenThreads::Condition          _cond;
+    };
+
+    static HostLimiter s_hostLimiter;
+
+    struct ScopedHostSlot
+    {
+        ScopedHostSlot(const std::string& url) : _host(getHost(url)), _limited(s_maxConnectionsPerHost > 0u) {
+            if (_limited) s_hostLimiter.acquire(_host);
+        }
+        ~ScopedHostSlot() {
+            if (_limited) s_hostLimiter.release(_host);
+        }
+        static std::string getHost(const std::string& url) {
+            std::string::size_type start = url.find("://");
+            start = start == std::string::npos ? 0 : start + 3;
+            return url.substr(start, url.find_first_of("/?#", start) - start);
+        }
+        std::string _host;
+        bool        _limited;
+    };
 }
 
 HTTPClient&
@@ -466,6 +543,26 @@ HTTPClient::initializeImpl()
     // Note that you must have curl built against zlib to support gzip or deflate encoding.
     curl_easy_setopt( _curl_handle, CURLOPT_ENCODING, "");
 
+    // Draw connections from the shared pool and keep them alive so that
+    // requests to the same server reuse them instead of reconnecting.
+    if ( s_curlShare )
+    {
+        curl_easy_setopt( _curl_handle, CURLOPT_SHARE, s_curlShare );
+    }
+#if LIBCURL_VERSION_NUM >= 0x071900
+    curl_easy_setopt( _curl_handle, CURLOPT_TCP_KEEPALIVE, 1L );
+#endif
+
+    // Negotiate HTTP/2 over TLS where the server supports it, and prefer
+    // multiplexing over an existing connection to opening a new one.
+#if LIBCURL_VERSION_NUM >= 0x072F00
+    if ( !::getenv("OSGEARTH_HTTP_DISABLE_HTTP2") )
+    {
+        curl_easy_setopt( _curl_handle, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS );
+        curl_easy_setopt( _curl_handle, CURLOPT_PIPEWAIT, 1L );
+    }
+#endif
+
     osg::ref_ptr< CurlConfigHandler > curlConfigHandler = getCurlConfigHandler();
     if (curlConfigHandler.valid()) {
         curlConfigHandler->onInitialize(_curl_handle);
@@ -558,10 +655,41 @@ void HTTPClient::setCurlConfighandler(CurlConfigHandler* handler)
     s_curlConfigHandler = handler;
 }
 
+unsigned HTTPClient::getMaxConnectionsPerHost()
+{
+    return s_maxConnectionsPerHost;
+}
+
+void HTTPClient::setMaxConnectionsPerHost(unsigned value)
+{
+    s_maxConnectionsPerHost = value;
+}
+
 void
 HTTPClient::globalInit()
 {
     curl_global_init(CURL_GLOBAL_ALL);
+
+    if ( !s_curlShare )
+    {
+        s_curlShare = curl_share_init();
+        if ( s_curlShare )
+        {
+            curl_share_setopt( s_curlShare, CURLSHOPT_LOCKFUNC, curlShareLock );
+            curl_share_setopt( s_curlShare, CURLSHOPT_UNLOCKFUNC, curlShareUnlock );
+            curl_share_setopt( s_curlShare, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS );
+            curl_share_setopt( s_curlShare, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION );
+#if LIBCURL_VERSION_NUM >= 0x073900
+            curl_share_setopt( s_curlShare, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT );
+#endif
+        }
+    }
+
+    const char* maxPerHost = ::getenv("OSGEARTH_HTTP_MAX_CONNECTIONS_PER_HOST");
+    if ( maxPerHost )
+    {
+        s_maxConnectionsPerHost = osgEarth::as<unsigned>(std::string(maxPerHost), 0u);
+    }
 }
 
 void
@@ -700,6 +828,37 @@ HTTPClient::readImage(const HTTPRequest&    request,
     return getClient().doReadImage( request, options, progress );
 }
 
+namespace
+{
+    struct ReadImageTask : public TaskRequest
+    {
+        ReadImageTask(const HTTPRequest& request, const osgDB::Options* dbOptions, ProgressCallback* progress) :
+            _request(request), _dbOptions(dbOptions), _progress(progress) { }
+
+        void operator()(ProgressCallback*)
+        {
+            ReadResult r = HTTPClient::readImage(_request, _dbOptions.get(), _progress.get());
+            _promise.resolve(r.succeeded() ? r.releaseImage() : 0L);
+        }
+
+        HTTPRequest                         _request;
+        osg::ref_ptr<const osgDB::Options>  _dbOptions;
+        osg::ref_ptr<ProgressCallback>      _progress;
+        Threading::Promise<osg::Image>      _promise;
+    };
+}
+
+Threading::Future<osg::Image>
+HTTPClient::readImageAsync(const HTTPRequest&    request,
+                           const osgDB::Options* options,
+                           ProgressCallback*     progress)
+{
+    ReadImageTask* task = new ReadImageTask(request, options, progress);
+    Threading::Future<osg::Image> result = task->_promise.getFuture();
+    Registry::instance()->getJobScheduler()->submit(task);
+    return result;
+}
+
 ReadResult
 HTTPClient::readNode(const HTTPRequest&    request,
                      const osgDB::Options* options,
@@ -732,6 +891,33 @@ HTTPClient::download(const std::string& uri,
 }
 
 
+namespace
+{
+    // Live HTTP metrics (see Metrics::getValue) for the life of one request,
+    // plus the "http" stage of the tile being traced, if any.
+    struct HTTPMetricsScope
+    {
+        HTTPMetricsScope() : _start(osg::Timer::instance()->tick()), _traceStage("http")
+        {
+            static MetricValue* s_requests = Metrics::getValue("http.requests");
+            static MetricValue* s_inFlight = Metrics::getValue("http.in_flight");
+            s_requests->increment();
+            s_inFlight->increment();
+        }
+
+        ~HTTPMetricsScope()
+        {
+            static MetricValue* s_inFlight = Metrics::getValue("http.in_flight");
+            static MetricValue* s_latency = Metrics::getValue("http.latency_ms");
+            s_inFlight->decrement();
+            s_latency->set((unsigned)osg::Timer::instance()->delta_m(_start, osg::Timer::instance()->tick()));
+        }
+
+        osg::Timer_t _start;
+        TileLoadTrace::ScopedStage _traceStage;
+    };
+}
+
 #ifdef OSGEARTH_USE_WININET_FOR_HTTP
 
 namespace
@@ -766,6 +952,8 @@ HTTPClient::doGet(const HTTPRequest&    request,
     METRIC_BEGIN("HTTPClient::doGet", 1,
                    "url", request.getURL().c_str());
 
+    HTTPMetricsScope liveMetrics;
+
     OE_START_TIMER(http_get);
 
     std::string url = request.getURL();
@@ -986,6 +1174,8 @@ HTTPClient::doGet(const HTTPRequest&    request,
     METRIC_BEGIN("HTTPClient::doGet", 1,
                    "url", request.getURL().c_str());
 
+    HTTPMetricsScope liveMetrics;
+
     initialize();
 
     OE_START_TIMER(http_get);
@@ -1184,7 +1374,10 @@ HTTPClient::doGet(const HTTPRequest&    request,
             curlConfigHandler->onGet(_curl_handle);
         }
 
-        res = curl_easy_perform(_curl_handle);
+        {
+            ScopedHostSlot slot(url);
+            res = curl_easy_perform(_curl_handle);
+        }
 
         curl_easy_setopt( _curl_handle, CURLOPT_WRITEDATA, (void*)0 );
         curl_easy_setopt( _curl_handle, CURLOPT_PROGRESSDATA, (void*)0);
@@ -1387,7 +1580,7 @@ HTTPClient::doDownload(const std::string& url, const std::string& filename)
 namespace
 {
     osgDB::ReaderWriter*
-    getReader( const std::string& url, const HTTPResponse& response )
+    getReader( const std::string& url, const HTTPResponse& response, std::string* format =0L )
     {
         osgDB::ReaderWriter* reader = 0L;
 
@@ -1396,6 +1589,8 @@ namespace
         if ( !ext.empty() )
         {
             reader = osgDB::Registry::instance()->getReaderWriterForExtension( ext );
+            if ( reader && format )
+                *format = ext;
         }
 
         if ( !reader )
@@ -1405,6 +1600,8 @@ namespace
             if ( !mimeType.empty() )
             {
                 reader = osgDB::Registry::instance()->getReaderWriterForMimeType(mimeType);
+                if ( reader && format )
+                    *format = mimeType;
             }
         }
 
@@ -1437,7 +1634,8 @@ HTTPClient::doReadImage(const HTTPRequest&    request,
 
     if (response.isOK())
     {
-        osgDB::ReaderWriter* reader = getReader(request.getURL(), response);
+        std::string format;
+        osgDB::ReaderWriter* reader = getReader(request.getURL(), response, &format);
         if (!reader)
         {
             result = ReadResult(ReadResult::RESULT_NO_READER);
@@ -1449,6 +1647,12 @@ HTTPClient::doReadImage(const HTTPRequest&    request,
             if ( rr.validImage() )
             {
                 result = ReadResult(rr.takeImage());
+
+                // keep the original bytes so the caller can cache them without re-encoding
+                if ( request.getKeepEncodedData() && response.getNumParts() == 1 )
+                {
+                    result.setEncodedData( new StringObject(response.getPartAsString(0)), format );
+                }
             }
             else
             {
@@ -27,6 +27,38 @@
 namespace
 {
     const std::string OSGEARTH_HORIZON_UDC_NAME = "osgEarth.Horizon";
+
+    // Same result as osg::computeLocalToWorld(path) with the last "count"
+    // nodes of the path, but works on the visitor's path in place; copying
+    // the path and running a TransformVisitor for every annotation in every
+    // cull adds up.
+    void computeLocalToWorld(const osg::NodePath& path, unsigned count, osg::Matrixd& out)
+    {
+        out.makeIdentity();
+
+        // start after the last absolute camera, like osg::computeLocalToWorld.
+        unsigned first = 0;
+        for (unsigned i = count; i > 0; --i)
+        {
+            const osg::Transform* xform = path[i-1]->asTransform();
+            if (xform)
+            {
+                const osg::Camera* camera = dynamic_cast<const osg::Camera*>(xform);
+                if (camera && (camera->getReferenceFrame() != osg::Transform::RELATIVE_RF || camera->getParents().empty()))
+                {
+                    first = i;
+                    break;
+                }
+            }
+        }
+
+        for (unsigned i = first; i < count; ++i)
+        {
+            const osg::Transform* xform = path[i]->asTransform();
+            if (xform)
+                xform->computeLocalToWorldMatrix(out, 0L);
+        }
+    }
 }
 
 using namespace osgEarth;
@@ -365,18 +397,20 @@ HorizonCullCallback::isVisible(osg::Node* node, osg::NodeVisitor* nv)
     if ( !node )
         return false;
 
-    osg::NodePath np = nv->getNodePath();
-    osg::Matrix local2world;
     Horizon* horizon = Horizon::get(*nv);
 
     // If we fetched the Horizon from the nodevisitor...
     if ( horizon )
     {
-        // pop the last node in the path (which is the node this callback is on)
+        // skip the last node in the path (which is the node this callback is on)
         // to prevent double-transforming the bounding sphere's center point
-        if (!np.empty() && np.back() == node)
-            np.pop_back();
-        local2world = osg::computeLocalToWorld(np);
+        const osg::NodePath& np = nv->getNodePath();
+        unsigned count = np.size();
+        if (count > 0 && np.back() == node)
+            --count;
+
+        osg::Matrixd local2world;
+        computeLocalToWorld(np, count, local2world);
 
         const osg::BoundingSphere& bs = node->getBound();
         double radius = _centerOnly ? 0.0 : bs.radius();
@@ -22,6 +22,7 @@
 #include <osgEarth/Progress>
 #include <osgEarth/Capabilities>
 #include <osgEarth/Metrics>
+#include <osgEarth/TileLoadTrace>
 
 using namespace osgEarth;
 using namespace OpenThreads;
@@ -73,11 +74,13 @@ ImageLayerOptions::setDefaults()
     _minRange.init( 0.0 );
     _maxRange.init( FLT_MAX );
     _featherPixels.init( false );
+    _precomputeMipmaps.init( false );
     _minFilter.init( osg::Texture::LINEAR_MIPMAP_LINEAR );
     _magFilter.init( osg::Texture::LINEAR );
     _texcomp.init( osg::Texture::USE_IMAGE_DATA_FORMAT ); // none
     _shared.init( false );
     _coverage.init( false );    
+    _sequenceLookahead.init( 0u );
 }
 
 void
@@ -96,6 +99,7 @@ ImageLayerOptions::fromConfig(const Config& conf)
     conf.getIfSet( "shared",         _shared );
     conf.getIfSet( "coverage",       _coverage );
     conf.getIfSet( "feather_pixels", _featherPixels);
+    conf.getIfSet( "precompute_mipmaps", _precomputeMipmaps );
 
     if ( conf.hasValue( "transparent_color" ) )
         _transparentColor = stringToColor( conf.value( "transparent_color" ), osg::Vec4ub(0,0,0,0));
@@ -127,6 +131,8 @@ ImageLayerOptions::fromConfig(const Config& conf)
     // uniform names
     conf.getIfSet("shared_sampler", _shareTexUniformName);
     conf.getIfSet("shared_matrix",  _shareTexMatUniformName);
+
+    conf.getIfSet("sequence_lookahead", _sequenceLookahead);
 }
 
 Config
@@ -141,6 +147,7 @@ ImageLayerOptions::getConfig() const
     conf.set( "shared",         _shared );
     conf.set( "coverage",       _coverage );
     conf.set( "feather_pixels", _featherPixels );
+    conf.set( "precompute_mipmaps", _precomputeMipmaps );
 
     if (_transparentColor.isSet())
         conf.set("transparent_color", colorToString( _transparentColor.value()));
@@ -177,6 +184,8 @@ ImageLayerOptions::getConfig() const
     conf.set("shared_sampler", _shareTexUniformName);
     conf.set("shared_matrix",  _shareTexMatUniformName);
 
+    conf.set("sequence_lookahead", _sequenceLookahead);
+
     //if (driver().isSet())
     //    conf.set("driver", driver()->getDriver());
 
@@ -340,7 +349,7 @@ ImageLayer::open()
 
     // If we are using createTexture to make image tiles,
     // we don't need to load a tile source plugin.
-    if (createTextureSupported())
+    if (createTextureSupported() && !getTileSource())
     {
         setTileSourceExpected(false);
     }
@@ -348,6 +357,20 @@ ImageLayer::open()
     return TerrainLayer::open();
 }
 
+bool
+ImageLayer::createTextureSupported() const
+{
+    TileSource* source = getTileSource();
+    return source && source->createTextureSupported();
+}
+
+osg::Texture*
+ImageLayer::createTexture(const TileKey& key, ProgressCallback* progress, osg::Matrixf& textureMatrix)
+{
+    TileSource* source = getTileSource();
+    return source ? source->createTexture(key, progress, textureMatrix) : 0L;
+}
+
 void
 ImageLayer::init()
 {
@@ -461,6 +484,15 @@ ImageLayer::getOrCreatePreCacheOp()
     return _preCacheOp.get();
 }
 
+std::string
+ImageLayer::getCacheKey(const TileKey& key) const
+{
+    // the cache key combines the Key and the horizontal profile.
+    return Cache::makeCacheKey(
+        Stringify() << key.str() << "-" << key.getProfile()->getHorizSignature(),
+        "image");
+}
+
 GeoImage
 ImageLayer::createImage(const TileKey&    key,
                         ProgressCallback* progress)
@@ -469,6 +501,10 @@ ImageLayer::createImage(const TileKey&    key,
                     "key", key.str().c_str(),
                     "name", getName().c_str());
 
+    TileLoadTrace::ScopedStage traceStage("image");
+
+    PendingRequest pending(this);
+
     if (getStatus().isError())
     {
         return GeoImage::INVALID;
@@ -572,16 +608,19 @@ ImageLayer::createImageInKeyProfile(const TileKey&    key,
         return GeoImage::INVALID;
     }
 
+    // Nothing there; skip both the cache and the source.
+    if ( isKnownEmpty(key) )
+    {
+        return GeoImage::INVALID;
+    }
+
 
     GeoImage result;
 
     OE_DEBUG << LC << "create image for \"" << key.str() << "\", ext= "
         << key.getExtent().toString() << std::endl;
 
-    // the cache key combines the Key and the horizontal profile.
-    std::string cacheKey = Cache::makeCacheKey(
-        Stringify() << key.str() << "-" << key.getProfile()->getHorizSignature(),
-        "image");
+    std::string cacheKey = getCacheKey(key);
 
     const CachePolicy& policy = getCacheSettings()->cachePolicy().get();
     
@@ -627,7 +666,11 @@ ImageLayer::createImageInKeyProfile(const TileKey&    key,
     // map profile, we can try this first.
     if ( cacheBin && policy.isCacheReadable() )
     {
-        ReadResult r = cacheBin->readImage(cacheKey, 0L);
+        ReadResult r;
+        {
+            TileLoadTrace::ScopedStage traceStage("cache.read");
+            r = cacheBin->readImage(cacheKey, 0L);
+        }
         if ( r.succeeded() )
         {
             cachedImage = r.releaseImage();
@@ -636,6 +679,13 @@ ImageLayer::createImageInKeyProfile(const TileKey&    key,
             if (!expired)
             {
                 OE_DEBUG << "Got cached image for " << key.str() << std::endl;                
+
+                // keep the decoded image so the next request doesn't decode it again
+                if ( _memCache.valid() )
+                {
+                    _memCache->getOrCreateDefaultBin()->write(cacheKey, cachedImage.get(), 0L);
+                }
+
                 return GeoImage( cachedImage.get(), key.getExtent() );                        
             }
             else
@@ -673,6 +723,18 @@ ImageLayer::createImageInKeyProfile(const TileKey&    key,
     if ( result.valid() )
     {
         ImageUtils::fixInternalFormat( result.getImage() );
+
+        // Compress and/or build mipmaps before caching so that cache hits
+        // hand back GPU-ready data.
+        osg::ref_ptr<osg::Image> compressed = createCompressedImage( result.getImage() );
+        if ( compressed.valid() )
+        {
+            result = GeoImage( compressed.get(), result.getExtent() );
+        }
+        else if ( needsPrecomputedMipmaps(result.getImage()) )
+        {
+            result = GeoImage( ImageUtils::buildBoxFilteredMipmaps(result.getImage()), result.getExtent() );
+        }
     }
 
     // Check for cancelation before writing to a cache:
@@ -699,6 +761,7 @@ ImageLayer::createImageInKeyProfile(const TileKey&    key,
             OE_INFO << LC << "WARNING! mismatched extents." << std::endl;
         }
 
+        TileLoadTrace::ScopedStage traceStage("cache.write");
         cacheBin->write(cacheKey, result.getImage(), 0L);
     }
 
@@ -777,6 +840,8 @@ ImageLayer::createImageFromTileSource(const TileKey&    key,
         {
             source->getBlacklist()->add( key );
         }
+
+        setKnownEmpty( key, progress );
     }
 
     if (progress && progress->isCanceled())
@@ -948,12 +1013,18 @@ ImageLayer::assembleImage(const TileKey& key, ProgressCallback* progress)
         // same (even though extents are different), then this operation is technically not a
         // reprojection but merely a resampling.
 
+        ImageResampler::Filter filter =
+            options().driver()->bicubicReprojection() == true ? ImageResampler::FILTER_BICUBIC :
+            options().driver()->bilinearReprojection() == true ? ImageResampler::FILTER_BILINEAR :
+            ImageResampler::FILTER_NEAREST;
+
+        GeoExtent extent = key.getExtent();
         result = mosaicedImage.reproject( 
             key.getProfile()->getSRS(),
-            &key.getExtent(), 
+            &extent, 
             options().reprojectedTileSize().get(),
             options().reprojectedTileSize().get(),
-            options().driver()->bilinearReprojection().get());
+            filter);
     }
 
     // Process images with full alpha to properly support MP blending.
@@ -973,6 +1044,79 @@ ImageLayer::assembleImage(const TileKey& key, ProgressCallback* progress)
 }
 
 
+bool
+ImageLayer::needsPrecomputedMipmaps(const osg::Image* image) const
+{
+    if ( !image || options().precomputeMipmaps() != true || isCoverage() )
+        return false;
+
+    osg::Texture::FilterMode minFilter = options().minFilter().get();
+    bool mipmapped =
+        minFilter == osg::Texture::LINEAR_MIPMAP_LINEAR ||
+        minFilter == osg::Texture::LINEAR_MIPMAP_NEAREST ||
+        minFilter == osg::Texture::NEAREST_MIPMAP_LINEAR ||
+        minFilter == osg::Texture::NEAREST_MIPMAP_NEAREST;
+
+    // Non-power-of-two and compressed tiles never get mipmap filtering.
+    return
+        mipmapped &&
+        !image->isMipmap() &&
+        ImageUtils::isPowerOfTwo(image) &&
+        !ImageUtils::isCompressed(image);
+}
+
+osg::Image*
+ImageLayer::createCompressedImage(const osg::Image* image) const
+{
+    // Only the "fastdxt" mode compresses on the CPU; coverages must never be
+    // compressed since it will corrupt the data.
+    if ( !image ||
+         isCoverage() ||
+         options().textureCompression() != (osg::Texture::InternalFormatMode)(~0 - 1) ||
+         ImageUtils::isCompressed(image) ||
+         image->getDataType() != GL_UNSIGNED_BYTE )
+    {
+        return 0L;
+    }
+
+    osg::Texture::InternalFormatMode mode;
+    // RGB uses DXT1
+    if (image->getPixelFormat() == GL_RGB)
+    {
+        mode = osg::Texture::USE_S3TC_DXT1_COMPRESSION;
+    }
+    // RGBA uses DXT5
+    else if (image->getPixelFormat() == GL_RGBA)
+    {         
+        mode = osg::Texture::USE_S3TC_DXT5_COMPRESSION;
+    }
+    else
+    {
+        OE_DEBUG << "FastDXT only works on GL_RGBA or GL_RGB images" << std::endl;
+        return 0L;
+    }
+
+    osgDB::ImageProcessor* imageProcessor = osgDB::Registry::instance()->getImageProcessorForExtension("fastdxt");
+    if ( !imageProcessor )
+    {
+        OE_WARN << "Failed to get ImageProcessor fastdxt" << std::endl;
+        return 0L;
+    }
+
+    // Compress a copy; the source image may be shared (e.g. by a memory cache).
+    osg::Timer_t start = osg::Timer::instance()->tick();
+    osg::ref_ptr<osg::Image> output = ImageUtils::cloneImage(image);
+    imageProcessor->compress(*output.get(), mode, true, true, osgDB::ImageProcessor::USE_CPU, osgDB::ImageProcessor::FASTEST);
+    osg::Timer_t end = osg::Timer::instance()->tick();
+    OE_DEBUG << "Compress took " << osg::Timer::instance()->delta_m(start, end) << std::endl;
+
+    if ( !ImageUtils::isCompressed(output.get()) )
+        return 0L;
+
+    ImageUtils::markAsNormalized(output.get(), ImageUtils::isNormalized(image));
+    return output.release();
+}
+
 void
 ImageLayer::applyTextureCompressionMode(osg::Texture* tex) const
 {
@@ -1009,39 +1153,17 @@ ImageLayer::applyTextureCompressionMode(osg::Texture* tex) const
     }
     else if ( options().textureCompression() == (osg::Texture::InternalFormatMode)(~0 - 1))
     {
-        osg::Timer_t start = osg::Timer::instance()->tick();
-        osgDB::ImageProcessor* imageProcessor = osgDB::Registry::instance()->getImageProcessorForExtension("fastdxt");
-        if (imageProcessor)
+        // Images that came through createImage() are already compressed;
+        // this only catches raw images (e.g. from an older cache).
+        osg::Image* image = tex->getImage(0);
+        if ( image && !ImageUtils::isCompressed(image) )
         {
-            osg::Texture::InternalFormatMode mode;
-            // RGB uses DXT1
-            if (tex->getImage(0)->getPixelFormat() == GL_RGB)
+            osg::ref_ptr<osg::Image> compressed = createCompressedImage(image);
+            if ( compressed.valid() )
             {
-                mode = osg::Texture::USE_S3TC_DXT1_COMPRESSION;
-            }
-            // RGBA uses DXT5
-            else if (tex->getImage(0)->getPixelFormat() == GL_RGBA)
-            {         
-                mode = osg::Texture::USE_S3TC_DXT5_COMPRESSION;
+                tex->setImage(0, compressed.get());
             }
-            else
-            {
-                OE_DEBUG << "FastDXT only works on GL_RGBA or GL_RGB images" << std::endl;
-                return;
-            }
-
-            osg::Image *image = tex->getImage(0);
-            imageProcessor->compress(*image, mode, false, true, osgDB::ImageProcessor::USE_CPU, osgDB::ImageProcessor::FASTEST);
-            osg::Timer_t end = osg::Timer::instance()->tick();
-            image->dirty();
-            tex->setImage(0, image);
-            OE_DEBUG << "Compress took " << osg::Timer::instance()->delta_m(start, end) << std::endl;        
         }
-        else
-        {
-            OE_WARN << "Failed to get ImageProcessor fastdxt" << std::endl;
-        }
-
     }
     else if ( options().textureCompression().isSet() )
     {
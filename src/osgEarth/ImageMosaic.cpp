@@ -18,6 +18,7 @@
  */
 
 #include <osgEarth/ImageMosaic>
+#include <string.h>
 
 #define LC "[ImageMosaic] "
 
@@ -113,10 +114,18 @@ ImageMosaic::createImage()
     //Initialize the image to be completely white!
     //memset(image->data(), 0xFF, image->getImageSizeInBytes());
 
+    // Write the first row pixel by pixel, then replicate it with memcpy so
+    // we don't pay for a PixelWriter call on every pixel of a large mosaic.
     ImageUtils::PixelWriter write(image.get());
-    for (unsigned t = 0; t < pixelsHigh; ++t)
+    for (unsigned r = 0; r < tileDepth; ++r)
+    {
         for (unsigned s = 0; s < pixelsWide; ++s)
-            write(osg::Vec4(1,1,1,0), s, t);
+            write(osg::Vec4(1,1,1,0), s, 0, r);
+
+        const unsigned char* firstRow = image->data(0, 0, r);
+        for (unsigned t = 1; t < pixelsHigh; ++t)
+            memcpy(image->data(0, t, r), firstRow, image->getRowSizeInBytes());
+    }
 
     //Composite the incoming images into the master image
     for (TileImageList::iterator i = _images.begin(); i != _images.end(); ++i)
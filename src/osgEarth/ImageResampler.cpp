@@ -0,0 +1,380 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2016 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/ImageResampler>
+#include <osgEarth/ImageUtils>
+#include <osgEarth/JobScheduler>
+#include <osgEarth/Registry>
+#include <osg/Math>
+
+#define LC "[ImageResampler] "
+
+using namespace osgEarth;
+
+namespace
+{
+    // Catmull-Rom weights for the 4 taps around a sample, where "t" is the
+    // fractional distance past the second tap.
+    inline void cubicWeights(double t, double w[4])
+    {
+        const double t2 = t*t, t3 = t2*t;
+        w[0] = 0.5 * (-t3 + 2.0*t2 - t);
+        w[1] = 0.5 * (3.0*t3 - 5.0*t2 + 2.0);
+        w[2] = 0.5 * (-3.0*t3 + 4.0*t2 + t);
+        w[3] = 0.5 * (t3 - t2);
+    }
+
+    template<typename T> inline T toChannel(double v);
+
+    template<> inline unsigned char toChannel<unsigned char>(double v)
+    {
+        return v <= 0.0 ? 0 : v >= 255.0 ? 255 : (unsigned char)(v + 0.5);
+    }
+
+    template<> inline float toChannel<float>(double v)
+    {
+        return (float)v;
+    }
+
+    /**
+     * Samples an image of N interleaved channels of type T straight out of
+     * its pixel rows. Each filter gets its own loop so the per-channel inner
+     * loops have a constant trip count the compiler can unroll.
+     */
+    template<typename T, int N>
+    struct NativeSampler
+    {
+        const unsigned char* _data;
+        unsigned _rowStep;
+        int _s, _t;
+
+        NativeSampler(const osg::Image* image, unsigned rowStep) :
+            _data(image->data()), _rowStep(rowStep), _s(image->s()), _t(image->t()) { }
+
+        inline const T* row(int y) const
+        {
+            return reinterpret_cast<const T*>(_data + y*_rowStep);
+        }
+
+        void nearest(const double* px, const double* py, unsigned count, T* out) const
+        {
+            for (unsigned i = 0; i < count; ++i, out += N)
+            {
+                if (px[i] < 0.0 || py[i] < 0.0)
+                    continue;
+
+                int x = osg::minimum((int)(px[i] + 0.5), _s-1);
+                int y = osg::minimum((int)(py[i] + 0.5), _t-1);
+                const T* p = row(y) + x*N;
+                for (int c = 0; c < N; ++c)
+                    out[c] = p[c];
+            }
+        }
+
+        void bilinear(const double* px, const double* py, unsigned count, T* out) const
+        {
+            for (unsigned i = 0; i < count; ++i, out += N)
+            {
+                if (px[i] < 0.0 || py[i] < 0.0)
+                    continue;
+
+                double x = osg::minimum(px[i], (double)(_s-1));
+                double y = osg::minimum(py[i], (double)(_t-1));
+                int x0 = (int)x, y0 = (int)y;
+                int x1 = osg::minimum(x0+1, _s-1), y1 = osg::minimum(y0+1, _t-1);
+                double fx = x - (double)x0, fy = y - (double)y0;
+
+                const T* p00 = row(y0) + x0*N;
+                const T* p10 = row(y0) + x1*N;
+                const T* p01 = row(y1) + x0*N;
+                const T* p11 = row(y1) + x1*N;
+
+                for (int c = 0; c < N; ++c)
+                {
+                    double bottom = (double)p00[c] + ((double)p10[c] - (double)p00[c]) * fx;
+                    double top    = (double)p01[c] + ((double)p11[c] - (double)p01[c]) * fx;
+                    out[c] = toChannel<T>(bottom + (top - bottom) * fy);
+                }
+            }
+        }
+
+        void bicubic(const double* px, const double* py, unsigned count, T* out) const
+        {
+            int xi[4], yi[4];
+            double wx[4], wy[4];
+
+            for (unsigned i = 0; i < count; ++i, out += N)
+            {
+                if (px[i] < 0.0 || py[i] < 0.0)
+                    continue;
+
+                double x = osg::minimum(px[i], (double)(_s-1));
+                double y = osg::minimum(py[i], (double)(_t-1));
+                int x0 = (int)x, y0 = (int)y;
+                cubicWeights(x - (double)x0, wx);
+                cubicWeights(y - (double)y0, wy);
+
+                for (int k = 0; k < 4; ++k)
+                {
+                    xi[k] = osg::clampBetween(x0 - 1 + k, 0, _s-1) * N;
+                    yi[k] = osg::clampBetween(y0 - 1 + k, 0, _t-1);
+                }
+
+                double sum[N];
+                for (int c = 0; c < N; ++c)
+                    sum[c] = 0.0;
+
+                for (int j = 0; j < 4; ++j)
+                {
+                    const T* r = row(yi[j]);
+                    for (int k = 0; k < 4; ++k)
+                    {
+                        const T* p = r + xi[k];
+                        double w = wx[k] * wy[j];
+                        for (int c = 0; c < N; ++c)
+                            sum[c] += w * (double)p[c];
+                    }
+                }
+
+                for (int c = 0; c < N; ++c)
+                    out[c] = toChannel<T>(sum[c]);
+            }
+        }
+
+        void run(ImageResampler::Filter filter, const double* px, const double* py, unsigned count, unsigned char* out) const
+        {
+            T* dst = reinterpret_cast<T*>(out);
+            switch (filter)
+            {
+            case ImageResampler::FILTER_NEAREST:  nearest (px, py, count, dst); break;
+            case ImageResampler::FILTER_BILINEAR: bilinear(px, py, count, dst); break;
+            case ImageResampler::FILTER_BICUBIC:  bicubic (px, py, count, dst); break;
+            }
+        }
+    };
+
+    // Fallback for formats without a native sampler.
+    void sampleGeneric(const osg::Image* source, ImageResampler::Filter filter,
+                       const double* px, const double* py, unsigned count,
+                       osg::Image* dest, unsigned row)
+    {
+        ImageUtils::PixelReader read(source);
+        ImageUtils::PixelWriter write(dest);
+        const int s = source->s(), t = source->t();
+
+        for (unsigned i = 0; i < count; ++i)
+        {
+            if (px[i] < 0.0 || py[i] < 0.0)
+                continue;
+
+            double x = osg::minimum(px[i], (double)(s-1));
+            double y = osg::minimum(py[i], (double)(t-1));
+            int x0 = (int)x, y0 = (int)y;
+            osg::Vec4 color;
+
+            if (filter == ImageResampler::FILTER_NEAREST)
+            {
+                color = read(osg::minimum((int)(x + 0.5), s-1), osg::minimum((int)(y + 0.5), t-1));
+            }
+            else if (filter == ImageResampler::FILTER_BILINEAR)
+            {
+                int x1 = osg::minimum(x0+1, s-1), y1 = osg::minimum(y0+1, t-1);
+                float fx = (float)(x - (double)x0), fy = (float)(y - (double)y0);
+                osg::Vec4 bottom = read(x0, y0)*(1.0f-fx) + read(x1, y0)*fx;
+                osg::Vec4 top    = read(x0, y1)*(1.0f-fx) + read(x1, y1)*fx;
+                color = bottom*(1.0f-fy) + top*fy;
+            }
+            else
+            {
+                double wx[4], wy[4];
+                cubicWeights(x - (double)x0, wx);
+                cubicWeights(y - (double)y0, wy);
+                color.set(0,0,0,0);
+                for (int j = 0; j < 4; ++j)
+                {
+                    int yj = osg::clampBetween(y0 - 1 + j, 0, t-1);
+                    for (int k = 0; k < 4; ++k)
+                    {
+                        int xk = osg::clampBetween(x0 - 1 + k, 0, s-1);
+                        color += read(xk, yj) * (float)(wx[k]*wy[j]);
+                    }
+                }
+                if (ImageUtils::isNormalized(source))
+                {
+                    for (int c = 0; c < 4; ++c)
+                        color[c] = osg::clampBetween(color[c], 0.0f, 1.0f);
+                }
+            }
+
+            write(color, (int)i, (int)row);
+        }
+    }
+
+    // Resamples a band of rows on the JobScheduler.
+    struct ResampleRowsTask : public TaskRequest
+    {
+        ResampleRowsTask(const ImageResampler* resampler, const double* px, const double* py,
+                         osg::Image* dest, unsigned firstRow, unsigned numRows) :
+            _resampler(resampler), _px(px), _py(py), _dest(dest), _firstRow(firstRow), _numRows(numRows) { }
+
+        void operator()(ProgressCallback*)
+        {
+            const unsigned width = _dest->s();
+            for (unsigned r = _firstRow; r < _firstRow + _numRows; ++r)
+            {
+                _resampler->resampleRow(_px + r*width, _py + r*width, width, _dest, r);
+            }
+        }
+
+        const ImageResampler* _resampler;
+        const double*         _px;
+        const double*         _py;
+        osg::Image*           _dest;
+        unsigned              _firstRow;
+        unsigned              _numRows;
+    };
+}
+
+//------------------------------------------------------------------------
+
+ImageResampler::ImageResampler(const osg::Image* source, Filter filter) :
+_source           ( source ),
+_filter           ( filter ),
+_rowStep          ( 0u ),
+_minParallelPixels( 512u*512u )
+{
+    if (_source && _source->data())
+    {
+        _rowStep = _source->t() > 1 ?
+            (unsigned)(_source->data(0, 1) - _source->data(0, 0)) :
+            _source->getRowSizeInBytes();
+    }
+}
+
+bool
+ImageResampler::isNativeFormat(const osg::Image* image)
+{
+    if (!image)
+        return false;
+
+    GLenum format = image->getPixelFormat();
+    GLenum type = image->getDataType();
+
+    return
+        (type == GL_UNSIGNED_BYTE && (format == GL_RGBA || format == GL_RGB)) ||
+        (type == GL_FLOAT && (format == GL_RED || format == GL_LUMINANCE));
+}
+
+bool
+ImageResampler::supports(const osg::Image* dest) const
+{
+    if (!_source || !_source->data() || !dest || !dest->data())
+        return false;
+
+    if (isNativeFormat(_source))
+    {
+        return
+            dest->getPixelFormat() == _source->getPixelFormat() &&
+            dest->getDataType() == _source->getDataType();
+    }
+
+    return
+        ImageUtils::PixelReader::supports(_source) &&
+        ImageUtils::PixelWriter::supports(dest);
+}
+
+void
+ImageResampler::resampleRow(const double* px, const double* py, unsigned count, osg::Image* dest, unsigned row) const
+{
+    count = osg::minimum(count, (unsigned)dest->s());
+    unsigned char* out = dest->data(0, row);
+
+    if (isNativeFormat(_source))
+    {
+        if (_source->getDataType() == GL_FLOAT)
+        {
+            NativeSampler<float, 1>(_source, _rowStep).run(_filter, px, py, count, out);
+        }
+        else if (_source->getPixelFormat() == GL_RGBA)
+        {
+            NativeSampler<unsigned char, 4>(_source, _rowStep).run(_filter, px, py, count, out);
+        }
+        else
+        {
+            NativeSampler<unsigned char, 3>(_source, _rowStep).run(_filter, px, py, count, out);
+        }
+    }
+    else
+    {
+        sampleGeneric(_source, _filter, px, py, count, dest, row);
+    }
+}
+
+void
+ImageResampler::resample(const double* px, const double* py, osg::Image* dest) const
+{
+    if (!supports(dest))
+    {
+        OE_WARN << LC << "Unsupported image format; cannot resample" << std::endl;
+        return;
+    }
+
+    const unsigned width = dest->s();
+    const unsigned height = dest->t();
+
+    JobScheduler* scheduler = 0L;
+    unsigned numBands = 1u;
+
+    if (width*height >= _minParallelPixels)
+    {
+        scheduler = Registry::instance()->getJobScheduler();
+        numBands = osg::minimum(height, (unsigned)scheduler->getNumThreads() + 1u);
+    }
+
+    if (numBands <= 1u)
+    {
+        for (unsigned r = 0; r < height; ++r)
+            resampleRow(px + r*width, py + r*width, width, dest, r);
+        return;
+    }
+
+    // Queue all but the first band and do the first one here.
+    const unsigned rowsPerBand = height / numBands;
+    osg::ref_ptr<JobGroup> jobs = new JobGroup();
+
+    for (unsigned b = 1; b < numBands; ++b)
+    {
+        unsigned firstRow = b * rowsPerBand;
+        unsigned numRows = b == numBands-1 ? height - firstRow : rowsPerBand;
+        scheduler->submit(
+            new ResampleRowsTask(this, px, py, dest, firstRow, numRows),
+            JobScheduler::LANE_HIGH,
+            jobs.get());
+    }
+
+    osg::ref_ptr<ResampleRowsTask> first = new ResampleRowsTask(this, px, py, dest, 0u, rowsPerBand);
+    (*first)(0L);
+
+    // A worker must help out rather than block, or it could end up
+    // waiting on jobs queued behind itself.
+    if (scheduler->isWorkerThread())
+    {
+        while (jobs->getNumPending() > 0u && scheduler->runOne());
+    }
+    jobs->wait();
+}
@@ -25,9 +25,16 @@
 
 // not needed for GL Core. Only for GL_R32F
 #include <osg/Texture>
+#include <osg/ValueObject>
 
 using namespace osgEarth;
 
+#ifndef GL_R16
+#define GL_R16 0x822A
+#endif
+
+#define SCALE_BIAS_KEY "oe_elevation_scale_bias"
+
 static bool
 isNoData( float f )
 {
@@ -201,6 +208,55 @@ osg::Image* ImageToHeightFieldConverter::convertToR32F(const osg::HeightField* h
     return image;
 }
 
+osg::Image* ImageToHeightFieldConverter::convertToR16(const osg::HeightField* hf) const
+{
+    if (!hf) {
+        return NULL;
+    }
+
+    const osg::FloatArray* heights = hf->getFloatArray();
+
+    float minHeight = FLT_MAX, maxHeight = -FLT_MAX;
+    for (unsigned i = 0; i < heights->size(); ++i)
+    {
+        float h = (*heights)[i];
+        if (!isNoData(h))
+        {
+            if (h < minHeight) minHeight = h;
+            if (h > maxHeight) maxHeight = h;
+        }
+    }
+
+    if (minHeight > maxHeight)
+        minHeight = maxHeight = 0.0f;
+
+    float range = maxHeight - minHeight;
+
+    osg::Image* image = new osg::Image();
+    image->allocateImage(hf->getNumColumns(), hf->getNumRows(), 1, GL_RED, GL_UNSIGNED_SHORT);
+    image->setInternalTextureFormat(GL_R16);
+
+    GLushort* ptr = (GLushort*)image->data();
+    for (unsigned i = 0; i < heights->size(); ++i)
+    {
+        float h = (*heights)[i];
+        float n = range > 0.0f && !isNoData(h) ? (h - minHeight) / range : 0.0f;
+        ptr[i] = (GLushort)(osg::clampBetween(n, 0.0f, 1.0f) * 65535.0f + 0.5f);
+    }
+
+    image->setUserValue(SCALE_BIAS_KEY, osg::Vec2f(range, minHeight));
+
+    return image;
+}
+
+osg::Vec2f ImageToHeightFieldConverter::getScaleBias(const osg::Image* image)
+{
+    osg::Vec2f scaleBias(1.0f, 0.0f);
+    if (image && image->getDataType() == GL_UNSIGNED_SHORT)
+        image->getUserValue(SCALE_BIAS_KEY, scaleBias);
+    return scaleBias;
+}
+
 osg::Image* ImageToHeightFieldConverter::convert32(const osg::HeightField* hf) const {
   if ( !hf ) {
     return NULL;
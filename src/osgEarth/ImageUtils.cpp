@@ -36,6 +36,10 @@
 #    define GL_RGB8A_INTERNAL GL_RGBA8
 #endif
 
+#ifndef GL_RG
+#    define GL_RG 0x8227
+#endif
+
 
 using namespace osgEarth;
 
@@ -194,6 +198,244 @@ ImageUtils::createBumpMap(const osg::Image* input)
     return output;
 }
 
+//------------------------------------------------------------------------
+
+// Format-specialized kernels. Each one runs over PixelRows/PixelSpans of a
+// fixed PixelLayout so the per-pixel work inlines; the public functions
+// below fall back on PixelReader/PixelWriter for any other format.
+namespace
+{
+    typedef ImageUtils::RGBA8 RGBA8;
+    typedef ImageUtils::RGB8  RGB8;
+    typedef ImageUtils::L8    L8;
+    typedef ImageUtils::R32F  R32F;
+
+    template<typename SRC, typename DST>
+    void mixRows(const osg::Image* src, osg::Image* dest, float a)
+    {
+        const bool srcHasAlpha  = SRC::numChannels == 4;
+        const bool destHasAlpha = DST::numChannels == 4;
+
+        for (int r = 0; r < src->r(); ++r)
+        {
+            ImageUtils::PixelRows<SRC> in(src, r);
+            ImageUtils::PixelRows<DST, osg::Image> out(dest, r);
+
+            for (unsigned t = 0; t < in.size(); ++t)
+            {
+                typename ImageUtils::PixelRows<SRC>::span_type inRow = in[t];
+                typename ImageUtils::PixelRows<DST, osg::Image>::span_type outRow = out[t];
+
+                for (unsigned s = 0; s < inRow.size(); ++s)
+                {
+                    const osg::Vec4 sp = inRow.read(s);
+                    const osg::Vec4 dp = outRow.read(s);
+                    float sa = srcHasAlpha ? a * sp.a() : a;
+                    float da = destHasAlpha ? dp.a() : 1.0f;
+                    outRow.write(s, osg::Vec4(
+                        dp.r()*(1.0f-sa) + sp.r()*sa,
+                        dp.g()*(1.0f-sa) + sp.g()*sa,
+                        dp.b()*(1.0f-sa) + sp.b()*sa,
+                        osg::maximum(sa, da)));
+                }
+            }
+        }
+    }
+
+    template<typename SRC>
+    bool mixFrom(const osg::Image* src, osg::Image* dest, float a)
+    {
+        if (RGBA8::matches(dest)) { mixRows<SRC, RGBA8>(src, dest, a); return true; }
+        if (RGB8::matches(dest))  { mixRows<SRC, RGB8> (src, dest, a); return true; }
+        return false;
+    }
+
+    bool mixSpecialized(const osg::Image* src, osg::Image* dest, float a)
+    {
+        if (RGBA8::matches(src)) return mixFrom<RGBA8>(src, dest, a);
+        if (RGB8::matches(src))  return mixFrom<RGB8> (src, dest, a);
+        return false;
+    }
+
+    // Source index pair and blend weight for one output row or column
+    // in resizeImage().
+    struct ResizeTap
+    {
+        int   _i0, _i1;
+        float _mix;
+    };
+
+    void computeResizeTaps(unsigned in_size, unsigned out_size, bool bilinear, std::vector<ResizeTap>& taps)
+    {
+        taps.resize(out_size);
+        for (unsigned i = 0; i < out_size; ++i)
+        {
+            float ratio = (float)i/(float)out_size;
+            float input = ratio * (float)in_size;
+            if ( input >= (float)in_size ) input = in_size-1;
+            else if ( input < 0 ) input = 0.0f;
+
+            ResizeTap& tap = taps[i];
+            if (bilinear)
+            {
+                tap._i0 = osg::maximum((int)floor(input), 0);
+                tap._i1 = osg::maximum(osg::minimum((int)ceil(input), (int)in_size-1), 0);
+                if (tap._i0 > tap._i1) tap._i0 = tap._i1;
+                tap._mix = tap._i1 > tap._i0 ? input - (float)tap._i0 : 0.0f;
+            }
+            else
+            {
+                // nearest neighbor:
+                tap._i0 = tap._i1 = (input-(int)input) <= (ceil(input)-input) ?
+                    (int)input :
+                    std::min( 1+(int)input, (int)in_size-1 );
+                tap._mix = 0.0f;
+            }
+        }
+    }
+
+    template<typename L>
+    void resizeRows(const osg::Image* input, osg::Image* output, bool bilinear)
+    {
+        typedef typename L::value_type T;
+        const unsigned N = L::numChannels;
+
+        std::vector<ResizeTap> cols, rows;
+        computeResizeTaps(input->s(), output->s(), bilinear, cols);
+        computeResizeTaps(input->t(), output->t(), bilinear, rows);
+
+        for (int layer = 0; layer < input->r(); ++layer)
+        {
+            ImageUtils::PixelRows<L> in(input, layer);
+            ImageUtils::PixelRows<L, osg::Image> out(output, layer);
+
+            for (unsigned t = 0; t < rows.size(); ++t)
+            {
+                const ResizeTap& row = rows[t];
+                typename ImageUtils::PixelRows<L>::span_type in0 = in[row._i0];
+                typename ImageUtils::PixelRows<L>::span_type in1 = in[row._i1];
+                typename ImageUtils::PixelRows<L, osg::Image>::span_type outRow = out[t];
+
+                for (unsigned s = 0; s < cols.size(); ++s)
+                {
+                    const ResizeTap& col = cols[s];
+                    T* dst = outRow[s];
+
+                    if (!bilinear)
+                    {
+                        const T* src = in0[col._i0];
+                        for (unsigned c = 0; c < N; ++c)
+                            dst[c] = src[c];
+                    }
+                    else
+                    {
+                        const T* p00 = in0[col._i0];
+                        const T* p10 = in0[col._i1];
+                        const T* p01 = in1[col._i0];
+                        const T* p11 = in1[col._i1];
+                        for (unsigned c = 0; c < N; ++c)
+                        {
+                            float r0 = (float)p00[c]*(1.0f-col._mix) + (float)p10[c]*col._mix;
+                            float r1 = (float)p01[c]*(1.0f-col._mix) + (float)p11[c]*col._mix;
+                            dst[c] = (T)(r0*(1.0f-row._mix) + r1*row._mix);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    bool resizeSpecialized(const osg::Image* input, osg::Image* output, bool bilinear)
+    {
+        if (!ImageUtils::sameFormat(input, output))
+            return false;
+
+        if (RGBA8::matches(input)) { resizeRows<RGBA8>(input, output, bilinear); return true; }
+        if (RGB8::matches(input))  { resizeRows<RGB8> (input, output, bilinear); return true; }
+        if (L8::matches(input))    { resizeRows<L8>   (input, output, bilinear); return true; }
+        if (R32F::matches(input))  { resizeRows<R32F> (input, output, bilinear); return true; }
+        return false;
+    }
+
+    template<typename SRC, typename DST>
+    void convertRows(const osg::Image* src, osg::Image* dst)
+    {
+        for (int r = 0; r < src->r(); ++r)
+        {
+            ImageUtils::PixelRows<SRC> in(src, r);
+            ImageUtils::PixelRows<DST, osg::Image> out(dst, r);
+
+            for (unsigned t = 0; t < in.size(); ++t)
+            {
+                typename ImageUtils::PixelRows<SRC>::span_type inRow = in[t];
+                typename ImageUtils::PixelRows<DST, osg::Image>::span_type outRow = out[t];
+
+                for (unsigned s = 0; s < inRow.size(); ++s)
+                    outRow.write(s, inRow.read(s));
+            }
+        }
+    }
+
+    template<typename SRC>
+    bool convertFrom(const osg::Image* src, osg::Image* dst)
+    {
+        if (RGBA8::matches(dst)) { convertRows<SRC, RGBA8>(src, dst); return true; }
+        if (RGB8::matches(dst))  { convertRows<SRC, RGB8> (src, dst); return true; }
+        if (L8::matches(dst))    { convertRows<SRC, L8>   (src, dst); return true; }
+        if (R32F::matches(dst))  { convertRows<SRC, R32F> (src, dst); return true; }
+        return false;
+    }
+
+    bool convertSpecialized(const osg::Image* src, osg::Image* dst)
+    {
+        if (RGBA8::matches(src)) return convertFrom<RGBA8>(src, dst);
+        if (RGB8::matches(src))  return convertFrom<RGB8> (src, dst);
+        if (L8::matches(src))    return convertFrom<L8>   (src, dst);
+        if (R32F::matches(src))  return convertFrom<R32F> (src, dst);
+        return false;
+    }
+
+    // Fills mipmap levels 1..n of "output" (whose level 0 is already
+    // populated) by box-filtering each level from the previous one.
+    template<typename L>
+    void boxFilterMipmaps(osg::Image* output)
+    {
+        typedef typename L::value_type T;
+        const unsigned N = L::numChannels;
+        const double bias = std::numeric_limits<T>::is_integer ? 0.5 : 0.0;
+
+        int in_s = output->s(), in_t = output->t();
+
+        for (unsigned level = 1; level < output->getNumMipmapLevels(); ++level)
+        {
+            const T* in = reinterpret_cast<const T*>(output->getMipmapData(level-1));
+            T* out = reinterpret_cast<T*>(output->getMipmapData(level));
+            const int s = osg::maximum(1, in_s >> 1), t = osg::maximum(1, in_t >> 1);
+
+            for (int y = 0; y < t; ++y)
+            {
+                const T* r0 = in + osg::minimum(2*y,   in_t-1)*in_s*N;
+                const T* r1 = in + osg::minimum(2*y+1, in_t-1)*in_s*N;
+
+                for (int x = 0; x < s; ++x, out += N)
+                {
+                    const int x0 = osg::minimum(2*x, in_s-1)*N, x1 = osg::minimum(2*x+1, in_s-1)*N;
+                    for (unsigned c = 0; c < N; ++c)
+                    {
+                        double sum = (double)r0[x0+c] + (double)r0[x1+c] + (double)r1[x0+c] + (double)r1[x1+c];
+                        out[c] = (T)(0.25*sum + bias);
+                    }
+                }
+            }
+
+            in_s = s;
+            in_t = t;
+        }
+    }
+}
+
+//------------------------------------------------------------------------
+
 bool
 ImageUtils::resizeImage(const osg::Image* input,
                         unsigned int out_s, unsigned int out_t,
@@ -246,6 +488,10 @@ ImageUtils::resizeImage(const osg::Image* input,
     {
         memcpy( output->data(), input->data(), input->getTotalSizeInBytes() );
     }
+    else if ( mipmapLevel == 0 && resizeSpecialized(input, output.get(), bilinear) )
+    {
+        // done.
+    }
     else
     {
         PixelReader read( input );
@@ -572,6 +818,60 @@ ImageUtils::bicubicUpsample(const osg::Image* source,
     return true;
 }
 
+osg::Image*
+ImageUtils::buildBoxFilteredMipmaps(const osg::Image* input)
+{
+    if ( !input )
+        return 0L;
+
+    if ( input->r() != 1 ||
+        !(RGBA8::matches(input) || RGB8::matches(input) || L8::matches(input) || R32F::matches(input)) )
+    {
+        return buildNearestNeighborMipmaps(input);
+    }
+
+    // Lay out all the levels in one tightly packed buffer.
+    const int numMipmapLevels = osg::Image::computeNumberOfMipmapLevels( input->s(), input->t() );
+    const unsigned pixelSizeBytes = input->getPixelSizeInBits() / 8;
+    osg::Image::MipmapDataType mipmapDataOffsets;
+    unsigned totalSizeBytes = 0u;
+
+    for( int i=0; i<numMipmapLevels; ++i )
+    {
+        if ( i > 0 )
+            mipmapDataOffsets.push_back( totalSizeBytes );
+
+        totalSizeBytes +=
+            osg::maximum(1, input->s() >> i) *
+            osg::maximum(1, input->t() >> i) * pixelSizeBytes;
+    }
+
+    unsigned char* data = new unsigned char[totalSizeBytes];
+
+    osg::ref_ptr<osg::Image> result = new osg::Image();
+    result->setImage(
+        input->s(), input->t(), 1,
+        input->getInternalTextureFormat(),
+        input->getPixelFormat(),
+        input->getDataType(),
+        data, osg::Image::USE_NEW_DELETE, 1 );
+
+    result->setMipmapLevels( mipmapDataOffsets );
+    markAsNormalized(result.get(), isNormalized(input));
+
+    // level 0 is a straight copy:
+    const unsigned rowBytes = input->s() * pixelSizeBytes;
+    for( int t=0; t<input->t(); ++t )
+        memcpy( data + t*rowBytes, input->data(0, t), rowBytes );
+
+    if      ( RGBA8::matches(input) ) boxFilterMipmaps<RGBA8>(result.get());
+    else if ( RGB8::matches(input) )  boxFilterMipmaps<RGB8> (result.get());
+    else if ( L8::matches(input) )    boxFilterMipmaps<L8>   (result.get());
+    else                              boxFilterMipmaps<R32F> (result.get());
+
+    return result.release();
+}
+
 osg::Image*
 ImageUtils::buildNearestNeighborMipmaps(const osg::Image* input)
 {
@@ -787,6 +1087,9 @@ ImageUtils::mix(osg::Image* dest, const osg::Image* src, float a)
         return false;
     }
     
+    if ( mixSpecialized(src, dest, osg::clampBetween(a, 0.0f, 1.0f)) )
+        return true;
+
     PixelVisitor<MixImage> mixer;
     mixer._a = osg::clampBetween( a, 0.0f, 1.0f );
     mixer._srcHasAlpha = hasAlphaChannel(src); //src->getPixelSizeInBits() == 32;
@@ -936,6 +1239,25 @@ ImageUtils::isEmptyImage(const osg::Image* image, float alphaThreshold)
     if ( !hasAlphaChannel(image) || !PixelReader::supports(image) )
         return false;
 
+    if ( RGBA8::matches(image) )
+    {
+        for(int r=0; r<image->r(); ++r)
+        {
+            PixelRows<RGBA8> rows(image, r);
+            const double scale = RGBA8::scale(isNormalized(image));
+            for(unsigned t=0; t<rows.size(); ++t)
+            {
+                PixelRows<RGBA8>::span_type row = rows[t];
+                for(const GLubyte* p = row.begin(); p != row.end(); p += 4)
+                {
+                    if ( (float)(p[3]*scale) > alphaThreshold )
+                        return false;
+                }
+            }
+        }
+        return true;
+    }
+
     PixelReader read(image);
     for(unsigned r=0; r<(unsigned)image->r(); ++r)
     {
@@ -1199,9 +1521,30 @@ ImageUtils::replaceNoDataValues(osg::Image*       target,
         xbias = targetBounds.xMin() - referenceBounds.xMin(),
         ybias = targetBounds.yMin() - referenceBounds.yMin();
 
+    PixelReader readReference(reference);
+
+    if ( R32F::matches(target) )
+    {
+        PixelRows<R32F, osg::Image> rows(target);
+        for(int t=0; t<target->t(); ++t)
+        {
+            PixelRows<R32F, osg::Image>::span_type row = rows[t];
+            for(int s=0; s<target->s(); ++s)
+            {
+                GLfloat* pixel = row[s];
+                if ( *pixel == NO_DATA_VALUE )
+                {
+                    float nx = (float)s / (float)(target->s()-1);
+                    float ny = (float)t / (float)(target->t()-1);
+                    row.write(s, readReference( xscale*nx+xbias, yscale*ny+ybias ));
+                }
+            }
+        }
+        return true;
+    }
+
     PixelReader readTarget(target);
     PixelWriter writeTarget(target);
-    PixelReader readReference(reference);
 
     for(int s=0; s<target->s(); ++s)
     {
@@ -1293,7 +1636,10 @@ ImageUtils::convert(const osg::Image* image, GLenum pixelFormat, GLenum dataType
     else
         result->setInternalTextureFormat( pixelFormat );
 
-    PixelVisitor<CopyImage>().accept( image, result );
+    if ( !convertSpecialized(image, result) )
+    {
+        PixelVisitor<CopyImage>().accept( image, result );
+    }
 
     return result;
 }
@@ -1723,6 +2069,29 @@ namespace
         }
     };
 
+    template<typename T>
+    struct ColorReader<GL_RG, T>
+    {
+        static osg::Vec4 read(const ImageUtils::PixelReader* ia, int s, int t, int r, int m)
+        {
+            const T* ptr = (const T*)ia->data(s, t, r, m);
+            float red = float(*ptr++) * GLTypeTraits<T>::scale(ia->_normalized);
+            float g = float(*ptr) * GLTypeTraits<T>::scale(ia->_normalized);
+            return osg::Vec4(red, g, 0.0f, 1.0f);
+        }
+    };
+
+    template<typename T>
+    struct ColorWriter<GL_RG, T>
+    {
+        static void write(const ImageUtils::PixelWriter* iw, const osg::Vec4f& c, int s, int t, int r, int m )
+        {
+            T* ptr = (T*)iw->data(s, t, r, m);
+            *ptr++ = (T)( c.r() / GLTypeTraits<T>::scale(iw->_normalized) );
+            *ptr   = (T)( c.g() / GLTypeTraits<T>::scale(iw->_normalized) );
+        }
+    };
+
     template<typename T>
     struct ColorReader<GL_RGB, T>
     {
@@ -1998,6 +2367,9 @@ namespace
         case GL_LUMINANCE_ALPHA:
             return chooseReader<GL_LUMINANCE_ALPHA>(dataType);
             break;        
+        case GL_RG:
+            return chooseReader<GL_RG>(dataType);
+            break;
         case GL_RGB:
             return chooseReader<GL_RGB>(dataType);
             break;        
@@ -2148,6 +2520,9 @@ namespace
         case GL_LUMINANCE_ALPHA:
             return chooseWriter<GL_LUMINANCE_ALPHA>(dataType);
             break;        
+        case GL_RG:
+            return chooseWriter<GL_RG>(dataType);
+            break;
         case GL_RGB:
             return chooseWriter<GL_RGB>(dataType);
             break;        
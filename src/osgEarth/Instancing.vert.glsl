@@ -10,10 +10,33 @@ $GLSL_DEFAULT_PRECISION_FLOAT
 
 uniform samplerBuffer oe_di_postex_TBO;
 
+// Bounding sphere of the instanced model (xyz = center, w = radius)
+uniform vec4 oe_di_bound;
+
+// Range from the eye in which an instance is visible (min, max)
+uniform vec2 oe_di_range;
+
 // Stage-global containing object ID
 uint oe_index_objectid;
 vec3 vp_Normal;
 
+// Whether a view-space sphere is at least partly inside the side planes
+// of the view frustum.
+bool oe_di_inFrustum(in vec3 center, in float radius)
+{
+    vec4 row0 = vec4(gl_ProjectionMatrix[0][0], gl_ProjectionMatrix[1][0], gl_ProjectionMatrix[2][0], gl_ProjectionMatrix[3][0]);
+    vec4 row1 = vec4(gl_ProjectionMatrix[0][1], gl_ProjectionMatrix[1][1], gl_ProjectionMatrix[2][1], gl_ProjectionMatrix[3][1]);
+    vec4 row3 = vec4(gl_ProjectionMatrix[0][3], gl_ProjectionMatrix[1][3], gl_ProjectionMatrix[2][3], gl_ProjectionMatrix[3][3]);
+    vec4 c = vec4(center, 1.0);
+
+    vec4 p;
+    p = row3 + row0; if (dot(p, c) < -radius*length(p.xyz)) return false;
+    p = row3 - row0; if (dot(p, c) < -radius*length(p.xyz)) return false;
+    p = row3 + row1; if (dot(p, c) < -radius*length(p.xyz)) return false;
+    p = row3 - row1; if (dot(p, c) < -radius*length(p.xyz)) return false;
+    return true;
+}
+
 void oe_di_setInstancePosition(inout vec4 VertexMODEL)
 { 
     int index = 4 * gl_InstanceID;
@@ -31,9 +54,21 @@ void oe_di_setInstancePosition(inout vec4 VertexMODEL)
     // transposed so we have to reverse the multiplication order.)
     mat4 xform = mat4(m0, m1, m2, vec4(0,0,0,1));
 
+    // Cull the instance if its bounds are out of view or out of range. Every
+    // vertex of a culled instance collapses to one point, so it draws nothing.
+    // (The scale estimate is conservative for any rotation/scale matrix.)
+    vec3 centerView = (gl_ModelViewMatrix * (vec4(oe_di_bound.xyz, 1.0) * xform)).xyz;
+    float radius = oe_di_bound.w * sqrt(dot(m0.xyz, m0.xyz) + dot(m1.xyz, m1.xyz) + dot(m2.xyz, m2.xyz));
+    float range = length(centerView);
+
+    if (range < oe_di_range[0] || range >= oe_di_range[1] || !oe_di_inFrustum(centerView, radius))
+    {
+        VertexMODEL = vec4(0.0, 0.0, 0.0, 1.0);
+        return;
+    }
+
     VertexMODEL = VertexMODEL * xform;
 
     // rotate the normal vector in the same manner.
     vp_Normal = vp_Normal * mat3(xform);
 }
-
@@ -0,0 +1,380 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2016 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/InstrumentedCacheBin>
+#include <osgEarth/Metrics>
+#include <osgEarth/StringUtils>
+#include <osg/Image>
+#include <osg/Math>
+#include <osg/Shape>
+#include <osg/Timer>
+#include <osg/observer_ptr>
+#include <algorithm>
+#include <cstdlib>
+
+using namespace osgEarth;
+using namespace osgEarth::Threading;
+
+#define LC "[InstrumentedCacheBin] "
+
+#define OSGEARTH_ENV_CACHE_STATS "OSGEARTH_CACHE_STATS"
+
+// number of recent operations the latency percentiles cover
+#define MAX_LATENCY_SAMPLES 1024
+
+namespace
+{
+    typedef std::vector< osg::observer_ptr<InstrumentedCacheBin> > Instances;
+
+    Threading::Mutex s_instancesMutex;
+    Instances        s_instances;
+
+    int s_enabled = -1; // unset
+
+    unsigned long long sizeOf(const osg::Object* object)
+    {
+        if ( !object )
+            return 0u;
+
+        const osg::Image* image = dynamic_cast<const osg::Image*>(object);
+        if ( image )
+            return image->getTotalSizeInBytesIncludingMipmaps();
+
+        const osg::HeightField* hf = dynamic_cast<const osg::HeightField*>(object);
+        if ( hf )
+            return hf->getFloatArray() ? hf->getFloatArray()->getTotalDataSize() : 0u;
+
+        const StringObject* so = dynamic_cast<const StringObject*>(object);
+        if ( so )
+            return so->getString().size();
+
+        return 0u;
+    }
+}
+
+//------------------------------------------------------------------------
+
+InstrumentedCacheBin::Samples::Samples() :
+_next(0u)
+{
+    _ms.reserve(MAX_LATENCY_SAMPLES);
+}
+
+void
+InstrumentedCacheBin::Samples::add(double ms)
+{
+    if ( _ms.size() < MAX_LATENCY_SAMPLES )
+    {
+        _ms.push_back(ms);
+    }
+    else
+    {
+        _ms[_next] = ms;
+        _next = (_next + 1u) % MAX_LATENCY_SAMPLES;
+    }
+}
+
+double
+InstrumentedCacheBin::Samples::percentile(double p) const
+{
+    if ( _ms.empty() )
+        return 0.0;
+
+    std::vector<double> sorted(_ms);
+    unsigned index = osg::minimum((unsigned)(p * (double)sorted.size()), (unsigned)sorted.size()-1u);
+    std::nth_element(sorted.begin(), sorted.begin()+index, sorted.end());
+    return sorted[index];
+}
+
+//------------------------------------------------------------------------
+
+bool
+InstrumentedCacheBin::isEnabled()
+{
+    if ( s_enabled < 0 )
+    {
+        s_enabled = ::getenv(OSGEARTH_ENV_CACHE_STATS) ? 1 : 0;
+    }
+    return s_enabled > 0;
+}
+
+void
+InstrumentedCacheBin::setEnabled(bool value)
+{
+    s_enabled = value ? 1 : 0;
+}
+
+InstrumentedCacheBin::InstrumentedCacheBin(CacheBin* bin, const CachePolicy& policy) :
+CacheBin( bin ? bin->getID() : std::string() ),
+_bin    ( bin ),
+_policy ( policy )
+{
+    if ( _bin.valid() )
+        setHashKeys( _bin->getHashKeys() );
+
+    ScopedMutexLock lock(s_instancesMutex);
+    s_instances.push_back(this);
+}
+
+InstrumentedCacheBin::~InstrumentedCacheBin()
+{
+    // our observer is already cleared by now, so just drop the dead ones.
+    ScopedMutexLock lock(s_instancesMutex);
+    for (Instances::iterator i = s_instances.begin(); i != s_instances.end(); )
+    {
+        if ( i->valid() )
+            ++i;
+        else
+            i = s_instances.erase(i);
+    }
+}
+
+void
+InstrumentedCacheBin::getInstances(std::vector< osg::ref_ptr<InstrumentedCacheBin> >& output)
+{
+    ScopedMutexLock lock(s_instancesMutex);
+    for (Instances::iterator i = s_instances.begin(); i != s_instances.end(); )
+    {
+        osg::ref_ptr<InstrumentedCacheBin> bin;
+        if ( i->lock(bin) )
+        {
+            output.push_back(bin.get());
+            ++i;
+        }
+        else
+        {
+            i = s_instances.erase(i);
+        }
+    }
+}
+
+void
+InstrumentedCacheBin::publishMetrics()
+{
+    if ( !Metrics::enabled() )
+        return;
+
+    std::vector< osg::ref_ptr<InstrumentedCacheBin> > bins;
+    getInstances(bins);
+
+    for (unsigned i = 0; i < bins.size(); ++i)
+    {
+        CacheBinStats stats = bins[i]->getStats();
+        std::string graph = "Cache::" + bins[i]->getID();
+
+        Metrics::counter(graph + "::Reads",
+            "Hits",   stats.hits,
+            "Misses", stats.misses,
+            "Stale",  stats.stale);
+
+        Metrics::counter(graph + "::MB",
+            "Read",    (double)stats.bytesRead / 1048576.0,
+            "Written", (double)stats.bytesWritten / 1048576.0);
+
+        Metrics::counter(graph + "::ReadLatency",
+            "p50", stats.readLatencyP50,
+            "p99", stats.readLatencyP99);
+
+        Metrics::counter(graph + "::WriteLatency",
+            "p50", stats.writeLatencyP50,
+            "p99", stats.writeLatencyP99);
+    }
+}
+
+CacheBinStats
+InstrumentedCacheBin::getStats() const
+{
+    ScopedMutexLock lock(_mutex);
+    CacheBinStats stats = _stats;
+    stats.readLatencyP50 = _readLatency.percentile(0.50);
+    stats.readLatencyP99 = _readLatency.percentile(0.99);
+    stats.writeLatencyP50 = _writeLatency.percentile(0.50);
+    stats.writeLatencyP99 = _writeLatency.percentile(0.99);
+    return stats;
+}
+
+void
+InstrumentedCacheBin::resetStats()
+{
+    ScopedMutexLock lock(_mutex);
+    _stats = CacheBinStats();
+    _readLatency = Samples();
+    _writeLatency = Samples();
+}
+
+void
+InstrumentedCacheBin::recordRead(const ReadResult& result, double ms)
+{
+    ScopedMutexLock lock(_mutex);
+
+    if ( result.succeeded() )
+    {
+        if ( _policy.isExpired(result.lastModifiedTime()) )
+            ++_stats.stale;
+        else
+            ++_stats.hits;
+
+        _stats.bytesRead += result.encodedData() ?
+            result.encodedData()->getString().size() :
+            sizeOf(result.getObject());
+    }
+    else
+    {
+        ++_stats.misses;
+    }
+
+    _readLatency.add(ms);
+}
+
+void
+InstrumentedCacheBin::recordWrite(bool ok, unsigned long long bytes, double ms)
+{
+    ScopedMutexLock lock(_mutex);
+
+    if ( ok )
+    {
+        ++_stats.writes;
+        _stats.bytesWritten += bytes;
+    }
+    else
+    {
+        ++_stats.failedWrites;
+    }
+
+    _writeLatency.add(ms);
+}
+
+ReadResult
+InstrumentedCacheBin::readObject(const std::string& key, const osgDB::Options* dbo)
+{
+    osg::Timer_t start = osg::Timer::instance()->tick();
+    ReadResult r = _bin->readObject(key, dbo);
+    recordRead(r, osg::Timer::instance()->delta_m(start, osg::Timer::instance()->tick()));
+    return r;
+}
+
+ReadResult
+InstrumentedCacheBin::readImage(const std::string& key, const osgDB::Options* dbo)
+{
+    osg::Timer_t start = osg::Timer::instance()->tick();
+    ReadResult r = _bin->readImage(key, dbo);
+    recordRead(r, osg::Timer::instance()->delta_m(start, osg::Timer::instance()->tick()));
+    return r;
+}
+
+ReadResult
+InstrumentedCacheBin::readString(const std::string& key, const osgDB::Options* dbo)
+{
+    osg::Timer_t start = osg::Timer::instance()->tick();
+    ReadResult r = _bin->readString(key, dbo);
+    recordRead(r, osg::Timer::instance()->delta_m(start, osg::Timer::instance()->tick()));
+    return r;
+}
+
+void
+InstrumentedCacheBin::readImages(const std::vector<std::string>& keys, const osgDB::Options* dbo, std::vector<ReadResult>& output)
+{
+    osg::Timer_t start = osg::Timer::instance()->tick();
+    _bin->readImages(keys, dbo, output);
+    double ms = osg::Timer::instance()->delta_m(start, osg::Timer::instance()->tick());
+
+    // spread the batch time evenly so the percentiles stay per-record.
+    for (unsigned i = 0; i < output.size(); ++i)
+        recordRead(output[i], ms / (double)output.size());
+}
+
+bool
+InstrumentedCacheBin::write(const std::string& key, const osg::Object* object, const Config& meta, const osgDB::Options* dbo)
+{
+    osg::Timer_t start = osg::Timer::instance()->tick();
+    bool ok = _bin->write(key, object, meta, dbo);
+    recordWrite(ok, sizeOf(object), osg::Timer::instance()->delta_m(start, osg::Timer::instance()->tick()));
+    return ok;
+}
+
+bool
+InstrumentedCacheBin::writeEncodedImage(const std::string& key, const std::string& data, const std::string& format, const Config& meta, const osgDB::Options* dbo)
+{
+    osg::Timer_t start = osg::Timer::instance()->tick();
+    bool ok = _bin->writeEncodedImage(key, data, format, meta, dbo);
+
+    // an unsupported encoded write falls back to write(), which counts itself.
+    if ( ok )
+        recordWrite(ok, data.size(), osg::Timer::instance()->delta_m(start, osg::Timer::instance()->tick()));
+    return ok;
+}
+
+bool
+InstrumentedCacheBin::writeBatch(const WriteRecords& records, const osgDB::Options* dbo)
+{
+    osg::Timer_t start = osg::Timer::instance()->tick();
+    bool ok = _bin->writeBatch(records, dbo);
+    double ms = osg::Timer::instance()->delta_m(start, osg::Timer::instance()->tick());
+
+    for (WriteRecords::const_iterator i = records.begin(); i != records.end(); ++i)
+        recordWrite(ok, sizeOf(i->_object.get()), ms / (double)records.size());
+    return ok;
+}
+
+CacheBin::RecordStatus
+InstrumentedCacheBin::getRecordStatus(const std::string& key)
+{
+    return _bin->getRecordStatus(key);
+}
+
+bool
+InstrumentedCacheBin::remove(const std::string& key)
+{
+    return _bin->remove(key);
+}
+
+bool
+InstrumentedCacheBin::touch(const std::string& key)
+{
+    return _bin->touch(key);
+}
+
+Config
+InstrumentedCacheBin::readMetadata()
+{
+    return _bin->readMetadata();
+}
+
+bool
+InstrumentedCacheBin::writeMetadata(const Config& meta)
+{
+    return _bin->writeMetadata(meta);
+}
+
+bool
+InstrumentedCacheBin::clear()
+{
+    return _bin->clear();
+}
+
+bool
+InstrumentedCacheBin::compact()
+{
+    return _bin->compact();
+}
+
+unsigned
+InstrumentedCacheBin::getStorageSize()
+{
+    return _bin->getStorageSize();
+}
@@ -0,0 +1,383 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2016 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/JobScheduler>
+#include <osgEarth/Notify>
+#include <osgEarth/StringUtils>
+#include <cstdlib>
+
+using namespace osgEarth;
+using namespace OpenThreads;
+
+#define LC "[JobScheduler] "
+
+// How long an idle worker sleeps before re-checking for work (ms).
+// Submissions wake a worker immediately; this is just a safety net.
+#define IDLE_WAIT_MS 50
+
+//------------------------------------------------------------------------
+
+JobGroup::JobGroup() :
+_pending(0u)
+{
+    _progress = new ProgressCallback();
+}
+
+void
+JobGroup::cancel()
+{
+    _progress->cancel();
+}
+
+unsigned
+JobGroup::getNumPending() const
+{
+    ScopedLock<Mutex> lock(_mutex);
+    return _pending;
+}
+
+void
+JobGroup::add()
+{
+    ScopedLock<Mutex> lock(_mutex);
+    ++_pending;
+}
+
+void
+JobGroup::remove()
+{
+    ScopedLock<Mutex> lock(_mutex);
+    if (_pending > 0u)
+        --_pending;
+    _cond.broadcast();
+}
+
+bool
+JobGroup::wait(unsigned maxPending, unsigned timeout_ms)
+{
+    osg::Timer_t start = osg::Timer::instance()->tick();
+
+    ScopedLock<Mutex> lock(_mutex);
+    while (_pending > maxPending)
+    {
+        if (timeout_ms > 0u)
+        {
+            double elapsed_ms = osg::Timer::instance()->delta_m(start, osg::Timer::instance()->tick());
+            if (elapsed_ms >= (double)timeout_ms)
+                return false;
+            _cond.wait(&_mutex, timeout_ms - (unsigned)elapsed_ms);
+        }
+        else
+        {
+            _cond.wait(&_mutex, IDLE_WAIT_MS);
+        }
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------
+
+JobScheduler::Worker::Worker(JobScheduler* scheduler, unsigned index) :
+_scheduler(scheduler),
+_index(index)
+{
+    //nop
+}
+
+void
+JobScheduler::Worker::run()
+{
+    while (!_scheduler->_done)
+    {
+        Job job;
+        if (_scheduler->take(this, job))
+        {
+            _scheduler->execute(job);
+        }
+        else
+        {
+            ScopedLock<Mutex> lock(_scheduler->_sleepMutex);
+            if ((unsigned)_scheduler->_numPending == 0u && !_scheduler->_done)
+            {
+                _scheduler->_sleep.wait(&_scheduler->_sleepMutex, IDLE_WAIT_MS);
+            }
+        }
+    }
+}
+
+//------------------------------------------------------------------------
+
+JobScheduler::JobScheduler(const std::string& name, int numThreads) :
+_name(name),
+_numPending(0u),
+_nextWorker(0u),
+_done(false)
+{
+    if (numThreads <= 0)
+    {
+        const char* env = ::getenv(OSGEARTH_ENV_NUM_JOB_THREADS);
+        numThreads = env ? as<int>(std::string(env), 0) : 0;
+
+        if (numThreads <= 0)
+            numThreads = OpenThreads::GetNumberOfProcessors();
+    }
+    numThreads = osg::maximum(1, numThreads);
+
+    for (int i = 0; i < numThreads; ++i)
+    {
+        _workers.push_back(new Worker(this, (unsigned)i));
+    }
+
+    // Start after all workers exist since any worker might try to steal
+    // from any other.
+    for (unsigned i = 0; i < _workers.size(); ++i)
+    {
+        _workers[i]->start();
+    }
+
+    OE_INFO << LC << "JobScheduler [" << _name << "] using " << _workers.size() << " threads" << std::endl;
+}
+
+JobScheduler::~JobScheduler()
+{
+    cancelAll();
+
+    {
+        ScopedLock<Mutex> lock(_sleepMutex);
+        _done = true;
+        _sleep.broadcast();
+    }
+
+    for (unsigned i = 0; i < _workers.size(); ++i)
+    {
+        _workers[i]->join();
+        delete _workers[i];
+    }
+    _workers.clear();
+}
+
+JobScheduler::Worker*
+JobScheduler::getCurrentWorker() const
+{
+    Worker* worker = dynamic_cast<Worker*>(OpenThreads::Thread::CurrentThread());
+    return worker && worker->_scheduler == this ? worker : 0L;
+}
+
+void
+JobScheduler::push(Worker* worker, Lane lane, const Job& job)
+{
+    // Count first so a thief never decrements past zero.
+    ++_numPending;
+
+    {
+        ScopedLock<Mutex> lock(worker->_mutex);
+        worker->_lanes[lane].push_back(job);
+    }
+
+    // Wake one idle worker. Taking the sleep mutex here closes the window
+    // between a worker checking _numPending and going to sleep.
+    ScopedLock<Mutex> lock(_sleepMutex);
+    _sleep.signal();
+}
+
+void
+JobScheduler::submit(TaskRequest* request, Lane lane, JobGroup* group)
+{
+    if (!request)
+        return;
+
+    if (lane < LANE_HIGH || lane >= NUM_LANES)
+        lane = LANE_NORMAL;
+
+    request->setState(TaskRequest::STATE_PENDING);
+
+    if (group)
+    {
+        // The group's progress callback is the cancellation token for
+        // every job in the group.
+        request->setProgressCallback(group->getProgressCallback());
+        group->add();
+    }
+    else if (!request->getProgressCallback())
+    {
+        request->setProgressCallback(new ProgressCallback());
+    }
+
+    // Jobs spawned by a worker stay local to that worker (for locality);
+    // external submissions are spread round-robin across the pool.
+    Worker* worker = getCurrentWorker();
+    if (!worker)
+    {
+        unsigned index = (++_nextWorker) % _workers.size();
+        worker = _workers[index];
+    }
+
+    push(worker, lane, Job(request, group));
+}
+
+bool
+JobScheduler::take(Worker* local, Job& output)
+{
+    if ((unsigned)_numPending == 0u)
+        return false;
+
+    const unsigned numWorkers = _workers.size();
+    const unsigned start = local ? local->_index : (unsigned)_nextWorker % numWorkers;
+
+    for (int lane = LANE_HIGH; lane < NUM_LANES; ++lane)
+    {
+        // Pop from the back of our own deque (most recently pushed,
+        // likely still warm in cache):
+        if (local)
+        {
+            ScopedLock<Mutex> lock(local->_mutex);
+            if (!local->_lanes[lane].empty())
+            {
+                output = local->_lanes[lane].back();
+                local->_lanes[lane].pop_back();
+                --_numPending;
+                return true;
+            }
+        }
+
+        // Steal from the front of a peer's deque (oldest work):
+        for (unsigned i = 0; i < numWorkers; ++i)
+        {
+            Worker* victim = _workers[(start + i) % numWorkers];
+            if (victim == local)
+                continue;
+
+            ScopedLock<Mutex> lock(victim->_mutex);
+            if (!victim->_lanes[lane].empty())
+            {
+                output = victim->_lanes[lane].front();
+                victim->_lanes[lane].pop_front();
+                --_numPending;
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+void
+JobScheduler::execute(Job& job, bool discard)
+{
+    TaskRequest* request = job._request.get();
+
+    bool canceled =
+        discard ||
+        request->getState() != TaskRequest::STATE_PENDING ||
+        request->wasCanceled() ||
+        (job._group.valid() && job._group->isCanceled());
+
+    if (!canceled)
+    {
+        if (request->getProgressCallback())
+            request->getProgressCallback()->onStarted();
+
+        request->setState(TaskRequest::STATE_IN_PROGRESS);
+        request->run();
+    }
+    else if (!job._group.valid())
+    {
+        // Grouped requests share the group's progress callback, so don't
+        // cancel it here or we'd cancel the entire group.
+        request->cancel();
+    }
+
+    request->setState(TaskRequest::STATE_COMPLETED);
+
+    if (request->getProgressCallback())
+        request->getProgressCallback()->onCompleted();
+
+    if (request->getCompletedEvent())
+        request->getCompletedEvent()->set();
+
+    if (job._group.valid())
+        job._group->remove();
+}
+
+bool
+JobScheduler::runOne()
+{
+    Job job;
+    if (take(getCurrentWorker(), job))
+    {
+        execute(job);
+        return true;
+    }
+    return false;
+}
+
+void
+JobScheduler::join(JobGroup* group)
+{
+    if (!group)
+        return;
+
+    if (isWorkerThread())
+    {
+        while (group->getNumPending() > 0u)
+        {
+            if (!runOne())
+                group->wait(0u, 10u);
+        }
+    }
+    else
+    {
+        group->wait();
+    }
+}
+
+unsigned
+JobScheduler::getNumPendingJobs() const
+{
+    return (unsigned)_numPending;
+}
+
+void
+JobScheduler::cancelAll()
+{
+    for (unsigned w = 0; w < _workers.size(); ++w)
+    {
+        JobDeque discarded[NUM_LANES];
+        {
+            ScopedLock<Mutex> lock(_workers[w]->_mutex);
+            for (int lane = LANE_HIGH; lane < NUM_LANES; ++lane)
+            {
+                for (unsigned i = 0; i < _workers[w]->_lanes[lane].size(); ++i)
+                    --_numPending;
+                discarded[lane].swap(_workers[w]->_lanes[lane]);
+            }
+        }
+
+        // Complete the discarded jobs outside the lock so their groups
+        // (and anyone waiting on them) are released.
+        for (int lane = LANE_HIGH; lane < NUM_LANES; ++lane)
+        {
+            for (JobDeque::iterator i = discarded[lane].begin(); i != discarded[lane].end(); ++i)
+            {
+                execute(*i, true);
+            }
+        }
+    }
+
+    OE_DEBUG << LC << "Canceled all pending jobs in JobScheduler [" << _name << "]" << std::endl;
+}
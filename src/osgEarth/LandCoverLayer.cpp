@@ -304,13 +304,8 @@ namespace
         out->allocateImage(tilesize, tilesize, 1, GL_RGB, GL_FLOAT);
         out->setInternalTextureFormat(internalFormat);
 
-        osg::Vec2 cov;    // coverage coordinates
-
         ImageUtils::PixelWriter write( out.get() );
 
-        float du = 1.0f / (float)(out->s()-1);
-        float dv = 1.0f / (float)(out->t()-1);
-
         osg::Vec4 nodata;
         if (internalFormat == GL_LUMINANCE16F_ARB)
             nodata.set(-32768, -32768, -32768, -32768);
@@ -319,80 +314,93 @@ namespace
 
         unsigned pixelsWritten = 0u;
 
-        for(float u=0.0f; u<=1.0f; u+=du)
+        // Pixels still waiting for a value, in the order we'll write them.
+        // Each layer (top-most first) gets one pass over the pixels that
+        // the layers above it left empty, so no layer is ever read where a
+        // higher-priority layer already has data.
+        std::vector<unsigned> unresolved(out->s() * out->t());
+        for (unsigned i = 0; i < unresolved.size(); ++i)
+            unresolved[i] = i;
+
+        std::vector<int> cols(out->s()), rows(out->t());
+
+        for(int L = layers.size()-1; L >= 0 && !unresolved.empty(); --L)
         {
-            for(float v=0.0f; v<=1.0f; v+=dv)
+            if (progress && progress->isCanceled())
             {
-                bool wrotePixel = false;
-                for(int L = layers.size()-1; L >= 0 && !wrotePixel; --L)
-                {
-                    if (progress && progress->isCanceled())
-                    {
-                        OE_DEBUG << LC << key.str() << " canceled" << std::endl;
-                        return 0L;
-                    }
+                OE_DEBUG << LC << key.str() << " canceled" << std::endl;
+                return 0L;
+            }
 
-                    ILayer& layer = layers[L];
-                    if ( !layer.valid )
-                        continue;
+            ILayer& layer = layers[L];
+            layer.load(key, _coverages[L].get(), progress);
+            if (!layer.valid)
+                continue;
 
-                    if ( !layer.image.valid() )
-                        layer.load(key, _coverages[L].get(), progress);
+            const CodeMap& codemap = _codemaps[L];
+            if (codemap.empty())
+                continue;
 
-                    if (!layer.valid)
-                        continue;
+            // Nearest source column and row for each output column and row,
+            // or -1 where the output falls outside this layer's image:
+            const osg::Image* source = layer.image.getImage();
+            for (int s = 0; s < out->s(); ++s)
+            {
+                float c = layer.scale*((float)s / (float)(out->s()-1)) + layer.bias.x();
+                cols[s] = c >= 0.0f && c <= 1.0f ? (int)(c * (float)(source->s()-1)) : -1;
+            }
+            for (int t = 0; t < out->t(); ++t)
+            {
+                float r = layer.scale*((float)t / (float)(out->t()-1)) + layer.bias.y();
+                rows[t] = r >= 0.0f && r <= 1.0f ? (int)(r * (float)(source->t()-1)) : -1;
+            }
 
-                    osg::Vec2 cov(layer.scale*u + layer.bias.x(), layer.scale*v + layer.bias.y());
+            std::vector<unsigned> remaining;
 
-                    if ( cov.x() >= 0.0f && cov.x() <= 1.0f && cov.y() >= 0.0f && cov.y() <= 1.0f )
-                    {
-                        osg::Vec4 texel = (*layer.read)(cov.x(), cov.y());
+            for (unsigned i = 0; i < unresolved.size(); ++i)
+            {
+                int s = unresolved[i] % out->s();
+                int t = unresolved[i] / out->s();
+
+                bool wrotePixel = false;
+
+                if (cols[s] >= 0 && rows[t] >= 0)
+                {
+                    osg::Vec4 texel = (*layer.read)(cols[s], rows[t]);
 
-                        if ( texel.r() != NO_DATA_VALUE )
+                    if ( texel.r() != NO_DATA_VALUE )
+                    {
+                        // normalized codes are stored as fractions of 255:
+                        int code = texel.r() < 1.0f ? (int)(texel.r()*255.0f) : (int)texel.r();
+                        if (code >= 0 && code < (int)codemap.size() && codemap[code] >= 0)
                         {
+                            texel.r() = (float)codemap[code];
+
                             // store the warp factor in the green channel
                             texel.g() = layer.warp;
 
                             // store the layer index in the blue channel
                             texel.b() = (float)L;
 
-                            if (texel.r() < 1.0f)
-                            {
-                                // normalized code; convert
-                                int code = (int)(texel.r()*255.0f);
-                                if (code < _codemaps[L].size())
-                                {
-                                    int value = _codemaps[L][code];
-                                    if (value >= 0)
-                                    {
-                                        texel.r() = (float)value;
-                                        write.f(texel, u, v);
-                                        wrotePixel = true;
-                                        pixelsWritten++;
-                                    }
-                                }
-                            }
-                            else
-                            {
-                                // unnormalized
-                                int code = (int)texel.r();
-                                if (code < _codemaps[L].size() && _codemaps[L][code] >= 0)
-                                {
-                                    texel.r() = (float)_codemaps[L][code];
-                                    write.f(texel, u, v);
-                                    wrotePixel = true;
-                                    pixelsWritten++;
-                                }
-                            }
+                            write(texel, s, t);
+                            wrotePixel = true;
+                            pixelsWritten++;
                         }
                     }
                 }
 
-                if ( !wrotePixel )
+                if (!wrotePixel)
                 {
-                    write.f(nodata, u, v);
+                    remaining.push_back(unresolved[i]);
                 }
             }
+
+            unresolved.swap(remaining);
+        }
+
+        for (unsigned i = 0; i < unresolved.size(); ++i)
+        {
+            write(nodata, unresolved[i] % out->s(), unresolved[i] / out->s());
         }
 
         return pixelsWritten > 0u? out.release() : 0L;
@@ -511,34 +519,50 @@ LandCoverLayer::createImageImplementation(const TileKey& key, ProgressCallback*
     {
         MetaImage metaImage;
 
-        for (int x = -1; x <= 1; ++x)
+        // Load the center tile first; its warp values (stored in the green
+        // channel) tell us whether we need the neighbors at all.
+        float maxWarp = 0.0f;
+        for (int n = 0; n < 9; ++n)
         {
-            for (int y = -1; y <= 1; ++y)
+            int x = n == 0 ? 0 : ((n-1) % 3) - 1;
+            int y = n == 0 ? 0 : ((n-1) / 3) - 1;
+            if (n > 0 && x == 0 && y == 0)
+                continue;
+
+            if (n > 0 && maxWarp <= 0.0f)
+                break;
+
+            // compute the neighoring key:
+            TileKey subkey = key.createNeighborKey(x, y);
+            if (subkey.valid())
             {
-                // compute the neighoring key:
-                TileKey subkey = key.createNeighborKey(x, y);
-                if (subkey.valid())
+                // compute the closest ancestor key with actual data for the neighbor key:
+                TileKey bestkey = getBestAvailableTileKey(subkey);
+                if (bestkey.valid())
                 {
-                    // compute the closest ancestor key with actual data for the neighbor key:
-                    TileKey bestkey = getBestAvailableTileKey(subkey);
-                    if (bestkey.valid())
+                    // load the image and store it to the metaimage.
+                    GeoImage tile = ImageLayer::createImageImplementation(bestkey, progress);
+                    if (tile.valid())
                     {
-                        // load the image and store it to the metaimage.
-                        GeoImage tile = ImageLayer::createImageImplementation(bestkey, progress);
-                        if (tile.valid())
+                        osg::Matrix scaleBias;
+                        subkey.getExtent().createScaleBias(bestkey.getExtent(), scaleBias);
+                        metaImage.setImage(x, y, tile.getImage(), scaleBias);
+
+                        if (n == 0)
                         {
-                            osg::Matrix scaleBias;
-                            subkey.getExtent().createScaleBias(bestkey.getExtent(), scaleBias);
-                            metaImage.setImage(x, y, tile.getImage(), scaleBias);
+                            ImageUtils::PixelReader readTile(tile.getImage());
+                            for (int t = 0; t < tile.getImage()->t(); ++t)
+                                for (int s = 0; s < tile.getImage()->s(); ++s)
+                                    maxWarp = osg::maximum(maxWarp, readTile(s, t).g());
                         }
                     }
                 }
+            }
 
-                if (progress && progress->isCanceled())
-                {
-                    OE_DEBUG << LC << key.str() << " canceled" << std::endl;
-                    return GeoImage::INVALID;
-                }
+            if (progress && progress->isCanceled())
+            {
+                OE_DEBUG << LC << key.str() << " canceled" << std::endl;
+                return GeoImage::INVALID;
             }
         }
 
@@ -571,50 +595,55 @@ LandCoverLayer::createImageImplementation(const TileKey& key, ProgressCallback*
 
         osg::Vec2d cov;
         osg::Vec2 noiseCoords;
-        osg::Vec4 pixel;
+        osg::Vec4 pixel, unwarpedPixel;
         osg::Vec4 nodata(NO_DATA_VALUE, NO_DATA_VALUE, NO_DATA_VALUE, NO_DATA_VALUE);
         
         float pdL = pow(2, (float)key.getLOD() - options().noiseLOD().get());
 
         for (int t = 0; t < image->t(); ++t)
         {
+            if (progress && progress->isCanceled())
+            {
+                OE_DEBUG << LC << key.str() << " canceled" << std::endl;
+                return GeoImage::INVALID;
+            }
+
             double v = (double)t / (double)(image->t() - 1);
             for (int s = 0; s < image->s(); ++s)
             {
                 double u = (double)s / (double)(image->s() - 1);
 
-                cov.set(u, v);
-
                 // first read the unwarped pixel to get the warping value.
                 // (warp is stored in pixel.g)
-                metaImage.read(cov.x(), cov.y(), pixel);
-                float warp = pixel.g() * pdL;
+                if (!metaImage.read(u, v, unwarpedPixel))
+                {
+                    write(nodata, s, t);
+                    continue;
+                }
+
+                float warp = unwarpedPixel.g() * pdL;
 
+                // no warping means no need for the (expensive) noise function.
+                if (warp <= 0.0f)
+                {
+                    write(unwarpedPixel, s, t);
+                    continue;
+                }
+
+                cov.set(u, v);
                 noiseCoords = getSplatCoords(key, options().noiseLOD().get(), cov);
                 double noise = getNoise(noiseGen, noiseCoords);
                 cov = warpCoverageCoords(cov, noise, warp);
 
-                if (metaImage.read(cov.x(), cov.y(), pixel))
-                {
-                    // only apply the warping if the location of the warped pixel
-                    // came from the same source layer. Otherwise you will get some
-                    // unsavory speckling. (Layer index is stored in pixel.b)
-                    osg::Vec4 unwarpedPixel;
-                    if (metaImage.read(u, v, unwarpedPixel) && pixel.b() != unwarpedPixel.b())
-                        write(unwarpedPixel, s, t);
-                    else
-                        write(pixel, s, t);
-                }
-                else
-                {
+                // only apply the warping if the location of the warped pixel
+                // came from the same source layer. Otherwise you will get some
+                // unsavory speckling. (Layer index is stored in pixel.b)
+                if (!metaImage.read(cov.x(), cov.y(), pixel))
                     write(nodata, s, t);
-                }
-                
-                if (progress && progress->isCanceled())
-                {
-                    OE_DEBUG << LC << key.str() << " canceled" << std::endl;
-                    return GeoImage::INVALID;
-                }
+                else if (pixel.b() != unwarpedPixel.b())
+                    write(unwarpedPixel, s, t);
+                else
+                    write(pixel, s, t);
             }
         }
 
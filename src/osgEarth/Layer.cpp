@@ -20,6 +20,9 @@
 #include <osgEarth/Layer>
 #include <osgEarth/Registry>
 #include <osgEarth/ShaderLoader>
+#include <osg/Geometry>
+#include <osg/Texture>
+#include <set>
 
 using namespace osgEarth;
 
@@ -386,3 +389,79 @@ Layer::setAttribution(const std::string& attribution)
 {
     _options->attribution() = attribution;
 }
+
+namespace
+{
+    // Adds up geometry and texture data in a scene graph, counting shared
+    // objects once.
+    struct MemoryUsageVisitor : public osg::NodeVisitor
+    {
+        MemoryUsageVisitor(Layer::MemoryUsage& usage) :
+            osg::NodeVisitor(TRAVERSE_ALL_CHILDREN),
+            _usage(usage)
+        {
+            setNodeMaskOverride(~0);
+        }
+
+        void apply(osg::Node& node)
+        {
+            addStateSet(node.getStateSet());
+            traverse(node);
+        }
+
+        void apply(osg::Drawable& drawable)
+        {
+            addStateSet(drawable.getStateSet());
+
+            osg::Geometry* geom = drawable.asGeometry();
+            if (geom && _seen.insert(geom).second)
+            {
+                osg::Geometry::ArrayList arrays;
+                geom->getArrayList(arrays);
+                for (unsigned i = 0; i < arrays.size(); ++i)
+                    if (arrays[i].valid() && _seen.insert(arrays[i].get()).second)
+                        _usage._geometryBytes += arrays[i]->getTotalDataSize();
+
+                for (unsigned i = 0; i < geom->getNumPrimitiveSets(); ++i)
+                {
+                    const osg::DrawElements* de = geom->getPrimitiveSet(i)->getDrawElements();
+                    if (de && _seen.insert(de).second)
+                        _usage._geometryBytes += de->getTotalDataSize();
+                }
+            }
+        }
+
+        void addStateSet(const osg::StateSet* ss)
+        {
+            if (!ss || !_seen.insert(ss).second)
+                return;
+
+            for (unsigned unit = 0; unit < ss->getNumTextureAttributeLists(); ++unit)
+            {
+                const osg::Texture* tex = dynamic_cast<const osg::Texture*>(
+                    ss->getTextureAttribute(unit, osg::StateAttribute::TEXTURE));
+
+                if (tex && _seen.insert(tex).second)
+                {
+                    for (unsigned i = 0; i < tex->getNumImages(); ++i)
+                        if (tex->getImage(i))
+                            _usage._textureBytes += tex->getImage(i)->getTotalSizeInBytesIncludingMipmaps();
+                }
+            }
+        }
+
+        Layer::MemoryUsage&         _usage;
+        std::set<const osg::Object*> _seen;
+    };
+}
+
+void
+Layer::getMemoryUsage(MemoryUsage& usage) const
+{
+    osg::Node* node = getNode();
+    if (node)
+    {
+        MemoryUsageVisitor visitor(usage);
+        node->accept(visitor);
+    }
+}
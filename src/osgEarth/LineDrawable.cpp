@@ -26,6 +26,8 @@
 
 #include <osg/LineStipple>
 #include <osg/LineWidth>
+#include <osg/BufferObject>
+#include <osg/GLExtensions>
 #include <osgUtil/Optimizer>
 
 #include <osgDB/ObjectWrapper>
@@ -48,6 +50,10 @@ using namespace osgEarth;
 // Comment this out to test the non-GLSL path
 //#define USE_GPU
 
+// Past this many separate dirty ranges, a ring-mode drawable uploads the
+// single span that covers them all instead of issuing one call per range.
+#define MAX_RING_UPLOAD_RANGES 64
+
 namespace osgEarth { namespace Serializers { namespace LineGroup
 {
     REGISTER_OBJECT_WRAPPER(
@@ -342,7 +348,11 @@ _current(NULL),
 _previous(NULL),
 _next(NULL),
 _colors(NULL),
-_colorBinding(osg::Array::Binding::BIND_PER_VERTEX)
+_colorBinding(osg::Array::Binding::BIND_PER_VERTEX),
+_ringCapacity(0u),
+_ringStride(0u),
+_ringContextID(-1),
+_ringSharedContexts(false)
 {
 #ifdef USE_GPU
     _gpu = Registry::capabilities().supportsGLSL();
@@ -365,7 +375,11 @@ _current(NULL),
 _previous(NULL),
 _next(NULL),
 _colors(NULL),
-_colorBinding(osg::Array::Binding::BIND_PER_VERTEX)
+_colorBinding(osg::Array::Binding::BIND_PER_VERTEX),
+_ringCapacity(0u),
+_ringStride(0u),
+_ringContextID(-1),
+_ringSharedContexts(false)
 {
 #ifdef USE_GPU
     _gpu = 
@@ -391,7 +405,13 @@ _current(NULL),
 _previous(NULL),
 _next(NULL),
 _colors(NULL),
-_colorBinding(rhs._colorBinding)
+_colorBinding(rhs._colorBinding),
+_ringCapacity(rhs._ringCapacity),
+_ringStride(rhs._ringStride),
+_rings(rhs._rings),
+_ringBound(rhs._ringBound),
+_ringContextID(-1),
+_ringSharedContexts(false)
 {
     _current = static_cast<osg::Vec3Array*>(getVertexArray());
 
@@ -601,6 +621,10 @@ LineDrawable::getCount() const
 void
 LineDrawable::updateFirstCount()
 {
+    // ring mode manages its own primitive sets
+    if (_ringCapacity > 0u)
+        return;
+
     if (_gpu)
     {
         osg::StateSet* ss = getOrCreateStateSet();
@@ -639,6 +663,12 @@ LineDrawable::updateFirstCount()
 void
 LineDrawable::pushVertex(const osg::Vec3& vert)
 {
+    if (_ringCapacity > 0u)
+    {
+        pushVertex(0u, vert, _color);
+        return;
+    }
+
     initialize();
 
     if (_gpu)
@@ -1048,6 +1078,15 @@ LineDrawable::reserve(unsigned size)
 void
 LineDrawable::clear()
 {
+    if (_ringCapacity > 0u)
+    {
+        for (unsigned i = 0; i < _rings.size(); ++i)
+            clearRing(i);
+        _ringBound.init();
+        dirtyBound();
+        return;
+    }
+
     initialize();
 
     unsigned n = getNumVerts();
@@ -1081,6 +1120,10 @@ namespace
 void
 LineDrawable::dirty()
 {
+    // ring mode keeps its primitive sets current on every push
+    if (_ringCapacity > 0u)
+        return;
+
     initialize();
 
     dirtyBound();
@@ -1182,6 +1225,295 @@ LineDrawable::dirty()
     }
 }
 
+void
+LineDrawable::setRingCapacity(unsigned capacity, unsigned numLines)
+{
+    // The GPU path stores each vertex several times alongside its neighbors,
+    // which cannot wrap around in place; ring mode always uses GL lines.
+    if (_gpu)
+    {
+        _gpu = false;
+        setVertexAttribArray(PreviousVertexAttrLocation, 0L);
+        setVertexAttribArray(NextVertexAttrLocation, 0L);
+        _previous = 0L;
+        _next = 0L;
+    }
+
+    initialize();
+
+    if (getNumPrimitiveSets() > 0u)
+        removePrimitiveSet(0, getNumPrimitiveSets());
+
+    {
+        Threading::ScopedMutexLock lock(_ringMutex);
+        _ringDirty.clear();
+    }
+
+    _rings.clear();
+    _ringBound.init();
+
+    if (capacity == 0u || numLines == 0u)
+    {
+        _ringCapacity = 0u;
+        _ringStride = 0u;
+        _current->clear();
+        _colors->clear();
+        dirty();
+        return;
+    }
+
+    // GL_LINES rings hold whole segments only.
+    if (_mode == GL_LINES && (capacity & 0x01) != 0u)
+        ++capacity;
+
+    _ringCapacity = capacity;
+
+    // Line strips reserve one extra slot per line that mirrors slot zero,
+    // so that a wrapped line still draws as two contiguous, joined ranges.
+    _ringStride = _mode == GL_LINES ? capacity : capacity + 1u;
+    _rings.resize(numLines);
+
+    unsigned total = _ringStride * numLines;
+    _current->assign(total, osg::Vec3(0,0,0));
+    if (_colorBinding != osg::Array::Binding::BIND_OVERALL)
+        _colors->assign(total, _color);
+
+    GLenum mode = _mode == GL_LINES ? GL_LINES : GL_LINE_STRIP;
+    for (unsigned i = 0; i < numLines; ++i)
+    {
+        addPrimitiveSet(new osg::DrawArrays(mode, i*_ringStride, 0));
+        addPrimitiveSet(new osg::DrawArrays(mode, i*_ringStride, 0));
+    }
+
+    setDataVariance(DYNAMIC);
+
+    // A full upload establishes the buffer; pushes only upload what changed.
+    _current->dirty();
+    _colors->dirty();
+    dirtyBound();
+}
+
+void
+LineDrawable::pushVertex(unsigned line, const osg::Vec3& vert)
+{
+    pushVertex(line, vert, _color);
+}
+
+void
+LineDrawable::pushVertex(unsigned line, const osg::Vec3& vert, const osg::Vec4& color)
+{
+    if (line >= _rings.size())
+        return;
+
+    RingLine& ring = _rings[line];
+    unsigned base = line * _ringStride;
+    unsigned slot = base + ring._head;
+    bool perVertexColor = _colorBinding != osg::Array::Binding::BIND_OVERALL;
+
+    (*_current)[slot] = vert;
+    if (perVertexColor)
+        (*_colors)[slot] = color;
+    markRingDirty(slot, slot+1u);
+
+    // keep the strip's mirror slot in sync with slot zero
+    if (ring._head == 0u && _ringStride > _ringCapacity)
+    {
+        unsigned mirror = base + _ringCapacity;
+        (*_current)[mirror] = vert;
+        if (perVertexColor)
+            (*_colors)[mirror] = color;
+        markRingDirty(mirror, mirror+1u);
+    }
+
+    ring._head = (ring._head + 1u) % _ringCapacity;
+    if (ring._size < _ringCapacity)
+        ++ring._size;
+
+    updateRingPrimitives(line);
+
+    // The bound only grows; it covers the line's history since the last
+    // clear() rather than being recomputed from the whole buffer.
+    _ringBound.expandBy(vert);
+    dirtyBound();
+}
+
+unsigned
+LineDrawable::getRingSize(unsigned line) const
+{
+    return line < _rings.size() ? _rings[line]._size : 0u;
+}
+
+void
+LineDrawable::clearRing(unsigned line)
+{
+    if (line < _rings.size())
+    {
+        _rings[line] = RingLine();
+        updateRingPrimitives(line);
+    }
+}
+
+void
+LineDrawable::markRingDirty(unsigned first, unsigned last)
+{
+    if (_ringSharedContexts)
+    {
+        // Sub-range uploads are tracked for one graphics context only;
+        // with several, fall back on re-sending the whole array.
+        _current->dirty();
+        _colors->dirty();
+        return;
+    }
+
+    Threading::ScopedMutexLock lock(_ringMutex);
+    if (!_ringDirty.empty() && _ringDirty.back().second == first)
+        _ringDirty.back().second = last;
+    else
+        _ringDirty.push_back(SlotRange(first, last));
+}
+
+void
+LineDrawable::updateRingPrimitives(unsigned line)
+{
+    const RingLine& ring = _rings[line];
+    unsigned base = line * _ringStride;
+
+    // primitive set 2*line draws the older part, 2*line+1 the newer part
+    osg::DrawArrays* older = static_cast<osg::DrawArrays*>(getPrimitiveSet(2u*line));
+    osg::DrawArrays* newer = static_cast<osg::DrawArrays*>(getPrimitiveSet(2u*line + 1u));
+
+    if (ring._size < _ringCapacity)
+    {
+        older->setFirst(base);
+        older->setCount(ring._size);
+        newer->setFirst(base);
+        newer->setCount(0);
+    }
+
+    else if (_mode == GL_LINES)
+    {
+        // skip past a segment whose first half was just overwritten
+        unsigned first = ring._head + (ring._head & 0x01);
+        older->setFirst(base + first);
+        older->setCount(_ringCapacity - first);
+        newer->setFirst(base);
+        newer->setCount(ring._head);
+    }
+
+    else if (ring._head == 0u)
+    {
+        older->setFirst(base);
+        older->setCount(_ringCapacity);
+        newer->setFirst(base);
+        newer->setCount(0);
+    }
+
+    else
+    {
+        // runs through the mirror slot, which joins it to the newer part
+        older->setFirst(base + ring._head);
+        older->setCount(_ringCapacity - ring._head + 1u);
+        newer->setFirst(base);
+        newer->setCount(ring._head);
+    }
+}
+
+namespace
+{
+    void uploadSlotRanges(osg::State& state, const osg::Array* array, const std::vector< std::pair<unsigned,unsigned> >& ranges)
+    {
+        osg::GLBufferObject* glbo = array->getOrCreateGLBufferObject(state.getContextID());
+        if (!glbo)
+            return;
+
+        // A new or dirty buffer gets a full upload from OSG, after which
+        // the ranges below are redundant but harmless.
+        if (glbo->isDirty())
+            glbo->compileBuffer();
+
+        state.bindVertexBufferObject(glbo);
+
+        const osg::GLExtensions* ext = state.get<osg::GLExtensions>();
+        const GLubyte* data = static_cast<const GLubyte*>(array->getDataPointer());
+        unsigned elementSize = array->getElementSize();
+        GLintptr offset = glbo->getOffset(array->getBufferIndex());
+
+        for (unsigned i = 0; i < ranges.size(); ++i)
+        {
+            ext->glBufferSubData(
+                GL_ARRAY_BUFFER_ARB,
+                offset + (GLintptr)(ranges[i].first * elementSize),
+                (GLsizeiptr)((ranges[i].second - ranges[i].first) * elementSize),
+                data + ranges[i].first * elementSize);
+        }
+    }
+}
+
+void
+LineDrawable::uploadRingData(osg::State& state) const
+{
+    Threading::ScopedMutexLock lock(_ringMutex);
+
+    if (_ringDirty.empty())
+        return;
+
+    int contextID = (int)state.getContextID();
+    if (_ringContextID < 0)
+    {
+        _ringContextID = contextID;
+    }
+    else if (_ringContextID != contextID)
+    {
+        // second context: every context re-uploads from here on
+        _ringSharedContexts = true;
+        _current->dirty();
+        _colors->dirty();
+        _ringDirty.clear();
+        return;
+    }
+
+    // without VBOs GL reads the arrays directly; nothing to do
+    if (_current->getBufferObject())
+    {
+        if (_ringDirty.size() > MAX_RING_UPLOAD_RANGES)
+        {
+            SlotRange span = _ringDirty.front();
+            for (unsigned i = 1; i < _ringDirty.size(); ++i)
+            {
+                span.first = osg::minimum(span.first, _ringDirty[i].first);
+                span.second = osg::maximum(span.second, _ringDirty[i].second);
+            }
+            _ringDirty.assign(1, span);
+        }
+
+        uploadSlotRanges(state, _current, _ringDirty);
+
+        if (_colorBinding != osg::Array::Binding::BIND_OVERALL && _colors->getBufferObject())
+            uploadSlotRanges(state, _colors, _ringDirty);
+    }
+
+    _ringDirty.clear();
+}
+
+void
+LineDrawable::drawImplementation(osg::RenderInfo& ri) const
+{
+    if (_ringCapacity > 0u)
+        uploadRingData(*ri.getState());
+
+    osg::Geometry::drawImplementation(ri);
+}
+
+osg::BoundingBox
+LineDrawable::computeBoundingBox() const
+{
+    // the ring storage includes unused slots, so use the tracked bound
+    if (_ringCapacity > 0u)
+        return _ringBound;
+
+    return osg::Geometry::computeBoundingBox();
+}
+
 osg::ref_ptr<osg::StateSet> LineDrawable::_gpuStateSet;
 
 void
@@ -18,8 +18,10 @@
  */
 #include <osgEarth/Map>
 #include <osgEarth/MapModelChange>
+#include <osgEarth/JobScheduler>
 #include <osgEarth/Registry>
 #include <osgEarth/Utils>
+#include <OpenThreads/Thread>
 
 using namespace osgEarth;
 
@@ -45,6 +47,33 @@ void Map::LayerCB::onEnabledChanged(Layer* layer) {
 
 //------------------------------------------------------------------------
 
+MapLayerSnapshot::MapLayerSnapshot(const LayerVector& layers, Revision revision) :
+_layers         ( layers ),
+_highestMinLevel( 0u ),
+_revision       ( revision )
+{
+    for (LayerVector::const_iterator i = _layers.begin(); i != _layers.end(); ++i)
+    {
+        TerrainLayer* terrainLayer = dynamic_cast<TerrainLayer*>(i->get());
+        if (terrainLayer)
+        {
+            const optional<unsigned>& minLevel = terrainLayer->options().minLevel();
+            if (minLevel.isSet() && minLevel.value() > _highestMinLevel)
+            {
+                _highestMinLevel = minLevel.value();
+            }
+
+            ElevationLayer* elevation = dynamic_cast<ElevationLayer*>(terrainLayer);
+            if (elevation)
+            {
+                _elevationLayers.push_back(elevation);
+            }
+        }
+    }
+}
+
+//------------------------------------------------------------------------
+
 Map::Map() :
 osg::Object(),
 _dataModelRevision(0)
@@ -121,6 +150,9 @@ Map::ctor()
     // create a callback that the Map will use to detect setEnabled calls
     _layerCB = new LayerCB(this);
 
+    // an empty layer list to start:
+    _snapshot = new MapLayerSnapshot( _layers, _dataModelRevision );
+
     // elevation sampling
     _elevationPool = new ElevationPool();
     _elevationPool->setMap( this );
@@ -145,6 +177,7 @@ Map::notifyLayerVisibleChanged(VisibleLayer* layer)
     {
         Threading::ScopedWriteLock lock(_mapDataMutex);
         newRevision = ++_dataModelRevision;
+        publishLayerSnapshot();
     }
 
     ElevationLayer* elevationLayer = dynamic_cast<ElevationLayer*>(layer);
@@ -173,6 +206,7 @@ Map::notifyOnLayerEnabledChanged(Layer* layer)
     {
         Threading::ScopedWriteLock lock(_mapDataMutex);
         newRevision = ++_dataModelRevision;
+        publishLayerSnapshot();
     }
 
     // reinitialize the elevation pool:
@@ -346,6 +380,7 @@ Map::addLayer(Layer* layer)
             _layers.push_back( layer );
             index = _layers.size() - 1;
             newRevision = ++_dataModelRevision;
+            publishLayerSnapshot();
         }
 
         // tell the layer it was just added.
@@ -360,6 +395,93 @@ Map::addLayer(Layer* layer)
     }
 }
 
+namespace
+{
+    // Opens a layer on the job scheduler. Map::addLayers finishes adding
+    // it on the calling thread.
+    struct OpenLayerTask : public TaskRequest
+    {
+        osg::ref_ptr<Layer> _layer;
+
+        OpenLayerTask(Layer* layer) : _layer(layer) { }
+
+        void operator()(ProgressCallback* progress)
+        {
+            _layer->open();
+        }
+    };
+}
+
+void
+Map::addLayers(const LayerVector& layers)
+{
+    osgEarth::Registry::instance()->clearBlacklist();
+
+    // Open all the enabled layers concurrently. Layers don't see the map
+    // until addedToMap(), so opening them out of order is safe.
+    JobScheduler* scheduler = Registry::instance()->getJobScheduler();
+    osg::ref_ptr<JobGroup> group = new JobGroup();
+
+    for (LayerVector::const_iterator i = layers.begin(); i != layers.end(); ++i)
+    {
+        Layer* layer = i->get();
+        if (layer)
+        {
+            installLayerCallbacks(layer);
+
+            if (layer->getEnabled())
+            {
+                prepareLayer(layer);
+                scheduler->submit(new OpenLayerTask(layer), JobScheduler::LANE_HIGH, group.get());
+            }
+        }
+    }
+
+    if (scheduler->isWorkerThread())
+    {
+        // help out rather than block a worker
+        while (group->getNumPending() > 0u)
+        {
+            if (!scheduler->runOne())
+                OpenThreads::Thread::YieldCurrentThread();
+        }
+    }
+    else
+    {
+        group->wait();
+    }
+
+    // Then add them in order, exactly as addLayer() would.
+    for (LayerVector::const_iterator i = layers.begin(); i != layers.end(); ++i)
+    {
+        osg::ref_ptr<Layer> layer = i->get();
+        if (!layer.valid())
+            continue;
+
+        if (layer->getEnabled() && layer->getStatus().isOK())
+        {
+            layer->addedToMap(this);
+        }
+
+        int newRevision;
+        unsigned index = -1;
+        {
+            Threading::ScopedWriteLock lock( _mapDataMutex );
+
+            _layers.push_back( layer.get() );
+            index = _layers.size() - 1;
+            newRevision = ++_dataModelRevision;
+            publishLayerSnapshot();
+        }
+
+        for( MapCallbackList::iterator c = _mapCallbacks.begin(); c != _mapCallbacks.end(); c++ )
+        {
+            c->get()->onMapModelChanged(MapModelChange(
+                MapModelChange::ADD_LAYER, newRevision, layer.get(), index));
+        }
+    }
+}
+
 void
 Map::insertLayer(Layer* layer, unsigned index)
 {
@@ -386,6 +508,7 @@ Map::insertLayer(Layer* layer, unsigned index)
                 _layers.insert( _layers.begin() + index, layer );
 
             newRevision = ++_dataModelRevision;
+            publishLayerSnapshot();
         }
 
         // tell the layer it was just added.
@@ -424,6 +547,7 @@ Map::removeLayer(Layer* layer)
             {
                 _layers.erase( i );
                 newRevision = ++_dataModelRevision;
+                publishLayerSnapshot();
                 break;
             }
         }
@@ -479,6 +603,7 @@ Map::moveLayer(Layer* layer, unsigned newIndex)
         _layers.insert( _layers.begin() + newIndex, layerToMove.get() );
 
         newRevision = ++_dataModelRevision;
+        publishLayerSnapshot();
     }
 
     // if this is an elevation layer, invalidate the elevation pool
@@ -541,7 +666,7 @@ Map::uninstallLayerCallbacks(Layer* layer)
 }
 
 void
-Map::openLayer(Layer* layer)
+Map::prepareLayer(Layer* layer)
 {
     // Pass along the Read Options (including the cache settings, etc.) to the layer:
     layer->setReadOptions(_readOptions.get());
@@ -552,6 +677,12 @@ Map::openLayer(Layer* layer)
     {
         terrainLayer->setTargetProfileHint(_profile.get());
     }
+}
+
+void
+Map::openLayer(Layer* layer)
+{
+    prepareLayer(layer);
 
     // Attempt to open the layer. Don't check the status here.
     if (layer->open().isOK())
@@ -572,13 +703,26 @@ Map::closeLayer(Layer* layer)
 Revision
 Map::getLayers(LayerVector& out_list) const
 {
-    out_list.reserve( _layers.size() );
+    osg::ref_ptr<const MapLayerSnapshot> snapshot = getLayerSnapshot();
+    out_list.insert( out_list.end(), snapshot->layers().begin(), snapshot->layers().end() );
+    return snapshot->getRevision();
+}
 
-    Threading::ScopedReadLock lock(_mapDataMutex);
-    for( LayerVector::const_iterator i = _layers.begin(); i != _layers.end(); ++i )
-        out_list.push_back( i->get() );
+osg::ref_ptr<const MapLayerSnapshot>
+Map::getLayerSnapshot() const
+{
+    Threading::ScopedMutexLock lock( _snapshotMutex );
+    return _snapshot;
+}
 
-    return _dataModelRevision;
+void
+Map::publishLayerSnapshot()
+{
+    osg::ref_ptr<const MapLayerSnapshot> snapshot = new MapLayerSnapshot( _layers, _dataModelRevision );
+
+    // swap it in; the old one dies with its last reader.
+    Threading::ScopedMutexLock lock( _snapshotMutex );
+    _snapshot.swap( snapshot );
 }
 
 unsigned
@@ -644,6 +788,7 @@ Map::clear()
 
         // calculate a new revision.
         newRevision = ++_dataModelRevision;
+        publishLayerSnapshot();
     }
 
     // a separate block b/c we don't need the mutex
@@ -23,10 +23,17 @@ using namespace osgEarth;
 
 #define LC "[MapFrame] "
 
+const MapLayerSnapshot*
+MapFrame::empty()
+{
+    static osg::ref_ptr<const MapLayerSnapshot> s_empty = new MapLayerSnapshot(LayerVector(), Revision());
+    return s_empty.get();
+}
+
 MapFrame::MapFrame() :
 _initialized    ( false ),
-_highestMinLevel( 0 ),
-_mapInfo        ( 0L )
+_mapInfo        ( 0L ),
+_snapshot       ( empty() )
 {
     //nop
 }
@@ -35,18 +42,16 @@ MapFrame::MapFrame(const MapFrame& rhs) :
 _initialized         ( rhs._initialized ),
 _map                 ( rhs._map.get() ),
 _mapInfo             ( rhs._mapInfo ),
-_highestMinLevel     ( rhs._highestMinLevel ),
-_mapDataModelRevision( rhs._mapDataModelRevision ),
-_layers              ( rhs._layers )
+_snapshot            ( rhs._snapshot.get() )
 {
-    //no sync required here; we copied the arrays etc
+    //no sync required here; the snapshot is immutable and shared
 }
 
 MapFrame::MapFrame(const Map* map) :
 _initialized    ( false ),
 _map            ( map ),
 _mapInfo        ( map ),
-_highestMinLevel( 0 )
+_snapshot       ( empty() )
 {
     sync();
 }
@@ -61,7 +66,7 @@ MapFrame::valid() const
 void
 MapFrame::setMap(const Map* map)
 {
-    _layers.clear();
+    _snapshot = empty();
 
     _map = map;
     if ( map )
@@ -70,7 +75,6 @@ MapFrame::setMap(const Map* map)
     }
 
     _initialized = false;
-    _highestMinLevel = 0;
 
     if (map)
     {
@@ -97,18 +101,19 @@ MapFrame::sync()
     osg::ref_ptr<const Map> map;
     if ( _map.lock(map) )
     {
-        if (map->getDataModelRevision() != _mapDataModelRevision)
+        // the map publishes a new snapshot with each revision, so an
+        // unchanged pointer means nothing to do.
+        osg::ref_ptr<const MapLayerSnapshot> snapshot = map->getLayerSnapshot();
+        if (snapshot.get() != _snapshot.get())
         {
-            _layers.clear();
-            map->getLayers(_layers);
-            refreshComputedValues();
-            _mapDataModelRevision = map->getDataModelRevision();
+            _snapshot = snapshot.get();
+            changed = true;
         }
+        _initialized = true;
     }
     else
     {
-        _layers.clear();
-        _elevationLayers.clear();
+        _snapshot = empty();
         changed = true;
     }    
 
@@ -122,22 +127,20 @@ MapFrame::needsSync() const
     osg::ref_ptr<const Map> map;
     return 
         _map.lock(map) &&
-        (map->getDataModelRevision() != _mapDataModelRevision || !_initialized);
+        (map->getDataModelRevision() != getRevision() || !_initialized);
 }
 
 void
 MapFrame::release()
 {
-    _layers.clear();
-    _elevationLayers.clear();
+    _snapshot = empty();
     _initialized = false;
-    _highestMinLevel = 0;
 }
 
 bool
 MapFrame::containsEnabledLayer(UID uid) const
 {
-    for (LayerVector::const_iterator i = _layers.begin(); i != _layers.end(); ++i)
+    for (LayerVector::const_iterator i = layers().begin(); i != layers().end(); ++i)
     {
         if (i->get()->getUID() == uid)
         {
@@ -147,33 +150,6 @@ MapFrame::containsEnabledLayer(UID uid) const
     return false;
 }
 
-void
-MapFrame::refreshComputedValues()
-{
-    _highestMinLevel = 0;
-
-    _elevationLayers.clear();
-
-    for (LayerVector::const_iterator i = _layers.begin(); i != _layers.end(); ++i)
-    {
-        TerrainLayer* terrainLayer = dynamic_cast<TerrainLayer*>(i->get());
-        if (terrainLayer)
-        {
-            const optional<unsigned>& minLevel = terrainLayer->options().minLevel();
-            if (minLevel.isSet() && minLevel.value() > _highestMinLevel)
-            {
-                _highestMinLevel = minLevel.value();
-            }
-            
-            ElevationLayer* elevation = dynamic_cast<ElevationLayer*>(terrainLayer);
-            if (elevation)
-            {
-                _elevationLayers.push_back(elevation);
-            }
-        }
-    }
-}
-
 bool
 MapFrame::populateHeightField(osg::ref_ptr<osg::HeightField>& hf,
                               const TileKey&                  key,
@@ -185,7 +161,7 @@ MapFrame::populateHeightField(osg::ref_ptr<osg::HeightField>& hf,
     {        
         ElevationInterpolation interp = map->getMapOptions().elevationInterpolation().get();
 
-        return _elevationLayers.populateHeightFieldAndNormalMap(
+        return elevationLayers().populateHeightFieldAndNormalMap(
             hf.get(),
             0L,         // no normal map to populate
             key,
@@ -211,7 +187,7 @@ MapFrame::populateHeightFieldAndNormalMap(osg::ref_ptr<osg::HeightField>& hf,
     {        
         ElevationInterpolation interp = map->getMapOptions().elevationInterpolation().get();
 
-        return _elevationLayers.populateHeightFieldAndNormalMap(
+        return elevationLayers().populateHeightFieldAndNormalMap(
             hf.get(),
             normalMap.get(),
             key,
@@ -233,7 +209,7 @@ MapFrame::isCached( const TileKey& key ) const
     if (_map.lock(map) && map->getCache() == 0L)
         return false;
 
-    for (LayerVector::const_iterator i = _layers.begin(); i != _layers.end(); ++i)
+    for (LayerVector::const_iterator i = layers().begin(); i != layers().end(); ++i)
     {
         TerrainLayer* layer = dynamic_cast<TerrainLayer*>(i->get());
         if (layer)
@@ -318,6 +318,10 @@ MapNode::init()
         draping->setAttachStencil( *_mapNodeOptions.overlayAttachStencil() );
     if ( _mapNodeOptions.overlayResolutionRatio().isSet() )
         draping->setResolutionRatio( *_mapNodeOptions.overlayResolutionRatio() );
+    if ( _mapNodeOptions.overlayCascades().isSet() )
+        draping->setNumCascades( *_mapNodeOptions.overlayCascades() );
+    if ( _mapNodeOptions.overlayUpdateThreshold().isSet() )
+        draping->setUpdateThreshold( *_mapNodeOptions.overlayUpdateThreshold() );
 
     draping->reestablish( _terrainEngine );
     _overlayDecorator->addTechnique( draping );
@@ -532,6 +536,18 @@ MapNode::getResourceReleaser() const
     return _resourceReleaser;
 }
 
+void
+MapNode::getMemoryUsage(const Layer* layer, Layer::MemoryUsage& usage) const
+{
+    if (!layer)
+        return;
+
+    layer->getMemoryUsage(usage);
+
+    if (_terrainEngine)
+        _terrainEngine->getMemoryUsage(layer, usage);
+}
+
 void
 MapNode::addExtension(Extension* extension, const osgDB::Options* options)
 {
@@ -38,7 +38,9 @@ _overlayMipMapping     ( false ),
 _overlayTextureSize    ( 4096 ),
 _terrainOptions        ( 0L ),
 _overlayAttachStencil  ( false ),
-_overlayResolutionRatio( 3.0f )
+_overlayResolutionRatio( 3.0f ),
+_overlayCascades       ( 1u ),
+_overlayUpdateThreshold( 0.0f )
 {
     mergeConfig( conf );
 }
@@ -52,6 +54,8 @@ _overlayTextureSize    ( 4096 ),
 _overlayMipMapping     ( false ),
 _overlayAttachStencil  ( false ),
 _overlayResolutionRatio( 3.0f ),
+_overlayCascades       ( 1u ),
+_overlayUpdateThreshold( 0.0f ),
 _terrainOptions        ( 0L )
 {
     setTerrainOptions( to );
@@ -66,6 +70,8 @@ _overlayTextureSize    ( 4096 ),
 _overlayMipMapping     ( false ),
 _overlayAttachStencil  ( false ),
 _overlayResolutionRatio( 3.0f ),
+_overlayCascades       ( 1u ),
+_overlayUpdateThreshold( 0.0f ),
 _terrainOptions        ( 0L )
 {
     mergeConfig( rhs.getConfig() );
@@ -97,6 +103,8 @@ MapNodeOptions::getConfig() const
     conf.updateIfSet   ( "overlay_mipmapping",       _overlayMipMapping );
     conf.updateIfSet   ( "overlay_attach_stencil",   _overlayAttachStencil );
     conf.updateIfSet   ( "overlay_resolution_ratio", _overlayResolutionRatio );
+    conf.updateIfSet   ( "overlay_cascades",         _overlayCascades );
+    conf.updateIfSet   ( "overlay_update_threshold", _overlayUpdateThreshold );
 
     return conf;
 }
@@ -115,6 +123,8 @@ MapNodeOptions::mergeConfig( const Config& conf )
     conf.getIfSet   ( "overlay_mipmapping",       _overlayMipMapping );
     conf.getIfSet   ( "overlay_attach_stencil",   _overlayAttachStencil );
     conf.getIfSet   ( "overlay_resolution_ratio", _overlayResolutionRatio );
+    conf.getIfSet   ( "overlay_cascades",         _overlayCascades );
+    conf.getIfSet   ( "overlay_update_threshold", _overlayUpdateThreshold );
 
     if ( conf.hasChild( "terrain" ) )
     {
@@ -17,6 +17,10 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include <osgEarth/MemCache>
+#include <osgEarth/IOTypes>
+#include <osg/Image>
+#include <osg/Shape>
+#include <algorithm>
 
 using namespace osgEarth;
 
@@ -29,11 +33,30 @@ namespace
     typedef std::pair<osg::ref_ptr<const osg::Object>, Config> MemCacheEntry;
     typedef LRUCache<std::string, MemCacheEntry> MemCacheLRU;
 
+    size_t sizeOf(const osg::Object* object)
+    {
+        const osg::Image* image = dynamic_cast<const osg::Image*>(object);
+        if ( image )
+            return image->getTotalSizeInBytesIncludingMipmaps();
+
+        const osg::HeightField* hf = dynamic_cast<const osg::HeightField*>(object);
+        if ( hf )
+            return hf->getFloatArray() ? hf->getFloatArray()->getTotalDataSize() : 0u;
+
+        const StringObject* so = dynamic_cast<const StringObject*>(object);
+        if ( so )
+            return so->getString().size();
+
+        return 0u;
+    }
+
+
     struct MemCacheBin : public CacheBin
     {
-        MemCacheBin( const std::string& id, unsigned maxSize )
+        MemCacheBin( const std::string& id, unsigned maxSize, bool share )
             : CacheBin( id ),
-              _lru    ( true /* MT-safe */, maxSize )
+              _lru    ( true /* MT-safe */, maxSize ),
+              _share  ( share )
         {
             //nop
         }
@@ -43,12 +66,20 @@ namespace
             MemCacheLRU::Record rec;
             _lru.get(key, rec);
 
-            // clone required since the cache is in memory
+            // clone required since the cache is in memory, unless the
+            // owner promised to leave the objects alone
 
             if ( rec.valid() )
             {
                 //OE_INFO << LC << "hits: " << _lru.getStats()._hitRatio*100.0f << "%" << std::endl;
 
+                if ( _share )
+                {
+                    return ReadResult(
+                        const_cast<osg::Object*>(rec.value().first.get()),
+                        rec.value().second );
+                }
+
                 return ReadResult( 
                    osg::clone(rec.value().first.get(), osg::CopyOp::DEEP_COPY_ALL),
                    rec.value().second );
@@ -74,8 +105,8 @@ namespace
         {
             if ( object ) 
             {
-                osg::ref_ptr<const osg::Object> cloned = osg::clone(object, osg::CopyOp::DEEP_COPY_ALL);
-                _lru.insert( key, std::make_pair(cloned.get(), meta) );
+                osg::ref_ptr<const osg::Object> cloned = _share ? object : osg::clone(object, osg::CopyOp::DEEP_COPY_ALL);
+                _lru.insert( key, std::make_pair(cloned.get(), meta), sizeOf(cloned.get()) );
                 return true;
             }
             else
@@ -113,6 +144,7 @@ namespace
         }
 
         MemCacheLRU _lru;
+        bool        _share;
     };
     
 
@@ -122,7 +154,8 @@ namespace
 //------------------------------------------------------------------------
 
 MemCache::MemCache( unsigned maxBinSize ) :
-_maxBinSize( std::max(maxBinSize, 1u) )
+_maxBinSize  ( std::max(maxBinSize, 1u) ),
+_shareObjects( false )
 {
     //nop
 }
@@ -130,7 +163,13 @@ _maxBinSize( std::max(maxBinSize, 1u) )
 CacheBin*
 MemCache::addBin( const std::string& binID )
 {
-    return _bins.getOrCreate( binID, new MemCacheBin(binID, _maxBinSize) );
+    CacheBin* bin = _bins.getOrCreate( binID, new MemCacheBin(binID, _maxBinSize, _shareObjects) );
+
+    Threading::ScopedMutexLock lock( _allBinsMutex );
+    if ( std::find(_allBins.begin(), _allBins.end(), bin) == _allBins.end() )
+        _allBins.push_back( bin );
+
+    return bin;
 }
 
 CacheBin*
@@ -151,7 +190,7 @@ MemCache::getOrCreateDefaultBin()
         // double check
         if ( !_defaultBin.valid() )
         {
-            _defaultBin = new MemCacheBin("__default", _maxBinSize);
+            _defaultBin = new MemCacheBin("__default", _maxBinSize, _shareObjects);
         }
     }
 
@@ -159,6 +198,21 @@ MemCache::getOrCreateDefaultBin()
 }
 
 
+size_t
+MemCache::getTotalBytes() const
+{
+    size_t bytes = 0u;
+
+    if ( _defaultBin.valid() )
+        bytes += static_cast<const MemCacheBin*>(_defaultBin.get())->_lru.getCost();
+
+    Threading::ScopedMutexLock lock( _allBinsMutex );
+    for (unsigned i = 0; i < _allBins.size(); ++i)
+        bytes += static_cast<const MemCacheBin*>(_allBins[i].get())->_lru.getCost();
+
+    return bytes;
+}
+
 void
 MemCache::dumpStats(const std::string& binID)
 {
@@ -0,0 +1,177 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2016 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/MemoryArena>
+#include <osgEarth/ThreadingUtils>
+#include <OpenThreads/Atomic>
+#include <new>
+#include <vector>
+
+using namespace osgEarth;
+
+// Size of each region block.
+#define BLOCK_SIZE (64u * 1024u)
+
+// Allocations bigger than this go straight to the heap.
+#define MAX_ARENA_ALLOCATION (BLOCK_SIZE / 16u)
+
+// Number of empty blocks to keep around for reuse.
+#define MAX_FREE_BLOCKS 64u
+
+// Every allocation is aligned to this.
+#define ARENA_ALIGNMENT 16u
+
+#if defined(_MSC_VER)
+#  define OE_ARENA_THREAD_LOCAL __declspec(thread)
+#else
+#  define OE_ARENA_THREAD_LOCAL __thread
+#endif
+
+namespace
+{
+    struct Block
+    {
+        // Number of live allocations, plus one while a region is filling it
+        OpenThreads::Atomic _live;
+        std::size_t         _used;
+    };
+
+    // Precedes every allocation; _block is NULL for heap allocations.
+    union Header
+    {
+        Block* _block;
+        char   _pad[ARENA_ALIGNMENT];
+    };
+
+    inline std::size_t align(std::size_t n)
+    {
+        return (n + ARENA_ALIGNMENT - 1u) & ~(std::size_t)(ARENA_ALIGNMENT - 1u);
+    }
+
+    inline char* blockData(Block* block)
+    {
+        return reinterpret_cast<char*>(block) + align(sizeof(Block));
+    }
+
+    // Per-thread region state. Plain data so it can live in thread-local storage.
+    OE_ARENA_THREAD_LOCAL Block*   s_current = 0L;
+    OE_ARENA_THREAD_LOCAL unsigned s_depth   = 0u;
+
+    Threading::Mutex    s_freeBlocksMutex;
+    std::vector<Block*> s_freeBlocks;
+
+    Block* acquireBlock()
+    {
+        Block* block = 0L;
+        {
+            Threading::ScopedMutexLock lock(s_freeBlocksMutex);
+            if (!s_freeBlocks.empty())
+            {
+                block = s_freeBlocks.back();
+                s_freeBlocks.pop_back();
+            }
+        }
+
+        if (!block)
+        {
+            void* mem = ::operator new(align(sizeof(Block)) + BLOCK_SIZE);
+            block = new (mem) Block();
+        }
+
+        block->_live.exchange(1u);
+        block->_used = 0u;
+        return block;
+    }
+
+    void releaseBlock(Block* block)
+    {
+        if (--block->_live != 0u)
+            return;
+
+        {
+            Threading::ScopedMutexLock lock(s_freeBlocksMutex);
+            if (s_freeBlocks.size() < MAX_FREE_BLOCKS)
+            {
+                s_freeBlocks.push_back(block);
+                return;
+            }
+        }
+
+        block->~Block();
+        ::operator delete(block);
+    }
+}
+
+MemoryArena::Scope::Scope()
+{
+    ++s_depth;
+}
+
+MemoryArena::Scope::~Scope()
+{
+    if (--s_depth == 0u && s_current)
+    {
+        releaseBlock(s_current);
+        s_current = 0L;
+    }
+}
+
+void*
+MemoryArena::allocate(std::size_t size)
+{
+    std::size_t total = sizeof(Header) + align(size);
+
+    if (s_depth == 0u || total > MAX_ARENA_ALLOCATION)
+    {
+        Header* header = static_cast<Header*>(::operator new(total));
+        header->_block = 0L;
+        return header + 1;
+    }
+
+    if (!s_current || s_current->_used + total > BLOCK_SIZE)
+    {
+        if (s_current)
+            releaseBlock(s_current);
+        s_current = acquireBlock();
+    }
+
+    Header* header = reinterpret_cast<Header*>(blockData(s_current) + s_current->_used);
+    s_current->_used += total;
+    ++s_current->_live;
+    header->_block = s_current;
+    return header + 1;
+}
+
+void
+MemoryArena::deallocate(void* ptr)
+{
+    if (!ptr)
+        return;
+
+    Header* header = static_cast<Header*>(ptr) - 1;
+    if (header->_block)
+        releaseBlock(header->_block);
+    else
+        ::operator delete(header);
+}
+
+bool
+MemoryArena::isActive()
+{
+    return s_depth > 0u;
+}
@@ -19,17 +19,58 @@
 #include <osgEarth/Metrics>
 #include <osgEarth/ThreadingUtils>
 #include <osgEarth/Memory>
+#include <osgEarth/InstrumentedCacheBin>
+#include <osgEarth/StringUtils>
 #include <osgViewer/Viewer>
+#include <OpenThreads/Thread>
 #include <cstdarg>
+#include <cctype>
+#include <sstream>
+#include <iomanip>
 
 using namespace osgEarth;
 
 #define LC "[Metrics] "
 
+// Max events a thread can buffer between flushes before new ones are dropped.
+#define MAX_EVENTS_PER_THREAD 65536u
+
+// How often the chrome backend writes out buffered events.
+#define FLUSH_INTERVAL_MS 250u
+
+#if defined(_MSC_VER)
+#  define OE_METRICS_THREAD_LOCAL __declspec(thread)
+#else
+#  define OE_METRICS_THREAD_LOCAL __thread
+#endif
+
 namespace
 {
     static osg::ref_ptr< MetricsBackend > s_metrics_backend;
     static bool s_metrics_debug = false;
+    static unsigned s_sampleRate = 1u;
+
+    // Per-thread sampling state: how deep we are in nested events, and
+    // whether the current top-level event was picked.
+    OE_METRICS_THREAD_LOCAL unsigned s_depth = 0u;
+    OE_METRICS_THREAD_LOCAL unsigned s_topLevelCount = 0u;
+    OE_METRICS_THREAD_LOCAL bool     s_sampled = true;
+
+    // Returns whether to report a begin event.
+    inline bool sampleBegin()
+    {
+        if (s_depth++ == 0u)
+            s_sampled = s_sampleRate <= 1u || (s_topLevelCount++ % s_sampleRate) == 0u;
+        return s_sampled;
+    }
+
+    // Returns whether to report an end event.
+    inline bool sampleEnd()
+    {
+        if (s_depth > 0u)
+            --s_depth;
+        return s_sampled;
+    }
 
     class MetricsStartup
     {
@@ -46,6 +87,11 @@ namespace
             {
                 s_metrics_debug = true;
             }
+            const char* sampleRate = ::getenv("OSGEARTH_METRICS_SAMPLE_RATE");
+            if (sampleRate)
+            {
+                Metrics::setSampleRate(as<unsigned>(sampleRate, 1u));
+            }
         }
 
         ~MetricsStartup()
@@ -55,11 +101,60 @@ namespace
     };
 
     static MetricsStartup s_metricsStartup;
+
+    typedef std::map<std::string, osg::ref_ptr<MetricValue> > MetricValueTable;
+
+    MetricValueTable& getMetricValueTable(Threading::Mutex*& mutex)
+    {
+        static Threading::Mutex s_mutex;
+        static MetricValueTable s_table;
+        mutex = &s_mutex;
+        return s_table;
+    }
+}
+
+MetricValue* Metrics::getValue(const std::string& name)
+{
+    Threading::Mutex* mutex;
+    MetricValueTable& table = getMetricValueTable(mutex);
+    Threading::ScopedMutexLock lock(*mutex);
+    osg::ref_ptr<MetricValue>& value = table[name];
+    if (!value.valid())
+        value = new MetricValue();
+    return value.get();
+}
+
+void Metrics::getValues(MetricValues& output)
+{
+    Threading::Mutex* mutex;
+    MetricValueTable& table = getMetricValueTable(mutex);
+    Threading::ScopedMutexLock lock(*mutex);
+    for (MetricValueTable::const_iterator i = table.begin(); i != table.end(); ++i)
+    {
+        output[i->first] = i->second->get();
+    }
+}
+
+void Metrics::writeValues(std::ostream& output)
+{
+    MetricValues values;
+    getValues(values);
+    for (MetricValues::const_iterator i = values.begin(); i != values.end(); ++i)
+    {
+        // Prometheus names can't contain dots.
+        std::string name = "osgearth_" + i->first;
+        for (std::string::iterator c = name.begin(); c != name.end(); ++c)
+        {
+            if (!isalnum(*c) && *c != '_')
+                *c = '_';
+        }
+        output << name << " " << i->second << "\n";
+    }
 }
 
 void Metrics::begin(const std::string& name, const Config& args)
 {
-    if (s_metrics_backend.valid())
+    if (s_metrics_backend.valid() && sampleBegin())
     {
         if (s_metrics_debug)
             OE_INFO << LC << "begin: " << name << "  " << (args.empty() ? "" : args.toJSON(false)) << std::endl;
@@ -89,7 +184,7 @@ Config Metrics::encodeArgs(unsigned count, ...)
 
 void Metrics::begin(const std::string& name, unsigned int argCount, ...)
 {
-    if (!s_metrics_backend.valid())
+    if (!s_metrics_backend.valid() || !sampleBegin())
         return;
 
     Config conf;
@@ -106,12 +201,15 @@ void Metrics::begin(const std::string& name, unsigned int argCount, ...)
 
     va_end(args);
 
-    begin(name, conf);
+    if (s_metrics_debug)
+        OE_INFO << LC << "begin: " << name << "  " << (conf.empty() ? "" : conf.toJSON(false)) << std::endl;
+
+    s_metrics_backend->begin(name, conf);
 }
 
 void Metrics::end(const std::string& name, unsigned int argCount, ...)
 {
-    if (!s_metrics_backend.valid())
+    if (!s_metrics_backend.valid() || !sampleEnd())
         return;
 
     Config conf;
@@ -128,12 +226,15 @@ void Metrics::end(const std::string& name, unsigned int argCount, ...)
 
     va_end(args);
 
-    end(name, conf);
+    s_metrics_backend->end(name, conf);
+
+    if (s_metrics_debug)
+        OE_INFO << LC << "end: " << name << "  " << (conf.empty() ? "" : conf.toJSON(false)) << std::endl;
 }
 
 void Metrics::end(const std::string& name, const Config& args)
 {
-    if (s_metrics_backend.valid())
+    if (s_metrics_backend.valid() && sampleEnd())
     {
         s_metrics_backend->end(name, args);
 
@@ -180,6 +281,16 @@ void Metrics::setMetricsBackend(MetricsBackend* backend)
     s_metrics_backend = backend;
 }
 
+void Metrics::setSampleRate(unsigned value)
+{
+    s_sampleRate = osg::maximum(value, 1u);
+}
+
+unsigned Metrics::getSampleRate()
+{
+    return s_sampleRate;
+}
+
 bool Metrics::enabled()
 {
     return getMetricsBackend() != NULL;
@@ -257,6 +368,7 @@ int Metrics::run(osgViewer::Viewer& viewer)
                     Metrics::counter("Memory::WorkingSet", "WorkingSet", Memory::getProcessPhysicalUsage() / 1048576);
                     Metrics::counter("Memory::PrivateBytes", "PrivateBytes", Memory::getProcessPrivateUsage() / 1048576);
                     Metrics::counter("Memory::PeakPrivateBytes", "PeakPrivateBytes", Memory::getProcessPeakPrivateUsage() / 1048576);
+                    InstrumentedCacheBin::publishMetrics();
                 }
             }
 
@@ -309,68 +421,165 @@ int Metrics::run(osgViewer::Viewer& viewer)
 
 
 
+struct ChromeMetricsBackend::Event
+{
+    char         _phase;
+    osg::Timer_t _time;
+    std::string  _name;
+    std::string  _args; // preformatted JSON members, or empty
+};
+
+struct ChromeMetricsBackend::ThreadEvents
+{
+    unsigned           _tid;
+    OpenThreads::Mutex _mutex; // only contended while the flusher swaps
+    std::vector<Event> _events;
+};
+
+class ChromeMetricsBackend::Flusher : public OpenThreads::Thread
+{
+public:
+    Flusher(ChromeMetricsBackend* backend) : _backend(backend) { }
+
+    void run()
+    {
+        // wait() returns true once set() is called to shut us down.
+        while (!_done.wait(FLUSH_INTERVAL_MS))
+        {
+            _backend->flush();
+        }
+    }
+
+    void stop()
+    {
+        _done.set();
+        join();
+    }
+
+    ChromeMetricsBackend* _backend;
+    Threading::Event      _done;
+};
+
+namespace
+{
+    // Identifies each chrome backend, so a thread can tell whether its
+    // cached buffer belongs to the current one.
+    OpenThreads::Atomic s_chromeBackendID;
+
+    OE_METRICS_THREAD_LOCAL unsigned s_threadEventsOwner = 0u;
+    OE_METRICS_THREAD_LOCAL void*    s_threadEvents = 0L;
+
+    void appendArg(std::string& out, const std::string& key, const std::string& value)
+    {
+        if (!out.empty())
+            out += ",\n";
+        out += "\"" + key + "\" : \"" + value + "\"";
+    }
+}
+
 ChromeMetricsBackend::ChromeMetricsBackend(const std::string& filename):
 _firstEvent(true)
 {
+    _id = ++s_chromeBackendID;
     _startTime = osg::Timer::instance()->tick();
     _metricsFile.open(filename.c_str(), std::ios::out);
     _metricsFile << "[";
+
+    _flusher = new Flusher(this);
+    _flusher->start();
 }
 
 ChromeMetricsBackend::~ChromeMetricsBackend()
 {
-     OpenThreads::ScopedLock< OpenThreads::Mutex > lk(_mutex);
+    _flusher->stop();
+    delete _flusher;
+
+    flush();
+
+    OpenThreads::ScopedLock< OpenThreads::Mutex > lk(_mutex);
     _metricsFile << "]";
     _metricsFile.close();
+
+    for (unsigned i = 0; i < _threadEvents.size(); ++i)
+        delete _threadEvents[i];
+
+    if ((unsigned)_dropped > 0u)
+    {
+        OE_WARN << LC << (unsigned)_dropped << " events were dropped; consider a higher sample rate" << std::endl;
+    }
 }
 
-void ChromeMetricsBackend::begin(const std::string& name, const Config& args)
+ChromeMetricsBackend::ThreadEvents*
+ChromeMetricsBackend::getThreadEvents()
+{
+    if (s_threadEventsOwner != _id)
+    {
+        ThreadEvents* events = new ThreadEvents();
+        events->_tid = osgEarth::Threading::getCurrentThreadId();
+        events->_events.reserve(1024);
+        {
+            OpenThreads::ScopedLock< OpenThreads::Mutex > lk(_threadEventsMutex);
+            _threadEvents.push_back(events);
+        }
+        s_threadEvents = events;
+        s_threadEventsOwner = _id;
+    }
+    return static_cast<ThreadEvents*>(s_threadEvents);
+}
+
+void ChromeMetricsBackend::push(char phase, const std::string& name, const std::string& args)
 {
     osg::Timer_t now = osg::Timer::instance()->tick();
 
-    OpenThreads::ScopedLock< OpenThreads::Mutex > lk(_mutex);
-    if (_firstEvent)
+    ThreadEvents* events = getThreadEvents();
+    OpenThreads::ScopedLock< OpenThreads::Mutex > lk(events->_mutex);
+    if (events->_events.size() >= MAX_EVENTS_PER_THREAD)
     {
-        _firstEvent = false;
+        ++_dropped;
+        return;
     }
-    else
+    events->_events.push_back(Event());
+    Event& e = events->_events.back();
+    e._phase = phase;
+    e._time = now;
+    e._name = name;
+    e._args = args;
+}
+
+void ChromeMetricsBackend::flush()
+{
+    std::vector<ThreadEvents*> threads;
     {
-        _metricsFile << "," << std::endl;
+        OpenThreads::ScopedLock< OpenThreads::Mutex > lk(_threadEventsMutex);
+        threads = _threadEvents;
     }
-    _metricsFile << "{"
-        << "\"cat\": \"" << "" << "\","
-        << "\"pid\": \"" << 0 << "\","
-        << "\"tid\": \"" << osgEarth::Threading::getCurrentThreadId() << "\","
-        << "\"ts\": \""  << std::setprecision(9) << osg::Timer::instance()->delta_u(_startTime, now) << "\","
-        << "\"ph\": \"B\","
-        << "\"name\": \""  << name << "\"";
 
-    if (!args.empty())
+    OpenThreads::ScopedLock< OpenThreads::Mutex > lk(_mutex);
+
+    std::vector<Event> events;
+    for (unsigned t = 0; t < threads.size(); ++t)
     {
-        _metricsFile << "," << std::endl << " \"args\": {";
-        bool first = true;
-        for( ConfigSet::const_iterator i = args.children().begin(); i != args.children().end(); ++i ) {
-            if (first)
-            {
-                first = !first;
-            }
-            else
-            {
-                _metricsFile << "," << std::endl;
-            }
-            _metricsFile << "\"" << i->key() << "\" : \"" << i->value() << "\"";
+        {
+            OpenThreads::ScopedLock< OpenThreads::Mutex > tlk(threads[t]->_mutex);
+            events.swap(threads[t]->_events);
+        }
+        for (unsigned i = 0; i < events.size(); ++i)
+        {
+            write(events[i], threads[t]->_tid);
         }
-        _metricsFile << "}";
+        events.clear();
+
+        // hand the (now empty) storage back so the thread doesn't reallocate
+        OpenThreads::ScopedLock< OpenThreads::Mutex > tlk(threads[t]->_mutex);
+        if (threads[t]->_events.empty())
+            events.swap(threads[t]->_events);
     }
 
-    _metricsFile << "}";
+    _metricsFile.flush();
 }
 
-void ChromeMetricsBackend::end(const std::string& name, const Config& args)
+void ChromeMetricsBackend::write(const Event& e, unsigned tid)
 {
-    osg::Timer_t now = osg::Timer::instance()->tick();
-
-    OpenThreads::ScopedLock< OpenThreads::Mutex > lk(_mutex);
     if (_firstEvent)
     {
         _firstEvent = false;
@@ -382,95 +591,105 @@ void ChromeMetricsBackend::end(const std::string& name, const Config& args)
     _metricsFile << "{"
         << "\"cat\": \"" << "" << "\","
         << "\"pid\": \"" << 0 << "\","
-        << "\"tid\": \"" << osgEarth::Threading::getCurrentThreadId() << "\","
-        << "\"ts\": \""  << std::setprecision(9) << osg::Timer::instance()->delta_u(_startTime, now) << "\","
-        << "\"ph\": \"E\","
-        << "\"name\": \""  << name << "\"";
+        << "\"tid\": \"" << tid << "\","
+        << "\"ts\": \""  << std::setprecision(9) << osg::Timer::instance()->delta_u(_startTime, e._time) << "\","
+        << "\"ph\": \"" << e._phase << "\","
+        << "\"name\": \""  << e._name << "\"";
 
-    if (!args.empty())
+    if (!e._args.empty())
     {
-        _metricsFile << "," << std::endl << " \"args\": {";
-        bool first = true;
-        for( ConfigSet::const_iterator i = args.children().begin(); i != args.children().end(); ++i ) {
-            if (first)
-            {
-                first = !first;
-            }
-            else
-            {
-                _metricsFile << "," << std::endl;
-            }
-            _metricsFile << "\"" << i->key() << "\" : \"" << i->value() << "\"";
-        }
-        _metricsFile << "}";
+        _metricsFile << "," << std::endl << " \"args\": {" << e._args << "}";
     }
 
     _metricsFile << "}";
 }
 
+void ChromeMetricsBackend::begin(const std::string& name, const Config& args)
+{
+    std::string argString;
+    for( ConfigSet::const_iterator i = args.children().begin(); i != args.children().end(); ++i )
+        appendArg(argString, i->key(), i->value());
+
+    push('B', name, argString);
+}
+
+void ChromeMetricsBackend::end(const std::string& name, const Config& args)
+{
+    std::string argString;
+    for( ConfigSet::const_iterator i = args.children().begin(); i != args.children().end(); ++i )
+        appendArg(argString, i->key(), i->value());
+
+    push('E', name, argString);
+}
+
 void ChromeMetricsBackend::counter(const std::string& graph,
                              const std::string& name0, double value0,
                              const std::string& name1, double value1,
                              const std::string& name2, double value2)
 {
-    osg::Timer_t now = osg::Timer::instance()->tick();
-
-    OpenThreads::ScopedLock< OpenThreads::Mutex > lk(_mutex);
-    if (_firstEvent)
-    {
-        _firstEvent = false;
-    }
-    else
-    {
-        _metricsFile << "," << std::endl;
-    }
-
-    _metricsFile << "{"
-        << "\"cat\": \"" << "" << "\","
-        << "\"pid\": \"" << 0 << "\","
-        << "\"tid\": \"" << osgEarth::Threading::getCurrentThreadId() << "\","
-        << "\"ts\": \""  << std::setprecision(9) << osg::Timer::instance()->delta_u(_startTime, now) << "\","
-        << "\"ph\": \"C\","
-        << "\"name\": \""  << graph << "\","
-        << "\"args\" : {";
+    // counters are infrequent, so format them here.
+    std::stringstream buf;
+    buf << std::setprecision(9);
 
     if (!name0.empty())
     {
-        _metricsFile << "    \"" << name0 << "\": " << std::setprecision(9) << value0;
+        buf << "    \"" << name0 << "\": " << value0;
     }
 
     if (!name1.empty())
     {
-        _metricsFile << ",    \"" << name1 << "\": " << std::setprecision(9) <<value1;
+        buf << ",    \"" << name1 << "\": " << value1;
     }
 
     if (!name2.empty())
     {
-        _metricsFile << ",    \"" << name2 << "\": " << std::setprecision(9) <<value2;
+        buf << ",    \"" << name2 << "\": " << value2;
     }
 
-    _metricsFile << "}}";
+    push('C', graph, buf.str());
 }
 
 
 
+ScopedMetric::ScopedMetric(const char* name) :
+_active(s_metrics_backend.valid())
+{
+    // only pay for the string when someone is listening.
+    if (_active)
+    {
+        _name = name;
+        static Config s_emptyConfig;
+        Metrics::begin(_name, s_emptyConfig);
+    }
+}
+
 ScopedMetric::ScopedMetric(const std::string& name) :
-_name(name)
+_active(s_metrics_backend.valid())
 {
-    static Config s_emptyConfig;
-    Metrics::begin(_name, s_emptyConfig);
+    if (_active)
+    {
+        _name = name;
+        static Config s_emptyConfig;
+        Metrics::begin(_name, s_emptyConfig);
+    }
 }
 
 ScopedMetric::ScopedMetric(const std::string& name, const Config& args) :
-_name(name)
+_active(s_metrics_backend.valid())
 {
-    Metrics::begin(_name, args);
+    if (_active)
+    {
+        _name = name;
+        Metrics::begin(_name, args);
+    }
 }
 
 ScopedMetric::ScopedMetric(const std::string& name, int argCount, ...) :
-_name(name)
+_active(s_metrics_backend.valid())
 {
-    if (!s_metrics_backend) return;
+    if (!_active) return;
+
+    _name = name;
 
     Config conf;
 
@@ -491,6 +710,7 @@ _name(name)
 
 ScopedMetric::~ScopedMetric()
 {
-    Metrics::end(_name);
+    if (_active)
+        Metrics::end(_name);
 }
 
@@ -18,6 +18,8 @@
  */
 #include <osgEarth/ModelLayer>
 #include <osgEarth/GLUtils>
+#include <osgEarth/Registry>
+#include <osgEarth/Progress>
 #include <osg/Depth>
 
 #define LC "[ModelLayer] Layer \"" << getName() << "\" "
@@ -58,6 +60,7 @@ ModelLayerOptions::setDefaults()
 {
     _lighting.init    ( true );
     _maskMinLevel.init( 0 );
+    _async.init       ( true );
 }
 
 Config
@@ -69,6 +72,7 @@ ModelLayerOptions::getConfig() const
     conf.set( "name",           _name );
     conf.set( "lighting",       _lighting );
     conf.set( "mask_min_level", _maskMinLevel );
+    conf.set( "async",          _async );
 
     // Merge the MaskSource options
     if ( mask().isSet() )
@@ -85,6 +89,7 @@ ModelLayerOptions::fromConfig( const Config& conf )
 {
     conf.getIfSet( "lighting",       _lighting );
     conf.getIfSet( "mask_min_level", _maskMinLevel );
+    conf.getIfSet( "async",          _async );
 
     if ( conf.hasValue("driver") )
         driver() = ModelSourceOptions(conf);
@@ -102,6 +107,55 @@ ModelLayerOptions::mergeConfig( const Config& conf )
 
 //------------------------------------------------------------------------
 
+// Creates the model source's scene graph on the job scheduler.
+struct ModelLayer::CreateNodeJob : public TaskRequest
+{
+    CreateNodeJob(ModelLayer* layer, const Map* map) : _layer(layer), _map(map) { }
+
+    void operator()(ProgressCallback* progress)
+    {
+        osg::ref_ptr<ModelLayer> layer;
+        osg::ref_ptr<const Map> map;
+        if (!_layer.lock(layer) || !_map.lock(map))
+            return;
+
+        if (progress && progress->isCanceled())
+            return;
+
+        osg::ref_ptr<osg::Node> node = layer->createNode(map.get(), progress);
+
+        Threading::ScopedMutexLock lock(layer->_mutex);
+
+        // canceled while it was building (the layer was removed or disabled):
+        if (progress && progress->isCanceled())
+            return;
+
+        layer->_createdNode = node.get();
+    }
+
+    osg::observer_ptr<ModelLayer> _layer;
+    osg::observer_ptr<const Map>  _map;
+};
+
+// Hands a graph created in the background to the layer's root node.
+struct ModelLayer::MergeCallback : public osg::NodeCallback
+{
+    MergeCallback(ModelLayer* layer) : _layer(layer) { }
+
+    void operator()(osg::Node* node, osg::NodeVisitor* nv)
+    {
+        osg::ref_ptr<ModelLayer> layer;
+        if (_layer.lock(layer))
+            layer->mergeCreatedNode();
+
+        traverse(node, nv);
+    }
+
+    osg::observer_ptr<ModelLayer> _layer;
+};
+
+//------------------------------------------------------------------------
+
 ModelLayer::ModelLayer() :
 VisibleLayer(&_optionsConcrete),
 _options(&_optionsConcrete)
@@ -150,15 +204,18 @@ _optionsConcrete(ModelLayerOptions())
 
 ModelLayer::~ModelLayer()
 {
-    //nop
+    if (_createJobs.valid())
+        _createJobs->cancel();
 }
 
 void
 ModelLayer::init()
 {
     VisibleLayer::init();
+    _needsNode = false;
     _root = new osg::Group();
     _root->setName(getName());
+    _root->setUpdateCallback(new MergeCallback(this));
 }
 
 const Status&
@@ -239,54 +296,153 @@ ModelLayer::addedToMap(const Map* map)
 
     if ( _modelSource.valid() )
     {
-        // reset the scene graph.
-        while (_root->getNumChildren() > 0)
+        Threading::ScopedMutexLock lock(_mutex);
+        _map = map;
+        _needsNode = true;
+
+        // a disabled layer creates its graph when it's enabled.
+        if ( getEnabled() )
+            startCreateNode();
+    }
+}
+
+void
+ModelLayer::removedFromMap(const Map* map)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    cancelCreateNode();
+    _map = 0L;
+    _needsNode = false;
+}
+
+void
+ModelLayer::setEnabled(bool value)
+{
+    VisibleLayer::setEnabled(value);
+
+    Threading::ScopedMutexLock lock(_mutex);
+    if ( getEnabled() )
+    {
+        if ( _needsNode && !_createJobs.valid() )
+            startCreateNode();
+    }
+    else
+    {
+        cancelCreateNode();
+    }
+}
+
+void
+ModelLayer::startCreateNode()
+{
+    // call with _mutex held.
+    osg::ref_ptr<const Map> map;
+    if ( !_map.lock(map) )
+        return;
+
+    // Share the scene graph callbacks with the model source:
+    _modelSource->setSceneGraphCallbacks(getSceneGraphCallbacks());
+
+    if ( options().async() == true )
+    {
+        cancelCreateNode();
+        _createJobs = new JobGroup();
+
+        Registry::instance()->getJobScheduler()->submit(
+            new CreateNodeJob(this, map.get()),
+            JobScheduler::LANE_NORMAL,
+            _createJobs.get());
+    }
+    else
+    {
+        installNode( createNode(map.get(), 0L) );
+        _needsNode = false;
+    }
+}
+
+void
+ModelLayer::cancelCreateNode()
+{
+    // call with _mutex held.
+    if ( _createJobs.valid() )
+    {
+        _createJobs->cancel();
+        _createJobs = 0L;
+    }
+    _createdNode = 0L;
+}
+
+osg::Node*
+ModelLayer::createNode(const Map* map, ProgressCallback* progress)
+{
+    // Create the scene graph from the mode source:
+    osg::ref_ptr<osg::Node> node = _modelSource->createNode(map, progress);
+    if (node.valid())
+    {
+        // Handle disabling depth testing
+        if ( _modelSource->getOptions().depthTestEnabled() == false )
         {
-            getSceneGraphCallbacks()->fireRemoveNode(_root->getChild(0));
-            _root->removeChildren(0, 1);
+            osg::StateSet* ss = node->getOrCreateStateSet();
+            ss->setAttributeAndModes( new osg::Depth( osg::Depth::ALWAYS ) );              
+            ss->setRenderBinDetails( 99999, "RenderBin" ); //TODO: configure this bin ...
         }
 
-        // Share the scene graph callbacks with the model source:
-        _modelSource->setSceneGraphCallbacks(getSceneGraphCallbacks());
+        // enfore a rendering bin if necessary:
+        if (_modelSource->getOptions().renderOrder().isSet())
+        {
+            osg::StateSet* ss = node->getOrCreateStateSet();
+            ss->setRenderBinDetails(
+                _modelSource->getOptions().renderOrder().value(),
+                ss->getBinName().empty() ? "DepthSortedBin" : ss->getBinName());
+        }
 
-        // Create the scene graph from the mode source:
-        osg::ref_ptr<osg::Node> node = _modelSource->createNode(map, 0L);
-        if (node.valid())
+        if (_modelSource->getOptions().renderBin().isSet())
         {
-            if ( options().lightingEnabled().isSet() )
-            {
-                setLightingEnabledNoLock( options().lightingEnabled().get() );
-            }
+            osg::StateSet* ss = node->getOrCreateStateSet();
+            ss->setRenderBinDetails(
+                ss->getBinNumber(),
+                _modelSource->getOptions().renderBin().get());
+        }
+    }
+    return node.release();
+}
 
-            _modelSource->sync( _modelSourceRev );
+void
+ModelLayer::installNode(osg::Node* node)
+{
+    // call with _mutex held.
+    osg::ref_ptr<osg::Node> ref = node;
 
-            // Handle disabling depth testing
-            if ( _modelSource->getOptions().depthTestEnabled() == false )
-            {
-                osg::StateSet* ss = node->getOrCreateStateSet();
-                ss->setAttributeAndModes( new osg::Depth( osg::Depth::ALWAYS ) );              
-                ss->setRenderBinDetails( 99999, "RenderBin" ); //TODO: configure this bin ...
-            }
+    // reset the scene graph.
+    while (_root->getNumChildren() > 0)
+    {
+        getSceneGraphCallbacks()->fireRemoveNode(_root->getChild(0));
+        _root->removeChildren(0, 1);
+    }
 
-            // enfore a rendering bin if necessary:
-            if (_modelSource->getOptions().renderOrder().isSet())
-            {
-                osg::StateSet* ss = node->getOrCreateStateSet();
-                ss->setRenderBinDetails(
-                    _modelSource->getOptions().renderOrder().value(),
-                    ss->getBinName().empty() ? "DepthSortedBin" : ss->getBinName());
-            }
+    if (ref.valid())
+    {
+        if ( options().lightingEnabled().isSet() )
+        {
+            setLightingEnabledNoLock( options().lightingEnabled().get() );
+        }
 
-            if (_modelSource->getOptions().renderBin().isSet())
-            {
-                osg::StateSet* ss = node->getOrCreateStateSet();
-                ss->setRenderBinDetails(
-                    ss->getBinNumber(),
-                    _modelSource->getOptions().renderBin().get());
-            }
+        _modelSource->sync( _modelSourceRev );
 
-            _root->addChild(node.get());
-        }
+        _root->addChild(ref.get());
+    }
+}
+
+void
+ModelLayer::mergeCreatedNode()
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    if ( _createJobs.valid() && _createJobs->getNumPending() == 0u )
+    {
+        installNode( _createdNode.get() );
+        _createdNode = 0L;
+        _createJobs = 0L;
+        _needsNode = false;
     }
 }
 
@@ -23,6 +23,7 @@
 #include <osgEarth/ObjectIndex>
 #include <osgEarth/Registry>
 #include <osg/Geometry>
+#include <algorithm>
 
 using namespace osgEarth;
 
@@ -34,6 +35,9 @@ using namespace osgEarth;
 // Object IDs under this reserved
 #define STARTING_OBJECT_ID 10
 
+#define STRINGIFY2(X) #X
+#define STRINGIFY(X) STRINGIFY2(X)
+
 namespace
 {
     const char* indexVertexInit =
@@ -44,23 +48,79 @@ namespace
         "#pragma vp_location   vertex_model \n"
         "#pragma vp_order      first \n"
 
+        "#define OE_INDEX_MAX_RANGES " STRINGIFY(OSGEARTH_OBJECTINDEX_MAX_RANGES) " \n"
+
         "uniform uint oe_index_objectid_uniform; \n"   // override objectid if > 0
+        "uniform int  oe_index_num_ranges; \n"         // number of vertex ranges (see tagRange)
+        "uniform uint oe_index_range_end[OE_INDEX_MAX_RANGES]; \n" // end vertex (exclusive) of each range
+        "uniform uint oe_index_range_id[OE_INDEX_MAX_RANGES]; \n"  // object ID of each range
         "in uint      oe_index_objectid_attr; \n"      // Vertex attribute containing the object ID.
         "uint         oe_index_objectid; \n"           // Stage global containing the Object ID.
 
         "void oe_index_readObjectID(inout vec4 vertex) \n"
         "{ \n"
+        "    oe_index_objectid = 0u; \n"
         "    if ( oe_index_objectid_uniform > 0u ) \n"
         "        oe_index_objectid = oe_index_objectid_uniform; \n"
+        "    else if ( oe_index_num_ranges > 0 ) \n"
+        "    { \n"
+        "        uint v = uint(gl_VertexID); \n"
+        "        for(int i=0; i<oe_index_num_ranges; ++i) \n"
+        "        { \n"
+        "            if ( v < oe_index_range_end[i] ) \n"
+        "            { \n"
+        "                oe_index_objectid = oe_index_range_id[i]; \n"
+        "                break; \n"
+        "            } \n"
+        "        } \n"
+        "    } \n"
         "    else if ( oe_index_objectid_attr > 0u ) \n"
         "        oe_index_objectid = oe_index_objectid_attr; \n"
-        "    else \n"
-        "        oe_index_objectid = 0u; \n"
         "} \n";
+
+    // Uniforms that hold the vertex ranges of a drawable
+    const char* NUM_RANGES_NAME = "oe_index_num_ranges";
+    const char* RANGE_END_NAME  = "oe_index_range_end";
+    const char* RANGE_ID_NAME   = "oe_index_range_id";
+
+    struct Range
+    {
+        Range(unsigned start, unsigned end, ObjectID id) : _start(start), _end(end), _id(id) { }
+        unsigned _start, _end;
+        ObjectID _id;
+        bool operator < (const Range& rhs) const { return _start < rhs._start; }
+    };
+
+    // Reads the tagged (non-empty) ranges from a state set.
+    void readRanges(const osg::StateSet* ss, std::vector<Range>& output)
+    {
+        if (!ss) return;
+
+        const osg::Uniform* numU = ss->getUniform(NUM_RANGES_NAME);
+        const osg::Uniform* endU = ss->getUniform(RANGE_END_NAME);
+        const osg::Uniform* idU  = ss->getUniform(RANGE_ID_NAME);
+        if (!numU || !endU || !idU) return;
+
+        int num;
+        numU->get(num);
+
+        unsigned start = 0u;
+        for (int i = 0; i < num; ++i)
+        {
+            unsigned end, id;
+            endU->getElement(i, end);
+            idU->getElement(i, id);
+            if (id != OSGEARTH_OBJECTID_EMPTY)
+                output.push_back(Range(start, end, id));
+            start = end;
+        }
+    }
 }
 
 ObjectIndex::ObjectIndex() :
-_idGen( STARTING_OBJECT_ID )
+_idGen( STARTING_OBJECT_ID ),
+_size( 0 ),
+_storage( STORAGE_PER_VERTEX )
 {
     _attribName     = "oe_index_objectid_attr";
 #ifdef __IOS__
@@ -74,6 +134,14 @@ _idGen( STARTING_OBJECT_ID )
     _shaders.add( "ObjectIndex.vert.glsl", indexVertexInit );
 }
 
+ObjectIndex::~ObjectIndex()
+{
+    for (unsigned i = 0; i < OSGEARTH_OBJECTINDEX_MAX_SLABS; ++i)
+    {
+        delete static_cast<Slab*>(_slabs[i].get());
+    }
+}
+
 bool
 ObjectIndex::loadShaders(VirtualProgram* vp) const
 {
@@ -85,10 +153,20 @@ ObjectIndex::loadShaders(VirtualProgram* vp) const
     return vp != 0L;
 }
 
+void
+ObjectIndex::installDefaultUniforms(osg::StateSet* stateSet) const
+{
+    if ( stateSet )
+    {
+        stateSet->addUniform( new osg::Uniform(_oidUniformName.c_str(), 0u) );
+        stateSet->addUniform( new osg::Uniform(NUM_RANGES_NAME, 0) );
+    }
+}
+
 void
 ObjectIndex::setObjectIDAtrribLocation(int value)
 {
-    if ( _index.size() == 0 )
+    if ( (unsigned)_size == 0u )
     {
         _attribLocation = value;
     } 
@@ -101,48 +179,112 @@ ObjectIndex::setObjectIDAtrribLocation(int value)
 ObjectID
 ObjectIndex::insert(osg::Referenced* object)
 {
-    Threading::ScopedMutexLock excl( _mutex );
     return insertImpl( object );
 }
 
+ObjectIndex::Slot*
+ObjectIndex::getSlot(ObjectID id, bool create) const
+{
+    unsigned s = id / OSGEARTH_OBJECTINDEX_SLAB_SIZE;
+    if ( s >= OSGEARTH_OBJECTINDEX_MAX_SLABS )
+        return 0L;
+
+    Slab* slab = static_cast<Slab*>(_slabs[s].get());
+    if ( !slab && create )
+    {
+        // Another thread may get here first; if so, use its slab.
+        Slab* newSlab = new Slab();
+        if ( _slabs[s].assign(newSlab, 0L) )
+        {
+            slab = newSlab;
+        }
+        else
+        {
+            delete newSlab;
+            slab = static_cast<Slab*>(_slabs[s].get());
+        }
+    }
+
+    return slab ? &slab->_slots[id % OSGEARTH_OBJECTINDEX_SLAB_SIZE] : 0L;
+}
+
 ObjectID
 ObjectIndex::insertImpl(osg::Referenced* object)
 {
-    // internal: assume mutex is locked
     ObjectID id = ++_idGen;
-    _index[id] = object;
-    OE_DEBUG << LC << "Insert " << id << "; size = " << _index.size() << "\n";
+
+    Slot* slot = getSlot(id, true);
+    if ( slot )
+    {
+        Threading::ScopedMutexLock lock( _stripes[id % OSGEARTH_OBJECTINDEX_NUM_STRIPES] );
+        *slot = object;
+    }
+    else
+    {
+        Threading::ScopedMutexLock lock( _mutex );
+        _overflow[id] = object;
+    }
+
+    ++_size;
+    OE_DEBUG << LC << "Insert " << id << "; size = " << (unsigned)_size << "\n";
     return id;
 }
 
-osg::Referenced*
+osg::ref_ptr<osg::Referenced>
 ObjectIndex::getImpl(ObjectID id) const
 {
-    // assume the mutex is locked
-    IndexMap::const_iterator i = _index.find(id);
-    return i != _index.end() ? i->second.get() : 0L;
+    osg::ref_ptr<osg::Referenced> object;
+
+    Slot* slot = getSlot(id, false);
+    if ( slot )
+    {
+        Threading::ScopedMutexLock lock( _stripes[id % OSGEARTH_OBJECTINDEX_NUM_STRIPES] );
+        slot->lock( object );
+    }
+    else if ( id / OSGEARTH_OBJECTINDEX_SLAB_SIZE >= OSGEARTH_OBJECTINDEX_MAX_SLABS )
+    {
+        Threading::ScopedMutexLock lock( _mutex );
+        IndexMap::const_iterator i = _overflow.find(id);
+        if ( i != _overflow.end() )
+            i->second.lock( object );
+    }
+
+    return object;
 }
 
 void
 ObjectIndex::remove(ObjectID id)
 {
-    Threading::ScopedMutexLock excl(_mutex);
     removeImpl(id);
 }
 
 void
 ObjectIndex::removeImpl(ObjectID id)
 {
-    // internal - assume mutex is locked
-    _index.erase( id );
-    OE_DEBUG << "Remove " << id << "; size = " << _index.size() << "\n";
+    bool removed = false;
+
+    Slot* slot = getSlot(id, false);
+    if ( slot )
+    {
+        Threading::ScopedMutexLock lock( _stripes[id % OSGEARTH_OBJECTINDEX_NUM_STRIPES] );
+        removed = slot->valid();
+        *slot = 0L;
+    }
+    else if ( id / OSGEARTH_OBJECTINDEX_SLAB_SIZE >= OSGEARTH_OBJECTINDEX_MAX_SLABS )
+    {
+        Threading::ScopedMutexLock lock( _mutex );
+        removed = _overflow.erase( id ) > 0;
+    }
 
+    if ( removed )
+        --_size;
+
+    OE_DEBUG << "Remove " << id << "; size = " << (unsigned)_size << "\n";
 }
 
 ObjectID
 ObjectIndex::tagDrawable(osg::Drawable* drawable, osg::Referenced* object)
 {
-    Threading::ScopedMutexLock lock(_mutex);
     ObjectID oid = insertImpl(object);
     tagDrawable(drawable, oid);
     return oid;
@@ -155,9 +297,22 @@ ObjectIndex::tagDrawable(osg::Drawable* drawable, ObjectID id) const
         return;
 
     osg::Geometry* geom = drawable->asGeometry();
-    if ( !geom )
+    if ( !geom || !geom->getVertexArray() )
         return;
 
+    if ( _storage == STORAGE_PER_DRAWABLE )
+    {
+        tagRange( geom, 0u, geom->getVertexArray()->getNumElements(), id );
+    }
+    else
+    {
+        tagVertices( geom, id );
+    }
+}
+
+void
+ObjectIndex::tagVertices(osg::Geometry* geom, ObjectID id) const
+{
     // add a new integer attributer to store the feautre ID per vertex.
     ObjectIDArray* ids = new ObjectIDArray();
     ids->setBinding(osg::Array::BIND_PER_VERTEX);
@@ -173,6 +328,137 @@ ObjectIndex::tagDrawable(osg::Drawable* drawable, ObjectID id) const
     ids->assign( geom->getVertexArray()->getNumElements(), id );
 }
 
+void
+ObjectIndex::tagRange(osg::Drawable* drawable, unsigned first, unsigned count, ObjectID id) const
+{
+    osg::Geometry* geom = drawable ? drawable->asGeometry() : 0L;
+    if ( !geom || count == 0u )
+        return;
+
+    // Already carrying per-vertex IDs? Then just write into those.
+    ObjectIDArray* oids = dynamic_cast<ObjectIDArray*>(geom->getVertexAttribArray(_attribLocation));
+    if ( oids && !oids->empty() )
+    {
+        unsigned end = std::min(first + count, (unsigned)oids->size());
+        for (unsigned i = first; i < end; ++i)
+            (*oids)[i] = id;
+        oids->dirty();
+        return;
+    }
+
+    // Merge the new range into the existing ones; the new range wins
+    // wherever they overlap.
+    std::vector<Range> ranges;
+    readRanges( geom->getStateSet(), ranges );
+
+    unsigned end = first + count;
+    std::vector<Range> merged;
+    for (std::vector<Range>::const_iterator r = ranges.begin(); r != ranges.end(); ++r)
+    {
+        if ( r->_end <= first || r->_start >= end )
+        {
+            merged.push_back( *r );
+        }
+        else
+        {
+            if ( r->_start < first )
+                merged.push_back( Range(r->_start, first, r->_id) );
+            if ( r->_end > end )
+                merged.push_back( Range(end, r->_end, r->_id) );
+        }
+    }
+    merged.push_back( Range(first, end, id) );
+    std::sort( merged.begin(), merged.end() );
+
+    // Encode as (end, id) pairs, filling any gaps with empty ranges:
+    std::vector<std::pair<unsigned, ObjectID> > encoded;
+    unsigned cursor = 0u;
+    for (std::vector<Range>::const_iterator r = merged.begin(); r != merged.end(); ++r)
+    {
+        if ( r->_start > cursor )
+            encoded.push_back( std::make_pair(r->_start, OSGEARTH_OBJECTID_EMPTY) );
+        encoded.push_back( std::make_pair(r->_end, r->_id) );
+        cursor = r->_end;
+    }
+
+    if ( encoded.size() > OSGEARTH_OBJECTINDEX_MAX_RANGES )
+    {
+        // Too many ranges for the uniforms; go per-vertex instead.
+        OE_DEBUG << LC << "Too many ranges in drawable; switching to per-vertex IDs" << std::endl;
+        convertRangesToVertices( geom );
+        tagRange( geom, first, count, id );
+        return;
+    }
+
+    osg::StateSet* ss = geom->getOrCreateStateSet();
+    osg::Uniform* endU = ss->getOrCreateUniform(RANGE_END_NAME, osg::Uniform::UNSIGNED_INT, OSGEARTH_OBJECTINDEX_MAX_RANGES);
+    osg::Uniform* idU  = ss->getOrCreateUniform(RANGE_ID_NAME,  osg::Uniform::UNSIGNED_INT, OSGEARTH_OBJECTINDEX_MAX_RANGES);
+    for (unsigned i = 0; i < encoded.size(); ++i)
+    {
+        endU->setElement( i, encoded[i].first );
+        idU->setElement( i, encoded[i].second );
+    }
+    ss->getOrCreateUniform(NUM_RANGES_NAME, osg::Uniform::INT)->set( (int)encoded.size() );
+}
+
+void
+ObjectIndex::convertRangesToVertices(osg::Geometry* geom) const
+{
+    std::vector<Range> ranges;
+    readRanges( geom->getStateSet(), ranges );
+
+    tagVertices( geom, OSGEARTH_OBJECTID_EMPTY );
+    ObjectIDArray* oids = static_cast<ObjectIDArray*>(geom->getVertexAttribArray(_attribLocation));
+
+    for (std::vector<Range>::const_iterator r = ranges.begin(); r != ranges.end(); ++r)
+    {
+        unsigned end = std::min(r->_end, (unsigned)oids->size());
+        for (unsigned i = r->_start; i < end; ++i)
+            (*oids)[i] = r->_id;
+    }
+
+    osg::StateSet* ss = geom->getStateSet();
+    if ( ss )
+    {
+        ss->removeUniform( NUM_RANGES_NAME );
+        ss->removeUniform( RANGE_END_NAME );
+        ss->removeUniform( RANGE_ID_NAME );
+    }
+}
+
+void
+ObjectIndex::tagPrimitiveSet(osg::Geometry* geometry, unsigned primSetIndex, ObjectID id) const
+{
+    if ( !geometry || primSetIndex >= geometry->getNumPrimitiveSets() )
+        return;
+
+    const osg::PrimitiveSet* pset = geometry->getPrimitiveSet(primSetIndex);
+    unsigned numIndices = pset->getNumIndices();
+    if ( numIndices == 0u )
+        return;
+
+    // gl_VertexID is the vertex index, so a primitive set covers the
+    // range of vertices it references.
+    unsigned minIndex = ~0u, maxIndex = 0u;
+    const osg::DrawArrays* da = dynamic_cast<const osg::DrawArrays*>(pset);
+    if ( da )
+    {
+        minIndex = da->getFirst();
+        maxIndex = da->getFirst() + da->getCount() - 1;
+    }
+    else
+    {
+        for (unsigned i = 0; i < numIndices; ++i)
+        {
+            unsigned index = pset->index(i);
+            minIndex = std::min(minIndex, index);
+            maxIndex = std::max(maxIndex, index);
+        }
+    }
+
+    tagRange( geometry, minIndex, maxIndex - minIndex + 1, id );
+}
+
 namespace
 {
     struct FindAndTagDrawables : public osg::NodeVisitor
@@ -194,10 +480,106 @@ namespace
     };
 }
 
+namespace
+{
+    struct CollapseObject : public osg::NodeVisitor
+    {
+        CollapseObject(const ObjectIndex* index, ObjectID id) : _index(index), _id(id), _found(false)
+        {
+            setTraversalMode(TRAVERSE_ALL_CHILDREN);
+            setNodeMaskOverride(~0);
+        }
+
+        void apply(osg::Node& node)
+        {
+            ObjectID oid;
+            if (_index->getObjectID(&node, oid) && oid == _id)
+            {
+                node.setNodeMask(0);
+                _found = true;
+                return;
+            }
+            traverse(node);
+        }
+
+        void apply(osg::Drawable& drawable)
+        {
+            if (_index->collapse(&drawable, _id))
+                _found = true;
+        }
+
+        const ObjectIndex* _index;
+        ObjectID           _id;
+        bool               _found;
+    };
+}
+
+bool
+ObjectIndex::collapse(osg::Node* graph, ObjectID id) const
+{
+    if ( !graph || id == OSGEARTH_OBJECTID_EMPTY )
+        return false;
+
+    CollapseObject visitor(this, id);
+    graph->accept( visitor );
+    return visitor._found;
+}
+
+bool
+ObjectIndex::collapse(osg::Drawable* drawable, ObjectID id) const
+{
+    osg::Geometry* geom = drawable ? drawable->asGeometry() : 0L;
+    osg::Vec3Array* verts = geom ? dynamic_cast<osg::Vec3Array*>(geom->getVertexArray()) : 0L;
+    if ( !verts || verts->empty() )
+        return false;
+
+    int anchor = -1;
+
+    std::vector<Range> ranges;
+    readRanges( geom->getStateSet(), ranges );
+    if ( !ranges.empty() )
+    {
+        for (std::vector<Range>::const_iterator r = ranges.begin(); r != ranges.end(); ++r)
+        {
+            if ( r->_id != id )
+                continue;
+
+            unsigned end = std::min(r->_end, (unsigned)verts->size());
+            for (unsigned i = r->_start; i < end; ++i)
+            {
+                if ( anchor < 0 ) anchor = i;
+                (*verts)[i] = (*verts)[anchor];
+            }
+        }
+    }
+    else
+    {
+        const ObjectIDArray* oids = dynamic_cast<const ObjectIDArray*>(geom->getVertexAttribArray(_attribLocation));
+        if ( !oids )
+            return false;
+
+        unsigned end = std::min(oids->size(), verts->size());
+        for (unsigned i = 0; i < end; ++i)
+        {
+            if ( (*oids)[i] != id )
+                continue;
+
+            if ( anchor < 0 ) anchor = i;
+            (*verts)[i] = (*verts)[anchor];
+        }
+    }
+
+    if ( anchor < 0 )
+        return false;
+
+    verts->dirty();
+    geom->dirtyBound();
+    return true;
+}
+
 ObjectID
 ObjectIndex::tagAllDrawables(osg::Node* node, osg::Referenced* object)
 {
-    Threading::ScopedMutexLock lock(_mutex);
     ObjectID oid = insertImpl(object);
     tagAllDrawables(node, oid);
     return oid;
@@ -216,7 +598,6 @@ ObjectIndex::tagAllDrawables(osg::Node* node, ObjectID id) const
 ObjectID
 ObjectIndex::tagNode(osg::Node* node, osg::Referenced* object)
 {
-    Threading::ScopedMutexLock lock(_mutex);
     ObjectID oid = insertImpl(object);
     tagNode(node, oid);
     return oid;
@@ -240,6 +621,15 @@ ObjectIndex::getObjectIDs(const osg::Drawable* drawable, std::set<ObjectID>& out
     const osg::Geometry* geometry = drawable->asGeometry();
     if (!geometry) return false;
 
+    std::vector<Range> ranges;
+    readRanges( geometry->getStateSet(), ranges );
+    if ( !ranges.empty() )
+    {
+        for (std::vector<Range>::const_iterator r = ranges.begin(); r != ranges.end(); ++r)
+            output.insert( r->_id );
+        return true;
+    }
+
     const ObjectIDArray* oids = dynamic_cast<const ObjectIDArray*>(geometry->getVertexAttribArray(_attribLocation));
     if ( !oids ) return false;
     if (oids->empty()) return false;
@@ -276,6 +666,34 @@ ObjectIndex::updateObjectIDs(osg::Drawable* drawable,
     osg::Geometry* geometry = drawable->asGeometry();
     if (!geometry) return false;
 
+    std::vector<Range> ranges;
+    readRanges( geometry->getStateSet(), ranges );
+    if ( !ranges.empty() )
+    {
+        osg::Uniform* idU = geometry->getStateSet()->getUniform(RANGE_ID_NAME);
+        int num;
+        geometry->getStateSet()->getUniform(NUM_RANGES_NAME)->get(num);
+        for (int i = 0; i < num; ++i)
+        {
+            ObjectID oldoid;
+            idU->getElement(i, oldoid);
+            if (oldoid == OSGEARTH_OBJECTID_EMPTY)
+                continue;
+
+            ObjectID newoid;
+            std::map<ObjectID, ObjectID>::iterator k = oldNewMap.find(oldoid);
+            if (k != oldNewMap.end()) {
+                newoid = k->second;
+            }
+            else {
+                newoid = insert(object);
+                oldNewMap[oldoid] = newoid;
+            }
+            idU->setElement(i, newoid);
+        }
+        return true;
+    }
+
     ObjectIDArray* oids = dynamic_cast<ObjectIDArray*>(geometry->getVertexAttribArray(_attribLocation));
     if ( !oids ) return false;
     if (oids->empty()) return false;
@@ -0,0 +1,129 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2016 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/OptionsOverlay>
+#include <osgEarth/Registry>
+#include <osgEarth/ThreadingUtils>
+#include <osg/observer_ptr>
+#include <map>
+#include <sstream>
+
+#define LC "[OptionsOverlay] "
+
+using namespace osgEarth;
+
+// Derived options to keep; past this, entries whose base options are gone
+// are dropped, then everything if that isn't enough.
+#define MAX_ENTRIES 1024u
+
+namespace
+{
+    struct Entry
+    {
+        bool                                    _hasBase;
+        osg::observer_ptr<const osgDB::Options> _base;
+        osg::ref_ptr<const osgDB::Options>      _derived;
+    };
+
+    typedef std::map<std::string, Entry> Entries;
+
+    Entries          s_entries;
+    Threading::Mutex s_entriesMutex;
+
+    void prune()
+    {
+        for (Entries::iterator i = s_entries.begin(); i != s_entries.end(); )
+        {
+            if (i->second._hasBase && !i->second._base.valid())
+                s_entries.erase(i++);
+            else
+                ++i;
+        }
+
+        if (s_entries.size() >= MAX_ENTRIES)
+            s_entries.clear();
+    }
+}
+
+OptionsOverlay&
+OptionsOverlay::pushDatabasePath(const std::string& path)
+{
+    _databasePath = path;
+    _key += "d\x01" + path + "\x02";
+    return *this;
+}
+
+OptionsOverlay&
+OptionsOverlay::prependOptionString(const std::string& value)
+{
+    _optionString = value;
+    _key += "o\x01" + value + "\x02";
+    return *this;
+}
+
+OptionsOverlay&
+OptionsOverlay::setPluginStringData(const std::string& name, const std::string& value)
+{
+    _pluginData.push_back(std::make_pair(name, value));
+    _key += "p\x01" + name + "\x01" + value + "\x02";
+    return *this;
+}
+
+osg::ref_ptr<const osgDB::Options>
+OptionsOverlay::apply(const osgDB::Options* base) const
+{
+    if (empty())
+        return base;
+
+    std::stringstream buf;
+    buf << (const void*)base << '\x02' << _key;
+    std::string key = buf.str();
+
+    Threading::ScopedMutexLock lock(s_entriesMutex);
+
+    // an entry counts only while its base lives; a new object at the same
+    // address replaces it.
+    Entries::iterator i = s_entries.find(key);
+    if (i != s_entries.end())
+    {
+        osg::ref_ptr<const osgDB::Options> live;
+        if (!i->second._hasBase || (i->second._base.lock(live) && live.get() == base))
+            return i->second._derived.get();
+    }
+
+    osg::ref_ptr<osgDB::Options> derived = Registry::cloneOrCreateOptions(base);
+
+    if (!_databasePath.empty())
+        derived->getDatabasePathList().push_front(_databasePath);
+
+    if (!_optionString.empty())
+        derived->setOptionString(_optionString + " " + derived->getOptionString());
+
+    for (unsigned p = 0; p < _pluginData.size(); ++p)
+        derived->setPluginStringData(_pluginData[p].first, _pluginData[p].second);
+
+    if (s_entries.size() >= MAX_ENTRIES)
+        prune();
+
+    Entry& entry = s_entries[key];
+    entry._hasBase = base != 0L;
+    entry._base = base;
+    entry._derived = derived.get();
+
+    return derived.get();
+}
@@ -18,6 +18,7 @@
  */
 #include <osgEarth/PagedNode>
 #include <osgEarth/Utils>
+#include <osgEarth/NodeUtils>
 
 #include <osgDB/Registry>
 #include <osgDB/FileNameUtils>
@@ -69,6 +70,15 @@ PagedNode::PagedNode() :
     _attachPoint = new osg::Group;
 
     _plod->addChild( _attachPoint );     
+
+    // load the paged child on the job scheduler; merging needs an update traversal.
+    _loader = new PagingLoader();
+    ADJUST_UPDATE_TRAV_COUNT(this, +1);
+}
+
+void PagedNode::traverse(osg::NodeVisitor& nv)
+{
+    _loader->traverse(this, nv);
 }
 
 void PagedNode::setRangeMode(osg::LOD::RangeMode mode)
@@ -0,0 +1,354 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2016 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/PagingLoader>
+#include <osgEarth/Registry>
+#include <osgEarth/Notify>
+#include <osgDB/ReadFile>
+#include <algorithm>
+
+#define LC "[PagingLoader] "
+
+using namespace osgEarth;
+
+// Frames a request may go without being asked for before it's dropped.
+#define MAX_REQUEST_AGE 2u
+
+struct PagingLoader::Request : public osg::Referenced
+{
+    enum State { IDLE, WAITING, RUNNING, COMPILING, READY, MERGED, FAILED };
+
+    Request() : _state(IDLE), _priority(0.0f), _lastFrame(0u) { }
+
+    State                               _state;
+    std::string                         _fileName;
+    osg::observer_ptr<osg::Group>       _parent;
+    osg::ref_ptr<const osgDB::Options>  _options;
+    float                               _priority;
+    unsigned                            _lastFrame;
+    osg::ref_ptr<osg::Node>             _node;
+};
+
+namespace
+{
+    // Like the REX loader's jobs, a job doesn't carry a request; it runs
+    // whichever one is most urgent when a worker picks it up.
+    struct PagingLoaderJob : public TaskRequest
+    {
+        PagingLoaderJob(PagingLoader* loader) : _loader(loader) { }
+
+        void operator()(ProgressCallback* progress)
+        {
+            osg::ref_ptr<PagingLoader> loader;
+            if (_loader.lock(loader))
+                loader->invokeNext();
+        }
+
+        osg::observer_ptr<PagingLoader> _loader;
+    };
+
+    // Hands a request back once the ICO has compiled its GL objects.
+    struct PagingLoaderCompileCompleted : public osgUtil::IncrementalCompileOperation::CompileCompletedCallback
+    {
+        PagingLoaderCompileCompleted(PagingLoader* loader, PagingLoader::Request* request) :
+            _loader(loader), _request(request) { }
+
+        bool compileCompleted(osgUtil::IncrementalCompileOperation::CompileSet* compileSet)
+        {
+            osg::ref_ptr<PagingLoader> loader;
+            if (_loader.lock(loader))
+                loader->queueForMerge(_request.get());
+            return true;
+        }
+
+        osg::observer_ptr<PagingLoader>      _loader;
+        osg::ref_ptr<PagingLoader::Request>  _request;
+    };
+
+    struct SortByPriority
+    {
+        bool operator()(const osg::ref_ptr<PagingLoader::Request>& lhs, const osg::ref_ptr<PagingLoader::Request>& rhs) const {
+            return lhs->_priority > rhs->_priority;
+        }
+    };
+}
+
+PagingLoader::PagingLoader() :
+_frame         ( 0u ),
+_mergesPerFrame( 0u ),
+_maxInFlight   ( 0u ),
+_inFlight      ( 0u )
+{
+    _jobs = new JobGroup();
+}
+
+PagingLoader::~PagingLoader()
+{
+    // Discard anything that hasn't started; running jobs will fail to
+    // lock the loader and exit.
+    _jobs->cancel();
+}
+
+unsigned
+PagingLoader::getNumWaiting() const
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    return _waiting.size();
+}
+
+void
+PagingLoader::traverse(osg::Group* owner, osg::NodeVisitor& nv)
+{
+    if (nv.getVisitorType() == nv.CULL_VISITOR)
+    {
+        // a paged node nested under another one shares the outer loader.
+        osg::NodeVisitor::DatabaseRequestHandler* previous = nv.getDatabaseRequestHandler();
+        if (dynamic_cast<PagingLoader*>(previous) == 0L)
+        {
+            // remember the pager so merged subgraphs can expire through it.
+            if (!_pager.valid())
+            {
+                osgDB::DatabasePager* pager = dynamic_cast<osgDB::DatabasePager*>(previous);
+                if (pager)
+                    _pager = pager;
+            }
+
+            nv.setDatabaseRequestHandler(this);
+            owner->osg::Group::traverse(nv);
+            nv.setDatabaseRequestHandler(previous);
+            return;
+        }
+    }
+
+    else if (nv.getVisitorType() == nv.UPDATE_VISITOR)
+    {
+        merge(nv.getFrameStamp());
+    }
+
+    owner->osg::Group::traverse(nv);
+}
+
+void
+PagingLoader::requestNodeFile(const std::string&             fileName,
+                              osg::NodePath&                 nodePath,
+                              float                          priority,
+                              const osg::FrameStamp*         framestamp,
+                              osg::ref_ptr<osg::Referenced>& databaseRequest,
+                              const osg::Referenced*         options)
+{
+    if (nodePath.empty())
+        return;
+
+    unsigned frame = framestamp ? framestamp->getFrameNumber() : 0u;
+    bool submit = false;
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+
+        _frame = std::max(_frame, frame);
+
+        // A merged request whose PagedLOD asks again had its child expired;
+        // a request from anywhere else belongs to the DatabasePager.
+        Request* request = dynamic_cast<Request*>(databaseRequest.get());
+        if (!request || request->_state == Request::MERGED)
+        {
+            request = new Request();
+            request->_fileName = fileName;
+            request->_parent = nodePath.back()->asGroup();
+            request->_options = dynamic_cast<const osgDB::Options*>(options);
+            databaseRequest = request;
+        }
+
+        // If several views ask in the same frame, the most urgent one wins.
+        if (request->_lastFrame != frame || priority > request->_priority)
+            request->_priority = priority;
+        request->_lastFrame = frame;
+
+        if (request->_state == Request::IDLE)
+        {
+            request->_state = Request::WAITING;
+            _waiting.push_back(request);
+            submit = true;
+        }
+    }
+
+    if (submit)
+    {
+        // Scenery comes after the terrain tiles it sits on, which load on
+        // LANE_HIGH.
+        Registry::instance()->getJobScheduler()->submit(
+            new PagingLoaderJob(this),
+            JobScheduler::LANE_NORMAL,
+            _jobs.get());
+    }
+}
+
+void
+PagingLoader::invokeNext()
+{
+    osg::ref_ptr<Request> request;
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+
+        // over budget; the next request to finish will submit a new job.
+        if (_maxInFlight > 0u && _inFlight >= _maxInFlight)
+            return;
+
+        int best = -1;
+        for (unsigned i = 0; i < _waiting.size(); )
+        {
+            Request* req = _waiting[i].get();
+
+            // drop anything the cull stopped asking for; it re-queues if it
+            // comes back.
+            if (_frame - req->_lastFrame > MAX_REQUEST_AGE)
+            {
+                req->_state = Request::IDLE;
+                _waiting[i] = _waiting.back();
+                _waiting.pop_back();
+                continue;
+            }
+
+            if (best < 0 || req->_priority > _waiting[best]->_priority)
+                best = i;
+            ++i;
+        }
+
+        if (best < 0)
+            return;
+
+        request = _waiting[best].get();
+        _waiting[best] = _waiting.back();
+        _waiting.pop_back();
+        request->_state = Request::RUNNING;
+        ++_inFlight;
+    }
+
+    osg::ref_ptr<osg::Node> node;
+    if (request->_parent.valid())
+    {
+        node = osgDB::readRefNodeFile(request->_fileName, request->_options.get());
+    }
+
+    bool stale;
+    bool submit;
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+        --_inFlight;
+        submit = _maxInFlight > 0u && !_waiting.empty();
+
+        // the cull stopped asking while it loaded (it left the view); don't
+        // spend a compile and a merge on it.
+        stale = _frame - request->_lastFrame > MAX_REQUEST_AGE;
+
+        if (!node.valid())
+        {
+            // a PagedLOD keeps asking for a child it doesn't have; don't retry.
+            request->_state = request->_parent.valid() ? Request::FAILED : Request::IDLE;
+        }
+        else if (stale)
+        {
+            request->_state = Request::IDLE;
+        }
+    }
+
+    if (submit)
+    {
+        Registry::instance()->getJobScheduler()->submit(
+            new PagingLoaderJob(this),
+            JobScheduler::LANE_NORMAL,
+            _jobs.get());
+    }
+
+    if (!node.valid() || stale)
+        return;
+
+    request->_node = node.get();
+
+    osg::ref_ptr<osgDB::DatabasePager> pager;
+    _pager.lock(pager);
+    osgUtil::IncrementalCompileOperation* ico = pager.valid() ? pager->getIncrementalCompileOperation() : 0L;
+    if (ico && !ico->getContextSet().empty())
+    {
+        {
+            Threading::ScopedMutexLock lock(_mutex);
+            request->_state = Request::COMPILING;
+        }
+
+        osgUtil::IncrementalCompileOperation::CompileSet* compileSet =
+            new osgUtil::IncrementalCompileOperation::CompileSet(node.get());
+        compileSet->_compileCompletedCallback = new PagingLoaderCompileCompleted(this, request.get());
+        ico->add(compileSet);
+        return;
+    }
+
+    queueForMerge(request.get());
+}
+
+void
+PagingLoader::queueForMerge(Request* request)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    request->_state = Request::READY;
+    _ready.push_back(request);
+}
+
+void
+PagingLoader::merge(const osg::FrameStamp* fs)
+{
+    RequestList ready;
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+        if (_ready.empty())
+            return;
+
+        std::sort(_ready.begin(), _ready.end(), SortByPriority());
+
+        if (_mergesPerFrame > 0u && _ready.size() > _mergesPerFrame)
+        {
+            ready.assign(_ready.begin(), _ready.begin() + _mergesPerFrame);
+            _ready.erase(_ready.begin(), _ready.begin() + _mergesPerFrame);
+        }
+        else
+        {
+            ready.swap(_ready);
+        }
+    }
+
+    unsigned frame = fs ? fs->getFrameNumber() : 0u;
+    osg::ref_ptr<osgDB::DatabasePager> pager;
+    _pager.lock(pager);
+
+    for (RequestList::iterator i = ready.begin(); i != ready.end(); ++i)
+    {
+        Request* request = i->get();
+        osg::ref_ptr<osg::Group> parent;
+
+        // the PagedLOD adds its paged child after the ones it already has.
+        if (request->_parent.lock(parent) && request->_node.valid())
+        {
+            parent->addChild(request->_node.get());
+
+            if (pager.valid())
+                pager->registerPagedLODs(request->_node.get(), frame);
+        }
+
+        Threading::ScopedMutexLock lock(_mutex);
+        request->_node = 0L;
+        request->_state = Request::MERGED;
+    }
+}
@@ -453,6 +453,15 @@ void PrimitiveIntersector::intersect(osgUtil::IntersectionVisitor& iv, osg::Draw
 
     if (iv.getDoDummyTraversal()) return;
 
+    // If the drawable carries a BVH, use it instead of testing every triangle.
+    // A BVH only indexes triangles, which the functor below tests without any
+    // thickness buffer, so the results are the same.
+    const TriangleBVH* bvh = dynamic_cast<const TriangleBVH*>(drawable->getShape());
+    if (bvh)
+    {
+        intersect(iv, drawable, *bvh, s, e);
+        return;
+    }
 
     osg::TemplatePrimitiveFunctor<PrimitiveIntersectorFunctor> ti;
 
@@ -523,6 +532,54 @@ void PrimitiveIntersector::intersect(osgUtil::IntersectionVisitor& iv, osg::Draw
     }
 }
 
+void PrimitiveIntersector::intersect(osgUtil::IntersectionVisitor& iv, osg::Drawable* drawable,
+                                     const TriangleBVH& bvh, const osg::Vec3d& s, const osg::Vec3d& e)
+{
+    std::vector<TriangleBVH::Hit> hits;
+
+    if (_intersectionLimit == NO_LIMIT)
+    {
+        bvh.intersect(s, e, hits);
+    }
+    else
+    {
+        TriangleBVH::Hit nearest;
+        if (bvh.intersect(s, e, nearest))
+            hits.push_back(nearest);
+    }
+
+    for(std::vector<TriangleBVH::Hit>::const_iterator h = hits.begin(); h != hits.end(); ++h)
+    {
+        // remap ratio into _start, _end range
+        double remap_ratio = ((s-_start).length() + h->ratio * (e-s).length() )/(_end-_start).length();
+
+        if ( _intersectionLimit == LIMIT_NEAREST && !getIntersections().empty() )
+        {
+            if (remap_ratio >= getIntersections().begin()->ratio )
+                break;
+            else
+                getIntersections().clear();
+        }
+
+        Intersection hit;
+        hit.ratio = remap_ratio;
+        hit.matrix = iv.getModelMatrix();
+        hit.nodePath = iv.getNodePath();
+        hit.drawable = drawable;
+        hit.primitiveIndex = h->triangle;
+        hit.localIntersectionPoint = _start*(1.0-remap_ratio) + _end*remap_ratio;
+        hit.localIntersectionNormal = h->normal;
+
+        for(unsigned i=0; i<3; ++i)
+        {
+            hit.indexList.push_back(h->index[i]);
+            hit.ratioList.push_back(h->weight[i]);
+        }
+
+        insertIntersection(hit);
+    }
+}
+
 void PrimitiveIntersector::reset()
 {
     Intersector::reset();
@@ -0,0 +1,347 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2016 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/ProgramBinaryCache>
+#include <osgEarth/Registry>
+#include <osgEarth/Capabilities>
+#include <osgEarth/FileUtils>
+#include <osgEarth/StringUtils>
+#include <osgEarth/Notify>
+#include <osg/GL2Extensions>
+#include <osg/Version>
+#include <osgDB/FileUtils>
+#include <osgDB/FileNameUtils>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+
+using namespace osgEarth;
+
+#define LC "[ProgramBinaryCache] "
+
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+
+// Bump this whenever the file layout changes.
+#define BINARY_FILE_VERSION 1u
+
+#define BINARY_FILE_EXTENSION "oepb"
+#define IDENTITY_FILE_NAME    "driver.txt"
+
+namespace
+{
+    void writeString(std::ostream& out, const std::string& value)
+    {
+        unsigned size = value.size();
+        out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+        out.write(value.c_str(), size);
+    }
+
+    bool readString(std::istream& in, std::string& value)
+    {
+        unsigned size = 0u;
+        in.read(reinterpret_cast<char*>(&size), sizeof(size));
+        if (!in.good() || size > (1u << 20))
+            return false;
+        value.resize(size);
+        if (size > 0u)
+            in.read(&value[0], size);
+        return in.good();
+    }
+}
+
+//------------------------------------------------------------------------
+
+ProgramBinaryCache::ProgramBinaryCache(const std::string& path) :
+_path   ( path ),
+_enabled( false )
+{
+    if (!_path.empty())
+    {
+        initialize();
+    }
+}
+
+bool
+ProgramBinaryCache::isEnabled() const
+{
+    return _enabled;
+}
+
+void
+ProgramBinaryCache::initialize()
+{
+    const Capabilities& caps = Registry::capabilities();
+    if (!caps.supportsProgramBinary())
+    {
+        OE_INFO << LC << "Disabled; the GL driver does not support program binaries" << std::endl;
+        return;
+    }
+
+    if (!osgDB::fileExists(_path) && !osgEarth::makeDirectory(_path))
+    {
+        OE_WARN << LC << "Disabled; failed to create folder \"" << _path << "\"" << std::endl;
+        return;
+    }
+
+    // Binaries are only valid for the exact driver that produced them.
+    _identity = Stringify()
+        << caps.getVendor() << "\n"
+        << caps.getRenderer() << "\n"
+        << caps.getVersion() << "\n"
+        << osgGetVersion();
+
+    // If the driver changed since the cache was written, everything in it
+    // is stale.
+    std::string identityFile = osgDB::concatPaths(_path, IDENTITY_FILE_NAME);
+    std::string stored;
+    {
+        std::ifstream in(identityFile.c_str());
+        if (in.is_open())
+        {
+            std::stringstream buf;
+            buf << in.rdbuf();
+            stored = buf.str();
+        }
+    }
+
+    if (stored != _identity)
+    {
+        purge();
+
+        std::ofstream out(identityFile.c_str(), std::ios::out | std::ios::trunc);
+        if (!out.is_open())
+        {
+            OE_WARN << LC << "Disabled; cannot write to \"" << _path << "\"" << std::endl;
+            return;
+        }
+        out << _identity;
+    }
+
+    _enabled = true;
+    OE_INFO << LC << "Caching program binaries in \"" << _path << "\"" << std::endl;
+}
+
+void
+ProgramBinaryCache::purge()
+{
+    unsigned count = 0u;
+    osgDB::DirectoryContents files = osgDB::getDirectoryContents(_path);
+    for (osgDB::DirectoryContents::const_iterator i = files.begin(); i != files.end(); ++i)
+    {
+        if (osgDB::getLowerCaseFileExtension(*i) == BINARY_FILE_EXTENSION)
+        {
+            if (::remove(osgDB::concatPaths(_path, *i).c_str()) == 0)
+                ++count;
+        }
+    }
+
+    if (count > 0u)
+    {
+        OE_INFO << LC << "GL driver changed; discarded " << count << " cached program binaries" << std::endl;
+    }
+}
+
+std::string
+ProgramBinaryCache::makeKey(const osg::Program* program) const
+{
+    // Shader order matters (it's the link order), and so do the attribute
+    // and frag data locations since they are baked into the binary.
+    std::stringstream buf;
+
+    for (unsigned i = 0; i < program->getNumShaders(); ++i)
+    {
+        const osg::Shader* shader = program->getShader(i);
+        buf << (int)shader->getType() << "\n" << shader->getShaderSource() << '\0';
+    }
+
+    const osg::Program::AttribBindingList& attribs = program->getAttribBindingList();
+    for (osg::Program::AttribBindingList::const_iterator i = attribs.begin(); i != attribs.end(); ++i)
+    {
+        buf << "a:" << i->first << "=" << i->second << "\n";
+    }
+
+    const osg::Program::FragDataBindingList& frags = program->getFragDataBindingList();
+    for (osg::Program::FragDataBindingList::const_iterator i = frags.begin(); i != frags.end(); ++i)
+    {
+        buf << "f:" << i->first << "=" << i->second << "\n";
+    }
+
+    std::string text = buf.str();
+
+    // Two 32-bit hashes, one of which includes the driver identity.
+    return hashToString(text) + hashToString(_identity + text);
+}
+
+std::string
+ProgramBinaryCache::makeFileName(const std::string& key) const
+{
+    return osgDB::concatPaths(_path, key + "." + BINARY_FILE_EXTENSION);
+}
+
+bool
+ProgramBinaryCache::attach(osg::Program* program)
+{
+    if (!_enabled || !program || program->getNumShaders() == 0 || program->getProgramBinary())
+        return false;
+
+    std::string key = makeKey(program);
+
+    Threading::ScopedMutexLock lock(_mutex);
+
+    std::ifstream in(makeFileName(key).c_str(), std::ios::in | std::ios::binary);
+    if (!in.is_open())
+        return false;
+
+    char magic[4];
+    unsigned version = 0u;
+    in.read(magic, 4);
+    in.read(reinterpret_cast<char*>(&version), sizeof(version));
+    if (!in.good() || magic[0] != 'O' || magic[1] != 'E' || magic[2] != 'P' || magic[3] != 'B' || version != BINARY_FILE_VERSION)
+        return false;
+
+    // Guard against hash collisions and stray files.
+    std::string identity, storedKey;
+    if (!readString(in, identity) || identity != _identity ||
+        !readString(in, storedKey) || storedKey != key)
+    {
+        return false;
+    }
+
+    unsigned format = 0u, size = 0u;
+    in.read(reinterpret_cast<char*>(&format), sizeof(format));
+    in.read(reinterpret_cast<char*>(&size), sizeof(size));
+    if (!in.good() || size == 0u)
+        return false;
+
+    osg::ref_ptr<osg::Program::ProgramBinary> binary = new osg::Program::ProgramBinary();
+    binary->allocate(size);
+    in.read(reinterpret_cast<char*>(binary->getData()), size);
+    if ((unsigned)in.gcount() != size)
+        return false;
+
+    binary->setFormat((GLenum)format);
+    program->setProgramBinary(binary.get());
+
+    OE_DEBUG << LC << "Loaded binary for program \"" << program->getName() << "\" (" << key << ")" << std::endl;
+    return true;
+}
+
+bool
+ProgramBinaryCache::store(osg::Program* program, osg::State& state)
+{
+    if (!_enabled || !program || program->getNumShaders() == 0 || program->getProgramBinary())
+        return false;
+
+    osg::Program::PerContextProgram* pcp;
+#if OSG_VERSION_GREATER_OR_EQUAL(3,3,4)
+    pcp = program->getPCP( state );
+#else
+    pcp = program->getPCP( state.getContextID() );
+#endif
+    if (!pcp || !pcp->isLinked())
+        return false;
+
+    // Query the driver directly; PerContextProgram::compileProgramBinary
+    // would re-link the program first.
+    const osg::GL2Extensions* extensions = osg::GL2Extensions::Get(state.getContextID(), true);
+    GLint length = 0;
+    extensions->glGetProgramiv(pcp->getHandle(), GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return false;
+
+    osg::ref_ptr<osg::Program::ProgramBinary> binary = new osg::Program::ProgramBinary();
+    binary->allocate(length);
+    GLenum format = 0;
+    extensions->glGetProgramBinary(pcp->getHandle(), length, 0L, &format, reinterpret_cast<GLvoid*>(binary->getData()));
+    binary->setFormat(format);
+
+    return store(program, binary.get());
+}
+
+bool
+ProgramBinaryCache::store(osg::Program* program, osg::Program::ProgramBinary* binary)
+{
+    if (!_enabled || !program || !binary || binary->getSize() == 0u)
+        return false;
+
+    std::string key = makeKey(program);
+    std::string fileName = makeFileName(key);
+    std::string tempName = fileName + ".tmp";
+
+    Threading::ScopedMutexLock lock(_mutex);
+    {
+        std::ofstream out(tempName.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!out.is_open())
+        {
+            OE_WARN << LC << "Failed to write \"" << tempName << "\"" << std::endl;
+            return false;
+        }
+
+        unsigned version = BINARY_FILE_VERSION;
+        unsigned fmt = (unsigned)binary->getFormat();
+        unsigned size = binary->getSize();
+        out.write("OEPB", 4);
+        out.write(reinterpret_cast<const char*>(&version), sizeof(version));
+        writeString(out, _identity);
+        writeString(out, key);
+        out.write(reinterpret_cast<const char*>(&fmt), sizeof(fmt));
+        out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+        out.write(reinterpret_cast<const char*>(binary->getData()), size);
+        if (!out.good())
+        {
+            out.close();
+            ::remove(tempName.c_str());
+            return false;
+        }
+    }
+
+    // Write-then-rename so another process never reads a partial file.
+    ::remove(fileName.c_str());
+    if (::rename(tempName.c_str(), fileName.c_str()) != 0)
+    {
+        ::remove(tempName.c_str());
+        return false;
+    }
+
+    // Keep the binary on the program so other contexts can link from it.
+    program->setProgramBinary(binary);
+
+    OE_DEBUG << LC << "Stored binary for program \"" << program->getName() << "\" (" << key << ")" << std::endl;
+    return true;
+}
+
+void
+ProgramBinaryCache::discard(osg::Program* program)
+{
+    if (!program || !program->getProgramBinary())
+        return;
+
+    if (_enabled)
+    {
+        std::string key = makeKey(program);
+        Threading::ScopedMutexLock lock(_mutex);
+        ::remove(makeFileName(key).c_str());
+    }
+
+    program->setProgramBinary(0L);
+    program->dirtyProgram();
+
+    OE_INFO << LC << "Discarded stale binary for program \"" << program->getName() << "\"" << std::endl;
+}
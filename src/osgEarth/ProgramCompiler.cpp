@@ -0,0 +1,436 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2016 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/ProgramCompiler>
+#include <osgEarth/ProgramBinaryCache>
+#include <osgEarth/Registry>
+#include <osgEarth/Capabilities>
+#include <osgEarth/Notify>
+#include <osg/GL2Extensions>
+#include <osg/GLExtensions>
+#include <osg/Geode>
+#include <osg/NodeVisitor>
+#include <osg/Version>
+#include <cstdlib>
+
+using namespace osgEarth;
+
+#define LC "[ProgramCompiler] "
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+
+#ifndef GL_APIENTRY
+#define GL_APIENTRY APIENTRY
+#endif
+
+namespace
+{
+    typedef void (GL_APIENTRY * MaxShaderCompilerThreadsProc)(GLuint count);
+}
+
+//------------------------------------------------------------------------
+
+ProgramCompiler::ProgramCompiler() :
+_enabled( ::getenv(OSGEARTH_ENV_ASYNC_SHADER_COMPILE) != 0L )
+{
+    //nop
+}
+
+ProgramCompiler::PerContext&
+ProgramCompiler::getPerContext(osg::State& state)
+{
+    // ASSUME a lock on _mutex.
+    unsigned contextID = state.getContextID();
+    if (_contexts.size() <= contextID)
+        _contexts.resize(contextID + 1);
+
+    PerContext& pc = _contexts[contextID];
+    if (!pc._initialized)
+    {
+        pc._initialized = true;
+
+        // the finished link is handed to OSG as a binary, so we need both.
+        pc._supported =
+            Registry::capabilities().supportsProgramBinary() &&
+            (osg::isGLExtensionSupported(contextID, "GL_KHR_parallel_shader_compile") ||
+             osg::isGLExtensionSupported(contextID, "GL_ARB_parallel_shader_compile"));
+
+        if (pc._supported)
+        {
+            // let the driver use as many compiler threads as it likes.
+            MaxShaderCompilerThreadsProc maxThreads = (MaxShaderCompilerThreadsProc)osg::getGLExtensionFuncPtr(
+                "glMaxShaderCompilerThreadsKHR", "glMaxShaderCompilerThreadsARB");
+            if (maxThreads)
+                maxThreads(0xFFFFFFFF);
+        }
+
+        OE_INFO << LC << "Background shader compilation on context " << contextID << " = "
+            << (pc._supported ? "yes" : "no") << std::endl;
+    }
+    return pc;
+}
+
+bool
+ProgramCompiler::isSupported(osg::State& state)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    return getPerContext(state)._supported;
+}
+
+unsigned
+ProgramCompiler::getNumPending(unsigned contextID) const
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    return contextID < _contexts.size() ? _contexts[contextID]._jobs.size() : 0u;
+}
+
+bool
+ProgramCompiler::canCompile(const osg::Program* program) const
+{
+    if (program->getNumShaders() == 0)
+        return false;
+
+    for (unsigned i = 0; i < program->getNumShaders(); ++i)
+    {
+        // OSG injects state-dependent #defines into these at compile time;
+        // we can't reproduce that here, so let OSG build them.
+        const std::string& source = program->getShader(i)->getShaderSource();
+        if (source.find("#pragma import_defines") != std::string::npos ||
+            source.find("#pragma requires") != std::string::npos)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool
+ProgramCompiler::start(Job& job, osg::State& state)
+{
+    const osg::GL2Extensions* ext = osg::GL2Extensions::Get(state.getContextID(), true);
+    const osg::Program* program = job._program.get();
+
+    job._handle = ext->glCreateProgram();
+    if (job._handle == 0)
+        return false;
+
+    // with KHR_parallel_shader_compile none of these calls block as long
+    // as we don't query status before the driver is done.
+    for (unsigned i = 0; i < program->getNumShaders(); ++i)
+    {
+        const osg::Shader* shader = program->getShader(i);
+
+        std::string source = shader->getShaderSource();
+        if (shader->getType() == osg::Shader::VERTEX && state.getUseVertexAttributeAliasing())
+        {
+            state.convertVertexShaderSourceToOsgBuiltIns(source);
+        }
+
+        GLuint handle = ext->glCreateShader(shader->getType());
+        const GLchar* text = source.c_str();
+        ext->glShaderSource(handle, 1, &text, 0L);
+        ext->glCompileShader(handle);
+        ext->glAttachShader(job._handle, handle);
+        job._shaders.push_back(handle);
+    }
+
+    // locations are baked into the binary, so match what OSG would bind.
+    const osg::Program::AttribBindingList& attribs = program->getAttribBindingList();
+    for (osg::Program::AttribBindingList::const_iterator i = attribs.begin(); i != attribs.end(); ++i)
+    {
+        ext->glBindAttribLocation(job._handle, i->second, reinterpret_cast<const GLchar*>(i->first.c_str()));
+    }
+
+    const osg::Program::FragDataBindingList& frags = program->getFragDataBindingList();
+    for (osg::Program::FragDataBindingList::const_iterator i = frags.begin(); i != frags.end(); ++i)
+    {
+        ext->glBindFragDataLocation(job._handle, i->second, reinterpret_cast<const GLchar*>(i->first.c_str()));
+    }
+
+    ext->glProgramParameteri(job._handle, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    ext->glLinkProgram(job._handle);
+    return true;
+}
+
+bool
+ProgramCompiler::finish(Job& job, osg::State& state)
+{
+    const osg::GL2Extensions* ext = osg::GL2Extensions::Get(state.getContextID(), true);
+
+    GLint linked = GL_FALSE;
+    ext->glGetProgramiv(job._handle, GL_LINK_STATUS, &linked);
+    if (linked != GL_TRUE)
+    {
+        // OSG will link the program from source and report the errors.
+        return false;
+    }
+
+    GLint length = 0;
+    ext->glGetProgramiv(job._handle, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return false;
+
+    osg::ref_ptr<osg::Program::ProgramBinary> binary = new osg::Program::ProgramBinary();
+    binary->allocate(length);
+    GLenum format = 0;
+    ext->glGetProgramBinary(job._handle, length, 0L, &format, reinterpret_cast<GLvoid*>(binary->getData()));
+    binary->setFormat(format);
+
+    job._program->setProgramBinary(binary.get());
+    Registry::instance()->getProgramBinaryCache()->store(job._program.get(), binary.get());
+    return true;
+}
+
+void
+ProgramCompiler::destroy(Job& job, osg::State& state)
+{
+    const osg::GL2Extensions* ext = osg::GL2Extensions::Get(state.getContextID(), true);
+
+    for (unsigned i = 0; i < job._shaders.size(); ++i)
+    {
+        if (job._handle != 0)
+            ext->glDetachShader(job._handle, job._shaders[i]);
+        ext->glDeleteShader(job._shaders[i]);
+    }
+    job._shaders.clear();
+
+    if (job._handle != 0)
+    {
+        ext->glDeleteProgram(job._handle);
+        job._handle = 0;
+    }
+}
+
+ProgramCompiler::Status
+ProgramCompiler::compile(osg::Program* program, osg::State& state)
+{
+    if (!_enabled || !program || program->getProgramBinary())
+        return READY;
+
+    Threading::ScopedMutexLock lock(_mutex);
+
+    PerContext& pc = getPerContext(state);
+    if (!pc._supported)
+        return READY;
+
+    JobMap::iterator i = pc._jobs.find(program);
+    if (i == pc._jobs.end())
+    {
+        if (!canCompile(program))
+            return READY;
+
+        Job& job = pc._jobs[program];
+        job._program = program;
+        job._handle = 0;
+        if (!start(job, state))
+        {
+            destroy(job, state);
+            pc._jobs.erase(program);
+            return READY;
+        }
+
+        OE_DEBUG << LC << "Started background compile of \"" << program->getName() << "\"" << std::endl;
+        return PENDING;
+    }
+
+    Job& job = i->second;
+
+    const osg::GL2Extensions* ext = osg::GL2Extensions::Get(state.getContextID(), true);
+    GLint done = GL_FALSE;
+    ext->glGetProgramiv(job._handle, GL_COMPLETION_STATUS_KHR, &done);
+    if (done != GL_TRUE)
+        return PENDING;
+
+    if (finish(job, state))
+    {
+        OE_DEBUG << LC << "Finished background compile of \"" << program->getName() << "\"" << std::endl;
+    }
+
+    destroy(job, state);
+    pc._jobs.erase(i);
+    return READY;
+}
+
+void
+ProgramCompiler::releaseGLObjects(osg::State* state)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+
+    if (!state)
+    {
+        // no context current; the GL objects go away with their contexts.
+        for (unsigned i = 0; i < _contexts.size(); ++i)
+            _contexts[i]._jobs.clear();
+        return;
+    }
+
+    if (state->getContextID() < _contexts.size())
+    {
+        JobMap& jobs = _contexts[state->getContextID()]._jobs;
+        for (JobMap::iterator i = jobs.begin(); i != jobs.end(); ++i)
+            destroy(i->second, *state);
+        jobs.clear();
+    }
+}
+
+//------------------------------------------------------------------------
+
+namespace
+{
+    // Records the stack of statesets leading to every drawable in a graph.
+    struct CollectPermutations : public osg::NodeVisitor
+    {
+        CollectPermutations(PrewarmProgramsOperation* op) :
+            osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN),
+            _op(op)
+        {
+            setNodeMaskOverride(~0);
+        }
+
+        void apply(osg::Node& node)
+        {
+#if OSG_VERSION_GREATER_OR_EQUAL(3,3,2)
+            if (node.asDrawable())
+            {
+                record(node.getStateSet());
+                return;
+            }
+#endif
+            if (node.getStateSet())
+                _stack.push_back(node.getStateSet());
+
+            traverse(node);
+
+            if (node.getStateSet())
+                _stack.pop_back();
+        }
+
+        void apply(osg::Geode& geode)
+        {
+            if (geode.getStateSet())
+                _stack.push_back(geode.getStateSet());
+
+            for (unsigned i = 0; i < geode.getNumDrawables(); ++i)
+            {
+                record(geode.getDrawable(i)->getStateSet());
+            }
+
+            if (geode.getStateSet())
+                _stack.pop_back();
+        }
+
+        void record(const osg::StateSet* drawableStateSet)
+        {
+            if (drawableStateSet)
+                _stack.push_back(drawableStateSet);
+
+            if (!_stack.empty())
+                _op->addPermutation(_stack);
+
+            if (drawableStateSet)
+                _stack.pop_back();
+        }
+
+        PrewarmProgramsOperation*               _op;
+        PrewarmProgramsOperation::StateSetStack _stack;
+    };
+}
+
+PrewarmProgramsOperation::PrewarmProgramsOperation() :
+osg::GraphicsOperation("osgEarth::PrewarmProgramsOperation", false)
+{
+    //nop
+}
+
+void
+PrewarmProgramsOperation::addPermutation(const StateSetStack& stack)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    _permutations.insert(stack);
+}
+
+void
+PrewarmProgramsOperation::addPermutation(const osg::NodePath& path)
+{
+    StateSetStack stack;
+    for (osg::NodePath::const_iterator i = path.begin(); i != path.end(); ++i)
+    {
+        if ((*i)->getStateSet())
+            stack.push_back((*i)->getStateSet());
+    }
+
+    if (!stack.empty())
+        addPermutation(stack);
+}
+
+void
+PrewarmProgramsOperation::addPermutations(osg::Node* graph)
+{
+    if (graph)
+    {
+        CollectPermutations collector(this);
+        graph->accept(collector);
+    }
+}
+
+void
+PrewarmProgramsOperation::operator()(osg::GraphicsContext* gc)
+{
+    osg::State* state = gc ? gc->getState() : 0L;
+    if (!state)
+        return;
+
+    std::set<StateSetStack> permutations;
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+        permutations.swap(_permutations);
+    }
+
+    // Applying each stack runs its VirtualPrograms just as drawing would,
+    // which builds, links and caches their programs.
+    for (std::set<StateSetStack>::const_iterator p = permutations.begin(); p != permutations.end(); ++p)
+    {
+        for (StateSetStack::const_iterator i = p->begin(); i != p->end(); ++i)
+        {
+            state->pushStateSet(i->get());
+        }
+        state->apply();
+        state->popAllStateSets();
+    }
+
+    // restore the default state for the first real frame.
+    state->apply();
+
+    const osg::GL2Extensions* extensions = osg::GL2Extensions::Get(state->getContextID(), true);
+    extensions->glUseProgram(0);
+    state->setLastAppliedProgramObject(0L);
+
+    OE_INFO << LC << "Prewarmed " << permutations.size() << " program permutations on context "
+        << state->getContextID() << std::endl;
+}
@@ -21,8 +21,12 @@
 #include <osgEarth/Cube>
 #include <osgEarth/ShaderFactory>
 #include <osgEarth/TaskService>
+#include <osgEarth/JobScheduler>
+#include <osgEarth/ProgramBinaryCache>
+#include <osgEarth/ProgramCompiler>
 #include <osgEarth/TerrainEngineNode>
 #include <osgEarth/ObjectIndex>
+#include <osgEarth/Text>
 
 #include <osgText/Font>
 
@@ -144,15 +148,6 @@ _devicePixelRatio(1.0f)
 #endif
     }
 
-#if OSG_VERSION_LESS_THAN(3,5,8)
-    if ( _defaultFont.valid() )
-    {
-        // mitigates mipmapping issues that cause rendering artifacts
-        // for some fonts/placement
-        _defaultFont->setGlyphImageMargin( 2 );
-    }
-#endif
-
     // register the system stock Units.
     Units::registerAll( this );
 }
@@ -160,9 +155,10 @@ _devicePixelRatio(1.0f)
 Registry::~Registry()
 {
     OE_DEBUG << LC << "Registry shutting down...\n";
-    _srsMutex.lock();
-    _srsCache.clear();
-    _srsMutex.unlock();
+    {
+        Threading::ScopedWriteLock exclusive(_srsMutex);
+        _srsCache.clear();
+    }
     _global_geodetic_profile = 0L;
     _spherical_mercator_profile = 0L;
     _cube_profile = 0L;
@@ -285,25 +281,27 @@ Registry::getNamedProfile( const std::string& name ) const
 SpatialReference*
 Registry::getOrCreateSRS(const SpatialReference::Key& key)
 {
-    Threading::ScopedMutexLock exclusiveLock(_srsMutex);
-    
-    SpatialReference* srs;
+    {
+        Threading::ScopedReadLock shared(_srsMutex);
+        SRSCache::const_iterator i = _srsCache.find(key);
+        if (i != _srsCache.end())
+            return i->second.get();
+    }
+
+    // Create outside the lock so a slow SRS doesn't block every other lookup.
+    osg::ref_ptr<SpatialReference> srs = SpatialReference::create(key);
 
+    Threading::ScopedWriteLock exclusive(_srsMutex);
+
+    // another thread may have beaten us to it.
     SRSCache::iterator i = _srsCache.find(key);
     if (i != _srsCache.end())
-    {
-        srs = i->second.get();
-    }
-    else
-    {
-        srs = SpatialReference::create(key);
-        if (srs)
-        {
-            _srsCache[key] = srs;
-        }
-    }
+        return i->second.get();
+
+    if (srs.valid())
+        _srsCache[key] = srs.get();
 
-    return srs;
+    return srs.release();
 }
 
 void
@@ -552,8 +550,15 @@ Registry::setDefaultFont( osgText::Font* font )
 osgText::Font*
 Registry::getDefaultFont()
 {
-    Threading::ScopedMutexLock shared(_regMutex);
-    return _defaultFont.get();
+    osgText::Font* font = 0L;
+    {
+        Threading::ScopedMutexLock shared(_regMutex);
+        font = _defaultFont.get();
+    }
+
+    // not in the constructor, since this can create a VirtualProgram.
+    Text::prepareFont(font);
+    return font;
 }
 
 UID
@@ -635,12 +640,57 @@ Registry::getStateSetCache() const
     return _stateSetCache.get();
 }
 
+JobScheduler*
+Registry::getJobScheduler() const
+{
+    if (!_jobScheduler.valid())
+    {
+        Threading::ScopedMutexLock lock(_regMutex);
+        if (!_jobScheduler.valid())
+        {
+            // thread count comes from OSGEARTH_NUM_JOB_THREADS, or the
+            // number of processors by default.
+            _jobScheduler = new JobScheduler("osgEarth", 0);
+        }
+    }
+    return _jobScheduler.get();
+}
+
 ProgramSharedRepo*
 Registry::getProgramSharedRepo()
 {
     return &_programRepo;
 }
 
+ProgramBinaryCache*
+Registry::getProgramBinaryCache() const
+{
+    if (!_programBinaryCache.valid())
+    {
+        Threading::ScopedMutexLock lock(_regMutex);
+        if (!_programBinaryCache.valid())
+        {
+            const char* path = ::getenv(OSGEARTH_ENV_PROGRAM_BINARY_CACHE);
+            _programBinaryCache = new ProgramBinaryCache(path ? std::string(path) : std::string());
+        }
+    }
+    return _programBinaryCache.get();
+}
+
+ProgramCompiler*
+Registry::getProgramCompiler() const
+{
+    if (!_programCompiler.valid())
+    {
+        Threading::ScopedMutexLock lock(_regMutex);
+        if (!_programCompiler.valid())
+        {
+            _programCompiler = new ProgramCompiler();
+        }
+    }
+    return _programCompiler.get();
+}
+
 ObjectIndex*
 Registry::getObjectIndex() const
 {
@@ -44,7 +44,15 @@ ResourceReleaser::push(osg::Object* object)
 {
     Threading::ScopedMutexLock lock(_mutex);
 
-    _toRelease.push_back(object);
+    if (_toReleasePerContext.empty())
+    {
+        _toRelease.push_back(object);
+    }
+    else
+    {
+        for (ObjectListPerContext::iterator i = _toReleasePerContext.begin(); i != _toReleasePerContext.end(); ++i)
+            i->second.push_back(object);
+    }
 }
 
 void
@@ -52,15 +60,37 @@ ResourceReleaser::push(const ObjectList& objects)
 {
     Threading::ScopedMutexLock lock(_mutex);
 
-    _toRelease.reserve(_toRelease.size() + objects.size());
-    for (unsigned i = 0; i<objects.size(); ++i)
-        _toRelease.push_back(objects[i].get());
+    if (_toReleasePerContext.empty())
+    {
+        _toRelease.insert(_toRelease.end(), objects.begin(), objects.end());
+    }
+    else
+    {
+        for (ObjectListPerContext::iterator i = _toReleasePerContext.begin(); i != _toReleasePerContext.end(); ++i)
+            i->second.insert(i->second.end(), objects.begin(), objects.end());
+    }
 }
 
 void
 ResourceReleaser::drawImplementation(osg::RenderInfo& ri) const
 {
-    releaseGLObjects(ri.getState());
+    osg::State* state = ri.getState();
+    if (!state)
+        return;
+
+    Threading::ScopedMutexLock lock(_mutex);
+
+    ObjectListPerContext::iterator i = _toReleasePerContext.find(state->getContextID());
+    if (i == _toReleasePerContext.end())
+    {
+        // first draw in this context. From now on every submission queues
+        // for it as well.
+        i = _toReleasePerContext.insert(std::make_pair(state->getContextID(), ObjectList())).first;
+        if (_toReleasePerContext.size() == 1u)
+            i->second.swap(_toRelease);
+    }
+
+    release(i->second, state);
 }
 
 void
@@ -68,19 +98,38 @@ ResourceReleaser::releaseGLObjects(osg::State* state) const
 {
     osg::Drawable::releaseGLObjects(state);
 
-    if (!_toRelease.empty())
+    Threading::ScopedMutexLock lock(_mutex);
+
+    if (state)
+    {
+        ObjectListPerContext::iterator i = _toReleasePerContext.find(state->getContextID());
+        if (i != _toReleasePerContext.end())
+            release(i->second, state);
+        else
+            release(_toRelease, state);
+    }
+    else
+    {
+        // every context:
+        release(_toRelease, state);
+        for (ObjectListPerContext::iterator i = _toReleasePerContext.begin(); i != _toReleasePerContext.end(); ++i)
+            release(i->second, state);
+        _toReleasePerContext.clear();
+    }
+}
+
+void
+ResourceReleaser::release(ObjectList& objects, osg::State* state) const
+{
+    if (!objects.empty())
     {
-        Threading::ScopedMutexLock lock(_mutex);
-        if (!_toRelease.empty())
+        METRIC_SCOPED("ResourceReleaser");
+        for (ObjectList::const_iterator i = objects.begin(); i != objects.end(); ++i)
         {
-            METRIC_SCOPED("ResourceReleaser");
-            for (ObjectList::const_iterator i = _toRelease.begin(); i != _toRelease.end(); ++i)
-            {
-                osg::Object* object = i->get();
-                object->releaseGLObjects(state);
-            }
-            OE_DEBUG << LC << "Released " << _toRelease.size() << " objects\n";
-            _toRelease.clear();
+            osg::Object* object = i->get();
+            object->releaseGLObjects(state);
         }
+        OE_DEBUG << LC << "Released " << objects.size() << " objects\n";
+        objects.clear();
     }
 }
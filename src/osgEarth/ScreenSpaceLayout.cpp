@@ -27,6 +27,7 @@
 #include <osgEarth/Registry>
 #include <osgEarthAnnotation/BboxDrawable>
 #include <osgText/Text>
+#include <algorithm>
 
 #define LC "[ScreenSpaceLayout] "
 
@@ -122,6 +123,45 @@ namespace
         }
     };
 
+    // Whether a drawable is a simple textured quad (like a PlaceNode icon) that
+    // the draw callback can merge into a batch together with other quads that
+    // share its state.
+    bool isBatchableQuad(const osg::Drawable* drawable)
+    {
+        const osg::Geometry* geom = drawable->asGeometry();
+        if (!geom || geom->getDrawCallback() || geom->getNumPrimitiveSets() != 1)
+            return false;
+
+        const osg::Vec3Array* verts = dynamic_cast<const osg::Vec3Array*>(geom->getVertexArray());
+        const osg::Vec2Array* tcs = dynamic_cast<const osg::Vec2Array*>(geom->getTexCoordArray(0));
+        if (!verts || !tcs || verts->size() != 4 || tcs->size() != 4 || geom->getNumTexCoordArrays() > 1)
+            return false;
+
+        const osg::Array* colors = geom->getColorArray();
+        if (colors && colors->getBinding() != osg::Array::BIND_OVERALL)
+            return false;
+
+        const osg::DrawElements* de = geom->getPrimitiveSet(0)->getDrawElements();
+        return de && de->getMode() == GL_TRIANGLES && de->getNumIndices() == 6;
+    }
+
+    struct IsNotBatchableQuad
+    {
+        bool operator()(const osgUtil::RenderLeaf* leaf) const
+        {
+            return !isBatchableQuad(leaf->getDrawable());
+        }
+    };
+
+    // groups leaves that share the same state so they can be batched.
+    struct SortByStateGraph
+    {
+        bool operator()(const osgUtil::RenderLeaf* lhs, const osgUtil::RenderLeaf* rhs) const
+        {
+            return lhs->_parent < rhs->_parent;
+        }
+    };
+
     // Data structure shared across entire layout system.
     struct ScreenSpaceLayoutContext : public osg::Referenced
     {
@@ -132,20 +172,141 @@ namespace
     // TODO: a way to clear out this list when drawables go away
     struct DrawableInfo
     {
-        DrawableInfo() : _lastAlpha(1.0f), _lastScale(1.0f), _frame(0u), _visible(true) { }
+        DrawableInfo() : _lastAlpha(1.0f), _lastScale(1.0f), _frame(0u), _visible(true),
+            _deferred(false), _blocker(0L), _usedPass(0u), _usedIndex(0u) { }
         float _lastAlpha, _lastScale;
         unsigned _frame;
         bool _visible;
+
+        // whether the overlap test was skipped (over budget) during the previous pass
+        bool _deferred;
+
+        // drawable that occluded this one during the previous pass (if any)
+        const osg::Drawable* _blocker;
+
+        // pass in which this drawable last reserved screen space, and the
+        // index of its box in the "used" list during that pass
+        unsigned _usedPass;
+        unsigned _usedIndex;
     };
 
     typedef std::map<const osg::Drawable*, DrawableInfo> DrawableMemory;
 
-    typedef std::pair<const osg::Node*, osg::BoundingBox> RenderLeafBox;
+    // maps a drawable parent to the last pass in which it was culled.
+    typedef std::map<const osg::Node*, unsigned> CulledParents;
+
+    // Screen-space box reserved by a drawable that passed the declutter test.
+    struct RenderLeafBox
+    {
+        RenderLeafBox(const osg::Node* parent, const osg::Drawable* drawable, const osg::BoundingBox& box)
+            : _parent(parent), _drawable(drawable), _box(box) { }
+        const osg::Node*     _parent;
+        const osg::Drawable* _drawable;
+        osg::BoundingBox     _box;
+
+        // true if the box overlaps this one and belongs to a different group
+        bool conflictsWith(const osg::BoundingBox& box, const osg::Node* parent) const
+        {
+            // only need a 2D test since we're in clip space
+            bool isClear =
+                box.xMin() > _box.xMax() ||
+                box.xMax() < _box.xMin() ||
+                box.yMin() > _box.yMax() ||
+                box.yMax() < _box.yMin();
+
+            // overlapping a sibling (same drawable parent) is acceptable.
+            return !isClear && parent != _parent;
+        }
+    };
+
+    typedef std::vector<RenderLeafBox> RenderLeafBoxList;
+
+    /**
+     * Uniform screen-space grid that buckets the boxes in a RenderLeafBoxList
+     * so that an overlap query only visits the boxes in nearby cells instead
+     * of every box placed so far. The cell vectors are kept from one pass to
+     * the next so they don't need to be re-allocated every frame.
+     */
+    struct DeclutterGrid
+    {
+        DeclutterGrid() : _cellSize(0u), _cols(0u), _rows(0u) { }
+
+        typedef std::vector<unsigned> Cell;
+
+        unsigned          _cellSize;
+        unsigned          _cols, _rows;
+        std::vector<Cell> _cells;
+
+        // prepare the grid for a new pass over a viewport of the given size.
+        void reset(unsigned cellSize, double width, double height)
+        {
+            unsigned cols = std::max(1u, (unsigned)ceil(width / (double)cellSize));
+            unsigned rows = std::max(1u, (unsigned)ceil(height / (double)cellSize));
+
+            if (cellSize != _cellSize || cols != _cols || rows != _rows)
+            {
+                _cellSize = cellSize;
+                _cols = cols;
+                _rows = rows;
+                _cells.resize(_cols * _rows);
+            }
+
+            for (std::vector<Cell>::iterator i = _cells.begin(); i != _cells.end(); ++i)
+                i->clear();
+        }
+
+        // range of cells covered by a box, clamped to the grid. Clamping keeps
+        // the mapping monotonic, so two overlapping boxes always share a cell.
+        void getRange(const osg::BoundingBox& box, unsigned& c0, unsigned& r0, unsigned& c1, unsigned& r1) const
+        {
+            c0 = clampCell(box.xMin(), _cols);
+            c1 = clampCell(box.xMax(), _cols);
+            r0 = clampCell(box.yMin(), _rows);
+            r1 = clampCell(box.yMax(), _rows);
+        }
+
+        unsigned clampCell(float v, unsigned count) const
+        {
+            int c = (int)floor(v / (float)_cellSize);
+            return c < 0 ? 0u : c >= (int)count ? count - 1u : (unsigned)c;
+        }
+
+        // returns the index of a box in "used" that conflicts with the input box,
+        // or -1 if the space is clear.
+        int findConflict(const osg::BoundingBox& box, const osg::Node* parent, const RenderLeafBoxList& used) const
+        {
+            unsigned c0, r0, c1, r1;
+            getRange(box, c0, r0, c1, r1);
+            for (unsigned r = r0; r <= r1; ++r)
+            {
+                for (unsigned c = c0; c <= c1; ++c)
+                {
+                    const Cell& cell = _cells[r*_cols + c];
+                    for (Cell::const_iterator i = cell.begin(); i != cell.end(); ++i)
+                    {
+                        if (used[*i].conflictsWith(box, parent))
+                            return (int)*i;
+                    }
+                }
+            }
+            return -1;
+        }
+
+        // registers the box at "index" in the "used" list.
+        void insert(const osg::BoundingBox& box, unsigned index)
+        {
+            unsigned c0, r0, c1, r1;
+            getRange(box, c0, r0, c1, r1);
+            for (unsigned r = r0; r <= r1; ++r)
+                for (unsigned c = c0; c <= c1; ++c)
+                    _cells[r*_cols + c].push_back(index);
+        }
+    };
 
     // Data structure stored one-per-View.
     struct PerCamInfo
     {
-        PerCamInfo() : _lastTimeStamp(0), _firstFrame(true) { }
+        PerCamInfo() : _lastTimeStamp(0), _firstFrame(true), _pass(0u), _nextMatrix(0u) { }
 
         // remembers the state of each drawable from the previous pass
         DrawableMemory _memory;
@@ -153,7 +314,46 @@ namespace
         // re-usable structures (to avoid unnecessary re-allocation)
         osgUtil::RenderBin::RenderLeafList _passed;
         osgUtil::RenderBin::RenderLeafList _failed;
-        std::vector<RenderLeafBox>         _used;
+        RenderLeafBoxList                  _used;
+        DeclutterGrid                      _grid;
+
+        // counts declutter passes, so we can tell whether a drawable's
+        // DrawableInfo::_usedIndex refers to the current pass
+        unsigned _pass;
+
+        // Parent nodes of drawables that are obscured (and culled). Drawables
+        // with the same parent node (typically a Geode) are considered to be grouped and
+        // will be culled as a group. Entries are stamped with the pass number instead
+        // of being cleared, so the map doesn't re-allocate its nodes every frame.
+        CulledParents _culledParents;
+
+        bool isCulled(const osg::Node* parent) const
+        {
+            CulledParents::const_iterator i = _culledParents.find(parent);
+            return i != _culledParents.end() && i->second == _pass;
+        }
+
+        // Pool of modelview matrices for the leaves we reposition. A matrix is
+        // only recycled once no render leaf refers to it any longer.
+        std::vector< osg::ref_ptr<osg::RefMatrix> > _matrices;
+        unsigned _nextMatrix;
+
+        osg::RefMatrix* allocateMatrix(const osg::Matrix& value)
+        {
+            for (; _nextMatrix < _matrices.size(); ++_nextMatrix)
+            {
+                osg::RefMatrix* m = _matrices[_nextMatrix].get();
+                if (m->referenceCount() == 1)
+                {
+                    ++_nextMatrix;
+                    m->set(value);
+                    return m;
+                }
+            }
+            _matrices.push_back(new osg::RefMatrix(value));
+            _nextMatrix = _matrices.size();
+            return _matrices.back().get();
+        }
 
         // time stamp of the previous pass, for calculating animation speed
         osg::Timer_t _lastTimeStamp;
@@ -188,6 +388,9 @@ void ScreenSpaceLayoutOptions::fromConfig(const Config& conf) {
     conf.getIfSet("right_margin", _rightMargin);
     conf.getIfSet("top_margin", _topMargin);
     conf.getIfSet("bottom_margin", _bottomMargin);
+    conf.getIfSet("grid_cell_size", _gridCellSize);
+    conf.getIfSet("max_declutter_tests", _maxDeclutterTests);
+    conf.getIfSet("batch_icons", _batchIcons);
 }
 
 Config ScreenSpaceLayoutOptions::getConfig() const {
@@ -205,6 +408,9 @@ Config ScreenSpaceLayoutOptions::getConfig() const {
     conf.addIfSet("right_margin", _rightMargin);
     conf.addIfSet("top_margin", _topMargin);
     conf.addIfSet("bottom_margin", _bottomMargin);
+    conf.addIfSet("grid_cell_size", _gridCellSize);
+    conf.addIfSet("max_declutter_tests", _maxDeclutterTests);
+    conf.addIfSet("batch_icons", _batchIcons);
     return conf;
 }
 
@@ -497,6 +703,8 @@ struct /*internal*/ DeclutterSort : public osgUtil::RenderBin::SortCallback {
         local._passed.clear();  // drawables that pass occlusion test
         local._failed.clear();  // drawables that fail occlusion test
         local._used.clear();    // list of occupied bounding boxes in screen space
+        ++local._pass;
+        local._nextMatrix = 0u;
 
         // compute a window matrix so we can do window-space culling. If this is an RTT camera
         // with a reference camera attachment, we actually want to declutter in the window-space
@@ -534,13 +742,21 @@ struct /*internal*/ DeclutterSort : public osgUtil::RenderBin::SortCallback {
         look = center - eye;
         look.normalize();
 
-        // Track the parent nodes of drawables that are obscured (and culled). Drawables
-        // with the same parent node (typically a Geode) are considered to be grouped and
-        // will be culled as a group.
-        std::set<const osg::Node*> culledParents;
+        // bucket the occupied boxes in a screen-space grid to speed up the
+        // overlap tests (unless disabled)
+        unsigned gridCellSize = options.gridCellSize().get();
+        bool useGrid = gridCellSize > 0u;
+        if (useGrid)
+            local._grid.reset(gridCellSize, refVP->width(), refVP->height());
 
         unsigned limit = *options.maxObjects();
 
+        // Number of full overlap tests we're allowed this pass. Once it runs out,
+        // the remaining (lowest priority) leaves keep the result of their previous pass,
+        // except the ones already deferred last pass, so nothing is deferred twice in a row.
+        unsigned testBudget = *options.maxDeclutterTests();
+        unsigned numTests = 0u;
+
         bool snapToPixel = options.snapToPixel() == true;
 
         osg::Matrix camVPW;
@@ -795,33 +1011,60 @@ struct /*internal*/ DeclutterSort : public osgUtil::RenderBin::SortCallback {
                 }
 
                 // if this leaf is already in a culled group, skip it.
-                else if ( culledParents.find(drawableParent) != culledParents.end() )
+                else if ( local.isCulled(drawableParent) )
                 {
                     visible = false;
                 }
 
+                // over budget: defer the test and keep the previous state. A leaf that
+                // stays visible still reserves its space so others will respect it.
+                else if ( numTests >= testBudget && !info._deferred )
+                {
+                    visible = info._visible && info._frame > 0u;
+                    info._deferred = true;
+                }
+
                 else
                 {
                     // weed out any drawables that are obscured by closer drawables.
-                    // TODO: think about a more efficient algorithm - right now we are just using
-                    // brute force to compare all bbox's
-                    for( std::vector<RenderLeafBox>::const_iterator j = local._used.begin(); j != local._used.end(); ++j )
+                    // Start with the drawable that obscured this one during the previous
+                    // pass: the layout is coherent from frame to frame, so the same
+                    // blocker usually rejects it again without a search.
+                    ++numTests;
+                    info._deferred = false;
+                    int conflict = -1;
+                    if (info._blocker)
+                    {
+                        DrawableMemory::const_iterator b = local._memory.find(info._blocker);
+                        if (b != local._memory.end() &&
+                            b->second._usedPass == local._pass &&
+                            local._used[b->second._usedIndex].conflictsWith(box, drawableParent))
+                        {
+                            conflict = (int)b->second._usedIndex;
+                        }
+                    }
+
+                    if (conflict < 0)
                     {
-                        // only need a 2D test since we're in clip space
-                        bool isClear =
-                            box.xMin() > j->second.xMax() ||
-                            box.xMax() < j->second.xMin() ||
-                            box.yMin() > j->second.yMax() ||
-                            box.yMax() < j->second.yMin();
-
-                        // if there's an overlap (and the conflict isn't from the same drawable
-                        // parent, which is acceptable), then the leaf is culled.
-                        if ( !isClear && drawableParent != j->first )
+                        if (useGrid)
+                        {
+                            conflict = local._grid.findConflict(box, drawableParent, local._used);
+                        }
+                        else
                         {
-                            visible = false;
-                            break;
+                            for (unsigned j = 0; j < local._used.size() && conflict < 0; ++j)
+                            {
+                                if (local._used[j].conflictsWith(box, drawableParent))
+                                    conflict = (int)j;
+                            }
                         }
                     }
+
+                    if (conflict >= 0)
+                    {
+                        visible = false;
+                        info._blocker = local._used[conflict]._drawable;
+                    }
                 }
             }
 
@@ -829,7 +1072,12 @@ struct /*internal*/ DeclutterSort : public osgUtil::RenderBin::SortCallback {
             {
                 // passed the test, so add the leaf's bbox to the "used" list, and add the leaf
                 // to the final draw list.
-                local._used.push_back( std::make_pair(drawableParent, box) );
+                info._blocker = 0L;
+                info._usedPass = local._pass;
+                info._usedIndex = local._used.size();
+                if (useGrid)
+                    local._grid.insert(box, info._usedIndex);
+                local._used.push_back( RenderLeafBox(drawableParent, drawable, box) );
                 local._passed.push_back( leaf );
             }
 
@@ -837,7 +1085,7 @@ struct /*internal*/ DeclutterSort : public osgUtil::RenderBin::SortCallback {
             {
                 // culled, so put the parent in the parents list so that any future leaves
                 // with the same parent will be trivially rejected
-                culledParents.insert( drawable->getParent(0) );
+                local._culledParents[drawable->getParent(0)] = local._pass;
                 if (!isViewCulled)
                     local._failed.push_back( leaf );
             }
@@ -863,9 +1111,8 @@ struct /*internal*/ DeclutterSort : public osgUtil::RenderBin::SortCallback {
                 }
 
                 // Leaf modelview matrixes are shared (by objects in the traversal stack) so we
-                // cannot just replace it unfortunately. Have to make a new one. Perhaps a nice
-                // allocation pool is in order here
-                leaf->_modelview = new osg::RefMatrix(newModelView);
+                // cannot just replace it unfortunately. Take a fresh one from the pool.
+                leaf->_modelview = local.allocateMatrix(newModelView);
             }
         }
 
@@ -879,7 +1126,7 @@ struct /*internal*/ DeclutterSort : public osgUtil::RenderBin::SortCallback {
                 osgUtil::RenderLeaf* leaf     = *i;
                 const osg::Drawable* drawable = leaf->getDrawable();
 
-                if ( culledParents.find( drawable->getParent(0) ) == culledParents.end() )
+                if ( !local.isCulled(drawable->getParent(0)) )
                 {
                     DrawableInfo& info = local._memory[drawable];
 
@@ -918,6 +1165,16 @@ struct /*internal*/ DeclutterSort : public osgUtil::RenderBin::SortCallback {
                 }
             }
 
+            // Gather the visible quads (icons) that share state at the end of the list, which
+            // is drawn first, so the draw callback can render each group in a single batch.
+            // Visible leaves don't overlap other groups so regrouping them is safe.
+            if ( options.batchIcons() == true )
+            {
+                osgUtil::RenderBin::RenderLeafList::iterator quads =
+                    std::stable_partition(leaves.begin(), leaves.end(), IsNotBatchableQuad());
+                std::stable_sort(quads, leaves.end(), SortByStateGraph());
+            }
+
             // next, go through the FAILED list and sort them into failure bins so we can draw
             // them using a different technique if necessary.
             for( osgUtil::RenderBin::RenderLeafList::const_iterator i=local._failed.begin(); i != local._failed.end(); ++i )
@@ -1009,6 +1266,8 @@ namespace
     {
         ScreenSpaceLayoutContext*                  _context;
         PerThread< osg::ref_ptr<osg::RefMatrix> > _ortho2D;
+        PerThread< osg::ref_ptr<osg::Geometry> >  _batch;
+        osg::ref_ptr<osg::RefMatrix>              _identity;
         osg::ref_ptr<osg::Uniform>                _fade;
 
         /**
@@ -1021,6 +1280,8 @@ namespace
             // create the fade uniform.
             _fade = new osg::Uniform( osg::Uniform::FLOAT, FADE_UNIFORM_NAME );
             _fade->set( 1.0f );
+
+            _identity = new osg::RefMatrix();
         }
 
         /**
@@ -1060,18 +1321,34 @@ namespace
             // render the list
             osgUtil::RenderBin::RenderLeafList& leaves = bin->getRenderLeafList();
 
+            bool batchIcons = _context->_options.batchIcons() == true;
+
             for(osgUtil::RenderBin::RenderLeafList::reverse_iterator rlitr = leaves.rbegin();
                 rlitr!= leaves.rend();
                 ++rlitr)
             {
                 osgUtil::RenderLeaf* rl = *rlitr;
 
-                osg::ref_ptr<osgEarth::Annotation::BboxDrawable> bboxDraw = dynamic_cast<osgEarth::Annotation::BboxDrawable*>(rl->_drawable.get());
-                osg::ref_ptr<osgText::Text> textDraw = dynamic_cast<osgText::Text*>(rl->_drawable.get());
-                if(bboxDraw.get())
-                    OE_DEBUG << "DRAW A BBOX\n";
-                if(textDraw.get())
-                    OE_DEBUG << "DRAW A TEXT \"" << textDraw.get()->getText().createUTF8EncodedString() << " \"\n";
+                // Merge a run of quads that share the same state into one draw.
+                // (The sort callback groups them together for us.)
+                if ( batchIcons && isBatchableQuad(rl->getDrawable()) )
+                {
+                    osgUtil::RenderBin::RenderLeafList::reverse_iterator last = rlitr;
+                    while (last+1 != leaves.rend() &&
+                           (*(last+1))->_parent == rl->_parent &&
+                           isBatchableQuad((*(last+1))->getDrawable()))
+                    {
+                        ++last;
+                    }
+
+                    if ( last != rlitr )
+                    {
+                        renderBatch( rlitr, last+1, renderInfo, previous );
+                        rlitr = last;
+                        previous = *last;
+                        continue;
+                    }
+                }
 
                 renderLeaf( rl, renderInfo, previous );
                 previous = rl;
@@ -1084,24 +1361,14 @@ namespace
         }
 
         /**
-         * Renders a single leaf. We already applied the projection matrix, so here we only
-         * need to apply a modelview matrix that specifies the ortho offset of the drawable.
-         *
-         * Most of this code is copied from RenderLeaf::draw() -- but I removed all the code
-         * dealing with nested bins, since decluttering does not support them.
+         * Applies the state of a leaf (relative to the previously rendered leaf) along
+         * with the given modelview matrix and the fade uniform.
          */
-        void renderLeaf( osgUtil::RenderLeaf* leaf, osg::RenderInfo& renderInfo, osgUtil::RenderLeaf*& previous )
+        void applyLeafState( osgUtil::RenderLeaf* leaf, osg::RefMatrix* modelview, osg::RenderInfo& renderInfo, osgUtil::RenderLeaf* previous )
         {
             osg::State& state = *renderInfo.getState();
 
-            // don't draw this leaf if the abort rendering flag has been set.
-            if (state.getAbortRendering())
-            {
-                //cout << "early abort"<<endl;
-                return;
-            }
-
-            state.applyModelViewMatrix( leaf->_modelview.get() );
+            state.applyModelViewMatrix( modelview );
 
             if (previous)
             {
@@ -1144,6 +1411,27 @@ namespace
                 _fade->set( s_declutteringEnabledGlobally ? leaf->_depth : 1.0f );
                 pcp->apply( *_fade.get() );
             }
+        }
+
+        /**
+         * Renders a single leaf. We already applied the projection matrix, so here we only
+         * need to apply a modelview matrix that specifies the ortho offset of the drawable.
+         *
+         * Most of this code is copied from RenderLeaf::draw() -- but I removed all the code
+         * dealing with nested bins, since decluttering does not support them.
+         */
+        void renderLeaf( osgUtil::RenderLeaf* leaf, osg::RenderInfo& renderInfo, osgUtil::RenderLeaf*& previous )
+        {
+            osg::State& state = *renderInfo.getState();
+
+            // don't draw this leaf if the abort rendering flag has been set.
+            if (state.getAbortRendering())
+            {
+                //cout << "early abort"<<endl;
+                return;
+            }
+
+            applyLeafState( leaf, leaf->_modelview.get(), renderInfo, previous );
 
             // draw the drawable
             leaf->_drawable->draw(renderInfo);
@@ -1153,6 +1441,75 @@ namespace
                 state.decrementDynamicObjectCount();
             }
         }
+
+        /**
+         * Renders a run of textured quads that share the same state with a single
+         * draw call. The quad vertices are transformed into window space on the CPU
+         * and written into a shared vertex buffer that is drawn with an identity
+         * modelview matrix.
+         */
+        void renderBatch(
+            osgUtil::RenderBin::RenderLeafList::reverse_iterator first,
+            osgUtil::RenderBin::RenderLeafList::reverse_iterator last,
+            osg::RenderInfo& renderInfo,
+            osgUtil::RenderLeaf* previous )
+        {
+            osg::State& state = *renderInfo.getState();
+
+            if (state.getAbortRendering())
+                return;
+
+            osg::ref_ptr<osg::Geometry>& batch = _batch.get();
+            if ( !batch.valid() )
+            {
+                batch = new osg::Geometry();
+                batch->setUseVertexBufferObjects(true);
+                batch->setUseDisplayList(false);
+                batch->setDataVariance(osg::Object::DYNAMIC);
+                batch->setVertexArray(new osg::Vec3Array());
+                batch->setTexCoordArray(0, new osg::Vec2Array());
+                osg::Vec4Array* colors = new osg::Vec4Array(osg::Array::BIND_OVERALL, 1);
+                (*colors)[0].set(1.0f, 1.0f, 1.0f, 1.0f);
+                batch->setColorArray(colors);
+                batch->addPrimitiveSet(new osg::DrawArrays(GL_TRIANGLES, 0, 0));
+            }
+
+            osg::Vec3Array* verts = static_cast<osg::Vec3Array*>(batch->getVertexArray());
+            osg::Vec2Array* tcs = static_cast<osg::Vec2Array*>(batch->getTexCoordArray(0));
+            verts->clear();
+            tcs->clear();
+
+            for(osgUtil::RenderBin::RenderLeafList::reverse_iterator i = first; i != last; ++i)
+            {
+                osgUtil::RenderLeaf* leaf = *i;
+                const osg::Geometry* geom = leaf->getDrawable()->asGeometry();
+                const osg::Vec3Array* leafVerts = static_cast<const osg::Vec3Array*>(geom->getVertexArray());
+                const osg::Vec2Array* leafTCs = static_cast<const osg::Vec2Array*>(geom->getTexCoordArray(0));
+                const osg::DrawElements* de = geom->getPrimitiveSet(0)->getDrawElements();
+                const osg::Matrix& mvm = *leaf->_modelview.get();
+
+                for(unsigned k = 0; k < de->getNumIndices(); ++k)
+                {
+                    unsigned index = de->index(k);
+                    verts->push_back( (*leafVerts)[index] * mvm );
+                    tcs->push_back( (*leafTCs)[index] );
+                }
+
+                if (leaf->_dynamic)
+                {
+                    state.decrementDynamicObjectCount();
+                }
+            }
+
+            verts->dirty();
+            tcs->dirty();
+            static_cast<osg::DrawArrays*>(batch->getPrimitiveSet(0))->setCount(verts->size());
+            batch->dirtyBound();
+
+            applyLeafState( *first, _identity.get(), renderInfo, previous );
+
+            batch->draw(renderInfo);
+        }
     };
 }
 
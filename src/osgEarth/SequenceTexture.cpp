@@ -0,0 +1,173 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2016 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/SequenceTexture>
+#include <osgEarth/Notify>
+#include <cfloat>
+#include <cmath>
+
+#define LC "[SequenceTexture] "
+
+using namespace osgEarth;
+
+SequenceTexture::SequenceTexture(const osg::Texture* source, unsigned lookahead) :
+osg::Texture2DArray(),
+_slice( 0 )
+{
+    osg::Image* image = source ? const_cast<osg::Image*>(source->getImage(0)) : 0L;
+    _sequence = dynamic_cast<osg::ImageSequence*>(image);
+
+    unsigned slices = osg::minimum(lookahead + 1u, getNumFrames());
+    _frames.assign(slices, -1);
+    _images.assign(slices, (const osg::Image*)0L);
+
+    if (source)
+    {
+        setWrap(WRAP_S, source->getWrap(WRAP_S));
+        setWrap(WRAP_T, source->getWrap(WRAP_T));
+        setFilter(MIN_FILTER, source->getFilter(MIN_FILTER));
+        setFilter(MAG_FILTER, source->getFilter(MAG_FILTER));
+        setMaxAnisotropy(source->getMaxAnisotropy());
+        setInternalFormatMode(source->getInternalFormatMode());
+        setResizeNonPowerOfTwoHint(false);
+    }
+
+    osg::Image* first = _sequence.valid() ? getFrameImage(0u) : image;
+    if (first)
+    {
+        setTextureSize(first->s(), first->t(), slices);
+    }
+
+    if (_sequence.valid())
+    {
+        setFrame(0u);
+    }
+    else if (image)
+    {
+        setImage(0, image);
+        _frames[0] = 0;
+        _images[0] = image;
+    }
+}
+
+unsigned
+SequenceTexture::getNumFrames() const
+{
+    if (!_sequence.valid())
+        return 1u;
+
+#if OSG_VERSION_LESS_THAN(3,1,4)
+    unsigned num = _sequence->getNumImages();
+#else
+    unsigned num = _sequence->getNumImageData();
+#endif
+    return osg::maximum(num, 1u);
+}
+
+osg::Image*
+SequenceTexture::getFrameImage(unsigned frame) const
+{
+    if (!_sequence.valid() || frame >= getNumFrames())
+        return 0L;
+
+    return _sequence->getImage(frame);
+}
+
+bool
+SequenceTexture::setFrame(unsigned frame)
+{
+    if (!_sequence.valid())
+        return false;
+
+    unsigned numFrames = getNumFrames();
+    unsigned numSlices = _frames.size();
+    frame = frame % numFrames;
+
+    // the window: this frame and the ones after it, wrapping around.
+    std::vector<bool> keep(numSlices, false);
+    for (unsigned i = 0; i < numSlices; ++i)
+    {
+        int f = (int)((frame + i) % numFrames);
+        for (unsigned s = 0; s < numSlices; ++s)
+            if (_frames[s] == f)
+                keep[s] = true;
+    }
+
+    bool changed = false;
+
+    for (unsigned i = 0; i < numSlices; ++i)
+    {
+        int f = (int)((frame + i) % numFrames);
+        osg::Image* image = getFrameImage(f);
+
+        // find the slice holding this frame, or one holding a frame that
+        // fell out of the window:
+        int slice = -1;
+        for (unsigned s = 0; s < numSlices && slice < 0; ++s)
+            if (_frames[s] == f)
+                slice = s;
+        for (unsigned s = 0; s < numSlices && slice < 0; ++s)
+            if (!keep[s])
+                slice = s;
+
+        if (slice < 0)
+            continue;
+
+        keep[slice] = true;
+
+        if (image && (_frames[slice] != f || _images[slice] != image))
+        {
+            setImage(slice, image);
+            _frames[slice] = f;
+            _images[slice] = image;
+            changed = true;
+        }
+
+        if (i == 0u)
+            _slice = slice;
+    }
+
+    return changed;
+}
+
+bool
+SequenceTexture::update(const osg::FrameStamp* fs)
+{
+    if (!_sequence.valid() || !fs)
+        return false;
+
+    if (_sequence->getStatus() != osg::ImageStream::PLAYING)
+        return setFrame(_frames[_slice] >= 0 ? (unsigned)_frames[_slice] : 0u);
+
+    double length = _sequence->getLength();
+    if (length <= 0.0)
+        return false;
+
+    double reference = _sequence->getReferenceTime();
+    if (reference == DBL_MAX)
+        reference = 0.0;
+
+    double t = fmod((fs->getSimulationTime() - reference) * _sequence->getTimeMultiplier(), length);
+    if (t < 0.0)
+        t += length;
+
+    unsigned numFrames = getNumFrames();
+    unsigned frame = osg::minimum((unsigned)(t / length * (double)numFrames), numFrames - 1u);
+
+    return setFrame(frame);
+}
@@ -26,6 +26,7 @@
 #include <osgEarth/Shaders>
 #include <osgEarth/GLUtils>
 #include <osgEarth/Lighting>
+#include <osgEarth/ThreadingUtils>
 
 #include <osg/PagedLOD>
 #include <osg/ProxyNode>
@@ -314,6 +315,84 @@ namespace
             return node->getOrCreateStateSet();
         }
     }
+
+    // Entries the result cache may hold before it starts over.
+    #define MAX_CACHED_RESULTS 4096u
+
+    /**
+     * Generated state, keyed by the input state it came from, and shared by
+     * every generator (the Registry runs a fresh copy of its generator on
+     * each graph, so the cache can't belong to an instance).
+     */
+    struct ResultCache
+    {
+        enum Kind { GEOMETRY, TEXT };
+
+        struct Key
+        {
+            unsigned                          _hash;
+            int                               _kind;
+            std::string                       _name;
+            osg::ref_ptr<const osg::StateSet> _original;
+            osg::ref_ptr<osg::StateSet>       _current;
+
+            Key(int kind, const std::string& name, const osg::StateSet* original, osg::StateSet* current) :
+                _kind(kind), _name(name), _original(original), _current(current)
+            {
+                _hash = StateSetCache::hash(original) * 31u + StateSetCache::hash(current);
+            }
+
+            bool operator < (const Key& rhs) const
+            {
+                if (_hash != rhs._hash) return _hash < rhs._hash;
+                if (_kind != rhs._kind) return _kind < rhs._kind;
+                if (_name != rhs._name) return _name < rhs._name;
+                if (_original.get() != rhs._original.get())
+                {
+                    if (!_original.valid() || !rhs._original.valid())
+                        return !_original.valid();
+                    int c = _original->compare(*rhs._original.get(), true);
+                    if (c != 0) return c < 0;
+                }
+                return _current->compare(*rhs._current.get(), true) < 0;
+            }
+        };
+
+        typedef std::map<Key, osg::ref_ptr<osg::StateSet> > Map;
+
+        // Looks up a result; a NULL result means the input needs no new state.
+        bool get(const Key& key, osg::ref_ptr<osg::StateSet>& output)
+        {
+            Threading::ScopedMutexLock lock(_mutex);
+            Map::const_iterator i = _map.find(key);
+            if (i == _map.end())
+                return false;
+            output = i->second.get();
+            return true;
+        }
+
+        // Stores a result. If another thread got there first, returns its
+        // result in "inout" instead so that both graphs share it.
+        void put(const Key& key, osg::ref_ptr<osg::StateSet>& inout)
+        {
+            Threading::ScopedMutexLock lock(_mutex);
+            if (_map.size() >= MAX_CACHED_RESULTS)
+                _map.clear();
+
+            std::pair<Map::iterator, bool> result = _map.insert(std::make_pair(key, inout));
+            if (!result.second)
+                inout = result.first->second.get();
+        }
+
+        Map              _map;
+        Threading::Mutex _mutex;
+    };
+
+    ResultCache& getResultCache()
+    {
+        static ResultCache s_cache;
+        return s_cache;
+    }
 }
 
 //...........................................................................
@@ -350,12 +429,14 @@ ShaderGenerator::ShaderGenerator()
     _state = new StateEx();
     _active = true;
     _duplicateSharedSubgraphs = false;
+    _cacheResults = true;
 }
 
 ShaderGenerator::ShaderGenerator(const ShaderGenerator& rhs, const osg::CopyOp& copy) :
 osg::NodeVisitor         (rhs, copy),
 _active                  (rhs._active),
-_duplicateSharedSubgraphs(rhs._duplicateSharedSubgraphs)
+_duplicateSharedSubgraphs(rhs._duplicateSharedSubgraphs),
+_cacheResults            (rhs._cacheResults)
 {
     _state = new StateEx();
 }
@@ -754,7 +835,8 @@ ShaderGenerator::apply(osgSim::LightPointNode& node)
         osg::ref_ptr<osg::StateSet> replacement;
         if ( processGeometry(stateset.get(), replacement) )
         {
-            // remove the temporary sprite.
+            // remove the temporary sprite (from a copy; the result may be shared).
+            replacement = osg::clone(replacement.get(), osg::CopyOp::SHALLOW_COPY);
             replacement->removeTextureAttribute(0, sprite.get());
             node.setStateSet(replacement.get() );
         }
@@ -774,6 +856,28 @@ ShaderGenerator::processText(const osg::StateSet* ss, osg::ref_ptr<osg::StateSet
     // Capture the active current state:
     osg::ref_ptr<osg::StateSet> current = static_cast<StateEx*>(_state.get())->capture();
 
+    // Reuse the result for identical input if we can. A DYNAMIC stateset
+    // may change later, so it gets its own.
+    bool cacheable =
+        _cacheResults &&
+        _acceptCallbacks.empty() &&
+        (!ss || ss->getDataVariance() != osg::Object::DYNAMIC);
+
+    if ( !cacheable )
+        return generateText(ss, current.get(), replacement);
+
+    ResultCache::Key key(ResultCache::TEXT, _name, ss, current.get());
+    if ( getResultCache().get(key, replacement) )
+        return replacement.valid();
+
+    generateText(ss, current.get(), replacement);
+    getResultCache().put(key, replacement);
+    return replacement.valid();
+}
+
+bool
+ShaderGenerator::generateText(const osg::StateSet* ss, osg::StateSet* current, osg::ref_ptr<osg::StateSet>& replacement)
+{
 
     // We ignore an existing program if the version is < 3.6.0 which is when the new osg text shaders with sdf were introduced.
 #if OSG_VERSION_LESS_THAN(3,6,0)
@@ -848,6 +952,29 @@ ShaderGenerator::processGeometry(const osg::StateSet*         original,
     // capture the active current state:
     osg::ref_ptr<osg::StateSet> current = static_cast<StateEx*>(_state.get())->capture();
 
+    // Reuse the result for identical input if we can (see processText).
+    bool cacheable =
+        _cacheResults &&
+        _acceptCallbacks.empty() &&
+        (!original || original->getDataVariance() != osg::Object::DYNAMIC);
+
+    if ( !cacheable )
+        return generateGeometry(original, current.get(), replacement);
+
+    ResultCache::Key key(ResultCache::GEOMETRY, _name, original, current.get());
+    if ( getResultCache().get(key, replacement) )
+        return replacement.valid();
+
+    generateGeometry(original, current.get(), replacement);
+    getResultCache().put(key, replacement);
+    return replacement.valid();
+}
+
+bool
+ShaderGenerator::generateGeometry(const osg::StateSet*         original,
+                                  osg::StateSet*               current,
+                                  osg::ref_ptr<osg::StateSet>& replacement)
+{
     // check for a real osg::Program in the whole state stack. If it exists, bail out
     // so that OSG can use the program already in the graph. We never override a
     // full Program.
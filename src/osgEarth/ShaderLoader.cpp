@@ -19,7 +19,9 @@
 #include <osgEarth/ShaderLoader>
 #include <osgEarth/URI>
 #include <osgEarth/VirtualProgram>
+#include <osgEarth/ThreadingUtils>
 #include <osgDB/FileUtils>
+#include <osgDB/Registry>
 
 #undef  LC
 #define LC "[ShaderLoader] "
@@ -29,6 +31,79 @@ using namespace osgEarth;
 
 typedef std::map<std::string,std::string> StringMap;
 
+namespace
+{
+    // Loaded and preprocessed shader text. The same few files get loaded
+    // for every VirtualProgram that installs them, so the file search,
+    // include resolution and replacements run once per distinct input.
+    // The input is everything load() depends on: the name, the inline
+    // source, the package's defines and replacements, and the search paths.
+    struct LoadedSourceCache
+    {
+        std::string makeKey(const std::string&               filename,
+                            const std::string&               inlineSource,
+                            const ShaderPackage::DefineMap&  defines,
+                            const ShaderPackage::ReplaceMap& replaces,
+                            const URIContext&                context,
+                            const osgDB::Options*            dbOptions)
+        {
+            std::stringstream buf;
+            buf << filename << '\n' << hashString(inlineSource) << '\n' << context.referrer();
+
+            for(ShaderPackage::DefineMap::const_iterator i = defines.begin(); i != defines.end(); ++i)
+                buf << "\nD" << i->first << '=' << (i->second ? '1' : '0');
+            for(ShaderPackage::ReplaceMap::const_iterator i = replaces.begin(); i != replaces.end(); ++i)
+                buf << "\nR" << i->first << '=' << i->second;
+
+            if ( dbOptions )
+            {
+                const osgDB::FilePathList& paths = dbOptions->getDatabasePathList();
+                for(osgDB::FilePathList::const_iterator i = paths.begin(); i != paths.end(); ++i)
+                    buf << "\nP" << *i;
+            }
+
+            const osgDB::FilePathList& paths = osgDB::Registry::instance()->getDataFilePathList();
+            for(osgDB::FilePathList::const_iterator i = paths.begin(); i != paths.end(); ++i)
+                buf << "\nP" << *i;
+
+            return buf.str();
+        }
+
+        bool get(const std::string& key, std::string& output)
+        {
+            Threading::ScopedMutexLock lock(_mutex);
+            StringMap::const_iterator i = _sources.find(key);
+            if ( i == _sources.end() )
+                return false;
+            output = i->second;
+            return true;
+        }
+
+        void put(const std::string& key, const std::string& output)
+        {
+            Threading::ScopedMutexLock lock(_mutex);
+            _sources[key] = output;
+        }
+
+        void clear()
+        {
+            Threading::ScopedMutexLock lock(_mutex);
+            _sources.clear();
+        }
+
+        StringMap        _sources;
+        Threading::Mutex _mutex;
+    };
+
+    LoadedSourceCache s_loadedSources;
+}
+
+void
+ShaderLoader::clearCache()
+{
+    s_loadedSources.clear();
+}
+
 
 // find the value of a pragma, e.g.:
 //   #pragma oe_key value
@@ -107,6 +182,10 @@ ShaderLoader::load(const std::string&    filename,
     if ( source != package._sources.end() )
         inlineSource = source->second;
 
+    std::string cacheKey = s_loadedSources.makeKey(filename, inlineSource, package._defines, package._replaces, context, dbOptions);
+    if ( s_loadedSources.get(cacheKey, output) )
+        return output;
+
     std::string path = osgDB::findDataFile(uri.full(), dbOptions);
     if ( path.empty() )
     {
@@ -216,6 +295,8 @@ for (ShaderPackage::ReplaceMap::const_iterator i = package._replaces.begin();
 // Lastly, remove any CRs
 osgEarth::replaceIn(output, "\r", "");
 
+s_loadedSources.put(cacheKey, output);
+
 return output;
 }
 
@@ -230,6 +311,10 @@ ShaderLoader::load(const std::string&    filename,
     URIContext context(dbOptions);
     URI uri(filename, context);
 
+    std::string cacheKey = s_loadedSources.makeKey(filename, inlineSource, ShaderPackage::DefineMap(), ShaderPackage::ReplaceMap(), context, dbOptions);
+    if (s_loadedSources.get(cacheKey, output))
+        return output;
+
     std::string path = osgDB::findDataFile(filename, dbOptions);
     if (path.empty())
     {
@@ -266,6 +351,8 @@ ShaderLoader::load(const std::string&    filename,
     // Lastly, remove any CRs
     osgEarth::replaceIn(output, "\r", "");
 
+    s_loadedSources.put(cacheKey, output);
+
     return output;
 }
 
@@ -492,7 +579,7 @@ ShaderPackage::loadAll(VirtualProgram*       vp,
     int oks = 0;
     for(SourceMap::const_iterator i = _sources.begin(); i != _sources.end(); ++i)
     {
-        oks += load( vp, i->first ) ? 1 : 0;
+        oks += load( vp, i->first, dbOptions ) ? 1 : 0;
     }
     return oks == _sources.size();
 }
@@ -504,7 +591,7 @@ ShaderPackage::unloadAll(VirtualProgram*       vp,
     int oks = 0;
     for(SourceMap::const_iterator i = _sources.begin(); i != _sources.end(); ++i)
     {
-        oks += unload( vp, i->first ) ? 1 : 0;
+        oks += unload( vp, i->first, dbOptions ) ? 1 : 0;
     }
     return oks == _sources.size();
 }
@@ -22,6 +22,7 @@
 #include <osgEarth/Capabilities>
 #include <osgEarth/CullingUtils>
 #include <osgEarth/GLSLChunker>
+#include <osgEarth/ThreadingUtils>
 
 using namespace osgEarth;
 
@@ -311,14 +312,62 @@ ShaderPreProcessor::applySupportForNoFFP(osg::Shader* shader)
 #endif // !defined(OSG_GL_FIXED_FUNCTION_AVAILABLE)
 }
 
+namespace
+{
+    // Preprocessed sources, by shader type and source hash. Every PolyShader
+    // runs the preprocessor on its source, and a VIEW or CLIP function runs
+    // it three times; the results depend on nothing else.
+    struct PreProcessedSourceCache
+    {
+        typedef std::pair<int, unsigned> Key;
+        typedef std::pair<std::string, std::string> Entry; // input, output
+        typedef std::map<Key, Entry> Map;
+
+        bool get(const osg::Shader* shader, std::string& output)
+        {
+            Key key(shader->getType(), hashString(shader->getShaderSource()));
+            Threading::ScopedMutexLock lock(_mutex);
+            Map::const_iterator i = _entries.find(key);
+            if ( i == _entries.end() || i->second.first != shader->getShaderSource() )
+                return false;
+            output = i->second.second;
+            return true;
+        }
+
+        void put(osg::Shader::Type type, const std::string& input, const std::string& output)
+        {
+            Key key(type, hashString(input));
+            Threading::ScopedMutexLock lock(_mutex);
+            // sources come from a small fixed set of shaders; the limit
+            // only keeps generated ones from piling up.
+            if ( _entries.size() >= 4096u )
+                _entries.clear();
+            _entries[key] = Entry(input, output);
+        }
+
+        Map              _entries;
+        Threading::Mutex _mutex;
+    };
+
+    PreProcessedSourceCache s_preprocessed;
+}
+
 void
 ShaderPreProcessor::run(osg::Shader* shader)
 {
     if ( shader )
     {
+        std::string source;
+        if ( s_preprocessed.get(shader, source) )
+        {
+            shader->setShaderSource( source );
+            return;
+        }
+
         bool dirty = false;
 
-        std::string source = shader->getShaderSource();
+        const std::string input = shader->getShaderSource();
+        source = input;
 
         // First replace any quotes with spaces. Quotes are illegal.
         if ( source.find('\"') != std::string::npos )
@@ -344,6 +393,8 @@ ShaderPreProcessor::run(osg::Shader* shader)
         chunker.write( chunks, source );
         shader->setShaderSource( source );
 
+        s_preprocessed.put( shader->getType(), input, source );
+
         //OE_WARN << source << std::endl << std::endl;
     }
 }
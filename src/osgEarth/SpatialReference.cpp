@@ -23,6 +23,11 @@
 #include <osgEarth/LocalTangentPlane>
 #include <ogr_spatialref.h>
 #include <cpl_conv.h>
+#include <gdal_version.h>
+
+#ifndef GDAL_VERSION_AT_LEAST
+#define GDAL_VERSION_AT_LEAST(MAJOR, MINOR, REV) ((GDAL_VERSION_MAJOR>MAJOR) || (GDAL_VERSION_MAJOR==MAJOR && (GDAL_VERSION_MINOR>MINOR || (GDAL_VERSION_MINOR==MINOR && GDAL_VERSION_REV>=REV))))
+#endif
 
 #define LC "[SpatialReference] "
 
@@ -67,6 +72,158 @@ namespace
             points[i].set( osg::RadiansToDegrees(lon), osg::RadiansToDegrees(lat), alt );
         }
     }
+
+    // Closed-form projections that stand in for OGR/PROJ in the most common
+    // cases (see SpatialReference::transformXYPointArraysFast). Geographic
+    // coordinates are in degrees. Each returns false, without touching the
+    // arrays, if any point is outside the range where it's accurate; the caller
+    // then falls back on OGR.
+
+    inline double wrapLongitude(double lon)
+    {
+        return lon > 180.0 ? lon - 360.0 : lon < -180.0 ? lon + 360.0 : lon;
+    }
+
+    // not every compiler we support has the C99 atanh
+    inline double arctanh(double x)
+    {
+        return 0.5 * log( (1.0 + x) / (1.0 - x) );
+    }
+
+    bool geographicToSphericalMercator(double* x, double* y, unsigned count,
+                                       double R, double k0, double lon0, double x0, double y0)
+    {
+        for( unsigned i=0; i<count; ++i )
+        {
+            if ( !(fabs(y[i]) < 90.0) )
+                return false;
+        }
+
+        const double Rk = R * k0;
+        for( unsigned i=0; i<count; ++i )
+        {
+            double lon = osg::DegreesToRadians( wrapLongitude(x[i] - lon0) );
+            double lat = osg::DegreesToRadians( y[i] );
+            x[i] = x0 + Rk * lon;
+            y[i] = y0 + Rk * log( tan(osg::PI_4 + 0.5*lat) );
+        }
+        return true;
+    }
+
+    bool sphericalMercatorToGeographic(double* x, double* y, unsigned count,
+                                       double R, double k0, double lon0, double x0, double y0)
+    {
+        const double Rk = R * k0;
+        for( unsigned i=0; i<count; ++i )
+        {
+            double lon = (x[i] - x0) / Rk;
+            double lat = 2.0*atan( exp((y[i] - y0) / Rk) ) - osg::PI_2;
+            x[i] = wrapLongitude( lon0 + osg::RadiansToDegrees(lon) );
+            y[i] = osg::RadiansToDegrees( lat );
+        }
+        return true;
+    }
+
+    /**
+     * Ellipsoidal transverse mercator using the Kruger series (3rd order in
+     * the third flattening), which is good to about a millimeter within
+     * 3000km of the central meridian.
+     */
+    struct TransverseMercator
+    {
+        TransverseMercator(double a, double b, double k0, double lon0, double x0, double y0) :
+            _lon0(lon0), _x0(x0), _y0(y0)
+        {
+            double n  = (a - b) / (a + b);
+            double n2 = n*n, n3 = n2*n;
+            _e = 2.0*sqrt(n) / (1.0 + n);
+            _k0A = k0 * a / (1.0 + n) * (1.0 + n2/4.0 + n2*n2/64.0);
+
+            _alpha[0] = n/2.0 - 2.0*n2/3.0 + 5.0*n3/16.0;
+            _alpha[1] = 13.0*n2/48.0 - 3.0*n3/5.0;
+            _alpha[2] = 61.0*n3/240.0;
+
+            _beta[0] = n/2.0 - 2.0*n2/3.0 + 37.0*n3/96.0;
+            _beta[1] = n2/48.0 + n3/15.0;
+            _beta[2] = 17.0*n3/480.0;
+
+            _delta[0] = 2.0*n - 2.0*n2/3.0 - 2.0*n3;
+            _delta[1] = 7.0*n2/3.0 - 8.0*n3/5.0;
+            _delta[2] = 56.0*n3/15.0;
+        }
+
+        bool forward(double* x, double* y, unsigned count) const
+        {
+            for( unsigned i=0; i<count; ++i )
+            {
+                if ( !(fabs(y[i]) < 90.0) || fabs(wrapLongitude(x[i] - _lon0)) > MAX_DLON )
+                    return false;
+            }
+
+            for( unsigned i=0; i<count; ++i )
+            {
+                double dlon   = osg::DegreesToRadians( wrapLongitude(x[i] - _lon0) );
+                double sinLat = sin( osg::DegreesToRadians(y[i]) );
+                double t      = sinh( arctanh(sinLat) - _e*arctanh(_e*sinLat) );
+                double xi     = atan2( t, cos(dlon) );
+                double eta    = arctanh( sin(dlon) / sqrt(1.0 + t*t) );
+
+                double E = eta, N = xi;
+                for( int j=0; j<3; ++j )
+                {
+                    double k = 2.0*(j+1);
+                    E += _alpha[j] * cos(k*xi) * sinh(k*eta);
+                    N += _alpha[j] * sin(k*xi) * cosh(k*eta);
+                }
+
+                x[i] = _x0 + _k0A * E;
+                y[i] = _y0 + _k0A * N;
+            }
+            return true;
+        }
+
+        bool inverse(double* x, double* y, unsigned count) const
+        {
+            for( unsigned i=0; i<count; ++i )
+            {
+                if ( fabs(x[i] - _x0)/_k0A > osg::DegreesToRadians(MAX_DLON) )
+                    return false;
+            }
+
+            for( unsigned i=0; i<count; ++i )
+            {
+                double xi  = (y[i] - _y0) / _k0A;
+                double eta = (x[i] - _x0) / _k0A;
+
+                double xi1 = xi, eta1 = eta;
+                for( int j=0; j<3; ++j )
+                {
+                    double k = 2.0*(j+1);
+                    xi1  -= _beta[j] * sin(k*xi) * cosh(k*eta);
+                    eta1 -= _beta[j] * cos(k*xi) * sinh(k*eta);
+                }
+
+                double chi = asin( sin(xi1) / cosh(eta1) );
+                double lat = chi;
+                for( int j=0; j<3; ++j )
+                {
+                    lat += _delta[j] * sin(2.0*(j+1)*chi);
+                }
+
+                x[i] = wrapLongitude( _lon0 + osg::RadiansToDegrees(atan2(sinh(eta1), cos(xi1))) );
+                y[i] = osg::RadiansToDegrees( lat );
+            }
+            return true;
+        }
+
+        // beyond this the series loses accuracy, so leave those to PROJ.
+        static const double MAX_DLON;
+
+        double _lon0, _x0, _y0, _e, _k0A;
+        double _alpha[3], _beta[3], _delta[3];
+    };
+
+    const double TransverseMercator::MAX_DLON = 20.0;
 }
 
 //------------------------------------------------------------------------
@@ -368,7 +525,8 @@ _is_user_defined( false ),
 _is_ltp         ( false ),
 _is_plate_carre ( false ),
 _is_spherical_mercator( false ),
-_ellipsoidId(0u)
+_ellipsoidId(0u),
+_fastProj       ( FASTPROJ_NONE )
 {
     // nop
 }
@@ -380,7 +538,8 @@ _handle        ( handle ),
 _owns_handle   ( ownsHandle ),
 _is_ltp        ( false ),
 _is_plate_carre( false ),
-_is_geocentric ( false )
+_is_geocentric ( false ),
+_fastProj      ( FASTPROJ_NONE )
 {
     //nop
 }
@@ -398,9 +557,12 @@ SpatialReference::~SpatialReference()
             OE_DEBUG << LC << "Destroying [unitialized SRS]" << std::endl;
         }
 
-        for (TransformHandleCache::iterator itr = _transformHandleCache.begin(); itr != _transformHandleCache.end(); ++itr)
+        for (PerThread<TransformHandleCache>::iterator t = _transformHandleCache.begin(); t != _transformHandleCache.end(); ++t)
         {
-            OCTDestroyCoordinateTransformation(itr->second);
+            for (TransformHandleCache::iterator itr = t->second.begin(); itr != t->second.end(); ++itr)
+            {
+                OCTDestroyCoordinateTransformation(itr->second);
+            }
         }
 
         if ( _owns_handle )
@@ -601,11 +763,23 @@ SpatialReference::_isEquivalentTo( const SpatialReference* rhs, bool considerVDa
             osg::equivalent( getEllipsoid()->getRadiusPolar(), rhs->getEllipsoid()->getRadiusPolar() );
     }
 
-    // last resort, since it requires the lock
+    // last resort, since it requires the lock; remember the answer.
+    {
+        Threading::ScopedReadLock shared( _equivalenceCacheMutex );
+        EquivalenceCache::const_iterator i = _equivalenceCache.find( rhs->_wkt );
+        if ( i != _equivalenceCache.end() )
+            return i->second;
+    }
+
+    bool same;
     {
         GDAL_SCOPED_LOCK;
-        return TRUE == ::OSRIsSame( _handle, rhs->_handle );
+        same = TRUE == ::OSRIsSame( _handle, rhs->_handle );
     }
+
+    Threading::ScopedWriteLock exclusive( _equivalenceCacheMutex );
+    _equivalenceCache[rhs->_wkt] = same;
+    return same;
 }
 
 const SpatialReference*
@@ -986,6 +1160,25 @@ SpatialReference::transform(std::vector<osg::Vec3d>& points,
     
     bool success = false;
 
+    if ( !outputSRS->_initialized )
+        const_cast<SpatialReference*>(outputSRS)->init();
+
+    // LTP <-> ECEF is just a matrix, so skip the round trip through geodetic coords:
+    if ( isLTP() && outputSRS->isGeocentric() && _ellipsoidId == outputSRS->_ellipsoidId )
+    {
+        const osg::Matrixd& m = static_cast<const TangentPlaneSpatialReference*>(this)->getLocalToWorld();
+        for( unsigned i=0; i<points.size(); ++i )
+            points[i] = points[i] * m;
+        return true;
+    }
+    else if ( isGeocentric() && outputSRS->isLTP() && _ellipsoidId == outputSRS->_ellipsoidId )
+    {
+        const osg::Matrixd& m = static_cast<const TangentPlaneSpatialReference*>(outputSRS)->getWorldToLocal();
+        for( unsigned i=0; i<points.size(); ++i )
+            points[i] = points[i] * m;
+        return true;
+    }
+
     // do the pre-transformation pass:
     const SpatialReference* inputSRS = preTransform( points );
     if ( !inputSRS )
@@ -1088,29 +1281,37 @@ SpatialReference::transformXYPointArrays(double*  x,
                                          unsigned count,
                                          const SpatialReference* out_srs) const
 {  
-    // Transform the X and Y values inside an exclusive GDAL/OGR lock
-    GDAL_SCOPED_LOCK;
+    // Common projections don't need OGR (or its lock) at all:
+    if ( transformXYPointArraysFast(x, y, count, out_srs) )
+        return true;
 
     //OE_INFO << LC << "Attempt transfrom from \n"
     //    << "    " << getHorizInitString() << "\n"
     //    << " -> " << out_srs->getHorizInitString() << std::endl;
 
+    // This thread's handles; no other thread touches them, so no lock is
+    // needed to look one up.
+    TransformHandleCache& handles = _transformHandleCache.get();
+
     void* xform_handle = NULL;
-    TransformHandleCache::const_iterator itr = _transformHandleCache.find(out_srs->getWKT());
-    if (itr != _transformHandleCache.end())
+    TransformHandleCache::const_iterator itr = handles.find(out_srs->getWKT());
+    if (itr != handles.end())
     {
         //OE_DEBUG << LC << "using cached transform handle" << std::endl;
         xform_handle = itr->second;
     }
     else
     {
+        // Creating a handle reads the shared OSR handles, so that needs the lock.
+        GDAL_SCOPED_LOCK;
         OE_DEBUG << LC << "allocating new OCT Transform" << std::endl;
         xform_handle = OCTNewCoordinateTransformation( _handle, out_srs->_handle);
-        const_cast<SpatialReference*>(this)->_transformHandleCache[out_srs->getWKT()] = xform_handle;
+        handles[out_srs->getWKT()] = xform_handle;
     }
 
     if ( !xform_handle )
     {
+        GDAL_SCOPED_LOCK;
         OE_WARN << LC
             << "SRS xform not possible" << std::endl
             << "    From => " << getName() << std::endl
@@ -1124,7 +1325,72 @@ SpatialReference::transformXYPointArrays(double*  x,
         return false;
     }
 
+#if GDAL_VERSION_AT_LEAST(1,11,0)
+    // Since 1.11 each OGR transformation carries its own PROJ context, and
+    // our handles are per-thread, so the transform itself can run unlocked.
     return OCTTransform( xform_handle, count, x, y, 0L ) > 0;
+#else
+    GDAL_SCOPED_LOCK;
+    return OCTTransform( xform_handle, count, x, y, 0L ) > 0;
+#endif
+}
+
+
+bool
+SpatialReference::transformXYPointArraysFast(double*  x,
+                                             double*  y,
+                                             unsigned count,
+                                             const SpatialReference* out_srs) const
+{
+    if ( !out_srs->_initialized )
+        const_cast<SpatialReference*>(out_srs)->init();
+
+    // user-defined SRS's have their own rules.
+    if ( _is_user_defined || out_srs->_is_user_defined )
+        return false;
+
+    const SpatialReference* geo;
+    const SpatialReference* proj;
+    bool forward;
+
+    if ( _fastProj == FASTPROJ_GEOGRAPHIC && out_srs->_fastProj > FASTPROJ_GEOGRAPHIC )
+    {
+        geo     = this;
+        proj    = out_srs;
+        forward = true;
+    }
+    else if ( _fastProj > FASTPROJ_GEOGRAPHIC && out_srs->_fastProj == FASTPROJ_GEOGRAPHIC )
+    {
+        geo     = out_srs;
+        proj    = this;
+        forward = false;
+    }
+    else
+    {
+        return false;
+    }
+
+    // no datum shifts allowed:
+    if ( !geo->isHorizEquivalentTo(proj->getGeographicSRS()) )
+        return false;
+
+    if ( proj->_fastProj == FASTPROJ_SPHERICAL_MERCATOR )
+    {
+        double R = proj->getEllipsoid()->getRadiusEquator();
+        return forward ?
+            geographicToSphericalMercator(x, y, count, R, proj->_fastProjK0, proj->_fastProjLon0, proj->_fastProjX0, proj->_fastProjY0) :
+            sphericalMercatorToGeographic(x, y, count, R, proj->_fastProjK0, proj->_fastProjLon0, proj->_fastProjX0, proj->_fastProjY0);
+    }
+
+    else // FASTPROJ_TRANSVERSE_MERCATOR
+    {
+        TransverseMercator tm(
+            proj->getEllipsoid()->getRadiusEquator(),
+            proj->getEllipsoid()->getRadiusPolar(),
+            proj->_fastProjK0, proj->_fastProjLon0, proj->_fastProjX0, proj->_fastProjY0);
+
+        return forward ? tm.forward(x, y, count) : tm.inverse(x, y, count);
+    }
 }
 
 
@@ -1497,6 +1763,42 @@ SpatialReference::_init()
     // Try to extract the horizontal datum
     _datum = getOGRAttrValue( _handle, "DATUM", 0, true );
 
+    // See whether transformXYPointArrays can skip OGR for this SRS:
+    _fastProj = FASTPROJ_NONE;
+    if ( _is_geographic )
+    {
+        if (OSRGetPrimeMeridian(_handle, 0L) == 0.0 &&
+            osg::equivalent(OSRGetAngularUnits(_handle, 0L), osg::DegreesToRadians(1.0), 1e-12))
+        {
+            _fastProj = FASTPROJ_GEOGRAPHIC;
+        }
+    }
+    else if ( !_is_geocentric && !_is_plate_carre && OSRGetLinearUnits(_handle, 0L) == 1.0 )
+    {
+        _fastProjLon0 = OSRGetProjParm( _handle, SRS_PP_CENTRAL_MERIDIAN, 0.0, &err );
+        _fastProjK0   = OSRGetProjParm( _handle, SRS_PP_SCALE_FACTOR,     1.0, &err );
+        _fastProjX0   = OSRGetProjParm( _handle, SRS_PP_FALSE_EASTING,    0.0, &err );
+        _fastProjY0   = OSRGetProjParm( _handle, SRS_PP_FALSE_NORTHING,   0.0, &err );
+        double lat0   = OSRGetProjParm( _handle, SRS_PP_LATITUDE_OF_ORIGIN, 0.0, &err );
+
+        if ( _is_spherical_mercator && lat0 == 0.0 )
+        {
+            if ( proj == "mercator_1sp" )
+            {
+                _fastProj = FASTPROJ_SPHERICAL_MERCATOR;
+            }
+            else if ( proj == "mercator_2sp" )
+            {
+                _fastProjK0 = cos(osg::DegreesToRadians(OSRGetProjParm(_handle, SRS_PP_STANDARD_PARALLEL_1, 0.0, &err)));
+                _fastProj = FASTPROJ_SPHERICAL_MERCATOR;
+            }
+        }
+        else if ( proj == "transverse_mercator" && lat0 == 0.0 )
+        {
+            _fastProj = FASTPROJ_TRANSVERSE_MERCATOR;
+        }
+    }
+
     // Extract the base units:
     std::string units = getOGRAttrValue( _handle, "UNIT", 0, true );
     double unitMultiplier = osgEarth::as<double>( getOGRAttrValue( _handle, "UNIT", 1, true ), 1.0 );
@@ -19,6 +19,8 @@
 #include <osgEarth/StateSetCache>
 #include <osg/NodeVisitor>
 #include <osg/BufferIndexBinding>
+#include <osg/Texture>
+#include <typeinfo>
 
 #define LC "[StateSetCache] "
 
@@ -32,6 +34,110 @@ using namespace osgEarth;
 
 namespace
 {
+    inline void hashCombine(unsigned& hash, unsigned value)
+    {
+        hash ^= value + 0x9e3779b9u + (hash << 6) + (hash >> 2);
+    }
+
+    inline unsigned hashChars(const char* str)
+    {
+        // FNV-1a
+        unsigned hash = 2166136261u;
+        for( ; str && *str; ++str )
+        {
+            hash ^= (unsigned char)(*str);
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+    /**
+     * Hashes only properties that StateAttribute::compare() also considers,
+     * so that any two attributes that compare equal hash the same.
+     */
+    unsigned hashAttribute(const osg::StateAttribute* attr)
+    {
+        unsigned hash = hashChars( typeid(*attr).name() );
+        hashCombine( hash, (unsigned)attr->getType() );
+
+        // Textures compare their images by content, which includes dimensions.
+        const osg::Texture* tex = dynamic_cast<const osg::Texture*>(attr);
+        if ( tex && tex->getNumImages() > 0 && tex->getImage(0) )
+        {
+            const osg::Image* image = tex->getImage(0);
+            hashCombine( hash, (unsigned)image->s() );
+            hashCombine( hash, (unsigned)image->t() );
+            hashCombine( hash, (unsigned)image->r() );
+        }
+
+        return hash;
+    }
+
+    void hashAttributeList(unsigned& hash, const osg::StateSet::AttributeList& attrs)
+    {
+        for( osg::StateSet::AttributeList::const_iterator i = attrs.begin(); i != attrs.end(); ++i )
+        {
+            hashCombine( hash, (unsigned)i->first.first );
+            hashCombine( hash, i->first.second );
+            hashCombine( hash, (unsigned)i->second.second );
+            if ( i->second.first.valid() )
+                hashCombine( hash, hashAttribute(i->second.first.get()) );
+        }
+    }
+
+    void hashModeList(unsigned& hash, const osg::StateSet::ModeList& modes)
+    {
+        for( osg::StateSet::ModeList::const_iterator i = modes.begin(); i != modes.end(); ++i )
+        {
+            hashCombine( hash, (unsigned)i->first );
+            hashCombine( hash, (unsigned)i->second );
+        }
+    }
+
+    /**
+     * Structural hash of a stateset, consistent with StateSet::compare(rhs, true).
+     */
+    unsigned hashStateSet(const osg::StateSet* ss)
+    {
+        unsigned hash = 0u;
+
+        hashAttributeList( hash, ss->getAttributeList() );
+        hashModeList( hash, ss->getModeList() );
+
+        const osg::StateSet::TextureAttributeList& texattrs = ss->getTextureAttributeList();
+        for( unsigned unit = 0; unit < texattrs.size(); ++unit )
+        {
+            if ( !texattrs[unit].empty() )
+            {
+                hashCombine( hash, unit );
+                hashAttributeList( hash, texattrs[unit] );
+            }
+        }
+
+        const osg::StateSet::TextureModeList& texmodes = ss->getTextureModeList();
+        for( unsigned unit = 0; unit < texmodes.size(); ++unit )
+        {
+            if ( !texmodes[unit].empty() )
+            {
+                hashCombine( hash, unit );
+                hashModeList( hash, texmodes[unit] );
+            }
+        }
+
+        const osg::StateSet::UniformList& uniforms = ss->getUniformList();
+        for( osg::StateSet::UniformList::const_iterator i = uniforms.begin(); i != uniforms.end(); ++i )
+        {
+            hashCombine( hash, hashChars(i->first.c_str()) );
+            hashCombine( hash, (unsigned)i->second.second );
+        }
+
+        hashCombine( hash, (unsigned)ss->getRenderingHint() );
+        hashCombine( hash, (unsigned)ss->getBinNumber() );
+        hashCombine( hash, hashChars(ss->getBinName().c_str()) );
+
+        return hash;
+    }
+
     bool isEligible(osg::StateAttribute* attr)
     {
         if ( !attr )
@@ -194,9 +300,15 @@ namespace
 
 //------------------------------------------------------------------------
 
+unsigned
+StateSetCache::hash(const osg::StateSet* stateSet)
+{
+    return stateSet ? hashStateSet(stateSet) : 0u;
+}
+
 StateSetCache::StateSetCache() :
-_pruneCount       ( 0 ),
 _maxSize          ( DEFAULT_PRUNE_ACCESS_COUNT ),
+_pruneCount       ( 0 ),
 _attrShareAttempts( 0 ),
 _attrsIneligible  ( 0 ),
 _attrShareHits    ( 0 ),
@@ -207,18 +319,14 @@ _attrShareMisses  ( 0 )
 
 StateSetCache::~StateSetCache()
 {
-    Threading::ScopedMutexLock lock( _mutex );
-    prune();
+    //nop
 }
 
 void
 StateSetCache::setMaxSize(unsigned value)
 {
     _maxSize = value;
-    {
-        Threading::ScopedMutexLock lock( _mutex );
-        pruneIfNecessary();
-    }
+    pruneIfNecessary();
 }
 
 void
@@ -273,155 +381,170 @@ StateSetCache::share(osg::ref_ptr<osg::StateSet>& input,
                      osg::ref_ptr<osg::StateSet>& output,
                      bool                         checkEligible)
 {
-    bool shared     = false;
-    //bool shareattrs = true;
-
-    if ( !checkEligible || eligible(input.get()) )
+    if ( !input.valid() || (checkEligible && !eligible(input.get())) )
     {
-        Threading::ScopedMutexLock lock( _mutex );
+        output = input.get();
+        return false;
+    }
 
-        pruneIfNecessary();
+    pruneIfNecessary();
 
-        //shareattrs = false;
+    Entry<osg::StateSet> key( hashStateSet(input.get()), input.get() );
+    Shard& shard = _shards[key._hash % NUM_SHARDS];
 
-        std::pair<StateSetSet::iterator,bool> result = _stateSetCache.insert( input );
-        if ( result.second )
-        {
-            // first use
-            output = input.get();
-            //shareattrs = true;
-            shared = false;
-        }
-        else
+    // Most lookups find an existing entry, so try that under a shared lock:
+    {
+        Threading::ScopedReadLock shared( shard._mutex );
+        StateSetSet::const_iterator i = shard._stateSets.find( key );
+        if ( i != shard._stateSets.end() )
         {
             // found a share!
-            output = result.first->get();
-            shared = true;
+            output = i->_object.get();
+            return true;
         }
     }
-    else
-    {
-        output = input.get();
-        shared = false;
-    }
 
-    // OBE.
-    //if ( shareattrs )
-    //{
-    //    ShareStateAttributes sa(this);
-    //    sa.applyStateSet( input.get() );
-    //}
+    Threading::ScopedWriteLock exclusive( shard._mutex );
 
-    return shared;
+    // insert() re-checks, since another thread may have beaten us to it.
+    std::pair<StateSetSet::iterator,bool> result = shard._stateSets.insert( key );
+    output = result.first->_object.get();
+    return !result.second;
 }
 
-
-
 bool
 StateSetCache::share(osg::ref_ptr<osg::StateAttribute>& input,
                      osg::ref_ptr<osg::StateAttribute>& output,
                      bool                               checkEligible)
 {
-    _attrShareAttempts++;
+    ++_attrShareAttempts;
 
-    if ( !checkEligible || eligible(input.get()) )
+    if ( !input.valid() || (checkEligible && !eligible(input.get())) )
     {
-        Threading::ScopedMutexLock lock( _mutex );
+        ++_attrsIneligible;
+        output = input.get();
+        return false;
+    }
 
-        pruneIfNecessary();
+    pruneIfNecessary();
 
-        std::pair<StateAttributeSet::iterator,bool> result = _stateAttributeCache.insert( input );
-        if ( result.second )
-        {
-            // first use
-            output = input.get();
-            _attrShareMisses++;
-            return false;
-        }
-        else
+    Entry<osg::StateAttribute> key( hashAttribute(input.get()), input.get() );
+    Shard& shard = _shards[key._hash % NUM_SHARDS];
+
+    {
+        Threading::ScopedReadLock shared( shard._mutex );
+        StateAttributeSet::const_iterator i = shard._stateAttributes.find( key );
+        if ( i != shard._stateAttributes.end() )
         {
             // found a share!
-            output = result.first->get();
-            _attrShareHits++;
+            output = i->_object.get();
+            ++_attrShareHits;
             return true;
         }
     }
-    else
+
+    Threading::ScopedWriteLock exclusive( shard._mutex );
+
+    std::pair<StateAttributeSet::iterator,bool> result = shard._stateAttributes.insert( key );
+    output = result.first->_object.get();
+    if ( result.second )
     {
-        _attrsIneligible++;
-        output = input.get();
+        // first use
+        ++_attrShareMisses;
         return false;
     }
+    else
+    {
+        // found a share!
+        ++_attrShareHits;
+        return true;
+    }
 }
 
 void
 StateSetCache::pruneIfNecessary()
 {
-    // assume an exclusve mutex is taken
-    if ( _pruneCount++ >= _maxSize )
+    // many threads may count at once; exactly one will see the boundary.
+    unsigned count = ++_pruneCount;
+    if ( count % osg::maximum(_maxSize, 1u) == 0u )
     {
         prune();
-        _pruneCount = 0;
     }
 }
 
 void
 StateSetCache::prune()
 {
-    // assume an exclusive mutex is taken.
-
     unsigned ss_count = 0, sa_count = 0;
 
-    for( StateSetSet::iterator i = _stateSetCache.begin(); i != _stateSetCache.end(); )
+    for( unsigned s = 0; s < NUM_SHARDS; ++s )
     {
-        if ( i->get()->referenceCount() <= 1 )
-        {
-            // do not call releaseGLObjects since the attrs themselves might still be shared
-            // TODO: review this.
-            _stateSetCache.erase( i++ );
-            ss_count++;
-        }
-        else
-        {
-            ++i;
-        }
-    }
+        Shard& shard = _shards[s];
+        Threading::ScopedWriteLock exclusive( shard._mutex );
 
-    for( StateAttributeSet::iterator i = _stateAttributeCache.begin(); i != _stateAttributeCache.end(); )
-    {
-        if ( i->get()->referenceCount() <= 1 )
+        for( StateSetSet::iterator i = shard._stateSets.begin(); i != shard._stateSets.end(); )
         {
-            _stateAttributeCache.erase( i++ );
-            sa_count++;
+            if ( i->_object->referenceCount() <= 1 )
+            {
+                // do not call releaseGLObjects since the attrs themselves might still be shared
+                // TODO: review this.
+                shard._stateSets.erase( i++ );
+                ss_count++;
+            }
+            else
+            {
+                ++i;
+            }
         }
-        else
+
+        for( StateAttributeSet::iterator i = shard._stateAttributes.begin(); i != shard._stateAttributes.end(); )
         {
-            ++i;
+            if ( i->_object->referenceCount() <= 1 )
+            {
+                shard._stateAttributes.erase( i++ );
+                sa_count++;
+            }
+            else
+            {
+                ++i;
+            }
         }
     }
 
     OE_DEBUG << LC << "Pruned " << sa_count << " attributes, " << ss_count << " statesets" << std::endl;
 }
 
+unsigned
+StateSetCache::size() const
+{
+    unsigned count = 0u;
+    for( unsigned s = 0; s < NUM_SHARDS; ++s )
+    {
+        Threading::ScopedReadLock shared( const_cast<Shard&>(_shards[s])._mutex );
+        count += _shards[s]._stateSets.size();
+    }
+    return count;
+}
+
 void
 StateSetCache::clear()
 {
-    Threading::ScopedMutexLock lock( _mutex );
-
-    prune();
-    _stateAttributeCache.clear();
-    _stateSetCache.clear();
+    for( unsigned s = 0; s < NUM_SHARDS; ++s )
+    {
+        Threading::ScopedWriteLock exclusive( _shards[s]._mutex );
+        _shards[s]._stateAttributes.clear();
+        _shards[s]._stateSets.clear();
+    }
 }
 
 
 void
 StateSetCache::dumpStats()
 {
-    Threading::ScopedMutexLock lock( _mutex );
-
     OE_NOTICE << LC << "StateSetCache Dump:" << std::endl
-        << "    attr attempts     = " << _attrShareAttempts << std::endl
-        << "    ineligibles attrs = " << _attrsIneligible << std::endl
-        << "    attr share hits   = " << _attrShareHits << std::endl
-        << "    attr share misses = " << _attrShareMisses << std::endl;
+        << "    attr attempts     = " << (unsigned)_attrShareAttempts << std::endl
+        << "    ineligibles attrs = " << (unsigned)_attrsIneligible << std::endl
+        << "    attr share hits   = " << (unsigned)_attrShareHits << std::endl
+        << "    attr share misses = " << (unsigned)_attrShareMisses << std::endl
+        << "    statesets         = " << size() << std::endl;
 }
@@ -281,6 +281,13 @@ Terrain::removeTerrainCallback( TerrainCallback* cb )
     }
 }
 
+void
+Terrain::queueUpdateOperation(osg::Operation* op)
+{
+    if (op)
+        _updateQueue->add(op);
+}
+
 void
 Terrain::notifyTileAdded( const TileKey& key, osg::Node* node )
 {
@@ -112,6 +112,7 @@ _requireNormalTextures   ( false ),
 _requireParentTextures   ( false ),
 _requireElevationBorder  ( false ),
 _requireFullDataAtFirstLOD( false ),
+_requireFallbackData     ( true ),
 _redrawRequired          ( true ),
 _updateScheduled( false )
 {
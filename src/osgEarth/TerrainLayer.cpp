@@ -20,6 +20,7 @@
 #include <osgEarth/Registry>
 #include <osgEarth/TimeControl>
 #include <osgEarth/URI>
+#include <sstream>
 
 using namespace osgEarth;
 using namespace OpenThreads;
@@ -138,7 +139,9 @@ _sourceDriver   ( rhs._sourceDriver ),
 _sourceTileSize ( rhs._sourceTileSize ),
 _sourceProfile  ( rhs._sourceProfile ),
 _cacheProfile   ( rhs._cacheProfile ),
-_cacheCreateTime( rhs._cacheCreateTime )
+_cacheCreateTime( rhs._cacheCreateTime ),
+_dataExtents    ( rhs._dataExtents ),
+_availability   ( rhs._availability )
 {
     //nop
 }
@@ -185,6 +188,8 @@ TerrainLayer::CacheBinMetadata::CacheBinMetadata(const Config& conf)
         }
     }
 
+    _availability = conf.child("availability");
+
     // check for validity. This will reject older caches that don't have
     // sufficient attribution.
     if (_valid)
@@ -228,6 +233,11 @@ TerrainLayer::CacheBinMetadata::getConfig() const
         conf.add("extents", extents);
     }
 
+    if (_availability.hasValue("empty"))
+    {
+        conf.add(_availability);
+    }
+
     return conf;
 }
 
@@ -262,6 +272,8 @@ TerrainLayer::init()
 {
     Layer::init();
 
+    _availability = new TileAvailability();
+
     // intiailize our read-options, which store caching and IO information.
     setReadOptions(0L);
 
@@ -303,6 +315,11 @@ TerrainLayer::open()
         if ( l2CacheSize > 0 )
         {
             _memCache = new MemCache( l2CacheSize );
+
+            // What goes in is the layer's finished tile, and the terrain only
+            // reads it (into a texture that lets go of it after upload), so
+            // there's no need for a copy on either side.
+            _memCache->setShareObjects( true );
         }
 
         // create the unique cache ID for the cache bin.
@@ -401,12 +418,18 @@ TerrainLayer::open()
 void
 TerrainLayer::close()
 {
+    if (_openCalled && getProfile())
+    {
+        saveAvailability();
+    }
+
     setProfile(0L);
     _tileSource = 0L;
     _openCalled = false;
     setStatus(Status());
     _readOptions = 0L;
     _cacheSettings = new CacheSettings();
+    _availability->clear();
 }
 
 void
@@ -584,6 +607,13 @@ TerrainLayer::getCacheBin(const Profile* profile)
                 }
 
                 bin->setMetadata(meta.get());
+
+                // the persisted availability covers keys in the layer's own profile.
+                if ( getProfile() && profile && profile->isHorizEquivalentTo(getProfile()) )
+                {
+                    _availability->merge(meta->_availability);
+                    mergeCachedBlacklist(bin, profile);
+                }
             }
             else
             {
@@ -973,7 +1003,15 @@ TerrainLayer::isCached(const TileKey& key) const
     if ( !bin )
         return false;
 
-    return bin->getRecordStatus( key.str() ) == CacheBin::STATUS_OK;
+    return bin->getRecordStatus( getCacheKey(key) ) == CacheBin::STATUS_OK;
+}
+
+std::string
+TerrainLayer::getCacheKey(const TileKey& key) const
+{
+    // the cache key combines the Key and the horizontal profile.
+    return Cache::makeCacheKey(
+        Stringify() << key.str() << "-" << key.getProfile()->getHorizSignature());
 }
 
 void
@@ -1000,6 +1038,20 @@ TerrainLayer::getCacheID() const
     return _runtimeCacheId;
 }
 
+void
+TerrainLayer::getMemoryUsage(MemoryUsage& usage) const
+{
+    VisibleLayer::getMemoryUsage(usage);
+
+    if (_memCache.valid())
+        usage._cacheBytes += _memCache->getTotalBytes();
+
+    if (_tileSource.valid())
+        usage._cacheBytes += _tileSource->getL2CacheBytes();
+
+    usage._pendingRequests += (unsigned)_pendingRequests;
+}
+
 const DataExtentList&
 TerrainLayer::getDataExtents() const
 {
@@ -1026,6 +1078,101 @@ TerrainLayer::dirtyDataExtents()
 {
     Threading::ScopedMutexLock lock(_mutex);
     _dataExtentsUnion = GeoExtent::INVALID;
+
+    // new extents usually mean a different source; start over.
+    _availability->clear();
+}
+
+bool
+TerrainLayer::isKnownEmpty(const TileKey& key) const
+{
+    return
+        key.valid() &&
+        getProfile() &&
+        key.getProfile()->isHorizEquivalentTo(getProfile()) &&
+        _availability->isEmpty(key);
+}
+
+// Learned tiles to collect before writing the cache bin metadata again.
+#define AVAILABILITY_SAVE_INTERVAL 64u
+
+void
+TerrainLayer::setKnownEmpty(const TileKey& key, ProgressCallback* progress)
+{
+    // Without a callback, a timeout looks just like a missing tile, and
+    // we don't want to remember that in the cache.
+    if (!progress || progress->isCanceled())
+        return;
+
+    if (!getProfile() || !key.getProfile()->isHorizEquivalentTo(getProfile()))
+        return;
+
+    _availability->setEmpty(key);
+
+    if (_availability->getNumUnsaved() >= AVAILABILITY_SAVE_INTERVAL)
+    {
+        saveAvailability();
+    }
+}
+
+void
+TerrainLayer::saveAvailability()
+{
+    if (!getCacheSettings()->cachePolicy()->isCacheWriteable())
+        return;
+
+    CacheBin* bin = getCacheBin(getProfile());
+    if (!bin)
+        return;
+
+    std::string metaKey = getMetadataKey(getProfile());
+
+    Threading::ScopedMutexLock lock(_mutex);
+
+    CacheBinMetadataMap::iterator i = _cacheBinMetadata.find(metaKey);
+    if (i == _cacheBinMetadata.end())
+        return;
+
+    i->second->_availability = _availability->getConfig();
+
+    std::string data = i->second->getConfig().toJSON(false);
+    osg::ref_ptr<StringObject> temp = new StringObject(data);
+    bin->write(metaKey, temp.get(), _readOptions.get());
+
+    if (_tileSource.valid() && _tileSource->getBlacklist()->size() > 0u)
+    {
+        // pick up what others sharing the cache found before overwriting it
+        mergeCachedBlacklist(bin, getProfile());
+
+        std::ostringstream buf;
+        _tileSource->getBlacklist()->write(buf);
+        osg::ref_ptr<StringObject> blob = new StringObject(buf.str());
+        bin->write(getBlacklistKey(getProfile()), blob.get(), _readOptions.get());
+    }
+}
+
+std::string
+TerrainLayer::getBlacklistKey(const Profile* profile) const
+{
+    return Stringify() << profile->getHorizSignature() << "_blacklist";
+}
+
+void
+TerrainLayer::mergeCachedBlacklist(CacheBin* bin, const Profile* profile)
+{
+    if (!_tileSource.valid() || !profile)
+        return;
+
+    ReadResult rr = bin->readString(getBlacklistKey(profile), _readOptions.get());
+    if (rr.succeeded())
+    {
+        std::istringstream in(rr.getString());
+        osg::ref_ptr<TileBlacklist> cached = TileBlacklist::read(in);
+        if (cached.valid())
+        {
+            _tileSource->getBlacklist()->merge(*cached.get());
+        }
+    }
 }
 
 const GeoExtent&
@@ -1183,7 +1330,24 @@ TerrainLayer::getBestAvailableTileKey(const TileKey& key) const
 bool
 TerrainLayer::mayHaveData(const TileKey& key) const
 {
-    return key == getBestAvailableTileKey(key);
+    if (isKnownEmpty(key))
+        return false;
+
+    if (key == getBestAvailableTileKey(key))
+        return true;
+
+    // A key that misses every data extent rules out its whole subtree;
+    // remember it so the descendants skip the extent walk.
+    if (key.valid() &&
+        !getDataExtents().empty() &&
+        getProfile() &&
+        key.getProfile()->isHorizEquivalentTo(getProfile()) &&
+        !mayHaveDataInExtent(key.getExtent()))
+    {
+        _availability->setSubtreeEmpty(key);
+    }
+
+    return false;
 }
 
 unsigned
@@ -0,0 +1,236 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2016 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/TerrainOcclusionCullCallback>
+#include <osgEarth/ElevationPool>
+#include <osgEarth/JobScheduler>
+#include <osgEarth/Registry>
+#include <osgUtil/CullVisitor>
+
+#define LC "[TerrainOcclusionCullCallback] "
+
+using namespace osgEarth;
+
+// Number of pieces to split each line of sight into. The elevation envelope
+// treats a segment as straight in the map SRS, so on a geocentric map we
+// follow the real (world) line more closely by testing it in pieces.
+#define NUM_SEGMENTS_GEOCENTRIC 8
+
+namespace
+{
+    // Parameter at which the segment p0 + t*dp enters a sphere, or 1.0 if it
+    // never does.
+    double entryIntoSphere(const osg::Vec3d& p0, const osg::Vec3d& dp,
+                           const osg::Vec3d& center, double radius)
+    {
+        osg::Vec3d m = p0 - center;
+        double a = dp * dp;
+        double b = m * dp;
+        double c = m * m - radius*radius;
+        double disc = b*b - a*c;
+        if (a <= 0.0 || disc < 0.0)
+            return 1.0;
+
+        double t = (-b - sqrt(disc)) / a;
+        return osg::clampBetween(t, 0.0, 1.0);
+    }
+}
+
+//........................................................................
+
+struct TerrainOcclusionCullCallback::Test : public TaskRequest
+{
+    osg::observer_ptr<ElevationPool>     _pool;
+    osg::ref_ptr<const SpatialReference> _srs;
+    unsigned                             _lod;
+    osg::Vec3d                           _eye;
+    osg::Vec3d                           _center;
+    double                               _radius;
+    std::vector<osg::Vec3d>              _targets;
+    bool                                 _occluded;
+
+    Test() : _occluded(false) { }
+
+    // Whether the terrain blocks the world-space segment from "from" to "to".
+    bool blocked(ElevationEnvelope* env, const osg::Vec3d& from, const osg::Vec3d& to)
+    {
+        int numSegments = _srs->isGeographic() ? NUM_SEGMENTS_GEOCENTRIC : 1;
+        osg::Vec3d dp = to - from;
+
+        osg::Vec3d p0, p1, hit;
+        if (!_srs->transformFromWorld(from, p0))
+            return false;
+
+        for (int i = 1; i <= numSegments; ++i)
+        {
+            if (!_srs->transformFromWorld(from + dp*((double)i/(double)numSegments), p1))
+                return false;
+
+            if (env->intersect(p0, p1, hit))
+                return true;
+
+            p0 = p1;
+        }
+        return false;
+    }
+
+    void operator()(ProgressCallback* progress)
+    {
+        osg::ref_ptr<ElevationPool> pool;
+        if (!_pool.lock(pool))
+            return;
+
+        osg::ref_ptr<ElevationEnvelope> env = pool->createEnvelope(_srs.get(), _lod);
+
+        // Only terrain outside the node's own bounds counts as an occluder,
+        // so each line of sight ends where it enters the bounding sphere.
+        for (unsigned i = 0; i < _targets.size(); ++i)
+        {
+            if (progress && progress->isCanceled())
+                return;
+
+            osg::Vec3d dp = _targets[i] - _eye;
+            double t = entryIntoSphere(_eye, dp, _center, _radius);
+
+            if (!blocked(env.get(), _eye, _eye + dp*t))
+            {
+                _occluded = false;
+                return;
+            }
+        }
+
+        _occluded = !_targets.empty();
+    }
+};
+
+//........................................................................
+
+TerrainOcclusionCullCallback::TerrainOcclusionCullCallback(ElevationPool* pool,
+                                                           const SpatialReference* srs) :
+_pool          ( pool ),
+_srs           ( srs ),
+_lod           ( 10u ),
+_numSamples    ( 3u ),
+_maxEyeMovement( 0.01 ),
+_minFrames     ( 10u ),
+_enabled       ( true )
+{
+    //nop
+}
+
+bool
+TerrainOcclusionCullCallback::isVisible(osg::Node* node, osg::NodeVisitor* nv)
+{
+    osgUtil::CullVisitor* cv = dynamic_cast<osgUtil::CullVisitor*>(nv);
+    if (!cv || !cv->getCurrentCamera() || !_pool.valid() || !_srs.valid())
+        return true;
+
+    const osg::BoundingSphere& bs = node->getBound();
+    if (!bs.valid())
+        return true;
+
+    // pop the last node in the path (which is the node this callback is on)
+    // to prevent double-transforming the bounding sphere's center point
+    osg::NodePath np = nv->getNodePath();
+    if (!np.empty() && np.back() == node)
+        np.pop_back();
+    osg::Matrix local2world = osg::computeLocalToWorld(np);
+
+    osg::Vec3d center = bs.center() * local2world;
+    double radius = bs.radius();
+    osg::Vec3d eye = osg::Vec3d(nv->getEyePoint()) * local2world;
+
+    if ((eye - center).length2() <= radius*radius)
+        return true;
+
+    unsigned frame = nv->getFrameStamp() ? nv->getFrameStamp()->getFrameNumber() : 0u;
+
+    Threading::ScopedMutexLock lock(_mutex);
+
+    CameraState& state = _cameraStates[cv->getCurrentCamera()];
+
+    // Pick up the result of a finished test:
+    if (state._pending.valid() && state._pending->isCompleted())
+    {
+        if (!state._pending->wasCanceled())
+        {
+            state._occluded = state._pending->_occluded;
+            state._eye = state._pending->_eye;
+        }
+        state._pending = 0L;
+    }
+
+    // The result only holds while the eye stays near the point it was tested from.
+    double maxMove = _maxEyeMovement * (state._eye - center).length();
+    bool stale = (eye - state._eye).length2() > maxMove*maxMove;
+
+    if (stale && !state._pending.valid() && frame - state._lastFrame >= _minFrames)
+    {
+        Test* test = new Test();
+        test->_pool = _pool.get();
+        test->_srs = _srs.get();
+        test->_lod = _lod;
+        test->_eye = eye;
+        test->_center = center;
+        test->_radius = radius;
+
+        // Grid of points on the top face of the box around the bounding sphere:
+        osg::Vec3d up = _srs->isGeographic() ? center : osg::Vec3d(0,0,1);
+        up.normalize();
+        osg::Vec3d east = osg::Vec3d(0,0,1) ^ up;
+        if (east.length2() < 1e-6)
+            east.set(1,0,0);
+        east.normalize();
+        osg::Vec3d north = up ^ east;
+
+        osg::Vec3d top = center + up*radius;
+        for (unsigned s = 0; s < _numSamples; ++s)
+        {
+            double u = _numSamples > 1 ? -1.0 + 2.0*(double)s/(double)(_numSamples-1) : 0.0;
+            for (unsigned t = 0; t < _numSamples; ++t)
+            {
+                double v = _numSamples > 1 ? -1.0 + 2.0*(double)t/(double)(_numSamples-1) : 0.0;
+                test->_targets.push_back(top + east*(u*radius) + north*(v*radius));
+            }
+        }
+
+        state._pending = test;
+        state._lastFrame = frame;
+        Registry::instance()->getJobScheduler()->submit(test, JobScheduler::LANE_LOW);
+
+        // Forget cameras that have gone away while we're here.
+        for (CameraStates::iterator i = _cameraStates.begin(); i != _cameraStates.end(); )
+        {
+            if (!i->first.valid())
+                _cameraStates.erase(i++);
+            else
+                ++i;
+        }
+    }
+
+    return !state._occluded || stale;
+}
+
+void
+TerrainOcclusionCullCallback::operator()(osg::Node* node, osg::NodeVisitor* nv)
+{
+    if (!_enabled || isVisible(node, nv))
+    {
+        traverse(node, nv);
+    }
+}
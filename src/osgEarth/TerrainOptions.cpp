@@ -48,7 +48,9 @@ _debug( false ),
 _binNumber( 0 ),
 _castShadows(true),
 _rangeMode(osg::LOD::DISTANCE_FROM_EYE_POINT),
-_tilePixelSize(256)
+_tilePixelSize(256),
+_packedElevationTextures(false),
+_gpuNormalMaps(false)
 {
     fromConfig( _conf );
 }
@@ -82,6 +84,8 @@ TerrainOptions::getConfig() const
     conf.set( "min_expiry_frames", _minExpiryFrames);
     conf.set("cast_shadows", _castShadows);
     conf.set("tile_pixel_size", _tilePixelSize);
+    conf.set("packed_elevation_textures", _packedElevationTextures);
+    conf.set("gpu_normal_maps", _gpuNormalMaps);
     conf.set("range_mode", "PIXEL_SIZE_ON_SCREEN", _rangeMode, osg::LOD::PIXEL_SIZE_ON_SCREEN);
     conf.set("range_mode", "DISTANCE_FROM_EYE_POINT", _rangeMode, osg::LOD::DISTANCE_FROM_EYE_POINT);
 
@@ -128,6 +132,8 @@ TerrainOptions::fromConfig( const Config& conf )
     conf.getIfSet( "min_expiry_frames", _minExpiryFrames);
     conf.getIfSet("cast_shadows", _castShadows);
     conf.getIfSet("tile_pixel_size", _tilePixelSize);
+    conf.getIfSet("packed_elevation_textures", _packedElevationTextures);
+    conf.getIfSet("gpu_normal_maps", _gpuNormalMaps);
     conf.getIfSet("range_mode", "PIXEL_SIZE_ON_SCREEN", _rangeMode, osg::LOD::PIXEL_SIZE_ON_SCREEN);
     conf.getIfSet("range_mode", "DISTANCE_FROM_EYE_POINT", _rangeMode, osg::LOD::DISTANCE_FROM_EYE_POINT);
 
@@ -33,7 +33,8 @@ TerrainTileLayerModel::TerrainTileLayerModel()
 
 TerrainTileElevationModel::TerrainTileElevationModel() :
 _minHeight( FLT_MAX ),
-_maxHeight(-FLT_MAX )
+_maxHeight(-FLT_MAX ),
+_geometricError( 0.0f )
 {
     //NOP
 }
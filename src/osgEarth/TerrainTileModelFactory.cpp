@@ -19,6 +19,13 @@
 #include <osgEarth/TerrainTileModelFactory>
 #include <osgEarth/ImageToHeightFieldConverter>
 #include <osgEarth/Map>
+#include <osgEarth/Registry>
+#include <osgEarth/JobScheduler>
+#include <osgEarth/Cache>
+#include <osgEarth/ElevationLayer>
+#include <osgEarth/StringUtils>
+#include <osgEarth/TileLoadTrace>
+#include <osgEarth/HeightFieldUtils>
 
 #include <osg/Texture2D>
 
@@ -26,6 +33,116 @@
 
 using namespace osgEarth;
 
+#ifndef GL_RG
+#define GL_RG 0x8227
+#endif
+
+#ifndef GL_R16
+#define GL_R16 0x822A
+#endif
+
+#ifndef GL_RG8
+#define GL_RG8 0x822B
+#endif
+
+namespace
+{
+    // Largest vertical distance between a heightfield and the mesh of
+    // tileSize x tileSize vertices that the terrain draws for it.
+    float computeGeometricError(const osg::HeightField* hf, unsigned tileSize)
+    {
+        unsigned cols = hf->getNumColumns(), rows = hf->getNumRows();
+        if (tileSize < 2u || cols < 2u || rows < 2u)
+            return 0.0f;
+
+        // heights at the mesh vertices:
+        std::vector<float> mesh(tileSize*tileSize);
+        for (unsigned t = 0; t < tileSize; ++t)
+            for (unsigned s = 0; s < tileSize; ++s)
+                mesh[t*tileSize+s] = HeightFieldUtils::getHeightAtNormalizedLocation(
+                    hf, (double)s/(double)(tileSize-1), (double)t/(double)(tileSize-1));
+
+        float maxError = 0.0f;
+        for (unsigned row = 0; row < rows; ++row)
+        {
+            float fy = (float)row/(float)(rows-1) * (float)(tileSize-1);
+            unsigned t = osg::minimum((unsigned)fy, tileSize-2u);
+            float ty = fy - (float)t;
+
+            for (unsigned col = 0; col < cols; ++col)
+            {
+                float h = hf->getHeight(col, row);
+                if (h == NO_DATA_VALUE)
+                    continue;
+
+                float fx = (float)col/(float)(cols-1) * (float)(tileSize-1);
+                unsigned s = osg::minimum((unsigned)fx, tileSize-2u);
+                float tx = fx - (float)s;
+
+                const float* m = &mesh[t*tileSize+s];
+                float meshHeight =
+                    (m[0]*(1.0f-tx) + m[1]*tx) * (1.0f-ty) +
+                    (m[tileSize]*(1.0f-tx) + m[tileSize+1]*tx) * ty;
+
+                maxError = osg::maximum(maxError, fabs(h - meshHeight));
+            }
+        }
+
+        return maxError;
+    }
+
+    // Repacks an RGBA normal map (normal*0.5+0.5 in RGB, curvature in A) into
+    // a two-channel texture holding the octahedral encoding of the normal.
+    // The terrain SDK shader decodes it when OE_TERRAIN_PACKED_NORMALS is set.
+    osg::Image* packNormalMap(const osg::Image* input)
+    {
+        osg::Image* output = new osg::Image();
+        output->allocateImage(input->s(), input->t(), 1, GL_RG, GL_UNSIGNED_BYTE);
+        output->setInternalTextureFormat(GL_RG8);
+
+        ImageUtils::PixelReader read(input);
+        ImageUtils::PixelWriter write(output);
+
+        for (int t = 0; t < input->t(); ++t)
+        {
+            for (int s = 0; s < input->s(); ++s)
+            {
+                osg::Vec4f c = read(s, t);
+                osg::Vec3f n(c.r()*2.0f-1.0f, c.g()*2.0f-1.0f, c.b()*2.0f-1.0f);
+                n /= osg::maximum(fabs(n.x()) + fabs(n.y()) + fabs(n.z()), 1e-6f);
+
+                // fold the lower hemisphere over the diagonals:
+                if (n.z() < 0.0f)
+                {
+                    float x = n.x(), y = n.y();
+                    n.x() = (1.0f - fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+                    n.y() = (1.0f - fabs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+                }
+
+                write(osg::Vec4f(n.x()*0.5f+0.5f, n.y()*0.5f+0.5f, 0.0f, 1.0f), s, t);
+            }
+        }
+
+        return output;
+    }
+
+    // Whether a tile can leave a layer out because the layer has nothing finer
+    // than an ancestor of the tile, and the engine reuses the parent tile's
+    // texture (with a scale/bias matrix) instead of a cropped or upsampled
+    // copy. The first LOD has no parent to inherit from.
+    bool isInheritedFromParent(const TerrainLayer*              layer,
+                               const TileKey&                   key,
+                               const TerrainOptions&            options,
+                               const TerrainEngineRequirements* reqs)
+    {
+        if (reqs == 0L || reqs->fallbackDataRequired() || key.getLOD() <= options.firstLOD().get())
+            return false;
+
+        TileKey bestKey = layer->getBestAvailableTileKey(key);
+        return bestKey.valid() && bestKey.getLOD() < key.getLOD();
+    }
+}
+
 //.........................................................................
 
 TerrainTileModelFactory::TerrainTileModelFactory(const TerrainOptions& options) :
@@ -57,9 +174,34 @@ TerrainTileModelFactory::createTileModel(const Map*                       map,
 
     if ( requirements == 0L || requirements->elevationTexturesRequired() )
     {
-        unsigned border = requirements->elevationBorderRequired() ? 1u : 0u;
+        // When no elevation layer has data of its own at this LOD, the
+        // heightfield would just resample the parent's:
+        ElevationLayerVector elevationLayers;
+        map->getLayers(elevationLayers);
+        bool inherit = !elevationLayers.empty();
+        for (ElevationLayerVector::const_iterator i = elevationLayers.begin(); i != elevationLayers.end() && inherit; ++i)
+        {
+            if (i->get()->getEnabled() && i->get()->getVisible())
+                inherit = isInheritedFromParent(i->get(), key, _options, requirements);
+        }
+
+        if (!inherit)
+        {
+            unsigned border = requirements->elevationBorderRequired() ? 1u : 0u;
 
-        addElevation( model.get(), map, key, filter, border, progress );
+            addElevation( model.get(), map, key, filter, border, progress );
+        }
+    }
+
+    // Now that the tile's data is all here, let layers without textures of
+    // their own decide whether they draw on it.
+    for (TerrainTileColorLayerModelVector::iterator i = model->colorLayers().begin(); i != model->colorLayers().end(); ++i)
+    {
+        TerrainTileColorLayerModel* colorModel = i->get();
+        if (colorModel->getLayer() && dynamic_cast<TerrainTileImageLayerModel*>(colorModel) == 0L)
+        {
+            colorModel->getLayer()->classifyTile(model.get(), colorModel->visible());
+        }
     }
 
 #if 0
@@ -73,6 +215,49 @@ TerrainTileModelFactory::createTileModel(const Map*                       map,
     return model.release();
 }
 
+namespace
+{
+    // Creates one layer's image for a tile on the JobScheduler.
+    struct CreateLayerImageTask : public TaskRequest
+    {
+        CreateLayerImageTask(ImageLayer* layer, const TileKey& key, ProgressCallback* progress, GeoImage* output) :
+            _layer(layer), _key(key), _progress(progress), _output(output), _trace(TileLoadTrace::current()) { }
+
+        void operator()(ProgressCallback*)
+        {
+            // carry the tile's trace over to this worker.
+            TileLoadTrace::Scope traceScope(_trace.get());
+            *_output = _layer->createImage(_key, _progress.get());
+        }
+
+        osg::ref_ptr<ImageLayer>       _layer;
+        TileKey                        _key;
+        osg::ref_ptr<ProgressCallback> _progress;
+        GeoImage*                      _output;
+        osg::ref_ptr<TileLoadTrace>    _trace;
+    };
+
+    bool isImageLayerToFetch(Layer* layer, const TileKey& key, const CreateTileModelFilter& filter,
+                             const TerrainOptions& options, const TerrainEngineRequirements* reqs)
+    {
+        if (layer->getRenderType() != layer->RENDERTYPE_TERRAIN_SURFACE ||
+            !layer->getEnabled() ||
+            !filter.accept(layer))
+        {
+            return false;
+        }
+
+        ImageLayer* imageLayer = dynamic_cast<ImageLayer*>(layer);
+        return
+            imageLayer &&
+            !imageLayer->createTextureSupported() &&
+            imageLayer->isKeyInLegalRange(key) &&
+            !imageLayer->isKnownEmpty(key) &&
+            imageLayer->mayHaveDataInExtent(key.getExtent()) &&
+            !isInheritedFromParent(imageLayer, key, options, reqs);
+    }
+}
+
 void
 TerrainTileModelFactory::addColorLayers(TerrainTileModel* model,
                                         const Map* map,
@@ -88,9 +273,49 @@ TerrainTileModelFactory::addColorLayers(TerrainTileModel* model,
     LayerVector layers;
     map->getLayers(layers);
 
-    for (LayerVector::const_iterator i = layers.begin(); i != layers.end(); ++i)
+    // When more than one image layer needs fetching, fetch them all at once:
+    // queue all but the first on the JobScheduler and do the first here.
+    std::vector<GeoImage> images(layers.size());
+    std::vector<bool> fetched(layers.size(), false);
+    std::vector<unsigned> toFetch;
+
+    for (unsigned i = 0; i < layers.size(); ++i)
     {
-        Layer* layer = i->get();
+        if (isImageLayerToFetch(layers[i].get(), key, filter, _options, reqs))
+            toFetch.push_back(i);
+    }
+
+    if (toFetch.size() > 1u)
+    {
+        JobScheduler* scheduler = Registry::instance()->getJobScheduler();
+        osg::ref_ptr<JobGroup> jobs = new JobGroup();
+
+        for (unsigned i = 1; i < toFetch.size(); ++i)
+        {
+            unsigned index = toFetch[i];
+            scheduler->submit(
+                new CreateLayerImageTask(static_cast<ImageLayer*>(layers[index].get()), key, progress, &images[index]),
+                JobScheduler::LANE_NORMAL,
+                jobs.get());
+        }
+
+        images[toFetch[0]] = static_cast<ImageLayer*>(layers[toFetch[0]].get())->createImage(key, progress);
+
+        // A worker must help out rather than block, or it could end up
+        // waiting on jobs queued behind itself.
+        if (scheduler->isWorkerThread())
+        {
+            while (jobs->getNumPending() > 0u && scheduler->runOne());
+        }
+        jobs->wait();
+
+        for (unsigned i = 0; i < toFetch.size(); ++i)
+            fetched[toFetch[i]] = true;
+    }
+
+    for (unsigned index = 0; index < layers.size(); ++index)
+    {
+        Layer* layer = layers[index].get();
 
         if (layer->getRenderType() != layer->RENDERTYPE_TERRAIN_SURFACE)
             continue;
@@ -107,7 +332,10 @@ TerrainTileModelFactory::addColorLayers(TerrainTileModel* model,
             osg::Texture* tex = 0L;
             osg::Matrixf textureMatrix;
 
-            if (imageLayer->isKeyInLegalRange(key) && imageLayer->mayHaveDataInExtent(key.getExtent()))
+            if (imageLayer->isKeyInLegalRange(key) &&
+                !imageLayer->isKnownEmpty(key) &&
+                imageLayer->mayHaveDataInExtent(key.getExtent()) &&
+                (imageLayer->createTextureSupported() || !isInheritedFromParent(imageLayer, key, _options, reqs)))
             {
                 if (imageLayer->createTextureSupported())
                 {
@@ -116,7 +344,7 @@ TerrainTileModelFactory::addColorLayers(TerrainTileModel* model,
 
                 else
                 {
-                    GeoImage geoImage = imageLayer->createImage( key, progress );
+                    GeoImage geoImage = fetched[index] ? images[index] : imageLayer->createImage( key, progress );
            
                     if ( geoImage.valid() )
                     {
@@ -230,6 +458,8 @@ TerrainTileModelFactory::addElevation(TerrainTileModel*            model,
     // make an elevation layer.
     OE_START_TIMER(fetch_elevation);
 
+    TileLoadTrace::ScopedStage traceStage("elevation");
+
     if (!filter.empty() && !filter.elevation().isSetTo(true))
         return;
 
@@ -269,12 +499,17 @@ TerrainTileModelFactory::addElevation(TerrainTileModel*            model,
             }
         }
 
+        layerModel->setGeometricError(computeGeometricError(mainHF.get(), _options.tileSize().get()));
+
         // needed for normal map generation
         model->heightFields().setNeighbor(0, 0, mainHF.get());
 
-        // convert the heightfield to a 1-channel 32-bit fp image:
+        // convert the heightfield to a 1-channel 32-bit fp image, or a
+        // 16-bit one scaled to the tile's height range:
         ImageToHeightFieldConverter conv;
-        osg::Image* hfImage = conv.convertToR32F(mainHF.get());
+        osg::Image* hfImage = _options.packedElevationTextures() == true ?
+            conv.convertToR16(mainHF.get()) :
+            conv.convertToR32F(mainHF.get());
 
         if ( hfImage )
         {
@@ -369,6 +604,37 @@ TerrainTileModelFactory::getOrCreateHeightField(const Map*
         return true;
     }
 
+    // Only heightfields we allocate ourselves go in the persistent cache,
+    // since a caller's heightfield could be any size.
+    CachePolicy policy;
+    CacheBin* bin = out_hf.valid() ? 0L : getElevationCacheBin(map, policy);
+    std::string binKey;
+
+    if (bin)
+    {
+        binKey = Stringify()
+            << key.str() << "_b" << border << "_p" << (int)samplePolicy
+            << "_" << key.getProfile()->getHorizSignature()
+            << (_options.gpuNormalMaps() == true ? "_nn" : "");
+
+        if (policy.isCacheReadable() &&
+            readElevationFromCache(bin, policy, binKey, map->getReadOptions(), out_hf, out_normalMap))
+        {
+            if (_heightFieldCacheEnabled)
+            {
+                HFCacheValue newValue;
+                newValue._hf = out_hf.get();
+                newValue._normalMap = out_normalMap.get();
+                _heightFieldCache.insert( cachekey, newValue );
+            }
+
+            if (progress)
+                progress->stats()["hfcache_bin_hit_count"] += 1;
+
+            return true;
+        }
+    }
+
     if ( !out_hf.valid() )
     {
         out_hf = HeightFieldUtils::createReferenceHeightField(
@@ -378,7 +644,8 @@ TerrainTileModelFactory::getOrCreateHeightField(const Map*
             true);              // initialize to HAE (0.0) heights
     }
 
-    if (!out_normalMap.valid())
+    // Skip normal map generation when the engine derives normals on the GPU.
+    if (!out_normalMap.valid() && _options.gpuNormalMaps() == false)
     {
         //OE_INFO << "TODO: check terrain reqs\n";
         out_normalMap = new NormalMap(257, 257); // ImageUtils::createEmptyImage(257, 257);
@@ -433,11 +700,112 @@ TerrainTileModelFactory::getOrCreateHeightField(const Map*
 
             _heightFieldCache.insert( cachekey, newValue );
         }
+
+        // and store the finished heightfield and normal map as one record,
+        // so the next run skips both compositing and normal generation.
+        if (bin && policy.isCacheWriteable())
+        {
+            osg::ref_ptr<osg::HeightField> record = new osg::HeightField(*out_hf.get(), osg::CopyOp::SHALLOW_COPY);
+            record->setUserData(out_normalMap.get());
+            bin->write(binKey, record.get(), map->getReadOptions());
+        }
     }
 
     return populated;
 }
 
+CacheBin*
+TerrainTileModelFactory::getElevationCacheBin(const Map* map, CachePolicy& out_policy)
+{
+    CacheSettings* cacheSettings = CacheSettings::get(map->getReadOptions());
+    if (!cacheSettings || !cacheSettings->getCache() || cacheSettings->isCacheDisabled())
+        return 0L;
+
+    // The composite depends on every contributing layer, in order. Any layer
+    // that opts out of caching keeps the whole composite out of the cache.
+    ElevationLayerVector layers;
+    map->getLayers(layers);
+
+    std::stringstream buf;
+    unsigned numContributing = 0u;
+    for (ElevationLayerVector::const_iterator i = layers.begin(); i != layers.end(); ++i)
+    {
+        ElevationLayer* layer = i->get();
+        if (!layer->getEnabled() || !layer->getVisible())
+            continue;
+
+        CacheSettings* layerCacheSettings = layer->getCacheSettings();
+        if (layer->getCacheID().empty() || !layerCacheSettings || layerCacheSettings->isCacheDisabled())
+            return 0L;
+
+        buf << layer->getCacheID() << (layer->isOffset() ? "+" : "") << ";";
+        ++numContributing;
+    }
+
+    if (numContributing == 0u)
+        return 0L;
+
+    std::string signature = buf.str();
+
+    Threading::ScopedMutexLock lock(_elevationBinMutex);
+
+    if (!_elevationBin.valid() || signature != _elevationBinSignature)
+    {
+        std::string binID = Stringify()
+            << "elevation_" << std::hex << std::setw(8) << std::setfill('0') << hashString(signature);
+
+        _elevationBin = cacheSettings->getCache()->addBin(binID);
+        _elevationBinPolicy = cacheSettings->cachePolicy().get();
+        _elevationBinSignature = signature;
+
+        OE_INFO << LC << "Caching composited elevation in bin \"" << binID << "\"" << std::endl;
+    }
+
+    out_policy = _elevationBinPolicy;
+    return _elevationBin.get();
+}
+
+bool
+TerrainTileModelFactory::readElevationFromCache(CacheBin*                       bin,
+                                                const CachePolicy&              policy,
+                                                const std::string&              cacheKey,
+                                                const osgDB::Options*           readOptions,
+                                                osg::ref_ptr<osg::HeightField>& out_hf,
+                                                osg::ref_ptr<NormalMap>&        out_normalMap) const
+{
+    ReadResult rr = bin->readObject(cacheKey, readOptions);
+    if (!rr.succeeded() || policy.isExpired(rr.lastModifiedTime()))
+        return false;
+
+    osg::ref_ptr<osg::HeightField> hf = dynamic_cast<osg::HeightField*>(rr.getObject());
+    if (!hf.valid())
+        return false;
+
+    // Records made without a normal map (GPU normals) are just the heightfield.
+    if (_options.gpuNormalMaps() == true)
+    {
+        hf->setUserData(0L);
+        out_hf = hf.get();
+        return true;
+    }
+
+    // The normal map comes back as a plain image; copy it into a NormalMap.
+    const osg::Image* image = dynamic_cast<const osg::Image*>(hf->getUserData());
+    if (!image || image->getPixelFormat() != GL_RGBA || image->getDataType() != GL_UNSIGNED_BYTE)
+        return false;
+
+    osg::ref_ptr<NormalMap> normalMap = new NormalMap(image->s(), image->t());
+    if (normalMap->getTotalSizeInBytes() != image->getTotalSizeInBytes())
+        return false;
+
+    ::memcpy(normalMap->data(), image->data(), image->getTotalSizeInBytes());
+    hf->setUserData(0L);
+
+    out_hf = hf.get();
+    out_normalMap = normalMap.get();
+    return true;
+}
+
 osg::Texture*
 TerrainTileModelFactory::createImageTexture(osg::Image*       image,
                                             const ImageLayer* layer) const
@@ -467,6 +835,10 @@ TerrainTileModelFactory::createImageTexture(osg::Image*       image,
 
     ImageUtils::activateMipMaps(tex);
 
+    // Once uploaded the texture needn't hold the image; the layer's mem cache
+    // keeps the one copy if it's on. (OSG keeps dynamic images regardless.)
+    tex->setUnRefImageDataAfterApply(Registry::instance()->unRefImageDataAfterApply().get());
+
     return tex;
 }
 
@@ -492,7 +864,7 @@ osg::Texture*
 TerrainTileModelFactory::createElevationTexture(osg::Image* image) const
 {
     osg::Texture2D* tex = new osg::Texture2D( image );
-    tex->setInternalFormat(GL_R32F);
+    tex->setInternalFormat(image->getDataType() == GL_UNSIGNED_SHORT ? GL_R16 : GL_R32F);
     tex->setFilter( osg::Texture::MAG_FILTER, osg::Texture::LINEAR );
     tex->setFilter( osg::Texture::MIN_FILTER, osg::Texture::NEAREST );
     tex->setWrap  ( osg::Texture::WRAP_S,     osg::Texture::CLAMP_TO_EDGE );
@@ -505,6 +877,9 @@ TerrainTileModelFactory::createElevationTexture(osg::Image* image) const
 osg::Texture*
 TerrainTileModelFactory::createNormalTexture(osg::Image* image) const
 {
+    if (_options.packedElevationTextures() == true)
+        image = packNormalMap(image);
+
     osg::Texture2D* tex = new osg::Texture2D( image );
     tex->setInternalFormatMode(osg::Texture::USE_IMAGE_DATA_FORMAT);
     tex->setFilter( osg::Texture::MAG_FILTER, osg::Texture::LINEAR );
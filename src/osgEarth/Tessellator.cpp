@@ -22,6 +22,7 @@
 #include <limits.h>
 
 #include <osgEarth/Tessellator>
+#include <osgEarth/ThreadingUtils>
 
 using namespace osgEarth;
 
@@ -122,6 +123,163 @@ struct TriIndices
 
 typedef std::vector<TriIndices> TriList;
 
+// FNV-1a
+inline void hashBytes(unsigned& hash, const void* data, unsigned size)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (unsigned i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+}
+
+// Hash of everything the tessellation depends on: the vertices and the
+// outlines drawn through them.
+unsigned hashPolygon(const osg::Geometry& geom, const osg::Vec3Array& vertices)
+{
+    unsigned hash = 2166136261u;
+    hashBytes(hash, &vertices.front(), vertices.size() * sizeof(osg::Vec3));
+
+    for (unsigned i = 0; i < geom.getNumPrimitiveSets(); ++i)
+    {
+        const osg::PrimitiveSet* primitive = geom.getPrimitiveSet(i);
+        GLenum mode = primitive->getMode();
+        hashBytes(hash, &mode, sizeof(mode));
+
+        if (primitive->getType() == osg::PrimitiveSet::DrawArrayLengthsPrimitiveType)
+        {
+            const osg::DrawArrayLengths* dal = static_cast<const osg::DrawArrayLengths*>(primitive);
+            GLint first = dal->getFirst();
+            hashBytes(hash, &first, sizeof(first));
+            if (!dal->empty())
+                hashBytes(hash, &dal->front(), dal->size() * sizeof(GLsizei));
+        }
+        else if (primitive->getType() == osg::PrimitiveSet::DrawArraysPrimitiveType)
+        {
+            const osg::DrawArrays* da = static_cast<const osg::DrawArrays*>(primitive);
+            GLint first = da->getFirst();
+            GLsizei count = da->getCount();
+            hashBytes(hash, &first, sizeof(first));
+            hashBytes(hash, &count, sizeof(count));
+        }
+        else
+        {
+            for (unsigned j = 0; j < primitive->getNumIndices(); ++j)
+            {
+                unsigned index = primitive->index(j);
+                hashBytes(hash, &index, sizeof(index));
+            }
+        }
+    }
+    return hash;
+}
+
+}
+
+//------------------------------------------------------------------------
+
+TessellationCache::TessellationCache(unsigned maxBytes) :
+_triangles( true, UINT_MAX )
+{
+    _triangles.setMaxCost( maxBytes );
+}
+
+TessellationCache*
+TessellationCache::getShared()
+{
+    static osg::ref_ptr<TessellationCache> s_shared;
+    static Threading::Mutex                s_sharedMutex;
+
+    Threading::ScopedMutexLock lock(s_sharedMutex);
+    if ( !s_shared.valid() )
+        s_shared = new TessellationCache();
+    return s_shared.get();
+}
+
+osg::DrawElementsUInt*
+TessellationCache::get(unsigned long id, unsigned numVerts, unsigned hash)
+{
+    Key key;
+    key._id = id;
+    key._numVerts = numVerts;
+    key._hash = hash;
+
+    Triangles::Record record;
+    if (_triangles.get(key, record))
+    {
+        // a copy, since merging geometries rewrites indices in place.
+        return new osg::DrawElementsUInt(*record.value().get());
+    }
+    return 0L;
+}
+
+void
+TessellationCache::insert(unsigned long id, unsigned numVerts, unsigned hash, const osg::DrawElementsUInt* triangles)
+{
+    if (!triangles)
+        return;
+
+    Key key;
+    key._id = id;
+    key._numVerts = numVerts;
+    key._hash = hash;
+
+    _triangles.insert(key, new osg::DrawElementsUInt(*triangles), triangles->size() * sizeof(GLuint));
+}
+
+void
+TessellationCache::setMaxBytes(unsigned value)
+{
+    _triangles.setMaxCost(value);
+}
+
+const CacheStats
+TessellationCache::getStats() const
+{
+    return _triangles.getStats();
+}
+
+//------------------------------------------------------------------------
+
+bool
+Tessellator::tessellateGeometry(osg::Geometry& geom, TessellationCache* cache, unsigned long id)
+{
+    if (!cache)
+        return tessellateGeometry(geom);
+
+    osg::Vec3Array* vertices = dynamic_cast<osg::Vec3Array*>(geom.getVertexArray());
+
+    if (!vertices || vertices->empty() || geom.getPrimitiveSetList().empty()) return false;
+
+    unsigned hash = hashPolygon(geom, *vertices);
+
+    osg::ref_ptr<osg::DrawElementsUInt> triangles = cache->get(id, vertices->size(), hash);
+    if (triangles.valid())
+    {
+        geom.removePrimitiveSet(0, geom.getNumPrimitiveSets());
+        geom.addPrimitiveSet(triangles.get());
+        return true;
+    }
+
+    if (!tessellateGeometry(geom))
+        return false;
+
+    // gather the triangles from each outline into one list.
+    triangles = new osg::DrawElementsUInt(osg::PrimitiveSet::TRIANGLES);
+    for (unsigned i = 0; i < geom.getNumPrimitiveSets(); ++i)
+    {
+        osg::DrawElementsUInt* de = dynamic_cast<osg::DrawElementsUInt*>(geom.getPrimitiveSet(i));
+        if (!de || de->getMode() != osg::PrimitiveSet::TRIANGLES)
+            return true;
+        triangles->insert(triangles->end(), de->begin(), de->end());
+    }
+
+    geom.removePrimitiveSet(0, geom.getNumPrimitiveSets());
+    geom.addPrimitiveSet(triangles.get());
+
+    cache->insert(id, vertices->size(), hash, triangles.get());
+    return true;
 }
 
 bool
@@ -226,6 +384,20 @@ Tessellator::tessellatePrimitive(osg::PrimitiveSet* primitive, osg::Vec3Array* v
 osg::PrimitiveSet*
 Tessellator::tessellatePrimitive(unsigned int first, unsigned int last, osg::Vec3Array* vertices)
 {
+    // Convex outlines need no ear search; a fan will do.
+    if (last - first >= 3 && isConvexPolygon(*vertices, first, last))
+    {
+        osg::DrawElementsUInt* triElements = new osg::DrawElementsUInt(osg::PrimitiveSet::TRIANGLES, 0);
+        triElements->reserve( (last-first-2) * 3 );
+        for (unsigned int i = first+1; i+1 < last; ++i)
+        {
+            triElements->push_back(first);
+            triElements->push_back(i);
+            triElements->push_back(i+1);
+        }
+        return triElements;
+    }
+
     std::vector<unsigned int> activeVerts;
     activeVerts.reserve( last-first+1 );
     for (unsigned int i=first; i < last; i++)
@@ -362,6 +534,30 @@ Tessellator::isConvex(const osg::Vec3Array &vertices, const std::vector<unsigned
     return (dataB.x() - dataA.x()) * (dataC.y() - dataA.y()) - (dataB.y() - dataA.y()) * (dataC.x() - dataA.x()) > 0.0;
 }
 
+bool
+Tessellator::isConvexPolygon(const osg::Vec3Array &vertices, unsigned int first, unsigned int last)
+{
+    // Every corner must turn left (CCW) and every fan triangle from the
+    // first vertex must be CCW too; the latter rules out outlines that
+    // turn left all the way but wind around more than once.
+    unsigned int n = last - first;
+    const osg::Vec3& origin = vertices[first];
+    for (unsigned int i = 0; i < n; ++i)
+    {
+        const osg::Vec3& a = vertices[first + i];
+        const osg::Vec3& b = vertices[first + (i+1) % n];
+        const osg::Vec3& c = vertices[first + (i+2) % n];
+
+        if (checkCCW(a.x(), a.y(), b.x(), b.y(), c.x(), c.y()) <= 0)
+            return false;
+
+        if (i > 0 && i+1 < n &&
+            checkCCW(origin.x(), origin.y(), a.x(), a.y(), b.x(), b.y()) <= 0)
+            return false;
+    }
+    return true;
+}
+
 bool
 Tessellator::isEar(const osg::Vec3Array &vertices, const std::vector<unsigned int> &activeVerts, unsigned int cursor, bool &tradEar)
 {
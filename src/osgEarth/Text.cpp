@@ -22,6 +22,7 @@
 #include <osgEarth/Shaders>
 #include <osg/Version>
 #include <osgText/Font>
+#include <osg/ValueObject>
 #include <sstream>
 #include <iomanip>
 
@@ -33,6 +34,12 @@ using namespace osgEarth;
 
 #define LC "[Text] "
 
+// Size of the glyph texture for fonts prepared with prepareFont. At the
+// default resolution of 32 this holds well over a thousand glyphs.
+#define PREPARED_FONT_TEXTURE_SIZE 2048
+
+#define PREPARED_FONT_TAG "osgEarth.Text.prepared"
+
 //....................................................................
 
 REGISTER_OBJECT_WRAPPER( osgEarth_Text,
@@ -258,3 +265,37 @@ Text::setFont(osg::ref_ptr<osgText::Font> font)
     osgText::TextBase::setFont(font);
 #endif
 }
+
+void
+Text::prepareFont(osgText::Font* font)
+{
+    if (!font)
+        return;
+
+    static Threading::Mutex mutex;
+    Threading::ScopedMutexLock lock(mutex);
+
+    bool prepared = false;
+    if (font->getUserValue(PREPARED_FONT_TAG, prepared) && prepared)
+        return;
+
+    font->setUserValue(PREPARED_FONT_TAG, true);
+
+#if OSG_VERSION_GREATER_OR_EQUAL(3,5,8)
+    font->setTextureSizeHint(PREPARED_FONT_TEXTURE_SIZE, PREPARED_FONT_TEXTURE_SIZE);
+
+    // Laying out a string builds its glyphs and assigns them to
+    // the font's glyph texture.
+    std::string ascii;
+    for (char c = 32; c < 127; ++c)
+        ascii.push_back(c);
+
+    osg::ref_ptr<Text> warmup = new Text();
+    warmup->setFont(font);
+    warmup->setText(ascii);
+#else
+    // mitigates mipmapping issues that cause rendering artifacts
+    // for some fonts/placement
+    font->setGlyphImageMargin( 2 );
+#endif
+}
@@ -0,0 +1,142 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2016 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/TileAvailability>
+#include <osg/Math>
+#include <sstream>
+
+#define LC "[TileAvailability] "
+
+using namespace osgEarth;
+
+TileAvailability::TileAvailability() :
+_minSubtreeLOD( ~0u ),
+_maxSubtreeLOD( 0u ),
+_unsaved      ( 0u )
+{
+    //nop
+}
+
+void
+TileAvailability::setEmpty(const TileKey& key)
+{
+    if (!key.valid())
+        return;
+
+    Threading::ScopedMutexLock lock(_mutex);
+    if (_tiles.insert(key.getID()).second)
+        ++_unsaved;
+}
+
+void
+TileAvailability::setSubtreeEmpty(const TileKey& key)
+{
+    if (!key.valid())
+        return;
+
+    Threading::ScopedMutexLock lock(_mutex);
+    if (_subtrees.insert(key.getID()).second)
+    {
+        _minSubtreeLOD = osg::minimum(_minSubtreeLOD, key.getLOD());
+        _maxSubtreeLOD = osg::maximum(_maxSubtreeLOD, key.getLOD());
+    }
+}
+
+bool
+TileAvailability::isEmpty(const TileKey& key) const
+{
+    if (!key.valid())
+        return false;
+
+    Threading::ScopedMutexLock lock(_mutex);
+
+    if (!_tiles.empty() && _tiles.find(key.getID()) != _tiles.end())
+        return true;
+
+    if (_subtrees.empty() || key.getLOD() < _minSubtreeLOD)
+        return false;
+
+    // only the LODs that hold a subtree entry need a look.
+    unsigned lod = osg::minimum(key.getLOD(), _maxSubtreeLOD);
+    for (;;)
+    {
+        unsigned d = key.getLOD() - lod;
+        TileKey ancestor(lod, key.getTileX() >> d, key.getTileY() >> d, 0L);
+        if (_subtrees.find(ancestor.getID()) != _subtrees.end())
+            return true;
+        if (lod == _minSubtreeLOD)
+            break;
+        --lod;
+    }
+    return false;
+}
+
+unsigned
+TileAvailability::getNumUnsaved() const
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    return _unsaved;
+}
+
+void
+TileAvailability::clear()
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    _tiles.clear();
+    _subtrees.clear();
+    _minSubtreeLOD = ~0u;
+    _maxSubtreeLOD = 0u;
+    _unsaved = 0u;
+}
+
+Config
+TileAvailability::getConfig() const
+{
+    Threading::ScopedMutexLock lock(_mutex);
+
+    // IDs are space-separated in one value; a child per tile would bloat
+    // the metadata record.
+    std::stringstream buf;
+    for (IDSet::const_iterator i = _tiles.begin(); i != _tiles.end(); ++i)
+    {
+        if (i != _tiles.begin())
+            buf << ' ';
+        buf << *i;
+    }
+    _unsaved = 0u;
+
+    Config conf("availability");
+    if (!_tiles.empty())
+        conf.set("empty", buf.str());
+    return conf;
+}
+
+void
+TileAvailability::merge(const Config& conf)
+{
+    std::string value = conf.value("empty");
+    if (value.empty())
+        return;
+
+    Threading::ScopedMutexLock lock(_mutex);
+
+    std::istringstream in(value);
+    TileKey::ID id;
+    while (in >> id)
+        _tiles.insert(id);
+}
@@ -27,45 +27,59 @@ TileKey TileKey::INVALID( 0, 0, 0, 0L );
 
 //------------------------------------------------------------------------
 
-TileKey::TileKey(unsigned int lod, unsigned int tile_x, unsigned int tile_y, const Profile* profile)
+TileKey::TileKey(unsigned int lod, unsigned int tile_x, unsigned int tile_y, const Profile* profile) :
+_lod    ( lod ),
+_x      ( tile_x ),
+_y      ( tile_y ),
+_profile( profile )
 {
-    _x = tile_x;
-    _y = tile_y;
-    _lod = lod;
-    _profile = profile;
-
-    double width, height;
-    if ( _profile.valid() )
-    {
-        _profile->getTileDimensions(lod, width, height);
-
-        double xmin = _profile->getExtent().xMin() + (width * (double)_x);
-        double ymax = _profile->getExtent().yMax() - (height * (double)_y);
-        double xmax = xmin + width;
-        double ymin = ymax - height;
-
-        _extent = GeoExtent( _profile->getSRS(), xmin, ymin, xmax, ymax );
-
-        _key = Stringify() << _lod << "/" << _x << "/" << _y;
-    }
-    else
-    {
-        _extent = GeoExtent::INVALID;
-        _key = "invalid";
-    }
+    //NOP
 }
 
 TileKey::TileKey( const TileKey& rhs ) :
-_key( rhs._key ),
 _lod(rhs._lod),
 _x(rhs._x),
 _y(rhs._y),
-_profile( rhs._profile.get() ),
-_extent( rhs._extent )
+_profile( rhs._profile.get() )
 {
     //NOP
 }
 
+std::string
+TileKey::str() const
+{
+    if ( !_profile.valid() )
+        return "invalid";
+
+    return Stringify() << _lod << "/" << _x << "/" << _y;
+}
+
+GeoExtent
+TileKey::getExtent() const
+{
+    if ( !_profile.valid() )
+        return GeoExtent::INVALID;
+
+    return GeoExtent( _profile->getSRS(), getBounds() );
+}
+
+Bounds
+TileKey::getBounds() const
+{
+    if ( !_profile.valid() )
+        return Bounds();
+
+    double width, height;
+    _profile->getTileDimensions(_lod, width, height);
+
+    double xmin = _profile->getExtent().xMin() + (width * (double)_x);
+    double ymax = _profile->getExtent().yMax() - (height * (double)_y);
+    double xmax = xmin + width;
+    double ymin = ymax - height;
+
+    return Bounds( xmin, ymin, xmax, ymax );
+}
+
 const Profile*
 TileKey::getProfile() const
 {
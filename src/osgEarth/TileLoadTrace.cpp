@@ -0,0 +1,233 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2016 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/TileLoadTrace>
+#include <osgEarth/Notify>
+#include <map>
+#include <iomanip>
+#include <stdlib.h>
+
+#define LC "[TileLoadTrace] "
+
+using namespace osgEarth;
+
+// Number of slowest tiles to keep for the report.
+#define MAX_SLOWEST 10u
+
+#if defined(_MSC_VER)
+#  define OE_TRACE_THREAD_LOCAL __declspec(thread)
+#else
+#  define OE_TRACE_THREAD_LOCAL __thread
+#endif
+
+namespace
+{
+    OE_TRACE_THREAD_LOCAL TileLoadTrace* s_current = 0L;
+
+    bool s_enabled = ::getenv(OSGEARTH_ENV_TILE_TRACE) != 0L;
+
+    struct StageStats
+    {
+        StageStats() : _count(0u), _total(0.0), _max(0.0) { }
+        unsigned _count;
+        double   _total;
+        double   _max;
+    };
+
+    struct Report
+    {
+        Report() : _tiles(0u), _total(0.0) { }
+
+        ~Report()
+        {
+            // print whatever we collected if tracing came from the environment.
+            if (::getenv(OSGEARTH_ENV_TILE_TRACE) != 0L && _tiles > 0u)
+            {
+                write(std::cout);
+            }
+        }
+
+        void write(std::ostream& out)
+        {
+            Threading::ScopedMutexLock lock(_mutex);
+
+            out << std::fixed << std::setprecision(1)
+                << "Tile load trace: " << _tiles << " tiles, average "
+                << (_tiles > 0u ? _total / (double)_tiles : 0.0) << " ms\n"
+                << std::left << std::setw(16) << "stage"
+                << std::right << std::setw(10) << "tiles"
+                << std::setw(12) << "avg ms"
+                << std::setw(12) << "max ms" << "\n";
+
+            for (std::map<std::string, StageStats>::const_iterator i = _stages.begin(); i != _stages.end(); ++i)
+            {
+                const StageStats& s = i->second;
+                out << std::left << std::setw(16) << i->first
+                    << std::right << std::setw(10) << s._count
+                    << std::setw(12) << (s._count > 0u ? s._total / (double)s._count : 0.0)
+                    << std::setw(12) << s._max << "\n";
+            }
+
+            if (!_slowest.empty())
+            {
+                out << "Slowest tiles:\n";
+                for (unsigned i = 0; i < _slowest.size(); ++i)
+                {
+                    TileLoadTrace* trace = _slowest[i].get();
+                    TileLoadTrace::Stages stages;
+                    trace->getStages(stages);
+
+                    out << "  " << std::left << std::setw(16) << trace->getKey().str()
+                        << std::right << std::setw(8) << trace->getTotal() << " ms :";
+                    for (TileLoadTrace::Stages::const_iterator s = stages.begin(); s != stages.end(); ++s)
+                        out << " " << s->first << "=" << s->second;
+                    out << "\n";
+                }
+            }
+
+            out << std::flush;
+        }
+
+        Threading::Mutex                   _mutex;
+        unsigned                           _tiles;
+        double                             _total;
+        std::map<std::string, StageStats>  _stages;
+        std::vector< osg::ref_ptr<TileLoadTrace> > _slowest; // sorted, slowest first
+    };
+
+    Report& getReport()
+    {
+        static Report s_report;
+        return s_report;
+    }
+}
+
+bool
+TileLoadTrace::enabled()
+{
+    return s_enabled;
+}
+
+void
+TileLoadTrace::setEnabled(bool value)
+{
+    s_enabled = value;
+}
+
+TileLoadTrace*
+TileLoadTrace::current()
+{
+    return s_current;
+}
+
+TileLoadTrace::TileLoadTrace(const TileKey& key) :
+_key  ( key ),
+_total( 0.0 )
+{
+    _start = osg::Timer::instance()->tick();
+}
+
+void
+TileLoadTrace::add(const char* stage, double ms)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    for (Stages::iterator i = _stages.begin(); i != _stages.end(); ++i)
+    {
+        if (i->first == stage)
+        {
+            i->second += ms;
+            return;
+        }
+    }
+    _stages.push_back(std::make_pair(std::string(stage), ms));
+}
+
+void
+TileLoadTrace::addSince(const char* stage, osg::Timer_t since)
+{
+    add(stage, osg::Timer::instance()->delta_m(since, osg::Timer::instance()->tick()));
+}
+
+void
+TileLoadTrace::getStages(Stages& output) const
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    output = _stages;
+}
+
+void
+TileLoadTrace::finish()
+{
+    _total = osg::Timer::instance()->delta_m(_start, osg::Timer::instance()->tick());
+
+    Stages stages;
+    getStages(stages);
+
+    Report& report = getReport();
+    Threading::ScopedMutexLock lock(report._mutex);
+
+    ++report._tiles;
+    report._total += _total;
+
+    for (Stages::const_iterator i = stages.begin(); i != stages.end(); ++i)
+    {
+        StageStats& s = report._stages[i->first];
+        ++s._count;
+        s._total += i->second;
+        s._max = osg::maximum(s._max, i->second);
+    }
+
+    std::vector< osg::ref_ptr<TileLoadTrace> >& slowest = report._slowest;
+    if (slowest.size() < MAX_SLOWEST || _total > slowest.back()->getTotal())
+    {
+        std::vector< osg::ref_ptr<TileLoadTrace> >::iterator i = slowest.begin();
+        while (i != slowest.end() && (*i)->getTotal() >= _total)
+            ++i;
+        slowest.insert(i, this);
+        if (slowest.size() > MAX_SLOWEST)
+            slowest.pop_back();
+    }
+}
+
+void
+TileLoadTrace::writeReport(std::ostream& out)
+{
+    getReport().write(out);
+}
+
+void
+TileLoadTrace::resetReport()
+{
+    Report& report = getReport();
+    Threading::ScopedMutexLock lock(report._mutex);
+    report._tiles = 0u;
+    report._total = 0.0;
+    report._stages.clear();
+    report._slowest.clear();
+}
+
+TileLoadTrace::Scope::Scope(TileLoadTrace* trace) :
+_previous(s_current)
+{
+    s_current = trace;
+}
+
+TileLoadTrace::Scope::~Scope()
+{
+    s_current = _previous;
+}
@@ -20,9 +20,29 @@
 #include <osgEarth/NodeUtils>
 #include <osgEarth/VirtualProgram>
 #include <osgEarth/GLUtils>
+#include <osg/GLExtensions>
+#include <osg/Projection>
+#include <osg/Viewport>
+#include <osg/Scissor>
+#include <cstring>
 
 #define LC "[TileRasterizer] "
 
+#ifndef GL_PIXEL_PACK_BUFFER
+#define GL_PIXEL_PACK_BUFFER 0x88EB
+#endif
+#ifndef GL_STREAM_READ
+#define GL_STREAM_READ 0x88E1
+#endif
+#ifndef GL_READ_ONLY
+#define GL_READ_ONLY 0x88B8
+#endif
+
+// glGetTexImage, which does the async atlas readback, isn't in GLES.
+#if !defined(OSG_GLES1_AVAILABLE) && !defined(OSG_GLES2_AVAILABLE) && !defined(OSG_GLES3_AVAILABLE)
+#define TILE_RASTERIZER_BATCHING 1
+#endif
+
 using namespace osgEarth;
 
 namespace
@@ -60,8 +80,9 @@ namespace
         "} \n";
 }
 
-TileRasterizer::TileRasterizer() :
-osg::Camera()
+TileRasterizer::TileRasterizer(unsigned atlasSize) :
+osg::Camera(),
+_atlasSize(atlasSize)
 {
     // active an update traversal.
     setNumChildrenRequiringUpdateTraversal(1);
@@ -113,6 +134,23 @@ osg::Camera()
     _distortionU = new osg::Uniform("oe_rasterizer_f", 1.0f);
     ss->addUniform(_distortionU.get());
 #endif
+
+#ifndef TILE_RASTERIZER_BATCHING
+    _atlasSize = 0u;
+#endif
+
+    if (_atlasSize > 0u)
+    {
+        // shared render target for batches of image jobs
+        _atlas = new osg::Texture2D();
+        _atlas->setTextureSize(_atlasSize, _atlasSize);
+        _atlas->setInternalFormat(GL_RGBA8);
+        _atlas->setSourceFormat(GL_RGBA);
+        _atlas->setSourceType(GL_UNSIGNED_BYTE);
+        _atlas->setFilter(osg::Texture::MIN_FILTER, osg::Texture::NEAREST);
+        _atlas->setFilter(osg::Texture::MAG_FILTER, osg::Texture::NEAREST);
+        _atlas->setResizeNonPowerOfTwoHint(false);
+    }
 }
 
 TileRasterizer::~TileRasterizer()
@@ -206,7 +244,33 @@ TileRasterizer::traverse(osg::NodeVisitor& nv)
             dirtyAttachmentMap();
         }
 
-        if (!_pendingJobs.empty() && _readbackJobs.empty() && _finishedJobs.empty())
+        if (_batch.valid())
+        {
+            // Drawn and read back; children are no longer needed, but keep the
+            // atlas attached so the camera draws once more to finish the readback.
+            if (_batch->_state == Batch::READBACK_ISSUED && _batch->_root.valid())
+            {
+                removeChild(_batch->_root.get());
+                _batch->_root = 0L;
+            }
+
+            else if (_batch->_state == Batch::DONE)
+            {
+                for (unsigned i = 0; i < _batch->_jobs.size(); ++i)
+                {
+                    Job& job = _batch->_jobs[i];
+                    job._imagePromise.resolve(job._image.get());
+                }
+                if (_batch->_root.valid())
+                    removeChild(_batch->_root.get());
+                _batch = 0L;
+                detach(osg::Camera::COLOR_BUFFER);
+                dirtyAttachmentMap();
+            }
+        }
+
+        if (!_pendingJobs.empty() && _readbackJobs.empty() && _finishedJobs.empty() && !_batch.valid() &&
+            !startBatch(nv.getFrameStamp() ? nv.getFrameStamp()->getFrameNumber() : 0u))
         {
             Job& job = _pendingJobs.front();
 
@@ -262,9 +326,175 @@ TileRasterizer::traverse(osg::NodeVisitor& nv)
     }
 }
 
+bool
+TileRasterizer::startBatch(unsigned frame)
+{
+    // call with _mutex locked.
+    if (!_atlas.valid())
+        return false;
+
+    // shelf-pack image jobs from the front of the queue until the atlas is full.
+    osg::ref_ptr<Batch> batch = new Batch();
+    int x = 0, y = 0, shelf = 0;
+    const int atlasSize = (int)_atlasSize;
+
+    while (!_pendingJobs.empty())
+    {
+        Job& job = _pendingJobs.front();
+        if (!job._image.valid() || job._image->s() > atlasSize || job._image->t() > atlasSize)
+            break;
+
+        int w = job._image->s(), h = job._image->t();
+        if (x + w > atlasSize)
+        {
+            x = 0;
+            y += shelf;
+            shelf = 0;
+        }
+        if (y + h > atlasSize)
+            break;
+
+        batch->_jobs.push_back(job);
+        batch->_offsets.push_back(osg::Vec2i(x, y));
+        x += w;
+        shelf = osg::maximum(shelf, h);
+        _pendingJobs.pop();
+    }
+
+    if (batch->_jobs.empty())
+        return false;
+
+    // Each job renders into its own window of the atlas with its own projection:
+    batch->_root = new osg::Group();
+    for (unsigned i = 0; i < batch->_jobs.size(); ++i)
+    {
+        const Job& job = batch->_jobs[i];
+        const osg::Vec2i& offset = batch->_offsets[i];
+
+        osg::Projection* proj = new osg::Projection(osg::Matrix::ortho2D(
+            job._extent.xMin(), job._extent.xMax(),
+            job._extent.yMin(), job._extent.yMax()));
+
+        osg::StateSet* ss = proj->getOrCreateStateSet();
+        ss->setAttribute(new osg::Viewport(offset.x(), offset.y(), job._image->s(), job._image->t()));
+        ss->setAttributeAndModes(new osg::Scissor(offset.x(), offset.y(), job._image->s(), job._image->t()), 1);
+
+        proj->addChild(job._node.get());
+        batch->_root->addChild(proj);
+    }
+
+    setProjectionMatrixAsOrtho2D(-1.0, 1.0, -1.0, 1.0);
+    setViewport(0, 0, _atlasSize, _atlasSize);
+    attach(COLOR_BUFFER, _atlas.get(), 0u, 0u, /*mipmap=*/false);
+    dirtyAttachmentMap();
+
+    addChild(batch->_root.get());
+    batch->_startFrame = frame;
+    _batch = batch.get();
+
+    OE_DEBUG << LC << "Batched " << batch->_jobs.size() << " image jobs" << std::endl;
+    return true;
+}
+
+void
+TileRasterizer::issueReadback(osg::RenderInfo& ri) const
+{
+#ifdef TILE_RASTERIZER_BATCHING
+    // call with _mutex locked, after the batch has drawn.
+    osg::State* state = ri.getState();
+    unsigned contextID = state->getContextID();
+    osg::GLExtensions* ext = osg::GLExtensions::Get(contextID, true);
+
+    osg::Texture::TextureObject* to = _atlas->getTextureObject(contextID);
+    if (!to || !ext || !ext->isPBOSupported)
+    {
+        OE_WARN << LC << "Atlas readback not possible; dropping " << _batch->_jobs.size() << " jobs" << std::endl;
+        _batch->_state = Batch::DONE;
+        return;
+    }
+
+    GLuint& pbo = _pbo[contextID];
+    if (pbo == 0)
+    {
+        ext->glGenBuffers(1, &pbo);
+        ext->glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+        ext->glBufferData(GL_PIXEL_PACK_BUFFER, _atlasSize*_atlasSize*4, 0L, GL_STREAM_READ);
+    }
+    else
+    {
+        ext->glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+    }
+
+    // Copy the atlas into the PBO. This returns right away; we don't touch
+    // the data until next frame, by which time the copy is done.
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glBindTexture(GL_TEXTURE_2D, to->id());
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0L);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    ext->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    state->haveAppliedTextureAttribute(state->getActiveTextureUnit(), osg::StateAttribute::TEXTURE);
+
+    _batch->_readbackFrame = state->getFrameStamp() ? state->getFrameStamp()->getFrameNumber() : 0u;
+    _batch->_state = Batch::READBACK_ISSUED;
+#endif
+}
+
+void
+TileRasterizer::completeReadback(osg::RenderInfo& ri) const
+{
+#ifdef TILE_RASTERIZER_BATCHING
+    // call with _mutex locked.
+    osg::State* state = ri.getState();
+    unsigned contextID = state->getContextID();
+    osg::GLExtensions* ext = osg::GLExtensions::Get(contextID, true);
+
+    ext->glBindBuffer(GL_PIXEL_PACK_BUFFER, _pbo[contextID]);
+    const unsigned char* data = (const unsigned char*)ext->glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+    if (data)
+    {
+        // split the atlas into the individual job images:
+        for (unsigned i = 0; i < _batch->_jobs.size(); ++i)
+        {
+            osg::Image* image = _batch->_jobs[i]._image.get();
+            const osg::Vec2i& offset = _batch->_offsets[i];
+            unsigned rowBytes = image->s() * 4;
+
+            for (int t = 0; t < image->t(); ++t)
+            {
+                const unsigned char* src = data + ((offset.y() + t)*_atlasSize + offset.x()) * 4;
+                ::memcpy(image->data(0, t), src, rowBytes);
+            }
+            image->dirty();
+        }
+        ext->glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    else
+    {
+        OE_WARN << LC << "Failed to map the atlas readback buffer" << std::endl;
+    }
+    ext->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    _batch->_state = Batch::DONE;
+#endif
+}
+
 void
 TileRasterizer::preDraw(osg::RenderInfo& ri) const
 {
+    if (_batch.valid())
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+
+        // readback was issued last frame (or earlier), so mapping won't stall:
+        if (_batch.valid() && _batch->_state == Batch::READBACK_ISSUED &&
+            ri.getState()->getFrameStamp() &&
+            ri.getState()->getFrameStamp()->getFrameNumber() > _batch->_readbackFrame)
+        {
+            completeReadback(ri);
+        }
+    }
+
     if (!_readbackJobs.empty())
     {
         Threading::ScopedMutexLock lock(_mutex);
@@ -283,6 +513,20 @@ TileRasterizer::preDraw(osg::RenderInfo& ri) const
 void
 TileRasterizer::postDraw(osg::RenderInfo& ri) const
 {
+    if (_batch.valid())
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+
+        // With a separate draw thread the previous frame may still be drawing
+        // when the batch is set up, so make sure this draw actually included it.
+        const osg::FrameStamp* fs = ri.getState()->getFrameStamp();
+        if (_batch.valid() && _batch->_state == Batch::RENDERING &&
+            (!fs || fs->getFrameNumber() >= _batch->_startFrame))
+        {
+            issueReadback(ri);
+        }
+    }
+
     if (!_readbackJobs.empty())
     {
         Threading::ScopedMutexLock lock(_mutex);
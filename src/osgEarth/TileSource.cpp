@@ -22,8 +22,13 @@
 #include <osgEarth/ImageToHeightFieldConverter>
 #include <osgEarth/Registry>
 #include <osgEarth/Progress>
+#include <osgEarth/JobScheduler>
+#include <osgEarth/TileLoadTrace>
 #include <osgDB/FileUtils>
 #include <osgDB/FileNameUtils>
+#include <algorithm>
+#include <iterator>
+#include <fstream>
 
 #define LC "[TileSource] "
 
@@ -34,37 +39,176 @@ using namespace osgEarth;
 
 //------------------------------------------------------------------------
 
+// Persisted blacklists start with this, followed by a version, a count and
+// the packed tile IDs (all little-endian). Older files are plain text,
+// one "lod x y" per line.
+#define BLACKLIST_MAGIC   "OEBL"
+#define BLACKLIST_VERSION 1u
+
+namespace
+{
+    void writeU64(std::ostream& out, unsigned long long value)
+    {
+        char buf[8];
+        for (unsigned i = 0; i < 8; ++i)
+            buf[i] = (char)((value >> (8u * i)) & 0xFF);
+        out.write(buf, 8);
+    }
+
+    bool readU64(std::istream& in, unsigned long long& value)
+    {
+        unsigned char buf[8];
+        if (!in.read((char*)buf, 8))
+            return false;
+        value = 0;
+        for (unsigned i = 0; i < 8; ++i)
+            value |= ((unsigned long long)buf[i]) << (8u * i);
+        return true;
+    }
+}
+
 TileBlacklist::TileBlacklist() :
-_tiles(true, 1024)
+_size( 0 )
 {
     //NOP
 }
 
+TileBlacklist::Shard&
+TileBlacklist::getShard(TileKey::ID id) const
+{
+    // mix X into Y so neighboring tiles land in different shards
+    return _shards[(id ^ (id >> 29)) % NUM_SHARDS];
+}
+
+bool
+TileBlacklist::Shard::find(TileKey::ID id) const
+{
+    return
+        std::binary_search(_sorted.begin(), _sorted.end(), id) ||
+        std::find(_pending.begin(), _pending.end(), id) != _pending.end();
+}
+
+void
+TileBlacklist::Shard::flush()
+{
+    std::sort(_pending.begin(), _pending.end());
+    std::vector<TileKey::ID> merged;
+    merged.reserve(_sorted.size() + _pending.size());
+    std::merge(_sorted.begin(), _sorted.end(), _pending.begin(), _pending.end(), std::back_inserter(merged));
+    _sorted.swap(merged);
+    _pending.clear();
+}
+
+bool
+TileBlacklist::insert(TileKey::ID id)
+{
+    Shard& shard = getShard(id);
+    Threading::ScopedWriteLock lock(shard._mutex);
+    if (shard.find(id))
+        return false;
+
+    // new entries go to a short unsorted list, and get merged into the
+    // sorted one in batches.
+    shard._pending.push_back(id);
+    if (shard._pending.size() >= MAX_PENDING)
+        shard.flush();
+
+    ++_size;
+    return true;
+}
+
 void
 TileBlacklist::add(const TileKey& key)
 {
-    _tiles.insert(key, true);
-    OE_DEBUG << "Added " << key.str() << " to blacklist" << std::endl;
+    if (insert(key.getID()))
+    {
+        OE_DEBUG << "Added " << key.str() << " to blacklist" << std::endl;
+    }
 }
 
 void
 TileBlacklist::remove(const TileKey& key)
 {
-    _tiles.erase(key);
+    TileKey::ID id = key.getID();
+    Shard& shard = getShard(id);
+    Threading::ScopedWriteLock lock(shard._mutex);
+
+    std::vector<TileKey::ID>::iterator i = std::lower_bound(shard._sorted.begin(), shard._sorted.end(), id);
+    if (i != shard._sorted.end() && *i == id)
+    {
+        shard._sorted.erase(i);
+        --_size;
+    }
+    else
+    {
+        i = std::find(shard._pending.begin(), shard._pending.end(), id);
+        if (i != shard._pending.end())
+        {
+            *i = shard._pending.back();
+            shard._pending.pop_back();
+            --_size;
+        }
+    }
     OE_DEBUG << "Removed " << key.str() << " from blacklist" << std::endl;
 }
 
 void
 TileBlacklist::clear()
 {
-    _tiles.clear();
+    // hold every shard so the count stays in step with the contents.
+    for (unsigned s = 0; s < NUM_SHARDS; ++s)
+        _shards[s]._mutex.writeLock();
+
+    for (unsigned s = 0; s < NUM_SHARDS; ++s)
+    {
+        _shards[s]._sorted.clear();
+        _shards[s]._pending.clear();
+    }
+    _size.exchange(0);
+
+    for (unsigned s = 0; s < NUM_SHARDS; ++s)
+        _shards[s]._mutex.writeUnlock();
+
     OE_DEBUG << "Cleared blacklist" << std::endl;
 }
 
 bool
 TileBlacklist::contains(const TileKey& key) const
 {
-    return _tiles.has(key);
+    // most sources never blacklist anything; skip the lock.
+    if (_size == 0)
+        return false;
+
+    TileKey::ID id = key.getID();
+    Shard& shard = getShard(id);
+    Threading::ScopedReadLock lock(shard._mutex);
+    return shard.find(id);
+}
+
+unsigned
+TileBlacklist::size() const
+{
+    return _size;
+}
+
+void
+TileBlacklist::merge(const TileBlacklist& rhs)
+{
+    std::vector<TileKey::ID> ids;
+    rhs.getIDs(ids);
+    for (std::vector<TileKey::ID>::const_iterator i = ids.begin(); i != ids.end(); ++i)
+        insert(*i);
+}
+
+void
+TileBlacklist::getIDs(std::vector<TileKey::ID>& output) const
+{
+    for (unsigned s = 0; s < NUM_SHARDS; ++s)
+    {
+        Threading::ScopedReadLock lock(_shards[s]._mutex);
+        output.insert(output.end(), _shards[s]._sorted.begin(), _shards[s]._sorted.end());
+        output.insert(output.end(), _shards[s]._pending.begin(), _shards[s]._pending.end());
+    }
 }
 
 TileBlacklist*
@@ -72,6 +216,27 @@ TileBlacklist::read(std::istream &in)
 {
     osg::ref_ptr< TileBlacklist > result = new TileBlacklist();
 
+    char magic[4];
+    if (in.read(magic, 4) && std::string(magic, 4) == BLACKLIST_MAGIC)
+    {
+        unsigned long long version, count, id;
+        if (!readU64(in, version) || version != BLACKLIST_VERSION || !readU64(in, count))
+        {
+            OE_WARN << "Unsupported blacklist version" << std::endl;
+            return 0L;
+        }
+
+        for (unsigned long long i = 0; i < count && readU64(in, id); ++i)
+        {
+            result->insert(id);
+        }
+        return result.release();
+    }
+
+    // not binary; fall back on the old text format.
+    in.clear();
+    in.seekg(0, std::ios::beg);
+
     while (!in.eof())
     {
         std::string line;
@@ -95,7 +260,7 @@ TileBlacklist::read(const std::string &filename)
 {
     if (osgDB::fileExists(filename) && (osgDB::fileType(filename) == osgDB::REGULAR_FILE))
     {
-        std::ifstream in( filename.c_str() );
+        std::ifstream in( filename.c_str(), std::ios::binary );
         return read( in );
     }
     return NULL;
@@ -110,25 +275,31 @@ TileBlacklist::write(const std::string &filename) const
         OE_NOTICE << "Couldn't create path " << path << std::endl;
         return;
     }
-    std::ofstream out(filename.c_str());
-    write(out);
-}
 
-namespace {
-    struct WriteFunctor : public LRUCache<TileKey,bool>::Functor {
-        std::ostream& _out;
-        WriteFunctor(std::ostream& out) : _out(out) { }
-        void operator()(const TileKey& key, const bool& value) {
-            _out << key.getLOD() << ' ' << key.getTileX() << ' ' << key.getTileY() << std::endl;
-        }
-    };
+    // Another process sharing the file may have added tiles since we read
+    // it; keep them.
+    osg::ref_ptr<TileBlacklist> merged = new TileBlacklist();
+    osg::ref_ptr<TileBlacklist> existing = read(filename);
+    if (existing.valid())
+        merged->merge(*existing.get());
+    merged->merge(*this);
+
+    std::ofstream out(filename.c_str(), std::ios::binary);
+    merged->write(out);
 }
 
 void
 TileBlacklist::write(std::ostream &output) const
 {
-    WriteFunctor writer(output);
-    _tiles.iterate(writer);
+    std::vector<TileKey::ID> ids;
+    getIDs(ids);
+    std::sort(ids.begin(), ids.end());
+
+    output.write(BLACKLIST_MAGIC, 4);
+    writeU64(output, BLACKLIST_VERSION);
+    writeU64(output, ids.size());
+    for (std::vector<TileKey::ID>::const_iterator i = ids.begin(); i != ids.end(); ++i)
+        writeU64(output, *i);
 }
 
 
@@ -139,6 +310,7 @@ TileSourceOptions::TileSourceOptions( const ConfigOptions& options ) :
 DriverConfigOptions   ( options ),
 _L2CacheSize          ( 16 ),
 _bilinearReprojection ( true ),
+_bicubicReprojection  ( false ),
 _coverage             ( false )
 {
     fromConfig( _conf );
@@ -152,6 +324,7 @@ TileSourceOptions::getConfig() const
     conf.set( "blacklist_filename", _blacklistFilename);
     conf.set( "l2_cache_size", _L2CacheSize );
     conf.set( "bilinear_reprojection", _bilinearReprojection );
+    conf.set( "bicubic_reprojection", _bicubicReprojection );
     conf.set( "coverage", _coverage );
     conf.set( "osg_option_string", _osgOptionString );
     conf.setObj( "profile", _profileOptions );
@@ -173,6 +346,7 @@ TileSourceOptions::fromConfig( const Config& conf )
     conf.getIfSet( "blacklist_filename", _blacklistFilename);
     conf.getIfSet( "l2_cache_size", _L2CacheSize );
     conf.getIfSet( "bilinear_reprojection", _bilinearReprojection );
+    conf.getIfSet( "bicubic_reprojection", _bicubicReprojection );
     conf.getIfSet( "coverage", _coverage );
     conf.getIfSet( "osg_option_string", _osgOptionString );
     conf.getObjIfSet( "profile", _profileOptions );
@@ -317,6 +491,8 @@ TileSource::createImage(const TileKey&        key,
     if (getStatus().isError())
         return 0L;
 
+    TileLoadTrace::ScopedStage traceStage("source");
+
     // Try to get it from the memcache fist
     if (_memCache.valid())
     {
@@ -348,6 +524,41 @@ TileSource::createImage(const TileKey&        key,
     return newImage.release();
 }
 
+namespace
+{
+    struct CreateImageTask : public TaskRequest
+    {
+        CreateImageTask(TileSource* source, const TileKey& key, TileSource::ImageOperation* op, ProgressCallback* progress) :
+            _source(source), _key(key), _op(op), _progress(progress), _trace(TileLoadTrace::current()) { }
+
+        void operator()(ProgressCallback*)
+        {
+            TileLoadTrace::Scope traceScope(_trace.get());
+            osg::ref_ptr<TileSource> source;
+            if (_source.lock(source))
+                _promise.resolve(source->createImage(_key, _op.get(), _progress.get()));
+        }
+
+        osg::observer_ptr<TileSource>   _source;
+        TileKey                         _key;
+        osg::ref_ptr<TileSource::ImageOperation> _op;
+        osg::ref_ptr<ProgressCallback>  _progress;
+        Threading::Promise<osg::Image>  _promise;
+        osg::ref_ptr<TileLoadTrace>     _trace;
+    };
+}
+
+Threading::Future<osg::Image>
+TileSource::createImageAsync(const TileKey&        key,
+                             ImageOperation*       prepOp,
+                             ProgressCallback*     progress)
+{
+    CreateImageTask* task = new CreateImageTask(this, key, prepOp, progress);
+    Threading::Future<osg::Image> result = task->_promise.getFuture();
+    Registry::instance()->getJobScheduler()->submit(task);
+    return result;
+}
+
 osg::HeightField*
 TileSource::createHeightField(const TileKey&        key,
                               HeightFieldOperation* prepOp,
@@ -356,6 +567,8 @@ TileSource::createHeightField(const TileKey&        key,
     if (getStatus().isError())
         return 0L;
 
+    TileLoadTrace::ScopedStage traceStage("source");
+
     // Try to get it from the memcache first:
     if (_memCache.valid())
     {
@@ -458,6 +671,12 @@ TileSource::getBlacklist() const
     return _blacklist.get();
 }
 
+size_t
+TileSource::getL2CacheBytes() const
+{
+    return _memCache.valid() ? _memCache->getTotalBytes() : 0u;
+}
+
 //------------------------------------------------------------------------
 
 #undef  LC
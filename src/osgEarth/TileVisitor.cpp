@@ -19,6 +19,16 @@
 #include <osgEarth/TileVisitor>
 #include <osgEarth/CacheEstimator>
 #include <osgEarth/FileUtils>
+#include <osgEarth/Registry>
+#include <osgEarth/Random>
+#include <osgEarth/DateTime>
+#include <osgDB/FileNameUtils>
+#include <osgDB/FileUtils>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
 
 #if OSG_VERSION_GREATER_OR_EQUAL(3,5,10)
 #include <osg/os_utils>
@@ -29,9 +39,221 @@
 
 using namespace osgEarth;
 
+#define LC "[TileVisitor] "
+
+TileCheckpoint::TileCheckpoint(const std::string& filename, unsigned level) :
+_filename( filename ),
+_level   ( level )
+{
+    //nop
+}
+
+void TileCheckpoint::setScope(const std::string& scope)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    _scope = scope;
+}
+
+unsigned TileCheckpoint::load()
+{
+    Threading::ScopedMutexLock lock(_mutex);
+
+    std::ifstream in( _filename.c_str(), std::ios::in );
+
+    unsigned count = 0;
+    std::string line;
+    while( getline(in, line) )
+    {
+        // lod, x, y, scope (the scope may itself contain commas)
+        std::string::size_type pos = 0;
+        for (unsigned i = 0; i < 3 && pos != std::string::npos; ++i)
+        {
+            pos = line.find(',', pos);
+            if (pos != std::string::npos)
+                ++pos;
+        }
+        if (pos == std::string::npos)
+            continue;
+
+        std::vector< std::string > parts;
+        StringTokenizer(line.substr(0, pos-1), parts, ",", "", true, true);
+        if (parts.size() == 3)
+        {
+            std::string scope = trim(line.substr(pos));
+            _done.insert( scope + "|" + parts[0] + "/" + parts[1] + "/" + parts[2] );
+            ++count;
+        }
+    }
+    return count;
+}
+
+bool TileCheckpoint::isDone(const TileKey& key) const
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    return _done.find(_scope + "|" + key.str()) != _done.end();
+}
+
+void TileCheckpoint::markDone(const TileKey& key)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+
+    if (!_done.insert(_scope + "|" + key.str()).second)
+        return;
+
+    if (!_out.is_open())
+    {
+        _out.open( _filename.c_str(), std::ios::out | std::ios::app );
+        if (!_out.is_open())
+        {
+            OE_WARN << LC << "Failed to open checkpoint file " << _filename << std::endl;
+            return;
+        }
+    }
+
+    // flush every line so a crash loses at most the subtree in progress.
+    _out << key.getLevelOfDetail() << ", " << key.getTileX() << ", " << key.getTileY() << ", " << _scope << std::endl;
+}
+
+/*****************************************************************************************/
+
+// Longest path segment (m) before it is split up; keeps the straight
+// world-space segments close to the surface on a round earth.
+#define MAX_SEGMENT_LENGTH 10000.0
+
+FlightPathFilter::FlightPathFilter(const Profile* profile, float minTileRangeFactor) :
+_profile( profile ),
+_rangeFactor( minTileRangeFactor )
+{
+    //nop
+}
+
+void FlightPathFilter::addPoint(const GeoPoint& input)
+{
+    GeoPoint point;
+    if (!_profile.valid() || !input.transform(_profile->getSRS(), point))
+    {
+        OE_WARN << LC << "Failed to transform path point " << input.toString() << std::endl;
+        return;
+    }
+
+    osg::Vec3d world;
+    if (!point.toWorld(world))
+        return;
+
+    // Split long segments so they don't cut under the curve of the earth.
+    if (!_points.empty())
+    {
+        const GeoPoint& prev = _geoPoints.back();
+        unsigned numSteps = (unsigned)ceil((world - _points.back()).length() / MAX_SEGMENT_LENGTH);
+
+        // take the short way around the antimeridian
+        double dx = point.x() - prev.x();
+        if (point.getSRS()->isGeographic())
+        {
+            if (dx > 180.0) dx -= 360.0;
+            else if (dx < -180.0) dx += 360.0;
+        }
+
+        for (unsigned i = 1; i < numSteps; ++i)
+        {
+            double t = (double)i / (double)numSteps;
+            GeoPoint mid(
+                point.getSRS(),
+                prev.x() + dx*t,
+                prev.y() + (point.y() - prev.y())*t,
+                prev.z() + (point.z() - prev.z())*t,
+                ALTMODE_ABSOLUTE);
+
+            osg::Vec3d midWorld;
+            if (mid.toWorld(midWorld))
+            {
+                _geoPoints.push_back(mid);
+                _points.push_back(midWorld);
+            }
+        }
+    }
+
+    _geoPoints.push_back(point);
+    _points.push_back(world);
+}
+
+double FlightPathFilter::getRange(unsigned lod) const
+{
+    Threading::ScopedMutexLock lock(_rangesMutex);
+
+    // Same calculation as the engines' selection info.
+    while (_ranges.size() <= lod)
+    {
+        TileKey key((unsigned)_ranges.size(), 0, 0, _profile.get());
+        GeoCircle c = key.getExtent().computeBoundingGeoCircle();
+        _ranges.push_back(c.getRadius() * _rangeFactor * 2.0);
+    }
+    return _ranges[lod];
+}
+
+GeoExtent FlightPathFilter::getExtent(unsigned minLevel) const
+{
+    GeoExtent extent(_profile->getSRS());
+    double r = getRange(minLevel);
+
+    for (std::vector<GeoPoint>::const_iterator p = _geoPoints.begin(); p != _geoPoints.end(); ++p)
+    {
+        double dx = r, dy = r;
+        if (p->getSRS()->isGeographic())
+        {
+            // meters to degrees
+            dy = r / 111320.0;
+            dx = dy / osg::maximum(cos(osg::DegreesToRadians(p->y())), 0.01);
+        }
+        extent.expandToInclude(p->x() - dx, p->y() - dy);
+        extent.expandToInclude(p->x() + dx, p->y() + dy);
+    }
+
+    GeoExtent clamped = _profile->clampAndTransformExtent(extent);
+    return clamped.isValid() ? clamped : _profile->getExtent();
+}
+
+bool FlightPathFilter::accept(const TileKey& key) const
+{
+    if (_points.empty())
+        return false;
+
+    GeoCircle circle = key.getExtent().computeBoundingGeoCircle();
+    GeoPoint center = circle.getCenter();
+    center.z() = 0.0;
+    center.altitudeMode() = ALTMODE_ABSOLUTE;
+
+    osg::Vec3d c;
+    if (!center.toWorld(c))
+        return true;
+
+    // Any part of the tile within the visibility range of the path?
+    double limit = getRange(key.getLOD()) + circle.getRadius();
+    double limit2 = limit*limit;
+
+    if (_points.size() == 1)
+    {
+        return (c - _points[0]).length2() < limit2;
+    }
+
+    for (unsigned i = 0; i+1 < _points.size(); ++i)
+    {
+        const osg::Vec3d& a = _points[i];
+        osg::Vec3d ab = _points[i+1] - a;
+        double len2 = ab.length2();
+        double t = len2 > 0.0 ? osg::clampBetween(((c - a) * ab) / len2, 0.0, 1.0) : 0.0;
+        if ((a + ab*t - c).length2() < limit2)
+            return true;
+    }
+    return false;
+}
+
+/*****************************************************************************************/
+
 TileVisitor::TileVisitor():
 _total(0),
 _processed(0),
+_skipped(0),
 _minLevel(0),
 _maxLevel(5)
 {
@@ -42,6 +264,7 @@ TileVisitor::TileVisitor(TileHandler* handler):
 _tileHandler( handler ),
 _total(0),
 _processed(0),
+_skipped(0),
 _minLevel(0),
 _maxLevel(5)
 {
@@ -51,6 +274,7 @@ void TileVisitor::resetProgress()
 {
     _total = 0;
     _processed = 0;
+    _skipped = 0;
 }
 
 void TileVisitor::addExtent( const GeoExtent& extent )
@@ -102,6 +326,11 @@ void TileVisitor::run( const Profile* mapProfile )
     {
         processKey( keys[i] );
     }
+
+    if (_skipped > 0)
+    {
+        OE_INFO << LC << "Skipped " << _skipped << " subtrees already finished in " << _checkpoint->getFilename() << std::endl;
+    }
 }
 
 void TileVisitor::estimate()
@@ -130,12 +359,31 @@ void TileVisitor::processKey( const TileKey& key )
     key.getTileXY(x, y);
     lod = key.getLevelOfDetail();    
 
+    // Skip subtrees finished in a previous run.
+    bool checkpoint = _checkpoint.valid() && lod == _checkpoint->getLevel();
+    if (checkpoint && _checkpoint->isDone(key))
+    {
+        ++_skipped;
+        return;
+    }
+
+    // Skip keys (and their subtrees) outside the filter.
+    if (_keyFilter.valid() && !_keyFilter->accept(key))
+    {
+        return;
+    }
+
     // Only process this key if it has a chance of succeeding.
     if (_tileHandler && !_tileHandler->hasData(key))
     {                
         return;
     }    
 
+    if (checkpoint)
+    {
+        beginSubtree(key);
+    }
+
     bool traverseChildren = false;
 
     // If the key intersects the extent attempt to traverse
@@ -162,6 +410,26 @@ void TileVisitor::processKey( const TileKey& key )
             processKey( k );
         }                                
     }       
+
+    if (checkpoint)
+    {
+        endSubtree(key);
+    }
+}
+
+void TileVisitor::beginSubtree( const TileKey& key )
+{
+    //nop
+}
+
+void TileVisitor::endSubtree( const TileKey& key )
+{
+    // Every tile below the key was handled synchronously, so unless we
+    // were interrupted the subtree is finished.
+    if (!isCanceled())
+    {
+        _checkpoint->markDone(key);
+    }
 }
 
 void TileVisitor::incrementProgress(unsigned int amount)
@@ -202,12 +470,14 @@ bool TileVisitor::handleTile( const TileKey& key )
 class HandleTileTask : public TaskRequest
 {
 public:
-    HandleTileTask( TileHandler* handler, TileVisitor* visitor, const TileKey& key ):      
+    HandleTileTask( TileHandler* handler, TileVisitor* visitor, const TileKey& key, MultithreadedTileVisitor::Subtree* subtree ):      
       _handler( handler ),
           _visitor(visitor),
-          _key( key )
+          _key( key ),
+          _subtree( subtree )
       {
-
+          if (_subtree.valid())
+              _subtree->acquire();
       }
 
       virtual void operator()(ProgressCallback* progress )
@@ -217,13 +487,34 @@ public:
               _handler->handleTile( _key, *_visitor.get() );
               _visitor->incrementProgress(1);
           }
+
+          // A canceled job never gets here, so its subtree is never marked finished.
+          if (_subtree.valid())
+              _subtree->release();
       }
 
       osg::ref_ptr<TileHandler> _handler;
       TileKey _key;
       osg::ref_ptr<TileVisitor> _visitor;
+      osg::ref_ptr<MultithreadedTileVisitor::Subtree> _subtree;
 };
 
+MultithreadedTileVisitor::Subtree::Subtree(TileCheckpoint* checkpoint, const TileKey& key, JobGroup* jobs) :
+_checkpoint( checkpoint ),
+_key( key ),
+_jobs( jobs ),
+_pending( 1u ) // held by the traversal until it leaves the subtree
+{
+}
+
+void MultithreadedTileVisitor::Subtree::release()
+{
+    if (--_pending == 0u && !_jobs->isCanceled())
+    {
+        _checkpoint->markDone(_key);
+    }
+}
+
 MultithreadedTileVisitor::MultithreadedTileVisitor():
 _numThreads( OpenThreads::GetNumberOfProcessors() )
 {
@@ -250,25 +541,20 @@ void MultithreadedTileVisitor::setNumThreads( unsigned int numThreads)
 
 void MultithreadedTileVisitor::run(const Profile* mapProfile)
 {                   
-    // Start up the task service
     OE_INFO << "Starting " << _numThreads << std::endl;
-    _taskService = new TaskService( "MTTileHandler", _numThreads, 1000 );
+    _jobs = new JobGroup();
 
     // Produce the tiles
     TileVisitor::run( mapProfile );
 
-    // Send a poison pill to kill all the threads
-    _taskService->add( new PoisonPill() );
-
-    OE_INFO << "Waiting on threads to complete" << _taskService->getNumRequests() << " tasks remaining" << std::endl;
+    OE_INFO << "Waiting on threads to complete" << _jobs->getNumPending() << " tasks remaining" << std::endl;
 
     // Wait for everything to finish, checking for cancellation while we wait so we can kill all the existing tasks.
-    while (_taskService->areThreadsRunning())
+    while (!_jobs->wait(0u, 10u))
     {
-        OpenThreads::Thread::microSleep(10000);
         if (_progress && _progress->isCanceled())
         {            
-            _taskService->cancelAll();
+            _jobs->cancel();
         }
     }
     OE_INFO << "All threads have completed" << std::endl;
@@ -276,11 +562,45 @@ void MultithreadedTileVisitor::run(const Profile* mapProfile)
 
 bool MultithreadedTileVisitor::handleTile( const TileKey& key )        
 {    
-    // Add the tile to the task queue.
-    _taskService->add( new HandleTileTask(_tileHandler.get(), this, key ) );
+    // Throttle so we never occupy more than _numThreads workers on the shared scheduler.
+    unsigned maxInFlight = osg::maximum(_numThreads, 1u) - 1u;
+    while (!_jobs->wait(maxInFlight, 10u))
+    {
+        if (_progress && _progress->isCanceled())
+        {
+            _jobs->cancel();
+            return false;
+        }
+    }
+
+    if (_jobs->isCanceled())
+        return false;
+
+    // Add the tile to the job queue.
+    Registry::instance()->getJobScheduler()->submit(
+        new HandleTileTask(_tileHandler.get(), this, key, _subtree.get()),
+        JobScheduler::LANE_NORMAL,
+        _jobs.get() );
+
     return true;
 }
 
+void MultithreadedTileVisitor::beginSubtree( const TileKey& key )
+{
+    _subtree = new Subtree(_checkpoint.get(), key, _jobs.get());
+}
+
+void MultithreadedTileVisitor::endSubtree( const TileKey& key )
+{
+    // Let go of the traversal's hold; the last job out marks it finished.
+    // An interrupted traversal keeps its hold so the subtree stays unfinished.
+    if (_subtree.valid() && !isCanceled())
+    {
+        _subtree->release();
+    }
+    _subtree = 0L;
+}
+
 /*****************************************************************************************/
 
 TaskList::TaskList(const Profile* profile):
@@ -482,6 +802,342 @@ void MultiprocessTileVisitor::processBatch()
 }
 
 
+/*****************************************************************************************/
+
+// Files in the work folder:
+//   <serial>_<count>.tiles                    batch waiting for a worker
+//   <serial>_<count>.tiles.<worker>.lease     batch leased by a worker
+//   <serial>_<count>.tiles.done               finished batch
+//   traversal.complete                        the coordinator wrote every batch
+#define BATCH_EXT       ".tiles"
+#define LEASE_EXT       ".lease"
+#define DONE_EXT        ".done"
+#define TEMP_EXT        ".tmp"
+#define COMPLETE_MARKER "traversal.complete"
+
+namespace
+{
+    // number of keys in a batch, from its file name
+    unsigned getBatchCount(const std::string& name)
+    {
+        std::string::size_type start = name.find('_');
+        std::string::size_type end = name.find(BATCH_EXT);
+        if (start == std::string::npos || end == std::string::npos || end <= start)
+            return 0u;
+        return as<unsigned>(name.substr(start+1, end-start-1), 0u);
+    }
+
+    // name of the batch a lease or done file belongs to
+    std::string getBatchName(const std::string& name)
+    {
+        std::string::size_type end = name.find(BATCH_EXT);
+        return end == std::string::npos ? name : name.substr(0, end) + BATCH_EXT;
+    }
+
+    // host name plus a random suffix; only needs to be unique to its leases
+    std::string makeWorkerName()
+    {
+        const char* host = ::getenv("HOSTNAME");
+        if (!host) host = ::getenv("COMPUTERNAME");
+        Random prng( (unsigned)osg::Timer::instance()->tick() );
+        return Stringify() << (host ? host : "worker") << "-" << std::hex << prng.next(0x7fffffff);
+    }
+
+    // refresh a lease if a third of its timeout has gone by
+    void keepAlive(const std::string& leasePath, TimeStamp& lastTouch, unsigned timeout)
+    {
+        TimeStamp now = DateTime().asTimeStamp();
+        if (now - lastTouch >= (TimeStamp)osg::maximum(timeout/3u, 1u))
+        {
+            if (!touchFile(leasePath))
+            {
+                OE_WARN << LC << "Lost the lease on " << leasePath << std::endl;
+            }
+            lastTouch = now;
+        }
+    }
+}
+
+DistributedTileVisitor::DistributedTileVisitor():
+_role( ROLE_WORKER ),
+_batchSize( 100 ),
+_leaseTimeout( 600 ),
+_numThreads( OpenThreads::GetNumberOfProcessors() ),
+_numBatches( 0 )
+{
+    osgDB::ObjectWrapper* wrapper = osgDB::Registry::instance()->getObjectWrapperManager()->findWrapper( "osg::Image" );
+
+    _workerName = makeWorkerName();
+}
+
+DistributedTileVisitor::DistributedTileVisitor( TileHandler* handler ):
+TileVisitor( handler ),
+_role( ROLE_WORKER ),
+_batchSize( 100 ),
+_leaseTimeout( 600 ),
+_numThreads( OpenThreads::GetNumberOfProcessors() ),
+_numBatches( 0 )
+{
+    _workerName = makeWorkerName();
+}
+
+void DistributedTileVisitor::run(const Profile* mapProfile)
+{
+    if (_workPath.empty())
+    {
+        OE_WARN << LC << "No work path set for distributed processing" << std::endl;
+        return;
+    }
+
+    if (!osgDB::fileExists(_workPath) && !osgEarth::makeDirectory(_workPath))
+    {
+        OE_WARN << LC << "Failed to create work path " << _workPath << std::endl;
+        return;
+    }
+
+    _profile = mapProfile;
+
+    if (_role == ROLE_COORDINATOR)
+        runCoordinator();
+    else
+        runWorker();
+}
+
+void DistributedTileVisitor::runCoordinator()
+{
+    std::string marker = osgDB::concatPaths(_workPath, COMPLETE_MARKER);
+
+    if (!osgDB::fileExists(marker))
+    {
+        // A partial traversal can't be picked up again, so start clean.
+        osgDB::DirectoryContents files = osgDB::getDirectoryContents(_workPath);
+        for (osgDB::DirectoryContents::iterator i = files.begin(); i != files.end(); ++i)
+        {
+            if (i->find(BATCH_EXT) != std::string::npos)
+                ::remove(osgDB::concatPaths(_workPath, *i).c_str());
+        }
+
+        _numBatches = 0;
+        _batch.clear();
+
+        // Traverse the tiles, writing them out in batches.
+        TileVisitor::run( _profile.get() );
+        writeBatch();
+
+        std::ofstream out( marker.c_str() );
+        out << _numBatches << std::endl;
+
+        OE_INFO << LC << "Wrote " << _numBatches << " batches to " << _workPath << std::endl;
+    }
+    else
+    {
+        resetProgress();
+        estimate();
+        OE_INFO << LC << "Found a finished traversal in " << _workPath << "; monitoring it" << std::endl;
+    }
+
+    // Wait for the workers, handing back any leases they abandon.
+    unsigned reported = 0u;
+    while (!isCanceled())
+    {
+        reclaimExpiredLeases();
+
+        unsigned numDone, numTilesDone;
+        bool finished = isFinished(numDone, numTilesDone);
+
+        if (numTilesDone > reported)
+        {
+            incrementProgress(numTilesDone - reported);
+            reported = numTilesDone;
+        }
+
+        if (finished)
+            break;
+
+        OpenThreads::Thread::microSleep(1000000);
+    }
+}
+
+void DistributedTileVisitor::runWorker()
+{
+    OE_INFO << LC << "Worker " << _workerName << " processing batches from " << _workPath << std::endl;
+
+    // Progress is reported against the whole job; this worker does a share of it.
+    resetProgress();
+    estimate();
+
+    while (!isCanceled())
+    {
+        std::string leaseFile;
+        if (leaseBatch(leaseFile))
+        {
+            processBatch(leaseFile);
+            continue;
+        }
+
+        // Nothing to lease. Stay around until every lease is done, in
+        // case one expires and needs another worker.
+        reclaimExpiredLeases();
+
+        unsigned numDone, numTilesDone;
+        if (isFinished(numDone, numTilesDone))
+            break;
+
+        OpenThreads::Thread::microSleep(1000000);
+    }
+
+    OE_INFO << LC << "Worker " << _workerName << " finished" << std::endl;
+}
+
+bool DistributedTileVisitor::handleTile( const TileKey& key )
+{
+    _batch.push_back( key );
+
+    if (_batch.size() >= _batchSize)
+    {
+        writeBatch();
+    }
+    return true;
+}
+
+void DistributedTileVisitor::writeBatch()
+{
+    if (_batch.empty())
+        return;
+
+    TaskList tasks( 0 );
+    tasks.getKeys() = _batch;
+
+    std::string name = Stringify() << std::setw(8) << std::setfill('0') << _numBatches << "_" << _batch.size() << BATCH_EXT;
+    std::string path = osgDB::concatPaths(_workPath, name);
+
+    // Write under a temporary name so no worker leases a partial batch.
+    std::string temp = path + TEMP_EXT;
+    tasks.save( temp );
+    if (::rename(temp.c_str(), path.c_str()) != 0)
+    {
+        OE_WARN << LC << "Failed to write batch " << path << std::endl;
+    }
+
+    ++_numBatches;
+    _batch.clear();
+}
+
+bool DistributedTileVisitor::leaseBatch( std::string& leaseFile )
+{
+    osgDB::DirectoryContents files = osgDB::getDirectoryContents(_workPath);
+    std::sort(files.begin(), files.end());
+
+    for (osgDB::DirectoryContents::iterator i = files.begin(); i != files.end(); ++i)
+    {
+        if (!endsWith(*i, BATCH_EXT))
+            continue;
+
+        // Renaming is atomic, so only one worker can win a batch.
+        std::string batch = osgDB::concatPaths(_workPath, *i);
+        std::string lease = batch + "." + _workerName + LEASE_EXT;
+        if (::rename(batch.c_str(), lease.c_str()) == 0)
+        {
+            // A rename keeps the old time, so start the lease now.
+            touchFile(lease);
+            leaseFile = lease;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool DistributedTileVisitor::processBatch( const std::string& leaseFile )
+{
+    TaskList tasks( _profile.get() );
+    tasks.load( leaseFile );
+
+    OE_DEBUG << LC << "Processing " << tasks.getKeys().size() << " tiles from " << leaseFile << std::endl;
+
+    osg::ref_ptr<JobGroup> jobs = new JobGroup();
+    TimeStamp lastTouch = DateTime().asTimeStamp();
+    unsigned maxInFlight = osg::maximum(_numThreads, 1u) - 1u;
+
+    for (TileKeyList::const_iterator key = tasks.getKeys().begin(); key != tasks.getKeys().end() && !isCanceled(); ++key)
+    {
+        while (!jobs->wait(maxInFlight, 100u))
+        {
+            keepAlive(leaseFile, lastTouch, _leaseTimeout);
+        }
+
+        Registry::instance()->getJobScheduler()->submit(
+            new HandleTileTask(_tileHandler.get(), this, *key, 0L),
+            JobScheduler::LANE_NORMAL,
+            jobs.get() );
+    }
+
+    if (isCanceled())
+        jobs->cancel();
+
+    while (!jobs->wait(0u, 100u))
+    {
+        keepAlive(leaseFile, lastTouch, _leaseTimeout);
+    }
+
+    std::string batch = getBatchName(leaseFile);
+
+    // Interrupted? Hand the batch back so another worker can do it.
+    std::string target = isCanceled() ? batch : batch + DONE_EXT;
+    if (::rename(leaseFile.c_str(), target.c_str()) != 0)
+    {
+        // The lease expired and went to another worker; it will finish the batch.
+        OE_WARN << LC << "Lease on " << batch << " expired before it finished" << std::endl;
+        return false;
+    }
+    return !isCanceled();
+}
+
+void DistributedTileVisitor::reclaimExpiredLeases()
+{
+    TimeStamp now = DateTime().asTimeStamp();
+
+    osgDB::DirectoryContents files = osgDB::getDirectoryContents(_workPath);
+    for (osgDB::DirectoryContents::iterator i = files.begin(); i != files.end(); ++i)
+    {
+        if (!endsWith(*i, LEASE_EXT))
+            continue;
+
+        std::string lease = osgDB::concatPaths(_workPath, *i);
+        TimeStamp touched = getLastModifiedTime(lease);
+        if (touched > 0 && now - touched > (TimeStamp)_leaseTimeout)
+        {
+            std::string batch = osgDB::concatPaths(_workPath, getBatchName(*i));
+            if (::rename(lease.c_str(), batch.c_str()) == 0)
+            {
+                OE_INFO << LC << "Reclaimed expired lease " << *i << std::endl;
+            }
+        }
+    }
+}
+
+bool DistributedTileVisitor::isFinished( unsigned& numDone, unsigned& numTilesDone )
+{
+    unsigned numPending = 0u;
+    numDone = 0u;
+    numTilesDone = 0u;
+
+    osgDB::DirectoryContents files = osgDB::getDirectoryContents(_workPath);
+    for (osgDB::DirectoryContents::iterator i = files.begin(); i != files.end(); ++i)
+    {
+        if (endsWith(*i, DONE_EXT))
+        {
+            ++numDone;
+            numTilesDone += getBatchCount(*i);
+        }
+        else if (endsWith(*i, BATCH_EXT) || endsWith(*i, LEASE_EXT))
+        {
+            ++numPending;
+        }
+    }
+
+    return numPending == 0u && osgDB::fileExists(osgDB::concatPaths(_workPath, COMPLETE_MARKER));
+}
+
 /*****************************************************************************************/
 TileKeyListVisitor::TileKeyListVisitor()
 {
@@ -0,0 +1,391 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2016 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/TriangleBVH>
+#include <algorithm>
+
+#define LC "[TriangleBVH] "
+
+using namespace osgEarth;
+
+// Deepest hierarchy we build (and can traverse). A median split halves the
+// triangle count at each level, so this is never reached in practice.
+#define MAX_DEPTH 64
+
+namespace
+{
+    // Orders triangle numbers by their centroid along one axis.
+    struct CentroidLess
+    {
+        CentroidLess(const std::vector<osg::Vec3f>& c, int axis) : _c(c), _axis(axis) { }
+        bool operator()(unsigned a, unsigned b) const { return _c[a][_axis] < _c[b][_axis]; }
+        const std::vector<osg::Vec3f>& _c;
+        int _axis;
+    };
+
+    // Clips the segment parameter range [tmin, tmax] against a box.
+    // Returns false if the segment misses the box.
+    bool clip(const osg::BoundingBox& box,
+              const osg::Vec3d& start, const osg::Vec3d& dir,
+              double tmin, double tmax)
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            if (osg::equivalent(dir[i], 0.0))
+            {
+                if (start[i] < box._min[i] || start[i] > box._max[i])
+                    return false;
+            }
+            else
+            {
+                double inv = 1.0 / dir[i];
+                double t0 = ((double)box._min[i] - start[i]) * inv;
+                double t1 = ((double)box._max[i] - start[i]) * inv;
+                if (t0 > t1) std::swap(t0, t1);
+                if (t0 > tmin) tmin = t0;
+                if (t1 < tmax) tmax = t1;
+                if (tmin > tmax)
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    // Keeps the nearest hit.
+    struct NearestVisitor
+    {
+        NearestVisitor() : _found(false) { _hit.ratio = 1.0; }
+        double limit() const { return _hit.ratio; }
+        void operator()(const TriangleBVH::Hit& hit) { _hit = hit; _found = true; }
+        TriangleBVH::Hit _hit;
+        bool _found;
+    };
+
+    // Keeps every hit.
+    struct AllVisitor
+    {
+        AllVisitor(std::vector<TriangleBVH::Hit>& hits) : _hits(hits) { }
+        double limit() const { return 1.0; }
+        void operator()(const TriangleBVH::Hit& hit) { _hits.push_back(hit); }
+        std::vector<TriangleBVH::Hit>& _hits;
+    };
+}
+
+//........................................................................
+
+TriangleBVH::Layout::Layout(const osg::Vec3f* verts,
+                            unsigned          numVerts,
+                            const GLuint*     indices,
+                            unsigned          numIndices,
+                            unsigned          maxLeafSize)
+{
+    unsigned numTris = numIndices / 3u;
+    if (numTris == 0u || verts == 0L || indices == 0L)
+        return;
+
+    maxLeafSize = osg::maximum(maxLeafSize, 1u);
+
+    std::vector<osg::Vec3f> centroids(numTris);
+    std::vector<unsigned> tris(numTris);
+
+    for (unsigned t = 0; t < numTris; ++t)
+    {
+        const GLuint* i = &indices[t*3];
+        if (i[0] < numVerts && i[1] < numVerts && i[2] < numVerts)
+            centroids[t] = (verts[i[0]] + verts[i[1]] + verts[i[2]]) / 3.0f;
+        tris[t] = t;
+    }
+
+    _nodes.reserve(2u * (numTris / maxLeafSize + 1u));
+    build(tris, 0u, numTris, centroids, maxLeafSize, 0u);
+
+    // Store the triangles in leaf order so each leaf reads a contiguous run.
+    _triangles.swap(tris);
+    _indices.resize(numTris * 3u);
+    for (unsigned t = 0; t < numTris; ++t)
+    {
+        const GLuint* i = &indices[_triangles[t]*3];
+        _indices[t*3+0] = i[0];
+        _indices[t*3+1] = i[1];
+        _indices[t*3+2] = i[2];
+    }
+}
+
+unsigned
+TriangleBVH::Layout::build(std::vector<unsigned>& tris,
+                           unsigned first, unsigned count,
+                           const std::vector<osg::Vec3f>& centroids,
+                           unsigned maxLeafSize,
+                           unsigned depth)
+{
+    unsigned index = _nodes.size();
+    _nodes.push_back(Node());
+
+    if (count <= maxLeafSize || depth+1 >= MAX_DEPTH)
+    {
+        _nodes[index]._first = first;
+        _nodes[index]._count = count;
+        _nodes[index]._right = 0u;
+        return index;
+    }
+
+    // Split at the median along the longest axis of the centroids:
+    osg::BoundingBox cbox;
+    for (unsigned t = first; t < first + count; ++t)
+        cbox.expandBy(centroids[tris[t]]);
+
+    osg::Vec3f size = cbox._max - cbox._min;
+    int axis = size.x() >= size.y() && size.x() >= size.z() ? 0 : size.y() >= size.z() ? 1 : 2;
+
+    unsigned half = count / 2u;
+    std::nth_element(
+        tris.begin() + first,
+        tris.begin() + first + half,
+        tris.begin() + first + count,
+        CentroidLess(centroids, axis));
+
+    _nodes[index]._first = 0u;
+    _nodes[index]._count = 0u;
+
+    build(tris, first, half, centroids, maxLeafSize, depth+1);
+    unsigned right = build(tris, first + half, count - half, centroids, maxLeafSize, depth+1);
+    _nodes[index]._right = right;
+
+    return index;
+}
+
+//........................................................................
+
+TriangleBVH::TriangleBVH() :
+_verts(0L),
+_numVerts(0u),
+_dirty(true)
+{
+    //nop
+}
+
+TriangleBVH::TriangleBVH(Layout* layout) :
+_layout(layout),
+_verts(0L),
+_numVerts(0u),
+_dirty(true)
+{
+    //nop
+}
+
+TriangleBVH::TriangleBVH(const TriangleBVH& rhs, const osg::CopyOp& copyop) :
+osg::Shape(rhs, copyop),
+_layout(rhs._layout.get()),
+_verts(rhs._verts),
+_numVerts(rhs._numVerts),
+_dirty(true)
+{
+    //nop
+}
+
+void
+TriangleBVH::setVertices(const osg::Vec3f* verts, unsigned numVerts)
+{
+    _verts = verts;
+    _numVerts = numVerts;
+    _dirty = true;
+}
+
+void
+TriangleBVH::refit() const
+{
+    if (!_dirty)
+        return;
+
+    Threading::ScopedMutexLock lock(_mutex);
+    if (!_dirty)
+        return;
+
+    const std::vector<Layout::Node>& nodes = _layout->_nodes;
+    const std::vector<GLuint>& indices = _layout->_indices;
+
+    _bounds.resize(nodes.size());
+
+    // Children always follow their parent, so walking backwards
+    // visits every child before the node that contains it.
+    for (int n = (int)nodes.size() - 1; n >= 0; --n)
+    {
+        const Layout::Node& node = nodes[n];
+        osg::BoundingBox& box = _bounds[n];
+        box.init();
+
+        if (node._count > 0u)
+        {
+            for (unsigned i = node._first*3u; i < (node._first + node._count)*3u; ++i)
+            {
+                if (indices[i] < _numVerts)
+                    box.expandBy(_verts[indices[i]]);
+            }
+        }
+        else
+        {
+            box.expandBy(_bounds[n + 1]);
+            box.expandBy(_bounds[node._right]);
+        }
+    }
+
+    _dirty = false;
+}
+
+bool
+TriangleBVH::intersectTriangle(unsigned t,
+                               const osg::Vec3d& start, const osg::Vec3d& dir,
+                               Hit& hit) const
+{
+    const GLuint* i = &_layout->_indices[t*3u];
+    if (i[0] >= _numVerts || i[1] >= _numVerts || i[2] >= _numVerts)
+        return false;
+
+    osg::Vec3d v0(_verts[i[0]]), v1(_verts[i[1]]), v2(_verts[i[2]]);
+    osg::Vec3d e1 = v1 - v0;
+    osg::Vec3d e2 = v2 - v0;
+
+    // Moller-Trumbore, in double precision since the segment may be long
+    // (e.g. from the eye to the far side of the globe).
+    osg::Vec3d p = dir ^ e2;
+    double det = e1 * p;
+    if (osg::equivalent(det, 0.0))
+        return false;
+
+    double invDet = 1.0 / det;
+    osg::Vec3d s = start - v0;
+    double u = (s * p) * invDet;
+    if (u < 0.0 || u > 1.0)
+        return false;
+
+    osg::Vec3d q = s ^ e1;
+    double v = (dir * q) * invDet;
+    if (v < 0.0 || u + v > 1.0)
+        return false;
+
+    double ratio = (e2 * q) * invDet;
+    if (ratio < 0.0 || ratio > 1.0)
+        return false;
+
+    hit.ratio = ratio;
+    hit.triangle = _layout->_triangles[t];
+    hit.index[0] = i[0];
+    hit.index[1] = i[1];
+    hit.index[2] = i[2];
+    hit.weight[0] = 1.0 - u - v;
+    hit.weight[1] = u;
+    hit.weight[2] = v;
+    hit.point = start + dir*ratio;
+    hit.normal = e1 ^ e2;
+    hit.normal.normalize();
+    return true;
+}
+
+template<typename VISITOR>
+void
+TriangleBVH::traverse(const osg::Vec3d& start, const osg::Vec3d& end, VISITOR& visitor) const
+{
+    if (!_layout.valid() || _layout->_nodes.empty() || _verts == 0L)
+        return;
+
+    refit();
+
+    const std::vector<Layout::Node>& nodes = _layout->_nodes;
+    osg::Vec3d dir = end - start;
+
+    unsigned stack[MAX_DEPTH];
+    unsigned top = 0;
+    stack[top++] = 0u;
+
+    Hit hit;
+
+    while (top > 0)
+    {
+        unsigned n = stack[--top];
+
+        if (!clip(_bounds[n], start, dir, 0.0, visitor.limit()))
+            continue;
+
+        const Layout::Node& node = nodes[n];
+        if (node._count > 0u)
+        {
+            for (unsigned t = node._first; t < node._first + node._count; ++t)
+            {
+                if (intersectTriangle(t, start, dir, hit) && hit.ratio <= visitor.limit())
+                {
+                    visitor(hit);
+                }
+            }
+        }
+        else if (top + 2 <= MAX_DEPTH)
+        {
+            stack[top++] = node._right;
+            stack[top++] = n + 1;
+        }
+    }
+}
+
+bool
+TriangleBVH::intersect(const osg::Vec3d& start,
+                       const osg::Vec3d& end,
+                       Hit&              out_nearest) const
+{
+    NearestVisitor visitor;
+    traverse(start, end, visitor);
+    if (visitor._found)
+        out_nearest = visitor._hit;
+    return visitor._found;
+}
+
+unsigned
+TriangleBVH::intersect(const osg::Vec3d& start,
+                       const osg::Vec3d& end,
+                       std::vector<Hit>& out_hits) const
+{
+    unsigned size = out_hits.size();
+    AllVisitor visitor(out_hits);
+    traverse(start, end, visitor);
+    std::sort(out_hits.begin() + size, out_hits.end());
+    return out_hits.size() - size;
+}
+
+unsigned
+TriangleBVH::intersect(const osg::Vec3d* starts,
+                       const osg::Vec3d* ends,
+                       unsigned          count,
+                       Hit*              out_hits) const
+{
+    unsigned numHits = 0u;
+
+    for (unsigned i = 0; i < count; ++i)
+    {
+        NearestVisitor visitor;
+        traverse(starts[i], ends[i], visitor);
+        if (visitor._found)
+        {
+            out_hits[i] = visitor._hit;
+            ++numHits;
+        }
+        else
+        {
+            out_hits[i] = Hit();
+        }
+    }
+
+    return numHits;
+}
@@ -19,11 +19,14 @@
 #include <osgEarth/URI>
 #include <osgEarth/Cache>
 #include <osgEarth/Registry>
+#include <osgEarth/OptionsOverlay>
 #include <osgEarth/FileUtils>
 #include <osgEarth/Progress>
+#include <osgEarth/ThreadingUtils>
 #include <osgDB/FileNameUtils>
 #include <osgDB/ReadFile>
 #include <osgDB/Archive>
+#include <map>
 
 #define LC "[URI] "
 
@@ -308,22 +311,67 @@ namespace
     }
 
 
+    //--------------------------------------------------------------------
+
+    // Finds an HTTP header (case-insensitively) in a result's metadata.
+    std::string getHeader(const Config& meta, const std::string& name)
+    {
+        for (ConfigSet::const_iterator i = meta.children().begin(); i != meta.children().end(); ++i)
+        {
+            if (ciEquals(i->key(), name))
+                return i->value();
+        }
+        return "";
+    }
+
+    // Builds the request for a remote read. When we hold an expired copy of
+    // the data, its validators turn this into a conditional GET so that an
+    // unchanged resource comes back as a "304 Not Modified" with no payload.
+    HTTPRequest createRequest(const URI& uri, TimeStamp lastModified, const Config& cachedMeta)
+    {
+        HTTPRequest req(uri.full());
+        req.getHeaders() = uri.context().getHeaders();
+
+        std::string etag = getHeader(cachedMeta, "ETag");
+        if (!etag.empty())
+        {
+            req.setETag(etag);
+        }
+
+        // Prefer the server's own Last-Modified value over our cache time.
+        std::string serverLastModified = getHeader(cachedMeta, "Last-Modified");
+        if (!serverLastModified.empty())
+        {
+            req.addHeader("If-Modified-Since", serverLastModified);
+        }
+        else if (lastModified > 0)
+        {
+            req.setLastModified(lastModified);
+        }
+        return req;
+    }
+
     //--------------------------------------------------------------------
     // Read functors (used by the doRead method)
 
-    struct ReadObject
+    struct ReadFunctor
     {
+        ReadFunctor() : _keepEncodedData(false) { }
+
+        // whether a network read should keep the encoded data for caching
+        bool _keepEncodedData;
+    };
+
+    struct ReadObject : public ReadFunctor
+    {
+        static const char* tag() { return "object"; }
+        static bool referencesFiles() { return true; }
         bool callbackRequestsCaching( URIReadCallback* cb ) const { return !cb || ((cb->cachingSupport() & URIReadCallback::CACHE_OBJECTS) != 0); }
         ReadResult fromCallback( URIReadCallback* cb, const std::string& uri, const osgDB::Options* opt ) { return cb->readObject(uri, opt); }
         ReadResult fromCache( CacheBin* bin, const std::string& key) { return bin->readObject(key, 0L); }
-        ReadResult fromHTTP( const URI& uri, const osgDB::Options* opt, ProgressCallback* p, TimeStamp lastModified )
+        ReadResult fromHTTP( const URI& uri, const osgDB::Options* opt, ProgressCallback* p, TimeStamp lastModified, const Config& cachedMeta )
         {
-            HTTPRequest req(uri.full());
-            req.getHeaders() = uri.context().getHeaders();
-            if (lastModified > 0)
-            {
-                req.setLastModified(lastModified);
-            }
+            HTTPRequest req = createRequest(uri, lastModified, cachedMeta);
             return HTTPClient::readObject(req, opt, p);
         }
         ReadResult fromFile( const std::string& uri, const osgDB::Options* opt ) {
@@ -331,19 +379,16 @@ namespace
         }
     };
 
-    struct ReadNode
+    struct ReadNode : public ReadFunctor
     {
+        static const char* tag() { return "node"; }
+        static bool referencesFiles() { return true; }
         bool callbackRequestsCaching( URIReadCallback* cb ) const { return !cb || ((cb->cachingSupport() & URIReadCallback::CACHE_NODES) != 0); }
         ReadResult fromCallback( URIReadCallback* cb, const std::string& uri, const osgDB::Options* opt ) { return cb->readNode(uri, opt); }
         ReadResult fromCache( CacheBin* bin, const std::string& key ) { return bin->readObject(key, 0L); }
-        ReadResult fromHTTP(const URI& uri, const osgDB::Options* opt, ProgressCallback* p, TimeStamp lastModified )
+        ReadResult fromHTTP(const URI& uri, const osgDB::Options* opt, ProgressCallback* p, TimeStamp lastModified, const Config& cachedMeta )
         {
-            HTTPRequest req(uri.full());
-            req.getHeaders() = uri.context().getHeaders();
-            if (lastModified > 0)
-            {
-                req.setLastModified(lastModified);
-            }
+            HTTPRequest req = createRequest(uri, lastModified, cachedMeta);
             return HTTPClient::readNode(req, opt, p);
         }
         ReadResult fromFile( const std::string& uri, const osgDB::Options* opt ) {
@@ -351,8 +396,10 @@ namespace
         }
     };
 
-    struct ReadImage
+    struct ReadImage : public ReadFunctor
     {
+        static const char* tag() { return "image"; }
+        static bool referencesFiles() { return false; }
         bool callbackRequestsCaching( URIReadCallback* cb ) const {
             return !cb || ((cb->cachingSupport() & URIReadCallback::CACHE_IMAGES) != 0);
         }
@@ -366,14 +413,9 @@ namespace
             if ( r.getImage() ) r.getImage()->setFileName( key );
             return r;
         }
-        ReadResult fromHTTP(const URI& uri, const osgDB::Options* opt, ProgressCallback* p, TimeStamp lastModified ) {
-            HTTPRequest req(uri.full());
-            req.getHeaders() = uri.context().getHeaders();
-
-            if (lastModified > 0)
-            {
-                req.setLastModified(lastModified);
-            }
+        ReadResult fromHTTP(const URI& uri, const osgDB::Options* opt, ProgressCallback* p, TimeStamp lastModified, const Config& cachedMeta ) {
+            HTTPRequest req = createRequest(uri, lastModified, cachedMeta);
+            req.setKeepEncodedData(_keepEncodedData);
             ReadResult r = HTTPClient::readImage(req, opt, p);
             if ( r.getImage() ) r.getImage()->setFileName( uri.full() );
             return r;
@@ -385,8 +427,10 @@ namespace
         }
     };
 
-    struct ReadString
+    struct ReadString : public ReadFunctor
     {
+        static const char* tag() { return "string"; }
+        static bool referencesFiles() { return false; }
         bool callbackRequestsCaching( URIReadCallback* cb ) const {
             return !cb || ((cb->cachingSupport() & URIReadCallback::CACHE_STRINGS) != 0);
         }
@@ -396,14 +440,9 @@ namespace
         ReadResult fromCache( CacheBin* bin, const std::string& key) { 
             return bin->readString(key, 0L);
         }
-        ReadResult fromHTTP(const URI& uri, const osgDB::Options* opt, ProgressCallback* p, TimeStamp lastModified )
+        ReadResult fromHTTP(const URI& uri, const osgDB::Options* opt, ProgressCallback* p, TimeStamp lastModified, const Config& cachedMeta )
         {
-            HTTPRequest req(uri.full());
-            req.getHeaders() = uri.context().getHeaders();
-            if (lastModified > 0)
-            {
-                req.setLastModified(lastModified);
-            }
+            HTTPRequest req = createRequest(uri, lastModified, cachedMeta);
             return HTTPClient::readString(req, opt, p);
         }
         ReadResult fromFile( const std::string& uri, const osgDB::Options* opt ) {
@@ -411,6 +450,89 @@ namespace
         }
     };
 
+    //--------------------------------------------------------------------
+    // Network reads in progress, so that concurrent readers of the same
+    // resource (shared layers, overlapping mosaics) share one download.
+
+    struct InFlightRead : public osg::Referenced
+    {
+        Threading::Event _done;
+        ReadResult       _result;
+    };
+
+    typedef std::map<std::string, osg::ref_ptr<InFlightRead> > InFlightReads;
+    static InFlightReads    s_inFlightReads;
+    static Threading::Mutex s_inFlightReadsMutex;
+
+    template<typename READ_FUNCTOR>
+    ReadResult fromHTTPCoalesced(
+        READ_FUNCTOR&         reader,
+        const URI&            uri,
+        CacheBin*             bin,
+        const osgDB::Options* opt,
+        ProgressCallback*     progress,
+        TimeStamp             lastModified,
+        const Config&         cachedMeta)
+    {
+        std::string key = Stringify() << reader.tag() << ":" << (bin ? bin->getID() : "") << ":" << uri.full();
+
+        osg::ref_ptr<InFlightRead> read;
+        bool leader = false;
+        {
+            Threading::ScopedMutexLock lock(s_inFlightReadsMutex);
+            osg::ref_ptr<InFlightRead>& entry = s_inFlightReads[key];
+            if (!entry.valid())
+            {
+                entry = new InFlightRead();
+                leader = true;
+            }
+            read = entry.get();
+        }
+
+        if (leader)
+        {
+            read->_result = reader.fromHTTP(uri, opt, progress, lastModified, cachedMeta);
+            {
+                Threading::ScopedMutexLock lock(s_inFlightReadsMutex);
+                s_inFlightReads.erase(key);
+            }
+            read->_done.set();
+            return read->_result;
+        }
+
+        while (!read->_done.wait(100u))
+        {
+            if (progress && progress->isCanceled())
+                return ReadResult(ReadResult::RESULT_CANCELED);
+        }
+
+        const ReadResult& shared = read->_result;
+
+        // A canceled read, or a "not modified" reply to someone else's
+        // conditional request, tells us nothing; go get our own.
+        if (shared.code() == ReadResult::RESULT_CANCELED ||
+            shared.code() == ReadResult::RESULT_NOT_MODIFIED)
+        {
+            return reader.fromHTTP(uri, opt, progress, lastModified, cachedMeta);
+        }
+
+        // Callers are free to modify what they read, so each one gets a copy.
+        osg::ref_ptr<osg::Object> object;
+        if (shared.getObject())
+        {
+            object = osg::clone(shared.getObject(), osg::CopyOp::DEEP_COPY_ALL);
+            if (!object.valid())
+                object = shared.getObject();
+        }
+
+        ReadResult result(shared.code(), object.get(), shared.metadata());
+        result.setLastModifiedTime(shared.lastModifiedTime());
+        result.setDuration(shared.duration());
+        result.setErrorDetail(shared.errorDetail());
+        result.setEncodedData(shared.encodedData(), shared.encodedFormat());
+        return result;
+    }
+
     //--------------------------------------------------------------------
     // MASTER read template function. I templatized this so we wouldn't
     // have 4 95%-identical code paths to maintain...
@@ -438,10 +560,9 @@ namespace
             // if we have an option string, incorporate it.
             if ( inputURI.optionString().isSet() )
             {
-                osgDB::Options* newLocalOptions = Registry::cloneOrCreateOptions(localOptions.get());
-                newLocalOptions->setOptionString(
-                    inputURI.optionString().get() + " " + localOptions->getOptionString());
-                localOptions = newLocalOptions;
+                localOptions = OptionsOverlay()
+                    .prependOptionString( inputURI.optionString().get() )
+                    .apply( localOptions.get() );
             }
 
             READ_FUNCTOR reader;
@@ -512,6 +633,12 @@ namespace
                         {
                             bin = cacheSettings->getCacheBin();
                         }
+
+                        reader._keepEncodedData =
+                            bin.valid() &&
+                            cp->isCacheWriteable() &&
+                            cacheSettings->getCache() &&
+                            cacheSettings->getCache()->getCacheOptions().storeEncodedImages() == true;
                     }
 
                     bool expired = false;
@@ -530,9 +657,15 @@ namespace
                     if ( result.empty() || expired )
                     {
                         // Need to do this to support nested PLODs and Proxynodes.
-                        osg::ref_ptr<osgDB::Options> remoteOptions =
-                            Registry::instance()->cloneOrCreateOptions( localOptions.get() );
-                        remoteOptions->getDatabasePathList().push_front( osgDB::getFilePath(uri.full()) );
+                        // Images and strings don't refer to other files, so
+                        // they skip deriving new options for every request.
+                        osg::ref_ptr<const osgDB::Options> remoteOptions = localOptions.get();
+                        if ( READ_FUNCTOR::referencesFiles() )
+                        {
+                            remoteOptions = OptionsOverlay()
+                                .pushDatabasePath( osgDB::getFilePath(uri.full()) )
+                                .apply( localOptions.get() );
+                        }
 
                         // Store the existing object from the cache if there is one.
                         osg::ref_ptr< osg::Object > object = result.getObject();
@@ -554,7 +687,7 @@ namespace
                             // still no data, go to the source:
                             if ( (result.empty() || expired) && cp->usage() != CachePolicy::USAGE_CACHE_ONLY )
                             {
-                                ReadResult remoteResult = reader.fromHTTP( uri, remoteOptions.get(), progress, result.lastModifiedTime() );
+                                ReadResult remoteResult = fromHTTPCoalesced( reader, uri, bin.get(), remoteOptions.get(), progress, result.lastModifiedTime(), result.metadata() );
                                 if (remoteResult.code() == ReadResult::RESULT_NOT_MODIFIED)
                                 {
                                     OE_DEBUG << LC << uri.full() << " not modified, using cached result" << std::endl;
@@ -579,8 +712,21 @@ namespace
                             if ( result.succeeded() && !result.isFromCache() && bin && cp->isCacheWriteable() && bin )
                             {
                                 OE_DEBUG << LC << "Writing " << uri.cacheKey() << " to cache" << std::endl;
-                                bin->write( uri.cacheKey(), result.getObject(), result.metadata(), remoteOptions.get() );
+
+                                // Store encoded data as-is when we have it, and fall back on
+                                // serializing the object if the bin can't.
+                                bool wroteEncoded =
+                                    result.encodedData() &&
+                                    bin->writeEncodedImage( uri.cacheKey(), result.encodedData()->getString(), result.encodedFormat(), result.metadata(), remoteOptions.get() );
+
+                                if ( !wroteEncoded )
+                                {
+                                    bin->write( uri.cacheKey(), result.getObject(), result.metadata(), remoteOptions.get() );
+                                }
                             }
+
+                            // no need to hang on to the encoded data any longer
+                            result.setEncodedData( 0L, "" );
                         }
                     }
                 }
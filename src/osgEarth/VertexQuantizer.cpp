@@ -0,0 +1,326 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2016 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/VertexQuantizer>
+#include <osgEarth/VirtualProgram>
+#include <osg/NodeVisitor>
+#include <osg/Transform>
+#include <typeinfo>
+#include <map>
+#include <set>
+
+#define LC "[VertexQuantizer] "
+
+using namespace osgEarth;
+
+int         VertexQuantizer::NormalAttrLocation = 11;
+
+const char* VertexQuantizer::NormalAttrName     = "oe_quantize_normal";
+const char* VertexQuantizer::OffsetUniformName  = "oe_quantize_offset";
+const char* VertexQuantizer::ScaleUniformName   = "oe_quantize_scale";
+
+// Largest magnitude of a quantized component
+#define QMAX 32767.0f
+
+namespace
+{
+    // Runs before any other model-space function so everyone downstream
+    // sees ordinary float vertices.
+    const float DECODE_ORDER = -1.0e6f;
+
+    const char* decodeVertex =
+        "#version " GLSL_VERSION_STR "\n"
+        GLSL_DEFAULT_PRECISION_FLOAT "\n"
+        "uniform vec3 oe_quantize_offset; \n"
+        "uniform vec3 oe_quantize_scale; \n"
+        "void oe_quantize_decodeVertex(inout vec4 vertex) \n"
+        "{ \n"
+        "    vertex = vec4(oe_quantize_offset + vertex.xyz*oe_quantize_scale, 1.0); \n"
+        "} \n";
+
+    const char* decodeVertexAndNormal =
+        "#version " GLSL_VERSION_STR "\n"
+        GLSL_DEFAULT_PRECISION_FLOAT "\n"
+        "uniform vec3 oe_quantize_offset; \n"
+        "uniform vec3 oe_quantize_scale; \n"
+        "in vec2 oe_quantize_normal; \n"
+        "vec3 vp_Normal; \n"
+        "void oe_quantize_decodeVertex(inout vec4 vertex) \n"
+        "{ \n"
+        "    vertex = vec4(oe_quantize_offset + vertex.xyz*oe_quantize_scale, 1.0); \n"
+        "    vec2 e = oe_quantize_normal; \n"
+        "    vec3 n = vec3(e.x, e.y, 1.0 - abs(e.x) - abs(e.y)); \n"
+        "    float t = max(-n.z, 0.0); \n"
+        "    n.x += n.x >= 0.0 ? -t : t; \n"
+        "    n.y += n.y >= 0.0 ? -t : t; \n"
+        "    vp_Normal = normalize(n); \n"
+        "} \n";
+
+    // Octahedral encoding of a unit vector, in [-1..1]
+    osg::Vec2f encodeNormal(const osg::Vec3f& in)
+    {
+        osg::Vec3f n = in;
+        float sum = fabs(n.x()) + fabs(n.y()) + fabs(n.z());
+        if (sum <= 0.0f)
+            return osg::Vec2f(0.0f, 0.0f);
+        n /= sum;
+
+        osg::Vec2f e(n.x(), n.y());
+        if (n.z() < 0.0f)
+        {
+            e.set(
+                (1.0f - fabs(n.y())) * (n.x() >= 0.0f ? 1.0f : -1.0f),
+                (1.0f - fabs(n.x())) * (n.y() >= 0.0f ? 1.0f : -1.0f));
+        }
+        return e;
+    }
+
+    inline short toShort(float v)
+    {
+        return (short)osg::round(osg::clampBetween(v, -1.0f, 1.0f) * QMAX);
+    }
+
+    // OSG can't compute a bound from 16-bit vertices, so hand it the decoded one.
+    struct QuantizedBounds : public osg::Drawable::ComputeBoundingBoxCallback
+    {
+        QuantizedBounds(const osg::BoundingBox& box) : _box(box) { }
+        osg::BoundingBox computeBound(const osg::Drawable&) const { return _box; }
+        osg::BoundingBox _box;
+    };
+
+    // Collects the eligible geometries and their combined bounds.
+    struct Collector : public osg::NodeVisitor
+    {
+        std::vector<osg::Geometry*> _geoms;
+        std::set<osg::Geometry*>    _seen;
+        osg::BoundingBox            _box;
+
+        Collector() : osg::NodeVisitor(TRAVERSE_ALL_CHILDREN)
+        {
+            setNodeMaskOverride(~0);
+        }
+
+        // Geometry under a transform lives in a different frame than the
+        // box we're building; it gets a box of its own later.
+        std::vector<osg::Transform*> _transforms;
+
+        void apply(osg::Transform& node)
+        {
+            _transforms.push_back(&node);
+        }
+
+        void apply(osg::Drawable& drawable)
+        {
+            osg::Geometry* geom = drawable.asGeometry();
+            if (geom &&
+                typeid(*geom) == typeid(osg::Geometry) &&
+                dynamic_cast<osg::Vec3Array*>(geom->getVertexArray()) &&
+                geom->getVertexAttribArray(VertexQuantizer::NormalAttrLocation) == 0L)
+            {
+                osg::Vec3Array* verts = static_cast<osg::Vec3Array*>(geom->getVertexArray());
+                if (!verts->empty() && _seen.insert(geom).second)
+                {
+                    for (unsigned i = 0; i < verts->size(); ++i)
+                        _box.expandBy((*verts)[i]);
+                    _geoms.push_back(geom);
+                }
+            }
+        }
+    };
+
+    void installDecoder(osg::StateSet* stateSet, bool normals,
+                        osg::Uniform* offset, osg::Uniform* scale)
+    {
+        VirtualProgram* vp = VirtualProgram::getOrCreate(stateSet);
+        vp->setName("VertexQuantizer");
+        vp->setFunction(
+            "oe_quantize_decodeVertex",
+            normals ? decodeVertexAndNormal : decodeVertex,
+            ShaderComp::LOCATION_VERTEX_MODEL,
+            DECODE_ORDER);
+
+        if (normals)
+            vp->addBindAttribLocation(VertexQuantizer::NormalAttrName, VertexQuantizer::NormalAttrLocation);
+
+        stateSet->addUniform(offset);
+        stateSet->addUniform(scale);
+    }
+}
+
+//........................................................................
+
+VertexQuantizer::VertexQuantizer() :
+_normals( true ),
+_colors ( true )
+{
+    //nop
+}
+
+unsigned
+VertexQuantizer::run(osg::Node& node)
+{
+    Collector collector;
+    node.accept(collector);
+
+    unsigned count = 0u;
+    for (unsigned t = 0; t < collector._transforms.size(); ++t)
+    {
+        osg::Transform* xform = collector._transforms[t];
+        for (unsigned c = 0; c < xform->getNumChildren(); ++c)
+            count += run(*xform->getChild(c));
+    }
+
+    if (collector._geoms.empty() || !collector._box.valid())
+        return count;
+
+    const osg::BoundingBox& box = collector._box;
+    osg::Vec3f center = box.center();
+    osg::Vec3f half = (box._max - box._min) * 0.5f;
+    for (unsigned i = 0; i < 3; ++i)
+        if (half[i] <= 0.0f)
+            half[i] = 1.0f;
+
+    osg::Vec3f scale(half.x()/QMAX, half.y()/QMAX, half.z()/QMAX);
+
+    osg::ref_ptr<osg::Uniform> offsetUniform = new osg::Uniform(OffsetUniformName, center);
+    osg::ref_ptr<osg::Uniform> scaleUniform  = new osg::Uniform(ScaleUniformName, scale);
+
+    // Shared decoding states (with and without normals), and decoding
+    // versions of the geometries' own state sets, so that geometries that
+    // shared a state set before still share one afterwards.
+    osg::ref_ptr<osg::StateSet> shared[2];
+    typedef std::map<std::pair<osg::StateSet*, bool>, osg::ref_ptr<osg::StateSet> > StateSetMap;
+    StateSetMap stateSets;
+
+    // Arrays may be shared between geometries, too.
+    typedef std::map<osg::Array*, osg::ref_ptr<osg::Array> > ArrayMap;
+    ArrayMap vertexArrays, normalArrays, colorArrays;
+
+    for (unsigned g = 0; g < collector._geoms.size(); ++g)
+    {
+        osg::Geometry* geom = collector._geoms[g];
+
+        // Positions:
+        osg::Vec3Array* verts = static_cast<osg::Vec3Array*>(geom->getVertexArray());
+        osg::ref_ptr<osg::Array>& qverts = vertexArrays[verts];
+        if (!qverts.valid())
+        {
+            osg::Vec4sArray* out = new osg::Vec4sArray(verts->size());
+            out->setBinding(osg::Array::BIND_PER_VERTEX);
+            for (unsigned i = 0; i < verts->size(); ++i)
+            {
+                osg::Vec3f v = (*verts)[i] - center;
+                (*out)[i].set(
+                    toShort(v.x()/half.x()),
+                    toShort(v.y()/half.y()),
+                    toShort(v.z()/half.z()),
+                    1);
+            }
+            qverts = out;
+        }
+
+        // Normals; only per-vertex ones are worth the attribute.
+        bool normals = false;
+        osg::Vec3Array* norms = dynamic_cast<osg::Vec3Array*>(geom->getNormalArray());
+        if (_normals && norms && norms->getBinding() == osg::Array::BIND_PER_VERTEX && norms->size() == verts->size())
+        {
+            osg::ref_ptr<osg::Array>& qnorms = normalArrays[norms];
+            if (!qnorms.valid())
+            {
+                osg::Vec2sArray* out = new osg::Vec2sArray(norms->size());
+                out->setBinding(osg::Array::BIND_PER_VERTEX);
+                out->setNormalize(true);
+                for (unsigned i = 0; i < norms->size(); ++i)
+                {
+                    osg::Vec2f e = encodeNormal((*norms)[i]);
+                    (*out)[i].set(toShort(e.x()), toShort(e.y()));
+                }
+                qnorms = out;
+            }
+            geom->setNormalArray(0L);
+            geom->setVertexAttribArray(NormalAttrLocation, qnorms.get());
+            normals = true;
+        }
+
+        // Colors:
+        osg::Vec4Array* colors = dynamic_cast<osg::Vec4Array*>(geom->getColorArray());
+        if (_colors && colors)
+        {
+            osg::ref_ptr<osg::Array>& qcolors = colorArrays[colors];
+            if (!qcolors.valid())
+            {
+                osg::Vec4ubArray* out = new osg::Vec4ubArray(colors->size());
+                out->setBinding(colors->getBinding());
+                out->setNormalize(true);
+                for (unsigned i = 0; i < colors->size(); ++i)
+                {
+                    const osg::Vec4f& c = (*colors)[i];
+                    (*out)[i].set(
+                        (unsigned char)osg::round(osg::clampBetween(c.r(), 0.0f, 1.0f)*255.0f),
+                        (unsigned char)osg::round(osg::clampBetween(c.g(), 0.0f, 1.0f)*255.0f),
+                        (unsigned char)osg::round(osg::clampBetween(c.b(), 0.0f, 1.0f)*255.0f),
+                        (unsigned char)osg::round(osg::clampBetween(c.a(), 0.0f, 1.0f)*255.0f));
+                }
+                qcolors = out;
+            }
+            geom->setColorArray(qcolors.get());
+        }
+
+        osg::BoundingBox geomBox;
+        for (unsigned i = 0; i < verts->size(); ++i)
+            geomBox.expandBy((*verts)[i]);
+
+        geom->setVertexArray(qverts.get());
+        geom->setComputeBoundingBoxCallback(new QuantizedBounds(geomBox));
+        geom->dirtyBound();
+
+        // Decoding shader:
+        osg::StateSet* original = geom->getStateSet();
+        if (original == 0L)
+        {
+            if (!shared[normals].valid())
+            {
+                shared[normals] = new osg::StateSet();
+                installDecoder(shared[normals].get(), normals, offsetUniform.get(), scaleUniform.get());
+            }
+            geom->setStateSet(shared[normals].get());
+        }
+        else
+        {
+            osg::ref_ptr<osg::StateSet>& ss = stateSets[std::make_pair(original, normals)];
+            if (!ss.valid())
+            {
+                ss = new osg::StateSet(*original, osg::CopyOp::SHALLOW_COPY);
+
+                // Don't add our functions to a program someone else shares.
+                VirtualProgram* vp = VirtualProgram::get(ss.get());
+                if (vp)
+                    ss->setAttribute(osg::clone(vp, osg::CopyOp::SHALLOW_COPY));
+
+                installDecoder(ss.get(), normals, offsetUniform.get(), scaleUniform.get());
+            }
+            geom->setStateSet(ss.get());
+        }
+
+        geom->dirtyDisplayList();
+    }
+
+    OE_DEBUG << LC << "Quantized " << collector._geoms.size() << " geometries\n";
+
+    return count + collector._geoms.size();
+}
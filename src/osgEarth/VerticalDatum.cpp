@@ -20,6 +20,7 @@
 #include <osgEarth/VerticalDatum>
 #include <osgEarth/ThreadingUtils>
 #include <osgEarth/GeoData>
+#include <osgEarth/Containers>
 
 #include <osgDB/ReadFile>
 
@@ -35,6 +36,36 @@ namespace
     typedef std::map<std::string, osg::ref_ptr<VerticalDatum> > VDatumCache;
     VDatumCache      _vdatumCache;
     Threading::Mutex _vdataCacheMutex;
+
+    // A grid of geoid offsets between two datums. Elevation layers on the
+    // same datum ask for the same tiles, so recent grids are kept around.
+    struct OffsetKey
+    {
+        const VerticalDatum* _from;
+        const VerticalDatum* _to;
+        double               _west, _south, _xstep, _ystep;
+        unsigned             _cols, _rows;
+
+        bool operator < (const OffsetKey& rhs) const
+        {
+            if (_from != rhs._from) return _from < rhs._from;
+            if (_to != rhs._to) return _to < rhs._to;
+            if (_cols != rhs._cols) return _cols < rhs._cols;
+            if (_rows != rhs._rows) return _rows < rhs._rows;
+            if (_west != rhs._west) return _west < rhs._west;
+            if (_south != rhs._south) return _south < rhs._south;
+            if (_xstep != rhs._xstep) return _xstep < rhs._xstep;
+            return _ystep < rhs._ystep;
+        }
+    };
+
+    typedef LRUCache<OffsetKey, osg::ref_ptr<osg::FloatArray> > OffsetCache;
+
+    OffsetCache& getOffsetCache()
+    {
+        static OffsetCache s_cache(true, 32u);
+        return s_cache;
+    }
 } 
 
 VerticalDatum*
@@ -152,18 +183,52 @@ VerticalDatum::transform(const VerticalDatum* from,
         ystep = (ne.y()-sw.y()) / double(rows-1);
     }
 
-    for( unsigned c=0; c<cols; ++c)
+    // Units convert linearly, so per sample the transform works out to
+    //   z' = (z + Nfrom)*scale - Nto = z*scale + offset
+    // Resample both geoids onto the tile once and reuse the offsets.
+    Units fromUnits = from ? from->getUnits() : Units::METERS;
+    Units toUnits = to ? to->getUnits() : Units::METERS;
+    float scale = (float)fromUnits.convertTo(toUnits, 1.0);
+
+    OffsetKey key;
+    key._from = from, key._to = to;
+    key._west = sw.x(), key._south = sw.y(), key._xstep = xstep, key._ystep = ystep;
+    key._cols = cols, key._rows = rows;
+
+    osg::ref_ptr<osg::FloatArray> offsets;
+    OffsetCache::Record record;
+    if ( getOffsetCache().get(key, record) )
+    {
+        offsets = record.value().get();
+    }
+    else
     {
-        double lon = sw.x() + xstep*double(c);
-        for( unsigned r=0; r<rows; ++r)
+        offsets = new osg::FloatArray(cols*rows);
+        std::vector<float>& out = offsets->asVector();
+
+        std::vector<float> geoid;
+        if ( from && from->getGeoid() )
         {
-            double lat = sw.y() + ystep*double(r);
-            float& h = hf->getHeight(c, r);
-            if (h != NO_DATA_VALUE)
-            {
-                VerticalDatum::transform( from, to, lat, lon, h );
-            }
+            from->getGeoid()->getHeights(sw.x(), sw.y(), xstep, ystep, cols, rows, geoid);
+            for(unsigned i=0; i<out.size(); ++i)
+                out[i] = geoid[i] * scale;
         }
+        if ( to && to->getGeoid() )
+        {
+            to->getGeoid()->getHeights(sw.x(), sw.y(), xstep, ystep, cols, rows, geoid);
+            for(unsigned i=0; i<out.size(); ++i)
+                out[i] -= geoid[i];
+        }
+
+        getOffsetCache().insert(key, offsets.get());
+    }
+
+    std::vector<float>& heights = hf->getFloatArray()->asVector();
+    const std::vector<float>& off = offsets->asVector();
+    for(unsigned i=0; i<heights.size() && i<off.size(); ++i)
+    {
+        if ( heights[i] != NO_DATA_VALUE )
+            heights[i] = heights[i]*scale + off[i];
     }
 
     return true;
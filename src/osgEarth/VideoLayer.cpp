@@ -18,10 +18,263 @@
 */
 #include <osgEarth/VideoLayer>
 #include <osg/ImageStream>
+#include <osg/GLExtensions>
+#include <osg/buffered_value>
 #include <osgEarth/Registry>
+#include <osgEarth/Notify>
+#include <string.h>
+
+#define LC "[VideoLayer] "
 
 using namespace osgEarth;
 
+#ifndef GL_PIXEL_UNPACK_BUFFER
+#define GL_PIXEL_UNPACK_BUFFER 0x88EC
+#endif
+#ifndef GL_STREAM_DRAW
+#define GL_STREAM_DRAW 0x88E0
+#endif
+#ifndef GL_WRITE_ONLY
+#define GL_WRITE_ONLY 0x88B9
+#endif
+#ifndef GL_MAP_WRITE_BIT
+#define GL_MAP_WRITE_BIT 0x0002
+#endif
+#ifndef GL_MAP_INVALIDATE_BUFFER_BIT
+#define GL_MAP_INVALIDATE_BUFFER_BIT 0x0008
+#endif
+#ifndef GL_MAP_UNSYNCHRONIZED_BIT
+#define GL_MAP_UNSYNCHRONIZED_BIT 0x0020
+#endif
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+#ifndef GL_SYNC_GPU_COMMANDS_COMPLETE
+#define GL_SYNC_GPU_COMMANDS_COMPLETE 0x9117
+#endif
+#ifndef GL_ALREADY_SIGNALED
+#define GL_ALREADY_SIGNALED 0x911A
+#endif
+#ifndef GL_CONDITION_SATISFIED
+#define GL_CONDITION_SATISFIED 0x911C
+#endif
+#ifndef GL_APIENTRY
+#define GL_APIENTRY APIENTRY
+#endif
+
+namespace
+{
+    typedef void (GL_APIENTRY * BufferStorageProc)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+
+    /**
+     * Texture that streams each new frame of its image through a ring of
+     * pixel buffer objects. Copying a frame into a buffer doesn't wait on
+     * the GPU, and the texture update that follows reads from the buffer
+     * asynchronously, so the draw thread doesn't stall per frame. Where
+     * GL_ARB_buffer_storage is available, the buffers stay mapped for good.
+     *
+     * A fence guards each buffer; if the GPU hasn't finished with the next
+     * one yet, the frame waits for the next draw rather than blocking.
+     * Anything that can't stream (first upload, size change, compressed or
+     * mipmapped data) goes through the regular Texture2D path.
+     */
+    class StreamingTexture : public osg::Texture2D
+    {
+    public:
+        StreamingTexture(osg::Image* image, unsigned numBuffers) :
+            osg::Texture2D(image), _numBuffers(numBuffers) { }
+
+        void apply(osg::State& state) const
+        {
+            const unsigned contextID = state.getContextID();
+            const osg::Image* image = getImage();
+            osg::GLExtensions* ext = state.get<osg::GLExtensions>();
+
+            bool canStream =
+                _numBuffers > 0u &&
+                image && image->data() &&
+                getTextureObject(contextID) != 0L &&
+                ext && ext->isPBOSupported &&
+                !image->isCompressed() &&
+                !image->isMipmap() &&
+                (getFilter(MIN_FILTER) == LINEAR || getFilter(MIN_FILTER) == NEAREST) &&
+                image->s() == getTextureWidth() &&
+                image->t() == getTextureHeight();
+
+            if (!canStream || getModifiedCount(contextID) == image->getModifiedCount())
+            {
+                osg::Texture2D::apply(state);
+                return;
+            }
+
+            // Mark the frame as current so the base class only binds.
+            unsigned modified = image->getModifiedCount();
+            getModifiedCount(contextID) = modified;
+            osg::Texture2D::apply(state);
+
+            if (!upload(ext, _pcs[contextID], image))
+            {
+                // no buffer free yet; pick the frame up on the next draw.
+                getModifiedCount(contextID) = modified - 1u;
+            }
+        }
+
+        void releaseGLObjects(osg::State* state) const
+        {
+            if (state)
+            {
+                osg::GLExtensions* ext = state->get<osg::GLExtensions>();
+                if (ext)
+                    release(ext, _pcs[state->getContextID()]);
+            }
+            osg::Texture2D::releaseGLObjects(state);
+        }
+
+    protected:
+        struct Slot
+        {
+            Slot() : _pbo(0), _mapped(0L), _sync(0L) { }
+            GLuint _pbo;
+            void*  _mapped;   // persistent mapping, or NULL
+            void*  _sync;     // fence on the last update that read this buffer
+        };
+
+        struct PerContext
+        {
+            PerContext() : _bytes(0u), _next(0u) { }
+            std::vector<Slot> _slots;
+            unsigned          _bytes;
+            unsigned          _next;
+        };
+
+        bool upload(osg::GLExtensions* ext, PerContext& pc, const osg::Image* image) const
+        {
+            bool haveSync = ext->glFenceSync != 0L && ext->glClientWaitSync != 0L && ext->glDeleteSync != 0L;
+            unsigned bytes = image->getTotalSizeInBytes();
+
+            if (pc._slots.empty() || pc._bytes != bytes)
+            {
+                release(ext, pc);
+                allocate(ext, pc, bytes, haveSync);
+            }
+
+            Slot& slot = pc._slots[pc._next];
+
+            if (slot._sync)
+            {
+                GLenum result = ext->glClientWaitSync((GLsync)slot._sync, 0, 0);
+                if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED)
+                    return false;
+                ext->glDeleteSync((GLsync)slot._sync);
+                slot._sync = 0L;
+            }
+
+            ext->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot._pbo);
+
+            void* dst = slot._mapped;
+            if (!dst)
+            {
+                dst = ext->glMapBufferRange ?
+                    ext->glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes,
+                        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | (haveSync ? GL_MAP_UNSYNCHRONIZED_BIT : 0)) :
+                    ext->glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+            }
+
+            if (!dst)
+            {
+                ext->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                return false;
+            }
+
+            ::memcpy(dst, image->data(), bytes);
+
+            if (!slot._mapped)
+                ext->glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+            // Returns right away; the GPU copies out of the buffer behind the fence.
+            glPixelStorei(GL_UNPACK_ALIGNMENT, image->getPacking());
+#ifdef GL_UNPACK_ROW_LENGTH
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, image->getRowLength());
+#endif
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image->s(), image->t(),
+                (GLenum)image->getPixelFormat(), (GLenum)image->getDataType(), 0L);
+#ifdef GL_UNPACK_ROW_LENGTH
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+#endif
+
+            ext->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+            if (haveSync)
+                slot._sync = (void*)ext->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+            pc._next = (pc._next + 1u) % pc._slots.size();
+            return true;
+        }
+
+        void allocate(osg::GLExtensions* ext, PerContext& pc, unsigned bytes, bool haveSync) const
+        {
+            // Persistent mappings are only safe to write with fences to go by.
+            BufferStorageProc bufferStorage = haveSync && ext->glMapBufferRange ?
+                (BufferStorageProc)osg::getGLExtensionFuncPtr("glBufferStorage", "glBufferStorageARB") : 0L;
+
+            const GLbitfield persistentFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+            pc._slots.resize(_numBuffers);
+            pc._bytes = bytes;
+            pc._next = 0u;
+
+            for (unsigned i = 0; i < pc._slots.size(); ++i)
+            {
+                Slot& slot = pc._slots[i];
+                ext->glGenBuffers(1, &slot._pbo);
+                ext->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot._pbo);
+
+                if (bufferStorage)
+                {
+                    bufferStorage(GL_PIXEL_UNPACK_BUFFER, bytes, 0L, persistentFlags);
+                    slot._mapped = ext->glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, persistentFlags);
+                }
+                else
+                {
+                    ext->glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, 0L, GL_STREAM_DRAW);
+                }
+            }
+
+            ext->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+            OE_DEBUG << LC << "Streaming " << bytes << "-byte frames through " << pc._slots.size()
+                << (bufferStorage ? " persistently mapped" : "") << " buffers" << std::endl;
+        }
+
+        void release(osg::GLExtensions* ext, PerContext& pc) const
+        {
+            for (unsigned i = 0; i < pc._slots.size(); ++i)
+            {
+                Slot& slot = pc._slots[i];
+                if (slot._sync)
+                    ext->glDeleteSync((GLsync)slot._sync);
+                if (slot._mapped)
+                {
+                    ext->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot._pbo);
+                    ext->glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+                    ext->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                }
+                if (slot._pbo)
+                    ext->glDeleteBuffers(1, &slot._pbo);
+            }
+            pc._slots.clear();
+            pc._bytes = 0u;
+            pc._next = 0u;
+        }
+
+        unsigned _numBuffers;
+        mutable osg::buffered_object<PerContext> _pcs;
+    };
+}
+
 REGISTER_OSGEARTH_LAYER(video, VideoLayer);
 
 VideoLayerOptions::VideoLayerOptions() :
@@ -48,6 +301,7 @@ ImageLayerOptions( name )
 void
 VideoLayerOptions::setDefaults()
 {
+    _uploadBuffers.init( 3u );
 }
 
 Config
@@ -57,6 +311,7 @@ VideoLayerOptions::getConfig() const
     conf.key() = "video";
 
     conf.set("url", _url);
+    conf.set("upload_buffers", _uploadBuffers);
 
     return conf;
 }
@@ -65,6 +320,7 @@ void
 VideoLayerOptions::fromConfig( const Config& conf )
 {
     conf.getIfSet("url", _url );
+    conf.getIfSet("upload_buffers", _uploadBuffers );
 }
 
 void
@@ -109,7 +365,10 @@ VideoLayer::open()
                 is->play();                 
             }
 
-            _texture = new osg::Texture2D( image );
+            // a still image only uploads once, so nothing to stream.
+            _texture = is ?
+                new StreamingTexture( image.get(), options().uploadBuffers().get() ) :
+                new osg::Texture2D( image.get() );
             _texture->setResizeNonPowerOfTwoHint( false );
             _texture->setFilter(osg::Texture::MIN_FILTER, osg::Texture2D::LINEAR);
             _texture->setFilter(osg::Texture::MAG_FILTER, osg::Texture2D::LINEAR);
@@ -24,6 +24,9 @@
 #include <osgEarth/ShaderUtils>
 #include <osgEarth/StringUtils>
 #include <osgEarth/Containers>
+#include <osgEarth/ProgramBinaryCache>
+#include <osgEarth/ProgramCompiler>
+#include <osgEarth/Metrics>
 #include <osg/Shader>
 #include <osg/Program>
 #include <osg/State>
@@ -102,6 +105,18 @@ namespace
 
     bool s_dumpShaders = false;        // debugging
 
+    // Incremental 64-bit hash of a ProgramKey. The key holds references to its
+    // PolyShaders, so their addresses are stable identities for as long as the
+    // key exists.
+    const VirtualProgram::ProgramKeyHash PROGRAM_KEY_HASH_SEED = 0xcbf29ce484222325ULL;
+
+    inline VirtualProgram::ProgramKeyHash hashProgramKey(VirtualProgram::ProgramKeyHash hash, const PolyShader* shader)
+    {
+        VirtualProgram::ProgramKeyHash value = (VirtualProgram::ProgramKeyHash)reinterpret_cast<size_t>(shader);
+        hash ^= value + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+        return hash;
+    }
+
     /** A device that lets us do a const search on the State's attribute map. OSG does not yet
         have a const way to do this. It has getAttributeVec() but that is non-const (it creates
         the vector if it doesn't exist); Newer versions have getAttributeMap(), but that does not
@@ -575,6 +590,9 @@ namespace
             }
         }
 
+        static MetricValue* s_programsBuilt = Metrics::getValue("vp.programs_built");
+        s_programsBuilt->increment();
+
         // Create the new program.
         osg::Program* program = new osg::Program();
         program->setName( programName );
@@ -918,7 +936,7 @@ VirtualProgram::resizeGLObjectBuffers(unsigned maxSize)
 
     for (ProgramMap::iterator i = _programCache.begin(); i != _programCache.end(); ++i)
     {
-        i->second._program->resizeGLObjectBuffers(maxSize);
+        i->second->_program->resizeGLObjectBuffers(maxSize);
     }
 
     // Resize shaders in the PolyShader
@@ -930,6 +948,8 @@ VirtualProgram::resizeGLObjectBuffers(unsigned maxSize)
         }
     }
 
+    _lastProgram.resize(maxSize);
+
     _programCacheMutex.unlock();
 }
 
@@ -941,7 +961,7 @@ VirtualProgram::releaseGLObjects(osg::State* state) const
     for (ProgramMap::const_iterator i = _programCache.begin(); i != _programCache.end(); ++i)
     {
         //if ( i->second->referenceCount() == 1 )
-            i->second._program->releaseGLObjects(state);
+            i->second->_program->releaseGLObjects(state);
     }
 
     for (ShaderMap::const_iterator i = _shaderMap.begin(); i != _shaderMap.end(); ++i)
@@ -953,6 +973,12 @@ VirtualProgram::releaseGLObjects(osg::State* state) const
     }
 
     _programCache.clear();
+    ++_programCacheGeneration;
+
+    if ( state )
+        _lastProgram[state->getContextID()] = 0L;
+    else
+        _lastProgram.clear();
 
     _programCacheMutex.unlock();
 }
@@ -1288,23 +1314,20 @@ VirtualProgram::apply( osg::State& state ) const
         ApplyVars& local = _apply[contextID];
 
         local.accumShaderMap.clear();
-        local.accumAttribBindings.clear();
-        local.accumAttribAliases.clear();
         local.programKey.clear();
 #else
         ApplyVars local;
 #endif
     
         // If we are inheriting, build the active shader map up to this point
-        // (but not including this VP).
+        // (but not including this VP). Attribute bindings are only needed to
+        // build a new program, so they are collected later on a cache miss.
         if ( _inherit )
         {
-            accumulateShaders(
+            accumulateShaderMap(
                 state,
                 _mask,
                 local.accumShaderMap,
-                local.accumAttribBindings,
-                local.accumAttribAliases,
                 acceptCallbacksVary);
         }
         
@@ -1321,41 +1344,84 @@ VirtualProgram::apply( osg::State& state ) const
                 }
             }
 
-            const AttribBindingList& abl = this->getAttribBindingList();
-            local.accumAttribBindings.insert( abl.begin(), abl.end() );
-
-    #ifdef USE_ATTRIB_ALIASES
-            const AttribAliasMap& aliases = this->getAttribAliases();
-            local.accumAttribAliases.insert( aliases.begin(), aliases.end() );
-    #endif
-            
             _dataModelMutex.unlock();
         }
 
         // next, assemble a list of the shaders in the map so we can use it as our
-        // program cache key.
+        // program cache key, hashing it as we go.
         // (Note: at present, the "cache key" does not include any information on the vertex
         // attribute bindings. Technically it should, but in practice this might not be an
         // issue; it is unlikely one would have two identical shader programs with different
         // bindings.)
+        ProgramKeyHash keyHash = PROGRAM_KEY_HASH_SEED;
         for( ShaderMap::iterator i = local.accumShaderMap.begin(); i != local.accumShaderMap.end(); ++i )
         {
-            local.programKey.push_back( i->data()._shader.get() );
+            PolyShader* shader = i->data()._shader.get();
+            local.programKey.push_back( shader );
+            keyHash = hashProgramKey( keyHash, shader );
         }
 
         // current frame number, for shader program expiry.
         unsigned frameNumber = state.getFrameStamp() ? state.getFrameStamp()->getFrameNumber() : 0;
 
-        // look up the program:
+        // look up the program in this context's private table first. Only this
+        // context's draw thread touches it, so no lock is necessary; we just
+        // flush it whenever the shared cache drops entries.
+        unsigned generation = (unsigned)_programCacheGeneration;
+        if ( local.lookupGeneration != generation )
+        {
+            for(unsigned i=0; i<PROGRAM_LOOKUP_SIZE; ++i)
+            {
+                local.lookup[i].entry = 0L;
+                local.lookup[i].key.clear();
+            }
+            local.lookupGeneration = generation;
+        }
+
+        ProgramLookupSlot& slot = local.lookup[keyHash % PROGRAM_LOOKUP_SIZE];
+        if ( slot.entry.valid() && slot.hash == keyHash && slot.key == local.programKey )
+        {
+            slot.entry->_frameLastUsed = frameNumber;
+            program = slot.entry->_program.get();
+        }
+
+        // then in the shared cache:
+        osg::ref_ptr<ProgramEntry> entry;
+        if ( !program.valid() )
         {
             _programCacheMutex.lock();
-            const_cast<VirtualProgram*>(this)->readProgramCache(local.programKey, frameNumber, program);
+            const_cast<VirtualProgram*>(this)->readProgramCache(local.programKey, keyHash, frameNumber, entry);
             _programCacheMutex.unlock();
         }
 
         // if not found, lock and build it:
-        if ( !program.valid() )
+        if ( !program.valid() && !entry.valid() )
         {
+            // collect the attribute bindings from the stack and this VP.
+            local.accumAttribBindings.clear();
+            local.accumAttribAliases.clear();
+
+            if ( _inherit )
+            {
+                accumulateAttribBindings(
+                    state,
+                    _mask,
+                    local.accumAttribBindings,
+                    local.accumAttribAliases);
+            }
+
+            _dataModelMutex.lock();
+
+            const AttribBindingList& abl = this->getAttribBindingList();
+            local.accumAttribBindings.insert( abl.begin(), abl.end() );
+
+    #ifdef USE_ATTRIB_ALIASES
+            const AttribAliasMap& aliases = this->getAttribAliases();
+            local.accumAttribAliases.insert( aliases.begin(), aliases.end() );
+    #endif
+
+            _dataModelMutex.unlock();
+
             // build a new set of accumulated functions, to support the creation of main()
             ShaderComp::FunctionLocationMap accumFunctions;
             accumulateFunctions( state, accumFunctions );
@@ -1366,8 +1432,8 @@ VirtualProgram::apply( osg::State& state ) const
                 Threading::ScopedMutexLock lock(_programCacheMutex);
 
                 // double-check: look again to negate race conditions
-                const_cast<VirtualProgram*>(this)->readProgramCache(local.programKey, frameNumber, program);
-                if ( !program.valid() )
+                const_cast<VirtualProgram*>(this)->readProgramCache(local.programKey, keyHash, frameNumber, entry);
+                if ( !entry.valid() )
                 {
                     local.programKey.clear();
 
@@ -1415,16 +1481,30 @@ VirtualProgram::apply( osg::State& state ) const
                     // global sharing.
                     Registry::programSharedRepo()->share( program );
 
+                    // pick up a previously linked binary of this program, if there is one.
+                    Registry::instance()->getProgramBinaryCache()->attach( program.get() );
+
                     // finally, put own new program in the cache.
-                    ProgramEntry& pe = _programCache[local.programKey];
-                    pe._program = program.get();
-                    pe._frameLastUsed = frameNumber;
+                    entry = new ProgramEntry();
+                    entry->_program = program.get();
+                    entry->_hash = keyHash;
+                    entry->_frameLastUsed = frameNumber;
+                    _programCache[local.programKey] = entry.get();
 
                     // purge expired programs.
                     const_cast<VirtualProgram*>(this)->removeExpiredProgramsFromCache(state, frameNumber);
                 }
             }
         }
+
+        // remember the selection in this context's lookup table.
+        if ( entry.valid() )
+        {
+            program = entry->_program.get();
+            slot.hash = keyHash;
+            slot.key = local.programKey;
+            slot.entry = entry.get();
+        }
     }
 
     // finally, apply the program attribute.
@@ -1449,6 +1529,24 @@ VirtualProgram::apply( osg::State& state ) const
 #else
         pcp = program->getPCP( contextID );
 #endif
+
+        // If the new program can compile in the background, keep drawing with
+        // the last program this VP used on this context until it's ready.
+        if ( pcp->needsLink() && !program->getProgramBinary() )
+        {
+            osg::Program* last = _lastProgram[contextID].get();
+            if ( last && last != program.get() &&
+                 Registry::instance()->getProgramCompiler()->compile( program.get(), state ) == ProgramCompiler::PENDING )
+            {
+                program = last;
+#if OSG_VERSION_GREATER_OR_EQUAL(3,3,4)
+                pcp = program->getPCP( state );
+#else
+                pcp = program->getPCP( contextID );
+#endif
+            }
+        }
+
         bool useProgram = state.getLastAppliedProgramObject() != pcp;
 
 #ifdef DEBUG_APPLY_COUNTS
@@ -1483,7 +1581,29 @@ VirtualProgram::apply( osg::State& state ) const
         if ( useProgram )
         {
             if( pcp->needsLink() )
-                program->compileGLObjects( state );
+            {
+                ProgramBinaryCache* binaryCache = Registry::instance()->getProgramBinaryCache();
+
+                if ( program->getProgramBinary() )
+                {
+                    // linking from a cached binary; no need to compile the shaders.
+                    pcp->linkProgram( state );
+
+                    // a binary from a different driver or GPU will fail to link;
+                    // throw it out and build from source instead.
+                    if ( !pcp->isLinked() )
+                    {
+                        binaryCache->discard( program.get() );
+                        program->compileGLObjects( state );
+                        binaryCache->store( program.get(), state );
+                    }
+                }
+                else
+                {
+                    program->compileGLObjects( state );
+                    binaryCache->store( program.get(), state );
+                }
+            }
 
             if( pcp->isLinked() )
             {
@@ -1492,6 +1612,8 @@ VirtualProgram::apply( osg::State& state ) const
 
                 pcp->useProgram();
                 state.setLastAppliedProgramObject( pcp );
+
+                _lastProgram[contextID] = program.get();
             }
             else
             {
@@ -1522,13 +1644,16 @@ VirtualProgram::removeExpiredProgramsFromCache(osg::State& state, unsigned frame
         // ASSUME a mutex lock on the cache.
         for(ProgramMap::iterator k=_programCache.begin(); k!=_programCache.end(); )
         {
-            if ( frameNumber - k->second._frameLastUsed > 2 )
+            if ( frameNumber - k->second->_frameLastUsed > 2 )
             {
-                if ( k->second._program->referenceCount() == 1 )
+                if ( k->second->_program->referenceCount() == 1 )
                 {
-                    k->second._program->releaseGLObjects(&state);
+                    k->second->_program->releaseGLObjects(&state);
                 }
                 k = _programCache.erase(k);
+
+                // per-context lookup tables may still reference it.
+                ++_programCacheGeneration;
             }
             else
             {
@@ -1539,17 +1664,21 @@ VirtualProgram::removeExpiredProgramsFromCache(osg::State& state, unsigned frame
 }
 
 bool
-VirtualProgram::readProgramCache(const ProgramKey& vec, unsigned frameNumber, osg::ref_ptr<osg::Program>& program)
-//VirtualProgram::readProgramCache(const ShaderVector& vec, unsigned frameNumber, osg::ref_ptr<osg::Program>& program)
+VirtualProgram::readProgramCache(const ProgramKey& key, ProgramKeyHash hash, unsigned frameNumber, osg::ref_ptr<ProgramEntry>& entry)
 {
-    ProgramMap::iterator p = _programCache.find( vec );
-    if ( p != _programCache.end() )
+    // ASSUME a mutex lock on the cache.
+    for(ProgramMap::iterator p = _programCache.begin(); p != _programCache.end(); ++p)
     {
-        // update as current..
-        p->second._frameLastUsed = frameNumber;
-        program = p->second._program.get();
+        // compare the hash first; the key comparison only confirms the match.
+        if ( p->second->_hash == hash && p->first == key )
+        {
+            // update as current..
+            p->second->_frameLastUsed = frameNumber;
+            entry = p->second.get();
+            return true;
+        }
     }
-    return program.valid();
+    return false;
 }
 
 
@@ -1674,12 +1803,10 @@ VirtualProgram::accumulateFunctions(const osg::State&                state,
 
 
 void
-VirtualProgram::accumulateShaders(const osg::State&  state, 
-                                  unsigned           mask,
-                                  ShaderMap&         accumShaderMap,
-                                  AttribBindingList& accumAttribBindings,
-                                  AttribAliasMap&    accumAttribAliases,
-                                  bool&              acceptCallbacksVary)
+VirtualProgram::accumulateShaderMap(const osg::State&  state,
+                                    unsigned           mask,
+                                    ShaderMap&         accumShaderMap,
+                                    bool&              acceptCallbacksVary)
 {
     acceptCallbacksVary = false;
 
@@ -1708,7 +1835,35 @@ VirtualProgram::accumulateShaders(const osg::State&  state,
 
                 // thread-safely adds the other vp's shaders to our accumulation map
                 vp->addShadersToAccumulationMap( accumShaderMap, state );
+            }
+        }
+    }
+}
+
+void
+VirtualProgram::accumulateAttribBindings(const osg::State&  state,
+                                         unsigned           mask,
+                                         AttribBindingList& accumAttribBindings,
+                                         AttribAliasMap&    accumAttribAliases)
+{
+    const AttrStack* av = StateEx::getProgramStack(state);
+    if ( av && av->size() > 0 )
+    {
+        // find the deepest VP that doesn't inherit:
+        unsigned start = 0;
+        for( start = (int)av->size()-1; start > 0; --start )
+        {
+            const VirtualProgram* vp = dynamic_cast<const VirtualProgram*>( (*av)[start].first );
+            if ( vp && (vp->_mask & mask) && vp->_inherit == false )
+                break;
+        }
 
+        // collect bindings from there to here:
+        for( unsigned i=start; i<av->size(); ++i )
+        {
+            const VirtualProgram* vp = dynamic_cast<const VirtualProgram*>( (*av)[i].first );
+            if ( vp && (vp->_mask && mask) )
+            {
                 const AttribBindingList& abl = vp->getAttribBindingList();
                 accumAttribBindings.insert( abl.begin(), abl.end() );
 
@@ -1721,6 +1876,18 @@ VirtualProgram::accumulateShaders(const osg::State&  state,
     }
 }
 
+void
+VirtualProgram::accumulateShaders(const osg::State&  state, 
+                                  unsigned           mask,
+                                  ShaderMap&         accumShaderMap,
+                                  AttribBindingList& accumAttribBindings,
+                                  AttribAliasMap&    accumAttribAliases,
+                                  bool&              acceptCallbacksVary)
+{
+    accumulateShaderMap( state, mask, accumShaderMap, acceptCallbacksVary );
+    accumulateAttribBindings( state, mask, accumAttribBindings, accumAttribAliases );
+}
+
 void
 VirtualProgram::addShadersToAccumulationMap(VirtualProgram::ShaderMap& accumMap,
                                             const osg::State&          state) const
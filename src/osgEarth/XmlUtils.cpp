@@ -20,6 +20,8 @@
 #include <osgEarth/XmlUtils>
 
 #include "tinyxml.h"
+#include <iterator>
+#include <string.h>
 
 
 using namespace osgEarth;
@@ -175,20 +177,17 @@ XmlElement::findElement(const std::string& name) const
 std::string
 XmlElement::getText() const
 {
-    std::stringstream builder;
+    std::string builder;
 
     for( XmlNodeList::const_iterator i = getChildren().begin(); i != getChildren().end(); i++ )
     {
         if ( i->get()->isText() )
         {
-            builder << ( static_cast<XmlText*>( i->get() ) )->getValue();
+            builder += ( static_cast<XmlText*>( i->get() ) )->getValue();
         }
     }
 
- 	 std::string builderStr;
-	 builderStr = builder.str();
-    std::string result = trim( builderStr );
-    return result;
+    return trim( builder );
 }
 
 
@@ -236,6 +235,49 @@ XmlElement::addSubElement(const std::string& tag, const Properties& attrs, const
     children.push_back(ele);
 }
 
+namespace
+{
+    // Fills in the Config for a (non-include) element in place. Returning
+    // each child by value and adding it to its parent would copy every
+    // subtree once per level, and setReferrer() would walk it again.
+    // "absReferrer" must already be absolute (or empty) so each node can
+    // take it without resolving the path again.
+    void buildConfig(const XmlElement* e, const std::string& referrer, const std::string& absReferrer, Config& conf)
+    {
+        conf.key() = e->getName();
+        conf.setReferrer( absReferrer );
+
+        ConfigSet& children = conf.children();
+
+        for( XmlAttributes::const_iterator a = e->getAttrs().begin(); a != e->getAttrs().end(); a++ )
+        {
+            children.push_back( Config(a->first, a->second) );
+            children.back().setReferrer( absReferrer );
+        }
+
+        for( XmlNodeList::const_iterator c = e->getChildren().begin(); c != e->getChildren().end(); c++ )
+        {
+            const XmlNode* n = c->get();
+            if ( n->isElement() )
+            {
+                const XmlElement* child = static_cast<const XmlElement*>(n);
+                if ( child->isInclude() )
+                {
+                    children.push_back( child->getConfig(referrer) );
+                    children.back().setReferrer( absReferrer );
+                }
+                else
+                {
+                    children.push_back( Config() );
+                    buildConfig( child, referrer, absReferrer, children.back() );
+                }
+            }
+        }
+
+        conf.value() = e->getText();
+    }
+}
+
 Config
 XmlElement::getConfig(const std::string& referrer) const
 {
@@ -270,24 +312,12 @@ XmlElement::getConfig(const std::string& referrer) const
 	}
 	else
 	{
+        // resolve the referrer once for the whole tree
 		Config conf( name );
         conf.setReferrer( referrer );
+        std::string absReferrer = conf.referrer();
 
-		for( XmlAttributes::const_iterator a = attrs.begin(); a != attrs.end(); a++ )
-		{
-			conf.set( a->first, a->second );
-		}
-
-		for( XmlNodeList::const_iterator c = children.begin(); c != children.end(); c++ )
-		{
-			XmlNode* n = c->get();
-			if ( n->isElement() )
-				conf.add( static_cast<const XmlElement*>(n)->getConfig(referrer) );
-		}
-
-		conf.value() = getText();
-		//else 
-		//    conf.value() = trim( static_cast<const XmlText*>(n)->getValue() );
+        buildConfig( this, referrer, absReferrer, conf );
 		return conf;
 	}
 }
@@ -322,95 +352,388 @@ XmlDocument::~XmlDocument()
 
 namespace
 {
-    XmlAttributes
-    getAttributes( const char** attrs )
+    /**
+     * Single-pass XML reader that builds XmlElements directly from the
+     * text, with no intermediate DOM. It reads what the old TinyXML path
+     * kept: elements (tag and attribute names lower-cased), text with
+     * whitespace condensed, and CDATA sections verbatim. Comments,
+     * processing instructions and DOCTYPE blocks are skipped.
+     */
+    class XmlReader
     {
-        XmlAttributes map;
-        const char** ptr = attrs;
-        while( *ptr != NULL )
+    public:
+        XmlReader(const char* begin, const char* end) :
+            _begin(begin), _p(begin), _end(end) { }
+
+        // Reads the document's root element into "parent".
+        bool readRoot(XmlElement* parent)
         {
-            std::string name = *ptr++;
-            std::string value = *ptr++;            
-            map[osgEarth::toLower(name)] = value;
+            // UTF-8 byte order mark
+            if (_end - _p >= 3 && (unsigned char)_p[0] == 0xEF && (unsigned char)_p[1] == 0xBB && (unsigned char)_p[2] == 0xBF)
+                _p += 3;
+
+            for (;;)
+            {
+                skipSpace();
+                if (_p >= _end)
+                    return fail("Document empty");
+                if (*_p != '<')
+                    return fail("Expected an element");
+                if (!skipMarkup())
+                    break;
+                if (!_error.empty())
+                    return false;
+            }
+
+            return readElement(parent);
         }
-        return map;
-    }
 
-    void processNode(XmlElement* parent, TiXmlNode* node)
-    {
-        XmlElement* new_element = 0;
-        switch (node->Type())
+        std::string getError() const
         {
-        case TiXmlNode::TINYXML_ELEMENT:
+            unsigned row = 1, col = 1;
+            for (const char* c = _begin; c < _p && c < _end; ++c)
             {
-                TiXmlElement* element = node->ToElement();
-                std::string tag = osgEarth::toLower(element->Value());
+                if (*c == '\n') { ++row; col = 1; }
+                else ++col;
+            }
+            return Stringify() << _error << " (row " << row << ", col " << col << ")";
+        }
+
+    private:
+        const char* _begin;
+        const char* _p;
+        const char* _end;
+        std::string _error;
+
+        bool fail(const char* message)
+        {
+            if (_error.empty())
+                _error = message;
+            return false;
+        }
 
-                //Get all the attributes
-                XmlAttributes attrs;
-                TiXmlAttribute* attr = element->FirstAttribute();
-                while (attr)
+        static bool isSpace(char c)
+        {
+            return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+        }
+
+        static bool isNameChar(char c)
+        {
+            return
+                (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+                c == '_' || c == '-' || c == '.' || c == ':' || (unsigned char)c >= 0x80;
+        }
+
+        void skipSpace()
+        {
+            while (_p < _end && isSpace(*_p))
+                ++_p;
+        }
+
+        bool startsWith(const char* token) const
+        {
+            const char* q = _p;
+            for (; *token; ++token, ++q)
+            {
+                if (q >= _end || *q != *token)
+                    return false;
+            }
+            return true;
+        }
+
+        // Skips past the next occurrence of "token".
+        bool skipPast(const char* token)
+        {
+            size_t len = strlen(token);
+            for (; _p + len <= _end; ++_p)
+            {
+                if (memcmp(_p, token, len) == 0)
                 {
-                    std::string name  = osgEarth::toLower(attr->Name());
-                    std::string value = attr->Value();
-                    attrs[name] = value;
-                    attr = attr->Next();
+                    _p += len;
+                    return true;
                 }
-                //All the element to the stack
-                new_element = new XmlElement( tag, attrs );
-                parent->getChildren().push_back( new_element );
             }
-            break;
-        case TiXmlNode::TINYXML_TEXT:
+            _p = _end;
+            return false;
+        }
+
+        // Skips a comment, processing instruction, or <!...> declaration at
+        // the read position. Returns false (and doesn't move) if the read
+        // position is something else.
+        bool skipMarkup()
+        {
+            if (startsWith("<!--"))
+            {
+                if (!skipPast("-->")) fail("Unterminated comment");
+                return true;
+            }
+            if (startsWith("<?"))
             {
-                TiXmlText* text = node->ToText();
-                std::string data( text->Value());
-                parent->getChildren().push_back( new XmlText( data ) );
+                if (!skipPast("?>")) fail("Unterminated processing instruction");
+                return true;
             }
-            break;
-        }    
-
-        XmlElement* new_parent = new_element ? new_element : parent;
-        TiXmlNode* child;
-        for (child = node->FirstChild(); child != 0; child = child->NextSibling())
-        {    
-            processNode( new_parent, child );
+            if (startsWith("<!") && !startsWith("<![CDATA["))
+            {
+                // DOCTYPE and friends, which can nest <...> blocks
+                int depth = 0;
+                for (++_p; _p < _end; ++_p)
+                {
+                    if (*_p == '<')
+                        ++depth;
+                    else if (*_p == '>' && depth-- == 0)
+                    {
+                        ++_p;
+                        return true;
+                    }
+                }
+                fail("Unterminated declaration");
+                return true;
+            }
+            return false;
         }
-    }
 
-    void
-    removeDocType(std::string &xmlStr)
-    {
-        //TinyXML has an issue with parsing DTDs.  See http://www.grinninglizard.com/tinyxmldocs/index.html
-        //We need to remove any !DOCTYPE block that appears in the XML before parsing to avoid errors.
-        std::string::size_type startIndex = xmlStr.find("<!DOCTYPE");
-        if (startIndex == xmlStr.npos) return;
-
-        std::string::size_type endIndex = startIndex;
-        int numChildElements = 0;
-        //We've found the first index of the <!DOCTYPE, now find the index of the closing >
-        while (endIndex < xmlStr.size())
-        {
-            endIndex+=1;
-            if (xmlStr[endIndex] == '<')
+        bool readName(std::string& out)
+        {
+            const char* start = _p;
+            while (_p < _end && isNameChar(*_p))
+                ++_p;
+            if (_p == start)
+                return fail("Expected a name");
+            out.assign(start, _p - start);
+            return true;
+        }
+
+        static void appendUTF8(std::string& out, unsigned long cp)
+        {
+            if (cp < 0x80) {
+                out += (char)cp;
+            }
+            else if (cp < 0x800) {
+                out += (char)(0xC0 | (cp >> 6));
+                out += (char)(0x80 | (cp & 0x3F));
+            }
+            else if (cp < 0x10000) {
+                out += (char)(0xE0 | (cp >> 12));
+                out += (char)(0x80 | ((cp >> 6) & 0x3F));
+                out += (char)(0x80 | (cp & 0x3F));
+            }
+            else {
+                out += (char)(0xF0 | (cp >> 18));
+                out += (char)(0x80 | ((cp >> 12) & 0x3F));
+                out += (char)(0x80 | ((cp >> 6) & 0x3F));
+                out += (char)(0x80 | (cp & 0x3F));
+            }
+        }
+
+        // Decodes the entity at the read position into "out". Anything that
+        // isn't a known entity is taken as a literal '&' (as TinyXML did).
+        void readEntity(std::string& out)
+        {
+            static const struct { const char* name; char c; } entities[] = {
+                { "&amp;", '&' }, { "&lt;", '<' }, { "&gt;", '>' }, { "&quot;", '\"' }, { "&apos;", '\'' }
+            };
+
+            if (startsWith("&#"))
+            {
+                const char* q = _p + 2;
+                bool hex = q < _end && *q == 'x';
+                if (hex) ++q;
+
+                unsigned long cp = 0;
+                const char* digits = q;
+                for (; q < _end && *q != ';'; ++q)
+                {
+                    char c = *q;
+                    if      (c >= '0' && c <= '9')         cp = cp * (hex ? 16 : 10) + (c - '0');
+                    else if (hex && c >= 'a' && c <= 'f')  cp = cp * 16 + (c - 'a' + 10);
+                    else if (hex && c >= 'A' && c <= 'F')  cp = cp * 16 + (c - 'A' + 10);
+                    else break;
+                }
+                if (q < _end && *q == ';' && q > digits)
+                {
+                    appendUTF8(out, cp);
+                    _p = q + 1;
+                    return;
+                }
+            }
+            else
             {
-                numChildElements++;
+                for (unsigned i = 0; i < sizeof(entities)/sizeof(entities[0]); ++i)
+                {
+                    if (startsWith(entities[i].name))
+                    {
+                        out += entities[i].c;
+                        _p += strlen(entities[i].name);
+                        return;
+                    }
+                }
             }
-            else if (xmlStr[endIndex] == '>')
+
+            out += '&';
+            ++_p;
+        }
+
+        // Reads an attribute value up to the closing quote, or (unquoted)
+        // up to whitespace or the end of the tag.
+        bool readAttrValue(std::string& out)
+        {
+            out.clear();
+            if (_p < _end && (*_p == '\"' || *_p == '\''))
             {
-                if (numChildElements == 0)
+                char quote = *_p++;
+                while (_p < _end && *_p != quote)
                 {
-                    break;
+                    if (*_p == '&')
+                        readEntity(out);
+                    else
+                        out += *_p++;
                 }
+                if (_p >= _end)
+                    return fail("Unterminated attribute value");
+                ++_p;
+                return true;
+            }
+
+            while (_p < _end && !isSpace(*_p) && *_p != '>' && !startsWith("/>"))
+            {
+                if (*_p == '&')
+                    readEntity(out);
                 else
+                    out += *_p++;
+            }
+            return true;
+        }
+
+        // Reads text up to the next '<', condensing each run of whitespace
+        // into one space and dropping it at either end.
+        void readText(std::string& out)
+        {
+            out.clear();
+            bool space = false;
+            while (_p < _end && *_p != '<')
+            {
+                if (isSpace(*_p))
                 {
-                    numChildElements--;
+                    space = true;
+                    ++_p;
+                    continue;
                 }
+                if (space && !out.empty())
+                    out += ' ';
+                space = false;
+
+                if (*_p == '&')
+                    readEntity(out);
+                else
+                    out += *_p++;
             }
         }
 
-        //Now, replace the <!DOCTYPE> element with whitespace
-        xmlStr.erase(startIndex, endIndex - startIndex + 1);
+        bool readElement(XmlElement* parent)
+        {
+            ++_p; // '<'
+
+            std::string tag;
+            if (!readName(tag))
+                return false;
+
+            XmlAttributes attrs;
+            std::string attrName, attrValue;
+            bool empty = false;
+
+            for (;;)
+            {
+                skipSpace();
+                if (_p >= _end)
+                    return fail("Unterminated element");
+                if (startsWith("/>"))
+                {
+                    _p += 2;
+                    empty = true;
+                    break;
+                }
+                if (*_p == '>')
+                {
+                    ++_p;
+                    break;
+                }
+
+                if (!readName(attrName))
+                    return false;
+                skipSpace();
+                if (_p >= _end || *_p != '=')
+                    return fail("Expected '=' after attribute name");
+                ++_p;
+                skipSpace();
+                if (!readAttrValue(attrValue))
+                    return false;
+                attrs[osgEarth::toLower(attrName)] = attrValue;
+            }
+
+            XmlElement* element = new XmlElement( osgEarth::toLower(tag), attrs );
+            parent->getChildren().push_back( element );
+
+            if (empty)
+                return true;
+
+            std::string text;
+            for (;;)
+            {
+                if (_p >= _end)
+                    return fail("Unterminated element");
+
+                if (*_p != '<')
+                {
+                    readText(text);
+                    if (!text.empty())
+                        element->getChildren().push_back( new XmlText(text) );
+                }
+                else if (startsWith("</"))
+                {
+                    _p += 2;
+                    const char* name = _p;
+                    if (_end - _p < (std::ptrdiff_t)tag.size() || tag.compare(0, tag.size(), name, tag.size()) != 0)
+                        return fail("Mismatched end tag");
+                    _p += tag.size();
+                    skipSpace();
+                    if (_p >= _end || *_p != '>')
+                        return fail("Mismatched end tag");
+                    ++_p;
+                    return true;
+                }
+                else if (startsWith("<![CDATA["))
+                {
+                    _p += 9;
+                    const char* start = _p;
+                    if (!skipPast("]]>"))
+                        return fail("Unterminated CDATA section");
+                    element->getChildren().push_back( new XmlText(std::string(start, _p - 3 - start)) );
+                }
+                else if (skipMarkup())
+                {
+                    if (!_error.empty())
+                        return false;
+                }
+                else if (!readElement(element))
+                {
+                    return false;
+                }
+            }
+        }
+    };
+
+    // Parses a document into "doc". Returns false on error.
+    bool parse(XmlDocument* doc, const std::string& xml, const URIContext& uriContext)
+    {
+        XmlReader reader(xml.data(), xml.data() + xml.size());
+        if (!reader.readRoot(doc))
+        {
+            OE_WARN << "Error in XML document: " << reader.getError() << std::endl;
+            if ( !uriContext.referrer().empty() )
+                OE_WARN << uriContext.referrer() << std::endl;
+            return false;
+        }
+        return true;
     }
 }
 
@@ -424,58 +747,32 @@ XmlDocument::load( const std::string& location, const osgDB::Options* dbOptions
 XmlDocument*
 XmlDocument::load( const URI& uri, const osgDB::Options* dbOptions )
 {
-    XmlDocument* result = 0L;
-
     ReadResult r = uri.readString( dbOptions );
     if ( r.succeeded() )
     {
-        std::stringstream buf( r.getString() );
-        URIContext context( uri.full() );
-        result = load( buf, context );
-        if ( result )
+        osg::ref_ptr<XmlDocument> doc = new XmlDocument();
+        if ( parse(doc.get(), r.getString(), URIContext(uri.full())) )
         {
-            result->_sourceURI = uri;
+            doc->_sourceURI = uri;
+            return doc.release();
         }
     }
 
-    return result;
+    return 0L;
 }
 
 XmlDocument*
 XmlDocument::load( std::istream& in, const URIContext& uriContext )
 {
-    TiXmlDocument xmlDoc;
-
     //Read the entire document into a string
-    std::stringstream buffer;
-    buffer << in.rdbuf();
-    std::string xmlStr;
-    xmlStr = buffer.str();
-
-    removeDocType( xmlStr );
-    //OE_NOTICE << xmlStr;
-
-    XmlDocument* doc = NULL;
-    xmlDoc.Parse(xmlStr.c_str());    
+    std::string xmlStr((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
 
-    if ( xmlDoc.Error() )
-    {
-        std::stringstream buf;
-        buf << xmlDoc.ErrorDesc() << " (row " << xmlDoc.ErrorRow() << ", col " << xmlDoc.ErrorCol() << ")";
-        std::string str;
-        str = buf.str();
-        OE_WARN << "Error in XML document: " << str << std::endl;
-        if ( !uriContext.referrer().empty() )
-            OE_WARN << uriContext.referrer() << std::endl;
-    }
+    osg::ref_ptr<XmlDocument> doc = new XmlDocument();
+    if ( !parse(doc.get(), xmlStr, uriContext) )
+        return 0L;
 
-    if ( !xmlDoc.Error() && xmlDoc.RootElement() )
-    {
-        doc = new XmlDocument();
-        processNode( doc,  xmlDoc.RootElement() );
-        doc->_sourceURI = URI("", uriContext);
-    }
-    return doc;    
+    doc->_sourceURI = URI("", uriContext);
+    return doc.release();
 }
 
 Config
@@ -61,11 +61,37 @@ AnnotationLayer::getGroup() const
     return _root.get();
 }
 
+AnnotationPager*
+AnnotationLayer::getPager() const
+{
+    return _pager.get();
+}
+
 void
 AnnotationLayer::deserialize()
 {
     // reset:
     _root->removeChildren(0, _root->getNumChildren());
+    _pager = 0L;
+
+    if (options().paging() == true)
+    {
+        _pager = new AnnotationPager();
+        _pager->setTileLOD(options().pagingLOD().get());
+        _pager->setRangeFactor(options().pagingRangeFactor().get());
+        _pager->setReadOptions(getReadOptions());
+
+        // annotations without a position end up in the pager's unpaged set:
+        const ConfigSet& children = options().getConfig().children();
+        for (ConfigSet::const_iterator i = children.begin(); i != children.end(); ++i)
+        {
+            if (!i->children().empty())
+                _pager->add(*i);
+        }
+
+        _root->addChild(_pager.get());
+        return;
+    }
 
     // deserialize from the options:
     osg::Group* group = 0L;
@@ -0,0 +1,435 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2016 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarthAnnotation/AnnotationPager>
+#include <osgEarthAnnotation/AnnotationRegistry>
+#include <osgEarthAnnotation/GeoPositionNode>
+#include <osgEarth/Registry>
+#include <osgEarth/NodeUtils>
+
+#define LC "[AnnotationPager] "
+
+using namespace osgEarth;
+using namespace osgEarth::Annotation;
+
+/**
+ * Annotations that share a tile (or the unpaged set), with a revision
+ * that counts edits.
+ */
+class AnnotationPager::Bucket : public osg::Referenced
+{
+public:
+    Bucket(const osgDB::Options* readOptions) : _readOptions(readOptions), _revision(0u) { }
+
+    osg::ref_ptr<const osgDB::Options> _readOptions;
+    Entries                            _entries;
+    unsigned                           _revision;
+    Threading::Mutex                   _mutex;
+};
+
+/**
+ * Group holding the instantiated annotations of a bucket, keyed by entry
+ * ID. It follows edits to the bucket during the update traversal, so only
+ * the content that's actually in the scene graph ever does any work.
+ */
+class AnnotationPager::Content : public osg::Group
+{
+public:
+    Content(Bucket* bucket) : _bucket(bucket), _revision(~0u)
+    {
+        ADJUST_UPDATE_TRAV_COUNT(this, +1);
+    }
+
+    //! Brings the group in line with the bucket.
+    void sync()
+    {
+        Entries entries;
+        unsigned revision;
+        {
+            Threading::ScopedMutexLock lock(_bucket->_mutex);
+            if (_revision == _bucket->_revision)
+                return;
+            entries = _bucket->_entries;
+            revision = _bucket->_revision;
+        }
+
+        // drop the nodes whose entries are gone:
+        for (Nodes::iterator i = _nodes.begin(); i != _nodes.end(); )
+        {
+            if (entries.find(i->first) == entries.end())
+            {
+                removeChild(i->second);
+                _nodes.erase(i++);
+            }
+            else ++i;
+        }
+
+        // and instantiate the new ones:
+        for (Entries::const_iterator e = entries.begin(); e != entries.end(); ++e)
+        {
+            if (_nodes.find(e->first) == _nodes.end())
+                add(e->second);
+        }
+
+        _revision = revision;
+    }
+
+    virtual void traverse(osg::NodeVisitor& nv)
+    {
+        if (nv.getVisitorType() == nv.UPDATE_VISITOR)
+            sync();
+
+        osg::Group::traverse(nv);
+    }
+
+protected:
+    typedef std::map<UID, osg::Node*> Nodes;
+    osg::ref_ptr<Bucket> _bucket;
+    unsigned             _revision;
+    Nodes                _nodes;
+
+    void add(const Entry& entry)
+    {
+        osg::ref_ptr<osg::Node> node = entry._node.get();
+        if (!node.valid())
+        {
+            osg::Group* group = 0L;
+            AnnotationRegistry::instance()->create(0L, entry._conf, _bucket->_readOptions.get(), group);
+            osg::ref_ptr<osg::Group> holder = group;
+            if (group)
+                node = group->getNumChildren() == 1 ? group->getChild(0) : group;
+        }
+
+        if (node.valid())
+        {
+            addChild(node.get());
+            _nodes[entry._uid] = node.get();
+        }
+    }
+};
+
+/**
+ * Paged node for one tile. Its paged child is a Content group built from
+ * the tile's bucket.
+ */
+class AnnotationPager::Tile : public PagedNode
+{
+public:
+    Tile(const TileKey& key, float rangeFactor, const osgDB::Options* readOptions) :
+        _bucket(new Bucket(readOptions))
+    {
+        // bound the tile on the ellipsoid; annotations raised far above the
+        // ground will page in a little late.
+        const GeoExtent& extent = key.getExtent();
+        const int samples = 4;
+        for (int c = 0; c <= samples; ++c)
+        {
+            for (int r = 0; r <= samples; ++r)
+            {
+                GeoPoint p(
+                    extent.getSRS(),
+                    extent.xMin() + extent.width()*(double)c/(double)samples,
+                    extent.yMin() + extent.height()*(double)r/(double)samples,
+                    0.0,
+                    ALTMODE_ABSOLUTE);
+                osg::Vec3d world;
+                p.toWorld(world);
+                _bound.expandBy(world);
+            }
+        }
+
+        setRangeFactor(rangeFactor);
+        setupPaging();
+    }
+
+    virtual osg::BoundingSphere getChildBound() const
+    {
+        return _bound;
+    }
+
+    virtual osg::Node* loadChild()
+    {
+        // instantiate in the pager thread; the update traversal catches
+        // any edits made while the load was in flight.
+        osg::ref_ptr<Content> content = new Content(_bucket.get());
+        content->sync();
+        return content.release();
+    }
+
+    osg::ref_ptr<Bucket> _bucket;
+    osg::BoundingSphere  _bound;
+};
+
+//------------------------------------------------------------------------
+
+AnnotationPager::AnnotationPager(const Profile* profile) :
+_profile        ( profile ),
+_lod            ( 8u ),
+_rangeFactor    ( 6.0f ),
+_updateRequested( false )
+{
+    if (!_profile.valid())
+        _profile = Registry::instance()->getGlobalGeodeticProfile();
+
+    _tileGroup = new osg::Group();
+    addChild(_tileGroup.get());
+
+    _unpaged = new Bucket(0L);
+    addChild(new Content(_unpaged.get()));
+
+    // new and emptied tiles join or leave the scene graph during the
+    // update traversal.
+    ADJUST_UPDATE_TRAV_COUNT(this, +1);
+}
+
+void
+AnnotationPager::setTileLOD(unsigned lod)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    if (_locations.empty())
+        _lod = lod;
+    else
+        OE_WARN << LC << "Tile LOD can't change once the pager holds annotations\n";
+}
+
+void
+AnnotationPager::setReadOptions(const osgDB::Options* value)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    _readOptions = value;
+    _unpaged->_readOptions = value;
+}
+
+UID
+AnnotationPager::add(const Config& conf)
+{
+    Entry entry;
+    entry._conf = conf;
+
+    // annotations that have a position can be paged:
+    GeoPoint location;
+    if (conf.hasChild("position"))
+        location = GeoPoint(conf.child("position"));
+
+    return add(entry, location);
+}
+
+UID
+AnnotationPager::add(AnnotationNode* node)
+{
+    if (!node)
+        return -1;
+
+    Entry entry;
+    entry._node = node;
+
+    GeoPoint location;
+    GeoPositionNode* geo = dynamic_cast<GeoPositionNode*>(node);
+    if (geo)
+        location = geo->getPosition();
+
+    return add(entry, location);
+}
+
+AnnotationPager::Bucket*
+AnnotationPager::getBucket(const TileKey& key) const
+{
+    if (!key.valid())
+        return _unpaged.get();
+
+    Tiles::const_iterator t = _tiles.find(key);
+    return t != _tiles.end() ? t->second->_bucket.get() : 0L;
+}
+
+UID
+AnnotationPager::add(const Entry& input, const GeoPoint& location)
+{
+    Entry entry = input;
+    entry._uid = Registry::instance()->createUID();
+
+    TileKey key;
+    if (location.isValid())
+    {
+        GeoPoint p = location.transform(_profile->getSRS());
+        if (p.isValid())
+            key = _profile->createTileKey(p.x(), p.y(), _lod);
+    }
+
+    Threading::ScopedMutexLock lock(_mutex);
+
+    if (key.valid())
+    {
+        osg::ref_ptr<Tile>& tile = _tiles[key];
+        if (!tile.valid())
+        {
+            tile = new Tile(key, _rangeFactor, _readOptions.get());
+            _changed.insert(key);
+            _updateRequested = true;
+        }
+    }
+
+    Bucket* bucket = getBucket(key);
+    {
+        Threading::ScopedMutexLock bucketLock(bucket->_mutex);
+        bucket->_entries[entry._uid] = entry;
+        ++bucket->_revision;
+    }
+
+    _locations[entry._uid] = key;
+    if (entry._node.valid())
+        _nodeIDs[entry._node.get()] = entry._uid;
+
+    return entry._uid;
+}
+
+bool
+AnnotationPager::remove(UID uid)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+
+    std::map<UID, TileKey>::iterator i = _locations.find(uid);
+    if (i == _locations.end())
+        return false;
+
+    Bucket* bucket = getBucket(i->second);
+    if (bucket)
+    {
+        Threading::ScopedMutexLock bucketLock(bucket->_mutex);
+        Entries::iterator e = bucket->_entries.find(uid);
+        if (e != bucket->_entries.end())
+        {
+            if (e->second._node.valid())
+                _nodeIDs.erase(e->second._node.get());
+            bucket->_entries.erase(e);
+            ++bucket->_revision;
+        }
+
+        if (bucket->_entries.empty() && i->second.valid())
+        {
+            _changed.insert(i->second);
+            _updateRequested = true;
+        }
+    }
+
+    _locations.erase(i);
+    return true;
+}
+
+bool
+AnnotationPager::remove(AnnotationNode* node)
+{
+    UID uid;
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+        std::map<AnnotationNode*, UID>::const_iterator i = _nodeIDs.find(node);
+        if (i == _nodeIDs.end())
+            return false;
+        uid = i->second;
+    }
+    return remove(uid);
+}
+
+void
+AnnotationPager::clear()
+{
+    Threading::ScopedMutexLock lock(_mutex);
+
+    for (Tiles::iterator t = _tiles.begin(); t != _tiles.end(); ++t)
+    {
+        Bucket* bucket = t->second->_bucket.get();
+        Threading::ScopedMutexLock bucketLock(bucket->_mutex);
+        bucket->_entries.clear();
+        ++bucket->_revision;
+        _changed.insert(t->first);
+    }
+
+    {
+        Threading::ScopedMutexLock bucketLock(_unpaged->_mutex);
+        _unpaged->_entries.clear();
+        ++_unpaged->_revision;
+    }
+
+    _locations.clear();
+    _nodeIDs.clear();
+    _updateRequested = true;
+}
+
+unsigned
+AnnotationPager::getNumAnnotations() const
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    return _locations.size();
+}
+
+unsigned
+AnnotationPager::getNumTiles() const
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    return _tiles.size();
+}
+
+void
+AnnotationPager::update()
+{
+    Threading::ScopedMutexLock lock(_mutex);
+
+    for (std::set<TileKey>::const_iterator i = _changed.begin(); i != _changed.end(); ++i)
+    {
+        Tiles::iterator t = _tiles.find(*i);
+        if (t == _tiles.end())
+            continue;
+
+        Tile* tile = t->second.get();
+
+        bool empty;
+        {
+            Threading::ScopedMutexLock bucketLock(tile->_bucket->_mutex);
+            empty = tile->_bucket->_entries.empty();
+        }
+
+        if (empty)
+        {
+            _tileGroup->removeChild(tile);
+            _tiles.erase(t);
+        }
+        else if (tile->getNumParents() == 0)
+        {
+            _tileGroup->addChild(tile);
+        }
+    }
+
+    _changed.clear();
+    _updateRequested = false;
+}
+
+void
+AnnotationPager::traverse(osg::NodeVisitor& nv)
+{
+    if (nv.getVisitorType() == nv.UPDATE_VISITOR)
+    {
+        bool needsUpdate;
+        {
+            Threading::ScopedMutexLock lock(_mutex);
+            needsUpdate = _updateRequested;
+        }
+        if (needsUpdate)
+            update();
+    }
+
+    osg::Group::traverse(nv);
+}
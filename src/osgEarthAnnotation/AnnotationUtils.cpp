@@ -89,11 +89,17 @@ AnnotationUtils::createTextDrawable(const std::string& text,
         text_encoding = convertTextSymbolEncoding(symbol->encoding().value());
     }
 
-    drawable->setText( text, text_encoding );
-
+    // the symbol's settings go in first, so the glyphs are laid out once
+    // with the final font and size; a symbol with content set replaces
+    // the text anyway.
     TextSymbolizer symbolizer(symbol);
     symbolizer.apply(drawable, 0L, 0L, &box);
 
+    if ( !symbol || !symbol->content().isSet() )
+    {
+        drawable->setText( text, text_encoding );
+    }
+
     // osgText::Text turns on depth writing by default, even if you turned it off.
     drawable->setEnableDepthWrites( false );
     
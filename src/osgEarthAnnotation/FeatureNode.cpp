@@ -59,6 +59,8 @@ _options           ( options ),
 _needsRebuild      ( true ),
 _styleSheet        ( styleSheet ),
 _clampDirty        (false),
+_clampAll          (true),
+_clampLOD          (0u),
 _index             ( 0 )
 {
     _features.push_back( feature );
@@ -81,6 +83,8 @@ _options        ( options ),
 _needsRebuild   ( true ),
 _styleSheet     ( styleSheet ),
 _clampDirty     ( false ),
+_clampAll       ( true ),
+_clampLOD       ( 0u ),
 _index          ( 0 )
 {
     _features.insert( _features.end(), features.begin(), features.end() );
@@ -121,6 +125,7 @@ FeatureNode::build()
     }
 
     _clamperData.clear();
+    _clampAll = true;
 
     osg::Node* node = _compiled.get();
     if (_needsRebuild || !_compiled.valid() )
@@ -313,28 +318,41 @@ FeatureNode::onTileAdded(const TileKey&          key,
                          osg::Node*              graph,
                          TerrainCallbackContext& context)
 {
-    if (!_clampDirty)
+    bool needsClamp;
+
+    if (key.valid())
+    {
+        osg::Polytope tope;
+        key.getExtent().createPolytope(tope);
+        needsClamp = tope.contains(this->getBound());
+    }
+    else
     {
-        bool needsClamp;
+        // without a valid tilekey we don't know the extent of the change,
+        // so clamping is required.
+        needsClamp = true;
+    }
 
-        if (key.valid())
+    if (needsClamp)
+    {
+        // Accumulate the changed area (even if a clamp is already pending)
+        // so the next clamp only needs to revisit the verts under it.
+        if (!key.valid())
         {
-            osg::Polytope tope;
-            key.getExtent().createPolytope(tope);
-            needsClamp = tope.contains(this->getBound());
+            _clampAll = true;
         }
         else
         {
-            // without a valid tilekey we don't know the extent of the change,
-            // so clamping is required.
-            needsClamp = true;
+            if (!_clampExtent.expandToInclude(key.getExtent()))
+                _clampExtent = key.getExtent();
+
+            _clampLOD = osg::maximum(_clampLOD, key.getLOD());
         }
 
-        if (needsClamp)
+        if (!_clampDirty)
         {
             _clampDirty = true;
             ADJUST_UPDATE_TRAV_COUNT(this, +1);
-            //clamp(graph, context.getTerrain());
         }
     }
 }
@@ -357,8 +375,24 @@ FeatureNode::clamp(osg::Node* graph, const Terrain* terrain)
         clamper.setUseVertexZ( relative );
         clamper.setOffset( offset );
 
+        // Sample the elevation pool in batches when we can, and limit the
+        // work to the terrain tiles that actually changed.
+        if (getMapNode())
+        {
+            clamper.setElevationPool( getMapNode()->getMap()->getElevationPool() );
+
+            if (_clampLOD > 0u)
+                clamper.setElevationLOD( _clampLOD );
+
+            if (!_clampAll)
+                clamper.setExtent( _clampExtent );
+        }
+
         this->accept( clamper );
     }
+
+    _clampExtent = GeoExtent::INVALID;
+    _clampAll = false;
 }
 
 void
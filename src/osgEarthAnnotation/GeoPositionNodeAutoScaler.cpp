@@ -23,6 +23,7 @@
 #include <osgEarthAnnotation/GeoPositionNodeAutoScaler>
 #include <osgEarthAnnotation/GeoPositionNode>
 #include <osgUtil/CullVisitor>
+#include <osg/PositionAttitudeTransform>
 
 #define LC "[GeoPositionNodeAutoScaler] "
 
@@ -38,6 +39,57 @@ _maxScale( maxScale )
     //nop
 }
 
+namespace
+{
+    // Same as osg::Transform::computeBound for a single transformed sphere.
+    osg::BoundingSphere transformBound(const osg::BoundingSphere& bs, const osg::Matrixd& m)
+    {
+        osg::Vec3d c = bs.center();
+        osg::Vec3d xdash = c + osg::Vec3d(bs.radius(), 0.0, 0.0);
+        osg::Vec3d ydash = c + osg::Vec3d(0.0, bs.radius(), 0.0);
+        osg::Vec3d zdash = c + osg::Vec3d(0.0, 0.0, bs.radius());
+
+        osg::Vec3d center = c * m;
+        double radius = osg::maximum(
+            osg::maximum((xdash*m - center).length(), (ydash*m - center).length()),
+            (zdash*m - center).length());
+
+        return osg::BoundingSphere(center, radius);
+    }
+}
+
+osg::BoundingSphere
+GeoPositionNodeAutoScaler::getBaseBound(GeoPositionNode* geo) const
+{
+    osg::PositionAttitudeTransform* pat = geo->getPositionAttitudeTransform();
+    GeoTransform* xform = geo->getGeoTransform();
+
+    // Work it out from the (cached) bounds below the scale, so the scale
+    // doesn't have to be reset first; that would dirty the bound of the node
+    // and all its parents in every cull. Anything but the stock layout
+    // takes the slow way.
+    if (geo->getNumChildren() != 1u || geo->getChild(0) != xform ||
+        xform->getNumChildren() != 1u || xform->getChild(0) != pat)
+    {
+        pat->setScale(_baseScale);
+        return geo->getBound();
+    }
+
+    osg::BoundingSphere content = pat->osg::Group::computeBound();
+    if (!content.valid())
+        return content;
+
+    osg::Matrixd m =
+        osg::Matrixd::translate(-pat->getPivotPoint()) *
+        osg::Matrixd::scale(_baseScale) *
+        osg::Matrixd::rotate(pat->getAttitude()) *
+        osg::Matrixd::translate(pat->getPosition());
+
+    xform->computeLocalToWorldMatrix(m, 0L);
+
+    return transformBound(content, m);
+}
+
 void
 GeoPositionNodeAutoScaler::operator()(osg::Node* node, osg::NodeVisitor* nv)
 {
@@ -58,9 +110,7 @@ GeoPositionNodeAutoScaler::operator()(osg::Node* node, osg::NodeVisitor* nv)
 
     if (cam->getViewport())
     {
-        // Reset the scale so we get a proper bound
-        geo->getPositionAttitudeTransform()->setScale(_baseScale);
-        const osg::BoundingSphere& bs = node->getBound();
+        osg::BoundingSphere bs = getBaseBound(geo);
 
         // transform centroid to VIEW space:
         osg::Vec3d centerView = bs.center() * cam->getViewMatrix();
@@ -83,8 +133,10 @@ GeoPositionNodeAutoScaler::operator()(osg::Node* node, osg::NodeVisitor* nv)
         else if (scale>_maxScale)
             scale = _maxScale;
 
-        geo->getPositionAttitudeTransform()->setScale(
-            osg::componentMultiply(_baseScale, osg::Vec3d(scale, scale, scale)));
+        // only touch the transform (and dirty the bounds) on a change.
+        osg::Vec3d newScale = osg::componentMultiply(_baseScale, osg::Vec3d(scale, scale, scale));
+        if (geo->getPositionAttitudeTransform()->getScale() != newScale)
+            geo->getPositionAttitudeTransform()->setScale(newScale);
     }
 
     if (node->getCullingActive() == false)
@@ -27,6 +27,7 @@
 #include <osgEarthFeatures/GeometryUtils>
 #include <osgEarthFeatures/FilterContext>
 #include <osgEarth/GeometryClamper>
+#include <osgEarth/MapNode>
 #include <osgEarth/Utils>
 #include <osgEarth/NodeUtils>
 
@@ -58,6 +59,8 @@ LocalGeometryNode::construct()
     _geom = 0L;
     _clampInUpdateTraversal = false;
     _perVertexClampingEnabled = false;
+    _clampAll = true;
+    _clampLOD = 0u;
 }
 
 void
@@ -81,6 +84,7 @@ LocalGeometryNode::compileGeometry()
 
     // any old clamping data is out of date, so clear it
     _clamperData.clear();
+    _clampAll = true;
     _perVertexClampingEnabled = false;
     
     if ( _geom.valid() )
@@ -160,6 +164,7 @@ LocalGeometryNode::setPosition(const GeoPoint& pos)
 
     if (posXYchanged)
     {
+        _clampAll = true;
         reclamp();
     }
 }
@@ -191,6 +196,7 @@ LocalGeometryNode::togglePerVertexClamping()
 
             _perVertexClampingEnabled = true;
 
+            _clampAll = true;
             reclamp();
         }
     }
@@ -218,10 +224,6 @@ LocalGeometryNode::onTileAdded(const TileKey&          key,
                                osg::Node*              graph, 
                                TerrainCallbackContext& context)
 {
-    // If we are already set to clamp, ignore this
-    if (_clampInUpdateTraversal)
-        return;
-
     bool needsClamp;
 
     // Does the tile key's polytope intersect the world bounds or this object?
@@ -240,10 +242,27 @@ LocalGeometryNode::onTileAdded(const TileKey&          key,
 
     if (needsClamp)
     {
-        _clampInUpdateTraversal = true;
-        ADJUST_UPDATE_TRAV_COUNT(this, +1);
+        // Accumulate the changed area (even if a clamp is already pending)
+        // so the next clamp only needs to revisit the verts under it.
+        if (!key.valid())
+        {
+            _clampAll = true;
+        }
+        else
+        {
+            if (!_clampExtent.expandToInclude(key.getExtent()))
+                _clampExtent = key.getExtent();
+
+            _clampLOD = osg::maximum(_clampLOD, key.getLOD());
+        }
+
+        if (!_clampInUpdateTraversal)
+        {
+            _clampInUpdateTraversal = true;
+            ADJUST_UPDATE_TRAV_COUNT(this, +1);
 
-        OE_DEBUG << LC << "LGN: clamp requested b/c of key " << key.str() << std::endl;
+            OE_DEBUG << LC << "LGN: clamp requested b/c of key " << key.str() << std::endl;
+        }
     }
 }
 
@@ -277,10 +296,26 @@ LocalGeometryNode::clamp(osg::Node* graph, const Terrain* terrain)
         // altitude back in as an offset.
         clamper.setOffset(getPosition().alt());
 
+        // Sample the elevation pool in batches when we can, and limit the
+        // work to the terrain tiles that actually changed.
+        if (getMapNode())
+        {
+            clamper.setElevationPool(getMapNode()->getMap()->getElevationPool());
+
+            if (_clampLOD > 0u)
+                clamper.setElevationLOD(_clampLOD);
+
+            if (!_clampAll)
+                clamper.setExtent(_clampExtent);
+        }
+
         this->accept( clamper );
         
         OE_DEBUG << LC << "LGN: clamped.\n";
     }
+
+    _clampExtent = GeoExtent::INVALID;
+    _clampAll = false;
 }
 
 void
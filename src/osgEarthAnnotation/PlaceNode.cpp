@@ -64,6 +64,29 @@ namespace
 osg::ref_ptr<osg::StateSet> PlaceNode::_geodeStateSet;
 osg::ref_ptr<osg::StateSet> PlaceNode::_imageStateSet;
 
+osg::StateSet*
+PlaceNode::shareIconStateSet(osg::Image* image, osg::StateSet* candidate)
+{
+    typedef std::map<const osg::Image*, osg::observer_ptr<osg::StateSet> > IconStateSets;
+    static IconStateSets s_iconStateSets;
+    static Threading::Mutex s_iconMutex;
+
+    Threading::ScopedMutexLock lock(s_iconMutex);
+
+    // the stateset references the image (through its texture), so an entry
+    // can only be stale if its stateset is gone.
+    osg::ref_ptr<osg::StateSet> shared;
+    IconStateSets::iterator i = s_iconStateSets.find(image);
+    if (i != s_iconStateSets.end() && i->second.lock(shared))
+    {
+        return shared.release();
+    }
+
+    candidate->merge(*_imageStateSet.get());
+    s_iconStateSets[image] = candidate;
+    return candidate;
+}
+
 PlaceNode::PlaceNode() :
 GeoPositionNode()
 {
@@ -279,8 +302,7 @@ PlaceNode::compile()
         _imageDrawable = AnnotationUtils::createImageGeometry(_image.get(), offset, 0, heading, scale);
         if (_imageDrawable)
         {
-            // todo: optimize this better:
-            _imageDrawable->getOrCreateStateSet()->merge(*_imageStateSet.get());
+            _imageDrawable->setStateSet(shareIconStateSet(_image.get(), _imageDrawable->getOrCreateStateSet()));
             _geode->addChild(_imageDrawable);
             imageBox = osgEarth::Utils::getBoundingBox(_imageDrawable);
         }    
@@ -479,12 +501,19 @@ PlaceNode::setIconImage(osg::Image* image)
     {
         _image = image;
         if (_imageDrawable)
-        {            
-            osg::Texture2D* texture = dynamic_cast<osg::Texture2D*>(_imageDrawable->getStateSet()->getTextureAttribute(0, osg::StateAttribute::TEXTURE));
+        {
+            // The icon stateset is shared with other places, so swap in one
+            // for the new image rather than changing the texture in place.
+            osg::StateSet* current = _imageDrawable->getStateSet();
+            osg::Texture2D* texture = dynamic_cast<osg::Texture2D*>(current->getTextureAttribute(0, osg::StateAttribute::TEXTURE));
             if (texture)
-            {                
-                texture->setImage(_image);
-            }            
+            {
+                osg::ref_ptr<osg::StateSet> candidate = new osg::StateSet(*current, osg::CopyOp::SHALLOW_COPY);
+                osg::Texture2D* newTexture = new osg::Texture2D(*texture, osg::CopyOp::SHALLOW_COPY);
+                newTexture->setImage(_image.get());
+                candidate->setTextureAttributeAndModes(0, newTexture, osg::StateAttribute::ON);
+                _imageDrawable->setStateSet(shareIconStateSet(_image.get(), candidate.get()));
+            }
         }
         else
         {
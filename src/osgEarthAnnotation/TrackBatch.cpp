@@ -0,0 +1,412 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2016 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarthAnnotation/TrackBatch>
+#include <osgEarthAnnotation/AnnotationUtils>
+#include <osgEarth/Registry>
+#include <osgEarth/ScreenSpaceLayout>
+#include <osgEarth/VirtualProgram>
+#include <osgEarth/CullingUtils>
+#include <osgEarth/Lighting>
+#include <osg/Depth>
+#include <osgText/Text>
+#include <osgUtil/CullVisitor>
+#include <osgUtil/IntersectionVisitor>
+#include <algorithm>
+
+#define LC "[TrackBatch] "
+
+using namespace osgEarth;
+using namespace osgEarth::Annotation;
+using namespace osgEarth::Symbology;
+
+//------------------------------------------------------------------------
+
+namespace
+{
+    const char* iconVS =
+        "#version " GLSL_VERSION_STR "\n"
+        "out vec2 oe_TrackBatch_texcoord; \n"
+        "void oe_TrackBatch_icon_VS(inout vec4 vertex) { \n"
+        "    oe_TrackBatch_texcoord = gl_MultiTexCoord0.st; \n"
+        "} \n";
+
+    const char* iconFS =
+        "#version " GLSL_VERSION_STR "\n"
+        "in vec2 oe_TrackBatch_texcoord; \n"
+        "uniform sampler2D oe_TrackBatch_tex; \n"
+        "void oe_TrackBatch_icon_FS(inout vec4 color) { \n"
+        "    color = texture(oe_TrackBatch_tex, oe_TrackBatch_texcoord); \n"
+        "} \n";
+
+    const std::string ICON_NAME = "oe_TrackBatch_icon";
+}
+
+//------------------------------------------------------------------------
+
+osg::ref_ptr<osg::StateSet> TrackBatch::_batchStateSet;
+osg::ref_ptr<osg::StateSet> TrackBatch::_imageStateSet;
+
+TrackBatch::TrackBatch(const SpatialReference*     srs,
+                       const TrackNodeFieldSchema& fieldSchema) :
+_srs        ( srs ),
+_fieldSchema( fieldSchema ),
+_pickable   ( false )
+{
+    // tracks are culled individually in traverse()
+    setCullingActive(false);
+
+    if (!_batchStateSet.valid())
+    {
+        static Threading::Mutex s_mutex;
+        Threading::ScopedMutexLock lock(s_mutex);
+        if (!_batchStateSet.valid())
+        {
+            osg::ref_ptr<osg::StateSet> stateSet = new osg::StateSet();
+
+            // draw in the screen-space bin
+            ScreenSpaceLayout::activate(stateSet.get());
+
+            // completely disable depth buffer
+            stateSet->setAttributeAndModes( new osg::Depth(osg::Depth::ALWAYS, 0, 1, false), 1 );
+
+            // Disable lighting for tracks by default
+            Lighting::set(stateSet.get(), osg::StateAttribute::OFF | osg::StateAttribute::PROTECTED);
+
+            // shared stateset for the icons
+            _imageStateSet = new osg::StateSet();
+            VirtualProgram* vp = VirtualProgram::getOrCreate(_imageStateSet.get());
+            vp->setFunction("oe_TrackBatch_icon_VS", iconVS, ShaderComp::LOCATION_VERTEX_MODEL);
+            vp->setFunction("oe_TrackBatch_icon_FS", iconFS, ShaderComp::LOCATION_FRAGMENT_COLORING);
+            _imageStateSet->addUniform(new osg::Uniform("oe_TrackBatch_tex", 0));
+
+            _batchStateSet = stateSet.get();
+        }
+    }
+
+    setStateSet(_batchStateSet.get());
+
+    if (_srs.valid() && _srs->isGeographic())
+    {
+        _horizon = new Horizon(_srs.get());
+    }
+}
+
+TrackBatch::~TrackBatch()
+{
+    for (std::vector<ObjectID>::const_iterator i = _objectIDs.begin(); i != _objectIDs.end(); ++i)
+    {
+        if (*i != OSGEARTH_OBJECTID_EMPTY)
+            Registry::objectIndex()->remove(*i);
+    }
+}
+
+unsigned
+TrackBatch::addStyle(const Style& style)
+{
+    TrackStyle ts;
+    ts._style = style;
+
+    const IconSymbol* icon = style.get<IconSymbol>();
+    osg::Image* image = icon ? icon->getImage() : 0L;
+    if (image)
+    {
+        // prototype icon; all tracks in this style share its arrays and state.
+        ts._icon = AnnotationUtils::createImageGeometry(
+            image,
+            osg::Vec2s(0,0),
+            0,
+            0.0,
+            icon->scale().isSet() ? icon->scale()->eval() : 1.0);
+
+        if (ts._icon.valid())
+        {
+            ts._icon->getOrCreateStateSet()->merge(*_imageStateSet.get());
+            ts._icon->setName(ICON_NAME);
+        }
+    }
+
+    _styles.push_back(ts);
+    return _styles.size() - 1;
+}
+
+unsigned
+TrackBatch::addTrack(const GeoPoint& position, unsigned style)
+{
+    unsigned track = _world.size();
+
+    osg::Vec3d world;
+    position.transform(_srs.get()).toWorld(world);
+
+    _world.push_back(world);
+    _heading.push_back(0.0f);
+    _style.push_back(style < _styles.size() ? style : 0u);
+    _visible.push_back(1);
+    _objectIDs.push_back(OSGEARTH_OBJECTID_EMPTY);
+    _layouts.push_back(new ScreenSpaceLayoutData());
+    _geodes.push_back(createTrackGeode(track));
+
+    if (_pickable)
+    {
+        _objectIDs[track] = Registry::objectIndex()->tagNode(_geodes[track].get(), new Track(this, track));
+    }
+
+    dirtyBound();
+    return track;
+}
+
+osg::Geode*
+TrackBatch::createTrackGeode(unsigned track)
+{
+    osg::Geode* geode = new osg::Geode();
+
+    // the track is culled as a point in traverse(); the geode's bound is
+    // in screen units and would only get in the way.
+    geode->setCullingActive(false);
+
+    const unsigned style = _style[track];
+    if (style < _styles.size() && _styles[style]._icon.valid())
+    {
+        osg::Geometry* icon = new osg::Geometry(*_styles[style]._icon.get(), osg::CopyOp::SHALLOW_COPY);
+        icon->setDataVariance(osg::Object::DYNAMIC);
+        icon->setUserData(_layouts[track].get());
+        geode->addDrawable(icon);
+    }
+
+    return geode;
+}
+
+void
+TrackBatch::setPosition(unsigned track, const GeoPoint& position)
+{
+    if (track < _world.size())
+    {
+        position.transform(_srs.get()).toWorld(_world[track]);
+        dirtyBound();
+    }
+}
+
+void
+TrackBatch::setPositions(unsigned first, unsigned count, const osg::Vec3d* world)
+{
+    if (first >= _world.size() || !world)
+        return;
+
+    count = osg::minimum(count, (unsigned)_world.size() - first);
+    std::copy(world, world + count, _world.begin() + first);
+    dirtyBound();
+}
+
+void
+TrackBatch::setHeading(unsigned track, float degrees)
+{
+    if (track < _heading.size() && _heading[track] != degrees)
+    {
+        _heading[track] = degrees;
+        updateIcon(track);
+    }
+}
+
+void
+TrackBatch::updateIcon(unsigned track)
+{
+    const unsigned style = _style[track];
+    if (style >= _styles.size() || !_styles[style]._icon.valid())
+        return;
+
+    osg::Geode* geode = _geodes[track].get();
+    osg::Geometry* icon = 0L;
+    for (unsigned i = 0; i < geode->getNumDrawables() && !icon; ++i)
+    {
+        if (geode->getDrawable(i)->getName() == ICON_NAME)
+            icon = geode->getDrawable(i)->asGeometry();
+    }
+    if (!icon)
+        return;
+
+    const osg::Vec3Array* protoVerts = static_cast<const osg::Vec3Array*>(_styles[style]._icon->getVertexArray());
+
+    if (_heading[track] == 0.0f)
+    {
+        icon->setVertexArray(const_cast<osg::Vec3Array*>(protoVerts));
+        return;
+    }
+
+    // rotate a private copy of the prototype's corners (reused on later updates).
+    osg::Vec3Array* verts = static_cast<osg::Vec3Array*>(icon->getVertexArray());
+    if (verts == protoVerts)
+    {
+        verts = new osg::Vec3Array(*protoVerts);
+        icon->setVertexArray(verts);
+    }
+
+    osg::Matrixd rot;
+    rot.makeRotate(osg::DegreesToRadians((double)_heading[track]), 0.0, 0.0, 1.0);
+    for (unsigned i = 0; i < verts->size(); ++i)
+    {
+        (*verts)[i] = rot * (*protoVerts)[i];
+    }
+    verts->dirty();
+    icon->dirtyBound();
+}
+
+void
+TrackBatch::setPriority(unsigned track, float value)
+{
+    if (track < _layouts.size())
+    {
+        _layouts[track]->setPriority(value);
+    }
+}
+
+void
+TrackBatch::setVisible(unsigned track, bool value)
+{
+    if (track < _visible.size() && (_visible[track] != 0) != value)
+    {
+        _visible[track] = value ? 1 : 0;
+        dirtyBound();
+    }
+}
+
+void
+TrackBatch::setFieldValue(unsigned track, const std::string& name, const osgText::String& value)
+{
+    if (track >= _geodes.size())
+        return;
+
+    osg::Geode* geode = _geodes[track].get();
+
+    for (unsigned i = 0; i < geode->getNumDrawables(); ++i)
+    {
+        osg::Drawable* d = geode->getDrawable(i);
+        if (d->getName() == name)
+        {
+            osgText::Text* text = dynamic_cast<osgText::Text*>(d);
+            if (text)
+            {
+                // same rule as TrackNode: only dynamic fields can change once attached
+                if (text->getDataVariance() == osg::Object::DYNAMIC || getNumParents() == 0)
+                {
+                    text->setText(value);
+                }
+                else
+                {
+                    OE_WARN << LC
+                        << "Illegal: attempt to modify a TrackBatch field value that is not marked as dynamic"
+                        << std::endl;
+                }
+            }
+            return;
+        }
+    }
+
+    // first value for this field; create its label.
+    TrackNodeFieldSchema::const_iterator f = _fieldSchema.find(name);
+    if (f == _fieldSchema.end() || !f->second._symbol.valid())
+        return;
+
+    const TrackNodeField& field = f->second;
+    osg::Vec3 offset(
+        field._symbol->pixelOffset()->x(),
+        field._symbol->pixelOffset()->y(),
+        0.0);
+
+    osgText::Text* text = AnnotationUtils::createTextDrawable(
+        value.createUTF8EncodedString(),
+        field._symbol.get(),
+        offset );
+
+    if (text)
+    {
+        text->setName(name);
+        text->setDataVariance(field._dynamic ? osg::Object::DYNAMIC : osg::Object::STATIC);
+
+        text->setUserData(_layouts[track].get());
+
+        geode->addDrawable(text);
+    }
+}
+
+ObjectID
+TrackBatch::getObjectID(unsigned track) const
+{
+    return track < _objectIDs.size() ? _objectIDs[track] : OSGEARTH_OBJECTID_EMPTY;
+}
+
+osg::BoundingSphere
+TrackBatch::computeBound() const
+{
+    osg::BoundingSphere bs;
+    for (unsigned i = 0; i < _world.size(); ++i)
+    {
+        if (_visible[i])
+            bs.expandBy(_world[i]);
+    }
+    return bs;
+}
+
+void
+TrackBatch::traverse(osg::NodeVisitor& nv)
+{
+    if (nv.getVisitorType() == osg::NodeVisitor::CULL_VISITOR)
+    {
+        osgUtil::CullVisitor* cv = Culling::asCullVisitor(nv);
+
+        if (_horizon.valid())
+        {
+            osg::Vec3d eye = osg::Vec3d(0,0,0) * osg::Matrixd::inverse(*cv->getModelViewMatrix());
+            _horizon->setEye(eye);
+        }
+
+        for (unsigned i = 0; i < _world.size(); ++i)
+        {
+            if (!_visible[i])
+                continue;
+
+            const osg::Vec3d& world = _world[i];
+
+            if (cv->isCulled(osg::BoundingSphere(world, 0.0f)))
+                continue;
+
+            if (_horizon.valid() && !_horizon->isVisible(world))
+                continue;
+
+            // Position the track's drawables directly; no transform node required.
+            osg::ref_ptr<osg::RefMatrix> mvm = new osg::RefMatrix(*cv->getModelViewMatrix());
+            mvm->preMultTranslate(world);
+            cv->pushModelViewMatrix(mvm.get(), osg::Transform::RELATIVE_RF);
+            _geodes[i]->accept(nv);
+            cv->popModelViewMatrix();
+        }
+    }
+
+    // Drawables are positioned in screen space, so there is nothing to intersect;
+    // other visitors (e.g., GL object compilation) get to see every track.
+    else if (dynamic_cast<osgUtil::IntersectionVisitor*>(&nv) == 0L)
+    {
+        for (unsigned i = 0; i < _geodes.size(); ++i)
+        {
+            _geodes[i]->accept(nv);
+        }
+    }
+}
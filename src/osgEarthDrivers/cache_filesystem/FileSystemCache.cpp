@@ -25,22 +25,44 @@
 #include <osgEarth/FileUtils>
 #include <osgEarth/StringUtils>
 #include <osgEarth/Registry>
+#include <osgEarth/OptionsOverlay>
 #include <osgDB/FileUtils>
 #include <osgDB/FileNameUtils>
+#include <osg/Timer>
+#include <OpenThreads/Atomic>
 #include <fstream>
+#include <iomanip>
+#include <list>
+#include <set>
+#include <map>
+#include <stdio.h>
 #include <sys/stat.h>
 
 using namespace osgEarth;
 using namespace osgEarth::Drivers;
 using namespace osgEarth::Threading;
 
-#ifndef _WIN32
+#ifdef _WIN32
+#   include <windows.h>
+#   include <process.h>
+#   define getpid _getpid
+#else
 #   include <unistd.h>
 #endif
 
 #define OSG_FORMAT "osgb"
 #define OSG_EXT   ".osgb"
 
+// Marks a bin that uses the hashed directory layout.
+#define HASHED_PATHS_MARKER "osgearth_hashed_paths"
+
+// Directory listings kept for existence checks, and how long (s) to trust one.
+#define MAX_LISTINGS      256u
+#define MAX_LISTING_AGE   5.0
+
+// Touches to queue before applying them.
+#define MAX_PENDING_TOUCHES 64u
+
 namespace
 {
     /** 
@@ -71,6 +93,7 @@ namespace
         void init();
 
         std::string _rootPath;
+        bool        _hashedPaths;
     };
 
     /** 
@@ -80,7 +103,7 @@ namespace
     class FileSystemCacheBin : public CacheBin
     {
     public:
-        FileSystemCacheBin( const std::string& name, const std::string& rootPath );
+        FileSystemCacheBin( const std::string& name, const std::string& rootPath, bool hashedPaths );
 
     public: // CacheBin interface
 
@@ -94,6 +117,8 @@ namespace
 
         bool write(const std::string& key, const osg::Object* object, const Config& meta, const osgDB::Options* dbo);
 
+        bool writeEncodedImage(const std::string& key, const std::string& data, const std::string& format, const Config& meta, const osgDB::Options* dbo);
+
         bool remove(const std::string& key);
 
         bool touch(const std::string& key);
@@ -107,34 +132,102 @@ namespace
         bool writeMetadata( const Config& meta );
 
     protected:
+        virtual ~FileSystemCacheBin();
+
         bool purgeDirectory( const std::string& dir );
 
         bool binValidForReading(bool silent =true);
 
         bool binValidForWriting(bool silent =false);
 
-        const osgDB::Options* mergeOptions(const osgDB::Options* in);
+        osg::ref_ptr<const osgDB::Options> mergeOptions(const osgDB::Options* in);
+
+        /** Path of a record, without the extension */
+        std::string getPath(const std::string& key) const;
+
+        /** Whether a file exists, from a recent listing of its folder in a hashed bin */
+        bool fileExists(const std::string& path);
+
+        /** Updates the cached listing (if any) after writing or removing a file */
+        void updateListing(const std::string& path, bool exists);
+
+        /** Creates the folder for a file unless already done */
+        void makeDirectoryForFile(const std::string& path);
+
+        void flushTouches();
+
+        struct Listing
+        {
+            std::set<std::string> _names;
+            double                _time;
+        };
+        typedef std::map<std::string, Listing> Listings;
 
         bool                              _ok;
         bool                              _binPathExists;
+        bool                              _hashedPaths;    // wanted for a new bin
+        bool                              _hashed;         // in use by this bin
         std::string                       _metaPath;       // full path to the bin's metadata file
         std::string                       _binPath;        // full path to the bin's root folder
         std::string                       _compressorName;
         osg::ref_ptr<osgDB::ReaderWriter> _rw;
         osg::ref_ptr<osgDB::Options>      _zlibOptions;
-        mutable Threading::ReadWriteMutex _mutex;
+        mutable Threading::ReadWriteMutex _mutex;          // clear() vs. metadata
         bool                              _debug;
+
+        std::set<std::string>             _dirs;           // folders known to exist
+        Listings                          _listings;
+        std::list<std::string>            _listingOrder;   // oldest first
+        std::vector<std::string>          _pendingTouches;
+        Threading::Mutex                  _pathMutex;
     };
 
-    void writeMeta( const std::string& fullPath, const Config& meta )
+    /**
+     * Name of a file to write next to "filename" before renaming it into
+     * place. Unique across threads and processes; keeps the extension so
+     * the OSG plugin still recognizes it.
+     */
+    std::string makeTempName(const std::string& filename)
+    {
+        static OpenThreads::Atomic s_counter;
+        std::string ext = osgDB::getFileExtensionIncludingDot(filename);
+        return Stringify()
+            << osgDB::getNameLessExtension(filename)
+            << ".tmp" << (int)::getpid() << "_" << (unsigned)++s_counter
+            << ext;
+    }
+
+    /**
+     * Moves a finished temp file over the real one. Readers see either the
+     * old file or the new one, never a partial write.
+     */
+    bool commitFile(const std::string& temp, const std::string& filename)
     {
-        std::ofstream outmeta( fullPath.c_str() );
-        if ( outmeta.is_open() )
+#ifdef _WIN32
+        bool ok = ::MoveFileExA(temp.c_str(), filename.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+        bool ok = ::rename(temp.c_str(), filename.c_str()) == 0;
+#endif
+        if ( !ok )
+            ::unlink( temp.c_str() );
+        return ok;
+    }
+
+    bool writeMeta( const std::string& fullPath, const Config& meta )
+    {
+        std::string temp = makeTempName( fullPath );
+        std::ofstream outmeta( temp.c_str() );
+        if ( !outmeta.is_open() )
+            return false;
+
+        outmeta << meta.toJSON();
+        outmeta.close();
+        if ( outmeta.fail() )
         {
-            outmeta << meta.toJSON();
-            outmeta.flush();
-            outmeta.close();
+            ::unlink( temp.c_str() );
+            return false;
         }
+        return commitFile( temp, fullPath );
     }
 
     void readMeta( const std::string& fullPath, Config& meta )
@@ -177,6 +270,7 @@ namespace
         }
 
         _rootPath = URI( *fsco.rootPath(), options.referrer() ).full();
+        _hashedPaths = fsco.hashedPaths() == true;
         init();
     }
 
@@ -189,7 +283,7 @@ namespace
     CacheBin*
     FileSystemCache::addBin( const std::string& name )
     {
-        return _bins.getOrCreate( name, new FileSystemCacheBin( name, _rootPath ) );
+        return _bins.getOrCreate( name, new FileSystemCacheBin( name, _rootPath, _hashedPaths ) );
     }
 
     CacheBin*
@@ -201,7 +295,7 @@ namespace
             Threading::ScopedMutexLock lock( s_defaultBinMutex );
             if ( !_defaultBin.valid() ) // double-check
             {
-                _defaultBin = new FileSystemCacheBin( "__default", _rootPath );
+                _defaultBin = new FileSystemCacheBin( "__default", _rootPath, _hashedPaths );
             }
         }
         return _defaultBin.get();
@@ -221,6 +315,7 @@ namespace
             if ( osgDB::fileExists(_binPath) )
             {
                 // ready to go
+                _hashed = osgDB::fileExists( osgDB::concatPaths(_binPath, HASHED_PATHS_MARKER) );
                 _binPathExists = true;
                 _ok = true;
             }
@@ -247,11 +342,22 @@ namespace
         }
         else if ( !_binPathExists )
         {
+            // only a brand new bin gets the hashed layout; an existing one
+            // keeps the layout its records were written with.
+            bool isNew = !osgDB::fileExists(_binPath);
+
             osgEarth::makeDirectoryForFile( _metaPath );
 
+            std::string marker = osgDB::concatPaths(_binPath, HASHED_PATHS_MARKER);
+            if ( isNew && _hashedPaths )
+            {
+                std::ofstream out( marker.c_str() );
+            }
+
             if ( osgDB::fileExists(_binPath) )
             {
                 // ready to go
+                _hashed = osgDB::fileExists( marker );
                 _binPathExists = true;
                 _ok = true;
             }
@@ -270,10 +376,13 @@ namespace
     }
 
     FileSystemCacheBin::FileSystemCacheBin(const std::string&   binID,
-                                           const std::string&   rootPath) :
+                                           const std::string&   rootPath,
+                                           bool                 hashedPaths) :
     CacheBin            ( binID ),
     _binPathExists      ( false ),
-    _ok( true )
+    _ok( true ),
+    _hashedPaths        ( hashedPaths ),
+    _hashed             ( false )
     {
         _binPath = osgDB::concatPaths( rootPath, binID );
         _metaPath = osgDB::concatPaths( _binPath, "osgearth_cacheinfo.json" );
@@ -299,25 +408,147 @@ namespace
         _debug = ::getenv("OSGEARTH_CACHE_DEBUG") != 0L;
     }
 
-    const osgDB::Options*
+    FileSystemCacheBin::~FileSystemCacheBin()
+    {
+        flushTouches();
+    }
+
+    std::string
+    FileSystemCacheBin::getPath(const std::string& key) const
+    {
+        if ( !_hashed )
+        {
+            // mangle "key" into a legal path name
+            return URI( key, _metaPath ).full();
+        }
+
+        // Two levels of 256 folders each keep every folder small no matter
+        // how many records the bin holds.
+        unsigned hash = hashString( key );
+
+        std::string name = key;
+        for (std::string::iterator c = name.begin(); c != name.end(); ++c)
+        {
+            if ( *c == '/' || *c == '\\' || *c == ':' || *c == '?' || *c == '*' ||
+                 *c == '"' || *c == '<'  || *c == '>' || *c == '|' )
+                *c = '_';
+        }
+
+        std::stringstream buf;
+        buf << std::hex << std::setfill('0')
+            << std::setw(2) << (hash & 0xff) << "/"
+            << std::setw(2) << ((hash >> 8) & 0xff);
+
+        return osgDB::concatPaths( osgDB::concatPaths(_binPath, buf.str()), name );
+    }
+
+    bool
+    FileSystemCacheBin::fileExists(const std::string& path)
+    {
+        // a flat bin mirrors the keys, so its folders can be huge; stat instead.
+        if ( !_hashed )
+            return osgDB::fileExists( path );
+
+        std::string dir  = osgDB::getFilePath( path );
+        std::string name = osgDB::getSimpleFileName( path );
+        double now = osg::Timer::instance()->time_s();
+
+        {
+            Threading::ScopedMutexLock lock( _pathMutex );
+            Listings::iterator i = _listings.find( dir );
+            if ( i != _listings.end() && now - i->second._time < MAX_LISTING_AGE )
+                return i->second._names.find( name ) != i->second._names.end();
+        }
+
+        // one scan answers every lookup in the folder for a while:
+        osgDB::DirectoryContents contents = osgDB::getDirectoryContents( dir );
+
+        Threading::ScopedMutexLock lock( _pathMutex );
+
+        Listings::iterator i = _listings.find( dir );
+        if ( i == _listings.end() )
+        {
+            if ( _listings.size() >= MAX_LISTINGS )
+            {
+                _listings.erase( _listingOrder.front() );
+                _listingOrder.pop_front();
+            }
+            i = _listings.insert( std::make_pair(dir, Listing()) ).first;
+            _listingOrder.push_back( dir );
+        }
+
+        i->second._names.clear();
+        i->second._names.insert( contents.begin(), contents.end() );
+        i->second._time = now;
+
+        return i->second._names.find( name ) != i->second._names.end();
+    }
+
+    void
+    FileSystemCacheBin::updateListing(const std::string& path, bool exists)
+    {
+        if ( !_hashed )
+            return;
+
+        Threading::ScopedMutexLock lock( _pathMutex );
+        Listings::iterator i = _listings.find( osgDB::getFilePath(path) );
+        if ( i != _listings.end() )
+        {
+            if ( exists )
+                i->second._names.insert( osgDB::getSimpleFileName(path) );
+            else
+                i->second._names.erase( osgDB::getSimpleFileName(path) );
+        }
+    }
+
+    void
+    FileSystemCacheBin::makeDirectoryForFile(const std::string& path)
+    {
+        std::string dir = osgDB::getFilePath( path );
+        {
+            Threading::ScopedMutexLock lock( _pathMutex );
+            if ( _dirs.find(dir) != _dirs.end() )
+                return;
+        }
+
+        // harmless if another thread gets here first.
+        if ( !osgDB::fileExists(dir) )
+            osgEarth::makeDirectoryForFile( path );
+
+        Threading::ScopedMutexLock lock( _pathMutex );
+        _dirs.insert( dir );
+    }
+
+    void
+    FileSystemCacheBin::flushTouches()
+    {
+        std::vector<std::string> touches;
+        {
+            Threading::ScopedMutexLock lock( _pathMutex );
+            touches.swap( _pendingTouches );
+        }
+
+        for (std::vector<std::string>::const_iterator i = touches.begin(); i != touches.end(); ++i)
+            osgEarth::touchFile( *i );
+    }
+
+    osg::ref_ptr<const osgDB::Options>
     FileSystemCacheBin::mergeOptions(const osgDB::Options* dbo)
     {
         if (!dbo)
         {
             return _zlibOptions.get();
         }
-        else if (!_zlibOptions.valid())
+        else if (!_zlibOptions.valid() || _compressorName.empty())
         {
             return dbo;
         }
         else
         {
-            osgDB::Options* merged = Registry::cloneOrCreateOptions(dbo);
-            if (_compressorName.length())
-            {
-                merged->setPluginStringData("Compressor", _compressorName);
-            }
-            return merged;
+            // shared per input options, instead of a clone per record
+            return OptionsOverlay()
+                .setPluginStringData("Compressor", _compressorName)
+                .apply(dbo);
         }
     }
 
@@ -327,36 +558,52 @@ namespace
         if ( !binValidForReading() ) 
             return ReadResult(ReadResult::RESULT_NOT_FOUND);
 
-        // mangle "key" into a legal path name
-        URI fileURI( key, _metaPath );
-        std::string path = fileURI.full() + OSG_EXT;
+        std::string base = getPath(key);
+        std::string path = base + OSG_EXT;
 
-        if ( !osgDB::fileExists(path) )
+        if ( !fileExists(path) )
             return ReadResult( ReadResult::RESULT_NOT_FOUND );
 
         osgEarth::TimeStamp timeStamp = osgEarth::getLastModifiedTime(path);     
 
         osg::ref_ptr<const osgDB::Options> dbo = mergeOptions(readOptions);
 
+        // Writers replace files by renaming them into place, so no lock is
+        // needed; a read sees either the old record or the new one.
         osgDB::ReaderWriter::ReadResult r;
         {
-            ScopedReadLock lock(_mutex);
+            // read metadata
+            Config meta;
+            std::string metafile = base + ".meta";
+            if ( fileExists(metafile) )
+                readMeta( metafile, meta );
+
+            // encoded images are stored as-is and decode straight from the file:
+            std::string format = getEncodedFormat(meta);
+            if ( !format.empty() )
+            {
+                std::ifstream in( path.c_str(), std::ios::binary );
+                ReadResult rr = decodeImage( in, format, readOptions );
+                if ( rr.succeeded() )
+                {
+                    rr.setMetadata(meta);
+                    rr.setLastModifiedTime(timeStamp);
+
+                    if (_debug)
+                        OE_NOTICE << LC << "Read encoded image \"" << key << "\" from cache bin [" << getID() << "] path=" << path << std::endl;
+                }
+                return rr;
+            }
 
             r = _rw->readImage( path, dbo.get() );
             if ( !r.success() )
                 return ReadResult();
 
-            // read metadata
-            Config meta;
-            std::string metafile = fileURI.full() + ".meta";
-            if ( osgDB::fileExists(metafile) )
-                readMeta( metafile, meta );
-
             ReadResult rr( r.getImage(), meta );
             rr.setLastModifiedTime(timeStamp);
 
             if (_debug)
-                OE_NOTICE << LC << "Read image \"" << key << "\" from cache bin [" << getID() << "] path=" << fileURI.full() << "." << OSG_EXT << std::endl;
+                OE_NOTICE << LC << "Read image \"" << key << "\" from cache bin [" << getID() << "] path=" << path << std::endl;
 
             return rr;            
         }
@@ -368,11 +615,10 @@ namespace
         if ( !binValidForReading() ) 
             return ReadResult(ReadResult::RESULT_NOT_FOUND);
 
-        // mangle "key" into a legal path name
-        URI fileURI( key, _metaPath );
-        std::string path = fileURI.full() + OSG_EXT;
+        std::string base = getPath(key);
+        std::string path = base + OSG_EXT;
 
-        if ( !osgDB::fileExists(path) )
+        if ( !fileExists(path) )
             return ReadResult( ReadResult::RESULT_NOT_FOUND );
 
         osgEarth::TimeStamp timeStamp = osgEarth::getLastModifiedTime(path);
@@ -381,23 +627,21 @@ namespace
 
         osgDB::ReaderWriter::ReadResult r;
         {
-            ScopedReadLock lock(_mutex);
-
             r = _rw->readObject( path, dbo.get() );
             if ( !r.success() )
                 return ReadResult();
 
             // read metadata
             Config meta;
-            std::string metafile = fileURI.full() + ".meta";
-            if ( osgDB::fileExists(metafile) )
+            std::string metafile = base + ".meta";
+            if ( fileExists(metafile) )
                 readMeta( metafile, meta );
 
             ReadResult rr( r.getObject(), meta );
             rr.setLastModifiedTime(timeStamp);
 
             if (_debug)
-                OE_NOTICE << LC << "Read object \"" << key << "\" from cache bin [" << getID() << "] path=" << fileURI.full() << "." << OSG_EXT << std::endl;
+                OE_NOTICE << LC << "Read object \"" << key << "\" from cache bin [" << getID() << "] path=" << path << std::endl;
 
             return rr;            
         }
@@ -434,52 +678,55 @@ namespace
             return false;
 
         // convert the key into a legal filename:
-        URI fileURI( key, _metaPath );
+        std::string base = getPath(key);
+        std::string filename = base + OSG_EXT;
         
         osgDB::ReaderWriter::WriteResult r;
 
         bool objWriteOK = false;
         {
-            // prevent cache contention:
-            ScopedWriteLock lock(_mutex);
-
             // make a home for it..
-            if ( !osgDB::fileExists( osgDB::getFilePath(fileURI.full()) ) )
-                osgEarth::makeDirectoryForFile( fileURI.full() );
+            makeDirectoryForFile( filename );
 
             osg::ref_ptr<const osgDB::Options> dbo = mergeOptions(writeOptions);
 
+            // write next to the record and rename over it when done, so
+            // concurrent writers and readers need no lock.
+            std::string temp = makeTempName( filename );
+
             if ( dynamic_cast<const osg::Image*>(object) )
             {
-                std::string filename = fileURI.full() + OSG_EXT;
-                r = _rw->writeImage( *static_cast<const osg::Image*>(object), filename, dbo.get() );
-                objWriteOK = r.success();
+                r = _rw->writeImage( *static_cast<const osg::Image*>(object), temp, dbo.get() );
             }
             else if ( dynamic_cast<const osg::Node*>(object) )
             {
-                std::string filename = fileURI.full() + OSG_EXT;
-                r = _rw->writeNode(*static_cast<const osg::Node*>(object), filename, dbo.get());
-                objWriteOK = r.success();
+                r = _rw->writeNode(*static_cast<const osg::Node*>(object), temp, dbo.get());
             }
             else
             {
-                std::string filename = fileURI.full() + OSG_EXT;
-                r = _rw->writeObject(*object, filename, dbo.get());
-                objWriteOK = r.success();
+                r = _rw->writeObject(*object, temp, dbo.get());
             }
 
-            // write metadata
-            if ( !meta.empty() && objWriteOK )
+            if ( r.success() )
+                objWriteOK = commitFile( temp, filename );
+            else
+                ::unlink( temp.c_str() );
+
+            // write metadata (replacing any left over from an encoded image)
+            std::string metaname = base + ".meta";
+            if ( objWriteOK && (!meta.empty() || fileExists(metaname)) )
             {
-                std::string metaname = fileURI.full() + ".meta";
-                writeMeta( metaname, meta );
+                if ( writeMeta( metaname, meta ) )
+                    updateListing( metaname, true );
             }
         }
 
         if ( objWriteOK )
         {
+            updateListing( filename, true );
+
             if (_debug)
-                OE_NOTICE << LC << "Wrote \"" << key << "\" to cache bin [" << getID() << "] path=" << fileURI.full() << "." << OSG_EXT << std::endl;
+                OE_NOTICE << LC << "Wrote \"" << key << "\" to cache bin [" << getID() << "] path=" << filename << std::endl;
         }
         else
         {
@@ -490,15 +737,66 @@ namespace
         return objWriteOK;
     }
 
+    bool
+    FileSystemCacheBin::writeEncodedImage(const std::string& key, const std::string& data, const std::string& format, const Config& meta, const osgDB::Options* writeOptions)
+    {
+        if ( !binValidForWriting() || format.empty() ) 
+            return false;
+
+        // convert the key into a legal filename:
+        std::string base = getPath(key);
+        std::string filename = base + OSG_EXT;
+
+        bool objWriteOK = false;
+        {
+            // make a home for it..
+            makeDirectoryForFile( filename );
+
+            // write the metadata first, since it's how readers know to
+            // expect an encoded image in the data file.
+            Config metadata(meta);
+            setEncodedFormat(metadata, format);
+            std::string metaname = base + ".meta";
+            if ( writeMeta( metaname, metadata ) )
+                updateListing( metaname, true );
+
+            std::string temp = makeTempName( filename );
+            std::ofstream out( temp.c_str(), std::ios::binary );
+            if ( out.is_open() )
+            {
+                out.write( data.c_str(), data.size() );
+                out.close();
+                if ( !out.fail() )
+                    objWriteOK = commitFile( temp, filename );
+                else
+                    ::unlink( temp.c_str() );
+            }
+        }
+
+        if ( objWriteOK )
+        {
+            updateListing( filename, true );
+
+            if (_debug)
+                OE_NOTICE << LC << "Wrote encoded image \"" << key << "\" to cache bin [" << getID() << "] path=" << filename << std::endl;
+        }
+        else
+        {
+            OE_WARN << LC << "FAILED to write encoded image \"" << key << "\" to cache bin " << getID() << std::endl;
+        }
+
+        return objWriteOK;
+    }
+
     CacheBin::RecordStatus
     FileSystemCacheBin::getRecordStatus(const std::string& key)
     {
         if ( !binValidForReading() ) 
             return STATUS_NOT_FOUND;
 
-        URI fileURI( key, _metaPath );
-        std::string path( fileURI.full() + OSG_EXT );
-        if ( !osgDB::fileExists(path) )
+        // a hashed bin answers from one scan of the record's folder.
+        std::string path( getPath(key) + OSG_EXT );
+        if ( !fileExists(path) )
             return STATUS_NOT_FOUND;
 
         return STATUS_OK;
@@ -508,10 +806,9 @@ namespace
     FileSystemCacheBin::remove(const std::string& key)
     {
         if ( !binValidForReading() ) return false;
-        URI fileURI( key, _metaPath );
-        std::string path( fileURI.full() + OSG_EXT );
+        std::string path( getPath(key) + OSG_EXT );
 
-        ScopedWriteLock lock(_mutex);
+        updateListing( path, false );
         return ::unlink( path.c_str() ) == 0;
     }
 
@@ -519,11 +816,22 @@ namespace
     FileSystemCacheBin::touch(const std::string& key)
     {
         if ( !binValidForReading() ) return false;
-        URI fileURI( key, _metaPath );
-        std::string path( fileURI.full() + OSG_EXT );
+        std::string path( getPath(key) + OSG_EXT );
+        if ( !fileExists(path) )
+            return false;
 
-        ScopedWriteLock lock(_mutex);
-        return osgEarth::touchFile( path );
+        // Touching only pushes back the expiry; queue them and apply them
+        // together rather than one utime per call.
+        bool flush;
+        {
+            Threading::ScopedMutexLock lock( _pathMutex );
+            _pendingTouches.push_back( path );
+            flush = _pendingTouches.size() >= MAX_PENDING_TOUCHES;
+        }
+        if ( flush )
+            flushTouches();
+
+        return true;
     }
 
     bool
@@ -553,7 +861,8 @@ namespace
                 }
                 else if ( type == osgDB::REGULAR_FILE )
                 {
-                    if ( full != _metaPath )
+                    // keep the bin's metadata and its layout marker
+                    if ( full != _metaPath && i->compare(HASHED_PATHS_MARKER) != 0 )
                     {
                         ok = ::unlink( full.c_str() );
                         if (_debug)
@@ -576,6 +885,13 @@ namespace
             return false;
 
         ScopedWriteLock lock(_mutex);
+        {
+            Threading::ScopedMutexLock pathLock( _pathMutex );
+            _dirs.clear();
+            _listings.clear();
+            _listingOrder.clear();
+            _pendingTouches.clear();
+        }
         std::string binDir = osgDB::getFilePath( _metaPath );
         return purgeDirectory( binDir );
     }
@@ -251,28 +251,66 @@ LevelDBCacheBin::read(const std::string& key, const Reader& reader)
     if ( !binValidForReading() ) 
         return ReadResult(ReadResult::RESULT_NOT_FOUND);
 
-    ++_tracker->reads;
-
-    Config metadata;
     leveldb::Status status;
     leveldb::ReadOptions ro;
 
     // first read the metadata record.
     std::string metavalue;
     status = _db->Get( ro, metaKey(key), &metavalue );
+    bool hasMeta = status.ok();
+        
+    // next read the data record.
+    std::string datavalue;
+    status = _db->Get( ro, dataKey(key), &datavalue );
+    bool hasData = status.ok();
+
+    return decode(key, hasMeta ? &metavalue : 0L, hasData ? &datavalue : 0L, reader);
+}
+
+void
+LevelDBCacheBin::readImages(const std::vector<std::string>& keys, const osgDB::Options* readOptions, std::vector<ReadResult>& output)
+{
+    output.clear();
+
+    if ( !binValidForReading() )
+    {
+        output.resize(keys.size(), ReadResult(ReadResult::RESULT_NOT_FOUND));
+        return;
+    }
+
+    // LevelDB has no multi-get; read all the records from a single snapshot
+    // so the batch is consistent with itself.
+    leveldb::ReadOptions ro;
+    ro.snapshot = _db->GetSnapshot();
+
+    ImageReader reader(_rw.get(), readOptions);
+    output.reserve(keys.size());
+    for (unsigned i = 0; i < keys.size(); ++i)
+    {
+        std::string metavalue, datavalue;
+        bool hasMeta = _db->Get( ro, metaKey(keys[i]), &metavalue ).ok();
+        bool hasData = _db->Get( ro, dataKey(keys[i]), &datavalue ).ok();
+        output.push_back(decode(keys[i], hasMeta ? &metavalue : 0L, hasData ? &datavalue : 0L, reader));
+    }
+
+    _db->ReleaseSnapshot(ro.snapshot);
+}
+
+ReadResult
+LevelDBCacheBin::decode(const std::string& key, const std::string* metavalue, std::string* datavalue, const Reader& reader)
+{
+    ++_tracker->reads;
+
+    Config metadata;
     TimeStamp lastModified = (TimeStamp)0;
-    if ( status.ok() )
+    if ( metavalue )
     {        
-        decodeMeta(metavalue, metadata);
+        decodeMeta(*metavalue, metadata);
         DateTime t( metadata.value(TIME_FIELD));
         lastModified = t.asTimeStamp();
     }
-        
-    // next read the data record.
-    std::string datakey = dataKey(key);
-    std::string datavalue;
-    status = _db->Get( ro, datakey, &datavalue );
-    if ( !status.ok() )
+
+    if ( !datavalue )
     {
         // main record not found for some reason.
         return ReadResult(ReadResult::RESULT_NOT_FOUND);
@@ -280,17 +318,38 @@ LevelDBCacheBin::read(const std::string& key, const Reader& reader)
 
     // blend the data string
     if ( _tracker->seed().isSet() )
-        unblend(datavalue, _tracker->seed().value());
+        unblend(*datavalue, _tracker->seed().value());
+
+    std::istringstream datastream(*datavalue);
+
+    // encoded images are stored as-is and decode straight from the data:
+    std::string format = getEncodedFormat(metadata);
+    if ( !format.empty() )
+    {
+        if ( !dynamic_cast<const ImageReader*>(&reader) )
+            return ReadResult(ReadResult::RESULT_READER_ERROR);
+
+        ReadResult rr = decodeImage(datastream, format, reader._op);
+        if ( rr.succeeded() )
+        {
+            if ( _tracker->hasSizeLimit() )
+                touch( key );
+
+            ++_tracker->hits;
+            rr.setMetadata(metadata);
+            rr.setLastModifiedTime(lastModified);
+        }
+        return rr;
+    }
 
     // finally, decode the OSGB stream into an object.
-    std::istringstream datastream(datavalue);
     osgDB::ReaderWriter::ReadResult r = reader.read(datastream);
     if ( !r.success() )
     {
         OE_WARN << LC << "Cache read failure!"
             << "\n reader = " << reader.name()
             << "\n error detail = " << r.message()
-            << "\n data value = " << datavalue
+            << "\n data value = " << *datavalue
             << "\n";
 
         return ReadResult(ReadResult::RESULT_READER_ERROR);
@@ -333,15 +392,9 @@ LevelDBCacheBin::readString(const std::string& key, const osgDB::Options* readOp
 }
 
 bool
-LevelDBCacheBin::write(const std::string& key, const osg::Object* object, const Config& meta, const osgDB::Options* writeOptions)
+LevelDBCacheBin::serialize(const osg::Object* object, const osgDB::Options* writeOptions, std::string& data, std::string& message)
 {
-    if ( !binValidForWriting() || !object ) 
-        return false;
-        
     osgDB::ReaderWriter::WriteResult r;
-    bool objWriteOK = false;
-
-    std::string       data;
     std::stringstream datastream;
 
     if ( dynamic_cast<const osg::Image*>(object) )
@@ -352,7 +405,6 @@ LevelDBCacheBin::write(const std::string& key, const osg::Object* object, const
             return false;
         }
         r = _rw->writeImage( *static_cast<const osg::Image*>(object), datastream, writeOptions );
-        objWriteOK = r.success();
     }
     else if ( dynamic_cast<const osg::Node*>(object) )
     {
@@ -362,7 +414,6 @@ LevelDBCacheBin::write(const std::string& key, const osg::Object* object, const
             return false;
         }
         r = _rw->writeNode( *static_cast<const osg::Node*>(object), datastream, writeOptions );
-        objWriteOK = r.success();
     }
     else
     {
@@ -372,28 +423,49 @@ LevelDBCacheBin::write(const std::string& key, const osg::Object* object, const
             return false;
         }
         r = _rw->writeObject( *object, datastream, writeOptions );
-        objWriteOK = r.success();
     }
 
-    if (objWriteOK)
-    {
-        DateTime now;
-        leveldb::WriteBatch batch;
+    message = r.message();
+    if ( !r.success() )
+        return false;
+
+    data = datastream.str();
+    if ( _tracker->seed().isSet() )
+        blend(data, _tracker->seed().value());
+
+    return true;
+}
+
+void
+LevelDBCacheBin::addToBatch(const std::string& key, const std::string& data, const Config& meta, const DateTime& now, leveldb::WriteBatch& batch)
+{
+    // write the data:
+    batch.Put( dataKey(key), data );
+
+    // write the timestamp index:
+    batch.Put( timeKey(now, key), binDataKeyTuple(key) );
 
-        // write the data:
-        data = datastream.str();
-        if ( _tracker->seed().isSet() )
-            blend(data, _tracker->seed().value());
-        batch.Put( dataKey(key), data );
+    // write the metadata:
+    std::string metavalue;
+    Config metadata(meta);
+    metadata.set( TIME_FIELD, now.asCompactISO8601() );
+    encodeMeta( metadata, metavalue );
+    batch.Put( metaKey(key), metavalue );
+}
+
+bool
+LevelDBCacheBin::write(const std::string& key, const osg::Object* object, const Config& meta, const osgDB::Options* writeOptions)
+{
+    if ( !binValidForWriting() || !object ) 
+        return false;
 
-        // write the timestamp index:
-        batch.Put( timeKey(now, key), binDataKeyTuple(key) );
+    std::string data, message;
+    bool objWriteOK = serialize(object, writeOptions, data, message);
 
-        // write the metadata:
-        Config metadata(meta);
-        metadata.set( TIME_FIELD, now.asCompactISO8601() );
-        encodeMeta( metadata, data );
-        batch.Put( metaKey(key), data );
+    if (objWriteOK)
+    {
+        leveldb::WriteBatch batch;
+        addToBatch(key, data, meta, DateTime(), batch);
 
         objWriteOK = _db->Write( leveldb::WriteOptions(), &batch ).ok();
 
@@ -408,17 +480,99 @@ LevelDBCacheBin::write(const std::string& key, const osg::Object* object, const
             }
         }
     }
-
         
     if ( !objWriteOK )
     {
         OE_WARN << LC << "Bin " << getID() << ": FAILED to write (" << key << "); msg = \"" 
-            << r.message() << "\"\n";
+            << message << "\"\n";
     }
 
     return objWriteOK;
 }
 
+bool
+LevelDBCacheBin::writeEncodedImage(const std::string& key, const std::string& encoded, const std::string& format, const Config& meta, const osgDB::Options* writeOptions)
+{
+    if ( !binValidForWriting() || format.empty() ) 
+        return false;
+
+    std::string data(encoded);
+    if ( _tracker->seed().isSet() )
+        blend(data, _tracker->seed().value());
+
+    Config metadata(meta);
+    setEncodedFormat(metadata, format);
+
+    leveldb::WriteBatch batch;
+    addToBatch(key, data, metadata, DateTime(), batch);
+
+    if ( !_db->Write( leveldb::WriteOptions(), &batch ).ok() )
+    {
+        OE_WARN << LC << "Bin " << getID() << ": FAILED to write encoded image (" << key << ")\n";
+        return false;
+    }
+
+    ++_tracker->writes;
+    postWrite();
+
+    if ( _debug )
+    {
+        OE_NOTICE << LC << "Bin " << getID() << ": wrote encoded image (" << key << ")\n";
+    }
+
+    return true;
+}
+
+bool
+LevelDBCacheBin::writeBatch(const WriteRecords& records, const osgDB::Options* writeOptions)
+{
+    if ( !binValidForWriting() ) 
+        return false;
+
+    // serialize everything first, then commit it all in one atomic write.
+    DateTime now;
+    leveldb::WriteBatch batch;
+    unsigned count = 0u;
+    bool ok = true;
+
+    for (WriteRecords::const_iterator i = records.begin(); i != records.end(); ++i)
+    {
+        std::string data, message;
+        if ( i->_object.valid() && serialize(i->_object.get(), writeOptions, data, message) )
+        {
+            addToBatch(i->_key, data, i->_meta, now, batch);
+            ++count;
+        }
+        else
+        {
+            OE_WARN << LC << "Bin " << getID() << ": FAILED to write (" << i->_key << "); msg = \"" 
+                << message << "\"\n";
+            ok = false;
+        }
+    }
+
+    if ( count == 0u )
+        return ok;
+
+    if ( !_db->Write( leveldb::WriteOptions(), &batch ).ok() )
+    {
+        OE_WARN << LC << "Bin " << getID() << ": FAILED to write a batch of " << count << " records\n";
+        return false;
+    }
+
+    for (unsigned i = 0; i < count; ++i)
+        ++_tracker->writes;
+
+    postWrite();
+
+    if ( _debug )
+    {
+        OE_NOTICE << LC << "Bin " << getID() << ": wrote a batch of " << count << " records\n";
+    }
+
+    return ok;
+}
+
 void
 LevelDBCacheBin::postWrite()
 {
@@ -0,0 +1,97 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2016 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "PackCache"
+#include "PackCacheBin"
+#include <osgEarth/URI>
+#include <osgEarth/ThreadingUtils>
+#include <osgDB/FileUtils>
+#include <osgDB/FileNameUtils>
+
+#define LC "[PackCache] "
+
+using namespace osgEarth;
+using namespace osgEarth::Drivers::PackCache;
+
+
+PackCacheImpl::PackCacheImpl( const CacheOptions& options ) :
+osgEarth::Cache( options ),
+_options       ( options )
+{
+    if ( _options.rootPath().isSet() )
+    {
+        _rootPath = URI( *_options.rootPath(), options.referrer() ).full();
+    }
+    else
+    {
+        // read the root path from ENV is necessary:
+        const char* cachePath = ::getenv(OSGEARTH_ENV_CACHE_PATH);
+        if ( cachePath )
+        {
+            _rootPath = cachePath;
+            OE_INFO << LC << "Cache location set from environment: \""
+                << cachePath << "\"" << std::endl;
+        }
+    }
+
+    if ( _rootPath.empty() )
+    {
+        _ok = false;
+        OE_WARN << LC << "Illegal: no root path set for cache!" << std::endl;
+    }
+    else if ( _options.build() == true )
+    {
+        OE_INFO << LC << "Building cache packs in \"" << _rootPath << "\"" << std::endl;
+    }
+    else if ( !osgDB::fileExists(_rootPath) )
+    {
+        OE_WARN << LC << "Cache pack folder \"" << _rootPath << "\" does not exist" << std::endl;
+    }
+}
+
+std::string
+PackCacheImpl::getPackPath( const std::string& binID ) const
+{
+    return osgDB::concatPaths( _rootPath, binID + OSGEARTH_PACK_EXTENSION );
+}
+
+CacheBin*
+PackCacheImpl::addBin( const std::string& name )
+{
+    return _ok ?
+        _bins.getOrCreate(name, new PackCacheBin(name, getPackPath(name), _options.build().get())) :
+        0L;
+}
+
+CacheBin*
+PackCacheImpl::getOrCreateDefaultBin()
+{
+    if ( !_ok )
+        return 0L;
+
+    static Threading::Mutex s_defaultBinMutex;
+    if ( !_defaultBin.valid() )
+    {
+        Threading::ScopedMutexLock lock( s_defaultBinMutex );
+        if ( !_defaultBin.valid() ) // double-check
+        {
+            _defaultBin = new PackCacheBin("_default", getPackPath("_default"), _options.build().get());
+        }
+    }
+    return _defaultBin.get();
+}
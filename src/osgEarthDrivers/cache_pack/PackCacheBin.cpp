@@ -0,0 +1,259 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2016 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "PackCacheBin"
+#include <osgEarth/DateTime>
+#include <osgDB/Registry>
+#include <osg/Image>
+#include <osg/Node>
+#include <sstream>
+
+#define LC "[PackCacheBin] "
+
+using namespace osgEarth;
+using namespace osgEarth::Drivers::PackCache;
+
+
+PackCacheBin::PackCacheBin(const std::string& binID, const std::string& path, bool build) :
+osgEarth::CacheBin ( binID ),
+_path              ( path ),
+_build             ( build ),
+_readerInitialized ( false )
+{
+    _rw = osgDB::Registry::instance()->getReaderWriterForExtension( "osgb" );
+
+    // the pack file itself isn't touched until the bin is used, since
+    // the cache may create (and discard) several bins for the same ID.
+    if ( _build )
+        _writer = new PackWriter( _path );
+
+    _debug = ::getenv("OSGEARTH_CACHE_DEBUG") != 0L;
+}
+
+PackCacheBin::~PackCacheBin()
+{
+    if ( _writer.valid() )
+        _writer->finish();
+}
+
+PackReader*
+PackCacheBin::getReader()
+{
+    if ( _build )
+        return 0L;
+
+    if ( !_readerInitialized )
+    {
+        Threading::ScopedMutexLock lock( _readerMutex );
+        if ( !_readerInitialized ) // double-check
+        {
+            osg::ref_ptr<PackReader> reader = new PackReader();
+            if ( reader->open(_path) )
+                _reader = reader.get();
+            else
+                OE_INFO << LC << "No cache pack for bin [" << getID() << "] at " << _path << std::endl;
+
+            _readerInitialized = true;
+        }
+    }
+    return _reader.get();
+}
+
+ReadResult
+PackCacheBin::read(const std::string& key, const osgDB::Options* dbo, Type type)
+{
+    PackReader* reader = getReader();
+    if ( !reader || !_rw.valid() )
+        return ReadResult(ReadResult::RESULT_NOT_FOUND);
+
+    const PackEntry* entry = reader->find(key);
+    if ( !entry )
+        return ReadResult(ReadResult::RESULT_NOT_FOUND);
+
+    Config meta;
+    if ( entry->_metaSize > 0 )
+        meta.fromJSON( reader->getMetadata(*entry) );
+
+    // decode straight from the mapped memory:
+    MemoryStreamBuf buf( reader->getData(*entry), (size_t)entry->_dataSize );
+    std::istream in( &buf );
+
+    ReadResult result;
+
+    std::string format = getEncodedFormat(meta);
+    if ( !format.empty() )
+    {
+        if ( type != TYPE_IMAGE )
+            return ReadResult(ReadResult::RESULT_READER_ERROR);
+
+        result = decodeImage( in, format, dbo );
+    }
+    else
+    {
+        osgDB::ReaderWriter::ReadResult r =
+            type == TYPE_IMAGE ? _rw->readImage( in, dbo ) :
+            _rw->readObject( in, dbo );
+
+        if ( !r.success() )
+        {
+            OE_WARN << LC << "Cache read failure in bin [" << getID() << "] for (" << key << "): " << r.message() << std::endl;
+            return ReadResult(ReadResult::RESULT_READER_ERROR);
+        }
+
+        result = ReadResult( r.getObject() );
+    }
+
+    if ( result.succeeded() )
+    {
+        result.setMetadata( meta );
+        result.setLastModifiedTime( (TimeStamp)entry->_timestamp );
+
+        if ( _debug )
+            OE_NOTICE << LC << "Bin " << getID() << ": read (" << key << ")\n";
+    }
+
+    return result;
+}
+
+ReadResult
+PackCacheBin::readImage(const std::string& key, const osgDB::Options* dbo)
+{
+    return read(key, dbo, TYPE_IMAGE);
+}
+
+ReadResult
+PackCacheBin::readObject(const std::string& key, const osgDB::Options* dbo)
+{
+    return read(key, dbo, TYPE_OBJECT);
+}
+
+ReadResult
+PackCacheBin::readString(const std::string& key, const osgDB::Options* dbo)
+{
+    ReadResult r = readObject(key, dbo);
+    if ( r.succeeded() && !r.get<StringObject>() )
+        return ReadResult();
+    return r;
+}
+
+bool
+PackCacheBin::write(const std::string& key, const osg::Object* object, const Config& meta, const osgDB::Options* dbo)
+{
+    if ( !_writer.valid() || !object || !_rw.valid() )
+        return false;
+
+    std::stringstream buf;
+    osgDB::ReaderWriter::WriteResult r;
+
+    if ( dynamic_cast<const osg::Image*>(object) )
+        r = _rw->writeImage( *static_cast<const osg::Image*>(object), buf, dbo );
+    else if ( dynamic_cast<const osg::Node*>(object) )
+        r = _rw->writeNode( *static_cast<const osg::Node*>(object), buf, dbo );
+    else
+        r = _rw->writeObject( *object, buf, dbo );
+
+    if ( !r.success() || !_writer->add(key, buf.str(), meta, DateTime().asTimeStamp()) )
+    {
+        OE_WARN << LC << "Bin " << getID() << ": FAILED to write (" << key << "); msg = \"" << r.message() << "\"\n";
+        return false;
+    }
+
+    if ( _debug )
+        OE_NOTICE << LC << "Bin " << getID() << ": wrote (" << key << ")\n";
+
+    return true;
+}
+
+bool
+PackCacheBin::writeEncodedImage(const std::string& key, const std::string& data, const std::string& format, const Config& meta, const osgDB::Options* dbo)
+{
+    if ( !_writer.valid() || format.empty() )
+        return false;
+
+    Config metadata(meta);
+    setEncodedFormat(metadata, format);
+
+    if ( !_writer->add(key, data, metadata, DateTime().asTimeStamp()) )
+    {
+        OE_WARN << LC << "Bin " << getID() << ": FAILED to write encoded image (" << key << ")\n";
+        return false;
+    }
+
+    if ( _debug )
+        OE_NOTICE << LC << "Bin " << getID() << ": wrote encoded image (" << key << ")\n";
+
+    return true;
+}
+
+bool
+PackCacheBin::remove(const std::string& key)
+{
+    // packs are immutable
+    return false;
+}
+
+bool
+PackCacheBin::touch(const std::string& key)
+{
+    // packs are immutable
+    return false;
+}
+
+CacheBin::RecordStatus
+PackCacheBin::getRecordStatus(const std::string& key)
+{
+    if ( _writer.valid() )
+        return _writer->has(key) ? STATUS_OK : STATUS_NOT_FOUND;
+
+    PackReader* reader = getReader();
+    return reader && reader->find(key) ? STATUS_OK : STATUS_NOT_FOUND;
+}
+
+unsigned
+PackCacheBin::getStorageSize()
+{
+    PackReader* reader = getReader();
+    return reader ? (unsigned)reader->getSize() : 0u;
+}
+
+Config
+PackCacheBin::readMetadata()
+{
+    if ( _writer.valid() )
+        return _writer->getBinMetadata();
+
+    PackReader* reader = getReader();
+    if ( !reader )
+        return Config();
+
+    Config meta;
+    std::string json = reader->getBinMetadata();
+    if ( !json.empty() )
+        meta.fromJSON( json );
+    return meta;
+}
+
+bool
+PackCacheBin::writeMetadata(const Config& meta)
+{
+    if ( !_writer.valid() )
+        return false;
+
+    _writer->setBinMetadata( meta );
+    return true;
+}
@@ -0,0 +1,412 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2016 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "PackFile"
+#include <osgEarth/FileUtils>
+#include <osgDB/FileUtils>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include <vector>
+
+#ifdef _WIN32
+#   define WIN32_LEAN_AND_MEAN
+#   include <windows.h>
+#else
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <fcntl.h>
+#   include <unistd.h>
+#endif
+
+#define LC "[PackFile] "
+
+using namespace osgEarth;
+using namespace osgEarth::Drivers::PackCache;
+
+//------------------------------------------------------------------------
+
+MemoryStreamBuf::MemoryStreamBuf(const char* data, size_t size)
+{
+    char* p = const_cast<char*>(data);
+    setg(p, p, p + size);
+}
+
+MemoryStreamBuf::pos_type
+MemoryStreamBuf::seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which)
+{
+    if ((which & std::ios_base::in) == 0)
+        return pos_type(off_type(-1));
+
+    char* pos =
+        dir == std::ios_base::beg ? eback() + off :
+        dir == std::ios_base::cur ? gptr()  + off :
+                                    egptr() + off;
+
+    if (pos < eback() || pos > egptr())
+        return pos_type(off_type(-1));
+
+    setg(eback(), pos, egptr());
+    return pos_type(off_type(pos - eback()));
+}
+
+MemoryStreamBuf::pos_type
+MemoryStreamBuf::seekpos(pos_type pos, std::ios_base::openmode which)
+{
+    return seekoff(off_type(pos), std::ios_base::beg, which);
+}
+
+//------------------------------------------------------------------------
+
+namespace
+{
+    // same ordering as std::string::compare, so it matches the std::map
+    // the writer uses to sort the index.
+    int compareKey(const char* a, size_t aSize, const char* b, size_t bSize)
+    {
+        int r = ::memcmp(a, b, std::min(aSize, bSize));
+        if (r != 0) return r;
+        return aSize < bSize ? -1 : aSize > bSize ? 1 : 0;
+    }
+}
+
+PackReader::PackReader() :
+_base      ( 0L ),
+_size      ( 0 ),
+_index     ( 0L ),
+_numEntries( 0 ),
+_trailer   ( 0L )
+#ifdef _WIN32
+,_file     ( 0L ),
+_mapping   ( 0L )
+#endif
+{
+    //nop
+}
+
+PackReader::~PackReader()
+{
+    close();
+}
+
+bool
+PackReader::open(const std::string& path)
+{
+    close();
+
+#ifdef _WIN32
+    HANDLE file = ::CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, 0L, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0L);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    if (!::GetFileSizeEx(file, &size) || size.QuadPart == 0)
+    {
+        ::CloseHandle(file);
+        return false;
+    }
+
+    HANDLE mapping = ::CreateFileMappingA(file, 0L, PAGE_READONLY, 0, 0, 0L);
+    if (!mapping)
+    {
+        ::CloseHandle(file);
+        return false;
+    }
+
+    void* base = ::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!base)
+    {
+        ::CloseHandle(mapping);
+        ::CloseHandle(file);
+        return false;
+    }
+
+    _file = file;
+    _mapping = mapping;
+    _base = (const char*)base;
+    _size = (size_t)size.QuadPart;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    void* base = ::mmap(0L, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+    // the mapping stays valid after the descriptor closes.
+    ::close(fd);
+
+    if (base == MAP_FAILED)
+        return false;
+
+    _base = (const char*)base;
+    _size = (size_t)st.st_size;
+#endif
+
+    // validate the trailer:
+    if (_size < sizeof(PackTrailer))
+    {
+        OE_WARN << LC << "Pack file is too small: " << path << std::endl;
+        close();
+        return false;
+    }
+
+    _trailer = (const PackTrailer*)(_base + _size - sizeof(PackTrailer));
+
+    if (::memcmp(_trailer->_magic, OSGEARTH_PACK_MAGIC, sizeof(_trailer->_magic)) != 0 ||
+        _trailer->_version != OSGEARTH_PACK_VERSION)
+    {
+        OE_WARN << LC << "Not a cache pack, or an unsupported version: " << path << std::endl;
+        close();
+        return false;
+    }
+
+    if (_trailer->_byteOrder != OSGEARTH_PACK_BYTE_ORDER)
+    {
+        OE_WARN << LC << "Cache pack was written on a machine with a different byte order: " << path << std::endl;
+        close();
+        return false;
+    }
+
+    if (_trailer->_indexOffset + _trailer->_numEntries*sizeof(PackEntry) > _size ||
+        _trailer->_binMetaOffset + _trailer->_binMetaSize > _size)
+    {
+        OE_WARN << LC << "Cache pack is corrupt: " << path << std::endl;
+        close();
+        return false;
+    }
+
+    _index = (const PackEntry*)(_base + _trailer->_indexOffset);
+    _numEntries = _trailer->_numEntries;
+
+    OE_INFO << LC << "Mapped " << path << " (" << _numEntries << " records)" << std::endl;
+    return true;
+}
+
+void
+PackReader::close()
+{
+    if (_base)
+    {
+#ifdef _WIN32
+        ::UnmapViewOfFile(_base);
+        ::CloseHandle((HANDLE)_mapping);
+        ::CloseHandle((HANDLE)_file);
+        _mapping = 0L;
+        _file = 0L;
+#else
+        ::munmap(const_cast<char*>(_base), _size);
+#endif
+    }
+    _base = 0L;
+    _size = 0;
+    _index = 0L;
+    _numEntries = 0;
+    _trailer = 0L;
+}
+
+const PackEntry*
+PackReader::find(const std::string& key) const
+{
+    // binary search on the sorted index:
+    unsigned long long lo = 0, hi = _numEntries;
+    while (lo < hi)
+    {
+        unsigned long long mid = lo + (hi - lo) / 2;
+        const PackEntry& entry = _index[mid];
+        int c = compareKey(_base + entry._stringOffset, entry._keySize, key.data(), key.size());
+        if (c < 0)
+            lo = mid + 1;
+        else if (c > 0)
+            hi = mid;
+        else
+            return &entry;
+    }
+    return 0L;
+}
+
+std::string
+PackReader::getBinMetadata() const
+{
+    return _trailer ?
+        std::string(_base + _trailer->_binMetaOffset, (size_t)_trailer->_binMetaSize) :
+        std::string();
+}
+
+//------------------------------------------------------------------------
+
+PackWriter::PackWriter(const std::string& path) :
+_path    ( path ),
+_tempPath( path + ".tmp" ),
+_open    ( false ),
+_finished( false ),
+_offset  ( 0 )
+{
+    //nop
+}
+
+PackWriter::~PackWriter()
+{
+    finish();
+}
+
+bool
+PackWriter::openFile()
+{
+    if (!_open)
+    {
+        osgEarth::makeDirectoryForFile(_tempPath);
+        _out.open(_tempPath.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+        _open = _out.is_open();
+        if (!_open)
+        {
+            OE_WARN << LC << "Failed to create " << _tempPath << std::endl;
+        }
+    }
+    return _open;
+}
+
+bool
+PackWriter::add(const std::string& key, const std::string& data, const Config& meta, TimeStamp timestamp)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+
+    if (_finished || !openFile())
+        return false;
+
+    _out.write(data.data(), data.size());
+    if (_out.fail())
+        return false;
+
+    // a replaced record's data just stays behind, unreferenced.
+    Record& record = _records[key];
+    record._dataOffset = _offset;
+    record._dataSize = data.size();
+    record._meta = meta.empty() ? std::string() : meta.toJSON(false);
+    record._timestamp = timestamp;
+
+    _offset += data.size();
+    return true;
+}
+
+bool
+PackWriter::has(const std::string& key) const
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    return _records.find(key) != _records.end();
+}
+
+void
+PackWriter::setBinMetadata(const Config& meta)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    _binMeta = meta;
+}
+
+Config
+PackWriter::getBinMetadata() const
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    return _binMeta;
+}
+
+bool
+PackWriter::finish()
+{
+    Threading::ScopedMutexLock lock(_mutex);
+
+    if (_finished)
+        return true;
+
+    _finished = true;
+
+    // nothing was ever written; leave any existing pack alone.
+    if (!_open && (_binMeta.empty() || !openFile()))
+        return true;
+
+    // strings (keys and metadata), in key order:
+    std::vector<PackEntry> index;
+    index.reserve(_records.size());
+
+    for (Records::const_iterator i = _records.begin(); i != _records.end(); ++i)
+    {
+        PackEntry entry;
+        entry._dataOffset = i->second._dataOffset;
+        entry._dataSize = i->second._dataSize;
+        entry._stringOffset = _offset;
+        entry._keySize = (unsigned)i->first.size();
+        entry._metaSize = (unsigned)i->second._meta.size();
+        entry._timestamp = (long long)i->second._timestamp;
+        index.push_back(entry);
+
+        _out.write(i->first.data(), i->first.size());
+        _out.write(i->second._meta.data(), i->second._meta.size());
+        _offset += i->first.size() + i->second._meta.size();
+    }
+
+    // pad so the index is aligned when mapped:
+    static const char zeros[8] = { 0,0,0,0,0,0,0,0 };
+    unsigned pad = (unsigned)((8 - (_offset % 8)) % 8);
+    _out.write(zeros, pad);
+    _offset += pad;
+
+    PackTrailer trailer;
+    ::memcpy(trailer._magic, OSGEARTH_PACK_MAGIC, sizeof(trailer._magic));
+    trailer._version = OSGEARTH_PACK_VERSION;
+    trailer._byteOrder = OSGEARTH_PACK_BYTE_ORDER;
+    trailer._numEntries = index.size();
+    trailer._indexOffset = _offset;
+
+    if (!index.empty())
+        _out.write((const char*)&index[0], index.size()*sizeof(PackEntry));
+    _offset += index.size()*sizeof(PackEntry);
+
+    std::string binMeta = _binMeta.empty() ? std::string() : _binMeta.toJSON(false);
+    trailer._binMetaOffset = _offset;
+    trailer._binMetaSize = binMeta.size();
+    _out.write(binMeta.data(), binMeta.size());
+    _offset += binMeta.size();
+
+    _out.write((const char*)&trailer, sizeof(PackTrailer));
+
+    _out.close();
+    if (_out.fail())
+    {
+        OE_WARN << LC << "Failed to write " << _tempPath << std::endl;
+        return false;
+    }
+
+    // move into place:
+    if (osgDB::fileExists(_path))
+        ::remove(_path.c_str());
+
+    if (::rename(_tempPath.c_str(), _path.c_str()) != 0)
+    {
+        OE_WARN << LC << "Failed to move " << _tempPath << " to " << _path << std::endl;
+        return false;
+    }
+
+    OE_INFO << LC << "Wrote " << _path << " (" << index.size() << " records)" << std::endl;
+    return true;
+}
@@ -19,6 +19,8 @@
 #include "RocksDBCache"
 #include "RocksDBCacheBin"
 #include <osgEarth/URI>
+#include <osgEarth/Registry>
+#include <osgEarth/StringUtils>
 #include <osgEarth/ThreadingUtils>
 #include <osgDB/Registry>
 #include <osgDB/ReaderWriter>
@@ -37,16 +39,39 @@
 
 #define OSGEARTH_ENV_CACHE_MAX_SIZE_MB "OSGEARTH_CACHE_MAX_SIZE_MB"
 
-#define ROCKSDB_CACHE_VERSION 1
-
 using namespace osgEarth;
 using namespace osgEarth::Drivers::RocksDBCache;
 
+namespace
+{
+    // Name of the column family that holds a bin. The prefix keeps bins
+    // from colliding with RocksDB's own "default" family.
+    std::string columnFamilyName(const std::string& binID)
+    {
+        return "bin!" + binID;
+    }
+
+    bool parseCompression(const std::string& input, rocksdb::CompressionType& output)
+    {
+        std::string name = toLower(input);
+        if      ( name == "none"   ) output = rocksdb::kNoCompression;
+        else if ( name == "snappy" ) output = rocksdb::kSnappyCompression;
+        else if ( name == "zlib"   ) output = rocksdb::kZlibCompression;
+        else if ( name == "bzip2"  ) output = rocksdb::kBZip2Compression;
+        else if ( name == "lz4"    ) output = rocksdb::kLZ4Compression;
+        else if ( name == "lz4hc"  ) output = rocksdb::kLZ4HCCompression;
+        else if ( name == "zstd"   ) output = rocksdb::kZSTD;
+        else return false;
+        return true;
+    }
+}
+
 
 RocksDBCacheImpl::RocksDBCacheImpl( const CacheOptions& options ) :
 osgEarth::Cache( options ),
 _options       ( options ),
-_active        ( true )
+_active        ( true ),
+_db            ( 0L )
 {
     // Force OSG to initialize the image wrapper. Failure to do this can result
     // in a race condition within OSG when the cache is accessed from multiple threads.
@@ -90,6 +115,17 @@ _active        ( true )
         }
     }
 
+    // Expire records by the cache-wide policy unless the cache has its own limit.
+    if ( !_options.maxAge().isSet() )
+    {
+        const optional<CachePolicy>& override = Registry::instance()->overrideCachePolicy();
+        const optional<CachePolicy>& defaults = Registry::instance()->defaultCachePolicy();
+        if ( override.isSet() && override->maxAge().isSet() )
+            _options.maxAge() = override->maxAge().get();
+        else if ( defaults.isSet() && defaults->maxAge().isSet() )
+            _options.maxAge() = defaults->maxAge().get();
+    }
+
     _tracker = new Tracker(_options, _rootPath);
     
     if ( !_rootPath.empty() )
@@ -145,48 +181,101 @@ RocksDBCacheImpl::init()
 
 // https://github.com/facebook/rocksdb/wiki/RocksDB-Tuning-Guide
 
+rocksdb::ColumnFamilyOptions
+RocksDBCacheImpl::getColumnFamilyOptions() const
+{
+    rocksdb::ColumnFamilyOptions options;
+
+    options.table_factory = _tableFactory;
+    options.compaction_filter = _expiryFilter.get();
+
+    if ( _options.compression().isSet() )
+    {
+        if ( !parseCompression(_options.compression().get(), options.compression) )
+        {
+            OE_WARN << LC << "Unrecognized compression \"" << _options.compression().get() << "\"; using default" << std::endl;
+        }
+    }
+
+	options.write_buffer_size = _options.writeBufferSize().value();
+	options.level0_file_num_compaction_trigger = _options.maxFilesLevel0().value();
+	options.min_write_buffer_number_to_merge = _options.minBuffersToMerge().value();
+
+	options.max_bytes_for_level_base = options.write_buffer_size * options.min_write_buffer_number_to_merge * options.level0_file_num_compaction_trigger;
+	options.target_file_size_base = options.max_bytes_for_level_base / 10;
+
+    return options;
+}
+
 void
 RocksDBCacheImpl::open()
 {
-    rocksdb::Options options;
-    options.create_if_missing = true;
+    // One block cache for every bin, so the memory budget doesn't grow
+    // with the number of layers. Index and filter blocks live in it too.
     rocksdb::BlockBasedTableOptions table_options;
-
-    options.stats_dump_period_sec = 30;
-
-	table_options.filter_policy.reset(rocksdb::NewBloomFilterPolicy(10));
+    if ( _options.bloomFilterBits().value() > 0u )
+        table_options.filter_policy.reset(rocksdb::NewBloomFilterPolicy(_options.bloomFilterBits().value()));
     table_options.block_size = _options.blockSize().value();
 	table_options.block_cache = rocksdb::NewLRUCache(_options.blockCacheSize().value());
-    options.table_factory.reset( NewBlockBasedTableFactory( table_options ) );
+    table_options.cache_index_and_filter_blocks = true;
+    table_options.pin_l0_filter_and_index_blocks_in_cache = true;
+    _tableFactory.reset( NewBlockBasedTableFactory( table_options ) );
+
+    if ( _options.maxAge().isSet() && _options.maxAge().get() > 0 )
+    {
+        _expiryFilter = std::make_shared<ExpiryFilter>(_options.maxAge().get());
+        OE_INFO << LC << "Records expire after " << _options.maxAge().get() << " s" << std::endl;
+    }
+
+    rocksdb::DBOptions options;
+    options.create_if_missing = true;
+    options.create_missing_column_families = true;
+    options.stats_dump_period_sec = 30;
 
 	if (_options.logPath().isSet())
 		options.db_log_dir = _options.logPath().value();
 
-	options.write_buffer_size = _options.writeBufferSize().value();
-	options.level0_file_num_compaction_trigger = _options.maxFilesLevel0().value();
-	options.min_write_buffer_number_to_merge = _options.minBuffersToMerge().value();
+    // All existing column families must be opened together. The default
+    // family only holds records from the old single-family layout, so it
+    // gets no expiry filter (its values have no time stamp).
+    std::vector<std::string> names;
+    if ( !rocksdb::DB::ListColumnFamilies(options, _rootPath, &names).ok() || names.empty() )
+        names.assign(1, rocksdb::kDefaultColumnFamilyName);
 
-	options.max_bytes_for_level_base = options.write_buffer_size * options.min_write_buffer_number_to_merge * options.level0_file_num_compaction_trigger;
-	options.target_file_size_base = options.max_bytes_for_level_base / 10;
+    std::vector<rocksdb::ColumnFamilyDescriptor> descriptors;
+    for (unsigned i = 0; i < names.size(); ++i)
+    {
+        rocksdb::ColumnFamilyOptions cfOptions = getColumnFamilyOptions();
+        if ( names[i] == rocksdb::kDefaultColumnFamilyName )
+            cfOptions.compaction_filter = 0L;
+        descriptors.push_back(rocksdb::ColumnFamilyDescriptor(names[i], cfOptions));
+    }
 
+    std::vector<rocksdb::ColumnFamilyHandle*> handles;
     rocksdb::Status status;
         
-    status = rocksdb::DB::Open(options, _rootPath, &_db);
-    if ( status.ok() )
-        return;
-
-    OE_WARN << LC << "Database problem...attempting to repair..." << std::endl;
-    status = rocksdb::RepairDB(_rootPath, options);
-    if ( status.ok() )
+    status = rocksdb::DB::Open(options, _rootPath, descriptors, &handles, &_db);
+    if ( !status.ok() )
     {
-        status = rocksdb::DB::Open(options, _rootPath, &_db);
+        OE_WARN << LC << "Database problem...attempting to repair..." << std::endl;
+        status = rocksdb::RepairDB(_rootPath, options, descriptors);
         if ( status.ok() )
         {
-            OE_WARN << LC << "...repair complete!" << std::endl;
-            return;
+            status = rocksdb::DB::Open(options, _rootPath, descriptors, &handles, &_db);
+            if ( status.ok() )
+            {
+                OE_WARN << LC << "...repair complete!" << std::endl;
+            }
         }
     }
 
+    if ( status.ok() )
+    {
+        for (unsigned i = 0; i < handles.size(); ++i)
+            _columnFamilies[handles[i]->GetName()] = handles[i];
+        return;
+    }
+
     OE_WARN << LC << "Failed to open or create cache bin at " << _rootPath << std::endl;
     if ( _db )
     {
@@ -196,11 +285,38 @@ RocksDBCacheImpl::open()
     }
 }
 
+rocksdb::ColumnFamilyHandle*
+RocksDBCacheImpl::getOrCreateColumnFamily(const std::string& binID)
+{
+    if ( !_db )
+        return 0L;
+
+    std::string name = columnFamilyName(binID);
+
+    Threading::ScopedMutexLock lock( _columnFamiliesMutex );
+
+    ColumnFamilies::iterator i = _columnFamilies.find(name);
+    if ( i != _columnFamilies.end() )
+        return i->second;
+
+    rocksdb::ColumnFamilyHandle* handle = 0L;
+    rocksdb::Status status = _db->CreateColumnFamily(getColumnFamilyOptions(), name, &handle);
+    if ( !status.ok() )
+    {
+        OE_WARN << LC << "Failed to create column family for bin \"" << binID << "\": " << status.ToString() << std::endl;
+        return 0L;
+    }
+
+    _columnFamilies[name] = handle;
+    return handle;
+}
+
 CacheBin*
 RocksDBCacheImpl::addBin( const std::string& name )
 {
-    return _db ?
-        _bins.getOrCreate(name, new RocksDBCacheBin(name, _db, _tracker.get())) :
+    rocksdb::ColumnFamilyHandle* cf = getOrCreateColumnFamily(name);
+    return cf ?
+        _bins.getOrCreate(name, new RocksDBCacheBin(name, _db, cf, _tracker.get())) :
         0L;
 }
 
@@ -216,7 +332,9 @@ RocksDBCacheImpl::getOrCreateDefaultBin()
         Threading::ScopedMutexLock lock( s_defaultBinMutex );
         if ( !_defaultBin.valid() ) // double-check
         {
-            _defaultBin = new RocksDBCacheBin("_default", _db, _tracker.get());
+            rocksdb::ColumnFamilyHandle* cf = getOrCreateColumnFamily("_default");
+            if ( cf )
+                _defaultBin = new RocksDBCacheBin("_default", _db, cf, _tracker.get());
         }
     }
     return _defaultBin.get();
@@ -234,7 +352,12 @@ RocksDBCacheImpl::compact()
     if ( !_db )
         return false;
 
-    _db->CompactRange(0L, 0L);
+    Threading::ScopedMutexLock lock( _columnFamiliesMutex );
+
+    for (ColumnFamilies::iterator cf = _columnFamilies.begin(); cf != _columnFamilies.end(); ++cf)
+    {
+        _db->CompactRange(rocksdb::CompactRangeOptions(), cf->second, 0L, 0L);
+    }
 
     return true;
 }
@@ -248,10 +371,16 @@ RocksDBCacheImpl::clear()
     // No WriteBatch because it doesn't seem to allow compaction to occur
     // -- need to figure out why someday.
 
-    rocksdb::Iterator* it = _db->NewIterator(rocksdb::ReadOptions());
-    for(it->SeekToFirst(); it->Valid(); it->Next())
+    Threading::ScopedMutexLock lock( _columnFamiliesMutex );
+
+    for (ColumnFamilies::iterator cf = _columnFamilies.begin(); cf != _columnFamilies.end(); ++cf)
     {
-        _db->Delete(rocksdb::WriteOptions(), it->key());
+        rocksdb::Iterator* it = _db->NewIterator(rocksdb::ReadOptions(), cf->second);
+        for(it->SeekToFirst(); it->Valid(); it->Next())
+        {
+            _db->Delete(rocksdb::WriteOptions(), cf->second, it->key());
+        }
+        delete it;
     }
 
     return true;
@@ -79,11 +79,13 @@ namespace
 #define TIME_FIELD "rocksdb.time"
 
 
-RocksDBCacheBin::RocksDBCacheBin(const std::string& binID,
-                                 rocksdb::DB*       db,
-                                 Tracker*           tracker) :
+RocksDBCacheBin::RocksDBCacheBin(const std::string&           binID,
+                                 rocksdb::DB*                 db,
+                                 rocksdb::ColumnFamilyHandle* cf,
+                                 Tracker*                     tracker) :
 osgEarth::CacheBin( binID ),
 _db               ( db ),
+_cf               ( cf ),
 _tracker          ( tracker ),
 _debug            ( false )
 {
@@ -103,7 +105,7 @@ RocksDBCacheBin::~RocksDBCacheBin()
 bool
 RocksDBCacheBin::binValidForReading(bool silent)
 {
-    bool ok = _db != 0L;
+    bool ok = _db != 0L && _cf != 0L;
     if ( !ok && !silent )
     {
         OE_WARN << LC << "Failed to locate cache bin (" << getID() << ")" << std::endl;
@@ -114,7 +116,7 @@ RocksDBCacheBin::binValidForReading(bool silent)
 bool
 RocksDBCacheBin::binValidForWriting(bool silent)
 {
-    bool ok = _db != 0L;
+    bool ok = _db != 0L && _cf != 0L;
     if ( !ok && !silent )
     {
         OE_WARN << LC << "Failed to locate cache bin (" << getID() << ")" << std::endl;
@@ -245,46 +247,119 @@ RocksDBCacheBin::read(const std::string& key, const Reader& reader)
     if ( !binValidForReading() ) 
         return ReadResult(ReadResult::RESULT_NOT_FOUND);
 
-    ++_tracker->reads;
-
-    Config metadata;
     rocksdb::Status status;
     rocksdb::ReadOptions ro;
 
     // first read the metadata record.
     std::string metavalue;
-    status = _db->Get( ro, metaKey(key), &metavalue );
+    status = _db->Get( ro, _cf, metaKey(key), &metavalue );
+    bool hasMeta = status.ok();
+        
+    // next read the data record.
+    std::string datavalue;
+    status = _db->Get( ro, _cf, dataKey(key), &datavalue );
+    bool hasData = status.ok();
+
+    return decode(key, hasMeta ? &metavalue : 0L, hasData ? &datavalue : 0L, reader);
+}
+
+void
+RocksDBCacheBin::readImages(const std::vector<std::string>& keys, const osgDB::Options* readOptions, std::vector<ReadResult>& output)
+{
+    output.clear();
+
+    if ( !binValidForReading() )
+    {
+        output.resize(keys.size(), ReadResult(ReadResult::RESULT_NOT_FOUND));
+        return;
+    }
+
+    // one lookup for all the metadata and data records, interleaved:
+    std::vector<std::string> dbkeys;
+    dbkeys.reserve(keys.size()*2);
+    for (unsigned i = 0; i < keys.size(); ++i)
+    {
+        dbkeys.push_back(metaKey(keys[i]));
+        dbkeys.push_back(dataKey(keys[i]));
+    }
+
+    std::vector<rocksdb::Slice> slices(dbkeys.begin(), dbkeys.end());
+    std::vector<std::string> values;
+    std::vector<rocksdb::ColumnFamilyHandle*> families(slices.size(), _cf);
+    std::vector<rocksdb::Status> statuses = _db->MultiGet(rocksdb::ReadOptions(), families, slices, &values);
+
+    ImageReader reader(_rw.get(), readOptions);
+    output.reserve(keys.size());
+    for (unsigned i = 0; i < keys.size(); ++i)
+    {
+        output.push_back(decode(
+            keys[i],
+            statuses[i*2].ok()   ? &values[i*2]   : 0L,
+            statuses[i*2+1].ok() ? &values[i*2+1] : 0L,
+            reader));
+    }
+}
+
+ReadResult
+RocksDBCacheBin::decode(const std::string& key, const std::string* metavalue, std::string* datavalue, const Reader& reader)
+{
+    ++_tracker->reads;
+
+    Config metadata;
     TimeStamp lastModified = (TimeStamp)0;
-    if ( status.ok() )
+    if ( metavalue )
     {        
-        decodeMeta(metavalue, metadata);
+        std::string metastring(*metavalue);
+        TimeStamp written;
+        RecordStamp::strip(metastring, written);
+        decodeMeta(metastring, metadata);
         DateTime t( metadata.value(TIME_FIELD));
         lastModified = t.asTimeStamp();
     }
-        
-    // next read the data record.
-    std::string datakey = dataKey(key);
-    std::string datavalue;
-    status = _db->Get( ro, datakey, &datavalue );
-    if ( !status.ok() )
+
+    if ( !datavalue )
     {
         // main record not found for some reason.
         return ReadResult(ReadResult::RESULT_NOT_FOUND);
     }
 
+    TimeStamp written;
+    RecordStamp::strip(*datavalue, written);
+
     // blend the data string
     if ( _tracker->seed().isSet() )
-        unblend(datavalue, _tracker->seed().value());
+        unblend(*datavalue, _tracker->seed().value());
+
+    std::istringstream datastream(*datavalue);
+
+    // encoded images are stored as-is and decode straight from the data:
+    std::string format = getEncodedFormat(metadata);
+    if ( !format.empty() )
+    {
+        if ( !dynamic_cast<const ImageReader*>(&reader) )
+            return ReadResult(ReadResult::RESULT_READER_ERROR);
+
+        ReadResult rr = decodeImage(datastream, format, reader._op);
+        if ( rr.succeeded() )
+        {
+            if ( _tracker->hasSizeLimit() )
+                touch( key );
+
+            ++_tracker->hits;
+            rr.setMetadata(metadata);
+            rr.setLastModifiedTime(lastModified);
+        }
+        return rr;
+    }
 
     // finally, decode the OSGB stream into an object.
-    std::istringstream datastream(datavalue);
     osgDB::ReaderWriter::ReadResult r = reader.read(datastream);
     if ( !r.success() )
     {
         OE_WARN << LC << "Cache read failure!"
             << "\n reader = " << reader.name()
             << "\n error detail = " << r.message()
-            << "\n data value = " << datavalue
+            << "\n data value = " << *datavalue
             << "\n";
 
         return ReadResult(ReadResult::RESULT_READER_ERROR);
@@ -327,15 +402,9 @@ RocksDBCacheBin::readString(const std::string& key, const osgDB::Options* readOp
 }
 
 bool
-RocksDBCacheBin::write(const std::string& key, const osg::Object* object, const Config& meta, const osgDB::Options* writeOptions)
+RocksDBCacheBin::serialize(const osg::Object* object, const osgDB::Options* writeOptions, std::string& data, std::string& message)
 {
-    if ( !binValidForWriting() || !object ) 
-        return false;
-        
     osgDB::ReaderWriter::WriteResult r;
-    bool objWriteOK = false;
-
-    std::string       data;
     std::stringstream datastream;
 
     if ( dynamic_cast<const osg::Image*>(object) )
@@ -345,8 +414,7 @@ RocksDBCacheBin::write(const std::string& key, const osg::Object* object, const
             OE_WARN << LC << "Internal: tried to write image to " << _rw->className() << "\n";
             return false;
         }
-        r = _rw->writeImage( *static_cast<const osg::Image*>(object), datastream, writeOptions);
-        objWriteOK = r.success();
+        r = _rw->writeImage( *static_cast<const osg::Image*>(object), datastream, writeOptions );
     }
     else if ( dynamic_cast<const osg::Node*>(object) )
     {
@@ -355,8 +423,7 @@ RocksDBCacheBin::write(const std::string& key, const osg::Object* object, const
             OE_WARN << LC << "Internal: tried to write node to " << _rw->className() << "\n";
             return false;
         }
-        r = _rw->writeNode( *static_cast<const osg::Node*>(object), datastream, writeOptions);
-        objWriteOK = r.success();
+        r = _rw->writeNode( *static_cast<const osg::Node*>(object), datastream, writeOptions );
     }
     else
     {
@@ -366,28 +433,52 @@ RocksDBCacheBin::write(const std::string& key, const osg::Object* object, const
             return false;
         }
         r = _rw->writeObject( *object, datastream, writeOptions );
-        objWriteOK = r.success();
     }
 
-    if (objWriteOK)
-    {
-        DateTime now;
-        rocksdb::WriteBatch batch;
+    message = r.message();
+    if ( !r.success() )
+        return false;
+
+    data = datastream.str();
+    if ( _tracker->seed().isSet() )
+        blend(data, _tracker->seed().value());
 
-        // write the data:
-        data = datastream.str();
-        if ( _tracker->seed().isSet() )
-            blend(data, _tracker->seed().value());
-        batch.Put( dataKey(key), data );
+    return true;
+}
+
+void
+RocksDBCacheBin::addToBatch(const std::string& key, const std::string& data, const Config& meta, const DateTime& now, rocksdb::WriteBatch& batch)
+{
+    // write the data:
+    std::string datavalue(data);
+    RecordStamp::write( now.asTimeStamp(), datavalue );
+    batch.Put( _cf, dataKey(key), datavalue );
 
-        // write the timestamp index:
-        batch.Put( timeKey(now, key), binDataKeyTuple(key) );
+    // write the timestamp index:
+    batch.Put( _cf, timeKey(now, key), binDataKeyTuple(key) );
 
-        // write the metadata:
-        Config metadata(meta);
-        metadata.set( TIME_FIELD, now.asCompactISO8601() );
-        encodeMeta( metadata, data );
-        batch.Put( metaKey(key), data );
+    // write the metadata:
+    std::string metavalue;
+    Config metadata(meta);
+    metadata.set( TIME_FIELD, now.asCompactISO8601() );
+    encodeMeta( metadata, metavalue );
+    RecordStamp::write( now.asTimeStamp(), metavalue );
+    batch.Put( _cf, metaKey(key), metavalue );
+}
+
+bool
+RocksDBCacheBin::write(const std::string& key, const osg::Object* object, const Config& meta, const osgDB::Options* writeOptions)
+{
+    if ( !binValidForWriting() || !object ) 
+        return false;
+
+    std::string data, message;
+    bool objWriteOK = serialize(object, writeOptions, data, message);
+
+    if (objWriteOK)
+    {
+        rocksdb::WriteBatch batch;
+        addToBatch(key, data, meta, DateTime(), batch);
 
         objWriteOK = _db->Write( rocksdb::WriteOptions(), &batch ).ok();
 
@@ -402,17 +493,99 @@ RocksDBCacheBin::write(const std::string& key, const osg::Object* object, const
             }
         }
     }
-
         
     if ( !objWriteOK )
     {
         OE_WARN << LC << "Bin " << getID() << ": FAILED to write (" << key << "); msg = \"" 
-            << r.message() << "\"\n";
+            << message << "\"\n";
     }
 
     return objWriteOK;
 }
 
+bool
+RocksDBCacheBin::writeEncodedImage(const std::string& key, const std::string& encoded, const std::string& format, const Config& meta, const osgDB::Options* writeOptions)
+{
+    if ( !binValidForWriting() || format.empty() ) 
+        return false;
+
+    std::string data(encoded);
+    if ( _tracker->seed().isSet() )
+        blend(data, _tracker->seed().value());
+
+    Config metadata(meta);
+    setEncodedFormat(metadata, format);
+
+    rocksdb::WriteBatch batch;
+    addToBatch(key, data, metadata, DateTime(), batch);
+
+    if ( !_db->Write( rocksdb::WriteOptions(), &batch ).ok() )
+    {
+        OE_WARN << LC << "Bin " << getID() << ": FAILED to write encoded image (" << key << ")\n";
+        return false;
+    }
+
+    ++_tracker->writes;
+    postWrite();
+
+    if ( _debug )
+    {
+        OE_NOTICE << LC << "Bin " << getID() << ": wrote encoded image (" << key << ")\n";
+    }
+
+    return true;
+}
+
+bool
+RocksDBCacheBin::writeBatch(const WriteRecords& records, const osgDB::Options* writeOptions)
+{
+    if ( !binValidForWriting() ) 
+        return false;
+
+    // serialize everything first, then commit it all in one atomic write.
+    DateTime now;
+    rocksdb::WriteBatch batch;
+    unsigned count = 0u;
+    bool ok = true;
+
+    for (WriteRecords::const_iterator i = records.begin(); i != records.end(); ++i)
+    {
+        std::string data, message;
+        if ( i->_object.valid() && serialize(i->_object.get(), writeOptions, data, message) )
+        {
+            addToBatch(i->_key, data, i->_meta, now, batch);
+            ++count;
+        }
+        else
+        {
+            OE_WARN << LC << "Bin " << getID() << ": FAILED to write (" << i->_key << "); msg = \"" 
+                << message << "\"\n";
+            ok = false;
+        }
+    }
+
+    if ( count == 0u )
+        return ok;
+
+    if ( !_db->Write( rocksdb::WriteOptions(), &batch ).ok() )
+    {
+        OE_WARN << LC << "Bin " << getID() << ": FAILED to write a batch of " << count << " records\n";
+        return false;
+    }
+
+    for (unsigned i = 0; i < count; ++i)
+        ++_tracker->writes;
+
+    postWrite();
+
+    if ( _debug )
+    {
+        OE_NOTICE << LC << "Bin " << getID() << ": wrote a batch of " << count << " records\n";
+    }
+
+    return ok;
+}
+
 void
 RocksDBCacheBin::postWrite()
 {
@@ -460,7 +633,7 @@ RocksDBCacheBin::getRecordStatus(const std::string& key)
 
     // read the metadata record.
     std::string metavalue;
-    status = _db->Get( ro, metaKey(key), &metavalue );
+    status = _db->Get( ro, _cf, metaKey(key), &metavalue );
     if ( status.ok() )
     {        
         return STATUS_OK;
@@ -479,17 +652,20 @@ RocksDBCacheBin::remove(const std::string& key)
 
     // first read in the time from the metadata record.
     std::string metavalue;
-    if ( _db->Get(rocksdb::ReadOptions(), metaKey(key), &metavalue).ok() == false )
+    if ( _db->Get(rocksdb::ReadOptions(), _cf, metaKey(key), &metavalue).ok() == false )
         return false;
 
+    TimeStamp written;
+    RecordStamp::strip(metavalue, written);
+
     Config metadata;
     decodeMeta(metavalue, metadata);
     DateTime t(metadata.value(TIME_FIELD));
 
     rocksdb::WriteBatch batch;
-    batch.Delete( dataKey(key) );
-    batch.Delete( metaKey(key) );
-    batch.Delete( timeKey(t, key) );
+    batch.Delete( _cf, dataKey(key) );
+    batch.Delete( _cf, metaKey(key) );
+    batch.Delete( _cf, timeKey(t, key) );
         
     rocksdb::Status status = _db->Write(rocksdb::WriteOptions(), &batch);
     if ( !status.ok() )
@@ -513,7 +689,12 @@ RocksDBCacheBin::touch(const std::string& key)
 
     // first read in the time from the metadata record.
     std::string metavalue;
-    if ( _db->Get(rocksdb::ReadOptions(), metaKey(key), &metavalue).ok() == false )
+    if ( _db->Get(rocksdb::ReadOptions(), _cf, metaKey(key), &metavalue).ok() == false )
+        return false;
+
+    // keep the original write time so touching doesn't postpone expiry.
+    TimeStamp written;
+    if ( !RecordStamp::strip(metavalue, written) )
         return false;
 
     Config metadata;
@@ -526,13 +707,14 @@ RocksDBCacheBin::touch(const std::string& key)
     std::string newtime = DateTime().asCompactISO8601();
     metadata.set(TIME_FIELD, newtime);
     encodeMeta(metadata, metavalue);
-    batch.Put(metaKey(key), metavalue);
+    RecordStamp::write(written, metavalue);
+    batch.Put(_cf, metaKey(key), metavalue);
 
     // ...remove the old time index record:
-    batch.Delete( timeKey(oldtime, key) );
+    batch.Delete( _cf, timeKey(oldtime, key) );
 
     // ...and write a new time index record.
-    batch.Put( timeKey(newtime, key), binDataKeyTuple(key) );
+    batch.Put( _cf, timeKey(newtime, key), binDataKeyTuple(key) );
 
     rocksdb::Status status = _db->Write(rocksdb::WriteOptions(), &batch);
     if ( !status.ok() )
@@ -555,13 +737,13 @@ RocksDBCacheBin::clear()
     rocksdb::WriteOptions wo;
     std::string binphrase = binPhrase();
     rocksdb::WriteBatch batch;
-    rocksdb::Iterator* i = _db->NewIterator(rocksdb::ReadOptions());
+    rocksdb::Iterator* i = _db->NewIterator(rocksdb::ReadOptions(), _cf);
     for(i->SeekToFirst(); i->Valid(); i->Next())
     {
         std::string key = i->key().ToString();
         if ( key.find(binphrase) != std::string::npos )
         {
-            _db->Delete( wo, i->key() );
+            _db->Delete( wo, _cf, i->key() );
         }
     }
     delete i;
@@ -581,7 +763,7 @@ RocksDBCacheBin::compact()
         return false;
 
     // This could take a while.
-    _db->CompactRange(0L, 0L);
+    _db->CompactRange(rocksdb::CompactRangeOptions(), _cf, 0L, 0L);
 
     return false;
 }
@@ -601,7 +783,7 @@ RocksDBCacheBin::getStorageSize()
     ranges[2] = rocksdb::Range(timeBegin(), timeEnd());
     sizes[0] = sizes[1] = sizes[2] = 0;
 
-    _db->GetApproximateSizes( ranges, 3, sizes );
+    _db->GetApproximateSizes( _cf, ranges, 3, sizes );
     return sizes[0] + sizes[1] + sizes[2];
 }
 
@@ -614,7 +796,7 @@ RocksDBCacheBin::readMetadata()
     ScopedMutexLock exclusiveLock( _rwMutex );
 
     std::string binvalue;
-    rocksdb::Status status = _db->Get(rocksdb::ReadOptions(), binKey(), &binvalue);
+    rocksdb::Status status = _db->Get(rocksdb::ReadOptions(), _cf, binKey(), &binvalue);
     if ( !status.ok() )
         return Config();
 
@@ -638,7 +820,7 @@ RocksDBCacheBin::writeMetadata(const Config& conf)
     std::string value;
     encodeMeta(mutableConf, value);
 
-    if ( _db->Put(rocksdb::WriteOptions(), binKey(), value).ok() == false )
+    if ( _db->Put(rocksdb::WriteOptions(), _cf, binKey(), value).ok() == false )
     {
         OE_WARN << LC << "Failed to write metadata record for bin (" << getID() << ")" << std::endl;
         return false;
@@ -653,12 +835,12 @@ RocksDBCacheBin::purgeOldest(unsigned maxnum)
     if ( !binValidForWriting() )
         return false;
 
-    rocksdb::Iterator* it = _db->NewIterator(rocksdb::ReadOptions());
+    rocksdb::Iterator* it = _db->NewIterator(rocksdb::ReadOptions(), _cf);
 
     unsigned count = 0;
     std::string limit = timeEndGlobal();
 
-    // note: this will delete records NOT OF THIS BIN as well!
+    // the time index is per column family, so this only purges this bin.
     for(it->Seek(timeBeginGlobal());
         count < maxnum && it->Valid() && it->key().ToString() < limit;
         it->Next(), ++count )
@@ -671,9 +853,9 @@ RocksDBCacheBin::purgeOldest(unsigned maxnum)
         // doing this in a WriteBatch did not work. The size of the
         // database would never go down.
         rocksdb::WriteOptions wo;
-        _db->Delete( wo, dataKeyFromTuple(tuple) );
-        _db->Delete( wo, metaKeyFromTuple(tuple) );
-        _db->Delete( wo, it->key() );
+        _db->Delete( wo, _cf, dataKeyFromTuple(tuple) );
+        _db->Delete( wo, _cf, metaKeyFromTuple(tuple) );
+        _db->Delete( wo, _cf, it->key() );
     }
 
     delete it;
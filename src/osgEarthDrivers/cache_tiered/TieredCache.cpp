@@ -0,0 +1,113 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2016 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "TieredCache"
+#include "TieredCacheBin"
+#include <osgEarth/ThreadingUtils>
+
+#define LC "[TieredCache] "
+
+using namespace osgEarth;
+using namespace osgEarth::Drivers::TieredCache;
+
+
+TieredCacheImpl::TieredCacheImpl( const CacheOptions& options ) :
+osgEarth::Cache( options ),
+_options       ( options )
+{
+    if ( _options.backend().isSet() )
+    {
+        _backend = CacheFactory::create( _options.backend().get() );
+    }
+
+    if ( !_backend.valid() || !_backend->isOK() )
+    {
+        _backend = 0L;
+        OE_WARN << LC << "No usable backend cache; records will only be cached in memory" << std::endl;
+    }
+
+    _state = new TieredCacheState(
+        (size_t)_options.memorySizeMB().get() * 1024u * 1024u,
+        _options.maxPendingWrites().get() );
+
+    OE_INFO << LC << "Memory tier size = " << _options.memorySizeMB().get() << " MB" << std::endl;
+}
+
+TieredCacheImpl::~TieredCacheImpl()
+{
+    // don't lose queued writes.
+    flush();
+}
+
+void
+TieredCacheImpl::flush()
+{
+    if ( _state.valid() )
+        _state->flush();
+}
+
+CacheBin*
+TieredCacheImpl::addBin( const std::string& name )
+{
+    return _bins.getOrCreate(name, new TieredCacheBin(
+        name,
+        _backend.valid() ? _backend->addBin(name) : 0L,
+        _state.get()));
+}
+
+CacheBin*
+TieredCacheImpl::getOrCreateDefaultBin()
+{
+    static Threading::Mutex s_defaultBinMutex;
+    if ( !_defaultBin.valid() )
+    {
+        Threading::ScopedMutexLock lock( s_defaultBinMutex );
+        if ( !_defaultBin.valid() ) // double-check
+        {
+            _defaultBin = new TieredCacheBin(
+                "_default",
+                _backend.valid() ? _backend->getOrCreateDefaultBin() : 0L,
+                _state.get());
+        }
+    }
+    return _defaultBin.get();
+}
+
+off_t
+TieredCacheImpl::getApproximateSize() const
+{
+    return _backend.valid() ? _backend->getApproximateSize() : 0;
+}
+
+bool
+TieredCacheImpl::compact()
+{
+    flush();
+    return _backend.valid() ? _backend->compact() : false;
+}
+
+bool
+TieredCacheImpl::clear()
+{
+    {
+        Threading::ScopedMutexLock lock( _state->_flushMutex );
+        _state->cancelPending( "", true );
+        _state->_memory.clear();
+    }
+    return _backend.valid() ? _backend->clear() : true;
+}
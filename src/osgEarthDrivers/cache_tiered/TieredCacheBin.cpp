@@ -0,0 +1,441 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2016 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "TieredCacheBin"
+#include <osgEarth/JobScheduler>
+#include <osgEarth/Registry>
+#include <osgEarth/DateTime>
+#include <osg/Image>
+
+#define LC "[TieredCache] "
+
+// Estimated size of objects we can't easily measure (e.g. nodes)
+#define DEFAULT_OBJECT_SIZE (64u*1024u)
+
+// Most records to hand to the backend in one writeBatch() call
+#define MAX_BATCH_SIZE 64u
+
+using namespace osgEarth;
+using namespace osgEarth::Drivers::TieredCache;
+
+//------------------------------------------------------------------------
+
+namespace
+{
+    // Drains the write-behind queue on the JobScheduler.
+    struct FlushTask : public TaskRequest
+    {
+        FlushTask(TieredCacheState* state) : _state(state) { }
+
+        void operator()(ProgressCallback*)
+        {
+            _state->flush();
+        }
+
+        osg::ref_ptr<TieredCacheState> _state;
+    };
+
+    // Collects the memory tier keys that belong to one bin.
+    struct CollectKeys : public TieredCacheState::Memory::Functor
+    {
+        CollectKeys(const std::string& prefix) : _prefix(prefix) { }
+
+        void operator()(const std::string& key, const TieredCacheState::Entry&)
+        {
+            if (key.compare(0, _prefix.length(), _prefix) == 0)
+                _keys.push_back(key);
+        }
+
+        std::string _prefix;
+        std::vector<std::string> _keys;
+    };
+
+    ReadResult makeResult(const TieredCacheState::Entry& entry)
+    {
+        // clone required since the cache is in memory
+        ReadResult r(osg::clone(entry._object.get(), osg::CopyOp::DEEP_COPY_ALL), entry._meta);
+        r.setLastModifiedTime(entry._time);
+        return r;
+    }
+}
+
+//------------------------------------------------------------------------
+
+TieredCacheState::TieredCacheState(size_t maxBytes, unsigned maxPendingWrites) :
+_memory        ( true /* MT-safe */, ~0u ),
+_maxPending    ( maxPendingWrites ),
+_flushScheduled( false )
+{
+    _memory.setMaxCost(maxBytes);
+}
+
+size_t
+TieredCacheState::getSize(const osg::Object* object)
+{
+    const osg::Image* image = dynamic_cast<const osg::Image*>(object);
+    if (image)
+        return image->getTotalSizeInBytesIncludingMipmaps();
+
+    const StringObject* str = dynamic_cast<const StringObject*>(object);
+    if (str)
+        return str->getString().size();
+
+    return DEFAULT_OBJECT_SIZE;
+}
+
+bool
+TieredCacheState::queueWrite(const std::string&    fullKey,
+                             CacheBin*             backend,
+                             const std::string&    key,
+                             const Entry&          entry,
+                             const osgDB::Options* dbo)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+
+    PendingWrites::iterator i = _pending.find(fullKey);
+    if (i == _pending.end())
+    {
+        if (_pending.size() >= _maxPending)
+            return false;
+
+        i = _pending.insert(std::make_pair(fullKey, PendingWrite())).first;
+        _queue.push_back(fullKey);
+    }
+
+    PendingWrite& write = i->second;
+    write._bin = backend;
+    write._key = key;
+    write._entry = entry;
+    write._dbo = dbo;
+
+    if (!_flushScheduled)
+    {
+        _flushScheduled = true;
+        Registry::instance()->getJobScheduler()->submit(new FlushTask(this), JobScheduler::LANE_LOW);
+    }
+
+    return true;
+}
+
+bool
+TieredCacheState::getPending(const std::string& fullKey, Entry& output)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    PendingWrites::const_iterator i = _pending.find(fullKey);
+    if (i == _pending.end())
+        return false;
+    output = i->second._entry;
+    return true;
+}
+
+void
+TieredCacheState::cancelPending(const std::string& key, bool isPrefix)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    if (isPrefix)
+    {
+        PendingWrites::iterator i = _pending.lower_bound(key);
+        while (i != _pending.end() && i->first.compare(0, key.length(), key) == 0)
+            _pending.erase(i++);
+    }
+    else
+    {
+        _pending.erase(key);
+    }
+}
+
+void
+TieredCacheState::flush()
+{
+    while (true)
+    {
+        Threading::ScopedMutexLock flushLock(_flushMutex);
+
+        // Gather a run of queued records bound for the same bin so we can
+        // hand them to the backend as one batch.
+        std::vector<std::string> fullKeys;
+        CacheBin::WriteRecords records;
+        osg::ref_ptr<CacheBin> bin;
+        osg::ref_ptr<const osgDB::Options> dbo;
+        {
+            Threading::ScopedMutexLock lock(_mutex);
+            while (!_queue.empty() && records.size() < MAX_BATCH_SIZE)
+            {
+                // canceled, or already written under a repeated key:
+                PendingWrites::iterator i = _pending.find(_queue.front());
+                if (i == _pending.end())
+                {
+                    _queue.pop_front();
+                    continue;
+                }
+
+                const PendingWrite& write = i->second;
+                if (bin.valid() && (write._bin != bin || write._dbo != dbo))
+                    break;
+
+                bin = write._bin.get();
+                dbo = write._dbo.get();
+                fullKeys.push_back(i->first);
+                records.push_back(CacheBin::WriteRecord(write._key, write._entry._object.get(), write._entry._meta));
+                _queue.pop_front();
+            }
+
+            if (records.empty())
+            {
+                _flushScheduled = false;
+                return;
+            }
+        }
+
+        if (!bin->writeBatch(records, dbo.get()))
+        {
+            OE_DEBUG << LC << "Failed to write " << records.size() << " records to the backend" << std::endl;
+        }
+
+        // Keep the records readable from the queue until they're written; but
+        // if one was re-written in the meantime, leave the newer one queued.
+        Threading::ScopedMutexLock lock(_mutex);
+        for (unsigned k = 0; k < fullKeys.size(); ++k)
+        {
+            PendingWrites::iterator i = _pending.find(fullKeys[k]);
+            if (i != _pending.end() && i->second._entry._object == records[k]._object)
+                _pending.erase(i);
+        }
+    }
+}
+
+//------------------------------------------------------------------------
+
+TieredCacheBin::TieredCacheBin(const std::string& binID, CacheBin* backend, TieredCacheState* state) :
+CacheBin( binID ),
+_backend( backend ),
+_state  ( state )
+{
+    //nop
+}
+
+ReadResult
+TieredCacheBin::read(const std::string& key, const osgDB::Options* dbo, Type type)
+{
+    std::string fullKey = getFullKey(key);
+
+    TieredCacheState::Memory::Record rec;
+    if (_state->_memory.get(fullKey, rec))
+        return makeResult(rec.value());
+
+    // the memory tier may have evicted a record that isn't written yet:
+    TieredCacheState::Entry pending;
+    if (_state->getPending(fullKey, pending))
+        return makeResult(pending);
+
+    if (!_backend.valid())
+        return ReadResult();
+
+    ReadResult r =
+        type == TYPE_IMAGE  ? _backend->readImage(key, dbo) :
+        type == TYPE_STRING ? _backend->readString(key, dbo) :
+        _backend->readObject(key, dbo);
+
+    // promote to the memory tier:
+    if (r.succeeded())
+    {
+        osg::ref_ptr<const osg::Object> cloned = osg::clone(r.getObject(), osg::CopyOp::DEEP_COPY_ALL);
+        _state->_memory.insert(
+            fullKey,
+            TieredCacheState::Entry(cloned.get(), r.metadata(), r.lastModifiedTime()),
+            TieredCacheState::getSize(cloned.get()));
+    }
+
+    return r;
+}
+
+ReadResult
+TieredCacheBin::readObject(const std::string& key, const osgDB::Options* dbo)
+{
+    return read(key, dbo, TYPE_OBJECT);
+}
+
+ReadResult
+TieredCacheBin::readImage(const std::string& key, const osgDB::Options* dbo)
+{
+    return read(key, dbo, TYPE_IMAGE);
+}
+
+void
+TieredCacheBin::readImages(const std::vector<std::string>& keys, const osgDB::Options* dbo, std::vector<ReadResult>& output)
+{
+    output.clear();
+    output.resize(keys.size());
+
+    // serve what we can from memory, and batch the rest to the backend:
+    std::vector<std::string> misses;
+    std::vector<unsigned> missIndices;
+
+    for (unsigned i = 0; i < keys.size(); ++i)
+    {
+        std::string fullKey = getFullKey(keys[i]);
+
+        TieredCacheState::Memory::Record rec;
+        TieredCacheState::Entry pending;
+        if (_state->_memory.get(fullKey, rec))
+        {
+            output[i] = makeResult(rec.value());
+        }
+        else if (_state->getPending(fullKey, pending))
+        {
+            output[i] = makeResult(pending);
+        }
+        else
+        {
+            misses.push_back(keys[i]);
+            missIndices.push_back(i);
+        }
+    }
+
+    if (misses.empty() || !_backend.valid())
+        return;
+
+    std::vector<ReadResult> results;
+    _backend->readImages(misses, dbo, results);
+
+    for (unsigned m = 0; m < misses.size() && m < results.size(); ++m)
+    {
+        ReadResult& r = results[m];
+        if (r.succeeded())
+        {
+            osg::ref_ptr<const osg::Object> cloned = osg::clone(r.getObject(), osg::CopyOp::DEEP_COPY_ALL);
+            _state->_memory.insert(
+                getFullKey(misses[m]),
+                TieredCacheState::Entry(cloned.get(), r.metadata(), r.lastModifiedTime()),
+                TieredCacheState::getSize(cloned.get()));
+        }
+        output[missIndices[m]] = r;
+    }
+}
+
+ReadResult
+TieredCacheBin::readString(const std::string& key, const osgDB::Options* dbo)
+{
+    return read(key, dbo, TYPE_STRING);
+}
+
+bool
+TieredCacheBin::write(const std::string& key, const osg::Object* object, const Config& meta, const osgDB::Options* dbo)
+{
+    if (!object)
+        return false;
+
+    std::string fullKey = getFullKey(key);
+
+    osg::ref_ptr<const osg::Object> cloned = osg::clone(object, osg::CopyOp::DEEP_COPY_ALL);
+    TieredCacheState::Entry entry(cloned.get(), meta, DateTime().asTimeStamp());
+    _state->_memory.insert(fullKey, entry, TieredCacheState::getSize(cloned.get()));
+
+    if (_backend.valid())
+    {
+        // If the queue is full, write through to apply some back-pressure.
+        if (!_state->queueWrite(fullKey, _backend.get(), key, entry, dbo))
+            return _backend->write(key, object, meta, dbo);
+    }
+
+    return true;
+}
+
+bool
+TieredCacheBin::remove(const std::string& key)
+{
+    std::string fullKey = getFullKey(key);
+
+    Threading::ScopedMutexLock lock(_state->_flushMutex);
+    _state->cancelPending(fullKey, false);
+    _state->_memory.erase(fullKey);
+    return _backend.valid() ? _backend->remove(key) : true;
+}
+
+bool
+TieredCacheBin::touch(const std::string& key)
+{
+    std::string fullKey = getFullKey(key);
+    bool touched = false;
+
+    TieredCacheState::Memory::Record rec;
+    if (_state->_memory.get(fullKey, rec))
+    {
+        TieredCacheState::Entry entry = rec.value();
+        entry._time = DateTime().asTimeStamp();
+        _state->_memory.insert(fullKey, entry, TieredCacheState::getSize(entry._object.get()));
+        touched = true;
+    }
+
+    if (_backend.valid() && _backend->touch(key))
+        touched = true;
+
+    return touched;
+}
+
+CacheBin::RecordStatus
+TieredCacheBin::getRecordStatus(const std::string& key)
+{
+    std::string fullKey = getFullKey(key);
+    TieredCacheState::Entry pending;
+
+    if (_state->_memory.has(fullKey) || _state->getPending(fullKey, pending))
+        return STATUS_OK;
+
+    return _backend.valid() ? _backend->getRecordStatus(key) : STATUS_NOT_FOUND;
+}
+
+bool
+TieredCacheBin::clear()
+{
+    std::string prefix = getFullKey("");
+
+    Threading::ScopedMutexLock lock(_state->_flushMutex);
+    _state->cancelPending(prefix, true);
+
+    CollectKeys collect(prefix);
+    _state->_memory.iterate(collect);
+    for (std::vector<std::string>::const_iterator i = collect._keys.begin(); i != collect._keys.end(); ++i)
+        _state->_memory.erase(*i);
+
+    return _backend.valid() ? _backend->clear() : true;
+}
+
+bool
+TieredCacheBin::compact()
+{
+    return _backend.valid() ? _backend->compact() : false;
+}
+
+unsigned
+TieredCacheBin::getStorageSize()
+{
+    return _backend.valid() ? _backend->getStorageSize() : 0u;
+}
+
+Config
+TieredCacheBin::readMetadata()
+{
+    return _backend.valid() ? _backend->readMetadata() : Config();
+}
+
+bool
+TieredCacheBin::writeMetadata(const Config& meta)
+{
+    return _backend.valid() ? _backend->writeMetadata(meta) : false;
+}
@@ -330,13 +330,15 @@ namespace
         return 0L;
     }
 
-    bool addLayer(const Config& conf, Map* map)
+    // Creates a layer and queues it up; Map::addLayers opens the queued
+    // layers together.
+    bool addLayer(const Config& conf, LayerVector& layers)
     {
         std::string name = conf.key();
         Layer* layer = Layer::create(name, conf);
         if (layer)
         {
-            map->addLayer(layer);
+            layers.push_back(layer);
         }
         return layer != 0L;
     }
@@ -410,6 +412,7 @@ EarthFileSerializer2::deserialize( const Config& conf, const std::string& referr
     // Read all the elevation layers in FIRST so other layers can access them for things like clamping.
     // TODO: revisit this since we should really be listening for elevation data changes and
     // re-clamping based on that..
+    LayerVector layers;
     for(ConfigSet::const_iterator i = conf.children().begin(); i != conf.children().end(); ++i)
     {
         // for backwards compatibility:
@@ -417,15 +420,18 @@ EarthFileSerializer2::deserialize( const Config& conf, const std::string& referr
         {
             Config temp = *i;
             temp.key() = "elevation";
-            addLayer(temp, map.get());
+            addLayer(temp, layers);
         }
 
         else if ( i->key() == "elevation" ) // || i->key() == "heightfield" )
         {
-            addLayer(*i, map.get());
+            addLayer(*i, layers);
         }
     }
 
+    map->addLayers(layers);
+    layers.clear();
+
     Config externalConfig;
     std::vector<osg::ref_ptr<Extension> > extensions;
 
@@ -470,7 +476,7 @@ EarthFileSerializer2::deserialize( const Config& conf, const std::string& referr
         else if ( !isReservedWord(i->key()) ) // plugins/extensions.
         {
             // try to add as a plugin Layer first:
-            bool addedLayer = addLayer(*i, map.get()); 
+            bool addedLayer = addLayer(*i, layers);
 
             // failing that, try to load as an extension:
             if ( !addedLayer )
@@ -482,6 +488,8 @@ EarthFileSerializer2::deserialize( const Config& conf, const std::string& referr
         }
     }
 
+    map->addLayers(layers);
+
     // Complete the batch update of the map
     map->endUpdate();
 
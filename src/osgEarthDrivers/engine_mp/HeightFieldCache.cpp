@@ -27,13 +27,27 @@ using namespace osgEarth;
 
 #define LC "[MP.HeightFieldCache] "
 
+// Heightfields to cache per stripe. There are 9 stripes, one for each
+// position in a 3x3 block of tiles, so a tile and its 8 neighbors never
+// share a lock.
+#define HF_CACHE_STRIPE_SIZE 16u
+#define HF_CACHE_STRIPES     9u
 
 HeightFieldCache::HeightFieldCache(const MPTerrainEngineOptions& options) :
-_cache   ( true, 128 ),
 _tileSize( options.tileSize().get() )
 {
     _useParentAsReferenceHF = (options.elevationSmoothing() == true);
     _enabled = (::getenv("OSGEARTH_MEMORY_PROFILE") == 0L);
+
+    for (unsigned i = 0; i < HF_CACHE_STRIPES; ++i)
+        _stripes.push_back( new Stripe(HF_CACHE_STRIPE_SIZE) );
+}
+
+HeightFieldCache::Stripe*
+HeightFieldCache::getStripe(const TileKey& key) const
+{
+    unsigned i = (key.getTileX() % 3u) * 3u + (key.getTileY() % 3u);
+    return _stripes[i].get();
 }
 
 
@@ -59,8 +73,10 @@ HeightFieldCache::getOrCreateHeightField(const MapFrame&                 frame,
     if (progress)
         progress->stats()["hfcache_try_count"] += 1;
 
+    LRUCache<HFKey,HFValue>& cache = getStripe(key)->_cache;
+
     LRUCache<HFKey,HFValue>::Record rec;
-    if ( _enabled && _cache.get(cachekey, rec) )
+    if ( _enabled && cache.get(cachekey, rec) )
     {
         // Found it in the cache.
         out_hf         = rec.value()._hf.get();
@@ -147,7 +163,7 @@ HeightFieldCache::getOrCreateHeightField(const MapFrame&                 frame,
             HFValue cacheval;
             cacheval._hf = out_hf.get();
             cacheval._isFallback = !populated;
-            _cache.insert( cachekey, cacheval );
+            cache.insert( cachekey, cacheval );
         }
 
         out_isFallback = !populated;
@@ -43,6 +43,7 @@
 #include <osgUtil/Optimizer>
 #include <osgUtil/MeshOptimizers>
 #include <osgText/Text>
+#include <typeinfo>
 
 using namespace osgEarth::Drivers::MPTerrainEngine;
 using namespace osgEarth;
@@ -532,6 +533,117 @@ namespace
     }
 
 
+    /**
+     * Unit-to-model transform for a whole sampling grid. A plain GeoLocator maps
+     * unit x and y independently, so the per-column and per-row parts of the
+     * transform (including the trig and the ellipsoid radius of a geocentric
+     * conversion) are computed once per column and once per row instead of for
+     * every vertex. Any other locator goes through its own unitToModel.
+     */
+    struct GridTransform
+    {
+        GridTransform(const GeoLocator* locator, unsigned numCols, unsigned numRows) :
+            _locator(locator), _numCols(numCols), _numRows(numRows), _fast(false), _geocentric(false)
+        {
+            // Subclasses (e.g. the cube face locator) may not be a plain matrix transform.
+            if ( typeid(*locator) != typeid(GeoLocator) && typeid(*locator) != typeid(MercatorLocator) )
+                return;
+            if ( numCols < 2 || numRows < 2 )
+                return;
+
+            const osg::Matrixd& m = locator->getTransform();
+            _zAxis.set( m(2,0), m(2,1), m(2,2) );
+            _geocentric = locator->getCoordinateSystemType() == osgTerrain::Locator::GEOCENTRIC;
+
+            if ( _geocentric )
+            {
+                // longitude must depend only on x, latitude only on y, and z only on height.
+                const osg::EllipsoidModel* em = locator->getEllipsoidModel();
+                if ( !em || m(1,0) != 0.0 || m(0,1) != 0.0 || m(2,0) != 0.0 || m(2,1) != 0.0 )
+                    return;
+
+                double a = em->getRadiusEquator();
+                double f = (a - em->getRadiusPolar()) / a;
+                _e2 = 2.0*f - f*f;
+
+                _cosLon.resize(numCols); _sinLon.resize(numCols); _colH.resize(numCols);
+                for(unsigned i=0; i<numCols; ++i)
+                {
+                    double u   = (double)i/(double)(numCols-1);
+                    double lon = u*m(0,0) + m(3,0);
+                    _cosLon[i] = cos(lon);
+                    _sinLon[i] = sin(lon);
+                    _colH[i]   = u*m(0,2);
+                }
+
+                _cosLat.resize(numRows); _sinLat.resize(numRows); _N.resize(numRows); _rowH.resize(numRows);
+                for(unsigned j=0; j<numRows; ++j)
+                {
+                    double v   = (double)j/(double)(numRows-1);
+                    double lat = v*m(1,1) + m(3,1);
+                    _cosLat[j] = cos(lat);
+                    _sinLat[j] = sin(lat);
+                    _N[j]      = a / sqrt(1.0 - _e2*_sinLat[j]*_sinLat[j]);
+                    _rowH[j]   = v*m(1,2) + m(3,2);
+                }
+            }
+            else
+            {
+                osg::Vec3d xAxis( m(0,0), m(0,1), m(0,2) );
+                osg::Vec3d yAxis( m(1,0), m(1,1), m(1,2) );
+                osg::Vec3d origin( m(3,0), m(3,1), m(3,2) );
+
+                _colTerms.resize(numCols);
+                for(unsigned i=0; i<numCols; ++i)
+                    _colTerms[i] = origin + xAxis*((double)i/(double)(numCols-1));
+
+                _rowTerms.resize(numRows);
+                for(unsigned j=0; j<numRows; ++j)
+                    _rowTerms[j] = yAxis*((double)j/(double)(numRows-1));
+            }
+
+            _fast = true;
+        }
+
+        //! Model position of grid point (i,j) at unit height z, and the model-space
+        //! offset of one unit of z there (the local up vector, unnormalized).
+        void toModel(unsigned i, unsigned j, double z, osg::Vec3d& model, osg::Vec3d& up) const
+        {
+            if ( !_fast )
+            {
+                osg::Vec3d ndc( (double)i/(double)(_numCols-1), (double)j/(double)(_numRows-1), z );
+                _locator->unitToModel( ndc, model );
+                ndc.z() += 1.0;
+                _locator->unitToModel( ndc, up );
+                up -= model;
+            }
+            else if ( _geocentric )
+            {
+                double h  = z*_zAxis.z() + _colH[i] + _rowH[j];
+                double cx = _cosLat[j]*_cosLon[i];
+                double cy = _cosLat[j]*_sinLon[i];
+                model.set( (_N[j]+h)*cx, (_N[j]+h)*cy, (_N[j]*(1.0-_e2)+h)*_sinLat[j] );
+                up.set( cx*_zAxis.z(), cy*_zAxis.z(), _sinLat[j]*_zAxis.z() );
+            }
+            else
+            {
+                model = _colTerms[i] + _rowTerms[j] + _zAxis*z;
+                up = _zAxis;
+            }
+        }
+
+        const GeoLocator*       _locator;
+        unsigned                _numCols, _numRows;
+        bool                    _fast;
+        bool                    _geocentric;
+        osg::Vec3d              _zAxis;
+        double                  _e2;
+        std::vector<osg::Vec3d> _colTerms, _rowTerms;
+        std::vector<double>     _cosLon, _sinLon, _colH;
+        std::vector<double>     _cosLat, _sinLat, _N, _rowH;
+    };
+
+
     /**
      * Iterate over the sampling grid and calculate the vertex positions and normals
      * for each sampling point.
@@ -570,6 +682,41 @@ namespace
         }
 
 
+        GridTransform grid( d.model->_tileLocator.get(), d.numCols, d.numRows );
+
+        // When the heightfield has a post for every grid point, read it directly
+        // instead of interpolating at each point.
+        bool hfOnGrid =
+            hf && hfLocator &&
+            hf->getNumColumns() == d.numCols &&
+            hf->getNumRows()    == d.numRows &&
+            hfLocator->isEquivalentTo( *d.model->_tileLocator.get() );
+
+        // Union of the mask bounding boxes; grid points inside it are left for
+        // the mask geometry.
+        bool       hasMaskBox = d.maskRecords.size() > 0;
+        osg::Vec2d maskMin, maskMax;
+        if ( hasMaskBox )
+        {
+            maskMin.set( d.maskRecords[0]._ndcMin.x(), d.maskRecords[0]._ndcMin.y() );
+            maskMax.set( d.maskRecords[0]._ndcMax.x(), d.maskRecords[0]._ndcMax.y() );
+            for (unsigned mrs = 1; mrs < d.maskRecords.size(); ++mrs)
+            {
+                maskMin.x() = osg::minimum( maskMin.x(), d.maskRecords[mrs]._ndcMin.x() );
+                maskMin.y() = osg::minimum( maskMin.y(), d.maskRecords[mrs]._ndcMin.y() );
+                maskMax.x() = osg::maximum( maskMax.x(), d.maskRecords[mrs]._ndcMax.x() );
+                maskMax.y() = osg::maximum( maskMax.y(), d.maskRecords[mrs]._ndcMax.y() );
+            }
+        }
+
+        // Which layers' texture spaces match the tile's, so they can use the raw ndc.
+        std::vector<bool> sameTexSpace( d.renderLayers.size(), true );
+        for( unsigned r = 0; r < d.renderLayers.size(); ++r )
+        {
+            if ( d.renderLayers[r]._ownsTexCoords )
+                sameTexSpace[r] = d.renderLayers[r]._locator->isEquivalentTo( *d.geoLocator.get() );
+        }
+
         // populate vertex and tex coord arrays    
         for(unsigned j=0; j < d.numRows; ++j)
         {
@@ -582,7 +729,11 @@ namespace
                 float heightValue = 0.0f;
                 bool  validValue  = true;
 
-                if ( hf )
+                if ( hfOnGrid )
+                {
+                    heightValue = hf->getHeight( i, j );
+                }
+                else if ( hf )
                 {
                     validValue = d.model->_elevationData.getHeight( ndc, d.model->_tileLocator.get(), heightValue, INTERP_TRIANGULATE );
                 }
@@ -596,48 +747,22 @@ namespace
 
                 // First check whether the sampling point falls within a mask's bounding box.
                 // If so, skip the sampling and mark it as a mask location
-                if ( validValue && d.maskRecords.size() > 0 )
+                if ( validValue && hasMaskBox )
                 {
-					double minndcx = d.maskRecords[0]._ndcMin.x();
-					double minndcy = d.maskRecords[0]._ndcMin.y();
-					double maxndcx = d.maskRecords[0]._ndcMax.x();
-					double maxndcy = d.maskRecords[0]._ndcMax.y();
-					for (int mrs = 1; mrs < d.maskRecords.size(); ++mrs)
-					{
-						if ( d.maskRecords[mrs]._ndcMin.x()< minndcx)
-						{
-							minndcx = d.maskRecords[mrs]._ndcMin.x();
-						}
-						if ( d.maskRecords[mrs]._ndcMin.y()< minndcy)
-						{
-							minndcy = d.maskRecords[mrs]._ndcMin.y();
-						}
-						if ( d.maskRecords[mrs]._ndcMax.x()> maxndcx)
-						{
-							maxndcx = d.maskRecords[mrs]._ndcMax.x();
-						}
-						if ( d.maskRecords[mrs]._ndcMax.y()> maxndcy)
-						{
-							maxndcy = d.maskRecords[mrs]._ndcMax.y();
-						}
-
-
-					}
-					if(ndc.x() >= (minndcx) && ndc.x() <= (maxndcx) &&
-						        ndc.y() >= (minndcy) && ndc.y() <= (maxndcy))
-				    {
-				        validValue = false;
-				        d.indices[iv] = -2;
-				    
-				    }
+                    if ( ndc.x() >= maskMin.x() && ndc.x() <= maskMax.x() &&
+                         ndc.y() >= maskMin.y() && ndc.y() <= maskMax.y() )
+                    {
+                        validValue = false;
+                        d.indices[iv] = -2;
+                    }
                 }
                 
                 if ( validValue )
                 {
                     d.indices[iv] = d.surfaceVerts->size();
 
-                    osg::Vec3d model;
-                    d.model->_tileLocator->unitToModel( ndc, model );
+                    osg::Vec3d model, model_up;
+                    grid.toModel( i, j, ndc.z(), model, model_up );
                     osg::Vec3d modelLTP = model * d.world2local;
                     (*d.surfaceVerts).push_back(modelLTP);
 
@@ -645,11 +770,12 @@ namespace
                     d.surfaceBound.expandBy( (*d.surfaceVerts).back() );
 
                     // the separate texture space requires separate transformed texcoords for each layer.
-                    for( RenderLayerVector::const_iterator r = d.renderLayers.begin(); r != d.renderLayers.end(); ++r )
+                    for( unsigned k = 0; k < d.renderLayers.size(); ++k )
                     {
+                        const RenderLayer* r = &d.renderLayers[k];
                         if ( r->_ownsTexCoords )
                         {
-                            if ( !r->_locator->isEquivalentTo( *d.geoLocator.get() ) )
+                            if ( !sameTexSpace[k] )
                             {
                                 osg::Vec3d color_ndc;
                                 osgTerrain::Locator::convertLocalCoordBetween( *d.geoLocator.get(), ndc, *r->_locator.get(), color_ndc );
@@ -671,10 +797,7 @@ namespace
                     (*d.elevations).push_back(ndc.z());
 
                     // compute the local normal (up vector)
-                    osg::Vec3d ndc_plus_one(ndc.x(), ndc.y(), ndc.z() + 1.0);
-                    osg::Vec3d model_up;
-                    d.model->_tileLocator->unitToModel(ndc_plus_one, model_up);
-                    model_up = (model_up*d.world2local) - modelLTP;
+                    model_up = osg::Matrixd::transform3x3( model_up, d.world2local );
                     model_up.normalize();
                     (*d.normals).push_back(model_up);
 
@@ -1479,6 +1602,17 @@ namespace
             }
         }
 
+        // mask bounding boxes in grid units
+        std::vector<osg::Vec4f> maskCells;
+        for (MaskRecordVector::iterator mr = d.maskRecords.begin(); mr != d.maskRecords.end(); ++mr)
+        {
+            maskCells.push_back( osg::Vec4f(
+                (*mr)._ndcMin.x() * (double)(d.numCols-1),
+                (*mr)._ndcMin.y() * (double)(d.numRows-1),
+                (*mr)._ndcMax.x() * (double)(d.numCols-1),
+                (*mr)._ndcMax.y() * (double)(d.numRows-1) ) );
+        }
+
         for(unsigned j=0; j<d.numRows-1; ++j)
         {
             for(unsigned i=0; i<d.numCols-1; ++i)
@@ -1514,15 +1648,12 @@ namespace
                 if (numValid==4)
                 {
                     bool VALID = true;
-                    for (MaskRecordVector::iterator mr = d.maskRecords.begin(); mr != d.maskRecords.end(); ++mr)
+                    for (unsigned m = 0; m < maskCells.size(); ++m)
                     {
-                        float min_i = (*mr)._ndcMin.x() * (double)(d.numCols-1);
-                        float min_j = (*mr)._ndcMin.y() * (double)(d.numRows-1);
-                        float max_i = (*mr)._ndcMax.x() * (double)(d.numCols-1);
-                        float max_j = (*mr)._ndcMax.y() * (double)(d.numRows-1);
+                        const osg::Vec4f& cell = maskCells[m];
 
                         // We test if mask is completely in square
-                        if(i+1 >= min_i && i <= max_i && j+1 >= min_j && j <= max_j)
+                        if(i+1 >= cell[0] && i <= cell[2] && j+1 >= cell[1] && j <= cell[3])
                         {
                             VALID = false;
                             break;
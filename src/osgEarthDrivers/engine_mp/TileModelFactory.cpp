@@ -310,9 +310,21 @@ TileModelFactory::buildElevation(const TileKey&    key,
                                 }
                             }
 
+                            // A live neighbor built against the same map revision already
+                            // holds the heightfield we want; share it rather than going
+                            // through the cache (or rebuilding it after an eviction).
+                            osg::ref_ptr<TileNode> neighborNode;
+                            if (_liveTiles->get(neighborKey, neighborNode) &&
+                                neighborNode->getTileModel() &&
+                                neighborNode->getTileModel()->getMapRevision() == frame.getRevision() &&
+                                neighborNode->getTileModel()->_elevationData.getHeightField() )
+                            {
+                                model->_elevationData.setNeighbor( x, y, neighborNode->getTileModel()->_elevationData.getHeightField() );
+                            }
+
                             // only pull the tile if we have a valid parent HF for it -- otherwise
                             // you might get a flat tile when upsampling data.
-                            if ( neighborParentHF.valid() )
+                            else if ( neighborParentHF.valid() )
                             {
                                 osg::ref_ptr<osg::HeightField> hf;
                                 if (_meshHFCache->getOrCreateHeightField(frame, neighborKey, neighborParentHF.get(), hf, isFallback, SAMPLE_FIRST_VALID, interp, progress) )
@@ -44,7 +44,10 @@ PerContextDrawState::refresh(osg::RenderInfo& ri, const RenderBindings* bindings
         // Reset all sampler matrix states since their uniform locations are going to change.
         _layerOrder.clear();
         _elevTexelCoeff.clear();
+        _elevDecode.clear();
+        _tileExtent.clear();
         _morphConstants.clear();
+        _elevRange.clear();
         _parentTextureExists.clear();
         _samplerState.clear();
 
@@ -54,11 +57,14 @@ PerContextDrawState::refresh(osg::RenderInfo& ri, const RenderBindings* bindings
         {
             const SamplerBinding& binding = (*bindings)[i];
             _samplerState._samplers[i]._matrixUL = pcp->getUniformLocation(osg::Uniform::getNameID(binding.matrixName()));
+            _samplerState._samplers[i]._sliceUL = pcp->getUniformLocation(osg::Uniform::getNameID(binding.samplerName() + "Slice"));
         }
 
         // resolve all the other uniform locations:
         _tileKeyUL = pcp->getUniformLocation(osg::Uniform::getNameID("oe_tile_key"));
         _elevTexelCoeffUL = pcp->getUniformLocation(osg::Uniform::getNameID("oe_tile_elevTexelCoeff"));
+        _elevDecodeUL = pcp->getUniformLocation(osg::Uniform::getNameID("oe_tile_elevDecode"));
+        _tileExtentUL = pcp->getUniformLocation(osg::Uniform::getNameID("oe_tile_extent"));
         _parentTextureExistsUL = pcp->getUniformLocation(osg::Uniform::getNameID("oe_layer_texParentExists"));
         _layerUidUL = pcp->getUniformLocation(osg::Uniform::getNameID("oe_layer_uid"));
         _layerOpacityUL = pcp->getUniformLocation(osg::Uniform::getNameID("oe_layer_opacity"));
@@ -66,6 +72,7 @@ PerContextDrawState::refresh(osg::RenderInfo& ri, const RenderBindings* bindings
         _layerMinRangeUL = pcp->getUniformLocation(osg::Uniform::getNameID("oe_layer_minRange"));
         _layerMaxRangeUL = pcp->getUniformLocation(osg::Uniform::getNameID("oe_layer_maxRange"));
         _morphConstantsUL = pcp->getUniformLocation(osg::Uniform::getNameID("oe_tile_morph"));
+        _elevRangeUL = pcp->getUniformLocation(osg::Uniform::getNameID("oe_tile_elevRange"));
     }
 
     _pcp = pcp;
@@ -76,4 +83,19 @@ PerContextDrawState::clear()
 {
     _samplerState.clear();
     _pcp = 0L;
+    _boundGeometry = 0L;
+}
+
+void
+DrawState::reset()
+{
+    _frame = 0u;
+    _bindings = 0L;
+    _batchGeometry = false;
+    _bs.init();
+    _box.init();
+
+    // forgetting the program makes the next refresh() resolve everything again
+    for (unsigned i = 0; i < _pcds.size(); ++i)
+        _pcds[i].clear();
 }
@@ -17,6 +17,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include "DrawTileCommand"
+#include <osgEarth/SequenceTexture>
 
 using namespace osgEarth::Drivers::RexTerrainEngine;
 
@@ -51,6 +52,27 @@ DrawTileCommand::draw(osg::RenderInfo& ri, DrawState& dsMaster, osg::Referenced*
         ds._elevTexelCoeff = _elevTexelCoeff;
     }
 
+    // Elevation decoding scale/bias for this tile's elevation texture
+    if (ds._elevDecodeUL >= 0 && !ds._elevDecode.isSetTo(_elevDecode))
+    {
+        ds._ext->glUniform2fv(ds._elevDecodeUL, 1, _elevDecode.ptr());
+        ds._elevDecode = _elevDecode;
+    }
+
+    // Tile size, for deriving normals from the elevation texture
+    if (ds._tileExtentUL >= 0 && !ds._tileExtent.isSetTo(_tileExtent))
+    {
+        ds._ext->glUniform2fv(ds._tileExtentUL, 1, _tileExtent.ptr());
+        ds._tileExtent = _tileExtent;
+    }
+
+    // Height range of this tile
+    if (ds._elevRangeUL >= 0 && !ds._elevRange.isSetTo(_elevRange))
+    {
+        ds._ext->glUniform2fv(ds._elevRangeUL, 1, _elevRange.ptr());
+        ds._elevRange = _elevRange;
+    }
+
     // Morphing constants for this LOD
     if (ds._morphConstantsUL >= 0 && !ds._morphConstants.isSetTo(_morphConstants))
     {
@@ -90,6 +112,18 @@ DrawTileCommand::draw(osg::RenderInfo& ri, DrawState& dsMaster, osg::Referenced*
                 samplerState._matrix = sampler._matrix;
             }
 
+            // Sequence layers sample a texture array; select the current time step.
+            if (samplerState._sliceUL >= 0)
+            {
+                const SequenceTexture* seq = dynamic_cast<const SequenceTexture*>(sampler._texture.get());
+                int slice = seq ? seq->getSlice() : 0;
+                if (!samplerState._slice.isSetTo(slice))
+                {
+                    ds._ext->glUniform1i(samplerState._sliceUL, slice);
+                    samplerState._slice = slice;
+                }
+            }
+
             // Need a special uniform for color parents.
             if (s == SamplerBinding::COLOR_PARENT)
             {
@@ -126,6 +160,13 @@ DrawTileCommand::draw(osg::RenderInfo& ri, DrawState& dsMaster, osg::Referenced*
 
     if (_drawCallback)
     {
+        // The callback may issue its own GL calls, so release any batched geometry.
+        if (ds._boundGeometry)
+        {
+            ds._boundGeometry->unbindArrays(state);
+            ds._boundGeometry = 0L;
+        }
+
         PatchLayer::DrawContext dc;
 
         //TODO: might not need any of this. review. -gw
@@ -149,6 +190,31 @@ DrawTileCommand::draw(osg::RenderInfo& ri, DrawState& dsMaster, osg::Referenced*
     if (_geom.valid())
     {
         _geom->_ptype[ri.getContextID()] = _drawPatch ? GL_PATCHES : _geom->getDrawElements()->getMode(); //GL_TRIANGLES;
-        _geom->draw(ri);
+
+        // A VAO already captures the array bindings, so only batch without one.
+#ifdef SUPPORTS_VAO
+        bool batch = dsMaster._batchGeometry && !state.useVertexArrayObject(_geom->getUseVertexArrayObject());
+#else
+        bool batch = dsMaster._batchGeometry;
+#endif
+
+        if (batch)
+        {
+            // Tiles are sorted by geometry, so runs of tiles sharing one
+            // only need to set up the vertex arrays once.
+            if (ds._boundGeometry != _geom.get())
+            {
+                if (ds._boundGeometry)
+                    ds._boundGeometry->unbindArrays(state);
+
+                _geom->bindArrays(state);
+                ds._boundGeometry = _geom.get();
+            }
+            _geom->drawPrimitives(state);
+        }
+        else
+        {
+            _geom->draw(ri);
+        }
     }    
 }
@@ -1,6 +1,7 @@
 #include "ElevationTextureUtils"
 
 #include <osgEarth/ImageUtils>
+#include <osgEarth/ImageToHeightFieldConverter>
 #include <osgEarth/TileKey>
 
 #include <osg/Texture>
@@ -28,6 +29,8 @@ ElevationImageReader::ElevationImageReader(const osg::Image* image, const osg::M
 void
 ElevationImageReader::init(const osg::Image* image, const osg::Matrix& matrixScaleBias)
 {
+    _decode = ImageToHeightFieldConverter::getScaleBias(image);
+
     double s_offset = matrixScaleBias(3,0) * (double)image->s();
     double t_offset = matrixScaleBias(3,1) * (double)image->t();
     double s_span   = matrixScaleBias(0,0) * (double)image->s();
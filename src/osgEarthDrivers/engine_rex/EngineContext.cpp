@@ -29,6 +29,9 @@ using namespace osgEarth;
 
 //#define PROFILE 1
 
+// Number of live tiles to check for expiration during each cull
+#define EXPIRATION_SCAN_TILES_PER_CULL 256u
+
 //..............................................................
 
 
@@ -48,6 +51,7 @@ _terrainEngine ( terrainEngine ),
 _geometryPool  ( geometryPool ),
 _loader        ( loader ),
 _unloader      ( unloader ),
+_prefetcher    ( 0L ),
 _tileRasterizer( tileRasterizer ),
 _liveTiles     ( liveTiles ),
 _renderBindings( renderBindings ),
@@ -88,61 +92,18 @@ EngineContext::getElapsedCullTime() const
 
 namespace
 {
-    struct Scanner : public TileNodeRegistry::ConstOperation
+    // Collects the keys of tiles whose subtiles have all gone dormant.
+    struct DormantScanner : public TileNodeRegistry::ConstTileOperation
     {
-        enum Policy {
-            POLICY_FIND_ALL,
-            POLICY_FIND_SOME,
-            POLICY_FIND_ONE
-        };
-
         std::vector<TileKey>& _keys;
         const osg::FrameStamp* _stamp;
-        Policy _policy;
 
-        Scanner(std::vector<TileKey>& keys, const osg::FrameStamp* stamp) : _keys(keys), _stamp(stamp)
-        {
-            _policy = POLICY_FIND_ALL;
-        }
+        DormantScanner(std::vector<TileKey>& keys, const osg::FrameStamp* stamp) : _keys(keys), _stamp(stamp) { }
 
-        void operator()(const TileNodeRegistry::TileNodeMap& tiles) const
+        void operator()(const TileNode* tile) const
         {
-            if ( tiles.empty() ) return;
-            unsigned f = _stamp->getFrameNumber(), s = tiles.size();
-
-            switch (_policy)
-            {
-                case POLICY_FIND_ALL:
-                {
-                    for (TileNodeRegistry::TileNodeMap::const_iterator i = tiles.begin(); i != tiles.end(); ++i)
-                    {
-                        const TileNode* tile = i->second.tile.get();
-                        if (tile->areSubTilesDormant(_stamp))
-                            _keys.push_back(i->first);
-                    }
-                }
-                break;
-
-                case POLICY_FIND_ONE:
-                {
-                    const TileNode* tile = tiles.at(f%s);
-                    if (tile->areSubTilesDormant(_stamp))
-                    {
-                        _keys.push_back(tile->getKey());
-                    }
-                }
-                break;
-
-                default:
-                case POLICY_FIND_SOME:
-                {
-                    for(unsigned i=0; i<4; ++i) {
-                        const TileNode* tile = tiles.at((f+i)%s);
-                        if ( tile->areSubTilesDormant(_stamp) )
-                            _keys.push_back( tile->getKey() );
-                    }
-                }
-            }
+            if (tile->areSubTilesDormant(_stamp))
+                _keys.push_back(tile->getKey());
         }
     };
 }
@@ -176,10 +137,12 @@ EngineContext::endCull(osgUtil::CullVisitor* cv)
     OE_NOTICE << c.toJSON(true) << std::endl << std::endl;
 #endif
 
-    // Scan for tiles that need to be unloaded.
+    // Scan for tiles that need to be unloaded. Each cull checks a fixed number
+    // of tiles and the registry cycles through the rest on subsequent frames,
+    // so the cost doesn't grow with the size of the terrain.
     std::vector<TileKey> tilesWithChildrenToUnload;
-    Scanner scanner(tilesWithChildrenToUnload, cv->getFrameStamp());
-    _liveTiles->run( scanner );
+    DormantScanner scanner(tilesWithChildrenToUnload, cv->getFrameStamp());
+    _liveTiles->runIncremental( scanner, EXPIRATION_SCAN_TILES_PER_CULL );
 
     if ( !tilesWithChildrenToUnload.empty() )
     {        
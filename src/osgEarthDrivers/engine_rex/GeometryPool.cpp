@@ -19,6 +19,7 @@
 #include "GeometryPool"
 #include <osgEarth/Locators>
 #include <osgEarth/NodeUtils>
+#include <osgEarth/Metrics>
 #include <osgEarthUtil/TopologyGraph>
 #include <osg/Point>
 #include <cstdlib> // for getenv
@@ -49,8 +50,15 @@ using namespace osgEarth::Drivers::RexTerrainEngine;
 GeometryPool::GeometryPool(const RexTerrainEngineOptions& options) :
 _options ( options ),
 _enabled ( true ),
-_debug   ( false )
+_debug   ( false ),
+_maxBytes( 0u ),
+_bytes   ( 0u ),
+_frame   ( 0u ),
+_hits    ( 0u ),
+_misses  ( 0u )
 {
+    _maxBytes = _options.geometryPoolMaxSize().get() * 1024u * 1024u;
+
     // sign up for the update traversal so we can prune unused pool objects.
     setNumChildrenRequiringUpdateTraversal(1u);
 
@@ -97,7 +105,9 @@ GeometryPool::getPooledGeometry(const TileKey&                tileKey,
         if ( !masking && i != _geometryMap.end() )
         {
             // Found. return it.
-            out = i->second.get();
+            out = i->second._geom.get();
+            i->second._lastUsed = _frame;
+            ++_hits;
         }
         else
         {
@@ -106,7 +116,12 @@ GeometryPool::getPooledGeometry(const TileKey&                tileKey,
 
             if (!masking && out.valid())
             {
-                _geometryMap[ geomKey ] = out.get();
+                PoolEntry& entry = _geometryMap[ geomKey ];
+                entry._geom = out.get();
+                entry._bytes = out->getTotalDataSize();
+                entry._lastUsed = _frame;
+                _bytes += entry._bytes;
+                ++_misses;
             }
 
             if ( _debug )
@@ -139,6 +154,83 @@ GeometryPool::getNumSkirtElements(unsigned tileSize) const
     return _options.heightFieldSkirtRatio().get() > 0.0 ? (tileSize-1) * 4 * 6 : 0;
 }
 
+osg::DrawElements*
+GeometryPool::getSharedElements(unsigned tileSize,
+                                bool     swapOrientation,
+                                bool     createSkirt,
+                                GLenum   mode) const
+{
+    unsigned key = (tileSize << 2) | (swapOrientation ? 2u : 0u) | (createSkirt ? 1u : 0u);
+
+    Threading::ScopedMutexLock lock( _sharedElementsMutex );
+
+    SharedElementsMap::iterator i = _sharedElements.find( key );
+    if ( i != _sharedElements.end() )
+        return i->second.get();
+
+    osg::DrawElements* primSet = new osg::DrawElementsUShort(mode);
+    primSet->setElementBufferObject(new osg::ElementBufferObject());
+    primSet->reserveElements((tileSize-1) * (tileSize-1) * 6 + getNumSkirtElements(tileSize));
+
+    // Same triangulation as the unmasked path in createGeometry.
+    for(unsigned j=0; j<tileSize-1; ++j)
+    {
+        for(unsigned i=0; i<tileSize-1; ++i)
+        {
+            int i00;
+            int i01;
+            if (swapOrientation)
+            {
+                i01 = j*tileSize + i;
+                i00 = i01+tileSize;
+            }
+            else
+            {
+                i00 = j*tileSize + i;
+                i01 = i00+tileSize;
+            }
+
+            int i10 = i00+1;
+            int i11 = i01+1;
+
+            primSet->addElement(i01);
+            primSet->addElement(i00);
+            primSet->addElement(i11);
+
+            primSet->addElement(i00);
+            primSet->addElement(i10);
+            primSet->addElement(i11);
+        }
+    }
+
+    if ( createSkirt )
+    {
+        // Skirt verts come in pairs after the surface verts: top and right
+        // edges contribute (tileSize-1) each, bottom and left tileSize each.
+        int skirtIndex = tileSize*tileSize;
+        int numSkirtVerts = 2 * ((tileSize-1)*2 + tileSize*2);
+        int i;
+        for(i=skirtIndex; i<skirtIndex+numSkirtVerts-2; i+=2)
+        {
+            primSet->addElement(i);
+            primSet->addElement(i+1);
+            primSet->addElement(i+2);
+            primSet->addElement(i+2);
+            primSet->addElement(i+1);
+            primSet->addElement(i+3);
+        }
+        primSet->addElement(i);
+        primSet->addElement(i+1);
+        primSet->addElement(skirtIndex);
+        primSet->addElement(skirtIndex);
+        primSet->addElement(i+1);
+        primSet->addElement(skirtIndex+1);
+    }
+
+    _sharedElements[key] = primSet;
+    return primSet;
+}
+
 namespace
 {
     int getMorphNeighborIndexOffset(unsigned col, unsigned row, int rowSize)
@@ -420,7 +512,19 @@ GeometryPool::createGeometry(const TileKey& tileKey,
         // TODO: do we really need this??
         bool swapOrientation = !locator->orientationOpenGL();
 
-        for(unsigned j=0; j<tileSize-1; ++j)
+        // Without a mask, every tile of this size has exactly the same
+        // triangles, so they can all share one element buffer.
+        osg::DrawElements* sharedElements = (maskSet == 0L && _enabled) ?
+            getSharedElements(tileSize, swapOrientation, createSkirt, mode) :
+            0L;
+
+        if (sharedElements)
+        {
+            geom->setDrawElements(sharedElements);
+            geom->setDrawElementsShared(true);
+        }
+
+        else for(unsigned j=0; j<tileSize-1; ++j)
         {
             for(unsigned i=0; i<tileSize-1; ++i)
             {
@@ -490,11 +594,14 @@ GeometryPool::createGeometry(const TileKey& tileKey,
                 addSkirtDataForIndex( r*tileSize, height ); //left
     
             // then create the elements indices:
-            int i;
-            for(i=skirtIndex; i<(int)verts->size()-2; i+=2)
-                addSkirtTriangles( i, i+2 );
+            if (!sharedElements)
+            {
+                int i;
+                for(i=skirtIndex; i<(int)verts->size()-2; i+=2)
+                    addSkirtTriangles( i, i+2 );
 
-            addSkirtTriangles( i, skirtIndex );
+                addSkirtTriangles( i, skirtIndex );
+            }
         }
     }
 
@@ -525,27 +632,49 @@ GeometryPool::traverse(osg::NodeVisitor& nv)
         {
             Threading::ScopedMutexLock exclusive( _geometryMapMutex );
 
-            std::vector<GeometryKey> keys;
+            ++_frame;
+
+            // Unused geometries, oldest first:
+            typedef std::multimap<unsigned, GeometryKey> UnusedByAge;
+            UnusedByAge unused;
 
             for (GeometryMap::iterator i = _geometryMap.begin(); i != _geometryMap.end(); ++i)
             {
-                if (i->second.get()->referenceCount() == 1)
+                if (i->second._geom->referenceCount() == 1)
                 {
-                    keys.push_back(i->first);
-                    objects.push_back(i->second.get());
-                    
-                    //OE_INFO << "Releasing: " << i->second.get() << std::endl;
+                    unused.insert(std::make_pair(i->second._lastUsed, i->first));
                 }
             }
-            for (std::vector<GeometryKey>::iterator key = keys.begin(); key != keys.end(); ++key)
+
+            // Release least-recently-used geometries until we are under budget.
+            // With no budget, release them all.
+            for (UnusedByAge::iterator u = unused.begin(); u != unused.end(); ++u)
             {
-                if (_geometryMap[*key]->referenceCount() != 2) // one for the map, and one for the local objects list
+                if (_maxBytes > 0u && _bytes <= _maxBytes)
+                    break;
+
+                GeometryMap::iterator i = _geometryMap.find(u->second);
+                objects.push_back(i->second._geom.get());
+
+                if (i->second._geom->referenceCount() != 2) // one for the map, and one for the local objects list
                     OE_WARN << LC << "Erasing key geom with refcount <> 2" << std::endl;
 
-                _geometryMap.erase(*key);
+                _bytes -= osg::minimum(_bytes, i->second._bytes);
+                _geometryMap.erase(i);
             }
 
-            //OE_WARN << "Released " << keys.size() << ", pool = " << _geometryMap.size() << std::endl;
+            if (Metrics::enabled())
+            {
+                Stats stats;
+                getStatsInternal(stats);
+                Metrics::counter("rex.geometry_pool",
+                    "geometries", stats._numGeometries,
+                    "unused", stats._numUnused,
+                    "MB", (double)(stats._bytes + stats._sharedElementBytes) / 1048576.0);
+                Metrics::counter("rex.geometry_pool.lookups",
+                    "hits", stats._hits,
+                    "misses", stats._misses);
+            }
         }
 
         if (!objects.empty())
@@ -557,6 +686,35 @@ GeometryPool::traverse(osg::NodeVisitor& nv)
     osg::Group::traverse(nv);
 }
 
+void
+GeometryPool::getStats(Stats& out) const
+{
+    Threading::ScopedMutexLock exclusive( _geometryMapMutex );
+    getStatsInternal(out);
+}
+
+void
+GeometryPool::getStatsInternal(Stats& out) const
+{
+    out._numGeometries = _geometryMap.size();
+    out._numUnused = 0u;
+    for (GeometryMap::const_iterator i = _geometryMap.begin(); i != _geometryMap.end(); ++i)
+    {
+        if (i->second._geom->referenceCount() == 1)
+            ++out._numUnused;
+    }
+    out._bytes = _bytes;
+    out._hits = _hits;
+    out._misses = _misses;
+
+    out._sharedElementBytes = 0u;
+    Threading::ScopedMutexLock lock( _sharedElementsMutex );
+    for (SharedElementsMap::const_iterator i = _sharedElements.begin(); i != _sharedElements.end(); ++i)
+    {
+        out._sharedElementBytes += i->second->getTotalDataSize();
+    }
+}
+
 
 void
 GeometryPool::clear()
@@ -574,11 +732,12 @@ GeometryPool::clear()
         {
             //if (i->second.get()->referenceCount() == 1)
             {
-                objects.push_back(i->second.get());
+                objects.push_back(i->second._geom.get());
             }
         }
 
         _geometryMap.clear();
+        _bytes = 0u;
 
         if (!objects.empty())
         {
@@ -596,7 +755,8 @@ GeometryPool::clear()
 //.........................................................................
 // Code mostly adapted from osgTerrain SharedGeometry.
 
-SharedGeometry::SharedGeometry()
+SharedGeometry::SharedGeometry() :
+_drawElementsShared(false)
 {
     setSupportsDisplayList(false);
     _supportsVertexBufferObjects = true;
@@ -611,7 +771,8 @@ SharedGeometry::SharedGeometry(const SharedGeometry& rhs,const osg::CopyOp& copy
     _texcoordArray(rhs._texcoordArray),
     _neighborArray(rhs._neighborArray),
     _drawElements(rhs._drawElements),
-    _maskElements(rhs._maskElements)
+    _maskElements(rhs._maskElements),
+    _drawElementsShared(rhs._drawElementsShared)
 {
     //nop
 }
@@ -621,6 +782,24 @@ SharedGeometry::~SharedGeometry()
     //nop
 }
 
+unsigned
+SharedGeometry::getTotalDataSize() const
+{
+    unsigned size = 0u;
+    if (_vertexArray.valid())   size += _vertexArray->getTotalDataSize();
+    if (_normalArray.valid())   size += _normalArray->getTotalDataSize();
+    if (_colorArray.valid())    size += _colorArray->getTotalDataSize();
+    if (_texcoordArray.valid()) size += _texcoordArray->getTotalDataSize();
+    if (_neighborArray.valid()) size += _neighborArray->getTotalDataSize();
+    if (_maskElements.valid())  size += _maskElements->getTotalDataSize();
+
+    // shared elements are accounted for by the pool
+    if (_drawElements.valid() && !_drawElementsShared)
+        size += _drawElements->getTotalDataSize();
+
+    return size;
+}
+
 bool 
 SharedGeometry::empty() const
 {
@@ -681,15 +860,25 @@ void SharedGeometry::releaseGLObjects(osg::State* state) const
     osg::BufferObject* vbo = _vertexArray->getVertexBufferObject();
     if (vbo) vbo->releaseGLObjects(state);
 
-    osg::BufferObject* ebo = _drawElements->getElementBufferObject();
-    if (ebo) ebo->releaseGLObjects(state);
+    // other geometries are still drawing with a shared EBO.
+    if (!_drawElementsShared)
+    {
+        osg::BufferObject* ebo = _drawElements->getElementBufferObject();
+        if (ebo) ebo->releaseGLObjects(state);
+    }
 }
 
 // called from DrawTileCommand
 void SharedGeometry::drawImplementation(osg::RenderInfo& renderInfo) const
 {
     osg::State& state = *renderInfo.getState();
-    
+    bindArrays(state);
+    drawPrimitives(state);
+    unbindArrays(state);
+}
+
+void SharedGeometry::bindArrays(osg::State& state) const
+{
 #if OSG_VERSION_LESS_THAN(3,5,6)
     osg::ArrayDispatchers& dispatchers = state.getArrayDispatchers();
 #else
@@ -745,21 +934,19 @@ void SharedGeometry::drawImplementation(osg::RenderInfo& renderInfo) const
 
         state.applyDisablingOfVertexAttributes();
     }
+}
 
-
-#ifdef SUPPORTS_VAO
-    bool request_bind_unbind = !state.useVertexArrayObject(_useVertexArrayObject) || state.getCurrentVertexArrayState()->getRequiresSetArrays();
-#else
-    bool request_bind_unbind = true;
-#endif
-
+void SharedGeometry::drawPrimitives(osg::State& state) const
+{
     GLenum primitiveType = _ptype[state.getContextID()];
 
     osg::GLBufferObject* ebo = _drawElements->getOrCreateGLBufferObject(state.getContextID());
 
     if (ebo)
     {
-        /*if (request_bind_unbind)*/ state.bindElementBufferObject(ebo);
+        // State tracks the bound EBO, so this is free when consecutive
+        // tiles share an element buffer.
+        state.bindElementBufferObject(ebo);
 
         if (_drawElements->getNumIndices() > 0u)
         {
@@ -770,8 +957,6 @@ void SharedGeometry::drawImplementation(osg::RenderInfo& renderInfo) const
         {
             glDrawElements(primitiveType, _maskElements->getNumIndices(), _maskElements->getDataType(), (const GLvoid *)(ebo->getOffset(_maskElements->getBufferIndex())));
         }
-
-        /*if (request_bind_unbind)*/ state.unbindElementBufferObject();
     }
     else
     {
@@ -785,6 +970,17 @@ void SharedGeometry::drawImplementation(osg::RenderInfo& renderInfo) const
             glDrawElements(primitiveType, _maskElements->getNumIndices(), _maskElements->getDataType(), _maskElements->getDataPointer());
         }
     }
+}
+
+void SharedGeometry::unbindArrays(osg::State& state) const
+{
+    state.unbindElementBufferObject();
+
+#ifdef SUPPORTS_VAO
+    bool request_bind_unbind = !state.useVertexArrayObject(_useVertexArrayObject) || state.getCurrentVertexArrayState()->getRequiresSetArrays();
+#else
+    bool request_bind_unbind = true;
+#endif
 
     // unbind the VBO's if any are used.
     if (request_bind_unbind)
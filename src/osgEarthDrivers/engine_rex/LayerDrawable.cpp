@@ -36,11 +36,32 @@ _draw(true)
     setUseVertexBufferObjects(true);
 }
 
+void
+LayerDrawable::reset()
+{
+    _tiles.clear();
+    _renderType = Layer::RENDERTYPE_TERRAIN_SURFACE;
+    _layer = 0L;
+    _visibleLayer = 0L;
+    _imageLayer = 0L;
+    _order = 0;
+    _clearOsgState = false;
+    _draw = true;
+    _drawState = 0L;
+    _gpuTimerName.clear();
+    setStateSet(0L);
+
+    // the bound comes from the (new) draw state
+    dirtyBound();
+}
+
 void
 LayerDrawable::drawImplementation(osg::RenderInfo& ri) const
 {
     //OE_INFO << LC << (_layer ? _layer->getName() : "[empty]") << " tiles=" << _tiles.size() << std::endl;
 
+    GPUTimer::Scope gpuTimer(ri, _gpuTimerName);
+
     // Get this context's state values:
     PerContextDrawState& ds = _drawState->getPCDS(ri.getContextID());
 
@@ -74,6 +95,13 @@ LayerDrawable::drawImplementation(osg::RenderInfo& ri) const
         tile->draw(ri, *_drawState, 0L);
     }
 
+    // Release the last geometry bound by batched drawing.
+    if (ds._boundGeometry)
+    {
+        ds._boundGeometry->unbindArrays(*ri.getState());
+        ds._boundGeometry = 0L;
+    }
+
     // If set, dirty all OSG state to prevent any leakage - this is sometimes
     // necessary when doing custom OpenGL within a Drawable.
     if (_clearOsgState)
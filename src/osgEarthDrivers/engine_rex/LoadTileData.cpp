@@ -18,6 +18,8 @@
 */
 #include "LoadTileData"
 #include "SurfaceNode"
+#include "Prefetcher"
+#include "MaskGenerator"
 #include <osgEarth/TerrainEngineNode>
 #include <osgEarth/Terrain>
 #include <osg/NodeVisitor>
@@ -31,7 +33,8 @@ using namespace osgEarth;
 LoadTileData::LoadTileData(TileNode* tilenode, EngineContext* context) :
 _tilenode(tilenode),
 _context(context),
-_enableCancel(true)
+_enableCancel(true),
+_invokedTick(0)
 {
     this->setTileKey(tilenode->getKey());
     _map = context->getMap();
@@ -68,6 +71,12 @@ LoadTileData::invoke()
     if (!_map.lock(map))
         return;
 
+    // Everything below here on this thread counts toward the tile's trace.
+    osg::ref_ptr<TileLoadTrace> trace = getTrace();
+    TileLoadTrace::Scope traceScope(trace.get());
+    if (trace.valid())
+        trace->addSince("queue", trace->getStartTick());
+
     // Only use our custom progress callback is cancelation is enabled.
     osg::ref_ptr<ProgressCallback> progress;
     if (_enableCancel)
@@ -75,12 +84,50 @@ LoadTileData::invoke()
     else
         progress = new ProgressCallback();
 
+    osg::ref_ptr<EngineContext> context;
+    _context.lock(context);
+
+    // Triangulate the children's mask geometry here rather than in the cull
+    // traversal that creates them. The results wait in the mask cache.
+    if (context.valid() && _filter.empty())
+    {
+        const TileKey& key = tilenode->getKey();
+        unsigned tileSize = context->getOptions().tileSize().get();
+        osg::ref_ptr<MaskGenerator> masks = new MaskGenerator(key, tileSize, map.get());
+        if (masks->hasMasks() && key.getLOD() < context->getOptions().maxLOD().get())
+        {
+            TileLoadTrace::ScopedStage traceStage("masks");
+            MapInfo mapInfo(map.get());
+            for (unsigned q = 0; q < 4; ++q)
+            {
+                osg::ref_ptr<MaskGenerator> childMasks = new MaskGenerator(key.createChildKey(q), tileSize, map.get());
+                childMasks->prepare(mapInfo);
+            }
+        }
+    }
+
+    // Use the model the prefetcher built ahead of time, if there is one.
+    if (_filter.empty() && context.valid() && context->getPrefetcher())
+    {
+        _dataModel = context->getPrefetcher()->take(tilenode->getKey(), map->getDataModelRevision());
+        if (_dataModel.valid())
+        {
+            _invokedTick = osg::Timer::instance()->tick();
+            return;
+        }
+    }
+
     // Assemble all the components necessary to display this tile
-    _dataModel = engine->createTileModel(
-        map.get(),
-        tilenode->getKey(),
-        _filter,
-        progress.get());
+    {
+        TileLoadTrace::ScopedStage traceStage("model");
+        _dataModel = engine->createTileModel(
+            map.get(),
+            tilenode->getKey(),
+            _filter,
+            progress.get());
+    }
+
+    _invokedTick = osg::Timer::instance()->tick();
 
     // if the operation was canceled, set the request to idle and delete the tile model.
     if (progress && progress->isCanceled())
@@ -103,6 +150,11 @@ LoadTileData::apply(const osg::FrameStamp* stamp)
     if (!_map.lock(map))
         return;
 
+    osg::ref_ptr<TileLoadTrace> trace = getTrace();
+    osg::Timer_t applyStart = osg::Timer::instance()->tick();
+    if (trace.valid() && _invokedTick != 0)
+        trace->addSince("merge.wait", _invokedTick);
+
     // ensure we got an actual datamodel:
     if (_dataModel.valid())
     {
@@ -136,6 +188,12 @@ LoadTileData::apply(const osg::FrameStamp* stamp)
         // Delete the model immediately
         _dataModel = 0L;
     }
+
+    if (trace.valid())
+    {
+        trace->addSince("merge", applyStart);
+        trace->finish();
+    }
 }
 
 namespace
@@ -145,13 +203,19 @@ namespace
     struct ModelCompilingAttribute : public osg::Texture2D
     {
         osg::observer_ptr<TerrainTileModel> _dataModel;
+        osg::ref_ptr<TileLoadTrace> _trace;
         
         // the ICO calls apply() directly instead of compileGLObjects
         void apply(osg::State& state) const
         {
             osg::ref_ptr<TerrainTileModel> dataModel;
             if (_dataModel.lock(dataModel))
+            {
+                osg::Timer_t start = osg::Timer::instance()->tick();
                 dataModel->compileGLObjects(state);
+                if (_trace.valid())
+                    _trace->addSince("compile", start);
+            }
         }
 
         // no need to override release or resize since this is a temporary object
@@ -185,6 +249,7 @@ LoadTileData::createStateSet() const
         out = new osg::StateSet();
         ModelCompilingAttribute* mca = new ModelCompilingAttribute();
         mca->_dataModel = _dataModel.get();
+        mca->_trace = getTrace();
         out->setTextureAttribute(0, mca, 1);
     }
 
@@ -23,11 +23,14 @@
 #include <osgEarth/Utils>
 #include <osgEarth/NodeUtils>
 #include <osgEarth/Metrics>
+#include <osgEarth/StringUtils>
 
 #include <osgDB/FileNameUtils>
 #include <osgDB/FileUtils>
 #include <osgDB/Registry>
 #include <osgDB/ReaderWriter>
+#include <osgDB/DatabasePager>
+#include <osgUtil/IncrementalCompileOperation>
 
 #include <string>
 
@@ -218,6 +221,15 @@ PagerLoader::setMergesPerFrame(int value)
     
 }
 
+void
+PagerLoader::setMergeBudget(unsigned us)
+{
+    _mergeTimer._budget_us = (double)us;
+    if ( us > 0u )
+        this->setNumChildrenRequiringUpdateTraversal( 1 );
+    OE_INFO << LC << "Merge budget = " << us << " us" << std::endl;
+}
+
 void
 PagerLoader::setLODPriorityScale(unsigned lod, float priorityScale)
 {
@@ -244,7 +256,6 @@ PagerLoader::load(Loader::Request* request, float priority, osg::NodeVisitor& nv
         if ( nv.getFrameStamp() )
         {
             fn = nv.getFrameStamp()->getFrameNumber();
-            request->setFrameNumber( fn );
         }
 
         bool addToRequestSet = false;
@@ -258,9 +269,12 @@ PagerLoader::load(Loader::Request* request, float priority, osg::NodeVisitor& nv
             request->_lastTick = osg::Timer::instance()->tick();
 
             // update the priority, scale and bias it, and then normalize it to [0..1] range.
+            // If several views ask for this tile in the same frame, the most urgent one wins.
             unsigned lod = request->getTileKey().getLOD();
             float p = priority * _priorityScales[lod] + _priorityOffsets[lod];            
-            request->_priority = p / (float)(_numLODs+1);
+            p /= (float)(_numLODs+1);
+            if ( request->getLastFrameSubmitted() != fn || p > request->_priority )
+                request->_priority = p;
 
             // timestamp it
             request->setFrameNumber( fn );
@@ -307,7 +321,7 @@ PagerLoader::clear()
 void
 PagerLoader::traverse(osg::NodeVisitor& nv)
 {
-    // only called when _mergesPerFrame > 0
+    // only called when _mergesPerFrame > 0 or there is a merge budget
     if ( nv.getVisitorType() == nv.UPDATE_VISITOR )
     {
         if ( nv.getFrameStamp() )
@@ -318,22 +332,32 @@ PagerLoader::traverse(osg::NodeVisitor& nv)
         // process pending merges.
         {
             METRIC_BEGIN("loader.merge");
+            osg::Timer_t start = osg::Timer::instance()->tick();
             int count;
-            for(count=0; count < _mergesPerFrame && !_mergeQueue.empty(); ++count)
+            for(count=0; (_mergesPerFrame == 0 || count < _mergesPerFrame) && !_mergeQueue.empty(); ++count)
             {
+                // always merge at least one so we make progress on slow frames.
+                if ( count > 0 && !_mergeTimer.hasTimeFor(osg::Timer::instance()->delta_u(start, osg::Timer::instance()->tick())) )
+                    break;
+
                 Request* req = _mergeQueue.begin()->get();
                 if ( req && req->_lastTick >= _checkpoint )
                 {
                     OE_START_TIMER(req_apply);
                     req->apply( getFrameStamp() );
-                    double s = OE_STOP_TIMER(req_apply);
+                    _mergeTimer.record( 1e6 * OE_STOP_TIMER(req_apply) );
 
                     req->setState(Request::FINISHED);
                 }
 
                 _mergeQueue.erase( _mergeQueue.begin() );
             }
-            METRIC_END("loader.merge");
+            METRIC_END("loader.merge", 2, "count", toString<int>(count).c_str(), "avg_us", toString<double>(_mergeTimer._avg_us).c_str());
+
+            static MetricValue* s_merges = Metrics::getValue("loader.merges_per_frame");
+            static MetricValue* s_mergeQueue = Metrics::getValue("loader.merge_queue");
+            s_merges->set(count);
+            s_mergeQueue->set(_mergeQueue.size());
         }
 
         // cull finished requests.
@@ -389,6 +413,9 @@ PagerLoader::traverse(osg::NodeVisitor& nv)
             }
 
             //OE_NOTICE << LC << "PagerLoader: requests=" << _requests.size() << "; mergeQueue=" << _mergeQueue.size() << std::endl;
+
+            static MetricValue* s_requests = Metrics::getValue("loader.requests");
+            s_requests->set(_requests.size());
         }
     }
 
@@ -409,7 +436,7 @@ PagerLoader::addChild(osg::Node* node)
             // and running (i.e. has not been canceled along the way)
             if (req->_lastTick >= _checkpoint && req->isRunning())
             {
-                if ( _mergesPerFrame > 0 )
+                if ( _mergesPerFrame > 0 || _mergeTimer._budget_us > 0.0 )
                 {
                     _mergeQueue.insert( req );
                     req->setState( Request::MERGING );
@@ -486,6 +513,384 @@ PagerLoader::invokeAndRelease(UID requestUID)
 
 
 
+//...............................................
+
+#undef  LC
+#define LC "[AsyncLoader] "
+
+namespace
+{
+    // A job doesn't carry a specific request; it runs whichever request has
+    // the highest priority at the time a worker picks it up.
+    struct AsyncLoaderJob : public TaskRequest
+    {
+        AsyncLoaderJob(AsyncLoader* loader) : _loader(loader) { }
+
+        void operator()(ProgressCallback* progress)
+        {
+            osg::ref_ptr<AsyncLoader> loader;
+            if (_loader.lock(loader))
+                loader->invokeNext();
+        }
+
+        osg::observer_ptr<AsyncLoader> _loader;
+    };
+
+    // Hands a request back to the loader once the ICO has finished
+    // compiling its GL objects.
+    struct AsyncLoaderCompileCompleted : public osgUtil::IncrementalCompileOperation::CompileCompletedCallback
+    {
+        AsyncLoaderCompileCompleted(AsyncLoader* loader, Loader::Request* request)
+            : _loader(loader), _request(request) { }
+
+        bool compileCompleted(osgUtil::IncrementalCompileOperation::CompileSet* compileSet)
+        {
+            osg::ref_ptr<AsyncLoader> loader;
+            if (_loader.lock(loader))
+                loader->queueForMerge(_request.get());
+
+            // true = we handled it; the ICO should not merge anything itself.
+            return true;
+        }
+
+        osg::observer_ptr<AsyncLoader> _loader;
+        osg::ref_ptr<Loader::Request>  _request;
+    };
+}
+
+AsyncLoader::AsyncLoader(TerrainEngineNode* engine) :
+_checkpoint    ( (osg::Timer_t)0 ),
+_mergesPerFrame( 0 ),
+_numLODs       ( 20u )
+{
+    _jobs = new JobGroup();
+
+    // merging and purging always happen in the update traversal.
+    this->setNumChildrenRequiringUpdateTraversal( 1 );
+
+    for (unsigned i = 0; i < 64; ++i)
+    {
+        _priorityScales[i] = 1.0f;
+        _priorityOffsets[i] = 0.0f;
+    }
+}
+
+AsyncLoader::~AsyncLoader()
+{
+    // Discard anything that hasn't started; running jobs will fail to
+    // lock the loader and exit.
+    _jobs->cancel();
+}
+
+void
+AsyncLoader::setNumLODs(unsigned lods)
+{
+    _numLODs = std::max(lods, 1u);
+}
+
+void
+AsyncLoader::setMergesPerFrame(int value)
+{
+    _mergesPerFrame = std::max(value, 0);
+    OE_INFO << LC << "Merges per frame = " << _mergesPerFrame << std::endl;
+}
+
+void
+AsyncLoader::setMergeBudget(unsigned us)
+{
+    _mergeTimer._budget_us = (double)us;
+    OE_INFO << LC << "Merge budget = " << us << " us" << std::endl;
+}
+
+void
+AsyncLoader::setLODPriorityScale(unsigned lod, float priorityScale)
+{
+    if (lod < 64)
+        _priorityScales[lod] = priorityScale;
+}
+
+void
+AsyncLoader::setLODPriorityOffset(unsigned lod, float offset)
+{
+    if (lod < 64)
+        _priorityOffsets[lod] = offset;
+}
+
+bool
+AsyncLoader::load(Loader::Request* request, float priority, osg::NodeVisitor& nv)
+{
+    if ( request && !request->isMerging() && !request->isFinished() )
+    {
+        unsigned fn = nv.getFrameStamp() ? nv.getFrameStamp()->getFrameNumber() : 0u;
+
+        bool isNew = false;
+
+        // lock the request since multiple cull traversals might hit this function.
+        request->lock();
+        {
+            request->setState(Request::RUNNING);
+            request->_lastTick = osg::Timer::instance()->tick();
+
+            // Re-prioritize on every call; workers read this when they choose
+            // what to run next. If several views ask for this tile in the same
+            // frame, the most urgent one wins.
+            unsigned lod = request->getTileKey().getLOD();
+            float p = priority * _priorityScales[lod] + _priorityOffsets[lod];
+            p /= (float)(_numLODs+1);
+            if ( request->getLastFrameSubmitted() != fn || p > request->_priority )
+                request->_priority = p;
+
+            request->setFrameNumber( fn );
+
+            request->_loadCount++;
+            isNew = (request->_loadCount == 1);
+        }
+        request->unlock();
+
+        if ( isNew )
+        {
+            {
+                Threading::ScopedMutexLock lock( _requestsMutex );
+                _requests[request->getUID()] = request;
+                _waiting[request->getUID()] = request;
+
+                // If the viewer is running an ICO, use it to spread the GL
+                // compilation of new tile data across frames.
+                if ( !_ico.valid() )
+                {
+                    osgDB::DatabasePager* pager = dynamic_cast<osgDB::DatabasePager*>(nv.getDatabaseRequestHandler());
+                    if ( pager && pager->getIncrementalCompileOperation() )
+                        _ico = pager->getIncrementalCompileOperation();
+                }
+            }
+
+            Registry::instance()->getJobScheduler()->submit(
+                new AsyncLoaderJob(this),
+                JobScheduler::LANE_HIGH,
+                _jobs.get() );
+        }
+
+        return isNew;
+    }
+    return false;
+}
+
+void
+AsyncLoader::clear()
+{
+    // Set a time checkpoint for invalidating old requests.
+    _checkpoint = osg::Timer::instance()->tick();
+}
+
+void
+AsyncLoader::invokeNext()
+{
+    RefRequest request;
+    {
+        Threading::ScopedMutexLock lock( _requestsMutex );
+
+        Requests::iterator best = _waiting.end();
+        for(Requests::iterator i = _waiting.begin(); i != _waiting.end(); )
+        {
+            Request* req = i->second.get();
+
+            // drop anything the cull stopped asking for:
+            if ( !req->isRunning() || req->_lastTick < _checkpoint )
+            {
+                _waiting.erase( i++ );
+                continue;
+            }
+
+            // don't run the same request on two threads at once:
+            if ( _inFlight.find(i->first) == _inFlight.end() &&
+                 (best == _waiting.end() || req->_priority > best->second->_priority) )
+            {
+                best = i;
+            }
+            ++i;
+        }
+
+        if ( best == _waiting.end() )
+            return;
+
+        request = best->second.get();
+        _waiting.erase( best );
+        _inFlight.insert( request->getUID() );
+    }
+
+    if ( REPORT_ACTIVITY )
+        Registry::instance()->startActivity( request->getName() );
+
+    request->invoke();
+
+    bool resubmit = false;
+    {
+        Threading::ScopedMutexLock lock( _requestsMutex );
+        _inFlight.erase( request->getUID() );
+
+        // if the request was dropped and re-requested while we were running it,
+        // its job may have been skipped; schedule another.
+        resubmit = _waiting.find( request->getUID() ) != _waiting.end();
+    }
+
+    if ( resubmit )
+    {
+        Registry::instance()->getJobScheduler()->submit(
+            new AsyncLoaderJob(this),
+            JobScheduler::LANE_HIGH,
+            _jobs.get() );
+    }
+
+    // only hand it off for merging if it wasn't canceled along the way.
+    if ( request->isRunning() && request->_lastTick >= _checkpoint )
+    {
+        osg::ref_ptr<osgUtil::IncrementalCompileOperation> ico;
+        if ( _ico.lock(ico) && !ico->getContextSet().empty() )
+        {
+            osg::ref_ptr<osg::Node> node = new RequestResultNode( request.get() );
+            if ( node->getStateSet() )
+            {
+                osgUtil::IncrementalCompileOperation::CompileSet* compileSet =
+                    new osgUtil::IncrementalCompileOperation::CompileSet( node.get() );
+
+                compileSet->_compileCompletedCallback = new AsyncLoaderCompileCompleted( this, request.get() );
+
+                ico->add( compileSet );
+                return;
+            }
+        }
+
+        queueForMerge( request.get() );
+    }
+}
+
+void
+AsyncLoader::queueForMerge(Loader::Request* request)
+{
+    Threading::ScopedMutexLock lock( _completedMutex );
+    _completed.push_back( request );
+}
+
+void
+AsyncLoader::endRequest(Loader::Request* req)
+{
+    req->setState( Request::IDLE );
+    if ( REPORT_ACTIVITY )
+        Registry::instance()->endActivity( req->getName() );
+}
+
+void
+AsyncLoader::traverse(osg::NodeVisitor& nv)
+{
+    if ( nv.getVisitorType() == nv.UPDATE_VISITOR )
+    {
+        if ( nv.getFrameStamp() )
+        {
+            setFrameStamp(nv.getFrameStamp());
+        }
+
+        // collect the requests the workers have finished.
+        {
+            std::vector<RefRequest> completed;
+            {
+                Threading::ScopedMutexLock lock( _completedMutex );
+                completed.swap( _completed );
+            }
+
+            for(std::vector<RefRequest>::iterator i = completed.begin(); i != completed.end(); ++i)
+            {
+                Request* req = i->get();
+                if ( req->isRunning() && req->_lastTick >= _checkpoint )
+                {
+                    req->setState( Request::MERGING );
+                    _mergeQueue.insert( req );
+                }
+            }
+        }
+
+        // process pending merges.
+        {
+            METRIC_BEGIN("loader.merge");
+            osg::Timer_t start = osg::Timer::instance()->tick();
+            int count;
+            for(count=0; (_mergesPerFrame == 0 || count < _mergesPerFrame) && !_mergeQueue.empty(); ++count)
+            {
+                // always merge at least one so we make progress on slow frames.
+                if ( count > 0 && !_mergeTimer.hasTimeFor(osg::Timer::instance()->delta_u(start, osg::Timer::instance()->tick())) )
+                    break;
+
+                Request* req = _mergeQueue.begin()->get();
+                if ( req && req->_lastTick >= _checkpoint )
+                {
+                    OE_START_TIMER(req_apply);
+                    req->apply( getFrameStamp() );
+                    _mergeTimer.record( 1e6 * OE_STOP_TIMER(req_apply) );
+                }
+                if ( req )
+                {
+                    req->setState(Request::FINISHED);
+                }
+
+                _mergeQueue.erase( _mergeQueue.begin() );
+            }
+            METRIC_END("loader.merge", 2, "count", toString<int>(count).c_str(), "avg_us", toString<double>(_mergeTimer._avg_us).c_str());
+
+            static MetricValue* s_merges = Metrics::getValue("loader.merges_per_frame");
+            static MetricValue* s_mergeQueue = Metrics::getValue("loader.merge_queue");
+            s_merges->set(count);
+            s_mergeQueue->set(_mergeQueue.size());
+        }
+
+        // cull finished and stale requests.
+        {
+            METRIC_SCOPED("loader.cull");
+
+            Threading::ScopedMutexLock lock( _requestsMutex );
+
+            unsigned fn = 0;
+            if ( nv.getFrameStamp() )
+                fn = nv.getFrameStamp()->getFrameNumber();
+
+            for(Requests::iterator i = _requests.begin(); i != _requests.end(); )
+            {
+                Request* req = i->second.get();
+                const unsigned frameDiff = fn - req->getLastFrameSubmitted();
+
+                if ( req->isFinished() )
+                {
+                    endRequest( req );
+                    _waiting.erase( i->first );
+                    _requests.erase( i++ );
+                }
+
+                // Unlike the pager, we can drop a request as soon as the cull
+                // stops asking for it. If it's in progress, setting it to IDLE
+                // cancels it.
+                else if ( !req->isMerging() && frameDiff > 1 )
+                {
+                    endRequest( req );
+                    _waiting.erase( i->first );
+                    _requests.erase( i++ );
+                }
+
+                else if ( req->isMerging() && frameDiff > 1800 )
+                {
+                    endRequest( req );
+                    _requests.erase( i++ );
+                }
+
+                else
+                {
+                    ++i;
+                }
+            }
+        }
+    }
+
+    LoaderGroup::traverse( nv );
+}
+
+
 namespace osgEarth { namespace Drivers { namespace RexTerrainEngine
 {
     using namespace osgEarth;
@@ -22,10 +22,13 @@
 #include <osgEarth/Locators>
 #include <osgEarth/Map>
 #include <osgEarth/MapInfo>
+#include <osgEarth/Containers>
 #include <osgEarthSymbology/Geometry>
 
 #include <osgUtil/DelaunayTriangulator>
 
+#include <algorithm>
+
 
 using namespace osgEarth::Drivers::RexTerrainEngine;
 using namespace osgEarth::Symbology;
@@ -39,9 +42,14 @@ using namespace osgEarth::Symbology;
 
 #define EQUIVALENT_2D(A, B) (EQUIVALENT(A->x(), B->x()) && EQUIVALENT(A->y(), B->y()))
 
+// Number of tiles whose mask triangulation stays cached.
+#define MAX_CACHED_PATCHES 256
+
 namespace
 {
-    void resample(Geometry* geom, double maxLen)
+    //! Resamples the segments that overlap the box [bmin,bmax]; the rest of
+    //! the boundary gets cropped away later, so it keeps its original points.
+    void resample(Geometry* geom, double maxLen, const osg::Vec2d& bmin, const osg::Vec2d& bmax)
     {
         GeometryIterator i(geom);
         while (i.hasMore())
@@ -59,7 +67,13 @@ namespace
                 osg::Vec2d vec2d(vec3d.x(), vec3d.y());
                 double len2d = vec2d.length();
 
-                if (len2d > maxLen)
+                bool overlaps =
+                    osg::maximum(seg.first.x(), seg.second.x()) >= bmin.x() &&
+                    osg::minimum(seg.first.x(), seg.second.x()) <= bmax.x() &&
+                    osg::maximum(seg.first.y(), seg.second.y()) >= bmin.y() &&
+                    osg::minimum(seg.first.y(), seg.second.y()) <= bmax.y();
+
+                if (overlaps && len2d > maxLen)
                 {
                     double numNewPoints = ::floor(len2d/maxLen);
                     double interval = len2d/(numNewPoints+1.0);
@@ -145,13 +159,110 @@ namespace
             //OE_INFO << LC << "Removed " << verts->size() - finalSize << " duplicates.\n";
         }
     }
+
+    //! Uniform grid over a polygon's boundary segments, limited to a box (the
+    //! part of the tile being patched), for finding the segments near a point.
+    //! Segment i runs from point i to point i+1 (the last one closes the loop).
+    struct SegmentIndex
+    {
+        SegmentIndex(const Polygon* poly, const osg::Vec2d& bmin, const osg::Vec2d& bmax, unsigned cells) :
+            _min(bmin), _cells(osg::maximum(cells, 1u))
+        {
+            _cellSize.set(
+                osg::maximum(bmax.x()-bmin.x(), MATCH_TOLERANCE) / (double)_cells,
+                osg::maximum(bmax.y()-bmin.y(), MATCH_TOLERANCE) / (double)_cells);
+
+            _grid.resize(_cells*_cells);
+
+            unsigned n = poly->size();
+            for (unsigned i = 0; i < n; ++i)
+            {
+                const osg::Vec3d& a = (*poly)[i];
+                const osg::Vec3d& b = (*poly)[i+1 < n ? i+1 : 0];
+
+                // grown by the query tolerance, for segments just off the box:
+                const double t = 2.0*MATCH_TOLERANCE;
+                int x0, y0, x1, y1;
+                if (range(osg::minimum(a.x(), b.x())-t, osg::minimum(a.y(), b.y())-t,
+                          osg::maximum(a.x(), b.x())+t, osg::maximum(a.y(), b.y())+t,
+                          x0, y0, x1, y1))
+                {
+                    for (int y = y0; y <= y1; ++y)
+                        for (int x = x0; x <= x1; ++x)
+                            _grid[y*_cells+x].push_back(i);
+                }
+            }
+        }
+
+        //! Segments that come within "tol" of p, in ascending order.
+        void query(const osg::Vec3d& p, double tol, std::vector<unsigned>& out) const
+        {
+            out.clear();
+            int x0, y0, x1, y1;
+            if (range(p.x()-tol, p.y()-tol, p.x()+tol, p.y()+tol, x0, y0, x1, y1))
+            {
+                for (int y = y0; y <= y1; ++y)
+                    for (int x = x0; x <= x1; ++x)
+                        out.insert(out.end(), _grid[y*_cells+x].begin(), _grid[y*_cells+x].end());
+
+                std::sort(out.begin(), out.end());
+                out.erase(std::unique(out.begin(), out.end()), out.end());
+            }
+        }
+
+        // cells covered by a box; false if it misses the grid entirely
+        bool range(double xmin, double ymin, double xmax, double ymax, int& x0, int& y0, int& x1, int& y1) const
+        {
+            x0 = (int)floor((xmin-_min.x())/_cellSize.x());
+            y0 = (int)floor((ymin-_min.y())/_cellSize.y());
+            x1 = (int)floor((xmax-_min.x())/_cellSize.x());
+            y1 = (int)floor((ymax-_min.y())/_cellSize.y());
+            if (x1 < 0 || y1 < 0 || x0 >= (int)_cells || y0 >= (int)_cells)
+                return false;
+            x0 = osg::maximum(x0, 0); y0 = osg::maximum(y0, 0);
+            x1 = osg::minimum(x1, (int)_cells-1); y1 = osg::minimum(y1, (int)_cells-1);
+            return true;
+        }
+
+        osg::Vec2d _min, _cellSize;
+        unsigned   _cells;
+        std::vector< std::vector<unsigned> > _grid;
+    };
+
+    //! Identifies a tile's mask triangulation.
+    struct PatchKey
+    {
+        PatchKey(const TileKey& key, unsigned tileSize, int revision) :
+            _key(key), _tileSize(tileSize), _revision(revision) { }
+
+        bool operator < (const PatchKey& rhs) const
+        {
+            if (_revision < rhs._revision) return true;
+            if (_revision > rhs._revision) return false;
+            if (_tileSize < rhs._tileSize) return true;
+            if (_tileSize > rhs._tileSize) return false;
+            return _key < rhs._key;
+        }
+
+        TileKey  _key;
+        unsigned _tileSize;
+        int      _revision;
+    };
+
+    typedef LRUCache< PatchKey, osg::ref_ptr<MaskPatch> > PatchCache;
+
+    PatchCache& getPatchCache()
+    {
+        static PatchCache s_cache(true, MAX_CACHED_PATCHES);
+        return s_cache;
+    }
 }
 
 
 
 
 MaskGenerator::MaskGenerator(const TileKey& key, unsigned tileSize, const Map* map) :
-_key( key ), _tileSize(tileSize)
+_key( key ), _tileSize(tileSize), _revision(map->getDataModelRevision())
 {
     MaskLayerVector maskLayers;
     map->getLayers(maskLayers);
@@ -247,6 +358,74 @@ MaskGenerator::createMaskPrimitives(const MapInfo& mapInfo,
         return R_BOUNDARY_DOES_NOT_INTERSECT_TILE;
     }
 
+    osg::ref_ptr<MaskPatch> patch;
+    getOrCreatePatch(mapInfo, patch);
+
+    if (patch->_result != R_BOUNDARY_INTERSECTS_TILE)
+    {
+        return patch->_result;
+    }
+
+    unsigned vertsOffset = verts->size();
+
+    verts->insert(verts->end(), patch->_verts->begin(), patch->_verts->end());
+    texCoords->insert(texCoords->end(), patch->_texCoords->begin(), patch->_texCoords->end());
+    normals->insert(normals->end(), patch->_normals->begin(), patch->_normals->end());
+
+    // use same vert for neighbor to prevent morphing
+    if ( neighbors )
+        neighbors->insert(neighbors->end(), patch->_verts->begin(), patch->_verts->end());
+
+    out_elements = new osg::DrawElementsUInt(patch->_elements->getMode());
+    out_elements->reserve(patch->_elements->size());
+    for (osg::DrawElementsUInt::const_iterator i = patch->_elements->begin(); i != patch->_elements->end(); ++i)
+    {
+        out_elements->push_back(vertsOffset + *i);
+    }
+
+    return R_BOUNDARY_INTERSECTS_TILE;
+}
+
+void
+MaskGenerator::prepare(const MapInfo& mapInfo)
+{
+    if (_maskRecords.size() > 0)
+    {
+        osg::ref_ptr<MaskPatch> patch;
+        getOrCreatePatch(mapInfo, patch);
+    }
+}
+
+void
+MaskGenerator::getOrCreatePatch(const MapInfo& mapInfo, osg::ref_ptr<MaskPatch>& out)
+{
+    PatchKey key(_key, _tileSize, _revision);
+
+    PatchCache::Record rec;
+    if (getPatchCache().get(key, rec))
+    {
+        out = rec.value().get();
+        return;
+    }
+
+    // Two threads may both miss and triangulate the same tile; the results
+    // are identical, so whichever finishes last wins.
+    out = new MaskPatch();
+    out->_result = createPatch(mapInfo, *out.get());
+    getPatchCache().insert(key, out.get());
+}
+
+MaskGenerator::Result
+MaskGenerator::createPatch(const MapInfo& mapInfo, MaskPatch& patch)
+{
+    patch._verts = new osg::Vec3Array();
+    patch._texCoords = new osg::Vec3Array();
+    patch._normals = new osg::Vec3Array();
+
+    osg::Vec3Array* verts = patch._verts.get();
+    osg::Vec3Array* texCoords = patch._texCoords.get();
+    osg::Vec3Array* normals = patch._normals.get();
+
     osg::ref_ptr<osgEarth::GeoLocator> geoLocator = GeoLocator::createForKey(_key, mapInfo);
     if (geoLocator->getCoordinateSystemType() == GeoLocator::GEOCENTRIC)
         geoLocator = geoLocator->getGeographicFromGeocentric();
@@ -366,6 +545,9 @@ MaskGenerator::createMaskPrimitives(const MapInfo& mapInfo,
 
     double patchArea = patchPoly->getSignedArea2D();
 
+    osg::Vec2d patchMin( (double)min_i/(double)(_tileSize-1), (double)min_j/(double)(_tileSize-1) );
+    osg::Vec2d patchMax( (double)max_i/(double)(_tileSize-1), (double)max_j/(double)(_tileSize-1) );
+
     std::set<osg::Vec3d, less_2d> boundaryVerts;
 
     osg::ref_ptr<osgUtil::DelaunayConstraint> dc = new osgUtil::DelaunayConstraint();
@@ -389,12 +571,19 @@ MaskGenerator::createMaskPrimitives(const MapInfo& mapInfo,
         // current tile grid, which will result in a better tessellation.
         // Ideally we would do this after cropping, but that is causing some
         // triangulation errors. TODO -gw
+        // Only the segments near the patch are resampled, since cropping
+        // throws the rest away.
+        const double interval = 1.0 / double(_tileSize-1);
         if (!boundaryPoly->empty())
         {
-            const double interval = 1.0 / double(_tileSize-1);
-            resample(boundaryPoly.get(), interval);
+            resample(boundaryPoly.get(), interval, patchMin - osg::Vec2d(interval,interval), patchMax + osg::Vec2d(interval,interval));
         }
 
+        // Index the boundary segments over the patch, where all the cropped
+        // points lie, so the searches below only visit segments nearby.
+        SegmentIndex segments(boundaryPoly.get(), patchMin, patchMax, (unsigned)osg::maximum(num_i, num_j));
+        std::vector<unsigned> nearby;
+
         // Crop the boundary to the patch polygon (i.e. the bounding box)
         // for case where mask crosses tile edges
         osg::ref_ptr<Geometry> boundaryPolyCroppedToTile;
@@ -457,9 +646,20 @@ MaskGenerator::createMaskPrimitives(const MapInfo& mapInfo,
             }
 
             // Search the original uncropped boundary polygon for matching points,
-            // and build a set of boundary vertices.
-            for (Polygon::iterator mit = boundaryPoly->begin(); mit != boundaryPoly->end(); ++mit)
+            // and build a set of boundary vertices. A matching point is an end
+            // of one of the segments near this one.
+            segments.query(*it, 2.0*MATCH_TOLERANCE, nearby);
+            std::vector<unsigned> points;
+            for (unsigned n = 0; n < nearby.size(); ++n)
+            {
+                points.push_back(nearby[n]);
+                points.push_back(nearby[n]+1 < boundaryPoly->size() ? nearby[n]+1 : 0);
+            }
+            std::sort(points.begin(), points.end());
+
+            for (unsigned n = 0; n < points.size(); ++n)
             {
+                Polygon::iterator mit = boundaryPoly->begin() + points[n];
                 if (EQUIVALENT_2D(mit, it))
                 {
                     (*it).z() = (*mit).z();
@@ -489,8 +689,14 @@ MaskGenerator::createMaskPrimitives(const MapInfo& mapInfo,
                 osg::Vec3d p2 = *it;
                 double closestZ = 0.0;
                 double closestRatio = DBL_MAX;
-                for (Polygon::iterator mit = boundaryPoly->begin(); mit != boundaryPoly->end(); ++mit)
+
+                // only segments whose extent (allowing for the truncation below)
+                // contains the point can pass the test:
+                segments.query(p2, 2.0*MATCH_TOLERANCE, nearby);
+
+                for (unsigned n = 0; n < nearby.size(); ++n)
                 {
+                    Polygon::iterator mit = boundaryPoly->begin() + nearby[n];
                     osg::Vec3d p1 = *mit;
                     osg::Vec3d p3 = mit == --boundaryPoly->end() ? boundaryPoly->front() : (*(mit + 1));
 
@@ -588,8 +794,6 @@ MaskGenerator::createMaskPrimitives(const MapInfo& mapInfo,
     verts->reserve(verts->size() + trigPoints->size());
     texCoords->reserve(texCoords->size() + trigPoints->size());
     normals->reserve(normals->size() + trigPoints->size());
-    if ( neighbors )
-        neighbors->reserve(neighbors->size() + trigPoints->size()); 
 
     // Iterate through point to convert to model coords, calculate normals, and set up tex coords
     osg::ref_ptr<GeoLocator> locator = GeoLocator::createForKey( _key, mapInfo );
@@ -619,10 +823,6 @@ MaskGenerator::createMaskPrimitives(const MapInfo& mapInfo,
 
         verts->push_back(local);
 
-        // use same vert for neighbor to prevent morphing
-        if ( neighbors )
-            neighbors->push_back( local );  
-
         // set up text coords
         texCoords->push_back( osg::Vec3f(it->x(), it->y(), isBoundary ? VERTEX_MARKER_BOUNDARY : VERTEX_MARKER_PATCH) );
     }
@@ -638,8 +838,9 @@ MaskGenerator::createMaskPrimitives(const MapInfo& mapInfo,
     }
 
     // Construct the output triangle set.
-    out_elements = new osg::DrawElementsUInt(tris->getMode());
+    osg::ref_ptr<osg::DrawElementsUInt> out_elements = new osg::DrawElementsUInt(tris->getMode());
     out_elements->reserve(tris->size());
+    patch._elements = out_elements.get();
 
     const osg::MixinVector<GLuint> ins = tris->asVector();
 
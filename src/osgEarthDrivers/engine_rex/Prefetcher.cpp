@@ -0,0 +1,354 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2008-2014 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "Prefetcher"
+#include "EngineContext"
+#include "SelectionInfo"
+#include "TileNodeRegistry"
+
+#include <osgEarth/TerrainEngineNode>
+#include <osgEarth/Registry>
+#include <osgEarth/Map>
+
+using namespace osgEarth::Drivers::RexTerrainEngine;
+using namespace osgEarth;
+
+#define LC "[Prefetcher] "
+
+// Minimum time between two predictions (s)
+#define PREDICTION_INTERVAL     0.1
+
+// A turn sharper than this (cosine of the angle) counts as a change of course
+#define COURSE_CHANGE_COS       0.866
+
+// Number of coarser LODs to fetch above each predicted tile
+#define NUM_ANCESTORS           3
+
+// Maximum number of jobs waiting to run
+#define MAX_PENDING_JOBS        64u
+
+// Maximum number of prefetched models waiting for the loader
+#define MAX_PREFETCHED_MODELS   128u
+
+//........................................................................
+
+namespace
+{
+    // Builds one tile model and hands it to the prefetcher.
+    struct PrefetchTileJob : public TaskRequest
+    {
+        PrefetchTileJob(Prefetcher* prefetcher, EngineContext* context, const TileKey& key) :
+            _prefetcher(prefetcher),
+            _engine(context->getEngine()),
+            _map(context->getMap().get()),
+            _key(key) { }
+
+        void operator()(ProgressCallback* progress)
+        {
+            osg::ref_ptr<Prefetcher> prefetcher;
+            osg::ref_ptr<TerrainEngineNode> engine;
+            osg::ref_ptr<const Map> map;
+            if (!_prefetcher.lock(prefetcher) || !_engine.lock(engine) || !_map.lock(map))
+                return;
+
+            osg::ref_ptr<TerrainTileModel> model = engine->createTileModel(
+                map.get(),
+                _key,
+                CreateTileModelFilter(),
+                progress);
+
+            if (model.valid() && !(progress && progress->isCanceled()))
+            {
+                prefetcher->store(model.get());
+            }
+        }
+
+        osg::observer_ptr<Prefetcher>        _prefetcher;
+        osg::observer_ptr<TerrainEngineNode> _engine;
+        osg::observer_ptr<const Map>         _map;
+        TileKey                              _key;
+    };
+}
+
+//........................................................................
+
+Prefetcher::Prefetcher(EngineContext* context) :
+_context           ( context ),
+_lookahead         ( 0.5 ),
+_lastFrame         ( ~0u ),
+_lastTime          ( 0.0 ),
+_lastPredictionTime( 0.0 ),
+_hasTarget         ( false )
+{
+    _jobs = new JobGroup();
+}
+
+Prefetcher::~Prefetcher()
+{
+    _jobs->cancel();
+}
+
+void
+Prefetcher::cull(osgUtil::CullVisitor* cv)
+{
+    const osg::FrameStamp* stamp = cv->getFrameStamp();
+    osg::Camera* camera = cv->getCurrentCamera();
+    if (!stamp || !camera || !camera->getView() || _lookahead <= 0.0)
+        return;
+
+    Threading::ScopedMutexLock lock(_mutex);
+
+    // Follow the first view we see, once per frame.
+    if (!_view.valid())
+    {
+        _view = camera->getView();
+    }
+    if (camera->getView() != _view.get() || stamp->getFrameNumber() == _lastFrame)
+    {
+        return;
+    }
+
+    osg::Vec3d eye = osg::Vec3d(0,0,0) * camera->getInverseViewMatrix();
+    double time = stamp->getReferenceTime();
+
+    bool first = (_lastFrame == ~0u);
+    double dt = time - _lastTime;
+    _lastFrame = stamp->getFrameNumber();
+
+    if (first || dt <= 0.0)
+    {
+        _lastEye = eye;
+        _lastTime = time;
+        return;
+    }
+
+    // Smooth the velocity over a few frames so a single jittery frame
+    // doesn't look like a change of course.
+    osg::Vec3d v = (eye - _lastEye) / dt;
+    _velocity = _velocity*0.5 + v*0.5;
+    _lastEye = eye;
+    _lastTime = time;
+
+    if (time - _lastPredictionTime < PREDICTION_INTERVAL)
+        return;
+    _lastPredictionTime = time;
+
+    osg::ref_ptr<EngineContext> context;
+    if (!_context.lock(context))
+        return;
+
+    osg::ref_ptr<const Map> map = context->getMap();
+    if (!map.valid())
+        return;
+
+    // Height above the ellipsoid approximates the distance to the tiles below.
+    GeoPoint eyeGeo;
+    eyeGeo.fromWorld(map->getSRS(), eye);
+    double range = osg::maximum(eyeGeo.z(), 1.0);
+
+    // Ignore movement too slow to leave the tiles we're already looking at.
+    double distance = _velocity.length() * _lookahead;
+    if (distance < range * 0.25)
+    {
+        // Stopped. At the end of a transition the target's tiles are still
+        // wanted; otherwise what we queued is no longer useful.
+        if (_hasTarget)
+            _hasTarget = false;
+        else if (_heading.length2() > 0.0)
+            restart();
+
+        _heading.set(0,0,0);
+        return;
+    }
+
+    // Transitions arc, so don't treat their turns as a change of course.
+    osg::Vec3d heading = _velocity / _velocity.length();
+    if (!_hasTarget && _heading.length2() > 0.0 && (heading * _heading) < COURSE_CHANGE_COS)
+    {
+        OE_DEBUG << LC << "Course changed; canceling prefetch" << std::endl;
+        restart();
+    }
+    _heading = heading;
+
+    osg::Vec3d predicted = eye + _velocity*_lookahead;
+    GeoPoint predictedGeo;
+    predictedGeo.fromWorld(map->getSRS(), predicted);
+
+    std::vector<TileKey> keys;
+    collectKeys(predicted, osg::maximum(predictedGeo.z(), 1.0), keys);
+    submit(keys);
+}
+
+void
+Prefetcher::prefetch(const GeoPoint& focalPoint, double range)
+{
+    osg::Vec3d world;
+    if (!focalPoint.toWorld(world))
+        return;
+
+    Threading::ScopedMutexLock lock(_mutex);
+
+    restart();
+    _hasTarget = true;
+
+    std::vector<TileKey> keys;
+    collectKeys(world, osg::maximum(range, 1.0), keys);
+    submit(keys);
+
+    OE_DEBUG << LC << "Prefetching " << keys.size() << " tiles around " << focalPoint.toString() << std::endl;
+}
+
+void
+Prefetcher::cancel()
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    restart();
+    _heading.set(0,0,0);
+}
+
+void
+Prefetcher::restart()
+{
+    _jobs->cancel();
+    _jobs = new JobGroup();
+    _requested.clear();
+    _hasTarget = false;
+}
+
+void
+Prefetcher::collectKeys(const osg::Vec3d& world, double range, std::vector<TileKey>& out) const
+{
+    osg::ref_ptr<EngineContext> context;
+    if (!_context.lock(context))
+        return;
+
+    osg::ref_ptr<const Map> map = context->getMap();
+    if (!map.valid())
+        return;
+
+    const Profile* profile = map->getProfile();
+
+    GeoPoint point;
+    if (!point.fromWorld(map->getSRS(), world))
+        return;
+    if (!point.transformInPlace(profile->getSRS()))
+        return;
+
+    // Deepest LOD the terrain will show at this range
+    const SelectionInfo& info = context->getSelectionInfo();
+    unsigned firstLOD = context->getOptions().firstLOD().get();
+    unsigned lod = firstLOD;
+    for (unsigned i = firstLOD; i < info.getNumLODs(); ++i)
+    {
+        if (info.visParameters(i)._visibilityRange < range)
+            break;
+        lod = i;
+    }
+
+    TileKey key = profile->createTileKey(point.x(), point.y(), lod);
+    if (!key.valid())
+        return;
+
+    // The tile under the point and its neighbors, then the coarser tiles
+    // that have to load before them.
+    for (int y = -1; y <= 1; ++y)
+    {
+        for (int x = -1; x <= 1; ++x)
+        {
+            TileKey k = (x == 0 && y == 0) ? key : key.createNeighborKey(x, y);
+            if (k.valid())
+                out.push_back(k);
+        }
+    }
+
+    TileKey parent = key.createParentKey();
+    for (unsigned i = 0; i < NUM_ANCESTORS && parent.valid() && parent.getLOD() >= firstLOD; ++i)
+    {
+        out.push_back(parent);
+        parent = parent.createParentKey();
+    }
+}
+
+void
+Prefetcher::submit(const std::vector<TileKey>& keys)
+{
+    osg::ref_ptr<EngineContext> context;
+    if (!_context.lock(context))
+        return;
+
+    JobScheduler* scheduler = Registry::instance()->getJobScheduler();
+
+    for (std::vector<TileKey>::const_iterator key = keys.begin(); key != keys.end(); ++key)
+    {
+        if (_jobs->getNumPending() >= MAX_PENDING_JOBS)
+            break;
+
+        // Already asked for, or already in the scene graph?
+        if (!_requested.insert(*key).second)
+            continue;
+
+        osg::ref_ptr<TileNode> tile;
+        if (context->liveTiles()->get(*key, tile))
+            continue;
+
+        scheduler->submit(
+            new PrefetchTileJob(this, context.get(), *key),
+            JobScheduler::LANE_LOW,
+            _jobs.get() );
+    }
+}
+
+void
+Prefetcher::store(TerrainTileModel* model)
+{
+    Threading::ScopedMutexLock lock(_modelsMutex);
+
+    const TileKey& key = model->getKey();
+    if (_models.find(key) == _models.end())
+    {
+        _modelLRU.push_back(key);
+    }
+    _models[key] = model;
+
+    // Drop the oldest models if the loader isn't picking them up.
+    while (_modelLRU.size() > MAX_PREFETCHED_MODELS)
+    {
+        _models.erase(_modelLRU.front());
+        _modelLRU.pop_front();
+    }
+}
+
+TerrainTileModel*
+Prefetcher::take(const TileKey& key, const Revision& revision)
+{
+    Threading::ScopedMutexLock lock(_modelsMutex);
+
+    Models::iterator i = _models.find(key);
+    if (i == _models.end())
+        return 0L;
+
+    osg::ref_ptr<TerrainTileModel> model = i->second.get();
+    _models.erase(i);
+    _modelLRU.remove(key);
+
+    // A model built before the map changed is no good.
+    if (model->getRevision() != revision)
+        return 0L;
+
+    return model.release();
+}
@@ -6,8 +6,15 @@ $GLSL_DEFAULT_PRECISION_FLOAT
 #pragma vp_order      0.5
 
 #pragma import_defines(OE_TERRAIN_RENDER_NORMAL_MAP)
+#pragma import_defines(OE_TERRAIN_GPU_NORMALS)
 
+#ifdef OE_TERRAIN_GPU_NORMALS
+// normals come from the elevation texture, so sample it in its own space:
+uniform mat4 oe_tile_elevationTexMatrix;
+#define oe_tile_normalTexMatrix oe_tile_elevationTexMatrix
+#else
 uniform mat4 oe_tile_normalTexMatrix;
+#endif
 uniform vec2 oe_tile_elevTexelCoeff;
 
 // stage globals
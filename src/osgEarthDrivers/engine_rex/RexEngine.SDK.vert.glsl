@@ -2,6 +2,8 @@
 $GLSL_DEFAULT_PRECISION_FLOAT
 
 #pragma vp_name Rex Terrain SDK
+#pragma import_defines(OE_TERRAIN_PACKED_NORMALS)
+#pragma import_defines(OE_TERRAIN_GPU_NORMALS)
 
 /**
  * SDK functions for the Rex engine.
@@ -12,11 +14,13 @@ $GLSL_DEFAULT_PRECISION_FLOAT
 uniform sampler2D oe_tile_elevationTex;
 uniform mat4 oe_tile_elevationTexMatrix;
 uniform vec2 oe_tile_elevTexelCoeff;
+uniform vec2 oe_tile_elevDecode; // height = sample*x + y
 
 uniform sampler2D oe_tile_normalTex;
 uniform mat4 oe_tile_normalTexMatrix;
 
 uniform vec4 oe_tile_key;
+uniform vec2 oe_tile_extent; // tile width and height in meters
 
 // Stage global
 vec4 oe_layer_tilec;
@@ -33,7 +37,7 @@ float oe_terrain_getElevationUnscaled(in vec2 uv)
         * oe_tile_elevTexelCoeff.x     // scale
         + oe_tile_elevTexelCoeff.y;
 
-    return texture(oe_tile_elevationTex, elevc).r;
+    return texture(oe_tile_elevationTex, elevc).r * oe_tile_elevDecode.x + oe_tile_elevDecode.y;
 }
 
 /**
@@ -48,7 +52,7 @@ float oe_terrain_getElevation(in vec2 uv)
         + oe_tile_elevTexelCoeff.x * oe_tile_elevationTexMatrix[3].st     // bias
         + oe_tile_elevTexelCoeff.y;
 
-    return texture(oe_tile_elevationTex, elevc).r;
+    return texture(oe_tile_elevationTex, elevc).r * oe_tile_elevDecode.x + oe_tile_elevDecode.y;
 }
 
 /**
@@ -61,20 +65,67 @@ float oe_terrain_getElevation()
 
 /**
  * Read the normal vector and curvature at resolved UV tile coordinates.
+ * The result is encoded: xyz = normal*0.5+0.5, w = curvature*0.5+0.5.
+ * With OE_TERRAIN_GPU_NORMALS the coordinates address the elevation texture.
  */
 vec4 oe_terrain_getNormalAndCurvature(in vec2 uv_scaledBiased)
 {
+#if defined(OE_TERRAIN_GPU_NORMALS)
+    // derive the normal from neighboring elevation samples. At the texture
+    // edge the differences become one-sided, like the CPU normal maps when
+    // no neighbor data is available.
+    vec2 size = vec2(textureSize(oe_tile_elevationTex, 0));
+    vec2 texel = 1.0/size;
+    vec2 lo = max(uv_scaledBiased - texel, 0.5*texel);
+    vec2 hi = min(uv_scaledBiased + texel, 1.0 - 0.5*texel);
+
+    float c = texture(oe_tile_elevationTex, uv_scaledBiased).r;
+    float w = texture(oe_tile_elevationTex, vec2(lo.x, uv_scaledBiased.y)).r;
+    float e = texture(oe_tile_elevationTex, vec2(hi.x, uv_scaledBiased.y)).r;
+    float s = texture(oe_tile_elevationTex, vec2(uv_scaledBiased.x, lo.y)).r;
+    float n = texture(oe_tile_elevationTex, vec2(uv_scaledBiased.x, hi.y)).r;
+
+    // meters between samples (an inherited texture covers more than the tile):
+    vec2 interval = oe_tile_extent / (oe_tile_elevationTexMatrix[0][0] * max(size-1.0, 1.0));
+    vec2 span = max((hi-lo)*size, 1.0) * interval;
+
+    vec3 normal = normalize(vec3(
+        (w-e)*oe_tile_elevDecode.x / span.x,
+        (s-n)*oe_tile_elevDecode.x / span.y,
+        1.0));
+
+    // curvature (2nd derivative of elevation), as in the CPU normal map:
+    float D = (0.5*(w+e) - c)*oe_tile_elevDecode.x / (interval.x*interval.x);
+    float E = (0.5*(s+n) - c)*oe_tile_elevDecode.x / (interval.y*interval.y);
+    float curvature = clamp(-2.0*(D+E)*100.0, -1.0, 1.0);
+
+    return vec4(normal, curvature)*0.5+0.5;
+
+#elif defined(OE_TERRAIN_PACKED_NORMALS)
+    // two-channel octahedral normal; no curvature.
+    vec2 f = texture(oe_tile_normalTex, uv_scaledBiased).xy*2.0-1.0;
+    vec3 n = vec3(f, 1.0-abs(f.x)-abs(f.y));
+    float t = clamp(-n.z, 0.0, 1.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return vec4(normalize(n)*0.5+0.5, 0.5);
+#else
     return texture(oe_tile_normalTex, uv_scaledBiased);
+#endif
 }
 
 vec4 oe_terrain_getNormalAndCurvature()
 {
+#ifdef OE_TERRAIN_GPU_NORMALS
+    mat4 normalTexMatrix = oe_tile_elevationTexMatrix;
+#else
+    mat4 normalTexMatrix = oe_tile_normalTexMatrix;
+#endif
     vec2 uv_scaledBiased = oe_layer_tilec.st
-        * oe_tile_elevTexelCoeff.x * oe_tile_normalTexMatrix[0][0]
-        + oe_tile_elevTexelCoeff.x * oe_tile_normalTexMatrix[3].st
+        * oe_tile_elevTexelCoeff.x * normalTexMatrix[0][0]
+        + oe_tile_elevTexelCoeff.x * normalTexMatrix[3].st
         + oe_tile_elevTexelCoeff.y;
 
-    return texture(oe_tile_normalTex, uv_scaledBiased);
+    return oe_terrain_getNormalAndCurvature(uv_scaledBiased);
 }
 
 /**
@@ -6,6 +6,7 @@
 #pragma vp_order      0.7
 
 #pragma import_defines(OE_TERRAIN_RENDER_ELEVATION)
+#pragma import_defines(OE_TERRAIN_TESSELLATION)
 
 // Vertex Markers:
 #define VERTEX_MARKER_DISCARD  1
@@ -26,7 +27,8 @@ float oe_terrain_getElevation(in vec2 uv);
 
 void oe_rexEngine_elevation(inout vec4 vertexModel)
 {
-#ifdef OE_TERRAIN_RENDER_ELEVATION
+// With hardware tessellation the TES applies the elevation instead.
+#if defined(OE_TERRAIN_RENDER_ELEVATION) && !defined(OE_TERRAIN_TESSELLATION)
 
     bool ignore =
         ((oe_terrain_vertexMarker & VERTEX_MARKER_BOUNDARY) != 0) ||
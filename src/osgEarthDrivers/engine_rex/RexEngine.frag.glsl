@@ -13,14 +13,26 @@ $GLSL_DEFAULT_PRECISION_FLOAT
 #pragma import_defines(OE_IS_PICK_CAMERA)
 #pragma import_defines(OE_IS_SHADOW_CAMERA)
 #pragma import_defines(OE_IS_DEPTH_CAMERA)
+#pragma import_defines(OE_TERRAIN_IMAGE_SEQUENCE)
 
+#ifdef OE_TERRAIN_IMAGE_SEQUENCE
+// time-sequence layer: one array slice per resident time step
+uniform sampler2DArray oe_layer_tex;
+uniform int oe_layer_texSlice;
+#else
 uniform sampler2D oe_layer_tex;
+#endif
 uniform int       oe_layer_uid;
 uniform int       oe_layer_order;
 uniform float     oe_layer_opacity;
 
 #ifdef OE_TERRAIN_MORPH_IMAGERY
+#ifdef OE_TERRAIN_IMAGE_SEQUENCE
+uniform sampler2DArray oe_layer_texParent;
+uniform int oe_layer_texParentSlice;
+#else
 uniform sampler2D oe_layer_texParent;
+#endif
 uniform float oe_layer_texParentExists;
 in vec4 oe_layer_texcParent;
 in float oe_rex_morphFactor;
@@ -72,12 +84,20 @@ void oe_rexEngine_frag(inout vec4 color)
 #endif
 
     float isImageLayer = oe_layer_uid >= 0 ? 1.0 : 0.0;
+#ifdef OE_TERRAIN_IMAGE_SEQUENCE
+	vec4 texelSelf = texture(oe_layer_tex, vec3(oe_layer_texc.st, float(oe_layer_texSlice)));
+#else
 	vec4 texelSelf = texture(oe_layer_tex, oe_layer_texc.st);
+#endif
 
 #ifdef OE_TERRAIN_MORPH_IMAGERY
 
     // sample the parent texture:
+#ifdef OE_TERRAIN_IMAGE_SEQUENCE
+	vec4 texelParent = texture(oe_layer_texParent, vec3(oe_layer_texcParent.st, float(oe_layer_texParentSlice)));
+#else
 	vec4 texelParent = texture(oe_layer_texParent, oe_layer_texcParent.st);
+#endif
 
     // if the parent texture does not exist, use the current texture with alpha=0 as the parent
     // so we can "fade in" an image layer that starts at LOD > 0:
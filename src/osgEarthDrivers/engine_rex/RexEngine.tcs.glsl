@@ -1,4 +1,85 @@
-#version $GLSL_VERSION_STR
-$GLSL_DEFAULT_PRECISION_FLOAT
+#version 400
 
+#pragma vp_name       REX Engine - TCS
+#pragma vp_entryPoint oe_rexEngine_tcs
+#pragma vp_location   tess_control
+
+#pragma import_defines(OE_TERRAIN_RENDER_ELEVATION)
+
+layout(vertices=3) out;
+
+// Vertex Markers:
+#define VERTEX_MARKER_DISCARD  1
+#define VERTEX_MARKER_BOUNDARY 8
+
+uniform float oe_terrain_tessPixels;
+uniform vec2  oe_ViewportSize;
+
+// stage globals
+vec4 vp_Vertex;
+vec3 vp_Normal;
+vec4 oe_layer_tilec;
+int oe_terrain_vertexMarker;
+
+// SDK functions:
+void VP_LoadVertex(in int);
+float oe_terrain_getElevation(in vec2 uv);
+
+vec3  oe_rex_corner[3];
+float oe_rex_elev[3];
+vec2  oe_rex_uv[3];
+
+// Tessellation level for the edge between corners a and b. It depends only
+// on the edge itself, so the two triangles sharing an edge (in this tile or
+// in a neighbor at the same LOD) split it the same way and stay water-tight.
+float oe_rex_edgeLevel(in int a, in int b)
+{
+    vec3 A = (gl_ModelViewMatrix * vec4(oe_rex_corner[a],1.0)).xyz;
+    vec3 B = (gl_ModelViewMatrix * vec4(oe_rex_corner[b],1.0)).xyz;
+    float len = distance(A, B);
+
+    // projected size of the edge, as a sphere so it doesn't vary with orientation:
+    float dist = max(length(0.5*(A+B)), 1.0);
+    float pixels = len * gl_ProjectionMatrix[1][1] * 0.5 * oe_ViewportSize.y / dist;
+
+    // curvature: how far the terrain at the midpoint departs from the straight edge.
+    // Smooth edges split into longer pieces than rough ones.
+    float roughness = 1.0;
+#ifdef OE_TERRAIN_RENDER_ELEVATION
+    float mid = oe_terrain_getElevation(0.5*(oe_rex_uv[a]+oe_rex_uv[b]));
+    float deviation = abs(mid - 0.5*(oe_rex_elev[a]+oe_rex_elev[b]));
+    roughness = clamp(4.0*deviation/max(len, 1.0), 0.25, 1.0);
+#endif
+
+    return clamp(pixels*roughness/max(oe_terrain_tessPixels, 1.0), 1.0, 64.0);
+}
+
+void oe_rexEngine_tcs()
+{
+    if (gl_InvocationID == 0)
+    {
+        for(int i=0; i<3; ++i)
+        {
+            VP_LoadVertex(i);
+            bool ignore =
+                ((oe_terrain_vertexMarker & VERTEX_MARKER_BOUNDARY) != 0) ||
+                ((oe_terrain_vertexMarker & VERTEX_MARKER_DISCARD)  != 0);
+            oe_rex_uv[i] = oe_layer_tilec.st;
+#ifdef OE_TERRAIN_RENDER_ELEVATION
+            oe_rex_elev[i] = ignore ? 0.0 : oe_terrain_getElevation(oe_layer_tilec.st);
+#else
+            oe_rex_elev[i] = 0.0;
+#endif
+            oe_rex_corner[i] = vp_Vertex.xyz + normalize(vp_Normal)*oe_rex_elev[i];
+        }
+
+        // outer level N is the edge opposite corner N:
+        gl_TessLevelOuter[0] = oe_rex_edgeLevel(1, 2);
+        gl_TessLevelOuter[1] = oe_rex_edgeLevel(2, 0);
+        gl_TessLevelOuter[2] = oe_rex_edgeLevel(0, 1);
+        gl_TessLevelInner[0] = max(gl_TessLevelOuter[0], max(gl_TessLevelOuter[1], gl_TessLevelOuter[2]));
+
+        // restore this invocation's vertex for the output copy:
+        VP_LoadVertex(gl_InvocationID);
+    }
 }
@@ -4,7 +4,70 @@
 #pragma vp_entryPoint oe_rexEngine_tes
 #pragma vp_location   tess_eval
 
+#pragma import_defines(OE_TERRAIN_RENDER_ELEVATION)
+
+// osgEarth terrain is always CCW winding
+layout(triangles, equal_spacing, ccw) in;
+
+// Vertex Markers:
+#define VERTEX_MARKER_DISCARD  1
+#define VERTEX_MARKER_BOUNDARY 8
+
+// stage globals
+vec4 vp_Vertex;
+vec3 vp_Normal;
+vec4 oe_layer_tilec;
+int oe_terrain_vertexMarker;
+
+// Internal helpers:
+void VP_LoadVertex(in int);
+void VP_Interpolate3();
+void VP_EmitVertex();
+
+// SDK functions:
+float oe_terrain_getElevation(in vec2 uv);
+
+float VP_Interpolate3(float a, float b, float c)
+{
+    return dot(gl_TessCoord.xyz, vec3(a,b,c));
+}
+
+vec2 VP_Interpolate3(vec2 a, vec2 b, vec2 c)
+{
+    return mat3x2(a,b,c) * gl_TessCoord.xyz;
+}
+
+vec3 VP_Interpolate3(vec3 a, vec3 b, vec3 c)
+{
+    return mat3(a,b,c) * gl_TessCoord.xyz;
+}
+
+vec4 VP_Interpolate3(vec4 a, vec4 b, vec4 c)
+{
+    return mat3x4(a,b,c) * gl_TessCoord.xyz;
+}
+
+// Places each generated vertex on the terrain. This replaces the elevation
+// of the vertex_model stage, which would only lift the base grid's corners.
 void oe_rexEngine_tes(void)
 {
-    //todo
+    // boundary vertices stay at zero, and the ones between fade out:
+    vec3 weight;
+    for(int i=0; i<3; ++i)
+    {
+        VP_LoadVertex(i);
+        bool ignore =
+            ((oe_terrain_vertexMarker & VERTEX_MARKER_BOUNDARY) != 0) ||
+            ((oe_terrain_vertexMarker & VERTEX_MARKER_DISCARD)  != 0);
+        weight[i] = ignore ? 0.0 : 1.0;
+    }
+
+    VP_Interpolate3();
+
+#ifdef OE_TERRAIN_RENDER_ELEVATION
+    float elev = oe_terrain_getElevation(oe_layer_tilec.st) * dot(gl_TessCoord.xyz, weight);
+    vp_Vertex.xyz += normalize(vp_Normal) * elev;
+#endif
+
+    VP_EmitVertex();
 }
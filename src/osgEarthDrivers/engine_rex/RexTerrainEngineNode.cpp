@@ -37,6 +37,7 @@
 #include <osg/Depth>
 #include <osg/CullFace>
 #include <osg/ValueObject>
+#include <osg/DisplaySettings>
 
 #include <cstdlib> // for getenv
 
@@ -270,6 +271,24 @@ RexTerrainEngineNode::setMap(const Map* map, const TerrainOptions& options)
         _terrainOptions.morphTerrain() = false;
     }
 
+    // Hardware tessellation subdivides a coarse base grid on the GPU, so the
+    // tile mesh only needs a few vertices. Geometry morphing moves the grid
+    // vertices and doesn't apply.
+    if (_terrainOptions.gpuTessellation() == true)
+    {
+        if (Registry::capabilities().supportsGLSL(400u))
+        {
+            if (!_terrainOptions.tileSize().isSet())
+                _terrainOptions.tileSize().init(5);
+            _terrainOptions.morphTerrain() = false;
+        }
+        else
+        {
+            OE_WARN << LC << "GPU tessellation requires GLSL 4.0; disabled" << std::endl;
+            _terrainOptions.gpuTessellation() = false;
+        }
+    }
+
     if (_terrainOptions.rangeMode() == osg::LOD::PIXEL_SIZE_ON_SCREEN)
     {
         OE_INFO << LC << "Range mode = pixel size; pixel tile size = " << _terrainOptions.tilePixelSize().get() << std::endl;
@@ -290,14 +309,26 @@ RexTerrainEngineNode::setMap(const Map* map, const TerrainOptions& options)
         if (getStateSet()) getStateSet()->removeDefine("OE_DEBUG_NORMALS");
 
     // check for normal map generation (required for lighting).
+    // GPU normals come from the elevation texture, so need no normal textures.
     if ( _terrainOptions.normalMaps() == true )
     {
-        this->_requireNormalTextures = true;
+        if (_terrainOptions.gpuNormalMaps() == true)
+            getOrCreateStateSet()->setDefine("OE_TERRAIN_GPU_NORMALS");
+        else
+            this->_requireNormalTextures = true;
     }
 
+    // packed normal maps need decoding in the terrain SDK.
+    if (_terrainOptions.packedElevationTextures() == true)
+        getOrCreateStateSet()->setDefine("OE_TERRAIN_PACKED_NORMALS");
+
     // ensure we get full coverage at the first LOD.
     this->_requireFullDataAtFirstLOD = true;
 
+    // a tile that has no data of its own for a layer keeps using its
+    // parent's texture with a scale/bias matrix.
+    this->_requireFallbackData = false;
+
     // A shared registry for tile nodes in the scene graph. Enable revision tracking
     // if requested in the options. Revision tracking lets the registry notify all
     // live tiles of the current map revision so they can inrementally update
@@ -310,28 +341,63 @@ RexTerrainEngineNode::setMap(const Map* map, const TerrainOptions& options)
     _releaser = new ResourceReleaser();
     this->addChild(_releaser.get());
 
+    // Every tile texture of a given layer has the same size and format, so
+    // when a tile is released its GL texture objects can be recycled by the
+    // next tile instead of being deleted and re-created. OSG does this by
+    // profile as long as the texture pool has room; this also gives us a
+    // fixed ceiling on texture memory. Must be set before the viewer creates
+    // its graphics contexts.
+    if ( _terrainOptions.texturePoolSize().get() > 0u )
+    {
+        unsigned poolSize = _terrainOptions.texturePoolSize().get() * 1024u * 1024u;
+        if ( osg::DisplaySettings::instance()->getMaxTexturePoolSize() < poolSize )
+        {
+            osg::DisplaySettings::instance()->setMaxTexturePoolSize( poolSize );
+            OE_INFO << LC << "Texture pool size = " << _terrainOptions.texturePoolSize().get() << " MB" << std::endl;
+        }
+    }
+
     // A shared geometry pool.
     _geometryPool = new GeometryPool( _terrainOptions );
     _geometryPool->setReleaser( _releaser.get());
     this->addChild( _geometryPool.get() );
 
     // Make a tile loader
-    PagerLoader* loader = new PagerLoader( this );
-    loader->setNumLODs(_terrainOptions.maxLOD().getOrUse(DEFAULT_MAX_LOD));
-    loader->setMergesPerFrame( _terrainOptions.mergesPerFrame().get() );
-    for (std::vector<RexTerrainEngineOptions::LODOptions>::const_iterator i = _terrainOptions.lods().begin(); i != _terrainOptions.lods().end(); ++i) {
-        if (i->_lod.isSet()) {
-            loader->setLODPriorityScale(i->_lod.get(), i->_priorityScale.getOrUse(1.0f));
-            loader->setLODPriorityOffset(i->_lod.get(), i->_priorityOffset.getOrUse(0.0f));
+    if (_terrainOptions.asyncLoader() == true)
+    {
+        AsyncLoader* loader = new AsyncLoader( this );
+        loader->setNumLODs(_terrainOptions.maxLOD().getOrUse(DEFAULT_MAX_LOD));
+        loader->setMergesPerFrame( _terrainOptions.mergesPerFrame().get() );
+        loader->setMergeBudget( _terrainOptions.mergeBudget().get() );
+        for (std::vector<RexTerrainEngineOptions::LODOptions>::const_iterator i = _terrainOptions.lods().begin(); i != _terrainOptions.lods().end(); ++i) {
+            if (i->_lod.isSet()) {
+                loader->setLODPriorityScale(i->_lod.get(), i->_priorityScale.getOrUse(1.0f));
+                loader->setLODPriorityOffset(i->_lod.get(), i->_priorityOffset.getOrUse(0.0f));
+            }
+        }
+        _loader = loader;
+    }
+    else
+    {
+        PagerLoader* loader = new PagerLoader( this );
+        loader->setNumLODs(_terrainOptions.maxLOD().getOrUse(DEFAULT_MAX_LOD));
+        loader->setMergesPerFrame( _terrainOptions.mergesPerFrame().get() );
+        loader->setMergeBudget( _terrainOptions.mergeBudget().get() );
+        for (std::vector<RexTerrainEngineOptions::LODOptions>::const_iterator i = _terrainOptions.lods().begin(); i != _terrainOptions.lods().end(); ++i) {
+            if (i->_lod.isSet()) {
+                loader->setLODPriorityScale(i->_lod.get(), i->_priorityScale.getOrUse(1.0f));
+                loader->setLODPriorityOffset(i->_lod.get(), i->_priorityOffset.getOrUse(0.0f));
+            }
         }
+        _loader = loader;
     }
 
-    _loader = loader;
     this->addChild( _loader.get() );
 
     // Make a tile unloader
     _unloader = new UnloaderGroup( _liveTiles.get() );
     _unloader->setThreshold( _terrainOptions.expirationThreshold().get() );
+    _unloader->setMaxBytes( (size_t)_terrainOptions.tileMemoryBudget().get() * 1024u * 1024u );
     _unloader->setReleaser(_releaser.get());
     this->addChild( _unloader.get() );
 
@@ -369,6 +435,15 @@ RexTerrainEngineNode::setMap(const Map* map, const TerrainOptions& options)
         _selectionInfo,
         _modifyBBoxCallback.get());
 
+    // Load tiles ahead of the camera if requested
+    if ( _terrainOptions.prefetchLookahead().get() > 0u )
+    {
+        _prefetcher = new Prefetcher( _engineContext.get() );
+        _prefetcher->setLookahead( 0.001 * (double)_terrainOptions.prefetchLookahead().get() );
+        _engineContext->_prefetcher = _prefetcher.get();
+        OE_INFO << LC << "Prefetch lookahead = " << _terrainOptions.prefetchLookahead().get() << " ms" << std::endl;
+    }
+
     // Calculate the LOD morphing parameters:
     unsigned maxLOD = _terrainOptions.maxLOD().getOrUse(DEFAULT_MAX_LOD);
 
@@ -431,6 +506,57 @@ RexTerrainEngineNode::getSurfaceStateSet()
     return _imageLayerStateSet.get();
 }
 
+void
+RexTerrainEngineNode::prefetch(const GeoPoint& focalPoint, double range)
+{
+    if ( _prefetcher.valid() )
+    {
+        _prefetcher->prefetch( focalPoint, range );
+    }
+}
+
+void
+RexTerrainEngineNode::cancelPrefetch()
+{
+    if ( _prefetcher.valid() )
+    {
+        _prefetcher->cancel();
+    }
+}
+
+namespace
+{
+    // Adds up the texture data each tile owns for one layer's rendering pass.
+    struct SumLayerTextureBytes : public TileNodeRegistry::ConstOperation
+    {
+        SumLayerTextureBytes(UID uid) : _uid(uid), _bytes(0u) { }
+
+        void operator()(const TileNodeRegistry::TileNodeMap& tiles) const
+        {
+            for (TileNodeRegistry::TileNodeMap::const_iterator i = tiles.begin(); i != tiles.end(); ++i)
+            {
+                const RenderingPass* pass = i->second.tile->renderModel().getPass(_uid);
+                if (pass)
+                    _bytes += pass->getTotalDataSize();
+            }
+        }
+
+        UID            _uid;
+        mutable size_t _bytes;
+    };
+}
+
+void
+RexTerrainEngineNode::getMemoryUsage(const Layer* layer, Layer::MemoryUsage& usage) const
+{
+    if ( !layer || !_liveTiles.valid() )
+        return;
+
+    SumLayerTextureBytes sum( layer->getUID() );
+    _liveTiles->run( sum );
+    usage._textureBytes += sum._bytes;
+}
+
 void
 RexTerrainEngineNode::setupRenderBindings()
 {
@@ -500,6 +626,12 @@ RexTerrainEngineNode::dirtyTerrain()
     // clear the loader:
     _loader->clear();
 
+    // anything being prefetched is out of date:
+    if ( _prefetcher.valid() )
+    {
+        _prefetcher->cancel();
+    }
+
     // clear out the tile registry:
     if ( _liveTiles.valid() )
     {
@@ -580,6 +712,35 @@ RexTerrainEngineNode::dirtyState()
     updateState();
 }
 
+// Frames a camera may go without culling before its render data is released.
+#define RENDER_DATA_POOL_MAX_AGE 120u
+
+osg::ref_ptr<TerrainRenderData>
+RexTerrainEngineNode::acquireRenderData(const osg::Camera* camera, unsigned frame)
+{
+    Threading::ScopedMutexLock lock(_renderDataPoolsMutex);
+
+    osg::ref_ptr<TerrainRenderDataPool> pool = _renderDataPools[camera].get();
+    if (!pool.valid())
+    {
+        pool = new TerrainRenderDataPool();
+        pool->_lastFrame = frame;
+        _renderDataPools[camera] = pool.get();
+
+        // a new camera is a good time to forget the ones that went away.
+        for (RenderDataPools::iterator i = _renderDataPools.begin(); i != _renderDataPools.end(); )
+        {
+            if (frame - i->second->_lastFrame > RENDER_DATA_POOL_MAX_AGE)
+                _renderDataPools.erase(i++);
+            else
+                ++i;
+        }
+    }
+
+    pool->_lastFrame = frame;
+    return pool->acquire();
+}
+
 void
 RexTerrainEngineNode::traverse(osg::NodeVisitor& nv)
 {
@@ -609,7 +770,8 @@ RexTerrainEngineNode::traverse(osg::NodeVisitor& nv)
         getEngineContext()->startCull( cv );
 
         // Initialize a new culler
-        TerrainCuller culler(cv, this->getEngineContext());
+        unsigned frame = nv.getFrameStamp() ? nv.getFrameStamp()->getFrameNumber() : 0u;
+        TerrainCuller culler(cv, this->getEngineContext(), acquireRenderData(cv->getCurrentCamera(), frame).get());
 
         // Prepare the culler with the set of renderable layers:
         culler.setup(getMap(), _cachedLayerExtents, this->getEngineContext()->getRenderBindings());
@@ -638,9 +800,10 @@ RexTerrainEngineNode::traverse(osg::NodeVisitor& nv)
 
         // If we're using geometry pooling, optimize the drawable for shared state
         // by sorting the draw commands
-        if (getEngineContext()->getGeometryPool()->isEnabled())
+        bool stateSort = getEngineContext()->getOptions().stateSortTiles() == true;
+        if (stateSort || getEngineContext()->getGeometryPool()->isEnabled())
         {
-            culler._terrain.sortDrawCommands();
+            culler._terrain.sortDrawCommands(stateSort);
         }
 
         // The common stateset for the terrain group:
@@ -731,6 +894,12 @@ RexTerrainEngineNode::traverse(osg::NodeVisitor& nv)
         // marks the end of the cull pass
         this->getEngineContext()->endCull( cv );
 
+        // follow the camera so we can load tiles ahead of it
+        if ( _prefetcher.valid() )
+        {
+            _prefetcher->cull( cv );
+        }
+
         // If the culler found any orphaned data, we need to update the render model
         // during the next update cycle.
         if (culler._orphanedPassesDetected > 0u)
@@ -1236,6 +1405,12 @@ RexTerrainEngineNode::addTileLayer(Layer* tileLayer)
             osg::StateSet* stateSet = imageLayer->getOrCreateStateSet();
             VirtualProgram* vp = VirtualProgram::getOrCreate(stateSet);
             shaders.load(vp, shaders.ENGINE_FRAG);
+
+            // A time-sequence layer's tiles are texture arrays (see TileNode::merge).
+            if (imageLayer->options().sequenceLookahead().get() > 0u)
+            {
+                stateSet->setDefine("OE_TERRAIN_IMAGE_SEQUENCE");
+            }
         }
 
         else
@@ -1417,8 +1592,18 @@ RexTerrainEngineNode::updateState()
                 surfaceStateSet->setDefine("OE_TERRAIN_RENDER_ELEVATION");
             }
 
+            // Hardware tessellation: the TES applies the elevation.
+            if (_terrainOptions.gpuTessellation() == true)
+            {
+                package.load(surfaceVP, package.ENGINE_TCS);
+                package.load(surfaceVP, package.ENGINE_TES);
+                surfaceStateSet->setDefine("OE_TERRAIN_TESSELLATION");
+                surfaceStateSet->addUniform(new osg::Uniform("oe_terrain_tessPixels", _terrainOptions.tessellationPixels().get()));
+            }
+
             // Normal mapping shaders:
-            if ( this->normalTexturesRequired() )
+            if ( this->normalTexturesRequired() ||
+                 (_terrainOptions.normalMaps() == true && _terrainOptions.gpuNormalMaps() == true) )
             {
                 package.load(surfaceVP, package.NORMAL_MAP_VERT);
                 package.load(surfaceVP, package.NORMAL_MAP_FRAG);
@@ -26,7 +26,9 @@
 using namespace osgEarth::Drivers::RexTerrainEngine;
 
 
-TerrainCuller::TerrainCuller(osgUtil::CullVisitor* cullVisitor, EngineContext* context) :
+TerrainCuller::TerrainCuller(osgUtil::CullVisitor* cullVisitor, EngineContext* context, TerrainRenderData* renderData) :
+_terrainRef(renderData),
+_terrain(*renderData),
 _camera(0L),
 _currentTileNode(0L),
 _orphanedPassesDetected(0u),
@@ -53,6 +55,7 @@ TerrainCuller::setup(const Map* map, LayerExtentVector& layerExtents, const Rend
     unsigned frameNum = getFrameStamp() ? getFrameStamp()->getFrameNumber() : 0u;
     _layerExtents = &layerExtents;
     _terrain.setup(map, bindings, frameNum, _cv);
+    _terrain._drawState->_batchGeometry = _context->getOptions().batchTileDraws() == true;
 }
 
 float
@@ -79,8 +82,8 @@ TerrainCuller::addDrawCommand(UID uid, const TileRenderModel* model, const Rende
     }
 
     // add a new Draw command to the appropriate layer
-    osg::ref_ptr<LayerDrawable> drawable = _terrain.layer(uid);
-    if (drawable.valid())
+    LayerDrawable* drawable = _terrain.layer(uid);
+    if (drawable)
     {
         // Layer marked for drawing?
         if (drawable->_draw)
@@ -91,7 +94,7 @@ TerrainCuller::addDrawCommand(UID uid, const TileRenderModel* model, const Rende
                 const LayerExtent& le = (*_layerExtents)[drawable->_layer->getUID()];
                 if (le._computed && 
                     le._extent.isValid() &&
-                    le._extent.intersects(tileNode->getKey().getExtent()) == false)
+                    le._extent.intersects(tileNode->getKey().getBounds()) == false)
                 {
                     // culled out!
                     //OE_DEBUG << LC << "Skippping " << drawable->_layer->getName() 
@@ -101,6 +104,9 @@ TerrainCuller::addDrawCommand(UID uid, const TileRenderModel* model, const Rende
                 }
             }
 
+            // Note: the caller may hold on to this pointer while it adds the
+            // commands for the tile's other passes. Those go to other layers,
+            // so growing this vector later won't invalidate it.
             drawable->_tiles.push_back(DrawTileCommand());
             DrawTileCommand* tile = &drawable->_tiles.back();
 
@@ -111,6 +117,7 @@ TerrainCuller::addDrawCommand(UID uid, const TileRenderModel* model, const Rende
             tile->_keyValue = tileNode->getTileKeyValue();
             tile->_geom = surface->getDrawable()->_geom.get();
             tile->_morphConstants = tileNode->getMorphConstants();
+            tile->_tileExtent = tileNode->getTileExtent();
             tile->_key = &tileNode->getKey();
             tile->_order = drawable->_order; // layer order in map tile.
 
@@ -133,6 +140,11 @@ TerrainCuller::addDrawCommand(UID uid, const TileRenderModel* model, const Rende
                 // remove the border, and shift an extra texel over as well. Giving us this:
                 float size = (float)elevRaster->s();
                 tile->_elevTexelCoeff.set((size - (2.0*bias)) / size, bias / size);
+
+                // Packed 16-bit elevation textures need a per-tile scale/bias to decode:
+                tile->_elevDecode = surface->getDrawable()->getElevationDecode();
+
+                tile->_elevRange = surface->getDrawable()->getElevationRange();
             }
 
             return tile;
@@ -229,6 +241,11 @@ TerrainCuller::apply(osg::Node& node)
             for (unsigned p = 0; p < renderModel._passes.size(); ++p)
             {
                 const RenderingPass& pass = renderModel._passes[p];
+
+                // the layer decided it has nothing to draw on this tile.
+                if (pass.culled())
+                    continue;
+
                 DrawTileCommand* cmd = addDrawCommand(pass.sourceUID(), &renderModel, &pass, _currentTileNode);
                 if (cmd)
                 {
@@ -19,6 +19,7 @@
 #include "TerrainRenderData"
 #include "TileNode"
 #include "SurfaceNode"
+#include <algorithm>
 
 using namespace osgEarth::Drivers::RexTerrainEngine;
 
@@ -27,11 +28,15 @@ using namespace osgEarth::Drivers::RexTerrainEngine;
 
 
 void
-TerrainRenderData::sortDrawCommands()
+TerrainRenderData::sortDrawCommands(bool byState)
 {
     for (LayerDrawableList::iterator i = _layerList.begin(); i != _layerList.end(); ++i)
     {
-        i->get()->_tiles.sort();
+        DrawTileCommands& tiles = i->get()->_tiles;
+        if (byState)
+            std::sort(tiles.begin(), tiles.end(), DrawTileCommand::SortByState());
+        else
+            std::sort(tiles.begin(), tiles.end());
     }
 }
 
@@ -43,8 +48,16 @@ TerrainRenderData::setup(const Map* map,
 {
     _bindings = &bindings;
 
-    // Create a new State object to track sampler and uniform settings
-    _drawState = new DrawState();
+    // Recycle last frame's containers (their capacity) and drawables.
+    _layerList.clear();
+    _layerMap.clear();
+    _patchLayers.clear();
+
+    // State object to track sampler and uniform settings
+    if (_drawState.valid())
+        _drawState->reset();
+    else
+        _drawState = new DrawState();
     _drawState->_frame = frameNum;
     _drawState->_bindings = &bindings;
     
@@ -56,8 +69,8 @@ TerrainRenderData::setup(const Map* map,
         (cam->getClearMask() & GL_DEPTH_BUFFER_BIT) != 0u;
 
     // Make a drawable for each rendering pass (i.e. each render-able map layer).
-    LayerVector layers;
-    map->getLayers(layers);
+    osg::ref_ptr<const MapLayerSnapshot> snapshot = map->getLayerSnapshot();
+    const LayerVector& layers = snapshot->layers();
 
     for (LayerVector::const_iterator i = layers.begin(); i != layers.end(); ++i)
     {
@@ -109,8 +122,43 @@ TerrainRenderData::setup(const Map* map,
     }
 
     // Include a "blank" layer for missing data.
+    if (!_blankStateSet.valid())
+    {
+        _blankStateSet = new osg::StateSet();
+        _blankStateSet->setDefine("OE_TERRAIN_RENDER_IMAGERY", osg::StateAttribute::OFF);
+    }
     LayerDrawable* blank = addLayerDrawable(0L);
-    blank->getOrCreateStateSet()->setDefine("OE_TERRAIN_RENDER_IMAGERY", osg::StateAttribute::OFF);
+    blank->setStateSet(_blankStateSet.get());
+}
+
+bool
+TerrainRenderData::isFree() const
+{
+    // in use by a culler?
+    if (referenceCount() > 1)
+        return false;
+
+    // still in a render graph? (these are also in _drawables)
+    for (LayerDrawableList::const_iterator i = _layerList.begin(); i != _layerList.end(); ++i)
+    {
+        if (i->get()->referenceCount() > 2)
+            return false;
+    }
+    return true;
+}
+
+TerrainRenderData*
+TerrainRenderDataPool::acquire()
+{
+    for (unsigned i = 0; i < _pool.size(); ++i)
+    {
+        if (_pool[i]->isFree())
+            return _pool[i].get();
+    }
+
+    _pool.push_back(new TerrainRenderData());
+    OE_DEBUG << LC << "Render data pool grew to " << _pool.size() << std::endl;
+    return _pool.back().get();
 }
 
 namespace
@@ -131,9 +179,15 @@ LayerDrawable*
 TerrainRenderData::addLayerDrawable(const Layer* layer)
 {
     UID uid = layer ? layer->getUID() : -1;
-    LayerDrawable* ld = new LayerDrawable();
+
+    // reuse one of last frame's drawables if there's one left.
+    if (_layerList.size() == _drawables.size())
+        _drawables.push_back(new LayerDrawable());
+    LayerDrawable* ld = _drawables[_layerList.size()].get();
+    ld->reset();
+
     _layerList.push_back(ld);
-    _layerMap[uid] = ld;
+    _layerMap.push_back(std::make_pair(uid, ld));
     ld->_layer = layer;
     ld->_visibleLayer = dynamic_cast<const VisibleLayer*>(layer);
     ld->_imageLayer = dynamic_cast<const ImageLayer*>(layer);
@@ -144,5 +198,9 @@ TerrainRenderData::addLayerDrawable(const Layer* layer)
         ld->setStateSet(layer->getStateSet());
         ld->_renderType = layer->getRenderType();
     }
+    if (GPUTimer::enabled())
+    {
+        ld->_gpuTimerName = layer ? "terrain." + layer->getName() : "terrain.surface";
+    }
     return ld;
 }
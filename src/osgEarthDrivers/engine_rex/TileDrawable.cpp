@@ -20,9 +20,12 @@
 
 #include <osg/Version>
 #include <iterator>
+#include <map>
+#include <cfloat>
 #include <osgEarth/Registry>
 #include <osgEarth/Capabilities>
 #include <osgEarth/ImageUtils>
+#include <osgEarth/ImageToHeightFieldConverter>
 
 using namespace osg;
 using namespace osgEarth::Drivers::RexTerrainEngine;
@@ -30,22 +33,55 @@ using namespace osgEarth;
 
 #define LC "[TileDrawable] "
 
+namespace
+{
+    // The mesh topology only depends on the tile size, so all tiles of the
+    // same size share one BVH layout. Each tile refits the bounds to its
+    // own elevated mesh.
+    typedef std::map<int, osg::ref_ptr<TriangleBVH::Layout> > MeshLayouts;
+    MeshLayouts      s_meshLayouts;
+    Threading::Mutex s_meshLayoutsMutex;
+
+    TriangleBVH::Layout* getMeshLayout(int tileSize, const GLuint* indices)
+    {
+        Threading::ScopedMutexLock lock(s_meshLayoutsMutex);
+
+        osg::ref_ptr<TriangleBVH::Layout>& layout = s_meshLayouts[tileSize];
+        if (!layout.valid())
+        {
+            // Split in grid space so the result suits any tile, whatever
+            // its location or elevation.
+            std::vector<osg::Vec3f> grid(tileSize*tileSize);
+            for(int t=0; t<tileSize; ++t)
+                for(int s=0; s<tileSize; ++s)
+                    grid[t*tileSize+s].set((float)s, (float)t, 0.0f);
+
+            layout = new TriangleBVH::Layout(
+                &grid[0], grid.size(),
+                indices, (tileSize-1)*(tileSize-1)*6);
+        }
+        return layout.get();
+    }
+}
+
 
 TileDrawable::TileDrawable(const TileKey& key,
                            SharedGeometry* geometry,
-                           int            tileSize) :
+                           int            tileSize,
+                           int            meshSize) :
 osg::Drawable( ),
 _key         ( key ),
 _geom        ( geometry ),
-_tileSize    ( tileSize )
+_tileSize    ( meshSize > 0 ? meshSize : tileSize ),
+_gridSize    ( tileSize )
 {   
     // a mesh to materialize the heightfield for functors
-    _mesh = new osg::Vec3f[ tileSize*tileSize ];
+    _mesh = new osg::Vec3f[ _tileSize*_tileSize ];
     
     // allocate and prepopulate mesh index array. 
     // TODO: This is the same for all tiles (of the same tilesize)
     // so perhaps in the future we can just share it.
-    _meshIndices = new GLuint[ (tileSize-1)*(tileSize-1)*6 ];
+    _meshIndices = new GLuint[ (_tileSize-1)*(_tileSize-1)*6 ];
     
     GLuint* k = &_meshIndices[0];
     for(int t=0; t<_tileSize-1; ++t)
@@ -62,6 +98,11 @@ _tileSize    ( tileSize )
         }
     }
     
+    // intersection hierarchy; the bounds are fit lazily on the first query.
+    _bvh = new TriangleBVH(getMeshLayout(_tileSize, _meshIndices));
+    _bvh->setVertices(_mesh, _tileSize*_tileSize);
+    setShape(_bvh.get());
+
     // builds the initial mesh.
     setElevationRaster(0L, osg::Matrixf::identity());
 }
@@ -78,6 +119,7 @@ TileDrawable::setElevationRaster(const osg::Image*   image,
 {
     _elevationRaster = image;
     _elevationScaleBias = scaleBias;
+    _elevationDecode = ImageToHeightFieldConverter::getScaleBias(image);
 
     if (osg::equivalent(0.0f, _elevationScaleBias(0,0)) ||
         osg::equivalent(0.0f, _elevationScaleBias(1,1)))
@@ -85,11 +127,51 @@ TileDrawable::setElevationRaster(const osg::Image*   image,
         OE_WARN << "("<<_key.str()<<") precision error\n";
     }
     
-    const osg::Vec3Array& verts = *static_cast<osg::Vec3Array*>(_geom->getVertexArray());
+    const osg::Vec3Array& gridVerts = *static_cast<osg::Vec3Array*>(_geom->getVertexArray());
+    const osg::Vec3Array& gridNormals = *static_cast<osg::Vec3Array*>(_geom->getNormalArray());
+
+    // resample a coarse grid at the mesh resolution; the GPU interpolates
+    // the tessellated vertices the same way.
+    osg::ref_ptr<osg::Vec3Array> resampledVerts, resampledNormals;
+    if (_gridSize != _tileSize)
+    {
+        resampledVerts = new osg::Vec3Array(_tileSize*_tileSize);
+        resampledNormals = new osg::Vec3Array(_tileSize*_tileSize);
+        float step = (float)(_gridSize-1) / (float)(_tileSize-1);
+        for(int t=0; t<_tileSize; ++t)
+        {
+            float ft = (float)t * step;
+            int t0 = osg::minimum((int)ft, _gridSize-2);
+            float dt = ft - (float)t0;
+
+            for(int s=0; s<_tileSize; ++s)
+            {
+                float fs = (float)s * step;
+                int s0 = osg::minimum((int)fs, _gridSize-2);
+                float ds = fs - (float)s0;
+
+                int i00 = t0*_gridSize + s0;
+                int i10 = i00 + 1;
+                int i01 = i00 + _gridSize;
+                int i11 = i01 + 1;
+
+                unsigned index = t*_tileSize+s;
+                (*resampledVerts)[index] =
+                    (gridVerts[i00]*(1.0f-ds) + gridVerts[i10]*ds) * (1.0f-dt) +
+                    (gridVerts[i01]*(1.0f-ds) + gridVerts[i11]*ds) * dt;
+                (*resampledNormals)[index] =
+                    (gridNormals[i00]*(1.0f-ds) + gridNormals[i10]*ds) * (1.0f-dt) +
+                    (gridNormals[i01]*(1.0f-ds) + gridNormals[i11]*ds) * dt;
+                (*resampledNormals)[index].normalize();
+            }
+        }
+    }
+
+    const osg::Vec3Array& verts = resampledVerts.valid() ? *resampledVerts.get() : gridVerts;
 
     if ( _elevationRaster.valid() )
     {
-        const osg::Vec3Array& normals = *static_cast<osg::Vec3Array*>(_geom->getNormalArray());
+        const osg::Vec3Array& normals = resampledNormals.valid() ? *resampledNormals.get() : gridNormals;
 
         //OE_INFO << LC << _key.str() << " - rebuilding height cache" << std::endl;
 
@@ -107,6 +189,28 @@ TileDrawable::setElevationRaster(const osg::Image*   image,
             OE_WARN << LC << "Precision loss in tile " << _key.str() << "\n";
         }
     
+        // The range covers every texel in the tile's window of the raster
+        // (not just the mesh samples) since shaders sample it per-pixel.
+        {
+            int w = _elevationRaster->s(), h = _elevationRaster->t();
+            int s0 = osg::clampBetween((int)floor(biasU*(float)(w-1)), 0, w-1);
+            int s1 = osg::clampBetween((int)ceil((biasU+scaleU)*(float)(w-1)), 0, w-1);
+            int t0 = osg::clampBetween((int)floor(biasV*(float)(h-1)), 0, h-1);
+            int t1 = osg::clampBetween((int)ceil((biasV+scaleV)*(float)(h-1)), 0, h-1);
+
+            ImageUtils::PixelReader texel(_elevationRaster.get());
+            _elevationRange.set(FLT_MAX, -FLT_MAX);
+            for (int t = t0; t <= t1; ++t)
+            {
+                for (int s = s0; s <= s1; ++s)
+                {
+                    float z = texel(s, t).r() * _elevationDecode.x() + _elevationDecode.y();
+                    _elevationRange.x() = osg::minimum(_elevationRange.x(), z);
+                    _elevationRange.y() = osg::maximum(_elevationRange.y(), z);
+                }
+            }
+        }
+
         for(int t=0; t<_tileSize; ++t)
         {
             float v = (float)t / (float)(_tileSize-1);
@@ -118,7 +222,8 @@ TileDrawable::setElevationRaster(const osg::Image*   image,
                 u = u*scaleU + biasU;
 
                 unsigned index = t*_tileSize+s;
-                _mesh[index] = verts[index] + normals[index] * elevation(u, v).r();
+                float h = elevation(u, v).r() * _elevationDecode.x() + _elevationDecode.y();
+                _mesh[index] = verts[index] + normals[index] * h;
             }
         }
     }
@@ -129,8 +234,13 @@ TileDrawable::setElevationRaster(const osg::Image*   image,
         {
             _mesh[i] = verts[i];
         }
+
+        _elevationRange.set(0.0f, 0.0f);
     }
 
+    if (_bvh.valid())
+        _bvh->dirty();
+
     dirtyBound();    
 }
 
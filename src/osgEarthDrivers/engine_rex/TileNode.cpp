@@ -34,6 +34,7 @@
 #include <osgEarth/Utils>
 #include <osgEarth/NodeUtils>
 #include <osgEarth/TraversalData>
+#include <osgEarth/SequenceTexture>
 
 #include <osg/Uniform>
 #include <osg/ComputeBoundsVisitor>
@@ -67,12 +68,14 @@ namespace
 
 TileNode::TileNode() : 
 _dirty        ( false ),
-_childrenReady( false ),
+_childrenReady( 0u ),
 _minExpiryTime( 0.0 ),
 _minExpiryFrames( 0 ),
 _lastTraversalTime(0.0),
 _lastTraversalFrame(0.0),
 _count(0),
+_elevationError(-1.0f),
+_geometricError(-1.0f),
 _stitchNormalMap(false),
 _empty(false),              // an "empty" node exists but has no geometry or children.,
 _isRootTile(false),
@@ -118,11 +121,15 @@ TileNode::create(const TileKey& key, TileNode* parent, EngineContext* context)
         return;
     }
 
-    // Create the drawable for the terrain surface:
+    // Create the drawable for the terrain surface. When the GPU tessellates
+    // our coarse grid, keep a finer mesh for intersections and bounds.
+    int meshSize = context->getOptions().gpuTessellation() == true ? (tileSize-1)*4+1 : tileSize;
+
     TileDrawable* surfaceDrawable = new TileDrawable(
         key, 
         geom.get(),
-        context->getOptions().tileSize().get() );
+        tileSize,
+        meshSize );
 
     // Give the tile Drawable access to the render model so it can properly
     // calculate its bounding box and sphere.
@@ -166,12 +173,40 @@ TileNode::create(const TileKey& key, TileNode* parent, EngineContext* context)
     one_by_end_minus_start = 1.0f/one_by_end_minus_start;
     _morphConstants.set( end * one_by_end_minus_start, one_by_end_minus_start );
 
+    // Screen-space error selection doesn't follow the morphing ranges, so
+    // turn morphing off (the factor is always 0).
+    if (context->getOptions().screenSpaceError().isSet())
+    {
+        _morphConstants.set( 1.0f, 0.0f );
+    }
+
+    // tile size in meters, for deriving normals from elevation on the GPU.
+    // Geographic tiles use the east-west scale at their center latitude.
+    const GeoExtent& extent = _key.getExtent();
+    if (extent.getSRS()->isGeographic())
+    {
+        double mPerDeg = (extent.getSRS()->getEllipsoid()->getRadiusEquator() * 2.0 * osg::PI) / 360.0;
+        double lat = 0.5*(extent.yMin() + extent.yMax());
+        _tileExtent.set(
+            extent.width() * mPerDeg * cos(osg::DegreesToRadians(lat)),
+            extent.height() * mPerDeg);
+    }
+    else
+    {
+        _tileExtent.set(extent.width(), extent.height());
+    }
+
     // Initialize the data model by copying the parent's rendering data
     // and scale/biasing the matrices.
     if (parent)
     {
         unsigned quadrant = getKey().getQuadrant();
 
+        // Until we get our own elevation data, our mesh samples the parent's
+        // at twice the density, roughly halving the error.
+        if (parent->_elevationError >= 0.0f)
+            _elevationError = 0.5f * parent->_elevationError;
+
         const RenderBindings& bindings = context->getRenderBindings();
 
         bool setElevation = false;
@@ -183,6 +218,7 @@ TileNode::create(const TileKey& key, TileNode* parent, EngineContext* context)
             // Copy the parent pass:
             _renderModel._passes.push_back(parentPass);
             RenderingPass& myPass = _renderModel._passes.back();
+            myPass.setCulledInherited(parentPass);
 
             // Scale/bias each matrix for this key quadrant.
             Samplers& samplers = myPass.samplers();
@@ -339,6 +375,22 @@ TileNode::shouldSubDivide(TerrainCuller* culler, const SelectionInfo& selectionI
 
     EngineContext* context = culler->getEngineContext();
 
+    // Screen-space error: subdivide while this tile's error would show up
+    // as more pixels than the target. Tiles with no data yet fall through
+    // to range-based selection.
+    if (context->getOptions().screenSpaceError().isSet() && _geometricError >= 0.0f)
+    {
+        if (currLOD+1 >= selectionInfo.getNumLODs())
+            return false;
+
+        if (currLOD < context->getOptions().minLOD().get())
+            return true;
+
+        const osg::BoundingSphere& bs = getBound();
+        float pixelsPerMeter = culler->clampedPixelSize(bs) / (bs.radius() * culler->getLODScale());
+        return _geometricError * pixelsPerMeter > context->getOptions().screenSpaceError().get();
+    }
+
     if (context->getOptions().rangeMode() == osg::LOD::PIXEL_SIZE_ON_SCREEN)
     {
         float pixelSize = -1.0;
@@ -444,6 +496,7 @@ TileNode::cull(TerrainCuller* culler)
         // If the children don't exist, create them and inherit the parent's data.
         if ( !_childrenReady && canCreateChildren )
         {
+            // Another view's cull may be creating them right now.
             _mutex.lock();
 
             if ( !_childrenReady )
@@ -451,7 +504,7 @@ TileNode::cull(TerrainCuller* culler)
                 OE_START_TIMER(createChildren);
                 createChildren( context );
                 REPORT("TileNode::createChildren", createChildren);
-                _childrenReady = true;
+                _childrenReady.exchange( 1u );
 
                 // This means that you cannot start loading data immediately; must wait a frame.
                 canLoadData = false;
@@ -508,8 +561,13 @@ TileNode::accept_cull(TerrainCuller* culler)
     if (culler)
     {
         // update the timestamp so this tile doesn't become dormant.
-        _lastTraversalFrame.exchange( culler->getFrameStamp()->getFrameNumber() );
-        _lastTraversalTime = culler->getFrameStamp()->getReferenceTime();
+        // Other views may be culling this tile at the same time; only the
+        // first one to get here this frame records the time.
+        unsigned frame = culler->getFrameStamp()->getFrameNumber();
+        if ( _lastTraversalFrame.exchange( frame ) != frame )
+        {
+            _lastTraversalTime = culler->getFrameStamp()->getReferenceTime();
+        }
 
         if ( !culler->isCulled(*this) )
         {
@@ -571,6 +629,19 @@ TileNode::traverse(osg::NodeVisitor& nv)
                     Sampler& sampler = samplers[s];
                     if (sampler._texture.valid() && sampler._matrix.isIdentity())
                     {
+                        // A sequence texture keeps its upcoming time steps resident
+                        // and only needs to move its window.
+                        SequenceTexture* seq = dynamic_cast<SequenceTexture*>(sampler._texture.get());
+                        if (seq)
+                        {
+                            if (seq->getNumFrames() > 1u)
+                            {
+                                seq->update(nv.getFrameStamp());
+                                numUpdated++;
+                            }
+                            continue;
+                        }
+
                         for(unsigned i = 0; i < sampler._texture->getNumImages(); ++i)
                         {
                             osg::Image* image = sampler._texture->getImage(i);
@@ -654,6 +725,17 @@ TileNode::merge(const TerrainTileModel* model, const RenderBindings& bindings)
             {
                 if (model->getTexture())
                 {
+                    osg::ref_ptr<osg::Texture> tex = model->getTexture();
+
+                    // Time-sequence layers keep several time steps resident in a
+                    // texture array. Every texture of such a layer becomes one,
+                    // so its shader can sample them all the same way.
+                    const ImageLayer* imageLayer = model->getImageLayer();
+                    if (imageLayer && imageLayer->options().sequenceLookahead().get() > 0u)
+                    {
+                        tex = new SequenceTexture(tex.get(), imageLayer->options().sequenceLookahead().get());
+                    }
+
                     RenderingPass* pass = _renderModel.getPass(model->getImageLayer()->getUID());
                     if (!pass)
                     {
@@ -664,11 +746,11 @@ TileNode::merge(const TerrainTileModel* model, const RenderBindings& bindings)
                         // Since it just arrived at this LOD, make the parent the same as the color.
                         if (bindings[SamplerBinding::COLOR_PARENT].isActive())
                         {
-                            pass->samplers()[SamplerBinding::COLOR_PARENT]._texture = model->getTexture();
+                            pass->samplers()[SamplerBinding::COLOR_PARENT]._texture = tex.get();
                             pass->samplers()[SamplerBinding::COLOR_PARENT]._matrix.makeIdentity();
                         }
                     }
-                    pass->samplers()[SamplerBinding::COLOR]._texture = model->getTexture();
+                    pass->samplers()[SamplerBinding::COLOR]._texture = tex.get();
                     pass->samplers()[SamplerBinding::COLOR]._matrix = *model->getMatrix();
 
                     // Handle an RTT image layer:
@@ -689,9 +771,17 @@ TileNode::merge(const TerrainTileModel* model, const RenderBindings& bindings)
                     // check to see if this data requires an image update traversal.
                     if (_imageUpdatesActive == false)
                     {
-                        for(unsigned i=0; i<model->getTexture()->getNumImages(); ++i)
+                        SequenceTexture* seq = dynamic_cast<SequenceTexture*>(tex.get());
+                        if (seq && seq->getNumFrames() > 1u)
                         {
-                            if (model->getTexture()->getImage(i)->requiresUpdateCall())
+                            ADJUST_UPDATE_TRAV_COUNT(this, +1);
+                            _imageUpdatesActive = true;
+                        }
+
+                        for(unsigned i=0; i<model->getTexture()->getNumImages() && !_imageUpdatesActive; ++i)
+                        {
+                            const osg::Image* image = model->getTexture()->getImage(i);
+                            if (image && image->requiresUpdateCall())
                             {
                                 ADJUST_UPDATE_TRAV_COUNT(this, +1);
                                 _imageUpdatesActive = true;
@@ -713,6 +803,11 @@ TileNode::merge(const TerrainTileModel* model, const RenderBindings& bindings)
                         pass = &_renderModel.addPass();
                         pass->setLayer(model->getLayer());
                     }
+
+                    if (model->visible().isSet())
+                    {
+                        pass->setCulled(!model->visible().get());
+                    }
                 }
             }
         }
@@ -793,6 +888,26 @@ TileNode::merge(const TerrainTileModel* model, const RenderBindings& bindings)
     {
         _context->getEngine()->getTerrain()->notifyTileAdded(getKey(), this);
     }
+
+    if (model->elevationModel().valid())
+    {
+        _elevationError = model->elevationModel()->getGeometricError();
+    }
+    updateGeometricError();
+
+    // Update the memory accounting for the new data.
+    _context->liveTiles()->updateDataSize(this);
+}
+
+unsigned
+TileNode::getTotalDataSize() const
+{
+    unsigned size = _renderModel.getTotalDataSize();
+
+    if (_surface.valid() && _surface->getDrawable() && _surface->getDrawable()->_geom.valid())
+        size += _surface->getDrawable()->_geom->getTotalDataSize();
+
+    return size;
 }
 
 void TileNode::loadChildren()
@@ -803,7 +918,7 @@ void TileNode::loadChildren()
     {        
         // Create the children
         createChildren( _context.get() );        
-        _childrenReady = true;        
+        _childrenReady.exchange( 1u );        
         int numChildren = getNumChildren();
         if ( numChildren > 0 )
         {
@@ -861,6 +976,9 @@ TileNode::refreshInheritedData(TileNode* parent, const RenderBindings& bindings)
         // Inherit the samplers for this pass.
         if (myPass)
         {
+            if (myPass->inheritCulled(parentPass))
+                ++changes;
+
             Samplers& samplers = myPass->samplers();
             for (unsigned s = 0; s < samplers.size(); ++s)
             {
@@ -921,6 +1039,7 @@ TileNode::refreshInheritedData(TileNode* parent, const RenderBindings& bindings)
             // Pass exists in the parent node, but not in this node, so add it now.
             myPass = &_renderModel.addPass();
             *myPass = parentPass;
+            myPass->setCulledInherited(parentPass);
 
             for (unsigned s = 0; s < myPass->samplers().size(); ++s)
             {
@@ -1030,7 +1149,7 @@ TileNode::areSubTilesDormant(const osg::FrameStamp* fs) const
 void
 TileNode::removeSubTiles()
 {
-    _childrenReady = false;
+    _childrenReady.exchange( 0u );
     this->removeChildren(0, this->getNumChildren());
 }
 
@@ -1047,6 +1166,35 @@ TileNode::notifyOfArrival(TileNode* that)
     updateNormalMap();
 }
 
+void
+TileNode::updateGeometricError()
+{
+    if (_elevationError < 0.0f)
+        return;
+
+    // Imagery of our own means the children may have finer imagery. Then the
+    // error is at least the size of one texel, so the texels stay within the
+    // target on screen.
+    float imageError = 0.0f;
+    for (unsigned p = 0; p < _renderModel._passes.size(); ++p)
+    {
+        const Sampler& color = _renderModel._passes[p].samplers()[SamplerBinding::COLOR];
+        if (color.ownsTexture())
+        {
+            // the image is gone once uploaded, if the texture let go of it.
+            const osg::Image* image = color._texture->getImage(0);
+            int s = image ? image->s() : color._texture->getTextureWidth();
+            if (s > 0)
+            {
+                float texel = osg::maximum(_tileExtent.x(), _tileExtent.y()) / (float)s;
+                imageError = osg::maximum(imageError, texel);
+            }
+        }
+    }
+
+    _geometricError = osg::maximum(_elevationError, imageError);
+}
+
 void
 TileNode::updateNormalMap()
 {
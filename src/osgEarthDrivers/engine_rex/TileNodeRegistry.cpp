@@ -35,11 +35,36 @@ TileNodeRegistry::TileNodeRegistry(const std::string& name) :
 _name              ( name ),
 _revisioningEnabled( false ),
 _frameNumber       ( 0u ),
-_notifyNeighbors   ( false )
+_notifyNeighbors   ( false ),
+_totalBytes        ( 0 ),
+_scanShard         ( 0u ),
+_scanIndex         ( 0u )
 {
     //nop
 }
 
+TileNodeRegistry::Shard&
+TileNodeRegistry::getShard(const TileKey& key)
+{
+    unsigned h = (key.getTileX() * 73856093u) ^ (key.getTileY() * 19349663u) ^ (key.getLOD() * 83492791u);
+    return _shards[h % NUM_SHARDS];
+}
+
+const TileNodeRegistry::Shard&
+TileNodeRegistry::getShard(const TileKey& key) const
+{
+    return const_cast<TileNodeRegistry*>(this)->getShard(key);
+}
+
+unsigned
+TileNodeRegistry::size() const
+{
+    // snapshot in time; don't bother locking the shards.
+    unsigned total = 0u;
+    for (unsigned s = 0; s < NUM_SHARDS; ++s)
+        total += _shards[s]._tiles.size();
+    return total;
+}
 
 void
 TileNodeRegistry::setRevisioningEnabled(bool value)
@@ -61,13 +86,14 @@ TileNodeRegistry::setMapRevision(const Revision& rev,
     {
         if ( _maprev != rev || setToDirty )
         {
-            Threading::ScopedWriteLock exclusive( _tilesMutex );
+            _maprev = rev;
 
-            if ( _maprev != rev || setToDirty )
+            for (unsigned s = 0; s < NUM_SHARDS; ++s)
             {
-                _maprev = rev;
+                Shard& shard = _shards[s];
+                Threading::ScopedWriteLock exclusive( shard._mutex );
 
-                for( TileNodeMap::iterator i = _tiles.begin(); i != _tiles.end(); ++i )
+                for( TileNodeMap::iterator i = shard._tiles.begin(); i != shard._tiles.end(); ++i )
                 {
                     i->second.tile->setMapRevision( _maprev );
                     if ( setToDirty )
@@ -88,79 +114,97 @@ TileNodeRegistry::setDirty(const GeoExtent& extent,
                            unsigned         minLevel,
                            unsigned         maxLevel)
 {
-    Threading::ScopedWriteLock exclusive( _tilesMutex );
-    
-    bool checkSRS = false;
-    for( TileNodeMap::iterator i = _tiles.begin(); i != _tiles.end(); ++i )
+    for (unsigned s = 0; s < NUM_SHARDS; ++s)
     {
-        const TileKey& key = i->first;
-        if (minLevel <= key.getLOD() && 
-            maxLevel >= key.getLOD() &&
-            extent.intersects(i->first.getExtent(), checkSRS) )
+        Shard& shard = _shards[s];
+        Threading::ScopedWriteLock exclusive( shard._mutex );
+
+        for( TileNodeMap::iterator i = shard._tiles.begin(); i != shard._tiles.end(); ++i )
         {
-            i->second.tile->setDirty( true );
+            const TileKey& key = i->second.tile->getKey();
+            if (minLevel <= key.getLOD() && 
+                maxLevel >= key.getLOD() &&
+                extent.intersects(key.getBounds()) )
+            {
+                i->second.tile->setDirty( true );
+            }
         }
     }
 }
 
 void
-TileNodeRegistry::addSafely(TileNode* tile)
+TileNodeRegistry::addSafely(Shard& shard, TileNode* tile)
 {
-    _tiles.insert( tile->getKey(), tile );
+    shard._tiles.insert( tile->getKey(), tile );
+
+    RandomAccessTileMap::Entry* entry = shard._tiles.findEntry( tile->getKey() );
+    unsigned bytes = tile->getTotalDataSize();
+    {
+        Threading::ScopedMutexLock lock( _totalBytesMutex );
+        _totalBytes = _totalBytes - entry->bytes + bytes;
+    }
+    entry->bytes = bytes;
     
     if ( _revisioningEnabled )
         tile->setMapRevision( _maprev );
-    
+}
+
+bool
+TileNodeRegistry::removeSafely(Shard& shard, const TileKey& key)
+{
+    RandomAccessTileMap::Entry* entry = shard._tiles.findEntry(key);
+    if ( entry )
+    {
+        {
+            Threading::ScopedMutexLock lock( _totalBytesMutex );
+            _totalBytes -= osg::minimum(_totalBytes, (size_t)entry->bytes);
+        }
+        shard._tiles.erase( key );
+        return true;
+    }
+    return false;
+}
+
+void
+TileNodeRegistry::notifyNeighbors(TileNode* tile)
+{
+    Threading::ScopedMutexLock lock( _notifiersMutex );
+
     // Start waiting on our neighbors
-    if (_notifyNeighbors)
+    startListeningFor(tile->getKey().createNeighborKey(1, 0), tile);
+    startListeningFor(tile->getKey().createNeighborKey(0, 1), tile);
+
+    // check for tiles that are waiting on this tile, and notify them!
+    TileKeyOneToMany::iterator notifier = _notifiers.find( tile->getKey() );
+    if ( notifier != _notifiers.end() )
     {
-        startListeningFor(tile->getKey().createNeighborKey(1, 0), tile);
-        startListeningFor(tile->getKey().createNeighborKey(0, 1), tile);
+        TileKeySet& listeners = notifier->second;
 
-        // check for tiles that are waiting on this tile, and notify them!
-        TileKeyOneToMany::iterator notifier = _notifiers.find( tile->getKey() );
-        if ( notifier != _notifiers.end() )
+        for(TileKeySet::iterator listener = listeners.begin(); listener != listeners.end(); ++listener)
         {
-            TileKeySet& listeners = notifier->second;
-
-            for(TileKeySet::iterator listener = listeners.begin(); listener != listeners.end(); ++listener)
+            osg::ref_ptr<TileNode> listenerTile;
+            if ( get( *listener, listenerTile ) )
             {
-                TileNode* listenerTile = _tiles.find( *listener );
-                if ( listenerTile )
-                {
-                    listenerTile->notifyOfArrival( tile );
-                }
+                listenerTile->notifyOfArrival( tile );
             }
-            _notifiers.erase( notifier );
         }
-
-        OE_DEBUG << LC << _name 
-            << ": tiles=" << _tiles.size()
-            << ", notifiers=" << _notifiers.size()
-            << std::endl;
+        _notifiers.erase( notifier );
     }
 
-    Metrics::counter("RexStats", "Tiles", _tiles.size());
+    OE_DEBUG << LC << _name 
+        << ": tiles=" << size()
+        << ", notifiers=" << _notifiers.size()
+        << std::endl;
 }
 
 void
-TileNodeRegistry::removeSafely(const TileKey& key)
+TileNodeRegistry::forgetNeighbors(TileNode* tile)
 {
-    TileNode* tile = _tiles.find(key);
-    if (tile)
-    {
-        if (_notifyNeighbors)
-        {
-            // remove neighbor listeners:
-            stopListeningFor(key.createNeighborKey(1, 0), tile);
-            stopListeningFor(key.createNeighborKey(0, 1), tile);
-        }
+    Threading::ScopedMutexLock lock( _notifiersMutex );
 
-        // remove the tile.
-        _tiles.erase( key );
-
-        Metrics::counter("RexStats", "Tiles", _tiles.size());
-    }
+    // remove neighbor listeners:
+    stopListeningFor(tile->getKey().createNeighborKey(1, 0), tile);
+    stopListeningFor(tile->getKey().createNeighborKey(0, 1), tile);
 }
 
 void
@@ -168,8 +212,16 @@ TileNodeRegistry::add( TileNode* tile )
 {
     if ( tile )
     {
-        Threading::ScopedWriteLock exclusive( _tilesMutex );
-        addSafely( tile );
+        {
+            Shard& shard = getShard(tile->getKey());
+            Threading::ScopedWriteLock exclusive( shard._mutex );
+            addSafely( shard, tile );
+        }
+
+        if ( _notifyNeighbors )
+            notifyNeighbors( tile );
+
+        Metrics::counter("RexStats", "Tiles", size());
     }
 }
 
@@ -178,13 +230,27 @@ TileNodeRegistry::add( const TileNodeVector& tiles )
 {
     if ( tiles.size() > 0 )
     {
-        Threading::ScopedWriteLock exclusive( _tilesMutex );
         for( TileNodeVector::const_iterator i = tiles.begin(); i != tiles.end(); ++i )
         {
             if ( i->valid() )
-                addSafely( i->get() );
+            {
+                Shard& shard = getShard(i->get()->getKey());
+                Threading::ScopedWriteLock exclusive( shard._mutex );
+                addSafely( shard, i->get() );
+            }
         }
-        OE_TEST << LC << _name << ": tiles=" << _tiles.size() << std::endl;
+
+        if ( _notifyNeighbors )
+        {
+            for( TileNodeVector::const_iterator i = tiles.begin(); i != tiles.end(); ++i )
+            {
+                if ( i->valid() )
+                    notifyNeighbors( i->get() );
+            }
+        }
+
+        Metrics::counter("RexStats", "Tiles", size());
+        OE_TEST << LC << _name << ": tiles=" << size() << std::endl;
     }
 }
 
@@ -193,18 +259,59 @@ TileNodeRegistry::remove( TileNode* tile )
 {
     if ( tile )
     {
-        Threading::ScopedWriteLock exclusive( _tilesMutex );
-        removeSafely( tile->getKey() );
+        bool removed;
+        {
+            Shard& shard = getShard(tile->getKey());
+            Threading::ScopedWriteLock exclusive( shard._mutex );
+            removed = removeSafely( shard, tile->getKey() );
+        }
+
+        if ( removed )
+        {
+            if ( _notifyNeighbors )
+                forgetNeighbors( tile );
+
+            Metrics::counter("RexStats", "Tiles", size());
+        }
     }
 }
   
 
+void
+TileNodeRegistry::updateDataSize( TileNode* tile )
+{
+    if ( tile )
+    {
+        Shard& shard = getShard(tile->getKey());
+        Threading::ScopedWriteLock exclusive( shard._mutex );
+
+        RandomAccessTileMap::Entry* entry = shard._tiles.findEntry( tile->getKey() );
+        if ( entry && entry->tile.get() == tile )
+        {
+            unsigned bytes = tile->getTotalDataSize();
+            {
+                Threading::ScopedMutexLock lock( _totalBytesMutex );
+                _totalBytes = _totalBytes - entry->bytes + bytes;
+            }
+            entry->bytes = bytes;
+        }
+    }
+}
+
+size_t
+TileNodeRegistry::getTotalDataSize() const
+{
+    Threading::ScopedMutexLock lock( _totalBytesMutex );
+    return _totalBytes;
+}
+
 bool
 TileNodeRegistry::get( const TileKey& key, osg::ref_ptr<TileNode>& out_tile )
 {
-    Threading::ScopedReadLock shared( _tilesMutex );
+    const Shard& shard = getShard(key);
+    Threading::ScopedReadLock shared( shard._mutex );
 
-    out_tile = _tiles.find(key);
+    out_tile = shard._tiles.find(key);
     return out_tile.valid();
 }
 
@@ -212,13 +319,25 @@ TileNodeRegistry::get( const TileKey& key, osg::ref_ptr<TileNode>& out_tile )
 bool
 TileNodeRegistry::take( const TileKey& key, osg::ref_ptr<TileNode>& out_tile )
 {
-    Threading::ScopedWriteLock exclusive( _tilesMutex );
+    {
+        Shard& shard = getShard(key);
+        Threading::ScopedWriteLock exclusive( shard._mutex );
+
+        out_tile = shard._tiles.find(key);
+        if ( out_tile.valid() )
+        {
+            removeSafely( shard, key );
+        }
+    }
 
-    out_tile = _tiles.find(key);
     if ( out_tile.valid() )
     {
-        removeSafely( key );
+        if ( _notifyNeighbors )
+            forgetNeighbors( out_tile.get() );
+
+        Metrics::counter("RexStats", "Tiles", size());
     }
+
     return out_tile.valid();
 }
 
@@ -226,20 +345,59 @@ TileNodeRegistry::take( const TileKey& key, osg::ref_ptr<TileNode>& out_tile )
 void
 TileNodeRegistry::run( TileNodeRegistry::Operation& op )
 {
-    Threading::ScopedWriteLock lock( _tilesMutex );
-    unsigned size = _tiles.size();
-    op.operator()( _tiles );
-    if ( size != _tiles.size() )
-        OE_TEST << LC << _name << ": tiles=" << _tiles.size() << std::endl;
+    for (unsigned s = 0; s < NUM_SHARDS; ++s)
+    {
+        Shard& shard = _shards[s];
+        Threading::ScopedWriteLock lock( shard._mutex );
+        unsigned size = shard._tiles.size();
+        op.operator()( shard._tiles );
+        if ( size != shard._tiles.size() )
+            OE_TEST << LC << _name << ": tiles=" << this->size() << std::endl;
+    }
 }
 
 
 void
 TileNodeRegistry::run( const TileNodeRegistry::ConstOperation& op ) const
 {
-    Threading::ScopedReadLock lock( _tilesMutex );
-    op.operator()( _tiles );
-    OE_TEST << LC << _name << ": tiles=" << _tiles.size() << std::endl;
+    for (unsigned s = 0; s < NUM_SHARDS; ++s)
+    {
+        const Shard& shard = _shards[s];
+        Threading::ScopedReadLock lock( shard._mutex );
+        op.operator()( shard._tiles );
+    }
+    OE_TEST << LC << _name << ": tiles=" << size() << std::endl;
+}
+
+
+void
+TileNodeRegistry::runIncremental( const TileNodeRegistry::ConstTileOperation& op, unsigned maxTiles ) const
+{
+    // only one scan at a time, so the cursor stays consistent
+    Threading::ScopedMutexLock lock( _scanMutex );
+
+    unsigned visited = 0u;
+
+    for (unsigned n = 0; n < NUM_SHARDS && visited < maxTiles; ++n)
+    {
+        const Shard& shard = _shards[_scanShard];
+        {
+            Threading::ScopedReadLock shared( shard._mutex );
+
+            while ( _scanIndex < shard._tiles.size() && visited < maxTiles )
+            {
+                op.operator()( shard._tiles.at(_scanIndex++) );
+                ++visited;
+            }
+
+            // out of budget partway through this shard; resume here next time.
+            if ( _scanIndex < shard._tiles.size() )
+                break;
+        }
+
+        _scanShard = (_scanShard + 1u) % NUM_SHARDS;
+        _scanIndex = 0u;
+    }
 }
 
 
@@ -247,21 +405,21 @@ bool
 TileNodeRegistry::empty() const
 {
     // don't bother mutex-protecteding this.
-    return _tiles.empty();
+    return size() == 0u;
 }
 
 void
 TileNodeRegistry::startListeningFor(const TileKey& tileToWaitFor, TileNode* waiter)
 {
-    // ASSUME EXCLUSIVE LOCK
+    // ASSUME _notifiersMutex LOCKED
 
-    TileNode* tile = _tiles.find( tileToWaitFor );
-    if ( tile )
+    osg::ref_ptr<TileNode> tile;
+    if ( get( tileToWaitFor, tile ) )
     {
         OE_DEBUG << LC << waiter->getKey().str() << " listened for " << tileToWaitFor.str()
             << ", but it was already in the repo.\n";
 
-        waiter->notifyOfArrival( tile );
+        waiter->notifyOfArrival( tile.get() );
     }
     else
     {
@@ -274,7 +432,7 @@ TileNodeRegistry::startListeningFor(const TileKey& tileToWaitFor, TileNode* wait
 void
 TileNodeRegistry::stopListeningFor(const TileKey& tileToWaitFor, TileNode* waiter)
 {
-    // ASSUME EXCLUSIVE LOCK
+    // ASSUME _notifiersMutex LOCKED
 
     TileKeyOneToMany::iterator i = _notifiers.find(tileToWaitFor);
     if (i != _notifiers.end())
@@ -293,9 +451,23 @@ TileNodeRegistry::stopListeningFor(const TileKey& tileToWaitFor, TileNode* waite
 TileNode*
 TileNodeRegistry::takeAny()
 {
-    Threading::ScopedWriteLock exclusive( _tilesMutex );
-    osg::ref_ptr<TileNode> tile = _tiles.begin()->second.tile.get();
-    removeSafely( tile->getKey() );
+    osg::ref_ptr<TileNode> tile;
+
+    for (unsigned s = 0; s < NUM_SHARDS && !tile.valid(); ++s)
+    {
+        Shard& shard = _shards[s];
+        Threading::ScopedWriteLock exclusive( shard._mutex );
+        if ( !shard._tiles.empty() )
+        {
+            // take the last one; erasing it is O(1) in the vector.
+            tile = shard._tiles.at(shard._tiles.size()-1);
+            removeSafely( shard, tile->getKey() );
+        }
+    }
+
+    if ( tile.valid() && _notifyNeighbors )
+        forgetNeighbors( tile.get() );
+
     return tile.release();
 }
 
@@ -303,19 +475,31 @@ void
 TileNodeRegistry::releaseAll(ResourceReleaser* releaser)
 {
     ResourceReleaser::ObjectList objects;
+
+    for (unsigned s = 0; s < NUM_SHARDS; ++s)
     {
-        Threading::ScopedWriteLock exclusive(_tilesMutex);
+        Shard& shard = _shards[s];
+        Threading::ScopedWriteLock exclusive(shard._mutex);
 
-        for (TileNodeMap::iterator i = _tiles.begin(); i != _tiles.end(); ++i)
+        for (TileNodeMap::iterator i = shard._tiles.begin(); i != shard._tiles.end(); ++i)
         {
             objects.push_back(i->second.tile.get());
         }
 
-        _tiles.clear();
+        shard._tiles.clear();
+    }
+
+    {
+        Threading::ScopedMutexLock lock( _notifiersMutex );
         _notifiers.clear();
+    }
 
-        Metrics::counter("RexStats", "Tiles", _tiles.size());
+    {
+        Threading::ScopedMutexLock lock( _totalBytesMutex );
+        _totalBytes = 0;
     }
 
+    Metrics::counter("RexStats", "Tiles", size());
+
     releaser->push(objects);
-}
\ No newline at end of file
+}
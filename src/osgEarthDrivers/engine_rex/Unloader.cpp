@@ -69,7 +69,8 @@ namespace
 
 UnloaderGroup::UnloaderGroup(TileNodeRegistry* tiles) :
 _tiles(tiles),
-_threshold( INT_MAX )
+_threshold( INT_MAX ),
+_maxBytes( 0 )
 {
     this->setNumChildrenRequiringUpdateTraversal( 1u );
 }
@@ -87,13 +88,22 @@ void
 UnloaderGroup::traverse(osg::NodeVisitor& nv)
 {
     if ( nv.getVisitorType() == nv.UPDATE_VISITOR )
-    {        
-        if ( _parentKeys.size() > _threshold )
+    {
+        size_t bytes = _tiles->getTotalDataSize();
+        bool overBudget = _maxBytes > 0 && bytes > _maxBytes;
+
+        if ( _parentKeys.size() > _threshold || (overBudget && !_parentKeys.empty()) )
         {
             ScopedMetric m("Unloader expire");
 
             unsigned unloaded=0, notFound=0, notDormant=0;
             Threading::ScopedMutexLock lock( _mutex );
+
+            // Order the candidates so the ones whose subtiles were seen least
+            // recently go first.
+            typedef std::multimap<unsigned, osg::ref_ptr<TileNode> > ParentsByLastSeen;
+            ParentsByLastSeen parents;
+
             for(std::set<TileKey>::const_iterator parentKey = _parentKeys.begin(); parentKey != _parentKeys.end(); ++parentKey)
             {
                 osg::ref_ptr<TileNode> parentNode;
@@ -102,27 +112,49 @@ UnloaderGroup::traverse(osg::NodeVisitor& nv)
                     // re-check for dormancy in case something has changed
                     if ( parentNode->areSubTilesDormant(nv.getFrameStamp()) )
                     {
-                        // find and move all tiles to be unloaded to the dead pile.
-                        ExpirationCollector collector( _tiles );
+                        unsigned lastSeen = 0u;
                         for(unsigned i=0; i<parentNode->getNumChildren(); ++i)
-                            parentNode->getSubTile(i)->accept( collector );
-                        unloaded += collector._count;
+                            lastSeen = osg::maximum(lastSeen, parentNode->getSubTile(i)->getLastTraversalFrame());
 
-                        // submit all collected nodes for GL resource release:
-                        if (!collector._nodes.empty() && _releaser.valid())
-                            _releaser->push(collector._nodes);
-
-                        parentNode->removeSubTiles();
+                        parents.insert(std::make_pair(lastSeen, parentNode));
                     }
                     else notDormant++;
                 }
                 else notFound++;
             }
 
+            for(ParentsByLastSeen::iterator i = parents.begin(); i != parents.end(); ++i)
+            {
+                // When we're only here because of the memory budget, stop as
+                // soon as we're under it.
+                if ( _parentKeys.size() <= _threshold && _tiles->getTotalDataSize() <= _maxBytes )
+                    break;
+
+                TileNode* parentNode = i->second.get();
+
+                // find and move all tiles to be unloaded to the dead pile.
+                ExpirationCollector collector( _tiles );
+                for(unsigned c=0; c<parentNode->getNumChildren(); ++c)
+                    parentNode->getSubTile(c)->accept( collector );
+                unloaded += collector._count;
+
+                // submit all collected nodes for GL resource release:
+                if (!collector._nodes.empty() && _releaser.valid())
+                    _releaser->push(collector._nodes);
+
+                parentNode->removeSubTiles();
+            }
+
             OE_DEBUG << LC << "Total=" << _parentKeys.size() << "; threshold=" << _threshold << "; unloaded=" << unloaded << "; notDormant=" << notDormant << "; notFound=" << notFound << "\n";
             _parentKeys.clear();
         }
+
+        if ( Metrics::enabled() )
+        {
+            Metrics::counter("rex.tile_memory",
+                "MB", (double)_tiles->getTotalDataSize() / 1048576.0,
+                "budgetMB", (double)_maxBytes / 1048576.0);
+        }
     }
     osg::Group::traverse( nv );
 }
-
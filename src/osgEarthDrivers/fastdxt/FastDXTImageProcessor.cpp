@@ -21,9 +21,78 @@
 #include <osgDB/Registry>
 #include <osg/Notify>
 #include <osgEarth/ImageUtils>
+#include <osgEarth/JobScheduler>
+#include <osgEarth/Registry>
 #include <stdlib.h>
 #include "libdxt.h"
 #include <string.h>
+#include <vector>
+
+namespace
+{
+    // Pixel rows per compression job; must be a multiple of the 4-row DXT block.
+    const int ROWS_PER_JOB = 64;
+
+    // Compresses a band of block rows of an RGBA8 level into its spot in the output.
+    struct CompressBandTask : public osgEarth::TaskRequest
+    {
+        CompressBandTask(const unsigned char* in, unsigned char* out, int width, int height, int format) :
+            _in(in), _out(out), _width(width), _height(height), _format(format) { }
+
+        void operator()(osgEarth::ProgressCallback*)
+        {
+            CompressDXT(_in, _out, _width, _height, _format);
+        }
+
+        const unsigned char* _in;
+        unsigned char*       _out;
+        int                  _width, _height, _format;
+    };
+
+    // Halves an RGBA8 image with a 2x2 box filter.
+    osg::Image* downsample(const osg::Image* input)
+    {
+        const int in_s = input->s(), in_t = input->t();
+        const int s = osg::maximum(1, in_s/2), t = osg::maximum(1, in_t/2);
+
+        osg::Image* output = new osg::Image();
+        output->allocateImage(s, t, 1, GL_RGBA, GL_UNSIGNED_BYTE);
+
+        for (int y = 0; y < t; ++y)
+        {
+            const unsigned char* r0 = input->data(0, osg::minimum(2*y, in_t-1));
+            const unsigned char* r1 = input->data(0, osg::minimum(2*y+1, in_t-1));
+            unsigned char* out = output->data(0, y);
+
+            for (int x = 0; x < s; ++x, out += 4)
+            {
+                int x0 = osg::minimum(2*x, in_s-1)*4, x1 = osg::minimum(2*x+1, in_s-1)*4;
+                for (int c = 0; c < 4; ++c)
+                    out[c] = (unsigned char)(((int)r0[x0+c] + r0[x1+c] + r1[x0+c] + r1[x1+c] + 2) / 4);
+            }
+        }
+        return output;
+    }
+
+    // Copies an RGBA8 image into a 16-byte aligned buffer padded out to whole
+    // 4x4 blocks by repeating the last column and row.
+    unsigned char* createBlockAlignedCopy(const osg::Image* image, int& width, int& height)
+    {
+        width = (image->s() + 3) & ~3;
+        height = (image->t() + 3) & ~3;
+
+        unsigned char* buf = (unsigned char*)memalign(16, width*height*4);
+        for (int y = 0; y < height; ++y)
+        {
+            const unsigned char* src = image->data(0, osg::minimum(y, image->t()-1));
+            unsigned char* dst = buf + y*width*4;
+            memcpy(dst, src, image->s()*4);
+            for (int x = image->s(); x < width; ++x)
+                memcpy(dst + x*4, src + (image->s()-1)*4, 4);
+        }
+        return buf;
+    }
+}
 
 class FastDXTProcessor : public osgDB::ImageProcessor
 {
@@ -53,16 +122,19 @@ public:
 
         int format;
         GLint pixelFormat;
+        unsigned blockBytes;
         switch (compressedFormat)
         {
         case osg::Texture::USE_S3TC_DXT1_COMPRESSION:
             format = FORMAT_DXT1;
             pixelFormat = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+            blockBytes = 8;
             OE_DEBUG << "FastDXT using dxt1 format" << std::endl;
             break;
         case osg::Texture::USE_S3TC_DXT5_COMPRESSION:
             format = FORMAT_DXT5;
             pixelFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+            blockBytes = 16;
             OE_DEBUG << "FastDXT dxt5 format" << std::endl;
             break;
         default:
@@ -71,33 +143,83 @@ public:
             break;
         }
 
-        //Copy over the source data to an array
-        unsigned char *in = 0;
-        in = (unsigned char*)memalign(16, sourceImage->getTotalSizeInBytes());
-        memcpy(in, sourceImage->data(0,0), sourceImage->getTotalSizeInBytes());
+        osg::Timer_t start = osg::Timer::instance()->tick();
 
+        // Build the RGBA8 mip chain to compress:
+        std::vector<const osg::Image*> levels;
+        std::vector< osg::ref_ptr<osg::Image> > mipmapImages;
+        levels.push_back(sourceImage);
+        if (generateMipMap)
+        {
+            while (levels.back()->s() > 1 || levels.back()->t() > 1)
+            {
+                mipmapImages.push_back(downsample(levels.back()));
+                levels.push_back(mipmapImages.back().get());
+            }
+        }
 
+        // Compressed levels are laid out back to back, each rounded up to whole blocks.
+        std::vector<unsigned> offsets;
+        unsigned outputBytes = 0u;
+        for (unsigned i = 0; i < levels.size(); ++i)
+        {
+            offsets.push_back(outputBytes);
+            outputBytes += ((levels[i]->s()+3)/4) * ((levels[i]->t()+3)/4) * blockBytes;
+        }
 
-        //Allocate memory for the output
-        unsigned char* out = (unsigned char*)memalign(16, image.s()*image.t()*4);
-        memset(out, 0, image.s()*image.t()*4);
+        unsigned char* data = (unsigned char*)malloc(outputBytes);
+
+        // Blocks are independent, so compress every level in bands of block
+        // rows on the job pool.
+        osgEarth::JobScheduler* scheduler = osgEarth::Registry::instance()->getJobScheduler();
+        osg::ref_ptr<osgEarth::JobGroup> jobs = new osgEarth::JobGroup();
+        std::vector<unsigned char*> inputs;
+
+        for (unsigned i = 0; i < levels.size(); ++i)
+        {
+            int width, height;
+            unsigned char* in = createBlockAlignedCopy(levels[i], width, height);
+            inputs.push_back(in);
+
+            for (int row = 0; row < height; row += ROWS_PER_JOB)
+            {
+                int rows = osg::minimum(ROWS_PER_JOB, height - row);
+                scheduler->submit(
+                    new CompressBandTask(
+                        in + row*width*4,
+                        data + offsets[i] + (row/4)*(width/4)*blockBytes,
+                        width, rows, format),
+                    osgEarth::JobScheduler::LANE_HIGH,
+                    jobs.get());
+            }
+        }
+
+        // A worker must help out rather than block, or it could end up
+        // waiting on jobs queued behind itself.
+        if (scheduler->isWorkerThread())
+        {
+            while (jobs->getNumPending() > 0u && scheduler->runOne());
+        }
+        jobs->wait();
+
+        for (unsigned i = 0; i < inputs.size(); ++i)
+            memfree(inputs[i]);
 
-        osg::Timer_t start = osg::Timer::instance()->tick();
-        int outputBytes = CompressDXT(in, out, sourceImage->s(), sourceImage->t(), format);
         osg::Timer_t end = osg::Timer::instance()->tick();
         OE_DEBUG << "compression took" << osg::Timer::instance()->delta_m(start, end) << std::endl;
 
-        //Allocate and copy over the output data to the correct size array.
-        unsigned char* data = (unsigned char*)malloc(outputBytes);
-        memcpy(data, out, outputBytes);
-        memfree(out);
-        memfree(in);
-        image.setImage(image.s(), image.t(), image.r(), pixelFormat, pixelFormat, GL_UNSIGNED_BYTE, data, osg::Image::USE_MALLOC_FREE);
+        image.setImage(sourceImage->s(), sourceImage->t(), image.r(), pixelFormat, pixelFormat, GL_UNSIGNED_BYTE, data, osg::Image::USE_MALLOC_FREE);
+
+        if (levels.size() > 1)
+        {
+            osg::Image::MipmapDataType mipmaps(offsets.begin()+1, offsets.end());
+            image.setMipmapLevels(mipmaps);
+        }
     }
 
     virtual void generateMipMap(osg::Image& image, bool resizeToPowerOfTwo, CompressionMethod method)
     {
-        OSG_WARN << "FastDXT: generateMipMap not implemented" << std::endl;
+        OSG_WARN << "FastDXT: generateMipMap not implemented; use compress() with generateMipMap=true" << std::endl;
     }
 };
 
@@ -87,6 +87,7 @@ _query            ( query ),
 _chunkSize        ( 500 ),
 _nextHandleToQueue( 0L ),
 _resultSetEndReached(false),
+_projected        ( false ),
 _profile          ( profile ),
 _filters          ( filters )
 {
@@ -107,6 +108,17 @@ _filters          ( filters )
             from = delim + from + delim;
         }
 
+        // Name only the projected fields so OGR can skip reading the rest.
+        // Keep them all if there's an ORDER BY, which may use any field.
+        std::string columns = "*";
+        if ( !_query.fields().empty() && !_query.orderby().isSet() )
+        {
+            std::stringstream buf;
+            for (unsigned i = 0; i < _query.fields().size(); ++i)
+                buf << (i > 0 ? ", " : "") << "\"" << _query.fields()[i] << "\"";
+            columns = buf.str();
+        }
+
         if ( _query.expression().isSet() )
         {
             // build the SQL: allow the Query to include either a full SQL statement or
@@ -119,7 +131,7 @@ _filters          ( filters )
             if ( temp.find( "select" ) != 0 )
             {
                 std::stringstream buf;
-                buf << "SELECT * FROM " << from << " WHERE " << expr;
+                buf << "SELECT " << columns << " FROM " << from << " WHERE " << expr;
                 std::string bufStr;
                 bufStr = buf.str();
                 expr = bufStr;
@@ -128,7 +140,7 @@ _filters          ( filters )
         else
         {
             std::stringstream buf;
-            buf << "SELECT * FROM " << from;
+            buf << "SELECT " << columns << " FROM " << from;
             expr = buf.str();
         }
 
@@ -179,10 +191,30 @@ _filters          ( filters )
         if ( _resultSetHandle )
         {
             OGR_L_ResetReading( _resultSetHandle );
+            resolveFields();
         }
     }
 
-    readChunk();
+    // Features are read on first use, so a batch read never builds any.
+}
+
+void
+FeatureCursorOGR::resolveFields()
+{
+    if ( _query.fields().empty() )
+        return;
+
+    OGRFeatureDefnH defn = OGR_L_GetLayerDefn( _resultSetHandle );
+    for (unsigned i = 0; i < _query.fields().size(); ++i)
+    {
+        // OGR matches field names case-insensitively
+        int index = OGR_FD_GetFieldIndex( defn, _query.fields()[i].c_str() );
+        if ( index >= 0 )
+            _fields.push_back( index );
+        else
+            OE_DEBUG << LC << "Query field \"" << _query.fields()[i] << "\" not found" << std::endl;
+    }
+    _projected = true;
 }
 
 FeatureCursorOGR::~FeatureCursorOGR()
@@ -205,6 +237,10 @@ FeatureCursorOGR::~FeatureCursorOGR()
 bool
 FeatureCursorOGR::hasMore() const
 {
+    // read lazily (see the constructor)
+    if ( _queue.empty() && !_resultSetEndReached )
+        const_cast<FeatureCursorOGR*>(this)->readChunk();
+
     return _resultSetHandle && _queue.size() > 0;
 }
 
@@ -236,6 +272,9 @@ FeatureCursorOGR::readChunk()
     
     OGR_SCOPED_LOCK;
 
+    // shared attribute names, if the source wants compact attribute storage
+    const AttributeSchema* attrSchema = _source->getAttributeSchema();
+
     while( _queue.size() < _chunkSize && !_resultSetEndReached )
     {
         FeatureList filterList;
@@ -253,10 +292,15 @@ FeatureCursorOGR::readChunk()
                     OGR_F_SetGeometry(handle, intersection);
                 }
                 */
-                osg::ref_ptr<Feature> feature = OgrUtils::createFeature( handle, _profile.get() );
+                osg::ref_ptr<Feature> feature = _projected ?
+                    OgrUtils::createFeature( handle, _profile.get(), _fields ) :
+                    OgrUtils::createFeature( handle, _profile.get() );
 
                 if (feature.valid())
                 {
+                    if (attrSchema)
+                        feature->setAttributeSchema( attrSchema );
+
                     if (!_source->isBlacklisted(feature->getFID()))
                     {
                         if (validateGeometry( feature->getGeometry() ))
@@ -313,3 +357,73 @@ FeatureCursorOGR::readChunk()
     }
 }
 
+unsigned
+FeatureCursorOGR::nextBatch(FeatureBatch& batch, unsigned maxSize)
+{
+    // Filters run on features, and features already read have to go out first.
+    if ( (_filters.valid() && !_filters->empty()) || !_queue.empty() || !_resultSetHandle )
+    {
+        return FeatureCursor::nextBatch( batch, maxSize );
+    }
+
+    batch.clear();
+    batch.srs = _profile.valid() ? _profile->getSRS() : 0L;
+
+    OGR_SCOPED_LOCK;
+
+    // One column per projected field (or per field if there's no projection)
+    OGRFeatureDefnH defn = OGR_L_GetLayerDefn( _resultSetHandle );
+    std::vector<int> fields = _fields;
+    if ( !_projected )
+    {
+        for (int i = 0; i < OGR_FD_GetFieldCount(defn); ++i)
+            fields.push_back( i );
+    }
+
+    for (unsigned i = 0; i < fields.size(); ++i)
+    {
+        OGRFieldDefnH field = OGR_FD_GetFieldDefn( defn, fields[i] );
+        AttributeType type = OgrUtils::getAttributeType( OGR_Fld_GetType(field) );
+        batch.addColumn(
+            osgEarth::toLower( std::string(OGR_Fld_GetNameRef(field)) ),
+            type == ATTRTYPE_UNSPECIFIED ? ATTRTYPE_STRING : type );
+    }
+
+    AttributeValue value;
+    while( batch.size() < maxSize && !_resultSetEndReached )
+    {
+        OGRFeatureH handle = OGR_L_GetNextFeature( _resultSetHandle );
+        if ( !handle )
+        {
+            _resultSetEndReached = true;
+            break;
+        }
+
+        FeatureID fid = OGR_F_GetFID( handle );
+        if ( !_source->isBlacklisted(fid) )
+        {
+            OGRGeometryH geomRef = OGR_F_GetGeometryRef( handle );
+            osg::ref_ptr<Geometry> geom = geomRef ? OgrUtils::createGeometry( geomRef ) : 0L;
+
+            if ( validateGeometry(geom.get()) )
+            {
+                batch.fids.push_back( fid );
+                batch.geometries.push_back( geom.get() );
+
+                for (unsigned i = 0; i < fields.size(); ++i)
+                {
+                    OgrUtils::getAttributeValue( handle, fields[i], value );
+                    batch.append( batch.columns[i], value );
+                }
+            }
+            else
+            {
+                OE_DEBUG << LC << "Invalid geometry found at feature " << fid << std::endl;
+            }
+        }
+
+        OGR_F_Destroy( handle );
+    }
+
+    return batch.size();
+}
@@ -380,10 +380,15 @@ public:
     {
         if (_writable && _layerHandle)
         {
+            // note where it was, so consumers only update that area.
+            osg::ref_ptr<Feature> feature = getFeature( fid );
+            GeoExtent extent = feature.valid() ? feature->getExtent() : GeoExtent::INVALID;
+
             OGR_SCOPED_LOCK;
             if (OGR_L_DeleteFeature( _layerHandle, fid ) == OGRERR_NONE)
             {
                 _needsSync = true;
+                notifyFeatureChanged( FeatureChange::DELETED, fid, extent );
                 return true;
             }            
         }
@@ -411,6 +416,8 @@ public:
             if (handle)
             {
                 result = OgrUtils::createFeature( handle, getFeatureProfile() );
+                if ( result && getAttributeSchema() )
+                    result->setAttributeSchema( getAttributeSchema() );
                 OGR_F_Destroy( handle );
             }
         }
@@ -481,8 +488,13 @@ public:
                 return false;
             }
 
+            // the layer assigns the FID.
+            FeatureID fid = (FeatureID)OGR_F_GetFID( feature_handle );
+
             // clean up the feature
             OGR_F_Destroy( feature_handle );
+
+            notifyFeatureChanged( FeatureChange::INSERTED, fid, feature->getExtent() );
         }
         else
         {
@@ -491,8 +503,6 @@ public:
             return false;
         }
 
-        dirty();
-
         return true;
     }
 
@@ -24,11 +24,13 @@
 #include <osgEarth/Progress>
 
 #include <osgEarthFeatures/FeatureSource>
+#include <osgEarthFeatures/FeatureTileCache>
 #include <osgEarthFeatures/Filter>
 #include <osgEarthFeatures/FilterContext>
 #include <osgEarthFeatures/BufferFilter>
 #include <osgEarthFeatures/ScaleFilter>
 #include <osgEarthFeatures/MVT>
+#include <osgEarthFeatures/GeoJSONReader>
 #include <osgEarthFeatures/OgrUtils>
 #include <osgEarthFeatures/FeatureCursor>
 
@@ -136,6 +138,30 @@ public:
             std::stringstream in(buffer);
             return MVT::read(in, key, features);
         }
+        else if (isJSON(mimeType))
+        {
+            // Stream GeoJSON straight into features; no need to go through OGR.
+            std::istringstream in(buffer);
+            const FeatureProfile* fp = getFeatureProfile();
+            GeoJSONReader reader(in, fp->getSRS());
+
+            for (;;)
+            {
+                osg::ref_ptr<Feature> f = reader.readNext();
+                if ( !f.valid() )
+                    break;
+                if ( fp->geoInterp().isSet() )
+                    f->geoInterp() = fp->geoInterp().get();
+                if ( !isBlacklisted(f->getFID()) )
+                    features.push_back( f.get() );
+            }
+
+            if (reader.hasError())
+            {
+                OE_WARN << LC << "Error reading GeoJSON response: " << reader.getError() << std::endl;
+                return false;
+            }
+        }
         else
         {            
             // find the right driver for the given mime type
@@ -143,7 +169,6 @@ public:
 
             // find the right driver for the given mime type
             OGRSFDriverH ogrDriver =
-                isJSON(mimeType) ? OGRGetDriverByName( "GeoJSON" ) :
                 isGML(mimeType)  ? OGRGetDriverByName( "GML" ) :
                 0L;
 
@@ -290,27 +315,37 @@ public:
         OE_DEBUG << LC << url << std::endl;
         URI uri(url);
 
-        // read the data:
-        ReadResult r = uri.readString(_readOptions.get(), progress);
-
-        const std::string& buffer = r.getString();
-        const Config&      meta   = r.metadata();
-
-        bool dataOK = false;
+        // parsed features may already be in the cache:
+        FeatureTileCache featureCache( _readOptions.get() );
+        std::string cacheKey = Stringify() << "features:" << uri.full();
 
         FeatureList features;
-        if ( !buffer.empty() )
+        bool dataOK = featureCache.read( cacheKey, features );
+
+        if ( !dataOK )
         {
-            // Get the mime-type from the metadata record if possible
-            std::string mimeType = r.metadata().value( IOMetadata::CONTENT_TYPE );
-            //If the mimetype is empty then try to set it from the format specification
-            if (mimeType.empty())
+            // read the data:
+            ReadResult r = uri.readString(_readOptions.get(), progress);
+
+            const std::string& buffer = r.getString();
+            const Config&      meta   = r.metadata();
+
+            if ( !buffer.empty() )
             {
-                if (_options.format().value() == "json") mimeType = "json";
-                else if (_options.format().value().compare("gml") == 0) mimeType = "text/xml";
-                else if (_options.format().value().compare("pbf") == 0) mimeType = "application/x-protobuf";
+                // Get the mime-type from the metadata record if possible
+                std::string mimeType = r.metadata().value( IOMetadata::CONTENT_TYPE );
+                //If the mimetype is empty then try to set it from the format specification
+                if (mimeType.empty())
+                {
+                    if (_options.format().value() == "json") mimeType = "json";
+                    else if (_options.format().value().compare("gml") == 0) mimeType = "text/xml";
+                    else if (_options.format().value().compare("pbf") == 0) mimeType = "application/x-protobuf";
+                }
+                dataOK = getFeatures( buffer, *query.tileKey(), mimeType, features );
             }
-            dataOK = getFeatures( buffer, *query.tileKey(), mimeType, features );
+
+            if ( dataOK )
+                featureCache.write( cacheKey, features );
         }
 
         if ( dataOK )
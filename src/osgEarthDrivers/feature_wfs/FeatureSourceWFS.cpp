@@ -23,6 +23,7 @@
 #include <osgEarth/URI>
 
 #include <osgEarthFeatures/FeatureSource>
+#include <osgEarthFeatures/FeatureTileCache>
 #include <osgEarthFeatures/Filter>
 #include <osgEarthFeatures/FilterContext>
 #include <osgEarthFeatures/FeatureCursor>
@@ -339,20 +340,30 @@ public:
         OE_DEBUG << LC << url << std::endl;
         URI uri(url);
 
-        // read the data:
-        ReadResult r = uri.readString( _readOptions.get(), progress );
-
-        const std::string& buffer = r.getString();
-        const Config&      meta   = r.metadata();
-
-        bool dataOK = false;
+        // parsed features may already be in the cache:
+        FeatureTileCache featureCache( _readOptions.get() );
+        std::string cacheKey = Stringify() << "features:" << uri.full();
 
         FeatureList features;
-        if ( !buffer.empty() )
+        bool dataOK = featureCache.read( cacheKey, features );
+
+        if ( !dataOK )
         {
-            // Get the mime-type from the metadata record if possible
-            const std::string& mimeType = r.metadata().value( IOMetadata::CONTENT_TYPE );
-            dataOK = getFeatures( buffer, mimeType, features );
+            // read the data:
+            ReadResult r = uri.readString( _readOptions.get(), progress );
+
+            const std::string& buffer = r.getString();
+            const Config&      meta   = r.metadata();
+
+            if ( !buffer.empty() )
+            {
+                // Get the mime-type from the metadata record if possible
+                const std::string& mimeType = r.metadata().value( IOMetadata::CONTENT_TYPE );
+                dataOK = getFeatures( buffer, mimeType, features );
+            }
+
+            if ( dataOK )
+                featureCache.write( cacheKey, features );
         }
 
         if ( dataOK )
@@ -35,6 +35,7 @@
 #include <osgDB/ImageOptions>
 
 #include <sstream>
+#include <map>
 #include <stdlib.h>
 #include <memory.h>
 
@@ -674,6 +675,26 @@ GeoExtent getGeoExtent(std::string& filename)
     return ext;
 }
 
+namespace
+{
+    /**
+     * Holds the global GDAL lock, but only if asked to; reads from a
+     * dataset that belongs to the calling thread don't need it.
+     */
+    struct OptionalGDALLock
+    {
+        OptionalGDALLock(bool lock) : _mutex(lock ? &getGDALMutex() : 0L)
+        {
+            if (_mutex) _mutex->lock();
+        }
+        ~OptionalGDALLock()
+        {
+            if (_mutex) _mutex->unlock();
+        }
+        OpenThreads::ReentrantMutex* _mutex;
+    };
+}
+
 
 
 class GDALTileSource : public TileSource
@@ -685,7 +706,9 @@ public:
       _warpedDS(NULL),
       _options(options),
       _maxDataLevel(30),
-      _linearUnits(1.0)
+      _linearUnits(1.0),
+      _warp(false),
+      _warpPolar(false)
     {
     }
 
@@ -693,6 +716,15 @@ public:
     {
         GDAL_SCOPED_LOCK;
 
+        // Close the per-thread handles
+        for (DatasetHandles::iterator i = _handles.begin(); i != _handles.end(); ++i)
+        {
+            if (i->second._warped && i->second._warped != i->second._src)
+                GDALClose(i->second._warped);
+            if (i->second._src)
+                GDALClose(i->second._src);
+        }
+
         // Close the _warpedDS dataset if :
         // - it exists
         // - and is different from _srcDS
@@ -840,6 +872,7 @@ public:
                         _srcDS = (GDALDataset*)GDALOpen(result.getString().c_str(), GA_ReadOnly );
                         if (_srcDS)
                         {
+                            _reopenName = result.getString();
                             OE_INFO << LC << INDENT << "Read VRT from cache!" << std::endl;
                         }
                     }
@@ -856,6 +889,11 @@ public:
 
                     if (_srcDS)
                     {
+                        // The XML description lets each thread open its own copy.
+                        char** vrtXML = _srcDS->GetMetadata("xml:VRT");
+                        if (vrtXML && vrtXML[0])
+                            _reopenName = vrtXML[0];
+
                         //Cache the VRT so we don't have to build it next time.
                         if (_cacheBin)
                         {
@@ -901,6 +939,7 @@ public:
 
                 if (_srcDS)
                 {
+                    _reopenName = files[0];
 
                     char **subDatasets = _srcDS->GetMetadata( "SUBDATASETS");
                     int numSubDatasets = CSLCount( subDatasets );
@@ -915,6 +954,7 @@ public:
                         char *pszSubdatasetName = CPLStrdup( CSLFetchNameValue( subDatasets, buf.str().c_str() ) );
                         GDALClose( _srcDS );
                         _srcDS = (GDALDataset*)GDALOpen( pszSubdatasetName, GA_ReadOnly ) ;
+                        _reopenName = pszSubdatasetName;
                         CPLFree( pszSubdatasetName );
                     }
                 }
@@ -1045,27 +1085,11 @@ public:
 
         if ( requiresReprojection || (profile && !profile->getSRS()->isEquivalentTo( src_srs.get() )) )
         {
-            if ( profile && profile->getSRS()->isGeographic() && (src_srs->isNorthPolar() || src_srs->isSouthPolar()) )
-            {
-                _warpedDS = (GDALDataset*)GDALAutoCreateWarpedVRTforPolarStereographic(
-                    _srcDS,
-                    src_srs->getWKT().c_str(),
-                    profile->getSRS()->getWKT().c_str(),
-                    GRA_NearestNeighbour,
-                    5.0,
-                    NULL);
-            }
-            else
-            {
-                std::string destWKT = profile ? profile->getSRS()->getWKT() : src_srs->getWKT();
-                _warpedDS = (GDALDataset*)GDALAutoCreateWarpedVRT(
-                    _srcDS,
-                    src_srs->getWKT().c_str(),
-                    destWKT.c_str(),
-                    GRA_NearestNeighbour,
-                    5.0,
-                    0);
-            }
+            _warp = true;
+            _warpPolar = profile && profile->getSRS()->isGeographic() && (src_srs->isNorthPolar() || src_srs->isSouthPolar());
+            _warpSrcWKT = src_srs->getWKT();
+            _warpDstWKT = profile ? profile->getSRS()->getWKT() : src_srs->getWKT();
+            _warpedDS = createWarpedDS(_srcDS);
 
             if ( _warpedDS )
             {
@@ -1247,13 +1271,86 @@ public:
     }
 
 
+    /**
+    * Creates a warping VRT on top of a source dataset, with the parameters
+    * worked out in initialize().
+    */
+    GDALDataset* createWarpedDS(GDALDataset* srcDS)
+    {
+        if (_warpPolar)
+        {
+            return (GDALDataset*)GDALAutoCreateWarpedVRTforPolarStereographic(
+                srcDS,
+                _warpSrcWKT.c_str(),
+                _warpDstWKT.c_str(),
+                GRA_NearestNeighbour,
+                5.0,
+                NULL);
+        }
+        else
+        {
+            return (GDALDataset*)GDALAutoCreateWarpedVRT(
+                srcDS,
+                _warpSrcWKT.c_str(),
+                _warpDstWKT.c_str(),
+                GRA_NearestNeighbour,
+                5.0,
+                0);
+        }
+    }
+
+    /**
+    * Gets the calling thread's own (warped) dataset, opening it the first time
+    * the thread asks, so that reads from different threads can run in parallel.
+    * Returns NULL if the source can't be reopened (an external dataset, for
+    * example), in which case the caller reads the shared dataset under the
+    * global GDAL lock.
+    */
+    GDALDataset* getThreadDataset()
+    {
+        if (_reopenName.empty())
+            return 0L;
+
+        unsigned id = Threading::getCurrentThreadId();
+        {
+            Threading::ScopedMutexLock lock(_handlesMutex);
+            DatasetHandles::const_iterator i = _handles.find(id);
+            if (i != _handles.end())
+                return i->second._warped;
+        }
+
+        DatasetHandle handle;
+        {
+            GDAL_SCOPED_LOCK;
+            handle._src = (GDALDataset*)GDALOpen(_reopenName.c_str(), GA_ReadOnly);
+            if (handle._src)
+            {
+                handle._warped = _warp ? createWarpedDS(handle._src) : handle._src;
+                if (!handle._warped)
+                {
+                    GDALClose(handle._src);
+                    handle._src = 0L;
+                }
+            }
+        }
+
+        if (!handle._warped)
+        {
+            OE_WARN << LC << "Failed to open a dataset handle for thread " << id
+                << "; falling back on the shared dataset" << std::endl;
+        }
+
+        // Only this thread adds its own entry, so there's no race to lose here.
+        Threading::ScopedMutexLock lock(_handlesMutex);
+        _handles[id] = handle;
+        return handle._warped;
+    }
+
     /**
     * Finds a raster band based on color interpretation
     */
     static GDALRasterBand* findBandByColorInterp(GDALDataset *ds, GDALColorInterp colorInterp)
     {
-        GDAL_SCOPED_LOCK;
-
         for (int i = 1; i <= ds->GetRasterCount(); ++i)
         {
             if (ds->GetRasterBand(i)->GetColorInterpretation() == colorInterp) return ds->GetRasterBand(i);
@@ -1263,8 +1360,6 @@ public:
 
     static GDALRasterBand* findBandByDataType(GDALDataset *ds, GDALDataType dataType)
     {
-        GDAL_SCOPED_LOCK;
-
         for (int i = 1; i <= ds->GetRasterCount(); ++i)
         {
             if (ds->GetRasterBand(i)->GetRasterDataType() == dataType) return ds->GetRasterBand(i);
@@ -1411,6 +1506,14 @@ public:
                 break;
         }
 
+        // Read from the best overview of the band when reducing:
+        if (eRWFlag == GF_Read)
+        {
+            int level = selectOverview(band, nXOff, nYOff, nXSize, nYSize, nBufXSize, nBufYSize);
+            if (level >= 0)
+                band = band->GetOverview(level);
+        }
+
         CPLErr err = band->RasterIO(eRWFlag, nXOff, nYOff, nXSize, nYSize, pData, nBufXSize, nBufYSize, eBufType, nPixelSpace, nLineSpace, &psExtraArg);
 #else
         if (interpolation != INTERP_NEAREST)
@@ -1426,6 +1529,132 @@ public:
         return (err == CE_None);
     }
 
+    /**
+    * Finds the coarsest overview of a band that still has at least the
+    * resolution of the output buffer, and maps the read window onto it.
+    * Returns -1 (and leaves the window alone) if the full resolution band
+    * is the best choice.
+    */
+    static int selectOverview(GDALRasterBand* band,
+        int& xOff, int& yOff, int& xSize, int& ySize,
+        int bufXSize, int bufYSize)
+    {
+        int numOverviews = band->GetOverviewCount();
+        if (numOverviews == 0 || bufXSize >= xSize || bufYSize >= ySize)
+            return -1;
+
+        // Resolution we need, as a fraction of the full resolution
+        double needX = (double)bufXSize / (double)xSize;
+        double needY = (double)bufYSize / (double)ySize;
+
+        int best = -1;
+        int bestXSize = band->GetXSize();
+        for (int i = 0; i < numOverviews; ++i)
+        {
+            GDALRasterBand* ov = band->GetOverview(i);
+            if (!ov)
+                continue;
+
+            double ratioX = (double)ov->GetXSize() / (double)band->GetXSize();
+            double ratioY = (double)ov->GetYSize() / (double)band->GetYSize();
+            if (ratioX >= needX && ratioY >= needY && ov->GetXSize() < bestXSize)
+            {
+                best = i;
+                bestXSize = ov->GetXSize();
+            }
+        }
+
+        if (best >= 0)
+        {
+            GDALRasterBand* ov = band->GetOverview(best);
+            double ratioX = (double)ov->GetXSize() / (double)band->GetXSize();
+            double ratioY = (double)ov->GetYSize() / (double)band->GetYSize();
+
+            int x0 = (int)floor(xOff * ratioX);
+            int y0 = (int)floor(yOff * ratioY);
+            int x1 = osg::minimum((int)ceil((xOff + xSize) * ratioX), ov->GetXSize());
+            int y1 = osg::minimum((int)ceil((yOff + ySize) * ratioY), ov->GetYSize());
+            if (x1 <= x0 || y1 <= y0)
+                return -1;
+
+            xOff = x0; yOff = y0;
+            xSize = x1 - x0; ySize = y1 - y0;
+        }
+        return best;
+    }
+
+    /**
+    * Reads the same window of several bytes bands into one pixel-interleaved
+    * buffer (numBands bytes per pixel), from the best overview level. If all
+    * the bands live in one dataset this is a single dataset read, so every
+    * block of a pixel-interleaved file is only decoded once.
+    */
+    bool readInterleaved(GDALRasterBand** bands, int numBands,
+        int xOff, int yOff, int xSize, int ySize,
+        unsigned char* buffer, int bufXSize, int bufYSize,
+        ElevationInterpolation interpolation)
+    {
+        int level = selectOverview(bands[0], xOff, yOff, xSize, ySize, bufXSize, bufYSize);
+
+        std::vector<GDALRasterBand*> readBands(numBands);
+        std::vector<int> bandMap(numBands);
+        GDALDataset* ds = 0L;
+        bool sameDataset = true;
+
+        for (int i = 0; i < numBands; ++i)
+        {
+            readBands[i] = level >= 0 ? bands[i]->GetOverview(level) : bands[i];
+            if (!readBands[i])
+                return false;
+
+            bandMap[i] = readBands[i]->GetBand();
+            GDALDataset* bandDS = readBands[i]->GetDataset();
+            if (i == 0)
+                ds = bandDS;
+            if (!bandDS || bandDS != ds || bandMap[i] < 1)
+                sameDataset = false;
+        }
+
+        if (sameDataset)
+        {
+#if GDAL_VERSION_2_0_OR_NEWER
+            GDALRasterIOExtraArg psExtraArg;
+            INIT_RASTERIO_EXTRA_ARG(psExtraArg);
+            switch(interpolation)
+            {
+                case INTERP_AVERAGE: // see rasterIO()
+                case INTERP_BILINEAR:
+                    psExtraArg.eResampleAlg = GRIORA_Bilinear;
+                    break;
+                case INTERP_CUBIC:
+                    psExtraArg.eResampleAlg = GRIORA_Cubic;
+                    break;
+                case INTERP_CUBICSPLINE:
+                    psExtraArg.eResampleAlg = GRIORA_CubicSpline;
+                    break;
+            }
+            CPLErr err = ds->RasterIO(GF_Read, xOff, yOff, xSize, ySize, buffer, bufXSize, bufYSize, GDT_Byte,
+                numBands, &bandMap[0], numBands, numBands*bufXSize, 1, &psExtraArg);
+#else
+            CPLErr err = ds->RasterIO(GF_Read, xOff, yOff, xSize, ySize, buffer, bufXSize, bufYSize, GDT_Byte,
+                numBands, &bandMap[0], numBands, numBands*bufXSize, 1);
+#endif
+            if (err != CE_None)
+            {
+                OE_WARN << LC << "RasterIO failed.\n";
+            }
+            return (err == CE_None);
+        }
+
+        bool ok = true;
+        for (int i = 0; i < numBands; ++i)
+        {
+            ok = rasterIO(readBands[i], GF_Read, xOff, yOff, xSize, ySize, buffer + i, bufXSize, bufYSize,
+                GDT_Byte, numBands, numBands*bufXSize, interpolation) && ok;
+        }
+        return ok;
+    }
+
     osg::Image* createImage( const TileKey&        key,
         ProgressCallback*     progress)
     {
@@ -1436,7 +1665,12 @@ public:
             return NULL;
         }
 
-        GDAL_SCOPED_LOCK;
+        // Read from this thread's own dataset if possible, and only lock
+        // when sharing the dataset with other threads.
+        GDALDataset* warpedDS = getThreadDataset();
+        OptionalGDALLock lock(warpedDS == 0L);
+        if (!warpedDS)
+            warpedDS = _warpedDS;
 
         int tileSize = getPixelsPerTile(); //_options.tileSize().value();
 
@@ -1501,8 +1735,8 @@ public:
         int height = (int)(src_max_y - src_min_y);
 
 
-        int rasterWidth = _warpedDS->GetRasterXSize();
-        int rasterHeight = _warpedDS->GetRasterYSize();
+        int rasterWidth = warpedDS->GetRasterXSize();
+        int rasterHeight = warpedDS->GetRasterYSize();
         if (off_x + width > rasterWidth || off_y + height > rasterHeight)
         {
             OE_WARN << LC << "Read window outside of bounds of dataset.  Source Dimensions=" << rasterWidth << "x" << rasterHeight << " Read Window=" << off_x << ", " << off_y << " " << width << "x" << height << std::endl;
@@ -1536,44 +1770,44 @@ public:
 
 
 
-        GDALRasterBand* bandRed = findBandByColorInterp(_warpedDS, GCI_RedBand);
-        GDALRasterBand* bandGreen = findBandByColorInterp(_warpedDS, GCI_GreenBand);
-        GDALRasterBand* bandBlue = findBandByColorInterp(_warpedDS, GCI_BlueBand);
-        GDALRasterBand* bandAlpha = findBandByColorInterp(_warpedDS, GCI_AlphaBand);
+        GDALRasterBand* bandRed = findBandByColorInterp(warpedDS, GCI_RedBand);
+        GDALRasterBand* bandGreen = findBandByColorInterp(warpedDS, GCI_GreenBand);
+        GDALRasterBand* bandBlue = findBandByColorInterp(warpedDS, GCI_BlueBand);
+        GDALRasterBand* bandAlpha = findBandByColorInterp(warpedDS, GCI_AlphaBand);
 
-        GDALRasterBand* bandGray = findBandByColorInterp(_warpedDS, GCI_GrayIndex);
+        GDALRasterBand* bandGray = findBandByColorInterp(warpedDS, GCI_GrayIndex);
 
-        GDALRasterBand* bandPalette = findBandByColorInterp(_warpedDS, GCI_PaletteIndex);
+        GDALRasterBand* bandPalette = findBandByColorInterp(warpedDS, GCI_PaletteIndex);
 
         if (!bandRed && !bandGreen && !bandBlue && !bandAlpha && !bandGray && !bandPalette)
         {
             OE_DEBUG << LC << "Could not determine bands based on color interpretation, using band count" << std::endl;
             //We couldn't find any valid bands based on the color interp, so just make an educated guess based on the number of bands in the file
             //RGB = 3 bands
-            if (_warpedDS->GetRasterCount() == 3)
+            if (warpedDS->GetRasterCount() == 3)
             {
-                bandRed   = _warpedDS->GetRasterBand( 1 );
-                bandGreen = _warpedDS->GetRasterBand( 2 );
-                bandBlue  = _warpedDS->GetRasterBand( 3 );
+                bandRed   = warpedDS->GetRasterBand( 1 );
+                bandGreen = warpedDS->GetRasterBand( 2 );
+                bandBlue  = warpedDS->GetRasterBand( 3 );
             }
             //RGBA = 4 bands
-            else if (_warpedDS->GetRasterCount() == 4)
+            else if (warpedDS->GetRasterCount() == 4)
             {
-                bandRed   = _warpedDS->GetRasterBand( 1 );
-                bandGreen = _warpedDS->GetRasterBand( 2 );
-                bandBlue  = _warpedDS->GetRasterBand( 3 );
-                bandAlpha = _warpedDS->GetRasterBand( 4 );
+                bandRed   = warpedDS->GetRasterBand( 1 );
+                bandGreen = warpedDS->GetRasterBand( 2 );
+                bandBlue  = warpedDS->GetRasterBand( 3 );
+                bandAlpha = warpedDS->GetRasterBand( 4 );
             }
             //Gray = 1 band
-            else if (_warpedDS->GetRasterCount() == 1)
+            else if (warpedDS->GetRasterCount() == 1)
             {
-                bandGray = _warpedDS->GetRasterBand( 1 );
+                bandGray = warpedDS->GetRasterBand( 1 );
             }
             //Gray + alpha = 2 bands
-            else if (_warpedDS->GetRasterCount() == 2)
+            else if (warpedDS->GetRasterCount() == 2)
             {
-                bandGray  = _warpedDS->GetRasterBand( 1 );
-                bandAlpha = _warpedDS->GetRasterBand( 2 );
+                bandGray  = warpedDS->GetRasterBand( 1 );
+                bandAlpha = warpedDS->GetRasterBand( 2 );
             }
         }
 
@@ -1585,25 +1819,30 @@ public:
 
         if (bandRed && bandGreen && bandBlue)
         {
-            unsigned char *red = new unsigned char[target_width * target_height];
-            unsigned char *green = new unsigned char[target_width * target_height];
-            unsigned char *blue = new unsigned char[target_width * target_height];
-            unsigned char *alpha = new unsigned char[target_width * target_height];
-
-            //Initialize the alpha values to 255.
-            memset(alpha, 255, target_width * target_height);
+            // Read all the bands at once into one RGBA buffer:
+            GDALRasterBand* bands[4] = { bandRed, bandGreen, bandBlue, bandAlpha };
+            int numBands = bandAlpha ? 4 : 3;
+            unsigned char *rgba = new unsigned char[target_width * target_height * 4];
 
             image = new osg::Image;
             image->allocateImage(tileSize, tileSize, 1, pixelFormat, GL_UNSIGNED_BYTE);
             memset(image->data(), 0, image->getImageSizeInBytes());
 
-            rasterIO(bandRed, GF_Read, off_x, off_y, width, height, red, target_width, target_height, GDT_Byte, 0, 0, *_options.interpolation());
-            rasterIO(bandGreen, GF_Read, off_x, off_y, width, height, green, target_width, target_height, GDT_Byte, 0, 0, *_options.interpolation());
-            rasterIO(bandBlue, GF_Read, off_x, off_y, width, height, blue, target_width, target_height, GDT_Byte, 0, 0, *_options.interpolation());
-
-            if (bandAlpha)
+            if (numBands == 4)
             {
-                rasterIO(bandAlpha, GF_Read, off_x, off_y, width, height, alpha, target_width, target_height, GDT_Byte, 0, 0, *_options.interpolation());
+                readInterleaved(bands, 4, off_x, off_y, width, height, rgba, target_width, target_height, *_options.interpolation());
+            }
+            else
+            {
+                // No alpha band: read RGB triplets, then spread them out with an opaque alpha.
+                readInterleaved(bands, 3, off_x, off_y, width, height, rgba, target_width, target_height, *_options.interpolation());
+                for (int i = target_width * target_height - 1; i >= 0; --i)
+                {
+                    rgba[i*4+3] = 255;
+                    rgba[i*4+2] = rgba[i*3+2];
+                    rgba[i*4+1] = rgba[i*3+1];
+                    rgba[i*4+0] = rgba[i*3+0];
+                }
             }
 
             for (int src_row = 0, dst_row = tile_offset_top;
@@ -1614,10 +1853,11 @@ public:
                     src_col < target_width;
                     ++src_col, ++dst_col)
                 {
-                    unsigned char r = red[src_col + src_row * target_width];
-                    unsigned char g = green[src_col + src_row * target_width];
-                    unsigned char b = blue[src_col + src_row * target_width];
-                    unsigned char a = alpha[src_col + src_row * target_width];
+                    const unsigned char* px = &rgba[(src_col + src_row * target_width) * 4];
+                    unsigned char r = px[0];
+                    unsigned char g = px[1];
+                    unsigned char b = px[2];
+                    unsigned char a = px[3];
                     *(image->data(dst_col, dst_row) + 0) = r;
                     *(image->data(dst_col, dst_row) + 1) = g;
                     *(image->data(dst_col, dst_row) + 2) = b;
@@ -1634,10 +1874,7 @@ public:
 
             image->flipVertical();
 
-            delete []red;
-            delete []green;
-            delete []blue;
-            delete []alpha;
+            delete []rgba;
         }
         else if (bandGray)
         {
@@ -1892,9 +2129,9 @@ public:
         return true;
     }
 
+    // Callers hold either the GDAL lock or a dataset of their own.
     bool isValidValue(float v, GDALRasterBand* band)
     {
-        GDAL_SCOPED_LOCK;
         return isValidValue_noLock( v, band );
     }
 
@@ -2026,7 +2263,10 @@ public:
             return NULL;
         }
 
-        GDAL_SCOPED_LOCK;
+        GDALDataset* warpedDS = getThreadDataset();
+        OptionalGDALLock lock(warpedDS == 0L);
+        if (!warpedDS)
+            warpedDS = _warpedDS;
 
         int tileSize = getPixelsPerTile();
 
@@ -2041,11 +2281,11 @@ public:
             key.getExtent().getBounds(xmin, ymin, xmax, ymax);
 
             // Try to find a FLOAT band
-            GDALRasterBand* band = findBandByDataType(_warpedDS, GDT_Float32);
+            GDALRasterBand* band = findBandByDataType(warpedDS, GDT_Float32);
             if (band == NULL)
             {
                 // Just get first band
-                band = _warpedDS->GetRasterBand(1);
+                band = warpedDS->GetRasterBand(1);
             }
 
             if (_options.interpolation() == INTERP_NEAREST)
@@ -2064,9 +2304,9 @@ public:
                 int iNumRows = iRowMax - iRowMin + 1;
 
                 int iWinColMin = max(0, iColMin);
-                int iWinColMax = min(_warpedDS->GetRasterXSize()-1, iColMax);
+                int iWinColMax = min(warpedDS->GetRasterXSize()-1, iColMax);
                 int iWinRowMin = max(0, iRowMin);
-                int iWinRowMax = min(_warpedDS->GetRasterYSize()-1, iRowMax);
+                int iWinRowMax = min(warpedDS->GetRasterYSize()-1, iRowMax);
                 int iNumWinCols = iWinColMax - iWinColMin + 1;
                 int iNumWinRows = iWinRowMax - iWinRowMin + 1;
 
@@ -2138,6 +2378,24 @@ private:
     osg::ref_ptr< osgDB::Options > _dbOptions;
 
     unsigned int _maxDataLevel;
+
+    // How to open more handles on the source: a file name, a subdataset
+    // name or VRT XML. Empty if the source can't be reopened.
+    std::string _reopenName;
+    bool        _warp;
+    bool        _warpPolar;
+    std::string _warpSrcWKT;
+    std::string _warpDstWKT;
+
+    struct DatasetHandle
+    {
+        DatasetHandle() : _src(0L), _warped(0L) { }
+        GDALDataset* _src;
+        GDALDataset* _warped;
+    };
+    typedef std::map<unsigned, DatasetHandle> DatasetHandles;
+    DatasetHandles   _handles;
+    Threading::Mutex _handlesMutex;
 };
 
 
@@ -0,0 +1,185 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2016 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "KMLBuilder"
+#include "KML_Placemark"
+#include <osgEarth/Registry>
+
+using namespace osgEarth_kml;
+using namespace osgEarth;
+
+#undef LC
+#define LC "[KMLBuilder] "
+
+// Finished batches to attach per frame.
+#define MAX_BATCHES_PER_FRAME 4u
+
+struct KMLBuilder::BuildTask : public TaskRequest
+{
+    BuildTask(KMLBuilder* builder, Batch* batch) : _builder(builder), _batch(batch) { }
+
+    void operator()(ProgressCallback* progress)
+    {
+        if (progress && progress->isCanceled())
+            return;
+
+        _builder->build(_batch.get());
+    }
+
+    osg::ref_ptr<KMLBuilder> _builder;
+    osg::ref_ptr<Batch>      _batch;
+};
+
+KMLBuilder::KMLBuilder(osg::Node* root, const KMLOptions& options, KMLSource* source) :
+_root    ( root ),
+_options ( options ),
+_source  ( source ),
+_finished( false )
+{
+    _jobs = new JobGroup();
+}
+
+void
+KMLBuilder::setContext(const KMLContext& cx)
+{
+    _context = cx;
+    _context._options = &_options;
+    _context._groupStack = std::stack<osg::ref_ptr<osg::Group> >();
+    _context._builder = this;
+    _context._inBackground = true;
+    _mapNode = cx._mapNode;
+}
+
+void
+KMLBuilder::defer(xml_node<>* placemark, KMLContext& cx)
+{
+    osg::Group* target = cx._groupStack.top().get();
+
+    if (_batch.valid() && _batch->_target.get() != target)
+        flush();
+
+    if (!_batch.valid())
+    {
+        _batch = new Batch();
+        _batch->_target = target;
+    }
+
+    _batch->_placemarks.push_back(placemark);
+
+    if (_batch->_placemarks.size() >= _options.placemarksPerBatch().get())
+        flush();
+}
+
+void
+KMLBuilder::flush()
+{
+    if (_batch.valid())
+    {
+        Registry::instance()->getJobScheduler()->submit(
+            new BuildTask(this, _batch.get()),
+            JobScheduler::LANE_NORMAL,
+            _jobs.get());
+
+        _batch = 0L;
+    }
+}
+
+void
+KMLBuilder::finish()
+{
+    flush();
+    _finished = true;
+}
+
+void
+KMLBuilder::build(Batch* batch)
+{
+    // nothing to do once the KML is gone.
+    osg::ref_ptr<osg::Node> root;
+    osg::ref_ptr<MapNode> mapNode;
+    if (!_root.lock(root) || !_mapNode.lock(mapNode))
+    {
+        _jobs->cancel();
+        return;
+    }
+
+    batch->_staging = new osg::Group();
+
+    KMLContext cx = _context;
+    cx._groupStack.push(batch->_staging.get());
+    if (cx._iconAndLabelGroup.valid())
+    {
+        batch->_iconStaging = new osg::Group();
+        cx._iconAndLabelGroup = batch->_iconStaging.get();
+    }
+
+    for (unsigned i = 0; i < batch->_placemarks.size(); ++i)
+    {
+        KML_Placemark placemark;
+        placemark.build(batch->_placemarks[i], cx);
+    }
+
+    Threading::ScopedMutexLock lock(_readyMutex);
+    _ready.push_back(batch);
+}
+
+void
+KMLBuilder::operator()(osg::Node* node, osg::NodeVisitor* nv)
+{
+    // hold a reference, since we might remove ourselves below.
+    osg::ref_ptr<KMLBuilder> self = this;
+
+    bool idle = _finished && _jobs->getNumPending() == 0u;
+
+    for (unsigned count = 0; count < MAX_BATCHES_PER_FRAME; ++count)
+    {
+        osg::ref_ptr<Batch> batch;
+        {
+            Threading::ScopedMutexLock lock(_readyMutex);
+            if (_ready.empty())
+                break;
+            batch = _ready.front();
+            _ready.pop_front();
+        }
+
+        for (unsigned i = 0; i < batch->_staging->getNumChildren(); ++i)
+            batch->_target->addChild(batch->_staging->getChild(i));
+
+        if (batch->_iconStaging.valid() && _options.iconAndLabelGroup().valid())
+        {
+            for (unsigned i = 0; i < batch->_iconStaging->getNumChildren(); ++i)
+                _options.iconAndLabelGroup()->addChild(batch->_iconStaging->getChild(i));
+        }
+    }
+
+    traverse(node, nv);
+
+    if (idle)
+    {
+        bool done;
+        {
+            Threading::ScopedMutexLock lock(_readyMutex);
+            done = _ready.empty();
+        }
+        if (done)
+        {
+            OE_INFO << LC << "Finished building placemarks\n";
+            node->removeUpdateCallback(this);
+        }
+    }
+}
@@ -19,6 +19,7 @@
 #include "KMLReader"
 #include "KML_Root"
 #include "KML_Geometry"
+#include "KMLBuilder"
 #include <osgEarth/Registry>
 #include <osgEarth/Capabilities>
 #include <osgEarth/XmlUtils>
@@ -35,7 +36,8 @@ using namespace osgEarth;
 
 KMLReader::KMLReader( MapNode* mapNode, const KMLOptions* options ) :
 _mapNode( mapNode ),
-_options( options )
+_options( options ),
+_source ( 0L )
 {
     //nop
 }
@@ -51,12 +53,16 @@ KMLReader::read( std::istream& in, const osgDB::Options* dbOptions )
     osg::Timer_t start = osg::Timer::instance()->tick();
 	std::stringstream buffer;
     buffer << in.rdbuf();
-    std::string xmlStr;
-    xmlStr = buffer.str();
-	xml_document<> doc;
-	doc.parse<0>(&xmlStr[0]);
 
-	osg::Node* node = read(doc, dbOptions);
+    // the parsed document lives on the heap, since a background build
+    // keeps reading from it after we return.
+    osg::ref_ptr<KMLSource> source = new KMLSource();
+    source->_xml = buffer.str();
+	source->_doc.parse<0>(&source->_xml[0]);
+
+    _source = source.get();
+	osg::Node* node = read(source->_doc, dbOptions);
+    _source = 0L;
 
     osg::Timer_t end = osg::Timer::instance()->tick();
 	OE_INFO << LC << "Loaded KML in " << osg::Timer::instance()->delta_s(start, end) << std::endl;
@@ -84,14 +90,31 @@ KMLReader::read( xml_document<>& doc, const osgDB::Options* dbOptions )
     cx._srs = _mapNode->getMapSRS()->getGeographicSRS();
     cx._referrer = context.referrer();
     cx._groupStack.push( root );
+    cx._resourceCache = ResourceCache::getShared();
+
+    // initialize the KML options with the defaults if necessary:
+    KMLOptions blankOptions;
+    if ( cx._options == 0L )
+        cx._options = &blankOptions;
 
+    cx._iconAndLabelGroup = cx._options->iconAndLabelGroup();
+
+    // placemarks can only build in the background if we own the document:
+    osg::ref_ptr<KMLBuilder> builder;
+    if ( cx._options->backgroundBuild() == true && _source )
+    {
+        builder = new KMLBuilder( root, *cx._options, _source );
+    }
 
     // clone the dbOptions, and install a resource cache if there isn't one already:
     URIResultCache defaultUriCache;
     if ( !URIResultCache::from(dbOptions) )
     {
         osgDB::Options* newOptions = Registry::instance()->cloneOrCreateOptions();
-        defaultUriCache.apply( newOptions );
+        if ( builder.valid() )
+            builder->getURICache()->apply( newOptions );
+        else
+            defaultUriCache.apply( newOptions );
         cx._dbOptions = newOptions;
     }
     else
@@ -99,10 +122,18 @@ KMLReader::read( xml_document<>& doc, const osgDB::Options* dbOptions )
         cx._dbOptions = dbOptions;
     }
 
-    // initialize the KML options with the defaults if necessary:
-    KMLOptions blankOptions;
-    if ( cx._options == 0L )
-        cx._options = &blankOptions;
+    if ( cx._options->paging() == true )
+    {
+        cx._pager = new osgEarth::Annotation::AnnotationPager( _mapNode->getMap()->getProfile() );
+        cx._pager->setTileLOD( cx._options->pagingLOD().get() );
+        root->addChild( cx._pager.get() );
+    }
+
+    if ( builder.valid() )
+    {
+        builder->setContext( cx );
+        cx._builder = builder.get();
+    }
 
     //if ( cx._options->iconAndLabelGroup().valid() && cx._options->declutter() == true )
     //{
@@ -132,6 +163,12 @@ KMLReader::read( xml_document<>& doc, const osgDB::Options* dbOptions )
         OE_INFO << LC << "  build took " << osg::Timer::instance()->delta_s(start, end) << std::endl;
     }
 
+    if ( builder.valid() )
+    {
+        builder->finish();
+        root->addUpdateCallback( builder.get() );
+    }
+
     URIResultCache* cacheUsed = URIResultCache::from(cx._dbOptions.get());
     CacheStats stats = cacheUsed->getStats();
     OE_INFO << LC << "  URI Cache: " << stats._queries << " reads, " << (stats._hitRatio*100.0) << "% hits" << std::endl;
@@ -28,6 +28,32 @@
 
 using namespace osgEarth_kml;
 
+namespace
+{
+    // Copy of the KML options, owned by the read options of a linked
+    // document so the pointer in its plugin data stays valid for as long
+    // as the database pager might load it.
+    struct KMLOptionsHolder : public osg::Referenced
+    {
+        KMLOptionsHolder(const KMLOptions& options) : _options(options) { }
+        KMLOptions _options;
+    };
+
+    // Options for loading a linked document. The database pager fetches it
+    // in the background, and it reads with the same settings (paging,
+    // background build) as the document linking to it.
+    osgDB::Options* createLinkOptions(KMLContext& cx)
+    {
+        osgDB::Options* options = Registry::instance()->cloneOrCreateOptions();
+        options->setPluginData( "osgEarth::MapNode", cx._mapNode );
+
+        KMLOptionsHolder* holder = new KMLOptionsHolder( *cx._options );
+        options->setUserData( holder );
+        options->setPluginData( "osgEarth::KMLOptions", &holder->_options );
+        return options;
+    }
+}
+
 void
 KML_NetworkLink::build( xml_node<>* node, KMLContext& cx )
 {
@@ -98,8 +124,7 @@ KML_NetworkLink::build( xml_node<>* node, KMLContext& cx )
         plod->setCenter( lodCenter );
         plod->setRadius( d );
 
-        osgDB::Options* options = Registry::instance()->cloneOrCreateOptions();
-        options->setPluginData( "osgEarth::MapNode", cx._mapNode );
+        osgDB::Options* options = createLinkOptions( cx );
         plod->setDatabaseOptions( options );
 
         OE_DEBUG << LC << 
@@ -113,8 +138,7 @@ KML_NetworkLink::build( xml_node<>* node, KMLContext& cx )
         osg::ProxyNode* proxy = new osg::ProxyNode();
         proxy->setFileName( 0, href );                
 
-        osgDB::Options* options = Registry::instance()->cloneOrCreateOptions();
-        options->setPluginData( "osgEarth::MapNode", cx._mapNode );
+        osgDB::Options* options = createLinkOptions( cx );
         proxy->setDatabaseOptions( options );
 
         cx._groupStack.top()->addChild( proxy );
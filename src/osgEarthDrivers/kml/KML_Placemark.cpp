@@ -19,6 +19,7 @@
 #include "KML_Placemark"
 #include "KML_Geometry"
 #include "KML_Style"
+#include "KMLBuilder"
 
 #include <osgEarthAnnotation/FeatureNode>
 #include <osgEarthAnnotation/PlaceNode>
@@ -26,6 +27,7 @@
 #include <osgEarthAnnotation/ModelNode>
 #include <osgEarth/ObjectIndex>
 #include <osgEarth/Registry>
+#include <osgEarthSymbology/ModelResource>
 
 #include <osg/Depth>
 #include <osgDB/WriteFile>
@@ -34,9 +36,21 @@ using namespace osgEarth_kml;
 using namespace osgEarth::Features;
 using namespace osgEarth::Annotation;
 
+namespace
+{
+    Threading::Mutex s_modelMutex;
+}
+
 void 
 KML_Placemark::build( xml_node<>* node, KMLContext& cx )
 {
+    // hand the placemark off to the background build if there is one:
+    if ( cx._builder && !cx._inBackground )
+    {
+        cx._builder->defer( node, cx );
+        return;
+    }
+
 	Style masterStyle;
 
 	std::string styleUrl = getValue(node, "styleurl");
@@ -127,7 +141,29 @@ KML_Placemark::build( xml_node<>* node, KMLContext& cx )
                     // if there's a model, render that - models do NOT get labels.
                     if ( model )
                     {
-                        ModelNode* node = new ModelNode( cx._mapNode, style, cx._dbOptions.get() );
+                        // share one copy of each model between the placemarks that use it:
+                        if ( cx._resourceCache.valid() && model->url().isSet() && !model->getModel() && model->uriAliasMap()->empty() )
+                        {
+                            osg::ref_ptr<ModelResource> res = new ModelResource();
+                            res->uri() = model->url()->evalURI();
+
+                            osg::ref_ptr<osg::Node> shared;
+                            if ( cx._resourceCache->getOrCreateInstanceNode(res.get(), shared, cx._dbOptions.get()) )
+                            {
+                                ModelSymbol* resolved = new ModelSymbol( *model );
+                                resolved->setModel( shared.get() );
+                                style.add( resolved );
+                                model = resolved;
+                            }
+                        }
+
+                        // a shared model gets its shaders generated on first use,
+                        // so model placemarks can't build concurrently.
+                        ModelNode* node;
+                        {
+                            Threading::ScopedMutexLock lock( s_modelMutex );
+                            node = new ModelNode( cx._mapNode, style, cx._dbOptions.get() );
+                        }
                         node->setPosition( position );
 
                         // model scale:
@@ -230,9 +266,13 @@ KML_Placemark::build( xml_node<>* node, KMLContext& cx )
                 {
                     if ( iconNode )
                     {
-                        if ( cx._options->iconAndLabelGroup().valid() )
+                        if ( cx._iconAndLabelGroup.valid() )
                         {
-                            cx._options->iconAndLabelGroup()->addChild( iconNode );
+                            cx._iconAndLabelGroup->addChild( iconNode );
+                        }
+                        else if ( cx._pager.valid() )
+                        {
+                            cx._pager->add( iconNode );
                         }
                         else
                         {
@@ -242,7 +282,10 @@ KML_Placemark::build( xml_node<>* node, KMLContext& cx )
                     }
                     if ( modelNode )
                     {
-                        cx._groupStack.top()->addChild( modelNode );
+                        if ( cx._pager.valid() )
+                            cx._pager->add( modelNode );
+                        else
+                            cx._groupStack.top()->addChild( modelNode );
                         KML_Feature::build( node, cx, modelNode );
                     }
                     if ( featureNode )
@@ -41,7 +41,10 @@ KML_Style::scan( xml_node<>* node, KMLContext& cx )
     KML_PolyStyle poly;
     poly.scan( node->first_node("polystyle", 0, false), style, cx );
 
-    cx._sheet->addStyle( style );
+    // a background build shares the sheet between threads, and the only
+    // styles it meets are inline ones that nothing else refers to.
+    if ( !cx._inBackground )
+        cx._sheet->addStyle( style );
 
     cx._activeStyle = style;
 }
@@ -73,6 +73,11 @@ public:
         NumericExpression iconHeadingExpr ( icon ? *icon->heading()  : NumericExpression() );
         NumericExpression vertOffsetExpr  ( alt  ? *alt->verticalOffset() : NumericExpression() );
 
+        // Features whose expressions evaluate alike (a street name repeated
+        // along every segment of the street) share one evaluated style.
+        typedef std::map<std::string, Style> StyleCache;
+        StyleCache styles;
+
         for( FeatureList::const_iterator i = input.begin(); i != input.end(); ++i )
         {
             Feature* feature = i->get();
@@ -97,42 +102,81 @@ public:
             if ( !geom )
                 continue;
 
-            Style tempStyle = styleCopy;
-
             // evaluate expressions into literals.
             // TODO: Later we could replace this with a generate "expression evaluator" type
             // that we could pass to PlaceNode in the DB options. -gw
 
+            std::string content, offsetWKT, iconURL;
+            double size = 0.0, rotation = 0.0, course = 0.0, iconScale = 0.0, iconHeading = 0.0;
+
             if ( text )
             {
                 if ( text->content().isSet() )
-                    tempStyle.get<TextSymbol>()->content()->setLiteral( feature->eval( textContentExpr, &context ) );
-
+                    content = feature->eval( textContentExpr, &context );
                 if ( text->size().isSet() )
-                    tempStyle.get<TextSymbol>()->size()->setLiteral( feature->eval(textSizeExpr, &context) );
-
+                    size = feature->eval( textSizeExpr, &context );
                 if ( text->onScreenRotation().isSet() )
-                    tempStyle.get<TextSymbol>()->onScreenRotation()->setLiteral( feature->eval(textRotationExpr, &context) );
-
+                    rotation = feature->eval( textRotationExpr, &context );
                 if ( text->geographicCourse().isSet() )
-                    tempStyle.get<TextSymbol>()->geographicCourse()->setLiteral( feature->eval(textCourseExpr, &context) );
-
+                    course = feature->eval( textCourseExpr, &context );
                 if ( text->autoOffsetGeomWKT().isSet() )
-                    tempStyle.get<TextSymbol>()->autoOffsetGeomWKT()->setLiteral( feature->eval( textOffsetSupportExpr, &context ) );
+                    offsetWKT = feature->eval( textOffsetSupportExpr, &context );
             }
 
             if ( icon )
             {
                 if ( icon->url().isSet() )
-                    tempStyle.get<IconSymbol>()->url()->setLiteral( feature->eval(iconUrlExpr, &context) );
-
+                    iconURL = feature->eval( iconUrlExpr, &context );
                 if ( icon->scale().isSet() )
-                    tempStyle.get<IconSymbol>()->scale()->setLiteral( feature->eval(iconScaleExpr, &context) );
-
+                    iconScale = feature->eval( iconScaleExpr, &context );
                 if ( icon->heading().isSet() )
-                    tempStyle.get<IconSymbol>()->heading()->setLiteral( feature->eval(iconHeadingExpr, &context) );
+                    iconHeading = feature->eval( iconHeadingExpr, &context );
             }
 
+            std::string key = Stringify()
+                << content << '\n' << size << '\n' << rotation << '\n' << course << '\n'
+                << offsetWKT << '\n' << iconURL << '\n' << iconScale << '\n' << iconHeading;
+
+            StyleCache::iterator cached = styles.find( key );
+            if ( cached == styles.end() )
+            {
+                Style tempStyle = styleCopy;
+
+                if ( text )
+                {
+                    if ( text->content().isSet() )
+                        tempStyle.get<TextSymbol>()->content()->setLiteral( content );
+
+                    if ( text->size().isSet() )
+                        tempStyle.get<TextSymbol>()->size()->setLiteral( size );
+
+                    if ( text->onScreenRotation().isSet() )
+                        tempStyle.get<TextSymbol>()->onScreenRotation()->setLiteral( rotation );
+
+                    if ( text->geographicCourse().isSet() )
+                        tempStyle.get<TextSymbol>()->geographicCourse()->setLiteral( course );
+
+                    if ( text->autoOffsetGeomWKT().isSet() )
+                        tempStyle.get<TextSymbol>()->autoOffsetGeomWKT()->setLiteral( offsetWKT );
+                }
+
+                if ( icon )
+                {
+                    if ( icon->url().isSet() )
+                        tempStyle.get<IconSymbol>()->url()->setLiteral( iconURL );
+
+                    if ( icon->scale().isSet() )
+                        tempStyle.get<IconSymbol>()->scale()->setLiteral( iconScale );
+
+                    if ( icon->heading().isSet() )
+                        tempStyle.get<IconSymbol>()->heading()->setLiteral( iconHeading );
+                }
+
+                cached = styles.insert( StyleCache::value_type(key, tempStyle) ).first;
+            }
+
+            const Style& tempStyle = cached->second;
+
             osgEarth::Annotation::PlaceNode* node = makePlaceNode(
                 context,
                 feature,
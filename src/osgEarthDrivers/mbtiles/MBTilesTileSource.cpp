@@ -41,6 +41,9 @@ using namespace osgEarth::Drivers::MBTiles;
 
 namespace
 {
+    const char* SELECT_TILE_SQL = "SELECT tile_data from tiles where zoom_level = ? AND tile_column = ? AND tile_row = ?";
+    const char* INSERT_TILE_SQL = "INSERT OR REPLACE INTO tiles (zoom_level, tile_column, tile_row, tile_data) VALUES (?, ?, ?, ?)";
+
     osgDB::ReaderWriter* getReaderWriter(const std::string& format)
     {
         osgDB::ReaderWriter* rw = 0L;
@@ -63,11 +66,50 @@ _options  ( options ),
 _database ( NULL ),
 _minLevel ( 0 ),
 _maxLevel ( 20 ),
-_forceRGB ( false )
+_forceRGB ( false ),
+_insertTile( NULL ),
+_selectTile( NULL ),
+_inBatch   ( false ),
+_batchCount( 0u )
 {
     //nop
 }
 
+MBTilesTileSource::~MBTilesTileSource()
+{
+    {
+        Threading::ScopedMutexLock lock(_connectionsMutex);
+        for (Connections::iterator i = _connections.begin(); i != _connections.end(); ++i)
+        {
+            if (i->second._selectTile)
+                sqlite3_finalize(i->second._selectTile);
+            if (i->second._db)
+                sqlite3_close(i->second._db);
+        }
+        _connections.clear();
+    }
+
+    Threading::ScopedMutexLock exclusiveLock(_mutex);
+
+    if (_database)
+    {
+        commitBatch();
+
+        if (_insertTile)
+            sqlite3_finalize(_insertTile);
+        if (_selectTile)
+            sqlite3_finalize(_selectTile);
+
+        // Leave the file in the default journal mode, so it still works
+        // from read-only media.
+        if ((MODE_WRITE & (int)getMode()) != 0)
+            sqlite3_exec(_database, "PRAGMA journal_mode=DELETE", 0L, 0L, 0L);
+
+        sqlite3_close(_database);
+        _database = NULL;
+    }
+}
+
 Status
 MBTilesTileSource::initialize(const osgDB::Options* dbOptions)
 {
@@ -120,6 +162,17 @@ MBTilesTileSource::initialize(const osgDB::Options* dbOptions)
             << "Database \"" << fullFilename << "\": " << sqlite3_errmsg(_database) );
     }
 
+    _fullFilename = fullFilename;
+
+    // WAL lets the read connections work while we write.
+    if ( readWrite )
+    {
+        if (SQLITE_OK != sqlite3_exec(_database, "PRAGMA journal_mode=WAL", 0L, 0L, 0L))
+        {
+            OE_WARN << LC << "Failed to enable WAL mode: " << sqlite3_errmsg(_database) << std::endl;
+        }
+    }
+
     // New database setup:
     if ( isNewDatabase )
     {
@@ -273,6 +326,19 @@ MBTilesTileSource::initialize(const osgDB::Options* dbOptions)
         }
     }
 
+    // statements on the main connection:
+    if ( SQLITE_OK != sqlite3_prepare_v2(_database, SELECT_TILE_SQL, -1, &_selectTile, 0L) )
+    {
+        OE_WARN << LC << "Failed to prepare SQL: " << SELECT_TILE_SQL << "; " << sqlite3_errmsg(_database) << std::endl;
+        _selectTile = NULL;
+    }
+
+    if ( readWrite && SQLITE_OK != sqlite3_prepare_v2(_database, INSERT_TILE_SQL, -1, &_insertTile, 0L) )
+    {
+        OE_WARN << LC << "Failed to prepare SQL: " << INSERT_TILE_SQL << "; " << sqlite3_errmsg(_database) << std::endl;
+        _insertTile = NULL;
+    }
+
     // do we require RGB? for jpeg?
     _forceRGB =
         osgEarth::endsWith(_tileFormat, "jpg", false) ||
@@ -299,12 +365,76 @@ MBTilesTileSource::getCachePolicyHint(const Profile* targetProfile) const
 }
 
 
+MBTilesTileSource::Connection*
+MBTilesTileSource::getReadConnection()
+{
+    unsigned id = Threading::getCurrentThreadId();
+
+    Threading::ScopedMutexLock lock(_connectionsMutex);
+
+    Connections::iterator i = _connections.find(id);
+    if (i != _connections.end())
+        return i->second._db ? &i->second : 0L;
+
+    // Each connection only ever belongs to one thread, so it doesn't need
+    // sqlite's own mutexing.
+    Connection& c = _connections[id];
+    int rc = sqlite3_open_v2( _fullFilename.c_str(), &c._db, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, 0L );
+    if ( rc == SQLITE_OK )
+    {
+        sqlite3_busy_timeout(c._db, 1000);
+        rc = sqlite3_prepare_v2( c._db, SELECT_TILE_SQL, -1, &c._selectTile, 0L );
+    }
+
+    if ( rc != SQLITE_OK )
+    {
+        OE_WARN << LC << "Failed to open a read connection to \"" << _fullFilename << "\": "
+            << (c._db ? sqlite3_errmsg(c._db) : "") << "; using the main connection" << std::endl;
+        if (c._selectTile)
+            sqlite3_finalize(c._selectTile);
+        if (c._db)
+            sqlite3_close(c._db);
+        c = Connection();
+        return 0L;
+    }
+
+    return &c;
+}
+
+bool
+MBTilesTileSource::readTile(sqlite3* db, sqlite3_stmt* select, int z, int x, int y, std::string& data)
+{
+    if ( !select )
+        return false;
+
+    sqlite3_bind_int( select, 1, z );
+    sqlite3_bind_int( select, 2, x );
+    sqlite3_bind_int( select, 3, y );
+
+    bool found = false;
+    int rc = sqlite3_step( select );
+    if ( rc == SQLITE_ROW)
+    {
+        // the pointer returned from _blob gets freed internally by sqlite, supposedly
+        const char* blob = (const char*)sqlite3_column_blob( select, 0 );
+        int blobLen = sqlite3_column_bytes( select, 0 );
+        data.assign( blob, blobLen );
+        found = true;
+    }
+    else if ( rc != SQLITE_DONE )
+    {
+        OE_DEBUG << LC << "SQL QUERY failed for " << SELECT_TILE_SQL << ": " << sqlite3_errmsg(db) << std::endl;
+    }
+
+    sqlite3_reset( select );
+    sqlite3_clear_bindings( select );
+    return found;
+}
+
 osg::Image*
 MBTilesTileSource::createImage(const TileKey&    key,
                                ProgressCallback* progress)
 {
-    Threading::ScopedMutexLock exclusiveLock(_mutex);
-
     int z = key.getLevelOfDetail();
     int x = key.getTileX();
     int y = key.getTileY();
@@ -324,66 +454,64 @@ MBTilesTileSource::createImage(const TileKey&    key,
     key.getProfile()->getNumTiles(key.getLevelOfDetail(), numCols, numRows);
     y  = numRows - y - 1;
 
-    //Get the image
-    sqlite3_stmt* select = NULL;
-    std::string query = "SELECT tile_data from tiles where zoom_level = ? AND tile_column = ? AND tile_row = ?";
-    int rc = sqlite3_prepare_v2( _database, query.c_str(), -1, &select, 0L );
-    if ( rc != SQLITE_OK )
+    //Get the image. A write batch isn't visible to other connections until it
+    //commits, so while batching, read through the main connection.
+    std::string dataBuffer;
+    bool valid;
+
+    Connection* c = _options.writeBatchSize() > 0u ? 0L : getReadConnection();
+    if ( c )
     {
-        OE_WARN << LC << "Failed to prepare SQL: " << query << "; " << sqlite3_errmsg(_database) << std::endl;
-        return NULL;
+        valid = readTile( c->_db, c->_selectTile, z, x, y, dataBuffer );
     }
-
-    bool valid = true;
-
-    sqlite3_bind_int( select, 1, z );
-    sqlite3_bind_int( select, 2, x );
-    sqlite3_bind_int( select, 3, y );
-
-    osg::Image* result = NULL;
-    rc = sqlite3_step( select );
-    if ( rc == SQLITE_ROW)
+    else
     {
-        // the pointer returned from _blob gets freed internally by sqlite, supposedly
-        const char* data = (const char*)sqlite3_column_blob( select, 0 );
-        int dataLen = sqlite3_column_bytes( select, 0 );
+        Threading::ScopedMutexLock exclusiveLock(_mutex);
+        valid = readTile( _database, _selectTile, z, x, y, dataBuffer );
+    }
 
-        std::string dataBuffer( data, dataLen );
+    if ( !valid )
+        return NULL;
 
-        // decompress if necessary:
-        if ( _compressor.valid() )
+    // decompress if necessary:
+    if ( _compressor.valid() )
+    {
+        std::istringstream inputStream(dataBuffer);
+        std::string value;
+        if ( !_compressor->decompress(inputStream, value) )
         {
-            std::istringstream inputStream(dataBuffer);
-            std::string value;
-            if ( !_compressor->decompress(inputStream, value) )
-            {
-                if ( _options.filename().isSet() )
-                    OE_WARN << LC << "Decompression failed: " << _options.filename()->base() << std::endl;
-                else
-                    OE_WARN << LC << "Decompression failed" << std::endl;
-                valid = false;
-            }
+            if ( _options.filename().isSet() )
+                OE_WARN << LC << "Decompression failed: " << _options.filename()->base() << std::endl;
             else
-            {
-                dataBuffer = value;
-            }
-        }
-
-        // decode the raw image data:
-        if ( valid )
-        {
-            std::istringstream inputStream(dataBuffer);
-            result = ImageUtils::readStream(inputStream, _dbOptions.get());
+                OE_WARN << LC << "Decompression failed" << std::endl;
+            return NULL;
         }
+        dataBuffer = value;
     }
-    else
+
+    // decode the raw image data:
+    std::istringstream inputStream(dataBuffer);
+    return ImageUtils::readStream(inputStream, _dbOptions.get());
+}
+
+bool
+MBTilesTileSource::commitBatch()
+{
+    // caller holds _mutex
+    if ( !_inBatch )
+        return true;
+
+    _inBatch = false;
+    _batchCount = 0u;
+
+    char* errorMsg = 0L;
+    if (SQLITE_OK != sqlite3_exec(_database, "COMMIT", 0L, 0L, &errorMsg))
     {
-        OE_DEBUG << LC << "SQL QUERY failed for " << query << ": " << std::endl;
-        valid = false;
+        OE_WARN << LC << "Failed to commit tiles: " << (errorMsg ? errorMsg : "") << std::endl;
+        sqlite3_free( errorMsg );
+        return false;
     }
-
-    sqlite3_finalize( select );
-    return result;
+    return true;
 }
 
 bool
@@ -394,8 +522,6 @@ MBTilesTileSource::storeImage(const TileKey&    key,
     if ( (getMode() & MODE_WRITE) == 0 )
         return false;
 
-    Threading::ScopedMutexLock exclusiveLock(_mutex);
-
     // encode the data stream:
     std::stringstream buf;
     osgDB::ReaderWriter::WriteResult wr;
@@ -438,14 +564,20 @@ MBTilesTileSource::storeImage(const TileKey&    key,
     key.getProfile()->getNumTiles(key.getLevelOfDetail(), numCols, numRows);
     y  = numRows - y - 1;
 
-    // Prep the insert statement:
-    sqlite3_stmt* insert = NULL;
-    std::string query = "INSERT OR REPLACE INTO tiles (zoom_level, tile_column, tile_row, tile_data) VALUES (?, ?, ?, ?)";
-    int rc = sqlite3_prepare_v2( _database, query.c_str(), -1, &insert, 0L );
-    if ( rc != SQLITE_OK )
-    {
-        OE_WARN << LC << "Failed to prepare SQL: " << query << "; " << sqlite3_errmsg(_database) << std::endl;
+    Threading::ScopedMutexLock exclusiveLock(_mutex);
+
+    sqlite3_stmt* insert = _insertTile;
+    if ( !insert )
         return false;
+
+    // Start a new batch if we're batching:
+    unsigned batchSize = _options.writeBatchSize().get();
+    if ( batchSize > 0u && !_inBatch )
+    {
+        if (SQLITE_OK == sqlite3_exec(_database, "BEGIN", 0L, 0L, 0L))
+            _inBatch = true;
+        else
+            OE_WARN << LC << "Failed to begin a transaction: " << sqlite3_errmsg(_database) << std::endl;
     }
 
     // bind parameters:
@@ -459,6 +591,7 @@ MBTilesTileSource::storeImage(const TileKey&    key,
     // run the sql.
     bool ok = true;
     int tries = 0;
+    int rc;
     do {
         rc = sqlite3_step(insert);
     }
@@ -467,14 +600,20 @@ MBTilesTileSource::storeImage(const TileKey&    key,
     if (SQLITE_OK != rc && SQLITE_DONE != rc)
     {
 #if SQLITE_VERSION_NUMBER >= 3007015
-        OE_WARN << LC << "Failed query: " << query << "(" << rc << ")" << sqlite3_errstr(rc) << "; " << sqlite3_errmsg(_database) << std::endl;
+        OE_WARN << LC << "Failed query: " << INSERT_TILE_SQL << "(" << rc << ")" << sqlite3_errstr(rc) << "; " << sqlite3_errmsg(_database) << std::endl;
 #else
-        OE_WARN << LC << "Failed query: " << query << "(" << rc << ")" << rc << "; " << sqlite3_errmsg(_database) << std::endl;
+        OE_WARN << LC << "Failed query: " << INSERT_TILE_SQL << "(" << rc << ")" << rc << "; " << sqlite3_errmsg(_database) << std::endl;
 #endif
         ok = false;
     }
 
-    sqlite3_finalize( insert );
+    sqlite3_reset( insert );
+    sqlite3_clear_bindings( insert );
+
+    if ( _inBatch && ++_batchCount >= batchSize )
+    {
+        ok = commitBatch() && ok;
+    }
 
     return ok;
 }
@@ -19,6 +19,8 @@
 #include "MonitorExtension"
 #include "MonitorUI"
 
+#include <osgEarth/InstrumentedCacheBin>
+
 #include <osgEarthFeatures/FeatureSource>
 #include <osgEarthDrivers/feature_ogr/OGRFeatureOptions>
 #include <osgEarthAnnotation/FeatureNode>
@@ -72,6 +74,9 @@ MonitorExtension::ctor()
 {
     OE_INFO << LC << "loaded\n";
     _ui = new MonitorUI();
+
+    // measure any cache bins opened from here on.
+    InstrumentedCacheBin::setEnabled(true);
 }
 
 
@@ -123,5 +128,9 @@ void
 MonitorExtension::frame(const osg::FrameStamp* fs)
 {
     if (_ui.valid())
-        _ui->update(fs);
+    {
+        osg::ref_ptr<MapNode> mapNode;
+        _mapNode.lock(mapNode);
+        _ui->update(fs, mapNode.get());
+    }
 }
\ No newline at end of file
@@ -19,6 +19,8 @@
 #include "MonitorUI"
 #include <osgEarth/Memory>
 #include <osgEarth/Registry>
+#include <osgEarth/InstrumentedCacheBin>
+#include <osgEarth/Metrics>
 
 using namespace osgEarth::Monitor;
 using namespace osgEarth;
@@ -52,10 +54,12 @@ MonitorUI::MonitorUI()
     _ppb->setHorizAlign(ALIGN_RIGHT);
     this->setControl(1, r, _ppb.get());
     ++r;
+
+    _numRows = r;
 }
 
 void
-MonitorUI::update(const osg::FrameStamp* fs)
+MonitorUI::update(const osg::FrameStamp* fs, const MapNode* mapNode)
 {
     if (fs && fs->getFrameNumber() % 15 == 0)
     {
@@ -63,7 +67,97 @@ MonitorUI::update(const osg::FrameStamp* fs)
         _pb->setText(Stringify() << (Memory::getProcessPrivateUsage() / 1048576) << " M");
         _ppb->setText(Stringify() << (Memory::getProcessPeakPrivateUsage() / 1048576) << " M");
 
+        updateCacheStats();
+        updateMetrics();
+
+        // walks the scene graph and live tiles, so less often.
+        if (mapNode && fs->getFrameNumber() % 60 == 0)
+            updateLayerMemory(mapNode);
+
         //Registry::instance()->startActivity("Current Mem", Stringify() <<  (bytes / 1048576) << " M");
         //Registry::instance()->startActivity("Peak Mem", Stringify() << (Memory::getProcessPeakUsage() / 1048576) << " M");
     }
 }
+
+void
+MonitorUI::updateCacheStats()
+{
+    std::vector< osg::ref_ptr<InstrumentedCacheBin> > bins;
+    InstrumentedCacheBin::getInstances(bins);
+
+    for (unsigned i = 0; i < bins.size(); ++i)
+    {
+        osg::ref_ptr<ui::LabelControl>& label = _cacheLabels[bins[i]->getID()];
+        if ( !label.valid() )
+        {
+            this->setControl(0, _numRows, new ui::LabelControl(Stringify() << "Cache " << bins[i]->getID() << ":"));
+            label = new ui::LabelControl();
+            label->setHorizAlign(ALIGN_RIGHT);
+            this->setControl(1, _numRows, label.get());
+            ++_numRows;
+        }
+
+        CacheBinStats stats = bins[i]->getStats();
+        unsigned reads = stats.hits + stats.misses + stats.stale;
+        label->setText(Stringify()
+            << std::fixed << std::setprecision(1)
+            << (reads > 0 ? 100.0f*(float)stats.hits/(float)reads : 0.0f) << "% hit, "
+            << stats.stale << " stale, "
+            << "read p50/p99 " << stats.readLatencyP50 << "/" << stats.readLatencyP99 << " ms");
+    }
+}
+
+void
+MonitorUI::updateMetrics()
+{
+    MetricValues values;
+    Metrics::getValues(values);
+
+    for (MetricValues::const_iterator i = values.begin(); i != values.end(); ++i)
+    {
+        osg::ref_ptr<ui::LabelControl>& label = _metricLabels[i->first];
+        if ( !label.valid() )
+        {
+            this->setControl(0, _numRows, new ui::LabelControl(Stringify() << i->first << ":"));
+            label = new ui::LabelControl();
+            label->setHorizAlign(ALIGN_RIGHT);
+            this->setControl(1, _numRows, label.get());
+            ++_numRows;
+        }
+
+        label->setText(Stringify() << i->second);
+    }
+}
+
+void
+MonitorUI::updateLayerMemory(const MapNode* mapNode)
+{
+    LayerVector layers;
+    mapNode->getMap()->getLayers(layers);
+
+    for (unsigned i = 0; i < layers.size(); ++i)
+    {
+        const Layer* layer = layers[i].get();
+
+        osg::ref_ptr<ui::LabelControl>& label = _layerLabels[layer->getUID()];
+        if ( !label.valid() )
+        {
+            this->setControl(0, _numRows, new ui::LabelControl(Stringify() << "Layer " << layer->getName() << ":"));
+            label = new ui::LabelControl();
+            label->setHorizAlign(ALIGN_RIGHT);
+            this->setControl(1, _numRows, label.get());
+            ++_numRows;
+        }
+
+        Layer::MemoryUsage usage;
+        mapNode->getMemoryUsage(layer, usage);
+
+        label->setText(Stringify()
+            << std::fixed << std::setprecision(1)
+            << (double)usage.getTotalBytes() / 1048576.0 << " M ("
+            << "cache " << (double)usage._cacheBytes / 1048576.0 << ", "
+            << "tex " << (double)usage._textureBytes / 1048576.0 << ", "
+            << "geom " << (double)usage._geometryBytes / 1048576.0 << "), "
+            << usage._pendingRequests << " pending");
+    }
+}
@@ -0,0 +1,284 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2016 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "QuantizedMesh"
+#include <osgEarth/GeoCommon>
+#include <osg/Math>
+#include <cmath>
+#include <string.h>
+
+using namespace osgEarth;
+using namespace osgEarth::Drivers::QuantizedMesh;
+
+#define LC "[QuantizedMesh] "
+
+namespace
+{
+    const double MAX_QUANTIZED = 32767.0;
+
+    // Reads little-endian values with bounds checking.
+    struct Reader
+    {
+        Reader(const std::string& data) : _data(data), _pos(0u), _ok(true) { }
+
+        bool has(size_t bytes) const { return _ok && _pos + bytes <= _data.size(); }
+
+        unsigned long long read(unsigned bytes)
+        {
+            if (!has(bytes)) { _ok = false; return 0u; }
+            unsigned long long value = 0u;
+            for (unsigned i = 0; i < bytes; ++i)
+                value |= (unsigned long long)(unsigned char)_data[_pos + i] << (8u * i);
+            _pos += bytes;
+            return value;
+        }
+
+        unsigned char  u8()  { return (unsigned char)read(1); }
+        unsigned short u16() { return (unsigned short)read(2); }
+        unsigned       u32() { return (unsigned)read(4); }
+
+        float f32() {
+            unsigned bits = u32();
+            float value;
+            ::memcpy(&value, &bits, sizeof(value));
+            return value;
+        }
+
+        double f64() {
+            unsigned long long bits = read(8);
+            double value;
+            ::memcpy(&value, &bits, sizeof(value));
+            return value;
+        }
+
+        void skip(size_t bytes) {
+            if (!has(bytes)) _ok = false;
+            else _pos += bytes;
+        }
+
+        void align(unsigned bytes) {
+            if (_pos % bytes)
+                skip(bytes - (_pos % bytes));
+        }
+
+        const std::string& _data;
+        size_t             _pos;
+        bool               _ok;
+    };
+
+    inline int zigZagDecode(unsigned short value)
+    {
+        return (int)(value >> 1) ^ -(int)(value & 1);
+    }
+
+    // Each value is the difference from the previous one, zig-zag encoded.
+    bool readDeltas(Reader& in, unsigned count, std::vector<unsigned short>& out)
+    {
+        if (!in.has(2u * count))
+            return false;
+
+        out.resize(count);
+        int value = 0;
+        for (unsigned i = 0; i < count; ++i)
+        {
+            value += zigZagDecode(in.u16());
+            out[i] = (unsigned short)value;
+        }
+        return true;
+    }
+
+    bool readIndices(Reader& in, unsigned count, unsigned width, std::vector<unsigned>& out)
+    {
+        if (!in.has((size_t)width * count))
+            return false;
+
+        out.resize(count);
+        for (unsigned i = 0; i < count; ++i)
+            out[i] = width == 4u ? in.u32() : in.u16();
+        return true;
+    }
+
+    // 2 bytes per normal, octahedron-encoded:
+    // http://jcgt.org/published/0003/02/01/
+    osg::Vec3 octDecode(unsigned char x, unsigned char y)
+    {
+        osg::Vec3 n(
+            (float)x / 255.0f * 2.0f - 1.0f,
+            (float)y / 255.0f * 2.0f - 1.0f,
+            0.0f);
+        n.z() = 1.0f - fabs(n.x()) - fabs(n.y());
+        if (n.z() < 0.0f)
+        {
+            float nx = n.x();
+            n.x() = (1.0f - fabs(n.y())) * (nx >= 0.0f ? 1.0f : -1.0f);
+            n.y() = (1.0f - fabs(nx)) * (n.y() >= 0.0f ? 1.0f : -1.0f);
+        }
+        n.normalize();
+        return n;
+    }
+
+    enum Extension
+    {
+        EXT_OCT_VERTEX_NORMALS = 1,
+        EXT_WATER_MASK         = 2,
+        EXT_METADATA           = 4
+    };
+}
+
+Mesh::Mesh() :
+_minHeight( 0.0f ),
+_maxHeight( 0.0f )
+{
+    //nop
+}
+
+bool
+Mesh::decode(const std::string& data)
+{
+    Reader in(data);
+
+    // header: center, height range, bounding sphere, horizon occlusion point
+    _center.x() = in.f64();
+    _center.y() = in.f64();
+    _center.z() = in.f64();
+    _minHeight = in.f32();
+    _maxHeight = in.f32();
+    in.skip(4u * 8u + 3u * 8u);
+
+    unsigned numVerts = in.u32();
+    if (!in._ok ||
+        !readDeltas(in, numVerts, _u) ||
+        !readDeltas(in, numVerts, _v) ||
+        !readDeltas(in, numVerts, _h))
+    {
+        return false;
+    }
+
+    // triangle indices are "high water mark" encoded; 32-bit ones are aligned.
+    unsigned width = numVerts > 65536u ? 4u : 2u;
+    in.align(width);
+
+    unsigned numTris = in.u32();
+    if (!in._ok || !readIndices(in, numTris * 3u, width, _indices))
+        return false;
+
+    unsigned highest = 0u;
+    for (unsigned i = 0; i < _indices.size(); ++i)
+    {
+        unsigned code = _indices[i];
+        _indices[i] = highest - code;
+        if (code == 0u)
+            ++highest;
+        if (_indices[i] >= numVerts)
+            return false;
+    }
+
+    // edge vertices (plain indices):
+    std::vector<unsigned>* edges[4] = { &_west, &_south, &_east, &_north };
+    for (unsigned e = 0; e < 4; ++e)
+    {
+        unsigned count = in.u32();
+        if (!in._ok || !readIndices(in, count, width, *edges[e]))
+            return false;
+    }
+
+    // extensions, each with an id and a length:
+    while (in.has(5u))
+    {
+        unsigned char id = in.u8();
+        unsigned length = in.u32();
+        if (!in.has(length))
+            break;
+
+        if (id == EXT_OCT_VERTEX_NORMALS && length >= 2u * numVerts)
+        {
+            _normals.resize(numVerts);
+            for (unsigned i = 0; i < numVerts; ++i)
+            {
+                unsigned char x = in.u8();
+                unsigned char y = in.u8();
+                _normals[i] = octDecode(x, y);
+            }
+            in.skip(length - 2u * numVerts);
+        }
+        else
+        {
+            in.skip(length);
+        }
+    }
+
+    return true;
+}
+
+float
+Mesh::getHeight(unsigned i) const
+{
+    return _minHeight + (float)((double)_h[i] / MAX_QUANTIZED) * (_maxHeight - _minHeight);
+}
+
+osg::HeightField*
+Mesh::createHeightField(unsigned size) const
+{
+    if (size < 2u || _indices.empty())
+        return 0L;
+
+    osg::HeightField* hf = new osg::HeightField();
+    hf->allocate(size, size);
+    for (unsigned i = 0; i < hf->getFloatArray()->size(); ++i)
+        (*hf->getFloatArray())[i] = NO_DATA_VALUE;
+
+    // grid posts per quantized unit:
+    const double scale = (double)(size - 1u) / MAX_QUANTIZED;
+
+    for (unsigned t = 0; t + 2u < _indices.size(); t += 3u)
+    {
+        unsigned i0 = _indices[t], i1 = _indices[t+1], i2 = _indices[t+2];
+
+        double x0 = _u[i0] * scale, y0 = _v[i0] * scale;
+        double x1 = _u[i1] * scale, y1 = _v[i1] * scale;
+        double x2 = _u[i2] * scale, y2 = _v[i2] * scale;
+
+        double d = (y1 - y2)*(x0 - x2) + (x2 - x1)*(y0 - y2);
+        if (d == 0.0)
+            continue;
+
+        float h0 = getHeight(i0), h1 = getHeight(i1), h2 = getHeight(i2);
+
+        int cmin = osg::maximum(0, (int)ceil(osg::minimum(x0, osg::minimum(x1, x2))));
+        int cmax = osg::minimum((int)size - 1, (int)floor(osg::maximum(x0, osg::maximum(x1, x2))));
+        int rmin = osg::maximum(0, (int)ceil(osg::minimum(y0, osg::minimum(y1, y2))));
+        int rmax = osg::minimum((int)size - 1, (int)floor(osg::maximum(y0, osg::maximum(y1, y2))));
+
+        for (int r = rmin; r <= rmax; ++r)
+        {
+            for (int c = cmin; c <= cmax; ++c)
+            {
+                // a post on a shared edge gets the same height from both triangles.
+                double l0 = ((y1 - y2)*(c - x2) + (x2 - x1)*(r - y2)) / d;
+                double l1 = ((y2 - y0)*(c - x2) + (x0 - x2)*(r - y2)) / d;
+                double l2 = 1.0 - l0 - l1;
+                if (l0 >= -1e-6 && l1 >= -1e-6 && l2 >= -1e-6)
+                {
+                    hf->setHeight(c, r, (float)(l0*h0 + l1*h1 + l2*h2));
+                }
+            }
+        }
+    }
+
+    return hf;
+}
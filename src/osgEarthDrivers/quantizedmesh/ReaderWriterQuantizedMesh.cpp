@@ -0,0 +1,149 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2016 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/TileSource>
+#include <osgEarth/Registry>
+#include <osgEarth/StringUtils>
+
+#include <osgDB/FileNameUtils>
+#include <osgDB/Registry>
+
+#include "QuantizedMeshOptions"
+#include "QuantizedMesh"
+
+using namespace osgEarth;
+using namespace osgEarth::Drivers;
+
+#define LC "[QuantizedMesh driver] "
+
+
+class QuantizedMeshSource : public TileSource
+{
+public:
+    QuantizedMeshSource(const TileSourceOptions& options) :
+      TileSource(options),
+      _options(options)
+      {
+          //nop
+      }
+
+      Status initialize(const osgDB::Options* dbOptions)
+      {
+          _dbOptions = Registry::instance()->cloneOrCreateOptions(dbOptions);
+
+          if ( _options.url()->empty() )
+          {
+              return Status::Error( Status::ConfigurationError, "Fail: driver requires a valid \"url\" property" );
+          }
+
+          // quantized-mesh tiles are always geographic, two tiles at LOD 0.
+          if ( !getProfile() )
+          {
+              setProfile( Registry::instance()->getGlobalGeodeticProfile() );
+          }
+
+          _template = _options.url()->full();
+
+          std::string accept = "application/vnd.quantized-mesh";
+          if ( _options.vertexNormals() == true )
+              accept += ";extensions=octvertexnormals";
+          _acceptHeader = accept + ",application/octet-stream;q=0.9,*/*;q=0.01";
+
+          return STATUS_OK;
+      }
+
+      osg::HeightField* createHeightField(const TileKey&    key,
+                                          ProgressCallback* progress)
+      {
+          if (getStatus().isError())
+              return 0L;
+
+          unsigned x, y;
+          key.getTileXY( x, y );
+
+          if ( _options.invertY() == true )
+          {
+              unsigned cols=0, rows=0;
+              key.getProfile()->getNumTiles( key.getLevelOfDetail(), cols, rows );
+              y = rows - y - 1;
+          }
+
+          std::string location = _template;
+          replaceIn( location, "{x}", Stringify() << x );
+          replaceIn( location, "{y}", Stringify() << y );
+          replaceIn( location, "{z}", Stringify() << key.getLevelOfDetail() );
+
+          // the payload is usually gzipped; HTTPClient has curl undo that.
+          URIContext context = _options.url()->context();
+          context.addHeader( "accept", _acceptHeader );
+          URI uri( location, context );
+
+          ReadResult r = uri.readString( _dbOptions.get(), progress );
+          if ( r.failed() )
+              return 0L;
+
+          QuantizedMesh::Mesh mesh;
+          if ( !mesh.decode(r.getString()) )
+          {
+              OE_WARN << LC << "Failed to decode " << uri.full() << std::endl;
+              return 0L;
+          }
+
+          return mesh.createHeightField( getPixelsPerTile() );
+      }
+
+      virtual std::string getExtension() const
+      {
+          return "terrain";
+      }
+
+private:
+    const QuantizedMeshOptions   _options;
+    std::string                  _template;
+    std::string                  _acceptHeader;
+    osg::ref_ptr<osgDB::Options> _dbOptions;
+};
+
+
+class QuantizedMeshTileSourceDriver : public TileSourceDriver
+{
+public:
+    QuantizedMeshTileSourceDriver()
+    {
+        supportsExtension( "osgearth_quantizedmesh", "Quantized-mesh terrain driver" );
+    }
+
+    virtual const char* className() const
+    {
+        return "Quantized-mesh terrain driver";
+    }
+
+    virtual ReadResult readObject(const std::string& file_name, const Options* options) const
+    {
+        if ( !acceptsExtension(osgDB::getLowerCaseFileExtension( file_name )))
+            return ReadResult::FILE_NOT_HANDLED;
+
+        return new QuantizedMeshSource( getTileSourceOptions(options) );
+    }
+};
+
+REGISTER_OSGPLUGIN(osgearth_quantizedmesh, QuantizedMeshTileSourceDriver)
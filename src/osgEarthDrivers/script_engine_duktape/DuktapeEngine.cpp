@@ -135,72 +135,133 @@ namespace
 
 namespace
 {
-    // Create a "feature" object in the global namespace.
-    void setFeature(duk_context* ctx, Feature const* feature, bool complete)
+    // Create a "feature" object in the global namespace, with the complete
+    // profile: properties, geometry, and API bindings.
+    void setCompleteFeature(duk_context* ctx, Feature const* feature)
     {
         duk_push_global_object(ctx);                             // [global]
 
-        // Complete profile: properties, geometry, and API bindings.
-        if ( complete )
-        {
-            std::string geojson = feature->getGeoJSON();
-            duk_push_string(ctx, geojson.c_str());               // [global, json]
-            duk_json_decode(ctx, -1);                            // [global, feature]
-            duk_push_pointer(ctx, (void*)feature);               // [global, feature, ptr]
-            duk_put_prop_string(ctx, -2, "__ptr");               // [global, feature]
-            duk_put_prop_string(ctx, -2, "feature");             // [global]
-
-            // add the save() function and the "attributes" alias.
-            duk_eval_string_noresult(ctx,
-                "feature.save = function() {"
-                "    oe_duk_save_feature(this.__ptr);"
-                "} ");
-
-            duk_eval_string_noresult(ctx,
-                "Object.defineProperty(feature, 'attributes', {get:function() {return feature.properties;}});");
-
-            GeometryAPI::bindToFeature(ctx);
+        std::string geojson = feature->getGeoJSON();
+        duk_push_string(ctx, geojson.c_str());                   // [global, json]
+        duk_json_decode(ctx, -1);                                // [global, feature]
+        duk_push_pointer(ctx, (void*)feature);                   // [global, feature, ptr]
+        duk_put_prop_string(ctx, -2, "__ptr");                   // [global, feature]
+        duk_put_prop_string(ctx, -2, "feature");                 // [global]
+
+        // add the save() function and the "attributes" alias.
+        duk_eval_string_noresult(ctx,
+            "feature.save = function() {"
+            "    oe_duk_save_feature(this.__ptr);"
+            "} ");
+
+        duk_eval_string_noresult(ctx,
+            "Object.defineProperty(feature, 'attributes', {get:function() {return feature.properties;}});");
+
+        GeometryAPI::bindToFeature(ctx);
+
+        duk_pop(ctx); 
+    }
+
+    // The minimal profile doesn't marshal the feature at all. Instead the
+    // global "feature" object's properties are a Proxy that looks each
+    // attribute up from the current native feature on demand, so a script
+    // only pays for the attributes it actually reads.
+
+    const Feature* getCurrentFeature(duk_context* ctx)
+    {
+        duk_push_global_stash(ctx);                              // [stash]
+        duk_get_prop_string(ctx, -1, "oe_feature");              // [stash, ptr]
+        const Feature* feature = reinterpret_cast<const Feature*>(duk_get_pointer(ctx, -1));
+        duk_pop_2(ctx);                                          // []
+        return feature;
+    }
+
+    void pushAttr(duk_context* ctx, const AttributeValue& value)
+    {
+        switch(value.first) {
+        case ATTRTYPE_DOUBLE: duk_push_number (ctx, value.getDouble()); break;
+        case ATTRTYPE_INT:    duk_push_int    (ctx, value.getInt()); break;
+        case ATTRTYPE_BOOL:   duk_push_boolean(ctx, value.getBool()); break;
+        case ATTRTYPE_STRING:
+        default:              duk_push_string (ctx, value.getString().c_str()); break;
         }
+    }
 
-        // Minimal profile: ID and properties only. MUCH faster!
-        else
+    static duk_ret_t oe_duk_get_attr(duk_context* ctx)
+    {
+        const Feature* feature = getCurrentFeature(ctx);
+        if ( feature )
         {
-            duk_idx_t feature_i = duk_push_object(ctx);
+            std::string key = toLower(duk_safe_to_string(ctx, 0));
+            AttributeTable::const_iterator a = feature->getAttrs().find(key);
+            if ( a != feature->getAttrs().end() )
             {
-                duk_push_int(ctx, feature->getFID());
-                duk_put_prop_string(ctx, feature_i, "id");
+                pushAttr(ctx, a->second);
+                return 1;
+            }
+        }
+        return 0; // undefined
+    }
 
-                duk_idx_t props_i = duk_push_object(ctx);
-                {
-                    const AttributeTable& attrs = feature->getAttrs();
-                    for(AttributeTable::const_iterator a = attrs.begin(); a != attrs.end(); ++a)
-                    {
-                        AttributeType type = a->second.first;
-                        switch(type) {
-                        case ATTRTYPE_DOUBLE: duk_push_number (ctx, a->second.getDouble()); break;
-                        case ATTRTYPE_INT:    duk_push_int    (ctx, a->second.getInt()); break;
-                        case ATTRTYPE_BOOL:   duk_push_boolean(ctx, a->second.getBool()); break;
-                        case ATTRTYPE_STRING:
-                        default:              duk_push_string (ctx, a->second.getString().c_str()); break;
-                        }
-                        duk_put_prop_string(ctx, props_i, a->first.c_str());
-                    }
-                }
-                duk_put_prop_string(ctx, feature_i, "properties");
+    static duk_ret_t oe_duk_has_attr(duk_context* ctx)
+    {
+        const Feature* feature = getCurrentFeature(ctx);
+        duk_push_boolean(ctx, feature && feature->hasAttr(duk_safe_to_string(ctx, 0)));
+        return 1;
+    }
+
+    static duk_ret_t oe_duk_attr_keys(duk_context* ctx)
+    {
+        const Feature* feature = getCurrentFeature(ctx);
+        duk_idx_t arr_i = duk_push_array(ctx);
+        if ( feature )
+        {
+            duk_uarridx_t n = 0;
+            const AttributeTable& attrs = feature->getAttrs();
+            for(AttributeTable::const_iterator a = attrs.begin(); a != attrs.end(); ++a)
+            {
+                duk_push_string(ctx, a->first.c_str());
+                duk_put_prop_index(ctx, arr_i, n++);
             }
-            duk_put_prop_string(ctx, -2, "feature");
         }
+        return 1;
+    }
 
-        duk_pop(ctx); 
+    static duk_ret_t oe_duk_get_fid(duk_context* ctx)
+    {
+        const Feature* feature = getCurrentFeature(ctx);
+        if ( !feature )
+            return 0;
+        duk_push_int(ctx, feature->getFID());
+        return 1;
     }
-    
+
+    const char* s_lazyFeatureBindings =
+        "var feature = {};"
+        "(function() {"
+        "    var handler = {"
+        "        get:       function(t, k) { return (k in t) ? t[k] : oe_duk_get_attr(k); },"
+        "        has:       function(t, k) { return (k in t) || oe_duk_has_attr(k); },"
+        "        enumerate: function(t)    { return oe_duk_attr_keys(); },"
+        "        ownKeys:   function(t)    { return oe_duk_attr_keys(); }"
+        "    };"
+        "    Object.defineProperty(feature, 'id', {get:function() {return oe_duk_get_fid();}});"
+        "    Object.defineProperty(feature, 'attributes', {get:function() {return feature.properties;}});"
+        "    feature.__reset = function() { this.properties = new Proxy({}, handler); };"
+        "    feature.__reset();"
+        "})();";
 }
 
 //............................................................................
 
+// Compiled scripts are cached per context; past this many the cache starts over.
+#define MAX_COMPILED_SCRIPTS 1024
+
 DuktapeEngine::Context::Context()
 {
     _ctx = 0L;
+    _complete = false;
+    _numCompiled = 0u;
 }
 
 void
@@ -210,6 +271,7 @@ DuktapeEngine::Context::initialize(const ScriptEngineOptions& options, bool comp
     {
         // new heap + context.
         _ctx = duk_create_heap_default();
+        _complete = complete;
 
         // if there is a static script, evaluate it first. This will register
         // any functions or objects with the EcmaScript global object.
@@ -238,8 +300,31 @@ DuktapeEngine::Context::initialize(const ScriptEngineOptions& options, bool comp
 
             GeometryAPI::install(_ctx);
         }
+        else
+        {
+            // lazy attribute accessors
+            duk_push_c_function(_ctx, oe_duk_get_attr, 1);    // [global, function]
+            duk_put_prop_string(_ctx, -2, "oe_duk_get_attr"); // [global]
+            duk_push_c_function(_ctx, oe_duk_has_attr, 1);
+            duk_put_prop_string(_ctx, -2, "oe_duk_has_attr");
+            duk_push_c_function(_ctx, oe_duk_attr_keys, 0);
+            duk_put_prop_string(_ctx, -2, "oe_duk_attr_keys");
+            duk_push_c_function(_ctx, oe_duk_get_fid, 0);
+            duk_put_prop_string(_ctx, -2, "oe_duk_get_fid");
+        }
 
         duk_pop(_ctx); // []
+
+        if ( !complete )
+        {
+            duk_eval_string_noresult(_ctx, s_lazyFeatureBindings);
+        }
+
+        // cache of compiled scripts, keyed by source code
+        duk_push_global_stash(_ctx);                      // [stash]
+        duk_push_object(_ctx);                            // [stash, cache]
+        duk_put_prop_string(_ctx, -2, "oe_compiled");     // [stash]
+        duk_pop(_ctx);                                    // []
     }
 }
 
@@ -266,6 +351,113 @@ DuktapeEngine::~DuktapeEngine()
     //nop
 }
 
+void
+DuktapeEngine::setFeature(Context& c, const Feature* feature)
+{
+    duk_context* ctx = c._ctx;
+
+    if ( c._complete )
+    {
+        // encode the feature in the global object and push a native pointer;
+        // skip it if the feature didn't change since that's expensive.
+        if ( feature && feature != c._feature.get() )
+            setCompleteFeature(ctx, feature);
+    }
+
+    // Always update the lazy bindings when there's no feature, since
+    // the one we remember may have been deleted.
+    else if ( !feature || feature != c._feature.get() )
+    {
+        duk_push_global_stash(ctx);                       // [stash]
+        duk_push_pointer(ctx, (void*)feature);            // [stash, ptr]
+        duk_put_prop_string(ctx, -2, "oe_feature");       // [stash]
+        duk_pop(ctx);                                     // []
+
+        if ( feature )
+        {
+            // fresh properties object so values a previous script assigned
+            // don't leak into this feature.
+            duk_get_global_string(ctx, "feature");        // [feature]
+            duk_get_prop_string(ctx, -1, "__reset");      // [feature, reset]
+            duk_swap(ctx, -1, -2);                        // [reset, feature]
+            duk_pcall_method(ctx, 0);                     // [result]
+            duk_pop(ctx);                                 // []
+        }
+    }
+
+    // remember the feature so we don't re-create it if not necessary
+    c._feature = feature;
+}
+
+bool
+DuktapeEngine::pushCompiled(Context& c, const std::string& code)
+{
+    duk_context* ctx = c._ctx;
+
+    duk_push_global_stash(ctx);                           // [stash]
+    duk_get_prop_string(ctx, -1, "oe_compiled");          // [stash, cache]
+
+    if ( duk_get_prop_string(ctx, -1, code.c_str()) )     // [stash, cache, fn]
+    {
+        duk_remove(ctx, -2);                              // [stash, fn]
+        duk_remove(ctx, -2);                              // [fn]
+        return true;
+    }
+    duk_pop(ctx);                                         // [stash, cache]
+
+    // On error, the top of stack will hold the error message instead.
+    if ( duk_pcompile_string(ctx, 0, code.c_str()) != 0 ) // [stash, cache, fn|err]
+    {
+        duk_remove(ctx, -2);
+        duk_remove(ctx, -2);                              // [err]
+        return false;
+    }
+
+    if ( c._numCompiled >= MAX_COMPILED_SCRIPTS )
+    {
+        duk_push_object(ctx);                             // [stash, cache, fn, new]
+        duk_dup(ctx, -1);                                 // [stash, cache, fn, new, new]
+        duk_put_prop_string(ctx, -5, "oe_compiled");      // [stash, cache, fn, new]
+        duk_replace(ctx, -3);                             // [stash, new, fn]
+        c._numCompiled = 0u;
+    }
+
+    duk_dup(ctx, -1);                                     // [stash, cache, fn, fn]
+    duk_put_prop_string(ctx, -3, code.c_str());           // [stash, cache, fn]
+    ++c._numCompiled;
+
+    duk_remove(ctx, -2);
+    duk_remove(ctx, -2);                                  // [fn]
+    return true;
+}
+
+ScriptResult
+DuktapeEngine::call(Context& c, const std::string& code)
+{
+    duk_context* ctx = c._ctx;
+
+    // run the script. On error, the top of stack will hold the error
+    // message instead of the return value.
+    std::string resultString;
+
+    bool ok = (duk_pcall(ctx, 0) == 0); // [ "result" ]
+    const char* resultVal = duk_to_string(ctx, -1);
+    if ( resultVal )
+        resultString = resultVal;
+
+    if ( !ok )
+    {
+        OE_DEBUG << LC << "Error: source =" << std::endl << code << std::endl;
+    }
+
+    // pop the return value:
+    duk_pop(ctx); // []
+
+    return ok ?
+        ScriptResult(resultString, true) :
+        ScriptResult("", false, resultString);
+}
+
 ScriptResult
 DuktapeEngine::run(const std::string&   code,
                    Feature const*       feature,
@@ -280,41 +472,66 @@ DuktapeEngine::run(const std::string&   code,
     // brand new context every time
     Context c;
     c.initialize( _options, complete );
-    duk_context* ctx = c._ctx;
 #else
     // cache the Context on a per-thread basis
     Context& c = _contexts.get();
     c.initialize( _options, complete );
-    duk_context* ctx = c._ctx;
 #endif
 
-	if ( feature && feature != c._feature.get() )
+    setFeature( c, feature );
+
+    if ( !pushCompiled(c, code) )
     {
-		// encode the feature in the global object and push a native pointer:
-		setFeature(ctx, feature, complete);
-	}
+        std::string error = duk_safe_to_string(c._ctx, -1);
+        duk_pop(c._ctx);
+        OE_DEBUG << LC << "Error: source =" << std::endl << code << std::endl;
+        return ScriptResult("", false, error);
+    }
 
-    // remember the feature so we don't re-create it if not necessary
-    c._feature = feature;
+    return call( c, code );
+}
 
-    // run the script. On error, the top of stack will hold the error
-    // message instead of the return value.
-    std::string resultString;
+void
+DuktapeEngine::run(const std::string&         code,
+                   const FeatureList&         features,
+                   std::vector<ScriptResult>& results,
+                   FilterContext const*       context)
+{
+    results.clear();
 
-    bool ok = (duk_peval_string(ctx, code.c_str()) == 0); // [ "result" ]
-    const char* resultVal = duk_to_string(ctx, -1);
-    if ( resultVal )
-        resultString = resultVal;
+    if (code.empty())
+    {
+        results.assign( features.size(), ScriptResult(EMPTY_STRING, false, "Script is empty.") );
+        return;
+    }
 
-    if ( !ok )
+    bool complete = (getProfile() == "full");
+
+#ifdef MAXIMUM_ISOLATION
+    Context c;
+    c.initialize( _options, complete );
+#else
+    Context& c = _contexts.get();
+    c.initialize( _options, complete );
+#endif
+
+    // compile once, then call the same function for every feature.
+    if ( !pushCompiled(c, code) )                         // [fn|err]
     {
+        std::string error = duk_safe_to_string(c._ctx, -1);
+        duk_pop(c._ctx);
         OE_DEBUG << LC << "Error: source =" << std::endl << code << std::endl;
+        results.assign( features.size(), ScriptResult("", false, error) );
+        return;
     }
 
-    // pop the return value:
-    duk_pop(ctx); // []
+    results.reserve( features.size() );
+    for(FeatureList::const_iterator i = features.begin(); i != features.end(); ++i)
+    {
+        setFeature( c, i->get() );
+        duk_dup( c._ctx, -1 );                            // [fn, fn]
+        results.push_back( call(c, code) );               // [fn]
+    }
 
-    return ok ?
-        ScriptResult(resultString, true) :
-        ScriptResult("", false, resultString);
+    duk_pop( c._ctx );                                    // []
 }
@@ -37,6 +37,7 @@
 #include <osgEarth/ShaderGenerator>
 #include <osgEarth/Shaders>
 #include <osgEarth/GLUtils>
+#include <osgEarth/GPUTimer>
 #include <osgEarth/Lighting>
 
 #include <osg/MatrixTransform>
@@ -505,6 +506,8 @@ SimpleSkyNode::makeAtmosphere(const osg::EllipsoidModel* em)
             osg::StateAttribute::PROTECTED);
     }
 
+    GPUTimer::install( drawable, "sky.atmosphere" );
+
     osg::Geode* geode = new osg::Geode();
     geode->addDrawable( drawable );
     
@@ -554,6 +557,7 @@ SimpleSkyNode::makeSun()
     const double zoomFactor = 80.0; // to account for the solare glare
     const double sunRadius = 695700000.0;
     sun->addDrawable(s_makeDiscGeometry(sunRadius * zoomFactor));
+    GPUTimer::install( sun->getDrawable(0), "sky.sun" );
 
     osg::StateSet* set = sun->getOrCreateStateSet();
     set->setMode( GL_BLEND, 1 );
@@ -662,6 +666,7 @@ SimpleSkyNode::makeMoon()
     cam->getOrCreateStateSet()->setRenderBinDetails( BIN_MOON, "RenderBin" );
     cam->setRenderOrder( osg::Camera::NESTED_RENDER );
     cam->setComputeNearFarMode( osg::CullSettings::COMPUTE_NEAR_FAR_USING_BOUNDING_VOLUMES );
+    GPUTimer::install( moonDrawable, "sky.moon" );
     cam->addChild( moonDrawable );
 
     _moon = cam;
@@ -763,8 +768,11 @@ SimpleSkyNode::buildStarGeometry(const std::vector<StarData>& stars)
         colors->push_back( osg::Vec4(c,c,c,1.0f) );
     }
 
+    // star positions never change (the transform above them turns them), so
+    // they upload once.
     osg::Geometry* geometry = new osg::Geometry;
     geometry->setUseVertexBufferObjects(true);
+    geometry->setDataVariance(osg::Object::STATIC);
 
     geometry->setVertexArray( coords );
     geometry->setColorArray( colors );
@@ -803,6 +811,7 @@ SimpleSkyNode::buildStarGeometry(const std::vector<StarData>& stars)
 
     osg::Geode* starGeode = new osg::Geode;
     starGeode->addDrawable( geometry );
+    GPUTimer::install( geometry, "sky.stars" );
 
     // A separate camera isolates the projection matrix calculations.
     osg::Camera* cam = new osg::Camera();
@@ -55,7 +55,8 @@ public:
     TileIndexSource( const TileSourceOptions& options ):
       TileSource( options ),
       _options( options ),
-	  _tileSourceCache( true )
+	  _tileSourceCache( true, _options.maxOpenFiles().get() ),
+      _readAheadCache( true, 64u )
     {
     }
 
@@ -74,6 +75,99 @@ public:
         return Status::Error("Failed to load TileIndex");
     }
 
+    // Gets the open TileSource for a file, opening it on first use.
+    // Returns false if the file can't be opened.
+    bool getTileSource( const std::string& file, osg::ref_ptr< TileSource >& source )
+    {
+        TileSourceCache::Record record;
+        if (_tileSourceCache.get( file, record ))
+        {
+            source = record.value().get();
+            return source.valid();
+        }
+
+        // Couldn't get it from the cache so open it.                    
+        GDALOptions opt;
+        opt.url() = file;
+        //Just force it to render so we don't have to worry about falling back
+        opt.maxDataLevelOverride() = 23;           
+        //Disable the l2 cache so that we don't run out of RAM so easily.
+        opt.L2CacheSize() = 0;
+
+        source = osgEarth::TileSourceFactory::create( opt );
+        if (!source.valid() || source->open().isError())
+        {
+            OE_WARN << LC << "Failed to open " << file << std::endl;
+            source = 0L;
+        }
+
+        // Failures are cached too, so a bad file isn't retried for every tile.
+        // An evicted source closes its file once no reader is using it.
+        _tileSourceCache.insert( file, source.get() );
+        return source.valid();
+    }
+
+    // Whether a source has data in a tile's extent.
+    static bool hasDataIn( TileSource* source, const TileKey& key )
+    {
+        const DataExtentList& extents = source->getDataExtents();
+        if (extents.empty())
+            return true;
+
+        for (DataExtentList::const_iterator i = extents.begin(); i != extents.end(); ++i)
+        {
+            if (i->intersects( key.getExtent() ))
+                return true;
+        }
+        return false;
+    }
+
+    // Reads the image for a key from one file, using (and feeding) the
+    // read-ahead cache.
+    osg::Image* readImage( TileSource* source, const std::string& file, const TileKey& key, ProgressCallback* progress )
+    {
+        std::string cacheKey = file + "|" + key.str();
+
+        ReadAheadCache::Record record;
+        if (_readAheadCache.get( cacheKey, record ))
+        {
+            // Each read-ahead tile is only wanted once.
+            osg::ref_ptr< osg::Image > image = record.value().get();
+            _readAheadCache.erase( cacheKey );
+            return image.release();
+        }
+
+        osg::ref_ptr< osg::Image > image = source->createImage( key, progress );
+
+        // While this file is open and its blocks are in GDAL's cache, read the
+        // siblings that also touch it.
+        if (_options.readAhead() == true && key.getLOD() > 0)
+        {
+            TileKey parent = key.createParentKey();
+            for (unsigned q = 0; q < 4; ++q)
+            {
+                TileKey sibling = parent.createChildKey( q );
+                if (sibling == key || !hasDataIn( source, sibling ))
+                    continue;
+
+                std::string siblingKey = file + "|" + sibling.str();
+                if (_readAheadCache.has( siblingKey ))
+                    continue;
+
+                if (progress && progress->isCanceled())
+                    break;
+
+                osg::ref_ptr< osg::Image > siblingImage = source->createImage( sibling, progress );
+                if (siblingImage.valid())
+                {
+                    _readAheadCache.insert( siblingKey, siblingImage.get() );
+                }
+            }
+        }
+
+        return image.release();
+    }
+
     osg::Image* createImage( const TileKey&        key,
                              ProgressCallback*     progress)
     {        
@@ -89,43 +183,11 @@ public:
         for (unsigned int i = 0; i < files.size(); i++)
         {            
             osg::ref_ptr< TileSource> source;
-            {
-                //Try to get the TileSource from the cache
-                TileSourceCache::Record record;
-                if (_tileSourceCache.get( files[i], record ))
-                {
-                    source = record.value().get();                    
-                }
-                else
-                {
-                    // Couldn't get it from the cache so open it.                    
-                    GDALOptions opt;
-                    opt.url() = files[i];
-                    //Just force it to render so we don't have to worry about falling back
-                    opt.maxDataLevelOverride() = 23;           
-                    //Disable the l2 cache so that we don't run out of RAM so easily.
-                    opt.L2CacheSize() = 0;
-
-                    start = osg::Timer::instance()->tick();
-                    source = osgEarth::TileSourceFactory::create( opt );                               
-                    Status compStatus = source->open();
-                    if (compStatus.isOK())
-                    {
-                        _tileSourceCache.insert( files[i], source.get() );                                                
-                    }
-                    else
-                    {
-                        OE_WARN << "Failed to open " << files[i] << std::endl;
-                    }
-                    end = osg::Timer::instance()->tick();
-                    //OE_NOTICE << "init took " << osg::Timer::instance()->delta_m( start, end) << "ms" << std::endl;
-                }               
-            }
-
-            
+            if (!getTileSource( files[i], source ))
+                continue;
             
             start = osg::Timer::instance()->tick();
-            osg::ref_ptr< osg::Image > image = source->createImage( key);
+            osg::ref_ptr< osg::Image > image = readImage( source.get(), files[i], key, progress );
             end = osg::Timer::instance()->tick();
             OE_DEBUG << "createImage " << osg::Timer::instance()->delta_m( start, end) << "ms" << std::endl;
             if (image)
@@ -150,12 +212,16 @@ public:
         return result;
     }
 
-    //std::map< std::string, osg::ref_ptr< TileSource> > _tileSourceCache;
+    // declared first; the caches are sized from it
+    TileIndexOptions _options;
+
     typedef LRUCache< std::string, osg::ref_ptr< TileSource> > TileSourceCache;
     TileSourceCache _tileSourceCache;
 
+    typedef LRUCache< std::string, osg::ref_ptr< osg::Image > > ReadAheadCache;
+    ReadAheadCache _readAheadCache;
+
     osg::ref_ptr< TileIndex > _index;
-    TileIndexOptions _options;
     osg::ref_ptr<osgDB::Options> _dbOptions;
 };
 
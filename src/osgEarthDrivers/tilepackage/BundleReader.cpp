@@ -20,28 +20,194 @@
 * along with this program.  If not, see <http://www.gnu.org/licenses/>
 */
 #include "BundleReader"
+#include <cstring>
+
+#ifdef _WIN32
+#   define WIN32_LEAN_AND_MEAN
+#   include <windows.h>
+#else
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <fcntl.h>
+#   include <unistd.h>
+#endif
+
+#define LC "[BundleReader] "
+
+namespace
+{
+    // Read-only stream over a block of memory, so images decode straight
+    // out of the mapped bundle.
+    class MemoryStreamBuf : public std::streambuf
+    {
+    public:
+        MemoryStreamBuf(const char* data, size_t size)
+        {
+            char* p = const_cast<char*>(data);
+            setg(p, p, p + size);
+        }
+
+    protected:
+        pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which)
+        {
+            if ((which & std::ios_base::in) == 0)
+                return pos_type(off_type(-1));
+
+            char* pos =
+                dir == std::ios_base::beg ? eback() + off :
+                dir == std::ios_base::cur ? gptr()  + off :
+                                            egptr() + off;
+
+            if (pos < eback() || pos > egptr())
+                return pos_type(off_type(-1));
+
+            setg(eback(), pos, egptr());
+            return pos_type(off_type(pos - eback()));
+        }
+
+        pos_type seekpos(pos_type pos, std::ios_base::openmode which)
+        {
+            return seekoff(off_type(pos), std::ios_base::beg, which);
+        }
+    };
+
+    // Little-endian unsigned integer of "numBytes" bytes
+    size_t readLE(const char* p, unsigned numBytes)
+    {
+        size_t sum = 0;
+        for (unsigned i = 0; i < numBytes; ++i)
+            sum |= ((size_t)(unsigned char)p[i]) << (8u * i);
+        return sum;
+    }
+
+    // Maps a whole file read-only. Returns NULL on failure.
+    const char* mapFile(const std::string& path, size_t& size, void*& file, void*& mapping)
+    {
+        file = 0L;
+        mapping = 0L;
+        size = 0;
+
+#ifdef _WIN32
+        HANDLE h = ::CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, 0L, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0L);
+        if (h == INVALID_HANDLE_VALUE)
+            return 0L;
+
+        LARGE_INTEGER fileSize;
+        if (!::GetFileSizeEx(h, &fileSize) || fileSize.QuadPart == 0)
+        {
+            ::CloseHandle(h);
+            return 0L;
+        }
+
+        HANDLE m = ::CreateFileMappingA(h, 0L, PAGE_READONLY, 0, 0, 0L);
+        if (!m)
+        {
+            ::CloseHandle(h);
+            return 0L;
+        }
+
+        void* base = ::MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0);
+        if (!base)
+        {
+            ::CloseHandle(m);
+            ::CloseHandle(h);
+            return 0L;
+        }
+
+        file = h;
+        mapping = m;
+        size = (size_t)fileSize.QuadPart;
+        return (const char*)base;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return 0L;
+
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || st.st_size == 0)
+        {
+            ::close(fd);
+            return 0L;
+        }
+
+        void* base = ::mmap(0L, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+        // the mapping stays valid after the descriptor closes.
+        ::close(fd);
+
+        if (base == MAP_FAILED)
+            return 0L;
+
+        size = (size_t)st.st_size;
+        return (const char*)base;
+#endif
+    }
+
+    void unmapFile(const char* base, size_t size, void* file, void* mapping)
+    {
+        if (!base)
+            return;
+#ifdef _WIN32
+        ::UnmapViewOfFile(base);
+        ::CloseHandle((HANDLE)mapping);
+        ::CloseHandle((HANDLE)file);
+#else
+        ::munmap(const_cast<char*>(base), size);
+#endif
+    }
+}
 
 BundleReader::BundleReader(const std::string& bundleFile, unsigned int bundleSize) :
     _bundleFile(bundleFile),
+    _bundleSize(bundleSize),
+    _base(0L),
+    _size(0),
+#ifdef _WIN32
+    _file(0L),
+    _mapping(0L),
+#endif
     _lod(0),
-    _colOffset(0),
     _rowOffset(0),
-    _bundleSize(bundleSize)
+    _colOffset(0)
 {
     init();
 }
 
+BundleReader::~BundleReader()
+{
+#ifdef _WIN32
+    unmapFile(_base, _size, _file, _mapping);
+#else
+    unmapFile(_base, _size, 0L, 0L);
+#endif
+}
+
 void BundleReader::init()
 {
 
     std::string base = osgDB::getNameLessExtension(_bundleFile);
     _indexFile = base + ".bundlx";
 
-    // Open the bundle
-    _in.open(_bundleFile.c_str(), std::ofstream::binary);
-
     // Read the index
-    readIndex(_indexFile, _index);
+    if (!readIndex(_indexFile, _index))
+    {
+        OE_WARN << LC << "Failed to read the bundle index " << _indexFile << std::endl;
+        return;
+    }
+
+    // Map the bundle
+    void* file = 0L;
+    void* mapping = 0L;
+    _base = mapFile(_bundleFile, _size, file, mapping);
+    if (!_base)
+    {
+        OE_WARN << LC << "Failed to map " << _bundleFile << std::endl;
+        return;
+    }
+#ifdef _WIN32
+    _file = file;
+    _mapping = mapping;
+#endif
 
     std::string baseName = osgDB::getSimpleFileName(base);
 
@@ -57,23 +223,31 @@ void BundleReader::init()
 /**
 * Reads the index of a bundle file.
 */
-void BundleReader::readIndex(const std::string& filename, std::vector<int>& index)
+bool BundleReader::readIndex(const std::string& filename, std::vector<size_t>& index)
 {
-    std::ifstream input(filename.c_str(), std::ifstream::binary);
-    char header[INDEX_HEADER_SIZE];
-    input.read(header, INDEX_HEADER_SIZE);
-    while (input.good()) {
-        std::vector<char> buffer;
-        buffer.resize(5);
-        if (input.read(&buffer[0], INDEX_SIZE))
+    size_t size;
+    void* file;
+    void* mapping;
+    const char* data = mapFile(filename, size, file, mapping);
+    if (!data)
+        return false;
+
+    if (size >= INDEX_HEADER_SIZE)
+    {
+        size_t count = (size - INDEX_HEADER_SIZE) / INDEX_SIZE;
+        index.resize(count);
+        const char* p = data + INDEX_HEADER_SIZE;
+        for (size_t i = 0; i < count; ++i, p += INDEX_SIZE)
         {
-            int offset = computeOffset(buffer);
-            index.push_back(offset);
+            index[i] = readLE(p, INDEX_SIZE);
         }
     }
+
+    unmapFile(data, size, file, mapping);
+    return true;
 }
 
-osg::Image* BundleReader::readImage(const TileKey& key)
+osg::Image* BundleReader::readImage(const TileKey& key) const
 {
     // Figure out the index for the tilekey
     unsigned int row = key.getTileX() - _colOffset;
@@ -81,22 +255,19 @@ osg::Image* BundleReader::readImage(const TileKey& key)
     return readImage(i);
 }
 
-osg::Image* BundleReader::readImage(unsigned int index)
+osg::Image* BundleReader::readImage(unsigned int index) const
 {
-    if (index < 0 || index > _index.size()) return 0;
-
-    _in.seekg(_index[index], std::ios::beg);
-    std::vector<char> sizeBuffer;
-    sizeBuffer.resize(4);
-    _in.read(&sizeBuffer[0], 4);
-    int size = computeOffset(sizeBuffer);
-    if (size > 0)
+    if (!_base || index >= _index.size()) return 0;
+
+    size_t offset = _index[index];
+    if (offset + 4 > _size) return 0;
+
+    size_t size = readLE(_base + offset, 4);
+    if (size > 0 && offset + 4 + size <= _size)
     {
-        std::string image;
-        image.resize(size);
-        _in.read(&image[0], size);
-        std::stringstream ss(image);
-        return ImageUtils::readStream(ss, 0);
+        MemoryStreamBuf buf(_base + offset + 4, size);
+        std::istream in(&buf);
+        return ImageUtils::readStream(in, 0);
     }
 
     return 0;
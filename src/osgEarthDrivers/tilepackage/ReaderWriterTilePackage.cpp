@@ -26,6 +26,7 @@
 #include <osgEarth/Registry>
 #include <osgEarth/URI>
 #include <osgEarth/XmlUtils>
+#include <osgEarth/Containers>
 
 #include <osg/Notify>
 #include <osgDB/FileNameUtils>
@@ -71,7 +72,8 @@ public:
         _profileConf(ProfileOptions()),
         _tileSize(256),
         _bundleSize(128),
-        _extension("png")
+        _extension("png"),
+        _bundles(true, 32u)
     {
     }
 
@@ -173,14 +175,27 @@ public:
         buf << ".bundle";
 
         std::string bundleFile = buf.str();
-        if (osgDB::fileExists(bundleFile))
+
+        // Keep recently used bundles open (and remember missing ones)
+        // so we aren't reopening and remapping files for every tile.
+        osg::ref_ptr<BundleReader> reader;
+        BundleCache::Record rec;
+        if (_bundles.get(bundleFile, rec))
+        {
+            reader = rec.value();
+        }
+        else
         {
-            BundleReader reader(bundleFile, _bundleSize);
-            osg::Image* result = reader.readImage(key);
-            return result;
+            if (osgDB::fileExists(bundleFile))
+            {
+                reader = new BundleReader(bundleFile, _bundleSize);
+                if (!reader->isOpen())
+                    reader = 0L;
+            }
+            _bundles.insert(bundleFile, reader);
         }
 
-        return 0;
+        return reader.valid() ? reader->readImage(key) : 0L;
     }
 
     // override
@@ -196,6 +211,9 @@ private:
     unsigned int _tileSize;
     std::string _extension;
     unsigned int _bundleSize;
+
+    typedef LRUCache<std::string, osg::ref_ptr<BundleReader> > BundleCache;
+    BundleCache _bundles;
 };
 
 
@@ -24,6 +24,8 @@
 #include <osgEarth/XmlUtils>
 #include <osgEarth/ImageUtils>
 #include <osgEarth/Containers>
+#include <osgEarth/ThreadingUtils>
+#include <osgEarth/JobScheduler>
 #include <osgEarthUtil/WMS>
 #include <osgDB/FileNameUtils>
 #include <osgDB/FileUtils>
@@ -31,6 +33,7 @@
 #include <osgDB/ReadFile>
 #include <osgDB/WriteFile>
 #include <osg/ImageSequence>
+#include <OpenThreads/Atomic>
 #include <sstream>
 #include <stdlib.h>
 #include <string.h>
@@ -48,6 +51,9 @@ using namespace osgEarth::Drivers;
 
 //#define SUPPORT_JPL_TILESERVICE
 
+// Bytes of split metatile neighbors to hold while they wait to be requested.
+#define MAX_METATILE_CACHE_BYTES (64u * 1024u * 1024u)
+
 //----------------------------------------------------------------------------
 
 namespace
@@ -64,6 +70,21 @@ namespace
             osg::ImageSequence::update( nv );
         }
     };
+
+    // Copies one size x size tile out of a metatile image.
+    osg::Image* extractTile(const osg::Image* meta, unsigned s0, unsigned t0, unsigned size)
+    {
+        osg::Image* tile = new osg::Image();
+        tile->allocateImage(size, size, 1, meta->getPixelFormat(), meta->getDataType(), meta->getPacking());
+        tile->setInternalTextureFormat(meta->getInternalTextureFormat());
+
+        unsigned rowBytes = size * meta->getPixelSizeInBits() / 8u;
+        for (unsigned t = 0; t < size; ++t)
+        {
+            memcpy(tile->data(0, t), meta->data(s0, t0 + t), rowBytes);
+        }
+        return tile;
+    }
 }
 
 //----------------------------------------------------------------------------
@@ -71,9 +92,11 @@ namespace
 class WMSSource : public TileSource, public SequenceControl
 {
 public:
-	WMSSource( const TileSourceOptions& options ) : TileSource( options ), _options(options)
+	WMSSource( const TileSourceOptions& options ) : TileSource( options ), _options(options), _metaTiles(true, 4096u)
     {
         _isPlaying     = false;
+        _metatileSize  = osg::maximum(_options.metatileSize().get(), 1u);
+        _metaTiles.setMaxCost(MAX_METATILE_CACHE_BYTES);
 
         if ( _options.times().isSet() )
         {
@@ -141,10 +164,10 @@ public:
         std::string wmsFormatToUse = _options.wmsFormat().value();
 
         //Initialize the WMS request prototype
-        std::stringstream buf;
+        std::stringstream head;
 
         // first the mandatory keys:
-        buf
+        head
             << std::fixed << _options.url()->full() << sep
 	    << "SERVICE=WMS"
             << "&VERSION=" << _options.wmsVersion().value()
@@ -152,19 +175,30 @@ public:
             << "&LAYERS=" << _options.layers().value()
             << "&FORMAT=" << ( wmsFormatToUse.empty() ? std::string("image/") + _formatToUse : wmsFormatToUse )
             << "&STYLES=" << _options.style().value()
-            << (_options.wmsVersion().value() == "1.3.0" ? "&CRS=" : "&SRS=") << _srsToUse            
-            << "&WIDTH="<< getPixelsPerTile()
-            << "&HEIGHT=" << getPixelsPerTile()
-            << "&BBOX=%lf,%lf,%lf,%lf";
+            << (_options.wmsVersion().value() == "1.3.0" ? "&CRS=" : "&SRS=") << _srsToUse;
+
+        std::string tail = "&BBOX=%lf,%lf,%lf,%lf";
 
         // then the optional keys:
         if ( _options.transparent().isSet() )
-            buf << "&TRANSPARENT=" << (_options.transparent() == true ? "TRUE" : "FALSE");
-            
+            tail += std::string("&TRANSPARENT=") + (_options.transparent() == true ? "TRUE" : "FALSE");
+
+        std::stringstream buf;
+        buf << head.str()
+            << "&WIDTH="<< getPixelsPerTile()
+            << "&HEIGHT=" << getPixelsPerTile()
+            << tail;
 
-        _prototype = "";
         _prototype = buf.str();
 
+        // metatile requests fill in their own size:
+        _metaPrototype = head.str() + "&WIDTH=%u&HEIGHT=%u" + tail;
+
+        if ( _metatileSize > 1u )
+        {
+            OE_INFO << LC << "Requesting " << _metatileSize << "x" << _metatileSize << " tiles per GetMap" << std::endl;
+        }
+
         //OE_NOTICE << "Prototype " << _prototype << std::endl;
 
         osg::ref_ptr<SpatialReference> wms_srs = SpatialReference::create( _srsToUse );
@@ -238,6 +272,9 @@ public:
             {
                 result = tileService->createProfile( patterns );
                 _prototype = _options.url()->full() + sep + patterns[0].getPrototype();
+
+                // the tile patterns are fixed-size.
+                _metatileSize = 1u;
             }
         }
         else
@@ -283,15 +320,15 @@ public:
         ProgressCallback*  progress, 
         ReadResult&        out_response )
     {
-        osg::ref_ptr<osg::Image> image;
-
-        std::string uri = createURI(key);
-        if ( !extraAttrs.empty() )
+        if ( _metatileSize > 1u )
         {
-            std::string delim = uri.find("?") == std::string::npos ? "?" : "&";
-            uri = uri + delim + extraAttrs;
+            return fetchMetaTileImage( key, extraAttrs, progress, out_response );
         }
 
+        osg::ref_ptr<osg::Image> image;
+
+        std::string uri = appendAttrs( createURI(key), extraAttrs );
+
         // Try to get the image first
         out_response = URI( uri ).readImage( _dbOptions.get(), progress);
 
@@ -345,6 +382,160 @@ public:
         return image.release();
     }
 
+    // fetch a tile as part of the block of metatileSize x metatileSize tiles
+    // it belongs to. The first request for a block issues one GetMap for all
+    // of it; concurrent requests for its other tiles wait for that one, and
+    // tiles nobody has asked for yet wait in _metaTiles.
+    osg::Image* fetchMetaTileImage(
+        const TileKey&     key,
+        const std::string& extraAttrs,
+        ProgressCallback*  progress,
+        ReadResult&        out_response )
+    {
+        const unsigned size = getPixelsPerTile();
+        const unsigned lod  = key.getLOD();
+
+        unsigned tilesWide, tilesHigh;
+        key.getProfile()->getNumTiles( lod, tilesWide, tilesHigh );
+
+        // the block, clamped to the edges of the profile:
+        unsigned x0   = (key.getTileX() / _metatileSize) * _metatileSize;
+        unsigned y0   = (key.getTileY() / _metatileSize) * _metatileSize;
+        unsigned cols = osg::minimum( _metatileSize, tilesWide - x0 );
+        unsigned rows = osg::minimum( _metatileSize, tilesHigh - y0 );
+
+        std::string tileId = key.str() + "|" + extraAttrs;
+        std::string metaId = TileKey(lod, x0, y0, key.getProfile()).str() + "|" + extraAttrs;
+
+        osg::ref_ptr<osg::Image>       cached;
+        Threading::Promise<osg::Image> promise;
+        Threading::Future<osg::Image>  future;
+        bool fetching = false;
+        {
+            Threading::ScopedMutexLock lock( _metaMutex );
+
+            MetaTileCache::Record rec;
+            if ( _metaTiles.get(tileId, rec) )
+            {
+                // handed over once; the layer takes it from here.
+                _metaTiles.erase( tileId );
+                cached = rec.value();
+            }
+            else
+            {
+                MetaTileFutures::iterator i = _metaFutures.find( metaId );
+                if ( i != _metaFutures.end() )
+                {
+                    future = i->second;
+                }
+                else
+                {
+                    future = promise.getFuture();
+                    _metaFutures[metaId] = future;
+                    fetching = true;
+                }
+            }
+        }
+
+        if ( cached.valid() )
+        {
+            out_response = ReadResult( cached.get() );
+            return cached.release();
+        }
+
+        osg::ref_ptr<osg::Image> meta;
+
+        if ( fetching )
+        {
+            double minx, miny, maxx, maxy, dummy;
+            TileKey(lod, x0,        y0,        key.getProfile()).getExtent().getBounds( minx, dummy, dummy, maxy );
+            TileKey(lod, x0+cols-1, y0+rows-1, key.getProfile()).getExtent().getBounds( dummy, miny, maxx, dummy );
+
+            char buf[2048];
+            sprintf( buf, _metaPrototype.c_str(), cols*size, rows*size, minx, miny, maxx, maxy );
+
+            std::string uri( buf );
+            if ( osgDB::containsServerAddress( uri ) )
+                uri = replaceIn( uri, " ", "%20" );
+
+            out_response = URI( appendAttrs(uri, extraAttrs) ).readImage( _dbOptions.get(), progress );
+
+            if ( out_response.succeeded() )
+            {
+                meta = out_response.getImage();
+
+                // only split what we can split; anything else falls back to
+                // one request per tile.
+                if ( meta.valid() &&
+                     ((unsigned)meta->s() != cols*size || (unsigned)meta->t() != rows*size ||
+                      meta->isCompressed() || meta->getPixelSizeInBits() % 8u != 0u) )
+                {
+                    OE_DEBUG << LC << "Metatile " << metaId << " came back "
+                        << meta->s() << "x" << meta->t() << "; not splitting" << std::endl;
+                    meta = 0L;
+                }
+            }
+
+            if ( meta.valid() )
+            {
+                for ( unsigned r = 0; r < rows; ++r )
+                {
+                    for ( unsigned c = 0; c < cols; ++c )
+                    {
+                        if ( x0 + c == key.getTileX() && y0 + r == key.getTileY() )
+                            continue;
+
+                        // tile rows go north to south; image rows go bottom up.
+                        osg::ref_ptr<osg::Image> tile = extractTile( meta.get(), c*size, (rows-1-r)*size, size );
+                        TileKey neighbor( lod, x0 + c, y0 + r, key.getProfile() );
+                        _metaTiles.insert( neighbor.str() + "|" + extraAttrs, tile.get(), tile->getTotalSizeInBytes() );
+                    }
+                }
+            }
+
+            {
+                Threading::ScopedMutexLock lock( _metaMutex );
+                _metaFutures.erase( metaId );
+            }
+            promise.resolve( meta.get() );
+        }
+        else
+        {
+            meta = future.get();
+
+            // our tile went into _metaTiles too; we're taking it here instead.
+            _metaTiles.erase( tileId );
+        }
+
+        if ( !meta.valid() )
+        {
+            // the block request failed; try this tile on its own.
+            osg::ref_ptr<osg::Image> image;
+            std::string uri = appendAttrs( createURI(key), extraAttrs );
+            out_response = URI( uri ).readImage( _dbOptions.get(), progress );
+            if ( out_response.succeeded() )
+                image = out_response.getImage();
+            return image.release();
+        }
+
+        unsigned c = key.getTileX() - x0;
+        unsigned r = key.getTileY() - y0;
+        osg::Image* image = extractTile( meta.get(), c*size, (rows-1-r)*size, size );
+        if ( !fetching )
+            out_response = ReadResult( image );
+        return image;
+    }
+
+    // appends extra query attributes (like TIME) to a request URI.
+    std::string appendAttrs( const std::string& uri, const std::string& extraAttrs ) const
+    {
+        if ( extraAttrs.empty() )
+            return uri;
+
+        std::string delim = uri.find("?") == std::string::npos ? "?" : "&";
+        return uri + delim + extraAttrs;
+    }
+
 
     /** override */
     osg::Image* createImage( const TileKey& key, ProgressCallback* progress )
@@ -409,6 +600,36 @@ public:
         if ( this->isSequencePlaying() )
             seq->play();
 
+#if !OSG_VERSION_LESS_THAN(3,1,4)
+        // While playing, only wait for the frame on screen now. Every slot
+        // starts out showing it, and the rest fill in from the background
+        // in playback order.
+        if ( this->isSequencePlaying() && _options.prefetchTimes() == true )
+        {
+            unsigned first = (unsigned)_currentFrame % _timesVec.size();
+
+            ReadResult response;
+            osg::ref_ptr<osg::Image> image = fetchTileImage( key, std::string("TIME=") + _timesVec[first], progress, response );
+            if ( !image.valid() )
+            {
+                return ImageUtils::createEmptyImage();
+            }
+
+            for( unsigned int r=0; r<_timesVec.size(); ++r )
+            {
+                seq->addImage( image.get() );
+            }
+
+            _sequenceCache.insert( seq.get() );
+
+            Registry::instance()->getJobScheduler()->submit(
+                new PrefetchTimesTask(this, seq.get(), key, first),
+                JobScheduler::LANE_LOW );
+
+            return seq.release();
+        }
+#endif
+
         for( unsigned int r=0; r<_timesVec.size(); ++r )
         {
             std::string extraAttrs = std::string("TIME=") + _timesVec[r];
@@ -531,13 +752,59 @@ public: // SequenceControl
 
         double len = _options.secondsPerFrame().value() * (double)_timesVec.size();
         double t   = fmod( fs->getSimulationTime(), len ) / len;
-        return osg::clampBetween(
+        int index  = osg::clampBetween(
             (int)(t * (double)_seqFrameInfoVec.size()), 
             (int)0, 
             (int)_seqFrameInfoVec.size()-1);
+
+        // remember where playback is, so new sequences load from here.
+        _currentFrame.exchange( (unsigned)index );
+        return index;
     }
 
 
+private:
+
+    // Fills in the time steps of a sequence after the first one, in
+    // playback order, until done or until the sequence goes away.
+    struct PrefetchTimesTask : public TaskRequest
+    {
+        PrefetchTimesTask(WMSSource* source, osg::ImageSequence* seq, const TileKey& key, unsigned first) :
+            _source(source), _seq(seq), _key(key), _first(first) { }
+
+        void operator()(ProgressCallback* progress)
+        {
+            unsigned n = _source->_timesVec.size();
+            for (unsigned i = 1; i < n; ++i)
+            {
+                unsigned r = (_first + i) % n;
+
+                // stop once the tile is gone.
+                if ( !_seq.valid() )
+                    return;
+
+                ReadResult response;
+                osg::ref_ptr<osg::Image> image = _source->fetchTileImage(
+                    _key, std::string("TIME=") + _source->_timesVec[r], progress, response );
+
+                osg::ref_ptr<osg::ImageSequence> seq;
+                if ( !_seq.lock(seq) )
+                    return;
+
+#if !OSG_VERSION_LESS_THAN(3,1,4)
+                if ( image.valid() )
+                    seq->setImage( r, image.get() );
+#endif
+            }
+        }
+
+        osg::ref_ptr<WMSSource>            _source;
+        osg::observer_ptr<osg::ImageSequence> _seq;
+        TileKey                            _key;
+        unsigned                           _first;
+    };
+
+
 private:
     const WMSOptions                 _options;
     std::string                      _formatToUse;
@@ -549,6 +816,16 @@ private:
     bool                             _isPlaying;
     std::vector<SequenceFrameInfo>   _seqFrameInfoVec;
 
+    typedef LRUCache<std::string, osg::ref_ptr<osg::Image> > MetaTileCache;
+    typedef std::map<std::string, Threading::Future<osg::Image> > MetaTileFutures;
+
+    unsigned                         _metatileSize;
+    std::string                      _metaPrototype;
+    MetaTileCache                    _metaTiles;
+    MetaTileFutures                  _metaFutures;
+    Threading::Mutex                 _metaMutex;
+    mutable OpenThreads::Atomic      _currentFrame;
+
     mutable ThreadSafeObserverSet<osg::ImageSequence> _sequenceCache;
 };
 
@@ -18,13 +18,55 @@
  */
 #include <osgEarthFeatures/BufferFilter>
 #include <osgEarthFeatures/FilterContext>
+#include <osgEarth/JobScheduler>
+#include <osgEarth/Registry>
 
 #define LC "[BufferFilter] "
 
+// Number of features each buffering job handles.
+#define FEATURES_PER_JOB 64u
+
 using namespace osgEarth;
 using namespace osgEarth::Features;
 using namespace osgEarth::Symbology;
 
+namespace
+{
+    /**
+     * Buffers a run of features on a job thread.
+     */
+    struct BufferJob : public TaskRequest
+    {
+        BufferJob(double distance, const Symbology::BufferParameters& params) :
+            _distance( distance ),
+            _params  ( params ) { }
+
+        void operator()(ProgressCallback* progress)
+        {
+            _keep.assign( _features.size(), false );
+
+            for( unsigned i = 0; i < _features.size(); ++i )
+            {
+                Feature* feature = _features[i];
+                if ( !feature || !feature->getGeometry() )
+                    continue;
+
+                osg::ref_ptr<Symbology::Geometry> output;
+                if ( feature->getGeometry()->buffer( _distance, output, _params ) )
+                {
+                    feature->setGeometry( output.get() );
+                    _keep[i] = true;
+                }
+            }
+        }
+
+        double                       _distance;
+        Symbology::BufferParameters  _params;
+        std::vector<Feature*>        _features;
+        std::vector<bool>            _keep;
+    };
+}
+
 bool
 BufferFilter::isSupported()
 {
@@ -86,34 +128,55 @@ BufferFilter::push( FeatureList& input, FilterContext& context )
         return context;
     }
 
-    //OE_NOTICE << "Buffer: input = " << input.size() << " features" << std::endl;
-    for( FeatureList::iterator i = input.begin(); i != input.end(); )
-    {
-        Feature* feature = i->get();
-        if ( !feature || !feature->getGeometry() )
-            continue;
+    Symbology::BufferParameters params;
 
-        osg::ref_ptr<Symbology::Geometry> output;
+    params._capStyle =
+            _capStyle == Stroke::LINECAP_ROUND  ? Symbology::BufferParameters::CAP_ROUND :
+            _capStyle == Stroke::LINECAP_SQUARE ? Symbology::BufferParameters::CAP_SQUARE :
+            _capStyle == Stroke::LINECAP_FLAT   ? Symbology::BufferParameters::CAP_FLAT :
+                                                  Symbology::BufferParameters::CAP_SQUARE;
 
-        Symbology::BufferParameters params;
-        
-        params._capStyle =
-                _capStyle == Stroke::LINECAP_ROUND  ? Symbology::BufferParameters::CAP_ROUND :
-                _capStyle == Stroke::LINECAP_SQUARE ? Symbology::BufferParameters::CAP_SQUARE :
-                _capStyle == Stroke::LINECAP_FLAT   ? Symbology::BufferParameters::CAP_FLAT :
-                                                      Symbology::BufferParameters::CAP_SQUARE;
+    params._cornerSegs = _numQuadSegs;
 
-        params._cornerSegs = _numQuadSegs;
+    // split the features into jobs and buffer them in parallel:
+    std::vector< osg::ref_ptr<BufferJob> > jobs;
+    for( FeatureList::iterator i = input.begin(); i != input.end(); ++i )
+    {
+        if ( jobs.empty() || jobs.back()->_features.size() >= FEATURES_PER_JOB )
+            jobs.push_back( new BufferJob(_distance.value(), params) );
+        jobs.back()->_features.push_back( i->get() );
+    }
 
-        if ( feature->getGeometry()->buffer( _distance.value(), output, params ) )
-        {
-            feature->setGeometry( output.get() );
-            ++i;
-        }
-        else
+    if ( jobs.size() == 1 )
+    {
+        (*jobs[0])( 0L );
+    }
+    else if ( jobs.size() > 1 )
+    {
+        JobScheduler* scheduler = Registry::instance()->getJobScheduler();
+        osg::ref_ptr<JobGroup> group = new JobGroup();
+        for( unsigned j = 0; j < jobs.size(); ++j )
+            scheduler->submit( jobs[j].get(), JobScheduler::LANE_NORMAL, group.get() );
+        scheduler->join( group.get() );
+    }
+
+    // drop the features that yielded no geometry, in order:
+    FeatureList::iterator i = input.begin();
+    for( unsigned j = 0; j < jobs.size(); ++j )
+    {
+        BufferJob* job = jobs[j].get();
+        for( unsigned k = 0; k < job->_keep.size(); ++k )
         {
-            i = input.erase( i );
-            OE_DEBUG << LC << "feature " << feature->getFID() << " yielded no geometry" << std::endl;
+            if ( job->_keep[k] )
+            {
+                ++i;
+            }
+            else
+            {
+                if ( i->valid() )
+                    OE_DEBUG << LC << "feature " << (*i)->getFID() << " yielded no geometry" << std::endl;
+                i = input.erase( i );
+            }
         }
     }
 
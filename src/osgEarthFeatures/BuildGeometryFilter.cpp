@@ -202,7 +202,7 @@ BuildGeometryFilter::processPolygons(FeatureList& features, FilterContext& conte
                 hats->push_back( i->z() );
 
             // build the geometry:
-            tileAndBuildPolygon(part, featureSRS, outputSRS, makeECEF, true, osgGeom.get(), w2l);
+            tileAndBuildPolygon(part, featureSRS, outputSRS, makeECEF, true, osgGeom.get(), w2l, input->getFID());
             //buildPolygon(part, featureSRS, mapSRS, makeECEF, true, osgGeom, w2l);
 
             osg::Vec3Array* allPoints = static_cast<osg::Vec3Array*>(osgGeom->getVertexArray());
@@ -804,13 +804,14 @@ void convertToDrawElementsUInt(osg::Geometry* geometry)
 }
 
 /**
- * Tesselates an osg::Geometry using the osgEarth tesselator.
+ * Tesselates an osg::Geometry using the osgEarth tesselator, reusing the
+ * triangles from an earlier build of the same feature geometry if there are any.
  * If it fails, fall back to the osgUtil tesselator.
  */
-bool tesselateGeometry(osg::Geometry* geometry)
+bool tesselateGeometry(osg::Geometry* geometry, FeatureID fid)
 {
     osgEarth::Tessellator oeTess;
-    if ( !oeTess.tessellateGeometry(*geometry) )
+    if ( !oeTess.tessellateGeometry(*geometry, TessellationCache::getShared(), fid) )
     {
         osgUtil::Tessellator tess;
         tess.setTessellationType( osgUtil::Tessellator::TESS_TYPE_GEOMETRY );
@@ -984,7 +985,8 @@ BuildGeometryFilter::tileAndBuildPolygon(Geometry*               ring,
                                          bool                    makeECEF,
                                          bool                    tessellate,
                                          osg::Geometry*          osgGeom,
-                                         const osg::Matrixd      &world2local)
+                                         const osg::Matrixd      &world2local,
+                                         FeatureID               fid)
 {
 #define MAX_POINTS_PER_CROP_TILE 1024
 //#define TARGET_TILE_SIZE_EXTENT_DEGREES 5
@@ -1031,7 +1033,7 @@ BuildGeometryFilter::tileAndBuildPolygon(Geometry*               ring,
             if ( temp->getNumPrimitiveSets() > 0 )
             {
                 // Tesselate the polygon while the coordinates are still in the LTP
-                if (tesselateGeometry( temp.get() ))
+                if (tesselateGeometry( temp.get(), fid ))
                 {
                     osg::Vec3Array* verts = static_cast<osg::Vec3Array*>(temp->getVertexArray());
                     if ( verts->getNumElements() > 0 )
@@ -17,13 +17,84 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include <osgEarthFeatures/CropFilter>
+#include <osgEarth/JobScheduler>
+#include <osgEarth/Registry>
 
 #define LC "[CropFilter] "
 
+// Number of features each cropping job handles.
+#define FEATURES_PER_JOB 64u
+
 using namespace osgEarth;
 using namespace osgEarth::Features;
 using namespace osgEarth::Symbology;
 
+namespace
+{
+    /**
+     * Crops a run of features to the extent on a job thread. The crop
+     * polygon is prepared once per job and reused for all its features.
+     */
+    struct CropJob : public TaskRequest
+    {
+        CropJob(const GeoExtent& extent, const Polygon* poly) :
+            _extent   ( extent ),
+            _poly     ( poly ),
+            _newExtent( extent.getSRS() ) { }
+
+        void operator()(ProgressCallback* progress)
+        {
+            _keep.assign( _features.size(), false );
+
+            osg::ref_ptr<GeometryCropper> cropper;
+
+            for( unsigned i = 0; i < _features.size(); ++i )
+            {
+                Feature* feature = _features[i];
+
+                Symbology::Geometry* featureGeom = feature->getGeometry();
+                if ( !featureGeom || !featureGeom->isValid() )
+                    continue;
+
+                const Bounds bounds = featureGeom->getBounds();
+                if ( !bounds.isValid() )
+                    continue;
+
+                // test for trivial acceptance:
+                if ( _extent.contains( bounds ) )
+                {
+                    _keep[i] = true;
+                    _newExtent.expandToInclude( bounds );
+                }
+
+                // then move on to the cropping operation:
+                else
+                {
+                    if ( !cropper.valid() )
+                        cropper = new GeometryCropper( _poly.get() );
+
+                    osg::ref_ptr<Geometry> croppedGeometry;
+                    if ( cropper->crop( featureGeom, croppedGeometry ) )
+                    {
+                        if ( croppedGeometry->isValid() )
+                        {
+                            feature->setGeometry( croppedGeometry.get() );
+                            _keep[i] = true;
+                            _newExtent.expandToInclude( croppedGeometry->getBounds() );
+                        }
+                    }
+                }
+            }
+        }
+
+        GeoExtent                     _extent;
+        osg::ref_ptr<const Polygon>   _poly;
+        std::vector<Feature*>         _features;
+        std::vector<bool>             _keep;
+        GeoExtent                     _newExtent;
+    };
+}
+
 CropFilter::CropFilter( CropFilter::Method method ) :
 _method( method )
 {
@@ -79,60 +150,50 @@ CropFilter::push( FeatureList& input, FilterContext& context )
 #ifdef OSGEARTH_HAVE_GEOS
 
         // create the intersection polygon:
-        osg::ref_ptr<Symbology::Polygon> poly;
-        
-        for( FeatureList::iterator i = input.begin(); i != input.end();  )
+        osg::ref_ptr<Symbology::Polygon> poly = new Symbology::Polygon();
+        poly->push_back( osg::Vec3d( extent.xMin(), extent.yMin(), 0 ));
+        poly->push_back( osg::Vec3d( extent.xMax(), extent.yMin(), 0 ));
+        poly->push_back( osg::Vec3d( extent.xMax(), extent.yMax(), 0 ));
+        poly->push_back( osg::Vec3d( extent.xMin(), extent.yMax(), 0 ));
+
+        // split the features into jobs and crop them in parallel:
+        std::vector< osg::ref_ptr<CropJob> > jobs;
+        for( FeatureList::iterator i = input.begin(); i != input.end(); ++i )
         {
-            bool keepFeature = false;
+            if ( jobs.empty() || jobs.back()->_features.size() >= FEATURES_PER_JOB )
+                jobs.push_back( new CropJob(extent, poly.get()) );
+            jobs.back()->_features.push_back( i->get() );
+        }
 
-            Feature* feature = i->get();
+        if ( jobs.size() == 1 )
+        {
+            (*jobs[0])( 0L );
+        }
+        else if ( jobs.size() > 1 )
+        {
+            JobScheduler* scheduler = Registry::instance()->getJobScheduler();
+            osg::ref_ptr<JobGroup> group = new JobGroup();
+            for( unsigned j = 0; j < jobs.size(); ++j )
+                scheduler->submit( jobs[j].get(), JobScheduler::LANE_NORMAL, group.get() );
+            scheduler->join( group.get() );
+        }
 
-            Symbology::Geometry* featureGeom = feature->getGeometry();
-            if ( featureGeom && featureGeom->isValid() )
+        // drop what didn't survive, in order:
+        FeatureList::iterator i = input.begin();
+        for( unsigned j = 0; j < jobs.size(); ++j )
+        {
+            CropJob* job = jobs[j].get();
+            for( unsigned k = 0; k < job->_keep.size(); ++k )
             {
-                // test for trivial acceptance:
-                const Bounds bounds = featureGeom->getBounds();
-                if ( !bounds.isValid() )
-                {
-                    //nop
-                }
-
-                else if ( extent.contains( bounds ) )
-                {
-                    keepFeature = true;
-                    newExtent.expandToInclude( bounds );
-                }
-
-                // then move on to the cropping operation:
+                if ( job->_keep[k] )
+                    ++i;
                 else
-                {
-                    if ( !poly.valid() )
-                    {
-                        poly = new Symbology::Polygon();
-                        poly->push_back( osg::Vec3d( extent.xMin(), extent.yMin(), 0 ));
-                        poly->push_back( osg::Vec3d( extent.xMax(), extent.yMin(), 0 ));
-                        poly->push_back( osg::Vec3d( extent.xMax(), extent.yMax(), 0 ));
-                        poly->push_back( osg::Vec3d( extent.xMin(), extent.yMax(), 0 ));
-                    }
-
-                    osg::ref_ptr<Geometry> croppedGeometry;
-                    if ( featureGeom->crop( poly.get(), croppedGeometry ) )
-                    {
-                        if ( croppedGeometry->isValid() )
-                        {
-                            feature->setGeometry( croppedGeometry.get() );
-                            keepFeature = true;
-                            newExtent.expandToInclude( croppedGeometry->getBounds() );
-                        }
-                    }
-                }
+                    i = input.erase( i );
             }
 
-            if ( keepFeature )
-                ++i;
-            else
-                i = input.erase( i );
-        }  
+            if ( job->_newExtent.isValid() )
+                newExtent.expandToInclude( job->_newExtent );
+        }
 
 #else // OSGEARTH_HAVE_GEOS
 
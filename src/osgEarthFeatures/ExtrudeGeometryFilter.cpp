@@ -701,7 +701,8 @@ bool
 ExtrudeGeometryFilter::buildRoofGeometry(const Structure&     structure,
                                          osg::Geometry*       roof,
                                          const osg::Vec4&     roofColor,
-                                         const SkinResource*  roofSkin)
+                                         const SkinResource*  roofSkin,
+                                         FeatureID            fid)
 {    
     osg::Vec3Array* verts = new osg::Vec3Array();
     roof->setVertexArray( verts );
@@ -710,10 +711,16 @@ ExtrudeGeometryFilter::buildRoofGeometry(const Structure&     structure,
     roof->setColorArray( color );
 
     osg::Vec3Array* tex = 0L;
+    osg::Vec2f bias(0,0), scale(1,1);
+    float layer = 0.0f;
     if ( roofSkin )
     {
         tex = new osg::Vec3Array();
         roof->setTexCoordArray(0, tex);
+
+        bias.set (roofSkin->imageBiasS().get(),  roofSkin->imageBiasT().get());
+        scale.set(roofSkin->imageScaleS().get(), roofSkin->imageScaleT().get());
+        layer = (float)roofSkin->imageLayer().get();
     }
 
     osg::Vec4Array* anchors = 0L;    
@@ -748,7 +755,8 @@ ExtrudeGeometryFilter::buildRoofGeometry(const Structure&     structure,
 
                 if ( tex )
                 {
-                    tex->push_back( osg::Vec3f(f->left.roofTexU, f->left.roofTexV, (float)0.0f) );
+                    osg::Vec2f t = bias + osg::componentMultiply(osg::Vec2f(f->left.roofTexU, f->left.roofTexV), scale);
+                    tex->push_back( osg::Vec3f(t.x(), t.y(), layer) );
                 }
 
                 if ( anchors )
@@ -781,7 +789,7 @@ ExtrudeGeometryFilter::buildRoofGeometry(const Structure&     structure,
 
     // Tessellate the roof lines into polygons.
     osgEarth::Tessellator oeTess;
-    if (!oeTess.tessellateGeometry(*roof))
+    if (!oeTess.tessellateGeometry(*roof, TessellationCache::getShared(), fid))
     {
         //fallback to osg tessellator
         OE_DEBUG << LC << "Falling back on OSG tessellator (" << roof->getName() << ")" << std::endl;
@@ -993,6 +1001,14 @@ ExtrudeGeometryFilter::process( FeatureList& features, FilterContext& context )
     Random wallSkinPRNG( _wallSkinSymbol.valid()? *_wallSkinSymbol->randomSeed() : 0, Random::METHOD_FAST );
     Random roofSkinPRNG( _roofSkinSymbol.valid()? *_roofSkinSymbol->randomSeed() : 0, Random::METHOD_FAST );
 
+    // A library in atlas mode textures all its skins from one state set, so
+    // the walls and roofs it skins share a geode and can merge.
+    osg::ref_ptr<osg::StateSet> wallAtlasStateSet, roofAtlasStateSet;
+    if ( _wallResLib.valid() && _wallResLib->atlas() == true )
+        context.resourceCache()->getOrCreateStateSet(_wallResLib.get(), wallAtlasStateSet, context.getDBOptions());
+    if ( _roofResLib.valid() && _roofResLib->atlas() == true )
+        context.resourceCache()->getOrCreateStateSet(_roofResLib.get(), roofAtlasStateSet, context.getDBOptions());
+
     for( FeatureList::iterator f = features.begin(); f != features.end(); ++f )
     {
         Feature* input = f->get();
@@ -1118,7 +1134,11 @@ ExtrudeGeometryFilter::process( FeatureList& features, FilterContext& context )
 
                 buildWallGeometry(structure, walls.get(), wallColor, wallBaseColor, wallSkin);
 
-                if ( wallSkin )
+                if ( wallSkin && wallAtlasStateSet.valid() )
+                {
+                    wallStateSet = wallAtlasStateSet.get();
+                }
+                else if ( wallSkin )
                 {
                     // Get a stateset for the individual wall stateset
                     context.resourceCache()->getOrCreateStateSet(wallSkin, wallStateSet, context.getDBOptions());
@@ -1134,9 +1154,13 @@ ExtrudeGeometryFilter::process( FeatureList& features, FilterContext& context )
                     roofColor = _roofPolygonSymbol->fill()->color();
                 }
 
-                buildRoofGeometry(structure, rooflines.get(), roofColor, roofSkin);
+                buildRoofGeometry(structure, rooflines.get(), roofColor, roofSkin, input->getFID());
 
-                if ( roofSkin )
+                if ( roofSkin && roofAtlasStateSet.valid() )
+                {
+                    roofStateSet = roofAtlasStateSet.get();
+                }
+                else if ( roofSkin )
                 {
                     // Get a stateset for the individual roof skin
                     context.resourceCache()->getOrCreateStateSet(roofSkin, roofStateSet, context.getDBOptions());
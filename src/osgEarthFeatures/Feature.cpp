@@ -166,9 +166,54 @@ AttributeValue::getBool( bool defaultValue ) const
 
 //----------------------------------------------------------------------------
 
+AttributeSchema::AttributeSchema() :
+_numNumbers( 0u ),
+_numStrings( 0u )
+{
+    //nop
+}
+
+AttributeSchema::AttributeSchema( const FeatureSchema& schema ) :
+_numNumbers( 0u ),
+_numStrings( 0u )
+{
+    for( FeatureSchema::const_iterator i = schema.begin(); i != schema.end(); ++i )
+    {
+        add( i->first, i->second );
+    }
+}
+
+int
+AttributeSchema::add( const std::string& name, AttributeType type )
+{
+    if ( type == ATTRTYPE_UNSPECIFIED )
+        return -1;
+
+    IndexMap::const_iterator i = _index.find( name );
+    if ( i != _index.end() )
+        return (int)i->second;
+
+    unsigned index = (unsigned)_names.size();
+    _names.push_back( name );
+    _types.push_back( type );
+    _storage.push_back( type == ATTRTYPE_STRING ? _numStrings++ : _numNumbers++ );
+    _index[name] = index;
+    return (int)index;
+}
+
+int
+AttributeSchema::indexOf( const std::string& name ) const
+{
+    IndexMap::const_iterator i = _index.find( name );
+    return i != _index.end() ? (int)i->second : -1;
+}
+
+//----------------------------------------------------------------------------
+
 Feature::Feature( FeatureID fid ) :
 _fid( fid ),
-_srs( 0L )
+_srs( 0L ),
+_attrsViewDirty( true )
 //_cachedBoundingPolytopeValid( false )
 {
     //NOP
@@ -177,7 +222,8 @@ _srs( 0L )
 Feature::Feature( Geometry* geom, const SpatialReference* srs, const Style& style, FeatureID fid ) :
 _geom ( geom ),
 _srs  ( srs ),
-_fid  ( fid )
+_fid  ( fid ),
+_attrsViewDirty( true )
 {
     if ( !style.empty() )
         _style = style;
@@ -190,7 +236,12 @@ _fid      ( rhs._fid ),
 _attrs    ( rhs._attrs ),
 _style    ( rhs._style ),
 _geoInterp( rhs._geoInterp ),
-_srs      ( rhs._srs.get() )
+_srs      ( rhs._srs.get() ),
+_schema   ( rhs._schema.get() ),
+_numbers  ( rhs._numbers ),
+_strings  ( rhs._strings ),
+_slots    ( rhs._slots ),
+_attrsViewDirty( true )
 {
     if ( rhs._geom.valid() )
         _geom = rhs._geom->clone();
@@ -247,9 +298,181 @@ Feature::dirty()
     //_cachedBoundingPolytopeValid = false;
 }
 
+void
+Feature::setAttributeSchema( const AttributeSchema* schema )
+{
+    if ( schema == _schema.get() )
+        return;
+
+    // move anything in compact storage back into the table:
+    if ( _schema.valid() )
+    {
+        for( unsigned i=0; i<_slots.size(); ++i )
+        {
+            if ( _slots[i] == SLOT_NULL || _slots[i] == SLOT_SET )
+                getSlotValue( i, _attrs[_schema->getName(i)] );
+        }
+    }
+
+    _schema = schema;
+    _numbers.clear();
+    _strings.clear();
+    _slots.clear();
+    _attrsViewDirty = true;
+
+    if ( !_schema.valid() )
+        return;
+
+    _numbers.resize( _schema->getNumNumbers(), 0.0 );
+    _strings.resize( _schema->getNumStrings() );
+    _slots.resize( _schema->size(), SLOT_ABSENT );
+
+    // ...and adopt any table attributes that the schema knows about.
+    for( unsigned i=0; i<_schema->size(); ++i )
+    {
+        AttributeTable::iterator a = _attrs.find( _schema->getName(i) );
+        if ( a != _attrs.end() && a->second.first == _schema->getType(i) )
+        {
+            setSlotValue( i, a->second );
+            _attrs.erase( a );
+        }
+        else if ( a != _attrs.end() )
+        {
+            _slots[i] = SLOT_TABLE;
+        }
+    }
+}
+
+const AttributeTable&
+Feature::getAttrs() const
+{
+    if ( !_schema.valid() )
+        return _attrs;
+
+    if ( _attrsViewDirty )
+    {
+        _attrsView = _attrs;
+        for( unsigned i=0; i<_slots.size(); ++i )
+        {
+            if ( _slots[i] == SLOT_NULL || _slots[i] == SLOT_SET )
+                getSlotValue( i, _attrsView[_schema->getName(i)] );
+        }
+        _attrsViewDirty = false;
+    }
+    return _attrsView;
+}
+
+int
+Feature::findSlot( const std::string& name ) const
+{
+    if ( !_schema.valid() )
+        return -1;
+
+    int i = _schema->indexOf( name );
+    return i >= 0 && (_slots[i] == SLOT_NULL || _slots[i] == SLOT_SET) ? i : -1;
+}
+
+int
+Feature::claimSlot( const std::string& name, AttributeType type )
+{
+    if ( !_schema.valid() )
+        return -1;
+
+    _attrsViewDirty = true;
+
+    int i = _schema->indexOf( name );
+    if ( i < 0 )
+        return -1;
+
+    if ( _schema->getType(i) == type )
+    {
+        // a value that was in the table because of a type mismatch goes away.
+        if ( _slots[i] == SLOT_TABLE )
+            _attrs.erase( name );
+        return i;
+    }
+
+    // type doesn't match the schema; this one lives in the table from now on.
+    _slots[i] = SLOT_TABLE;
+    return -1;
+}
+
+void
+Feature::getSlotValue( unsigned i, AttributeValue& out ) const
+{
+    unsigned k = _schema->getStorageIndex(i);
+    out.first = _schema->getType(i);
+    out.second.set = _slots[i] == SLOT_SET;
+
+    if ( out.first == ATTRTYPE_STRING )
+    {
+        out.second.stringValue = _strings[k];
+    }
+    else
+    {
+        double d = _numbers[k];
+        out.second.doubleValue = d;
+        out.second.intValue    = (int)d;
+        out.second.boolValue   = d != 0.0;
+    }
+}
+
+void
+Feature::setSlotValue( unsigned i, const AttributeValue& value )
+{
+    unsigned k = _schema->getStorageIndex(i);
+    _slots[i] = value.second.set ? SLOT_SET : SLOT_NULL;
+
+    switch( _schema->getType(i) )
+    {
+        case ATTRTYPE_STRING: _strings[k] = value.second.stringValue; break;
+        case ATTRTYPE_DOUBLE: _numbers[k] = value.second.doubleValue; break;
+        case ATTRTYPE_INT:    _numbers[k] = (double)value.second.intValue; break;
+        case ATTRTYPE_BOOL:   _numbers[k] = value.second.boolValue ? 1.0 : 0.0; break;
+        case ATTRTYPE_UNSPECIFIED: break;
+    }
+}
+
+const AttributeValue*
+Feature::findAttr( const std::string& name, AttributeValue& scratch ) const
+{
+    int slot = findSlot( name );
+    if ( slot >= 0 )
+    {
+        getSlotValue( slot, scratch );
+        return &scratch;
+    }
+
+    AttributeTable::const_iterator i = _attrs.find( name );
+    return i != _attrs.end() ? &i->second : 0L;
+}
+
+const std::string*
+Feature::findString( const std::string& name ) const
+{
+    int slot = findSlot( name );
+    if ( slot >= 0 )
+    {
+        return _schema->getType(slot) == ATTRTYPE_STRING && _slots[slot] == SLOT_SET ?
+            &_strings[_schema->getStorageIndex(slot)] : 0L;
+    }
+
+    AttributeTable::const_iterator i = _attrs.find( name );
+    return i != _attrs.end() && i->second.first == ATTRTYPE_STRING && i->second.second.set ?
+        &i->second.second.stringValue : 0L;
+}
+
 void
 Feature::set( const std::string& name, const std::string& value )
 {
+    int slot = claimSlot( name, ATTRTYPE_STRING );
+    if ( slot >= 0 )
+    {
+        _strings[_schema->getStorageIndex(slot)] = value;
+        _slots[slot] = SLOT_SET;
+        return;
+    }
+
     AttributeValue& a = _attrs[name];
     a.first = ATTRTYPE_STRING;
     a.second.stringValue = value;
@@ -259,6 +482,14 @@ Feature::set( const std::string& name, const std::string& value )
 void
 Feature::set( const std::string& name, double value )
 {
+    int slot = claimSlot( name, ATTRTYPE_DOUBLE );
+    if ( slot >= 0 )
+    {
+        _numbers[_schema->getStorageIndex(slot)] = value;
+        _slots[slot] = SLOT_SET;
+        return;
+    }
+
     AttributeValue& a = _attrs[name];
     a.first = ATTRTYPE_DOUBLE;
     a.second.doubleValue = value;
@@ -268,6 +499,14 @@ Feature::set( const std::string& name, double value )
 void
 Feature::set( const std::string& name, int value )
 {
+    int slot = claimSlot( name, ATTRTYPE_INT );
+    if ( slot >= 0 )
+    {
+        _numbers[_schema->getStorageIndex(slot)] = (double)value;
+        _slots[slot] = SLOT_SET;
+        return;
+    }
+
     AttributeValue& a = _attrs[name];
     a.first = ATTRTYPE_INT;
     a.second.intValue = value;
@@ -277,12 +516,27 @@ Feature::set( const std::string& name, int value )
 void
 Feature::set( const std::string& name, const AttributeValue& value)
 {
+    int slot = claimSlot( name, value.first );
+    if ( slot >= 0 )
+    {
+        setSlotValue( slot, value );
+        return;
+    }
+
     _attrs[ name ] = value;
 }
 
 void
 Feature::set( const std::string& name, bool value )
 {
+    int slot = claimSlot( name, ATTRTYPE_BOOL );
+    if ( slot >= 0 )
+    {
+        _numbers[_schema->getStorageIndex(slot)] = value ? 1.0 : 0.0;
+        _slots[slot] = SLOT_SET;
+        return;
+    }
+
     AttributeValue& a = _attrs[name];
     a.first = ATTRTYPE_BOOL;
     a.second.boolValue = value;
@@ -292,6 +546,14 @@ Feature::set( const std::string& name, bool value )
 void
 Feature::setNull( const std::string& name)
 {
+    // keeps the existing type, which for a schema attribute is the schema's.
+    int i = _schema.valid() ? _schema->indexOf(name) : -1;
+    if ( i >= 0 && claimSlot(name, _schema->getType(i)) >= 0 )
+    {
+        _slots[i] = SLOT_NULL;
+        return;
+    }
+
     AttributeValue& a = _attrs[name];    
     a.second.set = false;
 }
@@ -299,53 +561,62 @@ Feature::setNull( const std::string& name)
 void
 Feature::setNull( const std::string& name, AttributeType type)
 {
+    int slot = claimSlot( name, type );
+    if ( slot >= 0 )
+    {
+        _slots[slot] = SLOT_NULL;
+        return;
+    }
+
     AttributeValue& a = _attrs[name];
     a.first = type;    
     a.second.set = false;
 }
 
-
-
-
 bool
 Feature::hasAttr( const std::string& name ) const
 {
-    return _attrs.find(toLower(name)) != _attrs.end();
+    return findSlot(name) >= 0 || _attrs.find(name) != _attrs.end();
 }
 
 std::string
 Feature::getString( const std::string& name ) const
 {
-    AttributeTable::const_iterator i = _attrs.find(toLower(name));
-    return i != _attrs.end()? i->second.getString() : EMPTY_STRING;
+    AttributeValue scratch;
+    const AttributeValue* a = findAttr(name, scratch);
+    return a ? a->getString() : EMPTY_STRING;
 }
 
 double
 Feature::getDouble( const std::string& name, double defaultValue ) const 
 {
-    AttributeTable::const_iterator i = _attrs.find(toLower(name));
-    return i != _attrs.end()? i->second.getDouble(defaultValue) : defaultValue;
+    AttributeValue scratch;
+    const AttributeValue* a = findAttr(name, scratch);
+    return a ? a->getDouble(defaultValue) : defaultValue;
 }
 
 int
 Feature::getInt( const std::string& name, int defaultValue ) const 
 {
-    AttributeTable::const_iterator i = _attrs.find(toLower(name));
-    return i != _attrs.end()? i->second.getInt(defaultValue) : defaultValue;
+    AttributeValue scratch;
+    const AttributeValue* a = findAttr(name, scratch);
+    return a ? a->getInt(defaultValue) : defaultValue;
 }
 
 bool
 Feature::getBool( const std::string& name, bool defaultValue ) const 
 {
-    AttributeTable::const_iterator i = _attrs.find(toLower(name));
-    return i != _attrs.end()? i->second.getBool(defaultValue) : defaultValue;
+    AttributeValue scratch;
+    const AttributeValue* a = findAttr(name, scratch);
+    return a ? a->getBool(defaultValue) : defaultValue;
 }
 
 bool
 Feature::isSet( const std::string& name) const
 {
-    AttributeTable::const_iterator i = _attrs.find(toLower(name));
-    return i != _attrs.end()? i->second.second.set : false;
+    AttributeValue scratch;
+    const AttributeValue* a = findAttr(name, scratch);
+    return a ? a->second.set : false;
 }
 
 double
@@ -355,10 +626,11 @@ Feature::eval( NumericExpression& expr, FilterContext const* context ) const
     for( NumericExpression::Variables::const_iterator i = vars.begin(); i != vars.end(); ++i )
     {
       double val = 0.0;
-      AttributeTable::const_iterator ai = _attrs.find(toLower(i->first));
-      if (ai != _attrs.end())
+      AttributeValue scratch;
+      const AttributeValue* ai = findAttr(i->first, scratch);
+      if (ai)
       {
-        val = ai->second.getDouble(0.0);
+        val = ai->getDouble(0.0);
       }
       else if (context && context->getSession())
       {
@@ -388,10 +660,11 @@ Feature::eval(NumericExpression& expr, Session* session) const
     for( NumericExpression::Variables::const_iterator i = vars.begin(); i != vars.end(); ++i )
     {
         double val = 0.0;
-        AttributeTable::const_iterator ai = _attrs.find(toLower(i->first));
-        if (ai != _attrs.end())
+        AttributeValue scratch;
+        const AttributeValue* ai = findAttr(i->first, scratch);
+        if (ai)
         {
-            val = ai->second.getDouble(0.0);
+            val = ai->getDouble(0.0);
         }
         else if (session)
         {
@@ -423,11 +696,20 @@ Feature::eval( StringExpression& expr, FilterContext const* context ) const
     const StringExpression::Variables& vars = expr.variables();
     for( StringExpression::Variables::const_iterator i = vars.begin(); i != vars.end(); ++i )
     {
+      const std::string* str = findString(i->first);
+      if (str)
+      {
+        // common case: hand the stored string straight to the expression.
+        expr.set( *i, *str );
+        continue;
+      }
+
       std::string val = "";
-      AttributeTable::const_iterator ai = _attrs.find(toLower(i->first));
-      if (ai != _attrs.end())
+      AttributeValue scratch;
+      const AttributeValue* ai = findAttr(i->first, scratch);
+      if (ai)
       {
-        val = ai->second.getString();
+        val = ai->getString();
       }
       else if (context && context->getSession())
       {
@@ -459,11 +741,20 @@ Feature::eval(StringExpression& expr, Session* session) const
     const StringExpression::Variables& vars = expr.variables();
     for( StringExpression::Variables::const_iterator i = vars.begin(); i != vars.end(); ++i )
     {
+        const std::string* str = findString(i->first);
+        if (str)
+        {
+            // common case: hand the stored string straight to the expression.
+            expr.set( *i, *str );
+            continue;
+        }
+
         std::string val = "";
-        AttributeTable::const_iterator ai = _attrs.find(toLower(i->first));
-        if (ai != _attrs.end())
+        AttributeValue scratch;
+        const AttributeValue* ai = findAttr(i->first, scratch);
+        if (ai)
         {
-            val = ai->second.getString();
+            val = ai->getString();
         }
         else if (session)
         {
@@ -19,6 +19,7 @@
 #include <osgEarthFeatures/FeatureCursor>
 #include <osgEarthFeatures/Filter>
 #include <osgEarth/Progress>
+#include <osgEarth/StringUtils>
 
 using namespace osgEarth::Features;
 using namespace osgEarth::Symbology;
@@ -26,6 +27,68 @@ using namespace OpenThreads;
 
 //---------------------------------------------------------------------------
 
+int
+FeatureBatch::getColumnIndex(const std::string& name) const
+{
+    for (unsigned i = 0; i < columns.size(); ++i)
+    {
+        if ( osgEarth::ciEquals(columns[i].name, name) )
+            return (int)i;
+    }
+    return -1;
+}
+
+int
+FeatureBatch::addColumn(const std::string& name, AttributeType type)
+{
+    columns.push_back( Column() );
+    Column& column = columns.back();
+    column.name = name;
+    column.type = type;
+
+    // rows read before the column appeared are NULL
+    AttributeValue nullValue;
+    nullValue.first = type;
+    nullValue.second.set = false;
+    for (unsigned i = 0; i < size(); ++i)
+        append( column, nullValue );
+
+    return (int)columns.size()-1;
+}
+
+void
+FeatureBatch::append(Column& column, const AttributeValue& value)
+{
+    bool isSet = value.second.set;
+    column.set.push_back( isSet );
+
+    switch( column.type )
+    {
+    case ATTRTYPE_DOUBLE:
+        column.doubles.push_back( isSet ? value.getDouble() : 0.0 );
+        break;
+    case ATTRTYPE_INT:
+        column.ints.push_back( isSet ? value.getInt() : 0 );
+        break;
+    case ATTRTYPE_BOOL:
+        column.ints.push_back( isSet && value.getBool() ? 1 : 0 );
+        break;
+    default:
+        column.strings.push_back( isSet ? value.getString() : std::string() );
+    }
+}
+
+void
+FeatureBatch::clear()
+{
+    fids.clear();
+    geometries.clear();
+    columns.clear();
+    srs = 0L;
+}
+
+//---------------------------------------------------------------------------
+
 FeatureCursor::FeatureCursor(ProgressCallback* progress) :
 _progress(progress)
 {
@@ -46,6 +109,45 @@ FeatureCursor::fill(FeatureList& list)
     }
 }
 
+unsigned
+FeatureCursor::nextBatch(FeatureBatch& batch, unsigned maxSize)
+{
+    batch.clear();
+
+    while( batch.size() < maxSize && hasMore() )
+    {
+        Feature* f = nextFeature();
+        if ( !f )
+            continue;
+
+        if ( !batch.srs.valid() )
+            batch.srs = f->getSRS();
+
+        const AttributeTable& attrs = f->getAttrs();
+        for(AttributeTable::const_iterator a = attrs.begin(); a != attrs.end(); ++a)
+        {
+            int c = batch.getColumnIndex( a->first );
+            if ( c < 0 )
+                c = batch.addColumn( a->first, a->second.first );
+            batch.append( batch.columns[c], a->second );
+        }
+
+        batch.fids.push_back( f->getFID() );
+        batch.geometries.push_back( f->getGeometry() );
+
+        // NULL for columns this feature doesn't have
+        AttributeValue nullValue;
+        nullValue.second.set = false;
+        for(std::vector<FeatureBatch::Column>::iterator c = batch.columns.begin(); c != batch.columns.end(); ++c)
+        {
+            if ( c->set.size() < batch.size() )
+                batch.append( *c, nullValue );
+        }
+    }
+
+    return batch.size();
+}
+
 //---------------------------------------------------------------------------
 
 FeatureListCursor::FeatureListCursor(const FeatureList& features) :
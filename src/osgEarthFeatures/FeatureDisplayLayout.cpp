@@ -54,6 +54,7 @@ FeatureLevel::fromConfig( const Config& conf )
     conf.getIfSet( "max_visibility_range", _maxVisibilityRange );
     conf.getIfSet( "style",     _styleName ); 
     conf.getIfSet( "class",     _styleName ); // alias
+    conf.getIfSet( "max_triangles", _maxTriangles );
 }
 
 Config
@@ -64,6 +65,7 @@ FeatureLevel::getConfig() const
     conf.addIfSet( "max_range", _maxRange );
     conf.addIfSet( "max_visibility_range", _maxVisibilityRange );
     conf.addIfSet( "style",     _styleName );
+    conf.addIfSet( "max_triangles", _maxTriangles );
     return conf;
 }
 
@@ -76,6 +78,8 @@ _maxRange      ( 0.0f ),
 _cropFeatures  ( false ),
 _priorityOffset( 0.0f ),
 _priorityScale ( 1.0f ),
+_screenSpacePriority( true ),
+_maxConcurrentLoads ( 0u ),
 _minExpiryTime ( 0.0f ),
 _paged(true)
 {
@@ -90,6 +94,8 @@ FeatureDisplayLayout::fromConfig( const Config& conf )
     conf.getIfSet( "crop_features",    _cropFeatures );
     conf.getIfSet( "priority_offset",  _priorityOffset );
     conf.getIfSet( "priority_scale",   _priorityScale );
+    conf.getIfSet( "screen_space_priority", _screenSpacePriority );
+    conf.getIfSet( "max_concurrent_loads",  _maxConcurrentLoads );
     conf.getIfSet( "min_expiry_time",  _minExpiryTime );
     conf.getIfSet( "min_range",        _minRange );
     conf.getIfSet( "max_range",        _maxRange );
@@ -108,6 +114,8 @@ FeatureDisplayLayout::getConfig() const
     conf.addIfSet( "crop_features",    _cropFeatures );
     conf.addIfSet( "priority_offset",  _priorityOffset );
     conf.addIfSet( "priority_scale",   _priorityScale );
+    conf.addIfSet( "screen_space_priority", _screenSpacePriority );
+    conf.addIfSet( "max_concurrent_loads",  _maxConcurrentLoads );
     conf.addIfSet( "min_expiry_time",  _minExpiryTime );
     conf.addIfSet( "min_range",        _minRange );
     conf.addIfSet( "max_range",        _maxRange );
@@ -23,15 +23,23 @@
 
 using namespace osgEarth::Features;
 
+// Rebuild the index (to re-tune the cell size) once the feature count
+// grows this many times past the count at the last build.
+#define INDEX_REBUILD_GROWTH 4u
+
 FeatureListSource::FeatureListSource():
-FeatureSource()
+FeatureSource(),
+_indexDirty    ( true ),
+_indexBuildSize( 0u )
 {
     //nop
 }
 
 FeatureListSource::FeatureListSource(const GeoExtent& defaultExtent ) :
 FeatureSource (),
-_defaultExtent( defaultExtent )
+_defaultExtent( defaultExtent ),
+_indexDirty    ( true ),
+_indexBuildSize( 0u )
 {
     //nop
 }
@@ -42,10 +50,36 @@ FeatureListSource::createFeatureCursor(const Symbology::Query& query, ProgressCa
     if (getFeatureProfile() == 0L)
         setFeatureProfile(createFeatureProfile());
 
+    // Find the query bounds in the features' SRS, if any.
+    Bounds bounds;
+    if ( query.bounds().isSet() )
+    {
+        bounds = query.bounds().get();
+    }
+    else if ( query.tileKey().isSet() && getFeatureProfile()->getSRS() )
+    {
+        GeoExtent local = query.tileKey()->getExtent().transform( getFeatureProfile()->getSRS() );
+        if ( local.isValid() )
+            bounds = local.bounds();
+    }
+
+    Threading::ScopedMutexLock lock(_mutex);
+
+    FeatureList matches;
+    if ( bounds.isValid() )
+    {
+        updateIndex();
+        _index.query( bounds, matches );
+    }
+    else
+    {
+        matches = _features;
+    }
+
     //Create a copy of all of the features before returning the cursor.
     //The processing filters in osgEarth can modify the features as they are operating and we don't want our original data destroyed.
     FeatureList cursorFeatures;
-    for (FeatureList::iterator itr = _features.begin(); itr != _features.end(); ++itr)
+    for (FeatureList::iterator itr = matches.begin(); itr != matches.end(); ++itr)
     {
         Feature* feature = new Feature(*(itr->get()), osg::CopyOp::DEEP_COPY_ALL);        
         cursorFeatures.push_back( feature );
@@ -53,6 +87,17 @@ FeatureListSource::createFeatureCursor(const Symbology::Query& query, ProgressCa
     return new FeatureListCursor( cursorFeatures );
 }
 
+void
+FeatureListSource::updateIndex()
+{
+    if ( _indexDirty || _features.size() > _indexBuildSize * INDEX_REBUILD_GROWTH )
+    {
+        _index.build( _features );
+        _indexBuildSize = _features.size();
+        _indexDirty = false;
+    }
+}
+
 const FeatureProfile*
 FeatureListSource::createFeatureProfile()
 {    
@@ -86,10 +131,13 @@ bool
 FeatureListSource::deleteFeature(FeatureID fid)
 {
     dirtyFeatureProfile();
+    Threading::ScopedMutexLock lock(_mutex);
     for (FeatureList::iterator itr = _features.begin(); itr != _features.end(); ++itr) 
     {
         if (itr->get()->getFID() == fid)
         {
+            if ( !_indexDirty )
+                _index.remove( itr->get() );
             _features.erase( itr );
             dirty();
             return true;
@@ -114,7 +162,12 @@ FeatureListSource::getFeature( FeatureID fid )
 bool FeatureListSource::insertFeature(Feature* feature)
 {
     dirtyFeatureProfile();
-    _features.push_back( feature );
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+        _features.push_back( feature );
+        if ( !_indexDirty )
+            _index.insert( feature );
+    }
     dirty();
     return true;
 }
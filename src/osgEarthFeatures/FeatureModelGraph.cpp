@@ -22,17 +22,21 @@
 #include <osgEarthFeatures/FeatureSourceIndexNode>
 #include <osgEarthFeatures/FilterContext>
 
+#include <osgEarthSymbology/MeshSimplifier>
 #include <osgEarth/MapInfo>
 #include <osgEarth/Capabilities>
 #include <osgEarth/CullingUtils>
 #include <osgEarth/ElevationLOD>
 #include <osgEarth/ElevationQuery>
 #include <osgEarth/FadeEffect>
+#include <osgEarth/MemoryArena>
 #include <osgEarth/NodeUtils>
 #include <osgEarth/Registry>
+#include <osgEarth/TerrainOcclusionCullCallback>
 #include <osgEarth/ThreadingUtils>
 #include <osgEarth/Utils>
 #include <osgEarth/GLUtils>
+#include <osgEarth/JobScheduler>
 
 #include <osg/CullFace>
 #include <osg/PagedLOD>
@@ -171,6 +175,82 @@ namespace
         return str;
     }
 
+    /**
+     * Replaces the distance-based paging priority of a tile with the
+     * fraction of the viewport its bounds cover, so big tiles close to the
+     * camera come first whatever their LOD. The PagedLOD computes
+     * offset + scale * priority; with the scale zeroed out, the offset
+     * carries the whole priority.
+     */
+    struct ScreenSpacePriority : public osg::NodeCallback
+    {
+        ScreenSpacePriority(float offset, float importance) :
+            _offset(offset), _importance(importance) { }
+
+        void operator()(osg::Node* node, osg::NodeVisitor* nv)
+        {
+            osgUtil::CullVisitor* cv = Culling::asCullVisitor(nv);
+            osg::PagedLOD* plod = static_cast<osg::PagedLOD*>(node);
+            const osg::Viewport* vp = cv ? cv->getViewport() : 0L;
+
+            if (vp && vp->width() > 0.0 && vp->height() > 0.0)
+            {
+                float pixels = cv->clampedPixelSize(plod->getBound());
+                float coverage = osg::minimum(pixels*pixels / (float)(vp->width()*vp->height()), 1.0f);
+                plod->setPriorityScale(0, 0.0f);
+                plod->setPriorityOffset(0, _offset + _importance*coverage);
+            }
+
+            traverse(node, nv);
+        }
+
+        float _offset, _importance;
+    };
+
+    // Tile extents are INVALID when a tile covers everything.
+    bool overlaps(const GeoExtent& a, const GeoExtent& b)
+    {
+        return !a.isValid() || !b.isValid() || a.intersects(b);
+    }
+
+    // Collects the geometry of loaded tiles (see buildTileGeometry).
+    struct FindTileGeometry : public osg::NodeVisitor
+    {
+        FindTileGeometry() : osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN) { }
+
+        void apply(osg::Group& group)
+        {
+            if ( osgDB::getLowerCaseFileExtension(group.getName()) == "osgearth_pseudo_fmg" &&
+                 group.getNumParents() > 0 )
+            {
+                _results.push_back( &group );
+            }
+            else
+            {
+                traverse(group);
+            }
+        }
+
+        std::vector<osg::Group*> _results;
+    };
+
+    // Rebuilds the geometry of one tile after an edit.
+    struct TileUpdateJob : public TaskRequest
+    {
+        TileUpdateJob(FeatureModelGraph* graph, FeatureModelGraph::TileUpdate* update) :
+            _graph(graph), _update(update) { }
+
+        void operator()(ProgressCallback* progress)
+        {
+            osg::ref_ptr<FeatureModelGraph> graph;
+            if (_graph.lock(graph))
+                graph->runTileUpdate(_update.get());
+        }
+
+        osg::observer_ptr<FeatureModelGraph>        _graph;
+        osg::ref_ptr<FeatureModelGraph::TileUpdate> _update;
+    };
+
     osg::Group* createPagedNode(const osg::BoundingSphered& bs,
                                 const std::string& uri, 
                                 float minRange, 
@@ -219,6 +299,12 @@ namespace
         p->setRange(0, minRange, maxRange);
         p->setPriorityOffset(0, layout.priorityOffset().get());
         p->setPriorityScale(0, layout.priorityScale().get());
+        if (layout.screenSpacePriority() == true)
+        {
+            p->addCullCallback(new ScreenSpacePriority(
+                layout.priorityOffset().get(),
+                layout.priorityScale().get()));
+        }
         if (layout.minExpiryTime().isSet())
         {
             float value = layout.minExpiryTime() >= 0.0f ? layout.minExpiryTime().get() : FLT_MAX;
@@ -359,6 +445,14 @@ FeatureModelGraph::ctor()
 {
     // So we can pass it to the pseudoloader
     setName(USER_OBJECT_NAME);
+
+    // page tiles in on the job scheduler under this layer's own budget;
+    // merging needs an update traversal.
+    _loader = new PagingLoader();
+    _tileUpdateJobs = new JobGroup();
+    if (_options.layout().isSet())
+        _loader->setMaxRequestsInFlight(_options.layout()->maxConcurrentLoads().get());
+    ADJUST_UPDATE_TRAV_COUNT( this, +1 );
     
     OE_TEST << LC << "ctor" << std::endl;
 
@@ -375,16 +469,15 @@ FeatureModelGraph::ctor()
         return;
     }
 
-    // Set up a shared resource cache for the session. A session-wide cache means
-    // that all the paging threads that load data from this FMG will load resources
-    // from a single cache; e.g., once a texture is loaded in one thread, the same
-    // StateSet will be used across the entire Session. That also means that StateSets
+    // Use the process-wide resource cache for the session. That means that all the
+    // paging threads that load data from this FMG (and from every other layer) will
+    // load resources from a single cache; e.g., once a texture is loaded in one thread,
+    // the same StateSet will be used across all Sessions. That also means that StateSets
     // in the ResourceCache can potentially also be in the live graph; so you should
     // take care in dealing with them in a multi-threaded environment.
     if ( !_session->getResourceCache() && _options.sessionWideResourceCache() == true )
     {
-        //_session->setResourceCache( new ResourceCache(_session->getDBOptions()) );
-        _session->setResourceCache(new ResourceCache());
+        _session->setResourceCache(ResourceCache::getShared());
     }
     
     // Calculate the usable extent (in both feature and map coordinates) and bounds.
@@ -558,7 +651,7 @@ FeatureModelGraph::ctor()
 
 FeatureModelGraph::~FeatureModelGraph()
 {
-    //nop
+    _tileUpdateJobs->cancel();
 }
 
 Session*
@@ -720,6 +813,89 @@ FeatureModelGraph::setupPaging()
 }
 
 
+GeoExtent
+FeatureModelGraph::getTileExtent(unsigned lod, unsigned tileX, unsigned tileY) const
+{
+    if ( !_useTiledSource && (!_options.layout().isSet() || _options.layout()->getNumLevels() == 0) )
+    {
+        // one tile holds everything.
+        return GeoExtent::INVALID;
+    }
+
+    return lod > 0 ?
+        s_getTileExtent( lod, tileX, tileY, _usableFeatureExtent ) :
+        _usableFeatureExtent;
+}
+
+/**
+ * Builds the geometry of a tile's own level (without the PagedLODs of its
+ * subtiles). Returns NULL if the tile's LOD has no data level. Otherwise the
+ * result is named after the tile's URI, even if it's empty, so an edit can
+ * find it and rebuild it in place.
+ */
+osg::Group*
+FeatureModelGraph::buildTileGeometry(unsigned lod, unsigned tileX, unsigned tileY,
+                                     const std::string& uri,
+                                     const osgDB::Options* readOptions)
+{
+    osg::Group* geometry = 0L;
+
+    if ( _useTiledSource )
+    {       
+        // A "tiled" source has a pre-generted tile hierarchy, but no range information.
+        // We will calcluate the LOD ranges here, as a function of the tile radius and the
+        // "tile size factor" ... see below.
+        const FeatureProfile* featureProfile = _session->getFeatureSource()->getFeatureProfile();
+
+        if ( (int)lod < featureProfile->getFirstLevel() )
+            return 0L;
+
+        // The extent of this tile:
+        GeoExtent tileExtent = s_getTileExtent( lod, tileX, tileY, _usableFeatureExtent );
+
+        // Calculate the bounds of this new tile:
+        osg::BoundingSphered tileBound = getBoundInWorldCoords( tileExtent );
+
+        // Apply the tile range multiplier to calculate a max camera range. The max range is
+        // the geographic radius of the tile times the multiplier.
+        float tileFactor = _options.layout().isSet() ? _options.layout()->tileSizeFactor().get() : 15.0f;            
+        double maxRange =  tileBound.radius() * tileFactor;
+        FeatureLevel level( 0, maxRange );
+
+        // Construct a tile key that will be used to query the source for this tile.            
+        // The tilekey x, y, z that is computed in the FeatureModelGraph uses a lower left origin,
+        // osgEarth tilekeys use a lower left so we need to invert it.
+        unsigned int w, h;
+        featureProfile->getProfile()->getNumTiles(lod, w, h);
+        int invertedTileY = h - tileY - 1;
+
+        TileKey key(lod, tileX, invertedTileY, featureProfile->getProfile());
+
+        geometry = buildTile( level, tileExtent, &key, readOptions );
+    }
+
+    else if ( !_options.layout().isSet() || _options.layout()->getNumLevels() == 0 )
+    {
+        FeatureLevel all( 0.0f, FLT_MAX );
+        geometry = buildTile( all, GeoExtent::INVALID, (const TileKey*)0L, readOptions );
+    }
+
+    else
+    {
+        const FeatureLevel* level = lod < _lodmap.size() ? _lodmap[lod] : 0L;
+        if ( !level )
+            return 0L;
+
+        geometry = buildTile( *level, getTileExtent(lod, tileX, tileY), (const TileKey*)0L, readOptions );
+    }
+
+    if ( !geometry )
+        geometry = new osg::Group();
+
+    geometry->setName( uri );
+    return geometry;
+}
+
 /**
  * Called by the pseudo-loader, this method attempts to load a single tile of features.
  */
@@ -730,46 +906,16 @@ FeatureModelGraph::load(unsigned lod, unsigned tileX, unsigned tileY,
 {
     OE_TEST << LC << "load " << lod << "_" << tileX << "_" << tileY << std::endl;
 
-    osg::Group* result = 0L;
+    osg::ref_ptr<osg::Group> result;
+
+    // geometry for this tile's own level, if it has one:
+    osg::ref_ptr<osg::Group> geometry = buildTileGeometry( lod, tileX, tileY, uri, readOptions );
     
     if ( _useTiledSource )
     {       
-        // A "tiled" source has a pre-generted tile hierarchy, but no range information.
-        // We will calcluate the LOD ranges here, as a function of the tile radius and the
-        // "tile size factor" ... see below.
-        osg::Group* geometry =0L;
         const FeatureProfile* featureProfile = _session->getFeatureSource()->getFeatureProfile();
 
-        if ( (int)lod >= featureProfile->getFirstLevel() )
-        {
-            // The extent of this tile:
-            GeoExtent tileExtent = s_getTileExtent( lod, tileX, tileY, _usableFeatureExtent );
-
-            // Calculate the bounds of this new tile:
-            osg::BoundingSphered tileBound = getBoundInWorldCoords( tileExtent );
-
-            // Apply the tile range multiplier to calculate a max camera range. The max range is
-            // the geographic radius of the tile times the multiplier.
-            float tileFactor = _options.layout().isSet() ? _options.layout()->tileSizeFactor().get() : 15.0f;            
-            double maxRange =  tileBound.radius() * tileFactor;
-            FeatureLevel level( 0, maxRange );
-            //OE_NOTICE << "(" << lod << ": " << tileX << ", " << tileY << ")" << std::endl;
-            //OE_NOTICE << "  extent = " << tileExtent.width() << "x" << tileExtent.height() << std::endl;
-            //OE_NOTICE << "  tileFactor = " << tileFactor << " maxRange=" << maxRange << " radius=" << tileBound.radius() << std::endl;
-            
-
-            // Construct a tile key that will be used to query the source for this tile.            
-            // The tilekey x, y, z that is computed in the FeatureModelGraph uses a lower left origin,
-            // osgEarth tilekeys use a lower left so we need to invert it.
-            unsigned int w, h;
-            featureProfile->getProfile()->getNumTiles(lod, w, h);
-            int invertedTileY = h - tileY - 1;
-
-            TileKey key(lod, tileX, invertedTileY, featureProfile->getProfile());
-
-            geometry = buildTile( level, tileExtent, &key, readOptions );
-            result = geometry;
-        }
+        result = geometry.get();
 
         // check whether more levels exist below the current level.
         if ( (int)lod < featureProfile->getMaxLevel() )
@@ -781,13 +927,13 @@ FeatureModelGraph::load(unsigned lod, unsigned tileX, unsigned tileY,
             if ( lod+1 != ~0 )
             {
                 // only build sub-pagedlods if we are expecting subtiles at some point:
-                if ( geometry != 0L || (int)lod < featureProfile->getFirstLevel() )
+                if ( (geometry.valid() && geometry->getNumChildren() > 0) || (int)lod < featureProfile->getFirstLevel() )
                 {
                     buildSubTilePagedLODs( lod, tileX, tileY, group.get(), readOptions);
-                    group->addChild( geometry );
+                    group->addChild( geometry.get() );
                 }
 
-                result = group.release();
+                result = group.get();
             }   
         }
     }
@@ -797,32 +943,16 @@ FeatureModelGraph::load(unsigned lod, unsigned tileX, unsigned tileY,
         // This is a non-tiled data source that has NO level details. In this case, 
         // we simply want to load all features at once and make them visible at
         // maximum camera range.
-
-        FeatureLevel all( 0.0f, FLT_MAX );
-        result = buildTile( all, GeoExtent::INVALID, (const TileKey*)0L, readOptions );
+        result = geometry.get();
     }
 
     else if ( (int)lod < _lodmap.size() )
     {
         // This path computes the SG for a model graph with explicity-defined levels of
         // detail. We already calculated the LOD level map in setupPaging(). If the
-        // current LOD points to an actual FeatureLevel, we build the geometry for that
-        // level in the tile.
-
-        osg::Group* geometry = 0L;
-        const FeatureLevel* level = _lodmap[lod];
-        if ( level )
-        {
-            // There exists a real data level at this LOD. So build the geometry that will
-            // represent this tile.
-            GeoExtent tileExtent = 
-                lod > 0 ?
-                s_getTileExtent( lod, tileX, tileY, _usableFeatureExtent ) :
-                _usableFeatureExtent;
-                
-            geometry = buildTile( *level, tileExtent, (const TileKey*)0L, readOptions );
-            result = geometry;
-        }
+        // current LOD points to an actual FeatureLevel, buildTileGeometry() built
+        // the geometry for that level in the tile.
+        result = geometry.get();
 
         if ( lod < _lodmap.size()-1 )
         {
@@ -832,14 +962,14 @@ FeatureModelGraph::load(unsigned lod, unsigned tileX, unsigned tileY,
 
             buildSubTilePagedLODs( lod, tileX, tileY, group.get(), readOptions );
 
-            if ( geometry )
-                group->addChild( geometry );
+            if ( geometry.valid() )
+                group->addChild( geometry.get() );
 
-            result = group.release();
+            result = group.get();
         }
     }
 
-    if ( !result )
+    if ( !result.valid() )
     {
         // If the read resulting in nothing, create an empty group so that the read
         // (technically) succeeds and the pager won't try to load the null child
@@ -861,9 +991,9 @@ FeatureModelGraph::load(unsigned lod, unsigned tileX, unsigned tileY,
     }
 
     // Done - run the pre-merge operations.
-    runPreMergeOperations(result);
+    runPreMergeOperations(result.get());
 
-    return result;
+    return result.release();
 }
 
 
@@ -1163,7 +1293,8 @@ FeatureModelGraph::buildTile(const FeatureLevel& level,
     // Try to read it from a cache:
     std::string cacheKey = makeCacheKey(level, extent, key);
 
-    if (_options.nodeCaching() == true)
+    // (a cached tile under an edit is out of date.)
+    if (_options.nodeCaching() == true && !isEdited(extent))
     {
         group = readTileFromCache(cacheKey, readOptions);
     }
@@ -1171,6 +1302,10 @@ FeatureModelGraph::buildTile(const FeatureLevel& level,
     // Not there? Build it
     if (!group.valid())
     {
+        // The features and geometries read and filtered for this tile all
+        // come from one region, and are released together when they're done.
+        MemoryArena::Scope arena;
+
         osg::ref_ptr<ProgressCallback> progress = new ProgressCallback();
 
         // set up for feature indexing if appropriate:
@@ -1245,6 +1380,14 @@ FeatureModelGraph::buildTile(const FeatureLevel& level,
         {
             group->removeChildren(0, group->getNumChildren());
         }
+
+        // simplify the tile if it's over this level's triangle budget:
+        else if (level.maxTriangles().isSet() && level.maxTriangles().get() > 0u)
+        {
+            MeshSimplifier simplifier;
+            simplifier.setMaxTriangles( level.maxTriangles().get() );
+            simplifier.run( *group.get() );
+        }
         
         // cache it if appropriate (and not if it was canceled)
         //else if (_options.nodeCaching() == true)
@@ -1294,6 +1437,16 @@ FeatureModelGraph::buildTile(const FeatureLevel& level,
             }
         }
 
+        // install a terrain occlusion culler.
+        if ( _options.terrainOcclusionCulling() == true )
+        {
+            osg::ref_ptr<const Map> map = _session->getMap();
+            if ( map.valid() )
+            {
+                group->addCullCallback( new TerrainOcclusionCullCallback(map->getElevationPool(), map->getSRS()) );
+            }
+        }
+
         return group.release();
     }
 
@@ -1751,10 +1904,26 @@ FeatureModelGraph::traverse(osg::NodeVisitor& nv)
               _session->getFeatureSource()->outOfSyncWith(_featureSourceRev) ||
               (_modelSource.valid() && _modelSource->outOfSyncWith(_modelSourceRev))))
         {
-            OE_TEST << LC << "out of sync - requesting update" << std::endl;
+            // if only features changed, and the source logged each change,
+            // update just the tiles they touch.
+            FeatureSource::FeatureChangeList changes;
+            if (!_dirty &&
+                !(_modelSource.valid() && _modelSource->outOfSyncWith(_modelSourceRev)) &&
+                _session->getFeatureSource()->getChangesSince(_featureSourceRev, changes) &&
+                !changes.empty())
+            {
+                OE_TEST << LC << "feature changes - requesting incremental update" << std::endl;
 
-            _pendingUpdate = true;
-            ADJUST_UPDATE_TRAV_COUNT( this, +1 );
+                _featureSourceRev = Revision(changes.back()._revision);
+                _pendingChanges.insert(_pendingChanges.end(), changes.begin(), changes.end());
+            }
+            else
+            {
+                OE_TEST << LC << "out of sync - requesting update" << std::endl;
+
+                _pendingUpdate = true;
+                ADJUST_UPDATE_TRAV_COUNT( this, +1 );
+            }
         }
     }
 
@@ -1766,11 +1935,20 @@ FeatureModelGraph::traverse(osg::NodeVisitor& nv)
 
             redraw();
             _pendingUpdate = false;
+            _pendingChanges.clear();
             ADJUST_UPDATE_TRAV_COUNT( this, -1 );
         }
+
+        else if ( !_pendingChanges.empty() )
+        {
+            applyChanges( _pendingChanges );
+            _pendingChanges.clear();
+        }
+
+        mergeTileUpdates();
     }
 
-    osg::Group::traverse(nv);
+    _loader->traverse(this, nv);
 }
 
 void
@@ -1791,6 +1969,151 @@ FeatureModelGraph::runPostMergeOperations(osg::Node* node)
    }
 }
 
+struct FeatureModelGraph::TileUpdate : public osg::Referenced
+{
+    unsigned                      _lod, _tileX, _tileY;
+    std::string                   _uri;
+    osg::observer_ptr<osg::Group> _parent;
+    osg::observer_ptr<osg::Group> _oldGeometry;
+    osg::ref_ptr<osg::Group>      _newGeometry;
+};
+
+bool
+FeatureModelGraph::isEdited(const GeoExtent& extent) const
+{
+    Threading::ScopedMutexLock lock(_editsMutex);
+    for(std::vector<GeoExtent>::const_iterator i = _editedExtents.begin(); i != _editedExtents.end(); ++i)
+    {
+        if ( overlaps(*i, extent) )
+            return true;
+    }
+    return false;
+}
+
+void
+FeatureModelGraph::applyChanges(const FeatureSource::FeatureChangeList& changes)
+{
+    FindNodesVisitor<FeatureSourceIndexNode> findIndexes;
+    if ( _featureIndex.valid() )
+        this->accept( findIndexes );
+
+    std::vector<GeoExtent> rebuild;
+
+    for(FeatureSource::FeatureChangeList::const_iterator c = changes.begin(); c != changes.end(); ++c)
+    {
+        // remember the edit so tiles under it skip the cache from now on:
+        {
+            Threading::ScopedMutexLock lock(_editsMutex);
+            _editedExtents.push_back( c->_extent );
+        }
+
+        // empty tiles under the edit may not be empty anymore:
+        {
+            Threading::ScopedWriteLock exclusiveLock( _blacklistMutex );
+            for(std::set<std::string>::iterator i = _blacklist.begin(); i != _blacklist.end(); )
+            {
+                unsigned lod, x, y;
+                sscanf( i->c_str(), "%d_%d_%d.%*s", &lod, &x, &y );
+                if ( overlaps(c->_extent, getTileExtent(lod, x, y)) )
+                    _blacklist.erase( i++ );
+                else
+                    ++i;
+            }
+        }
+
+        // a deletion just hides the feature in the tiles that have it:
+        if ( c->_type == FeatureSource::FeatureChange::DELETED && _featureIndex.valid() )
+        {
+            for(unsigned i = 0; i < findIndexes._results.size(); ++i)
+                findIndexes._results[i]->hideFeature( c->_fid );
+            continue;
+        }
+
+        rebuild.push_back( c->_extent );
+    }
+
+    if ( rebuild.empty() )
+        return;
+
+    // rebuild the geometry of the loaded tiles the other edits touch; each
+    // one keeps showing until its replacement is ready.
+    FindTileGeometry findTiles;
+    this->accept( findTiles );
+
+    for(unsigned t = 0; t < findTiles._results.size(); ++t)
+    {
+        osg::Group* tile = findTiles._results[t];
+
+        osg::ref_ptr<TileUpdate> update = new TileUpdate();
+        update->_uri = tile->getName();
+        sscanf( update->_uri.c_str(), "%d_%d_%d.%*s", &update->_lod, &update->_tileX, &update->_tileY );
+
+        GeoExtent tileExtent = getTileExtent( update->_lod, update->_tileX, update->_tileY );
+
+        bool touched = false;
+        for(unsigned i = 0; i < rebuild.size() && !touched; ++i)
+            touched = overlaps( rebuild[i], tileExtent );
+
+        if ( touched )
+        {
+            update->_parent      = tile->getParent(0);
+            update->_oldGeometry = tile;
+
+            Registry::instance()->getJobScheduler()->submit(
+                new TileUpdateJob(this, update.get()),
+                JobScheduler::LANE_NORMAL,
+                _tileUpdateJobs.get());
+        }
+    }
+
+    OE_DEBUG << LC << "Applied " << changes.size() << " feature change(s)\n";
+}
+
+void
+FeatureModelGraph::runTileUpdate(TileUpdate* update)
+{
+    osg::ref_ptr<osg::Group> geometry = buildTileGeometry(
+        update->_lod, update->_tileX, update->_tileY, update->_uri,
+        _session->getDBOptions() );
+
+    if ( !geometry.valid() )
+        return;
+
+    runPreMergeOperations( geometry.get() );
+
+    update->_newGeometry = geometry.get();
+
+    Threading::ScopedMutexLock lock(_tileUpdatesMutex);
+    _tileUpdates.push_back( update );
+}
+
+void
+FeatureModelGraph::mergeTileUpdates()
+{
+    std::vector< osg::ref_ptr<TileUpdate> > updates;
+    {
+        Threading::ScopedMutexLock lock(_tileUpdatesMutex);
+        if ( _tileUpdates.empty() )
+            return;
+        updates.swap( _tileUpdates );
+    }
+
+    for(unsigned i = 0; i < updates.size(); ++i)
+    {
+        TileUpdate* update = updates[i].get();
+
+        // skip tiles that paged out while they rebuilt.
+        osg::ref_ptr<osg::Group> parent;
+        osg::ref_ptr<osg::Group> oldGeometry;
+        if ( update->_parent.lock(parent) && update->_oldGeometry.lock(oldGeometry) &&
+             parent->containsNode(oldGeometry.get()) )
+        {
+            parent->replaceChild( oldGeometry.get(), update->_newGeometry.get() );
+            runPostMergeOperations( update->_newGeometry.get() );
+        }
+    }
+}
+
 void
 FeatureModelGraph::redraw()
 {
@@ -45,6 +45,7 @@ FeatureModelOptions::FeatureModelOptions(const ConfigOptions& co) :
 _lit               ( true ),
 _maxGranularity_deg( 1.0 ),
 _clusterCulling    ( true ),
+_terrainOcclusionCulling( false ),
 _backfaceCulling   ( true ),
 _alphaBlending     ( true ),
 _sessionWideResourceCache( true ),
@@ -67,6 +68,7 @@ FeatureModelOptions::fromConfig(const Config& conf)
     conf.getIfSet( "lighting",         _lit );
     conf.getIfSet( "max_granularity",  _maxGranularity_deg );
     conf.getIfSet( "cluster_culling",  _clusterCulling );
+    conf.getIfSet( "terrain_occlusion_culling", _terrainOcclusionCulling );
     conf.getIfSet( "backface_culling", _backfaceCulling );
     conf.getIfSet( "alpha_blending",   _alphaBlending );
     conf.getIfSet( "node_caching",     _nodeCaching );
@@ -98,6 +100,7 @@ FeatureModelOptions::getConfig() const
     conf.set( "lighting",         _lit );
     conf.set( "max_granularity",  _maxGranularity_deg );
     conf.set( "cluster_culling",  _clusterCulling );
+    conf.set( "terrain_occlusion_culling", _terrainOcclusionCulling );
     conf.set( "backface_culling", _backfaceCulling );
     conf.set( "alpha_blending",   _alphaBlending );
     conf.set( "node_caching",     _nodeCaching );
@@ -131,6 +134,7 @@ FeatureModelSourceOptions::fromConfig( const Config& conf )
     conf.getIfSet( "lighting",         _lit );
     conf.getIfSet( "max_granularity",  _maxGranularity_deg );
     conf.getIfSet( "cluster_culling",  _clusterCulling );
+    conf.getIfSet( "terrain_occlusion_culling", _terrainOcclusionCulling );
     conf.getIfSet( "backface_culling", _backfaceCulling );
     conf.getIfSet( "alpha_blending",   _alphaBlending );
     conf.getIfSet( "node_caching",     _nodeCaching );
@@ -159,6 +163,7 @@ FeatureModelSourceOptions::getConfig() const
     conf.set( "lighting",         _lit );
     conf.set( "max_granularity",  _maxGranularity_deg );
     conf.set( "cluster_culling",  _clusterCulling );
+    conf.set( "terrain_occlusion_culling", _terrainOcclusionCulling );
     conf.set( "backface_culling", _backfaceCulling );
     conf.set( "alpha_blending",   _alphaBlending );
     conf.set( "node_caching",     _nodeCaching );
@@ -271,6 +276,12 @@ FeatureModelSource::createNodeImplementation(const Map*        map,
         return 0L;
     }
 
+    // the layer may have gone away while this waited to run.
+    if ( progress && progress->isCanceled() )
+    {
+        return 0L;
+    }
+
     // create a feature node factory:
     FeatureNodeFactory* factory = createFeatureNodeFactory();
     if ( !factory )
@@ -22,18 +22,23 @@
 #include <osgEarthFeatures/ConvertTypeFilter>
 #include <osgEarthFeatures/FilterContext>
 #include <osgEarth/Registry>
+#include <osgEarth/Notify>
 #include <osg/Notify>
 #include <osgDB/ReadFile>
 #include <OpenThreads/ScopedLock>
 
 #define LC "[FeatureSource] "
 
+// Edits a source remembers for consumers that haven't caught up yet.
+#define MAX_LOGGED_CHANGES 1024u
+
 using namespace osgEarth::Features;
 using namespace osgEarth::Symbology;
 using namespace OpenThreads;
 
 FeatureSourceOptions::FeatureSourceOptions(const ConfigOptions& options) :
-DriverConfigOptions( options )
+DriverConfigOptions( options ),
+_compactAttributes  ( false )
 {
     fromConfig( _conf );
 }
@@ -55,6 +60,7 @@ FeatureSourceOptions::fromConfig(const Config& conf)
     conf.getIfSet   ( "geo_interpolation", "great_circle", _geoInterp, GEOINTERP_GREAT_CIRCLE );
     conf.getIfSet   ( "geo_interpolation", "rhumb_line",   _geoInterp, GEOINTERP_RHUMB_LINE );
     conf.getIfSet   ( "fid_attribute", _fidAttribute );
+    conf.getIfSet   ( "compact_attributes", _compactAttributes );
 
     // For backwards-compatibility (before adding the "filters" block)
     // TODO: Remove at some point in the distant future.
@@ -82,6 +88,7 @@ FeatureSourceOptions::getConfig() const
     conf.updateIfSet   ( "geo_interpolation", "great_circle", _geoInterp, GEOINTERP_GREAT_CIRCLE );
     conf.updateIfSet   ( "geo_interpolation", "rhumb_line",   _geoInterp, GEOINTERP_RHUMB_LINE );
     conf.updateIfSet   ( "fid_attribute", _fidAttribute );
+    conf.updateIfSet   ( "compact_attributes", _compactAttributes );
 
     if ( !_filterOptions.empty() )
     {
@@ -99,13 +106,15 @@ FeatureSourceOptions::getConfig() const
 //------------------------------------------------------------------------
 
 
-FeatureSource::FeatureSource()
+FeatureSource::FeatureSource() :
+_attributeSchemaInit( false )
 {    
     //nop
 }
 
 FeatureSource::FeatureSource(const ConfigOptions&  options) :
-_options( options )
+_options( options ),
+_attributeSchemaInit( false )
 {
     //nop
 }
@@ -176,6 +185,22 @@ FeatureSource::getSchema() const
     return s_emptySchema;
 }
 
+const AttributeSchema*
+FeatureSource::getAttributeSchema() const
+{
+    Threading::ScopedMutexLock lock( _attributeSchemaMutex );
+    if ( !_attributeSchemaInit )
+    {
+        if ( _options.compactAttributes() == true && !getSchema().empty() )
+        {
+            _attributeSchema = new AttributeSchema( getSchema() );
+            OE_DEBUG << LC << "Interned " << _attributeSchema->size() << " attribute names" << std::endl;
+        }
+        _attributeSchemaInit = true;
+    }
+    return _attributeSchema.get();
+}
+
 void
 FeatureSource::addToBlacklist( FeatureID fid )
 {
@@ -204,6 +229,50 @@ FeatureSource::isBlacklisted( FeatureID fid ) const
     return _blacklist.find( fid ) != _blacklist.end();
 }
 
+void
+FeatureSource::notifyFeatureChanged(FeatureChange::Type type, FeatureID fid, const GeoExtent& extent)
+{
+    Threading::ScopedMutexLock lock( _changesMutex );
+
+    dirty();
+
+    FeatureChange change;
+    change._type   = type;
+    change._fid    = fid;
+    change._extent = extent;
+
+    Revision revision;
+    sync( revision );
+    change._revision = revision;
+
+    _changes.push_back( change );
+    if ( _changes.size() > MAX_LOGGED_CHANGES )
+        _changes.pop_front();
+}
+
+bool
+FeatureSource::getChangesSince(const Revision& revision, FeatureChangeList& output) const
+{
+    Threading::ScopedMutexLock lock( _changesMutex );
+
+    Revision current;
+    sync( current );
+
+    // every revision since the caller's must come from a logged change.
+    int expected = (int)revision + 1;
+    for(std::deque<FeatureChange>::const_iterator i = _changes.begin(); i != _changes.end(); ++i)
+    {
+        if ( i->_revision <= (int)revision )
+            continue;
+        if ( i->_revision != expected )
+            return false;
+        output.push_back( *i );
+        ++expected;
+    }
+
+    return expected == (int)current + 1;
+}
+
 void
 FeatureSource::applyFilters(FeatureList& features, const GeoExtent& extent) const
 {
@@ -28,28 +28,6 @@ using namespace osgEarth::Features;
 //#undef  OE_DEBUG
 //#define OE_DEBUG OE_INFO
 
-namespace
-{
-    // nifty template to iterate over a map's keys
-    template<typename T>
-    struct KeyIter : public T::iterator
-    {
-        KeyIter() : T::iterator() { }
-        KeyIter(typename T::iterator i) : T::iterator(i) { }
-        typename T::key_type* operator->() { return (typename T::key_type* const)&(T::iterator::operator->()->first); }
-        typename T::key_type operator*() { return T::iterator::operator*().first; }
-    };
-
-    template<typename T>
-    struct ConstKeyIter : public T::const_iterator
-    {
-        ConstKeyIter() : T::const_iterator() { }
-        ConstKeyIter(typename T::const_iterator i) : T::const_iterator(i) { }
-        typename T::key_type* operator->() { return (typename T::key_type* const)&(T::const_iterator::operator->()->first); }
-        typename T::key_type operator*() { return T::const_iterator::operator*().first; }
-    };
-}
-
 //-----------------------------------------------------------------------------
 
 
@@ -75,20 +53,28 @@ FeatureSourceIndexOptions::getConfig() const
 #undef  LC
 #define LC "[FeatureSourceIndexNode] "
 
-FeatureSourceIndexNode::FeatureSourceIndexNode()
+FeatureSourceIndexNode::FeatureSourceIndexNode() :
+_compact( true ),
+_added  ( false )
 {
     //nop
 }
 
 FeatureSourceIndexNode::FeatureSourceIndexNode(const FeatureSourceIndexNode& rhs, const osg::CopyOp& copy) :
-osg::Group(rhs, copy)
+osg::Group(rhs, copy),
+_compact( true ),
+_added  ( false )
 {
     _index = rhs._index.get();
-    _fids  = rhs._fids;
+    rhs.getColumns( _fids, _oids );
+    if ( _index.valid() )
+        _index->retain( _fids, _oids );
 }
 
 FeatureSourceIndexNode::FeatureSourceIndexNode(FeatureSourceIndex* index) :
-_index( index )
+_index  ( index ),
+_compact( true ),
+_added  ( false )
 {
     //nop
 }
@@ -97,61 +83,167 @@ FeatureSourceIndexNode::~FeatureSourceIndexNode()
 {
     if ( _index.valid() )
     {
-        // must copy and clear the original list first to dereference the RefIDPair instances.
-        std::set<FeatureID> fidsToRemove;
-        fidsToRemove.insert( KeyIter<FIDMap>(_fids.begin()), KeyIter<FIDMap>(_fids.end()) );
-        _fids.clear();
+        OE_DEBUG << LC << "Removing " << _fids.size() << " fids\n";
+        _index->removeTile( this, _fids );
+    }
+}
+
+bool
+FeatureSourceIndexNode::begin(FeatureID fid)
+{
+    Threading::ScopedMutexLock lock(_fidsMutex);
+
+    // tagging more after the tile compacted: bring back the lookup set.
+    if ( _tagging.empty() && !_fids.empty() )
+        _tagging.insert( _fids.begin(), _fids.end() );
+
+    return _tagging.insert( fid ).second;
+}
+
+void
+FeatureSourceIndexNode::end(FeatureID fid, ObjectID oid)
+{
+    Threading::ScopedMutexLock lock(_fidsMutex);
+    _fids.push_back( fid );
+    _oids.push_back( oid );
+    _compact = false;
+}
+
+void
+FeatureSourceIndexNode::compact() const
+{
+    if ( _compact )
+        return;
+
+    std::vector< std::pair<FeatureID, ObjectID> > pairs;
+    pairs.reserve( _fids.size() );
+    for(unsigned i = 0; i < _fids.size(); ++i)
+        pairs.push_back( std::make_pair(_fids[i], _oids[i]) );
+
+    std::sort( pairs.begin(), pairs.end() );
 
-        OE_DEBUG << LC << "Removing " << fidsToRemove.size() << " fids\n";
-        _index->removeFIDs( fidsToRemove.begin(), fidsToRemove.end() );
+    for(unsigned i = 0; i < pairs.size(); ++i)
+    {
+        _fids[i] = pairs[i].first;
+        _oids[i] = pairs[i].second;
     }
+
+    // the columns answer membership from now on.
+    std::set<FeatureID>().swap( _tagging );
+    _compact = true;
 }
 
 ObjectID
 FeatureSourceIndexNode::tagDrawable(osg::Drawable* drawable, Feature* feature)
 {
     if ( !feature || !_index.valid() ) return OSGEARTH_OBJECTID_EMPTY;
-    RefIDPair* r = _index->tagDrawable( drawable, feature );
-    if ( r ) _fids[ feature->getFID() ] = r;
-    return r ? r->_oid : OSGEARTH_OBJECTID_EMPTY;
+    bool isNew = begin( feature->getFID() );
+    ObjectID oid = _index->tagDrawable( drawable, feature, isNew );
+    if ( isNew )
+        end( feature->getFID(), oid );
+    return oid;
 }
 
 ObjectID
 FeatureSourceIndexNode::tagAllDrawables(osg::Node* node, Feature* feature)
 {
     if ( !feature || !_index.valid() ) return OSGEARTH_OBJECTID_EMPTY;
-    RefIDPair* r = _index->tagAllDrawables( node, feature );
-    if ( r ) _fids[ feature->getFID() ] = r;
-    return r ? r->_oid : OSGEARTH_OBJECTID_EMPTY;
+    bool isNew = begin( feature->getFID() );
+    ObjectID oid = _index->tagAllDrawables( node, feature, isNew );
+    if ( isNew )
+        end( feature->getFID(), oid );
+    return oid;
 }
 
 ObjectID
 FeatureSourceIndexNode::tagNode(osg::Node* node, Feature* feature)
 {
     if ( !feature || !_index.valid() ) return OSGEARTH_OBJECTID_EMPTY;
-    RefIDPair* r = _index->tagNode( node, feature );
-    if ( r ) _fids[ feature->getFID() ] = r;
-    return r ? r->_oid : OSGEARTH_OBJECTID_EMPTY;
+    bool isNew = begin( feature->getFID() );
+    ObjectID oid = _index->tagNode( node, feature, isNew );
+    if ( isNew )
+        end( feature->getFID(), oid );
+    return oid;
+}
+
+void
+FeatureSourceIndexNode::traverse(osg::NodeVisitor& nv)
+{
+    // the tile is done building once it's in a live graph; pack up the
+    // columns and make them available to picking.
+    if ( !_added && _index.valid() )
+    {
+        {
+            Threading::ScopedMutexLock lock(_fidsMutex);
+            compact();
+        }
+        _index->addTile( this );
+        _added = true;
+    }
+
+    osg::Group::traverse( nv );
 }
 
 bool
 FeatureSourceIndexNode::getAllFIDs(std::vector<FeatureID>& output) const
 {
-    ConstKeyIter<FIDMap> start( _fids.begin() );
-    ConstKeyIter<FIDMap> end  ( _fids.end() );
-    for(ConstKeyIter<FIDMap> i = start; i != end; ++i )
+    Threading::ScopedMutexLock lock(_fidsMutex);
+    compact();
+    output.insert( output.end(), _fids.begin(), _fids.end() );
+    return true;
+}
+
+bool
+FeatureSourceIndexNode::getFID(ObjectID oid, FeatureID& output) const
+{
+    Threading::ScopedMutexLock lock(_fidsMutex);
+
+    // only picking needs this, so a scan of the (contiguous) column will do.
+    std::vector<ObjectID>::const_iterator i = std::find( _oids.begin(), _oids.end(), oid );
+    if ( i == _oids.end() )
+        return false;
+
+    output = _fids[i - _oids.begin()];
+    return true;
+}
+
+bool
+FeatureSourceIndexNode::hideFeature(FeatureID fid)
+{
+    ObjectID oid;
     {
-        output.push_back( *i );
+        Threading::ScopedMutexLock lock(_fidsMutex);
+        compact();
+        std::vector<FeatureID>::const_iterator f = std::lower_bound( _fids.begin(), _fids.end(), fid );
+        if ( f == _fids.end() || *f != fid )
+            return false;
+        oid = _oids[f - _fids.begin()];
     }
 
-    return true;
+    if ( !_index.valid() || !_index->_masterIndex.valid() )
+        return false;
+
+    return _index->_masterIndex->collapse( this, oid );
+}
+
+void
+FeatureSourceIndexNode::getColumns(std::vector<FeatureID>& fids, std::vector<ObjectID>& oids) const
+{
+    Threading::ScopedMutexLock lock(_fidsMutex);
+    compact();
+    fids = _fids;
+    oids = _oids;
 }
 
 void
-FeatureSourceIndexNode::setFIDMap(const FeatureSourceIndexNode::FIDMap& fids)
+FeatureSourceIndexNode::setColumns(const std::vector<FeatureID>& fids, const std::vector<ObjectID>& oids)
 {
+    Threading::ScopedMutexLock lock(_fidsMutex);
     _fids = fids;
-    //todo
+    _oids = oids;
+    _oids.resize( _fids.size(), OSGEARTH_OBJECTID_EMPTY );
+    _compact = false;
+    compact();
 }
 
 namespace
@@ -183,15 +275,15 @@ namespace
         }
     };
 
-    /** Visitor that re-indexes objects after deserialization. */
+    /** Visitor that re-assigns the object IDs in deserialized geometry. */
     struct ReIndex : public osg::NodeVisitor
     {
-        FeatureSourceIndexNode*        _indexNode;
-        FeatureSourceIndexNode::FIDMap _newFIDMap;
+        ObjectIndex*                   _masterIndex;
+        FeatureSourceIndex*            _index;
         std::map<ObjectID,ObjectID>&   _oldToNew;
 
-        ReIndex(FeatureSourceIndexNode* indexNode, std::map<ObjectID,ObjectID>& oldToNew) :
-            _indexNode(indexNode), _oldToNew(oldToNew)
+        ReIndex(ObjectIndex* masterIndex, FeatureSourceIndex* index, std::map<ObjectID,ObjectID>& oldToNew) :
+            _masterIndex(masterIndex), _index(index), _oldToNew(oldToNew)
         {
             setTraversalMode(TRAVERSE_ALL_CHILDREN);
             setNodeMaskOverride(~0);
@@ -199,16 +291,16 @@ namespace
 
         void apply(osg::Node& node)
         {
-            _indexNode->reIndexNode(&node, _oldToNew, _newFIDMap);
+            _masterIndex->updateObjectID(&node, _oldToNew, _index);
             traverse(node);
         }
 
         void apply(osg::Geode& geode)
         {
-            _indexNode->reIndexNode(&geode, _oldToNew, _newFIDMap);
+            _masterIndex->updateObjectID(&geode, _oldToNew, _index);
             for (unsigned i = 0; i < geode.getNumDrawables(); ++i)
             {
-                _indexNode->reIndexDrawable(geode.getDrawable(i), _oldToNew, _newFIDMap);
+                _masterIndex->updateObjectIDs(geode.getDrawable(i), _oldToNew, _index);
             }
             traverse(geode);
         }
@@ -228,29 +320,37 @@ FeatureSourceIndexNode::reconstitute(osg::Node* graph, FeatureSourceIndex* index
     graph->accept(visitor);
 }
 
+// When Feature index data is deserialized, the old serialized ObjectIDs are 
+// no longer valid. This method re-installs the IDs in the master index, and
+// keeps the features whose geometry carried them under their new IDs.
 void
 FeatureSourceIndexNode::reIndex(std::map<ObjectID,ObjectID>& oidmappings)
 {
-    ReIndex visitor(this, oidmappings);
-    this->accept(visitor);
-    _fids = visitor._newFIDMap;
-    //OE_INFO << LC << "Reindexed " << _fids.size() << " mappings\n";
-}
-
-void
-FeatureSourceIndexNode::reIndexDrawable(osg::Drawable* drawable, std::map<ObjectID,ObjectID>& oldNew, FIDMap& newFIDMap)
-{
-    if ( !drawable || !_index.valid() ) return;
+    if ( !_index.valid() || !_index->_masterIndex.valid() )
+        return;
 
-    _index->update(drawable, oldNew, _fids, newFIDMap);
-}
+    ReIndex visitor(_index->_masterIndex.get(), _index.get(), oidmappings);
+    this->accept(visitor);
 
-void
-FeatureSourceIndexNode::reIndexNode(osg::Node* node, std::map<ObjectID,ObjectID>& oldNew, FIDMap& newFIDMap)
-{
-    if (!node || !_index.valid()) return;
+    std::vector<FeatureID> fids;
+    std::vector<ObjectID>  oids;
+    {
+        Threading::ScopedMutexLock lock(_fidsMutex);
+        for(unsigned i = 0; i < _fids.size(); ++i)
+        {
+            std::map<ObjectID,ObjectID>::const_iterator k = oidmappings.find( _oids[i] );
+            if ( k != oidmappings.end() )
+            {
+                fids.push_back( _fids[i] );
+                oids.push_back( k->second );
+            }
+        }
+        _fids = fids;
+        _oids = oids;
+    }
 
-    _index->update(node, oldNew, _fids, newFIDMap);
+    _index->retain( fids, oids );
+    //OE_INFO << LC << "Reindexed " << _fids.size() << " mappings\n";
 }
 
 FeatureSourceIndexNode* FeatureSourceIndexNode::get(osg::Node* graph)
@@ -268,26 +368,30 @@ FeatureSourceIndexNode* FeatureSourceIndexNode::get(osg::Node* graph)
 #include <osgDB/InputStream>
 #include <osgDB/OutputStream>
 
+
 namespace osgEarth { namespace Serializers { namespace FeatureSourceIndexNodeClass
 {
     using namespace osgEarth::Features;
 
     bool checkFIDMap(const FeatureSourceIndexNode& node)
     {
-        return !node.getFIDMap().empty();
+        std::vector<FeatureID> fids;
+        node.getAllFIDs(fids);
+        return !fids.empty();
     }
 
     bool writeFIDMap(osgDB::OutputStream& os, const FeatureSourceIndexNode& node)
     {
-        const FeatureSourceIndexNode::FIDMap& fids = node.getFIDMap();
+        std::vector<FeatureID> fids;
+        std::vector<ObjectID>  oids;
+        node.getColumns(fids, oids);
 
         os.writeSize(fids.size());
         os << os.BEGIN_BRACKET << std::endl;
         {
-            for (FeatureSourceIndexNode::FIDMap::const_iterator i = fids.begin(); i != fids.end(); ++i)
+            for (unsigned i = 0; i < fids.size(); ++i)
             {
-                const RefIDPair* idPair = i->second.get();
-                os << idPair->_fid << idPair->_oid;
+                os << fids[i] << oids[i];
             }
         }
         os << os.END_BRACKET << std::endl;
@@ -297,21 +401,25 @@ namespace osgEarth { namespace Serializers { namespace FeatureSourceIndexNodeCla
 
     bool readFIDMap(osgDB::InputStream& is, FeatureSourceIndexNode& node)
     {
-        FeatureSourceIndexNode::FIDMap fids;
+        std::vector<FeatureID> fids;
+        std::vector<ObjectID>  oids;
         FeatureID fid;
         ObjectID oid;
 
         unsigned size = is.readSize();
+        fids.reserve(size);
+        oids.reserve(size);
         is >> is.BEGIN_BRACKET;
         {
             for (unsigned i=0; i<size; ++i)
             {
                 is >> fid >> oid;
-                fids[fid] = new RefIDPair(fid, oid);
+                fids.push_back(fid);
+                oids.push_back(oid);
             }
         }
         is >> is.END_BRACKET;
-        node.setFIDMap(fids);
+        node.setColumns(fids, oids);
 
         return true;
     }
@@ -347,117 +455,135 @@ _options        ( options )
 
 FeatureSourceIndex::~FeatureSourceIndex()
 {
-    if ( _masterIndex.valid() && !_oids.empty() )
+    if ( _masterIndex.valid() )
     {
         // remove all OIDs from the master index.
-        _masterIndex->remove( KeyIter<OIDMap>(_oids.begin()), KeyIter<OIDMap>(_oids.end()) );
+        for(FIDMap::const_iterator i = _fids.begin(); i != _fids.end(); ++i)
+            _masterIndex->remove( i->second._oid );
     }
 
-    _oids.clear();
     _fids.clear();
     _embeddedFeatures.clear();
+    _tiles.clear();
 }
 
-RefIDPair*
-FeatureSourceIndex::tagDrawable(osg::Drawable* drawable, Feature* feature)
+int
+FeatureSourceIndex::size() const
 {
-    if ( !feature ) return 0L;
-
     Threading::ScopedMutexLock lock(_mutex);
-    
-    RefIDPair* p = 0L;
+    return _fids.size();
+}
+
+ObjectID
+FeatureSourceIndex::getOrCreateObjectID(Feature* feature, bool newInTile)
+{
     FeatureID fid = feature->getFID();
 
-    FIDMap::const_iterator f = _fids.find( fid );
-    if ( f != _fids.end() )
-    {
-        ObjectID oid = f->second->_oid;
-        _masterIndex->tagDrawable( drawable, oid );
-        p = f->second.get();
-    }
-    else
+    FIDMap::iterator f = _fids.find( fid );
+    if ( f == _fids.end() )
     {
-        ObjectID oid = _masterIndex->tagDrawable( drawable, this );
-        p = new RefIDPair( fid, oid );
-        _fids[fid] = p;
-        _oids[oid] = fid;
-    
+        Entry entry;
+        entry._oid   = _masterIndex->insert( this );
+        entry._tiles = 0u;
+        f = _fids.insert( std::make_pair(fid, entry) ).first;
+
         if ( _embed )
         {
             _embeddedFeatures[fid] = feature;
         }
     }
 
-    return p;
+    if ( newInTile )
+        ++f->second._tiles;
+
+    return f->second._oid;
 }
 
-RefIDPair*
-FeatureSourceIndex::tagAllDrawables(osg::Node* node, Feature* feature)
+ObjectID
+FeatureSourceIndex::tagDrawable(osg::Drawable* drawable, Feature* feature, bool newInTile)
 {
-    if ( !feature ) return 0L;
+    if ( !feature ) return OSGEARTH_OBJECTID_EMPTY;
 
     Threading::ScopedMutexLock lock(_mutex);
-    
-    RefIDPair* p = 0L;
-    FeatureID fid = feature->getFID();
+    ObjectID oid = getOrCreateObjectID( feature, newInTile );
+    _masterIndex->tagDrawable( drawable, oid );
+    return oid;
+}
 
-    FIDMap::const_iterator f = _fids.find( fid );
-    if ( f != _fids.end() )
-    {
-        ObjectID oid = f->second->_oid;
-        _masterIndex->tagAllDrawables( node, oid );
-        p = f->second.get();
-    }
-    else
+ObjectID
+FeatureSourceIndex::tagAllDrawables(osg::Node* node, Feature* feature, bool newInTile)
+{
+    if ( !feature ) return OSGEARTH_OBJECTID_EMPTY;
+
+    Threading::ScopedMutexLock lock(_mutex);
+    ObjectID oid = getOrCreateObjectID( feature, newInTile );
+    _masterIndex->tagAllDrawables( node, oid );
+    return oid;
+}
+
+ObjectID
+FeatureSourceIndex::tagNode(osg::Node* node, Feature* feature, bool newInTile)
+{
+    if ( !feature ) return OSGEARTH_OBJECTID_EMPTY;
+
+    Threading::ScopedMutexLock lock(_mutex);
+    ObjectID oid = getOrCreateObjectID( feature, newInTile );
+    _masterIndex->tagNode( node, oid );
+
+    OE_DEBUG << LC << "Tagging feature ID = " << feature->getFID() << " => " << oid << " (" << feature->getString("name") << ")\n";
+
+    return oid;
+}
+
+void
+FeatureSourceIndex::retain(const std::vector<FeatureID>& fids, const std::vector<ObjectID>& oids)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    for(unsigned i = 0; i < fids.size() && i < oids.size(); ++i)
     {
-        ObjectID oid = _masterIndex->tagAllDrawables( node, this );
-        p = new RefIDPair( fid, oid );
-        _fids[fid] = p;
-        _oids[oid] = fid;
-    
-        if ( _embed )
+        FIDMap::iterator f = _fids.find( fids[i] );
+        if ( f == _fids.end() )
         {
-            _embeddedFeatures[fid] = feature;
+            Entry entry;
+            entry._oid   = oids[i];
+            entry._tiles = 0u;
+            f = _fids.insert( std::make_pair(fids[i], entry) ).first;
         }
+        ++f->second._tiles;
     }
-
-    return p;
 }
 
-RefIDPair*
-FeatureSourceIndex::tagNode(osg::Node* node, Feature* feature)
+void
+FeatureSourceIndex::addTile(FeatureSourceIndexNode* tile)
 {
-    if ( !feature ) return 0L;
+    Threading::ScopedMutexLock lock(_mutex);
+    _tiles.insert( tile );
+}
 
+void
+FeatureSourceIndex::removeTile(FeatureSourceIndexNode* tile, const std::vector<FeatureID>& fids)
+{
     Threading::ScopedMutexLock lock(_mutex);
-    
-    RefIDPair* p = 0L;
-    FeatureID fid = feature->getFID();
-    ObjectID oid;
 
-    FIDMap::const_iterator f = _fids.find( fid );
-    if ( f != _fids.end() )
-    {
-        oid = f->second->_oid;
-        _masterIndex->tagNode( node, oid );
-        p = f->second.get();
-    }
-    else
+    _tiles.erase( tile );
+
+    for(std::vector<FeatureID>::const_iterator fid = fids.begin(); fid != fids.end(); ++fid)
     {
-        oid = _masterIndex->tagNode( node, this );
-        p = new RefIDPair( fid, oid );
-        _fids[fid] = p;
-        _oids[oid] = fid;
-    
-        if ( _embed )
+        FIDMap::iterator f = _fids.find( *fid );
+        if ( f == _fids.end() )
+            continue;
+
+        if ( f->second._tiles > 0u )
+            --f->second._tiles;
+
+        if ( f->second._tiles == 0u )
         {
-            _embeddedFeatures[fid] = feature;
+            if ( _masterIndex.valid() )
+                _masterIndex->remove( f->second._oid );
+            _embeddedFeatures.erase( *fid );
+            _fids.erase( f );
         }
     }
-
-    OE_DEBUG << LC << "Tagging feature ID = " << fid << " => " << oid << " (" << feature->getString("name") << ")\n";
-
-    return p;
 }
 
 Feature*
@@ -465,11 +591,16 @@ FeatureSourceIndex::getFeature(ObjectID oid) const
 {
     Feature* feature = 0L;
     Threading::ScopedMutexLock lock(_mutex);
-    OIDMap::const_iterator i = _oids.find( oid );
-    if ( i != _oids.end() )
+
+    FeatureID fid;
+    bool found = false;
+    for(std::set<FeatureSourceIndexNode*>::const_iterator t = _tiles.begin(); t != _tiles.end() && !found; ++t)
     {
-        FeatureID fid = i->second;
+        found = (*t)->getFID( oid, fid );
+    }
 
+    if ( found )
+    {
         if ( _embed )
         {
             FeatureMap::const_iterator j = _embeddedFeatures.find( fid );
@@ -489,67 +620,7 @@ FeatureSourceIndex::getObjectID(FeatureID fid) const
     Threading::ScopedMutexLock lock(_mutex);
     FIDMap::const_iterator i = _fids.find(fid);
     if ( i != _fids.end() )
-        return i->second->_oid;
+        return i->second._oid;
     else
         return OSGEARTH_OBJECTID_EMPTY;
 }
-
-// When Feature index data is deserialized, the old serialized ObjectIDs are 
-// no longer valid. This method will re-install the mappings in the master index
-// and write new local mappings with new ObjectIDs.
-void
-FeatureSourceIndex::update(osg::Drawable* drawable, std::map<ObjectID,ObjectID>& oldToNew, const FIDMap& oldFIDMap, FIDMap& newFIDMap)
-{
-    unsigned count = 0;
-    if (_masterIndex->updateObjectIDs(drawable, oldToNew, this))
-    {
-        for (std::map<ObjectID, ObjectID>::const_iterator i = oldToNew.begin(); i != oldToNew.end(); ++i)
-        {
-            const ObjectID& oldoid = i->first;
-            const ObjectID& newoid = i->second;
-
-            for (FIDMap::const_iterator j = oldFIDMap.begin(); j != oldFIDMap.end(); ++j)
-            {
-                const RefIDPair* rip = j->second.get();
-                if (rip && rip->_oid == oldoid)
-                {
-                    RefIDPair* newrip = new RefIDPair(rip->_fid, newoid);
-                    _oids[newoid] = rip->_fid;
-                    _fids[rip->_fid] = newrip;
-                    newFIDMap[rip->_fid] = newrip;
-                    ++count;
-                }
-            }
-        }
-    }
-}
-
-// When Feature index data is deserialized, the old serialized ObjectIDs are 
-// no longer valid. This method will re-install the mappings in the master index
-// and write new local mappings with new ObjectIDs.
-void
-FeatureSourceIndex::update(osg::Node* node, std::map<ObjectID,ObjectID>& oldToNew, const FIDMap& oldFIDMap, FIDMap& newFIDMap)
-{
-    unsigned count = 0;
-    if (_masterIndex->updateObjectID(node, oldToNew, this))
-    {
-        for (std::map<ObjectID, ObjectID>::const_iterator i = oldToNew.begin(); i != oldToNew.end(); ++i)
-        {
-            const ObjectID& oldoid = i->first;
-            const ObjectID& newoid = i->second;
-
-            for (FIDMap::const_iterator j = oldFIDMap.begin(); j != oldFIDMap.end(); ++j)
-            {
-                const RefIDPair* rip = j->second.get();
-                if (rip && rip->_oid == oldoid)
-                {
-                    RefIDPair* newrip = new RefIDPair(rip->_fid, newoid);
-                    _oids[newoid] = rip->_fid;
-                    _fids[rip->_fid] = newrip;
-                    newFIDMap[rip->_fid] = newrip;
-                    ++count;
-                }
-            }
-        }
-    }
-}
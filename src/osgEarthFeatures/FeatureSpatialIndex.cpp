@@ -0,0 +1,250 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2008-2014 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarthFeatures/FeatureSpatialIndex>
+#include <osgEarth/Notify>
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+#define LC "[FeatureSpatialIndex] "
+
+using namespace osgEarth;
+using namespace osgEarth::Features;
+
+// Features that span more cells than this go in a separate list that
+// every query checks, so one huge feature doesn't flood the grid.
+#define MAX_CELLS_PER_FEATURE 256
+
+// Target number of features per cell when build() picks a cell size.
+#define FEATURES_PER_CELL 4.0
+
+namespace
+{
+    bool intersects2d(const Bounds& a, const Bounds& b)
+    {
+        return
+            a.xMin() <= b.xMax() && a.xMax() >= b.xMin() &&
+            a.yMin() <= b.yMax() && a.yMax() >= b.yMin();
+    }
+}
+
+FeatureSpatialIndex::FeatureSpatialIndex(double cellSize) :
+_cellSize( cellSize )
+{
+    //nop
+}
+
+void
+FeatureSpatialIndex::clear()
+{
+    _cells.clear();
+    _entries.clear();
+    _oversized.clear();
+}
+
+void
+FeatureSpatialIndex::build(const FeatureList& features)
+{
+    clear();
+
+    Bounds extent;
+    unsigned count = 0u;
+    for(FeatureList::const_iterator i = features.begin(); i != features.end(); ++i)
+    {
+        Geometry* geom = i->get()->getGeometry();
+        if ( geom )
+        {
+            extent.expandBy( geom->getBounds() );
+            ++count;
+        }
+    }
+
+    if ( count > 0u && extent.isValid() )
+    {
+        double area = extent.area2d();
+        if ( area > 0.0 )
+            _cellSize = sqrt( area * FEATURES_PER_CELL / (double)count );
+        else
+            _cellSize = osg::maximum(extent.width(), extent.height()) * FEATURES_PER_CELL / (double)count;
+    }
+
+    if ( _cellSize <= 0.0 )
+        _cellSize = 1.0;
+
+    for(FeatureList::const_iterator i = features.begin(); i != features.end(); ++i)
+    {
+        insert( i->get() );
+    }
+
+    OE_DEBUG << LC << "Indexed " << _entries.size() << " features, cell size = " << _cellSize
+        << ", oversized = " << _oversized.size() << std::endl;
+}
+
+FeatureSpatialIndex::Cell
+FeatureSpatialIndex::toCell(double x, double y) const
+{
+    double cx = floor(x / _cellSize);
+    double cy = floor(y / _cellSize);
+    return Cell(
+        (int)osg::clampBetween(cx, (double)INT_MIN, (double)INT_MAX),
+        (int)osg::clampBetween(cy, (double)INT_MIN, (double)INT_MAX) );
+}
+
+void
+FeatureSpatialIndex::insert(Feature* feature)
+{
+    if ( !feature || !feature->getGeometry() )
+        return;
+
+    if ( _cellSize <= 0.0 )
+        _cellSize = 1.0;
+
+    // re-inserting replaces the old entry
+    remove( feature );
+
+    Entry entry;
+    entry._feature = feature;
+    entry._bounds  = feature->getGeometry()->getBounds();
+    if ( !entry._bounds.isValid() )
+        return;
+
+    entry._min = toCell( entry._bounds.xMin(), entry._bounds.yMin() );
+    entry._max = toCell( entry._bounds.xMax(), entry._bounds.yMax() );
+
+    double numCells =
+        ((double)entry._max.first  - (double)entry._min.first  + 1.0) *
+        ((double)entry._max.second - (double)entry._min.second + 1.0);
+
+    entry._oversized = numCells > (double)MAX_CELLS_PER_FEATURE;
+
+    if ( entry._oversized )
+    {
+        _oversized.push_back( feature );
+    }
+    else
+    {
+        for(int x = entry._min.first; x <= entry._max.first; ++x)
+            for(int y = entry._min.second; y <= entry._max.second; ++y)
+                _cells[Cell(x, y)].push_back( feature );
+    }
+
+    _entries[feature] = entry;
+}
+
+void
+FeatureSpatialIndex::erase(FeatureVector& v, Feature* feature)
+{
+    FeatureVector::iterator i = std::find(v.begin(), v.end(), feature);
+    if ( i != v.end() )
+    {
+        // order within a cell doesn't matter
+        *i = v.back();
+        v.pop_back();
+    }
+}
+
+bool
+FeatureSpatialIndex::remove(Feature* feature)
+{
+    EntryMap::iterator e = _entries.find( feature );
+    if ( e == _entries.end() )
+        return false;
+
+    const Entry& entry = e->second;
+    if ( entry._oversized )
+    {
+        erase( _oversized, feature );
+    }
+    else
+    {
+        for(int x = entry._min.first; x <= entry._max.first; ++x)
+        {
+            for(int y = entry._min.second; y <= entry._max.second; ++y)
+            {
+                CellMap::iterator c = _cells.find( Cell(x, y) );
+                if ( c != _cells.end() )
+                {
+                    erase( c->second, feature );
+                    if ( c->second.empty() )
+                        _cells.erase( c );
+                }
+            }
+        }
+    }
+
+    _entries.erase( e );
+    return true;
+}
+
+void
+FeatureSpatialIndex::query(const Bounds& bounds, FeatureList& output) const
+{
+    if ( !bounds.isValid() || _entries.empty() )
+        return;
+
+    Cell qmin = toCell( bounds.xMin(), bounds.yMin() );
+    Cell qmax = toCell( bounds.xMax(), bounds.yMax() );
+
+    double numCells =
+        ((double)qmax.first  - (double)qmin.first  + 1.0) *
+        ((double)qmax.second - (double)qmin.second + 1.0);
+
+    if ( numCells > (double)_cells.size() )
+    {
+        // The query touches more cells than are occupied, so walking the
+        // entries is cheaper than walking the query range.
+        for(EntryMap::const_iterator e = _entries.begin(); e != _entries.end(); ++e)
+        {
+            if ( !e->second._oversized && intersects2d(bounds, e->second._bounds) )
+                output.push_back( e->first );
+        }
+    }
+    else
+    {
+        for(int x = qmin.first; x <= qmax.first; ++x)
+        {
+            for(int y = qmin.second; y <= qmax.second; ++y)
+            {
+                CellMap::const_iterator c = _cells.find( Cell(x, y) );
+                if ( c == _cells.end() )
+                    continue;
+
+                for(FeatureVector::const_iterator f = c->second.begin(); f != c->second.end(); ++f)
+                {
+                    const Entry& entry = _entries.find( *f )->second;
+
+                    // A feature lives in every cell it overlaps; only report it from
+                    // the first overlapping cell inside the query range.
+                    if ( x != osg::maximum(qmin.first,  entry._min.first) ||
+                         y != osg::maximum(qmin.second, entry._min.second) )
+                        continue;
+
+                    if ( intersects2d(bounds, entry._bounds) )
+                        output.push_back( *f );
+                }
+            }
+        }
+    }
+
+    for(FeatureVector::const_iterator f = _oversized.begin(); f != _oversized.end(); ++f)
+    {
+        if ( intersects2d(bounds, _entries.find(*f)->second._bounds) )
+            output.push_back( *f );
+    }
+}
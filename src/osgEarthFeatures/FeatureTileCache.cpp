@@ -0,0 +1,434 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2008-2014 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarthFeatures/FeatureTileCache>
+#include <osgEarth/IOTypes>
+#include <osgEarth/Notify>
+#include <cstring>
+
+#define LC "[FeatureTileCache] "
+
+using namespace osgEarth;
+using namespace osgEarth::Features;
+
+#define FEATURE_CACHE_MAGIC   "OEFC"
+#define FEATURE_CACHE_VERSION 1u
+
+// Written in native byte order; a record from a host with a different
+// byte order is treated as a cache miss.
+#define FEATURE_CACHE_BOM     0x01020304u
+
+namespace
+{
+    struct Writer
+    {
+        std::string& _out;
+        Writer(std::string& out) : _out(out) { }
+
+        template<typename T> void put(const T& value) {
+            _out.append( reinterpret_cast<const char*>(&value), sizeof(T) );
+        }
+
+        void putString(const std::string& value) {
+            put<unsigned>( value.size() );
+            _out.append( value );
+        }
+    };
+
+    struct Reader
+    {
+        const std::string& _in;
+        std::string::size_type _pos;
+        bool _ok;
+        Reader(const std::string& in, std::string::size_type pos =0) : _in(in), _pos(pos), _ok(true) { }
+
+        template<typename T> T get() {
+            T value = T();
+            if ( _ok && _pos + sizeof(T) <= _in.size() ) {
+                ::memcpy( &value, _in.data() + _pos, sizeof(T) );
+                _pos += sizeof(T);
+            }
+            else _ok = false;
+            return value;
+        }
+
+        std::string getString() {
+            unsigned len = get<unsigned>();
+            if ( _ok && _pos + len <= _in.size() ) {
+                std::string value = _in.substr( _pos, len );
+                _pos += len;
+                return value;
+            }
+            _ok = false;
+            return std::string();
+        }
+    };
+
+    void writeGeometry(Writer& w, const Geometry* geom)
+    {
+        w.put<unsigned char>( (unsigned char)geom->getType() );
+
+        if ( geom->getType() == Geometry::TYPE_MULTI )
+        {
+            const GeometryCollection& parts = static_cast<const MultiGeometry*>(geom)->getComponents();
+            w.put<unsigned>( parts.size() );
+            for( GeometryCollection::const_iterator i = parts.begin(); i != parts.end(); ++i )
+                writeGeometry( w, i->get() );
+            return;
+        }
+
+        // Points are stored as single-precision offsets from the first point,
+        // which is plenty for the extent of a single feature.
+        osg::Vec3d origin = geom->empty() ? osg::Vec3d() : geom->front();
+        w.put<double>( origin.x() );
+        w.put<double>( origin.y() );
+        w.put<double>( origin.z() );
+        w.put<unsigned>( geom->size() );
+        for( Geometry::const_iterator i = geom->begin(); i != geom->end(); ++i )
+        {
+            osg::Vec3f offset( *i - origin );
+            w.put<float>( offset.x() );
+            w.put<float>( offset.y() );
+            w.put<float>( offset.z() );
+        }
+
+        if ( geom->getType() == Geometry::TYPE_POLYGON )
+        {
+            const RingCollection& holes = static_cast<const Symbology::Polygon*>(geom)->getHoles();
+            w.put<unsigned>( holes.size() );
+            for( RingCollection::const_iterator i = holes.begin(); i != holes.end(); ++i )
+                writeGeometry( w, i->get() );
+        }
+    }
+
+    Geometry* readGeometry(Reader& r)
+    {
+        Geometry::Type type = (Geometry::Type)r.get<unsigned char>();
+        if ( !r._ok )
+            return 0L;
+
+        if ( type == Geometry::TYPE_MULTI )
+        {
+            osg::ref_ptr<MultiGeometry> multi = new MultiGeometry();
+            unsigned numParts = r.get<unsigned>();
+            for( unsigned i=0; i<numParts && r._ok; ++i )
+            {
+                Geometry* part = readGeometry( r );
+                if ( part )
+                    multi->add( part );
+            }
+            return r._ok ? multi.release() : 0L;
+        }
+
+        osg::ref_ptr<Geometry> geom;
+        switch( type )
+        {
+        case Geometry::TYPE_POINTSET:   geom = new PointSet();   break;
+        case Geometry::TYPE_LINESTRING: geom = new LineString(); break;
+        case Geometry::TYPE_RING:       geom = new Ring();       break;
+        case Geometry::TYPE_POLYGON:    geom = new Symbology::Polygon(); break;
+        default:
+            r._ok = false;
+            return 0L;
+        }
+
+        osg::Vec3d origin;
+        origin.x() = r.get<double>();
+        origin.y() = r.get<double>();
+        origin.z() = r.get<double>();
+        unsigned numPoints = r.get<unsigned>();
+        if ( !r._ok || numPoints > (r._in.size() - r._pos) / (3*sizeof(float)) )
+        {
+            r._ok = false;
+            return 0L;
+        }
+
+        geom->reserve( numPoints );
+        for( unsigned i=0; i<numPoints; ++i )
+        {
+            float x = r.get<float>(), y = r.get<float>(), z = r.get<float>();
+            geom->push_back( origin + osg::Vec3d(x, y, z) );
+        }
+
+        if ( type == Geometry::TYPE_POLYGON )
+        {
+            Symbology::Polygon* poly = static_cast<Symbology::Polygon*>(geom.get());
+            unsigned numHoles = r.get<unsigned>();
+            for( unsigned i=0; i<numHoles && r._ok; ++i )
+            {
+                osg::ref_ptr<Geometry> hole = readGeometry( r );
+                Ring* ring = dynamic_cast<Ring*>( hole.get() );
+                if ( ring )
+                    poly->getHoles().push_back( ring );
+            }
+        }
+
+        return r._ok ? geom.release() : 0L;
+    }
+
+    void writeFeature(Writer& w, const Feature* feature)
+    {
+        w.put<unsigned long long>( feature->getFID() );
+
+        const Geometry* geom = feature->getGeometry();
+        w.put<unsigned char>( geom ? 1 : 0 );
+        if ( geom )
+            writeGeometry( w, geom );
+
+        unsigned char interp =
+            !feature->geoInterp().isSet() ? 0 :
+            feature->geoInterp() == GEOINTERP_GREAT_CIRCLE ? 1 : 2;
+        w.put<unsigned char>( interp );
+
+        const AttributeTable& attrs = feature->getAttrs();
+        w.put<unsigned>( attrs.size() );
+        for( AttributeTable::const_iterator a = attrs.begin(); a != attrs.end(); ++a )
+        {
+            const AttributeValue& value = a->second;
+            w.putString( a->first );
+            w.put<unsigned char>( (unsigned char)value.first );
+            w.put<unsigned char>( value.second.set ? 1 : 0 );
+            switch( value.first )
+            {
+            case ATTRTYPE_INT:    w.put<int>( value.second.intValue ); break;
+            case ATTRTYPE_DOUBLE: w.put<double>( value.second.doubleValue ); break;
+            case ATTRTYPE_BOOL:   w.put<unsigned char>( value.second.boolValue ? 1 : 0 ); break;
+            default:              w.putString( value.second.stringValue ); break;
+            }
+        }
+    }
+
+    Feature* readFeature(Reader& r, const SpatialReference* srs)
+    {
+        FeatureID fid = (FeatureID)r.get<unsigned long long>();
+
+        osg::ref_ptr<Geometry> geom;
+        if ( r.get<unsigned char>() != 0 )
+        {
+            geom = readGeometry( r );
+            if ( !geom.valid() )
+                return 0L;
+        }
+
+        osg::ref_ptr<Feature> feature = new Feature( geom.get(), srs, Style(), fid );
+
+        unsigned char interp = r.get<unsigned char>();
+        if ( interp == 1 )
+            feature->geoInterp() = GEOINTERP_GREAT_CIRCLE;
+        else if ( interp == 2 )
+            feature->geoInterp() = GEOINTERP_RHUMB_LINE;
+
+        unsigned numAttrs = r.get<unsigned>();
+        for( unsigned i=0; i<numAttrs && r._ok; ++i )
+        {
+            std::string name = r.getString();
+            AttributeType type = (AttributeType)r.get<unsigned char>();
+            bool set = r.get<unsigned char>() != 0;
+
+            AttributeValue value;
+            value.first = type;
+            value.second.set = set;
+            switch( type )
+            {
+            case ATTRTYPE_INT:    value.second.intValue    = r.get<int>(); break;
+            case ATTRTYPE_DOUBLE: value.second.doubleValue = r.get<double>(); break;
+            case ATTRTYPE_BOOL:   value.second.boolValue   = r.get<unsigned char>() != 0; break;
+            default:              value.second.stringValue = r.getString(); break;
+            }
+
+            if ( r._ok )
+                feature->set( name, value );
+        }
+
+        return r._ok ? feature.release() : 0L;
+    }
+
+    bool intersects2d(const Bounds& a, const Bounds& b)
+    {
+        return
+            a.xMin() <= b.xMax() && a.xMax() >= b.xMin() &&
+            a.yMin() <= b.yMax() && a.yMax() >= b.yMin();
+    }
+}
+
+//------------------------------------------------------------------------
+
+FeatureTileCache::FeatureTileCache(const osgDB::Options* readOptions)
+{
+    CacheSettings* settings = CacheSettings::get( readOptions );
+    if ( settings && settings->isCacheEnabled() )
+    {
+        _policy = settings->cachePolicy();
+        _bin = settings->getCacheBin();
+    }
+}
+
+bool
+FeatureTileCache::read(const std::string& key, FeatureList& output, const Bounds* bounds) const
+{
+    if ( !_bin.valid() || !_policy->isCacheReadable() )
+        return false;
+
+    ReadResult r = _bin->readString( key, 0L );
+    if ( !r.succeeded() )
+        return false;
+
+    if ( _policy->isExpired(r.lastModifiedTime()) )
+    {
+        OE_DEBUG << LC << "Expired record for " << key << std::endl;
+        return false;
+    }
+
+    if ( !decode(r.getString(), output, bounds) )
+    {
+        OE_WARN << LC << "Bad record for " << key << "; ignoring" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool
+FeatureTileCache::write(const std::string& key, const FeatureList& features) const
+{
+    if ( !_bin.valid() || !_policy->isCacheWriteable() )
+        return false;
+
+    std::string buffer;
+    if ( !encode(features, buffer) )
+        return false;
+
+    osg::ref_ptr<StringObject> object = new StringObject( buffer );
+    return _bin->write( key, object.get(), Config(), 0L );
+}
+
+bool
+FeatureTileCache::encode(const FeatureList& features, std::string& output)
+{
+    // All features must share an SRS and carry no embedded style.
+    const SpatialReference* srs = 0L;
+    for( FeatureList::const_iterator i = features.begin(); i != features.end(); ++i )
+    {
+        const Feature* feature = i->get();
+        if ( feature->style().isSet() )
+            return false;
+
+        if ( i == features.begin() )
+            srs = feature->getSRS();
+        else if ( srs != feature->getSRS() && (!srs || !srs->isEquivalentTo(feature->getSRS())) )
+            return false;
+    }
+
+    // Encode the features first so we know where each one starts.
+    std::string body;
+    std::vector<std::string::size_type> offsets;
+    std::vector<Bounds> bounds;
+    Writer bw( body );
+    for( FeatureList::const_iterator i = features.begin(); i != features.end(); ++i )
+    {
+        offsets.push_back( body.size() );
+        const Geometry* geom = i->get()->getGeometry();
+        bounds.push_back( geom ? geom->getBounds() : Bounds() );
+        writeFeature( bw, i->get() );
+    }
+
+    output.clear();
+    output.reserve( body.size() + features.size()*(4*sizeof(double)+sizeof(unsigned)) + 256 );
+
+    Writer w( output );
+    output.append( FEATURE_CACHE_MAGIC, 4 );
+    w.put<unsigned>( FEATURE_CACHE_VERSION );
+    w.put<unsigned>( FEATURE_CACHE_BOM );
+    w.putString( srs ? srs->getHorizInitString() : "" );
+    w.putString( srs ? srs->getVertInitString() : "" );
+
+    // Index: bounds and body offset of each feature.
+    w.put<unsigned>( offsets.size() );
+    for( unsigned i=0; i<offsets.size(); ++i )
+    {
+        w.put<unsigned char>( bounds[i].isValid() ? 1 : 0 );
+        w.put<double>( bounds[i].xMin() );
+        w.put<double>( bounds[i].yMin() );
+        w.put<double>( bounds[i].xMax() );
+        w.put<double>( bounds[i].yMax() );
+        w.put<unsigned>( offsets[i] );
+    }
+
+    output.append( body );
+    return true;
+}
+
+bool
+FeatureTileCache::decode(const std::string& input, FeatureList& output, const Bounds* bounds)
+{
+    if ( input.size() < 4 || input.compare(0, 4, FEATURE_CACHE_MAGIC) != 0 )
+        return false;
+
+    Reader r( input, 4 );
+    if ( r.get<unsigned>() != FEATURE_CACHE_VERSION || r.get<unsigned>() != FEATURE_CACHE_BOM )
+        return false;
+
+    std::string horiz = r.getString();
+    std::string vert  = r.getString();
+    if ( !r._ok )
+        return false;
+
+    osg::ref_ptr<const SpatialReference> srs;
+    if ( !horiz.empty() )
+    {
+        srs = SpatialReference::get( horiz, vert );
+        if ( !srs.valid() )
+            return false;
+    }
+
+    // Read the index and pick out the features we want.
+    unsigned count = r.get<unsigned>();
+    const std::string::size_type entrySize = 1 + 4*sizeof(double) + sizeof(unsigned);
+    if ( !r._ok || count > (input.size() - r._pos) / entrySize )
+        return false;
+
+    std::vector<unsigned> wanted;
+    wanted.reserve( count );
+    for( unsigned i=0; i<count; ++i )
+    {
+        bool valid = r.get<unsigned char>() != 0;
+        double xmin = r.get<double>(), ymin = r.get<double>();
+        double xmax = r.get<double>(), ymax = r.get<double>();
+        unsigned offset = r.get<unsigned>();
+
+        if ( !bounds || (valid && intersects2d(*bounds, Bounds(xmin, ymin, xmax, ymax))) )
+            wanted.push_back( offset );
+    }
+    if ( !r._ok )
+        return false;
+
+    const std::string::size_type bodyStart = r._pos;
+
+    FeatureList results;
+    for( unsigned i=0; i<wanted.size(); ++i )
+    {
+        Reader fr( input, bodyStart + wanted[i] );
+        Feature* feature = readFeature( fr, srs.get() );
+        if ( !feature )
+            return false;
+        results.push_back( feature );
+    }
+
+    output.insert( output.end(), results.begin(), results.end() );
+    return true;
+}
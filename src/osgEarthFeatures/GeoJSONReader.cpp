@@ -0,0 +1,891 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2008-2014 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include <osgEarthFeatures/GeoJSONReader>
+#include <osgEarth/StringUtils>
+#include <climits>
+#include <cstdlib>
+#include <vector>
+
+using namespace osgEarth;
+using namespace osgEarth::Features;
+using namespace osgEarth::Symbology;
+
+#define LC "[GeoJSONReader] "
+
+// A "coordinates" array, before we know which geometry type it belongs to.
+// Each level is either a list of positions or a list of deeper levels.
+struct GeoJSONReader::Coords
+{
+    std::vector<osg::Vec3d> _points;
+    std::vector<Coords>     _parts;
+};
+
+// The members of a JSON object that matter for GeoJSON, collected as they
+// stream by (they can come in any order).
+struct GeoJSONReader::Object
+{
+    std::string                                  _type;
+    Coords                                       _coords;
+    osg::Vec3d                                   _position;
+    bool                                         _isPosition;
+    std::vector< osg::ref_ptr<Geometry> >        _geometries;
+    osg::ref_ptr<Geometry>                       _geometry;
+    osg::ref_ptr<Feature>                        _feature;
+    bool                                         _hasFID;
+    FeatureID                                    _fid;
+
+    Object() : _isPosition(false), _hasFID(false), _fid(0) { }
+};
+
+namespace
+{
+    // Appends a point, skipping consecutive duplicates (like OgrUtils::populate)
+    void addPoint(Geometry* geom, const osg::Vec3d& p)
+    {
+        if ( geom->size() == 0 || p != geom->back() )
+            geom->push_back( p );
+    }
+
+    void addPoints(Geometry* geom, const std::vector<osg::Vec3d>& points)
+    {
+        geom->reserve( points.size() );
+        for (unsigned i = 0; i < points.size(); ++i)
+            addPoint( geom, points[i] );
+    }
+
+    Polygon* createPolygon(const std::vector<osg::Vec3d>* rings, unsigned numRings)
+    {
+        if ( numRings == 0 )
+            return 0L;
+
+        Polygon* poly = new Polygon( rings[0].size() );
+        addPoints( poly, rings[0] );
+        poly->rewind( Ring::ORIENTATION_CCW );
+
+        for (unsigned r = 1; r < numRings; ++r)
+        {
+            Ring* hole = new Ring( rings[r].size() );
+            addPoints( hole, rings[r] );
+            hole->rewind( Ring::ORIENTATION_CW );
+            poly->getHoles().push_back( hole );
+        }
+        return poly;
+    }
+
+    void appendUTF8(std::string& out, unsigned cp)
+    {
+        if (cp < 0x80) {
+            out += (char)cp;
+        }
+        else if (cp < 0x800) {
+            out += (char)(0xC0 | (cp >> 6));
+            out += (char)(0x80 | (cp & 0x3F));
+        }
+        else if (cp < 0x10000) {
+            out += (char)(0xE0 | (cp >> 12));
+            out += (char)(0x80 | ((cp >> 6) & 0x3F));
+            out += (char)(0x80 | (cp & 0x3F));
+        }
+        else {
+            out += (char)(0xF0 | (cp >> 18));
+            out += (char)(0x80 | ((cp >> 12) & 0x3F));
+            out += (char)(0x80 | ((cp >> 6) & 0x3F));
+            out += (char)(0x80 | (cp & 0x3F));
+        }
+    }
+}
+
+GeoJSONReader::GeoJSONReader(std::istream& in, const SpatialReference* srs) :
+_buf  ( in.rdbuf() ),
+_srs  ( srs ),
+_state( STATE_START ),
+_root ( 0L ),
+_count( 0 )
+{
+    //nop
+}
+
+GeoJSONReader::~GeoJSONReader()
+{
+    delete _root;
+}
+
+bool
+GeoJSONReader::fail(const std::string& message)
+{
+    if (_error.empty())
+        _error = message;
+    _state = STATE_DONE;
+    return false;
+}
+
+bool
+GeoJSONReader::skipSpace()
+{
+    if (!_buf)
+        return false;
+
+    int c = _buf->sgetc();
+    while (c == ' ' || c == '\t' || c == '\n' || c == '\r')
+    {
+        _buf->sbumpc();
+        c = _buf->sgetc();
+    }
+    return c != std::char_traits<char>::eof();
+}
+
+bool
+GeoJSONReader::expect(char c)
+{
+    if (!skipSpace() || _buf->sgetc() != c)
+        return fail(Stringify() << "Expected '" << c << "'");
+    _buf->sbumpc();
+    return true;
+}
+
+bool
+GeoJSONReader::readString(std::string& out, std::string* raw)
+{
+    out.clear();
+    if (!expect('"'))
+        return false;
+    if (raw) *raw += '"';
+
+    for (;;)
+    {
+        int c = _buf->sbumpc();
+        if (c == std::char_traits<char>::eof())
+            return fail("Unterminated string");
+        if (raw) *raw += (char)c;
+
+        if (c == '"')
+            return true;
+
+        if (c != '\\')
+        {
+            out += (char)c;
+            continue;
+        }
+
+        int e = _buf->sbumpc();
+        if (e == std::char_traits<char>::eof())
+            return fail("Unterminated string");
+        if (raw) *raw += (char)e;
+
+        switch (e)
+        {
+        case 'b': out += '\b'; break;
+        case 'f': out += '\f'; break;
+        case 'n': out += '\n'; break;
+        case 'r': out += '\r'; break;
+        case 't': out += '\t'; break;
+        case 'u':
+            {
+                unsigned cp = 0;
+                for (int i = 0; i < 4; ++i)
+                {
+                    int h = _buf->sbumpc();
+                    if (raw && h != std::char_traits<char>::eof()) *raw += (char)h;
+                    cp <<= 4;
+                    if      (h >= '0' && h <= '9') cp |= h - '0';
+                    else if (h >= 'a' && h <= 'f') cp |= h - 'a' + 10;
+                    else if (h >= 'A' && h <= 'F') cp |= h - 'A' + 10;
+                    else return fail("Bad \\u escape in string");
+                }
+
+                // a high surrogate followed by its low half (kept simple:
+                // unpaired surrogates are written as-is)
+                if (cp >= 0xD800 && cp < 0xDC00 && _buf->sgetc() == '\\')
+                {
+                    _buf->sbumpc();
+                    if (raw) *raw += '\\';
+                    if (_buf->sbumpc() != 'u')
+                        return fail("Bad surrogate pair in string");
+                    if (raw) *raw += 'u';
+
+                    unsigned lo = 0;
+                    for (int i = 0; i < 4; ++i)
+                    {
+                        int h = _buf->sbumpc();
+                        if (raw && h != std::char_traits<char>::eof()) *raw += (char)h;
+                        lo <<= 4;
+                        if      (h >= '0' && h <= '9') lo |= h - '0';
+                        else if (h >= 'a' && h <= 'f') lo |= h - 'a' + 10;
+                        else if (h >= 'A' && h <= 'F') lo |= h - 'A' + 10;
+                        else return fail("Bad \\u escape in string");
+                    }
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                }
+                appendUTF8(out, cp);
+            }
+            break;
+        default:
+            // \" \\ \/
+            out += (char)e;
+        }
+    }
+}
+
+bool
+GeoJSONReader::readNumber(double& out, bool& isInteger, std::string* raw)
+{
+    if (!skipSpace())
+        return fail("Expected a number");
+
+    char buf[64];
+    unsigned len = 0;
+    isInteger = true;
+
+    for (int c = _buf->sgetc(); ; c = _buf->sgetc())
+    {
+        if ((c >= '0' && c <= '9') || c == '-' || c == '+')
+            ;
+        else if (c == '.' || c == 'e' || c == 'E')
+            isInteger = false;
+        else
+            break;
+
+        if (len+1 >= sizeof(buf))
+            return fail("Number too long");
+        buf[len++] = (char)c;
+        _buf->sbumpc();
+    }
+    buf[len] = 0;
+
+    if (len == 0)
+        return fail("Expected a number");
+
+    char* end = 0L;
+    out = strtod(buf, &end);
+    if (end != buf + len)
+        return fail(Stringify() << "Bad number \"" << buf << "\"");
+
+    if (raw) *raw += buf;
+    return true;
+}
+
+bool
+GeoJSONReader::readLiteral(const char* literal, std::string* raw)
+{
+    skipSpace();
+    for (const char* p = literal; *p; ++p)
+    {
+        if (_buf->sbumpc() != *p)
+            return fail(Stringify() << "Expected \"" << literal << "\"");
+    }
+    if (raw) *raw += literal;
+    return true;
+}
+
+bool
+GeoJSONReader::skipValue(std::string* raw)
+{
+    if (!skipSpace())
+        return fail("Expected a value");
+
+    std::string temp;
+    double number;
+    bool isInteger;
+
+    switch (_buf->sgetc())
+    {
+    case '"':
+        return readString(temp, raw);
+
+    case 't': return readLiteral("true", raw);
+    case 'f': return readLiteral("false", raw);
+    case 'n': return readLiteral("null", raw);
+
+    case '{':
+        _buf->sbumpc();
+        if (raw) *raw += '{';
+        if (!skipSpace())
+            return fail("Unterminated object");
+        if (_buf->sgetc() == '}')
+        {
+            _buf->sbumpc();
+            if (raw) *raw += '}';
+            return true;
+        }
+        for (;;)
+        {
+            if (!readString(temp, raw) || !expect(':'))
+                return false;
+            if (raw) *raw += ':';
+            if (!skipValue(raw) || !skipSpace())
+                return fail("Unterminated object");
+
+            int c = _buf->sbumpc();
+            if (raw) *raw += (char)c;
+            if (c == '}')
+                return true;
+            if (c != ',')
+                return fail("Expected ',' or '}'");
+        }
+
+    case '[':
+        _buf->sbumpc();
+        if (raw) *raw += '[';
+        if (!skipSpace())
+            return fail("Unterminated array");
+        if (_buf->sgetc() == ']')
+        {
+            _buf->sbumpc();
+            if (raw) *raw += ']';
+            return true;
+        }
+        for (;;)
+        {
+            if (!skipValue(raw) || !skipSpace())
+                return fail("Unterminated array");
+
+            int c = _buf->sbumpc();
+            if (raw) *raw += (char)c;
+            if (c == ']')
+                return true;
+            if (c != ',')
+                return fail("Expected ',' or ']'");
+        }
+
+    default:
+        return readNumber(number, isInteger, raw);
+    }
+}
+
+bool
+GeoJSONReader::readCoords(Coords& node, osg::Vec3d& position, bool& isPosition)
+{
+    if (!expect('['))
+        return false;
+    if (!skipSpace())
+        return fail("Unterminated array");
+
+    int c = _buf->sgetc();
+    if (c == ']')
+    {
+        _buf->sbumpc();
+        isPosition = false;
+        return true;
+    }
+
+    isPosition = (c != '[');
+    unsigned n = 0;
+
+    for (;;)
+    {
+        if (isPosition)
+        {
+            double value;
+            bool isInteger;
+            if (!readNumber(value, isInteger))
+                return false;
+            // x, y and optional z; anything past that (like M) is ignored
+            if (n < 3)
+                position[n] = value;
+            ++n;
+        }
+        else
+        {
+            osg::Vec3d childPosition;
+            bool childIsPosition;
+            node._parts.push_back(Coords());
+            if (!readCoords(node._parts.back(), childPosition, childIsPosition))
+                return false;
+            if (childIsPosition)
+            {
+                node._parts.pop_back();
+                node._points.push_back(childPosition);
+            }
+        }
+
+        if (!skipSpace())
+            return fail("Unterminated array");
+
+        c = _buf->sbumpc();
+        if (c == ']')
+            break;
+        if (c != ',')
+            return fail("Expected ',' or ']'");
+    }
+
+    if (isPosition && n < 2)
+        return fail("Position needs at least two coordinates");
+
+    return true;
+}
+
+bool
+GeoJSONReader::readProperties(Feature* feature)
+{
+    if (!expect('{'))
+        return false;
+    if (!skipSpace())
+        return fail("Unterminated object");
+    if (_buf->sgetc() == '}')
+    {
+        _buf->sbumpc();
+        return true;
+    }
+
+    std::string key, value;
+    for (;;)
+    {
+        if (!readString(key) || !expect(':') || !skipSpace())
+            return false;
+
+        std::string name = toLower(key);
+
+        switch (_buf->sgetc())
+        {
+        case '"':
+            if (!readString(value))
+                return false;
+            feature->set(name, value);
+            break;
+
+        case 't':
+        case 'f':
+            {
+                bool b = _buf->sgetc() == 't';
+                if (!readLiteral(b ? "true" : "false"))
+                    return false;
+                feature->set(name, b);
+            }
+            break;
+
+        case 'n':
+            if (!readLiteral("null"))
+                return false;
+            feature->setNull(name);
+            break;
+
+        case '{':
+        case '[':
+            value.clear();
+            if (!skipValue(&value))
+                return false;
+            feature->set(name, value);
+            break;
+
+        default:
+            {
+                double number;
+                bool isInteger;
+                if (!readNumber(number, isInteger))
+                    return false;
+                if (isInteger && number >= (double)INT_MIN && number <= (double)INT_MAX)
+                    feature->set(name, (int)number);
+                else
+                    feature->set(name, number);
+            }
+        }
+
+        if (!skipSpace())
+            return fail("Unterminated object");
+
+        int c = _buf->sbumpc();
+        if (c == '}')
+            return true;
+        if (c != ',')
+            return fail("Expected ',' or '}'");
+    }
+}
+
+bool
+GeoJSONReader::readGeometry(osg::ref_ptr<Geometry>& out)
+{
+    if (!skipSpace())
+        return fail("Expected a geometry");
+
+    if (_buf->sgetc() == 'n')
+    {
+        out = 0L;
+        return readLiteral("null");
+    }
+
+    Object obj;
+    if (!expect('{'))
+        return false;
+    if (!skipSpace())
+        return fail("Unterminated object");
+
+    if (_buf->sgetc() == '}')
+    {
+        _buf->sbumpc();
+    }
+    else
+    {
+        std::string key;
+        for (;;)
+        {
+            if (!readString(key) || !expect(':') || !readMember(obj, key) || !skipSpace())
+                return fail("Unterminated object");
+
+            int c = _buf->sbumpc();
+            if (c == '}')
+                break;
+            if (c != ',')
+                return fail("Expected ',' or '}'");
+        }
+    }
+
+    out = createGeometry(obj);
+    return true;
+}
+
+bool
+GeoJSONReader::readMember(Object& obj, const std::string& key)
+{
+    if (key == "type")
+    {
+        return readString(obj._type);
+    }
+    else if (key == "coordinates")
+    {
+        return readCoords(obj._coords, obj._position, obj._isPosition);
+    }
+    else if (key == "geometries")
+    {
+        if (!expect('[') || !skipSpace())
+            return false;
+        if (_buf->sgetc() == ']')
+        {
+            _buf->sbumpc();
+            return true;
+        }
+        for (;;)
+        {
+            osg::ref_ptr<Geometry> geom;
+            if (!readGeometry(geom) || !skipSpace())
+                return false;
+            if (geom.valid())
+                obj._geometries.push_back(geom.get());
+
+            int c = _buf->sbumpc();
+            if (c == ']')
+                return true;
+            if (c != ',')
+                return fail("Expected ',' or ']'");
+        }
+    }
+    else if (key == "geometry")
+    {
+        return readGeometry(obj._geometry);
+    }
+    else if (key == "properties")
+    {
+        if (!skipSpace())
+            return fail("Expected properties");
+        if (_buf->sgetc() == 'n')
+            return readLiteral("null");
+        if (!obj._feature.valid())
+            obj._feature = new Feature(0L, _srs.get());
+        return readProperties(obj._feature.get());
+    }
+    else if (key == "id")
+    {
+        if (!skipSpace())
+            return fail("Expected an id");
+        int c = _buf->sgetc();
+        if (c == '-' || (c >= '0' && c <= '9'))
+        {
+            double id;
+            bool isInteger;
+            if (!readNumber(id, isInteger))
+                return false;
+            if (isInteger)
+            {
+                obj._fid = (FeatureID)id;
+                obj._hasFID = true;
+            }
+            return true;
+        }
+        return skipValue();
+    }
+
+    return skipValue();
+}
+
+Geometry*
+GeoJSONReader::createGeometry(Object& obj)
+{
+    const std::string& type = obj._type;
+    Coords& coords = obj._coords;
+
+    if (type == "Point")
+    {
+        if (!obj._isPosition)
+            return 0L;
+        PointSet* points = new PointSet(1);
+        points->push_back(obj._position);
+        return points;
+    }
+    else if (type == "MultiPoint")
+    {
+        MultiGeometry* multi = new MultiGeometry();
+        for (unsigned i = 0; i < coords._points.size(); ++i)
+        {
+            PointSet* point = new PointSet(1);
+            point->push_back(coords._points[i]);
+            multi->getComponents().push_back(point);
+        }
+        return multi;
+    }
+    else if (type == "LineString")
+    {
+        LineString* line = new LineString(coords._points.size());
+        addPoints(line, coords._points);
+        return line;
+    }
+    else if (type == "MultiLineString")
+    {
+        MultiGeometry* multi = new MultiGeometry();
+        for (unsigned i = 0; i < coords._parts.size(); ++i)
+        {
+            LineString* line = new LineString(coords._parts[i]._points.size());
+            addPoints(line, coords._parts[i]._points);
+            multi->getComponents().push_back(line);
+        }
+        return multi;
+    }
+    else if (type == "Polygon")
+    {
+        std::vector< std::vector<osg::Vec3d> > rings(coords._parts.size());
+        for (unsigned r = 0; r < rings.size(); ++r)
+            rings[r].swap(coords._parts[r]._points);
+        return createPolygon(rings.empty() ? 0L : &rings[0], rings.size());
+    }
+    else if (type == "MultiPolygon")
+    {
+        MultiGeometry* multi = new MultiGeometry();
+        for (unsigned p = 0; p < coords._parts.size(); ++p)
+        {
+            Coords& poly = coords._parts[p];
+            std::vector< std::vector<osg::Vec3d> > rings(poly._parts.size());
+            for (unsigned r = 0; r < rings.size(); ++r)
+                rings[r].swap(poly._parts[r]._points);
+
+            Polygon* polygon = createPolygon(rings.empty() ? 0L : &rings[0], rings.size());
+            if (polygon)
+                multi->getComponents().push_back(polygon);
+        }
+        return multi;
+    }
+    else if (type == "GeometryCollection")
+    {
+        MultiGeometry* multi = new MultiGeometry();
+        for (unsigned i = 0; i < obj._geometries.size(); ++i)
+            multi->getComponents().push_back(obj._geometries[i].get());
+        return multi;
+    }
+
+    return 0L;
+}
+
+Feature*
+GeoJSONReader::finish(Object& obj)
+{
+    osg::ref_ptr<Feature> feature = obj._feature.valid() ? obj._feature.get() : new Feature(0L, _srs.get());
+
+    if (obj._geometry.valid())
+        feature->setGeometry(obj._geometry.get());
+
+    // OGR numbers features without an id by their position in the input
+    feature->setFID(obj._hasFID ? obj._fid : (FeatureID)_count);
+    ++_count;
+
+    return feature.release();
+}
+
+Feature*
+GeoJSONReader::readNext()
+{
+    std::string key;
+
+    for (;;)
+    {
+        switch (_state)
+        {
+        case STATE_START:
+            if (!skipSpace())
+            {
+                _state = STATE_DONE;
+                return 0L;
+            }
+            if (!expect('{'))
+                return 0L;
+            delete _root;
+            _root = new Object();
+            _state = STATE_ROOT;
+            if (!skipSpace())
+            {
+                fail("Unterminated object");
+                return 0L;
+            }
+            if (_buf->sgetc() == '}')
+            {
+                _buf->sbumpc();
+                _state = STATE_DONE;
+                return 0L;
+            }
+            break;
+
+        case STATE_ROOT:
+            {
+                // next member of the top-level object
+                if (!readString(key) || !expect(':'))
+                    return 0L;
+
+                if (key == "features")
+                {
+                    if (!expect('[') || !skipSpace())
+                        return 0L;
+
+                    if (_buf->sgetc() != ']')
+                    {
+                        _state = STATE_FEATURES;
+                        break;
+                    }
+                    _buf->sbumpc();
+                }
+                else if (!readMember(*_root, key))
+                {
+                    return 0L;
+                }
+
+                if (!skipSpace())
+                {
+                    fail("Unterminated object");
+                    return 0L;
+                }
+
+                int c = _buf->sbumpc();
+                if (c == '}')
+                {
+                    _state = STATE_DONE;
+
+                    // a lone Feature, or a bare geometry
+                    if (_root->_type != "Feature")
+                    {
+                        _root->_geometry = createGeometry(*_root);
+                        if (!_root->_geometry.valid())
+                            return 0L;
+                    }
+                    return finish(*_root);
+                }
+                if (c != ',')
+                {
+                    fail("Expected ',' or '}'");
+                    return 0L;
+                }
+            }
+            break;
+
+        case STATE_FEATURES:
+            {
+                // next element of the "features" array
+                Object obj;
+                if (!expect('{') || !skipSpace())
+                    return 0L;
+
+                if (_buf->sgetc() == '}')
+                {
+                    _buf->sbumpc();
+                }
+                else
+                {
+                    for (;;)
+                    {
+                        if (!readString(key) || !expect(':') || !readMember(obj, key) || !skipSpace())
+                        {
+                            fail("Unterminated feature");
+                            return 0L;
+                        }
+
+                        int c = _buf->sbumpc();
+                        if (c == '}')
+                            break;
+                        if (c != ',')
+                        {
+                            fail("Expected ',' or '}'");
+                            return 0L;
+                        }
+                    }
+                }
+
+                if (!skipSpace())
+                {
+                    fail("Unterminated array");
+                    return 0L;
+                }
+
+                int c = _buf->sbumpc();
+                if (c == ']')
+                {
+                    // back to the rest of the top-level object
+                    if (!skipSpace())
+                    {
+                        fail("Unterminated object");
+                        return 0L;
+                    }
+                    c = _buf->sbumpc();
+                    if (c == '}')
+                        _state = STATE_DONE;
+                    else if (c == ',')
+                        _state = STATE_ROOT;
+                    else
+                    {
+                        fail("Expected ',' or '}'");
+                        return 0L;
+                    }
+                }
+                else if (c != ',')
+                {
+                    fail("Expected ',' or ']'");
+                    return 0L;
+                }
+
+                return finish(obj);
+            }
+
+        case STATE_DONE:
+        default:
+            return 0L;
+        }
+    }
+}
+
+bool
+GeoJSONReader::read(std::istream& in, const SpatialReference* srs, FeatureList& features)
+{
+    GeoJSONReader reader(in, srs);
+
+    Feature* feature;
+    while ((feature = reader.readNext()) != 0L)
+    {
+        features.push_back(feature);
+    }
+
+    if (reader.hasError())
+    {
+        OE_WARN << LC << reader.getError() << std::endl;
+        return false;
+    }
+    return true;
+}
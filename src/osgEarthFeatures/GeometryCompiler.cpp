@@ -27,6 +27,7 @@
 #include <osgEarthFeatures/SubstituteModelFilter>
 #include <osgEarthFeatures/TessellateOperator>
 #include <osgEarthFeatures/Session>
+#include <osgEarthSymbology/MeshConsolidator>
 
 #include <osgEarth/Utils>
 #include <osgEarth/CullingUtils>
@@ -35,6 +36,9 @@
 #include <osgEarth/ShaderGenerator>
 #include <osgEarth/ShaderUtils>
 #include <osgEarth/Utils>
+#include <osgEarth/JobScheduler>
+#include <osgEarth/StringUtils>
+#include <osgEarth/VertexQuantizer>
 
 #include <osg/MatrixTransform>
 #include <osg/Timer>
@@ -44,6 +48,8 @@
 
 
 #include <cstdlib>
+#include <map>
+#include <typeinfo>
 
 #define LC "[GeometryCompiler] "
 
@@ -68,17 +74,19 @@ GeometryCompilerOptions::GeometryCompilerOptions(bool stockDefaults) :
 _maxGranularity_deg    ( 10.0 ),
 _mergeGeometry         ( true ),
 _clustering            ( false ),
-_instancing            ( false ),
+_instancing            ( true ),
 _ignoreAlt             ( false ),
 _shaderPolicy          ( SHADERPOLICY_GENERATE ),
 _geoInterp             ( GEOINTERP_GREAT_CIRCLE ),
 _optimizeStateSharing  ( true ),
 _optimize              ( false ),
 _optimizeVertexOrdering( true ),
+_quantizeVertices      ( false ),
 _validate              ( false ),
 _maxPolyTilingAngle    ( 45.0f ),
 _useGPULines           ( false ),
-_colorBinding          ( osg::Geometry::BIND_PER_VERTEX )  
+_colorBinding          ( osg::Geometry::BIND_PER_VERTEX ),
+_parallelChunkSize     ( 0u )
 {
     if (::getenv("OSGEARTH_GPU_SCREEN_SPACE_LINES") != 0L)
     {
@@ -103,10 +111,12 @@ _geoInterp             ( s_defaults.geoInterp().value() ),
 _optimizeStateSharing  ( s_defaults.optimizeStateSharing().value() ),
 _optimize              ( s_defaults.optimize().value() ),
 _optimizeVertexOrdering( s_defaults.optimizeVertexOrdering().value() ),
+_quantizeVertices      ( s_defaults.quantizeVertices().value() ),
 _validate              ( s_defaults.validate().value() ),
 _maxPolyTilingAngle    ( s_defaults.maxPolygonTilingAngle().value() ),
 _useGPULines           ( s_defaults.useGPUScreenSpaceLines().value() ),
-_colorBinding          ( s_defaults.colorBinding().value() )
+_colorBinding          ( s_defaults.colorBinding().value() ),
+_parallelChunkSize     ( s_defaults.parallelChunkSize().value() )
 {
     fromConfig(conf.getConfig());
 }
@@ -125,10 +135,12 @@ GeometryCompilerOptions::fromConfig( const Config& conf )
     conf.getIfSet   ( "optimize_state_sharing", _optimizeStateSharing );
     conf.getIfSet   ( "optimize", _optimize );
     conf.getIfSet   ( "optimize_vertex_ordering", _optimizeVertexOrdering);
+    conf.getIfSet   ( "quantize_vertices", _quantizeVertices );
     conf.getIfSet   ( "validate", _validate );
     conf.getIfSet   ( "max_polygon_tiling_angle", _maxPolyTilingAngle );
     conf.getIfSet   ( "use_gpu_screen_space_lines", _useGPULines );
-    
+    conf.getIfSet   ( "parallel_chunk_size", _parallelChunkSize );
+
  
     conf.getIfSet( "color_binding", "overall",   _colorBinding, osg::Geometry::BIND_OVERALL );
     conf.getIfSet( "color_binding", "vertex",    _colorBinding, osg::Geometry::BIND_PER_VERTEX );
@@ -153,9 +165,11 @@ GeometryCompilerOptions::getConfig() const
     conf.addIfSet   ( "optimize_state_sharing", _optimizeStateSharing );
     conf.addIfSet   ( "optimize", _optimize );
     conf.addIfSet   ( "optimize_vertex_ordering", _optimizeVertexOrdering);
+    conf.addIfSet   ( "quantize_vertices", _quantizeVertices );
     conf.addIfSet   ( "validate", _validate );
     conf.addIfSet   ( "max_polygon_tiling_angle", _maxPolyTilingAngle );
     conf.addIfSet   ( "use_gpu_screen_space_lines", _useGPULines );    
+    conf.addIfSet   ( "parallel_chunk_size", _parallelChunkSize );
     
     conf.addIfSet( "color_binding", "overall",   _colorBinding, osg::Geometry::BIND_OVERALL );
     conf.addIfSet( "color_binding", "vertex",    _colorBinding, osg::Geometry::BIND_PER_VERTEX );
@@ -234,30 +248,207 @@ GeometryCompiler::compile(FeatureCursor*        cursor,
     return compile(workingSet, style, context);
 }
 
-osg::Node*
-GeometryCompiler::compile(FeatureList&          workingSet,
-                          const Style&          style,
-                          const FilterContext&  context)
+namespace osgEarth { namespace Features
 {
-#ifdef PROFILING
-    osg::Timer_t p_start = osg::Timer::instance()->tick();
-    unsigned p_features = workingSet.size();
-#endif
+    /**
+     * Compiles one chunk of a feature list on the job scheduler.
+     */
+    class CompileChunkJob : public TaskRequest
+    {
+    public:
+        CompileChunkJob(const GeometryCompiler* compiler,
+                        const Style&            style,
+                        const FilterContext&    context) :
+            _compiler(compiler),
+            _style   (style),
+            _context (context)
+        {
+            //nop
+        }
 
-    // for debugging/validation.
-    std::vector<std::string> history;
-    bool trackHistory = (_options.validate() == true);
+        void operator()(ProgressCallback* progress)
+        {
+            if ( progress && progress->isCanceled() )
+                return;
 
-    osg::ref_ptr<osg::Group> resultGroup = new osg::Group();
+            _output = new osg::Group();
+            _compiler->compileFeatures( _features, _style, _context, _output.get(), 0L );
 
-    // create a filter context that will track feature data through the process
-    FilterContext sharedCX = context;
+            // Share state through the session-wide cache so that equivalent
+            // state from different chunks ends up as the same object, and
+            // the chunks can merge. The chunk isn't live yet, so this is safe.
+            if ( _compiler->_options.optimizeStateSharing() == true && _context.getSession() )
+            {
+                _context.getSession()->getStateSetCache()->optimize( _output.get() );
+            }
+        }
 
-    if ( !sharedCX.extent().isSet() && sharedCX.profile() )
+        const GeometryCompiler*  _compiler;
+        Style                    _style;
+        FilterContext            _context;
+        FeatureList              _features;
+        osg::ref_ptr<osg::Group> _output;
+    };
+} }
+
+namespace
+{
+    /**
+     * Collects the geodes from a set of chunk results and re-bins them by
+     * localization matrix and state so that equivalent geometry from
+     * different chunks ends up in the same geode and can be consolidated.
+     * Anything that isn't a plain group, transform or geode is kept as-is.
+     */
+    struct MergeChunksVisitor : public osg::NodeVisitor
     {
-        sharedCX.extent() = sharedCX.profile()->getExtent();
+        typedef std::map<osg::StateSet*, osg::ref_ptr<osg::Geode> > GeodeMap;
+
+        struct Bin
+        {
+            // geode stateset -> (drawable stateset -> merged geode)
+            std::map<osg::StateSet*, GeodeMap> _geodes;
+            std::vector<osg::ref_ptr<osg::Node> > _others;
+        };
+
+        std::map<osg::Matrixd, Bin> _bins;
+        std::vector<osg::Matrixd>   _matrixStack;
+
+        MergeChunksVisitor() : osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN)
+        {
+            _matrixStack.push_back( osg::Matrixd::identity() );
+        }
+
+        void apply(osg::Node& node)
+        {
+            _bins[_matrixStack.back()]._others.push_back( &node );
+        }
+
+        void apply(osg::Group& node)
+        {
+            if ( typeid(node) == typeid(osg::Group) && !node.getStateSet() )
+                traverse( node );
+            else
+                apply( static_cast<osg::Node&>(node) );
+        }
+
+        void apply(osg::MatrixTransform& node)
+        {
+            if ( typeid(node) == typeid(osg::MatrixTransform) && !node.getStateSet() )
+            {
+                _matrixStack.push_back( node.getMatrix() * _matrixStack.back() );
+                traverse( node );
+                _matrixStack.pop_back();
+            }
+            else
+            {
+                apply( static_cast<osg::Node&>(node) );
+            }
+        }
+
+        void apply(osg::Geode& node)
+        {
+            if ( typeid(node) != typeid(osg::Geode) )
+            {
+                apply( static_cast<osg::Node&>(node) );
+                return;
+            }
+
+            GeodeMap& geodes = _bins[_matrixStack.back()]._geodes[node.getStateSet()];
+            for( unsigned i=0; i<node.getNumDrawables(); ++i )
+            {
+                osg::Drawable* drawable = node.getDrawable(i);
+                osg::ref_ptr<osg::Geode>& geode = geodes[drawable->getStateSet()];
+                if ( !geode.valid() )
+                {
+                    geode = new osg::Geode();
+                    geode->setStateSet( node.getStateSet() );
+                }
+                geode->addDrawable( drawable );
+            }
+        }
+
+        // Write the merged geodes into the output group.
+        void merge(osg::Group* output)
+        {
+            for( std::map<osg::Matrixd, Bin>::iterator b = _bins.begin(); b != _bins.end(); ++b )
+            {
+                osg::Group* group = b->first.isIdentity() ?
+                    new osg::Group() :
+                    new osg::MatrixTransform( b->first );
+
+                for( std::map<osg::StateSet*, GeodeMap>::iterator g = b->second._geodes.begin(); g != b->second._geodes.end(); ++g )
+                {
+                    for( GeodeMap::iterator d = g->second.begin(); d != g->second.end(); ++d )
+                    {
+                        osg::Geode* geode = d->second.get();
+                        MeshConsolidator::run( *geode );
+                        group->addChild( geode );
+                    }
+                }
+
+                for( unsigned i=0; i<b->second._others.size(); ++i )
+                {
+                    group->addChild( b->second._others[i].get() );
+                }
+
+                output->addChild( group );
+            }
+        }
+    };
+}
+
+void
+GeometryCompiler::compileFeaturesInParallel(FeatureList&              workingSet,
+                                            const Style&              style,
+                                            const FilterContext&      context,
+                                            osg::Group*               output,
+                                            std::vector<std::string>* history) const
+{
+    const unsigned chunkSize = osg::maximum(1u, _options.parallelChunkSize().get());
+
+    JobScheduler* scheduler = Registry::instance()->getJobScheduler();
+    osg::ref_ptr<JobGroup> jobs = new JobGroup();
+
+    // Split the list into disjoint chunks, each with its own copy of the
+    // filter context (the filters modify it as they go).
+    std::vector<osg::ref_ptr<CompileChunkJob> > chunks;
+    for( FeatureList::iterator i = workingSet.begin(); i != workingSet.end(); )
+    {
+        CompileChunkJob* chunk = new CompileChunkJob( this, style, context );
+        for( unsigned n = 0; n < chunkSize && i != workingSet.end(); ++n, ++i )
+        {
+            chunk->_features.push_back( i->get() );
+        }
+        chunks.push_back( chunk );
     }
 
+    for( unsigned i=0; i<chunks.size(); ++i )
+    {
+        scheduler->submit( chunks[i].get(), JobScheduler::LANE_NORMAL, jobs.get() );
+    }
+
+    scheduler->join( jobs.get() );
+
+    MergeChunksVisitor merger;
+    for( unsigned i=0; i<chunks.size(); ++i )
+    {
+        if ( chunks[i]->_output.valid() )
+            chunks[i]->_output->accept( merger );
+    }
+    merger.merge( output );
+
+    if ( history ) history->push_back( Stringify() << "parallel(" << chunks.size() << ")" );
+
+    OE_DEBUG << LC << "Compiled " << workingSet.size() << " features in " << chunks.size() << " parallel chunks" << std::endl;
+}
+
+void
+GeometryCompiler::compileFeatures(FeatureList&              workingSet,
+                                  const Style&              style,
+                                  FilterContext&            context,
+                                  osg::Group*               output,
+                                  std::vector<std::string>* history) const
+{
     // ref_ptr's to hold defaults in case we need them.
     osg::ref_ptr<PointSymbol>   defaultPoint;
     osg::ref_ptr<LineSymbol>    defaultLine;
@@ -282,16 +473,16 @@ GeometryCompiler::compile(FeatureList&          workingSet,
             TessellateOperator filter;
             filter.setNumPartitions( *line->tessellation() );
             filter.setDefaultGeoInterp( _options.geoInterp().get() );
-            sharedCX = filter.push( workingSet, sharedCX );
-            if ( trackHistory ) history.push_back( "tessellation" );
+            context = filter.push( workingSet, context );
+            if ( history ) history->push_back( "tessellation" );
         }
         else if ( line->tessellationSize().isSet() )
         {
             TessellateOperator filter;
             filter.setMaxPartitionSize( *line->tessellationSize() );
             filter.setDefaultGeoInterp( _options.geoInterp().get() );
-            sharedCX = filter.push( workingSet, sharedCX );
-            if ( trackHistory ) history.push_back( "tessellationSize" );
+            context = filter.push( workingSet, context );
+            if ( history ) history->push_back( "tessellationSize" );
         }
     }
 
@@ -334,8 +525,8 @@ GeometryCompiler::compile(FeatureList&          workingSet,
         {
             resample.maxLength() = *_options.resampleMaxLength();
         }                   
-        sharedCX = resample.push( workingSet, sharedCX ); 
-        if ( trackHistory ) history.push_back( "resample" );
+        context = resample.push( workingSet, context ); 
+        if ( history ) history->push_back( "resample" );
     }    
     
     // check whether we need to do elevation clamping:
@@ -353,9 +544,9 @@ GeometryCompiler::compile(FeatureList&          workingSet,
         const InstanceSymbol* instance = (const InstanceSymbol*)model;
 
         // use a separate filter context since we'll be munging the data
-        FilterContext localCX = sharedCX;
+        FilterContext localCX = context;
         
-        if ( trackHistory ) history.push_back( "model");
+        if ( history ) history->push_back( "model");
 
         if ( instance->placement() == InstanceSymbol::PLACEMENT_RANDOM   ||
              instance->placement() == InstanceSymbol::PLACEMENT_INTERVAL )
@@ -365,13 +556,13 @@ GeometryCompiler::compile(FeatureList&          workingSet,
             scatter.setRandom( instance->placement() == InstanceSymbol::PLACEMENT_RANDOM );
             scatter.setRandomSeed( *instance->randomSeed() );
             localCX = scatter.push( workingSet, localCX );
-            if ( trackHistory ) history.push_back( "scatter" );
+            if ( history ) history->push_back( "scatter" );
         }
         else if ( instance->placement() == InstanceSymbol::PLACEMENT_CENTROID )
         {
             CentroidFilter centroid;
             localCX = centroid.push( workingSet, localCX );
-            if ( trackHistory ) history.push_back( "centroid" );
+            if ( history ) history->push_back( "centroid" );
         }
 
         if ( altRequired )
@@ -379,7 +570,7 @@ GeometryCompiler::compile(FeatureList&          workingSet,
             AltitudeFilter clamp;
             clamp.setPropertiesFromStyle( style );
             localCX = clamp.push( workingSet, localCX );
-            if ( trackHistory ) history.push_back( "altitude" );
+            if ( history ) history->push_back( "altitude" );
         }
 
         SubstituteModelFilter sub( style );
@@ -398,9 +589,9 @@ GeometryCompiler::compile(FeatureList&          workingSet,
         osg::Node* node = sub.push( workingSet, localCX );
         if ( node )
         {
-            if ( trackHistory ) history.push_back( "substitute" );
+            if ( history ) history->push_back( "substitute" );
 
-            resultGroup->addChild( node );
+            output->addChild( node );
         }
     }
 
@@ -411,8 +602,8 @@ GeometryCompiler::compile(FeatureList&          workingSet,
         {
             AltitudeFilter clamp;
             clamp.setPropertiesFromStyle( style );
-            sharedCX = clamp.push( workingSet, sharedCX );
-            if ( trackHistory ) history.push_back( "altitude" );
+            context = clamp.push( workingSet, context );
+            if ( history ) history->push_back( "altitude" );
             altRequired = false;
         }
 
@@ -426,11 +617,11 @@ GeometryCompiler::compile(FeatureList&          workingSet,
         if ( _options.mergeGeometry().isSet() )
             extrude.setMergeGeometry( *_options.mergeGeometry() );
 
-        osg::Node* node = extrude.push( workingSet, sharedCX );
+        osg::Node* node = extrude.push( workingSet, context );
         if ( node )
         {
-            if ( trackHistory ) history.push_back( "extrude" );
-            resultGroup->addChild( node );
+            if ( history ) history->push_back( "extrude" );
+            output->addChild( node );
         }
         
     }
@@ -442,8 +633,8 @@ GeometryCompiler::compile(FeatureList&          workingSet,
         {
             AltitudeFilter clamp;
             clamp.setPropertiesFromStyle( style );
-            sharedCX = clamp.push( workingSet, sharedCX );
-            if ( trackHistory ) history.push_back( "altitude" );
+            context = clamp.push( workingSet, context );
+            if ( history ) history->push_back( "altitude" );
             altRequired = false;
         }
 
@@ -466,11 +657,11 @@ GeometryCompiler::compile(FeatureList&          workingSet,
         if (render && render->maxCreaseAngle().isSet())
             filter.maxCreaseAngle() = render->maxCreaseAngle().get();
 
-        osg::Node* node = filter.push( workingSet, sharedCX );
+        osg::Node* node = filter.push( workingSet, context );
         if ( node )
         {
-            if ( trackHistory ) history.push_back( "geometry" );
-            resultGroup->addChild( node );
+            if ( history ) history->push_back( "geometry" );
+            output->addChild( node );
         }
     }
 
@@ -480,19 +671,63 @@ GeometryCompiler::compile(FeatureList&          workingSet,
         {
             AltitudeFilter clamp;
             clamp.setPropertiesFromStyle( style );
-            sharedCX = clamp.push( workingSet, sharedCX );
-            if ( trackHistory ) history.push_back( "altitude" );
+            context = clamp.push( workingSet, context );
+            if ( history ) history->push_back( "altitude" );
             altRequired = false;
         }
 
         BuildTextFilter filter( style );
-        osg::Node* node = filter.push( workingSet, sharedCX );
+        osg::Node* node = filter.push( workingSet, context );
         if ( node )
         {
-            if ( trackHistory ) history.push_back( "text" );
-            resultGroup->addChild( node );
+            if ( history ) history->push_back( "text" );
+            output->addChild( node );
         }
     }
+}
+
+osg::Node*
+GeometryCompiler::compile(FeatureList&          workingSet,
+                          const Style&          style,
+                          const FilterContext&  context)
+{
+#ifdef PROFILING
+    osg::Timer_t p_start = osg::Timer::instance()->tick();
+    unsigned p_features = workingSet.size();
+#endif
+
+    // for debugging/validation.
+    std::vector<std::string> history;
+    bool trackHistory = (_options.validate() == true);
+
+    osg::ref_ptr<osg::Group> resultGroup = new osg::Group();
+
+    // create a filter context that will track feature data through the process
+    FilterContext sharedCX = context;
+
+    if ( !sharedCX.extent().isSet() && sharedCX.profile() )
+    {
+        sharedCX.extent() = sharedCX.profile()->getExtent();
+    }
+
+    // Large lists of simple or extruded geometry compile in parallel chunks.
+    const unsigned chunkSize = _options.parallelChunkSize().get();
+    bool parallel =
+        chunkSize > 0u &&
+        workingSet.size() > chunkSize &&
+        (style.has<PointSymbol>() || style.has<LineSymbol>() || style.has<PolygonSymbol>() || style.has<ExtrusionSymbol>()) &&
+        !style.has<ModelSymbol>() &&
+        !style.has<TextSymbol>() &&
+        !style.has<IconSymbol>();
+
+    if ( parallel )
+    {
+        compileFeaturesInParallel( workingSet, style, sharedCX, resultGroup.get(), trackHistory ? &history : 0L );
+    }
+    else
+    {
+        compileFeatures( workingSet, style, sharedCX, resultGroup.get(), trackHistory ? &history : 0L );
+    }
 
     if (Registry::capabilities().supportsGLSL())
     {
@@ -520,10 +755,16 @@ GeometryCompiler::compile(FeatureList&          workingSet,
         osg::ref_ptr<StateSetCache> sscache;
         if ( sharedCX.getSession() )
         {
-            // with a shared cache, don't combine statesets. They may be
-            // in the live graph
+            // with a shared cache, don't combine the top-level stateset. The
+            // caller may still modify it, and a shared one may be in the live
+            // graph. Everything below it can share freely (the cache is safe
+            // to use from concurrent compiles).
             sscache = sharedCX.getSession()->getStateSetCache();
             sscache->consolidateStateAttributes( resultGroup.get() );
+            for( unsigned i=0; i<resultGroup->getNumChildren(); ++i )
+            {
+                sscache->consolidateStateSets( resultGroup->getChild(i) );
+            }
         }
         else 
         {
@@ -561,6 +802,16 @@ GeometryCompiler::compile(FeatureList&          workingSet,
 
         if ( trackHistory ) history.push_back( "optimize" );
     }
+
+    // Convert to compact vertex formats last, since everything above
+    // expects float arrays.
+    if ( _options.quantizeVertices() == true )
+    {
+        VertexQuantizer quantizer;
+        quantizer.run( *resultGroup.get() );
+
+        if ( trackHistory ) history.push_back( "quantize" );
+    }
     
 
     //test: dump the tile to disk
@@ -21,34 +21,31 @@
 #include <osgEarth/Registry>
 #include <osgEarth/FileUtils>
 #include <osgEarth/GeoData>
+#include <osgEarth/StringUtils>
 #include <osgEarthFeatures/FeatureSource>
 #include <osgDB/Registry>
-#include <list>
-#include <stdio.h>
-#include <stdlib.h>
-
-#ifdef OSGEARTH_HAVE_MVT
-#include "vector_tile.pb.h"
-#endif
+#include <sstream>
+#include <vector>
+#include <string.h>
+#include <stdint.h>
+#include <float.h>
 
 using namespace osgEarth;
 using namespace osgEarth::Features;
 
 #define LC "[MVT] "
 
+// The tiles are decoded straight from the protobuf wire format (schema in
+// vector_tile.proto), without generated message classes: geometry commands
+// go directly into osgEarth geometries, and each value in a layer's value
+// table is only decoded the first time a feature refers to it.
+// https://github.com/mapbox/vector-tile-spec/tree/master/2.1
+
 #define CMD_BITS 3
 #define CMD_MOVETO 1
 #define CMD_LINETO 2
 #define CMD_CLOSEPATH 7
 
-// https://github.com/mapbox/mapnik-vector-tile/blob/master/examples/c%2B%2B/tileinfo.cpp
-enum CommandType {
-    SEG_END    = 0,
-    SEG_MOVETO = 1,
-    SEG_LINETO = 2,
-    SEG_CLOSE = (0x40 | 0x0f)
-};
-
 enum eGeomType {
     Unknown = 0,
     Point = 1,
@@ -56,193 +53,385 @@ enum eGeomType {
     Polygon = 3
 };
 
-int zig_zag_decode(int n)
+// protobuf wire types
+#define WIRE_VARINT  0
+#define WIRE_FIXED64 1
+#define WIRE_LENGTH  2
+#define WIRE_FIXED32 5
+
+namespace
 {
-    return (n >> 1) ^ (-(n & 1));
-}
+    inline int zig_zag_decode(uint32_t n)
+    {
+        return (int)(n >> 1) ^ (-(int)(n & 1));
+    }
 
-#ifdef OSGEARTH_HAVE_MVT
+    inline int64_t zig_zag_decode64(uint64_t n)
+    {
+        return (int64_t)(n >> 1) ^ (-(int64_t)(n & 1));
+    }
 
-Geometry* decodeLine(const mapnik::vector::tile_feature& feature, const TileKey& key, unsigned int tileres)
-{
-    unsigned int length = 0;
-    int cmd = -1;
-    const int cmd_bits = 3;
+    /**
+     * Reads one protobuf message from a buffer, field by field. Sub-messages
+     * and packed fields are read by making a new reader over their bytes,
+     * so nothing is copied.
+     */
+    struct PBReader
+    {
+        const unsigned char* _p;
+        const unsigned char* _end;
+        bool                 _ok;
 
-    int x = 0;
-    int y = 0;
+        PBReader() : _p(0L), _end(0L), _ok(true) { }
 
-    std::vector< osg::ref_ptr< osgEarth::Symbology::LineString > > lines;
-    osg::ref_ptr< osgEarth::Symbology::LineString > currentLine;
+        PBReader(const char* data, size_t len) :
+            _p  ( reinterpret_cast<const unsigned char*>(data) ),
+            _end( reinterpret_cast<const unsigned char*>(data) + len ),
+            _ok ( true ) { }
 
-    for (int k = 0; k < feature.geometry_size();)
-    {
-        if (!length)
+        bool ok() const { return _ok; }
+
+        bool more() const { return _ok && _p < _end; }
+
+        uint64_t varint()
         {
-            unsigned int cmd_length = feature.geometry(k++);
-            cmd = cmd_length & ((1 << cmd_bits) - 1);
-            length = cmd_length >> cmd_bits;
+            uint64_t result = 0;
+            for (unsigned shift = 0; shift < 64; shift += 7)
+            {
+                if (_p >= _end)
+                    break;
+                unsigned char b = *_p++;
+                result |= (uint64_t)(b & 0x7f) << shift;
+                if ((b & 0x80) == 0)
+                    return result;
+            }
+            _ok = false;
+            return 0;
         }
-        if (length > 0)
+
+        // Reads the next field key. Returns false at the end of the message.
+        bool next(unsigned& field, unsigned& type)
         {
-            length--;
+            if (!more())
+                return false;
+            uint64_t key = varint();
+            field = (unsigned)(key >> 3);
+            type = (unsigned)(key & 7);
+            return _ok;
+        }
 
-            if (cmd == SEG_MOVETO || cmd == SEG_LINETO)
+        // Reads a length-delimited field as a sub-reader.
+        PBReader message()
+        {
+            uint64_t len = varint();
+            if (!_ok || len > (uint64_t)(_end - _p))
             {
-                if (cmd == SEG_MOVETO)
-                {
-                    currentLine = new osgEarth::Symbology::LineString;
-                    lines.push_back( currentLine.get() );
-                }
-                int px = feature.geometry(k++);
-                int py = feature.geometry(k++);
-                px = zig_zag_decode(px);
-                py = zig_zag_decode(py);
+                _ok = false;
+                return PBReader();
+            }
+            PBReader sub(reinterpret_cast<const char*>(_p), (size_t)len);
+            _p += len;
+            return sub;
+        }
+
+        std::string string()
+        {
+            PBReader sub = message();
+            return _ok ? std::string(reinterpret_cast<const char*>(sub._p), sub._end - sub._p) : std::string();
+        }
 
-                x += px;
-                y += py;
+        uint64_t fixed(unsigned bytes)
+        {
+            if ((size_t)(_end - _p) < bytes)
+            {
+                _ok = false;
+                return 0;
+            }
+            // little-endian on the wire, whatever the host is
+            uint64_t result = 0;
+            for (unsigned i = 0; i < bytes; ++i)
+                result |= (uint64_t)_p[i] << (8*i);
+            _p += bytes;
+            return result;
+        }
 
-                double width = key.getExtent().width();
-                double height = key.getExtent().height();
+        float float32()
+        {
+            uint32_t bits = (uint32_t)fixed(4);
+            float f;
+            memcpy(&f, &bits, 4);
+            return f;
+        }
 
-                double geoX = key.getExtent().xMin() + (width/(double)tileres) * (double)x;
-                double geoY = key.getExtent().yMax() - (height/(double)tileres) * (double)y;
+        double float64()
+        {
+            uint64_t bits = fixed(8);
+            double d;
+            memcpy(&d, &bits, 8);
+            return d;
+        }
 
-                if (currentLine.valid())
-                {
-                    currentLine->push_back(geoX, geoY, 0);
-                }
+        void skip(unsigned type)
+        {
+            switch (type)
+            {
+            case WIRE_VARINT:  varint(); break;
+            case WIRE_FIXED64: fixed(8); break;
+            case WIRE_LENGTH:  message(); break;
+            case WIRE_FIXED32: fixed(4); break;
+            default: _ok = false;
             }
         }
-    }
 
-    currentLine = 0;
+        // Reads a repeated uint32 field into "out", packed or not.
+        void uints(unsigned type, std::vector<uint32_t>& out)
+        {
+            if (type == WIRE_LENGTH)
+            {
+                PBReader packed = message();
+                while (packed.more())
+                    out.push_back((uint32_t)packed.varint());
+                _ok = _ok && packed.ok();
+            }
+            else
+            {
+                out.push_back((uint32_t)varint());
+            }
+        }
+    };
 
-    if (lines.size() == 0)
-    {
-        return 0;
-    }
-    else if (lines.size() == 1)
-    {
-        // Just return a simple LineString
-        return lines[0].release();
-    }
-    else
+    /**
+     * One entry of a layer's value table, decoded on first use.
+     */
+    struct LazyValue
     {
-        // Return a multilinestring
-        MultiGeometry* multi = new MultiGeometry;
-        for (unsigned int i = 0; i < lines.size(); i++)
+        PBReader  _raw;
+        bool      _decoded;
+
+        enum Type { NONE, STRING, DOUBLE, INT, BOOL } _type;
+        std::string _string;
+        double      _double;
+        int         _int;
+        bool        _bool;
+
+        LazyValue(const PBReader& raw) : _raw(raw), _decoded(false), _type(NONE), _double(0.0), _int(0), _bool(false) { }
+
+        void decode()
         {
-            multi->add(lines[i].get());
+            _decoded = true;
+            PBReader r = _raw;
+            unsigned field, type;
+            // A value should hold exactly one field; if it has more, prefer
+            // them in the order below.
+            bool hasString = false, hasFloat = false, hasDouble = false, hasInt = false, hasBool = false;
+            float f = 0.0f;
+            while (r.next(field, type))
+            {
+                switch (field)
+                {
+                case 1: _string = r.string(); hasString = true; break;
+                case 2: f = r.float32(); hasFloat = true; break;
+                case 3: _double = r.float64(); hasDouble = true; break;
+                case 4: _int = (int)(int64_t)r.varint(); hasInt = true; break;
+                case 5: _int = (int)r.varint(); hasInt = true; break;
+                case 6: _int = (int)zig_zag_decode64(r.varint()); hasInt = true; break;
+                case 7: _bool = r.varint() != 0; hasBool = true; break;
+                default: r.skip(type);
+                }
+            }
+
+            if      (hasBool)   _type = BOOL;
+            else if (hasDouble) _type = DOUBLE;
+            else if (hasFloat)  { _type = DOUBLE; _double = f; }
+            else if (hasInt)    _type = INT;
+            else if (hasString) _type = STRING;
         }
-        return multi;
-    }
-}
 
-Geometry* decodePoint(const mapnik::vector::tile_feature& feature, const TileKey& key, unsigned int tileres)
-{
-    unsigned int length = 0;
-    int cmd = -1;
-    const int cmd_bits = 3;
+        void apply(Feature* feature, const std::string& key)
+        {
+            if (!_decoded)
+                decode();
 
-    int x = 0;
-    int y = 0;
+            switch (_type)
+            {
+            case BOOL:   feature->set(key, _bool); break;
+            case DOUBLE: feature->set(key, _double); break;
+            case INT:    feature->set(key, _int); break;
+            case STRING: feature->set(key, _string); break;
+            default: break;
+            }
 
-    osgEarth::Symbology::PointSet *geometry = new osgEarth::Symbology::PointSet();
+            // Special path for getting heights from our test dataset.
+            if (key == "other_tags" && _type == STRING)
+            {
+                StringTokenizer tok("=>");
+                StringVector tized;
+                tok.tokenize(_string, tized);
+                if (tized.size() == 3)
+                {
+                    if (tized[0] == "height")
+                    {
+                        // Remove quotes from the height
+                        float height = as<float>(tized[2], FLT_MAX);
+                        if (height != FLT_MAX)
+                        {
+                            feature->set("height", height);
+                        }
+                    }
+                }
+            }
+        }
+    };
 
-    for (int k = 0; k < feature.geometry_size();)
+    /**
+     * Maps tile coordinates (y down) to the key's extent.
+     */
+    struct TileTransform
     {
-        if (!length)
+        double _x0, _y0, _sx, _sy;
+
+        TileTransform(const TileKey& key, unsigned tileres)
         {
-            unsigned int cmd_length = feature.geometry(k++);
-            cmd = cmd_length & ((1 << cmd_bits) - 1);
-            length = cmd_length >> cmd_bits;
+            const GeoExtent& e = key.getExtent();
+            double res = tileres > 0 ? (double)tileres : 4096.0;
+            _x0 = e.xMin();
+            _y0 = e.yMax();
+            _sx = e.width() / res;
+            _sy = e.height() / res;
         }
-        if (length > 0)
+
+        osg::Vec3d operator()(int x, int y) const
         {
-            length--;
-            if (cmd == SEG_MOVETO || cmd == SEG_LINETO)
+            return osg::Vec3d(_x0 + _sx*(double)x, _y0 - _sy*(double)y, 0.0);
+        }
+    };
+
+    Geometry* decodeLine(const std::vector<uint32_t>& geom, const TileTransform& xform)
+    {
+        std::vector< osg::ref_ptr< osgEarth::Symbology::LineString > > lines;
+        osgEarth::Symbology::LineString* currentLine = 0L;
+
+        int x = 0, y = 0;
+        unsigned k = 0;
+        while (k < geom.size())
+        {
+            unsigned cmd = geom[k] & ((1 << CMD_BITS) - 1);
+            unsigned count = geom[k] >> CMD_BITS;
+            ++k;
+
+            if (cmd == CMD_MOVETO || cmd == CMD_LINETO)
             {
-                int px = feature.geometry(k++);
-                int py = feature.geometry(k++);
-                px = zig_zag_decode(px);
-                py = zig_zag_decode(py);
+                if (cmd == CMD_MOVETO || !currentLine)
+                {
+                    currentLine = new osgEarth::Symbology::LineString();
+                    lines.push_back( currentLine );
+                }
+                currentLine->reserve(currentLine->size() + count);
 
-                x += px;
-                y += py;
+                for (unsigned c = 0; c < count && k+1 < geom.size(); ++c, k += 2)
+                {
+                    x += zig_zag_decode(geom[k]);
+                    y += zig_zag_decode(geom[k+1]);
+                    currentLine->push_back(xform(x, y));
 
-                double width = key.getExtent().width();
-                double height = key.getExtent().height();
+                    // each MoveTo point starts a new line
+                    if (cmd == CMD_MOVETO && c+1 < count)
+                    {
+                        currentLine = new osgEarth::Symbology::LineString();
+                        lines.push_back( currentLine );
+                    }
+                }
+            }
+        }
 
-                double geoX = key.getExtent().xMin() + (width/(double)tileres) * (double)x;
-                double geoY = key.getExtent().yMax() - (height/(double)tileres) * (double)y;
-                geometry->push_back(geoX, geoY, 0);
+        if (lines.size() == 0)
+        {
+            return 0;
+        }
+        else if (lines.size() == 1)
+        {
+            // Just return a simple LineString
+            return lines[0].release();
+        }
+        else
+        {
+            // Return a multilinestring
+            MultiGeometry* multi = new MultiGeometry;
+            for (unsigned int i = 0; i < lines.size(); i++)
+            {
+                multi->add(lines[i].get());
             }
+            return multi;
         }
     }
 
-    return geometry;
-}
+    Geometry* decodePoint(const std::vector<uint32_t>& geom, const TileTransform& xform)
+    {
+        osgEarth::Symbology::PointSet *geometry = new osgEarth::Symbology::PointSet();
 
-Geometry* decodePolygon(const mapnik::vector::tile_feature& feature, const  TileKey& key, unsigned int tileres)
-{
-    /*
-     https://github.com/mapbox/vector-tile-spec/tree/master/2.1
-     Decoding polygons is a bit more difficult than lines or points.
-     A Polygon geometry is either a single polygon or a multipolygon.  Each polygon has one exterior ring and zero or more interior rings.
-     The rings are in sequence and you must check the orientation of the ring to know if it's an exterior ring (new polygon) or an
-     interior ring (inner polygon of the current polygon).
-     */
+        int x = 0, y = 0;
+        unsigned k = 0;
+        while (k < geom.size())
+        {
+            unsigned cmd = geom[k] & ((1 << CMD_BITS) - 1);
+            unsigned count = geom[k] >> CMD_BITS;
+            ++k;
 
+            if (cmd == CMD_MOVETO || cmd == CMD_LINETO)
+            {
+                geometry->reserve(geometry->size() + count);
+                for (unsigned c = 0; c < count && k+1 < geom.size(); ++c, k += 2)
+                {
+                    x += zig_zag_decode(geom[k]);
+                    y += zig_zag_decode(geom[k+1]);
+                    geometry->push_back(xform(x, y));
+                }
+            }
+        }
 
-    unsigned int length = 0;
-    int cmd = -1;
-    const int cmd_bits = 3;
+        return geometry;
+    }
 
-    int x = 0;
-    int y = 0;
+    Geometry* decodePolygon(const std::vector<uint32_t>& geom, const TileTransform& xform)
+    {
+        /*
+         Decoding polygons is a bit more difficult than lines or points.
+         A Polygon geometry is either a single polygon or a multipolygon.  Each polygon has one exterior ring and zero or more interior rings.
+         The rings are in sequence and you must check the orientation of the ring to know if it's an exterior ring (new polygon) or an
+         interior ring (inner polygon of the current polygon).
+         */
 
-    // The list of polygons we've collected
-    std::vector< osg::ref_ptr< osgEarth::Symbology::Polygon > > polygons;
+        // The list of polygons we've collected
+        std::vector< osg::ref_ptr< osgEarth::Symbology::Polygon > > polygons;
 
-    osg::ref_ptr< osgEarth::Symbology::Polygon > currentPolygon;
+        osg::ref_ptr< osgEarth::Symbology::Polygon > currentPolygon;
 
-    osg::ref_ptr< osgEarth::Symbology::Ring > currentRing;
+        osg::ref_ptr< osgEarth::Symbology::Ring > currentRing;
 
-    for (int k = 0; k < feature.geometry_size();)
-    {
-        if (!length)
+        int x = 0, y = 0;
+        unsigned k = 0;
+        while (k < geom.size())
         {
-            unsigned int cmd_length = feature.geometry(k++);
-            cmd = cmd_length & ((1 << cmd_bits) - 1);
-            length = cmd_length >> cmd_bits;
-        }
-        if (length > 0)
-        {
-            length--;
-            if (cmd == SEG_MOVETO || cmd == SEG_LINETO)
+            unsigned cmd = geom[k] & ((1 << CMD_BITS) - 1);
+            unsigned count = geom[k] >> CMD_BITS;
+            ++k;
+
+            if (cmd == CMD_MOVETO || cmd == CMD_LINETO)
             {
-                if (!currentRing)
+                if (!currentRing.valid())
                 {
                     currentRing = new osgEarth::Symbology::Ring();
                 }
+                currentRing->reserve(currentRing->size() + count);
 
-                int px = feature.geometry(k++);
-                int py = feature.geometry(k++);
-                px = zig_zag_decode(px);
-                py = zig_zag_decode(py);
-
-                x += px;
-                y += py;
-
-                double width = key.getExtent().width();
-                double height = key.getExtent().height();
-
-                double geoX = key.getExtent().xMin() + (width/(double)tileres) * (double)x;
-                double geoY = key.getExtent().yMax() - (height/(double)tileres) * (double)y;
-                currentRing->push_back(geoX, geoY, 0);
+                for (unsigned c = 0; c < count && k+1 < geom.size(); ++c, k += 2)
+                {
+                    x += zig_zag_decode(geom[k]);
+                    y += zig_zag_decode(geom[k+1]);
+                    currentRing->push_back(xform(x, y));
+                }
             }
-            else if (cmd == (SEG_CLOSE & ((1 << cmd_bits) - 1)))
+            else if (cmd == CMD_CLOSEPATH && currentRing.valid())
             {
                 // The orientation is the opposite of what we want for features.  clockwise means exterior ring, counter clockwise means interior
 
@@ -281,42 +470,116 @@ Geometry* decodePolygon(const mapnik::vector::tile_feature& feature, const  Tile
                 currentRing = 0;
             }
         }
-    }
-
-    currentRing = 0;
-    currentPolygon = 0;
 
-    if (polygons.size() == 0)
-    {
-        return 0;
-    }
-    else if (polygons.size() == 1)
-    {
-        // Just return a simple polygon
-        return polygons[0].release();
+        if (polygons.size() == 0)
+        {
+            return 0;
+        }
+        else if (polygons.size() == 1)
+        {
+            // Just return a simple polygon
+            return polygons[0].release();
+        }
+        else
+        {
+            // Return a multipolygon
+            MultiGeometry* multi = new MultiGeometry;
+            for (unsigned int i = 0; i < polygons.size(); i++)
+            {
+                multi->add(polygons[i].get());
+            }
+            return multi;
+        }
     }
-    else
+
+    bool readLayer(PBReader layerMsg, const TileKey& key, FeatureList& features)
     {
-        // Return a multipolygon
-        MultiGeometry* multi = new MultiGeometry;
-        for (unsigned int i = 0; i < polygons.size(); i++)
+        // Fields can come in any order, so find the tables before the features.
+        std::string name;
+        std::vector<PBReader> featureMsgs;
+        std::vector<std::string> keys;
+        std::vector<LazyValue> values;
+        unsigned extent = 4096;
+
+        unsigned field, type;
+        while (layerMsg.next(field, type))
         {
-            multi->add(polygons[i].get());
+            if      (field == 1 && type == WIRE_LENGTH) name = layerMsg.string();
+            else if (field == 2 && type == WIRE_LENGTH) featureMsgs.push_back(layerMsg.message());
+            else if (field == 3 && type == WIRE_LENGTH) keys.push_back(layerMsg.string());
+            else if (field == 4 && type == WIRE_LENGTH) values.push_back(LazyValue(layerMsg.message()));
+            else if (field == 5 && type == WIRE_VARINT) extent = (unsigned)layerMsg.varint();
+            else layerMsg.skip(type);
         }
-        return multi;
+        if (!layerMsg.ok())
+            return false;
+
+        TileTransform xform(key, extent);
+        const SpatialReference* srs = key.getProfile()->getSRS();
+
+        std::vector<uint32_t> tags, geom;
+
+        for (unsigned j = 0; j < featureMsgs.size(); ++j)
+        {
+            PBReader& f = featureMsgs[j];
+            eGeomType geomType = Unknown;
+            tags.clear();
+            geom.clear();
+
+            while (f.next(field, type))
+            {
+                if      (field == 2) f.uints(type, tags);
+                else if (field == 3 && type == WIRE_VARINT) geomType = static_cast<eGeomType>(f.varint());
+                else if (field == 4) f.uints(type, geom);
+                else f.skip(type);
+            }
+            if (!f.ok())
+                return false;
+
+            osg::ref_ptr< osgEarth::Symbology::Geometry > geometry;
+            if (geomType == ::Polygon)
+            {
+                geometry = decodePolygon(geom, xform);
+            }
+            else if (geomType == ::Point)
+            {
+                geometry = decodePoint(geom, xform);
+            }
+            else
+            {
+                geometry = decodeLine(geom, xform);
+            }
+
+            if (!geometry.valid())
+                continue;
+
+            osg::ref_ptr< Feature > oeFeature = new Feature(geometry.get(), srs);
+
+            // Set the layer name as "mvt_layer" so we can filter it later
+            oeFeature->set("mvt_layer", name);
+
+            // Read attributes
+            for (unsigned k = 0; k+1 < tags.size(); k += 2)
+            {
+                if (tags[k] < keys.size() && tags[k+1] < values.size())
+                {
+                    values[tags[k+1]].apply(oeFeature.get(), keys[tags[k]]);
+                }
+            }
+
+            features.push_back(oeFeature.get());
+        }
+
+        return true;
     }
 }
 
-#endif
-
 
 bool
     MVT::read(std::istream& in, const TileKey& key, FeatureList& features)
 {
     features.clear();
 
-#ifdef OSGEARTH_HAVE_MVT
-
     // Get the compressor
     osg::ref_ptr< osgDB::BaseCompressor> compressor = osgDB::Registry::instance()->getObjectWrapperManager()->findCompressor("zlib");
     if (!compressor.valid())
@@ -326,131 +589,36 @@ bool
 
     // Decompress the tile
     std::string original((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
-    in.seekg (0, std::ios::beg);
     std::string value;
-    if (!compressor->decompress(in, value))
     {
-        value = original;
+        std::istringstream compressed(original);
+        if (!compressor->decompress(compressed, value))
+        {
+            value.swap(original);
+        }
     }
 
-
-    mapnik::vector::tile tile;
-
-    if (tile.ParseFromString(value))
+    PBReader tile(value.data(), value.size());
+    unsigned field, type;
+    bool ok = true;
+    while (ok && tile.next(field, type))
     {
-        for (unsigned int i = 0; i < tile.layers().size(); i++)
+        if (field == 3 && type == WIRE_LENGTH)
         {
-            const mapnik::vector::tile_layer &layer = tile.layers().Get(i);
-
-
-            for (unsigned int j = 0; j < layer.features().size(); j++)
-            {
-                const mapnik::vector::tile_feature &feature = layer.features().Get(j);
-
-
-                osg::ref_ptr< Feature > oeFeature = new Feature(0, key.getProfile()->getSRS());
-
-                // Set the layer name as "mvt_layer" so we can filter it later
-                oeFeature->set("mvt_layer", layer.name());
-
-                // Read attributes
-                for (unsigned int k = 0; k < feature.tags().size(); k+=2)
-                {
-                    std::string key = layer.keys().Get(feature.tags().Get(k));
-                    mapnik::vector::tile_value value = layer.values().Get(feature.tags().Get(k+1));
-
-                    if (value.has_bool_value())
-                    {
-                        oeFeature->set(key, value.bool_value());
-                    }
-                    else if (value.has_double_value())
-                    {
-                        oeFeature->set(key, value.double_value());
-                    }
-                    else if (value.has_float_value())
-                    {
-                        oeFeature->set(key, value.float_value());
-                    }
-                    else if (value.has_int_value())
-                    {
-                        oeFeature->set(key, (int)value.int_value());
-                    }
-                    else if (value.has_sint_value())
-                    {
-                        oeFeature->set(key, (int)value.sint_value());
-                    }
-                    else if (value.has_string_value())
-                    {
-                        oeFeature->set(key, value.string_value());
-                    }
-                    else if (value.has_uint_value())
-                    {
-                        oeFeature->set(key, (int)value.uint_value());
-                    }
-
-                    // Special path for getting heights from our test dataset.
-                    if (key == "other_tags")
-                    {
-                        std::string other_tags = value.string_value();
-
-                        StringTokenizer tok("=>");
-                        StringVector tized;
-                        tok.tokenize(other_tags, tized);
-                        if (tized.size() == 3)
-                        {
-                            if (tized[0] == "height")
-                            {
-                                std::string value = tized[2];
-                                // Remove quotes from the height
-                                float height = as<float>(value, FLT_MAX);
-                                if (height != FLT_MAX)
-                                {
-                                    oeFeature->set("height", height);
-                                }
-                            }
-                        }
-                    }
-                }
-
-
-
-                osg::ref_ptr< osgEarth::Symbology::Geometry > geometry;
-
-                eGeomType geomType = static_cast<eGeomType>(feature.type());
-                if (geomType == ::Polygon)
-                {
-                    geometry = decodePolygon(feature, key, layer.extent());
-                }
-                else if (geomType == ::LineString)
-                {
-                    geometry = decodeLine(feature, key, layer.extent());
-                }
-                else if (geomType == ::Point)
-                {
-                    geometry = decodePoint(feature, key, layer.extent());
-                }
-                else
-                {
-                    geometry = decodeLine(feature, key, layer.extent());
-                }
-
-                if (geometry)
-                {
-                    oeFeature->setGeometry( geometry.get() );
-                    features.push_back(oeFeature.get());
-                }
-            }
+            PBReader layer = tile.message();
+            ok = tile.ok() && readLayer(layer, key, features);
+        }
+        else
+        {
+            tile.skip(type);
         }
     }
-    else
+
+    if (!ok || !tile.ok())
     {
         OE_WARN << "Failed to parse mvt" << key.str() << std::endl;
         return false;
     }
 
     return true;
-#else
-    OE_NOTICE << "Mapnik Vector Tiles NOT SUPPORTED - please compile osgEarth with protobuf to enable." << std::endl;
-    return false;
-#endif
 }
@@ -308,22 +308,23 @@ OgrUtils::createOgrGeometry(const osgEarth::Symbology::Geometry* geometry, OGRwk
 Feature*
 OgrUtils::createFeature(OGRFeatureH handle, const FeatureProfile* profile)
 {
-    Feature* f = 0L;
-    if ( profile )
-    {
-        f = createFeature( handle, profile->getSRS() );
-        if ( f && profile->geoInterp().isSet() )
-            f->geoInterp() = profile->geoInterp().get();
-    }
-    else
-    {
-        f = createFeature( handle, (const SpatialReference*)0L );
-    }
+    Feature* f = createFeature( handle, profile ? profile->getSRS() : 0L, 0L );
+    if ( f && profile && profile->geoInterp().isSet() )
+        f->geoInterp() = profile->geoInterp().get();
     return f;
-}            
+}
+
+Feature*
+OgrUtils::createFeature(OGRFeatureH handle, const FeatureProfile* profile, const std::vector<int>& fields)
+{
+    Feature* f = createFeature( handle, profile ? profile->getSRS() : 0L, &fields );
+    if ( f && profile && profile->geoInterp().isSet() )
+        f->geoInterp() = profile->geoInterp().get();
+    return f;
+}
 
 Feature*
-OgrUtils::createFeature( OGRFeatureH handle, const SpatialReference* srs )
+OgrUtils::createFeature( OGRFeatureH handle, const SpatialReference* srs, const std::vector<int>* fields )
 {
     long fid = OGR_F_GetFID( handle );
 
@@ -338,63 +339,67 @@ OgrUtils::createFeature( OGRFeatureH handle, const SpatialReference* srs )
 
     Feature* feature = new Feature( geom, srs, Style(), fid );
 
-    int numAttrs = OGR_F_GetFieldCount(handle); 
-    for (int i = 0; i < numAttrs; ++i) 
+    // read the requested fields, or all of them.
+    int numAttrs = fields ? (int)fields->size() : OGR_F_GetFieldCount(handle);
+    for (int n = 0; n < numAttrs; ++n) 
     { 
+        int i = fields ? (*fields)[n] : n;
+
         OGRFieldDefnH field_handle_ref = OGR_F_GetFieldDefnRef( handle, i ); 
+        if ( !field_handle_ref )
+            continue;
 
         // get the field name and convert to lower case:
         const char* field_name = OGR_Fld_GetNameRef( field_handle_ref ); 
         std::string name = osgEarth::toLower( std::string(field_name) );
 
-        // get the field type and set the value appropriately
-        OGRFieldType field_type = OGR_Fld_GetType( field_handle_ref );        
-        switch( field_type )
+        AttributeValue value;
+        getAttributeValue( handle, i, value );
+
+        if ( value.second.set )
         {
-        case OFTInteger:
-            {     
-                if (IsFieldSet( handle, i ))
-                {
-                    int value = OGR_F_GetFieldAsInteger( handle, i );
-                    feature->set( name, value );                    
-                }
-                else
-                {
-                    feature->setNull( name, ATTRTYPE_INT );
-                }
-            }
-            break;
-        case OFTReal:
-            {
-                if (IsFieldSet( handle, i ))
-                {
-                    double value = OGR_F_GetFieldAsDouble( handle, i );
-                    feature->set( name, value );
-                }
-                else
-                {
-                    feature->setNull( name, ATTRTYPE_DOUBLE );
-                }
-            }
-            break;
-        default:
+            switch( value.first )
             {
-                if (IsFieldSet( handle, i ))
-                {
-                    const char* value = OGR_F_GetFieldAsString(handle, i);
-                    feature->set( name, std::string(value) );
-                }
-                else
-                {
-                    feature->setNull( name, ATTRTYPE_STRING );
-                }
+            case ATTRTYPE_INT:    feature->set( name, value.second.intValue ); break;
+            case ATTRTYPE_DOUBLE: feature->set( name, value.second.doubleValue ); break;
+            default:              feature->set( name, value.second.stringValue );
             }
         }
+        else
+        {
+            feature->setNull( name, value.first );
+        }
     } 
 
     return feature;
 }
 
+void
+OgrUtils::getAttributeValue( OGRFeatureH handle, int i, AttributeValue& out )
+{
+    OGRFieldDefnH field_handle_ref = OGR_F_GetFieldDefnRef( handle, i ); 
+    OGRFieldType field_type = OGR_Fld_GetType( field_handle_ref );        
+
+    out.second.set = IsFieldSet( handle, i );
+
+    // get the field type and set the value appropriately
+    switch( field_type )
+    {
+    case OFTInteger:
+        out.first = ATTRTYPE_INT;
+        out.second.intValue = out.second.set ? OGR_F_GetFieldAsInteger( handle, i ) : 0;
+        break;
+    case OFTReal:
+        out.first = ATTRTYPE_DOUBLE;
+        out.second.doubleValue = out.second.set ? OGR_F_GetFieldAsDouble( handle, i ) : 0.0;
+        break;
+    default:
+        out.first = ATTRTYPE_STRING;
+        if ( out.second.set )
+            out.second.stringValue = OGR_F_GetFieldAsString( handle, i );
+    }
+}
+
 AttributeType
 OgrUtils::getAttributeType( OGRFieldType type )
 {
@@ -19,9 +19,13 @@
 #include <osgEarthFeatures/ResampleFilter>
 #include <osgEarthFeatures/FilterContext>
 #include <osgEarth/GeoMath>
+#include <osgEarth/JobScheduler>
+#include <osgEarth/Random>
+#include <osgEarth/Registry>
 #include <osg/io_utils>
-#include <list>
-#include <cstdlib>
+
+// Number of features each resampling job handles.
+#define FEATURES_PER_JOB 64u
 
 using namespace osgEarth;
 using namespace osgEarth::Features;
@@ -55,6 +59,29 @@ ResampleFilterOptions( conf )
 }
 
 
+namespace
+{
+    /**
+     * Resamples a run of features on a job thread.
+     */
+    struct ResampleJob : public TaskRequest
+    {
+        ResampleJob(ResampleFilter* filter, FilterContext& context) :
+            _filter ( filter ),
+            _context( context ) { }
+
+        void operator()(ProgressCallback* progress)
+        {
+            for( unsigned i = 0; i < _features.size(); ++i )
+                _filter->push( _features[i], _context );
+        }
+
+        ResampleFilter*       _filter;
+        FilterContext&        _context;
+        std::vector<Feature*> _features;
+    };
+}
+
 bool
 ResampleFilter::push( Feature* input, FilterContext& context )
 {
@@ -63,6 +90,15 @@ ResampleFilter::push( Feature* input, FilterContext& context )
 
     bool success = true;
 
+    // perturbation draws from a sequence seeded by the feature, so the
+    // result doesn't depend on which thread resamples it.
+    Random prng( (unsigned)input->getFID() * 2654435761u, Random::METHOD_FAST );
+
+    const ResampleMode mode = resampleMode().value();
+    const bool geodetic = mode == RESAMPLE_GREATCIRCLE || mode == RESAMPLE_RHUMB;
+
+    std::vector<osg::Vec3d> output;
+
     GeometryIterator i( input->getGeometry() );
     while( i.hasMore() )
     {        
@@ -70,34 +106,23 @@ ResampleFilter::push( Feature* input, FilterContext& context )
 
         if ( part->size() < 2 ) continue;
 
-        unsigned int origSize = part->size();
+        const unsigned size = part->size();
 
-        // whether to resample the virtual segment that closes an open ring:
-        bool loop =
-            part->getComponentType() == Geometry::TYPE_RING &&
-            static_cast<Ring*>(part)->isOpen();
+        output.clear();
+        output.reserve( size );
+        output.push_back( (*part)[0] );
 
-        // copy the original part to a linked list. use a std::list since insert/erase
-        // will not invalidate iterators.
-        std::list<osg::Vec3d> plist;
-        plist.insert( plist.begin(), part->begin(), part->end() );
-
-        std::list<osg::Vec3d>::iterator v1 = plist.begin(); ++v1;
-        std::list<osg::Vec3d>::iterator v0 = plist.begin();
-        std::list<osg::Vec3d>::iterator last = plist.end(); --last;
-
-        while( v0 != last )
+        for( unsigned j = 1; j < size; ++j )
         {
-            bool increment = true;
-
-            osg::Vec3d& p0 = *v0;
-            osg::Vec3d& p1 = *v1;
-            bool lastSeg = v1 == last;
+            // the segment runs from the last point kept to the next original one:
+            const osg::Vec3d p0 = output.back();
+            const osg::Vec3d& p1 = (*part)[j];
+            bool lastSeg = j+1 == size;
             osg::Vec3d seg = p1 - p0;
 
             osg::Vec3d p0Rad, p1Rad;
 
-            if (resampleMode().value() == RESAMPLE_GREATCIRCLE || resampleMode().value() == RESAMPLE_RHUMB)
+            if ( geodetic )
             {
                 p0Rad = osg::Vec3d(osg::DegreesToRadians(p0.x()), osg::DegreesToRadians(p0.y()), p0.z());
                 p1Rad = osg::Vec3d(osg::DegreesToRadians(p1.x()), osg::DegreesToRadians(p1.y()), p1.z());
@@ -105,7 +130,7 @@ ResampleFilter::push( Feature* input, FilterContext& context )
                        
             //Compute the length of the segment
             double segLen = 0.0;
-            switch (resampleMode().value())
+            switch (mode)
             {
             case RESAMPLE_LINEAR:
                 segLen = seg.length();
@@ -118,61 +143,73 @@ ResampleFilter::push( Feature* input, FilterContext& context )
                 break;
             }
 
-            if ( segLen < _minLen.value() && !lastSeg && plist.size() > 2 )
+            // drop a point too close to the last one, as long as the part
+            // keeps at least two points:
+            if ( segLen < _minLen.value() && !lastSeg && output.size() + (size-j) > 2 )
             {
-                v1 = plist.erase( v1 );
-                increment = false;
+                continue;
             }
+
             else if ( segLen > _maxLen.value() )
             {
-                //Compute the number of divisions to make
+                // Split the whole segment at once into equal divisions:
                 int numDivs = (1 + (int)(segLen/_maxLen.value()));
                 double newSegLen = segLen/(double)numDivs;
                 seg.normalize();
-                osg::Vec3d newPt;
-                double newHeight;
-                switch (resampleMode().value())
+
+                double bearing = 0.0;
+                if ( mode == RESAMPLE_GREATCIRCLE )
+                    bearing = GeoMath::bearing(p0Rad.y(), p0Rad.x(), p1Rad.y(), p1Rad.x());
+                else if ( mode == RESAMPLE_RHUMB )
+                    bearing = GeoMath::rhumbBearing(p0Rad.y(), p0Rad.x(), p1Rad.y(), p1Rad.x());
+
+                output.reserve( output.size() + numDivs );
+
+                for( int d = 1; d < numDivs; ++d )
                 {
-                case RESAMPLE_LINEAR:
-                    {
-                        newPt = p0 + seg * newSegLen;
-                    }
-                    break;
-                case RESAMPLE_GREATCIRCLE:
+                    double dist = newSegLen * (double)d;
+                    osg::Vec3d newPt;
+                    switch (mode)
                     {
-                        double bearing = GeoMath::bearing(p0Rad.y(), p0Rad.x(), p1Rad.y(), p1Rad.x());
-                        double lat,lon;
-                        GeoMath::destination(p0Rad.y(), p0Rad.x(), bearing, newSegLen, lat, lon);
-                        newHeight = p0Rad.z() + ( p1Rad.z() - p0Rad.z() ) / (double)numDivs;
-                        newPt = osg::Vec3d(osg::RadiansToDegrees(lon), osg::RadiansToDegrees(lat), newHeight);
+                    case RESAMPLE_LINEAR:
+                        {
+                            newPt = p0 + seg * dist;
+                        }
+                        break;
+                    case RESAMPLE_GREATCIRCLE:
+                        {
+                            double lat,lon;
+                            GeoMath::destination(p0Rad.y(), p0Rad.x(), bearing, dist, lat, lon);
+                            double newHeight = p0Rad.z() + ( p1Rad.z() - p0Rad.z() ) * (double)d / (double)numDivs;
+                            newPt = osg::Vec3d(osg::RadiansToDegrees(lon), osg::RadiansToDegrees(lat), newHeight);
+                        }
+                        break;
+                    case RESAMPLE_RHUMB:
+                        {
+                            double lat,lon;
+                            GeoMath::rhumbDestination(p0Rad.y(), p0Rad.x(), bearing, dist, lat, lon);
+                            double newHeight = p0Rad.z() + ( p1Rad.z() - p0Rad.z() ) * (double)d / (double)numDivs;
+                            newPt = osg::Vec3d(osg::RadiansToDegrees(lon), osg::RadiansToDegrees(lat), newHeight);
+                        }
+                        break;
                     }
-                    break;
-                case RESAMPLE_RHUMB:
+
+                    if ( _perturbThresh.value() > 0.0 && _perturbThresh.value() < newSegLen )
                     {
-                        double bearing = GeoMath::rhumbBearing(p0Rad.y(), p0Rad.x(), p1Rad.y(), p1Rad.x());
-                        double lat,lon;
-                        GeoMath::rhumbDestination(p0Rad.y(), p0Rad.x(), bearing, newSegLen, lat, lon);
-                        newHeight = p0Rad.z() + ( p1Rad.z() - p0Rad.z() ) / (double)numDivs;
-                        newPt = osg::Vec3d(osg::RadiansToDegrees(lon), osg::RadiansToDegrees(lat), newHeight);
+                        float r = 0.5f - (float)prng.next();
+                        newPt.x() += r;
+                        newPt.y() += r;
                     }
-                    break;
-                }
-                
-                if ( _perturbThresh.value() > 0.0 && _perturbThresh.value() < newSegLen )
-                {
-                    float r = 0.5 - (float)::rand()/(float)RAND_MAX;
-                    newPt.x() += r;
-                    newPt.y() += r;
+
+                    output.push_back( newPt );
                 }
-                v1 = plist.insert( v1, newPt );
             }
 
-            if ( increment ) { ++v0; ++v1; }
+            output.push_back( p1 );
         }
 
         part->clear();
-        part->reserve( plist.size() );
-        part->insert( part->begin(), plist.begin(), plist.end() );
+        part->insert( part->begin(), output.begin(), output.end() );
     }
     return success;
 }
@@ -187,10 +224,27 @@ ResampleFilter::push( FeatureList& input, FilterContext& context )
         return context;
     }
 
-    bool ok = true;
+    // split the features into jobs and resample them in parallel:
+    std::vector< osg::ref_ptr<ResampleJob> > jobs;
     for( FeatureList::iterator i = input.begin(); i != input.end(); ++i )
-        if ( !push( i->get(), context ) )
-            ok = false;
+    {
+        if ( jobs.empty() || jobs.back()->_features.size() >= FEATURES_PER_JOB )
+            jobs.push_back( new ResampleJob(this, context) );
+        jobs.back()->_features.push_back( i->get() );
+    }
+
+    if ( jobs.size() == 1 )
+    {
+        (*jobs[0])( 0L );
+    }
+    else if ( jobs.size() > 1 )
+    {
+        JobScheduler* scheduler = Registry::instance()->getJobScheduler();
+        osg::ref_ptr<JobGroup> group = new JobGroup();
+        for( unsigned j = 0; j < jobs.size(); ++j )
+            scheduler->submit( jobs[j].get(), JobScheduler::LANE_NORMAL, group.get() );
+        scheduler->join( group.get() );
+    }
 
     return context;
 }
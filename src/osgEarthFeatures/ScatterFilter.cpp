@@ -19,16 +19,160 @@
 #include <osgEarthFeatures/ScatterFilter>
 #include <osgEarthFeatures/FilterContext>
 #include <osgEarth/GeoMath>
+#include <osgEarth/JobScheduler>
+#include <osgEarth/Registry>
+#include <algorithm>
 #include <stdlib.h>
 
 #define LC "[ScatterFilter] "
 
+// Number of features each scattering job handles.
+#define FEATURES_PER_JOB 64u
+
+// Fewest instances in a polygon before building a grid to test them against.
+#define MIN_INSTANCES_FOR_GRID 64u
+
 using namespace osgEarth;
 using namespace osgEarth::Features;
 using namespace osgEarth::Symbology;
 
 //------------------------------------------------------------------------
 
+namespace
+{
+    /**
+     * Grid over a polygon's bounds that knows which cells lie wholly inside
+     * or outside it. A point in one of those is answered from the grid; only
+     * a point in a cell that an edge passes through takes the full
+     * Polygon::contains2D test. Until it's built, every point does.
+     */
+    class PolygonGrid
+    {
+    public:
+        PolygonGrid(const Polygon* polygon) :
+            _polygon( polygon ), _x0(0.0), _y0(0.0), _cols(0u), _rows(0u), _dx(0.0), _dy(0.0) { }
+
+        void build(const Bounds& bounds, unsigned cells)
+        {
+            _x0 = bounds.xMin();
+            _y0 = bounds.yMin();
+            _cols = _rows = cells;
+            _dx = bounds.width() / (double)cells;
+            _dy = bounds.height() / (double)cells;
+            _cells.assign( cells*cells, OUTSIDE );
+
+            if ( _dx <= 0.0 || _dy <= 0.0 )
+            {
+                _cells.clear();
+                return;
+            }
+
+            std::vector<const Ring*> rings;
+            rings.push_back( _polygon );
+            for( RingCollection::const_iterator h = _polygon->getHoles().begin(); h != _polygon->getHoles().end(); ++h )
+                rings.push_back( h->get() );
+
+            // any cell in the bounding box of an edge may contain part of it:
+            for( unsigned r = 0; r < rings.size(); ++r )
+            {
+                const Ring& ring = *rings[r];
+                for( unsigned i = 0, j = ring.size()-1; i < ring.size(); j = i++ )
+                {
+                    unsigned c0 = col( osg::minimum(ring[i].x(), ring[j].x()) );
+                    unsigned c1 = col( osg::maximum(ring[i].x(), ring[j].x()) );
+                    unsigned r0 = row( osg::minimum(ring[i].y(), ring[j].y()) );
+                    unsigned r1 = row( osg::maximum(ring[i].y(), ring[j].y()) );
+                    for( unsigned y = r0; y <= r1; ++y )
+                        for( unsigned x = c0; x <= c1; ++x )
+                            _cells[y*_cols + x] = EDGE;
+                }
+            }
+
+            // classify the rest by casting one ray along each row; this
+            // counts crossings the same way Ring::contains2D does.
+            std::vector<double> crossings;
+            for( unsigned y = 0; y < _rows; ++y )
+            {
+                double cy = _y0 + ((double)y + 0.5) * _dy;
+
+                crossings.clear();
+                for( unsigned r = 0; r < rings.size(); ++r )
+                {
+                    const Ring& ring = *rings[r];
+                    for( unsigned i = 0, j = ring.size()-1; i < ring.size(); j = i++ )
+                    {
+                        const osg::Vec3d& a = ring[i];
+                        const osg::Vec3d& b = ring[j];
+                        if ( (a.y() <= cy && cy < b.y()) || (b.y() <= cy && cy < a.y()) )
+                            crossings.push_back( (b.x()-a.x()) * (cy-a.y()) / (b.y()-a.y()) + a.x() );
+                    }
+                }
+                std::sort( crossings.begin(), crossings.end() );
+
+                for( unsigned x = 0; x < _cols; ++x )
+                {
+                    unsigned char& cell = _cells[y*_cols + x];
+                    if ( cell != EDGE )
+                    {
+                        // crossings to the right of the center: odd means inside.
+                        double cx = _x0 + ((double)x + 0.5) * _dx;
+                        size_t right = crossings.end() - std::upper_bound( crossings.begin(), crossings.end(), cx );
+                        cell = (right & 1) ? INSIDE : OUTSIDE;
+                    }
+                }
+            }
+        }
+
+        bool contains2D(double x, double y) const
+        {
+            if ( _cells.empty() )
+                return _polygon->contains2D( x, y );
+
+            unsigned char cell = _cells[row(y)*_cols + col(x)];
+            return
+                cell == INSIDE ? true :
+                cell == OUTSIDE ? false :
+                _polygon->contains2D( x, y );
+        }
+
+    private:
+        enum { OUTSIDE, INSIDE, EDGE };
+
+        unsigned col(double x) const {
+            return (unsigned)osg::clampBetween( (int)((x-_x0)/_dx), 0, (int)_cols-1 );
+        }
+
+        unsigned row(double y) const {
+            return (unsigned)osg::clampBetween( (int)((y-_y0)/_dy), 0, (int)_rows-1 );
+        }
+
+        const Polygon*             _polygon;
+        double                     _x0, _y0;
+        unsigned                   _cols, _rows;
+        double                     _dx, _dy;
+        std::vector<unsigned char> _cells;
+    };
+
+    /**
+     * Scatters a run of features on a job thread.
+     */
+    struct ScatterJob : public TaskRequest
+    {
+        ScatterJob(const ScatterFilter* filter, const FilterContext& context) :
+            _filter ( filter ),
+            _context( context ) { }
+
+        void operator()(ProgressCallback* progress)
+        {
+            for( unsigned i = 0; i < _features.size(); ++i )
+                _filter->scatter( _features[i], _context );
+        }
+
+        const ScatterFilter*  _filter;
+        const FilterContext&  _context;
+        std::vector<Feature*> _features;
+    };
+}
 
 //------------------------------------------------------------------------
 
@@ -44,7 +188,8 @@ void
 ScatterFilter::polyScatter(const Geometry*         input,
                            const SpatialReference* inputSRS,
                            const FilterContext&    context,
-                           PointSet*               output )
+                           Random&                 prng,
+                           PointSet*               output ) const
 {
     Bounds bounds;
     double areaSqKm = 0.0;
@@ -78,6 +223,15 @@ ScatterFilter::polyScatter(const Geometry*         input,
         if ( numInstancesInBoundingRect == 0 )
             continue;
 
+        // Big polygons test their candidates against a grid; about four
+        // candidates per cell keeps it cheap to build.
+        PolygonGrid grid( polygon );
+        if ( numInstancesInBoundingRect >= MIN_INSTANCES_FOR_GRID )
+        {
+            unsigned cells = osg::minimum( (unsigned)(0.5*sqrt((double)numInstancesInBoundingRect)), 256u );
+            grid.build( bounds, cells );
+        }
+
         if ( _random )
         {
             // Random scattering. Note, we try to place as many instances as would
@@ -86,12 +240,10 @@ ScatterFilter::polyScatter(const Geometry*         input,
             // be correct.
             for( unsigned j=0; j<numInstancesInBoundingRect; ++j )
             {
-                double x = bounds.xMin() + _prng.next() * bounds.width();
-                double y = bounds.yMin() + _prng.next() * bounds.height();
+                double x = bounds.xMin() + prng.next() * bounds.width();
+                double y = bounds.yMin() + prng.next() * bounds.height();
 
-                bool include = true;
-
-                if ( include && polygon->contains2D( x, y ) )
+                if ( grid.contains2D( x, y ) )
                     output->push_back( osg::Vec3d(x, y, zMin) );
             }
         }
@@ -111,9 +263,7 @@ ScatterFilter::polyScatter(const Geometry*         input,
             {
                 for( double cx = bounds.xMin(); cx <= bounds.xMax(); cx += interval )
                 {
-                    bool include = true;
-
-                    if ( include && polygon->contains2D( cx, cy ) )
+                    if ( grid.contains2D( cx, cy ) )
                         output->push_back( osg::Vec3d(cx, cy, zMin) );
                 }
             }
@@ -125,7 +275,8 @@ void
 ScatterFilter::lineScatter(const Geometry*         input,
                            const SpatialReference* inputSRS,
                            const FilterContext&    context,
-                           PointSet*               output )
+                           Random&                 prng,
+                           PointSet*               output ) const
 {
     // calculate the number of instances per linear km.
     float instPerKm = sqrt( osg::clampAbove( 0.1f, _density ) );
@@ -172,9 +323,10 @@ ScatterFilter::lineScatter(const Geometry*         input,
                 osg::Vec3d unit = p1-p0;
                 unit.normalize();
 
+                output->reserve( output->size() + numInstances );
                 for( unsigned n=0; n<numInstances; ++n )
                 {
-                    double offset = _prng.next() * seglen_native;
+                    double offset = prng.next() * seglen_native;
                     output->push_back( p0 + unit*offset );
                 }
             }
@@ -182,6 +334,41 @@ ScatterFilter::lineScatter(const Geometry*         input,
     }
 }
 
+void
+ScatterFilter::scatter(Feature* f, const FilterContext& context) const
+{
+    Geometry* geom = f ? f->getGeometry() : 0L;
+    if ( !geom )
+        return;
+
+    // seed from the feature so the randomness is the same each time,
+    // regardless of the order in which features run.
+    unsigned long fid = f->getFID();
+    unsigned seed = _randomSeed ^ ((unsigned)fid * 2654435761u) ^ (unsigned)(fid >> 16 >> 16);
+    Random prng( seed, Random::METHOD_FAST );
+
+    const SpatialReference* geomSRS = context.profile()->getSRS();
+
+    osg::ref_ptr< PointSet > points = new PointSet();
+
+    if ( geom->getComponentType() == Geometry::TYPE_POLYGON )
+    {
+        polyScatter( geom, geomSRS, context, prng, points.get() );
+    }
+    else if (
+        geom->getComponentType() == Geometry::TYPE_LINESTRING ||
+        geom->getComponentType() == Geometry::TYPE_RING )            
+    {
+        lineScatter( geom, geomSRS, context, prng, points.get() );
+    }
+    else {            
+        points = static_cast< PointSet*>(geom->cloneAs(Geometry::TYPE_POINTSET));
+    }
+
+    // replace the source geometry with the scattered points.
+    f->setGeometry( points.get() );
+}
+
 FilterContext
 ScatterFilter::push(FeatureList& features, FilterContext& context )
 {
@@ -190,37 +377,26 @@ ScatterFilter::push(FeatureList& features, FilterContext& context )
         return context;
     }
 
-    // seed the random number generator so the randomness is the same each time
-    _prng = Random( _randomSeed, Random::METHOD_FAST );
-
+    // split the features into jobs and scatter them in parallel:
+    std::vector< osg::ref_ptr<ScatterJob> > jobs;
     for( FeatureList::iterator i = features.begin(); i != features.end(); ++i )
     {
-        Feature* f = i->get();
-        
-        Geometry* geom = f->getGeometry();
-        if ( !geom )
-            continue;
-
-        const SpatialReference* geomSRS = context.profile()->getSRS();
-
-        osg::ref_ptr< PointSet > points = new PointSet();
-
-        if ( geom->getComponentType() == Geometry::TYPE_POLYGON )
-        {
-            polyScatter( geom, geomSRS, context, points.get() );
-        }
-        else if (
-            geom->getComponentType() == Geometry::TYPE_LINESTRING ||
-            geom->getComponentType() == Geometry::TYPE_RING )            
-        {
-            lineScatter( geom, geomSRS, context, points.get() );
-        }
-        else {            
-            points = static_cast< PointSet*>(geom->cloneAs(Geometry::TYPE_POINTSET));
-        }
+        if ( jobs.empty() || jobs.back()->_features.size() >= FEATURES_PER_JOB )
+            jobs.push_back( new ScatterJob(this, context) );
+        jobs.back()->_features.push_back( i->get() );
+    }
 
-        // replace the source geometry with the scattered points.
-        f->setGeometry( points.get() );
+    if ( jobs.size() == 1 )
+    {
+        (*jobs[0])( 0L );
+    }
+    else if ( jobs.size() > 1 )
+    {
+        JobScheduler* scheduler = Registry::instance()->getJobScheduler();
+        osg::ref_ptr<JobGroup> group = new JobGroup();
+        for( unsigned j = 0; j < jobs.size(); ++j )
+            scheduler->submit( jobs[j].get(), JobScheduler::LANE_NORMAL, group.get() );
+        scheduler->join( group.get() );
     }
 
     return context;
@@ -88,18 +88,26 @@ ScriptFilter::push( FeatureList& input, FilterContext& context )
         return context;
     }
 
-    bool ok = true;
-    for( FeatureList::iterator i = input.begin(); i != input.end(); )
+    // Run the expression over the whole list in one batch, then drop the
+    // features that didn't pass.
+    FeatureList candidates;
+    for( FeatureList::iterator i = input.begin(); i != input.end(); ++i )
     {
-        if ( push( i->get(), context ) )
-        {
-            ++i;
-        }
-        else
-        {
-            i = input.erase(i);
-        }
+        if ( i->valid() && i->get()->getGeometry() )
+            candidates.push_back( i->get() );
+    }
+
+    std::vector<ScriptResult> results;
+    _engine->run( _expression.get(), candidates, results, &context );
+
+    FeatureList output;
+    FeatureList::iterator c = candidates.begin();
+    for( unsigned r = 0; c != candidates.end() && r < results.size(); ++c, ++r )
+    {
+        if ( results[r].asBool() )
+            output.push_back( c->get() );
     }
+    input.swap( output );
 
     return context;
 }
@@ -19,6 +19,8 @@
 #include <osgEarthFeatures/TextSymbolizer>
 #include <osgEarthFeatures/Feature>
 #include <osgEarth/Registry>
+#include <osgEarth/Text>
+#include <osgEarth/ThreadingUtils>
 
 using namespace osgEarth;
 using namespace osgEarth::Features;
@@ -63,6 +65,29 @@ namespace
             convertEncoding(symbol->encoding().get()) :
             osgText::String::ENCODING_UNDEFINED;
     }
+
+    // Fonts by name. Every label of a layer names the same font, and going
+    // through the reader (path search, object cache lookup) per label adds up.
+    osgText::Font* getFont(const std::string& name)
+    {
+        typedef std::map<std::string, osg::ref_ptr<osgText::Font> > FontMap;
+        static FontMap s_fonts;
+        static Threading::Mutex s_fontsMutex;
+
+        Threading::ScopedMutexLock lock(s_fontsMutex);
+        FontMap::iterator i = s_fonts.find(name);
+        if (i != s_fonts.end())
+            return i->second.get();
+
+        osg::ref_ptr<osgText::Font> font = osgText::readRefFontFile(name);
+        if (font.valid())
+        {
+            // all labels using this font share its glyph texture
+            osgEarth::Text::prepareFont(font.get());
+        }
+        s_fonts[name] = font.get();
+        return font.get();
+    }
 }
 
 osgText::String::Encoding
@@ -80,12 +105,17 @@ TextSymbolizer::apply(osgText::Text* drawable,
     static TextSymbol s_defaultSymbol;
     const TextSymbol* symbol = _symbol.valid() ? _symbol.get() : &s_defaultSymbol;
 
+    // osgText::Text lays its glyphs out again on every setter call, so hold
+    // the text back until everything else is set and lay it out once.
+    osgText::String text = drawable->getText();
+    drawable->setText(osgText::String());
+
     osgText::String::Encoding encoding = convertEncoding(symbol->encoding().get());
     if (symbol->content().isSet())
     {
         StringExpression temp(symbol->content().get());
         std::string content = feature ? feature->eval(temp, context) : symbol->content()->eval();
-        drawable->setText(content, encoding);
+        text.set(content, encoding);
     }
 
     // osgText::Text turns on depth writing by default, even if you turned it off.
@@ -182,22 +212,22 @@ TextSymbolizer::apply(osgText::Text* drawable,
     osg::ref_ptr<osgText::Font> font;
     if ( symbol->font().isSet() )
     {
-        font = osgText::readRefFontFile( *symbol->font() );
+        font = getFont( *symbol->font() );
     }
 
     if ( !font )
     {
         font = Registry::instance()->getDefaultFont();
+        if ( font )
+        {
+            // all labels using this font share its glyph texture
+            osgEarth::Text::prepareFont( font.get() );
+        }
     }
 
     if ( font )
     {
         drawable->setFont( font );
-        
-#if OSG_VERSION_LESS_THAN(3,5,8)
-        // mitigates mipmapping issues that cause rendering artifacts for some fonts/placement
-        font->setGlyphImageMargin( 2 );
-#endif        
     }
 
 #if OSG_VERSION_LESS_THAN(3,5,8)
@@ -240,7 +270,8 @@ TextSymbolizer::apply(osgText::Text* drawable,
     {
         drawable->getStateSet()->setRenderBinToInherit();
     }
-    
+
+    drawable->setText( text );
 }
 
 void
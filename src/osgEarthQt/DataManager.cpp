@@ -28,10 +28,52 @@
 #include <osgEarth/ElevationLayer>
 #include <osgEarth/ModelLayer>
 
+#include <osg/OperationThread>
+
+#include <QMetaType>
+#include <QThread>
+
 using namespace osgEarth::QtGui;
 using namespace osgEarth::Annotation;
 
 
+namespace osgEarth { namespace QtGui
+{
+    // One deferred DataManager call, run during the viewer's update traversal.
+    struct DataManagerOperation : public osg::Operation
+    {
+        enum Type { ADD_ANNOTATION, REMOVE_ANNOTATION, DO_ACTION, UNDO_ACTION };
+
+        DataManagerOperation(DataManager* dm, Type type) :
+            osg::Operation("DataManagerOperation", false),
+            _dm(dm), _type(type), _sender(0L), _reversible(true) { }
+
+        void operator()(osg::Object*)
+        {
+            osg::ref_ptr<DataManager> dm;
+            if (!_dm.lock(dm))
+                return;
+
+            switch(_type)
+            {
+            case ADD_ANNOTATION:    dm->addAnnotationNow(_annotation.get(), _parent.get()); break;
+            case REMOVE_ANNOTATION: dm->removeAnnotationNow(_annotation.get(), _parent.get()); break;
+            case DO_ACTION:         dm->doActionNow(_sender, _action.get(), _reversible); break;
+            case UNDO_ACTION:       dm->undoActionNow(); break;
+            }
+        }
+
+        osg::observer_ptr<DataManager> _dm;
+        Type                           _type;
+        osg::ref_ptr<AnnotationNode>   _annotation;
+        osg::ref_ptr<osg::Group>       _parent;
+        void*                          _sender;
+        osg::ref_ptr<Action>           _action;
+        bool                           _reversible;
+    };
+} }
+
+
 DataManager::DataManager(osgEarth::MapNode* mapNode) : _mapNode(mapNode), _maxUndoStackSize( 128 )
 {
   if (_mapNode)
@@ -55,6 +97,9 @@ void DataManager::initialize()
 {
   _selectedDecoration = "selected";
 
+  // signals may come from a render thread (see setViewer)
+  qRegisterMetaType<osgEarth::Annotation::AnnotationNode*>("osgEarth::Annotation::AnnotationNode*");
+
   _elevationCallback = new DataManagerElevationLayerCallback(this);
   _imageCallback = new DataManagerImageLayerCallback(this);
   _modelCallback = new DataManagerModelLayerCallback(this);
@@ -80,11 +125,43 @@ void DataManager::initialize()
   }
 }
 
+bool DataManager::defer(DataManagerOperation* op)
+{
+  osg::ref_ptr<DataManagerOperation> opRef = op;
+
+  // already off the GUI thread (e.g. an action adding an annotation from
+  // its own update operation); run it now.
+  if (QThread::currentThread() != thread())
+    return false;
+
+  osg::ref_ptr<osgViewer::ViewerBase> viewer;
+  if (!_viewer.lock(viewer))
+    return false;
+
+  viewer->addUpdateOperation(op);
+  return true;
+}
+
 void DataManager::addAnnotation(osgEarth::Annotation::AnnotationNode* annotation, osg::Group* parent)
 {
   if (!annotation || !parent)
     return;
 
+  if (_viewer.valid())
+  {
+    DataManagerOperation* op = new DataManagerOperation(this, DataManagerOperation::ADD_ANNOTATION);
+    op->_annotation = annotation;
+    op->_parent = parent;
+    if (defer(op))
+      return;
+  }
+
+  addAnnotationNow(annotation, parent);
+}
+
+void DataManager::addAnnotationNow(osgEarth::Annotation::AnnotationNode* annotation, osg::Group* parent)
+{
+
   //osg::Node* root = parent ? parent : 
 
   if (parent->addChild(annotation))
@@ -104,6 +181,20 @@ void DataManager::removeAnnotation(osgEarth::Annotation::AnnotationNode* annotat
   if (!annotation)
     return;
 
+  if (_viewer.valid())
+  {
+    DataManagerOperation* op = new DataManagerOperation(this, DataManagerOperation::REMOVE_ANNOTATION);
+    op->_annotation = annotation;
+    op->_parent = parent;
+    if (defer(op))
+      return;
+  }
+
+  removeAnnotationNow(annotation, parent);
+}
+
+void DataManager::removeAnnotationNow(osgEarth::Annotation::AnnotationNode* annotation, osg::Group* parent)
+{
   osg::ref_ptr<osgEarth::Annotation::AnnotationNode> annoToRemove = annotation;
 
   bool removed = false;
@@ -299,6 +390,23 @@ bool DataManager::doAction( void* sender, Action* action_, bool reversible )
     // this ensures that the action will be unref'd and deleted after running
     osg::ref_ptr<Action> action = action_;
 
+    if ( _viewer.valid() )
+    {
+        DataManagerOperation* op = new DataManagerOperation(this, DataManagerOperation::DO_ACTION);
+        op->_sender = sender;
+        op->_action = action.get();
+        op->_reversible = reversible;
+        if ( defer(op) )
+            return true;
+    }
+
+    return doActionNow( sender, action.get(), reversible );
+}
+
+bool DataManager::doActionNow( void* sender, Action* action_, bool reversible )
+{
+    osg::ref_ptr<Action> action = action_;
+
     bool undoInProgress = sender == this;
 
     for( ActionCallbackList::iterator i = _beforeCallbacks.begin(); i != _beforeCallbacks.end(); ++i )
@@ -318,6 +426,7 @@ bool DataManager::doAction( void* sender, Action* action_, bool reversible )
             }
             else if ( reversible && action->isReversible() )
             {
+                Threading::ScopedWriteLock lock( _dataMutex );
                 _undoStack.push_back( action.get() );
                 if ( (int)_undoStack.size() > _maxUndoStackSize )
                 {
@@ -347,8 +456,26 @@ bool DataManager::undoAction()
     if ( !canUndo() )
         return false;
 
-	osg::ref_ptr<ReversibleAction> action = static_cast<ReversibleAction*>( _undoStack.back().get() );
-	_undoStack.pop_back();
+    if ( _viewer.valid() )
+    {
+        if ( defer(new DataManagerOperation(this, DataManagerOperation::UNDO_ACTION)) )
+            return true;
+    }
+
+    return undoActionNow();
+}
+
+bool DataManager::undoActionNow()
+{
+    osg::ref_ptr<ReversibleAction> action;
+    {
+        Threading::ScopedWriteLock lock( _dataMutex );
+        if ( _undoStack.empty() )
+            return false;
+
+        action = static_cast<ReversibleAction*>( _undoStack.back().get() );
+        _undoStack.pop_back();
+    }
 
 	bool undoSucceeded = action->undoAction( this, this );
 
@@ -371,15 +498,18 @@ bool DataManager::undoAction()
 
 bool DataManager::canUndo() const
 {
+    Threading::ScopedReadLock lock(const_cast<DataManager*>(this)->_dataMutex);
     return _undoStack.size() > 0;
 }
 
 void DataManager::clearUndoActions()
 {
+    Threading::ScopedWriteLock lock( _dataMutex );
     _undoStack.clear();
 }
 
 ReversibleAction* DataManager::getNextUndoAction() const
 {
+    Threading::ScopedReadLock lock(const_cast<DataManager*>(this)->_dataMutex);
     return _undoStack.size() > 0 ? static_cast<ReversibleAction*>( _undoStack.front().get() ): 0L;
 }
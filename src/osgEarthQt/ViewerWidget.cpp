@@ -23,6 +23,7 @@
 
 #include <osgEarthUtil/EarthManipulator>
 
+#include <osg/Timer>
 #include <osgGA/StateSetManipulator>
 #include <osgQt/GraphicsWindowQt>
 #include <osgViewer/Viewer>
@@ -30,13 +31,105 @@
 
 #include <QtGui>
 #include <QtCore/QTimer>
+#include <QtCore/QThread>
+#include <QtCore/QMutex>
+#include <QtCore/QCoreApplication>
 #include <QWidget>
 
 using namespace osgEarth;
 using namespace osgEarth::QtGui;
 
 
-ViewerWidget::ViewerWidget(osg::Node* scene)
+/**
+ * Runs the frame loop for a render-threaded ViewerWidget. It owns the
+ * widget's GL context while it runs and hands it back when it stops.
+ */
+class ViewerWidget::RenderThread : public QThread
+{
+public:
+    RenderThread(ViewerWidget* widget) :
+        _widget(widget), _done(0u), _resized(false) { }
+
+    void cancel() { _done.exchange(1u); }
+
+    //! Called from the GUI thread; applied before the next frame.
+    void resize(int x, int y, int width, int height)
+    {
+        QMutexLocker lock(&_resizeMutex);
+        _x = x; _y = y; _width = width; _height = height;
+        _resized = true;
+    }
+
+protected:
+    void run()
+    {
+        osg::Timer* timer = osg::Timer::instance();
+
+        while (_done == 0u)
+        {
+            osg::Timer_t start = timer->tick();
+
+            osg::ref_ptr<osgViewer::ViewerBase> viewer;
+            if (!_widget->_viewer.lock(viewer) || viewer->done())
+                break;
+
+            applyResize();
+
+            if (viewer->getRunFrameScheme() == osgViewer::ViewerBase::CONTINUOUS ||
+                viewer->checkNeedToDoFrame())
+            {
+                viewer->frame();
+            }
+
+            double elapsed = timer->delta_m(start, timer->tick());
+            int interval = (int)(unsigned)_widget->_frameInterval;
+            if (elapsed < (double)interval)
+            {
+                msleep((unsigned long)((double)interval - elapsed));
+            }
+        }
+
+        // hand the context back to the GUI thread.
+        if (_widget->_gc.valid())
+        {
+            _widget->_gc->releaseContext();
+        }
+#if QT_VERSION >= 0x050000
+        _widget->context()->moveToThread(QCoreApplication::instance()->thread());
+#endif
+    }
+
+    void applyResize()
+    {
+        int x, y, width, height;
+        {
+            QMutexLocker lock(&_resizeMutex);
+            if (!_resized)
+                return;
+            x = _x; y = _y; width = _width; height = _height;
+            _resized = false;
+        }
+
+        osgViewer::GraphicsWindow* gw = dynamic_cast<osgViewer::GraphicsWindow*>(_widget->_gc.get());
+        if (gw)
+        {
+            gw->resized(x, y, width, height);
+            gw->getEventQueue()->windowResize(x, y, width, height);
+            gw->requestRedraw();
+        }
+    }
+
+    ViewerWidget*       _widget;
+    OpenThreads::Atomic _done;
+    QMutex              _resizeMutex;
+    bool                _resized;
+    int                 _x, _y, _width, _height;
+};
+
+
+ViewerWidget::ViewerWidget(osg::Node* scene) :
+_frameInterval( 20u ),
+_renderThread ( 0L )
 {
     // create a new viewer (a simple osgViewer::Viewer)
     createViewer();
@@ -52,7 +145,9 @@ ViewerWidget::ViewerWidget(osg::Node* scene)
 }
 
 ViewerWidget::ViewerWidget(osgViewer::ViewerBase* viewer) :
-_viewer( viewer )
+_frameInterval( 20u ),
+_renderThread ( 0L ),
+_viewer       ( viewer )
 {
     if ( !_viewer.valid() )
     {
@@ -82,6 +177,7 @@ _viewer( viewer )
 ViewerWidget::~ViewerWidget()
 {
     _timer.stop();
+    setRenderThreaded( false );
     if ( _viewer.valid() )
     {
         _viewer->stopThreading();
@@ -95,7 +191,9 @@ ViewerWidget::~ViewerWidget()
 void
 ViewerWidget::setTimerInterval(int milliseconds)
 {
-    if ( _timer.interval() != milliseconds )
+    _frameInterval.exchange( (unsigned)osg::maximum(milliseconds, 0) );
+
+    if ( !_renderThread && _timer.interval() != milliseconds )
     {
         _timer.start( milliseconds );
     }
@@ -106,7 +204,46 @@ void ViewerWidget::installFrameTimer()
 {    
     // start the frame timer.
     connect(&_timer, SIGNAL(timeout()), this, SLOT(update()));
-    _timer.start(20);
+    _timer.start((int)(unsigned)_frameInterval);
+}
+
+
+void
+ViewerWidget::setRenderThreaded(bool value)
+{
+    if ( value == getRenderThreaded() )
+        return;
+
+    if ( value )
+    {
+        if ( !_viewer.valid() || !_gc.valid() )
+            return;
+
+        // realize here, since it touches the widget; after this the thread
+        // only makes the context current and swaps.
+        if ( !_viewer->isRealized() )
+            _viewer->realize();
+
+        _timer.stop();
+
+        _gc->releaseContext();
+
+        _renderThread = new RenderThread(this);
+#if QT_VERSION >= 0x050000
+        context()->moveToThread(_renderThread);
+#endif
+        _renderThread->start();
+    }
+
+    else
+    {
+        _renderThread->cancel();
+        _renderThread->wait();
+        delete _renderThread;
+        _renderThread = 0L;
+
+        _timer.start((int)(unsigned)_frameInterval);
+    }
 }
 
 
@@ -182,9 +319,35 @@ void ViewerWidget::reconfigure( osgViewer::View* view )
       
 void ViewerWidget::paintEvent(QPaintEvent* e)
 {
+    if ( _renderThread )
+    {
+        // the render thread draws; just make sure it does.
+        osgViewer::ViewerBase::Views views;
+        getViews( views );
+        for( osgViewer::ViewerBase::Views::iterator v = views.begin(); v != views.end(); ++v )
+            (*v)->requestRedraw();
+        return;
+    }
+
     if (_viewer->getRunFrameScheme() == osgViewer::ViewerBase::CONTINUOUS || 
         _viewer->checkNeedToDoFrame() )
     {
         _viewer->frame();
     }
 }
+
+void ViewerWidget::resizeEvent(QResizeEvent* e)
+{
+    if ( !_renderThread )
+    {
+        osgQt::GLWidget::resizeEvent( e );
+        return;
+    }
+
+    // resizing the GC updates the cameras, which the render thread is using.
+    int ratio = 1;
+#if QT_VERSION >= 0x050000
+    ratio = osg::maximum((int)devicePixelRatio(), 1);
+#endif
+    _renderThread->resize(x(), y(), e->size().width()*ratio, e->size().height()*ratio);
+}
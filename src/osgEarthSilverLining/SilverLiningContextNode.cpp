@@ -28,6 +28,7 @@
 #include <osg/LightSource>
 #include <osgEarth/CullingUtils>
 #include <osgEarth/NodeUtils>
+#include <osgEarth/GPUTimer>
 
 #undef  LC
 #define LC "[SilverLiningContextNode] "
@@ -42,7 +43,9 @@ SilverLiningContextNode::SilverLiningContextNode(SilverLiningNode* node,
 _silverLiningNode (node),
 _camera           (camera),
 _options          (options),
-_lastAltitude(DBL_MAX)
+_lastAltitude(DBL_MAX),
+_lastCullFrame(~0u),
+_lastLightingTime(-DBL_MAX)
 {
     // The main silver lining data:
     _SL = new SilverLiningContext( options );
@@ -57,11 +60,13 @@ _lastAltitude(DBL_MAX)
     // Draws the sky before everything else
     _skyDrawable = new SkyDrawable(this);
     _skyDrawable->getOrCreateStateSet()->setRenderBinDetails( -99, "RenderBin" );
+    GPUTimer::install(_skyDrawable.get(), "sky.silverlining");
     _geode->addDrawable(_skyDrawable.get());
 
     // Clouds draw after everything else
     _cloudsDrawable = new CloudsDrawable(this);
     _cloudsDrawable->getOrCreateStateSet()->setRenderBinDetails( 99, "DepthSortedBin" );
+    GPUTimer::install(_cloudsDrawable.get(), "sky.clouds");
     _geode->addDrawable(_cloudsDrawable.get());
 
     // SL requires an update pass.
@@ -84,6 +89,9 @@ SilverLiningContextNode::onSetDateTime()
     ::SilverLining::LocalTime utcTime;
     utcTime.SetFromEpochSeconds( _silverLiningNode->getDateTime().asTimeStamp() );
     _SL->getAtmosphere()->GetConditions()->SetTime( utcTime );
+
+    // the sun moved; relight on the next frame.
+    _lastLightingTime = -DBL_MAX;
 }
 
 void
@@ -130,15 +138,34 @@ SilverLiningContextNode::traverse(osg::NodeVisitor& nv)
 				if(getTargetCamera() == camera)
 #endif
      			{
-					// TODO: make this multi-camera safe
-					_SL->setCameraPosition( nv.getEyePoint() );
-
-					_lastAltitude = _SL->getSRS()->isGeographic() ?
-						cv->getEyePoint().length() - _SL->getSRS()->getEllipsoid()->getRadiusEquator() :
-					cv->getEyePoint().z();
-
-					_SL->updateLocation();
-					_SL->updateLight();
+                    // Once per frame, even if the camera culls more than once
+                    // (stereo, or a slave sharing the master's view).
+                    const osg::FrameStamp* fs = nv.getFrameStamp();
+                    unsigned frame = fs ? fs->getFrameNumber() : 0u;
+                    if (frame != _lastCullFrame || !fs)
+                    {
+                        _lastCullFrame = frame;
+
+                        // TODO: make this multi-camera safe
+                        _SL->setCameraPosition( nv.getEyePoint() );
+
+                        _lastAltitude = _SL->getSRS()->isGeographic() ?
+                            cv->getEyePoint().length() - _SL->getSRS()->getEllipsoid()->getRadiusEquator() :
+                        cv->getEyePoint().z();
+
+                        _SL->updateLocation();
+
+                        // The lighting changes slowly; fetching it from SL is
+                        // expensive, so do it at a reduced rate.
+                        double t = fs ? fs->getSimulationTime() : 0.0;
+                        if (!fs ||
+                            t - _lastLightingTime >= _options.lightingUpdateInterval().get() ||
+                            t < _lastLightingTime)
+                        {
+                            _lastLightingTime = t;
+                            _SL->updateLight();
+                        }
+                    }
 				}
 			}
         }
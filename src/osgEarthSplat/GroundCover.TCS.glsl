@@ -1,7 +1,8 @@
 #version 400
 
 /**
- * TCS that assigns a patch grid density.
+ * TCS that assigns a patch grid density, and culls whole patches that
+ * cannot produce a visible billboard before they reach the tessellator.
  */
  
 #pragma vp_name       GroundCover tessellation control shader
@@ -11,18 +12,72 @@
 layout(vertices=3) out;
 
 uniform float oe_GroundCover_density;
+uniform float oe_GroundCover_maxDistance;
 
-// per-vertex tile coordinates
+// per-vertex tile coordinates and up vector
 vec4 oe_layer_tilec;
+vec3 oe_UpVectorView;
+
+// SDK function to load per-vertex data
+void VP_LoadVertex(in int);
+
+// SDK import
+float oe_terrain_getElevation(in vec2);
+
+// Generated in code
+float oe_GroundCover_getMaxBillboardSize();
 
 #ifdef OE_GROUNDCOVER_COVERAGE_PRECHECK
 // SDK function to sample the coverage data
 int oe_GroundCover_getBiomeIndex(in vec4);
-
-// SDK function to load per-vertex data
-void VP_LoadVertex(in int);
 #endif
 
+// Whether a view-space sphere lies entirely outside the plane
+// formed by adding (sign*) row "i" of the projection matrix to row 3.
+bool oe_GroundCover_outside(in int i, in float s, in vec3 center, in float radius)
+{
+    mat4 P = gl_ProjectionMatrix;
+    vec4 plane = vec4(P[0][3], P[1][3], P[2][3], P[3][3]) +
+                 s * vec4(P[0][i], P[1][i], P[2][i], P[3][i]);
+    return dot(plane, vec4(center,1.0)) < -radius*length(plane.xyz);
+}
+
+// Whether any billboard generated in this patch could be visible.
+// The corners are clamped to the terrain the same way the GS clamps
+// each billboard, and the bounding sphere is grown by the largest
+// billboard in any biome.
+bool oe_GroundCover_patchIsVisible()
+{
+    vec3 corner[3];
+    for(int i=0; i<3; ++i)
+    {
+        VP_LoadVertex(i);
+        vec4 v = gl_ModelViewMatrix * gl_in[i].gl_Position;
+        corner[i] = v.xyz + oe_UpVectorView*oe_terrain_getElevation(oe_layer_tilec.st);
+    }
+    VP_LoadVertex(0);
+
+    vec3 center = (corner[0]+corner[1]+corner[2])/3.0;
+    float radius = max(distance(center, corner[0]), max(distance(center, corner[1]), distance(center, corner[2])));
+    radius += oe_GroundCover_getMaxBillboardSize();
+
+    // the GS discards every billboard past the maximum distance:
+    if ( length(center) - radius > oe_GroundCover_maxDistance )
+        return false;
+
+    // left, right, bottom, top and near planes:
+    if ( oe_GroundCover_outside(0,  1.0, center, radius) ||
+         oe_GroundCover_outside(0, -1.0, center, radius) ||
+         oe_GroundCover_outside(1,  1.0, center, radius) ||
+         oe_GroundCover_outside(1, -1.0, center, radius) ||
+         oe_GroundCover_outside(2,  1.0, center, radius) )
+    {
+        return false;
+    }
+
+    return true;
+}
+
 // MAIN ENTRY POINT                
 void oe_GroundCover_configureTess()
 {
@@ -30,6 +85,17 @@ void oe_GroundCover_configureTess()
 	{
         float d = oe_GroundCover_density;
 
+        // An outer level of zero discards the patch, so neither the
+        // tessellator nor the GS does any work for it.
+        if ( !oe_GroundCover_patchIsVisible() )
+        {
+            gl_TessLevelOuter[0] = 0.0;
+            gl_TessLevelOuter[1] = 0.0;
+            gl_TessLevelOuter[2] = 0.0;
+            gl_TessLevelInner[0] = 0.0;
+            return;
+        }
+
 #ifdef OE_GROUNDCOVER_COVERAGE_PRECHECK
         // Samples the three corner points to see whether the triangle
         // is likely to contain a groundcover biome. This is not perfect
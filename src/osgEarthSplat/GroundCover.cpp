@@ -217,6 +217,7 @@ GroundCover::createShader() const
         "const oe_GroundCover_Billboard oe_GroundCover_billboards[" << totalBillboards << "] = oe_GroundCover_Billboard[" << totalBillboards << "](\n";
     
     int index = 0;
+    float maxSize = 0.0f;
     for(int i=0; i<getBiomes().size(); ++i)
     {
         const GroundCoverBiome* biome = getBiomes()[i].get();
@@ -258,6 +259,8 @@ GroundCover::createShader() const
             << ", float(" << options().fill().get() << ")"
             << ", vec2(float(" << maxWidth << "),float(" << maxHeight*2.0f << ")))";
 
+        maxSize = std::max(maxSize, std::max(maxWidth, maxHeight*2.0f));
+
         if ( (i+1) < getBiomes().size() )
             biomeBuf << ",\n";
     }
@@ -272,6 +275,12 @@ GroundCover::createShader() const
         << "void oe_GroundCover_getBiome(in int biomeIndex, out oe_GroundCover_Biome biome) { \n"
         << "    biome = oe_GroundCover_biomes[biomeIndex]; \n"
         << "} \n";
+
+    // largest billboard in any biome, for patch culling in the TCS
+    biomeBuf
+        << "float oe_GroundCover_getMaxBillboardSize() { \n"
+        << "    return float(" << maxSize << "); \n"
+        << "} \n";
         
     billboardBuf
         << "void oe_GroundCover_getBillboard(in int billboardIndex, out oe_GroundCover_Billboard billboard) { \n"
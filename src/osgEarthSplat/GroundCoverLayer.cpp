@@ -327,7 +327,7 @@ GroundCoverLayer::buildStateSets()
     }
 
     NoiseTextureFactory noise;
-    osg::ref_ptr<osg::Texture> noiseTexture = noise.create(256u, 4u);
+    osg::ref_ptr<osg::Texture> noiseTexture = noise.create(256u, 4u, getReadOptions());
 
     GroundCoverShaders shaders;
 
@@ -21,7 +21,11 @@
 #include <osgEarth/ImageUtils>
 #include <osgEarth/Random>
 #include <osgEarth/SimplexNoise>
+#include <osgEarth/Cache>
+#include <osgEarth/ThreadingUtils>
+#include <osgEarth/StringUtils>
 #include <osg/Texture2D>
+#include <map>
 
 using namespace osgEarth;
 using namespace osgEarth::Splat;
@@ -29,11 +33,74 @@ using namespace osgEarth::Splat;
 
 #define LC "[NoiseTextureFactory] "
 
+// Bump this when the generator changes, to orphan old cached images.
+#define NOISE_VERSION 1
+
+namespace
+{
+    typedef std::map<std::pair<unsigned, unsigned>, osg::ref_ptr<osg::Image> > NoiseImages;
+    NoiseImages      s_images;
+    Threading::Mutex s_imagesMutex;
+}
+
 osg::Texture*
-NoiseTextureFactory::create(unsigned dim, unsigned chans) const
+NoiseTextureFactory::create(unsigned dim, unsigned chans, const osgDB::Options* readOptions) const
 {
     chans = osg::clampBetween(chans, 1u, 4u);
 
+    // Several layers ask for the same noise; they share the image.
+    osg::ref_ptr<osg::Image> image;
+    {
+        Threading::ScopedMutexLock lock(s_imagesMutex);
+
+        NoiseImages::iterator i = s_images.find(std::make_pair(dim, chans));
+        if (i != s_images.end())
+            image = i->second.get();
+
+        if (!image.valid())
+        {
+            CacheBin* bin = 0L;
+            CacheSettings* cacheSettings = CacheSettings::get(readOptions);
+            if (cacheSettings && cacheSettings->isCacheEnabled() && cacheSettings->getCache())
+                bin = cacheSettings->getCache()->addBin("splat_noise");
+
+            std::string key = Stringify() << "noise_" << NOISE_VERSION << "_" << dim << "_" << chans;
+
+            if (bin && cacheSettings->cachePolicy()->isCacheReadable())
+            {
+                ReadResult r = bin->readImage(key, 0L);
+                if (r.succeeded())
+                    image = r.getImage();
+            }
+
+            if (!image.valid())
+            {
+                image = createImage(dim, chans);
+
+                if (bin && cacheSettings->cachePolicy()->isCacheWriteable())
+                    bin->write(key, image.get(), 0L);
+            }
+
+            s_images[std::make_pair(dim, chans)] = image.get();
+        }
+    }
+
+    // make a texture:
+    osg::Texture2D* tex = new osg::Texture2D( image.get() );
+    tex->setWrap(tex->WRAP_S, tex->REPEAT);
+    tex->setWrap(tex->WRAP_T, tex->REPEAT);
+    tex->setFilter(tex->MIN_FILTER, tex->LINEAR_MIPMAP_LINEAR);
+    tex->setFilter(tex->MAG_FILTER, tex->LINEAR);
+    tex->setMaxAnisotropy( 4.0f );
+    tex->setUnRefImageDataAfterApply( true );
+    ImageUtils::activateMipMaps(tex);
+
+    return tex;
+}
+
+osg::Image*
+NoiseTextureFactory::createImage(unsigned dim, unsigned chans) const
+{
     GLenum type = chans >= 2u ? GL_RGBA : GL_LUMINANCE;
     
     osg::Image* image = new osg::Image();
@@ -106,15 +173,5 @@ NoiseTextureFactory::create(unsigned dim, unsigned chans) const
         }
     }
 
-    // make a texture:
-    osg::Texture2D* tex = new osg::Texture2D( image );
-    tex->setWrap(tex->WRAP_S, tex->REPEAT);
-    tex->setWrap(tex->WRAP_T, tex->REPEAT);
-    tex->setFilter(tex->MIN_FILTER, tex->LINEAR_MIPMAP_LINEAR);
-    tex->setFilter(tex->MAG_FILTER, tex->LINEAR);
-    tex->setMaxAnisotropy( 4.0f );
-    tex->setUnRefImageDataAfterApply( true );
-    ImageUtils::activateMipMaps(tex);
-
-    return tex;
+    return image;
 }
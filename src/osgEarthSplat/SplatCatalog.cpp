@@ -20,6 +20,8 @@
 #include <osgEarth/Config>
 #include <osgEarth/ImageUtils>
 #include <osgEarth/XmlUtils>
+#include <osgEarth/Cache>
+#include <osgEarth/StringUtils>
 #include <osg/Texture2DArray>
 
 using namespace osgEarth;
@@ -188,7 +190,10 @@ SplatCatalog::getConfig() const
 
 namespace
 {
-    osg::Image* loadImage(const URI& uri, const osgDB::Options* dbOptions, osg::Image* firstImage)
+    // Bump this when the image processing changes, to orphan old cached images.
+    #define SPLAT_IMAGE_VERSION 1
+
+    osg::Image* readImage(const URI& uri, const osgDB::Options* dbOptions, osg::Image* firstImage)
     {
         // try to load the image:
         ReadResult result = uri.readImage(dbOptions);
@@ -242,11 +247,64 @@ namespace
 
         return result.releaseImage();
     }
+
+    /**
+     * Reads a catalog image, converted to match the first one and with a
+     * full mipmap chain, which is the slow part at startup. The finished
+     * image goes to the cache bin (if any), keyed on the source and the
+     * format it was converted to, so later runs load it as-is.
+     */
+    osg::Image* loadImage(const URI& uri, const osgDB::Options* dbOptions, osg::Image* firstImage,
+                          CacheBin* bin, const CachePolicy& policy)
+    {
+        std::string key;
+        if ( bin )
+        {
+            std::stringstream buf;
+            buf << "splat_" << SPLAT_IMAGE_VERSION << "_" << hashToString(uri.full());
+            if ( firstImage )
+            {
+                buf << "_" << firstImage->s() << "x" << firstImage->t()
+                    << "_" << std::hex << firstImage->getPixelFormat()
+                    << "_" << firstImage->getDataType();
+            }
+            key = buf.str();
+
+            if ( policy.isCacheReadable() )
+            {
+                ReadResult r = bin->readImage( key, 0L );
+                if ( r.succeeded() )
+                    return r.releaseImage();
+            }
+        }
+
+        osg::ref_ptr<osg::Image> image = readImage( uri, dbOptions, firstImage );
+        if ( !image.valid() )
+            return 0L;
+
+        if ( !image->isMipmap() && !ImageUtils::isCompressed(image.get()) )
+        {
+            osg::ref_ptr<osg::Image> mipmapped = ImageUtils::buildBoxFilteredMipmaps( image.get() );
+            if ( mipmapped.valid() )
+            {
+                mipmapped->setInternalTextureFormat( image->getInternalTextureFormat() );
+                image = mipmapped.get();
+            }
+        }
+
+        if ( bin && policy.isCacheWriteable() )
+        {
+            bin->write( key, image.get(), 0L );
+        }
+
+        return image.release();
+    }
 }
 
 bool
-SplatCatalog::createSplatTextureDef(const osgDB::Options* dbOptions,
-                                    SplatTextureDef&      out)
+SplatCatalog::createSplatTextureDef(const osgDB::Options*      dbOptions,
+                                    SplatTextureDef&           out,
+                                    const LandCoverDictionary* landCoverDict)
 {
     // Reset all texture indices to default
     for(SplatClassMap::iterator i = _classes.begin(); i != _classes.end(); ++i)
@@ -267,12 +325,31 @@ SplatCatalog::createSplatTextureDef(const osgDB::Options* dbOptions,
     std::vector< osg::ref_ptr<osg::Image> > imagesInOrder;
     int index = 0;
     osg::Image* firstImage  = 0L;
+    unsigned numSkipped = 0;
+
+    // processed images are cached per catalog:
+    CacheBin* bin = 0L;
+    CachePolicy policy;
+    CacheSettings* cacheSettings = CacheSettings::get(dbOptions);
+    if ( cacheSettings && cacheSettings->isCacheEnabled() && cacheSettings->getCache() )
+    {
+        bin = cacheSettings->getCache()->addBin( Stringify() << "splat_catalog_" << hashToString(name().get()) );
+        policy = cacheSettings->cachePolicy().get();
+    }
 
     // Load all referenced images in the catalog, and assign each a unique index.
     for(SplatClassMap::iterator i = _classes.begin(); i != _classes.end(); ++i)
     {
         SplatClass& c = i->second;
 
+        // Classes the coverage cannot produce never reach the LUT,
+        // so don't spend texture memory on them.
+        if ( landCoverDict && landCoverDict->getClassByName(c._name) == 0L )
+        {
+            ++numSkipped;
+            continue;
+        }
+
         for(SplatRangeDataVector::iterator range = c._ranges.begin(); range != c._ranges.end(); ++range)
         {
             // Load the main image and assign it an index:
@@ -282,7 +359,7 @@ SplatCatalog::createSplatTextureDef(const osgDB::Options* dbOptions,
                 ImageIndexTable::iterator k = imageIndices.find(range->_imageURI.get());
                 if ( k == imageIndices.end() )
                 {
-                    osg::ref_ptr<osg::Image> image = loadImage( range->_imageURI.get(), dbOptions, firstImage );
+                    osg::ref_ptr<osg::Image> image = loadImage( range->_imageURI.get(), dbOptions, firstImage, bin, policy );
                     if ( image.valid() )
                     {
                         if ( !firstImage )
@@ -307,7 +384,7 @@ SplatCatalog::createSplatTextureDef(const osgDB::Options* dbOptions,
                 ImageIndexTable::iterator k = imageIndices.find(range->_detail->_imageURI.get());
                 if ( k == imageIndices.end() )
                 {
-                    osg::ref_ptr<osg::Image> image = loadImage( range->_detail->_imageURI.get(), dbOptions, firstImage );
+                    osg::ref_ptr<osg::Image> image = loadImage( range->_detail->_imageURI.get(), dbOptions, firstImage, bin, policy );
                     if ( image.valid() )
                     {
                         if ( !firstImage )
@@ -345,6 +422,10 @@ SplatCatalog::createSplatTextureDef(const osgDB::Options* dbOptions,
         out._texture->setResizeNonPowerOfTwoHint( false );
         out._texture->setMaxAnisotropy( 4.0f );
 
+        // The images are only needed for the upload; don't keep
+        // a second copy of the whole array in system memory.
+        out._texture->setUnRefImageDataAfterApply( true );
+
         for(unsigned i=0; i<imagesInOrder.size(); ++i)
         {
             out._texture->setImage( i, imagesInOrder[i].get() );
@@ -352,6 +433,7 @@ SplatCatalog::createSplatTextureDef(const osgDB::Options* dbOptions,
 
         OE_INFO << LC << "Catalog \"" << this->name().get()
             << "\" texture size = "<< imagesInOrder.size()
+            << " (skipped " << numSkipped << " unused classes)"
             << std::endl;
     }
 
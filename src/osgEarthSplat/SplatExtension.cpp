@@ -115,7 +115,7 @@ SplatExtension::connect(MapNode* mapNode)
         if (mapNode->getTerrainEngine()->getResources()->reserveTextureImageUnit(_noiseTexUnit, "Splat Noise"))
         {
             NoiseTextureFactory noise;
-            terrainStateSet->setTextureAttribute(_noiseTexUnit, noise.create(256u, 4u));
+            terrainStateSet->setTextureAttribute(_noiseTexUnit, noise.create(256u, 4u, mapNode->getMap()->getReadOptions()));
             terrainStateSet->addUniform(new osg::Uniform("oe_splat_noiseTex", _noiseTexUnit));
         }
     }
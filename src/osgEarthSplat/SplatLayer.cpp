@@ -310,7 +310,7 @@ SplatLayer::buildStateSets()
     if (_noiseBinding.valid())
     {
         NoiseTextureFactory noise;
-        osg::ref_ptr<osg::Texture> noiseTexture = noise.create(256u, 1u);
+        osg::ref_ptr<osg::Texture> noiseTexture = noise.create(256u, 1u, getReadOptions());
         stateset->setTextureAttribute(_noiseBinding.unit(), noiseTexture.get());
         stateset->addUniform(new osg::Uniform(NOISE_SAMPLER, _noiseBinding.unit()));
         stateset->setDefine("OE_SPLAT_HAVE_NOISE_SAMPLER");
@@ -73,7 +73,7 @@ Surface::loadTextures(const LandCoverDictionary* landCoverDict, const osgDB::Opt
     if ( landCoverDict == 0L || !_catalog.valid() )
         return false;
 
-    if ( _catalog->createSplatTextureDef(dbo, _textureDef) )
+    if ( _catalog->createSplatTextureDef(dbo, _textureDef, landCoverDict) )
     {
         _textureDef._splatLUTBuffer = createLUTBuffer(landCoverDict);
     }
@@ -48,7 +48,8 @@ _src  ( rhs._src ),
 _rpn  ( rhs._rpn ),
 _vars ( rhs._vars ),
 _value( rhs._value ),
-_dirty( rhs._dirty )
+_dirty( rhs._dirty ),
+_stack( rhs._stack )
 {
     //nop
 }
@@ -264,6 +265,18 @@ NumericExpression::init()
         _rpn.push_back( s.top() );
         s.pop();
     }
+
+    // find the deepest the evaluation stack can get so eval() never has to grow it.
+    unsigned depth = 0, maxDepth = 0;
+    for( unsigned i=0; i<_rpn.size(); ++i )
+    {
+        Op op = _rpn[i].first;
+        if ( op < ADD || op > MAX )
+            maxDepth = std::max( maxDepth, ++depth );
+        else if ( depth >= 2 )
+            --depth;
+    }
+    _stack.resize( std::max(maxDepth, 1u) );
 }
 
 void 
@@ -282,82 +295,38 @@ NumericExpression::eval() const
 {
     if ( _dirty )
     {
-        std::stack<double> s;
+        // Fixed-size stack from init(); "top" is the number of values on it.
+        double* s = _stack.empty() ? 0L : &_stack[0];
+        unsigned top = 0;
 
         for( unsigned i=0; i<_rpn.size(); ++i )
         {
             const Atom& a = _rpn[i];
 
-            if ( a.first == ADD )
+            if ( a.first < ADD || a.first > MAX ) // OPERAND or VARIABLE
             {
-                if ( s.size() >= 2 )
-                {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( op1 + op2 );
-                }
+                s[top++] = a.second;
             }
-            else if ( a.first == SUB )
+            else if ( top >= 2 )
             {
-                if ( s.size() >= 2 )
-                {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( op1 - op2 );
-                }
-            }
-            else if ( a.first == MULT )
-            {
-                if ( s.size() >= 2 )
-                {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( op1 * op2 );
-                }
-            }
-            else if ( a.first == DIV )
-            {
-                if ( s.size() >= 2 )
-                {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( op1 / op2 );
-                }
-            }
-            else if ( a.first == MOD )
-            {
-                if ( s.size() >= 2 )
-                {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( fmod(op1, op2) );
-                }
-            }
-            else if ( a.first == MIN )
-            {
-                if ( s.size() >= 2 )
-                {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( std::min(op1, op2) );
-                }
-            }
-            else if ( a.first == MAX )
-            {
-                if ( s.size() >= 2 )
+                double op2 = s[--top];
+                double op1 = s[top-1];
+                double& result = s[top-1];
+
+                switch( a.first )
                 {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( std::max(op1, op2) );
+                case ADD:  result = op1 + op2; break;
+                case SUB:  result = op1 - op2; break;
+                case MULT: result = op1 * op2; break;
+                case DIV:  result = op1 / op2; break;
+                case MOD:  result = fmod(op1, op2); break;
+                case MIN:  result = std::min(op1, op2); break;
+                default:   result = std::max(op1, op2); break; // MAX
                 }
             }
-            else // OPERAND or VARIABLE
-            {
-                s.push( a.second );
-            }
         }
 
-        const_cast<NumericExpression*>(this)->_value = s.size() > 0 ? s.top() : 0.0;
+        const_cast<NumericExpression*>(this)->_value = top > 0 ? s[top-1] : 0.0;
         const_cast<NumericExpression*>(this)->_dirty = false;
     }
 
@@ -636,11 +605,12 @@ StringExpression::eval() const
     // Case non conditional expression
     else if ( _dirty )
     {
-        std::stringstream buf;
+        // build in place so the string's capacity is reused from call to call
+        std::string& value = const_cast<StringExpression*>(this)->_value;
+        value.clear();
         for( AtomVector::const_iterator i = _infix.begin(); i != _infix.end(); ++i )
-            buf << i->second;
+            value.append( i->second );
 
-        const_cast<StringExpression*>(this)->_value = buf.str();
         const_cast<StringExpression*>(this)->_dirty = false;
     }
 
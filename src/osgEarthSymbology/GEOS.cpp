@@ -44,8 +44,11 @@ using namespace geos::operation;
 
 #define LC "[GEOS] "
 
-#define GEOS_VERSION_AT_LEAST(MAJOR, MINOR) \
-    ((GEOS_VERSION_MAJOR>MAJOR) || (GEOS_VERSION_MAJOR==MAJOR && GEOS_VERSION_MINOR>=MINOR))
+#if defined(_MSC_VER)
+#  define OE_GEOS_THREAD_LOCAL __declspec(thread)
+#else
+#  define OE_GEOS_THREAD_LOCAL __thread
+#endif
 
 namespace
 {
@@ -236,6 +239,16 @@ GEOSContext::~GEOSContext()
 #endif
 }
 
+GEOSContext&
+GEOSContext::forCurrentThread()
+{
+    // Lives as long as the thread does; the feature threads are pooled.
+    static OE_GEOS_THREAD_LOCAL GEOSContext* s_context = 0L;
+    if ( !s_context )
+        s_context = new GEOSContext();
+    return *s_context;
+}
+
 geom::Geometry*
 GEOSContext::importGeometry(const Symbology::Geometry* input)
 {
@@ -33,6 +33,8 @@ using namespace osgEarth::Symbology;
 #  include <geos/operation/buffer/BufferOp.h>
 #  include <geos/operation/buffer/BufferBuilder.h> 
 #  include <geos/operation/overlay/OverlayOp.h>
+#  include <geos/geom/prep/PreparedGeometry.h>
+#  include <geos/geom/prep/PreparedGeometryFactory.h>
 using namespace geos;
 using namespace geos::operation;
 #endif
@@ -41,6 +43,59 @@ using namespace geos::operation;
 
 #define LC "[Geometry] "
 
+namespace
+{
+    // Whether two valid bounds are apart in x and y (overlays ignore z).
+    bool disjoint2d(const Bounds& a, const Bounds& b)
+    {
+        return
+            a.isValid() && b.isValid() &&
+            (a.xMin() > b.xMax() || a.xMax() < b.xMin() ||
+             a.yMin() > b.yMax() || a.yMax() < b.yMin());
+    }
+
+#ifdef OSGEARTH_HAVE_GEOS
+    // Converts the result of an overlay operation, as crop() and geounion()
+    // report it, and disposes of it.
+    bool exportOverlay(GEOSContext& gc, geom::Geometry* outGeom, osg::ref_ptr<Geometry>& output)
+    {
+        bool success = false;
+        output = 0L;
+
+        if ( outGeom )
+        {
+            output = gc.exportGeometry( outGeom );
+
+            if ( output.valid())
+            {
+                if ( output->isValid() )
+                {
+                    success = true;
+                }
+                else
+                {
+                    // GEOS result is invalid
+                    output = 0L;
+                }
+            }
+            else
+            {
+                // set output to empty geometry to indicate the (valid) empty case,
+                // still returning false but allows for check.
+                if (outGeom->getNumPoints() == 0)
+                {
+                    output = new osgEarth::Symbology::Geometry();
+                }
+            }
+
+            gc.disposeGeometry( outGeom );
+        }
+
+        return success;
+    }
+#endif
+}
+
 
 Geometry::Geometry( const Geometry& rhs ) :
 osgEarth::MixinVector<osg::Vec3d,osg::Referenced>( rhs )
@@ -158,7 +213,7 @@ Geometry::buffer(double distance,
 {
 #ifdef OSGEARTH_HAVE_GEOS   
 
-    GEOSContext gc;
+    GEOSContext& gc = GEOSContext::forCurrentThread();
 
     geom::Geometry* inGeom = gc.importGeometry( this );
     if ( inGeom )
@@ -238,7 +293,14 @@ Geometry::crop( const Polygon* cropPoly, osg::ref_ptr<Geometry>& output ) const
     bool success = false;
     output = 0L;
 
-    GEOSContext gc;
+    // nothing to convert if the bounds don't even overlap (the empty case).
+    if ( cropPoly && disjoint2d(getBounds(), cropPoly->getBounds()) )
+    {
+        output = new osgEarth::Symbology::Geometry();
+        return false;
+    }
+
+    GEOSContext& gc = GEOSContext::forCurrentThread();
 
     //Create the GEOS Geometries
     geom::Geometry* inGeom   = gc.importGeometry( this );
@@ -266,34 +328,7 @@ Geometry::crop( const Polygon* cropPoly, osg::ref_ptr<Geometry>& output ) const
             outGeom = 0L;
         }
 
-        if ( outGeom )
-        {
-            output = gc.exportGeometry( outGeom );
-
-            if ( output.valid())
-            {
-                if ( output->isValid() )
-                {
-                    success = true;
-                }
-                else
-                {
-                    // GEOS result is invalid
-                    output = 0L;
-                }
-            }
-            else
-            {
-                // set output to empty geometry to indicate the (valid) empty case,
-                // still returning false but allows for check.
-                if (outGeom->getNumPoints() == 0)
-                {
-                    output = new osgEarth::Symbology::Geometry();
-                }
-            }
-
-            gc.disposeGeometry( outGeom );
-        }
+        success = exportOverlay( gc, outGeom, output );
     }
 
     //Destroy the geometry
@@ -329,7 +364,7 @@ Geometry::geounion( const Geometry* other, osg::ref_ptr<Geometry>& output ) cons
     bool success = false;
     output = 0L;
 
-    GEOSContext gc;
+    GEOSContext& gc = GEOSContext::forCurrentThread();
 
     //Create the GEOS Geometries
     geom::Geometry* inGeom   = gc.importGeometry( this );
@@ -357,34 +392,7 @@ Geometry::geounion( const Geometry* other, osg::ref_ptr<Geometry>& output ) cons
             outGeom = 0L;
         }
 
-        if ( outGeom )
-        {
-            output = gc.exportGeometry( outGeom );
-
-            if ( output.valid())
-            {
-                if ( output->isValid() )
-                {
-                    success = true;
-                }
-                else
-                {
-                    // GEOS result is invalid
-                    output = 0L;
-                }
-            }
-            else
-            {
-                // set output to empty geometry to indicate the (valid) empty case,
-                // still returning false but allows for check.
-                if (outGeom->getNumPoints() == 0)
-                {
-                    output = new osgEarth::Symbology::Geometry();
-                }
-            }
-
-            gc.disposeGeometry( outGeom );
-        }
+        success = exportOverlay( gc, outGeom, output );
     }
 
     //Destroy the geometry
@@ -406,7 +414,14 @@ Geometry::difference( const Polygon* diffPolygon, osg::ref_ptr<Geometry>& output
 {
 #ifdef OSGEARTH_HAVE_GEOS
 
-    GEOSContext gc;
+    // subtracting something that doesn't overlap leaves this geometry as is.
+    if ( diffPolygon && isValid() && disjoint2d(getBounds(), diffPolygon->getBounds()) )
+    {
+        output = clone();
+        return output.valid();
+    }
+
+    GEOSContext& gc = GEOSContext::forCurrentThread();
 
     //Create the GEOS Geometries
     geom::Geometry* inGeom   = gc.importGeometry( this );
@@ -467,7 +482,7 @@ Geometry::intersects(
 {
 #ifdef OSGEARTH_HAVE_GEOS
 
-    GEOSContext gc;
+    GEOSContext& gc = GEOSContext::forCurrentThread();
 
     //Create the GEOS Geometries
     geom::Geometry* inGeom   = gc.importGeometry( this );
@@ -1173,3 +1188,129 @@ ConstSegmentIterator::next()
 
     return Segment( p0, *_iter );
 }
+
+//------------------------------------------------------------------------
+
+#ifdef OSGEARTH_HAVE_GEOS
+namespace
+{
+    // The crop polygon in GEOS, with its prepared (indexed) form.
+    struct PreparedPolygon : public osg::Referenced
+    {
+        PreparedPolygon( const Polygon* polygon ) :
+            _gc      ( GEOSContext::forCurrentThread() ),
+            _geom    ( 0L ),
+            _prepared( 0L )
+        {
+            _geom = _gc.importGeometry( polygon );
+            if ( _geom )
+            {
+                try {
+#if GEOS_VERSION_AT_LEAST(3,8)
+                    _prepared = geom::prep::PreparedGeometryFactory::prepare( _geom ).release();
+#else
+                    _prepared = geom::prep::PreparedGeometryFactory::prepare( _geom );
+#endif
+                }
+                catch(const geos::util::GEOSException&) {
+                    _prepared = 0L;
+                }
+            }
+        }
+
+        virtual ~PreparedPolygon()
+        {
+#if GEOS_VERSION_AT_LEAST(3,8)
+            delete _prepared;
+#else
+            if ( _prepared )
+                geom::prep::PreparedGeometryFactory::destroy( _prepared );
+#endif
+            _gc.disposeGeometry( _geom );
+        }
+
+        GEOSContext&                        _gc;
+        geom::Geometry*                     _geom;
+        const geom::prep::PreparedGeometry* _prepared;
+    };
+}
+#endif
+
+GeometryCropper::GeometryCropper( const Polygon* cropPolygon ) :
+_polygon( cropPolygon )
+{
+    if ( _polygon.valid() )
+    {
+        _bounds = _polygon->getBounds();
+#ifdef OSGEARTH_HAVE_GEOS
+        _prepared = new PreparedPolygon( _polygon.get() );
+#endif
+    }
+}
+
+bool
+GeometryCropper::crop( Geometry* input, osg::ref_ptr<Geometry>& output )
+{
+    output = 0L;
+
+    if ( !input || !_polygon.valid() )
+        return false;
+
+    if ( disjoint2d(input->getBounds(), _bounds) )
+    {
+        // the valid empty case, as in Geometry::crop.
+        output = new Geometry();
+        return false;
+    }
+
+#ifdef OSGEARTH_HAVE_GEOS
+    PreparedPolygon* pp = static_cast<PreparedPolygon*>( _prepared.get() );
+    if ( pp && pp->_prepared )
+    {
+        GEOSContext& gc = pp->_gc;
+
+        geom::Geometry* inGeom = gc.importGeometry( input );
+        if ( !inGeom )
+            return false;
+
+        geom::Geometry* outGeom = 0L;
+        bool inside = false, outside = false;
+        try {
+            if ( pp->_prepared->containsProperly(inGeom) )
+                inside = true;
+            else if ( !pp->_prepared->intersects(inGeom) )
+                outside = true;
+            else
+                outGeom = overlay::OverlayOp::overlayOp( inGeom, pp->_geom, overlay::OverlayOp::opINTERSECTION );
+        }
+        catch (const geos::util::TopologyException& ex) {
+            GEOS_OUT << LC << "Crop(GEOS): "
+                << (ex.what()? ex.what() : " no error message")
+                << std::endl;
+            outGeom = 0L;
+        }
+        catch(const geos::util::GEOSException& ex) {
+            OE_INFO << LC << "Crop(GEOS): "
+                << (ex.what()? ex.what() : " no error message")
+                << std::endl;
+            outGeom = 0L;
+        }
+
+        gc.disposeGeometry( inGeom );
+
+        if ( inside )
+        {
+            output = input;
+            return true;
+        }
+        if ( outside )
+        {
+            output = new Geometry();
+            return false;
+        }
+        return exportOverlay( gc, outGeom, output );
+    }
+#endif
+
+    return input->crop( _polygon.get(), output );
+}
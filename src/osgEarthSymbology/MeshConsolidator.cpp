@@ -21,6 +21,8 @@
 */
 
 #include <osgEarthSymbology/MeshConsolidator>
+#include <osgEarth/JobScheduler>
+#include <osgEarth/Registry>
 #include <osgEarth/StringUtils>
 #include <osg/TriangleFunctor>
 #include <osg/TriangleIndexFunctor>
@@ -28,6 +30,7 @@
 #include <osgDB/WriteFile>
 #include <osgUtil/MeshOptimizers>
 #include <limits>
+#include <algorithm>
 #include <map>
 #include <iterator>
 
@@ -74,12 +77,12 @@ namespace
         return newDE;
     }
 
+    // Prefer 16-bit indices over 8-bit ones, which many drivers have to
+    // convert before drawing.
     template<typename FROM>
     osg::PrimitiveSet* remake( FROM* src, unsigned numVerts, unsigned offset )
     {
-        if ( numVerts < 0x100 )
-            return copy<FROM,osg::DrawElementsUByte>( src, offset );
-        else if ( numVerts < 0x10000 )
+        if ( numVerts <= 0x10000 )
             return copy<FROM,osg::DrawElementsUShort>( src, offset );
         else
             return copy<FROM,osg::DrawElementsUInt>( src, offset );
@@ -216,9 +219,7 @@ namespace
     osg::PrimitiveSet* convertDAtoDE( osg::DrawArrays* da, unsigned numVerts, unsigned offset )
     {
         osg::DrawElements* de = 0L;
-        if ( numVerts < 0x100 )
-            de = new osg::DrawElementsUByte( da->getMode() );
-        else if ( numVerts < 0x10000 )
+        if ( numVerts <= 0x10000 )
             de = new osg::DrawElementsUShort( da->getMode() );
         else
             de = new osg::DrawElementsUInt( da->getMode() );
@@ -395,6 +396,7 @@ namespace
         unsigned                      numNormals,
         const std::vector<unsigned>&  texCoordArrayUnits,
         bool                          useVBOs,
+        osg::StateSet*                unifiedStateSet,
         DrawableList&                 results )
     {
         osg::Array::Binding newColorsBinding, newNormalsBinding;
@@ -462,18 +464,10 @@ namespace
 
         std::vector<osg::ref_ptr<osg::Geometry> > nonOptimizedGeoms;
 
-        osg::StateSet* unifiedStateSet = 0L;
-
         for( DrawableList::iterator i = start; i != end; ++i )
         {
             osg::Geometry* geom = i->get()->asGeometry(); //geode.getDrawable(i)->asGeometry();
 
-            // merge in the stateset:
-            if ( unifiedStateSet == 0L )
-                unifiedStateSet = geom->getStateSet();
-            else if ( geom->getStateSet() )
-                unifiedStateSet->merge( *geom->getStateSet() );            
-
             // copy over the verts:
             osg::Vec3Array* geomVerts = dynamic_cast<osg::Vec3Array*>( geom->getVertexArray() );
             if ( geomVerts )
@@ -618,10 +612,28 @@ namespace
         newGeom->setUseVertexBufferObjects( useVBOs );
         newGeom->setUseDisplayList( !useVBOs );
 
+        MeshConsolidator::optimizeVertexCache( *newGeom );
+
         results.push_back( newGeom );
 
         //GeometryValidator().apply( *newGeom );
     }
+
+    // Runs one merge() on the job scheduler.
+    struct MergeJob : public TaskRequest
+    {
+        DrawableList::iterator _start, _end;
+        unsigned               _numVerts, _numColors, _numNormals;
+        std::vector<unsigned>  _texCoordArrayUnits;
+        bool                   _useVBOs;
+        osg::ref_ptr<osg::StateSet> _stateSet;
+        DrawableList           _results;
+
+        void operator()(ProgressCallback*)
+        {
+            merge( _start, _end, _numVerts, _numColors, _numNormals, _texCoordArrayUnits, _useVBOs, _stateSet.get(), _results );
+        }
+    };
 }
 
 
@@ -679,37 +691,84 @@ MeshConsolidator::run( osg::Geode& geode )
         }
     }
 
-    // start consolidating the geometries.
-    unsigned targetNumVertsPerGeom = 100000; //TODO: configurable?
+    // start consolidating the geometries. Keep each merged geometry within
+    // reach of 16-bit indices unless a single input is already larger.
+    unsigned targetNumVertsPerGeom = 0x10000; //TODO: configurable?
     DrawableList results;
 
-    unsigned numVerts = 0, numColors = 0, numNormals = 0;
+    std::vector<osg::ref_ptr<MergeJob> > jobs;
+
     DrawableList::iterator start = consolidate.begin();
 
-    for( DrawableList::iterator end = consolidate.begin(); end != consolidate.end(); )
+    while( start != consolidate.end() )
     {
-        osg::Geometry* geom = end->get()->asGeometry(); // already type-checked this earlier.
-        unsigned geomNumVerts = geom->getVertexArray()->getNumElements();
+        MergeJob* job = new MergeJob();
+        job->_numVerts = 0, job->_numColors = 0, job->_numNormals = 0;
+        job->_texCoordArrayUnits = texCoordArrayUnits;
+        job->_useVBOs = useVBOs;
+
+        DrawableList::iterator end = start;
+        for( ; end != consolidate.end(); ++end )
+        {
+            osg::Geometry* geom = end->get()->asGeometry(); // already type-checked this earlier.
+            unsigned geomNumVerts = geom->getVertexArray()->getNumElements();
+
+            if ( end != start && job->_numVerts + geomNumVerts > targetNumVertsPerGeom )
+                break;
+
+            job->_numVerts += geomNumVerts;
+            if ( geom->getColorArray() )
+                job->_numColors += geom->getColorArray()->getNumElements();
+            if ( geom->getNormalArray() )
+                job->_numNormals += geom->getNormalArray()->getNumElements();
+
+            // merge in the stateset here rather than in the job, since the
+            // merged geometries may share state:
+            if ( !job->_stateSet.valid() )
+                job->_stateSet = geom->getStateSet();
+            else if ( geom->getStateSet() )
+                job->_stateSet->merge( *geom->getStateSet() );
+        }
 
-        ++end;
+        OE_DEBUG << LC << "Merging " << ((unsigned)(end-start)) << " geoms with " << job->_numVerts << " verts." << std::endl;
 
-        numVerts += geomNumVerts;
-        if ( geom->getColorArray() )
-            numColors += geom->getColorArray()->getNumElements();
-        if ( geom->getNormalArray() )
-            numNormals += geom->getNormalArray()->getNumElements();
+        job->_start = start;
+        job->_end = end;
+        jobs.push_back( job );
 
-        if ( numVerts > targetNumVertsPerGeom || end == consolidate.end() )
-        {
-            OE_DEBUG << LC << "Merging " << ((unsigned)(end-start)) << " geoms with " << numVerts << " verts." << std::endl;
+        start = end;
+    }
 
-            merge( start, end, numVerts, numColors, numNormals, texCoordArrayUnits, useVBOs, results );
+    if ( jobs.size() == 1 )
+    {
+        jobs[0]->run();
+    }
+    else if ( jobs.size() > 1 )
+    {
+        JobScheduler* scheduler = Registry::instance()->getJobScheduler();
+        osg::ref_ptr<JobGroup> group = new JobGroup();
+
+        for( unsigned i=0; i<jobs.size(); ++i )
+            scheduler->submit( jobs[i].get(), JobScheduler::LANE_NORMAL, group.get() );
 
-            start = end;
-            numVerts = 0, numColors = 0, numNormals = 0;
+        // If we're on a scheduler thread, help out instead of blocking a worker.
+        if ( scheduler->isWorkerThread() )
+        {
+            while( group->getNumPending() > 0u )
+            {
+                if ( !scheduler->runOne() )
+                    group->wait( 0u, 10u );
+            }
+        }
+        else
+        {
+            group->wait();
         }
     }
 
+    for( unsigned i=0; i<jobs.size(); ++i )
+        std::copy( jobs[i]->_results.begin(), jobs[i]->_results.end(), std::back_inserter(results) );
+
     // re-build the geode:
     geode.removeDrawables( 0, geode.getNumDrawables() );
 
@@ -719,3 +778,335 @@ MeshConsolidator::run( osg::Geode& geode )
     for( DrawableList::iterator i = dontConsolidate.begin(); i != dontConsolidate.end(); ++i )
         geode.addDrawable( i->get() );
 }
+
+//------------------------------------------------------------------------
+
+namespace
+{
+    // Picks the next fanning vertex for tipsify(). Sets "hard" if the
+    // choice breaks the locality of the ordering (a new cluster).
+    int nextFanningVertex(const std::vector<GLuint>&   candidates,
+                          const std::vector<int>&      live,
+                          const std::vector<unsigned>& cacheTime,
+                          unsigned                     time,
+                          unsigned                     cacheSize,
+                          std::vector<GLuint>&         deadEnd,
+                          unsigned&                    cursor,
+                          bool&                        hard)
+    {
+        // Prefer a candidate whose remaining triangles will still find
+        // its vertices in the cache, and failing that, the oldest one.
+        int best = -1, bestPriority = -1;
+        for( unsigned i=0; i<candidates.size(); ++i )
+        {
+            GLuint v = candidates[i];
+            if ( live[v] > 0 )
+            {
+                int priority = 0;
+                if ( time - cacheTime[v] + 2*live[v] <= cacheSize )
+                    priority = time - cacheTime[v];
+                if ( priority > bestPriority )
+                {
+                    bestPriority = priority;
+                    best = v;
+                }
+            }
+        }
+
+        if ( best >= 0 )
+        {
+            hard = false;
+            return best;
+        }
+
+        hard = true;
+
+        // Otherwise back up to a recently used vertex...
+        while( !deadEnd.empty() )
+        {
+            GLuint v = deadEnd.back();
+            deadEnd.pop_back();
+            if ( live[v] > 0 )
+                return v;
+        }
+
+        // ...or the next vertex in input order that has triangles left.
+        while( cursor < live.size() )
+        {
+            if ( live[cursor] > 0 )
+                return cursor;
+            ++cursor;
+        }
+
+        return -1;
+    }
+
+    // Tipsify (Sander, Nehab & Barczak 2007): reorders a triangle list for a
+    // post-transform vertex cache of the given size, then sorts the clusters
+    // of the new order so outward-facing ones draw first, reducing overdraw.
+    void tipsify(const std::vector<GLuint>& input,
+                 const osg::Vec3Array&      verts,
+                 unsigned                   cacheSize,
+                 std::vector<GLuint>&       output)
+    {
+        unsigned numVerts = verts.size();
+        unsigned numTris = input.size() / 3u;
+
+        // vertex -> triangle adjacency:
+        std::vector<unsigned> adjStart(numVerts+1, 0u);
+        for( unsigned i=0; i<numTris*3u; ++i )
+            adjStart[input[i]+1]++;
+        for( unsigned v=0; v<numVerts; ++v )
+            adjStart[v+1] += adjStart[v];
+
+        std::vector<unsigned> adj(numTris*3u);
+        std::vector<unsigned> fill(adjStart.begin(), adjStart.end()-1);
+        for( unsigned i=0; i<numTris*3u; ++i )
+            adj[fill[input[i]]++] = i/3u;
+
+        std::vector<int> live(numVerts);
+        for( unsigned v=0; v<numVerts; ++v )
+            live[v] = adjStart[v+1] - adjStart[v];
+
+        std::vector<unsigned> cacheTime(numVerts, 0u);
+        std::vector<bool>     emitted(numTris, false);
+        std::vector<GLuint>   deadEnd, candidates;
+        std::vector<unsigned> clusters; // first triangle of each cluster
+
+        output.clear();
+        output.reserve(numTris*3u);
+
+        unsigned time = cacheSize + 1u;
+        unsigned cursor = 0u;
+        bool hard = true;
+        int f = nextFanningVertex(candidates, live, cacheTime, time, cacheSize, deadEnd, cursor, hard);
+
+        while( f >= 0 )
+        {
+            if ( hard )
+                clusters.push_back(output.size()/3u);
+
+            candidates.clear();
+            for( unsigned a=adjStart[f]; a<adjStart[f+1]; ++a )
+            {
+                unsigned t = adj[a];
+                if ( emitted[t] )
+                    continue;
+
+                for( unsigned j=0; j<3; ++j )
+                {
+                    GLuint v = input[t*3u+j];
+                    output.push_back(v);
+                    deadEnd.push_back(v);
+                    candidates.push_back(v);
+                    live[v]--;
+                    if ( time - cacheTime[v] > cacheSize )
+                    {
+                        cacheTime[v] = time;
+                        ++time;
+                    }
+                }
+                emitted[t] = true;
+            }
+
+            f = nextFanningVertex(candidates, live, cacheTime, time, cacheSize, deadEnd, cursor, hard);
+        }
+
+        if ( clusters.size() < 2 )
+            return;
+
+        // Sort the clusters by how far they face out from the mesh center.
+        osg::Vec3d meshCenter;
+        for( unsigned i=0; i<output.size(); ++i )
+            meshCenter += osg::Vec3d(verts[output[i]]);
+        meshCenter /= (double)output.size();
+
+        std::vector<std::pair<double, unsigned> > order(clusters.size());
+        for( unsigned c=0; c<clusters.size(); ++c )
+        {
+            unsigned t0 = clusters[c];
+            unsigned t1 = c+1 < clusters.size() ? clusters[c+1] : output.size()/3u;
+
+            osg::Vec3d center, normal;
+            for( unsigned t=t0; t<t1; ++t )
+            {
+                const osg::Vec3& v0 = verts[output[t*3u]];
+                const osg::Vec3& v1 = verts[output[t*3u+1]];
+                const osg::Vec3& v2 = verts[output[t*3u+2]];
+                center += osg::Vec3d(v0 + v1 + v2) / 3.0;
+                normal += osg::Vec3d((v1 - v0) ^ (v2 - v0));
+            }
+            center /= (double)(t1-t0);
+            normal.normalize();
+
+            order[c].first = -((center - meshCenter) * normal);
+            order[c].second = c;
+        }
+        std::stable_sort(order.begin(), order.end());
+
+        std::vector<GLuint> sorted;
+        sorted.reserve(output.size());
+        for( unsigned i=0; i<order.size(); ++i )
+        {
+            unsigned c = order[i].second;
+            unsigned t0 = clusters[c];
+            unsigned t1 = c+1 < clusters.size() ? clusters[c+1] : output.size()/3u;
+            sorted.insert(sorted.end(), output.begin() + t0*3u, output.begin() + t1*3u);
+        }
+        output.swap(sorted);
+    }
+
+    // Rebuilds per-vertex arrays from a new-to-old index map.
+    struct Remap : public osg::ArrayVisitor
+    {
+        Remap(const std::vector<unsigned>& newToOld) : _newToOld(newToOld) { }
+        const std::vector<unsigned>& _newToOld;
+
+        template<typename T>
+        void remap(T& array)
+        {
+            T temp(_newToOld.size());
+            for (unsigned i = 0; i < _newToOld.size(); ++i)
+                temp[i] = array[_newToOld[i]];
+            array.asVector().swap(temp.asVector());
+        }
+
+        virtual void apply(osg::ByteArray& a)    { remap(a); }
+        virtual void apply(osg::ShortArray& a)   { remap(a); }
+        virtual void apply(osg::IntArray& a)     { remap(a); }
+        virtual void apply(osg::UByteArray& a)   { remap(a); }
+        virtual void apply(osg::UShortArray& a)  { remap(a); }
+        virtual void apply(osg::UIntArray& a)    { remap(a); }
+        virtual void apply(osg::FloatArray& a)   { remap(a); }
+        virtual void apply(osg::DoubleArray& a)  { remap(a); }
+        virtual void apply(osg::Vec2Array& a)    { remap(a); }
+        virtual void apply(osg::Vec3Array& a)    { remap(a); }
+        virtual void apply(osg::Vec4Array& a)    { remap(a); }
+        virtual void apply(osg::Vec4ubArray& a)  { remap(a); }
+        virtual void apply(osg::Vec2dArray& a)   { remap(a); }
+        virtual void apply(osg::Vec3dArray& a)   { remap(a); }
+        virtual void apply(osg::Vec4dArray& a)   { remap(a); }
+    };
+
+    void remapArray(osg::Array* array, unsigned numVerts, Remap& remap)
+    {
+        if ( array && array->getBinding() == osg::Array::BIND_PER_VERTEX && array->getNumElements() == numVerts )
+        {
+            array->accept( remap );
+            array->dirty();
+        }
+    }
+}
+
+void
+MeshConsolidator::optimizeVertexCache( osg::Geometry& geom, unsigned cacheSize )
+{
+    osg::Vec3Array* verts = dynamic_cast<osg::Vec3Array*>( geom.getVertexArray() );
+    if ( !verts || verts->empty() || cacheSize < 3u )
+        return;
+
+    unsigned numVerts = verts->size();
+
+    // Only indexed triangle lists can be reordered; and we can only renumber
+    // the vertices if every primitive set is indexed.
+    bool allIndexed = true;
+    std::vector<std::vector<GLuint> > indexLists( geom.getNumPrimitiveSets() );
+
+    for( unsigned p=0; p<geom.getNumPrimitiveSets(); ++p )
+    {
+        osg::DrawElements* de = geom.getPrimitiveSet(p)->getDrawElements();
+        if ( !de )
+        {
+            allIndexed = false;
+            continue;
+        }
+
+        std::vector<GLuint>& indices = indexLists[p];
+        indices.resize( de->getNumIndices() );
+        for( unsigned i=0; i<indices.size(); ++i )
+        {
+            indices[i] = de->getElement(i);
+            if ( indices[i] >= numVerts )
+                return; // bad geometry; leave it alone
+        }
+
+        if ( de->getMode() == GL_TRIANGLES && de->getNumInstances() == 0 && indices.size() >= 6u )
+        {
+            std::vector<GLuint> optimized;
+            tipsify( indices, *verts, cacheSize, optimized );
+            indices.swap( optimized );
+        }
+    }
+
+    // Renumber the vertices in the order of first use:
+    std::vector<unsigned> oldToNew( numVerts, ~0u );
+    if ( allIndexed )
+    {
+        std::vector<unsigned> newToOld;
+        newToOld.reserve( numVerts );
+        for( unsigned p=0; p<indexLists.size(); ++p )
+        {
+            for( unsigned i=0; i<indexLists[p].size(); ++i )
+            {
+                GLuint v = indexLists[p][i];
+                if ( oldToNew[v] == ~0u )
+                {
+                    oldToNew[v] = newToOld.size();
+                    newToOld.push_back( v );
+                }
+            }
+        }
+
+        // keep any unreferenced vertices (at the end):
+        for( unsigned v=0; v<numVerts; ++v )
+        {
+            if ( oldToNew[v] == ~0u )
+            {
+                oldToNew[v] = newToOld.size();
+                newToOld.push_back( v );
+            }
+        }
+
+        Remap remap( newToOld );
+        remapArray( geom.getVertexArray(), numVerts, remap );
+        remapArray( geom.getNormalArray(), numVerts, remap );
+        remapArray( geom.getColorArray(), numVerts, remap );
+        remapArray( geom.getSecondaryColorArray(), numVerts, remap );
+        remapArray( geom.getFogCoordArray(), numVerts, remap );
+        for( unsigned i=0; i<geom.getNumTexCoordArrays(); ++i )
+            remapArray( geom.getTexCoordArray(i), numVerts, remap );
+        for( unsigned i=0; i<geom.getNumVertexAttribArrays(); ++i )
+            remapArray( geom.getVertexAttribArray(i), numVerts, remap );
+    }
+    else
+    {
+        for( unsigned v=0; v<numVerts; ++v )
+            oldToNew[v] = v;
+    }
+
+    // Rebuild the indexed primitive sets:
+    for( unsigned p=0; p<geom.getNumPrimitiveSets(); ++p )
+    {
+        osg::PrimitiveSet* old = geom.getPrimitiveSet(p);
+        if ( !old->getDrawElements() )
+            continue;
+
+        const std::vector<GLuint>& indices = indexLists[p];
+        osg::DrawElements* de;
+        if ( numVerts <= 0x10000 )
+            de = new osg::DrawElementsUShort( old->getMode() );
+        else
+            de = new osg::DrawElementsUInt( old->getMode() );
+
+        de->reserveElements( indices.size() );
+        for( unsigned i=0; i<indices.size(); ++i )
+            de->addElement( oldToNew[indices[i]] );
+
+        de->setNumInstances( old->getNumInstances() );
+        de->setUserData( old->getUserData() );
+        geom.setPrimitiveSet( p, de );
+    }
+
+    geom.dirtyDisplayList();
+    geom.dirtyBound();
+}
@@ -23,9 +23,12 @@
 #include <osgEarthSymbology/MeshConsolidator>
 #include <osgEarthSymbology/MeshFlattener>
 #include <osgEarth/StateSetCache>
+#include <osgEarth/JobScheduler>
+#include <osgEarth/Registry>
 #include <osgUtil/Optimizer>
 #include <osgDB/WriteFile>
 #include <osg/Billboard>
+#include <set>
 
 using namespace osgEarth;
 using namespace osgEarth::Symbology;
@@ -56,6 +59,34 @@ namespace
             }
         }
     };
+
+    // Consolidates (and optionally merges) the drawables of one geode,
+    // i.e. one state bucket, on the job scheduler.
+    struct ConsolidateJob : public TaskRequest
+    {
+        osg::ref_ptr<osg::Geode> _geode;
+        bool _mergeGeometry;
+        unsigned _maxVertsPerCluster;
+
+        void operator()(ProgressCallback*)
+        {
+            // Consolidate all the drawables in the geode.
+            MeshConsolidator::run(*_geode.get());
+
+            if (_mergeGeometry)
+            {
+                // Run MERGE_GEOMETRY so that it will merge all the primitive sets
+                osgUtil::Optimizer::MergeGeometryVisitor mg;
+                mg.setTargetMaximumNumberOfVertices(std::max(_maxVertsPerCluster, 1000u));
+                _geode->accept( mg );
+
+                // Remove any empty geoetries. For some reason the MergeGeometryVisitor sometimes 
+                // leaves them around.
+                RemoveEmptyGeometries reg;
+                _geode->accept( reg );
+            }
+        }
+    };
 }
 
 /********************************/
@@ -162,6 +193,9 @@ osg::NodeVisitor( osg::NodeVisitor::TRAVERSE_ALL_CHILDREN )
 
         OE_DEBUG << "We have " << _geometries.size() << " stateset stacks" << std::endl;
 
+        std::vector<osg::ref_ptr<ConsolidateJob> > jobs;
+        std::set<osg::Geometry*> seen;
+
         unsigned int i = 0;
         for (StateSetStackToGeometryMap::iterator itr = _geometries.begin(); itr != _geometries.end(); ++itr)
         {
@@ -180,27 +214,45 @@ osg::NodeVisitor( osg::NodeVisitor::TRAVERSE_ALL_CHILDREN )
             for (GeometryVector::iterator gItr = itr->second.begin(); gItr != itr->second.end(); ++gItr)
             {
                 osg::Geometry* g = gItr->get();
+
+                // Buckets are consolidated in parallel, so a geometry that
+                // appears in more than one of them needs its own copy.
+                if (!seen.insert(g).second)
+                    g = osg::clone(g, osg::CopyOp::DEEP_COPY_ARRAYS | osg::CopyOp::DEEP_COPY_PRIMITIVES);
+
                 // Remove any stateset that might be on the Geometry
                 g->setStateSet(0);
                 geode->addDrawable( g );
             }
             result->addChild(geode);
-            
-            // Consolidate all the drawables in the geode.
-            MeshConsolidator::run(*geode);
+
+            ConsolidateJob* job = new ConsolidateJob();
+            job->_geode = geode;
+            job->_mergeGeometry = _mergeGeometry;
+            job->_maxVertsPerCluster = _maxVertsPerCluster;
+            jobs.push_back(job);
         }
 
-        if (_mergeGeometry)
+        // Each state bucket is independent, so consolidate them in parallel.
+        JobScheduler* scheduler = Registry::instance()->getJobScheduler();
+        osg::ref_ptr<JobGroup> group = new JobGroup();
+        for (unsigned j = 0; j < jobs.size(); ++j)
+        {
+            scheduler->submit(jobs[j].get(), JobScheduler::LANE_NORMAL, group.get());
+        }
+
+        // If we're on a scheduler thread, help out instead of blocking a worker.
+        if (scheduler->isWorkerThread())
+        {
+            while (group->getNumPending() > 0u)
+            {
+                if (!scheduler->runOne())
+                    group->wait(0u, 10u);
+            }
+        }
+        else
         {
-            // Run MERGE_GEOMETRY so that it will merge all the primitive sets
-            osgUtil::Optimizer::MergeGeometryVisitor mg;
-            mg.setTargetMaximumNumberOfVertices(std::max(_maxVertsPerCluster, 1000u));
-            result->accept( mg );
-
-            // Remove any empty geoetries. For some reason the MergeGeometryVisitor sometimes 
-            // leaves them around.
-            RemoveEmptyGeometries reg;
-            result->accept( reg );
+            group->wait();
         }
        
         //osgDB::writeNodeFile(*result, "clustered.osgt");
@@ -0,0 +1,423 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2016 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarthSymbology/MeshSimplifier>
+#include <osgEarth/ObjectIndex>
+#include <osgEarth/Registry>
+#include <osgEarth/Notify>
+#include <osg/TriangleIndexFunctor>
+#include <osg/NodeVisitor>
+#include <algorithm>
+#include <cmath>
+
+#define LC "[MeshSimplifier] "
+
+using namespace osgEarth;
+using namespace osgEarth::Symbology;
+
+// Number of times to grow the cell size while looking for one
+// that meets the triangle budget, and the growth factor.
+#define MAX_SEARCH_STEPS 16
+#define CELL_GROWTH      1.5
+
+namespace
+{
+    struct TriangleCollector
+    {
+        std::vector<GLuint>* _indices;
+        void operator()(GLuint i0, GLuint i1, GLuint i2)
+        {
+            _indices->push_back(i0);
+            _indices->push_back(i1);
+            _indices->push_back(i2);
+        }
+    };
+
+    bool isTriangleMode(GLenum mode)
+    {
+        return
+            mode == GL_TRIANGLES ||
+            mode == GL_TRIANGLE_STRIP ||
+            mode == GL_TRIANGLE_FAN ||
+            mode == GL_QUADS ||
+            mode == GL_QUAD_STRIP ||
+            mode == GL_POLYGON;
+    }
+
+    // Grid cell plus whatever must match for two vertices to merge.
+    struct VertexKey
+    {
+        int _x, _y, _z;
+        unsigned _tag;
+        unsigned _vert;
+
+        bool operator < (const VertexKey& rhs) const
+        {
+            if (_x != rhs._x) return _x < rhs._x;
+            if (_y != rhs._y) return _y < rhs._y;
+            if (_z != rhs._z) return _z < rhs._z;
+            if (_tag != rhs._tag) return _tag < rhs._tag;
+            return _vert < rhs._vert;
+        }
+
+        bool sameCell(const VertexKey& rhs) const
+        {
+            return _x == rhs._x && _y == rhs._y && _z == rhs._z && _tag == rhs._tag;
+        }
+    };
+
+    // A geometry with its triangle primitive sets expanded to triangle lists.
+    struct Mesh
+    {
+        osg::Geometry*                   _geom;
+        const osg::Vec3Array*            _verts;
+        std::vector<unsigned>            _tags;     // per-vertex merge tag
+        std::vector<unsigned>            _psets;    // primitive set numbers
+        std::vector<std::vector<GLuint> > _tris;    // triangle list for each of those
+        std::vector<unsigned>            _rep;      // representative of each vertex
+        bool                             _simple;   // only triangle primitive sets
+
+        unsigned getNumTriangles() const
+        {
+            unsigned count = 0u;
+            for (unsigned i = 0; i < _tris.size(); ++i)
+                count += _tris[i].size() / 3u;
+            return count;
+        }
+    };
+
+    // Normal direction bucket (dominant axis and sign), 0..5.
+    unsigned normalBucket(const osg::Vec3f& n)
+    {
+        float ax = fabs(n.x()), ay = fabs(n.y()), az = fabs(n.z());
+        if (ax >= ay && ax >= az) return n.x() >= 0.0f ? 0u : 1u;
+        if (ay >= az)             return n.y() >= 0.0f ? 2u : 3u;
+        return                           n.z() >= 0.0f ? 4u : 5u;
+    }
+
+    bool prepare(osg::Geometry* geom, Mesh& mesh)
+    {
+        mesh._geom = geom;
+        mesh._verts = dynamic_cast<const osg::Vec3Array*>(geom->getVertexArray());
+        mesh._simple = true;
+        if (!mesh._verts || mesh._verts->empty())
+            return false;
+
+        unsigned numVerts = mesh._verts->size();
+
+        for (unsigned p = 0; p < geom->getNumPrimitiveSets(); ++p)
+        {
+            osg::PrimitiveSet* pset = geom->getPrimitiveSet(p);
+            if (!isTriangleMode(pset->getMode()) || pset->getNumInstances() > 0)
+            {
+                mesh._simple = false;
+                continue;
+            }
+
+            mesh._psets.push_back(p);
+            mesh._tris.push_back(std::vector<GLuint>());
+
+            osg::TriangleIndexFunctor<TriangleCollector> collector;
+            collector._indices = &mesh._tris.back();
+            pset->accept(collector);
+        }
+
+        if (mesh._psets.empty())
+            return false;
+
+        // Merge tag: object ID (so features stay separate) and normal bucket
+        // (so faces pointing different ways stay separate).
+        mesh._tags.assign(numVerts, 0u);
+
+        const osg::Vec3Array* normals = dynamic_cast<const osg::Vec3Array*>(geom->getNormalArray());
+        if (normals && normals->size() == numVerts)
+        {
+            for (unsigned i = 0; i < numVerts; ++i)
+                mesh._tags[i] = normalBucket((*normals)[i]);
+        }
+
+        const ObjectIDArray* oids = dynamic_cast<const ObjectIDArray*>(
+            geom->getVertexAttribArray(Registry::objectIndex()->getObjectIDAttribLocation()));
+        if (oids && oids->size() == numVerts)
+        {
+            for (unsigned i = 0; i < numVerts; ++i)
+                mesh._tags[i] += 6u * (*oids)[i];
+        }
+
+        return true;
+    }
+
+    // Picks a representative vertex for every vertex in the mesh and returns
+    // the number of triangles that would survive.
+    unsigned cluster(Mesh& mesh, double cellSize)
+    {
+        unsigned numVerts = mesh._verts->size();
+        mesh._rep.resize(numVerts);
+
+        if (cellSize <= 0.0)
+        {
+            for (unsigned i = 0; i < numVerts; ++i)
+                mesh._rep[i] = i;
+            return mesh.getNumTriangles();
+        }
+
+        std::vector<VertexKey> keys(numVerts);
+        double inv = 1.0 / cellSize;
+        for (unsigned i = 0; i < numVerts; ++i)
+        {
+            const osg::Vec3f& v = (*mesh._verts)[i];
+            keys[i]._x = (int)floor(v.x() * inv);
+            keys[i]._y = (int)floor(v.y() * inv);
+            keys[i]._z = (int)floor(v.z() * inv);
+            keys[i]._tag = mesh._tags[i];
+            keys[i]._vert = i;
+        }
+        std::sort(keys.begin(), keys.end());
+
+        // The lowest-numbered vertex in each cell represents it.
+        for (unsigned i = 0; i < numVerts; )
+        {
+            unsigned j = i;
+            while (j < numVerts && keys[j].sameCell(keys[i]))
+            {
+                mesh._rep[keys[j]._vert] = keys[i]._vert;
+                ++j;
+            }
+            i = j;
+        }
+
+        unsigned count = 0u;
+        for (unsigned p = 0; p < mesh._tris.size(); ++p)
+        {
+            const std::vector<GLuint>& tris = mesh._tris[p];
+            for (unsigned t = 0; t + 2 < tris.size(); t += 3)
+            {
+                GLuint a = mesh._rep[tris[t]], b = mesh._rep[tris[t+1]], c = mesh._rep[tris[t+2]];
+                if (a != b && b != c && a != c)
+                    ++count;
+            }
+        }
+        return count;
+    }
+
+    // Rebuilds per-vertex arrays from a new-to-old index map.
+    struct Remap : public osg::ArrayVisitor
+    {
+        Remap(const std::vector<unsigned>& newToOld) : _newToOld(newToOld) { }
+        const std::vector<unsigned>& _newToOld;
+
+        template<typename T>
+        void remap(T& array)
+        {
+            T temp(_newToOld.size());
+            for (unsigned i = 0; i < _newToOld.size(); ++i)
+                temp[i] = array[_newToOld[i]];
+            array.asVector().swap(temp.asVector());
+        }
+
+        virtual void apply(osg::ByteArray& a)    { remap(a); }
+        virtual void apply(osg::ShortArray& a)   { remap(a); }
+        virtual void apply(osg::IntArray& a)     { remap(a); }
+        virtual void apply(osg::UByteArray& a)   { remap(a); }
+        virtual void apply(osg::UShortArray& a)  { remap(a); }
+        virtual void apply(osg::UIntArray& a)    { remap(a); }
+        virtual void apply(osg::FloatArray& a)   { remap(a); }
+        virtual void apply(osg::DoubleArray& a)  { remap(a); }
+        virtual void apply(osg::Vec2Array& a)    { remap(a); }
+        virtual void apply(osg::Vec3Array& a)    { remap(a); }
+        virtual void apply(osg::Vec4Array& a)    { remap(a); }
+        virtual void apply(osg::Vec4ubArray& a)  { remap(a); }
+        virtual void apply(osg::Vec2dArray& a)   { remap(a); }
+        virtual void apply(osg::Vec3dArray& a)   { remap(a); }
+        virtual void apply(osg::Vec4dArray& a)   { remap(a); }
+    };
+
+    void remapArray(osg::Array* array, unsigned numVerts, Remap& remap)
+    {
+        if (array && array->getNumElements() == numVerts)
+        {
+            array->accept(remap);
+            array->dirty();
+        }
+    }
+
+    // Writes the clustered triangles back into the geometry.
+    void applyMesh(Mesh& mesh)
+    {
+        osg::Geometry* geom = mesh._geom;
+        unsigned numVerts = mesh._verts->size();
+
+        std::vector<osg::ref_ptr<osg::DrawElementsUInt> > newSets(mesh._psets.size());
+        for (unsigned p = 0; p < mesh._psets.size(); ++p)
+        {
+            const std::vector<GLuint>& tris = mesh._tris[p];
+            osg::DrawElementsUInt* de = new osg::DrawElementsUInt(GL_TRIANGLES);
+            for (unsigned t = 0; t + 2 < tris.size(); t += 3)
+            {
+                GLuint a = mesh._rep[tris[t]], b = mesh._rep[tris[t+1]], c = mesh._rep[tris[t+2]];
+                if (a != b && b != c && a != c)
+                {
+                    de->push_back(a);
+                    de->push_back(b);
+                    de->push_back(c);
+                }
+            }
+
+            // keep the user data (e.g. feature index tags) with its primitives
+            osg::PrimitiveSet* old = geom->getPrimitiveSet(mesh._psets[p]);
+            de->setUserData(old->getUserData());
+            newSets[p] = de;
+        }
+
+        // Drop the unused vertices, unless other primitive sets still refer
+        // to the old vertex numbering.
+        if (mesh._simple)
+        {
+            std::vector<unsigned> oldToNew(numVerts, ~0u);
+            std::vector<unsigned> newToOld;
+            for (unsigned p = 0; p < newSets.size(); ++p)
+            {
+                osg::DrawElementsUInt& de = *newSets[p];
+                for (unsigned i = 0; i < de.size(); ++i)
+                {
+                    if (oldToNew[de[i]] == ~0u)
+                    {
+                        oldToNew[de[i]] = newToOld.size();
+                        newToOld.push_back(de[i]);
+                    }
+                    de[i] = oldToNew[de[i]];
+                }
+            }
+
+            Remap remap(newToOld);
+            remapArray(geom->getVertexArray(), numVerts, remap);
+            remapArray(geom->getNormalArray(), numVerts, remap);
+            remapArray(geom->getColorArray(), numVerts, remap);
+            remapArray(geom->getSecondaryColorArray(), numVerts, remap);
+            remapArray(geom->getFogCoordArray(), numVerts, remap);
+            for (unsigned i = 0; i < geom->getNumTexCoordArrays(); ++i)
+                remapArray(geom->getTexCoordArray(i), numVerts, remap);
+            for (unsigned i = 0; i < geom->getNumVertexAttribArrays(); ++i)
+                remapArray(geom->getVertexAttribArray(i), numVerts, remap);
+        }
+
+        for (unsigned p = 0; p < newSets.size(); ++p)
+            geom->setPrimitiveSet(mesh._psets[p], newSets[p].get());
+
+        geom->dirtyDisplayList();
+        geom->dirtyBound();
+    }
+
+    struct CollectGeometry : public osg::NodeVisitor
+    {
+        CollectGeometry() : osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN) { }
+        std::vector<osg::Geometry*> _geoms;
+
+        void apply(osg::Drawable& drawable)
+        {
+            osg::Geometry* geom = drawable.asGeometry();
+            if (geom && std::find(_geoms.begin(), _geoms.end(), geom) == _geoms.end())
+                _geoms.push_back(geom);
+        }
+    };
+}
+
+//------------------------------------------------------------------------
+
+MeshSimplifier::MeshSimplifier() :
+_maxTriangles( 0u ),
+_cellSize    ( 0.0 )
+{
+    //nop
+}
+
+unsigned
+MeshSimplifier::run(osg::Node& node)
+{
+    CollectGeometry collect;
+    node.accept(collect);
+    return run(collect._geoms);
+}
+
+unsigned
+MeshSimplifier::run(osg::Geometry& geom)
+{
+    std::vector<osg::Geometry*> geoms(1, &geom);
+    return run(geoms);
+}
+
+unsigned
+MeshSimplifier::run(std::vector<osg::Geometry*>& geoms)
+{
+    std::vector<Mesh> meshes;
+    meshes.reserve(geoms.size());
+
+    osg::BoundingBox bbox;
+    unsigned numTris = 0u;
+
+    for (unsigned i = 0; i < geoms.size(); ++i)
+    {
+        meshes.push_back(Mesh());
+        if (prepare(geoms[i], meshes.back()))
+        {
+            numTris += meshes.back().getNumTriangles();
+            bbox.expandBy(geoms[i]->getBoundingBox());
+        }
+        else
+        {
+            meshes.pop_back();
+        }
+    }
+
+    if (meshes.empty())
+        return 0u;
+
+    double cellSize = _cellSize;
+
+    if (cellSize <= 0.0)
+    {
+        if (_maxTriangles == 0u || numTris <= _maxTriangles)
+            return numTris;
+
+        // Start with cells about the size of a triangle at the target
+        // density and grow them until the mesh fits the budget.
+        double size = osg::maximum(bbox.xMax()-bbox.xMin(), osg::maximum(bbox.yMax()-bbox.yMin(), bbox.zMax()-bbox.zMin()));
+        cellSize = 0.5 * size / sqrt((double)_maxTriangles);
+    }
+
+    unsigned result = 0u;
+    for (int step = 0; step < MAX_SEARCH_STEPS; ++step)
+    {
+        result = 0u;
+        for (unsigned i = 0; i < meshes.size(); ++i)
+            result += cluster(meshes[i], cellSize);
+
+        if (_cellSize > 0.0 || result <= _maxTriangles)
+            break;
+
+        cellSize *= CELL_GROWTH;
+    }
+
+    for (unsigned i = 0; i < meshes.size(); ++i)
+        applyMesh(meshes[i]);
+
+    OE_DEBUG << LC << "Simplified " << numTris << " triangles to " << result
+        << " (cell size = " << cellSize << ")" << std::endl;
+
+    return result;
+}
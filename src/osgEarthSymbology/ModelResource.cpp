@@ -22,11 +22,17 @@
 #include <osgEarth/Registry>
 #include <osgEarth/Capabilities>
 #include <osgEarth/ImageUtils>
+#include <osgEarth/Cache>
+#include <osgEarth/OptionsOverlay>
 #include <osgUtil/Optimizer>
 #include <osg/ComputeBoundsVisitor>
 
 #define LC "[ModelResource] "
 
+// Bump this when the optimization below changes, so stale cache records
+// are ignored.
+#define MODEL_CACHE_VERSION 1
+
 using namespace osgEarth;
 using namespace osgEarth::Symbology;
 
@@ -110,6 +116,33 @@ ModelResource::createNodeFromURI( const URI& uri, const osgDB::Options* dbOption
 
     osg::Node* node = 0L;
 
+    // The optimizer pass costs far more than reading the result back, so
+    // the optimized model goes in its own cache bin.
+    CacheBin* bin = 0L;
+    CacheSettings* cacheSettings = CacheSettings::get(options.get());
+    if (cacheSettings && cacheSettings->isCacheEnabled() && cacheSettings->getCache())
+        bin = cacheSettings->getCache()->addBin("model_resources");
+
+    std::string cacheKey = Stringify() << "model_" << MODEL_CACHE_VERSION << "_" << uri.cacheKey();
+
+    if (bin && cacheSettings->cachePolicy()->isCacheReadable())
+    {
+        ReadResult r = bin->readObject(cacheKey, options.get());
+        if (r.succeeded() && !cacheSettings->cachePolicy()->isExpired(r.lastModifiedTime()))
+        {
+            node = r.releaseNode();
+        }
+    }
+
+    if (node)
+    {
+        OE_INFO << LC << "Loaded " << uri.base() << " (optimized, from cache)" << std::endl;
+
+        SetUnRefPolicyToFalse visitor;
+        node->accept( visitor );
+        return node;
+    }
+
     ReadResult r = uri.readNode( options.get() );
     if ( r.succeeded() )
     {
@@ -134,6 +167,16 @@ ModelResource::createNodeFromURI( const URI& uri, const osgDB::Options* dbOption
         // Disable automatic texture unref since resources can be shared/paged.
         SetUnRefPolicyToFalse visitor;
         node->accept( visitor );
+
+        if (bin && cacheSettings->cachePolicy()->isCacheWriteable())
+        {
+            // Textures go inline so the record stands on its own.
+            osg::ref_ptr<const osgDB::Options> writeOptions = OptionsOverlay()
+                .setPluginStringData("WriteImageHint", "IncludeData")
+                .apply(dbOptions);
+
+            bin->write(cacheKey, node, writeOptions.get());
+        }
     }
     else // failing that, fall back on the old encoding format..
     {
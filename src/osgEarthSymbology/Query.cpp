@@ -17,6 +17,8 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include <osgEarthSymbology/Query>
+#include <osgEarth/StringUtils>
+#include <set>
 
 using namespace osgEarth;
 using namespace osgEarth::Symbology;
@@ -31,7 +33,8 @@ _bounds(rhs._bounds),
 _expression(rhs._expression),
 _orderby(rhs._orderby),
 _tileKey(rhs._tileKey),
-_limit(rhs._limit)
+_limit(rhs._limit),
+_fields(rhs._fields)
 {
     //nop
 }
@@ -57,6 +60,12 @@ Query::mergeConfig( const Config& conf )
     }
 
     conf.getIfSet("limit", _limit);
+
+    if ( conf.hasValue("fields") )
+    {
+        _fields.clear();
+        StringTokenizer( conf.value("fields"), _fields, ", ", "", false, true );
+    }
 }
 
 Config
@@ -66,6 +75,12 @@ Query::getConfig() const
     conf.addIfSet( "expr", _expression );
     conf.addIfSet( "orderby", _orderby);
     conf.addIfSet( "limit", _limit);
+    if ( !_fields.empty() ) {
+        std::string fields;
+        for (unsigned i = 0; i < _fields.size(); ++i)
+            fields += (i > 0 ? "," : "") + _fields[i];
+        conf.set( "fields", fields );
+    }
     if ( _bounds.isSet() ) {
         Config bc( "extent" );
         bc.add( "xmin", toString(_bounds->xMin()) );
@@ -128,5 +143,17 @@ Query::combineWith( const Query& rhs ) const
         merged.bounds() = *rhs.bounds();
     }
 
+    // merge the fields; if either side wants every field, so does the result.
+    if ( !_fields.empty() && !rhs._fields.empty() )
+    {
+        std::set<std::string> names;
+        merged._fields = _fields;
+        for (unsigned i = 0; i < _fields.size(); ++i)
+            names.insert( toLower(_fields[i]) );
+        for (unsigned i = 0; i < rhs._fields.size(); ++i)
+            if ( names.insert( toLower(rhs._fields[i]) ).second )
+                merged._fields.push_back( rhs._fields[i] );
+    }
+
     return merged;
 }
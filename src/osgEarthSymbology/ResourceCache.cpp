@@ -17,118 +17,410 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include <osgEarthSymbology/ResourceCache>
+#include <osgEarth/JobScheduler>
+#include <osgEarth/Registry>
 #include <osg/Texture2D>
+#include <osg/Geode>
+#include <osg/Geometry>
+#include <OpenThreads/Thread>
+#include <set>
+
+#define LC "[ResourceCache] "
 
 using namespace osgEarth;
 using namespace osgEarth::Symbology;
 
-
-// internal thread-safety not required since we mutex it in this object.
-ResourceCache::ResourceCache() : // const osgDB::Options* dbOptions ) :
-//_dbOptions    ( dbOptions ),
-_skinCache    ( false ),
-_instanceCache( false ),
-_resourceLibraryCache( false )
+namespace
 {
-    //nop
-}
+    // Estimates the memory held by a cached object: image data and
+    // vertex/index arrays, counting shared data once.
+    struct EstimateBytes : public osg::NodeVisitor
+    {
+        EstimateBytes() : osg::NodeVisitor(TRAVERSE_ALL_CHILDREN), _bytes(0u) { }
 
-bool
-ResourceCache::getOrCreateLineTexture(const URI& uri, osg::ref_ptr<osg::Texture>& output, const osgDB::Options* readOptions)
-{
-    Threading::ScopedMutexLock lock(_texMutex);
-    TextureCache::Record rec;
-    if (_texCache.get(uri.full(), rec) && rec.value().valid())
+        void apply(osg::Node& node)
+        {
+            add(node.getStateSet());
+            traverse(node);
+        }
+
+        void apply(osg::Geode& geode)
+        {
+            add(geode.getStateSet());
+            for (unsigned i = 0; i < geode.getNumDrawables(); ++i)
+            {
+                osg::Drawable* drawable = geode.getDrawable(i);
+                add(drawable->getStateSet());
+
+                osg::Geometry* geom = drawable->asGeometry();
+                if (geom)
+                {
+                    add(geom->getVertexArray());
+                    add(geom->getNormalArray());
+                    add(geom->getColorArray());
+                    for (unsigned t = 0; t < geom->getNumTexCoordArrays(); ++t)
+                        add(geom->getTexCoordArray(t));
+                    for (unsigned a = 0; a < geom->getNumVertexAttribArrays(); ++a)
+                        add(geom->getVertexAttribArray(a));
+                    for (unsigned p = 0; p < geom->getNumPrimitiveSets(); ++p)
+                        add(geom->getPrimitiveSet(p));
+                }
+            }
+            traverse(geode);
+        }
+
+        void add(osg::BufferData* data)
+        {
+            if (data && _seen.insert(data).second)
+                _bytes += data->getTotalDataSize();
+        }
+
+        void add(osg::StateSet* stateSet)
+        {
+            if (!stateSet || !_seen.insert(stateSet).second)
+                return;
+
+            const osg::StateSet::TextureAttributeList& units = stateSet->getTextureAttributeList();
+            for (unsigned u = 0; u < units.size(); ++u)
+            {
+                osg::Texture* tex = dynamic_cast<osg::Texture*>(
+                    stateSet->getTextureAttribute(u, osg::StateAttribute::TEXTURE));
+                add(tex);
+            }
+        }
+
+        void add(osg::Texture* tex)
+        {
+            if (!tex || !_seen.insert(tex).second)
+                return;
+
+            for (unsigned i = 0; i < tex->getNumImages(); ++i)
+            {
+                osg::Image* image = tex->getImage(i);
+                if (image && _seen.insert(image).second)
+                    _bytes += image->getTotalSizeInBytes();
+            }
+        }
+
+        unsigned                    _bytes;
+        std::set<const osg::Object*> _seen;
+    };
+
+    unsigned estimateBytes(osg::Object* object)
     {
-        output = rec.value().get();
+        EstimateBytes visitor;
+        if (dynamic_cast<osg::Node*>(object))
+            static_cast<osg::Node*>(object)->accept(visitor);
+        else if (dynamic_cast<osg::StateSet*>(object))
+            visitor.add(static_cast<osg::StateSet*>(object));
+        else if (dynamic_cast<osg::Texture*>(object))
+            visitor.add(static_cast<osg::Texture*>(object));
+        return visitor._bytes;
     }
-    else
+
+    struct SkinLoader : public ResourceCache::Loader
+    {
+        SkinLoader(SkinResource* skin, const osgDB::Options* readOptions) :
+            _skin(skin), _readOptions(readOptions) { }
+
+        osg::Object* load()
+        {
+            return _skin->createStateSet(_readOptions.get());
+        }
+
+        osg::ref_ptr<SkinResource>         _skin;
+        osg::ref_ptr<const osgDB::Options> _readOptions;
+    };
+
+    struct InstanceLoader : public ResourceCache::Loader
+    {
+        InstanceLoader(InstanceResource* res, const osgDB::Options* readOptions) :
+            _res(res), _readOptions(readOptions) { }
+
+        osg::Object* load()
+        {
+            return _res->createNode(_readOptions.get());
+        }
+
+        osg::ref_ptr<InstanceResource>     _res;
+        osg::ref_ptr<const osgDB::Options> _readOptions;
+    };
+
+    struct LineTextureLoader : public ResourceCache::Loader
     {
-        osg::ref_ptr<osg::Image> image = uri.getImage(readOptions);
-        if (image.valid())
+        LineTextureLoader(const URI& uri, const osgDB::Options* readOptions) :
+            _uri(uri), _readOptions(readOptions) { }
+
+        osg::Object* load()
         {
-            osg::Texture2D* tex = new osg::Texture2D(image);
+            osg::ref_ptr<osg::Image> image = _uri.getImage(_readOptions.get());
+            if (!image.valid())
+                return 0L;
+
+            osg::Texture2D* tex = new osg::Texture2D(image.get());
             tex->setWrap( osg::Texture::WRAP_S, osg::Texture::CLAMP_TO_EDGE );
             tex->setWrap( osg::Texture::WRAP_T, osg::Texture::REPEAT );
             tex->setFilter( osg::Texture::MIN_FILTER, osg::Texture::LINEAR_MIPMAP_LINEAR );
             tex->setFilter( osg::Texture::MAG_FILTER, osg::Texture::LINEAR);
             tex->setMaxAnisotropy( 4.0f );
             tex->setResizeNonPowerOfTwoHint( false );
-            output = tex;
-            _texCache.insert(uri.full(), output.get());
+            return tex;
         }
+
+        URI                                _uri;
+        osg::ref_ptr<const osgDB::Options> _readOptions;
+    };
+
+    // Key for an instance: its definition without its name, so identical
+    // resources from different libraries share an entry.
+    std::string instanceKey(InstanceResource* res)
+    {
+        Config conf = res->getConfig();
+        conf.remove("name");
+        return "instance:" + conf.toJSON(false);
     }
+}
 
-    return output.valid();
+struct ResourceCache::LoadTask : public TaskRequest
+{
+    LoadTask(ResourceCache* cache, const std::string& key, Loader* loader) :
+        _cache(cache), _key(key), _loader(loader) { }
+
+    void operator()(ProgressCallback* progress)
+    {
+        osg::ref_ptr<osg::Object> object = _loader->load();
+        _cache->loaded(_key, object.get());
+        _promise.resolve(object.get());
+    }
+
+    osg::ref_ptr<ResourceCache>    _cache;
+    std::string                    _key;
+    osg::ref_ptr<Loader>           _loader;
+    Threading::Promise<osg::Object> _promise;
+};
+
+//------------------------------------------------------------------------
+
+ResourceCache::ResourceCache() :
+_maxBytes( 256u * 1024u * 1024u ),
+_bytes   ( 0u ),
+_clock   ( 0u )
+{
+    //nop
 }
 
-bool
-ResourceCache::getOrCreateStateSet(SkinResource*                skin,
-                                   osg::ref_ptr<osg::StateSet>& output,
-                                   const osgDB::Options*        readOptions)
+ResourceCache*
+ResourceCache::getShared()
 {
-    output = 0L;
-    //std::string key = skin->getConfig().toJSON(false);
+    static osg::ref_ptr<ResourceCache> s_shared;
+    static Threading::Mutex            s_sharedMutex;
 
-    // Note: we use the imageURI as the basis for the caching key since 
-    // it's the only property used by Skin->createStateSet(). If that
-    // changes, we need to address it here. It might be better it SkinResource
-    // were to provide a unique key.
-    std::string key = skin->getUniqueID();
+    Threading::ScopedMutexLock lock(s_sharedMutex);
+    if ( !s_shared.valid() )
+        s_shared = new ResourceCache();
+    return s_shared.get();
+}
+
+void
+ResourceCache::setMaxBytes(unsigned value)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    _maxBytes = value;
+    evict();
+}
+
+unsigned
+ResourceCache::getNumBytes() const
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    return _bytes;
+}
+
+void
+ResourceCache::clear()
+{
+    Threading::ScopedMutexLock lock(_mutex);
+
+    // keep the entries that are still loading, so their waiters resolve.
+    for (Entries::iterator i = _entries.begin(); i != _entries.end(); )
+    {
+        if (i->second._future.isAvailable())
+            _entries.erase(i++);
+        else
+            ++i;
+    }
+    _bytes = 0u;
+    _skinStats._entries = 0u;
+    _instanceStats._entries = 0u;
+}
 
-    // exclusive lock (since it's an LRU)
+const CacheStats
+ResourceCache::getSkinStats() const
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    return CacheStats(_skinStats._entries, 0u, _skinStats._queries,
+        _skinStats._queries > 0u ? (float)_skinStats._hits/(float)_skinStats._queries : 0.0f);
+}
+
+const CacheStats
+ResourceCache::getInstanceStats() const
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    return CacheStats(_instanceStats._entries, 0u, _instanceStats._queries,
+        _instanceStats._queries > 0u ? (float)_instanceStats._hits/(float)_instanceStats._queries : 0.0f);
+}
+
+osg::Object*
+ResourceCache::getOrCreate(const std::string& key, Loader* loader, Stats* stats)
+{
+    osg::ref_ptr<Loader> loaderRef = loader;
+    Threading::Future<osg::Object> future;
+    osg::ref_ptr<LoadTask> task;
     {
-        Threading::ScopedMutexLock exclusive( _skinMutex );
-            
-        // double check to avoid race condition
-        SkinCache::Record rec;       
-        if ( _skinCache.get(key, rec) && rec.value().valid() )
+        Threading::ScopedMutexLock lock(_mutex);
+
+        if (stats)
+            ++stats->_queries;
+
+        Entries::iterator i = _entries.find(key);
+        if (i != _entries.end())
         {
-            output = rec.value().get();
+            if (stats)
+                ++stats->_hits;
+            i->second._lastUse = ++_clock;
+            future = i->second._future;
         }
         else
         {
-            // still not there, make it.
-            output = skin->createStateSet(readOptions);
-            if ( output.valid() )
-            {
-                _skinCache.insert( key, output.get() );
-            }
+            task = new LoadTask(this, key, loader);
+            Entry& entry = _entries[key];
+            entry._future = task->_promise.getFuture();
+            entry._lastUse = ++_clock;
+            future = entry._future;
+            if (stats)
+                ++stats->_entries;
         }
     }
 
-    return output.valid();
-}
+    JobScheduler* scheduler = Registry::instance()->getJobScheduler();
 
+    if (task.valid())
+    {
+        // a job thread loads in place rather than queue work behind itself.
+        if (scheduler->isWorkerThread())
+            (*task)(0L);
+        else
+            scheduler->submit(task.get(), JobScheduler::LANE_HIGH);
+    }
 
-bool
-ResourceCache::getOrCreateInstanceNode(InstanceResource*        res,
-                                       osg::ref_ptr<osg::Node>& output,
-                                       const osgDB::Options*    readOptions)
+    // a job thread waiting on another thread's load helps with the queue
+    // in the meantime, since that load might be in it.
+    if (scheduler->isWorkerThread())
+    {
+        while (!future.isAvailable())
+        {
+            if (!scheduler->runOne())
+                OpenThreads::Thread::microSleep(1000);
+        }
+    }
+
+    return future.get();
+}
+
+void
+ResourceCache::loaded(const std::string& key, osg::Object* object)
 {
-    output = 0L;
-    std::string key = res->getConfig().toJSON(false);
+    unsigned bytes = object ? estimateBytes(object) : 0u;
 
-    // exclusive lock (since it's an LRU)
+    Threading::ScopedMutexLock lock(_mutex);
+
+    Entries::iterator i = _entries.find(key);
+    if (i == _entries.end())
+        return;
+
+    // failures are not cached, so the next request tries again.
+    if (!object)
     {
-        Threading::ScopedMutexLock exclusive( _instanceMutex );
+        _entries.erase(i);
+        return;
+    }
 
-        // double check to avoid race condition
-        InstanceCache::Record rec;
-        if ( _instanceCache.get(key, rec) && rec.value().valid() )
-        {
-            output = rec.value().get();
-        }
-        else
+    i->second._bytes = bytes;
+    _bytes += bytes;
+    evict();
+}
+
+void
+ResourceCache::evict()
+{
+    while (_bytes > _maxBytes)
+    {
+        // least recently used entry that's done loading:
+        Entries::iterator oldest = _entries.end();
+        for (Entries::iterator i = _entries.begin(); i != _entries.end(); ++i)
         {
-            // still not there, make it.
-            output = res->createNode(readOptions);
-            if ( output.valid() )
+            if (i->second._future.isAvailable() &&
+                (oldest == _entries.end() || i->second._lastUse < oldest->second._lastUse))
             {
-                _instanceCache.insert( key, output.get() );
+                oldest = i;
             }
         }
+
+        if (oldest == _entries.end())
+            break;
+
+        OE_DEBUG << LC << "Evicting " << oldest->first << " (" << oldest->second._bytes << " bytes)\n";
+
+        _bytes -= oldest->second._bytes;
+        Stats& stats = oldest->first.compare(0, 5, "skin:") == 0 ? _skinStats : _instanceStats;
+        if (stats._entries > 0u)
+            --stats._entries;
+        _entries.erase(oldest);
     }
+}
+
+bool
+ResourceCache::getOrCreateLineTexture(const URI& uri, osg::ref_ptr<osg::Texture>& output, const osgDB::Options* readOptions)
+{
+    output = dynamic_cast<osg::Texture*>(
+        getOrCreate("line:" + uri.full(), new LineTextureLoader(uri, readOptions), 0L));
+
+    return output.valid();
+}
+
+bool
+ResourceCache::getOrCreateStateSet(SkinResource*                skin,
+                                   osg::ref_ptr<osg::StateSet>& output,
+                                   const osgDB::Options*        readOptions)
+{
+    // Note: we use the imageURI as the basis for the caching key since 
+    // it's the only property used by Skin->createStateSet(). If that
+    // changes, we need to address it here. It might be better it SkinResource
+    // were to provide a unique key.
+    output = dynamic_cast<osg::StateSet*>(
+        getOrCreate("skin:" + skin->getUniqueID(), new SkinLoader(skin, readOptions), &_skinStats));
+
+    return output.valid();
+}
+
+bool
+ResourceCache::getOrCreateStateSet(ResourceLibrary*             library,
+                                   osg::ref_ptr<osg::StateSet>& output,
+                                   const osgDB::Options*        readOptions)
+{
+    // The library keeps its own atlas: building it assigns its skins their
+    // layers, so it can't be shared with another library object.
+    output = library ? library->getAtlasStateSet(readOptions) : 0L;
+    return output.valid();
+}
+
+bool
+ResourceCache::getOrCreateInstanceNode(InstanceResource*        res,
+                                       osg::ref_ptr<osg::Node>& output,
+                                       const osgDB::Options*    readOptions)
+{
+    output = dynamic_cast<osg::Node*>(
+        getOrCreate(instanceKey(res), new InstanceLoader(res, readOptions), &_instanceStats));
 
     return output.valid();
 }
@@ -138,33 +430,15 @@ ResourceCache::cloneOrCreateInstanceNode(InstanceResource*        res,
                                          osg::ref_ptr<osg::Node>& output,
                                          const osgDB::Options*    readOptions)
 {
-    output = 0L;
-    std::string key = res->getConfig().toJSON(false);
-
-    // exclusive lock (since it's an LRU)
+    osg::ref_ptr<osg::Node> prototype;
+    if ( !getOrCreateInstanceNode(res, prototype, readOptions) )
     {
-        Threading::ScopedMutexLock exclusive( _instanceMutex );
-
-        // Deep copy everything except for images.  Some models may share imagery so we only want one copy of it at a time.
-        osg::CopyOp copyOp = osg::CopyOp::DEEP_COPY_ALL & ~osg::CopyOp::DEEP_COPY_IMAGES & ~osg::CopyOp::DEEP_COPY_TEXTURES;
-
-        // double check to avoid race condition
-        InstanceCache::Record rec;
-        if ( _instanceCache.get(key, rec) && rec.value().valid() )
-        {
-            output = osg::clone(rec.value().get(), copyOp);
-        }
-        else
-        {
-            // still not there, make it.
-            output = res->createNode(readOptions);
-            if ( output.valid() )
-            {
-                _instanceCache.insert( key, output.get() );
-                output = osg::clone(output.get(), copyOp);
-            }
-        }
+        output = 0L;
+        return false;
     }
 
+    // Deep copy everything except for images.  Some models may share imagery so we only want one copy of it at a time.
+    osg::CopyOp copyOp = osg::CopyOp::DEEP_COPY_ALL & ~osg::CopyOp::DEEP_COPY_IMAGES & ~osg::CopyOp::DEEP_COPY_TEXTURES;
+    output = osg::clone(prototype.get(), copyOp);
     return output.valid();
 }
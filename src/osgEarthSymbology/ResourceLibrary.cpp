@@ -22,6 +22,9 @@
 #include <osgEarth/ThreadingUtils>
 #include <osgEarth/XmlUtils>
 #include <osgEarth/Random>
+#include <osgEarth/ImageUtils>
+#include <osg/Texture2DArray>
+#include <osg/BlendFunc>
 #include <iterator>
 #include <algorithm>
 #include <fstream>
@@ -32,10 +35,15 @@ using namespace osgEarth;
 using namespace osgEarth::Symbology;
 using namespace OpenThreads;
 
+// Largest width or height of a layer in a runtime atlas.
+#define MAX_ATLAS_LAYER_SIZE 2048
+
 //------------------------------------------------------------------------
 
 ResourceLibrary::ResourceLibrary(const Config& conf) :
-_initialized( false )
+_initialized( false ),
+_atlas      ( false ),
+_atlasBuilt ( false )
 {
     mergeConfig( conf );
 }
@@ -44,7 +52,9 @@ ResourceLibrary::ResourceLibrary(const std::string&    name,
                                  const URI&            uri) :
 _name       ( name ),
 _uri        ( uri, uri ),
-_initialized( false )
+_initialized( false ),
+_atlas      ( false ),
+_atlasBuilt ( false )
 {
     //nop
 }
@@ -56,6 +66,7 @@ ResourceLibrary::mergeConfig( const Config& conf )
         _name = conf.value( "name" );
 
     conf.getIfSet( "url", _uri );
+    conf.getIfSet( "atlas", _atlas );
 
     for( ConfigSet::const_iterator i = conf.children().begin(); i != conf.children().end(); ++i )
     {
@@ -92,6 +103,8 @@ ResourceLibrary::getConfig() const
             conf.set( "name", _name );
         }
 
+        conf.addIfSet( "atlas", _atlas );
+
         if ( _uri.isSet() )
         {
             conf.addIfSet( "url", _uri );
@@ -398,4 +411,126 @@ ResourceLibrary::getModels(const ModelSymbol* ms, ModelResourceVector& output, c
             }
         }
     }
-}
\ No newline at end of file
+}
+
+osg::StateSet*
+ResourceLibrary::getAtlasStateSet( const osgDB::Options* dbOptions )
+{
+    Threading::ScopedMutexLock lock( _atlasMutex );
+    if ( !_atlasBuilt )
+    {
+        _atlasStateSet = createAtlasStateSet( dbOptions );
+        _atlasBuilt = true;
+    }
+    return _atlasStateSet.get();
+}
+
+osg::StateSet*
+ResourceLibrary::createAtlasStateSet( const osgDB::Options* dbOptions )
+{
+    SkinResourceVector skins;
+    getSkins( skins, dbOptions );
+    if ( skins.empty() )
+        return 0L;
+
+    // A baked atlas already points all its skins at the same image.
+    bool baked = true;
+    for( unsigned i = 1; i < skins.size() && baked; ++i )
+    {
+        baked = skins[i]->imageURI()->full() == skins[0]->imageURI()->full();
+    }
+    if ( baked )
+    {
+        return skins[0]->createStateSet( dbOptions );
+    }
+
+    // Load all the images and make every layer the size of the largest one.
+    std::vector< osg::ref_ptr<osg::Image> > images( skins.size() );
+    unsigned width = 0, height = 0;
+    bool hasAlpha = false;
+    for( unsigned i = 0; i < skins.size(); ++i )
+    {
+        images[i] = skins[i]->createImage( dbOptions );
+        if ( images[i].valid() )
+        {
+            width    = osg::maximum( width,  (unsigned)images[i]->s() );
+            height   = osg::maximum( height, (unsigned)images[i]->t() );
+            hasAlpha = hasAlpha || ImageUtils::hasAlphaChannel( images[i].get() );
+        }
+        else
+        {
+            OE_WARN << LC << "Skin \"" << skins[i]->name() << "\" failed to load; leaving it out of the atlas" << std::endl;
+        }
+    }
+
+    if ( width == 0 || height == 0 )
+        return 0L;
+
+    width  = osg::minimum( width,  (unsigned)MAX_ATLAS_LAYER_SIZE );
+    height = osg::minimum( height, (unsigned)MAX_ATLAS_LAYER_SIZE );
+
+    osg::Texture2DArray* tex = new osg::Texture2DArray();
+    tex->setSourceFormat( GL_RGBA );
+    tex->setInternalFormat( GL_RGBA8 );
+    tex->setFilter( osg::Texture::MIN_FILTER, osg::Texture::LINEAR_MIPMAP_LINEAR );
+    tex->setFilter( osg::Texture::MAG_FILTER, osg::Texture::LINEAR );
+    tex->setWrap( osg::Texture::WRAP_S, osg::Texture::REPEAT );
+    tex->setWrap( osg::Texture::WRAP_T, osg::Texture::REPEAT );
+    tex->setResizeNonPowerOfTwoHint( false );
+    tex->setUnRefImageDataAfterApply( false );
+
+    unsigned layer = 0;
+    {
+        Threading::ScopedWriteLock exclusive( _mutex );
+
+        for( unsigned i = 0; i < skins.size(); ++i )
+        {
+            osg::ref_ptr<osg::Image> image = images[i].get();
+            if ( !image.valid() )
+                continue;
+
+            if ( (unsigned)image->s() != width || (unsigned)image->t() != height )
+            {
+                osg::ref_ptr<osg::Image> resized;
+                if ( ImageUtils::resizeImage( image.get(), width, height, resized ) )
+                    image = resized.get();
+            }
+            image = ImageUtils::convertToRGBA8( image.get() );
+            if ( !image.valid() )
+                continue;
+
+            tex->setImage( layer, image.get() );
+
+            // Each skin gets a whole layer, so tiled skins still repeat.
+            SkinResource* skin = skins[i].get();
+            skin->imageLayer()  = layer;
+            skin->imageBiasS()  = 0.0f;
+            skin->imageBiasT()  = 0.0f;
+            skin->imageScaleS() = 1.0f;
+            skin->imageScaleT() = 1.0f;
+            ++layer;
+        }
+    }
+
+    if ( layer == 0 )
+        return 0L;
+
+    tex->setTextureSize( width, height, layer );
+    ImageUtils::activateMipMaps( tex );
+
+    OE_INFO << LC << "Packed " << layer << " skins of library \"" << getName() << "\" into a "
+        << width << "x" << height << " texture array" << std::endl;
+
+    osg::StateSet* stateSet = new osg::StateSet();
+    stateSet->setTextureAttributeAndModes( 0, tex, osg::StateAttribute::ON );
+
+    if ( hasAlpha )
+    {
+        osg::BlendFunc* blendFunc = new osg::BlendFunc();
+        blendFunc->setFunction( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
+        stateSet->setAttributeAndModes( blendFunc, osg::StateAttribute::ON );
+        stateSet->setRenderingHint( osg::StateSet::TRANSPARENT_BIN );
+    }
+
+    return stateSet;
+}
@@ -22,6 +22,7 @@
 #include <osgDB/FileNameUtils>
 #include <osgEarth/SpatialReference>
 #include <cstdlib>
+#include <cfloat>
 
 #define LC "[TritonContext] "
 
@@ -36,7 +37,9 @@ _resourceLoader       ( 0L ),
 _environment          ( 0L ),
 _environmentWrapper   ( 0L ),
 _ocean                ( 0L ),
-_oceanWrapper         ( 0L )
+_oceanWrapper         ( 0L ),
+_lastUpdateTime       ( -DBL_MAX ),
+_simTime              ( 0.0 )
 {    
     //nop
 }
@@ -178,13 +181,114 @@ TritonContext::initialize(osg::RenderInfo& renderInfo)
 void
 TritonContext::update(double simTime)
 {
-    if ( _ocean )
+    // several views (or several nodes) tick the same context each frame.
+    if ( _ocean && simTime != _lastUpdateTime )
     {
+        _lastUpdateTime = simTime;
+
         // fmod requires b/c CUDA is limited to single-precision values
-        _ocean->UpdateSimulation( fmod(simTime, 86400.0) );
+        _simTime = fmod(simTime, 86400.0);
+        _ocean->UpdateSimulation( _simTime );
+    }
+}
+
+namespace
+{
+    // Largest dot product of "n" with any direction on the arc from a to b
+    // (unit vectors, a and b less than 180 degrees apart).
+    double maxDotOnArc(const osg::Vec3d& n, const osg::Vec3d& a, const osg::Vec3d& b)
+    {
+        double best = osg::maximum(n*a, n*b);
+
+        osg::Vec3d c = a ^ b;
+        if (c.normalize() > 0.0)
+        {
+            osg::Vec3d p = n - c*(n*c);
+            double len = p.normalize();
+            if (len > 0.0 && ((a^p)*c) >= 0.0 && ((p^b)*c) >= 0.0)
+                best = osg::maximum(best, len);
+        }
+        return best;
     }
 }
 
+bool
+TritonContext::isOceanInView(osgUtil::CullVisitor* cv) const
+{
+    const osg::Camera* camera = cv ? cv->getCurrentCamera() : 0L;
+    if (!camera || !_srs.valid())
+        return true;
+
+    const osg::Matrixd& proj = *cv->getProjectionMatrix();
+
+    // orthographic views look along parallel rays; don't bother.
+    if (proj(3,3) != 0.0)
+        return true;
+
+    osg::Matrixd viewInverse = camera->getInverseViewMatrix();
+    osg::Vec3d eye = osg::Vec3d(0,0,0) * viewInverse;
+
+    // "n" points straight down. A view ray reaches sea level if it points
+    // more than "limit" below the local horizontal (the dip of the horizon).
+    osg::Vec3d n;
+    double limit;
+
+    if (_srs->isGeographic())
+    {
+        const osg::EllipsoidModel* em = _srs->getEllipsoid();
+        double lat, lon, alt;
+        em->convertXYZToLatLongHeight(eye.x(), eye.y(), eye.z(), lat, lon, alt);
+
+        // below sea level: the surface is overhead.
+        double dist = eye.length();
+        double radius = dist - alt;
+        if (alt <= 0.0 || dist <= 0.0)
+            return true;
+
+        n = -eye / dist;
+        double r = radius / dist;
+        limit = sqrt(1.0 - r*r);
+    }
+    else
+    {
+        if (eye.z() <= 0.0)
+            return true;
+
+        n.set(0,0,-1);
+        limit = 0.0;
+    }
+
+    // directions through the corners of the view, in world space.
+    osg::Matrixd clipToWorld;
+    clipToWorld.invert(proj);
+    clipToWorld.postMult(viewInverse);
+
+    osg::Vec3d corners[4];
+    const double cx[4] = { -1, 1, 1, -1 };
+    const double cy[4] = { -1, -1, 1, 1 };
+    for (unsigned i = 0; i < 4; ++i)
+    {
+        corners[i] = osg::Vec3d(cx[i], cy[i], 0.0) * clipToWorld - eye;
+        corners[i].normalize();
+    }
+
+    // looking straight down, or anywhere on the edge of the view dips low enough:
+    osg::Vec4d nadir = osg::Vec4d(eye + n, 1.0) * camera->getViewMatrix() * proj;
+    if (nadir.w() > 0.0 && fabs(nadir.x()) <= nadir.w() && fabs(nadir.y()) <= nadir.w())
+        return true;
+
+    // waves and rounding; err on the side of drawing.
+    limit -= 1e-3;
+
+    for (unsigned i = 0; i < 4; ++i)
+    {
+        if (maxDotOnArc(n, corners[i], corners[(i+1)%4]) >= limit)
+            return true;
+    }
+
+    return false;
+}
+
 void
 TritonContext::resizeGLObjectBuffers(unsigned maxSize)
 {
@@ -27,7 +27,6 @@
 #include <osgEarth/VirtualProgram>
 #include <osgEarth/MapNode>
 #include <osgEarth/TerrainEngineNode>
-#include <osgEarth/Random>
 
 #undef  LC
 #define LC "[TritonDrawable] "
@@ -282,7 +281,7 @@ TritonDrawable::drawImplementation(osg::RenderInfo& renderInfo) const
             osg::GLExtensions* ext = osg::GLExtensions::Get(state->getContextID(), true);
 
             _TRITON->getOcean()->Draw(
-                renderInfo.getView()->getFrameStamp()->getSimulationTime() + osgEarth::Random().next(),
+                _TRITON->getSimulationTime(), // the time of the shared update
                 true, // depth writes
                 true, // draw water
                 false, // draw particles
@@ -26,8 +26,10 @@
 #include <osgEarth/ImageLayer>
 #include <osgEarth/ResourceReleaser>
 #include <osgEarth/NodeUtils>
+#include <osgEarth/GPUTimer>
 #include <osgEarth/ElevationLOD>
 #include <osgEarth/TerrainEngineNode>
+#include <osgEarth/CullingUtils>
 
 #define LC "[TritonLayer] "
 
@@ -121,6 +123,7 @@ namespace
             _alphaUniform->set(1.0f); // TODO
             _drawable->setNodeMask(TRITON_OCEAN_MASK);
             drawable->setMaskLayer(_maskLayer.get());
+            GPUTimer::install(drawable, "ocean.triton");
             this->addChild(_drawable);
 
             // Place in the depth-sorted bin and set a rendering order.
@@ -169,6 +172,16 @@ namespace
                 }
             }
 
+            else if (nv.getVisitorType() == nv.CULL_VISITOR)
+            {
+                // Skip the ocean (and its height map) for cameras that only see sky.
+                if (_TRITON.valid() && _options.horizonCulling() == true &&
+                    !_TRITON->isOceanInView(osgEarth::Culling::asCullVisitor(nv)))
+                {
+                    return;
+                }
+            }
+
             osg::Group::traverse(nv);
         }
 
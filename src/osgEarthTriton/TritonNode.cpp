@@ -21,6 +21,7 @@
 #include "TritonContext"
 #include "TritonDrawable"
 #include <osgEarth/CullingUtils>
+#include <osgEarth/GPUTimer>
 #include <osgEarth/NodeUtils>
 #include <osgEarth/TerrainEngineNode>
 
@@ -115,6 +116,7 @@ TritonNode::create()
     _alphaUniform->set(getAlpha());
     _drawable->setNodeMask( TRITON_OCEAN_MASK );
     drawable->setMaskLayer(_maskLayer.get());
+    GPUTimer::install(drawable, "ocean.triton");
     this->addChild(_drawable);
 
     OE_INFO << LC << "TritonNode created" << std::endl;
@@ -197,5 +199,14 @@ TritonNode::traverse(osg::NodeVisitor& nv)
         }
     }
 
+    else if ( nv.getVisitorType() == nv.CULL_VISITOR )
+    {
+        if ( _TRITON.valid() && _options.horizonCulling() == true &&
+             !_TRITON->isOceanInView(Culling::asCullVisitor(nv)) )
+        {
+            return;
+        }
+    }
+
     osgEarth::Util::OceanNode::traverse(nv);
 }
@@ -1,12 +1,255 @@
 #include <osgEarthUtil/ClusterNode>
 
 #include <osgEarthUtil/kdbush.hpp>
+#include <osgEarth/Registry>
+#include <osgEarth/JobScheduler>
 
 typedef std::pair<int, int> TPoint;
 typedef std::vector< std::size_t > TIds;
 
 using namespace osgEarth::Util;
 
+// Size of the spatial buckets that nodes are sorted into (world units)
+#define BUCKET_SIZE 250000.0
+
+// Number of zoom levels in the precomputed cluster hierarchy, and the
+// resolution (meters per pixel) of level zero. Each level doubles the resolution.
+#define NUM_ZOOM_LEVELS 20
+#define ZOOM_LEVEL_ZERO_RESOLUTION (2.0 * osg::PI * 6378137.0 / 256.0)
+
+/**
+ * Precomputed cluster hierarchy. Each level holds the clusters for a range of
+ * zoom levels, from coarsest (index 0) to the individual nodes (last index).
+ * A cluster refers to the clusters it absorbed in the next finer level, so the
+ * cull pass can descend from the coarse levels and skip whole subtrees that
+ * are out of view.
+ */
+struct ClusterNode::Hierarchy : public osg::Referenced
+{
+    struct Level
+    {
+        std::vector< osg::Vec3d > centers;
+        std::vector< float >      radii;    // extent of all the nodes in the cluster
+        std::vector< unsigned >   counts;   // number of nodes in the cluster
+        std::vector< unsigned >   reps;     // index of a representative node
+        std::vector< unsigned >   offsets;  // children of cluster i: [offsets[i], offsets[i+1])
+        std::vector< unsigned >   children; // indices in the next finer level
+
+        unsigned size() const { return centers.size(); }
+    };
+
+    osg::NodeList         nodes;
+    std::vector< Level >  levels;
+    unsigned              levelForZoom[NUM_ZOOM_LEVELS];
+};
+
+namespace
+{
+    typedef ClusterNode::CanClusterCallback CanClusterCallback;
+
+    struct CellKey
+    {
+        int x, y, z;
+        bool operator < (const CellKey& rhs) const {
+            return x < rhs.x || (x == rhs.x && (y < rhs.y || (y == rhs.y && z < rhs.z)));
+        }
+    };
+
+    inline CellKey getCellKey(const osg::Vec3d& p, double cellSize)
+    {
+        CellKey key;
+        key.x = (int)floor(p.x() / cellSize);
+        key.y = (int)floor(p.y() / cellSize);
+        key.z = (int)floor(p.z() / cellSize);
+        return key;
+    }
+
+    /**
+     * Greedily merges the clusters of a level into a coarser level, absorbing all
+     * unclaimed clusters within "radius" of each seed (the supercluster approach,
+     * using a uniform grid instead of a k-d tree to find the neighbors).
+     */
+    void clusterLevel(
+        const ClusterNode::Hierarchy::Level& fine,
+        const osg::NodeList&                 nodes,
+        double                               radius,
+        CanClusterCallback*                  canCluster,
+        ClusterNode::Hierarchy::Level&       coarse)
+    {
+        typedef std::map< CellKey, std::vector< unsigned > > Grid;
+        Grid grid;
+        for (unsigned i = 0; i < fine.size(); ++i)
+        {
+            grid[getCellKey(fine.centers[i], radius)].push_back(i);
+        }
+
+        std::vector< bool > claimed(fine.size(), false);
+        double radius2 = radius * radius;
+
+        coarse.offsets.push_back(0u);
+
+        for (unsigned i = 0; i < fine.size(); ++i)
+        {
+            if (claimed[i])
+                continue;
+
+            claimed[i] = true;
+            coarse.children.push_back(i);
+
+            const osg::Vec3d& seed = fine.centers[i];
+            CellKey key = getCellKey(seed, radius);
+
+            for (int dx = -1; dx <= 1; ++dx)
+            {
+                for (int dy = -1; dy <= 1; ++dy)
+                {
+                    for (int dz = -1; dz <= 1; ++dz)
+                    {
+                        CellKey n = { key.x + dx, key.y + dy, key.z + dz };
+                        Grid::const_iterator cell = grid.find(n);
+                        if (cell == grid.end())
+                            continue;
+
+                        for (std::vector< unsigned >::const_iterator j = cell->second.begin(); j != cell->second.end(); ++j)
+                        {
+                            if (claimed[*j] || (fine.centers[*j] - seed).length2() > radius2)
+                                continue;
+
+                            if (canCluster && !(*canCluster)(nodes[fine.reps[i]].get(), nodes[fine.reps[*j]].get()))
+                                continue;
+
+                            claimed[*j] = true;
+                            coarse.children.push_back(*j);
+                        }
+                    }
+                }
+            }
+
+            // weighted center and extent of the new cluster:
+            unsigned begin = coarse.offsets.back();
+            unsigned end = coarse.children.size();
+            osg::Vec3d center;
+            unsigned count = 0u;
+            for (unsigned c = begin; c < end; ++c)
+            {
+                unsigned child = coarse.children[c];
+                center += fine.centers[child] * (double)fine.counts[child];
+                count += fine.counts[child];
+            }
+            center /= (double)count;
+
+            float extent = 0.0f;
+            for (unsigned c = begin; c < end; ++c)
+            {
+                unsigned child = coarse.children[c];
+                extent = osg::maximum(extent, (float)(fine.centers[child] - center).length() + fine.radii[child]);
+            }
+
+            coarse.centers.push_back(center);
+            coarse.radii.push_back(extent);
+            coarse.counts.push_back(count);
+            coarse.reps.push_back(fine.reps[i]);
+            coarse.offsets.push_back(end);
+        }
+    }
+
+    /**
+     * Background job that builds a cluster hierarchy out of a snapshot of the nodes.
+     */
+    struct BuildHierarchyTask : public TaskRequest
+    {
+        osg::ref_ptr< ClusterNode::Hierarchy > _hierarchy;
+        unsigned                               _radius;
+        osg::ref_ptr< CanClusterCallback >     _canCluster;
+
+        ClusterNode::Hierarchy::Level          _leaves;
+
+        BuildHierarchyTask(const osg::NodeList& nodes, unsigned radius, CanClusterCallback* canCluster) :
+            _radius(radius),
+            _canCluster(canCluster)
+        {
+            _hierarchy = new ClusterNode::Hierarchy();
+            _hierarchy->nodes = nodes;
+
+            // The finest level holds the individual nodes. Read the positions here
+            // since computing node bounds is not safe outside the traversal thread.
+            unsigned numNodes = nodes.size();
+            _leaves.centers.reserve(numNodes);
+            for (unsigned i = 0; i < numNodes; ++i)
+            {
+                _leaves.centers.push_back(nodes[i]->getBound().center());
+            }
+            _leaves.radii.assign(numNodes, 0.0f);
+            _leaves.counts.assign(numNodes, 1u);
+            _leaves.reps.resize(numNodes);
+            for (unsigned i = 0; i < numNodes; ++i)
+            {
+                _leaves.reps[i] = i;
+            }
+        }
+
+        void operator()(ProgressCallback* progress)
+        {
+            ClusterNode::Hierarchy* h = _hierarchy.get();
+
+            // Build from the finest zoom level to the coarsest, only keeping the levels
+            // that actually merge something.
+            std::vector< ClusterNode::Hierarchy::Level > levels;
+            levels.reserve(NUM_ZOOM_LEVELS + 1);
+            levels.push_back(ClusterNode::Hierarchy::Level());
+            levels.back().centers.swap(_leaves.centers);
+            levels.back().radii.swap(_leaves.radii);
+            levels.back().counts.swap(_leaves.counts);
+            levels.back().reps.swap(_leaves.reps);
+
+            unsigned levelsFromFinest[NUM_ZOOM_LEVELS];
+
+            for (int zoom = NUM_ZOOM_LEVELS - 1; zoom >= 0; --zoom)
+            {
+                if (progress && progress->isCanceled())
+                    return;
+
+                double radius = (double)_radius * ZOOM_LEVEL_ZERO_RESOLUTION / (double)(1u << zoom);
+
+                ClusterNode::Hierarchy::Level coarse;
+                clusterLevel(levels.back(), h->nodes, radius, _canCluster.get(), coarse);
+
+                if (coarse.size() < levels.back().size())
+                {
+                    levels.push_back(ClusterNode::Hierarchy::Level());
+                    levels.back().centers.swap(coarse.centers);
+                    levels.back().radii.swap(coarse.radii);
+                    levels.back().counts.swap(coarse.counts);
+                    levels.back().reps.swap(coarse.reps);
+                    levels.back().offsets.swap(coarse.offsets);
+                    levels.back().children.swap(coarse.children);
+                }
+
+                levelsFromFinest[zoom] = levels.size() - 1;
+            }
+
+            // Store coarsest first.
+            h->levels.resize(levels.size());
+            for (unsigned i = 0; i < levels.size(); ++i)
+            {
+                ClusterNode::Hierarchy::Level& dst = h->levels[levels.size() - 1 - i];
+                dst.centers.swap(levels[i].centers);
+                dst.radii.swap(levels[i].radii);
+                dst.counts.swap(levels[i].counts);
+                dst.reps.swap(levels[i].reps);
+                dst.offsets.swap(levels[i].offsets);
+                dst.children.swap(levels[i].children);
+            }
+            for (unsigned zoom = 0; zoom < NUM_ZOOM_LEVELS; ++zoom)
+            {
+                h->levelForZoom[zoom] = levels.size() - 1 - levelsFromFinest[zoom];
+            }
+
+            _result = h;
+        }
+    };
+}
+
 ClusterNode::ClusterNode(MapNode* mapNode, osg::Image* defaultImage) :
     _radius(50),
     _mapNode(mapNode),
@@ -14,36 +257,83 @@ ClusterNode::ClusterNode(MapNode* mapNode, osg::Image* defaultImage) :
     _enabled(true),
     _dirty(true),
     _defaultImage(defaultImage),
-    _dirtyIndex(true)
+    _precompute(false),
+    _dirtyHierarchy(true)
 {
     setCullingActive(false);
 
     _horizon = new Horizon();
 }
 
+ClusterNode::~ClusterNode()
+{
+    if (_hierarchyJob.valid())
+        _hierarchyJob->cancel();
+}
+
+ClusterNode::BucketKey ClusterNode::getBucketKey(osg::Node* node) const
+{
+    const osg::Vec3d center = node->getBound().center();
+    BucketKey key;
+    key.x = (int)floor(center.x() / BUCKET_SIZE);
+    key.y = (int)floor(center.y() / BUCKET_SIZE);
+    key.z = (int)floor(center.z() / BUCKET_SIZE);
+    return key;
+}
+
 void ClusterNode::addNode(osg::Node* node)
 {
+    if (!node || _nodeEntries.find(node) != _nodeEntries.end())
+        return;
+
+    NodeEntry& entry = _nodeEntries[node];
+    entry.bucket = getBucketKey(node);
+    entry.position = _nodes.size();
     _nodes.push_back(node);
+
+    osg::ref_ptr< osg::Group >& bucket = _buckets[entry.bucket];
+    if (!bucket.valid())
+        bucket = new osg::Group();
+    bucket->addChild(node);
+
     _dirty = true;
-    _dirtyIndex = true;
+    _dirtyHierarchy = true;
 }
 
 void ClusterNode::removeNode(osg::Node* node)
 {
-    osg::NodeList::iterator itr = std::find(_nodes.begin(), _nodes.end(), node);
-    if (itr != _nodes.end())
+    NodeEntryMap::iterator itr = _nodeEntries.find(node);
+    if (itr != _nodeEntries.end())
     {
-        _nodes.erase(itr);
+        BucketMap::iterator bucket = _buckets.find(itr->second.bucket);
+        if (bucket != _buckets.end())
+        {
+            bucket->second->removeChild(node);
+            if (bucket->second->getNumChildren() == 0)
+                _buckets.erase(bucket);
+        }
+
+        // swap the last node in to fill the hole:
+        unsigned position = itr->second.position;
+        if (position + 1 < _nodes.size())
+        {
+            _nodes[position] = _nodes.back();
+            _nodeEntries[_nodes[position].get()].position = position;
+        }
+        _nodes.pop_back();
+        _nodeEntries.erase(itr);
     }
     _dirty = true;
-    _dirtyIndex = true;
+    _dirtyHierarchy = true;
 }
 
 void ClusterNode::clear()
 {
     _nodes.clear();
+    _nodeEntries.clear();
+    _buckets.clear();
     _dirty = true;
-    _dirtyIndex = true;
+    _dirtyHierarchy = true;
 }
 
 unsigned int ClusterNode::getRadius() const
@@ -55,6 +345,7 @@ void ClusterNode::setRadius(unsigned int radius)
 {
     _radius = radius;
     _dirty = true;
+    _dirtyHierarchy = true;
 }
 
 bool ClusterNode::getEnabled() const
@@ -79,7 +370,6 @@ void ClusterNode::setMapNode(MapNode* mapNode)
     {
         _mapNode = mapNode;
         _dirty = true;
-        _dirtyIndex = true;
         _labelPool.clear();
         _nextLabel = 0;
     }
@@ -106,40 +396,148 @@ void ClusterNode::setCanClusterCallback(ClusterNode::CanClusterCallback* callbac
 {
     _canClusterCallback = callback;
     _dirty = true;
+    _dirtyHierarchy = true;
 }
 
-bool boundSort(const osg::ref_ptr< osg::Node> &i, const osg::ref_ptr< osg::Node> &j)
+bool ClusterNode::getPrecomputeClusters() const
 {
-    osg::BoundingSphere bsI = i->getBound();
-    osg::BoundingSphere bsJ = j->getBound();
+    return _precompute;
+}
 
-    return bsI.center().x() < bsJ.center().x();
+void ClusterNode::setPrecomputeClusters(bool value)
+{
+    if (_precompute != value)
+    {
+        _precompute = value;
+        _dirty = true;
+    }
 }
 
+void ClusterNode::buildHierarchy()
+{
+    // collect a finished build:
+    if (_hierarchyJob.valid() && _hierarchyJob->isCompleted())
+    {
+        ClusterNode::Hierarchy* result = dynamic_cast<ClusterNode::Hierarchy*>(_hierarchyJob->getResult());
+        if (result)
+        {
+            _hierarchy = result;
+            _dirty = true;
+        }
+        _hierarchyJob = 0L;
+    }
 
-void ClusterNode::buildIndex()
+    // start a new build if the nodes changed. The previous hierarchy (if any)
+    // stays in use until the new one is ready.
+    if (_dirtyHierarchy && !_hierarchyJob.valid())
+    {
+        _hierarchyJob = new BuildHierarchyTask(_nodes, _radius, _canClusterCallback.get());
+        Registry::instance()->getJobScheduler()->submit(_hierarchyJob.get(), JobScheduler::LANE_LOW);
+        _dirtyHierarchy = false;
+    }
+}
+
+void ClusterNode::getPrecomputedClusters(osgUtil::CullVisitor* cv, ClusterList& out)
 {
-    if (_dirtyIndex)
+    _nextLabel = 0;
+
+    osg::Camera* camera = cv->getCurrentCamera();
+    osg::Viewport* viewport = camera->getViewport();
+    if (!viewport || !_hierarchy.valid() || _hierarchy->levels.empty())
     {
-        _clusterIndex.clear();
+        return;
+    }
+
+    // Approximate ground resolution at the center of the view:
+    osg::Vec3d eye, center, up;
+    camera->getViewMatrixAsLookAt(eye, center, up);
+
+    double altitude = eye.z();
+    const SpatialReference* srs = _mapNode->getMapSRS();
+    if (srs->isGeographic())
+    {
+        altitude = eye.length() - srs->getEllipsoid()->getRadiusEquator();
+    }
+    altitude = osg::maximum(altitude, 1.0);
+
+    double metersPerPixel;
+    double fovy, aspect, zn, zf, left, right, bottom, top;
+    if (camera->getProjectionMatrixAsPerspective(fovy, aspect, zn, zf))
+    {
+        metersPerPixel = 2.0 * altitude * tan(osg::DegreesToRadians(fovy) * 0.5) / viewport->height();
+    }
+    else if (camera->getProjectionMatrixAsOrtho(left, right, bottom, top, zn, zf))
+    {
+        metersPerPixel = (top - bottom) / viewport->height();
+    }
+    else
+    {
+        return;
+    }
+
+    int zoom = (int)floor(log(ZOOM_LEVEL_ZERO_RESOLUTION / metersPerPixel) / log(2.0));
+    zoom = osg::clampBetween(zoom, 0, NUM_ZOOM_LEVELS - 1);
 
-        std::sort(_nodes.begin(), _nodes.end(), boundSort);
+    const Hierarchy& h = *_hierarchy.get();
+    unsigned target = h.levelForZoom[zoom];
 
-        unsigned int maxNodes = 10000;
+    // Descend from the coarsest level, culling whole subtrees on the way.
+    std::vector< unsigned > current, next;
+    for (unsigned i = 0; i < h.levels[0].size(); ++i)
+        current.push_back(i);
 
-        osg::Group* currentGroup = 0;
+    for (unsigned level = 0; level <= target; ++level)
+    {
+        const Hierarchy::Level& lev = h.levels[level];
+        next.clear();
 
-        for (unsigned int i = 0; i < _nodes.size(); i++)
+        for (std::vector< unsigned >::const_iterator i = current.begin(); i != current.end(); ++i)
         {
-            if (!currentGroup || currentGroup->getNumChildren() >= maxNodes)
+            osg::BoundingSphere bs(lev.centers[*i], lev.radii[*i]);
+            if (cv->isCulled(bs) || !_horizon->isVisible(bs))
             {
-                currentGroup = new osg::Group;
-                _clusterIndex.push_back(currentGroup);
+                continue;
+            }
+
+            if (level < target)
+            {
+                for (unsigned c = lev.offsets[*i]; c < lev.offsets[*i + 1]; ++c)
+                    next.push_back(lev.children[c]);
+            }
+            else
+            {
+                Cluster cluster;
+
+                // expand the cluster into its nodes:
+                std::vector< unsigned > members(1, *i), finer;
+                for (unsigned l = level; l + 1 < h.levels.size(); ++l)
+                {
+                    finer.clear();
+                    const Hierarchy::Level& ml = h.levels[l];
+                    for (std::vector< unsigned >::const_iterator m = members.begin(); m != members.end(); ++m)
+                        for (unsigned c = ml.offsets[*m]; c < ml.offsets[*m + 1]; ++c)
+                            finer.push_back(ml.children[c]);
+                    members.swap(finer);
+                }
+                for (std::vector< unsigned >::const_iterator m = members.begin(); m != members.end(); ++m)
+                    cluster.nodes.push_back(h.nodes[*m]);
+
+                std::stringstream buf;
+                buf << lev.counts[*i] << std::endl;
+
+                PlaceNode* marker = getOrCreateLabel();
+                GeoPoint markerPos;
+                markerPos.fromWorld(_mapNode->getMapSRS(), lev.centers[*i]);
+                marker->setPosition(markerPos);
+                marker->setText(buf.str());
+
+                cluster.marker = marker;
+                out.push_back(cluster);
             }
-            currentGroup->addChild(_nodes[i]);                      
         }
+
+        current.swap(next);
     }
-    _dirtyIndex = false;
 }
 
 
@@ -163,11 +561,9 @@ void ClusterNode::getClusters(osgUtil::CullVisitor* cv, ClusterList& out)
 
     osg::NodeList validPlaces;
 
-    buildIndex();
-
-    for (osg::NodeList::iterator itr = _clusterIndex.begin(); itr != _clusterIndex.end(); ++itr)
+    for (BucketMap::iterator itr = _buckets.begin(); itr != _buckets.end(); ++itr)
     {
-        osg::Group* index = static_cast<osg::Group*>(itr->get());
+        osg::Group* index = itr->second.get();
         if (cv->isCulled(index->getBound()))
         {
             continue;
@@ -279,6 +675,11 @@ void ClusterNode::traverse(osg::NodeVisitor& nv)
         {
             if (_mapNode.valid())
             {
+                if (_precompute)
+                {
+                    buildHierarchy();
+                }
+
                 const osg::Matrixd &currentViewMatrix = cv->getCurrentCamera()->getViewMatrix();
                 if (_lastViewMatrix != currentViewMatrix || _dirty)
                 {
@@ -288,7 +689,10 @@ void ClusterNode::traverse(osg::NodeVisitor& nv)
                     _horizon->setEye(eye);
 
                     _clusters.clear();
-                    getClusters(cv, _clusters);
+                    if (_precompute && _hierarchy.valid())
+                        getPrecomputedClusters(cv, _clusters);
+                    else
+                        getClusters(cv, _clusters);
 
                     // Style the clusters if need be
                     if (_styleCallback)
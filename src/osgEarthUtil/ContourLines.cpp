@@ -0,0 +1,215 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2016 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include <osgEarthUtil/ContourLines>
+#include <osgEarth/ElevationLayer>
+#include <osgEarth/HeightFieldUtils>
+#include <osgEarth/GeoData>
+#include <osgEarth/GLUtils>
+#include <osg/Geometry>
+#include <osg/Geode>
+#include <osg/MatrixTransform>
+#include <cmath>
+
+#define LC "[ContourLines] "
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+namespace
+{
+    // Where height "level" crosses the edge from a to b, as a fraction of the edge.
+    inline float crossing(float a, float b, float level)
+    {
+        return (level - a) / (b - a);
+    }
+}
+
+ContourLines::ContourLines(const Map* map) :
+SimplePager(map ? map->getProfile() : 0L),
+_map       ( map ),
+_interval  ( 100.0f ),
+_color     ( 1.0f, 1.0f, 0.0f, 1.0f ),
+_tileSize  ( 33u ),
+_cache     ( true, 256u )
+{
+    osg::StateSet* ss = getOrCreateStateSet();
+    GLUtils::setLighting(ss, osg::StateAttribute::OFF);
+    GLUtils::setLineWidth(ss, 1.5f, osg::StateAttribute::ON);
+
+    // the lines lie on the terrain; keep them from sinking into it.
+    _depthOffset.setGraph(this);
+}
+
+osg::Node*
+ContourLines::createNode(const TileKey& key, ProgressCallback* progress)
+{
+    LRUCache<TileKey, osg::ref_ptr<osg::Node> >::Record record;
+    if (_cache.get(key, record))
+        return record.value().get();
+
+    osg::ref_ptr<osg::Node> node = traceTile(key, progress);
+
+    // don't remember a tile that was canceled half-way.
+    if (!progress || !progress->isCanceled())
+        _cache.insert(key, node.get());
+
+    return node.release();
+}
+
+osg::Node*
+ContourLines::traceTile(const TileKey& key, ProgressCallback* progress) const
+{
+    osg::ref_ptr<const Map> map;
+    if (!_map.lock(map) || _interval <= 0.0f)
+        return 0L;
+
+    const GeoExtent& extent = key.getExtent();
+
+    osg::ref_ptr<osg::HeightField> hf = HeightFieldUtils::createReferenceHeightField(
+        extent, _tileSize, _tileSize, 0u, true);
+
+    ElevationLayerVector elevation;
+    map->getLayers(elevation);
+    if (!elevation.populateHeightFieldAndNormalMap(hf.get(), 0L, key, map->getProfile(), INTERP_BILINEAR, progress))
+        return 0L;
+
+    unsigned cols = hf->getNumColumns(), rows = hf->getNumRows();
+    double dx = extent.width() / (double)(cols-1);
+    double dy = extent.height() / (double)(rows-1);
+
+    // Line segments as (column, row, height) grid coordinates; converted to
+    // world space once the tile is traced.
+    std::vector<osg::Vec3d> segments;
+
+    for (unsigned r = 0; r + 1 < rows; ++r)
+    {
+        for (unsigned c = 0; c + 1 < cols; ++c)
+        {
+            // corners counter-clockwise from the lower left:
+            float h[4] = {
+                hf->getHeight(c,   r),
+                hf->getHeight(c+1, r),
+                hf->getHeight(c+1, r+1),
+                hf->getHeight(c,   r+1) };
+
+            if (h[0] == NO_DATA_VALUE || h[1] == NO_DATA_VALUE || h[2] == NO_DATA_VALUE || h[3] == NO_DATA_VALUE)
+                continue;
+
+            float lo = osg::minimum(osg::minimum(h[0], h[1]), osg::minimum(h[2], h[3]));
+            float hi = osg::maximum(osg::maximum(h[0], h[1]), osg::maximum(h[2], h[3]));
+
+            // every level in (lo, hi] crosses this cell.
+            for (float level = (floor(lo / _interval) + 1.0f) * _interval; level <= hi; level += _interval)
+            {
+                // crossing points on edges 0 (bottom), 1 (right), 2 (top), 3 (left):
+                osg::Vec3d p[4];
+                bool crossed[4];
+                for (unsigned e = 0; e < 4; ++e)
+                {
+                    float a = h[e], b = h[(e+1)%4];
+                    crossed[e] = (a < level) != (b < level);
+                    if (crossed[e])
+                    {
+                        float t = crossing(a, b, level);
+                        switch (e)
+                        {
+                        case 0: p[e].set(c + t,   r,       level); break;
+                        case 1: p[e].set(c + 1,   r + t,   level); break;
+                        case 2: p[e].set(c + 1-t, r + 1,   level); break;
+                        case 3: p[e].set(c,       r + 1-t, level); break;
+                        }
+                    }
+                }
+
+                if (crossed[0] && crossed[1] && crossed[2] && crossed[3])
+                {
+                    // saddle: the cell's center decides which corners the
+                    // lines cut off.
+                    float center = 0.25f*(h[0] + h[1] + h[2] + h[3]);
+                    if ((center < level) == (h[0] < level))
+                    {
+                        segments.push_back(p[0]); segments.push_back(p[1]);
+                        segments.push_back(p[2]); segments.push_back(p[3]);
+                    }
+                    else
+                    {
+                        segments.push_back(p[3]); segments.push_back(p[0]);
+                        segments.push_back(p[1]); segments.push_back(p[2]);
+                    }
+                }
+                else
+                {
+                    for (unsigned e = 0; e < 4; ++e)
+                        if (crossed[e])
+                            segments.push_back(p[e]);
+
+                    // a flat edge exactly at the level can leave an odd one out.
+                    if (segments.size() % 2u)
+                        segments.pop_back();
+                }
+            }
+        }
+
+        if (progress && progress->isCanceled())
+            return 0L;
+    }
+
+    // nothing here, but finer tiles may still have lines.
+    if (segments.empty())
+        return new osg::Group();
+
+    // convert to world coordinates, relative to the tile's center:
+    osg::Vec3d centerWorld;
+    GeoPoint(extent.getSRS(), extent.getCentroid(), ALTMODE_ABSOLUTE).toWorld(centerWorld);
+
+    osg::Vec3Array* verts = new osg::Vec3Array();
+    verts->reserve(segments.size());
+    for (unsigned i = 0; i < segments.size(); ++i)
+    {
+        const osg::Vec3d& g = segments[i];
+        osg::Vec3d world;
+        GeoPoint(
+            extent.getSRS(),
+            extent.xMin() + g.x()*dx,
+            extent.yMin() + g.y()*dy,
+            g.z(),
+            ALTMODE_ABSOLUTE).toWorld(world);
+        verts->push_back(world - centerWorld);
+    }
+
+    osg::Geometry* geom = new osg::Geometry();
+    geom->setUseVertexBufferObjects(true);
+    geom->setVertexArray(verts);
+
+    osg::Vec4Array* colors = new osg::Vec4Array(1);
+    (*colors)[0] = _color;
+    geom->setColorArray(colors, osg::Array::BIND_OVERALL);
+
+    geom->addPrimitiveSet(new osg::DrawArrays(GL_LINES, 0, verts->size()));
+
+    osg::Geode* geode = new osg::Geode();
+    geode->addDrawable(geom);
+
+    osg::MatrixTransform* xform = new osg::MatrixTransform(osg::Matrixd::translate(centerWorld));
+    xform->addChild(geode);
+    return xform;
+}
@@ -20,10 +20,12 @@
 * along with this program.  If not, see <http://www.gnu.org/licenses/>
 */
 #include <osgEarthUtil/ContourMap>
+#include <osgEarthUtil/ContourLines>
 #include <osgEarthUtil/Shaders>
 #include <osgEarth/Registry>
 #include <osgEarth/TerrainEngineNode>
 #include <osgEarth/MapNode>
+#include <cfloat>
 
 #define LC "[ContourMap] "
 
@@ -59,6 +61,11 @@ ContourMap::init()
     _xferSampler = new osg::Uniform(osg::Uniform::SAMPLER_1D, "oe_contour_xfer" );
 #endif
     _opacityUniform = new osg::Uniform(osg::Uniform::FLOAT,   "oe_contour_opacity" );
+    _intervalUniform = new osg::Uniform(osg::Uniform::FLOAT,  "oe_contour_interval" );
+    _lineColorUniform = new osg::Uniform(osg::Uniform::FLOAT_VEC4, "oe_contour_lineColor" );
+
+    // REX sets the real range on each tile; this default never skips one.
+    _elevRangeUniform = new osg::Uniform("oe_tile_elevRange", osg::Vec2f(-FLT_MAX, FLT_MAX));
 
     // Create a 1D texture from the transfer function's image.
     _xferTexture = new TextureType();
@@ -108,6 +115,8 @@ void
 ContourMap::dirty()
 {
     _opacityUniform->set(opacity().getOrUse(1.0f));
+    _intervalUniform->set(osg::maximum(interval().get(), 0.001f));
+    _lineColorUniform->set(osg::Vec4f(lineColor().get()));
     
     // build a transfer function.
     osg::TransferFunction1D* xfer = new osg::TransferFunction1D();
@@ -159,14 +168,28 @@ ContourMap::onInstall(TerrainEngineNode* engine)
 {
     if ( engine )
     {
+        osg::StateSet* stateset = engine->getOrCreateStateSet();
+
+        // Lines need no transfer function, so no texture unit either.
+        if ( mode() == MODE_ISOLINES )
+        {
+            VirtualProgram* vp = VirtualProgram::getOrCreate(stateset);
+            Shaders pkg;
+            pkg.load(vp, pkg.ContourMap_LinesFragment);
+
+            stateset->addUniform( _intervalUniform.get() );
+            stateset->addUniform( _lineColorUniform.get() );
+            stateset->addUniform( _opacityUniform.get() );
+            stateset->addUniform( _elevRangeUniform.get() );
+            return;
+        }
+
         if ( !engine->getResources()->reserveTextureImageUnit(_unit, "ContourMap") )
         {
             OE_WARN << LC << "Failed to reserve a texture image unit; disabled." << std::endl;
             return;
         }
 
-        osg::StateSet* stateset = engine->getOrCreateStateSet();
-
         // Install the texture and its sampler uniform:
         stateset->setTextureAttributeAndModes( _unit, _xferTexture.get(), osg::StateAttribute::ON );
         stateset->addUniform( _xferSampler.get() );
@@ -205,6 +228,9 @@ ContourMap::onUninstall(TerrainEngineNode* engine)
             stateset->removeUniform( _xferRange.get() );
             stateset->removeUniform( _xferSampler.get() );
             stateset->removeUniform( _opacityUniform.get() );
+            stateset->removeUniform( _intervalUniform.get() );
+            stateset->removeUniform( _lineColorUniform.get() );
+            stateset->removeUniform( _elevRangeUniform.get() );
 
             stateset->removeTextureAttribute( _unit, osg::StateAttribute::TEXTURE );
 
@@ -214,6 +240,7 @@ ContourMap::onUninstall(TerrainEngineNode* engine)
                 Shaders pkg;
                 pkg.unload(vp, pkg.ContourMap_Vertex);
                 pkg.unload(vp, pkg.ContourMap_Fragment);
+                pkg.unload(vp, pkg.ContourMap_LinesFragment);
             }
         }
 
@@ -233,6 +260,21 @@ REGISTER_OSGEARTH_EXTENSION(osgearth_contour_map, ContourMapExtension);
 bool
 ContourMapExtension::connect(MapNode* mapNode)
 {
+    if ( mode() == MODE_GEOMETRY )
+    {
+        if ( !_lines.valid() )
+        {
+            ContourLines* lines = new ContourLines(mapNode->getMap());
+            lines->setInterval( interval().get() );
+            lines->setColor( lineColor().get() );
+            lines->setMaxLevel( maxLevel().get() );
+            lines->build();
+            _lines = lines;
+        }
+        mapNode->addChild( _lines.get() );
+        return true;
+    }
+
     if ( !_effect.valid() )
         _effect = new ContourMap(*this);
 
@@ -244,6 +286,11 @@ bool
 ContourMapExtension::disconnect(MapNode* mapNode)
 {
     if ( mapNode )
-        mapNode->getTerrainEngine()->removeEffect( _effect.get() );
+    {
+        if ( _lines.valid() )
+            mapNode->removeChild( _lines.get() );
+        if ( _effect.valid() )
+            mapNode->getTerrainEngine()->removeEffect( _effect.get() );
+    }
     return true;
 }
@@ -0,0 +1,30 @@
+#version $GLSL_VERSION_STR
+$GLSL_DEFAULT_PRECISION_FLOAT
+
+#pragma vp_entryPoint oe_contour_lines
+#pragma vp_location   fragment_coloring
+#pragma vp_order      0.2
+
+in vec4 oe_layer_tilec;
+uniform vec2 oe_tile_elevRange;     // min/max height of this tile
+uniform float oe_contour_interval;
+uniform vec4 oe_contour_lineColor;
+uniform float oe_contour_opacity;
+
+float oe_terrain_getElevation(in vec2 uv);
+
+void oe_contour_lines( inout vec4 color )
+{
+    // No contour crosses a tile whose whole height range falls between
+    // two lines, so skip the elevation sample.
+    if ( floor(oe_tile_elevRange.x/oe_contour_interval) == floor(oe_tile_elevRange.y/oe_contour_interval) )
+        return;
+
+    float h = oe_terrain_getElevation(oe_layer_tilec.st) / oe_contour_interval;
+
+    // distance to the nearest line in pixels, for an even width at any range:
+    float d = abs(fract(h+0.5)-0.5) / max(fwidth(h), 1e-6);
+    float a = (1.0 - clamp(d, 0.0, 1.0)) * oe_contour_lineColor.a * oe_contour_opacity;
+
+    color.rgb = mix(color.rgb, oe_contour_lineColor.rgb, a);
+}
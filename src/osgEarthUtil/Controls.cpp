@@ -221,6 +221,8 @@ Control::init()
     _active = false;
     _absorbEvents = true;
     _dirty = true;
+    _contentDirty = false;
+    _childDirty = false;
     _borderWidth = 1.0f;
 
     _geode = new osg::Geode();
@@ -464,7 +466,7 @@ void
 Control::setForeColor( const osg::Vec4f& value ) {
     if ( value != _foreColor.value() ) {
         _foreColor = value;
-        dirty();
+        dirtyContent();
     }
 }
 
@@ -472,7 +474,7 @@ void
 Control::setBackColor( const osg::Vec4f& value ) {
     if ( value != _backColor.value() ) {
         _backColor = value;
-        dirty();
+        dirtyContent();
     }
 }
 
@@ -481,7 +483,7 @@ Control::setActiveColor( const osg::Vec4f& value ) {
     if ( value != _activeColor.value() ) {
         _activeColor = value;
         if ( _active )
-            dirty();
+            dirtyContent();
     }
 }
 
@@ -489,7 +491,7 @@ void
 Control::setBorderColor( const osg::Vec4f& value ) {
     if ( value != _borderColor.value() ) {
         _borderColor = value;
-        dirty();
+        dirtyContent();
     }
 }
 
@@ -506,7 +508,7 @@ Control::setActive( bool value ) {
     if ( value != _active ) {
         _active = value;
         if ( _activeColor.isSet() )
-            dirty();
+            dirtyContent();
     }
 }
 
@@ -514,7 +516,7 @@ void
 Control::setBorderWidth( float value ) {
     if ( value != _borderWidth ) {
         _borderWidth = value;
-        dirty();
+        dirtyContent();
     }
 }
 
@@ -544,6 +546,34 @@ namespace
     }
 }
 
+// Like dirtyParent(), but only tells the ancestors that something below
+// them needs a redraw; they keep their layout.
+void
+Control::dirtyContentParent(osg::Group* p)
+{
+    if ( p )
+    {
+        Control* c = dynamic_cast<Control*>( p );
+        if ( c && c->_childDirty )
+        {
+            return;
+        }
+        else if ( c )
+        {
+            c->_childDirty = true;
+        }
+        else if ( dynamic_cast<ControlCanvas*>( p ) )
+        {
+            return;
+        }
+
+        for( unsigned i=0; i<p->getNumParents(); ++i )
+        {
+            dirtyContentParent( p->getParent(i) );
+        }
+    }
+}
+
 void
 Control::dirty()
 {
@@ -554,6 +584,55 @@ Control::dirty()
     }
 }
 
+void
+Control::dirtyContent()
+{
+    _contentDirty = true;
+    for(unsigned i=0; i<getNumParents(); ++i)
+    {
+        dirtyContentParent( getParent(i) );
+    }
+}
+
+bool
+Control::redrawContent(const ControlContext& cx)
+{
+    if ( _dirty )
+    {
+        return false;
+    }
+
+    else if ( _contentDirty )
+    {
+        // Only a freestanding control that keeps its size can redraw where
+        // it is; a container has to lay its children out again, and a fill
+        // control gets its size from its container.
+        if ( dynamic_cast<Container*>(this) || _hfill || _vfill || !visible() || !parentIsVisible() )
+            return false;
+
+        osg::Vec2f oldSize = _renderSize;
+        osg::Vec2f size;
+        calcSize( cx, size );
+        if ( _renderSize != oldSize )
+            return false;
+
+        draw( cx );
+    }
+
+    else if ( _childDirty )
+    {
+        for( unsigned i=1; i<getNumChildren(); ++i )
+        {
+            Control* child = dynamic_cast<Control*>( getChild(i) );
+            if ( child && child->isDirty() && !child->redrawContent(cx) )
+                return false;
+        }
+        _childDirty = false;
+    }
+
+    return true;
+}
+
 void
 Control::calcSize(const ControlContext& cx, osg::Vec2f& out_size)
 {
@@ -630,6 +709,9 @@ Control::draw(const ControlContext& cx)
 {
     clearGeode();
 
+    _contentDirty = false;
+    _childDirty = false;
+
     // by default, rendering a Control directly results in a colored quad. Usually however
     // you will not render a Control directly, but rather one of its subclasses.
     if ( visible()  && parentIsVisible() )
@@ -638,27 +720,34 @@ Control::draw(const ControlContext& cx)
         {
             float vph = cx._vp->height();
 
-            // draw the background poly:
+            // draw the background poly. The geometry is kept between redraws
+            // and its arrays updated in place.
             {
-                _geom = newGeometry();
+                if ( !_geom.valid() )
+                {
+                    _geom = newGeometry();
+                    _geom->setVertexArray( new osg::Vec3Array(6) );
+                    _geom->addPrimitiveSet( new osg::DrawArrays( GL_TRIANGLES, 0, 6 ) );
+                    _geom->setColorArray( new osg::Vec4Array(osg::Array::BIND_OVERALL, 1) );
+                }
 
                 float rx = _renderPos.x() - padding().left();
                 float ry = _renderPos.y() - padding().top();
 
-                osg::Vec3Array* verts = new osg::Vec3Array(6);
-                _geom->setVertexArray( verts );
+                osg::Vec3Array* verts = static_cast<osg::Vec3Array*>( _geom->getVertexArray() );
                 (*verts)[0].set( rx, vph - ry, 0 );
                 (*verts)[1].set( rx, vph - ry - _renderSize.y(), 0 );
                 (*verts)[2].set( rx + _renderSize.x(), vph - ry - _renderSize.y(), 0 );
                 (*verts)[3].set( (*verts)[2] );
                 (*verts)[4].set( rx + _renderSize.x(), vph - ry, 0 );
                 (*verts)[5].set( (*verts)[0] );
-                
-               _geom->addPrimitiveSet( new osg::DrawArrays( GL_TRIANGLES, 0, 6 ) );
+                verts->dirty();
 
-                osg::Vec4Array* colors = new osg::Vec4Array(osg::Array::BIND_OVERALL, 1);
+                osg::Vec4Array* colors = static_cast<osg::Vec4Array*>( _geom->getColorArray() );
                 (*colors)[0] = _active && _activeColor.isSet() ? _activeColor.value() : _backColor.value();
-                _geom->setColorArray( colors );
+                colors->dirty();
+
+                _geom->dirtyBound();
 
                 getGeode()->addDrawable( _geom.get() );
             }
@@ -787,7 +876,8 @@ _fontSize( fontSize ),
 _encoding( osgText::String::ENCODING_UNDEFINED ),
 _backdropType( osgText::Text::OUTLINE ),
 _backdropImpl( osgText::Text::NO_DEPTH_BUFFER ),
-_backdropOffset( 0.03f )
+_backdropOffset( 0.03f ),
+_textDirty    ( true )
 { 
     //setStateSet(textStateSet());
     setFont( Registry::instance()->getDefaultFont() );    
@@ -803,7 +893,8 @@ _fontSize( fontSize ),
 _encoding( osgText::String::ENCODING_UNDEFINED ),
 _backdropType( osgText::Text::OUTLINE ),
 _backdropImpl( osgText::Text::NO_DEPTH_BUFFER ),
-_backdropOffset( 0.03f )
+_backdropOffset( 0.03f ),
+_textDirty    ( true )
 {    	
     setFont( Registry::instance()->getDefaultFont() );   
     setForeColor( foreColor );
@@ -817,7 +908,8 @@ _fontSize( fontSize ),
 _encoding( osgText::String::ENCODING_UNDEFINED ),
 _backdropType( osgText::Text::OUTLINE ),
 _backdropImpl( osgText::Text::NO_DEPTH_BUFFER ),
-_backdropOffset( 0.03f )
+_backdropOffset( 0.03f ),
+_textDirty    ( true )
 {
     setFont( Registry::instance()->getDefaultFont() );    
     setForeColor( foreColor );
@@ -834,7 +926,8 @@ _fontSize( fontSize ),
 _encoding( osgText::String::ENCODING_UNDEFINED ),
 _backdropType( osgText::Text::OUTLINE ),
 _backdropImpl( osgText::Text::NO_DEPTH_BUFFER ),
-_backdropOffset( 0.03f )
+_backdropOffset( 0.03f ),
+_textDirty    ( true )
 {    	
     setFont( Registry::instance()->getDefaultFont() );   
     setForeColor( foreColor );
@@ -850,7 +943,8 @@ LabelControl::setText( const std::string& value )
 {
     if ( value != _text ) {
         _text = value;
-        dirty();
+        _textDirty = true;
+        dirtyContent();
     }
 }
 
@@ -859,7 +953,8 @@ LabelControl::setEncoding( osgText::String::Encoding value )
 {
     if ( value != _encoding ) {
         _encoding = value;
-        dirty();
+        _textDirty = true;
+        dirtyContent();
     }
 }
 
@@ -868,7 +963,8 @@ LabelControl::setFont( osgText::Font* value )
 {
     if ( value != _font.get() ) {
         _font = value;
-        dirty();
+        _textDirty = true;
+        dirtyContent();
     }
 }
 
@@ -877,7 +973,8 @@ LabelControl::setFontSize( float value )
 {
     if ( value != _fontSize ) {
         _fontSize = value;
-        dirty();
+        _textDirty = true;
+        dirtyContent();
     }
 }
 
@@ -886,7 +983,8 @@ LabelControl::setHaloColor( const osg::Vec4f& value )
 {
     if ( !_haloColor.isSet() || *_haloColor != value ) {
         _haloColor = value;
-        dirty();
+        _textDirty = true;
+        dirtyContent();
     }
 }
 
@@ -895,7 +993,8 @@ LabelControl::setTextBackdropImplementation(osgText::Text::BackdropImplementatio
 {
     if( _backdropImpl != value ) {
         _backdropImpl = value;
-        dirty();
+        _textDirty = true;
+        dirtyContent();
     }
 }
 
@@ -904,7 +1003,8 @@ LabelControl::setTextBackdropType(osgText::Text::BackdropType value)
 {
     if( _backdropType != value ) {
         _backdropType = value;
-        dirty();
+        _textDirty = true;
+        dirtyContent();
     }
 }
 
@@ -913,7 +1013,8 @@ LabelControl::setTextBackdropOffset(float offsetValue)
 {
     if ( offsetValue != _backdropOffset ) {
         _backdropOffset = offsetValue;
-        dirty();
+        _textDirty = true;
+        dirtyContent();
     }
 }
 
@@ -923,30 +1024,43 @@ LabelControl::calcSize(const ControlContext& cx, osg::Vec2f& out_size)
     if ( visible() == true )
     {
         // we have to create the drawable during the layout pass so we can calculate its size.
-        LabelText* t = new LabelText();
+        // It lives as long as the label; the glyphs are only laid out again when
+        // the text or its font changes, not on every relayout.
+        LabelText* t = static_cast<LabelText*>( _drawable.get() );
+        if ( !t )
+        {
+            t = new LabelText();
+            // yes, object coords. screen coords won't work because the bounding box will be wrong.
+            t->setCharacterSizeMode( osgText::Text::OBJECT_COORDS );
+            // always align to top. layout alignment gets calculated layer in Control::calcPos().
+            t->setAlignment( osgText::Text::LEFT_TOP ); 
+            _drawable = t;
+            _textDirty = true;
+        }
 
-        t->setText( _text, _encoding );
-        // yes, object coords. screen coords won't work because the bounding box will be wrong.
-        t->setCharacterSizeMode( osgText::Text::OBJECT_COORDS );
-        t->setCharacterSize( _fontSize );
+        if ( _textDirty )
+        {
+            t->setText( _text, _encoding );
+            t->setCharacterSize( _fontSize );
 
-        // always align to top. layout alignment gets calculated layer in Control::calcPos().
-        t->setAlignment( osgText::Text::LEFT_TOP ); 
-        t->setColor( foreColor().value() );
+            // set up the font.
+            if ( _font.valid() )
+                t->setFont( _font.get() );
 
-        // set up the font.
-        if ( _font.valid() )
-            t->setFont( _font.get() );
+            // set up the backdrop halo:
+            if ( haloColor().isSet() )
+            {
+                t->setBackdropType( _backdropType );
+                t->setBackdropImplementation( _backdropImpl );
+                t->setBackdropOffset( _backdropOffset );
+                t->setBackdropColor( haloColor().value() );
+            }
 
-        // set up the backdrop halo:
-        if ( haloColor().isSet() )
-        {
-            t->setBackdropType( _backdropType );
-            t->setBackdropImplementation( _backdropImpl );
-            t->setBackdropOffset( _backdropOffset );
-            t->setBackdropColor( haloColor().value() );
+            _textDirty = false;
         }
 
+        t->setColor( foreColor().value() );
+
         osg::BoundingBox bbox = t->getTextBB();
         if ( cx._viewContextID != ~0u )
         {
@@ -968,8 +1082,6 @@ LabelControl::calcSize(const ControlContext& cx, osg::Vec2f& out_size)
         // If width explicitly set and > measured width of label text - use it.
         if (width().isSet() && width().get() > _renderSize.x()) _renderSize.x() = width().get();
 
-        _drawable = t;
-
         out_size.set(
             margin().x() + _renderSize.x(),
             margin().y() + _renderSize.y() );
@@ -1283,7 +1395,7 @@ HSliderControl::setValue( float value, bool notify )
         _value = value;
         if ( notify )
             fireValueChanged();
-        dirty();
+        dirtyContent();
     }
 }
 
@@ -1436,7 +1548,7 @@ CheckBoxControl::setValue( bool value, bool notify )
         _value = value;
         if (notify)
             fireValueChanged();
-        dirty();
+        dirtyContent();
     }
 }
 
@@ -2918,6 +3030,10 @@ ControlCanvas::update(const osg::FrameStamp* frameStamp)
         Control* control = dynamic_cast<Control*>( getChild(i) );
         if ( control && (control->isDirty() || _contextDirty))
         {
+            // content-only changes redraw just the controls that changed:
+            if ( !_contextDirty && control->redrawContent( _context ) )
+                continue;
+
             osg::Vec2f size;
             control->calcSize( _context, size );
             control->calcFill( _context );
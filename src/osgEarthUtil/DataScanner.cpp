@@ -21,7 +21,16 @@
 */
 #include <osgEarthUtil/DataScanner>
 #include <osgEarthDrivers/gdal/GDALOptions>
+#include <osgEarth/TileSource>
+#include <osgEarth/JobScheduler>
+#include <osgEarth/Registry>
+#include <osgEarth/FileUtils>
+#include <osgEarth/Config>
 #include <osgDB/FileUtils>
+#include <osgDB/FileNameUtils>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
 
 #define LC "[DataScanner] "
 
@@ -31,9 +40,137 @@ using namespace osgEarth::Drivers;
 
 namespace
 {
+    // What a scan learned about one file.
+    struct FileInfo
+    {
+        FileInfo() : _modified(0), _ok(false), _maxLevel(0u) { }
+
+        TimeStamp   _modified;
+        bool        _ok;
+        std::string _srs;
+        double      _xmin, _ymin, _xmax, _ymax;
+        unsigned    _maxLevel;
+
+        Config getConfig() const
+        {
+            Config conf("file");
+            conf.set("modified", (long long)_modified);
+            conf.set("ok", _ok);
+            if (_ok)
+            {
+                conf.set("srs", _srs);
+                conf.set("xmin", _xmin);
+                conf.set("ymin", _ymin);
+                conf.set("xmax", _xmax);
+                conf.set("ymax", _ymax);
+                conf.set("max_level", _maxLevel);
+            }
+            return conf;
+        }
+
+        void fromConfig(const Config& conf)
+        {
+            long long modified = 0;
+            conf.getIfSet("modified", modified);
+            _modified = (TimeStamp)modified;
+            conf.getIfSet("ok", _ok);
+            conf.getIfSet("srs", _srs);
+            conf.getIfSet("xmin", _xmin);
+            conf.getIfSet("ymin", _ymin);
+            conf.getIfSet("xmax", _xmax);
+            conf.getIfSet("ymax", _ymax);
+            conf.getIfSet("max_level", _maxLevel);
+        }
+    };
+
+    typedef std::map<std::string, FileInfo> FileIndex;
+
+    void readIndex(const std::string& location, FileIndex& index)
+    {
+        std::ifstream input(location.c_str());
+        if (!input.is_open())
+            return;
+
+        std::stringstream buf;
+        buf << input.rdbuf();
+
+        Config conf;
+        if (!conf.fromJSON(buf.str()))
+            return;
+
+        for (ConfigSet::const_iterator i = conf.children().begin(); i != conf.children().end(); ++i)
+        {
+            std::string path = i->value("path");
+            if (!path.empty())
+                index[path].fromConfig(*i);
+        }
+    }
+
+    void writeIndex(const std::string& location, const FileIndex& index)
+    {
+        Config conf("index");
+        for (FileIndex::const_iterator i = index.begin(); i != index.end(); ++i)
+        {
+            Config file = i->second.getConfig();
+            file.set("path", i->first);
+            conf.add(file);
+        }
+
+        std::ofstream output(location.c_str());
+        if (output.is_open())
+        {
+            output << conf.toJSON(true);
+        }
+        else
+        {
+            OE_WARN << LC << "Cannot write index file " << location << std::endl;
+        }
+    }
+
+    // Opens a new or changed file with GDAL and records its metadata.
+    struct ProbeFileTask : public TaskRequest
+    {
+        ProbeFileTask(const std::string& path, FileInfo* info) : _path(path), _info(info) { }
+
+        void operator()(ProgressCallback* progress)
+        {
+            GDALOptions gdal;
+            gdal.url() = _path;
+
+            osg::ref_ptr<TileSource> source = TileSourceFactory::create(gdal);
+            if (!source.valid() || source->open().isError() || !source->getProfile())
+                return;
+
+            const Profile* profile = source->getProfile();
+            GeoExtent extent = profile->getExtent();
+            _info->_maxLevel = 0u;
+
+            const DataExtentList& dataExtents = source->getDataExtents();
+            if (!dataExtents.empty())
+            {
+                extent = dataExtents.front();
+                for (DataExtentList::const_iterator i = dataExtents.begin(); i != dataExtents.end(); ++i)
+                {
+                    if (i->maxLevel().isSet())
+                        _info->_maxLevel = std::max(_info->_maxLevel, i->maxLevel().get());
+                }
+            }
+
+            _info->_srs = extent.getSRS()->getHorizInitString();
+            _info->_xmin = extent.xMin();
+            _info->_ymin = extent.yMin();
+            _info->_xmax = extent.xMax();
+            _info->_ymax = extent.yMax();
+            _info->_ok = true;
+        }
+
+        std::string _path;
+        FileInfo*   _info;
+    };
+
     void traverse(const std::string&              path,
                   const std::vector<std::string>& extensions,
-                  ImageLayerVector&               out_imageLayers)
+                  std::vector<std::string>&       out_files)
     {
         if ( osgDB::fileType(path) == osgDB::DIRECTORY )
         {
@@ -44,7 +181,7 @@ namespace
                     continue;
 
                 std::string filepath = osgDB::concatPaths( path, *f );
-                traverse( filepath, extensions, out_imageLayers );
+                traverse( filepath, extensions, out_files );
             }
         }
 
@@ -54,16 +191,7 @@ namespace
 
             if ( std::find(extensions.begin(), extensions.end(), ext) != extensions.end() )
             {
-                GDALOptions gdal;
-                gdal.url() = path;
-                //gdal.interpolation() = INTERP_NEAREST;
-
-                ImageLayerOptions options( path, gdal );
-                options.cachePolicy() = CachePolicy::NO_CACHE;
-
-                ImageLayer* layer = new ImageLayer(options);
-                out_imageLayers.push_back( layer );
-                OE_INFO << LC << "Found " << path << std::endl;
+                out_files.push_back( path );
             }
         }
     }
@@ -75,5 +203,81 @@ DataScanner::findImageLayers(const std::string&              absRootPath,
                              const std::vector<std::string>& extensions,
                              ImageLayerVector&               out_imageLayers) const
 {
-    traverse( absRootPath, extensions, out_imageLayers );
+    std::vector<std::string> files;
+    traverse( absRootPath, extensions, files );
+
+    FileIndex index;
+    if ( !_indexFile.empty() )
+        readIndex( _indexFile, index );
+
+    // Probe whatever is new or changed since the last scan, in parallel.
+    // The index entries are created up front so the tasks don't modify the map.
+    JobScheduler* scheduler = Registry::instance()->getJobScheduler();
+    osg::ref_ptr<JobGroup> group = new JobGroup();
+    unsigned probed = 0u;
+
+    for( std::vector<std::string>::const_iterator i = files.begin(); i != files.end(); ++i )
+    {
+        TimeStamp modified = osgEarth::getLastModifiedTime( *i );
+
+        FileIndex::iterator entry = index.find( *i );
+        if ( entry != index.end() && entry->second._modified == modified )
+            continue;
+
+        FileInfo& info = index[*i];
+        info = FileInfo();
+        info._modified = modified;
+        scheduler->submit( new ProbeFileTask(*i, &info), JobScheduler::LANE_NORMAL, group.get() );
+        ++probed;
+    }
+
+    if ( scheduler->isWorkerThread() )
+    {
+        // help out rather than block a worker
+        while( group->getNumPending() > 0u )
+        {
+            if ( !scheduler->runOne() )
+                OpenThreads::Thread::YieldCurrentThread();
+        }
+    }
+    else
+    {
+        group->wait();
+    }
+
+    for( std::vector<std::string>::const_iterator i = files.begin(); i != files.end(); ++i )
+    {
+        const std::string& path = *i;
+        const FileInfo& info = index[path];
+
+        if ( !info._ok )
+        {
+            OE_INFO << LC << "Skipping " << path << " (not readable)" << std::endl;
+            continue;
+        }
+
+        GDALOptions gdal;
+        gdal.url() = path;
+        //gdal.interpolation() = INTERP_NEAREST;
+
+        ImageLayerOptions options( path, gdal );
+        options.cachePolicy() = CachePolicy::NO_CACHE;
+
+        ImageLayer* layer = new ImageLayer(options);
+        out_imageLayers.push_back( layer );
+        OE_INFO << LC << "Found " << path << std::endl;
+    }
+
+    if ( !_indexFile.empty() )
+    {
+        // forget files that are gone:
+        FileIndex current;
+        for( std::vector<std::string>::const_iterator i = files.begin(); i != files.end(); ++i )
+            current[*i] = index[*i];
+
+        if ( probed > 0u || current.size() != index.size() )
+            writeIndex( _indexFile, current );
+    }
+
+    OE_INFO << LC << "Scanned " << files.size() << " files (" << probed << " probed)" << std::endl;
 }
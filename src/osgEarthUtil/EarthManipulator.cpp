@@ -294,6 +294,8 @@ _max_vp_duration_s              ( 8.0 ),
 _orthoTracksPerspective         ( true ),
 _terrainAvoidanceEnabled        ( true ),
 _terrainAvoidanceMinDistance    ( 1.0 ),
+_terrainQueriesUseElevation     ( false ),
+_terrainQueryLOD                ( 15u ),
 _throwingEnabled                ( false ),
 _throwDecayRate                 ( 0.05 )
 {
@@ -325,6 +327,8 @@ _orthoTracksPerspective( rhs._orthoTracksPerspective ),
 _breakTetherActions( rhs._breakTetherActions ),
 _terrainAvoidanceEnabled( rhs._terrainAvoidanceEnabled ),
 _terrainAvoidanceMinDistance( rhs._terrainAvoidanceMinDistance ),
+_terrainQueriesUseElevation( rhs._terrainQueriesUseElevation ),
+_terrainQueryLOD( rhs._terrainQueryLOD ),
 _throwingEnabled( rhs._throwingEnabled ),
 _throwDecayRate( rhs._throwDecayRate )
 {
@@ -341,6 +345,8 @@ EarthManipulator::Settings::apply(osg::ArgumentParser& args)
         setTerrainAvoidanceEnabled( boolval );
     if ( args.read("--manip-terrain-avoidance-min-distance", doubleval) )
         setTerrainAvoidanceMinimumDistance( doubleval );
+    if ( args.read("--manip-elevation-queries", boolval) )
+        setTerrainQueriesUseElevation( boolval );
     if ( args.read("--manip-min-distance", doubleval) )
         setMinMaxDistance(doubleval, _max_distance);
     if ( args.read("--manip-max-distance", doubleval) )
@@ -855,6 +861,7 @@ EarthManipulator::setNode(osg::Node* node)
         _node     = node;
         _mapNode = 0L;
         _srs     = 0L;
+        _heightPatch = 0L;
 
         reinitialize();
         established();
@@ -1039,6 +1046,15 @@ EarthManipulator::setViewpoint(const Viewpoint& vp, double duration_seconds)
             double h1 = range1 * sin( -pitch1 );
             double dh = (h1 - h0);
 
+            // Let the terrain start loading the destination while we fly there.
+            osg::ref_ptr<MapNode> mapNode;
+            if ( _mapNode.lock(mapNode) && mapNode->getTerrainEngine() )
+            {
+                GeoPoint endPoint;
+                if ( endPoint.fromWorld(_srs.get(), endWorld) )
+                    mapNode->getTerrainEngine()->prefetch( endPoint, range1 );
+            }
+
             // calculate the total distance the focal point will travel and derive an arc height:
             double de = (endWorld - startWorld).length();
 
@@ -1270,6 +1286,14 @@ EarthManipulator::clearViewpoint()
 {
     bool breakingTether = isTethering();
 
+    // An interrupted transition no longer needs its destination.
+    if ( isSettingViewpoint() )
+    {
+        osg::ref_ptr<MapNode> mapNode;
+        if ( _mapNode.lock(mapNode) && mapNode->getTerrainEngine() )
+            mapNode->getTerrainEngine()->cancelPrefetch();
+    }
+
     // Cancel any ongoing transition or tethering:
     _setVP0.unset();
     _setVP1.unset();
@@ -1308,7 +1332,11 @@ void EarthManipulator::collisionDetect()
     double r = std::min( _srs->getEllipsoid()->getRadiusEquator(), _srs->getEllipsoid()->getRadiusPolar() );
     osg::Vec3d ip, normal;
 
-    if (intersect(eye + eyeUp * r, eye - eyeUp * r, ip, normal))
+    bool hit =
+        (_settings->getTerrainQueriesUseElevation() && getTerrainPoint(eye, ip)) ||
+        intersect(eye + eyeUp * r, eye - eyeUp * r, ip, normal);
+
+    if (hit)
     {
         double eps = _settings->getTerrainAvoidanceMinimumDistance();
         // Now determine if the point is above the ground or not
@@ -1355,6 +1383,38 @@ EarthManipulator::intersect(const osg::Vec3d& start, const osg::Vec3d& end, osg:
     return false;
 }
 
+bool
+EarthManipulator::getTerrainPoint(const osg::Vec3d& world, osg::Vec3d& out_world) const
+{
+    osg::ref_ptr<MapNode> mapNode;
+    if ( !_mapNode.lock(mapNode) || !mapNode->getMap()->getElevationPool() )
+        return false;
+
+    const Profile* profile = mapNode->getMap()->getProfile();
+
+    GeoPoint point;
+    if ( !point.fromWorld(profile->getSRS(), world) )
+        return false;
+
+    // the patch spans a few hundred tiles at the query LOD; leaving it
+    // starts a fresh envelope rather than growing the old one.
+    unsigned lod = _settings->getTerrainQueryLOD();
+    TileKey patchKey = profile->createTileKey(point.x(), point.y(), lod > 4u ? lod - 4u : 0u);
+    if ( !_heightPatch.valid() || patchKey != _heightPatchKey )
+    {
+        _heightPatch = mapNode->getMap()->getElevationPool()->createEnvelope(profile->getSRS(), lod);
+        _heightPatchKey = patchKey;
+    }
+
+    float h = _heightPatch->getElevation(point.x(), point.y());
+    if ( h == NO_DATA_VALUE )
+        return false;
+
+    point.z() = h;
+    point.altitudeMode() = ALTMODE_ABSOLUTE;
+    return point.toWorld(out_world);
+}
+
 bool
 EarthManipulator::intersectLookVector(osg::Vec3d& out_eye,
                                       osg::Vec3d& out_target,
@@ -2472,6 +2532,17 @@ EarthManipulator::recalculateCenter( const osg::CoordinateFrame& frame )
 
         osg::Vec3d up = getUpVector(frame);
 
+        // the ground right under the center, without walking the graph:
+        if ( _settings->getTerrainQueriesUseElevation() )
+        {
+            osg::Vec3d ip;
+            if ( getTerrainPoint(_center, ip) )
+            {
+                setCenter( ip );
+                return;
+            }
+        }
+
         osg::Vec3d ip1;
         osg::Vec3d ip2;
         osg::Vec3d normal;
@@ -20,6 +20,7 @@
 * along with this program.  If not, see <http://www.gnu.org/licenses/>
 */
 #include <osgEarthUtil/Ephemeris>
+#include <cfloat>
 
 using namespace osgEarth;
 using namespace osgEarth::Util;
@@ -58,14 +59,8 @@ namespace
     {
         // http://www.stjarnhimlen.se/comp/tutorial.html#5
         // Test: http://www.satellite-calculations.com/Satellite/suncalc.htm
-        CelestialBody getPosition(const DateTime& dt) const
+        static void getState(double d, double* out)
         {
-            static const osg::EllipsoidModel WGS84;
-
-            // Reference to 1999Dec31.0TDT
-            const double JD_REFTIME = DateTime(1999,12,31,0.0).getJulianDay();
-            double d = dt.getJulianDay() - JD_REFTIME;
-
             double w = 282.9404 + 4.70935E-5 * d;
             const double a = 1.0;
 
@@ -93,68 +88,11 @@ namespace
             double DECL_deg = r2d(atan2(zequat, sqrt(xequat*xequat + yequat*yequat)));
 
             double GMST0_deg = rev(L + 180);
-            double UT = d - floor(d);
-
-            CelestialBody sun;
-
-            sun.rightAscension.set(RA_deg, Units::DEGREES);
-            sun.declination.set(DECL_deg, Units::DEGREES);
-            sun.latitude.set(DECL_deg, Units::DEGREES);
-            sun.longitude.set(rev(0*180+RA_deg-GMST0_deg-UT*360), Units::DEGREES);
-            sun.altitude.set(149600000.0, Units::KILOMETERS);
-            
-#if 0
-            // compute topographic measurements relative to observer position:
-            if (sun._observer.isValid())
-            {
-                double siteLat_deg = sun._observer.y(); // TODO
-                double siteLon_deg = sun._observer.x(); // TODO
-
-                double SIDEREAL_deg = GMST0_deg + UT * 360 + siteLon_deg;
-                double siteLon_rad = d2r(siteLon_deg);
-                double siteLat_rad = d2r(siteLat_deg);
-                double hourAngle_rad = d2r(SIDEREAL_deg - RA_deg);
-                double DECL_rad = d2r(DECL_deg);
-                x = cos(hourAngle_rad) * cos(DECL_rad);
-                y = sin(hourAngle_rad) * cos(DECL_rad);
-                z = sin(DECL_rad);
-                double xhor = x*sin(siteLat_rad) - z*cos(siteLat_rad);
-                double yhor = y;
-                double zhor = x*cos(siteLat_rad) + z*sin(siteLat_rad);
-
-                double elev = asin(zhor);
-                double azim = atan2(yhor, zhor);
-                azim = siteLat_deg < 0.0? azim + osg::PI : azim - osg::PI;
-                nrad2(azim);
-
-                sun._topoElevation.set(elev, Units::RADIANS);
-                sun._topoAzimuth.set(azim, Units::RADIANS);
-            }
-#endif
 
-            // geocentric:
-            {
-                WGS84.convertLatLongHeightToXYZ(
-                    sun.latitude.as(Units::RADIANS),
-                    sun.longitude.as(Units::RADIANS),
-                    sun.altitude.as(Units::METERS),
-                    sun.geocentric.x(), sun.geocentric.y(), sun.geocentric.z());
-            }
-
-            // ECI:
-            {
-                double RA = sun.rightAscension.as(Units::RADIANS);
-                double DECL = sun.declination.as(Units::RADIANS);
-                double R = sun.altitude.as(Units::METERS);
-                sun.eci.set(
-                    R*cos(DECL)*cos(RA),
-                    R*cos(DECL)*sin(RA),
-                    R*sin(DECL));
-            }
-
-            //OE_DEBUG << "RA = " << RA << ", DECL = " << DECL << ", LAT = " << r2d(out_lat) << ", LON = " << r2d(out_lon) << std::endl;
-
-            return sun;
+            out[0] = d2r(RA_deg);
+            out[1] = d2r(DECL_deg);
+            out[2] = 149600000.0 * 1000.0;
+            out[3] = d2r(GMST0_deg);
         }
     };
 
@@ -165,13 +103,10 @@ namespace
         // Test: http://www.satellite-calculations.com/Satellite/suncalc.htm
         // Test: http://www.timeanddate.com/astronomy/moon/light.html
         //osg::Vec3d getEarthLonLatRange(int year, int month, int date, double hoursUTC ) const
-        CelestialBody getPosition(const DateTime& dt) const
+        static void getState(double d, double* out)
         {
             static const osg::EllipsoidModel WGS84;
-            
-            // Reference to 1999Dec31.0TDT
-            const double JD_REFTIME = DateTime(1999,12,31,0.0).getJulianDay();
-            double d = dt.getJulianDay() - JD_REFTIME;
+
             double N = d2r(125.1228 - 0.0529538083 * d);  nrad(N);
             double i = d2r(5.1454);                       
             double w = d2r(318.0634 + 0.1643573223 * d);  nrad(w);
@@ -263,54 +198,71 @@ namespace
             double RA = atan2(ye, xe); nrad(RA);
             double Decl = atan2(ze, sqrt(xe*xe + ye*ye));
           
-            // finally, adjust for the time of day (rotation of the earth).
-            double UT = 2.0*osg::PI * (d - floor(d));
-            //double UT = d - floor(d); // 0..1
             double GMST0 = Ls + d2r(180.0); nrad(GMST0);
 
             // Note. The paper creates a "correction" called called "topographic RA/DECL"
             // based on an observer location. We're not using that here which is why the
             // longitude doesn't match up exactly with the test site.
 
-            double earthLat = Decl;
-            double earthLon = RA - GMST0 - UT;
-            nrad(earthLon);
-
             // since r (distance to moon) is in "earth radius units", resolve it to meters
-            r *= WGS84.getRadiusEquator();
+            out[0] = RA;
+            out[1] = Decl;
+            out[2] = r * WGS84.getRadiusEquator();
+            out[3] = GMST0;
+        }
+    };
 
-            CelestialBody moon;
-            
-            moon.rightAscension.set(RA, Units::RADIANS);
-            moon.declination.set(Decl, Units::RADIANS);
-            moon.latitude.set(earthLat, Units::RADIANS);
-            moon.longitude.set(earthLon, Units::RADIANS);
-            moon.altitude.set(r, Units::METERS);
+    // Builds a body from its state (see Ephemeris::Track) by adding the rotation
+    // of the earth at day number d.
+    CelestialBody makeBody(const double* state, double d)
+    {
+        static const osg::EllipsoidModel WGS84;
 
-            // geocentric:
-            {
-                WGS84.convertLatLongHeightToXYZ(
-                    moon.latitude.as(Units::RADIANS),
-                    moon.longitude.as(Units::RADIANS),
-                    moon.altitude.as(Units::METERS),
-                    moon.geocentric.x(), moon.geocentric.y(), moon.geocentric.z());
-            }
+        double RA   = state[0]; nrad(RA);
+        double Decl = state[1];
+        double R    = state[2];
 
-            // ECI:
-            {
-                double RA = moon.rightAscension.as(Units::RADIANS);
-                double DECL = moon.declination.as(Units::RADIANS);
-                double R = moon.altitude.as(Units::METERS);
-                moon.eci.set(
-                    R*cos(DECL)*cos(RA),
-                    R*cos(DECL)*sin(RA),
-                    R*sin(DECL));
-            }
+        // adjust for the time of day (rotation of the earth).
+        double UT = TWO_PI * (d - floor(d));
+        double earthLon = state[0] - state[3] - UT;
+        nrad(earthLon);
 
+        CelestialBody body;
 
-            return moon;
-        }
-    };
+        body.rightAscension.set(RA, Units::RADIANS);
+        body.declination.set(Decl, Units::RADIANS);
+        body.latitude.set(Decl, Units::RADIANS);
+        body.longitude.set(earthLon, Units::RADIANS);
+        body.altitude.set(R, Units::METERS);
+
+        // geocentric:
+        WGS84.convertLatLongHeightToXYZ(
+            Decl, earthLon, R,
+            body.geocentric.x(), body.geocentric.y(), body.geocentric.z());
+
+        // ECI:
+        body.eci.set(
+            R*cos(Decl)*cos(RA),
+            R*cos(Decl)*sin(RA),
+            R*sin(Decl));
+
+        return body;
+    }
+
+    // Day number relative to 1999Dec31.0TDT
+    double getDayNumber(const DateTime& dt)
+    {
+        static const double JD_REFTIME = DateTime(1999,12,31,0.0).getJulianDay();
+        return dt.getJulianDay() - JD_REFTIME;
+    }
+
+    // Brings angle b within PI of angle a so the two interpolate the short way.
+    double unwrap(double a, double b)
+    {
+        double diff = b - a;
+        nrad2(diff);
+        return a + diff;
+    }
 }
 
 
@@ -319,16 +271,72 @@ namespace
 #undef  LC
 #define LC "[Ephemeris] "
 
+Ephemeris::Ephemeris() :
+_step( 600.0 )
+{
+    //nop
+}
+
+void
+Ephemeris::setInterpolationStep(double seconds)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    _step = osg::maximum(seconds, 0.0);
+    _sunTrack._start = _moonTrack._start = -DBL_MAX;
+}
+
 CelestialBody
 Ephemeris::getSunPosition(const DateTime& dt) const
 {
-    return Sun().getPosition(dt);
+    return getPosition(_sunTrack, getDayNumber(dt), &Sun::getState);
 }
 
 CelestialBody
 Ephemeris::getMoonPosition(const DateTime& dt) const
 {
-    return Moon().getPosition(dt);
+    return getPosition(_moonTrack, getDayNumber(dt), &Moon::getState);
+}
+
+CelestialBody
+Ephemeris::getPosition(Track& track, double d, void (*getState)(double, double*)) const
+{
+    double state[4];
+
+    Threading::ScopedMutexLock lock(_mutex);
+
+    if (_step <= 0.0)
+    {
+        getState(d, state);
+        return makeBody(state, d);
+    }
+
+    double step  = _step / 86400.0;
+    double start = floor(d / step) * step;
+
+    if (start != track._start)
+    {
+        // Playing forward reuses the end of the last step as the start of this one.
+        if (osg::absolute(start - (track._start + step)) < step * 1e-6)
+        {
+            for (unsigned k = 0; k < 4; ++k)
+                track._ends[0][k] = track._ends[1][k];
+        }
+        else
+        {
+            getState(start, track._ends[0]);
+        }
+
+        getState(start + step, track._ends[1]);
+        track._ends[1][0] = unwrap(track._ends[0][0], track._ends[1][0]);
+        track._ends[1][3] = unwrap(track._ends[0][3], track._ends[1][3]);
+        track._start = start;
+    }
+
+    double t = (d - start) / step;
+    for (unsigned k = 0; k < 4; ++k)
+        state[k] = track._ends[0][k] + (track._ends[1][k] - track._ends[0][k]) * t;
+
+    return makeBody(state, d);
 }
 
 osg::Vec3d
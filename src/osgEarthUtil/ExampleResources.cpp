@@ -29,6 +29,7 @@
 #include <osgEarthUtil/Shadowing>
 #include <osgEarthUtil/ActivityMonitorTool>
 #include <osgEarthUtil/LogarithmicDepthBuffer>
+#include <osgEarthUtil/ReverseZDepthBuffer>
 
 #include <osgEarthUtil/VerticalScale>
 
@@ -440,6 +441,7 @@ MapNodeHelper::parse(MapNode*             mapNode,
     bool showActivity  = args.read("--activity");
     bool useLogDepth   = args.read("--logdepth");
     bool useLogDepth2  = args.read("--logdepth2");
+    bool useReverseZ   = args.read("--reversez");
     bool kmlUI         = args.read("--kmlui");
 
     std::string kmlFile;
@@ -451,6 +453,9 @@ MapNodeHelper::parse(MapNode*             mapNode,
     std::string imageExtensions;
     args.read("--image-extensions", imageExtensions);
 
+    std::string imageIndex;
+    args.read("--image-index", imageIndex);
+
     // animation path:
     std::string animpath;
     if ( args.read("--path", animpath) )
@@ -603,6 +608,13 @@ MapNodeHelper::parse(MapNode*             mapNode,
         logDepth.install( view->getCamera() );
     }
 
+    else if ( useReverseZ )
+    {
+        OE_INFO << LC << "Activating reverse-Z depth buffer on main camera" << std::endl;
+        osgEarth::Util::ReverseZDepthBuffer reverseZ;
+        reverseZ.install( view->getCamera() );
+    }
+
     // Scan for images if necessary.
     if ( !imageFolder.empty() )
     {
@@ -615,15 +627,15 @@ MapNodeHelper::parse(MapNode*             mapNode,
         OE_INFO << LC << "Loading images from " << imageFolder << "..." << std::endl;
         ImageLayerVector imageLayers;
         DataScanner scanner;
+        scanner.setIndexFile( imageIndex );
         scanner.findImageLayers( imageFolder, extensions, imageLayers );
 
         if ( imageLayers.size() > 0 )
         {
+            // addLayers() opens them all in parallel.
+            LayerVector layers( imageLayers.begin(), imageLayers.end() );
             mapNode->getMap()->beginUpdate();
-            for( ImageLayerVector::iterator i = imageLayers.begin(); i != imageLayers.end(); ++i )
-            {
-                mapNode->getMap()->addLayer( i->get() );
-            }
+            mapNode->getMap()->addLayers( layers );
             mapNode->getMap()->endUpdate();
         }
         OE_INFO << LC << "...found " << imageLayers.size() << " image layers." << std::endl;
@@ -797,9 +809,11 @@ MapNodeHelper::usage() const
         << "  --ortho                       : use an orthographic camera\n"
         << "  --logdepth                    : activates the logarithmic depth buffer\n"
         << "  --logdepth2                   : activates logarithmic depth buffer with per-fragment interpolation\n"
+        << "  --reversez                    : activates a reverse-Z depth buffer\n"
         << "  --shadows                     : activates model layer shadows\n"
         << "  --images [path]               : finds and loads image layers from folder [path]\n"
         << "  --image-extensions [ext,...]  : with --images, extensions to use\n"
+        << "  --image-index [file]          : with --images, caches file metadata in [file]\n"
         << "  --out-earth [file]            : write the loaded map to an earth file\n"
         << "  --uniform [name] [min] [max]  : create a uniform controller with min/max values\n"
         << "  --define [name]               : install a shader #define\n"
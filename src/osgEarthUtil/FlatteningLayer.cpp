@@ -188,6 +188,102 @@ namespace
 
     typedef std::vector<Widths> WidthsList;
     
+    // Number of grid cells along each side of a tile. Each cell covers
+    // about 8x8 samples of a 257x257 heightfield.
+    static const unsigned GRID_CELLS_PER_SIDE = 32u;
+
+    // Computes the location of every heightfield sample in the working SRS.
+    // Samples are stored row by row.
+    void getSamplePoints(const TileKey& key, const osg::HeightField* hf, const SpatialReference* geomSRS, std::vector<POINT>& points)
+    {
+        const GeoExtent& ex = key.getExtent();
+
+        unsigned numCols = hf->getNumColumns();
+        unsigned numRows = hf->getNumRows();
+        double col_interval = ex.width() / (double)(numCols-1);
+        double row_interval = ex.height() / (double)(numRows-1);
+
+        bool needsTransform = ex.getSRS() != geomSRS;
+
+        points.resize(numCols * numRows);
+        for (unsigned row = 0; row < numRows; ++row)
+        {
+            for (unsigned col = 0; col < numCols; ++col)
+            {
+                POINT Pex(ex.xMin() + (double)col * col_interval, ex.yMin() + (double)row * row_interval, 0.0);
+                if (needsTransform)
+                    ex.getSRS()->transform(Pex, geomSRS, points[row*numCols + col]);
+                else
+                    points[row*numCols + col] = Pex;
+            }
+        }
+    }
+
+    // Uniform grid over a tile's sample points. Each item goes in every cell
+    // that its buffered bounds overlap, so a sample only has to look at the
+    // items in its own cell. Each cell keeps its items in insertion order.
+    class SampleGrid
+    {
+    public:
+        SampleGrid(const std::vector<POINT>& points, unsigned cellsPerSide) :
+            _numCols(cellsPerSide),
+            _numRows(cellsPerSide)
+        {
+            _xmin = _ymin = DBL_MAX;
+            _xmax = _ymax = -DBL_MAX;
+            for (unsigned i = 0; i < points.size(); ++i)
+            {
+                _xmin = std::min(_xmin, points[i].x()), _xmax = std::max(_xmax, points[i].x());
+                _ymin = std::min(_ymin, points[i].y()), _ymax = std::max(_ymax, points[i].y());
+            }
+            _cellWidth = _xmax > _xmin ? (_xmax - _xmin) / (double)_numCols : 1.0;
+            _cellHeight = _ymax > _ymin ? (_ymax - _ymin) / (double)_numRows : 1.0;
+            _cells.resize(_numCols * _numRows);
+        }
+
+        void insert(unsigned item, double xmin, double ymin, double xmax, double ymax)
+        {
+            if (xmax < _xmin || xmin > _xmax || ymax < _ymin || ymin > _ymax)
+                return;
+
+            unsigned c0 = col(xmin), c1 = col(xmax);
+            unsigned r0 = row(ymin), r1 = row(ymax);
+            for (unsigned r = r0; r <= r1; ++r)
+                for (unsigned c = c0; c <= c1; ++c)
+                    _cells[r*_numCols + c].push_back(item);
+        }
+
+        const std::vector<unsigned>& get(const POINT& P) const
+        {
+            return _cells[row(P.y())*_numCols + col(P.x())];
+        }
+
+    private:
+        unsigned col(double x) const
+        {
+            return (unsigned)clamp(floor((x - _xmin) / _cellWidth), 0.0, (double)(_numCols-1));
+        }
+
+        unsigned row(double y) const
+        {
+            return (unsigned)clamp(floor((y - _ymin) / _cellHeight), 0.0, (double)(_numRows-1));
+        }
+
+        double   _xmin, _ymin, _xmax, _ymax;
+        double   _cellWidth, _cellHeight;
+        unsigned _numCols, _numRows;
+        std::vector<std::vector<unsigned> > _cells;
+    };
+
+    // A polygon to flatten, with its flattened elevation (found on demand).
+    struct FlatPolygon
+    {
+        const Polygon* polygon;
+        double         bufferWidth;
+        bool           hasElevation;
+        float          elevation;
+    };
+    
     // Creates a heightfield that flattens an area intersecting the input polygon geometry.
     // The height of the area is found by sampling a point internal to the polygon.
     // bufferWidth = width of transition from flat area to natural terrain.
@@ -197,95 +293,107 @@ namespace
     {
         bool wroteChanges = false;
 
-        const GeoExtent& ex = key.getExtent();
+        std::vector<POINT> points;
+        getSamplePoints(key, hf, geomSRS, points);
 
-        double col_interval = ex.width() / (double)(hf->getNumColumns()-1);
-        double row_interval = ex.height() / (double)(hf->getNumRows()-1);
+        // Bucket the polygons, buffered by their transition width. A sample
+        // outside every polygon's buffer keeps its natural elevation.
+        SampleGrid grid(points, GRID_CELLS_PER_SIDE);
+        std::vector<FlatPolygon> polygons;
 
-        POINT Pex, P, internalP;
-
-        bool needsTransform = ex.getSRS() != geomSRS;
-        
-        for (unsigned col = 0; col < hf->getNumColumns(); ++col)
+        for (unsigned int geomIndex = 0; geomIndex < geom->getNumComponents(); geomIndex++)
         {
-            Pex.x() = ex.xMin() + (double)col * col_interval;
-
-            for (unsigned row = 0; row < hf->getNumRows(); ++row)
+            Geometry* component = geom->getComponents()[geomIndex].get();
+            double bufferWidth = widths[geomIndex].bufferWidth;
+            ConstGeometryIterator giter(component, false);
+            while (giter.hasMore())
             {
-                // check for cancelation periodically
-                //if (progress && progress->isCanceled())
-                //    return false;
+                const Polygon* polygon = dynamic_cast<const Polygon*>(giter.next());
+                if (polygon)
+                {
+                    FlatPolygon fp;
+                    fp.polygon = polygon;
+                    fp.bufferWidth = bufferWidth;
+                    fp.hasElevation = false;
+                    fp.elevation = 0.0f;
+
+                    const Bounds& b = polygon->getBounds();
+                    grid.insert(polygons.size(),
+                        b.xMin() - bufferWidth, b.yMin() - bufferWidth,
+                        b.xMax() + bufferWidth, b.yMax() + bufferWidth);
+
+                    polygons.push_back(fp);
+                }
+            }
+        }
 
-                Pex.y() = ex.yMin() + (double)row * row_interval;
+        unsigned numCols = hf->getNumColumns();
 
-                if (needsTransform)
-                    ex.getSRS()->transform(Pex, geomSRS, P);
-                else
-                    P = Pex;
-                
-                bool done = false;
-                double minD2 = DBL_MAX;//bufferWidth * bufferWidth; // minimum distance(squared) to closest polygon edge
-                double bufferWidth = 0.0;
+        for (unsigned row = 0; row < hf->getNumRows(); ++row)
+        {
+            for (unsigned col = 0; col < numCols; ++col)
+            {
+                const POINT& P = points[row*numCols + col];
 
-                const Polygon* bestPoly = 0L;
+                double minD2 = DBL_MAX; // minimum distance(squared) to closest polygon edge
+                FlatPolygon* best = 0L;
 
-                for (unsigned int geomIndex = 0; geomIndex < geom->getNumComponents(); geomIndex++)
+                const std::vector<unsigned>& candidates = grid.get(P);
+                for (unsigned k = 0; k < candidates.size(); ++k)
                 {
-                    Geometry* component = geom->getComponents()[geomIndex].get();
-                    Widths width = widths[geomIndex];
-                    ConstGeometryIterator giter(component, false);
-                    while (giter.hasMore() && !done)
+                    FlatPolygon& fp = polygons[candidates[k]];
+
+                    // Does the point P fall within the polygon?
+                    if (fp.polygon->contains2D(P.x(), P.y()))
                     {
-                        const Polygon* polygon = dynamic_cast<const Polygon*>(giter.next());
-                        if (polygon)
-                        {
-                            // Does the point P fall within the polygon?
-                            if (polygon->contains2D(P.x(), P.y()))
-                            {
-                                // yes, flatten it to the polygon's centroid elevation;
-                                // and we're dont with this point.
-                                done = true;
-                                bestPoly = polygon;
-                                minD2 = -1.0;
-                                bufferWidth = width.bufferWidth;
-                            }
-
-                            // If not in the polygon, how far to the closest edge?
-                            else
-                            {
-                                double D2 = getDistanceSquaredToClosestEdge(P, polygon);
-                                if (D2 < minD2)
-                                {
-                                    minD2 = D2;
-                                    bestPoly = polygon;
-                                    bufferWidth = width.bufferWidth;
-                                }
-                            }
-                        }                    
+                        // yes, flatten it to the polygon's centroid elevation;
+                        // and we're done with this point.
+                        best = &fp;
+                        minD2 = -1.0;
+                        break;
+                    }
+
+                    // If not in the polygon, how far to the closest edge?
+                    double D2 = getDistanceSquaredToClosestEdge(P, fp.polygon);
+                    if (D2 < minD2)
+                    {
+                        minD2 = D2;
+                        best = &fp;
                     }
                 }
 
-                if (bestPoly && minD2 != 0.0)
+                if (best && minD2 != 0.0)
                 {
-                    float h;
-                    POINT internalP = getInternalPoint(bestPoly);
-                    float elevInternal = envelope->getElevation(internalP.x(), internalP.y());
+                    if (!best->hasElevation)
+                    {
+                        POINT internalP = getInternalPoint(best->polygon);
+                        best->elevation = envelope->getElevation(internalP.x(), internalP.y());
+                        best->hasElevation = true;
+                    }
 
+                    float h;
                     if (minD2 < 0.0)
                     {
-                        h = elevInternal;
+                        h = best->elevation;
                     }
                     else
                     {
                         float elevNatural = envelope->getElevation(P.x(), P.y());
-                        double blend = clamp(sqrt(minD2)/bufferWidth, 0.0, 1.0); // [0..1] 0=internal, 1=natural
-                        h = smootherstep(elevInternal, elevNatural, blend);
+                        double blend = clamp(sqrt(minD2)/best->bufferWidth, 0.0, 1.0); // [0..1] 0=internal, 1=natural
+                        h = smootherstep(best->elevation, elevNatural, blend);
                     }
 
                     hf->setHeight(col, row, h);
                     wroteChanges = true;
                 }
 
+                else if (!best && !polygons.empty())
+                {
+                    // Beyond every transition buffer: natural terrain.
+                    hf->setHeight(col, row, envelope->getElevation(P.x(), P.y()));
+                    wroteChanges = true;
+                }
+
                 else if (fillAllPixels)
                 {
                     float h = envelope->getElevation(P.x(), P.y());
@@ -299,7 +407,6 @@ namespace
     }
 
 
-
     struct Sample {
         double D2;      // distance to segment squared
         osg::Vec3d A;   // endpoint of segment
@@ -319,6 +426,15 @@ namespace
 
     typedef std::vector<Sample> Samples;
 
+    // A line segment to flatten around, with the radii of its flat area
+    // and its transition buffer.
+    struct LineSegment
+    {
+        osg::Vec3d A, B;
+        double innerRadius;
+        double outerRadius;
+    };
+
     bool EQ2(const osg::Vec3d& a, const osg::Vec3d& b) {
         return osg::equivalent(a.x(), b.x()) && osg::equivalent(a.y(), b.y());
     }
@@ -392,33 +508,51 @@ namespace
     {
         bool wroteChanges = false;
 
-        const GeoExtent& ex = key.getExtent();
-
-        double col_interval = ex.width() / (double)(hf->getNumColumns()-1);
-        double row_interval = ex.height() / (double)(hf->getNumRows()-1);
+        std::vector<POINT> points;
+        getSamplePoints(key, hf, geomSRS, points);
 
-        osg::Vec3d Pex, P, PROJ;
+        // Bucket every line segment, buffered by its outer radius, so that each
+        // point only measures against the segments that can possibly reach it.
+        SampleGrid grid(points, GRID_CELLS_PER_SIDE);
+        std::vector<LineSegment> segments;
 
-        bool needsTransform = ex.getSRS() != geomSRS;
-        
-        // Loop over the new heightfield.
-        for (unsigned col = 0; col < hf->getNumColumns(); ++col)
+        for (unsigned int geomIndex = 0; geomIndex < geom->getNumComponents(); geomIndex++)
         {
-            Pex.x() = ex.xMin() + (double)col * col_interval;
+            LineSegment seg;
+            seg.innerRadius = widths[geomIndex].lineWidth * 0.5;
+            seg.outerRadius = seg.innerRadius + widths[geomIndex].bufferWidth;
 
-            for (unsigned row = 0; row < hf->getNumRows(); ++row)
+            Geometry* component = geom->getComponents()[geomIndex].get();
+            ConstGeometryIterator giter(component);
+            while (giter.hasMore())
             {
-                // check for cancelation periodically
-                //if (progress && progress->isCanceled())
-                //    return false;
+                const Geometry* part = giter.next();
 
-                Pex.y() = ex.yMin() + (double)row * row_interval;
+                for (unsigned i = 0; i + 1 < part->size(); ++i)
+                {
+                    seg.A = (*part)[i];
+                    seg.B = (*part)[i+1];
 
-                // Move the point into the working SRS if necessary
-                if (needsTransform)
-                    ex.getSRS()->transform(Pex, geomSRS, P);
-                else
-                    P = Pex;
+                    grid.insert(segments.size(),
+                        std::min(seg.A.x(), seg.B.x()) - seg.outerRadius,
+                        std::min(seg.A.y(), seg.B.y()) - seg.outerRadius,
+                        std::max(seg.A.x(), seg.B.x()) + seg.outerRadius,
+                        std::max(seg.A.y(), seg.B.y()) + seg.outerRadius);
+
+                    segments.push_back(seg);
+                }
+            }
+        }
+
+        osg::Vec3d PROJ;
+        unsigned numCols = hf->getNumColumns();
+
+        // Loop over the new heightfield.
+        for (unsigned row = 0; row < hf->getNumRows(); ++row)
+        {
+            for (unsigned col = 0; col < numCols; ++col)
+            {
+                const POINT& P = points[row*numCols + col];
 
                 // For each point, we need to find the closest line segments to that point
                 // because the elevation values on these line segments will be the flattening
@@ -427,93 +561,84 @@ namespace
                 static const unsigned Maxsamples = 4;
                 Samples samples;
 
-                for (unsigned int geomIndex = 0; geomIndex < geom->getNumComponents(); geomIndex++)
+                // Search for line segments.
+                const std::vector<unsigned>& candidates = grid.get(P);
+                for (unsigned k = 0; k < candidates.size(); ++k)
                 {
-                    Widths w = widths[geomIndex];
-                    double innerRadius = w.lineWidth * 0.5;
-                    double outerRadius = innerRadius + w.bufferWidth;
+                    // AB is a candidate line segment:
+                    const LineSegment& seg = segments[candidates[k]];
+                    const osg::Vec3d& A = seg.A;
+                    const osg::Vec3d& B = seg.B;
+                    double innerRadius = seg.innerRadius;
+                    double outerRadius = seg.outerRadius;
                     double outerRadius2 = outerRadius * outerRadius;
 
-                    Geometry* component = geom->getComponents()[geomIndex].get();
-                    // Search for line segments.
-                    ConstGeometryIterator giter(component);
-                    while (giter.hasMore())
+                    osg::Vec3d AB = B - A;    // current segment AB
+
+                    double t;                 // parameter [0..1] on segment AB
+                    double D2;                // shortest distance from point P to segment AB, squared
+                    double L2 = AB.length2(); // length (squared) of segment AB
+                    osg::Vec3d AP = P - A;    // vector from endpoint A to point P
+
+                    if (L2 == 0.0)
+                    {
+                        // trivial case: zero-length segment
+                        t = 0.0;
+                        D2 = AP.length2();
+                    }
+                    else
                     {
-                        const Geometry* part = giter.next();                        
+                        // Calculate parameter "t" [0..1] which will yield the closest point on AB to P.
+                        // Clamping it means the closest point won't be beyond the endpoints of the segment.
+                        t = clamp((AP * AB)/L2, 0.0, 1.0);
 
-                        for (int i = 0; i < part->size()-1; ++i)
+                        // project our point P onto segment AB:
+                        PROJ.set( A + AB*t );
+
+                        // measure the distance (squared) from P to the projected point on AB:
+                        D2 = (P - PROJ).length2();
+                    }
+
+                    // If the distance from our point to the line segment falls within
+                    // the maximum flattening distance, store it.
+                    if (D2 <= outerRadius2)
+                    {
+                        // see if P is a new sample.
+                        Sample* b;
+                        if (samples.size() < Maxsamples)
                         {
-                            // AB is a candidate line segment:
-                            const osg::Vec3d& A = (*part)[i];
-                            const osg::Vec3d& B = (*part)[i+1];
-
-                            osg::Vec3d AB = B - A;    // current segment AB
-
-                            double t;                 // parameter [0..1] on segment AB
-                            double D2;                // shortest distance from point P to segment AB, squared
-                            double L2 = AB.length2(); // length (squared) of segment AB
-                            osg::Vec3d AP = P - A;    // vector from endpoint A to point P
-
-                            if (L2 == 0.0)
-                            {
-                                // trivial case: zero-length segment
-                                t = 0.0;
-                                D2 = AP.length2();
-                            }
-                            else
-                            {
-                                // Calculate parameter "t" [0..1] which will yield the closest point on AB to P.
-                                // Clamping it means the closest point won't be beyond the endpoints of the segment.
-                                t = clamp((AP * AB)/L2, 0.0, 1.0);
-
-                                // project our point P onto segment AB:
-                                PROJ.set( A + AB*t );
-
-                                // measure the distance (squared) from P to the projected point on AB:
-                                D2 = (P - PROJ).length2();
-                            }
-
-                            // If the distance from our point to the line segment falls within
-                            // the maximum flattening distance, store it.
-                            if (D2 <= outerRadius2)
-                            {
-                                // see if P is a new sample.
-                                Sample* b;
-                                if (samples.size() < Maxsamples)
-                                {
-                                    // If we haven't collected the maximum number of samples yet,
-                                    // just add this to the list:
-                                    samples.push_back(Sample());
-                                    b = &samples.back();
-                                }
-                                else
-                                {
-                                    // If we are maxed out on samples, find the farthest one we have so far
-                                    // and replace it if the new point is closer:
-                                    unsigned max_i = 0;
-                                    for (unsigned i=1; i<samples.size(); ++i)
-                                        if (samples[i].D2 > samples[max_i].D2)
-                                            max_i = i;
-
-                                    b = &samples[max_i];
-
-                                    if (b->D2 < D2)
-                                        b = 0L;
-                                }
-
-                                if (b)
-                                {
-                                    b->D2 = D2;
-                                    b->A = A;
-                                    b->B = B;
-                                    b->T = t;
-                                    b->innerRadius = innerRadius;
-                                    b->outerRadius = outerRadius;
-                                }
-                            }
+                            // If we haven't collected the maximum number of samples yet,
+                            // just add this to the list:
+                            samples.push_back(Sample());
+                            b = &samples.back();
+                        }
+                        else
+                        {
+                            // If we are maxed out on samples, find the farthest one we have so far
+                            // and replace it if the new point is closer:
+                            unsigned max_i = 0;
+                            for (unsigned i=1; i<samples.size(); ++i)
+                                if (samples[i].D2 > samples[max_i].D2)
+                                    max_i = i;
+
+                            b = &samples[max_i];
+
+                            if (b->D2 < D2)
+                                b = 0L;
+                        }
+
+                        if (b)
+                        {
+                            b->D2 = D2;
+                            b->A = A;
+                            b->B = B;
+                            b->T = t;
+                            b->innerRadius = innerRadius;
+                            b->outerRadius = outerRadius;
                         }
                     }
                 }
+                }
 
                 // Remove unnecessary sample points that lie on the endpoint of a segment
                 // that abuts another segment in our list.
@@ -17,11 +17,14 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include <osgEarthUtil/GARSGraticule>
-#include <osgEarthAnnotation/FeatureNode>
+#include <osgEarthUtil/Shaders>
 #include <osgEarthFeatures/TextSymbolizer>
 #include <osgEarth/PagedNode>
 #include <osgEarth/GLUtils>
 #include <osgEarth/Text>
+#include <osgEarth/MapNodeObserver>
+#include <osgEarth/TerrainEngineNode>
+#include <osgEarth/VirtualProgram>
 
 using namespace osgEarth;
 using namespace osgEarth::Util;
@@ -33,8 +36,31 @@ using namespace osgEarth::Symbology;
 #define GL_CLIP_DISTANCE0 0x3000
 #endif
 
+#define COLOR_UNIFORM "oe_GARSGraticule_color"
+#define WIDTH_UNIFORM "oe_GARSGraticule_lineWidth"
+
 namespace
 {
+    // Root of the label graph; the map node finds it when the layer is added
+    // and hands itself over so the grid line shader can go on the terrain.
+    struct GARSRoot : public osg::Group, public MapNodeObserver
+    {
+        GARSRoot(GARSGraticule* graticule) : _graticule(graticule) { }
+
+        void setMapNode(MapNode* mapNode)
+        {
+            _mapNode = mapNode;
+            osg::ref_ptr<GARSGraticule> graticule;
+            if (_graticule.lock(graticule))
+                graticule->setMapNode(mapNode);
+        }
+
+        MapNode* getMapNode() { return _mapNode.get(); }
+
+        osg::observer_ptr<GARSGraticule> _graticule;
+        osg::observer_ptr<MapNode>       _mapNode;
+    };
+
     osg::BoundingSphere getBounds(const GeoExtent& extent)
     {
         int samples = 6;
@@ -176,24 +202,12 @@ namespace
 
     void GridNode::build()
     { 
-        Feature* feature = new Feature(new LineString(5), SpatialReference::create("wgs84"));
-        feature->getGeometry()->push_back(_extent.west(), _extent.south(), 0.0);
-        feature->getGeometry()->push_back(_extent.east(), _extent.south(), 0.0);
-        feature->getGeometry()->push_back(_extent.east(), _extent.north(), 0.0);
-        feature->getGeometry()->push_back(_extent.west(), _extent.north(), 0.0);
-        feature->getGeometry()->push_back(_extent.west(), _extent.south(), 0.0);    
-        FeatureList features;
-        features.push_back(feature);
-
+        // The cell outline comes from the terrain shader; only the label is geometry.
         Style style = _graticule->options().style().get();
 
         double lon, lat;
         _extent.getCentroid(lon, lat);
         std::string label = getGARSLabel(lon, lat, _level);
-    
-        FeatureNode* featureNode = new FeatureNode(features, style);
-        // Add the node to the attachpoint.
-        _attachPoint->addChild(featureNode);
        
         GeoPoint centroid(_extent.getSRS(), lon, lat, 0.0f);
         GeoPoint ll(_extent.getSRS(), _extent.west(), _extent.south(), 0.0f);
@@ -342,12 +356,7 @@ GARSGraticule::init()
         options().style()->getOrCreateSymbol<LineSymbol>()->tessellation() = 10;
     }
 
-    // Always use draping.
-    // Note: since we use draping we do NOT need to activate a horizon clip plane!
-    options().style()->getOrCreateSymbol<AltitudeSymbol>()->clamping() = AltitudeSymbol::CLAMP_TO_TERRAIN;
-    options().style()->getOrCreateSymbol<AltitudeSymbol>()->technique() = AltitudeSymbol::TECHNIQUE_DRAPE;
-
-    _root = new osg::Group();
+    _root = new GARSRoot(this);
     _root->getOrCreateStateSet()->setAttribute(new osg::Program(), osg::StateAttribute::OFF);
 
     if (getEnabled() == true)
@@ -365,7 +374,73 @@ GARSGraticule::addedToMap(const Map* map)
 void
 GARSGraticule::removedFromMap(const Map* map)
 {
-    //nop
+    removeEffect();
+    _mapNode = 0L;
+}
+
+void
+GARSGraticule::setMapNode(MapNode* mapNode)
+{
+    if (mapNode == _mapNode.get())
+        return;
+
+    removeEffect();
+    _mapNode = mapNode;
+
+    if (getVisible())
+        installEffect();
+}
+
+void
+GARSGraticule::setVisible(bool value)
+{
+    VisibleLayer::setVisible(value);
+
+    if (value)
+        installEffect();
+    else
+        removeEffect();
+}
+
+void
+GARSGraticule::installEffect()
+{
+    osg::ref_ptr<MapNode> mapNode;
+    if (!_mapNode.lock(mapNode))
+        return;
+
+    osg::StateSet* stateset = mapNode->getTerrainEngine()->getSurfaceStateSet();
+    VirtualProgram* vp = VirtualProgram::getOrCreate(stateset);
+
+    Shaders package;
+    package.load(vp, package.GARSGraticule_Vertex);
+    package.load(vp, package.GARSGraticule_Fragment);
+
+    const LineSymbol* line = options().style()->get<LineSymbol>();
+    Color color = line && line->stroke().isSet() ? line->stroke()->color() : Color::Blue;
+    float width = line && line->stroke().isSet() && line->stroke()->width().isSet() ? line->stroke()->width().get() : 1.0f;
+
+    stateset->getOrCreateUniform(COLOR_UNIFORM, osg::Uniform::FLOAT_VEC4)->set(color);
+    stateset->getOrCreateUniform(WIDTH_UNIFORM, osg::Uniform::FLOAT)->set(width);
+}
+
+void
+GARSGraticule::removeEffect()
+{
+    osg::ref_ptr<MapNode> mapNode;
+    if (!_mapNode.lock(mapNode))
+        return;
+
+    osg::StateSet* stateset = mapNode->getTerrainEngine()->getSurfaceStateSet();
+    VirtualProgram* vp = VirtualProgram::get(stateset);
+    if (vp)
+    {
+        Shaders package;
+        package.unload(vp, package.GARSGraticule_Vertex);
+        package.unload(vp, package.GARSGraticule_Fragment);
+    }
+    stateset->removeUniform(COLOR_UNIFORM);
+    stateset->removeUniform(WIDTH_UNIFORM);
 }
 
 osg::Node*
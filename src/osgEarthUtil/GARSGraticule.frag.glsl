@@ -0,0 +1,38 @@
+#version $GLSL_VERSION_STR
+$GLSL_DEFAULT_PRECISION_FLOAT
+
+#pragma vp_entryPoint oe_GARSGraticule_fragment
+#pragma vp_location   fragment_lighting
+#pragma vp_order      1.1
+
+uniform vec4  oe_GARSGraticule_color;
+uniform float oe_GARSGraticule_lineWidth;
+
+in vec2 oe_GARSGraticule_coord;
+
+// Coverage of the lines spaced "spacing" degrees apart, faded out as the
+// cells shrink below a few pixels across.
+float oe_GARSGraticule_lines(in float spacing, in vec2 dF)
+{
+    vec2 d = mod(oe_GARSGraticule_coord, spacing);
+    d = min(d, spacing - d);
+    vec2 w = dF * oe_GARSGraticule_lineWidth;
+    vec2 cov = 1.0 - clamp(d/w, 0.0, 1.0);
+
+    float cellPixels = spacing / max(dF.x, dF.y);
+    return max(cov.x, cov.y) * clamp((cellPixels - 8.0)/8.0, 0.0, 1.0);
+}
+
+void oe_GARSGraticule_fragment(inout vec4 color)
+{
+    vec2 dx = abs(dFdx(oe_GARSGraticule_coord));
+    vec2 dy = abs(dFdy(oe_GARSGraticule_coord));
+    vec2 dF = max(dx, dy);
+
+    // the 30-minute cells, 15-minute quadrants and 5-minute keypads:
+    float a = max(
+        oe_GARSGraticule_lines(0.5, dF),
+        max(oe_GARSGraticule_lines(0.25, dF), oe_GARSGraticule_lines(5.0/60.0, dF)));
+
+    color.rgb = mix(color.rgb, oe_GARSGraticule_color.rgb, oe_GARSGraticule_color.a * a);
+}
@@ -0,0 +1,16 @@
+#version $GLSL_VERSION_STR
+
+#pragma vp_entryPoint oe_GARSGraticule_vertex
+#pragma vp_location   vertex_view
+#pragma vp_order      0.5
+
+uniform vec4 oe_tile_key;
+out vec4 oe_layer_tilec;
+out vec2 oe_GARSGraticule_coord;
+
+void oe_GARSGraticule_vertex(inout vec4 vertex)
+{
+    // degrees east of -180 and north of -90:
+    vec2 r = (oe_tile_key.xy + oe_layer_tilec.xy)/exp2(oe_tile_key.z);
+    oe_GARSGraticule_coord = r * 180.0;
+}
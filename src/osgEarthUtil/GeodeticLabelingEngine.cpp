@@ -88,9 +88,7 @@ GeodeticLabelingEngine::updateLabels(const osg::Vec3d& LL_world, osg::Vec3d& UL_
         GeoPoint p(wgs84, -180.0 + (double)i * resDegrees, minLat, 0, ALTMODE_ABSOLUTE);
         std::string text = getText(p, false);
         window.clampToBottom(p); // also xforms to geographic
-        data.xLabels[xi]->setPosition(p);
-        data.xLabels[xi]->setText(text);
-        data.xLabels[xi]->setNodeMask(~0);
+        showLabel(data.xLabels[xi].get(), p, text);
         xi++;
         if (xi >= data.xLabels.size()) break;
     }
@@ -101,9 +99,7 @@ GeodeticLabelingEngine::updateLabels(const osg::Vec3d& LL_world, osg::Vec3d& UL_
         GeoPoint p(wgs84, minLon, -90.0 + (double)i * resDegrees, 0, ALTMODE_ABSOLUTE);
         std::string text = getText(p, true);
         window.clampToLeft(p); // also xforms to geographic
-        data.yLabels[yi]->setPosition(p);
-        data.yLabels[yi]->setText(text);
-        data.yLabels[yi]->setNodeMask(~0);
+        showLabel(data.yLabels[yi].get(), p, text);
         yi++;
         if (yi >= data.yLabels.size()) break;
     }
@@ -64,7 +64,9 @@ namespace
 
 //........................................................................
 
-GraticuleLabelingEngine::GraticuleLabelingEngine(const SpatialReference* srs)
+GraticuleLabelingEngine::GraticuleLabelingEngine(const SpatialReference* srs) :
+_motionThreshold(0.002),
+_updateFrame(~0u)
 {
     _srs = srs;
 
@@ -87,6 +89,52 @@ bool GraticuleLabelingEngine::getVisible(osg::Camera* camera)
     return data.visible;
 }
 
+void
+GraticuleLabelingEngine::setMotionThreshold(double value)
+{
+    _motionThreshold = osg::maximum(value, 0.0);
+}
+
+bool
+GraticuleLabelingEngine::needsUpdate(const osg::Matrixd& MVP, const CameraData& data) const
+{
+    if (!data.cached)
+        return true;
+
+    // Compare where the corners of the last view land on screen now:
+    for (unsigned i = 0; i < 3; ++i)
+    {
+        osg::Vec3d a = data.corners[i] * data.MVP;
+        osg::Vec3d b = data.corners[i] * MVP;
+        if (fabs(a.x() - b.x()) > _motionThreshold ||
+            fabs(a.y() - b.y()) > _motionThreshold ||
+            fabs(a.z() - b.z()) > _motionThreshold)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool
+GraticuleLabelingEngine::claimUpdate(unsigned frame)
+{
+    Threading::ScopedMutexLock lock(_updateMutex);
+    if (_updateFrame == frame)
+        return false;
+    _updateFrame = frame;
+    return true;
+}
+
+void
+GraticuleLabelingEngine::showLabel(LabelNode* label, const GeoPoint& position, const std::string& text)
+{
+    label->setPosition(position);
+    if (label->getText() != text)
+        label->setText(text);
+    label->setNodeMask(~0);
+}
+
 void
 GraticuleLabelingEngine::AcceptCameraData::operator()(GraticuleLabelingEngine::CameraData& data)
 {
@@ -131,10 +179,25 @@ GraticuleLabelingEngine::cullTraverse(osgUtil::CullVisitor& nv, CameraData& data
 {    
     osg::Camera* cam = nv.getCurrentCamera();
 
+    osg::Matrix MVP = (*nv.getModelViewMatrix()) * cam->getProjectionMatrix();
+
+    // If the view has barely moved since the last update, the labels
+    // (and their visibility) from that update still apply.
+    if (!needsUpdate(MVP, data))
+        return data.visible;
+
+    // Only one camera recalculates per frame; the others keep last frame's
+    // labels until their turn comes.
+    if (data.cached && nv.getFrameStamp() && !claimUpdate(nv.getFrameStamp()->getFrameNumber()))
+        return data.visible;
+
     // Don't draw the labels if we are too far from North-Up:
     double heading = getCameraHeading(cam->getViewMatrix());
     if (osg::RadiansToDegrees(fabs(heading)) > 7.0)
+    {
+        data.cached = false;
         return false;
+    }
 
     // Initialize the label pool for this camera if we have not done so:
     if (data.xLabels.empty())
@@ -173,7 +236,6 @@ GraticuleLabelingEngine::cullTraverse(osgUtil::CullVisitor& nv, CameraData& data
     // for displaying the extent of the current view.
 
     // Calculate the "clip to world" matrix = MVPinv.
-    osg::Matrix MVP = (*nv.getModelViewMatrix()) * cam->getProjectionMatrix();
     osg::Matrix MVPinv;
     MVPinv.invert(MVP);
 
@@ -189,7 +251,10 @@ GraticuleLabelingEngine::cullTraverse(osgUtil::CullVisitor& nv, CameraData& data
     p1 = osg::Vec3d(-1, -1, +1) * MVPinv;
     bool LL_ok = ellipsoid.intersectLine(p0, p1, LL_world);
     if (!LL_ok)
+    {
+        data.cached = false;
         return false;
+    }
 
     // find the upper-left corner of the frustum:
     osg::Vec3d UL_world;
@@ -197,7 +262,10 @@ GraticuleLabelingEngine::cullTraverse(osgUtil::CullVisitor& nv, CameraData& data
     p1 = osg::Vec3d(-1, +1, +1) * MVPinv;
     bool UL_ok = ellipsoid.intersectLine(p0, p1, UL_world);
     if (!UL_ok)
+    {
+        data.cached = false;
         return false;
+    }
 
     // find the lower-right corner of the frustum:
     osg::Vec3d LR_world;
@@ -205,12 +273,23 @@ GraticuleLabelingEngine::cullTraverse(osgUtil::CullVisitor& nv, CameraData& data
     p1 = osg::Vec3d(+1, -1, +1) * MVPinv;
     bool LR_ok = ellipsoid.intersectLine(p0, p1, LR_world);
     if (!LR_ok)
+    {
+        data.cached = false;
         return false;
+    }
 
     // Use this for clamping geopoints to the edges of the frustum:
     ClipSpace window(MVP, MVPinv);
 
-    return updateLabels(LL_world, UL_world, LR_world, window, data);
+    bool visible = updateLabels(LL_world, UL_world, LR_world, window, data);
+
+    data.MVP = MVP;
+    data.corners[0] = LL_world;
+    data.corners[1] = UL_world;
+    data.corners[2] = LR_world;
+    data.cached = true;
+
+    return visible;
 }
 
 bool GraticuleLabelingEngine::updateLabels(const osg::Vec3d& LL_world, osg::Vec3d& UL_world, osg::Vec3d& LR_world, ClipSpace& clipSpace, CameraData& data)
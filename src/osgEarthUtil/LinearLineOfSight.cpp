@@ -22,10 +22,72 @@
 #include <osgEarthUtil/LinearLineOfSight>
 #include <osgEarth/TerrainEngineNode>
 #include <osgEarth/GLUtils>
+#include <osgEarth/ElevationPool>
+#include <osgEarth/GeoMath>
+#include <osgEarth/Registry>
 
 using namespace osgEarth;
 using namespace osgEarth::Util;
 
+struct LinearLineOfSightNode::PublishOperation : public osg::Operation
+{
+    PublishOperation(LinearLineOfSightNode* los, unsigned generation) :
+        osg::Operation("LinearLineOfSight", false),
+        _los(los), _generation(generation), _hasLOS(true) { }
+
+    void operator()(osg::Object*)
+    {
+        osg::ref_ptr<LinearLineOfSightNode> los;
+        if (_los.lock(los))
+            los->publish(_generation, _start, _end, _hasLOS, _hit);
+    }
+
+    osg::observer_ptr<LinearLineOfSightNode> _los;
+    unsigned   _generation;
+    osg::Vec3d _start, _end, _hit; // map coordinates, absolute
+    bool       _hasLOS;
+};
+
+struct LinearLineOfSightNode::IntersectTask : public TaskRequest
+{
+    void operator()(ProgressCallback* progress)
+    {
+        osg::ref_ptr<ElevationPool> pool;
+        osg::ref_ptr<Terrain> terrain;
+        if (!_pool.lock(pool) || !_terrain.lock(terrain))
+            return;
+
+        osg::ref_ptr<ElevationEnvelope> envelope = pool->createEnvelope(_srs.get(), _lod);
+
+        // Resolve terrain-relative end points against the same data:
+        osg::Vec3d& start = _publish->_start;
+        osg::Vec3d& end   = _publish->_end;
+        if (_startRelative || _endRelative)
+        {
+            double x[2] = { start.x(), end.x() };
+            double y[2] = { start.y(), end.y() };
+            float  z[2];
+            envelope->getElevations(x, y, 2u, 1u, z);
+            if (_startRelative && z[0] != NO_DATA_VALUE) start.z() += z[0];
+            if (_endRelative   && z[1] != NO_DATA_VALUE) end.z()   += z[1];
+        }
+
+        _publish->_hasLOS = !envelope->intersect(start, end, _publish->_hit);
+
+        if (progress && progress->isCanceled())
+            return;
+
+        terrain->queueUpdateOperation(_publish.get());
+    }
+
+    osg::observer_ptr<ElevationPool>     _pool;
+    osg::observer_ptr<Terrain>           _terrain;
+    osg::ref_ptr<const SpatialReference> _srs;
+    unsigned                             _lod;
+    bool                                 _startRelative, _endRelative;
+    osg::ref_ptr<PublishOperation>       _publish;
+};
+
 namespace
 {
     class TerrainChangedCallback : public osgEarth::TerrainCallback
@@ -80,7 +142,9 @@ _hasLOS( true ),
 _goodColor(0.0f, 1.0f, 0.0f, 1.0f),
 _badColor(1.0f, 0.0f, 0.0f, 1.0f),
 _displayMode( LineOfSight::MODE_SPLIT ),
-_terrainOnly( false )
+_terrainOnly( false ),
+_generation( 0u ),
+_jobs( new JobGroup() )
 {
     compute(getNode());
     subscribeToTerrain();    
@@ -98,7 +162,9 @@ _hasLOS( true ),
 _goodColor(0.0f, 1.0f, 0.0f, 1.0f),
 _badColor(1.0f, 0.0f, 0.0f, 1.0f),
 _displayMode( LineOfSight::MODE_SPLIT ),
-_terrainOnly( false )
+_terrainOnly( false ),
+_generation( 0u ),
+_jobs( new JobGroup() )
 {
     compute(getNode());    
     subscribeToTerrain();    
@@ -116,6 +182,7 @@ LinearLineOfSightNode::~LinearLineOfSightNode()
 {
     //Unsubscribe to the terrain callback
     setMapNode( 0L );
+    _jobs->cancel();
 }
 
 void
@@ -147,6 +214,16 @@ LinearLineOfSightNode::setMapNode( MapNode* mapNode )
 void
 LinearLineOfSightNode::terrainChanged( const osgEarth::TileKey& tileKey, osg::Node* terrain )
 {
+    // Tiles that don't overlap the line can't change the result:
+    if ( _extent.isValid() && !tileKey.getExtent().intersects(_extent) )
+        return;
+
+    // In terrain-only mode the result comes from the map's elevation data
+    // rather than the tiles, so it only changes when that data does:
+    if ( _terrainOnly && _extent.isValid() && getMapNode() &&
+         _revision == getMapNode()->getMap()->getDataModelRevision() )
+        return;
+
     compute( getNode() );
 }
 
@@ -239,17 +316,33 @@ LinearLineOfSightNode::compute(osg::Node* node, bool backgroundThread)
         return;          
     }
 
+    // supersedes anything still in flight:
+    ++_generation;
+    _extent = GeoExtent::INVALID;
+
     if (_start != _end)
     {
       const SpatialReference* mapSRS = getMapNode()->getMapSRS();
       const Terrain* terrain = getMapNode()->getTerrain();
 
+      if (_terrainOnly)
+      {
+          computeAsync();
+          return;
+      }
+
       //Computes the LOS and redraws the scene      
       if (!_start.transform(mapSRS).toWorld( _startWorld, terrain ) || !_end.transform(mapSRS).toWorld( _endWorld, terrain ))
       {
           return;
       }
 
+      GeoPoint startMap = _start.transform(mapSRS), endMap = _end.transform(mapSRS);
+      _extent = GeoExtent(mapSRS);
+      _extent.expandToInclude(startMap.x(), startMap.y());
+      _extent.expandToInclude(endMap.x(), endMap.y());
+      _revision = getMapNode()->getMap()->getDataModelRevision();
+
 
       osgUtil::LineSegmentIntersector* lsi = new osgUtil::LineSegmentIntersector(_startWorld, _endWorld);
       osgUtil::IntersectionVisitor iv( lsi );
@@ -277,6 +370,69 @@ LinearLineOfSightNode::compute(osg::Node* node, bool backgroundThread)
     }	
 }
 
+void
+LinearLineOfSightNode::computeAsync()
+{
+    const Map* map = getMapNode()->getMap();
+    const SpatialReference* mapSRS = map->getSRS();
+
+    GeoPoint start = _start.transform(mapSRS);
+    GeoPoint end   = _end.transform(mapSRS);
+    if (!start.isValid() || !end.isValid())
+        return;
+
+    _extent = GeoExtent(mapSRS);
+    _extent.expandToInclude(start.x(), start.y());
+    _extent.expandToInclude(end.x(), end.y());
+    _revision = map->getDataModelRevision();
+
+    IntersectTask* task = new IntersectTask();
+    task->_pool    = map->getElevationPool();
+    task->_terrain = getMapNode()->getTerrain();
+    task->_srs     = mapSRS;
+
+    // Sample at about a thousand posts along the line:
+    double length = GeoMath::distance(start.vec3d(), end.vec3d(), mapSRS);
+    double resolution = length / 1024.0;
+    if (mapSRS->isGeographic())
+        resolution /= (mapSRS->getEllipsoid()->getRadiusEquator() * osg::PI / 180.0);
+    task->_lod = map->getProfile()->getLevelOfDetailForHorizResolution(resolution, map->getElevationPool()->getTileSize());
+
+    task->_startRelative = start.altitudeMode() == ALTMODE_RELATIVE;
+    task->_endRelative   = end.altitudeMode() == ALTMODE_RELATIVE;
+    task->_publish = new PublishOperation(this, _generation);
+    task->_publish->_start = start.vec3d();
+    task->_publish->_end   = end.vec3d();
+
+    Registry::instance()->getJobScheduler()->submit(task, JobScheduler::LANE_NORMAL, _jobs.get());
+}
+
+void
+LinearLineOfSightNode::publish(unsigned generation, const osg::Vec3d& start, const osg::Vec3d& end, bool hasLOS, const osg::Vec3d& hit)
+{
+    // result for end points (or a map) that have since changed:
+    if (generation != _generation || !getMapNode())
+        return;
+
+    const SpatialReference* mapSRS = getMapNode()->getMapSRS();
+    mapSRS->transformToWorld(start, _startWorld);
+    mapSRS->transformToWorld(end, _endWorld);
+
+    _hasLOS = hasLOS;
+    if (!_hasLOS)
+    {
+        _hit.set(mapSRS, hit, ALTMODE_ABSOLUTE);
+        mapSRS->transformToWorld(hit, _hitWorld);
+    }
+
+    draw();
+
+    for( LOSChangedCallbackList::iterator i = _changedCallbacks.begin(); i != _changedCallbacks.end(); i++ )
+    {
+        i->get()->onChanged();
+    }
+}
+
 void
 LinearLineOfSightNode::draw(bool backgroundThread)
 {
@@ -17,6 +17,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include <osgEarthUtil/MultiElevationLayer>
+#include <algorithm>
 
 using namespace osgEarth;
 using namespace osgEarth::Util;
@@ -114,8 +115,6 @@ MultiElevationLayer::open()
                 }
 
                 _layers.push_back(elayer);
-
-                //TODO: establish the data extents
             }
             else
             {
@@ -125,6 +124,56 @@ MultiElevationLayer::open()
         }
     }
 
+    // Index the children's data extents so that each key only visits the
+    // children that can contribute to it. A child without extents covers
+    // the entire profile. If every child has extents, their union becomes
+    // this layer's data extents.
+    _coverage.clear();
+    if (getProfile())
+    {
+        const SpatialReference* srs = getProfile()->getSRS();
+        bool allHaveExtents = !_layers.empty();
+        DataExtentList combined;
+
+        for (unsigned i = 0; i < _layers.size(); ++i)
+        {
+            const DataExtentList& extents = _layers[i]->getDataExtents();
+            if (extents.empty())
+            {
+                Coverage c;
+                c.extent = getProfile()->getExtent();
+                c.minLevel = 0u;
+                c.maxLevel = ~0u;
+                c.layer = i;
+                _coverage.push_back(c);
+                allHaveExtents = false;
+                continue;
+            }
+
+            for (DataExtentList::const_iterator de = extents.begin(); de != extents.end(); ++de)
+            {
+                Coverage c;
+                c.extent = de->transform(srs);
+                c.minLevel = de->minLevel().isSet() ? de->minLevel().get() : 0u;
+                c.maxLevel = de->maxLevel().isSet() ? de->maxLevel().get() : ~0u;
+                c.layer = i;
+                if (c.extent.isValid())
+                {
+                    _coverage.push_back(c);
+                    combined.push_back(*de);
+                }
+            }
+        }
+
+        if (allHaveExtents)
+        {
+            dataExtents() = combined;
+            dirtyDataExtents();
+        }
+
+        OE_INFO << LC << "Indexed " << _coverage.size() << " data extents from " << _layers.size() << " layers\n";
+    }
+
     return ElevationLayer::open();
 }
 
@@ -146,12 +195,58 @@ MultiElevationLayer::removedFromMap(const Map* map)
     }
 }
 
+void
+MultiElevationLayer::getCandidates(const TileKey& key, ElevationLayerVector& out, int& out_firstFull) const
+{
+    std::vector<bool> touches(_layers.size(), false);
+    std::vector<bool> covers(_layers.size(), false);
+
+    const GeoExtent& keyExtent = key.getExtent();
+    unsigned lod = key.getLOD();
+
+    for (std::vector<Coverage>::const_iterator c = _coverage.begin(); c != _coverage.end(); ++c)
+    {
+        if (lod >= c->minLevel && c->extent.intersects(keyExtent, false))
+        {
+            touches[c->layer] = true;
+            if (lod <= c->maxLevel && c->extent.contains(keyExtent))
+                covers[c->layer] = true;
+        }
+    }
+
+    out_firstFull = -1;
+    for (unsigned i = 0; i < _layers.size(); ++i)
+    {
+        if (touches[i])
+        {
+            if (covers[i] && !_layers[i]->isOffset())
+                out_firstFull = out.size();
+            out.push_back(_layers[i].get());
+        }
+    }
+}
+
 void
 MultiElevationLayer::createImplementation(const TileKey& key,
                                           osg::ref_ptr<osg::HeightField>& out_heightField,
                                           osg::ref_ptr<NormalMap>& out_normalMap,
                                           ProgressCallback* progress)
 {
+    ElevationLayerVector candidates;
+    int firstFull;
+    getCandidates(key, candidates, firstFull);
+
+    if (candidates.empty())
+    {
+        out_heightField = 0L;
+        out_normalMap = 0L;
+        return;
+    }
+
+    // Only a heightfield we initialize to NO DATA can tell us whether
+    // the first pass resolved every sample.
+    bool canStopEarly = firstFull > 0 && !out_heightField.valid();
+
     if (!out_heightField.valid())
     {
         out_heightField = new osg::HeightField();
@@ -161,8 +256,42 @@ MultiElevationLayer::createImplementation(const TileKey& key,
         out_normalMap = new NormalMap(257, 257);
     }
 
+    bool realData = false;
+
+    // First try only the children at or above the highest-priority child
+    // that covers the whole key. If that leaves no holes, the rest
+    // would never be sampled, so don't ask them.
+    if (canStopEarly)
+    {
+        ElevationLayerVector top;
+        for (unsigned i = firstFull; i < candidates.size(); ++i)
+            top.push_back(candidates[i].get());
+
+        realData = top.populateHeightFieldAndNormalMap(
+            out_heightField.get(),
+            out_normalMap.get(),
+            key,
+            0L,
+            INTERP_BILINEAR,
+            progress);
+
+        if (realData)
+        {
+            const osg::FloatArray* heights = out_heightField->getFloatArray();
+            if (std::find(heights->begin(), heights->end(), NO_DATA_VALUE) == heights->end())
+                return;
+        }
+
+        if (progress && progress->isCanceled())
+        {
+            out_heightField = 0L;
+            out_normalMap = 0L;
+            return;
+        }
+    }
+
     // Populate the heightfield and return it if it's valid
-    bool realData = _layers.populateHeightFieldAndNormalMap(
+    realData = candidates.populateHeightFieldAndNormalMap(
         out_heightField.get(),
         out_normalMap.get(),
         key,
@@ -17,17 +17,37 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include <osgEarthUtil/RTTPicker>
+#include <osgEarthUtil/ReverseZDepthBuffer>
 #include <osgEarth/ImageUtils>
 #include <osgEarth/Registry>
 #include <osgEarth/GLUtils>
 
 #include <osg/BlendFunc>
+#include <osg/GLExtensions>
+#include <set>
 
 using namespace osgEarth;
 using namespace osgEarth::Util;
 
 #define LC "[RTTPicker] "
 
+#ifndef GL_PIXEL_PACK_BUFFER
+#define GL_PIXEL_PACK_BUFFER 0x88EB
+#endif
+#ifndef GL_SYNC_GPU_COMMANDS_COMPLETE
+#define GL_SYNC_GPU_COMMANDS_COMPLETE 0x9117
+#endif
+#ifndef GL_ALREADY_SIGNALED
+#define GL_ALREADY_SIGNALED 0x911A
+#endif
+#ifndef GL_CONDITION_SATISFIED
+#define GL_CONDITION_SATISFIED 0x911C
+#endif
+
+// How many frames an asynchronous pick waits for a readback before
+// giving up and reporting a miss.
+#define MAX_ASYNC_PICK_FRAMES 8u
+
 namespace
 {
     // Callback to set the "far plane" uniform just before drawing.
@@ -101,6 +121,118 @@ namespace
         "} \n";
 }
 
+RTTPicker::AsyncReadback::AsyncReadback(osg::Image* image, osg::Texture2D* texture) :
+_image(image),
+_texture(texture),
+_resultFrame(0u)
+{
+    //nop
+}
+
+void
+RTTPicker::AsyncReadback::operator()(osg::RenderInfo& ri) const
+{
+    osg::State* state = ri.getState();
+    unsigned contextID = state->getContextID();
+    unsigned frame = state->getFrameStamp() ? state->getFrameStamp()->getFrameNumber() : 0u;
+
+    osg::GLExtensions* ext = osg::GLExtensions::Get(contextID, true);
+    osg::Texture::TextureObject* to = _texture->getTextureObject(contextID);
+    if (!to || !ext)
+        return;
+
+    unsigned imageBytes = _image->getTotalSizeInBytes();
+
+    if (!ext->isPBOSupported)
+    {
+        // No PBOs; fall back on a synchronous read.
+        Threading::ScopedMutexLock lock(_mutex);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glBindTexture(GL_TEXTURE_2D, to->id());
+        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, _image->data());
+        glBindTexture(GL_TEXTURE_2D, 0);
+        state->haveAppliedTextureAttribute(state->getActiveTextureUnit(), osg::StateAttribute::TEXTURE);
+        _resultFrame = frame;
+        return;
+    }
+
+    bool haveSync = ext->glFenceSync != 0L && ext->glClientWaitSync != 0L && ext->glDeleteSync != 0L;
+
+    // Copy out any readbacks the GPU has finished. Without fences, assume
+    // that a readback is done by the second frame after we issued it.
+    for (unsigned i = 0; i < 2; ++i)
+    {
+        Slot& slot = _slots[i];
+        if (!slot._pending)
+            continue;
+
+        bool done;
+        if (haveSync && slot._sync)
+        {
+            GLenum result = ext->glClientWaitSync((GLsync)slot._sync, 0, 0);
+            done = (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED);
+        }
+        else
+        {
+            done = frame > slot._frame + 1u;
+        }
+
+        if (!done)
+            continue;
+
+        ext->glBindBuffer(GL_PIXEL_PACK_BUFFER, slot._pbo);
+        const void* data = ext->glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+        if (data)
+        {
+            Threading::ScopedMutexLock lock(_mutex);
+            // Slots can finish out of order; never go back in time.
+            if (slot._frame > _resultFrame)
+            {
+                ::memcpy(_image->data(), data, imageBytes);
+                _resultFrame = slot._frame;
+            }
+            ext->glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        ext->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        if (slot._sync)
+        {
+            ext->glDeleteSync((GLsync)slot._sync);
+            slot._sync = 0L;
+        }
+        slot._pending = false;
+    }
+
+    // Start a new readback of this frame's pick image, if a slot is free.
+    Slot* slot = !_slots[0]._pending ? &_slots[0] : !_slots[1]._pending ? &_slots[1] : 0L;
+    if (!slot)
+        return;
+
+    if (slot->_pbo == 0)
+    {
+        ext->glGenBuffers(1, &slot->_pbo);
+        ext->glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->_pbo);
+        ext->glBufferData(GL_PIXEL_PACK_BUFFER, imageBytes, 0L, GL_STREAM_READ);
+    }
+    else
+    {
+        ext->glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->_pbo);
+    }
+
+    // Returns right away; the copy completes on the GPU behind the fence.
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glBindTexture(GL_TEXTURE_2D, to->id());
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0L);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    ext->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    state->haveAppliedTextureAttribute(state->getActiveTextureUnit(), osg::StateAttribute::TEXTURE);
+
+    slot->_sync = haveSync ? (void*)ext->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0) : 0L;
+    slot->_frame = frame;
+    slot->_pending = true;
+}
+
 VirtualProgram* 
 RTTPicker::createRTTProgram()
 {    
@@ -129,6 +261,9 @@ RTTPicker::RTTPicker(int cameraSize)
 
     // pixels around the click to test
     _buffer = 2;
+
+    // read the pick image back through PBOs
+    _asyncReadback = true;
     
     // Cull mask for RTT cameras
     _cullMask = ~0u;
@@ -238,7 +373,29 @@ RTTPicker::getOrCreatePickContext(osg::View* view)
     c._pickCamera->setViewport( 0, 0, _rttSize, _rttSize );
     c._pickCamera->setRenderOrder( osg::Camera::NESTED_RENDER );
     c._pickCamera->setRenderTargetImplementation( osg::Camera::FRAME_BUFFER_OBJECT );
-    c._pickCamera->attach( osg::Camera::COLOR_BUFFER0, c._image.get() );
+
+    if ( _asyncReadback )
+    {
+        // Render to a texture, and copy that into the image asynchronously
+        // instead of having OSG read the pixels back on every frame.
+        c._tex = new osg::Texture2D();
+        c._tex->setTextureSize(_rttSize, _rttSize);
+        c._tex->setInternalFormat(GL_RGBA8);
+        c._tex->setSourceFormat(GL_RGBA);
+        c._tex->setSourceType(GL_UNSIGNED_BYTE);
+        c._tex->setFilter(c._tex->MIN_FILTER, c._tex->NEAREST); // no filtering
+        c._tex->setFilter(c._tex->MAG_FILTER, c._tex->NEAREST); // no filtering
+        c._tex->setMaxAnisotropy(1.0f); // no filtering
+        c._pickCamera->attach( osg::Camera::COLOR_BUFFER0, c._tex.get() );
+
+        c._readback = new AsyncReadback(c._image.get(), c._tex.get());
+        c._pickCamera->setFinalDrawCallback( c._readback.get() );
+    }
+    else
+    {
+        c._pickCamera->attach( osg::Camera::COLOR_BUFFER0, c._image.get() );
+    }
+
     c._pickCamera->setSmallFeatureCullingPixelSize( -1.0f );
     c._pickCamera->setCullMask( _cullMask );
 
@@ -274,8 +431,8 @@ RTTPicker::getOrCreatePickContext(osg::View* view)
     rttSS->setDefine("OE_IS_PICK_CAMERA");
     rttSS->setDefine("OE_LIGHTING", osg::StateAttribute::OFF | osg::StateAttribute::OVERRIDE);
 
-    // default value for the objectid override uniform:
-    rttSS->addUniform( new osg::Uniform(Registry::objectIndex()->getObjectIDUniformName().c_str(), 0u) );
+    // default values for the objectid override and range uniforms:
+    Registry::objectIndex()->installDefaultUniforms( rttSS );
     
     // install the pick camera as a slave of the view's camera so it will
     // duplicate the view matrix and projection matrix during the update traversal
@@ -293,6 +450,13 @@ RTTPicker::getOrCreatePickContext(osg::View* view)
     // change over time (such as installing or uninstalling a Logarithmic Depth Buffer)
     c._pickCamera->setPreDrawCallback( new CallHostCameraPreDrawCallback(view->getCamera()) );
 
+    // The pick camera renders the same depth-tested scene as its host, so
+    // it has to use the same depth convention.
+    if ( ReverseZDepthBuffer::isInstalled(view->getCamera()) )
+    {
+        ReverseZDepthBuffer().install( c._pickCamera.get() );
+    }
+
     return c;
 }
 
@@ -331,12 +495,38 @@ RTTPicker::pick(osg::View* view, float mouseX, float mouseY)
 
 bool
 RTTPicker::pick(osg::View* view, float mouseX, float mouseY, Callback* callback)
+{
+    Pick pick;
+    pick._u1 = pick._u = mouseX;
+    pick._v1 = pick._v = mouseY;
+    pick._rect = false;
+    pick._callback = callback;
+    return queuePick(view, pick);
+}
+
+bool
+RTTPicker::pick(osg::View* view, float x0, float y0, float x1, float y1, Callback* callback)
+{
+    Pick pick;
+    pick._u  = std::min(x0, x1);
+    pick._v  = std::min(y0, y1);
+    pick._u1 = std::max(x0, x1);
+    pick._v1 = std::max(y0, y1);
+    pick._rect = true;
+    pick._callback = callback;
+    return queuePick(view, pick);
+}
+
+bool
+RTTPicker::queuePick(osg::View* view, Pick& pick)
 {
     if ( !view )
         return false;
 
-    Callback* callbackToUse = callback ? callback : _defaultCallback.get();
-    if ( !callbackToUse )
+    if ( !pick._callback.valid() )
+        pick._callback = _defaultCallback.get();
+
+    if ( !pick._callback.valid() )
         return false;
     
     osg::Camera* cam = view->getCamera();
@@ -348,22 +538,30 @@ RTTPicker::pick(osg::View* view, float mouseX, float mouseY, Callback* callback)
         return false;
 
     // normalize the input cooridnates [0..1]
-    float u = (mouseX - (float)vp->x())/(float)vp->width();
-    float v = (mouseY - (float)vp->y())/(float)vp->height();
+    pick._u  = (pick._u  - (float)vp->x())/(float)vp->width();
+    pick._v  = (pick._v  - (float)vp->y())/(float)vp->height();
+    pick._u1 = (pick._u1 - (float)vp->x())/(float)vp->width();
+    pick._v1 = (pick._v1 - (float)vp->y())/(float)vp->height();
 
-    // check the bounds:
-    if ( u < 0.0f || u > 1.0f || v < 0.0f || v > 1.0f )
-        return false;
+    if ( pick._rect )
+    {
+        // clamp the rectangle to the viewport:
+        pick._u  = osg::clampBetween(pick._u,  0.0f, 1.0f);
+        pick._v  = osg::clampBetween(pick._v,  0.0f, 1.0f);
+        pick._u1 = osg::clampBetween(pick._u1, 0.0f, 1.0f);
+        pick._v1 = osg::clampBetween(pick._v1, 0.0f, 1.0f);
+    }
+    else
+    {
+        // check the bounds:
+        if ( pick._u < 0.0f || pick._u > 1.0f || pick._v < 0.0f || pick._v > 1.0f )
+            return false;
+    }
 
     // install the RTT pick camera under this view's camera if it's not already:
     PickContext& context = getOrCreatePickContext( view );
     
-    // Create a new pick
-    Pick pick;
     pick._context  = &context;
-    pick._u        = u;
-    pick._v        = v;
-    pick._callback = callbackToUse;
     pick._frame    = view->getFrameStamp() ? view->getFrameStamp()->getFrameNumber() : 0u;
    
     // Queue it up.
@@ -472,18 +670,49 @@ namespace
 }
 
 bool
-RTTPicker::checkForPickResult(Pick& pick, unsigned frameNumber)
+RTTPicker::decodePick(Pick& pick, const osg::Image* image)
 {
-    // decode the results
-    osg::Image* image = pick._context->_image.get();
     ImageUtils::PixelReader read( image );
 
     // uncomment to see the RTT image.
     //osg::ref_ptr<osgDB::Options> o = new osgDB::Options();
     //osgDB::writeImageFile(*image, "out.tif", o.get());
 
-    bool hit = false;
     osg::Vec4f value;
+
+    if ( pick._rect )
+    {
+        // Collect every distinct object ID in the rectangle:
+        int s0 = (int)(pick._u  * (float)(image->s()-1)), s1 = (int)(pick._u1 * (float)(image->s()-1));
+        int t0 = (int)(pick._v  * (float)(image->t()-1)), t1 = (int)(pick._v1 * (float)(image->t()-1));
+
+        std::set<ObjectID> ids;
+        for (int t = t0; t <= t1; ++t)
+        {
+            for (int s = s0; s <= s1; ++s)
+            {
+                value = read(s, t);
+
+                ObjectID id = (ObjectID)(
+                    ((unsigned)(value.r()*255.0) << 24) +
+                    ((unsigned)(value.g()*255.0) << 16) +
+                    ((unsigned)(value.b()*255.0) <<  8) +
+                    ((unsigned)(value.a()*255.0)));
+
+                if ( id > 0 )
+                    ids.insert( id );
+            }
+        }
+
+        for (std::set<ObjectID>::const_iterator id = ids.begin(); id != ids.end(); ++id)
+        {
+            pick._callback->onHit( *id );
+        }
+
+        return !ids.empty();
+    }
+
+    bool hit = false;
     SpiralIterator iter(image->s(), image->t(), std::max(_buffer,1), pick._u, pick._v);
     while (iter.next() && (hit == false))
     {
@@ -502,14 +731,47 @@ RTTPicker::checkForPickResult(Pick& pick, unsigned frameNumber)
         }
     }
 
-    // A pick expires if (a) it registers a hit, or (b) is registers a miss
-    // for 2 frames in a row. Why 2? Because the RTT picker itself delays 
-    // pick results by one frame, and the osgEarth draping/clamping systems
-    // also delay drawing by one frame. So we need 2 frames to positively
-    // register a hit on draped/clamped geometry.
-    bool pickExpired =
-        hit == true ||
-        frameNumber - pick._frame >= 2u;
+    return hit;
+}
+
+bool
+RTTPicker::checkForPickResult(Pick& pick, unsigned frameNumber)
+{
+    bool hit = false;
+    bool pickExpired;
+
+    AsyncReadback* readback = pick._context->_readback.get();
+    if ( readback )
+    {
+        // The image holds the pixels from _resultFrame, which trails the
+        // current frame by however long the readback took.
+        Threading::ScopedMutexLock lock( readback->_mutex );
+        unsigned resultFrame = readback->_resultFrame;
+
+        if ( resultFrame > pick._frame )
+        {
+            hit = decodePick( pick, readback->_image.get() );
+            pickExpired = hit == true || resultFrame - pick._frame >= 2u;
+        }
+        else
+        {
+            // nothing rendered since the pick was queued yet
+            pickExpired = frameNumber - pick._frame >= MAX_ASYNC_PICK_FRAMES;
+        }
+    }
+    else
+    {
+        hit = decodePick( pick, pick._context->_image.get() );
+
+        // A pick expires if (a) it registers a hit, or (b) is registers a miss
+        // for 2 frames in a row. Why 2? Because the RTT picker itself delays 
+        // pick results by one frame, and the osgEarth draping/clamping systems
+        // also delay drawing by one frame. So we need 2 frames to positively
+        // register a hit on draped/clamped geometry.
+        pickExpired =
+            hit == true ||
+            frameNumber - pick._frame >= 2u;
+    }
 
     if ((hit == false) && (pickExpired == true))
     {
@@ -22,10 +22,297 @@
 #include <osgEarthUtil/RadialLineOfSight>
 #include <osgEarth/TerrainEngineNode>
 #include <osgEarth/GLUtils>
+#include <osgEarth/ElevationPool>
+#include <osgEarth/GPUTimer>
+#include <osgEarth/Registry>
+#include <osgEarth/Capabilities>
+#include <osgEarth/TerrainResources>
+#include <osgEarth/VirtualProgram>
+#include <osgEarthUtil/Shaders>
+#include <osg/Texture2D>
+#include <osgUtil/CullVisitor>
+
+#define LC "[RadialLineOfSightNode] "
 
 using namespace osgEarth;
 using namespace osgEarth::Util;
 
+// Number of GPU viewsheds a terrain engine supports, and the layout of their
+// depth maps in the shared atlas. Each slot is two square maps side by side,
+// one per hemisphere.
+#define VIEWSHED_MAX_OBSERVERS     32
+#define VIEWSHED_ATLAS_COLS        8
+#define VIEWSHED_ATLAS_ROWS        (VIEWSHED_MAX_OBSERVERS/VIEWSHED_ATLAS_COLS)
+#define VIEWSHED_MAP_SIZE          256
+
+// Viewsheds whose depth maps may be re-rendered in any one frame; the rest
+// wait for a later frame, so many moving observers don't stall one frame.
+#define VIEWSHED_RENDERS_PER_FRAME 4
+
+namespace osgEarth { namespace Util
+{
+    /**
+     * Depth map atlas, terrain shader and uniforms shared by all the GPU
+     * viewsheds on one terrain engine.
+     */
+    class ViewshedAtlas : public osg::Referenced
+    {
+    public:
+        //! Atlas for a terrain engine, created on first use.
+        static ViewshedAtlas* get(TerrainEngineNode* engine);
+
+        //! Reserves a slot; returns -1 if they're all taken.
+        int acquire();
+        void release(int slot);
+
+        //! Updates the terrain shader's view of an observer.
+        void setObserver(int slot, const osg::Matrixd& worldToLocal, float radius, const osg::Vec4f& good, const osg::Vec4f& bad);
+
+        //! Camera that renders one hemisphere of a slot's depth map.
+        osg::Camera* createCamera(int slot, int hemisphere, osg::Node* terrain);
+
+        //! Whether one more depth map may render this frame.
+        bool claimRender(unsigned frame);
+
+        //! State to push while culling the depth cameras.
+        osg::StateSet* getRTTStateSet() const { return _rttStateSet.get(); }
+
+    protected:
+        ViewshedAtlas(TerrainEngineNode* engine);
+        virtual ~ViewshedAtlas();
+
+        void updateCount();
+
+        osg::observer_ptr<TerrainEngineNode> _engine;
+        TerrainEngineNode*                   _key;
+        osg::ref_ptr<osg::Texture2D>         _map;
+        int                                  _unit;
+        std::vector<bool>                    _used;
+        osg::ref_ptr<osg::Uniform>           _count, _worldToLocal, _radius, _goodColor, _badColor;
+        osg::ref_ptr<osg::StateSet>          _rttStateSet;
+        unsigned                             _frame, _renders;
+        Threading::Mutex                     _mutex;
+    };
+} }
+
+namespace
+{
+    typedef std::map<TerrainEngineNode*, ViewshedAtlas*> ViewshedAtlases;
+
+    ViewshedAtlases& getViewshedAtlases()
+    {
+        static ViewshedAtlases s_atlases;
+        return s_atlases;
+    }
+
+    Threading::Mutex s_viewshedAtlasesMutex;
+
+    Shaders& getViewshedShaders()
+    {
+        static Shaders s_package;
+        static bool s_init = false;
+        if (!s_init)
+        {
+            s_package.replace("$OE_VIEWSHED_MAX_OBSERVERS", Stringify() << VIEWSHED_MAX_OBSERVERS);
+            s_package.replace("$OE_VIEWSHED_ATLAS_COLS", Stringify() << VIEWSHED_ATLAS_COLS);
+            s_package.replace("$OE_VIEWSHED_ATLAS_ROWS", Stringify() << VIEWSHED_ATLAS_ROWS);
+            s_init = true;
+        }
+        return s_package;
+    }
+}
+
+ViewshedAtlas*
+ViewshedAtlas::get(TerrainEngineNode* engine)
+{
+    Threading::ScopedMutexLock lock(s_viewshedAtlasesMutex);
+    ViewshedAtlases& atlases = getViewshedAtlases();
+    ViewshedAtlases::iterator i = atlases.find(engine);
+    if (i != atlases.end())
+        return i->second;
+
+    ViewshedAtlas* atlas = new ViewshedAtlas(engine);
+    atlases[engine] = atlas;
+    return atlas;
+}
+
+ViewshedAtlas::ViewshedAtlas(TerrainEngineNode* engine) :
+_engine ( engine ),
+_key    ( engine ),
+_unit   ( -1 ),
+_used   ( VIEWSHED_MAX_OBSERVERS, false ),
+_frame  ( ~0u ),
+_renders( 0u )
+{
+    if (!engine->getResources()->reserveTextureImageUnit(_unit, "Viewshed"))
+    {
+        OE_WARN << LC << "No texture image units available for the GPU viewshed" << std::endl;
+        _unit = -1;
+        return;
+    }
+
+    _map = new osg::Texture2D();
+    _map->setTextureSize(2*VIEWSHED_ATLAS_COLS*VIEWSHED_MAP_SIZE, VIEWSHED_ATLAS_ROWS*VIEWSHED_MAP_SIZE);
+    _map->setInternalFormat(GL_DEPTH_COMPONENT);
+    _map->setFilter(osg::Texture::MIN_FILTER, osg::Texture::NEAREST);
+    _map->setFilter(osg::Texture::MAG_FILTER, osg::Texture::NEAREST);
+    _map->setWrap(osg::Texture::WRAP_S, osg::Texture::CLAMP_TO_EDGE);
+    _map->setWrap(osg::Texture::WRAP_T, osg::Texture::CLAMP_TO_EDGE);
+
+    // terrain side: color each fragment by whether the observers see it.
+    osg::StateSet* stateset = engine->getSurfaceStateSet();
+    VirtualProgram* vp = VirtualProgram::getOrCreate(stateset);
+    Shaders& package = getViewshedShaders();
+    package.load(vp, package.Viewshed_Vertex);
+    package.load(vp, package.Viewshed_Fragment);
+
+    stateset->setTextureAttribute(_unit, _map.get(), osg::StateAttribute::ON);
+    stateset->addUniform(new osg::Uniform("oe_viewshed_map", _unit));
+
+    _count        = new osg::Uniform("oe_viewshed_count", 0);
+    _worldToLocal = new osg::Uniform(osg::Uniform::FLOAT_MAT4, "oe_viewshed_worldToLocal", VIEWSHED_MAX_OBSERVERS);
+    _radius       = new osg::Uniform(osg::Uniform::FLOAT, "oe_viewshed_radius", VIEWSHED_MAX_OBSERVERS);
+    _goodColor    = new osg::Uniform(osg::Uniform::FLOAT_VEC4, "oe_viewshed_goodColor", VIEWSHED_MAX_OBSERVERS);
+    _badColor     = new osg::Uniform(osg::Uniform::FLOAT_VEC4, "oe_viewshed_badColor", VIEWSHED_MAX_OBSERVERS);
+    for (unsigned i = 0; i < VIEWSHED_MAX_OBSERVERS; ++i)
+        _radius->setElement(i, 0.0f);
+
+    stateset->addUniform(_count.get());
+    stateset->addUniform(_worldToLocal.get());
+    stateset->addUniform(_radius.get());
+    stateset->addUniform(_goodColor.get());
+    stateset->addUniform(_badColor.get());
+
+    // depth map side: a depth-only pass over the terrain, projected in the
+    // vertex shader.
+    _rttStateSet = new osg::StateSet();
+    _rttStateSet->setDefine("OE_IS_DEPTH_CAMERA");
+    _rttStateSet->addUniform(new osg::Uniform("oe_shadowToPrimaryMatrix", osg::Matrixf()));
+    _rttStateSet->setMode(GL_CULL_FACE, osg::StateAttribute::OFF | osg::StateAttribute::OVERRIDE);
+
+    VirtualProgram* rttVP = VirtualProgram::getOrCreate(_rttStateSet.get());
+    package.load(rttVP, package.ViewshedDepth_VertexView);
+    package.load(rttVP, package.ViewshedDepth_VertexClip);
+    package.load(rttVP, package.ViewshedDepth_Fragment);
+}
+
+ViewshedAtlas::~ViewshedAtlas()
+{
+    {
+        Threading::ScopedMutexLock lock(s_viewshedAtlasesMutex);
+        getViewshedAtlases().erase(_key);
+    }
+
+    osg::ref_ptr<TerrainEngineNode> engine;
+    if (_unit < 0 || !_engine.lock(engine))
+        return;
+
+    osg::StateSet* stateset = engine->getSurfaceStateSet();
+    VirtualProgram* vp = VirtualProgram::get(stateset);
+    if (vp)
+    {
+        Shaders& package = getViewshedShaders();
+        package.unload(vp, package.Viewshed_Vertex);
+        package.unload(vp, package.Viewshed_Fragment);
+    }
+
+    stateset->removeTextureAttribute(_unit, _map.get());
+    stateset->removeUniform("oe_viewshed_map");
+    stateset->removeUniform(_count.get());
+    stateset->removeUniform(_worldToLocal.get());
+    stateset->removeUniform(_radius.get());
+    stateset->removeUniform(_goodColor.get());
+    stateset->removeUniform(_badColor.get());
+
+    engine->getResources()->releaseTextureImageUnit(_unit);
+}
+
+int
+ViewshedAtlas::acquire()
+{
+    if (_unit < 0)
+        return -1;
+
+    Threading::ScopedMutexLock lock(_mutex);
+    for (unsigned i = 0; i < _used.size(); ++i)
+    {
+        if (!_used[i])
+        {
+            _used[i] = true;
+            updateCount();
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+void
+ViewshedAtlas::release(int slot)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    if (slot >= 0 && slot < (int)_used.size())
+    {
+        _used[slot] = false;
+        _radius->setElement(slot, 0.0f);
+        updateCount();
+    }
+}
+
+void
+ViewshedAtlas::updateCount()
+{
+    int count = 0;
+    for (unsigned i = 0; i < _used.size(); ++i)
+        if (_used[i]) count = i+1;
+    _count->set(count);
+}
+
+void
+ViewshedAtlas::setObserver(int slot, const osg::Matrixd& worldToLocal, float radius, const osg::Vec4f& good, const osg::Vec4f& bad)
+{
+    _worldToLocal->setElement(slot, osg::Matrixf(worldToLocal));
+    _radius->setElement(slot, radius);
+    _goodColor->setElement(slot, good);
+    _badColor->setElement(slot, bad);
+}
+
+osg::Camera*
+ViewshedAtlas::createCamera(int slot, int hemisphere, osg::Node* terrain)
+{
+    int col = slot % VIEWSHED_ATLAS_COLS;
+    int row = slot / VIEWSHED_ATLAS_COLS;
+
+    osg::Camera* rtt = new osg::Camera();
+    rtt->setReferenceFrame(osg::Camera::ABSOLUTE_RF);
+    rtt->setClearDepth(1.0);
+    rtt->setClearMask(GL_DEPTH_BUFFER_BIT);
+    rtt->setComputeNearFarMode(osg::CullSettings::DO_NOT_COMPUTE_NEAR_FAR);
+    rtt->setViewport((2*col + hemisphere)*VIEWSHED_MAP_SIZE, row*VIEWSHED_MAP_SIZE, VIEWSHED_MAP_SIZE, VIEWSHED_MAP_SIZE);
+    rtt->setRenderOrder(osg::Camera::PRE_RENDER);
+    rtt->setRenderTargetImplementation(osg::Camera::FRAME_BUFFER_OBJECT);
+    rtt->setImplicitBufferAttachmentMask(0, 0);
+    rtt->attach(osg::Camera::DEPTH_BUFFER, _map.get());
+    rtt->addChild(terrain);
+    rtt->getOrCreateStateSet()->addUniform(new osg::Uniform("oe_viewshed_hemisphere", hemisphere == 0 ? 1.0f : -1.0f));
+    GPUTimer::install(rtt, "viewshed");
+    return rtt;
+}
+
+bool
+ViewshedAtlas::claimRender(unsigned frame)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    if (frame != _frame)
+    {
+        _frame = frame;
+        _renders = 0u;
+    }
+    if (_renders >= VIEWSHED_RENDERS_PER_FRAME)
+        return false;
+    ++_renders;
+    return true;
+}
+
 namespace
 {
     osg::Vec3d getNodeCenter(osg::Node* node)
@@ -86,7 +373,10 @@ _outlineColor( 1.0f, 1.0f, 1.0f, 1.0f),
 _displayMode( LineOfSight::MODE_SPLIT ),
 //_altitudeMode( ALTMODE_ABSOLUTE ),
 _fill(false),
-_terrainOnly( false )
+_terrainOnly( false ),
+_method( METHOD_SCENE_GRAPH ),
+_slot( -1 ),
+_viewshedDirty( false )
 {
     //compute(getNode());
     _terrainChangedCallback = new RadialLineOfSightNodeTerrainChangedCallback( this );
@@ -97,6 +387,7 @@ _terrainOnly( false )
 RadialLineOfSightNode::~RadialLineOfSightNode()
 {
     setMapNode( 0L );
+    releaseGPU();
 }
 
 void
@@ -114,6 +405,9 @@ RadialLineOfSightNode::setMapNode( MapNode* mapNode )
             }
         }
 
+        // the viewshed slot belongs to the old terrain engine:
+        releaseGPU();
+
         _mapNode = mapNode;
 
         if ( _mapNode.valid() && _terrainChangedCallback.valid() )
@@ -211,6 +505,22 @@ void RadialLineOfSightNode::setTerrainOnly( bool terrainOnly )
     }
 }
 
+RadialLineOfSightNode::Method
+RadialLineOfSightNode::getMethod() const
+{
+    return _method;
+}
+
+void
+RadialLineOfSightNode::setMethod( Method method )
+{
+    if (_method != method)
+    {
+        _method = method;
+        compute(getNode());
+    }
+}
+
 osg::Node*
 RadialLineOfSightNode::getNode()
 {
@@ -223,12 +533,81 @@ void
 RadialLineOfSightNode::terrainChanged( const osgEarth::TileKey& tileKey, osg::Node* terrain )
 {
     OE_DEBUG << "RadialLineOfSightNode::terrainChanged" << std::endl;
+
+    // Tiles outside the radius can't change the result:
+    if ( _extent.isValid() && !tileKey.getExtent().intersects(_extent) )
+        return;
+
+    // A GPU viewshed only needs its depth map re-rendered:
+    if ( _atlas.valid() )
+    {
+        _viewshedDirty = true;
+        return;
+    }
+
+    // The elevation pool holds the map's data rather than the tiles, so
+    // its result only changes when that data does:
+    if ( _method != METHOD_SCENE_GRAPH && _extent.isValid() && getMapNode() &&
+         _revision == getMapNode()->getMap()->getDataModelRevision() )
+        return;
+
     compute( getNode() );    
 }
 
+void
+RadialLineOfSightNode::traverse(osg::NodeVisitor& nv)
+{
+    if (nv.getVisitorType() == nv.CULL_VISITOR && _viewshedDirty && _atlas.valid())
+    {
+        osgUtil::CullVisitor* cv = dynamic_cast<osgUtil::CullVisitor*>(&nv);
+        unsigned frame = nv.getFrameStamp() ? nv.getFrameStamp()->getFrameNumber() : 0u;
+        if (cv && _atlas->claimRender(frame))
+        {
+            cv->pushStateSet(_atlas->getRTTStateSet());
+            _viewshedCameras[0]->accept(nv);
+            _viewshedCameras[1]->accept(nv);
+            cv->popStateSet();
+            _viewshedDirty = false;
+        }
+    }
+
+    LineOfSightNode::traverse(nv);
+}
+
+void
+RadialLineOfSightNode::updateExtent()
+{
+    GeoPoint centerMap;
+    if ( !getMapNode() || !_center.isValid() || !_center.transform(getMapNode()->getMapSRS(), centerMap) )
+    {
+        _extent = GeoExtent::INVALID;
+        return;
+    }
+
+    const SpatialReference* srs = centerMap.getSRS();
+    double dx = _radius, dy = _radius;
+    if (srs->isGeographic())
+    {
+        dy = _radius / (srs->getEllipsoid()->getRadiusEquator() * osg::PI / 180.0);
+        dx = dy / osg::maximum(cos(osg::DegreesToRadians(centerMap.y())), 0.01);
+    }
+    _extent = GeoExtent(srs, centerMap.x()-dx, centerMap.y()-dy, centerMap.x()+dx, centerMap.y()+dy);
+    _revision = getMapNode()->getMap()->getDataModelRevision();
+}
+
 void
 RadialLineOfSightNode::compute(osg::Node* node )
 {
+    if ( !getMapNode() )
+        return;
+
+    updateExtent();
+
+    if (_method == METHOD_GPU && computeGPU())
+        return;
+
+    releaseGPU();
+
     if (_fill)
     {
         compute_fill( node );
@@ -239,6 +618,125 @@ RadialLineOfSightNode::compute(osg::Node* node )
     }
 }
 
+bool
+RadialLineOfSightNode::computeGPU()
+{
+    const Capabilities& caps = Registry::capabilities();
+    if ( !caps.supportsGLSL() || !caps.supportsFragDepthWrite() )
+        return false;
+
+    if ( !_atlas.valid() )
+    {
+        osg::ref_ptr<ViewshedAtlas> atlas = ViewshedAtlas::get(getMapNode()->getTerrainEngine());
+        _slot = atlas->acquire();
+        if (_slot < 0)
+        {
+            OE_INFO << LC << "No GPU viewshed slots left; computing on the CPU" << std::endl;
+            return false;
+        }
+        _atlas = atlas.get();
+
+        for (int i = 0; i < 2; ++i)
+            _viewshedCameras[i] = _atlas->createCamera(_slot, i, getMapNode()->getTerrainEngine());
+
+        // nothing to draw ourselves, but the depth cameras need culling:
+        setCullingActive(false);
+    }
+
+    GeoPoint centerMap;
+    _center.transform( getMapNode()->getMapSRS(), centerMap );
+    centerMap.toWorld( _centerWorld, getMapNode()->getTerrain() );
+
+    // local tangent frame at the observer:
+    GeoPoint observer;
+    osg::Matrixd localToWorld, worldToLocal;
+    observer.fromWorld( getMapNode()->getMapSRS(), _centerWorld );
+    observer.createLocalToWorld( localToWorld );
+    worldToLocal.invert( localToWorld );
+
+    for (int i = 0; i < 2; ++i)
+    {
+        _viewshedCameras[i]->setViewMatrix( worldToLocal );
+        // only used for culling; the shader does the projection.
+        _viewshedCameras[i]->setProjectionMatrixAsOrtho( -_radius, _radius, -_radius, _radius, -_radius, _radius );
+        _viewshedCameras[i]->getOrCreateStateSet()->getOrCreateUniform("oe_viewshed_radius", osg::Uniform::FLOAT)->set((float)_radius);
+    }
+
+    _atlas->setObserver( _slot, worldToLocal, (float)_radius, _goodColor, _badColor );
+    _viewshedDirty = true;
+
+    removeChildren(0, getNumChildren());
+
+    for( LOSChangedCallbackList::iterator i = _changedCallbacks.begin(); i != _changedCallbacks.end(); i++ )
+    {
+        i->get()->onChanged();
+    }
+
+    return true;
+}
+
+void
+RadialLineOfSightNode::releaseGPU()
+{
+    if ( _atlas.valid() )
+    {
+        _atlas->release( _slot );
+        _atlas = 0L;
+        _slot = -1;
+        _viewshedCameras[0] = 0L;
+        _viewshedCameras[1] = 0L;
+        _viewshedDirty = false;
+        setCullingActive(true);
+    }
+}
+
+void
+RadialLineOfSightNode::castSpokes(osg::Node* node, osgUtil::IntersectorGroup* spokes)
+{
+    if ( _method == METHOD_SCENE_GRAPH )
+    {
+        osgUtil::IntersectionVisitor iv;
+        iv.setIntersector( spokes );
+        node->accept( iv );
+        return;
+    }
+
+    // Terrain only: march each spoke over the elevation pool's min/max
+    // pyramid, at a resolution of a few hundred posts across the radius.
+    const Map* map = getMapNode()->getMap();
+    const SpatialReference* mapSRS = map->getSRS();
+    ElevationPool* pool = map->getElevationPool();
+
+    double resolution = _radius / 256.0;
+    if (mapSRS->isGeographic())
+        resolution /= (mapSRS->getEllipsoid()->getRadiusEquator() * osg::PI / 180.0);
+    unsigned lod = map->getProfile()->getLevelOfDetailForHorizResolution(resolution, pool->getTileSize());
+
+    osg::ref_ptr<ElevationEnvelope> envelope = pool->createEnvelope(mapSRS, lod);
+
+    osgUtil::IntersectorGroup::Intersectors& list = spokes->getIntersectors();
+    for (osgUtil::IntersectorGroup::Intersectors::iterator i = list.begin(); i != list.end(); ++i)
+    {
+        osgUtil::LineSegmentIntersector* lsi = dynamic_cast<osgUtil::LineSegmentIntersector*>(i->get());
+        if ( !lsi )
+            continue;
+
+        GeoPoint start, end;
+        start.fromWorld( mapSRS, lsi->getStart() );
+        end.fromWorld( mapSRS, lsi->getEnd() );
+
+        osg::Vec3d hit;
+        if ( envelope->intersect(start.vec3d(), end.vec3d(), hit) )
+        {
+            osgUtil::LineSegmentIntersector::Intersection isect;
+            GeoPoint(mapSRS, hit, ALTMODE_ABSOLUTE).toWorld( isect.localIntersectionPoint );
+            double length = (lsi->getEnd() - lsi->getStart()).length();
+            isect.ratio = length > 0.0 ? (isect.localIntersectionPoint - lsi->getStart()).length() / length : 0.0;
+            lsi->getIntersections().insert( isect );
+        }
+    }
+}
+
 void
 RadialLineOfSightNode::compute_line(osg::Node* node)
 {    
@@ -286,10 +784,7 @@ RadialLineOfSightNode::compute_line(osg::Node* node)
         ivGroup->addIntersector( dplsi.get() );
     }
 
-    osgUtil::IntersectionVisitor iv;
-    iv.setIntersector( ivGroup.get() );
-
-    node->accept( iv );
+    castSpokes( node, ivGroup.get() );
 
     for (unsigned int i = 0; i < (unsigned int)_numSpokes; i++)
     {
@@ -429,10 +924,7 @@ RadialLineOfSightNode::compute_fill(osg::Node* node)
             ivGroup->addIntersector( dplsi.get() );
     }
 
-    osgUtil::IntersectionVisitor iv;
-    iv.setIntersector( ivGroup.get() );
-
-    node->accept( iv );
+    castSpokes( node, ivGroup.get() );
 
     for (unsigned int i = 0; i < (unsigned int)_numSpokes; i++)
     {
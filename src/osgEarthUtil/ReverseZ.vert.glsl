@@ -0,0 +1,18 @@
+#version $GLSL_VERSION_STR
+
+#pragma vp_entryPoint oe_reverseZ_vert
+#pragma vp_location   vertex_clip
+#pragma vp_order      last
+
+#pragma import_defines(OE_REVERSE_Z)
+
+// Maps clip-space Z from [-w..w] (near..far) to [w..0], so that with
+// ZERO_TO_ONE clip control the near plane lands at depth 1.
+// RTT cameras that render with their own depth conventions switch this
+// off by turning the define off.
+void oe_reverseZ_vert(inout vec4 clip)
+{
+#ifdef OE_REVERSE_Z
+    clip.z = 0.5*(clip.w - clip.z);
+#endif
+}
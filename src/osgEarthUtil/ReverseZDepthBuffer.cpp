@@ -0,0 +1,360 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2016 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include <osgEarthUtil/ReverseZDepthBuffer>
+#include <osgEarthUtil/Shaders>
+#include <osgEarth/Registry>
+#include <osgEarth/Capabilities>
+#include <osgEarth/VirtualProgram>
+#include <osg/Depth>
+#include <osg/PolygonOffset>
+#include <osg/GLExtensions>
+#include <osg/ValueObject>
+#include <osg/buffered_value>
+
+#define LC "[ReverseZDepthBuffer] "
+
+#define REVERSE_Z_DEFINE "OE_REVERSE_Z"
+#define FLIPPED_KEY      "oe_reverseZ_flipped"
+
+#ifndef GL_LOWER_LEFT
+#define GL_LOWER_LEFT 0x8CA1
+#endif
+
+#ifndef GL_NEGATIVE_ONE_TO_ONE
+#define GL_NEGATIVE_ONE_TO_ONE 0x935E
+#endif
+
+#ifndef GL_ZERO_TO_ONE
+#define GL_ZERO_TO_ONE 0x935F
+#endif
+
+#ifndef GL_DEPTH_COMPONENT32F
+#define GL_DEPTH_COMPONENT32F 0x8CAC
+#endif
+
+#ifndef GL_DEPTH32F_STENCIL8
+#define GL_DEPTH32F_STENCIL8 0x8CAD
+#endif
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+//------------------------------------------------------------------------
+
+namespace
+{
+    typedef void (GL_APIENTRY * ClipControlProc)(GLenum origin, GLenum depth);
+
+    // glClipControl for a graphics context, or NULL if it doesn't have one.
+    ClipControlProc getClipControl(osg::State* state)
+    {
+        static osg::buffered_value<int> s_loaded;
+        static osg::buffered_object<ClipControlProc> s_procs;
+
+        unsigned id = state->getContextID();
+        if ( !s_loaded[id] )
+        {
+            s_loaded[id] = 1;
+            s_procs[id] = 0L;
+            if ( osg::isGLExtensionOrVersionSupported(id, "GL_ARB_clip_control", 4.5f) )
+                osg::setGLExtensionFuncPtr( s_procs[id], "glClipControl", "glClipControlARB" );
+            if ( !s_procs[id] )
+                OE_WARN << LC << "glClipControl is not available; depth precision will be reduced" << std::endl;
+        }
+        return s_procs[id];
+    }
+
+    // Switches to ZERO_TO_ONE clip control for the camera's draw. Clip
+    // control isn't part of the osg::State, so the final callback puts it
+    // back for the cameras that draw after this one.
+    struct BeginClipControl : public osg::Camera::DrawCallback
+    {
+        BeginClipControl(const osg::Camera::DrawCallback* next) : _next(next) { }
+
+        void operator()(osg::RenderInfo& ri) const
+        {
+            if (_next.valid())
+                (*_next)(ri);
+            ClipControlProc clipControl = getClipControl(ri.getState());
+            if (clipControl)
+                clipControl(GL_LOWER_LEFT, GL_ZERO_TO_ONE);
+        }
+
+        osg::ref_ptr<const osg::Camera::DrawCallback> _next;
+    };
+
+    struct EndClipControl : public osg::Camera::DrawCallback
+    {
+        EndClipControl(const osg::Camera::DrawCallback* next) : _next(next) { }
+
+        void operator()(osg::RenderInfo& ri) const
+        {
+            ClipControlProc clipControl = getClipControl(ri.getState());
+            if (clipControl)
+                clipControl(GL_LOWER_LEFT, GL_NEGATIVE_ONE_TO_ONE);
+            if (_next.valid())
+                (*_next)(ri);
+        }
+
+        osg::ref_ptr<const osg::Camera::DrawCallback> _next;
+    };
+
+    osg::Depth::Function reversed(osg::Depth::Function func)
+    {
+        switch(func)
+        {
+        case osg::Depth::LESS:    return osg::Depth::GREATER;
+        case osg::Depth::LEQUAL:  return osg::Depth::GEQUAL;
+        case osg::Depth::GREATER: return osg::Depth::LESS;
+        case osg::Depth::GEQUAL:  return osg::Depth::LEQUAL;
+        default:                  return func;
+        }
+    }
+
+    struct FlipVisitor : public osg::NodeVisitor
+    {
+        FlipVisitor(bool reverse) : osg::NodeVisitor(TRAVERSE_ALL_CHILDREN), _reverse(reverse)
+        {
+            setNodeMaskOverride(~0);
+        }
+
+        void flip(osg::StateSet* ss)
+        {
+            if (!ss)
+                return;
+
+            flip(dynamic_cast<osg::Depth*>(ss->getAttribute(osg::StateAttribute::DEPTH)));
+            flip(dynamic_cast<osg::PolygonOffset*>(ss->getAttribute(osg::StateAttribute::POLYGONOFFSET)));
+        }
+
+        // the marker makes shared attributes flip only once.
+        bool mark(osg::Object* obj)
+        {
+            bool flipped = false;
+            obj->getUserValue(FLIPPED_KEY, flipped);
+            if (flipped == _reverse)
+                return false;
+            obj->setUserValue(FLIPPED_KEY, _reverse);
+            return true;
+        }
+
+        void flip(osg::Depth* depth)
+        {
+            if (depth && mark(depth))
+                depth->setFunction(reversed(depth->getFunction()));
+        }
+
+        void flip(osg::PolygonOffset* offset)
+        {
+            if (offset && mark(offset))
+            {
+                offset->setFactor(-offset->getFactor());
+                offset->setUnits(-offset->getUnits());
+            }
+        }
+
+        void apply(osg::Node& node)
+        {
+            flip(node.getStateSet());
+            traverse(node);
+        }
+
+        void apply(osg::Geode& geode)
+        {
+            flip(geode.getStateSet());
+            for (unsigned i = 0; i < geode.getNumDrawables(); ++i)
+                flip(geode.getDrawable(i)->getStateSet());
+            traverse(geode);
+        }
+
+        bool _reverse;
+    };
+
+    // Flips the subgraphs attached to a camera after install(), such as the
+    // scene data a viewer adds to its master camera.
+    struct FlipNewChildren : public osg::NodeCallback
+    {
+        void operator()(osg::Node* node, osg::NodeVisitor* nv)
+        {
+            osg::Group* group = node->asGroup();
+            if (group && group->getNumChildren() != _flipped.size())
+                flipNewChildren(group);
+            else if (group)
+            {
+                for (unsigned i = 0; i < group->getNumChildren(); ++i)
+                {
+                    if (group->getChild(i) != _flipped[i].get())
+                    {
+                        flipNewChildren(group);
+                        break;
+                    }
+                }
+            }
+
+            // a view's own cameras have no parents; the viewer already
+            // traverses their scene, so don't update it twice.
+            if (node->getNumParents() > 0)
+                traverse(node, nv);
+        }
+
+        void flipNewChildren(osg::Group* group)
+        {
+            std::vector< osg::observer_ptr<osg::Node> > flipped;
+            for (unsigned i = 0; i < group->getNumChildren(); ++i)
+            {
+                // the marker skips anything that's already flipped.
+                ReverseZDepthBuffer::flip(group->getChild(i), true);
+                flipped.push_back(group->getChild(i));
+            }
+            _flipped.swap(flipped);
+        }
+
+        std::vector< osg::observer_ptr<osg::Node> > _flipped;
+    };
+
+    // Camera depth attachments become 32-bit float.
+    void attachFloatDepth(osg::Camera* camera)
+    {
+        osg::Camera::BufferAttachmentMap& attachments = camera->getBufferAttachmentMap();
+
+        osg::Camera::BufferAttachmentMap::iterator packed = attachments.find(osg::Camera::PACKED_DEPTH_STENCIL_BUFFER);
+        if (packed != attachments.end() && !packed->second._texture.valid() && !packed->second._image.valid())
+        {
+            camera->attach(osg::Camera::PACKED_DEPTH_STENCIL_BUFFER, GL_DEPTH32F_STENCIL8);
+            return;
+        }
+
+        osg::Camera::BufferAttachmentMap::iterator depth = attachments.find(osg::Camera::DEPTH_BUFFER);
+        if (depth != attachments.end() && depth->second._texture.valid())
+        {
+            depth->second._texture->setInternalFormat(GL_DEPTH_COMPONENT32F);
+        }
+        else if (depth == attachments.end() || !depth->second._image.valid())
+        {
+            camera->attach(osg::Camera::DEPTH_BUFFER, GL_DEPTH_COMPONENT32F);
+        }
+    }
+}
+
+//------------------------------------------------------------------------
+
+ReverseZDepthBuffer::ReverseZDepthBuffer()
+{
+    _supported = Registry::capabilities().supportsGLSL();
+    if ( !_supported )
+    {
+        OE_WARN << LC << "Not supported on this platform (no GLSL)" << std::endl;
+    }
+}
+
+bool
+ReverseZDepthBuffer::isInstalled(const osg::Camera* camera)
+{
+    const osg::StateSet* stateset = camera ? camera->getStateSet() : 0L;
+    if ( !stateset )
+        return false;
+
+    osg::StateSet::DefineList::const_iterator i = stateset->getDefineList().find(REVERSE_Z_DEFINE);
+    return
+        i != stateset->getDefineList().end() &&
+        (i->second.second & osg::StateAttribute::ON) != 0;
+}
+
+void
+ReverseZDepthBuffer::flip(osg::Node* node, bool reverse)
+{
+    if ( node )
+    {
+        FlipVisitor visitor(reverse);
+        node->accept( visitor );
+    }
+}
+
+void
+ReverseZDepthBuffer::install(osg::Camera* camera)
+{
+    if ( camera && _supported && !isInstalled(camera) )
+    {
+        osg::StateSet* stateset = camera->getOrCreateStateSet();
+
+        VirtualProgram* vp = VirtualProgram::getOrCreate( stateset );
+        Shaders pkg;
+        pkg.load( vp, pkg.ReverseZ_VertFile );
+
+        stateset->setDefine( REVERSE_Z_DEFINE );
+        stateset->setAttributeAndModes( new osg::Depth(osg::Depth::GEQUAL, 0.0, 1.0, true), osg::StateAttribute::ON );
+        camera->setClearDepth( 0.0 );
+
+        if ( camera->getRenderTargetImplementation() == osg::Camera::FRAME_BUFFER_OBJECT )
+        {
+            attachFloatDepth( camera );
+        }
+
+        camera->setInitialDrawCallback( new BeginClipControl(camera->getInitialDrawCallback()) );
+        camera->setFinalDrawCallback( new EndClipControl(camera->getFinalDrawCallback()) );
+
+        flip( camera, true );
+
+        FlipNewChildren* flipper = new FlipNewChildren();
+        flipper->flipNewChildren( camera );
+        camera->addUpdateCallback( flipper );
+    }
+}
+
+void
+ReverseZDepthBuffer::uninstall(osg::Camera* camera)
+{
+    if ( camera && isInstalled(camera) )
+    {
+        osg::StateSet* stateset = camera->getStateSet();
+
+        VirtualProgram* vp = VirtualProgram::get( stateset );
+        if ( vp )
+        {
+            Shaders pkg;
+            pkg.unload( vp, pkg.ReverseZ_VertFile );
+        }
+
+        stateset->removeDefine( REVERSE_Z_DEFINE );
+        stateset->removeAttribute( osg::StateAttribute::DEPTH );
+        camera->setClearDepth( 1.0 );
+
+        BeginClipControl* begin = dynamic_cast<BeginClipControl*>( camera->getInitialDrawCallback() );
+        if ( begin )
+            camera->setInitialDrawCallback( const_cast<osg::Camera::DrawCallback*>(begin->_next.get()) );
+
+        EndClipControl* end = dynamic_cast<EndClipControl*>( camera->getFinalDrawCallback() );
+        if ( end )
+            camera->setFinalDrawCallback( const_cast<osg::Camera::DrawCallback*>(end->_next.get()) );
+
+        for( osg::Callback* cb = camera->getUpdateCallback(); cb; cb = cb->getNestedCallback() )
+        {
+            if ( dynamic_cast<FlipNewChildren*>(cb) )
+            {
+                camera->removeUpdateCallback( cb );
+                break;
+            }
+        }
+
+        flip( camera, false );
+    }
+}
@@ -22,6 +22,7 @@
 #include <osgEarthUtil/Shadowing>
 #include <osgEarthUtil/Shaders>
 #include <osgEarth/CullingUtils>
+#include <osgEarth/GPUTimer>
 #include <osgEarth/Registry>
 #include <osgEarth/Capabilities>
 #include <osgEarth/Shadowing>
@@ -32,6 +33,9 @@
 
 using namespace osgEarth::Util;
 
+// How much bigger than the view slice a cached slice renders, as a fraction
+// of its size on each side, so it stays valid while the camera moves a bit.
+#define CACHED_SLICE_MARGIN 0.25
 
 
 ShadowCaster::ShadowCaster() :
@@ -39,7 +43,10 @@ _size         ( 2048 ),
 _texImageUnit ( 7 ),
 _blurFactor   ( 0.001f ),
 _color        ( 0.4f ),
-_traversalMask( ~0 )
+_traversalMask( ~0 ),
+_firstCachedSlice( ~0u ),
+_cachedLightThreshold( 0.25f ),
+_cachedSlicesDirty( true )
 {
     _castingGroup = new osg::Group();
 
@@ -96,6 +103,21 @@ ShadowCaster::setShadowColor(float value)
         _shadowColorUniform->set(value);
 }
 
+void
+ShadowCaster::setSliceTraversalMask(unsigned slice, unsigned mask)
+{
+    if ( slice >= _sliceMasks.size() )
+        _sliceMasks.resize( slice+1, ~0u );
+    _sliceMasks[slice] = mask;
+    dirtyCachedSlices();
+}
+
+unsigned
+ShadowCaster::getSliceTraversalMask(unsigned slice) const
+{
+    return slice < _sliceMasks.size() ? _sliceMasks[slice] : ~0u;
+}
+
 void
 ShadowCaster::reinitialize()
 {
@@ -104,6 +126,8 @@ ShadowCaster::reinitialize()
 
     _shadowmap = 0L;
     _rttCameras.clear();
+    _cachedSlices.clear();
+    _cachedSlicesDirty = true;
 
     int numSlices = (int)_ranges.size() - 1;
     if ( numSlices < 1 )
@@ -123,6 +147,8 @@ ShadowCaster::reinitialize()
     _shadowmap->setBorderColor(osg::Vec4(1,1,1,1));
 
     // set up the RTT camera:
+    _cachedSlices.resize( numSlices );
+
     for(int i=0; i<numSlices; ++i)
     {
         osg::Camera* rtt = new osg::Camera();
@@ -137,6 +163,7 @@ ShadowCaster::reinitialize()
         rtt->setImplicitBufferAttachmentMask(0, 0);
         rtt->attach( osg::Camera::DEPTH_BUFFER, _shadowmap.get(), 0, i );
         rtt->addChild( _castingGroup.get() );
+        GPUTimer::install( rtt, "shadows" );
         _rttCameras.push_back(rtt);
     }
 
@@ -228,6 +255,23 @@ ShadowCaster::traverse(osg::NodeVisitor& nv)
             // between the two cameras.
             osg::Matrix lightViewMatInv = osg::Matrix::inverse(lightViewMat);
             _shadowToPrimaryMatrix->set( lightViewMatInv * MV);
+
+            // this xforms from clip [-1..1] to texture [0..1] space
+            static osg::Matrix s_scaleBiasMat = 
+                osg::Matrix::translate(1.0,1.0,1.0) * 
+                osg::Matrix::scale(0.5,0.5,0.5);
+
+            // casters that were added, removed or moved invalidate the cached slices.
+            const osg::BoundingSphere& castingBound = _castingGroup->getBound();
+            if ( castingBound.center() != _castingBound.center() || castingBound.radius() != _castingBound.radius() )
+            {
+                _castingBound = castingBound;
+                _cachedSlicesDirty = true;
+            }
+
+            double cosLightThreshold = cos(osg::DegreesToRadians((double)_cachedLightThreshold));
+
+            std::vector<bool> renderSlice( _rttCameras.size(), true );
             
             int i;
             for(i=0; i < (int) _ranges.size()-1; ++i)
@@ -258,6 +302,33 @@ ShadowCaster::traverse(osg::NodeVisitor& nv)
                 for( std::vector<osg::Vec3d>::iterator v = verts.begin(); v != verts.end(); ++v )
                     bbox.expandBy( (*v) * lightViewMat );
 
+                // A cached slice that still covers this part of the view, with the
+                // light (nearly) where it was, keeps last render's shadow map.
+                if ( (unsigned)i >= _firstCachedSlice )
+                {
+                    CachedSlice& cached = _cachedSlices[i];
+
+                    bool valid =
+                        cached._valid &&
+                        !_cachedSlicesDirty &&
+                        lightVectorWorld * cached._lightDir >= cosLightThreshold;
+
+                    for( std::vector<osg::Vec3d>::iterator v = verts.begin(); valid && v != verts.end(); ++v )
+                        valid = cached._box.contains( (*v) * cached._view );
+
+                    if ( valid )
+                    {
+                        renderSlice[i] = false;
+                        _shadowMapTexGenUniform->setElement(i, inverseMV * cached._view * cached._proj * s_scaleBiasMat);
+                        continue;
+                    }
+
+                    // re-render over a padded area so it lasts a while.
+                    osg::Vec3d pad = (bbox._max - bbox._min) * CACHED_SLICE_MARGIN;
+                    bbox._min -= pad;
+                    bbox._max += pad;
+                }
+
                 osg::Matrix lightProjMat;
                 n = -std::max(bbox.zMin(), bbox.zMax());
                 f = -std::min(bbox.zMin(), bbox.zMax());
@@ -268,10 +339,15 @@ ShadowCaster::traverse(osg::NodeVisitor& nv)
                 _rttCameras[i]->setViewMatrix( lightViewMat );
                 _rttCameras[i]->setProjectionMatrix( lightProjMat );
 
-                // this xforms from clip [-1..1] to texture [0..1] space
-                static osg::Matrix s_scaleBiasMat = 
-                    osg::Matrix::translate(1.0,1.0,1.0) * 
-                    osg::Matrix::scale(0.5,0.5,0.5);
+                if ( (unsigned)i >= _firstCachedSlice )
+                {
+                    CachedSlice& cached = _cachedSlices[i];
+                    cached._valid    = true;
+                    cached._view     = lightViewMat;
+                    cached._proj     = lightProjMat;
+                    cached._box      = bbox;
+                    cached._lightDir = lightVectorWorld;
+                }
                 
                 // set the texture coordinate generation matrix that the shadow
                 // receiver will use to sample the shadow map. Doing this on the CPU
@@ -280,15 +356,19 @@ ShadowCaster::traverse(osg::NodeVisitor& nv)
                 _shadowMapTexGenUniform->setElement(i, inverseMV * VPS);
             }
 
-            // install the shadow-casting traversal mask:
+            _cachedSlicesDirty = false;
+
             unsigned saveMask = cv->getTraversalMask();
-            cv->setTraversalMask( _traversalMask & saveMask );
 
-            // render the shadow maps.
+            // render the shadow maps, each with its shadow-casting traversal mask.
             cv->pushStateSet( _rttStateSet.get() );
             for(i=0; i < (int) _rttCameras.size(); ++i)
             {
-                _rttCameras[i]->accept( nv );
+                if ( renderSlice[i] )
+                {
+                    cv->setTraversalMask( _traversalMask & getSliceTraversalMask(i) & saveMask );
+                    _rttCameras[i]->accept( nv );
+                }
             }
             cv->popStateSet();
 
@@ -23,6 +23,8 @@
 #include <osgEarthUtil/Shaders>
 #include <osgEarth/VirtualProgram>
 #include <osgEarth/ImageLayer>
+#include <osgEarth/ImageUtils>
+#include <osgEarth/TerrainTileModel>
 #include <osg/CullFace>
 
 
@@ -121,6 +123,7 @@ SimpleOceanLayer::setMaskLayer(const ImageLayer* maskLayer)
         osg::StateSet* ss = getOrCreateStateSet();
         ss->setDefine("OE_OCEAN_MASK", maskLayer->shareTexUniformName().get());
         ss->setDefine("OE_OCEAN_MASK_MATRIX", maskLayer->shareTexMatUniformName().get());
+        _maskLayer = maskLayer;
 
         OE_INFO << LC << "Installed \"" << maskLayer->getName() << "\" as mask layer\n";
     }
@@ -130,6 +133,7 @@ SimpleOceanLayer::setMaskLayer(const ImageLayer* maskLayer)
         osg::StateSet* ss = getOrCreateStateSet();
         ss->removeDefine("OE_OCEAN_MASK");
         ss->removeDefine("OE_OCEAN_MASK_MATRIX");
+        _maskLayer = 0L;
 
         OE_INFO << LC << "Uninstalled mask layer\n";
     }
@@ -190,6 +194,49 @@ SimpleOceanLayer::modifyTileBoundingBox(const TileKey& key, osg::BoundingBox& bo
     box.zMax() = std::max(box.zMax(), (osg::BoundingBox::value_type)0.0);
 }
 
+void
+SimpleOceanLayer::classifyTile(const TerrainTileModel* model, optional<bool>& out_visible) const
+{
+    // The ocean draws flat at sea level, so the terrain hides all of it on a
+    // tile that is above sea level everywhere.
+    const TerrainTileElevationModel* elevation = model->elevationModel().get();
+    if (elevation && elevation->getHeightField())
+    {
+        if (elevation->getMinHeight() > 0.0f)
+        {
+            out_visible = false;
+            return;
+        }
+        out_visible = true;
+    }
+
+    // The mask's alpha scales the ocean's, so it draws nothing where the mask
+    // has no water at all.
+    osg::ref_ptr<const ImageLayer> maskLayer;
+    if (_maskLayer.lock(maskLayer))
+    {
+        for (TerrainTileImageLayerModelVector::const_iterator i = model->sharedLayers().begin(); i != model->sharedLayers().end(); ++i)
+        {
+            const TerrainTileImageLayerModel* layerModel = i->get();
+            if (layerModel->getImageLayer() != maskLayer.get() || !layerModel->getTexture())
+                continue;
+
+            const osg::Image* image = layerModel->getTexture()->getImage(0);
+            if (!image || !ImageUtils::PixelReader::supports(image))
+                break;
+
+            ImageUtils::PixelReader read(image);
+            bool water = false;
+            for (int t = 0; t < image->t() && !water; ++t)
+                for (int s = 0; s < image->s() && !water; ++s)
+                    water = read(s, t).a() > 0.0f;
+
+            out_visible = water && out_visible.getOrUse(true);
+            break;
+        }
+    }
+}
+
 Config
 SimpleOceanLayer::getConfig() const
 {
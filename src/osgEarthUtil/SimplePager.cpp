@@ -1,6 +1,7 @@
 #include <osgEarthUtil/SimplePager> 
 #include <osgEarth/TileKey>
 #include <osgEarth/Utils>
+#include <osgEarth/NodeUtils>
 #include <osgDB/Registry>
 #include <osgDB/FileNameUtils>
 #include <osg/ShapeDrawable>
@@ -147,6 +148,16 @@ _canCancel(true)
     // install the master framestamp tracker:
     _progressMaster = new ProgressMaster();
     addCullCallback( _progressMaster.get() );
+
+    // load tiles on the job scheduler alongside the terrain; merging
+    // needs an update traversal.
+    _loader = new PagingLoader();
+    ADJUST_UPDATE_TRAV_COUNT(this, +1);
+}
+
+void SimplePager::traverse(osg::NodeVisitor& nv)
+{
+    _loader->traverse(this, nv);
 }
 
 void SimplePager::setEnableCancelation(bool value)
@@ -240,7 +251,9 @@ osg::Node* SimplePager::createPagedNode(const TileKey& key, ProgressCallback* pr
 
         if ( node.valid() )
         {
-            tileBounds = node->getBound();
+            // an empty tile keeps the key's bounds so its children still page in.
+            if ( node->getBound().valid() )
+                tileBounds = node->getBound();
         }
         else
         {
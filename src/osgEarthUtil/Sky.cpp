@@ -84,6 +84,10 @@ SkyNode::getEphemeris() const
 void
 SkyNode::setDateTime(const DateTime& dt)
 {
+    // A time control may set the same time every frame while paused.
+    if ( dt.asTimeStamp() == _dateTime.asTimeStamp() )
+        return;
+
     _dateTime = dt;
     //OE_INFO << LC << "Time = " << dt.asRFC1123() << std::endl;
     onSetDateTime();
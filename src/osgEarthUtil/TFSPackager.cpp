@@ -22,6 +22,8 @@
 #include <osgEarthUtil/TFSPackager>
 
 #include <osgEarth/FileUtils>
+#include <osgEarth/JobScheduler>
+#include <osgEarth/Registry>
 
 #include <osgEarthFeatures/FeatureCursor>
 
@@ -29,6 +31,10 @@
 
 #define LC "[TFSPackager] "
 
+// Maximum number of tile write jobs in flight at once. Each one holds
+// its tile's features in memory until it's written.
+#define MAX_PENDING_WRITES 64
+
 using namespace osgEarth;
 using namespace osgEarth::Features;
 using namespace osgEarth::Symbology;
@@ -49,7 +55,7 @@ public:
       {        
       }
 
-      const GeoExtent& getExtent() const
+      GeoExtent getExtent() const
       {
           return _key.getExtent();
       }
@@ -160,20 +166,9 @@ public:
               {
                   if (_levelAdded < 0 || _levelAdded == tile->getKey().getLevelOfDetail())
                   {
-                      osg::ref_ptr< Feature > clone = new Feature( *_feature, osg::CopyOp::DEEP_COPY_ALL );
-                      FeatureList features;
-                      features.push_back( clone );
-
-                      CropFilter cropFilter(_cropMethod);
-                      FilterContext context(0);
-                      context.extent() = tile->getExtent();
-                      cropFilter.push( features, context );
-
-
-                      if (!features.empty() && clone->getGeometry() && clone->getGeometry()->isValid())
+                      if (cropsToTile(tile))
                       {
-                          //tile->getFeatures().push_back( clone );
-                          tile->getFeatures().push_back( clone->getFID() );
+                          tile->getFeatures().push_back( _feature->getFID() );
                           _added = true;
                           _levelAdded = tile->getKey().getLevelOfDetail();
                           _numAdded++;                   
@@ -195,6 +190,29 @@ public:
           }          
       }
 
+      // Whether any of the feature would remain after cropping it to the tile.
+      bool cropsToTile(FeatureTile* tile) const
+      {
+          // The centroid method never changes the geometry, so we
+          // can test it without making a copy.
+          if (_cropMethod == CropFilter::METHOD_CENTROID)
+          {
+              osg::Vec3d centroid = _feature->getGeometry()->getBounds().center();
+              return tile->getExtent().contains( centroid.x(), centroid.y() );
+          }
+
+          osg::ref_ptr< Feature > clone = new Feature( *_feature, osg::CopyOp::DEEP_COPY_ALL );
+          FeatureList features;
+          features.push_back( clone );
+
+          CropFilter cropFilter(_cropMethod);
+          FilterContext context(0);
+          context.extent() = tile->getExtent();
+          cropFilter.push( features, context );
+
+          return !features.empty() && clone->getGeometry() && clone->getGeometry()->isValid();
+      }
+
       int _levelAdded;
 
       bool _added;
@@ -212,75 +230,101 @@ public:
 
 
 /******************************************************************************************/
-class WriteFeaturesVisitor : public FeatureTileVisitor
+class CollectTilesVisitor : public FeatureTileVisitor
 {
 public:
-    WriteFeaturesVisitor(FeatureSource* features, const std::string& dest, CropFilter::Method cropMethod, const SpatialReference* srs):
-      _dest( dest ),
+    virtual void traverse( FeatureTile* tile)
+    {
+        if (tile->getFeatures().size() > 0)
+        {
+            _tiles.push_back( tile );
+        }
+        tile->traverse( this );
+    }
+
+    std::vector< osg::ref_ptr< FeatureTile > > _tiles;
+};
+
+/**
+ * Loads the features of one tile, crops them, and streams them
+ * out as a GeoJSON feature collection.
+ */
+class WriteTileTask : public TaskRequest
+{
+public:
+    WriteTileTask(FeatureTile* tile, FeatureSource* features, const std::string& dest, CropFilter::Method cropMethod, const SpatialReference* srs):
+      _tile( tile ),
           _features( features ),
+          _dest( dest ),
           _cropMethod( cropMethod ),
           _srs( srs )
       {
-
       }
 
-      virtual void traverse( FeatureTile* tile)
+      void operator()(ProgressCallback* progress)
       {
-          if (tile->getFeatures().size() > 0)
-          {                 
-              //Actually load up the features
-              FeatureList features;
-              for (FeatureIDList::const_iterator i = tile->getFeatures().begin(); i != tile->getFeatures().end(); i++)
-              {
-                  Feature* f = _features->getFeature( *i );                  
+          if (progress && progress->isCanceled())
+              return;
 
-                  if (f)
-                  {
-                      //Reproject the feature to the dest SRS if it's not already
-                      if (!f->getSRS()->isEquivalentTo( _srs.get() ) )
-                      {
-                          f->transform( _srs.get() );
-                      }
-                      features.push_back( f );
-                  }
-                  else
+          //Actually load up the features
+          FeatureList features;
+          for (FeatureIDList::const_iterator i = _tile->getFeatures().begin(); i != _tile->getFeatures().end(); i++)
+          {
+              Feature* f = _features->getFeature( *i );                  
+
+              if (f)
+              {
+                  //Reproject the feature to the dest SRS if it's not already
+                  if (!f->getSRS()->isEquivalentTo( _srs.get() ) )
                   {
-                      OE_NOTICE << "couldn't get feature " << *i << std::endl;
+                      f->transform( _srs.get() );
                   }
+                  features.push_back( f );
               }
-
-              //Need to do the cropping again since these are brand new features coming from the feature source.
-              CropFilter cropFilter(_cropMethod);
-              FilterContext context(0);
-              context.extent() = tile->getExtent();
-              cropFilter.push( features, context );
-
-              std::string contents = Feature::featuresToGeoJSON( features );
-              std::stringstream buf;
-              int x =  tile->getKey().getTileX();
-              unsigned int numRows, numCols;
-              tile->getKey().getProfile()->getNumTiles(tile->getKey().getLevelOfDetail(), numCols, numRows);
-              int y  = numRows - tile->getKey().getTileY() - 1;
-
-              buf << _dest << "/" << tile->getKey().getLevelOfDetail() << "/" << x << "/" << y << ".json";
-              std::string filename = buf.str();
-              //OE_NOTICE << "Writing " << features.size() << " features to " << filename << std::endl;
-
-              if ( !osgDB::fileExists( osgDB::getFilePath(filename) ) )
-                  osgEarth::makeDirectoryForFile( filename );
-
-
-              std::fstream output( filename.c_str(), std::ios_base::out );
-              if ( output.is_open() )
+              else
               {
-                  output << contents;
-                  output.flush();
-                  output.close();                
-              }            
+                  OE_NOTICE << "couldn't get feature " << *i << std::endl;
+              }
           }
-          tile->traverse( this );        
+
+          //Need to do the cropping again since these are brand new features coming from the feature source.
+          CropFilter cropFilter(_cropMethod);
+          FilterContext context(0);
+          context.extent() = _tile->getExtent();
+          cropFilter.push( features, context );
+
+          std::stringstream buf;
+          int x =  _tile->getKey().getTileX();
+          unsigned int numRows, numCols;
+          _tile->getKey().getProfile()->getNumTiles(_tile->getKey().getLevelOfDetail(), numCols, numRows);
+          int y  = numRows - _tile->getKey().getTileY() - 1;
+
+          buf << _dest << "/" << _tile->getKey().getLevelOfDetail() << "/" << x << "/" << y << ".json";
+          std::string filename = buf.str();
+          //OE_NOTICE << "Writing " << features.size() << " features to " << filename << std::endl;
+
+          if ( !osgDB::fileExists( osgDB::getFilePath(filename) ) )
+              osgEarth::makeDirectoryForFile( filename );
+
+          // Write one feature at a time instead of building the whole
+          // collection in memory first.
+          std::fstream output( filename.c_str(), std::ios_base::out );
+          if ( output.is_open() )
+          {
+              output << "{\"type\": \"FeatureCollection\", \"features\": [";
+              for (FeatureList::const_iterator i = features.begin(); i != features.end(); ++i)
+              {
+                  if (i != features.begin())
+                      output << ",";
+                  output << i->get()->getGeoJSON();
+              }
+              output << "]}";
+              output.flush();
+              output.close();                
+          }            
       }
 
+      osg::ref_ptr< FeatureTile > _tile;
       osg::ref_ptr< FeatureSource > _features;
       std::string _dest;      
       CropFilter::Method _cropMethod;
@@ -383,8 +427,20 @@ TFSPackager::package( FeatureSource* features, const std::string& destination, c
     }
 #endif
 
-    WriteFeaturesVisitor write(features, destination, _method, _srs.get());
-    root->accept( &write );
+    // Write the tiles in parallel. Each tile only needs its own features,
+    // which it reads back from the source, so the jobs are independent.
+    CollectTilesVisitor collect;
+    root->accept( &collect );
+
+    JobScheduler* scheduler = Registry::instance()->getJobScheduler();
+    osg::ref_ptr< JobGroup > group = new JobGroup();
+    for (unsigned int i = 0; i < collect._tiles.size(); ++i)
+    {
+        group->wait( MAX_PENDING_WRITES );
+        scheduler->submit( new WriteTileTask(collect._tiles[i].get(), features, destination, _method, _srs.get()), JobScheduler::LANE_NORMAL, group.get() );
+    }
+    group->wait();
+    OE_NOTICE << "Wrote " << collect._tiles.size() << " tiles" << std::endl;
 
     //Write out the meta doc
     TFSLayer layer;
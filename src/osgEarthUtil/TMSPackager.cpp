@@ -23,10 +23,36 @@
 #include <osgEarth/ImageLayer>
 #include <osgDB/FileUtils>
 #include <osgDB/WriteFile>
+#include <osgDB/Registry>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
 
+#ifdef WIN32
+#  include <windows.h>
+#else
+#  include <unistd.h>
+#endif
 
 #define LC "[TMSPackager] "
 
+// Only tiles at most this size are considered for deduplication. Tiles
+// that repeat (uniform color, fully transparent) compress very well, so
+// this keeps the table of written tiles small without missing them.
+#define MAX_DEDUPLICATE_BYTES 65536
+
+namespace
+{
+    bool createHardLink(const std::string& existing, const std::string& path)
+    {
+#ifdef WIN32
+        return ::CreateHardLinkA(path.c_str(), existing.c_str(), NULL) != 0;
+#else
+        return ::link(existing.c_str(), path.c_str()) == 0;
+#endif
+    }
+}
+
 using namespace osgEarth::Util;
 using namespace osgEarth;
 
@@ -117,9 +143,7 @@ bool WriteTMSTileHandler::handleTile(const TileKey& key, const TileVisitor& tv)
             }
             else
             {
-                // attempt to create the output folder:
-                osgEarth::makeDirectoryForFile( path );
-                return osgDB::writeImageFile(*final.get(), path, _packager->getOptions());
+                return writeImage(final.get(), path);
             }
         }
     }
@@ -140,9 +164,7 @@ bool WriteTMSTileHandler::handleTile(const TileKey& key, const TileVisitor& tv)
             }
             else
             {
-                // attempt to create the output folder:
-                osgEarth::makeDirectoryForFile( path );
-                return osgDB::writeImageFile(*image.get(), path, _packager->getOptions());
+                return writeImage(image.get(), path);
             }
         }
     }
@@ -156,6 +178,29 @@ bool WriteTMSTileHandler::handleTile(const TileKey& key, const TileVisitor& tv)
     return false;
 }
 
+bool WriteTMSTileHandler::writeImage( const osg::Image* image, const std::string& path )
+{
+    // attempt to create the output folder:
+    osgEarth::makeDirectoryForFile( path );
+
+    // Encode the image in memory so the packager can compare it to
+    // the tiles that are already written.
+    if (_packager->getDeduplicate())
+    {
+        osgDB::ReaderWriter* rw = osgDB::Registry::instance()->getReaderWriterForExtension(_packager->getExtension());
+        if (rw)
+        {
+            std::stringstream buf;
+            if (rw->writeImage(*image, buf, _packager->getOptions()).success())
+            {
+                return _packager->writeTileFile(path, buf.str());
+            }
+        }
+    }
+
+    return osgDB::writeImageFile(*image, path, _packager->getOptions());
+}
+
 bool WriteTMSTileHandler::hasData( const TileKey& key ) const
 {
     return _layer->mayHaveData(key);
@@ -235,6 +280,7 @@ _visitor(new TileVisitor()),
     _overwrite(false),
     _keepEmpties(false),
     _applyAlphaMask(false),
+    _deduplicate(false),
     _tileSource(0L)
 {
 }
@@ -329,6 +375,56 @@ void TMSPackager::setApplyAlphaMask(bool applyAlphaMask)
     _applyAlphaMask = applyAlphaMask;
 }
 
+bool TMSPackager::getDeduplicate() const
+{
+    return _deduplicate;
+}
+
+void TMSPackager::setDeduplicate(bool deduplicate)
+{
+    _deduplicate = deduplicate;
+}
+
+bool TMSPackager::writeTileFile( const std::string& path, const std::string& data )
+{
+    if (_deduplicate && data.size() <= MAX_DEDUPLICATE_BYTES)
+    {
+        unsigned hash = hashString(data);
+        std::string existing;
+        {
+            Threading::ScopedMutexLock lock(_writtenTilesMutex);
+            WrittenTiles::iterator i = _writtenTiles.find(hash);
+            if (i == _writtenTiles.end())
+            {
+                WrittenTile& tile = _writtenTiles[hash];
+                tile._path = path;
+                tile._data = data;
+            }
+            else if (i->second._data == data && i->second._path != path)
+            {
+                existing = i->second._path;
+            }
+        }
+
+        if (!existing.empty())
+        {
+            // replace any previous version of this tile with a link:
+            ::remove(path.c_str());
+            if (createHardLink(existing, path))
+            {
+                return true;
+            }
+        }
+    }
+
+    std::ofstream out(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!out.is_open())
+        return false;
+
+    out.write(data.data(), data.size());
+    return !out.fail();
+}
+
 TileVisitor* TMSPackager::getTileVisitor() const
 {
     return _visitor.get();
@@ -454,4 +550,4 @@ void TMSPackager::writeXML(TerrainLayer* layer, Map* map)
     std::string tileMapFilename = osgDB::concatPaths( osgDB::concatPaths(_destination, toLegalFileName( _layerName )), "tms.xml");
     OE_NOTICE << "Layer name " << _layerName << std::endl;
     TMS::TileMapReaderWriter::write( tileMap.get(), tileMapFilename );
-}
\ No newline at end of file
+}
\ No newline at end of file
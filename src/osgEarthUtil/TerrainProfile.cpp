@@ -22,10 +22,67 @@
 #include <osgEarthUtil/TerrainProfile>
 #include <osgEarth/MapNode>
 #include <osgEarth/TerrainEngineNode>
+#include <osgEarth/ElevationPool>
+#include <osgEarth/GeoMath>
+#include <osgEarth/Registry>
+
+#define LC "[TerrainProfileCalculator] "
 
 using namespace osgEarth;
 using namespace osgEarth::Util;
 
+// Number of consecutive samples that are resampled as a unit
+#define SAMPLES_PER_SEGMENT 16u
+
+struct TerrainProfileCalculator::PublishOperation : public osg::Operation
+{
+    PublishOperation(TerrainProfileCalculator* calc, unsigned generation, const std::vector<unsigned>& segments, Revision revision) :
+        osg::Operation("TerrainProfile", false),
+        _calc(calc), _generation(generation), _segments(segments), _revision(revision) { }
+
+    void operator()(osg::Object*)
+    {
+        osg::ref_ptr<TerrainProfileCalculator> calc;
+        if (_calc.lock(calc))
+            calc->publish(_generation, _segments, _heights, _revision);
+    }
+
+    osg::observer_ptr<TerrainProfileCalculator> _calc;
+    unsigned              _generation;
+    std::vector<unsigned> _segments;
+    std::vector<float>    _heights;
+    Revision              _revision;
+};
+
+struct TerrainProfileCalculator::SampleTask : public TaskRequest
+{
+    void operator()(ProgressCallback* progress)
+    {
+        osg::ref_ptr<ElevationPool> pool;
+        osg::ref_ptr<Terrain> terrain;
+        if (!_pool.lock(pool) || !_terrain.lock(terrain) || _x.empty())
+            return;
+
+        // One batched query for all the samples; the envelope keeps the
+        // tiles it has touched, so neighboring samples share them.
+        osg::ref_ptr<ElevationEnvelope> envelope = pool->createEnvelope(_srs.get(), _lod);
+        _publish->_heights.resize(_x.size());
+        envelope->getElevations(&_x[0], &_y[0], _x.size(), 1u, &_publish->_heights[0]);
+
+        if (progress && progress->isCanceled())
+            return;
+
+        terrain->queueUpdateOperation(_publish.get());
+    }
+
+    osg::observer_ptr<ElevationPool>      _pool;
+    osg::observer_ptr<Terrain>            _terrain;
+    osg::ref_ptr<const SpatialReference>  _srs;
+    unsigned                              _lod;
+    std::vector<double>                   _x, _y;
+    osg::ref_ptr<PublishOperation>        _publish;
+};
+
 /***************************************************/
 TerrainProfile::TerrainProfile():
 _spacing( 1.0 )
@@ -93,20 +150,29 @@ TerrainProfile::getElevationRanges(double &min, double &max ) const
 TerrainProfileCalculator::TerrainProfileCalculator(MapNode* mapNode, const GeoPoint& start, const GeoPoint& end):
 _mapNode( mapNode ),
 _start( start),
-_end( end )
+_end( end ),
+_numSamples( 256u ),
+_lod( 0u ),
+_generation( 0u )
 {        
     _mapNode->getTerrain()->addTerrainCallback( this );        
     recompute();
 }
 
 TerrainProfileCalculator::TerrainProfileCalculator(MapNode* mapNode):
-_mapNode( mapNode )
+_mapNode( mapNode ),
+_numSamples( 256u ),
+_lod( 0u ),
+_generation( 0u )
 {
     _mapNode->getTerrain()->addTerrainCallback( this );
 }
 
 TerrainProfileCalculator::~TerrainProfileCalculator()
 {
+    if (_jobs.valid())
+        _jobs->cancel();
+
     _mapNode->getTerrain()->removeTerrainCallback( this );
 }
 
@@ -184,36 +250,164 @@ void TerrainProfileCalculator::setStartEnd(const GeoPoint& start, const GeoPoint
     }
 }
 
-void TerrainProfileCalculator::onTileAdded(const osgEarth::TileKey& tileKey, osg::Node* graph, TerrainCallbackContext&)
+void TerrainProfileCalculator::setNumSamples(unsigned value)
 {
-    if (_start.isValid() && _end.isValid())
+    value = osg::maximum(value, 2u);
+    if (_numSamples != value)
     {
-        GeoExtent extent( _start.getSRS());
-        extent.expandToInclude(_start.x(), _start.y());
-        extent.expandToInclude(_end.x(), _end.y());
+        _numSamples = value;
+        recompute();
+    }
+}
+
+void TerrainProfileCalculator::onTileAdded(const osgEarth::TileKey& tileKey, osg::Node* graph, TerrainCallbackContext&)
+{
+    if (_segments.empty() || !_mapNode.valid())
+        return;
+
+    // The samples come from the map's elevation data, not from the terrain
+    // tiles themselves, so a new tile only matters if the data under it
+    // changed since the segment was sampled.
+    Revision revision = _mapNode->getMap()->getDataModelRevision();
 
-        if (tileKey.getExtent().intersects( extent ))
+    std::vector<unsigned> dirty;
+    for (unsigned i = 0; i < _segments.size(); ++i)
+    {
+        const Segment& segment = _segments[i];
+        if (!segment._pending &&
+            segment._revision != revision &&
+            tileKey.getExtent().intersects(segment._extent))
         {
-            recompute();
+            dirty.push_back(i);
         }
     }
+
+    if (!dirty.empty())
+    {
+        resample(dirty);
+    }
 }
 
 void TerrainProfileCalculator::recompute()
 {
-    if (_start.isValid() && _end.isValid())
+    // Anything still in flight is for the old end points:
+    if (_jobs.valid())
+        _jobs->cancel();
+    _jobs = new JobGroup();
+    ++_generation;
+
+    _samples.clear();
+    _heights.clear();
+    _segments.clear();
+
+    GeoPoint end;
+    if (!_mapNode.valid() || !_start.isValid() || !_end.isValid() || !_end.transform(_start.getSRS(), end))
     {
-        computeTerrainProfile( _mapNode.get(), _start, _end, _profile);
+        _profile.clear();
+        return;
+    }
+
+    const SpatialReference* srs = _start.getSRS();
+
+    // Lay out the sample points and their distances along the profile:
+    _samples.resize(_numSamples);
+    double distance = 0.0;
+    for (unsigned i = 0; i < _numSamples; ++i)
+    {
+        double t = (double)i / (double)(_numSamples - 1);
+        osg::Vec3d p(
+            _start.x() + (end.x() - _start.x())*t,
+            _start.y() + (end.y() - _start.y())*t,
+            0.0);
 
-        for( ChangedCallbackList::iterator i = _changedCallbacks.begin(); i != _changedCallbacks.end(); i++ )
+        if (i > 0)
         {
-            if ( i->get() )
-                i->get()->onChanged(this);
+            const osg::Vec3d& prev = _samples[i-1];
+            distance += GeoMath::distance(osg::Vec3d(prev.x(), prev.y(), 0.0), p, srs);
         }
+        p.z() = distance;
+        _samples[i] = p;
     }
-    else
+    _heights.assign(_numSamples, NO_DATA_VALUE);
+
+    // Sample at the pool LOD whose resolution matches the sample spacing:
+    const Profile* mapProfile = _mapNode->getMap()->getProfile();
+    double spacing = distance / (double)(_numSamples - 1);
+    if (mapProfile->getSRS()->isGeographic())
+        spacing /= (mapProfile->getSRS()->getEllipsoid()->getRadiusEquator() * osg::PI / 180.0);
+    _lod = mapProfile->getLevelOfDetailForHorizResolution(spacing, _mapNode->getMap()->getElevationPool()->getTileSize());
+
+    Revision revision = _mapNode->getMap()->getDataModelRevision();
+
+    std::vector<unsigned> all;
+    for (unsigned first = 0; first < _numSamples; first += SAMPLES_PER_SEGMENT)
     {
-        _profile.clear();
+        Segment segment;
+        segment._first = first;
+        segment._count = osg::minimum(SAMPLES_PER_SEGMENT, _numSamples - first);
+        segment._extent = GeoExtent(srs);
+        for (unsigned i = first; i < first + segment._count; ++i)
+            segment._extent.expandToInclude(_samples[i].x(), _samples[i].y());
+        segment._revision = revision;
+        segment._pending = false;
+
+        all.push_back(_segments.size());
+        _segments.push_back(segment);
+    }
+
+    resample(all);
+}
+
+void TerrainProfileCalculator::resample(const std::vector<unsigned>& segments)
+{
+    SampleTask* task = new SampleTask();
+    task->_pool    = _mapNode->getMap()->getElevationPool();
+    task->_terrain = _mapNode->getTerrain();
+    task->_srs     = _start.getSRS();
+    task->_lod     = _lod;
+    task->_publish = new PublishOperation(this, _generation, segments, _mapNode->getMap()->getDataModelRevision());
+
+    for (std::vector<unsigned>::const_iterator s = segments.begin(); s != segments.end(); ++s)
+    {
+        Segment& segment = _segments[*s];
+        segment._pending = true;
+        for (unsigned i = segment._first; i < segment._first + segment._count; ++i)
+        {
+            task->_x.push_back(_samples[i].x());
+            task->_y.push_back(_samples[i].y());
+        }
+    }
+
+    Registry::instance()->getJobScheduler()->submit(task, JobScheduler::LANE_NORMAL, _jobs.get());
+}
+
+void TerrainProfileCalculator::publish(unsigned generation, const std::vector<unsigned>& segments, const std::vector<float>& heights, Revision revision)
+{
+    // results for end points that have since changed:
+    if (generation != _generation)
+        return;
+
+    unsigned k = 0;
+    for (std::vector<unsigned>::const_iterator s = segments.begin(); s != segments.end(); ++s)
+    {
+        Segment& segment = _segments[*s];
+        for (unsigned i = segment._first; i < segment._first + segment._count && k < heights.size(); ++i, ++k)
+            _heights[i] = heights[k];
+        segment._revision = revision;
+        segment._pending = false;
+    }
+
+    _profile.clear();
+    for (unsigned i = 0; i < _samples.size(); ++i)
+    {
+        if (_heights[i] != NO_DATA_VALUE)
+            _profile.addElevation(_samples[i].z(), _heights[i]);
+    }
+
+    for( ChangedCallbackList::iterator i = _changedCallbacks.begin(); i != _changedCallbacks.end(); i++ )
+    {
+        if ( i->get() )
+            i->get()->onChanged(this);
     }
 }
 
@@ -40,7 +40,17 @@ using namespace std;
 
 #define OGR_SCOPED_LOCK GDAL_SCOPED_LOCK
 
-TileIndex::TileIndex()
+namespace
+{
+    // Index entries carry their insertion order in the FID.
+    bool lessByOrder(const osg::ref_ptr<Feature>& lhs, const osg::ref_ptr<Feature>& rhs)
+    {
+        return lhs->getFID() < rhs->getFID();
+    }
+}
+
+TileIndex::TileIndex() :
+_spatialIndexBuiltSize( 0u )
 {
 }
 
@@ -79,6 +89,21 @@ TileIndex::load(const std::string& filename)
     TileIndex* index = new TileIndex();
     index->_features = features.get();
     index->_filename = filename;
+
+    // Read every footprint once; queries are answered from memory after this.
+    osg::ref_ptr< FeatureCursor > cursor = features->createFeatureCursor( Symbology::Query(), 0L );
+    while (cursor.valid() && cursor->hasMore())
+    {
+        osg::ref_ptr< Feature > feature = cursor->nextFeature();
+        if (feature.valid())
+        {
+            index->addToSpatialIndex( feature.get(), getFullPath(filename, feature->getString("location")) );
+        }
+    }
+    index->_spatialIndex.build( index->_indexed );
+    index->_spatialIndexBuiltSize = index->_indexed.size();
+
+    OE_INFO << "[TileIndex] Indexed " << index->_indexed.size() << " files from " << filename << std::endl;
     return index;
 }
 
@@ -113,25 +138,36 @@ TileIndex::create( const std::string& filename, const osgEarth::SpatialReference
 }
 
 
+void
+TileIndex::addToSpatialIndex(Feature* feature, const std::string& location)
+{
+    // The in-memory copy only needs its footprint and the resolved path.
+    osg::ref_ptr< Feature > entry = new Feature( feature->getGeometry(), feature->getSRS() );
+    entry->setFID( _indexed.size() );
+    entry->set( "location", location );
+    _indexed.push_back( entry.get() );
+}
+
 void
 TileIndex::getFiles(const osgEarth::GeoExtent& extent, std::vector< std::string >& files)
 {            
     files.clear();
-    osgEarth::Symbology::Query query;    
 
     GeoExtent transformed = extent.transform( _features->getFeatureProfile()->getSRS() );
-    query.bounds() = transformed.bounds();
-    osg::ref_ptr< osgEarth::Features::FeatureCursor> cursor = _features->createFeatureCursor( query, 0L );
 
-    while (cursor->hasMore())
+    FeatureList hits;
     {
-        osg::ref_ptr< osgEarth::Features::Feature> feature = cursor->nextFeature();
-        if (feature.valid())
-        {
-            std::string location = getFullPath(_filename, feature->getString("location"));
-            files.push_back( location );
-        }
-    }    
+        Threading::ScopedReadLock lock( _spatialIndexMutex );
+        _spatialIndex.query( transformed.bounds(), hits );
+    }
+
+    // Keep the order of the index so later files still draw over earlier ones.
+    hits.sort( lessByOrder );
+
+    for (FeatureList::const_iterator i = hits.begin(); i != hits.end(); ++i)
+    {
+        files.push_back( i->get()->getString("location") );
+    }
 }
 
 bool TileIndex::add( const std::string& filename, const GeoExtent& extent )
@@ -149,6 +185,23 @@ bool TileIndex::add( const std::string& filename, const GeoExtent& extent )
     const SpatialReference* wgs84 = SpatialReference::create("epsg:4326");
     feature->transform( wgs84 );
 
-    return _features->insertFeature( feature.get() );    
+    if (!_features->insertFeature( feature.get() ))
+        return false;
+
+    feature->transform( _features->getFeatureProfile()->getSRS() );
+
+    Threading::ScopedWriteLock lock( _spatialIndexMutex );
+    addToSpatialIndex( feature.get(), getFullPath(_filename, filename) );
+
+    // Re-tune the grid once the index has doubled since it was last built.
+    if (_indexed.size() >= 2u * osg::maximum(_spatialIndexBuiltSize, 8u))
+    {
+        _spatialIndex.build( _indexed );
+        _spatialIndexBuiltSize = _indexed.size();
+    }
+    else
+    {
+        _spatialIndex.insert( _indexed.back().get() );
+    }
     return true;
 }
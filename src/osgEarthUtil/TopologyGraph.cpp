@@ -26,9 +26,26 @@ using namespace osgEarth::Util;
 #include <osg/Point>
 #include <osg/TriangleIndexFunctor>
 #include <osgDB/WriteFile>
+#include <cstring>
 
 #define LC "[TopologyGraph] "
 
+namespace
+{
+    // Hashes the XY position of a vertex. Two verts weld when their X and Y
+    // compare equal (see Vertex::operator<), so they always land in the
+    // same bucket.
+    inline unsigned hashXY(float x, float y)
+    {
+        // fold -0 into +0 since they compare equal:
+        x += 0.0f, y += 0.0f;
+        unsigned hx, hy;
+        ::memcpy(&hx, &x, sizeof(unsigned));
+        ::memcpy(&hy, &y, sizeof(unsigned));
+        return (hx * 73856093u) ^ (hy * 19349663u);
+    }
+}
+
 
 TopologyGraph::TopologyGraph() :
 _maxGraphID(0u)
@@ -206,7 +223,10 @@ TopologyGraph::dumpBoundary(const IndexVector& boundary, const std::string& file
     osgDB::writeNodeFile(*(g.get()), filename);
 }
 
-TopologyBuilder::TopologyBuilder()
+TopologyBuilder::TopologyBuilder() :
+_graph   ( 0L ),
+_drawable( 0L ),
+_verts   ( 0L )
 {
     //nop
 }
@@ -259,16 +279,36 @@ TopologyBuilder::add(unsigned v)
 {
     // first see if we already added the vert at this index.
     UniqueMap::iterator i = _uniqueMap.find(v);
-    if (i == _uniqueMap.end())
+    if (i != _uniqueMap.end())
+        return i->second;
+
+    // size the hash to the source array, so buckets stay short:
+    if (_weld.empty())
     {
-        TopologyGraph::Vertex vertex(_verts, v);
-        std::pair<TopologyGraph::Index, bool> f = _graph->_verts.insert(vertex);
-        return f.first;
+        unsigned size = 16u;
+        while (size < _verts->size())
+            size <<= 1;
+        _weld.resize(size);
     }
-    else
+
+    // next, look for a vert at the same position:
+    const osg::Vec3& p = (*_verts)[v];
+    TopologyGraph::IndexVector& bucket = _weld[hashXY(p.x(), p.y()) & (_weld.size()-1)];
+    for (TopologyGraph::IndexVector::const_iterator b = bucket.begin(); b != bucket.end(); ++b)
     {
-        return i->second;
+        if ((*b)->x() == p.x() && (*b)->y() == p.y())
+        {
+            _uniqueMap[v] = *b;
+            return *b;
+        }
     }
+
+    // new to this builder. The graph may still have it from another drawable.
+    TopologyGraph::Vertex vertex(_verts, v);
+    TopologyGraph::Index index = _graph->_verts.insert(vertex).first;
+    bucket.push_back(index);
+    _uniqueMap[v] = index;
+    return index;
 }
 
 void
@@ -278,20 +318,32 @@ TopologyBuilder::assignAndPropagate(TopologyGraph::Index& vertex, unsigned graph
     if (vertex->_graphID == graphID)
         return;
 
-    // assign
+    // assign, and propagate along all edges. Use an explicit stack since a
+    // large mesh will recurse deeper than the thread's stack allows.
     vertex->_graphID = graphID;
 
-    // propagate along all edges
-    TopologyGraph::EdgeMap::iterator edges = _graph->_edgeMap.find(vertex);
-    if (edges != _graph->_edgeMap.end())
+    TopologyGraph::IndexVector stack;
+    stack.push_back(vertex);
+
+    while (!stack.empty())
     {
-        TopologyGraph::IndexSet& endPoints = edges->second;
-        for (TopologyGraph::IndexSet::iterator endPoint = endPoints.begin();
-            endPoint != endPoints.end();
-            ++endPoint)
+        TopologyGraph::Index next = stack.back();
+        stack.pop_back();
+
+        TopologyGraph::EdgeMap::iterator edges = _graph->_edgeMap.find(next);
+        if (edges != _graph->_edgeMap.end())
         {
-            TopologyGraph::Index vertex = *endPoint;
-            assignAndPropagate(vertex, graphID);
+            TopologyGraph::IndexSet& endPoints = edges->second;
+            for (TopologyGraph::IndexSet::iterator endPoint = endPoints.begin();
+                endPoint != endPoints.end();
+                ++endPoint)
+            {
+                if ((*endPoint)->_graphID != graphID)
+                {
+                    (*endPoint)->_graphID = graphID;
+                    stack.push_back(*endPoint);
+                }
+            }
         }
     }
 }
@@ -156,9 +156,7 @@ UTMLabelingEngine::updateLabels(const osg::Vec3d& LL_world, osg::Vec3d& UL_world
             window.clampToBottom(p); // also xforms to geographic
             if (p.y() < 84.0 && p.y() > -80.0)
             {
-                data.xLabels[xi]->setPosition(p);
-                data.xLabels[xi]->setText(Stringify() << std::setprecision(8) << xx);
-                data.xLabels[xi]->setNodeMask(~0);
+                showLabel(data.xLabels[xi].get(), p, Stringify() << std::setprecision(8) << xx);
             }
         }
         
@@ -177,9 +175,7 @@ UTMLabelingEngine::updateLabels(const osg::Vec3d& LL_world, osg::Vec3d& UL_world
             window.clampToLeft(p); // also xforms to geographic
             if (p.y() < 84.0 && p.y() > -80.0)
             {
-                data.yLabels[yi]->setPosition(p);
-                data.yLabels[yi]->setText(Stringify() << std::setprecision(8) << yy);
-                data.yLabels[yi]->setNodeMask(~0);
+                showLabel(data.yLabels[yi].get(), p, Stringify() << std::setprecision(8) << yy);
             }
         }
     }
@@ -203,9 +199,7 @@ UTMLabelingEngine::updateLabels(const osg::Vec3d& LL_world, osg::Vec3d& UL_world
             window.clampToBottom(p); // also xforms to geographic
             if (p.y() < 84.0 && p.y() > -80.0)
             {
-                data.xLabels[xi]->setPosition(p);
-                data.xLabels[xi]->setText(Stringify() << std::setprecision(8) << xx);
-                data.xLabels[xi]->setNodeMask(~0);
+                showLabel(data.xLabels[xi].get(), p, Stringify() << std::setprecision(8) << xx);
             }
         }
     }
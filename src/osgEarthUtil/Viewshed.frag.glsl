@@ -0,0 +1,50 @@
+#version $GLSL_VERSION_STR
+$GLSL_DEFAULT_PRECISION_FLOAT
+
+#pragma vp_entryPoint oe_viewshed_fragment
+#pragma vp_location   fragment_lighting
+#pragma vp_order      1.2
+
+#pragma import_defines(OE_IS_DEPTH_CAMERA)
+
+uniform int       oe_viewshed_count;
+uniform mat4      oe_viewshed_worldToLocal[$OE_VIEWSHED_MAX_OBSERVERS];
+uniform float     oe_viewshed_radius[$OE_VIEWSHED_MAX_OBSERVERS];
+uniform vec4      oe_viewshed_goodColor[$OE_VIEWSHED_MAX_OBSERVERS];
+uniform vec4      oe_viewshed_badColor[$OE_VIEWSHED_MAX_OBSERVERS];
+uniform sampler2D oe_viewshed_map;
+
+in vec3 oe_viewshed_world;
+
+void oe_viewshed_fragment(inout vec4 color)
+{
+#ifndef OE_IS_DEPTH_CAMERA
+    for(int i=0; i<oe_viewshed_count; ++i)
+    {
+        float radius = oe_viewshed_radius[i];
+        vec3 local = (oe_viewshed_worldToLocal[i] * vec4(oe_viewshed_world, 1.0)).xyz;
+        float d = length(local);
+        if (radius <= 0.0 || d > radius || d < 0.001)
+            continue;
+
+        // dual-paraboloid lookup; each observer's slot in the atlas holds
+        // the +X hemisphere on the left and the -X hemisphere on the right.
+        vec3 p = local/d;
+        float h = p.x >= 0.0 ? 1.0 : -1.0;
+        vec2 uv = vec2(p.y*h, p.z)/(1.0 + p.x*h);
+
+        float col = mod(float(i), $OE_VIEWSHED_ATLAS_COLS.0);
+        float row = floor(float(i) / $OE_VIEWSHED_ATLAS_COLS.0);
+        vec2 tc = vec2(
+            (2.0*col + (h > 0.0 ? 0.0 : 1.0) + 0.5*uv.x + 0.5) / (2.0*$OE_VIEWSHED_ATLAS_COLS.0),
+            (row + 0.5*uv.y + 0.5) / $OE_VIEWSHED_ATLAS_ROWS.0);
+
+        // the nearest surface the observer sees in this direction:
+        float nearest = texture(oe_viewshed_map, tc).r * radius;
+        float bias = max(1.0, 0.01*d);
+
+        vec4 tint = d <= nearest + bias ? oe_viewshed_goodColor[i] : oe_viewshed_badColor[i];
+        color.rgb = mix(color.rgb, tint.rgb, 0.5*tint.a);
+    }
+#endif
+}
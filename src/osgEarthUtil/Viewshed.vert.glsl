@@ -0,0 +1,15 @@
+#version $GLSL_VERSION_STR
+
+#pragma vp_entryPoint oe_viewshed_vertex
+#pragma vp_location   vertex_view
+
+uniform mat4 osg_ViewMatrixInverse;
+
+out vec3 oe_viewshed_world;
+
+void oe_viewshed_vertex(inout vec4 vertex)
+{
+    // single precision is good to a meter or so at the earth's surface,
+    // which is plenty for coloring a viewshed.
+    oe_viewshed_world = (osg_ViewMatrixInverse * vertex).xyz;
+}
@@ -0,0 +1,22 @@
+#version $GLSL_VERSION_STR
+$GLSL_DEFAULT_PRECISION_FLOAT
+
+#pragma vp_entryPoint oe_viewshed_depth_fragment
+#pragma vp_location   fragment_coloring
+#pragma vp_order      0.0
+
+uniform float oe_viewshed_hemisphere;
+uniform float oe_viewshed_radius;
+
+in vec3 oe_viewshed_local;
+
+void oe_viewshed_depth_fragment(inout vec4 color)
+{
+    // the other hemisphere's geometry folds over the rim; drop it.
+    if (oe_viewshed_local.x * oe_viewshed_hemisphere < 0.0)
+        discard;
+
+    // exact distance, rather than the per-vertex depth interpolated
+    // across the curved projection:
+    gl_FragDepth = clamp(length(oe_viewshed_local)/oe_viewshed_radius, 0.0, 1.0);
+}
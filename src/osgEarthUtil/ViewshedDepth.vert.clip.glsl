@@ -0,0 +1,20 @@
+#version $GLSL_VERSION_STR
+
+#pragma vp_entryPoint oe_viewshed_depth_vertex_clip
+#pragma vp_location   vertex_clip
+
+uniform float oe_viewshed_hemisphere;
+uniform float oe_viewshed_radius;
+
+out vec3 oe_viewshed_local;
+
+void oe_viewshed_depth_vertex_clip(inout vec4 vertex)
+{
+    // paraboloid projection of the hemisphere facing oe_viewshed_hemisphere*X;
+    // the projection matrix is only there for culling.
+    float d = length(oe_viewshed_local);
+    vec3 p = oe_viewshed_local/max(d, 0.001);
+    float h = oe_viewshed_hemisphere;
+    vec2 uv = vec2(p.y*h, p.z)/max(1.0 + p.x*h, 0.001);
+    vertex = vec4(uv, 2.0*clamp(d/oe_viewshed_radius, 0.0, 1.0) - 1.0, 1.0);
+}
@@ -0,0 +1,13 @@
+#version $GLSL_VERSION_STR
+
+#pragma vp_entryPoint oe_viewshed_depth_vertex_view
+#pragma vp_location   vertex_view
+
+out vec3 oe_viewshed_local;
+
+void oe_viewshed_depth_vertex_view(inout vec4 vertex)
+{
+    // the viewshed camera's view matrix takes the vertex into the
+    // observer's local tangent frame.
+    oe_viewshed_local = vertex.xyz/vertex.w;
+}
@@ -0,0 +1,404 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2016 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+// Timings for the hot paths the rest of the library leans on. These are
+// hidden test cases, so they only run when asked for:
+//
+//   osgEarth_tests [benchmark]
+
+#include <osgEarth/catch.hpp>
+#include "Benchmark"
+
+#include <osgEarth/GeoData>
+#include <osgEarth/Registry>
+#include <osgEarth/TileKey>
+#include <osgEarth/ImageUtils>
+#include <osgEarth/HeightFieldUtils>
+#include <osgEarth/Cache>
+#include <osgEarth/CacheBin>
+#include <osgEarthSymbology/Expression>
+#include <osgEarthSymbology/Geometry>
+#include <osgEarthFeatures/GeometryUtils>
+#include <osgEarthFeatures/MVT>
+#include <osgDB/FileUtils>
+#include <sstream>
+#include <map>
+
+using namespace osgEarth;
+using namespace osgEarth::Symbology;
+using namespace osgEarth::Features;
+
+namespace
+{
+    // Just enough protobuf encoding to build a vector tile to decode.
+    void writeVarint(std::string& out, unsigned long long value)
+    {
+        while (value >= 0x80)
+        {
+            out.push_back((char)((value & 0x7F) | 0x80));
+            value >>= 7;
+        }
+        out.push_back((char)value);
+    }
+
+    void writeTag(std::string& out, unsigned field, unsigned wireType)
+    {
+        writeVarint(out, (field << 3) | wireType);
+    }
+
+    void writeBytes(std::string& out, unsigned field, const std::string& bytes)
+    {
+        writeTag(out, field, 2);
+        writeVarint(out, bytes.size());
+        out += bytes;
+    }
+
+    unsigned zigzag(int value)
+    {
+        return (unsigned)((value << 1) ^ (value >> 31));
+    }
+
+    // One layer of square polygons on a grid, like a block of buildings.
+    std::string createVectorTile(unsigned gridSize)
+    {
+        std::string layer;
+        writeTag(layer, 15, 0); writeVarint(layer, 2);  // version
+        writeBytes(layer, 1, "buildings");              // name
+        writeBytes(layer, 3, "height");                 // keys
+        std::string value;
+        writeTag(value, 3, 1);                          // double_value
+        double height = 10.0;
+        value.append((const char*)&height, sizeof(height));
+        writeBytes(layer, 4, value);                    // values
+
+        int cell = 4096 / gridSize;
+        int size = cell / 2;
+        int cursorX = 0, cursorY = 0;
+        for (unsigned y = 0; y < gridSize; ++y)
+        {
+            for (unsigned x = 0; x < gridSize; ++x)
+            {
+                int x0 = x*cell, y0 = y*cell;
+
+                std::string geom;
+                writeVarint(geom, (1 << 3) | 1);        // MoveTo x1
+                writeVarint(geom, zigzag(x0 - cursorX));
+                writeVarint(geom, zigzag(y0 - cursorY));
+                writeVarint(geom, (3 << 3) | 2);        // LineTo x3
+                writeVarint(geom, zigzag(size)); writeVarint(geom, zigzag(0));
+                writeVarint(geom, zigzag(0));    writeVarint(geom, zigzag(size));
+                writeVarint(geom, zigzag(-size)); writeVarint(geom, zigzag(0));
+                writeVarint(geom, (1 << 3) | 7);        // ClosePath
+                cursorX = x0;
+                cursorY = y0 + size;
+
+                std::string tags;
+                writeVarint(tags, 0); writeVarint(tags, 0);
+
+                std::string feature;
+                writeTag(feature, 1, 0); writeVarint(feature, y*gridSize + x + 1); // id
+                writeBytes(feature, 2, tags);
+                writeTag(feature, 3, 0); writeVarint(feature, 3);                   // POLYGON
+                writeBytes(feature, 4, geom);
+
+                writeBytes(layer, 2, feature);
+            }
+        }
+        writeTag(layer, 5, 0); writeVarint(layer, 4096); // extent
+
+        std::string tile;
+        writeBytes(tile, 3, layer);
+        return tile;
+    }
+
+    osg::Image* createTestImage(unsigned size)
+    {
+        osg::Image* image = new osg::Image();
+        image->allocateImage(size, size, 1, GL_RGBA, GL_UNSIGNED_BYTE);
+        unsigned char* data = image->data();
+        for (unsigned i = 0; i < size*size*4; ++i)
+            data[i] = (unsigned char)(i * 7);
+        return image;
+    }
+
+    void benchmarkCacheBin(CacheBin* bin, const std::string& driver)
+    {
+        osg::ref_ptr<osg::Image> image = createTestImage(256);
+        unsigned i = 0;
+
+        OE_BENCHMARK("CacheBin::write(image) [" + driver + "]")
+        {
+            bin->write(Stringify() << "key_" << (i++ % 256), image.get(), 0L);
+        }
+
+        i = 0;
+        OE_BENCHMARK("CacheBin::readImage [" + driver + "]")
+        {
+            ReadResult r = bin->readImage(Stringify() << "key_" << (i++ % 256), 0L);
+            OE_BENCHMARK_USE(r);
+        }
+    }
+}
+
+TEST_CASE("Benchmark SpatialReference::transform", "[.benchmark]")
+{
+    const SpatialReference* wgs84 = SpatialReference::get("wgs84");
+    const SpatialReference* mercator = SpatialReference::get("spherical-mercator");
+    const SpatialReference* utm = SpatialReference::get("+proj=utm +zone=19 +datum=WGS84");
+    const SpatialReference* ecef = wgs84->getGeocentricSRS();
+    REQUIRE(wgs84 != 0L);
+    REQUIRE(mercator != 0L);
+    REQUIRE(utm != 0L);
+
+    osg::Vec3d in(-71.06, 42.36, 0.0), out;
+
+    OE_BENCHMARK("transform wgs84 -> spherical-mercator")
+    {
+        wgs84->transform(in, mercator, out);
+    }
+
+    OE_BENCHMARK("transform wgs84 -> utm")
+    {
+        wgs84->transform(in, utm, out);
+    }
+
+    OE_BENCHMARK("transform wgs84 -> geocentric")
+    {
+        wgs84->transform(in, ecef, out);
+    }
+
+    std::vector<osg::Vec3d> points(1024, in);
+    OE_BENCHMARK("transform wgs84 -> utm (1024 points)")
+    {
+        std::vector<osg::Vec3d> copy(points);
+        wgs84->transform(copy, utm);
+    }
+}
+
+TEST_CASE("Benchmark GeoExtent", "[.benchmark]")
+{
+    const SpatialReference* wgs84 = SpatialReference::get("wgs84");
+    GeoExtent a(wgs84, -10, -10, 10, 10);
+    GeoExtent b(wgs84, 5, 5, 20, 20);
+    GeoExtent c(wgs84, 170, -10, 190, 10);
+
+    OE_BENCHMARK("GeoExtent::intersects")
+    {
+        OE_BENCHMARK_USE(a.intersects(b));
+    }
+
+    OE_BENCHMARK("GeoExtent::intersects (antimeridian)")
+    {
+        OE_BENCHMARK_USE(a.intersects(c));
+    }
+
+    OE_BENCHMARK("GeoExtent::intersectionSameSRS")
+    {
+        OE_BENCHMARK_USE(a.intersectionSameSRS(b));
+    }
+}
+
+TEST_CASE("Benchmark TileKey", "[.benchmark]")
+{
+    const Profile* profile = Registry::instance()->getGlobalGeodeticProfile();
+    TileKey key(10, 512, 256, profile);
+
+    unsigned i = 0;
+    OE_BENCHMARK("TileKey construction")
+    {
+        TileKey k(12, i & 4095, (i >> 12) & 2047, profile);
+        OE_BENCHMARK_USE(k);
+        ++i;
+    }
+
+    OE_BENCHMARK("TileKey::createChildKey")
+    {
+        OE_BENCHMARK_USE(key.createChildKey(i++ & 3));
+    }
+
+    OE_BENCHMARK("TileKey::getExtent")
+    {
+        OE_BENCHMARK_USE(key.getExtent());
+    }
+
+    OE_BENCHMARK("TileKey copy")
+    {
+        TileKey k(key);
+        OE_BENCHMARK_USE(k);
+    }
+
+    std::map<TileKey::ID, unsigned> ids;
+    for (unsigned j = 0; j < 4096u; ++j)
+        ids[TileKey(12, j & 63, j >> 6, profile).getID()] = j;
+
+    OE_BENCHMARK("TileKey::ID map lookup")
+    {
+        OE_BENCHMARK_USE(ids.find(TileKey(12, i & 63, (i >> 6) & 63, profile).getID()));
+        ++i;
+    }
+}
+
+TEST_CASE("Benchmark ImageUtils", "[.benchmark]")
+{
+    osg::ref_ptr<osg::Image> image = createTestImage(256);
+    osg::ref_ptr<osg::Image> other = createTestImage(256);
+
+    OE_BENCHMARK("ImageUtils::resizeImage 256 -> 128")
+    {
+        osg::ref_ptr<osg::Image> output;
+        ImageUtils::resizeImage(image.get(), 128, 128, output);
+    }
+
+    OE_BENCHMARK("ImageUtils::convert RGBA -> RGB")
+    {
+        osg::ref_ptr<osg::Image> output = ImageUtils::convert(image.get(), GL_RGB, GL_UNSIGNED_BYTE);
+    }
+
+    OE_BENCHMARK("ImageUtils::mix")
+    {
+        ImageUtils::mix(other.get(), image.get(), 0.5f);
+    }
+}
+
+TEST_CASE("Benchmark HeightFieldUtils", "[.benchmark]")
+{
+    osg::ref_ptr<osg::HeightField> hf = new osg::HeightField();
+    hf->allocate(257, 257);
+    for (unsigned i = 0; i < hf->getHeightList().size(); ++i)
+        hf->getHeightList()[i] = (float)(i % 1000);
+
+    double x = 0.0;
+    OE_BENCHMARK("HeightFieldUtils::getHeightAtLocation (bilinear)")
+    {
+        OE_BENCHMARK_USE(HeightFieldUtils::getHeightAtLocation(hf.get(), x, 0.37, 0.0, 0.0, 1.0/256.0, 1.0/256.0, INTERP_BILINEAR));
+        x += 0.0001; if (x > 1.0) x = 0.0;
+    }
+
+    OE_BENCHMARK("HeightFieldUtils::getHeightAtLocation (triangulate)")
+    {
+        OE_BENCHMARK_USE(HeightFieldUtils::getHeightAtLocation(hf.get(), x, 0.37, 0.0, 0.0, 1.0/256.0, 1.0/256.0, INTERP_TRIANGULATE));
+        x += 0.0001; if (x > 1.0) x = 0.0;
+    }
+}
+
+TEST_CASE("Benchmark NumericExpression", "[.benchmark]")
+{
+    NumericExpression expr("[height] * 3.5 + [floors] * 0.25");
+    const NumericExpression::Variables& vars = expr.variables();
+
+    double v = 0.0;
+    OE_BENCHMARK("NumericExpression::eval")
+    {
+        for (NumericExpression::Variables::const_iterator i = vars.begin(); i != vars.end(); ++i)
+            expr.set(*i, v);
+        OE_BENCHMARK_USE(expr.eval());
+        v += 1.0;
+    }
+}
+
+TEST_CASE("Benchmark Geometry operations", "[.benchmark]")
+{
+    if (!Geometry::hasBufferOperation())
+    {
+        WARN("osgEarth was built without GEOS; skipping buffer/crop benchmarks");
+        return;
+    }
+
+    osg::ref_ptr<Geometry> polygon = GeometryUtils::geometryFromWKT(
+        "POLYGON((0 0, 10 0, 10 10, 7 10, 7 3, 3 3, 3 10, 0 10, 0 0))");
+    REQUIRE(polygon.valid());
+
+    osg::ref_ptr<Polygon> cropper = new Polygon();
+    cropper->push_back(osg::Vec3d(2, 2, 0));
+    cropper->push_back(osg::Vec3d(8, 2, 0));
+    cropper->push_back(osg::Vec3d(8, 8, 0));
+    cropper->push_back(osg::Vec3d(2, 8, 0));
+
+    OE_BENCHMARK("Geometry::buffer")
+    {
+        osg::ref_ptr<Geometry> output;
+        polygon->buffer(0.5, output);
+    }
+
+    OE_BENCHMARK("Geometry::crop(Polygon)")
+    {
+        osg::ref_ptr<Geometry> output;
+        polygon->crop(cropper.get(), output);
+    }
+
+    OE_BENCHMARK("Geometry::crop(Bounds)")
+    {
+        osg::ref_ptr<Geometry> output;
+        polygon->crop(Bounds(2, 2, 8, 8), output);
+    }
+}
+
+TEST_CASE("Benchmark MVT::read", "[.benchmark]")
+{
+    const Profile* profile = Registry::instance()->getSphericalMercatorProfile();
+    TileKey key(14, 4954, 6060, profile);
+    std::string tile = createVectorTile(32);
+
+    // make sure the tile decodes before timing it.
+    {
+        std::istringstream in(tile);
+        FeatureList features;
+        REQUIRE(MVT::read(in, key, features));
+        REQUIRE(features.size() == 32u*32u);
+    }
+
+    OE_BENCHMARK("MVT::read (1024 polygons)")
+    {
+        std::istringstream in(tile);
+        FeatureList features;
+        MVT::read(in, key, features);
+    }
+}
+
+TEST_CASE("Benchmark CacheBin", "[.benchmark]")
+{
+    const char* drivers[] = { "filesystem", "leveldb", "rocksdb", 0L };
+
+    for (unsigned d = 0; drivers[d] != 0L; ++d)
+    {
+        std::string path = Stringify() << "osgearth_benchmark_cache_" << drivers[d];
+        osgDB::makeDirectory(path);
+
+        Config conf;
+        conf.set("driver", drivers[d]);
+        conf.set("path", path);
+
+        osg::ref_ptr<Cache> cache = CacheFactory::create(CacheOptions(conf));
+        if (!cache.valid() || !cache->isOK())
+        {
+            WARN("Cache driver " << drivers[d] << " is not available");
+            continue;
+        }
+
+        osg::ref_ptr<CacheBin> bin = cache->addBin("benchmark");
+        REQUIRE(bin.valid());
+
+        benchmarkCacheBin(bin.get(), drivers[d]);
+
+        bin->clear();
+    }
+}
@@ -169,6 +169,13 @@ TEST_CASE( "GeoExtent" ) {
         REQUIRE(e1.intersects(e2)==false);
         REQUIRE(e1.intersectionSameSRS(e2).isInvalid());
     }
+
+    SECTION("Intersect bounds the same way as extents") {
+        GeoExtent e1(WGS84, 170, -10, -170, 10);
+        REQUIRE(e1.intersects(Bounds(-175, -60, -165, 60))==true);
+        REQUIRE(e1.intersects(Bounds(20, 20, 30, 30))==false);
+        REQUIRE(e1.intersects(Bounds(-170, -10, -160, 10))==false);
+    }
     
     SECTION("Scaling") {
         GeoExtent e1(WGS84, -10, -10, 10, 10);
@@ -22,6 +22,8 @@
 
 #include <osgEarth/catch.hpp>
 #include <osgEarth/ThreadingUtils>
+#include <osgEarth/JobScheduler>
+#include <OpenThreads/Atomic>
 
 using namespace osgEarth;
 
@@ -132,4 +134,47 @@ TEST_CASE( "ReadWriteMutex can handle multiple read locks from the same thread w
     REQUIRE(!thread2.isRunning());
     REQUIRE(elapsedTime < maxTimeSeconds);
 }
-*/
\ No newline at end of file
+*/
+
+namespace JobSchedulerTest
+{
+    struct CountingTask : public osgEarth::TaskRequest
+    {
+        CountingTask(OpenThreads::Atomic& count) : _count(count) { }
+        void operator()(osgEarth::ProgressCallback*) { ++_count; }
+        OpenThreads::Atomic& _count;
+    };
+}
+
+TEST_CASE( "JobScheduler runs every job in a group" ) {
+
+    osg::ref_ptr<osgEarth::JobScheduler> scheduler = new osgEarth::JobScheduler("test", 4);
+    osg::ref_ptr<osgEarth::JobGroup> group = new osgEarth::JobGroup();
+    OpenThreads::Atomic count(0u);
+
+    for (unsigned i = 0; i < 1000; ++i)
+    {
+        osgEarth::JobScheduler::Lane lane = (osgEarth::JobScheduler::Lane)(i % osgEarth::JobScheduler::NUM_LANES);
+        scheduler->submit(new JobSchedulerTest::CountingTask(count), lane, group.get());
+    }
+
+    REQUIRE(group->wait(0u, 10000u));
+    REQUIRE((unsigned)count == 1000u);
+    REQUIRE(group->getNumPending() == 0u);
+}
+
+TEST_CASE( "JobScheduler discards jobs in a canceled group" ) {
+
+    osg::ref_ptr<osgEarth::JobScheduler> scheduler = new osgEarth::JobScheduler("test", 1);
+    osg::ref_ptr<osgEarth::JobGroup> group = new osgEarth::JobGroup();
+    OpenThreads::Atomic count(0u);
+
+    group->cancel();
+    for (unsigned i = 0; i < 100; ++i)
+    {
+        scheduler->submit(new JobSchedulerTest::CountingTask(count), osgEarth::JobScheduler::LANE_NORMAL, group.get());
+    }
+
+    REQUIRE(group->wait(0u, 10000u));
+    REQUIRE((unsigned)count == 0u);
+}